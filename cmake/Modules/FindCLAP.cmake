@@ -0,0 +1,22 @@
+# - Try to find the CLAP headers
+# Once done this will define
+#  CLAP_FOUND - System has the CLAP headers
+#  CLAP_INCLUDE_DIRS - The CLAP include directory
+
+include(FindPkgConfig)
+
+find_package(PkgConfig)
+pkg_search_module(PC_CLAP QUIET clap)
+
+find_path(CLAP_INCLUDE_DIR clap/clap.h
+  HINTS ${PC_CLAP_INCLUDEDIR} ${PC_CLAP_INCLUDE_DIRS}
+)
+
+set(CLAP_INCLUDE_DIRS ${CLAP_INCLUDE_DIR})
+
+include(FindPackageHandleStandardArgs)
+# Handle the QUIETLY and REQUIRED arguments and set CLAP_FOUND to TRUE
+# if all listed variables are TRUE
+find_package_handle_standard_args(CLAP DEFAULT_MSG CLAP_INCLUDE_DIR)
+
+mark_as_advanced(CLAP_INCLUDE_DIR)
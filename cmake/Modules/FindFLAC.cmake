@@ -0,0 +1,33 @@
+# - Try to find libFLAC
+# Once done this will define
+#  FLAC_FOUND - System has libFLAC
+#  FLAC_INCLUDE_DIRS - The libFLAC include directory
+#  FLAC_LIBRARIES - Link these to use libFLAC
+
+if(DEFINED FLAC_INCLUDE_DIRS AND DEFINED FLAC_LIBRARIES)
+  set(FLAC_FOUND TRUE)
+  return()
+endif()
+
+include(FindPkgConfig)
+
+find_package(PkgConfig)
+pkg_search_module(PC_FLAC QUIET flac)
+
+find_path(FLAC_INCLUDE_DIR FLAC/stream_encoder.h
+  HINTS ${PC_FLAC_INCLUDEDIR} ${PC_FLAC_INCLUDE_DIRS}
+)
+
+find_library(FLAC_LIBRARY FLAC
+  HINTS ${PC_FLAC_LIBDIR} ${PC_FLAC_LIBRARY_DIRS}
+)
+
+set(FLAC_LIBRARIES ${FLAC_LIBRARY})
+set(FLAC_INCLUDE_DIRS ${FLAC_INCLUDE_DIR})
+
+include(FindPackageHandleStandardArgs)
+# Handle the QUIETLY and REQUIRED arguments and set FLAC_FOUND to TRUE
+# if all listed variables are TRUE
+find_package_handle_standard_args(FLAC DEFAULT_MSG FLAC_LIBRARY FLAC_INCLUDE_DIR)
+
+mark_as_advanced(FLAC_LIBRARY FLAC_INCLUDE_DIR)
@@ -20,7 +20,10 @@
 #include "internals.h"
 
 #include "Analog.h"
+#include "CPUFeatures.h"
+#include "SIMDDispatch.h"
 #include "Synth.h"
+#include "SynthState.h"
 
 namespace MT32Emu {
 
@@ -85,6 +88,8 @@ static const FloatSample ACCURATE_LPF_TAPS_CM32L[] = {
 	-0.000131231f, 3.88575E-07f, 4.48813E-05f, -1.31906E-06f, -1.03499E-05f, 7.71971E-06f, 2.86721E-06f
 };
 
+static const FloatSample NULL_LPF_TAPS[] = { 1.0f };
+
 // According to the CM-64 PCB schematic, there is a difference in the values of the LPF entrance resistors for the reverb and non-reverb channels.
 // This effectively results in non-unity LPF DC gain for the reverb channel of 0.68 while the LPF has unity DC gain for the LA32 output channels.
 // In emulation, the reverb output gain is multiplied by this factor to compensate for the LPF gain difference.
@@ -100,6 +105,11 @@ static const unsigned int ACCURATE_LPF_PHASE_INCREMENT_REGULAR = 2; // Downsampl
 static const unsigned int ACCURATE_LPF_PHASE_INCREMENT_OVERSAMPLED = 1; // No downsampling
 static const Bit32u ACCURATE_LPF_DELTAS_REGULAR[][ACCURATE_LPF_NUMBER_OF_PHASES] = { { 0, 0, 0 }, { 1, 1, 0 }, { 1, 2, 1 } };
 static const Bit32u ACCURATE_LPF_DELTAS_OVERSAMPLED[][ACCURATE_LPF_NUMBER_OF_PHASES] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 } };
+// Each phase of the accurate LPF spans one more sample than the delay line, the rows are padded to a multiple of the SIMD vector length.
+static const unsigned int ACCURATE_LPF_ROW_LENGTH = 20;
+
+// Maximum number of output samples the low-pass filters produce in one pass.
+static const unsigned int LPF_PROCESSING_BLOCK_SIZE = 256;
 
 template <class SampleEx>
 class AbstractLowPassFilter {
@@ -107,11 +117,10 @@ public:
 	static AbstractLowPassFilter<SampleEx> &createLowPassFilter(const AnalogOutputMode mode, const bool oldMT32AnalogLPF);
 
 	virtual ~AbstractLowPassFilter() {}
-	virtual SampleEx process(const SampleEx sample) = 0;
 
-	virtual bool hasNextSample() const {
-		return false;
-	}
+	// Produces outLength samples, at most LPF_PROCESSING_BLOCK_SIZE, consuming as many input samples
+	// as reported by estimateInSampleCount().
+	virtual void process(SampleEx *outSamples, const SampleEx *inSamples, const unsigned int outLength) = 0;
 
 	virtual unsigned int getOutputSampleRate() const {
 		return SAMPLE_RATE;
@@ -122,13 +131,22 @@ public:
 	}
 
 	virtual void addPositionIncrement(const unsigned int) {}
+
+	virtual size_t getAllocatedMemorySize() const = 0;
+
+	virtual void saveState(StateWriter &) const {}
+	virtual void restoreState(StateReader &) {}
 };
 
 template <class SampleEx>
 class NullLowPassFilter : public AbstractLowPassFilter<SampleEx> {
 public:
-	SampleEx process(const SampleEx sample) {
-		return sample;
+	void process(SampleEx *outSamples, const SampleEx *inSamples, const unsigned int outLength) {
+		memcpy(outSamples, inSamples, outLength * sizeof(SampleEx));
+	}
+
+	size_t getAllocatedMemorySize() const {
+		return sizeof(*this);
 	}
 };
 
@@ -150,7 +168,13 @@ public:
 		Synth::muteSampleBuffer(ringBuffer, COARSE_LPF_DELAY_LINE_LENGTH);
 	}
 
-	SampleEx process(const SampleEx inSample) {
+	void process(SampleEx *outSamples, const SampleEx *inSamples, const unsigned int outLength) {
+		for (unsigned int i = 0; i < outLength; i++) {
+			outSamples[i] = processSample(inSamples[i]);
+		}
+	}
+
+	SampleEx processSample(const SampleEx inSample) {
 		static const unsigned int DELAY_LINE_MASK = COARSE_LPF_DELAY_LINE_LENGTH - 1;
 
 		SampleEx sample = lpfTaps[COARSE_LPF_DELAY_LINE_LENGTH] * ringBuffer[ringBufferPosition];
@@ -164,27 +188,67 @@ public:
 
 		return normaliseSample(sample);
 	}
+
+	const SampleEx *getLPFTaps() const {
+		return lpfTaps;
+	}
+
+	// Exchange the delay line with Analog::processLockstep(). The samples are arranged starting from the current position,
+	// so that the filters at different positions can advance together.
+	void getDelayLine(SampleEx *delayLine) const {
+		for (unsigned int i = 0; i < COARSE_LPF_DELAY_LINE_LENGTH; i++) {
+			delayLine[i] = ringBuffer[(i + ringBufferPosition) & (COARSE_LPF_DELAY_LINE_LENGTH - 1)];
+		}
+	}
+
+	void setDelayLine(const SampleEx *delayLine, const unsigned int positionIncrement) {
+		for (unsigned int i = 0; i < COARSE_LPF_DELAY_LINE_LENGTH; i++) {
+			ringBuffer[(i + ringBufferPosition) & (COARSE_LPF_DELAY_LINE_LENGTH - 1)] = delayLine[i];
+		}
+		ringBufferPosition = (ringBufferPosition + positionIncrement) & (COARSE_LPF_DELAY_LINE_LENGTH - 1);
+	}
+
+	size_t getAllocatedMemorySize() const {
+		return sizeof(*this);
+	}
+
+	void saveState(StateWriter &writer) const {
+		writer.writeSamples(ringBuffer, COARSE_LPF_DELAY_LINE_LENGTH);
+		writer.writeUInt32(ringBufferPosition);
+	}
+
+	void restoreState(StateReader &reader) {
+		reader.readSamples(ringBuffer, COARSE_LPF_DELAY_LINE_LENGTH);
+		ringBufferPosition = reader.readIndex(COARSE_LPF_DELAY_LINE_LENGTH);
+	}
 };
 
+// The accurate LPF is implemented as a polyphase FIR. The taps of each phase are rearranged in a separate row, so that
+// every output sample is a dot product of the row with a contiguous span of the linearised delay line.
 class AccurateLowPassFilter : public AbstractLowPassFilter<IntSampleEx>, public AbstractLowPassFilter<FloatSample> {
 private:
-	const FloatSample * const LPF_TAPS;
 	const Bit32u (* const deltas)[ACCURATE_LPF_NUMBER_OF_PHASES];
 	const unsigned int phaseIncrement;
 	const unsigned int outputSampleRate;
 
-	FloatSample ringBuffer[ACCURATE_LPF_DELAY_LINE_LENGTH];
-	unsigned int ringBufferPosition;
+	FloatSample phaseTaps[ACCURATE_LPF_NUMBER_OF_PHASES][ACCURATE_LPF_ROW_LENGTH];
+	// The oldest samples come first. Only the last ACCURATE_LPF_ROW_LENGTH samples are retained between passes.
+	FloatSample delayLine[ACCURATE_LPF_ROW_LENGTH + LPF_PROCESSING_BLOCK_SIZE];
 	unsigned int phase;
 
+	template <class SampleEx>
+	void produceOutput(SampleEx *outSamples, const SampleEx *inSamples, const unsigned int outLength);
+
 public:
 	AccurateLowPassFilter(const bool oldMT32AnalogLPF, const bool oversample);
-	FloatSample process(const FloatSample sample);
-	IntSampleEx process(const IntSampleEx sample);
-	bool hasNextSample() const;
+	void process(FloatSample *outSamples, const FloatSample *inSamples, const unsigned int outLength);
+	void process(IntSampleEx *outSamples, const IntSampleEx *inSamples, const unsigned int outLength);
 	unsigned int getOutputSampleRate() const;
 	unsigned int estimateInSampleCount(const unsigned int outSamples) const;
 	void addPositionIncrement(const unsigned int positionIncrement);
+	size_t getAllocatedMemorySize() const;
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 };
 
 static inline IntSampleEx normaliseSample(const IntSampleEx sample) {
@@ -195,6 +259,32 @@ static inline FloatSample normaliseSample(const FloatSample sample) {
 	return sample;
 }
 
+// Mixes the DAC streams of both channels down to the LPF input in a single pass. The SIMD version processes as many
+// samples as fit in whole vectors and returns their count, the caller finishes the rest. The operations are performed
+// in the same order as in AnalogImpl::mixSample(), so the output doesn't depend on the instruction set used.
+template <class SampleEx, class Sample>
+static inline Bit32u mixChannelsSIMD(SampleEx *, SampleEx *, const Sample *, const Sample *, const Sample *, const Sample *, const Sample *, const Sample *, Bit32u, SampleEx, SampleEx) {
+	return 0;
+}
+
+#if MT32EMU_SIMD_SSE2
+static Bit32u mixChannelsSIMD(FloatSample *outLeft, FloatSample *outRight, const FloatSample *nonReverbLeft, const FloatSample *nonReverbRight, const FloatSample *reverbDryLeft, const FloatSample *reverbDryRight, const FloatSample *reverbWetLeft, const FloatSample *reverbWetRight, Bit32u length, FloatSample synthGain, FloatSample reverbGain) {
+	if (!SIMDDispatch::isBaselineSIMDEnabled()) return 0;
+	const Bit32u vectorLength = length & ~3U;
+	const __m128 synthGains = _mm_set1_ps(synthGain);
+	const __m128 reverbGains = _mm_set1_ps(reverbGain);
+	for (Bit32u i = 0; i < vectorLength; i += 4) {
+		const __m128 dryLeft = _mm_add_ps(_mm_loadu_ps(nonReverbLeft + i), _mm_loadu_ps(reverbDryLeft + i));
+		const __m128 dryRight = _mm_add_ps(_mm_loadu_ps(nonReverbRight + i), _mm_loadu_ps(reverbDryRight + i));
+		const __m128 wetLeft = _mm_mul_ps(_mm_loadu_ps(reverbWetLeft + i), reverbGains);
+		const __m128 wetRight = _mm_mul_ps(_mm_loadu_ps(reverbWetRight + i), reverbGains);
+		_mm_storeu_ps(outLeft + i, _mm_add_ps(_mm_mul_ps(dryLeft, synthGains), wetLeft));
+		_mm_storeu_ps(outRight + i, _mm_add_ps(_mm_mul_ps(dryRight, synthGains), wetRight));
+	}
+	return vectorLength;
+}
+#endif
+
 static inline float getActualReverbOutputGain(const float reverbGain, const bool mt32ReverbCompatibilityMode) {
 	return mt32ReverbCompatibilityMode ? reverbGain : reverbGain * CM32L_REVERB_TO_LA32_ANALOG_OUTPUT_GAIN_FACTOR;
 }
@@ -206,14 +296,18 @@ static inline IntSampleEx getIntOutputGain(const float outputGain) {
 template <class SampleEx>
 class AnalogImpl : public Analog {
 public:
+	const AnalogOutputMode mode;
+	const bool oldMT32AnalogLPF;
 	AbstractLowPassFilter<SampleEx> &leftChannelLPF;
 	AbstractLowPassFilter<SampleEx> &rightChannelLPF;
 	SampleEx synthGain;
 	SampleEx reverbGain;
 
-	AnalogImpl(const AnalogOutputMode mode, const bool oldMT32AnalogLPF) :
-		leftChannelLPF(AbstractLowPassFilter<SampleEx>::createLowPassFilter(mode, oldMT32AnalogLPF)),
-		rightChannelLPF(AbstractLowPassFilter<SampleEx>::createLowPassFilter(mode, oldMT32AnalogLPF)),
+	AnalogImpl(const AnalogOutputMode useMode, const bool useOldMT32AnalogLPF) :
+		mode(useMode),
+		oldMT32AnalogLPF(useOldMT32AnalogLPF),
+		leftChannelLPF(AbstractLowPassFilter<SampleEx>::createLowPassFilter(useMode, useOldMT32AnalogLPF)),
+		rightChannelLPF(AbstractLowPassFilter<SampleEx>::createLowPassFilter(useMode, useOldMT32AnalogLPF)),
 		synthGain(0),
 		reverbGain(0)
 	{}
@@ -223,6 +317,10 @@ public:
 		delete &rightChannelLPF;
 	}
 
+	AnalogOutputMode getMode() const {
+		return mode;
+	}
+
 	unsigned int getOutputSampleRate() const {
 		return leftChannelLPF.getOutputSampleRate();
 	}
@@ -231,37 +329,124 @@ public:
 		return leftChannelLPF.estimateInSampleCount(outputLength);
 	}
 
+	size_t getAllocatedMemorySize() const {
+		return sizeof(*this) + leftChannelLPF.getAllocatedMemorySize() + rightChannelLPF.getAllocatedMemorySize();
+	}
+
+	bool isLockstepCapable() const;
 	void setSynthOutputGain(const float synthGain);
 	void setReverbOutputGain(const float reverbGain, const bool mt32ReverbCompatibilityMode);
+	SampleEx getAccumulationGain(const float gain) const;
+
+	bool process(const StereoOutputDescriptor<IntSample> &output, const IntSample *nonReverbLeft, const IntSample *nonReverbRight, const IntSample *reverbDryLeft, const IntSample *reverbDryRight, const IntSample *reverbWetLeft, const IntSample *reverbWetRight, Bit32u outLength);
+	bool process(const StereoOutputDescriptor<FloatSample> &output, const FloatSample *nonReverbLeft, const FloatSample *nonReverbRight, const FloatSample *reverbDryLeft, const FloatSample *reverbDryRight, const FloatSample *reverbWetLeft, const FloatSample *reverbWetRight, Bit32u outLength);
+	bool mixDACStreams(IntSample *outStream, const IntSample *nonReverbLeft, const IntSample *nonReverbRight, const IntSample *reverbDryLeft, const IntSample *reverbDryRight, const IntSample *reverbWetLeft, const IntSample *reverbWetRight, Bit32u length);
+	bool mixDACStreams(FloatSample *outStream, const FloatSample *nonReverbLeft, const FloatSample *nonReverbRight, const FloatSample *reverbDryLeft, const FloatSample *reverbDryRight, const FloatSample *reverbWetLeft, const FloatSample *reverbWetRight, Bit32u length);
+
+	// The gains are saved as they are actually applied, since these also depend on the history of the settings.
+	void saveState(StateWriter &writer) const {
+		writer.writeSamples(&synthGain, 1);
+		writer.writeSamples(&reverbGain, 1);
+		leftChannelLPF.saveState(writer);
+		rightChannelLPF.saveState(writer);
+	}
+
+	void restoreState(StateReader &reader) {
+		reader.readSamples(&synthGain, 1);
+		reader.readSamples(&reverbGain, 1);
+		leftChannelLPF.restoreState(reader);
+		rightChannelLPF.restoreState(reader);
+	}
 
-	bool process(IntSample *outStream, const IntSample *nonReverbLeft, const IntSample *nonReverbRight, const IntSample *reverbDryLeft, const IntSample *reverbDryRight, const IntSample *reverbWetLeft, const IntSample *reverbWetRight, Bit32u outLength);
-	bool process(FloatSample *outStream, const FloatSample *nonReverbLeft, const FloatSample *nonReverbRight, const FloatSample *reverbDryLeft, const FloatSample *reverbDryRight, const FloatSample *reverbWetLeft, const FloatSample *reverbWetRight, Bit32u outLength);
+	unsigned int getLPFKernel(const FloatSample *&taps, unsigned int &upsampleFactor) const {
+		switch (mode) {
+		case AnalogOutputMode_COARSE:
+			taps = oldMT32AnalogLPF ? COARSE_LPF_FLOAT_TAPS_MT32 : COARSE_LPF_FLOAT_TAPS_CM32L;
+			break;
+		case AnalogOutputMode_ACCURATE:
+		case AnalogOutputMode_OVERSAMPLED:
+			taps = oldMT32AnalogLPF ? ACCURATE_LPF_TAPS_MT32 : ACCURATE_LPF_TAPS_CM32L;
+			break;
+		default:
+			taps = NULL_LPF_TAPS;
+			break;
+		}
+		return getLPFKernelLength(mode, upsampleFactor);
+	}
 
 	template <class Sample>
-	void produceOutput(Sample *outStream, const Sample *nonReverbLeft, const Sample *nonReverbRight, const Sample *reverbDryLeft, const Sample *reverbDryRight, const Sample *reverbWetLeft, const Sample *reverbWetRight, Bit32u outLength) {
-		if (outStream == NULL) {
+	inline SampleEx mixSample(const Sample nonReverb, const Sample reverbDry, const Sample reverbWet) const {
+		return normaliseSample((SampleEx(nonReverb) + SampleEx(reverbDry)) * synthGain + SampleEx(reverbWet) * reverbGain);
+	}
+
+	template <class Sample>
+	void mixStreams(Sample *outStream, const Sample *nonReverbLeft, const Sample *nonReverbRight, const Sample *reverbDryLeft, const Sample *reverbDryRight, const Sample *reverbWetLeft, const Sample *reverbWetRight, Bit32u length) {
+		for (Bit32u i = 0; i < length; i++) {
+			*(outStream++) = Synth::clipSampleEx(mixSample(nonReverbLeft[i], reverbDryLeft[i], reverbWetLeft[i]));
+			*(outStream++) = Synth::clipSampleEx(mixSample(nonReverbRight[i], reverbDryRight[i], reverbWetRight[i]));
+		}
+	}
+
+	template <class Sample>
+	void mixChannels(SampleEx *outLeft, SampleEx *outRight, const Sample *nonReverbLeft, const Sample *nonReverbRight, const Sample *reverbDryLeft, const Sample *reverbDryRight, const Sample *reverbWetLeft, const Sample *reverbWetRight, Bit32u length) const {
+		Bit32u i = mixChannelsSIMD(outLeft, outRight, nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, length, synthGain, reverbGain);
+		for (; i < length; i++) {
+			outLeft[i] = mixSample(nonReverbLeft[i], reverbDryLeft[i], reverbWetLeft[i]);
+			outRight[i] = mixSample(nonReverbRight[i], reverbDryRight[i], reverbWetRight[i]);
+		}
+	}
+
+	template <class Sample>
+	void produceOutput(const StereoOutputDescriptor<Sample> &output, const Sample *nonReverbLeft, const Sample *nonReverbRight, const Sample *reverbDryLeft, const Sample *reverbDryRight, const Sample *reverbWetLeft, const Sample *reverbWetRight, Bit32u outLength) {
+		if (output.left == NULL) {
 			leftChannelLPF.addPositionIncrement(outLength);
 			rightChannelLPF.addPositionIncrement(outLength);
 			return;
 		}
 
-		while (0 < (outLength--)) {
-			SampleEx outSampleL;
-			SampleEx outSampleR;
-
-			if (leftChannelLPF.hasNextSample()) {
-				outSampleL = leftChannelLPF.process(0);
-				outSampleR = rightChannelLPF.process(0);
+		SampleEx inSamplesL[LPF_PROCESSING_BLOCK_SIZE], inSamplesR[LPF_PROCESSING_BLOCK_SIZE];
+		SampleEx outSamplesL[LPF_PROCESSING_BLOCK_SIZE], outSamplesR[LPF_PROCESSING_BLOCK_SIZE];
+		Sample *outLeft = output.left;
+		Sample *outRight = output.right;
+		const Bit32u stride = output.stride;
+		const bool bypassLPF = mode == AnalogOutputMode_DIGITAL_ONLY;
+		while (outLength > 0) {
+			const Bit32u thisPassLength = outLength < LPF_PROCESSING_BLOCK_SIZE ? outLength : LPF_PROCESSING_BLOCK_SIZE;
+			const Bit32u inLength = leftChannelLPF.estimateInSampleCount(thisPassLength);
+
+			if (bypassLPF) {
+				// The NullLowPassFilter would merely copy the samples, so the streams are mixed straight into its output.
+				mixChannels(outSamplesL, outSamplesR, nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, inLength);
 			} else {
-				SampleEx inSampleL = (SampleEx(*(nonReverbLeft++)) + SampleEx(*(reverbDryLeft++))) * synthGain + SampleEx(*(reverbWetLeft++)) * reverbGain;
-				SampleEx inSampleR = (SampleEx(*(nonReverbRight++)) + SampleEx(*(reverbDryRight++))) * synthGain + SampleEx(*(reverbWetRight++)) * reverbGain;
+				mixChannels(inSamplesL, inSamplesR, nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, inLength);
+				leftChannelLPF.process(outSamplesL, inSamplesL, thisPassLength);
+				rightChannelLPF.process(outSamplesR, inSamplesR, thisPassLength);
+			}
 
-				outSampleL = leftChannelLPF.process(normaliseSample(inSampleL));
-				outSampleR = rightChannelLPF.process(normaliseSample(inSampleR));
+			if (output.accumulate) {
+				const SampleEx gain = getAccumulationGain(output.gain);
+				for (Bit32u i = 0; i < thisPassLength; i++) {
+					*outLeft = Synth::clipSampleEx(SampleEx(*outLeft) + normaliseSample(outSamplesL[i] * gain));
+					*outRight = Synth::clipSampleEx(SampleEx(*outRight) + normaliseSample(outSamplesR[i] * gain));
+					outLeft += stride;
+					outRight += stride;
+				}
+			} else {
+				for (Bit32u i = 0; i < thisPassLength; i++) {
+					*outLeft = Synth::clipSampleEx(outSamplesL[i]);
+					*outRight = Synth::clipSampleEx(outSamplesR[i]);
+					outLeft += stride;
+					outRight += stride;
+				}
 			}
 
-			*(outStream++) = Synth::clipSampleEx(outSampleL);
-			*(outStream++) = Synth::clipSampleEx(outSampleR);
+			nonReverbLeft += inLength;
+			nonReverbRight += inLength;
+			reverbDryLeft += inLength;
+			reverbDryRight += inLength;
+			reverbWetLeft += inLength;
+			reverbWetRight += inLength;
+			outLength -= thisPassLength;
 		}
 	}
 };
@@ -277,28 +462,75 @@ Analog *Analog::createAnalog(const AnalogOutputMode mode, const bool oldMT32Anal
 	return NULL;
 }
 
+unsigned int Analog::getLPFKernelLength(const AnalogOutputMode mode, unsigned int &upsampleFactor) {
+	switch (mode) {
+	case AnalogOutputMode_COARSE:
+		upsampleFactor = 1;
+		return COARSE_LPF_DELAY_LINE_LENGTH + 1;
+	case AnalogOutputMode_ACCURATE:
+	case AnalogOutputMode_OVERSAMPLED:
+		upsampleFactor = ACCURATE_LPF_NUMBER_OF_PHASES;
+		return ACCURATE_LPF_DELAY_LINE_LENGTH * ACCURATE_LPF_NUMBER_OF_PHASES + 1;
+	default:
+		upsampleFactor = 1;
+		return 1;
+	}
+}
+
+template<>
+bool AnalogImpl<IntSampleEx>::process(const StereoOutputDescriptor<IntSample> &output, const IntSample *nonReverbLeft, const IntSample *nonReverbRight, const IntSample *reverbDryLeft, const IntSample *reverbDryRight, const IntSample *reverbWetLeft, const IntSample *reverbWetRight, Bit32u outLength) {
+	produceOutput(output, nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, outLength);
+	return true;
+}
+
+template<>
+bool AnalogImpl<FloatSample>::process(const StereoOutputDescriptor<IntSample> &, const IntSample *, const IntSample *, const IntSample *, const IntSample *, const IntSample *, const IntSample *, Bit32u) {
+	return false;
+}
+
+template<>
+bool AnalogImpl<IntSampleEx>::process(const StereoOutputDescriptor<FloatSample> &, const FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, Bit32u) {
+	return false;
+}
+
+template<>
+bool AnalogImpl<FloatSample>::process(const StereoOutputDescriptor<FloatSample> &output, const FloatSample *nonReverbLeft, const FloatSample *nonReverbRight, const FloatSample *reverbDryLeft, const FloatSample *reverbDryRight, const FloatSample *reverbWetLeft, const FloatSample *reverbWetRight, Bit32u outLength) {
+	produceOutput(output, nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, outLength);
+	return true;
+}
+
 template<>
-bool AnalogImpl<IntSampleEx>::process(IntSample *outStream, const IntSample *nonReverbLeft, const IntSample *nonReverbRight, const IntSample *reverbDryLeft, const IntSample *reverbDryRight, const IntSample *reverbWetLeft, const IntSample *reverbWetRight, Bit32u outLength) {
-	produceOutput(outStream, nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, outLength);
+bool AnalogImpl<IntSampleEx>::mixDACStreams(IntSample *outStream, const IntSample *nonReverbLeft, const IntSample *nonReverbRight, const IntSample *reverbDryLeft, const IntSample *reverbDryRight, const IntSample *reverbWetLeft, const IntSample *reverbWetRight, Bit32u length) {
+	mixStreams(outStream, nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, length);
 	return true;
 }
 
 template<>
-bool AnalogImpl<FloatSample>::process(IntSample *, const IntSample *, const IntSample *, const IntSample *, const IntSample *, const IntSample *, const IntSample *, Bit32u) {
+bool AnalogImpl<FloatSample>::mixDACStreams(IntSample *, const IntSample *, const IntSample *, const IntSample *, const IntSample *, const IntSample *, const IntSample *, Bit32u) {
 	return false;
 }
 
 template<>
-bool AnalogImpl<IntSampleEx>::process(FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, Bit32u) {
+bool AnalogImpl<IntSampleEx>::mixDACStreams(FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, const FloatSample *, Bit32u) {
 	return false;
 }
 
 template<>
-bool AnalogImpl<FloatSample>::process(FloatSample *outStream, const FloatSample *nonReverbLeft, const FloatSample *nonReverbRight, const FloatSample *reverbDryLeft, const FloatSample *reverbDryRight, const FloatSample *reverbWetLeft, const FloatSample *reverbWetRight, Bit32u outLength) {
-	produceOutput(outStream, nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, outLength);
+bool AnalogImpl<FloatSample>::mixDACStreams(FloatSample *outStream, const FloatSample *nonReverbLeft, const FloatSample *nonReverbRight, const FloatSample *reverbDryLeft, const FloatSample *reverbDryRight, const FloatSample *reverbWetLeft, const FloatSample *reverbWetRight, Bit32u length) {
+	mixStreams(outStream, nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, reverbWetLeft, reverbWetRight, length);
 	return true;
 }
 
+template<>
+bool AnalogImpl<IntSampleEx>::isLockstepCapable() const {
+	return false;
+}
+
+template<>
+bool AnalogImpl<FloatSample>::isLockstepCapable() const {
+	return mode == AnalogOutputMode_COARSE;
+}
+
 template<>
 void AnalogImpl<IntSampleEx>::setSynthOutputGain(const float useSynthGain) {
 	synthGain = getIntOutputGain(useSynthGain);
@@ -309,6 +541,11 @@ void AnalogImpl<IntSampleEx>::setReverbOutputGain(const float useReverbGain, con
 	reverbGain = getIntOutputGain(getActualReverbOutputGain(useReverbGain, mt32ReverbCompatibilityMode));
 }
 
+template<>
+IntSampleEx AnalogImpl<IntSampleEx>::getAccumulationGain(const float gain) const {
+	return getIntOutputGain(gain);
+}
+
 template<>
 void AnalogImpl<FloatSample>::setSynthOutputGain(const float useSynthGain) {
 	synthGain = useSynthGain;
@@ -319,6 +556,100 @@ void AnalogImpl<FloatSample>::setReverbOutputGain(const float useReverbGain, con
 	reverbGain = getActualReverbOutputGain(useReverbGain, mt32ReverbCompatibilityMode);
 }
 
+template<>
+FloatSample AnalogImpl<FloatSample>::getAccumulationGain(const float gain) const {
+	return gain;
+}
+
+static void processCoarseLPFScalar(CoarseLowPassFilter<FloatSample> &leftChannelLPF, CoarseLowPassFilter<FloatSample> &rightChannelLPF, FloatSample *stream, Bit32u length) {
+	for (Bit32u i = 0; i < length; i++) {
+		stream[0] = leftChannelLPF.processSample(stream[0]);
+		stream[1] = rightChannelLPF.processSample(stream[1]);
+		stream += 2;
+	}
+}
+
+// Filters the streams of two units at once. The vector lanes hold the left and right channels of the first unit followed by
+// those of the second unit. The operations are performed in the same order as in CoarseLowPassFilter::processSample(),
+// so the output doesn't depend on whether the units are processed in lockstep. Returns false if SIMD is unavailable.
+static bool processCoarseLPFLockstepSIMD(CoarseLowPassFilter<FloatSample> * const *lpfs, FloatSample *stream0, FloatSample *stream1, Bit32u length) {
+#if MT32EMU_SIMD_SSE2
+	static const unsigned int DELAY_LINE_MASK = COARSE_LPF_DELAY_LINE_LENGTH - 1;
+	static const unsigned int LANE_COUNT = 4;
+
+	if (!SIMDDispatch::isBaselineSIMDEnabled()) return false;
+
+	// The taps and the delay lines are transposed, so that each row holds the lanes of a vector.
+	FloatSample taps[COARSE_LPF_DELAY_LINE_LENGTH + 1][LANE_COUNT];
+	FloatSample delayLines[LANE_COUNT][COARSE_LPF_DELAY_LINE_LENGTH];
+	FloatSample delayLine[COARSE_LPF_DELAY_LINE_LENGTH][LANE_COUNT];
+	for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+		const FloatSample *lpfTaps = lpfs[lane]->getLPFTaps();
+		for (unsigned int i = 0; i <= COARSE_LPF_DELAY_LINE_LENGTH; i++) {
+			taps[i][lane] = lpfTaps[i];
+		}
+		lpfs[lane]->getDelayLine(delayLines[lane]);
+		for (unsigned int i = 0; i < COARSE_LPF_DELAY_LINE_LENGTH; i++) {
+			delayLine[i][lane] = delayLines[lane][i];
+		}
+	}
+
+	unsigned int position = 0;
+	__m128 tapVectors[COARSE_LPF_DELAY_LINE_LENGTH + 1];
+	__m128 delayLineVectors[COARSE_LPF_DELAY_LINE_LENGTH];
+	for (unsigned int i = 0; i <= COARSE_LPF_DELAY_LINE_LENGTH; i++) {
+		tapVectors[i] = _mm_loadu_ps(taps[i]);
+	}
+	for (unsigned int i = 0; i < COARSE_LPF_DELAY_LINE_LENGTH; i++) {
+		delayLineVectors[i] = _mm_loadu_ps(delayLine[i]);
+	}
+	for (Bit32u i = 0; i < length; i++) {
+		const __m128 inSamples = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64 *>(stream0 + 2 * i)), reinterpret_cast<const __m64 *>(stream1 + 2 * i));
+		__m128 samples = _mm_mul_ps(tapVectors[COARSE_LPF_DELAY_LINE_LENGTH], delayLineVectors[position]);
+		delayLineVectors[position] = inSamples;
+		for (unsigned int j = 0; j < COARSE_LPF_DELAY_LINE_LENGTH; j++) {
+			samples = _mm_add_ps(samples, _mm_mul_ps(tapVectors[j], delayLineVectors[(j + position) & DELAY_LINE_MASK]));
+		}
+		position = (position - 1) & DELAY_LINE_MASK;
+		_mm_storel_pi(reinterpret_cast<__m64 *>(stream0 + 2 * i), samples);
+		_mm_storeh_pi(reinterpret_cast<__m64 *>(stream1 + 2 * i), samples);
+	}
+	for (unsigned int i = 0; i < COARSE_LPF_DELAY_LINE_LENGTH; i++) {
+		_mm_storeu_ps(delayLine[i], delayLineVectors[i]);
+	}
+
+	for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+		for (unsigned int i = 0; i < COARSE_LPF_DELAY_LINE_LENGTH; i++) {
+			delayLines[lane][i] = delayLine[i][lane];
+		}
+		lpfs[lane]->setDelayLine(delayLines[lane], position);
+	}
+	return true;
+#else
+	(void)lpfs;
+	(void)stream0;
+	(void)stream1;
+	(void)length;
+	return false;
+#endif
+}
+
+void Analog::processLockstep(Analog * const *analogs, FloatSample * const *streams, unsigned int count, Bit32u length) {
+	CoarseLowPassFilter<FloatSample> *lpfs[4];
+	for (unsigned int unit = 0; unit < count; unit += 2) {
+		const unsigned int unitCount = count - unit < 2 ? count - unit : 2;
+		for (unsigned int i = 0; i < unitCount; i++) {
+			AnalogImpl<FloatSample> &analog = static_cast<AnalogImpl<FloatSample> &>(*analogs[unit + i]);
+			lpfs[2 * i] = static_cast<CoarseLowPassFilter<FloatSample> *>(&analog.leftChannelLPF);
+			lpfs[2 * i + 1] = static_cast<CoarseLowPassFilter<FloatSample> *>(&analog.rightChannelLPF);
+		}
+		if (unitCount == 2 && processCoarseLPFLockstepSIMD(lpfs, streams[unit], streams[unit + 1], length)) continue;
+		for (unsigned int i = 0; i < unitCount; i++) {
+			processCoarseLPFScalar(*lpfs[2 * i], *lpfs[2 * i + 1], streams[unit + i], length);
+		}
+	}
+}
+
 template<>
 AbstractLowPassFilter<IntSampleEx> &AbstractLowPassFilter<IntSampleEx>::createLowPassFilter(AnalogOutputMode mode, bool oldMT32AnalogLPF) {
 	switch (mode) {
@@ -367,44 +698,88 @@ FloatSample CoarseLowPassFilter<FloatSample>::normaliseSample(const FloatSample
 	return sample;
 }
 
+// Computes the dot product of a polyphase row with the delay line samples. The products are summed in four interleaved
+// partial sums, exactly as in the SIMD versions, so that the output doesn't depend on the instruction set used.
+static inline FloatSample dotProductScalar(const FloatSample *taps, const FloatSample *samples) {
+	FloatSample sums[4];
+	for (unsigned int j = 0; j < 4; j++) {
+		sums[j] = taps[j] * samples[j];
+	}
+	for (unsigned int i = 4; i < ACCURATE_LPF_ROW_LENGTH; i += 4) {
+		for (unsigned int j = 0; j < 4; j++) {
+			sums[j] += taps[i + j] * samples[i + j];
+		}
+	}
+	return (sums[0] + sums[2]) + (sums[1] + sums[3]);
+}
+
+#if MT32EMU_SIMD_SSE2
+static inline FloatSample dotProductSIMD(const FloatSample *taps, const FloatSample *samples) {
+	__m128 sums = _mm_mul_ps(_mm_loadu_ps(taps), _mm_loadu_ps(samples));
+	for (unsigned int i = 4; i < ACCURATE_LPF_ROW_LENGTH; i += 4) {
+		sums = _mm_add_ps(sums, _mm_mul_ps(_mm_loadu_ps(taps + i), _mm_loadu_ps(samples + i)));
+	}
+	sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+	return _mm_cvtss_f32(_mm_add_ss(sums, _mm_shuffle_ps(sums, sums, 1)));
+}
+#endif
+
 AccurateLowPassFilter::AccurateLowPassFilter(const bool oldMT32AnalogLPF, const bool oversample) :
-	LPF_TAPS(oldMT32AnalogLPF ? ACCURATE_LPF_TAPS_MT32 : ACCURATE_LPF_TAPS_CM32L),
 	deltas(oversample ? ACCURATE_LPF_DELTAS_OVERSAMPLED : ACCURATE_LPF_DELTAS_REGULAR),
 	phaseIncrement(oversample ? ACCURATE_LPF_PHASE_INCREMENT_OVERSAMPLED : ACCURATE_LPF_PHASE_INCREMENT_REGULAR),
 	outputSampleRate(SAMPLE_RATE * ACCURATE_LPF_NUMBER_OF_PHASES / phaseIncrement),
-	ringBufferPosition(0),
 	phase(0)
 {
-	Synth::muteSampleBuffer(ringBuffer, ACCURATE_LPF_DELAY_LINE_LENGTH);
-}
-
-FloatSample AccurateLowPassFilter::process(const FloatSample inSample) {
-	static const unsigned int DELAY_LINE_MASK = ACCURATE_LPF_DELAY_LINE_LENGTH - 1;
-
-	FloatSample sample = (phase == 0) ? LPF_TAPS[ACCURATE_LPF_DELAY_LINE_LENGTH * ACCURATE_LPF_NUMBER_OF_PHASES] * ringBuffer[ringBufferPosition] : 0.0f;
-	if (!hasNextSample()) {
-		ringBuffer[ringBufferPosition] = inSample;
+	const FloatSample * const lpfTaps = oldMT32AnalogLPF ? ACCURATE_LPF_TAPS_MT32 : ACCURATE_LPF_TAPS_CM32L;
+	// The last element of each row corresponds to the newest sample. Only phase 0 has the extra tap applied
+	// to the sample that's ACCURATE_LPF_DELAY_LINE_LENGTH samples old.
+	Synth::muteSampleBuffer(&phaseTaps[0][0], ACCURATE_LPF_NUMBER_OF_PHASES * ACCURATE_LPF_ROW_LENGTH);
+	for (unsigned int phaseIx = 0; phaseIx < ACCURATE_LPF_NUMBER_OF_PHASES; phaseIx++) {
+		for (unsigned int delaySampleIx = 0; delaySampleIx < ACCURATE_LPF_DELAY_LINE_LENGTH; delaySampleIx++) {
+			phaseTaps[phaseIx][ACCURATE_LPF_ROW_LENGTH - 1 - delaySampleIx] = lpfTaps[phaseIx + delaySampleIx * ACCURATE_LPF_NUMBER_OF_PHASES];
+		}
 	}
+	phaseTaps[0][ACCURATE_LPF_ROW_LENGTH - 1 - ACCURATE_LPF_DELAY_LINE_LENGTH] = lpfTaps[ACCURATE_LPF_DELAY_LINE_LENGTH * ACCURATE_LPF_NUMBER_OF_PHASES];
+	Synth::muteSampleBuffer(delayLine, ACCURATE_LPF_ROW_LENGTH);
+}
 
-	for (unsigned int tapIx = phase, delaySampleIx = 0; delaySampleIx < ACCURATE_LPF_DELAY_LINE_LENGTH; delaySampleIx++, tapIx += ACCURATE_LPF_NUMBER_OF_PHASES) {
-		sample += LPF_TAPS[tapIx] * ringBuffer[(delaySampleIx + ringBufferPosition) & DELAY_LINE_MASK];
+template <class SampleEx>
+void AccurateLowPassFilter::produceOutput(SampleEx *outSamples, const SampleEx *inSamples, const unsigned int outLength) {
+	// The input is appended to the delay line beforehand, so that the vector loads don't stall waiting for the recent stores.
+	const unsigned int inLength = estimateInSampleCount(outLength);
+	for (unsigned int i = 0; i < inLength; i++) {
+		delayLine[ACCURATE_LPF_ROW_LENGTH + i] = FloatSample(inSamples[i]);
 	}
-
-	phase += phaseIncrement;
-	if (ACCURATE_LPF_NUMBER_OF_PHASES <= phase) {
-		phase -= ACCURATE_LPF_NUMBER_OF_PHASES;
-		ringBufferPosition = (ringBufferPosition - 1) & DELAY_LINE_MASK;
+	const FloatSample *newestSample = delayLine + ACCURATE_LPF_ROW_LENGTH - 1;
+#if MT32EMU_SIMD_SSE2
+	const bool useSIMD = SIMDDispatch::isBaselineSIMDEnabled();
+#endif
+	for (unsigned int i = 0; i < outLength; i++) {
+		// A new input sample is only consumed by phases below the phase increment, the other phases are interpolated.
+		if (phase < phaseIncrement) {
+			newestSample++;
+		}
+		const FloatSample *samples = newestSample - (ACCURATE_LPF_ROW_LENGTH - 1);
+#if MT32EMU_SIMD_SSE2
+		const FloatSample sample = useSIMD ? dotProductSIMD(phaseTaps[phase], samples) : dotProductScalar(phaseTaps[phase], samples);
+#else
+		const FloatSample sample = dotProductScalar(phaseTaps[phase], samples);
+#endif
+		outSamples[i] = SampleEx(ACCURATE_LPF_NUMBER_OF_PHASES * sample);
+		phase += phaseIncrement;
+		if (ACCURATE_LPF_NUMBER_OF_PHASES <= phase) {
+			phase -= ACCURATE_LPF_NUMBER_OF_PHASES;
+		}
 	}
-
-	return ACCURATE_LPF_NUMBER_OF_PHASES * sample;
+	memmove(delayLine, newestSample - (ACCURATE_LPF_ROW_LENGTH - 1), ACCURATE_LPF_ROW_LENGTH * sizeof(FloatSample));
 }
 
-IntSampleEx AccurateLowPassFilter::process(const IntSampleEx sample) {
-	return IntSampleEx(process(FloatSample(sample)));
+void AccurateLowPassFilter::process(FloatSample *outSamples, const FloatSample *inSamples, const unsigned int outLength) {
+	produceOutput(outSamples, inSamples, outLength);
 }
 
-bool AccurateLowPassFilter::hasNextSample() const {
-	return phaseIncrement <= phase;
+void AccurateLowPassFilter::process(IntSampleEx *outSamples, const IntSampleEx *inSamples, const unsigned int outLength) {
+	produceOutput(outSamples, inSamples, outLength);
 }
 
 unsigned int AccurateLowPassFilter::getOutputSampleRate() const {
@@ -421,4 +796,18 @@ void AccurateLowPassFilter::addPositionIncrement(const unsigned int positionIncr
 	phase = (phase + positionIncrement * phaseIncrement) % ACCURATE_LPF_NUMBER_OF_PHASES;
 }
 
+size_t AccurateLowPassFilter::getAllocatedMemorySize() const {
+	return sizeof(*this);
+}
+
+void AccurateLowPassFilter::saveState(StateWriter &writer) const {
+	writer.writeSamples(delayLine, ACCURATE_LPF_ROW_LENGTH);
+	writer.writeUInt32(phase);
+}
+
+void AccurateLowPassFilter::restoreState(StateReader &reader) {
+	reader.readSamples(delayLine, ACCURATE_LPF_ROW_LENGTH);
+	phase = reader.readIndex(ACCURATE_LPF_NUMBER_OF_PHASES);
+}
+
 } // namespace MT32Emu
@@ -18,6 +18,8 @@
 #ifndef MT32EMU_ANALOG_H
 #define MT32EMU_ANALOG_H
 
+#include <cstddef>
+
 #include "globals.h"
 #include "internals.h"
 #include "Enumerations.h"
@@ -25,6 +27,12 @@
 
 namespace MT32Emu {
 
+class StateReader;
+class StateWriter;
+
+template <class T>
+struct StereoOutputDescriptor;
+
 /* Analog class is dedicated to perform fair emulation of analogue circuitry of hardware units that is responsible
  * for processing output signal after the DAC. It appears that the analogue circuit labeled "LPF" on the schematic
  * also applies audible changes to the signal spectra. There is a significant boost of higher frequencies observed
@@ -38,14 +46,43 @@ class Analog {
 public:
 	static Analog *createAnalog(const AnalogOutputMode mode, const bool oldMT32AnalogLPF, const RendererType rendererType);
 
+	// Returns the number of taps and the upsampling factor of the LPF kernel used in the given mode, see getLPFKernel().
+	static unsigned int getLPFKernelLength(const AnalogOutputMode mode, unsigned int &upsampleFactor);
+
 	virtual ~Analog() {}
+	virtual AnalogOutputMode getMode() const = 0;
 	virtual unsigned int getOutputSampleRate() const = 0;
 	virtual Bit32u getDACStreamsLength(const Bit32u outputLength) const = 0;
 	virtual void setSynthOutputGain(const float synthGain) = 0;
 	virtual void setReverbOutputGain(const float reverbGain, const bool mt32ReverbCompatibilityMode) = 0;
 
-	virtual bool process(IntSample *outStream, const IntSample *nonReverbLeft, const IntSample *nonReverbRight, const IntSample *reverbDryLeft, const IntSample *reverbDryRight, const IntSample *reverbWetLeft, const IntSample *reverbWetRight, Bit32u outLength) = 0;
-	virtual bool process(FloatSample *outStream, const FloatSample *nonReverbLeft, const FloatSample *nonReverbRight, const FloatSample *reverbDryLeft, const FloatSample *reverbDryRight, const FloatSample *reverbWetLeft, const FloatSample *reverbWetRight, Bit32u outLength) = 0;
+	virtual bool process(const StereoOutputDescriptor<IntSample> &output, const IntSample *nonReverbLeft, const IntSample *nonReverbRight, const IntSample *reverbDryLeft, const IntSample *reverbDryRight, const IntSample *reverbWetLeft, const IntSample *reverbWetRight, Bit32u outLength) = 0;
+	virtual bool process(const StereoOutputDescriptor<FloatSample> &output, const FloatSample *nonReverbLeft, const FloatSample *nonReverbRight, const FloatSample *reverbDryLeft, const FloatSample *reverbDryRight, const FloatSample *reverbWetLeft, const FloatSample *reverbWetRight, Bit32u outLength) = 0;
+
+	// Mixes the DAC streams down to the stereo interleaved output at the DAC sample rate applying the output gains,
+	// yet bypassing the LPF. Intended for fusing the LPF with the subsequent resampling, see getLPFKernel().
+	virtual bool mixDACStreams(IntSample *outStream, const IntSample *nonReverbLeft, const IntSample *nonReverbRight, const IntSample *reverbDryLeft, const IntSample *reverbDryRight, const IntSample *reverbWetLeft, const IntSample *reverbWetRight, Bit32u length) = 0;
+	virtual bool mixDACStreams(FloatSample *outStream, const FloatSample *nonReverbLeft, const FloatSample *nonReverbRight, const FloatSample *reverbDryLeft, const FloatSample *reverbDryRight, const FloatSample *reverbWetLeft, const FloatSample *reverbWetRight, Bit32u length) = 0;
+
+	// Retrieves the FIR that models the LPF. The taps are specified at the DAC sample rate multiplied by upsampleFactor,
+	// as though the input was upsampled by zero-stuffing. Returns the number of taps.
+	virtual unsigned int getLPFKernel(const FloatSample *&taps, unsigned int &upsampleFactor) const = 0;
+
+	// Returns true if the LPF of this unit can be applied along with the LPFs of other units by processLockstep().
+	// Currently, only the coarse LPF of the float renderer qualifies.
+	virtual bool isLockstepCapable() const = 0;
+
+	// Applies the LPFs of several lockstep capable units in place to the stereo interleaved streams produced by mixDACStreams().
+	// The units are filtered in pairs, with the channels of both units occupying the lanes of a single SIMD vector.
+	// The output is the same as that of the regular processing of each unit on its own.
+	static void processLockstep(Analog * const *analogs, FloatSample * const *streams, unsigned int count, Bit32u length);
+
+	// Returns the amount of memory allocated by the analog circuitry emulation including the LPFs.
+	virtual size_t getAllocatedMemorySize() const = 0;
+
+	// Saves and restores the state of the LPFs. The output gains are not included, as they are set by the synth.
+	virtual void saveState(StateWriter &writer) const = 0;
+	virtual void restoreState(StateReader &reader) = 0;
 };
 
 } // namespace MT32Emu
@@ -0,0 +1,114 @@
+/* Copyright (C) 2003, 2004, 2005, 2006, 2008, 2009 Dean Beeler, Jerome Fisher
+ * Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_ATOMICS_H
+#define MT32EMU_ATOMICS_H
+
+#include "internals.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif !defined(__GNUC__)
+#error "Atomic operations are not implemented for this compiler"
+#endif
+
+// A minimal set of atomic operations on 32-bit integers required to implement lock-free data structures.
+// C++98 offers nothing like this, so the compiler intrinsics are used: the GCC builtins (also supported by clang)
+// or the Interlocked family of functions with MSVC.
+
+namespace MT32Emu {
+
+namespace Atomics {
+
+// Reads the value with acquire semantics, i.e. no subsequent memory access can be reordered before this load.
+static inline Bit32u loadAcquire(const volatile Bit32u &var) {
+#if defined(_MSC_VER)
+	return Bit32u(_InterlockedOr(reinterpret_cast<volatile long *>(const_cast<volatile Bit32u *>(&var)), 0));
+#elif defined(__ATOMIC_ACQUIRE)
+	return __atomic_load_n(&var, __ATOMIC_ACQUIRE);
+#else
+	Bit32u value = var;
+	__sync_synchronize();
+	return value;
+#endif
+}
+
+// Writes the value with release semantics, i.e. no preceding memory access can be reordered after this store.
+static inline void storeRelease(volatile Bit32u &var, Bit32u value) {
+#if defined(_MSC_VER)
+	_InterlockedExchange(reinterpret_cast<volatile long *>(&var), long(value));
+#elif defined(__ATOMIC_RELEASE)
+	__atomic_store_n(&var, value, __ATOMIC_RELEASE);
+#else
+	__sync_synchronize();
+	var = value;
+#endif
+}
+
+// Atomically replaces the value with desiredValue provided it is equal to expectedValue.
+// Returns true on success. Acts as a full memory barrier.
+static inline bool compareAndSwap(volatile Bit32u &var, Bit32u expectedValue, Bit32u desiredValue) {
+#if defined(_MSC_VER)
+	return Bit32u(_InterlockedCompareExchange(reinterpret_cast<volatile long *>(&var), long(desiredValue), long(expectedValue))) == expectedValue;
+#else
+	return __sync_bool_compare_and_swap(&var, expectedValue, desiredValue);
+#endif
+}
+
+// Atomically adds the increment to the value. Returns the value before the addition. Acts as a full memory barrier.
+static inline Bit32u fetchAdd(volatile Bit32u &var, Bit32u increment) {
+#if defined(_MSC_VER)
+	return Bit32u(_InterlockedExchangeAdd(reinterpret_cast<volatile long *>(&var), long(increment)));
+#else
+	return __sync_fetch_and_add(&var, increment);
+#endif
+}
+
+// Atomically sets the given bits in the value. Returns the value before the update. Acts as a full memory barrier.
+static inline Bit32u fetchOr(volatile Bit32u &var, Bit32u bits) {
+#if defined(_MSC_VER)
+	return Bit32u(_InterlockedOr(reinterpret_cast<volatile long *>(&var), long(bits)));
+#else
+	return __sync_fetch_and_or(&var, bits);
+#endif
+}
+
+// Atomically clears the bits in the value that are not set in the mask. Returns the value before the update.
+// Acts as a full memory barrier.
+static inline Bit32u fetchAnd(volatile Bit32u &var, Bit32u mask) {
+#if defined(_MSC_VER)
+	return Bit32u(_InterlockedAnd(reinterpret_cast<volatile long *>(&var), long(mask)));
+#else
+	return __sync_fetch_and_and(&var, mask);
+#endif
+}
+
+// Prevents any memory access from being reordered across the barrier, including a store followed by a load.
+static inline void fullBarrier() {
+#if defined(_MSC_VER)
+	volatile long dummy = 0;
+	_InterlockedOr(&dummy, 0);
+#else
+	__sync_synchronize();
+#endif
+}
+
+} // namespace Atomics
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_ATOMICS_H
@@ -20,7 +20,12 @@
 #include "internals.h"
 
 #include "BReverbModel.h"
+#include "CPUFeatures.h"
+#include "HotMemory.h"
+#include "RealtimeCheck.h"
+#include "SIMDDispatch.h"
 #include "Synth.h"
+#include "SynthState.h"
 
 // Analysing of state of reverb RAM address lines gives exact sizes of the buffers of filters used. This also indicates that
 // the reverb model implemented in the real devices consists of three series allpass filters preceded by a non-feedback comb (or a delay with a LPF)
@@ -40,6 +45,9 @@ static const Bit32u MODE_3_FEEDBACK_DELAY = 1;
 // Avoid denormals degrading performance, using biased input
 static const FloatSample BIAS = 1e-20f;
 
+// Maximum number of samples processed by the filter network before the comb outputs are mixed.
+static const Bit32u PROCESSING_BLOCK_SIZE = 128;
+
 struct BReverbSettings {
 	const Bit32u numberOfAllpasses;
 	const Bit32u * const allpassSizes;
@@ -273,24 +281,108 @@ static inline FloatSample mixCombs(FloatSample out1, FloatSample out2, FloatSamp
 	return 1.5f * (out1 + out2) + out3;
 }
 
+// Mixes the outputs of the three parallel comb filters for a block of samples and applies the wet level.
 template <class Sample>
-class RingBuffer {
-	static inline Sample sampleValueThreshold();
+static void mixCombsWet(Sample *out, const Sample *out1, const Sample *out2, const Sample *out3, Bit32u length, Bit8u wetLevel) {
+	for (Bit32u i = 0; i < length; i++) {
+		out[i] = weirdMul(mixCombs(out1[i], out2[i], out3[i]), wetLevel, 0xFF);
+	}
+}
+
+// The vectorised versions below produce exactly the same output as the scalar code, which they fall back to
+// when SIMD is disabled by SIMDDispatch.
+#if !MT32EMU_BOSS_REVERB_PRECISE_MODE && MT32EMU_SIMD_SSE2
+
+static inline __m128i mixCombsSSE2(const __m128i out1, const __m128i out2, const __m128i out3) {
+	return _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(out1, _mm_srai_epi32(out1, 1)), _mm_add_epi32(out2, _mm_srai_epi32(out2, 1))), out3);
+}
+
+static inline __m128i widenLowSSE2(const __m128i samples) {
+	return _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+}
+
+static inline __m128i widenHighSSE2(const __m128i samples) {
+	return _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+}
+
+template <>
+void mixCombsWet<IntSample>(IntSample *out, const IntSample *out1, const IntSample *out2, const IntSample *out3, Bit32u length, Bit8u wetLevel) {
+	const __m128i wet = _mm_set1_epi16(wetLevel);
+	const Bit32u vectorLength = SIMDDispatch::isBaselineSIMDEnabled() ? length & ~7U : 0;
+	for (Bit32u i = 0; i < vectorLength; i += 8) {
+		const __m128i samples1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out1 + i));
+		const __m128i samples2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out2 + i));
+		const __m128i samples3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out3 + i));
+		const __m128i mixedLow = mixCombsSSE2(widenLowSSE2(samples1), widenLowSSE2(samples2), widenLowSSE2(samples3));
+		const __m128i mixedHigh = mixCombsSSE2(widenHighSSE2(samples1), widenHighSSE2(samples2), widenHighSSE2(samples3));
+		// Saturating pack does the clipping, the products then fit in 32 bits and the result fits in 16 bits.
+		const __m128i mixed = _mm_packs_epi32(mixedLow, mixedHigh);
+		const __m128i productsLow = _mm_mullo_epi16(mixed, wet);
+		const __m128i productsHigh = _mm_mulhi_epi16(mixed, wet);
+		const __m128i wetLow = _mm_srai_epi32(_mm_unpacklo_epi16(productsLow, productsHigh), 8);
+		const __m128i wetHigh = _mm_srai_epi32(_mm_unpackhi_epi16(productsLow, productsHigh), 8);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(wetLow, wetHigh));
+	}
+	for (Bit32u i = vectorLength; i < length; i++) {
+		out[i] = weirdMul(mixCombs(out1[i], out2[i], out3[i]), wetLevel, 0xFF);
+	}
+}
+
+#endif
+
+#if MT32EMU_SIMD_SSE2
+
+template <>
+void mixCombsWet<FloatSample>(FloatSample *out, const FloatSample *out1, const FloatSample *out2, const FloatSample *out3, Bit32u length, Bit8u wetLevel) {
+	const __m128 combFactor = _mm_set1_ps(1.5f);
+	const __m128 wet = _mm_set1_ps(float(wetLevel));
+	const __m128 divisor = _mm_set1_ps(256.0f);
+	const Bit32u vectorLength = SIMDDispatch::isBaselineSIMDEnabled() ? length & ~3U : 0;
+	for (Bit32u i = 0; i < vectorLength; i += 4) {
+		const __m128 mixed = _mm_add_ps(_mm_mul_ps(combFactor, _mm_add_ps(_mm_loadu_ps(out1 + i), _mm_loadu_ps(out2 + i))), _mm_loadu_ps(out3 + i));
+		_mm_storeu_ps(out + i, _mm_div_ps(_mm_mul_ps(mixed, wet), divisor));
+	}
+	for (Bit32u i = vectorLength; i < length; i++) {
+		out[i] = weirdMul(mixCombs(out1[i], out2[i], out3[i]), wetLevel, 0xFF);
+	}
+}
+
+#endif
 
+static inline IntSample convertSilenceThreshold(IntSample, float threshold) {
+	return threshold > 0.0f ? Synth::clipSampleEx(IntSampleEx(threshold * 32768.0f)) : 8;
+}
+
+static inline FloatSample convertSilenceThreshold(FloatSample, float threshold) {
+	return threshold > 0.0f ? threshold : 0.001f;
+}
+
+template <class Sample>
+class RingBuffer {
 protected:
 	Sample *buffer;
 	const Bit32u size;
 	Bit32u index;
 
-public:
-	RingBuffer(const Bit32u newsize) : size(newsize), index(0) {
-		buffer = new Sample[size];
+	// Samples with magnitude not greater than this are considered silent.
+	Sample silenceThreshold;
+	// Number of silent samples stored in a row. Once it reaches the buffer size, the buffer can only contain
+	// silent samples, so it is known to be empty without scanning.
+	Bit32u silentSampleCount;
+
+	void store(const Sample sample) {
+		buffer[index] = sample;
+		// This is meant to compile branchless. The counter may wrap around after a couple of days of silence,
+		// which merely causes the buffer to be considered non-empty again for a short while.
+		const bool silent = -silenceThreshold <= sample && sample <= silenceThreshold;
+		silentSampleCount = silent ? silentSampleCount + 1 : 0;
 	}
 
-	virtual ~RingBuffer() {
-		delete[] buffer;
-		buffer = NULL;
-	}
+public:
+	// The buffer is a part of the sample storage owned by the model.
+	RingBuffer(const Bit32u newsize, Sample *useBuffer) : buffer(useBuffer), size(newsize), index(0), silenceThreshold(convertSilenceThreshold(Sample(), 0.0f)), silentSampleCount(0) {}
+
+	virtual ~RingBuffer() {}
 
 	Sample next() {
 		if (++index >= size) {
@@ -300,35 +392,42 @@ public:
 	}
 
 	bool isEmpty() const {
-		if (buffer == NULL) return true;
-
-		Sample *buf = buffer;
-		for (Bit32u i = 0; i < size; i++) {
-			if (*buf < -sampleValueThreshold() || *buf > sampleValueThreshold()) return false;
-			buf++;
-		}
-		return true;
+		return buffer == NULL || silentSampleCount >= size;
 	}
 
 	void mute() {
 		Synth::muteSampleBuffer(buffer, size);
+		silentSampleCount = size;
 	}
-};
 
-template<>
-IntSample RingBuffer<IntSample>::sampleValueThreshold() {
-	return 8;
-}
+	void setSilenceThreshold(const Sample useSilenceThreshold) {
+		silenceThreshold = useSilenceThreshold;
+		// Being conservative, the samples already stored have to be re-evaluated against the new threshold.
+		silentSampleCount = 0;
+	}
 
-template<>
-FloatSample RingBuffer<FloatSample>::sampleValueThreshold() {
-	return 0.001f;
-}
+	virtual void saveState(StateWriter &writer) const {
+		writer.writeUInt32(size);
+		writer.writeSamples(buffer, size);
+		writer.writeUInt32(index);
+		writer.writeUInt32(silentSampleCount);
+	}
+
+	virtual void restoreState(StateReader &reader) {
+		if (reader.readUInt32() != size) {
+			reader.fail();
+			return;
+		}
+		reader.readSamples(buffer, size);
+		index = reader.readIndex(size);
+		silentSampleCount = reader.readUInt32();
+	}
+};
 
 template <class Sample>
 class AllpassFilter : public RingBuffer<Sample> {
 public:
-	AllpassFilter(const Bit32u useSize) : RingBuffer<Sample>(useSize) {}
+	AllpassFilter(const Bit32u useSize, Sample *useBuffer) : RingBuffer<Sample>(useSize, useBuffer) {}
 
 	// This model corresponds to the allpass filter implementation of the real CM-32L device
 	// found from sample analysis
@@ -336,10 +435,11 @@ public:
 		const Sample bufferOut = this->next();
 
 		// store input - feedback / 2
-		this->buffer[this->index] = in - halveSample(bufferOut);
+		const Sample bufferIn = in - halveSample(bufferOut);
+		this->store(bufferIn);
 
 		// return buffer output + feedforward / 2
-		return bufferOut + halveSample(this->buffer[this->index]);
+		return bufferOut + halveSample(bufferIn);
 	}
 };
 
@@ -350,7 +450,7 @@ protected:
 	Bit8u feedbackFactor;
 
 public:
-	CombFilter(const Bit32u useSize, const Bit8u useFilterFactor) : RingBuffer<Sample>(useSize), filterFactor(useFilterFactor) {}
+	CombFilter(const Bit32u useSize, Sample *useBuffer, const Bit8u useFilterFactor) : RingBuffer<Sample>(useSize, useBuffer), filterFactor(useFilterFactor) {}
 
 	// This model corresponds to the comb filter implementation of the real CM-32L device
 	void process(const Sample in) {
@@ -362,16 +462,29 @@ public:
 		const Sample filterIn = in + weirdMul(this->next(), feedbackFactor, 0xF0);
 
 		// store input + feedback processed by a low-pass filter
-		this->buffer[this->index] = weirdMul(last, filterFactor, 0xC0) - filterIn;
+		this->store(weirdMul(last, filterFactor, 0xC0) - filterIn);
 	}
 
 	Sample getOutputAt(const Bit32u outIndex) const {
-		return this->buffer[(this->size + this->index - outIndex) % this->size];
+		// The output positions never exceed the buffer size, so a single subtraction is sufficient to wrap the index.
+		Bit32u outPosition = this->size + this->index - outIndex;
+		if (outPosition >= this->size) outPosition -= this->size;
+		return this->buffer[outPosition];
 	}
 
 	void setFeedbackFactor(const Bit8u useFeedbackFactor) {
 		feedbackFactor = useFeedbackFactor;
 	}
+
+	void saveState(StateWriter &writer) const {
+		RingBuffer<Sample>::saveState(writer);
+		writer.writeUInt8(feedbackFactor);
+	}
+
+	void restoreState(StateReader &reader) {
+		RingBuffer<Sample>::restoreState(reader);
+		feedbackFactor = reader.readUInt8();
+	}
 };
 
 template <class Sample>
@@ -379,8 +492,8 @@ class DelayWithLowPassFilter : public CombFilter<Sample> {
 	Bit8u amp;
 
 public:
-	DelayWithLowPassFilter(const Bit32u useSize, const Bit8u useFilterFactor, const Bit8u useAmp)
-		: CombFilter<Sample>(useSize, useFilterFactor), amp(useAmp) {}
+	DelayWithLowPassFilter(const Bit32u useSize, Sample *useBuffer, const Bit8u useFilterFactor, const Bit8u useAmp)
+		: CombFilter<Sample>(useSize, useBuffer, useFilterFactor), amp(useAmp) {}
 
 	void process(const Sample in) {
 		// the previously stored value
@@ -393,7 +506,7 @@ public:
 		Sample lpfOut = weirdMul(last, this->filterFactor, 0xFF) + in;
 
 		// store lpfOut multiplied by LPF amp factor
-		this->buffer[this->index] = weirdMul(lpfOut, amp, 0xFF);
+		this->store(weirdMul(lpfOut, amp, 0xFF));
 	}
 };
 
@@ -403,7 +516,7 @@ class TapDelayCombFilter : public CombFilter<Sample> {
 	Bit32u outR;
 
 public:
-	TapDelayCombFilter(const Bit32u useSize, const Bit8u useFilterFactor) : CombFilter<Sample>(useSize, useFilterFactor) {}
+	TapDelayCombFilter(const Bit32u useSize, Sample *useBuffer, const Bit8u useFilterFactor) : CombFilter<Sample>(useSize, useBuffer, useFilterFactor) {}
 
 	void process(const Sample in) {
 		// the previously stored value
@@ -417,7 +530,7 @@ public:
 		const Sample filterIn = in + weirdMul(this->getOutputAt(outR + MODE_3_FEEDBACK_DELAY), this->feedbackFactor, 0xF0);
 
 		// store input + feedback processed by a low-pass filter
-		this->buffer[this->index] = weirdMul(last, this->filterFactor, 0xF0) - filterIn;
+		this->store(weirdMul(last, this->filterFactor, 0xF0) - filterIn);
 	}
 
 	Sample getLeftOutput() const {
@@ -432,6 +545,20 @@ public:
 		outL = useOutL;
 		outR = useOutR;
 	}
+
+	void saveState(StateWriter &writer) const {
+		CombFilter<Sample>::saveState(writer);
+		writer.writeUInt32(outL);
+		writer.writeUInt32(outR);
+	}
+
+	void restoreState(StateReader &reader) {
+		CombFilter<Sample>::restoreState(reader);
+		// The output positions mustn't exceed the buffer size, see getOutputAt().
+		const Bit32u maxPosition = this->size - PROCESS_DELAY - MODE_3_ADDITIONAL_DELAY;
+		outL = reader.readIndex(maxPosition + 1);
+		outR = reader.readIndex(maxPosition + 1);
+	}
 };
 
 template <class Sample>
@@ -440,15 +567,31 @@ public:
 	AllpassFilter<Sample> **allpasses;
 	CombFilter<Sample> **combs;
 
+	// The buffers of all the filters are carved out of this single allocation, which is placed in hotMemoryBlock
+	// when hot memory is used.
+	Sample *sampleStorage;
+	const bool hotMemory;
+	HotMemoryBlock hotMemoryBlock;
+
 	const BReverbSettings &currentSettings;
 	const bool tapDelayMode;
 	Bit8u dryAmp;
 	Bit8u wetLevel;
 
-	BReverbModelImpl(const ReverbMode mode, const bool mt32CompatibleModel) :
-		allpasses(NULL), combs(NULL),
+	Sample silenceThreshold;
+	// Set unless the threshold is left at the default, which only serves isActive().
+	bool silenceMuteEnabled;
+	// Set when the filters are muted after the reverb tail has decayed, so that the network needn't run
+	// until some input arrives.
+	bool muted;
+
+	BReverbModelImpl(const ReverbMode mode, const bool mt32CompatibleModel, const bool useHotMemory) :
+		allpasses(NULL), combs(NULL), sampleStorage(NULL), hotMemory(useHotMemory),
 		currentSettings(mt32CompatibleModel ? getMT32Settings(mode) : getCM32L_LAPCSettings(mode)),
-		tapDelayMode(mode == REVERB_MODE_TAP_DELAY)
+		tapDelayMode(mode == REVERB_MODE_TAP_DELAY),
+		silenceThreshold(convertSilenceThreshold(Sample(), 0.0f)),
+		silenceMuteEnabled(false),
+		muted(false)
 	{}
 
 	~BReverbModelImpl() {
@@ -459,23 +602,47 @@ public:
 		return combs != NULL;
 	}
 
+	Bit32u getSampleStorageSize() const {
+		Bit32u sampleCount = 0;
+		for (Bit32u i = 0; i < currentSettings.numberOfAllpasses; i++) {
+			sampleCount += currentSettings.allpassSizes[i];
+		}
+		const Bit32u combCount = tapDelayMode ? 1 : currentSettings.numberOfCombs;
+		for (Bit32u i = 0; i < combCount; i++) {
+			sampleCount += currentSettings.combSizes[i];
+		}
+		return sampleCount;
+	}
+
 	void open() {
 		if (isOpen()) return;
+		const Bit32u sampleStorageSize = getSampleStorageSize();
+		if (hotMemory && hotMemoryBlock.allocate(sampleStorageSize * sizeof(Sample))) {
+			hotMemoryBlock.lock();
+			sampleStorage = reinterpret_cast<Sample *>(hotMemoryBlock.getData());
+		} else {
+			sampleStorage = new Sample[sampleStorageSize];
+		}
+		Sample *buffer = sampleStorage;
 		if (currentSettings.numberOfAllpasses > 0) {
 			allpasses = new AllpassFilter<Sample>*[currentSettings.numberOfAllpasses];
 			for (Bit32u i = 0; i < currentSettings.numberOfAllpasses; i++) {
-				allpasses[i] = new AllpassFilter<Sample>(currentSettings.allpassSizes[i]);
+				allpasses[i] = new AllpassFilter<Sample>(currentSettings.allpassSizes[i], buffer);
+				buffer += currentSettings.allpassSizes[i];
 			}
 		}
 		combs = new CombFilter<Sample>*[currentSettings.numberOfCombs];
 		if (tapDelayMode) {
-			*combs = new TapDelayCombFilter<Sample>(*currentSettings.combSizes, *currentSettings.filterFactors);
+			*combs = new TapDelayCombFilter<Sample>(*currentSettings.combSizes, buffer, *currentSettings.filterFactors);
 		} else {
-			combs[0] = new DelayWithLowPassFilter<Sample>(currentSettings.combSizes[0], currentSettings.filterFactors[0], currentSettings.lpfAmp);
+			combs[0] = new DelayWithLowPassFilter<Sample>(currentSettings.combSizes[0], buffer, currentSettings.filterFactors[0], currentSettings.lpfAmp);
+			buffer += currentSettings.combSizes[0];
 			for (Bit32u i = 1; i < currentSettings.numberOfCombs; i++) {
-				combs[i] = new CombFilter<Sample>(currentSettings.combSizes[i], currentSettings.filterFactors[i]);
+				combs[i] = new CombFilter<Sample>(currentSettings.combSizes[i], buffer, currentSettings.filterFactors[i]);
+				buffer += currentSettings.combSizes[i];
 			}
 		}
+		applySilenceThreshold();
 		mute();
 	}
 
@@ -500,6 +667,34 @@ public:
 			delete[] combs;
 			combs = NULL;
 		}
+		if (sampleStorage != reinterpret_cast<Sample *>(hotMemoryBlock.getData())) delete[] sampleStorage;
+		hotMemoryBlock.release();
+		sampleStorage = NULL;
+	}
+
+	bool isMemoryLocked() const {
+		return hotMemoryBlock.isLocked();
+	}
+
+	size_t getAllocatedMemorySize() const {
+		size_t size = sizeof(*this);
+		if (!isOpen()) return size;
+		if (allpasses != NULL) {
+			size += currentSettings.numberOfAllpasses * sizeof(AllpassFilter<Sample> *);
+			for (Bit32u i = 0; i < currentSettings.numberOfAllpasses; i++) {
+				size += sizeof(AllpassFilter<Sample>) + currentSettings.allpassSizes[i] * sizeof(Sample);
+			}
+		}
+		size += currentSettings.numberOfCombs * sizeof(CombFilter<Sample> *);
+		if (tapDelayMode) {
+			size += sizeof(TapDelayCombFilter<Sample>) + *currentSettings.combSizes * sizeof(Sample);
+		} else {
+			size += sizeof(DelayWithLowPassFilter<Sample>) + currentSettings.combSizes[0] * sizeof(Sample);
+			for (Bit32u i = 1; i < currentSettings.numberOfCombs; i++) {
+				size += sizeof(CombFilter<Sample>) + currentSettings.combSizes[i] * sizeof(Sample);
+			}
+		}
+		return size;
 	}
 
 	void mute() {
@@ -513,6 +708,31 @@ public:
 				combs[i]->mute();
 			}
 		}
+		muted = true;
+	}
+
+	void setSilenceThreshold(float threshold) {
+		silenceThreshold = convertSilenceThreshold(Sample(), threshold);
+		silenceMuteEnabled = threshold > 0.0f;
+		if (isOpen()) applySilenceThreshold();
+	}
+
+	void applySilenceThreshold() {
+		for (Bit32u i = 0; i < currentSettings.numberOfAllpasses; i++) {
+			allpasses[i]->setSilenceThreshold(silenceThreshold);
+		}
+		for (Bit32u i = 0; i < currentSettings.numberOfCombs; i++) {
+			combs[i]->setSilenceThreshold(silenceThreshold);
+		}
+		muted = false;
+	}
+
+	bool isInputSilent(const Sample *inLeft, const Sample *inRight, Bit32u numSamples) const {
+		for (Bit32u i = 0; i < numSamples; i++) {
+			if (inLeft[i] < -silenceThreshold || inLeft[i] > silenceThreshold) return false;
+			if (inRight[i] < -silenceThreshold || inRight[i] > silenceThreshold) return false;
+		}
+		return true;
 	}
 
 	void setParameters(Bit8u time, Bit8u level) {
@@ -542,6 +762,7 @@ public:
 		}
 	}
 
+	// Cheap enough to call for each rendered block, as the filters keep track of the silent samples they store.
 	bool isActive() const {
 		if (!isOpen()) return false;
 		for (Bit32u i = 0; i < currentSettings.numberOfAllpasses; i++) {
@@ -557,6 +778,30 @@ public:
 		return &currentSettings == &getMT32Settings(mode);
 	}
 
+	void saveState(StateWriter &writer) const {
+		writer.writeUInt8(dryAmp);
+		writer.writeUInt8(wetLevel);
+		writer.writeBool(muted);
+		for (Bit32u i = 0; i < currentSettings.numberOfAllpasses; i++) {
+			allpasses[i]->saveState(writer);
+		}
+		for (Bit32u i = 0; i < currentSettings.numberOfCombs; i++) {
+			combs[i]->saveState(writer);
+		}
+	}
+
+	void restoreState(StateReader &reader) {
+		dryAmp = reader.readUInt8();
+		wetLevel = reader.readUInt8();
+		muted = reader.readBool();
+		for (Bit32u i = 0; i < currentSettings.numberOfAllpasses; i++) {
+			allpasses[i]->restoreState(reader);
+		}
+		for (Bit32u i = 0; i < currentSettings.numberOfCombs; i++) {
+			combs[i]->restoreState(reader);
+		}
+	}
+
 	template <class SampleEx>
 	void produceOutput(const Sample *inLeft, const Sample *inRight, Sample *outLeft, Sample *outRight, Bit32u numSamples) {
 		if (!isOpen()) {
@@ -565,29 +810,40 @@ public:
 			return;
 		}
 
-		while ((numSamples--) > 0) {
-			Sample dry;
-
-			if (tapDelayMode) {
-				dry = halveSample(*(inLeft++)) + halveSample(*(inRight++));
-			} else {
-				dry = quarterSample(*(inLeft++)) + quarterSample(*(inRight++));
+		if (silenceMuteEnabled && !BReverbModelImpl::isActive()) {
+			if (isInputSilent(inLeft, inRight, numSamples)) {
+				// The reverb tail has decayed below the silence threshold and there is nothing to add to it,
+				// so the residue is dropped rather than kept circulating through the network.
+				if (!muted) mute();
+				Synth::muteSampleBuffer(outLeft, numSamples);
+				Synth::muteSampleBuffer(outRight, numSamples);
+				return;
 			}
+			muted = false;
+		}
 
-			// Looks like dryAmp doesn't change in MT-32 but it does in CM-32L / LAPC-I
-			dry = weirdMul(addDCBias(dry), dryAmp, 0xFF);
+		if (tapDelayMode) {
+			produceTapDelayOutput(inLeft, inRight, outLeft, outRight, numSamples);
+			return;
+		}
+
+		// The samples are taken through the filter network in blocks, the comb taps are collected for each block
+		// and mixed afterwards using vector operations. Keeping all the filters in a single loop lets the CPU overlap
+		// the feedback paths of the entrance LPF and the combs, which are inherently sequential.
+		DelayWithLowPassFilter<Sample> * const entranceDelay = static_cast<DelayWithLowPassFilter<Sample> *>(combs[0]);
+		CombFilter<Sample> * const comb1 = combs[1];
+		CombFilter<Sample> * const comb2 = combs[2];
+		CombFilter<Sample> * const comb3 = combs[3];
+		Sample leftTaps[3][PROCESSING_BLOCK_SIZE];
+		Sample rightTaps[3][PROCESSING_BLOCK_SIZE];
+		while (numSamples > 0) {
+			const Bit32u blockLength = numSamples < PROCESSING_BLOCK_SIZE ? numSamples : PROCESSING_BLOCK_SIZE;
+			for (Bit32u i = 0; i < blockLength; i++) {
+				Sample dry = quarterSample(inLeft[i]) + quarterSample(inRight[i]);
+
+				// Looks like dryAmp doesn't change in MT-32 but it does in CM-32L / LAPC-I
+				dry = weirdMul(addDCBias(dry), dryAmp, 0xFF);
 
-			if (tapDelayMode) {
-				TapDelayCombFilter<Sample> *comb = static_cast<TapDelayCombFilter<Sample> *>(*combs);
-				comb->process(dry);
-				if (outLeft != NULL) {
-					*(outLeft++) = weirdMul(comb->getLeftOutput(), wetLevel, 0xFF);
-				}
-				if (outRight != NULL) {
-					*(outRight++) = weirdMul(comb->getRightOutput(), wetLevel, 0xFF);
-				}
-			} else {
-				DelayWithLowPassFilter<Sample> * const entranceDelay = static_cast<DelayWithLowPassFilter<Sample> *>(combs[0]);
 				// If the output position is equal to the comb size, get it now in order not to loose it
 				Sample link = entranceDelay->getOutputAt(currentSettings.combSizes[0] - 1);
 
@@ -599,46 +855,69 @@ public:
 				link = allpasses[2]->process(link);
 
 				// If the output position is equal to the comb size, get it now in order not to loose it
-				Sample outL1 = combs[1]->getOutputAt(currentSettings.outLPositions[0] - 1);
+				leftTaps[0][i] = comb1->getOutputAt(currentSettings.outLPositions[0] - 1);
 
-				combs[1]->process(link);
-				combs[2]->process(link);
-				combs[3]->process(link);
+				comb1->process(link);
+				comb2->process(link);
+				comb3->process(link);
 
-				if (outLeft != NULL) {
-					Sample outL2 = combs[2]->getOutputAt(currentSettings.outLPositions[1]);
-					Sample outL3 = combs[3]->getOutputAt(currentSettings.outLPositions[2]);
-					Sample outSample = mixCombs(outL1, outL2, outL3);
-					*(outLeft++) = weirdMul(outSample, wetLevel, 0xFF);
-				}
-				if (outRight != NULL) {
-					Sample outR1 = combs[1]->getOutputAt(currentSettings.outRPositions[0]);
-					Sample outR2 = combs[2]->getOutputAt(currentSettings.outRPositions[1]);
-					Sample outR3 = combs[3]->getOutputAt(currentSettings.outRPositions[2]);
-					Sample outSample = mixCombs(outR1, outR2, outR3);
-					*(outRight++) = weirdMul(outSample, wetLevel, 0xFF);
-				}
-			} // if (tapDelayMode)
-		} // while ((numSamples--) > 0)
+				leftTaps[1][i] = comb2->getOutputAt(currentSettings.outLPositions[1]);
+				leftTaps[2][i] = comb3->getOutputAt(currentSettings.outLPositions[2]);
+				rightTaps[0][i] = comb1->getOutputAt(currentSettings.outRPositions[0]);
+				rightTaps[1][i] = comb2->getOutputAt(currentSettings.outRPositions[1]);
+				rightTaps[2][i] = comb3->getOutputAt(currentSettings.outRPositions[2]);
+			}
+
+			if (outLeft != NULL) {
+				mixCombsWet(outLeft, leftTaps[0], leftTaps[1], leftTaps[2], blockLength, wetLevel);
+				outLeft += blockLength;
+			}
+			if (outRight != NULL) {
+				mixCombsWet(outRight, rightTaps[0], rightTaps[1], rightTaps[2], blockLength, wetLevel);
+				outRight += blockLength;
+			}
+			inLeft += blockLength;
+			inRight += blockLength;
+			numSamples -= blockLength;
+		}
 	} // produceOutput
 
+	void produceTapDelayOutput(const Sample *inLeft, const Sample *inRight, Sample *outLeft, Sample *outRight, Bit32u numSamples) {
+		TapDelayCombFilter<Sample> *comb = static_cast<TapDelayCombFilter<Sample> *>(*combs);
+		while ((numSamples--) > 0) {
+			Sample dry = halveSample(*(inLeft++)) + halveSample(*(inRight++));
+
+			// Looks like dryAmp doesn't change in MT-32 but it does in CM-32L / LAPC-I
+			dry = weirdMul(addDCBias(dry), dryAmp, 0xFF);
+
+			comb->process(dry);
+			if (outLeft != NULL) {
+				*(outLeft++) = weirdMul(comb->getLeftOutput(), wetLevel, 0xFF);
+			}
+			if (outRight != NULL) {
+				*(outRight++) = weirdMul(comb->getRightOutput(), wetLevel, 0xFF);
+			}
+		}
+	}
+
 	bool process(const IntSample *inLeft, const IntSample *inRight, IntSample *outLeft, IntSample *outRight, Bit32u numSamples);
 	bool process(const FloatSample *inLeft, const FloatSample *inRight, FloatSample *outLeft, FloatSample *outRight, Bit32u numSamples);
 };
 
-BReverbModel *BReverbModel::createBReverbModel(const ReverbMode mode, const bool mt32CompatibleModel, const RendererType rendererType) {
+BReverbModel *BReverbModel::createBReverbModel(const ReverbMode mode, const bool mt32CompatibleModel, const RendererType rendererType, const bool hotMemory) {
 	switch (rendererType)
 	{
 	case RendererType_BIT16S:
-		return new BReverbModelImpl<IntSample>(mode, mt32CompatibleModel);
+		return new BReverbModelImpl<IntSample>(mode, mt32CompatibleModel, hotMemory);
 	case RendererType_FLOAT:
-		return new BReverbModelImpl<FloatSample>(mode, mt32CompatibleModel);
+		return new BReverbModelImpl<FloatSample>(mode, mt32CompatibleModel, hotMemory);
 	}
 	return NULL;
 }
 
 template <>
 bool BReverbModelImpl<IntSample>::process(const IntSample *inLeft, const IntSample *inRight, IntSample *outLeft, IntSample *outRight, Bit32u numSamples) {
+	RealtimeScope realtimeScope("BReverbModel");
 	produceOutput<IntSampleEx>(inLeft, inRight, outLeft, outRight, numSamples);
 	return true;
 }
@@ -655,6 +934,7 @@ bool BReverbModelImpl<FloatSample>::process(const IntSample *, const IntSample *
 
 template <>
 bool BReverbModelImpl<FloatSample>::process(const FloatSample *inLeft, const FloatSample *inRight, FloatSample *outLeft, FloatSample *outRight, Bit32u numSamples) {
+	RealtimeScope realtimeScope("BReverbModel");
 	produceOutput<FloatSample>(inLeft, inRight, outLeft, outRight, numSamples);
 	return true;
 }
@@ -18,6 +18,8 @@
 #ifndef MT32EMU_B_REVERB_MODEL_H
 #define MT32EMU_B_REVERB_MODEL_H
 
+#include <cstddef>
+
 #include "globals.h"
 #include "internals.h"
 #include "Enumerations.h"
@@ -25,9 +27,13 @@
 
 namespace MT32Emu {
 
+class StateReader;
+class StateWriter;
+
 class BReverbModel {
 public:
-	static BReverbModel *createBReverbModel(const ReverbMode mode, const bool mt32CompatibleModel, const RendererType rendererType);
+	// With hotMemory set, the buffers are allocated as a HotMemoryBlock locked into RAM upon opening.
+	static BReverbModel *createBReverbModel(const ReverbMode mode, const bool mt32CompatibleModel, const RendererType rendererType, const bool hotMemory);
 
 	virtual ~BReverbModel() {}
 	virtual bool isOpen() const = 0;
@@ -36,11 +42,24 @@ public:
 	// May be called multiple times without an open() in between.
 	virtual void close() = 0;
 	virtual void mute() = 0;
+	// Returns the amount of memory allocated by the model, including the buffers when open.
+	virtual size_t getAllocatedMemorySize() const = 0;
+	// Returns true if the model is open with the buffers in hot memory locked into RAM.
+	virtual bool isMemoryLocked() const = 0;
 	virtual void setParameters(Bit8u time, Bit8u level) = 0;
+	// Returns false once the contents of all the filters have decayed below the silence threshold.
 	virtual bool isActive() const = 0;
+	// Sets the level relative to the full scale, below which the samples are considered silent. Once the reverb
+	// becomes inactive and the input is silent, the filters are muted and process() merely produces silence until
+	// some input arrives. A non-positive value disables the mute, isActive() then uses the default threshold,
+	// which is 8 LSBs for IntSample and 0.001 for FloatSample.
+	virtual void setSilenceThreshold(float threshold) = 0;
 	virtual bool isMT32Compatible(const ReverbMode mode) const = 0;
 	virtual bool process(const IntSample *inLeft, const IntSample *inRight, IntSample *outLeft, IntSample *outRight, Bit32u numSamples) = 0;
 	virtual bool process(const FloatSample *inLeft, const FloatSample *inRight, FloatSample *outLeft, FloatSample *outRight, Bit32u numSamples) = 0;
+	// The model must be open. The state can only be restored into a model of the same mode, compatibility and renderer type.
+	virtual void saveState(StateWriter &writer) const = 0;
+	virtual void restoreState(StateReader &reader) = 0;
 };
 
 } // namespace MT32Emu
@@ -0,0 +1,129 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "internals.h"
+
+#include "CPUFeatures.h"
+
+#if MT32EMU_SIMD_AVX2 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MT32EMU_DENORMAL_CONTROL_MXCSR 1
+#include <xmmintrin.h>
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define MT32EMU_DENORMAL_CONTROL_FPCR 1
+#endif
+
+namespace MT32Emu {
+
+namespace CPUFeatures {
+
+#if MT32EMU_SIMD_AVX2
+bool isSSE41Supported() {
+#if defined(_MSC_VER)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	return (cpuInfo[2] & 0x80000) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.1") != 0;
+#endif
+}
+
+bool isAVX2Supported() {
+#if defined(_MSC_VER)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 0);
+	if (cpuInfo[0] < 7) return false;
+	__cpuid(cpuInfo, 1);
+	// Both OSXSAVE and AVX flags must be set, and the OS must preserve the YMM registers
+	if ((cpuInfo[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(cpuInfo, 7, 0);
+	return (cpuInfo[1] & 0x20) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+} // namespace CPUFeatures
+
+#if MT32EMU_DENORMAL_CONTROL_MXCSR
+
+// MXCSR bits FTZ and DAZ respectively.
+static const Bit32u DENORMAL_FLUSH_CONTROL_MASK = 0x8000 | 0x0040;
+
+static inline Bit32u getFPControl() {
+	return Bit32u(_mm_getcsr());
+}
+
+static inline void setFPControl(Bit32u control) {
+	_mm_setcsr(control);
+}
+
+#elif MT32EMU_DENORMAL_CONTROL_FPCR
+
+// FPCR bit FZ, which covers both the inputs and the results.
+static const Bit32u DENORMAL_FLUSH_CONTROL_MASK = 1 << 24;
+
+static inline Bit32u getFPControl() {
+	unsigned long long control;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(control));
+	return Bit32u(control);
+}
+
+static inline void setFPControl(Bit32u control) {
+	unsigned long long fpcr = control;
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+}
+
+#endif
+
+#if MT32EMU_DENORMAL_CONTROL_MXCSR || MT32EMU_DENORMAL_CONTROL_FPCR
+
+DenormalFlushScope::DenormalFlushScope(bool enabled) : savedControl(0), active(false) {
+	if (!enabled) return;
+	savedControl = getFPControl();
+	// Nested scopes and callers that have already set the modes leave the control state alone.
+	if ((savedControl & DENORMAL_FLUSH_CONTROL_MASK) == DENORMAL_FLUSH_CONTROL_MASK) return;
+	setFPControl(savedControl | DENORMAL_FLUSH_CONTROL_MASK);
+	active = true;
+}
+
+DenormalFlushScope::~DenormalFlushScope() {
+	if (active) setFPControl(savedControl);
+}
+
+bool DenormalFlushScope::isFlushingActive() {
+	return (getFPControl() & DENORMAL_FLUSH_CONTROL_MASK) == DENORMAL_FLUSH_CONTROL_MASK;
+}
+
+#else
+
+DenormalFlushScope::DenormalFlushScope(bool) : savedControl(0), active(false) {}
+
+DenormalFlushScope::~DenormalFlushScope() {}
+
+bool DenormalFlushScope::isFlushingActive() {
+	return false;
+}
+
+#endif
+
+} // namespace MT32Emu
@@ -0,0 +1,75 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_CPU_FEATURES_H
+#define MT32EMU_CPU_FEATURES_H
+
+#include "internals.h"
+
+// Compile-time selection of the SIMD instruction sets that may be used by the optimised kernels.
+// MT32EMU_SIMD_SSE2 - SSE2 is targeted by the compiler and thus available unconditionally.
+// MT32EMU_SIMD_AVX2 - functions declared with MT32EMU_AVX2_TARGET may use AVX2 provided CPUFeatures::isAVX2Supported() is true.
+#if MT32EMU_USE_SIMD
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MT32EMU_SIMD_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER) && _MSC_VER >= 1700
+#define MT32EMU_SIMD_AVX2 1
+#define MT32EMU_AVX2_TARGET
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define MT32EMU_SIMD_AVX2 1
+#define MT32EMU_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#if MT32EMU_SIMD_AVX2
+#include <immintrin.h>
+#endif
+#endif
+#endif // #if MT32EMU_USE_SIMD
+
+namespace MT32Emu {
+
+namespace CPUFeatures {
+
+#if MT32EMU_SIMD_AVX2
+// Returns true if the CPU supports SSE4.1 instructions. Detection relies on the same compiler support as the AVX2 target.
+bool isSSE41Supported();
+
+// Returns true if both the CPU and the OS support AVX2 instructions.
+bool isAVX2Supported();
+#endif
+
+} // namespace CPUFeatures
+
+// Switches the floating-point unit of the current thread to the flush-to-zero and denormals-are-zero modes for the lifetime
+// of the object, provided it is enabled, and restores the control state of the caller afterwards. The denormal numbers
+// that decaying filters and reverb tails produce are thus replaced with zeros instead of slowing the arithmetic down
+// by up to two orders of magnitude. Only x86 with SSE and AArch64 are supported, the object has no effect elsewhere.
+class DenormalFlushScope {
+public:
+	explicit DenormalFlushScope(bool enabled);
+	~DenormalFlushScope();
+
+	// Returns true if the current thread flushes the denormal numbers, e.g. within an enabled scope.
+	static bool isFlushingActive();
+
+private:
+	Bit32u savedControl;
+	bool active;
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_CPU_FEATURES_H
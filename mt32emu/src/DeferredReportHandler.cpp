@@ -0,0 +1,249 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+#include <cstring>
+
+#include "internals.h"
+
+#include "DeferredReportHandler.h"
+#include "Atomics.h"
+
+namespace MT32Emu {
+
+// Must be a power of 2.
+static const Bit32u REPORT_RING_SIZE = 64;
+static const Bit32u PART_COUNT = 9;
+static const size_t MAX_TEXT_LENGTH = 20;
+static const size_t MAX_PATCH_NAME_LENGTH = 10;
+
+enum ReportType {
+	ReportType_LCD_MESSAGE,
+	ReportType_DEVICE_RESET,
+	ReportType_DEVICE_RECONFIG,
+	ReportType_REVERB_MODE,
+	ReportType_REVERB_TIME,
+	ReportType_REVERB_LEVEL,
+	ReportType_PROGRAM_CHANGED
+};
+
+struct DeferredReportHandler::Report {
+	// Set once the record is complete, as the concurrent writers may complete the claimed records in any order.
+	volatile Bit32u ready;
+	Bit8u type;
+	Bit8u value;
+	// Either the LCD message or the sound group name.
+	char text[MAX_TEXT_LENGTH + 1];
+	char patchName[MAX_PATCH_NAME_LENGTH + 1];
+};
+
+// Copies at most size - 1 characters, the NULL string is stored as empty.
+static void copyText(char *dst, const char *src, size_t size) {
+	size_t length = 0;
+	if (src != NULL) {
+		while (length < size - 1 && src[length] != 0) {
+			dst[length] = src[length];
+			length++;
+		}
+	}
+	dst[length] = 0;
+}
+
+static void setFlags(volatile Bit32u &flags, Bit32u newFlags) {
+	Bit32u oldFlags;
+	do {
+		oldFlags = Atomics::loadAcquire(flags);
+		if ((oldFlags & newFlags) == newFlags) return;
+	} while (!Atomics::compareAndSwap(flags, oldFlags, oldFlags | newFlags));
+}
+
+static Bit32u takeValue(volatile Bit32u &var) {
+	Bit32u value;
+	do {
+		value = Atomics::loadAcquire(var);
+		if (value == 0) return 0;
+	} while (!Atomics::compareAndSwap(var, value, 0));
+	return value;
+}
+
+static void increment(volatile Bit32u &var) {
+	Bit32u value;
+	do {
+		value = Atomics::loadAcquire(var);
+	} while (!Atomics::compareAndSwap(var, value, value + 1));
+}
+
+DeferredReportHandler::DeferredReportHandler(ReportHandler &useTargetReportHandler) :
+	targetReportHandler(useTargetReportHandler),
+	reports(new Report[REPORT_RING_SIZE]),
+	writeIx(0),
+	readIx(0),
+	lostReportCount(0),
+	midiMessagePlayed(0),
+	polyStateChangedParts(0)
+{
+	for (Bit32u i = 0; i < REPORT_RING_SIZE; i++) {
+		reports[i].ready = 0;
+	}
+}
+
+DeferredReportHandler::~DeferredReportHandler() {
+	delete[] reports;
+}
+
+// May be invoked from several threads concurrently. The slot is claimed first, then filled in and marked ready.
+void DeferredReportHandler::recordReport(Bit8u type, Bit8u value, const char *text, const char *patchName) {
+	Bit32u ix;
+	do {
+		ix = Atomics::loadAcquire(writeIx);
+		if (ix - Atomics::loadAcquire(readIx) >= REPORT_RING_SIZE) {
+			increment(lostReportCount);
+			return;
+		}
+	} while (!Atomics::compareAndSwap(writeIx, ix, ix + 1));
+	Report &report = reports[ix & (REPORT_RING_SIZE - 1)];
+	report.type = type;
+	report.value = value;
+	copyText(report.text, text, sizeof(report.text));
+	copyText(report.patchName, patchName, sizeof(report.patchName));
+	Atomics::storeRelease(report.ready, 1);
+}
+
+Bit32u DeferredReportHandler::deliverReports() {
+	bool deviceReset = false;
+	bool deviceReconfig = false;
+	int reverbMode = -1;
+	int reverbTime = -1;
+	int reverbLevel = -1;
+	bool lcdMessageShown = false;
+	char lcdMessage[MAX_TEXT_LENGTH + 1];
+	Bit32u changedPrograms = 0;
+	char soundGroupNames[PART_COUNT][MAX_TEXT_LENGTH + 1];
+	char patchNames[PART_COUNT][MAX_PATCH_NAME_LENGTH + 1];
+
+	Bit32u ix = readIx;
+	while (ix != Atomics::loadAcquire(writeIx)) {
+		Report &report = reports[ix & (REPORT_RING_SIZE - 1)];
+		// The record is still being written, so it is left till the next delivery along with the following ones.
+		if (Atomics::loadAcquire(report.ready) == 0) break;
+		switch (report.type) {
+		case ReportType_LCD_MESSAGE:
+			lcdMessageShown = true;
+			memcpy(lcdMessage, report.text, sizeof(lcdMessage));
+			break;
+		case ReportType_DEVICE_RESET:
+			deviceReset = true;
+			break;
+		case ReportType_DEVICE_RECONFIG:
+			deviceReconfig = true;
+			break;
+		case ReportType_REVERB_MODE:
+			reverbMode = report.value;
+			break;
+		case ReportType_REVERB_TIME:
+			reverbTime = report.value;
+			break;
+		case ReportType_REVERB_LEVEL:
+			reverbLevel = report.value;
+			break;
+		case ReportType_PROGRAM_CHANGED:
+			if (report.value < PART_COUNT) {
+				changedPrograms |= 1 << report.value;
+				memcpy(soundGroupNames[report.value], report.text, sizeof(soundGroupNames[0]));
+				memcpy(patchNames[report.value], report.patchName, sizeof(patchNames[0]));
+			}
+			break;
+		}
+		report.ready = 0;
+		Atomics::storeRelease(readIx, ++ix);
+	}
+
+	if (deviceReset) targetReportHandler.onDeviceReset();
+	if (deviceReconfig) targetReportHandler.onDeviceReconfig();
+	if (reverbMode >= 0) targetReportHandler.onNewReverbMode(Bit8u(reverbMode));
+	if (reverbTime >= 0) targetReportHandler.onNewReverbTime(Bit8u(reverbTime));
+	if (reverbLevel >= 0) targetReportHandler.onNewReverbLevel(Bit8u(reverbLevel));
+	for (Bit8u partNum = 0; partNum < PART_COUNT; partNum++) {
+		if ((changedPrograms & (1 << partNum)) == 0) continue;
+		const char *soundGroupName = soundGroupNames[partNum][0] == 0 ? NULL : soundGroupNames[partNum];
+		targetReportHandler.onProgramChanged(partNum, soundGroupName, patchNames[partNum]);
+	}
+	const Bit32u changedPolyStates = takeValue(polyStateChangedParts);
+	for (Bit8u partNum = 0; partNum < PART_COUNT; partNum++) {
+		if (changedPolyStates & (1 << partNum)) targetReportHandler.onPolyStateChanged(partNum);
+	}
+	if (lcdMessageShown) targetReportHandler.showLCDMessage(lcdMessage);
+	if (takeValue(midiMessagePlayed) != 0) targetReportHandler.onMIDIMessagePlayed();
+	return takeValue(lostReportCount);
+}
+
+void DeferredReportHandler::printDebug(const char *fmt, va_list list) {
+	targetReportHandler.printDebug(fmt, list);
+}
+
+void DeferredReportHandler::onErrorControlROM() {
+	targetReportHandler.onErrorControlROM();
+}
+
+void DeferredReportHandler::onErrorPCMROM() {
+	targetReportHandler.onErrorPCMROM();
+}
+
+void DeferredReportHandler::showLCDMessage(const char *message) {
+	recordReport(ReportType_LCD_MESSAGE, 0, message, NULL);
+}
+
+void DeferredReportHandler::onMIDIMessagePlayed() {
+	setFlags(midiMessagePlayed, 1);
+}
+
+bool DeferredReportHandler::onMIDIQueueOverflow() {
+	return targetReportHandler.onMIDIQueueOverflow();
+}
+
+void DeferredReportHandler::onMIDISystemRealtime(Bit8u systemRealtime) {
+	targetReportHandler.onMIDISystemRealtime(systemRealtime);
+}
+
+void DeferredReportHandler::onDeviceReset() {
+	recordReport(ReportType_DEVICE_RESET, 0, NULL, NULL);
+}
+
+void DeferredReportHandler::onDeviceReconfig() {
+	recordReport(ReportType_DEVICE_RECONFIG, 0, NULL, NULL);
+}
+
+void DeferredReportHandler::onNewReverbMode(Bit8u mode) {
+	recordReport(ReportType_REVERB_MODE, mode, NULL, NULL);
+}
+
+void DeferredReportHandler::onNewReverbTime(Bit8u time) {
+	recordReport(ReportType_REVERB_TIME, time, NULL, NULL);
+}
+
+void DeferredReportHandler::onNewReverbLevel(Bit8u level) {
+	recordReport(ReportType_REVERB_LEVEL, level, NULL, NULL);
+}
+
+void DeferredReportHandler::onPolyStateChanged(Bit8u partNum) {
+	if (partNum < PART_COUNT) setFlags(polyStateChangedParts, 1 << partNum);
+}
+
+void DeferredReportHandler::onProgramChanged(Bit8u partNum, const char *soundGroupName, const char *patchName) {
+	recordReport(ReportType_PROGRAM_CHANGED, partNum, soundGroupName, patchName);
+}
+
+} // namespace MT32Emu
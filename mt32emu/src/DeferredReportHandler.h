@@ -0,0 +1,77 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_DEFERRED_REPORT_HANDLER_H
+#define MT32EMU_DEFERRED_REPORT_HANDLER_H
+
+#include <cstdarg>
+
+#include "globals.h"
+#include "Types.h"
+#include "Synth.h"
+
+namespace MT32Emu {
+
+// Wraps a ReportHandler, so that the notifications issued while playing MIDI messages and rendering are not delivered
+// synchronously. Instead, they are recorded in a fixed-size lock-free ring and delivered to the wrapped handler
+// by deliverReports(), which the client invokes once per rendering pass or whenever convenient, e.g. on a UI timer.
+// The delivery is coalesced: only the latest LCD message, reverb setting and program of each part are reported,
+// the changes of poly state are reported once per part, and onMIDIMessagePlayed() is reported once at most.
+// Note, the ring may overflow if the delivery is delayed for too long, then the excess notifications are lost.
+// The notifications that concern the MIDI input or the opening of the synth, as well as the debug messages,
+// are passed to the wrapped handler immediately.
+class MT32EMU_EXPORT DeferredReportHandler : public ReportHandler {
+public:
+	explicit DeferredReportHandler(ReportHandler &targetReportHandler);
+	~DeferredReportHandler();
+
+	// Delivers the notifications recorded so far to the wrapped handler in the calling thread.
+	// Only one thread may deliver at a time. Returns the number of notifications lost since the previous call.
+	Bit32u deliverReports();
+
+	void printDebug(const char *fmt, va_list list);
+	void onErrorControlROM();
+	void onErrorPCMROM();
+	void showLCDMessage(const char *message);
+	void onMIDIMessagePlayed();
+	bool onMIDIQueueOverflow();
+	void onMIDISystemRealtime(Bit8u systemRealtime);
+	void onDeviceReset();
+	void onDeviceReconfig();
+	void onNewReverbMode(Bit8u mode);
+	void onNewReverbTime(Bit8u time);
+	void onNewReverbLevel(Bit8u level);
+	void onPolyStateChanged(Bit8u partNum);
+	void onProgramChanged(Bit8u partNum, const char *soundGroupName, const char *patchName);
+
+private:
+	struct Report;
+
+	ReportHandler &targetReportHandler;
+	Report * const reports;
+	volatile Bit32u writeIx;
+	volatile Bit32u readIx;
+	volatile Bit32u lostReportCount;
+	// The most frequent notifications are merely flagged rather than recorded.
+	volatile Bit32u midiMessagePlayed;
+	volatile Bit32u polyStateChangedParts;
+
+	void recordReport(Bit8u type, Bit8u value, const char *text, const char *patchName);
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_DEFERRED_REPORT_HANDLER_H
@@ -41,6 +41,15 @@
 #define MT32EMU_RENDERER_TYPE_NAME mt32emu_renderer_type
 #define MT32EMU_RENDERER_TYPE(ident) MT32EMU_RT_##ident
 
+#define MT32EMU_SIMD_INSTRUCTION_SET_NAME mt32emu_simd_instruction_set
+#define MT32EMU_SIMD_INSTRUCTION_SET(ident) MT32EMU_SIS_##ident
+
+#define MT32EMU_FLOAT_WAVE_ACCURACY_NAME mt32emu_float_wave_accuracy
+#define MT32EMU_FLOAT_WAVE_ACCURACY(ident) MT32EMU_FWA_##ident
+
+#define MT32EMU_DEGRADATION_LEVEL_NAME mt32emu_degradation_level
+#define MT32EMU_DEGRADATION_LEVEL(ident) MT32EMU_DL_##ident
+
 #else /* #ifdef MT32EMU_C_ENUMERATIONS */
 
 #define MT32EMU_CPP_ENUMERATIONS_H
@@ -63,6 +72,15 @@
 #define MT32EMU_RENDERER_TYPE_NAME RendererType
 #define MT32EMU_RENDERER_TYPE(ident) RendererType_##ident
 
+#define MT32EMU_SIMD_INSTRUCTION_SET_NAME SIMDInstructionSet
+#define MT32EMU_SIMD_INSTRUCTION_SET(ident) SIMDInstructionSet_##ident
+
+#define MT32EMU_FLOAT_WAVE_ACCURACY_NAME FloatWaveAccuracy
+#define MT32EMU_FLOAT_WAVE_ACCURACY(ident) FloatWaveAccuracy_##ident
+
+#define MT32EMU_DEGRADATION_LEVEL_NAME DegradationLevel
+#define MT32EMU_DEGRADATION_LEVEL(ident) DegradationLevel_##ident
+
 namespace MT32Emu {
 
 #endif /* #ifdef MT32EMU_C_ENUMERATIONS */
@@ -160,6 +178,55 @@ enum MT32EMU_RENDERER_TYPE_NAME {
 	MT32EMU_RENDERER_TYPE(FLOAT)
 };
 
+/**
+ * SIMD instruction sets the optimised kernels (wave generation, mixing, reverb, analog LPF and internal resampler)
+ * may be dispatched for at runtime. Kernels that have no variant for the selected instruction set use the best
+ * variant of those the instruction set implies. The output doesn't depend on the instruction set used.
+ */
+enum MT32EMU_SIMD_INSTRUCTION_SET_NAME {
+	/** Plain C++ code, available on all platforms. */
+	MT32EMU_SIMD_INSTRUCTION_SET(NONE),
+	/** x86 SSE2, the baseline of the x86-64 architecture. */
+	MT32EMU_SIMD_INSTRUCTION_SET(SSE2),
+	/** x86 SSE4.1, implies SSE2. */
+	MT32EMU_SIMD_INSTRUCTION_SET(SSE4_1),
+	/** x86 AVX2, implies SSE4.1. */
+	MT32EMU_SIMD_INSTRUCTION_SET(AVX2),
+	/** AArch64 Advanced SIMD. Reserved, the library has no NEON kernels yet, so it is never reported as supported. */
+	MT32EMU_SIMD_INSTRUCTION_SET(NEON)
+};
+
+/**
+ * Accuracy of the transcendental functions the float renderer evaluates to synthesise the square and sawtooth waves.
+ * The PCM waves and the integer renderer aren't affected.
+ */
+enum MT32EMU_FLOAT_WAVE_ACCURACY_NAME {
+	/** Evaluate the functions of the standard C library for each sample. The slowest mode, kept as the reference. */
+	MT32EMU_FLOAT_WAVE_ACCURACY(REFERENCE),
+	/** Use polynomial approximations accurate to about one float ULP. */
+	MT32EMU_FLOAT_WAVE_ACCURACY(HIGH),
+	/** Use polynomial approximations of lower degree, with the relative error below 3e-6 (about -110 dB). */
+	MT32EMU_FLOAT_WAVE_ACCURACY(FAST)
+};
+
+/**
+ * Steps of the ladder of cheaper processing modes that a realtime host may go through when rendering is at risk
+ * of missing its deadlines, in the order of the increasing quality loss. Each step includes the ones before it.
+ * All the steps can be switched while rendering, so cheaper analog output modes or sample rate conversion qualities,
+ * which require reopening the synth, aren't on the ladder. Neither is limiting the polyphony, which is set separately.
+ */
+enum MT32EMU_DEGRADATION_LEVEL_NAME {
+	/** Full quality, nothing is degraded. */
+	MT32EMU_DEGRADATION_LEVEL(NONE),
+	/** The float renderer synthesises the square and sawtooth waves as with the FAST float wave accuracy. */
+	MT32EMU_DEGRADATION_LEVEL(FAST_WAVES),
+	/**
+	 * The reverb model is fed with silence, so that the reverb tail decays naturally and the model stops processing
+	 * once it decays below the silence threshold. The dry output is unaffected.
+	 */
+	MT32EMU_DEGRADATION_LEVEL(REVERB_DRAINED)
+};
+
 #ifndef MT32EMU_C_ENUMERATIONS
 
 } // namespace MT32Emu
@@ -184,4 +251,13 @@ enum MT32EMU_RENDERER_TYPE_NAME {
 #undef MT32EMU_RENDERER_TYPE_NAME
 #undef MT32EMU_RENDERER_TYPE
 
+#undef MT32EMU_SIMD_INSTRUCTION_SET_NAME
+#undef MT32EMU_SIMD_INSTRUCTION_SET
+
+#undef MT32EMU_FLOAT_WAVE_ACCURACY_NAME
+#undef MT32EMU_FLOAT_WAVE_ACCURACY
+
+#undef MT32EMU_DEGRADATION_LEVEL_NAME
+#undef MT32EMU_DEGRADATION_LEVEL
+
 #endif /* #if (!defined MT32EMU_CPP_ENUMERATIONS_H && !defined MT32EMU_C_ENUMERATIONS) || (!defined MT32EMU_C_ENUMERATIONS_H && defined MT32EMU_C_ENUMERATIONS) */
@@ -0,0 +1,48 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_EXECUTOR_H
+#define MT32EMU_EXECUTOR_H
+
+#include "globals.h"
+
+namespace MT32Emu {
+
+// Runs the parallel work of the library in the threads of the host application. Normally, the library spawns its own
+// worker threads for rendering partials, the reverb pipeline, opening the synth in the background and the multi-synth
+// engine. When an executor is installed, no threads are spawned, and each share of a parallel job is submitted to it
+// instead. This way, hosts that already maintain a thread pool may apply their own scheduling and realtime policies.
+//
+// The executor may run the submitted procedures in any of its threads and in any order, but it must eventually run
+// each of them without waiting for the submitting thread, which may block until they complete. Note, the parallel
+// rendering jobs are submitted once per rendered block, so the executor should dispatch them with low latency.
+// If a procedure cannot be accepted, execute() returns false, and the library runs it in the submitting thread instead.
+// Executors are only used when the library is built with multithreading support (libmt32emu_WITH_THREADS).
+class MT32EMU_EXPORT Executor {
+public:
+	virtual ~Executor() {}
+	virtual bool execute(void (*proc)(void *), void *context) = 0;
+
+	// Installs the executor for all the synth instances in the process, NULL restores the built-in worker threads.
+	// The executor is picked up whenever a set of worker threads would be created, e.g. when a synth is opened.
+	// So, it should be installed before opening any synth, and it must remain valid until all of them are closed.
+	static void setExecutor(Executor *executor);
+	static Executor *getExecutor();
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_EXECUTOR_H
@@ -22,6 +22,7 @@
 #include "internals.h"
 
 #include "FileStream.h"
+#include "RealtimeCheck.h"
 
 namespace MT32Emu {
 
@@ -72,6 +73,7 @@ const Bit8u *FileStream::getData() {
 	if (getSize() == 0) {
 		return NULL;
 	}
+	RealtimeCheck::reportFileIO();
 	Bit8u *fileData = new Bit8u[size];
 	if (fileData == NULL) {
 		return NULL;
@@ -88,6 +90,7 @@ const Bit8u *FileStream::getData() {
 }
 
 bool FileStream::open(const char *filename) {
+	RealtimeCheck::reportFileIO();
 	configureSystemLocale();
 	ifsp.clear();
 	ifsp.open(filename, ios_base::in | ios_base::binary);
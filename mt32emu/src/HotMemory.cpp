@@ -0,0 +1,210 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined _WIN32 && !defined _DEFAULT_SOURCE
+// Needed for anonymous mappings, mlock() and madvise() when compiling in strict ANSI mode.
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#endif
+
+#include "internals.h"
+
+#include "HotMemory.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#if !defined MAP_ANONYMOUS && defined MAP_ANON
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+namespace MT32Emu {
+
+#ifdef _WIN32
+
+static size_t getPageSize() {
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwPageSize;
+}
+
+#else // #ifdef _WIN32
+
+// The huge page size of x86-64 and of AArch64 with 4KB pages. Where the default huge page size differs, mmap() rejects
+// the length and regular pages are used instead.
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static size_t getPageSize() {
+	const long pageSize = sysconf(_SC_PAGESIZE);
+	return pageSize > 0 ? size_t(pageSize) : 4096;
+}
+
+#endif // #ifdef _WIN32
+
+static size_t roundUpSize(const size_t size, const size_t granularity) {
+	return (size + granularity - 1) / granularity * granularity;
+}
+
+// Writing to each page makes the OS back it with a private page, reading would only map the shared zero page.
+static void prefaultWritable(Bit8u *data, const size_t size, const size_t pageSize) {
+	volatile Bit8u *page = data;
+	for (size_t offset = 0; offset < size; offset += pageSize) {
+		page[offset] = 0;
+	}
+}
+
+static void prefaultReadOnly(const Bit8u *data, const size_t size, const size_t pageSize) {
+	const volatile Bit8u *page = data;
+	for (size_t offset = 0; offset < size; offset += pageSize) {
+		(void)page[offset];
+	}
+}
+
+HotMemoryBlock::HotMemoryBlock() : data(NULL), mappedSize(0), locked(false), hugePageBacked(false)
+{}
+
+HotMemoryBlock::~HotMemoryBlock() {
+	release();
+}
+
+#ifdef _WIN32
+
+bool HotMemoryBlock::allocate(const size_t size) {
+	release();
+	// Large pages are only granted to processes holding SeLockMemoryPrivilege, they're never paged out.
+	const size_t largePageSize = GetLargePageMinimum();
+	if (largePageSize > 0 && size >= largePageSize) {
+		const size_t largeSize = roundUpSize(size, largePageSize);
+		void *mapping = VirtualAlloc(NULL, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (mapping != NULL) {
+			data = static_cast<Bit8u *>(mapping);
+			mappedSize = largeSize;
+			locked = true;
+			hugePageBacked = true;
+			return true;
+		}
+	}
+	const size_t pageSize = getPageSize();
+	const size_t regularSize = roundUpSize(size, pageSize);
+	void *mapping = VirtualAlloc(NULL, regularSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (mapping == NULL) return false;
+	data = static_cast<Bit8u *>(mapping);
+	mappedSize = regularSize;
+	prefaultWritable(data, mappedSize, pageSize);
+	return true;
+}
+
+void HotMemoryBlock::release() {
+	if (data == NULL) return;
+	// Freeing the pages unlocks them as well.
+	VirtualFree(data, 0, MEM_RELEASE);
+	data = NULL;
+	mappedSize = 0;
+	locked = false;
+	hugePageBacked = false;
+}
+
+#else // #ifdef _WIN32
+
+bool HotMemoryBlock::allocate(const size_t size) {
+	release();
+	void *mapping = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	// Explicit huge pages only exist if the administrator has reserved some, e.g. via /proc/sys/vm/nr_hugepages.
+	if (size >= HUGE_PAGE_SIZE) {
+		const size_t hugeSize = roundUpSize(size, HUGE_PAGE_SIZE);
+		mapping = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mapping != MAP_FAILED) {
+			mappedSize = hugeSize;
+			hugePageBacked = true;
+		}
+	}
+#endif
+	const size_t pageSize = getPageSize();
+	if (mapping == MAP_FAILED) {
+		const size_t regularSize = roundUpSize(size, pageSize);
+		mapping = mmap(NULL, regularSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapping == MAP_FAILED) return false;
+		mappedSize = regularSize;
+#ifdef MADV_HUGEPAGE
+		// Otherwise, the kernel may still back the aligned huge page ranges with transparent huge pages.
+		if (size >= HUGE_PAGE_SIZE) madvise(mapping, regularSize, MADV_HUGEPAGE);
+#endif
+	}
+	data = static_cast<Bit8u *>(mapping);
+	prefaultWritable(data, mappedSize, pageSize);
+	return true;
+}
+
+void HotMemoryBlock::release() {
+	if (data == NULL) return;
+	// Unmapping the pages unlocks them as well.
+	munmap(data, mappedSize);
+	data = NULL;
+	mappedSize = 0;
+	locked = false;
+	hugePageBacked = false;
+}
+
+#endif // #ifdef _WIN32
+
+bool HotMemoryBlock::lock() {
+	if (data == NULL) return false;
+	if (!locked) locked = HotMemory::lockRange(data, mappedSize);
+	return locked;
+}
+
+namespace HotMemory {
+
+// The locks apply to whole pages, so the range is extended to the page boundaries.
+static void getPageRange(const void *data, const size_t size, const Bit8u *&firstPage, size_t &pagesSize) {
+	const size_t pageSize = getPageSize();
+	const size_t offset = reinterpret_cast<size_t>(data) % pageSize;
+	firstPage = static_cast<const Bit8u *>(data) - offset;
+	pagesSize = roundUpSize(offset + size, pageSize);
+}
+
+bool lockRange(const void *data, const size_t size) {
+	if (data == NULL || size == 0) return false;
+	const Bit8u *firstPage;
+	size_t pagesSize;
+	getPageRange(data, size, firstPage, pagesSize);
+	prefaultReadOnly(firstPage, pagesSize, getPageSize());
+#ifdef _WIN32
+	return VirtualLock(const_cast<Bit8u *>(firstPage), pagesSize) != 0;
+#else
+	return mlock(firstPage, pagesSize) == 0;
+#endif
+}
+
+void unlockRange(const void *data, const size_t size) {
+	if (data == NULL || size == 0) return;
+	const Bit8u *firstPage;
+	size_t pagesSize;
+	getPageRange(data, size, firstPage, pagesSize);
+#ifdef _WIN32
+	VirtualUnlock(const_cast<Bit8u *>(firstPage), pagesSize);
+#else
+	munlock(firstPage, pagesSize);
+#endif
+}
+
+} // namespace HotMemory
+
+} // namespace MT32Emu
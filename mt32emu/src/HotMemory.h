@@ -0,0 +1,75 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_HOT_MEMORY_H
+#define MT32EMU_HOT_MEMORY_H
+
+#include <cstddef>
+
+#include "internals.h"
+
+namespace MT32Emu {
+
+// Storage for the data touched while rendering, see Synth::setHotMemoryLockingEnabled(). The block is obtained directly
+// from the OS, page-aligned and zero-filled. Blocks that span at least a huge page are backed by huge pages where the OS
+// provides them, which saves TLB misses. All the pages are faulted in upon allocation rather than on the first touch.
+class HotMemoryBlock {
+public:
+	HotMemoryBlock();
+	~HotMemoryBlock();
+
+	// Replaces the block with a new one of at least the given size. Returns false if the OS refuses to provide the memory.
+	bool allocate(size_t size);
+	void release();
+
+	// Locks the pages of the block into RAM, so that they're never paged out. Returns false if the OS refuses, typically
+	// due to RLIMIT_MEMLOCK or the working set limits on Windows. The block stays usable regardless.
+	bool lock();
+
+	Bit8u *getData() const {
+		return data;
+	}
+
+	bool isLocked() const {
+		return locked;
+	}
+
+	bool isHugePageBacked() const {
+		return hugePageBacked;
+	}
+
+private:
+	Bit8u *data;
+	size_t mappedSize;
+	bool locked;
+	bool hugePageBacked;
+
+	HotMemoryBlock(const HotMemoryBlock &);
+	HotMemoryBlock &operator=(const HotMemoryBlock &);
+};
+
+namespace HotMemory {
+
+// Faults in and locks the pages spanned by memory allocated elsewhere, e.g. a memory-mapped file. Returns false if locking
+// fails, the pages are faulted in anyway. The locks don't nest, the range is unlocked by a single call to unlockRange().
+bool lockRange(const void *data, size_t size);
+void unlockRange(const void *data, size_t size);
+
+} // namespace HotMemory
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_HOT_MEMORY_H
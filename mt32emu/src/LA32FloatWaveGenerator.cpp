@@ -20,7 +20,10 @@
 #include "internals.h"
 
 #include "LA32FloatWaveGenerator.h"
+#include "LA32FloatWaveKernels.h"
+#include "MixKernels.h"
 #include "mmath.h"
+#include "SynthState.h"
 #include "Tables.h"
 
 namespace MT32Emu {
@@ -29,6 +32,19 @@ static const float MIDDLE_CUTOFF_VALUE = 128.0f;
 static const float RESONANCE_DECAY_THRESHOLD_CUTOFF_VALUE = 144.0f;
 static const float MAX_CUTOFF_VALUE = 240.0f;
 
+// Converts cutoffRampVal (see generateNextSample()) to the cutoff value of the model
+static inline float getCutoffVal(const Bit32u cutoffRampVal) {
+	// The cutoffModifier may not be supposed to be directly added to the cutoff -
+	// it may for example need to be multiplied in some way.
+	// The 240 cutoffVal limit was determined via sample analysis (internal Munt capture IDs: glop3, glop4).
+	// More research is needed to be sure that this is correct, however.
+	float cutoffVal = cutoffRampVal / 262144.0f;
+	if (cutoffVal > MAX_CUTOFF_VALUE) {
+		cutoffVal = MAX_CUTOFF_VALUE;
+	}
+	return cutoffVal;
+}
+
 float LA32FloatWaveGenerator::getPCMSample(unsigned int position) {
 	if (position >= pcmWaveLength) {
 		if (!pcmWaveLooped) {
@@ -41,6 +57,67 @@ float LA32FloatWaveGenerator::getPCMSample(unsigned int position) {
 	return ((pcmSample & 32768) == 0) ? sampleValue : -sampleValue;
 }
 
+LA32FloatWaveGenerator::LA32FloatWaveGenerator() : active(false), pcmWaveAddress(NULL), accuracy(FloatWaveAccuracy_REFERENCE) {}
+
+void LA32FloatWaveGenerator::updateAmp(const Bit32u ampVal) {
+	cachedAmpVal = ampVal;
+	cachedAmp = EXP2F(ampVal / -1024.0f / 4096.0f);
+}
+
+void LA32FloatWaveGenerator::updatePitch(const Bit16u pitch) {
+	cachedPitch = pitch;
+	cachedFreq = EXP2F(pitch / 4096.0f - 16.0f) * SAMPLE_RATE;
+	// Wave length in samples
+	cachedWaveLen = SAMPLE_RATE / cachedFreq;
+}
+
+void LA32FloatWaveGenerator::updateCutoff(const Bit32u cutoffRampVal) {
+	cachedCutoffRampVal = cutoffRampVal;
+	const float cutoffVal = getCutoffVal(cutoffRampVal);
+	cachedCutoffVal = cutoffVal;
+
+	cachedCosineLenFactor = 1.0f;
+	cachedAttenuation = 1.0f;
+	if (cutoffVal > MIDDLE_CUTOFF_VALUE) {
+		cachedCosineLenFactor = EXP2F((cutoffVal - MIDDLE_CUTOFF_VALUE) / -16.0f); // found from sample analysis
+	} else if (cutoffVal < MIDDLE_CUTOFF_VALUE) {
+		// Attenuate samples below cutoff 50
+		// Found by sample analysis
+		cachedAttenuation = EXP2F(-0.125f * (MIDDLE_CUTOFF_VALUE - cutoffVal));
+	}
+
+	// Correct resAmp for cutoff in range 50..66
+	cachedResAmp = baseResAmp;
+	if ((cutoffVal >= MIDDLE_CUTOFF_VALUE) && (cutoffVal < RESONANCE_DECAY_THRESHOLD_CUTOFF_VALUE)) {
+		cachedResAmp *= sin(FLOAT_PI * (cutoffVal - MIDDLE_CUTOFF_VALUE) / 32.0f);
+	}
+}
+
+void LA32FloatWaveGenerator::resetCachedParameters() {
+	if (!isPCMWave()) {
+		baseResAmp = EXP2F(1.0f - (32 - resonance) / 4.0f);
+		{
+			//static const float resAmpFactor = EXP2F(-7);
+			//baseResAmp = EXP2I(resonance << 10) * resAmpFactor;
+		}
+
+		// Ratio of positive segment to wave length
+		pulseLenFactor = 0.5f;
+		if (pulseWidth > 128) {
+			pulseLenFactor = EXP2F((64 - pulseWidth) / 64.0f);
+			//static const float pulseLenFactor = EXP2F(-192 / 64);
+			//pulseLen = EXP2I((256 - pulseWidthVal) << 6) * pulseLenFactor;
+		}
+
+		// Resonance decay speed factor
+		baseResAmpDecayFactor = Tables::getInstance().resAmpDecayFactor[resonance >> 2];
+
+		updateCutoff(0);
+	}
+	updateAmp(0);
+	updatePitch(0);
+}
+
 void LA32FloatWaveGenerator::initSynth(const bool useSawtoothWaveform, const Bit8u usePulseWidth, const Bit8u useResonance) {
 	sawtoothWaveform = useSawtoothWaveform;
 	pulseWidth = usePulseWidth;
@@ -50,6 +127,7 @@ void LA32FloatWaveGenerator::initSynth(const bool useSawtoothWaveform, const Bit
 	lastFreq = 0.0f;
 
 	pcmWaveAddress = NULL;
+	resetCachedParameters();
 	active = true;
 }
 
@@ -60,9 +138,14 @@ void LA32FloatWaveGenerator::initPCM(const Bit16s * const usePCMWaveAddress, con
 	pcmWaveInterpolated = usePCMWaveInterpolated;
 
 	pcmPosition = 0.0f;
+	resetCachedParameters();
 	active = true;
 }
 
+void LA32FloatWaveGenerator::setAccuracy(const FloatWaveAccuracy useAccuracy) {
+	accuracy = useAccuracy;
+}
+
 // ampVal - Logarithmic amp of the wave generator
 // pitch - Logarithmic frequency of the resulting wave
 // cutoffRampVal - Composed of the base cutoff in range [78..178] left-shifted by 18 bits and the TVF modifier
@@ -71,6 +154,16 @@ float LA32FloatWaveGenerator::generateNextSample(const Bit32u ampVal, const Bit1
 		return 0.0f;
 	}
 
+	if (!isPCMWave() && accuracy != FloatWaveAccuracy_REFERENCE) {
+		// The approximated model is only implemented by the kernels, which synthesise a single sample just as well
+		LA32FloatSynthBlock block;
+		prepareSynthSample(block, 0, ampVal, pitch, cutoffRampVal);
+		completeSynthBlock(block, 1);
+		float sample;
+		LA32FloatWaveKernels::synthesise(&sample, block, 1);
+		return sample;
+	}
+
 	float sample = 0.0f;
 
 	// SEMI-CONFIRMED: From sample analysis:
@@ -83,8 +176,14 @@ float LA32FloatWaveGenerator::generateNextSample(const Bit32u ampVal, const Bit1
 	//
 	// Also still partially unconfirmed is the behaviour when ramping between levels, as well as the timing.
 
-	float amp = EXP2F(ampVal / -1024.0f / 4096.0f);
-	float freq = EXP2F(pitch / 4096.0f - 16.0f) * SAMPLE_RATE;
+	if (ampVal != cachedAmpVal) {
+		updateAmp(ampVal);
+	}
+	if (pitch != cachedPitch) {
+		updatePitch(pitch);
+	}
+	const float amp = cachedAmp;
+	const float freq = cachedFreq;
 
 	if (isPCMWave()) {
 		// Render PCM waveform
@@ -95,8 +194,6 @@ float LA32FloatWaveGenerator::generateNextSample(const Bit32u ampVal, const Bit1
 			deactivate();
 			return 0.0f;
 		}
-		float positionDelta = freq * 2048.0f / SAMPLE_RATE;
-
 		// Linear interpolation
 		float firstSample = getPCMSample(intPCMPosition);
 		// We observe that for partial structures with ring modulation the interpolation is not applied to the slave PCM partial.
@@ -108,38 +205,22 @@ float LA32FloatWaveGenerator::generateNextSample(const Bit32u ampVal, const Bit1
 			sample = firstSample;
 		}
 
-		float newPCMPosition = pcmPosition + positionDelta;
-		if (pcmWaveLooped) {
-			newPCMPosition = fmod(newPCMPosition, float(pcmWaveLength));
-		}
-		pcmPosition = newPCMPosition;
+		advancePCMPosition(freq);
 	} else {
 		// Render synthesised waveform
 		wavePos *= lastFreq / freq;
 		lastFreq = freq;
 
-		float resAmp = EXP2F(1.0f - (32 - resonance) / 4.0f);
-		{
-			//static const float resAmpFactor = EXP2F(-7);
-			//resAmp = EXP2I(resonance << 10) * resAmpFactor;
-		}
-
-		// The cutoffModifier may not be supposed to be directly added to the cutoff -
-		// it may for example need to be multiplied in some way.
-		// The 240 cutoffVal limit was determined via sample analysis (internal Munt capture IDs: glop3, glop4).
-		// More research is needed to be sure that this is correct, however.
-		float cutoffVal = cutoffRampVal / 262144.0f;
-		if (cutoffVal > MAX_CUTOFF_VALUE) {
-			cutoffVal = MAX_CUTOFF_VALUE;
+		if (cutoffRampVal != cachedCutoffRampVal) {
+			updateCutoff(cutoffRampVal);
 		}
-
-		// Wave length in samples
-		float waveLen = SAMPLE_RATE / freq;
+		const float cutoffVal = cachedCutoffVal;
+		const float waveLen = cachedWaveLen;
 
 		// Init cosineLen
 		float cosineLen = 0.5f * waveLen;
 		if (cutoffVal > MIDDLE_CUTOFF_VALUE) {
-			cosineLen *= EXP2F((cutoffVal - MIDDLE_CUTOFF_VALUE) / -16.0f); // found from sample analysis
+			cosineLen *= cachedCosineLenFactor;
 		}
 
 		// Start playing in center of first cosine segment
@@ -149,14 +230,7 @@ float LA32FloatWaveGenerator::generateNextSample(const Bit32u ampVal, const Bit1
 			relWavePos -= waveLen;
 		}
 
-		// Ratio of positive segment to wave length
-		float pulseLen = 0.5f;
-		if (pulseWidth > 128) {
-			pulseLen = EXP2F((64 - pulseWidth) / 64.0f);
-			//static const float pulseLenFactor = EXP2F(-192 / 64);
-			//pulseLen = EXP2I((256 - pulseWidthVal) << 6) * pulseLenFactor;
-		}
-		pulseLen *= waveLen;
+		float pulseLen = pulseLenFactor * waveLen;
 
 		float hLen = pulseLen - cosineLen;
 
@@ -165,11 +239,6 @@ float LA32FloatWaveGenerator::generateNextSample(const Bit32u ampVal, const Bit1
 			hLen = 0.0f;
 		}
 
-		// Correct resAmp for cutoff in range 50..66
-		if ((cutoffVal >= MIDDLE_CUTOFF_VALUE) && (cutoffVal < RESONANCE_DECAY_THRESHOLD_CUTOFF_VALUE)) {
-			resAmp *= sin(FLOAT_PI * (cutoffVal - MIDDLE_CUTOFF_VALUE) / 32.0f);
-		}
-
 		// Produce filtered square wave with 2 cosine waves on slopes
 
 		// 1st cosine segment
@@ -194,15 +263,14 @@ float LA32FloatWaveGenerator::generateNextSample(const Bit32u ampVal, const Bit1
 		if (cutoffVal < MIDDLE_CUTOFF_VALUE) {
 
 			// Attenuate samples below cutoff 50
-			// Found by sample analysis
-			sample *= EXP2F(-0.125f * (MIDDLE_CUTOFF_VALUE - cutoffVal));
+			sample *= cachedAttenuation;
 		} else {
 
 			// Add resonance sine. Effective for cutoff > 50 only
 			float resSample = 1.0f;
 
 			// Resonance decay speed factor
-			float resAmpDecayFactor = Tables::getInstance().resAmpDecayFactor[resonance >> 2];
+			float resAmpDecayFactor = baseResAmpDecayFactor;
 
 			// Now relWavePos counts from the middle of first cosine
 			relWavePos = wavePos;
@@ -248,7 +316,7 @@ float LA32FloatWaveGenerator::generateNextSample(const Bit32u ampVal, const Bit1
 				}
 			}
 
-			sample += resSample * resAmp * resAmpFade;
+			sample += resSample * cachedResAmp * resAmpFade;
 		}
 
 		// sawtooth waves
@@ -269,6 +337,90 @@ float LA32FloatWaveGenerator::generateNextSample(const Bit32u ampVal, const Bit1
 	return sample;
 }
 
+void LA32FloatWaveGenerator::advancePCMPosition(const float freq) {
+	float positionDelta = freq * 2048.0f / SAMPLE_RATE;
+	float newPCMPosition = pcmPosition + positionDelta;
+	if (pcmWaveLooped) {
+		newPCMPosition = fmod(newPCMPosition, float(pcmWaveLength));
+	}
+	pcmPosition = newPCMPosition;
+}
+
+void LA32FloatWaveGenerator::skipNextSample(const Bit16u pitch) {
+	if (!active || !isPCMWave()) {
+		return;
+	}
+	if (int(pcmPosition) >= int(pcmWaveLength) && !pcmWaveLooped) {
+		// Past the end of a non-looping PCM waveform, see generateNextSample()
+		deactivate();
+		return;
+	}
+	if (pitch != cachedPitch) {
+		updatePitch(pitch);
+	}
+	advancePCMPosition(cachedFreq);
+}
+
+void LA32FloatWaveGenerator::prepareSynthSample(LA32FloatSynthBlock &block, const Bit32u ix, const Bit32u ampVal, const Bit16u pitch, const Bit32u cutoffRampVal) {
+	// The wave position accumulates with respect to the changing frequency, so it must be tracked sample-by-sample.
+	if (pitch != cachedPitch) {
+		updatePitch(pitch);
+	}
+	const float freq = cachedFreq;
+	wavePos *= lastFreq / freq;
+	lastFreq = freq;
+
+	block.wavePos[ix] = wavePos;
+	block.waveLen[ix] = cachedWaveLen;
+	block.cutoffVal[ix] = getCutoffVal(cutoffRampVal);
+	block.ampLog[ix] = ampVal / -1024.0f / 4096.0f;
+
+	wavePos++;
+	if (wavePos > cachedWaveLen) {
+		wavePos -= cachedWaveLen;
+	}
+}
+
+void LA32FloatWaveGenerator::completeSynthBlock(LA32FloatSynthBlock &block, const Bit32u length) const {
+	// Padding the arrays keeps the unused vector lanes within sane values
+	for (Bit32u i = length; i < LA32_MAX_BLOCK_LENGTH && (i & 7) != 0; i++) {
+		block.wavePos[i] = 0.0f;
+		block.waveLen[i] = 1.0f;
+		block.cutoffVal[i] = MIDDLE_CUTOFF_VALUE;
+		block.ampLog[i] = 0.0f;
+	}
+
+	block.accuracy = accuracy;
+	block.sawtoothWaveform = sawtoothWaveform;
+	block.resAmp = baseResAmp;
+	block.pulseLenFactor = pulseLenFactor;
+	block.resAmpDecayFactor = baseResAmpDecayFactor;
+}
+
+bool LA32FloatWaveGenerator::canSynthesiseBlock() const {
+	return active && !isPCMWave() && accuracy != FloatWaveAccuracy_REFERENCE;
+}
+
+void LA32FloatWaveGenerator::prepareSynthBlock(LA32FloatSynthBlock &block, const LA32WGControlBlock &controls, const Bit32u length) {
+	for (Bit32u i = 0; i < length; i++) {
+		prepareSynthSample(block, i, controls.amp[i], controls.pitch[i], controls.cutoff[i]);
+	}
+	completeSynthBlock(block, length);
+}
+
+void LA32FloatWaveGenerator::generateNextSamples(float *outBuf, const LA32WGControlBlock &controls, const Bit32u length) {
+	if (!canSynthesiseBlock()) {
+		for (Bit32u i = 0; i < length; i++) {
+			outBuf[i] = generateNextSample(controls.amp[i], controls.pitch[i], controls.cutoff[i]);
+		}
+		return;
+	}
+
+	LA32FloatSynthBlock block;
+	prepareSynthBlock(block, controls, length);
+	LA32FloatWaveKernels::synthesise(outBuf, block, length);
+}
+
 void LA32FloatWaveGenerator::deactivate() {
 	active = false;
 }
@@ -281,6 +433,8 @@ bool LA32FloatWaveGenerator::isPCMWave() const {
 	return pcmWaveAddress != NULL;
 }
 
+LA32FloatPartialPair::LA32FloatPartialPair() : ringModulated(false), mixed(false), masterOutputSample(0.0f), slaveOutputSample(0.0f) {}
+
 void LA32FloatPartialPair::init(const bool useRingModulated, const bool useMixed) {
 	ringModulated = useRingModulated;
 	mixed = useMixed;
@@ -304,6 +458,11 @@ void LA32FloatPartialPair::initPCM(const PairType useMaster, const Bit16s *pcmWa
 	}
 }
 
+void LA32FloatPartialPair::setAccuracy(const FloatWaveAccuracy accuracy) {
+	master.setAccuracy(accuracy);
+	slave.setAccuracy(accuracy);
+}
+
 void LA32FloatPartialPair::generateNextSample(const PairType useMaster, const Bit32u amp, const Bit16u pitch, const Bit32u cutoff) {
 	if (useMaster == MASTER) {
 		masterOutputSample = master.generateNextSample(amp, pitch, cutoff);
@@ -312,6 +471,14 @@ void LA32FloatPartialPair::generateNextSample(const PairType useMaster, const Bi
 	}
 }
 
+void LA32FloatPartialPair::skipNextSample(const PairType useMaster, const Bit16u pitch) {
+	if (useMaster == MASTER) {
+		master.skipNextSample(pitch);
+	} else {
+		slave.skipNextSample(pitch);
+	}
+}
+
 static inline float produceDistortedSample(float sample) {
 	if (sample < -1.0f) {
 		return sample + 2.0f;
@@ -342,6 +509,39 @@ float LA32FloatPartialPair::nextOutSample() {
 	return 0.25f * (mixed ? masterOutputSample + ringModulatedSample : ringModulatedSample);
 }
 
+void LA32FloatPartialPair::generateNextSamples(float *outBuf, const LA32WGControlBlock &masterControls, const LA32WGControlBlock *slaveControls, const Bit32u length) {
+	// The WGs don't depend on each other, so each one renders the whole run in turn.
+	// The master output is kept in outBuf until it is mixed with the slave output.
+	float slaveBuf[LA32_MAX_BLOCK_LENGTH];
+	if (slaveControls != NULL && master.canSynthesiseBlock() && slave.canSynthesiseBlock()) {
+		// Both synth waves are handed to the kernels at once, so that short runs fill more vector lanes
+		LA32FloatSynthBlock masterBlock;
+		LA32FloatSynthBlock slaveBlock;
+		master.prepareSynthBlock(masterBlock, masterControls, length);
+		slave.prepareSynthBlock(slaveBlock, *slaveControls, length);
+		float * const outBufs[] = {outBuf, slaveBuf};
+		const LA32FloatSynthBlock * const blocks[] = {&masterBlock, &slaveBlock};
+		LA32FloatWaveKernels::synthesise(outBufs, blocks, 2, length);
+	} else {
+		master.generateNextSamples(outBuf, masterControls, length);
+		if (slaveControls != NULL) {
+			slave.generateNextSamples(slaveBuf, *slaveControls, length);
+		}
+	}
+	if (slaveControls == NULL) {
+		// The slave WG output stays unchanged during the run
+		for (Bit32u i = 0; i < length; i++) {
+			slaveBuf[i] = slaveOutputSample;
+		}
+	}
+	if (length > 0) {
+		// Keep the last WG output for nextOutSample()
+		masterOutputSample = outBuf[length - 1];
+		slaveOutputSample = slaveBuf[length - 1];
+	}
+	MixKernels::combinePair(outBuf, slaveBuf, length, ringModulated, mixed);
+}
+
 void LA32FloatPartialPair::deactivate(const PairType useMaster) {
 	if (useMaster == MASTER) {
 		master.deactivate();
@@ -356,4 +556,63 @@ bool LA32FloatPartialPair::isActive(const PairType useMaster) const {
 	return useMaster == MASTER ? master.isActive() : slave.isActive();
 }
 
+void LA32FloatWaveGenerator::saveState(StateWriter &writer) const {
+	writer.writeBool(active);
+	if (!active) return;
+	writer.writeBool(isPCMWave());
+	if (isPCMWave()) {
+		writer.writeUInt32(pcmWaveLength);
+		writer.writePCMRef(pcmWaveAddress);
+		writer.writeBool(pcmWaveLooped);
+		writer.writeBool(pcmWaveInterpolated);
+		writer.writeFloat(pcmPosition);
+		return;
+	}
+	writer.writeBool(sawtoothWaveform);
+	writer.writeUInt8(resonance);
+	writer.writeUInt8(pulseWidth);
+	writer.writeFloat(wavePos);
+	writer.writeFloat(lastFreq);
+}
+
+void LA32FloatWaveGenerator::restoreState(StateReader &reader) {
+	active = reader.readBool();
+	if (!active) return;
+	if (reader.readBool()) {
+		pcmWaveLength = reader.readUInt32();
+		pcmWaveAddress = reader.readPCMRef(pcmWaveLength);
+		pcmWaveLooped = reader.readBool();
+		pcmWaveInterpolated = reader.readBool();
+		pcmPosition = reader.readFloat();
+		if (pcmWaveAddress == NULL || pcmWaveLength == 0 || !(pcmPosition >= 0.0f && pcmPosition < float(pcmWaveLength))) reader.fail();
+		resetCachedParameters();
+		return;
+	}
+	pcmWaveAddress = NULL;
+	sawtoothWaveform = reader.readBool();
+	resonance = reader.readUInt8();
+	pulseWidth = reader.readUInt8();
+	wavePos = reader.readFloat();
+	lastFreq = reader.readFloat();
+	resetCachedParameters();
+}
+
+void LA32FloatPartialPair::saveState(StateWriter &writer) const {
+	writer.writeBool(ringModulated);
+	writer.writeBool(mixed);
+	writer.writeFloat(masterOutputSample);
+	writer.writeFloat(slaveOutputSample);
+	master.saveState(writer);
+	slave.saveState(writer);
+}
+
+void LA32FloatPartialPair::restoreState(StateReader &reader) {
+	ringModulated = reader.readBool();
+	mixed = reader.readBool();
+	masterOutputSample = reader.readFloat();
+	slaveOutputSample = reader.readFloat();
+	master.restoreState(reader);
+	slave.restoreState(reader);
+}
+
 } // namespace MT32Emu
@@ -21,10 +21,13 @@
 #include "globals.h"
 #include "internals.h"
 #include "Types.h"
+#include "Enumerations.h"
 #include "LA32WaveGenerator.h"
 
 namespace MT32Emu {
 
+struct LA32FloatSynthBlock;
+
 /**
  * LA32WaveGenerator is aimed to represent the exact model of LA32 wave generator.
  * The output square wave is created by adding high / low linear segments in-between
@@ -72,18 +75,67 @@ class LA32FloatWaveGenerator {
 	float lastFreq;
 	float pcmPosition;
 
+	FloatWaveAccuracy accuracy;
+
+	// Parameters derived from the invariant parameters of synth partials
+	float baseResAmp;
+	float pulseLenFactor;
+	float baseResAmpDecayFactor;
+
+	// Parameters derived from the inputs of the last generated sample, only recomputed when the inputs change
+	Bit32u cachedAmpVal;
+	float cachedAmp;
+	Bit16u cachedPitch;
+	float cachedFreq;
+	float cachedWaveLen;
+	Bit32u cachedCutoffRampVal;
+	float cachedCutoffVal;
+	float cachedCosineLenFactor;
+	float cachedAttenuation;
+	float cachedResAmp;
+
+	void updateAmp(const Bit32u ampVal);
+	void updatePitch(const Bit16u pitch);
+	void updateCutoff(const Bit32u cutoffRampVal);
+	void resetCachedParameters();
+
 	float getPCMSample(unsigned int position);
+	void advancePCMPosition(const float freq);
+
+	// Advances the wave position exactly as generateNextSample() does and stores the state for the sample ix to the block
+	void prepareSynthSample(LA32FloatSynthBlock &block, const Bit32u ix, const Bit32u ampVal, const Bit16u pitch, const Bit32u cutoffRampVal);
+	// Pads the arrays of the block prepared for length samples and sets up the invariant parameters
+	void completeSynthBlock(LA32FloatSynthBlock &block, const Bit32u length) const;
 
 public:
+	LA32FloatWaveGenerator();
+
 	// Initialise the WG engine for generation of synth partial samples and set up the invariant parameters
 	void initSynth(const bool sawtoothWaveform, const Bit8u pulseWidth, const Bit8u resonance);
 
 	// Initialise the WG engine for generation of PCM partial samples and set up the invariant parameters
 	void initPCM(const Bit16s * const pcmWaveAddress, const Bit32u pcmWaveLength, const bool pcmWaveLooped, const bool pcmWaveInterpolated);
 
+	// Select the accuracy of the transcendental functions used to synthesise the square and sawtooth waves
+	void setAccuracy(const FloatWaveAccuracy accuracy);
+
 	// Update parameters with respect to TVP, TVA and TVF, and generate next sample
 	float generateNextSample(const Bit32u amp, const Bit16u pitch, const Bit32u cutoff);
 
+	// Generate a run of samples using the values of amp, pitch and cutoff precomputed for each sample
+	void generateNextSamples(float *outBuf, const LA32WGControlBlock &controls, const Bit32u length);
+
+	// Returns true if the next run of samples can be rendered by the synthesis kernels rather than sample-by-sample
+	bool canSynthesiseBlock() const;
+
+	// Advance the wave position through a run of samples as generateNextSamples() does, yet only prepare the block
+	// for the synthesis kernels instead of rendering it. Requires canSynthesiseBlock() to be true
+	void prepareSynthBlock(LA32FloatSynthBlock &block, const LA32WGControlBlock &controls, const Bit32u length);
+
+	// Advance the PCM wave position with respect to TVP as generateNextSample() does, yet skip generating the sample.
+	// The position of synth waves is left intact
+	void skipNextSample(const Bit16u pitch);
+
 	// Deactivate the WG engine
 	void deactivate();
 
@@ -92,6 +144,9 @@ public:
 
 	// Return true if the WG engine generates PCM wave samples
 	bool isPCMWave() const;
+
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 }; // class LA32FloatWaveGenerator
 
 class LA32FloatPartialPair : public LA32PartialPair {
@@ -103,6 +158,8 @@ class LA32FloatPartialPair : public LA32PartialPair {
 	float slaveOutputSample;
 
 public:
+	LA32FloatPartialPair();
+
 	// ringModulated should be set to false for the structures with mixing or stereo output
 	// ringModulated should be set to true for the structures with ring modulation
 	// mixed is used for the structures with ring modulation and indicates whether the master partial output is mixed to the ring modulator output
@@ -114,17 +171,31 @@ public:
 	// Initialise the WG engine for generation of PCM partial samples and set up the invariant parameters
 	void initPCM(const PairType master, const Bit16s * const pcmWaveAddress, const Bit32u pcmWaveLength, const bool pcmWaveLooped);
 
+	// Select the accuracy of the transcendental functions used by both WGs to synthesise the square and sawtooth waves
+	void setAccuracy(const FloatWaveAccuracy accuracy);
+
 	// Update parameters with respect to TVP, TVA and TVF, and generate next sample
 	void generateNextSample(const PairType master, const Bit32u amp, const Bit16u pitch, const Bit32u cutoff);
 
+	// Advance the PCM wave position with respect to TVP, yet skip generating the sample
+	void skipNextSample(const PairType master, const Bit16u pitch);
+
 	// Perform mixing / ring modulation and return the result
 	float nextOutSample();
 
+	// Generate a run of samples using the values of amp, pitch and cutoff precomputed for each WG,
+	// perform mixing / ring modulation and store the result in outBuf.
+	// slaveControls is NULL when the slave WG isn't used in the structure.
+	void generateNextSamples(float *outBuf, const LA32WGControlBlock &masterControls, const LA32WGControlBlock *slaveControls, const Bit32u length);
+
 	// Deactivate the WG engine
 	void deactivate(const PairType master);
 
 	// Return active state of the WG engine
 	bool isActive(const PairType master) const;
+
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 }; // class LA32FloatPartialPair
 
 } // namespace MT32Emu
@@ -0,0 +1,196 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+#include <cstring>
+
+#include "internals.h"
+
+#include "LA32FloatWaveKernels.h"
+#include "CPUFeatures.h"
+#include "SIMDDispatch.h"
+#include "LA32FloatWaveKernelsImpl.h"
+
+namespace MT32Emu {
+
+namespace LA32FloatWaveKernels {
+
+typedef void (*Synthesiser)(float *outBuf, const LA32FloatSynthBlock &block, const Bit32u length);
+typedef void (*BlockSynthesiser)(float * const *outBufs, const LA32FloatSynthBlock * const *blocks, const Bit32u blockCount, const Bit32u length);
+
+struct Implementation {
+	const char *instructionSetName;
+	Synthesiser synthesiser;
+	BlockSynthesiser blockSynthesiser;
+};
+
+// Single-lane vectors of plain floats. The operations round exactly as the corresponding SIMD instructions do,
+// so that the output doesn't depend on the instruction set.
+class ScalarVector {
+public:
+	typedef float Float;
+	typedef Bit32s Int;
+	typedef bool Mask;
+
+	static const Bit32u WIDTH = 1;
+
+	static inline Float load(const float *data) { return *data; }
+	static inline void store(float *data, const Float v) { *data = v; }
+	static inline Float set(const float value) { return value; }
+
+	static inline Float add(const Float a, const Float b) { return a + b; }
+	static inline Float sub(const Float a, const Float b) { return a - b; }
+	static inline Float mul(const Float a, const Float b) { return a * b; }
+	static inline Float div(const Float a, const Float b) { return a / b; }
+	static inline Float min(const Float a, const Float b) { return a < b ? a : b; }
+	static inline Float max(const Float a, const Float b) { return a > b ? a : b; }
+
+	static inline Mask less(const Float a, const Float b) { return a < b; }
+	static inline Mask lessOrEqual(const Float a, const Float b) { return a <= b; }
+	static inline Float select(const Mask mask, const Float a, const Float b) { return mask ? a : b; }
+	static inline Mask maskAnd(const Mask a, const Mask b) { return a && b; }
+	static inline bool anyOf(const Mask mask) { return mask; }
+	static inline bool allOf(const Mask mask) { return mask; }
+
+	static inline Float floor(const Float x) {
+		const Float truncated = Float(Int(x));
+		return truncated > x ? truncated - 1.0f : truncated;
+	}
+	static inline Int roundToInt(const Float x) {
+		// Ties are rounded away from zero rather than to even, which makes no difference for the reduction of the argument
+		return Int(x < 0.0f ? x - 0.5f : x + 0.5f);
+	}
+	static inline Float toFloat(const Int k) { return Float(k); }
+	static inline Float powerOfTwo(const Float n) {
+		const Bit32u bits = Bit32u(Int(n) + 127) << 23;
+		Float result;
+		memcpy(&result, &bits, sizeof result);
+		return result;
+	}
+	static inline Float negateIfOdd(const Float x, const Int k) { return (k & 1) != 0 ? -x : x; }
+};
+
+static void synthesiseScalar(float *outBuf, const LA32FloatSynthBlock &block, const Bit32u length) {
+	synthesiseVectors<ScalarVector>(outBuf, block, length);
+}
+
+static void synthesiseBlocksScalar(float * const *outBufs, const LA32FloatSynthBlock * const *blocks, const Bit32u blockCount, const Bit32u length) {
+	synthesiseBlockVectors<ScalarVector>(outBufs, blocks, blockCount, length);
+}
+
+#if MT32EMU_SIMD_SSE2
+
+class SSE2Vector {
+public:
+	typedef __m128 Float;
+	typedef __m128i Int;
+	typedef __m128 Mask;
+
+	static const Bit32u WIDTH = 4;
+
+	static inline Float load(const float *data) { return _mm_loadu_ps(data); }
+	static inline void store(float *data, const Float v) { _mm_storeu_ps(data, v); }
+	static inline Float set(const float value) { return _mm_set1_ps(value); }
+
+	static inline Float add(const Float a, const Float b) { return _mm_add_ps(a, b); }
+	static inline Float sub(const Float a, const Float b) { return _mm_sub_ps(a, b); }
+	static inline Float mul(const Float a, const Float b) { return _mm_mul_ps(a, b); }
+	static inline Float div(const Float a, const Float b) { return _mm_div_ps(a, b); }
+	static inline Float min(const Float a, const Float b) { return _mm_min_ps(a, b); }
+	static inline Float max(const Float a, const Float b) { return _mm_max_ps(a, b); }
+
+	static inline Mask less(const Float a, const Float b) { return _mm_cmplt_ps(a, b); }
+	static inline Mask lessOrEqual(const Float a, const Float b) { return _mm_cmple_ps(a, b); }
+	static inline Float select(const Mask mask, const Float a, const Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	static inline Mask maskAnd(const Mask a, const Mask b) { return _mm_and_ps(a, b); }
+	static inline bool anyOf(const Mask mask) { return _mm_movemask_ps(mask) != 0; }
+	static inline bool allOf(const Mask mask) { return _mm_movemask_ps(mask) == 0xF; }
+
+	static inline Float floor(const Float x) {
+		const Float truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+		return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+	}
+	static inline Int roundToInt(const Float x) { return _mm_cvtps_epi32(x); }
+	static inline Float toFloat(const Int k) { return _mm_cvtepi32_ps(k); }
+	static inline Float powerOfTwo(const Float n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23)); }
+	static inline Float negateIfOdd(const Float x, const Int k) { return _mm_xor_ps(x, _mm_castsi128_ps(_mm_slli_epi32(k, 31))); }
+};
+
+static void synthesiseSSE2(float *outBuf, const LA32FloatSynthBlock &block, const Bit32u length) {
+	synthesiseVectors<SSE2Vector>(outBuf, block, length);
+}
+
+static void synthesiseBlocksSSE2(float * const *outBufs, const LA32FloatSynthBlock * const *blocks, const Bit32u blockCount, const Bit32u length) {
+	synthesiseBlockVectors<SSE2Vector>(outBufs, blocks, blockCount, length);
+}
+
+#endif // #if MT32EMU_SIMD_SSE2
+
+static Implementation createImplementation(const SIMDInstructionSet instructionSet) {
+	Implementation implementation;
+#if MT32EMU_WITH_AVX2_KERNELS && MT32EMU_SIMD_AVX2
+	if (instructionSet == SIMDInstructionSet_AVX2) {
+		implementation.instructionSetName = "AVX2";
+		implementation.synthesiser = synthesiseAVX2;
+		implementation.blockSynthesiser = synthesiseBlocksAVX2;
+		return implementation;
+	}
+#endif
+#if MT32EMU_WITH_SSE41_KERNELS && MT32EMU_SIMD_AVX2
+	if (instructionSet == SIMDInstructionSet_SSE4_1 || instructionSet == SIMDInstructionSet_AVX2) {
+		implementation.instructionSetName = "SSE4.1";
+		implementation.synthesiser = synthesiseSSE41;
+		implementation.blockSynthesiser = synthesiseBlocksSSE41;
+		return implementation;
+	}
+#endif
+#if MT32EMU_SIMD_SSE2
+	if (instructionSet != SIMDInstructionSet_NONE) {
+		implementation.instructionSetName = "SSE2";
+		implementation.synthesiser = synthesiseSSE2;
+		implementation.blockSynthesiser = synthesiseBlocksSSE2;
+		return implementation;
+	}
+#endif
+	implementation.instructionSetName = "none";
+	implementation.synthesiser = synthesiseScalar;
+	implementation.blockSynthesiser = synthesiseBlocksScalar;
+	return implementation;
+}
+
+// Selected during static initialisation and only re-selected by SIMDDispatch while no synth is rendering,
+// so that no synchronisation is needed.
+static Implementation implementation = createImplementation(SIMDDispatch::getSupportedInstructionSet());
+
+void selectImplementation(const SIMDInstructionSet instructionSet) {
+	implementation = createImplementation(instructionSet);
+}
+
+void synthesise(float *outBuf, const LA32FloatSynthBlock &block, const Bit32u length) {
+	implementation.synthesiser(outBuf, block, length);
+}
+
+void synthesise(float * const *outBufs, const LA32FloatSynthBlock * const *blocks, const Bit32u blockCount, const Bit32u length) {
+	implementation.blockSynthesiser(outBufs, blocks, blockCount, length);
+}
+
+const char *getInstructionSetName() {
+	return implementation.instructionSetName;
+}
+
+} // namespace LA32FloatWaveKernels
+
+} // namespace MT32Emu
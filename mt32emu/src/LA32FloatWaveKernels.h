@@ -0,0 +1,69 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_LA32_FLOAT_WAVE_KERNELS_H
+#define MT32EMU_LA32_FLOAT_WAVE_KERNELS_H
+
+#include "internals.h"
+#include "Enumerations.h"
+#include "LA32WaveGenerator.h"
+
+namespace MT32Emu {
+
+// The state of a synth wave generator prepared sample-by-sample for a run of samples, along with the invariant parameters.
+// The arrays are padded, so that the kernels may process the entire vectors.
+struct LA32FloatSynthBlock {
+	// Position within the wave and the wave length in samples
+	float wavePos[LA32_MAX_BLOCK_LENGTH];
+	float waveLen[LA32_MAX_BLOCK_LENGTH];
+	// Cutoff value, limited to MAX_CUTOFF_VALUE
+	float cutoffVal[LA32_MAX_BLOCK_LENGTH];
+	// Binary logarithm of the amp
+	float ampLog[LA32_MAX_BLOCK_LENGTH];
+
+	FloatWaveAccuracy accuracy;
+	bool sawtoothWaveform;
+	float resAmp;
+	// Ratio of positive segment to wave length
+	float pulseLenFactor;
+	float resAmpDecayFactor;
+};
+
+// Kernels that synthesise square and sawtooth waves with resonance several samples at once, following exactly the same model
+// as LA32FloatWaveGenerator::generateNextSample() does in the reference mode. The trigonometric and exponential functions
+// are approximated with polynomials of the degree that suits the accuracy requested in the block.
+namespace LA32FloatWaveKernels {
+
+// Selects the implementation for the specified instruction set. Must not be invoked while synthesis is in progress.
+// The plain C++ implementation is used when the instruction set is none.
+void selectImplementation(SIMDInstructionSet instructionSet);
+
+// Renders length samples (which shall not exceed LA32_MAX_BLOCK_LENGTH) to outBuf.
+void synthesise(float *outBuf, const LA32FloatSynthBlock &block, const Bit32u length);
+
+// Renders length samples of each of blockCount blocks to the respective output buffers. The blocks must be prepared
+// for the same run length and with the same accuracy. Short runs are synthesised with the blocks side by side,
+// one block per vector lane, so that the vectors are filled even when the run is shorter than the vector width.
+void synthesise(float * const *outBufs, const LA32FloatSynthBlock * const *blocks, const Bit32u blockCount, const Bit32u length);
+
+// Returns the name of the instruction set used by the selected implementation, for diagnostic purposes.
+const char *getInstructionSetName();
+
+} // namespace LA32FloatWaveKernels
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_LA32_FLOAT_WAVE_KERNELS_H
@@ -0,0 +1,321 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_LA32_FLOAT_WAVE_KERNELS_IMPL_H
+#define MT32EMU_LA32_FLOAT_WAVE_KERNELS_IMPL_H
+
+#include "LA32FloatWaveKernels.h"
+
+// This file provides the implementation of the kernels that is generic to the vector types.
+// It is included by the source files that compile the kernels for a specific instruction set,
+// each of which provides a class V of static functions that operate on the vectors as follows:
+// - V::Float, V::Int, V::Mask are the vector types of floats, integers and comparison results;
+// - V::WIDTH is the number of lanes;
+// - load(), store(), set() transfer data;
+// - add(), sub(), mul(), div(), min(), max() perform float arithmetic;
+// - less(), lessOrEqual() compare floats;
+// - select(mask, a, b) returns the lanes of a where the mask is set and the lanes of b otherwise;
+// - maskAnd() combines masks, anyOf() returns true if the mask is set in any lane, allOf() in all lanes;
+// - floor() rounds floats down, roundToInt() converts floats to the nearest integers and toFloat() converts back;
+// - powerOfTwo(n) returns 2^n for integral floats n in range [-126, 127];
+// - negateIfOdd(x, k) returns -x in lanes where the integer k is odd.
+// Everything has internal linkage, so that instantiations for different instruction sets never get mixed.
+
+namespace MT32Emu {
+
+namespace LA32FloatWaveKernels {
+
+static const float MIDDLE_CUTOFF_VALUE = 128.0f;
+static const float RESONANCE_DECAY_THRESHOLD_CUTOFF_VALUE = 144.0f;
+
+// Computes 2^x. Arguments below -126 are clamped, so the result remains a normal float.
+// The fast variant uses a polynomial of lower degree, see FloatWaveAccuracy.
+template <class V, bool fast>
+static inline typename V::Float exp2(const typename V::Float x) {
+	const typename V::Float clampedX = V::max(x, V::set(-126.0f));
+	const typename V::Float n = V::floor(clampedX);
+	const typename V::Float f = V::sub(clampedX, n);
+	typename V::Float p;
+	if (fast) {
+		// Minimax approximation of 2^f in range [0, 1), relative error below 3e-6
+		p = V::set(1.353416126e-02f);
+		p = V::add(V::mul(p, f), V::set(5.201147869e-02f));
+		p = V::add(V::mul(p, f), V::set(2.414427400e-01f));
+		p = V::add(V::mul(p, f), V::set(6.930038333e-01f));
+		p = V::add(V::mul(p, f), V::set(1.000002623e+00f));
+	} else {
+		// Minimax approximation of 2^f in range [0, 1), relative error below 8e-8
+		p = V::set(1.876232911e-03f);
+		p = V::add(V::mul(p, f), V::set(8.992584126e-03f));
+		p = V::add(V::mul(p, f), V::set(5.582360437e-02f));
+		p = V::add(V::mul(p, f), V::set(2.401545299e-01f));
+		p = V::add(V::mul(p, f), V::set(6.931529682e-01f));
+		p = V::add(V::mul(p, f), V::set(9.999999269e-01f));
+	}
+	return V::mul(p, V::powerOfTwo(n));
+}
+
+// Computes sin(PI * x). The argument is reduced exactly, so this is accurate for all samples of a wave
+// unlike sin(FLOAT_PI * x), which suffers from rounding of the product.
+template <class V, bool fast>
+static inline typename V::Float sinPi(const typename V::Float x) {
+	const typename V::Int k = V::roundToInt(x);
+	const typename V::Float r = V::sub(x, V::toFloat(k));
+	const typename V::Float r2 = V::mul(r, r);
+	typename V::Float p;
+	if (fast) {
+		// Minimax approximation of sin(PI * r) / r in range [-0.5, 0.5], absolute error of the sine below 8e-7
+		p = V::set(-5.546359420e-01f);
+		p = V::add(V::mul(p, r2), V::set(2.541898966e+00f));
+		p = V::add(V::mul(p, r2), V::set(-5.167142868e+00f));
+		p = V::add(V::mul(p, r2), V::set(3.141582012e+00f));
+	} else {
+		// Minimax approximation of sin(PI * r) / r in range [-0.5, 0.5], relative error below 1e-8
+		p = V::set(7.765525780e-02f);
+		p = V::add(V::mul(p, r2), V::set(-5.982943390e-01f));
+		p = V::add(V::mul(p, r2), V::set(2.550079146e+00f));
+		p = V::add(V::mul(p, r2), V::set(-5.167710289e+00f));
+		p = V::add(V::mul(p, r2), V::set(3.141592646e+00f));
+	}
+	return V::negateIfOdd(V::mul(p, r), k);
+}
+
+template <class V, bool fast>
+static inline typename V::Float cosPi(const typename V::Float x) {
+	return sinPi<V, fast>(V::add(x, V::set(0.5f)));
+}
+
+template <class V>
+static inline typename V::Float negate(const typename V::Float x) {
+	return V::sub(V::set(0.0f), x);
+}
+
+// The invariant parameters of the blocks synthesised in the lanes. The sample-parallel kernels broadcast the parameters
+// of a single block to all lanes, while the block-parallel kernels load them from a different block in each lane.
+template <class V>
+struct VectorParameters {
+	typename V::Float resAmp;
+	typename V::Float pulseLenFactor;
+	typename V::Float resAmpDecayFactor;
+	typename V::Mask sawtoothWaveform;
+	bool anySawtoothWaveform;
+};
+
+// See LA32FloatWaveGenerator::generateNextSample() for the explanation of the model.
+// The branches are replaced with selection of lanes, the branches that are rarely taken are skipped
+// when none of the lanes need them.
+template <class V, bool fast>
+static inline typename V::Float synthesiseVector(const VectorParameters<V> &params, const typename V::Float wavePos,
+	const typename V::Float waveLen, const typename V::Float cutoffVal, const typename V::Float ampLog)
+{
+	typedef typename V::Float Float;
+	typedef typename V::Mask Mask;
+
+	const Float zero = V::set(0.0f);
+	const Float half = V::set(0.5f);
+	const Float middleCutoff = V::set(MIDDLE_CUTOFF_VALUE);
+
+	Float cosineLen = V::mul(half, waveLen);
+	const Mask highCutoff = V::less(middleCutoff, cutoffVal);
+	if (V::anyOf(highCutoff)) {
+		const Float cosineLenFactor = exp2<V, fast>(V::div(V::sub(cutoffVal, middleCutoff), V::set(-16.0f)));
+		cosineLen = V::select(highCutoff, V::mul(cosineLen, cosineLenFactor), cosineLen);
+	}
+	const Float halfCosineLen = V::mul(half, cosineLen);
+
+	Float relWavePos = V::add(wavePos, halfCosineLen);
+	relWavePos = V::select(V::less(waveLen, relWavePos), V::sub(relWavePos, waveLen), relWavePos);
+
+	const Float pulseLen = V::mul(params.pulseLenFactor, waveLen);
+	const Float hLen = V::max(V::sub(pulseLen, cosineLen), zero);
+	const Float cosineAndHLen = V::add(cosineLen, hLen);
+
+	// Filtered square wave with 2 cosine segments on slopes
+	const Mask firstCosineSegment = V::less(relWavePos, cosineLen);
+	const Mask highLinearSegment = V::less(relWavePos, cosineAndHLen);
+	const Mask secondCosineSegment = V::less(relWavePos, V::add(V::add(cosineLen, cosineLen), hLen));
+	const Float cosineSegmentPos = V::select(firstCosineSegment, relWavePos, V::sub(relWavePos, cosineAndHLen));
+	const Float cosine = cosPi<V, fast>(V::div(cosineSegmentPos, cosineLen));
+	const Float one = V::set(1.0f);
+	Float sample = V::select(secondCosineSegment, cosine, negate<V>(one));
+	sample = V::select(highLinearSegment, one, sample);
+	sample = V::select(firstCosineSegment, negate<V>(cosine), sample);
+
+	const Mask lowCutoff = V::less(cutoffVal, middleCutoff);
+	Float attenuatedSample = sample;
+	if (V::anyOf(lowCutoff)) {
+		const Float attenuation = exp2<V, fast>(V::mul(V::set(-0.125f), V::sub(middleCutoff, cutoffVal)));
+		attenuatedSample = V::mul(sample, attenuation);
+	}
+	if (V::allOf(lowCutoff)) {
+		sample = attenuatedSample;
+	} else {
+		// Resonance sine amp corrected for cutoff in range 50..66
+		Float resAmp = params.resAmp;
+		const Mask resAmpCorrected = V::maskAnd(V::lessOrEqual(middleCutoff, cutoffVal), V::less(cutoffVal, V::set(RESONANCE_DECAY_THRESHOLD_CUTOFF_VALUE)));
+		if (V::anyOf(resAmpCorrected)) {
+			const Float resAmpFactor = sinPi<V, fast>(V::div(V::sub(cutoffVal, middleCutoff), V::set(32.0f)));
+			resAmp = V::select(resAmpCorrected, V::mul(resAmp, resAmpFactor), resAmp);
+		}
+
+		// Resonance sine WG, counting from the middle of first cosine
+		const Mask positiveResonanceSegment = V::less(wavePos, cosineAndHLen);
+		const Float resonancePos = V::select(positiveResonanceSegment, wavePos, V::sub(wavePos, cosineAndHLen));
+		const Float resonancePhase = V::div(resonancePos, cosineLen);
+		const Float resSine = sinPi<V, fast>(resonancePhase);
+		const Float resSample = V::select(positiveResonanceSegment, resSine, negate<V>(resSine));
+
+		// Resonance sine amp, decaying a bit faster in the negative segments
+		const Float resAmpDecayFactor = V::select(positiveResonanceSegment, params.resAmpDecayFactor, V::add(params.resAmpDecayFactor, V::set(0.25f)));
+		Float resAmpFade = exp2<V, fast>(V::mul(V::mul(V::set(-0.125f), resAmpDecayFactor), resonancePhase));
+
+		// Window position, negative to the left from center of any cosine
+		Float windowPos = V::select(V::less(wavePos, V::add(hLen, halfCosineLen)), wavePos, V::sub(wavePos, cosineAndHLen));
+		windowPos = V::select(V::less(wavePos, V::sub(waveLen, halfCosineLen)), windowPos, V::sub(wavePos, waveLen));
+		const Mask windowed = V::less(windowPos, halfCosineLen);
+		if (V::anyOf(windowed)) {
+			const Float syncSine = sinPi<V, fast>(V::div(windowPos, cosineLen));
+			const Float window = V::select(V::less(windowPos, zero), V::mul(syncSine, syncSine), syncSine);
+			resAmpFade = V::select(windowed, V::mul(resAmpFade, window), resAmpFade);
+		}
+
+		const Float resonatedSample = V::add(sample, V::mul(V::mul(resSample, resAmp), resAmpFade));
+		sample = V::select(lowCutoff, attenuatedSample, resonatedSample);
+	}
+
+	if (params.anySawtoothWaveform) {
+		const Float sawtoothSample = V::mul(sample, cosPi<V, fast>(V::div(V::add(wavePos, wavePos), waveLen)));
+		sample = V::select(params.sawtoothWaveform, sawtoothSample, sample);
+	}
+
+	return V::mul(sample, exp2<V, fast>(ampLog));
+}
+
+template <class V, bool fast>
+static inline typename V::Float synthesiseVector(const VectorParameters<V> &params, const LA32FloatSynthBlock &block, const Bit32u ix) {
+	return synthesiseVector<V, fast>(params, V::load(block.wavePos + ix), V::load(block.waveLen + ix), V::load(block.cutoffVal + ix), V::load(block.ampLog + ix));
+}
+
+template <class V, bool fast>
+static void synthesiseRun(float *outBuf, const LA32FloatSynthBlock &block, const Bit32u length) {
+	VectorParameters<V> params;
+	params.resAmp = V::set(block.resAmp);
+	params.pulseLenFactor = V::set(block.pulseLenFactor);
+	params.resAmpDecayFactor = V::set(block.resAmpDecayFactor);
+	params.sawtoothWaveform = V::less(V::set(0.0f), V::set(block.sawtoothWaveform ? 1.0f : 0.0f));
+	params.anySawtoothWaveform = block.sawtoothWaveform;
+
+	Bit32u ix = 0;
+	for (; ix + V::WIDTH <= length; ix += V::WIDTH) {
+		V::store(outBuf + ix, synthesiseVector<V, fast>(params, block, ix));
+	}
+	if (ix < length) {
+		float lastSamples[V::WIDTH];
+		V::store(lastSamples, synthesiseVector<V, fast>(params, block, ix));
+		for (Bit32u i = 0; ix < length; i++, ix++) {
+			outBuf[ix] = lastSamples[i];
+		}
+	}
+}
+
+template <class V>
+static void synthesiseVectors(float *outBuf, const LA32FloatSynthBlock &block, const Bit32u length) {
+	if (block.accuracy == FloatWaveAccuracy_FAST) {
+		synthesiseRun<V, true>(outBuf, block, length);
+	} else {
+		synthesiseRun<V, false>(outBuf, block, length);
+	}
+}
+
+// Synthesises up to V::WIDTH blocks side by side, one block per lane, advancing all of them by a sample per vector.
+// The unused lanes repeat the first block, their output is discarded.
+template <class V, bool fast>
+static void synthesiseLanes(float * const *outBufs, const LA32FloatSynthBlock * const *blocks, const Bit32u blockCount, const Bit32u length) {
+	float resAmp[V::WIDTH], pulseLenFactor[V::WIDTH], resAmpDecayFactor[V::WIDTH], sawtoothWaveform[V::WIDTH];
+	const LA32FloatSynthBlock *laneBlocks[V::WIDTH];
+	bool anySawtoothWaveform = false;
+	for (Bit32u lane = 0; lane < V::WIDTH; lane++) {
+		const LA32FloatSynthBlock &block = *blocks[lane < blockCount ? lane : 0];
+		laneBlocks[lane] = &block;
+		resAmp[lane] = block.resAmp;
+		pulseLenFactor[lane] = block.pulseLenFactor;
+		resAmpDecayFactor[lane] = block.resAmpDecayFactor;
+		sawtoothWaveform[lane] = block.sawtoothWaveform ? 1.0f : 0.0f;
+		anySawtoothWaveform |= block.sawtoothWaveform;
+	}
+	VectorParameters<V> params;
+	params.resAmp = V::load(resAmp);
+	params.pulseLenFactor = V::load(pulseLenFactor);
+	params.resAmpDecayFactor = V::load(resAmpDecayFactor);
+	params.sawtoothWaveform = V::less(V::set(0.0f), V::load(sawtoothWaveform));
+	params.anySawtoothWaveform = anySawtoothWaveform;
+
+	for (Bit32u ix = 0; ix < length; ix++) {
+		float wavePos[V::WIDTH], waveLen[V::WIDTH], cutoffVal[V::WIDTH], ampLog[V::WIDTH], samples[V::WIDTH];
+		for (Bit32u lane = 0; lane < V::WIDTH; lane++) {
+			wavePos[lane] = laneBlocks[lane]->wavePos[ix];
+			waveLen[lane] = laneBlocks[lane]->waveLen[ix];
+			cutoffVal[lane] = laneBlocks[lane]->cutoffVal[ix];
+			ampLog[lane] = laneBlocks[lane]->ampLog[ix];
+		}
+		V::store(samples, synthesiseVector<V, fast>(params, V::load(wavePos), V::load(waveLen), V::load(cutoffVal), V::load(ampLog)));
+		for (Bit32u lane = 0; lane < blockCount; lane++) {
+			outBufs[lane][ix] = samples[lane];
+		}
+	}
+}
+
+// Synthesises several blocks prepared for the same run length. When the run is short compared to the vector width,
+// most lanes would remain idle if the blocks were synthesised one after another, so the blocks are rather spread
+// across the lanes. All the blocks must be prepared with the same accuracy.
+template <class V>
+static void synthesiseBlockVectors(float * const *outBufs, const LA32FloatSynthBlock * const *blocks, const Bit32u blockCount, const Bit32u length) {
+	const Bit32u vectorsPerBlock = (length + V::WIDTH - 1) / V::WIDTH;
+	const Bit32u laneGroupCount = (blockCount + V::WIDTH - 1) / V::WIDTH;
+	if (laneGroupCount * length >= blockCount * vectorsPerBlock) {
+		for (Bit32u i = 0; i < blockCount; i++) {
+			synthesiseVectors<V>(outBufs[i], *blocks[i], length);
+		}
+		return;
+	}
+	const bool fast = blocks[0]->accuracy == FloatWaveAccuracy_FAST;
+	for (Bit32u i = 0; i < blockCount; i += V::WIDTH) {
+		const Bit32u laneCount = blockCount - i < V::WIDTH ? blockCount - i : V::WIDTH;
+		if (fast) {
+			synthesiseLanes<V, true>(outBufs + i, blocks + i, laneCount, length);
+		} else {
+			synthesiseLanes<V, false>(outBufs + i, blocks + i, laneCount, length);
+		}
+	}
+}
+
+#if MT32EMU_WITH_SSE41_KERNELS
+// Provided by a separate source file compiled for SSE4.1.
+void synthesiseSSE41(float *outBuf, const LA32FloatSynthBlock &block, const Bit32u length);
+void synthesiseBlocksSSE41(float * const *outBufs, const LA32FloatSynthBlock * const *blocks, const Bit32u blockCount, const Bit32u length);
+#endif
+
+#if MT32EMU_WITH_AVX2_KERNELS
+// Provided by a separate source file compiled for AVX2.
+void synthesiseAVX2(float *outBuf, const LA32FloatSynthBlock &block, const Bit32u length);
+void synthesiseBlocksAVX2(float * const *outBufs, const LA32FloatSynthBlock * const *blocks, const Bit32u blockCount, const Bit32u length);
+#endif
+
+} // namespace LA32FloatWaveKernels
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_LA32_FLOAT_WAVE_KERNELS_IMPL_H
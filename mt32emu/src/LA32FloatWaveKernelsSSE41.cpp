@@ -0,0 +1,78 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// This file is compiled with SSE4.1 instructions enabled. To avoid mixing up with the code compiled for other
+// instruction sets, it only includes the headers that don't define inline functions besides the generic kernels.
+// The kernels are only invoked after checking that the CPU supports SSE4.1.
+
+#include <smmintrin.h>
+
+#include "internals.h"
+
+#include "LA32FloatWaveKernelsImpl.h"
+
+#if MT32EMU_USE_SIMD && MT32EMU_WITH_SSE41_KERNELS
+
+namespace MT32Emu {
+
+namespace LA32FloatWaveKernels {
+
+class SSE41Vector {
+public:
+	typedef __m128 Float;
+	typedef __m128i Int;
+	typedef __m128 Mask;
+
+	static const Bit32u WIDTH = 4;
+
+	static inline Float load(const float *data) { return _mm_loadu_ps(data); }
+	static inline void store(float *data, const Float v) { _mm_storeu_ps(data, v); }
+	static inline Float set(const float value) { return _mm_set1_ps(value); }
+
+	static inline Float add(const Float a, const Float b) { return _mm_add_ps(a, b); }
+	static inline Float sub(const Float a, const Float b) { return _mm_sub_ps(a, b); }
+	static inline Float mul(const Float a, const Float b) { return _mm_mul_ps(a, b); }
+	static inline Float div(const Float a, const Float b) { return _mm_div_ps(a, b); }
+	static inline Float min(const Float a, const Float b) { return _mm_min_ps(a, b); }
+	static inline Float max(const Float a, const Float b) { return _mm_max_ps(a, b); }
+
+	static inline Mask less(const Float a, const Float b) { return _mm_cmplt_ps(a, b); }
+	static inline Mask lessOrEqual(const Float a, const Float b) { return _mm_cmple_ps(a, b); }
+	static inline Float select(const Mask mask, const Float a, const Float b) { return _mm_blendv_ps(b, a, mask); }
+	static inline Mask maskAnd(const Mask a, const Mask b) { return _mm_and_ps(a, b); }
+	static inline bool anyOf(const Mask mask) { return _mm_movemask_ps(mask) != 0; }
+	static inline bool allOf(const Mask mask) { return _mm_movemask_ps(mask) == 0xF; }
+
+	static inline Float floor(const Float x) { return _mm_floor_ps(x); }
+	static inline Int roundToInt(const Float x) { return _mm_cvtps_epi32(x); }
+	static inline Float toFloat(const Int k) { return _mm_cvtepi32_ps(k); }
+	static inline Float powerOfTwo(const Float n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23)); }
+	static inline Float negateIfOdd(const Float x, const Int k) { return _mm_xor_ps(x, _mm_castsi128_ps(_mm_slli_epi32(k, 31))); }
+};
+
+void synthesiseSSE41(float *outBuf, const LA32FloatSynthBlock &block, const Bit32u length) {
+	synthesiseVectors<SSE41Vector>(outBuf, block, length);
+}
+
+void synthesiseBlocksSSE41(float * const *outBufs, const LA32FloatSynthBlock * const *blocks, const Bit32u blockCount, const Bit32u length) {
+	synthesiseBlockVectors<SSE41Vector>(outBufs, blocks, blockCount, length);
+}
+
+} // namespace LA32FloatWaveKernels
+
+} // namespace MT32Emu
+
+#endif // #if MT32EMU_USE_SIMD && MT32EMU_WITH_SSE41_KERNELS
@@ -51,6 +51,7 @@ We haven't fully explored:
 #include "internals.h"
 
 #include "LA32Ramp.h"
+#include "SynthState.h"
 #include "Tables.h"
 
 namespace MT32Emu {
@@ -137,6 +138,93 @@ Bit32u LA32Ramp::nextValue() {
 	return current;
 }
 
+// Returns the number of upcoming calls to nextValue() that change the current value by largeIncrement
+// without reaching the target. The call that follows reaches the target and starts the interrupt countdown.
+Bit32u LA32Ramp::getLinearStepCount() const {
+	if (descending) {
+		// Staying above the target implies no underflow either
+		return current > largeTarget ? (current - largeTarget - 1) / largeIncrement : 0;
+	}
+	// Staying below the target implies no overflow either, since the target never exceeds MAX_CURRENT
+	return current < largeTarget ? (largeTarget - current - 1) / largeIncrement : 0;
+}
+
+Bit32u LA32Ramp::nextValues(Bit32u *buffer, Bit32u sampleCount) {
+	while (sampleCount > 0) {
+		if (interruptCountdown > 0) {
+			// The value stays intact until the interrupt is raised
+			Bit32u countdownSamples = Bit32u(interruptCountdown) < sampleCount ? Bit32u(interruptCountdown) : sampleCount;
+			if (buffer != NULL) {
+				for (Bit32u i = 0; i < countdownSamples; i++) {
+					*(buffer++) = current;
+				}
+			}
+			sampleCount -= countdownSamples;
+			interruptCountdown -= int(countdownSamples);
+			if (interruptCountdown == 0) {
+				interruptRaised = true;
+			}
+		} else if (largeIncrement == 0) {
+			if (buffer != NULL) {
+				for (Bit32u i = 0; i < sampleCount; i++) {
+					*(buffer++) = current;
+				}
+			}
+			sampleCount = 0;
+		} else {
+			Bit32u linearSteps = getLinearStepCount();
+			if (linearSteps >= sampleCount) {
+				linearSteps = sampleCount;
+			}
+			if (buffer != NULL) {
+				Bit32u value = current;
+				if (descending) {
+					for (Bit32u i = 0; i < linearSteps; i++) {
+						value -= largeIncrement;
+						*(buffer++) = value;
+					}
+				} else {
+					for (Bit32u i = 0; i < linearSteps; i++) {
+						value += largeIncrement;
+						*(buffer++) = value;
+					}
+				}
+			}
+			if (descending) {
+				current -= linearSteps * largeIncrement;
+			} else {
+				current += linearSteps * largeIncrement;
+			}
+			sampleCount -= linearSteps;
+			if (sampleCount > 0) {
+				// The target is reached
+				current = largeTarget;
+				interruptCountdown = INTERRUPT_TIME;
+				if (buffer != NULL) {
+					*(buffer++) = current;
+				}
+				sampleCount--;
+			}
+		}
+	}
+	return current;
+}
+
+Bit32u LA32Ramp::advance(Bit32u sampleCount) {
+	return nextValues(NULL, sampleCount);
+}
+
+Bit32u LA32Ramp::getSamplesUntilInterrupt() const {
+	if (interruptCountdown > 0) {
+		return Bit32u(interruptCountdown) - 1;
+	}
+	if (largeIncrement == 0) {
+		return INFINITE_SAMPLE_COUNT;
+	}
+	// One more sample to reach the target, then the interrupt countdown elapses
+	return getLinearStepCount() + INTERRUPT_TIME;
+}
+
 bool LA32Ramp::checkInterrupt() {
 	bool wasRaised = interruptRaised;
 	interruptRaised = false;
@@ -161,4 +249,28 @@ bool LA32Ramp::isBelowCurrent(Bit8u target) const {
 	return Bit32u(target << TARGET_SHIFTS) < current;
 }
 
+bool LA32Ramp::staysBelow(Bit8u level) const {
+	const Bit32u largeLevel = Bit32u(level) << TARGET_SHIFTS;
+	if (current >= largeLevel) return false;
+	return largeIncrement == 0 || descending || largeTarget < largeLevel;
+}
+
+void LA32Ramp::saveState(StateWriter &writer) const {
+	writer.writeUInt32(current);
+	writer.writeUInt32(largeTarget);
+	writer.writeUInt32(largeIncrement);
+	writer.writeBool(descending);
+	writer.writeInt32(interruptCountdown);
+	writer.writeBool(interruptRaised);
+}
+
+void LA32Ramp::restoreState(StateReader &reader) {
+	current = reader.readUInt32();
+	largeTarget = reader.readUInt32();
+	largeIncrement = reader.readUInt32();
+	descending = reader.readBool();
+	interruptCountdown = reader.readInt32();
+	interruptRaised = reader.readBool();
+}
+
 } // namespace MT32Emu
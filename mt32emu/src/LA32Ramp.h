@@ -23,7 +23,13 @@
 
 namespace MT32Emu {
 
+class StateReader;
+class StateWriter;
+
 class LA32Ramp {
+public:
+	static const Bit32u INFINITE_SAMPLE_COUNT = 0xFFFFFFFF;
+
 private:
 	Bit32u current;
 	unsigned int largeTarget;
@@ -33,13 +39,28 @@ private:
 	int interruptCountdown;
 	bool interruptRaised;
 
+	Bit32u getLinearStepCount() const;
+
 public:
 	LA32Ramp();
 	void startRamp(Bit8u target, Bit8u increment);
 	Bit32u nextValue();
+	// Equivalent to calling nextValue() sampleCount times, yet the ramp is advanced in closed form.
+	// If buffer is not NULL, it receives the value for each sample. Returns the last value.
+	Bit32u nextValues(Bit32u *buffer, Bit32u sampleCount);
+	Bit32u advance(Bit32u sampleCount);
+	// Returns the number of samples that can be rendered before the interrupt is raised, i.e. the number of calls
+	// to nextValue() which leave checkInterrupt() false. When the ramp is idle, returns INFINITE_SAMPLE_COUNT.
+	Bit32u getSamplesUntilInterrupt() const;
 	bool checkInterrupt();
 	void reset();
 	bool isBelowCurrent(Bit8u target) const;
+	// Returns true if the current value is below the specified level and the ramp cannot rise to the level
+	// before the next interrupt.
+	bool staysBelow(Bit8u level) const;
+
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 };
 
 } // namespace MT32Emu
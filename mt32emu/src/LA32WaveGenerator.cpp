@@ -20,6 +20,8 @@
 #include "internals.h"
 
 #include "LA32WaveGenerator.h"
+#include "MixKernels.h"
+#include "SynthState.h"
 #include "Tables.h"
 
 namespace MT32Emu {
@@ -30,12 +32,9 @@ static const Bit32u RESONANCE_DECAY_THRESHOLD_CUTOFF_VALUE = 144 << 18;
 static const Bit32u MAX_CUTOFF_VALUE = 240 << 18;
 static const LogSample SILENCE = {65535, LogSample::POSITIVE};
 
+// The interpolation is precomputed in Tables::interpolatedExp
 Bit16u LA32Utilites::interpolateExp(const Bit16u fract) {
-	Bit16u expTabIndex = fract >> 3;
-	Bit16u extraBits = ~fract & 7;
-	Bit16u expTabEntry2 = 8191 - Tables::getInstance().exp9[expTabIndex];
-	Bit16u expTabEntry1 = expTabIndex == 0 ? 8191 : (8191 - Tables::getInstance().exp9[expTabIndex - 1]);
-	return expTabEntry2 + (((expTabEntry1 - expTabEntry2) * extraBits) >> 3);
+	return Tables::getInstance().interpolatedExp[fract];
 }
 
 Bit16s LA32Utilites::unlog(const LogSample &logSample) {
@@ -238,6 +237,10 @@ void LA32WaveGenerator::generateNextPCMWaveLogSamples() {
 	} else {
 		secondPCMLogSample = SILENCE;
 	}
+	advancePCMWavePosition();
+}
+
+void LA32WaveGenerator::advancePCMWavePosition() {
 	// pcmSampleStep = (Bit32u)EXP2F(pitch / 4096.0f + 3.0f);
 	Bit32u pcmSampleStep = LA32Utilites::interpolateExp(~pitch & 4095);
 	pcmSampleStep <<= pitch >> 12;
@@ -254,6 +257,13 @@ void LA32WaveGenerator::generateNextPCMWaveLogSamples() {
 	}
 }
 
+LA32WaveGenerator::LA32WaveGenerator() : active(false), pcmWaveAddress(NULL) {
+	squareLogSample = SILENCE;
+	resonanceLogSample = SILENCE;
+	firstPCMLogSample = SILENCE;
+	secondPCMLogSample = SILENCE;
+}
+
 void LA32WaveGenerator::initSynth(const bool useSawtoothWaveform, const Bit8u usePulseWidth, const Bit8u useResonance) {
 	sawtoothWaveform = useSawtoothWaveform;
 	pulseWidth = usePulseWidth;
@@ -311,6 +321,14 @@ void LA32WaveGenerator::generateNextSample(const Bit32u useAmp, const Bit16u use
 	advancePosition();
 }
 
+void LA32WaveGenerator::skipNextSample(const Bit16u usePitch) {
+	if (!active || !isPCMWave()) {
+		return;
+	}
+	pitch = usePitch;
+	advancePCMWavePosition();
+}
+
 LogSample LA32WaveGenerator::getOutputLogSample(const bool first) const {
 	if (!isActive()) {
 		return SILENCE;
@@ -337,6 +355,8 @@ Bit32u LA32WaveGenerator::getPCMInterpolationFactor() const {
 	return pcmInterpolationFactor;
 }
 
+LA32IntPartialPair::LA32IntPartialPair() : ringModulated(false), mixed(false) {}
+
 void LA32IntPartialPair::init(const bool useRingModulated, const bool useMixed) {
 	ringModulated = useRingModulated;
 	mixed = useMixed;
@@ -366,6 +386,14 @@ void LA32IntPartialPair::generateNextSample(const PairType useMaster, const Bit3
 	}
 }
 
+void LA32IntPartialPair::skipNextSample(const PairType useMaster, const Bit16u pitch) {
+	if (useMaster == MASTER) {
+		master.skipNextSample(pitch);
+	} else {
+		slave.skipNextSample(pitch);
+	}
+}
+
 Bit16s LA32IntPartialPair::unlogAndMixWGOutput(const LA32WaveGenerator &wg) {
 	if (!wg.isActive()) {
 		return 0;
@@ -382,19 +410,22 @@ static inline Bit16s produceDistortedSample(Bit16s sample) {
 	return ((sample & 0x2000) == 0) ? Bit16s(sample & 0x1fff) : Bit16s(sample | ~0x1fff);
 }
 
-Bit16s LA32IntPartialPair::nextOutSample() {
+Bit16s LA32IntPartialPair::unlogSlaveWGOutput() const {
 	if (!ringModulated) {
-		return unlogAndMixWGOutput(master) + unlogAndMixWGOutput(slave);
+		return unlogAndMixWGOutput(slave);
 	}
-
-	Bit16s masterSample = unlogAndMixWGOutput(master); // Store master partial sample for further mixing
-
 	/* SEMI-CONFIRMED from sample analysis:
 	 * We observe that for partial structures with ring modulation the interpolation is not applied to the slave PCM partial.
 	 * It's assumed that the multiplication circuitry intended to perform the interpolation on the slave PCM partial
 	 * is borrowed by the ring modulation circuit (or the LA32 chip has a similar lack of resources assigned to each partial pair).
 	 */
-	Bit16s slaveSample = slave.isPCMWave() ? LA32Utilites::unlog(slave.getOutputLogSample(true)) : unlogAndMixWGOutput(slave);
+	return slave.isPCMWave() ? LA32Utilites::unlog(slave.getOutputLogSample(true)) : unlogAndMixWGOutput(slave);
+}
+
+Bit16s LA32IntPartialPair::mixWGOutput(const Bit16s masterSample, const Bit16s slaveSample) const {
+	if (!ringModulated) {
+		return masterSample + slaveSample;
+	}
 
 	/* SEMI-CONFIRMED: Ring modulation model derived from sample analysis of specially constructed patches which exploit distortion.
 	 * LA32 ring modulator found to produce distorted output in case if the absolute value of maximal amplitude of one of the input partials exceeds 8191.
@@ -408,6 +439,35 @@ Bit16s LA32IntPartialPair::nextOutSample() {
 	return mixed ? masterSample + ringModulatedSample : ringModulatedSample;
 }
 
+Bit16s LA32IntPartialPair::nextOutSample() {
+	// Store master partial sample for further mixing
+	Bit16s masterSample = unlogAndMixWGOutput(master);
+	return mixWGOutput(masterSample, unlogSlaveWGOutput());
+}
+
+void LA32IntPartialPair::generateNextSamples(Bit16s *outBuf, const LA32WGControlBlock &masterControls, const LA32WGControlBlock *slaveControls, const Bit32u length) {
+	// The WGs don't depend on each other, so each one renders and unlogs the whole run in turn.
+	// The master output is kept in outBuf until it is combined with the slave output.
+	for (Bit32u i = 0; i < length; i++) {
+		master.generateNextSample(masterControls.amp[i], masterControls.pitch[i], masterControls.cutoff[i]);
+		outBuf[i] = unlogAndMixWGOutput(master);
+	}
+	Bit16s slaveBuf[LA32_MAX_BLOCK_LENGTH];
+	if (slaveControls == NULL) {
+		// The slave WG state stays unchanged during the run
+		const Bit16s slaveSample = unlogSlaveWGOutput();
+		for (Bit32u i = 0; i < length; i++) {
+			slaveBuf[i] = slaveSample;
+		}
+	} else {
+		for (Bit32u i = 0; i < length; i++) {
+			slave.generateNextSample(slaveControls->amp[i], slaveControls->pitch[i], slaveControls->cutoff[i]);
+			slaveBuf[i] = unlogSlaveWGOutput();
+		}
+	}
+	MixKernels::combinePair(outBuf, slaveBuf, length, ringModulated, mixed);
+}
+
 void LA32IntPartialPair::deactivate(const PairType useMaster) {
 	if (useMaster == MASTER) {
 		master.deactivate();
@@ -420,4 +480,91 @@ bool LA32IntPartialPair::isActive(const PairType useMaster) const {
 	return useMaster == MASTER ? master.isActive() : slave.isActive();
 }
 
+static void saveLogSample(StateWriter &writer, const LogSample &logSample) {
+	writer.writeUInt16(logSample.logValue);
+	writer.writeBool(logSample.sign == LogSample::NEGATIVE);
+}
+
+static void restoreLogSample(StateReader &reader, LogSample &logSample) {
+	logSample.logValue = reader.readUInt16();
+	logSample.sign = reader.readBool() ? LogSample::NEGATIVE : LogSample::POSITIVE;
+}
+
+void LA32WaveGenerator::saveState(StateWriter &writer) const {
+	writer.writeBool(active);
+	if (!active) return;
+	writer.writeUInt32(amp);
+	writer.writeUInt16(pitch);
+	writer.writeUInt32(wavePosition);
+	writer.writeBool(isPCMWave());
+	if (isPCMWave()) {
+		writer.writeUInt32(pcmWaveLength);
+		writer.writePCMRef(pcmWaveAddress);
+		writer.writeBool(pcmWaveLooped);
+		writer.writeBool(pcmWaveInterpolated);
+		writer.writeUInt32(pcmInterpolationFactor);
+		saveLogSample(writer, firstPCMLogSample);
+		saveLogSample(writer, secondPCMLogSample);
+		return;
+	}
+	writer.writeBool(sawtoothWaveform);
+	writer.writeUInt8(resonance);
+	writer.writeUInt8(pulseWidth);
+	writer.writeUInt32(cutoffVal);
+	writer.writeUInt32(squareWavePosition);
+	writer.writeUInt32(resonanceSinePosition);
+	writer.writeUInt32(resonanceAmpSubtraction);
+	writer.writeUInt32(resAmpDecayFactor);
+	writer.writeUInt32(phase);
+	writer.writeUInt32(resonancePhase);
+	saveLogSample(writer, squareLogSample);
+	saveLogSample(writer, resonanceLogSample);
+}
+
+void LA32WaveGenerator::restoreState(StateReader &reader) {
+	active = reader.readBool();
+	if (!active) return;
+	amp = reader.readUInt32();
+	pitch = reader.readUInt16();
+	wavePosition = reader.readUInt32();
+	if (reader.readBool()) {
+		pcmWaveLength = reader.readUInt32();
+		pcmWaveAddress = reader.readPCMRef(pcmWaveLength);
+		pcmWaveLooped = reader.readBool();
+		pcmWaveInterpolated = reader.readBool();
+		pcmInterpolationFactor = reader.readUInt32();
+		restoreLogSample(reader, firstPCMLogSample);
+		restoreLogSample(reader, secondPCMLogSample);
+		if (pcmWaveAddress == NULL || pcmWaveLength == 0 || (wavePosition >> 8) >= pcmWaveLength) reader.fail();
+		return;
+	}
+	pcmWaveAddress = NULL;
+	sawtoothWaveform = reader.readBool();
+	resonance = reader.readUInt8();
+	pulseWidth = reader.readUInt8();
+	cutoffVal = reader.readUInt32();
+	squareWavePosition = reader.readUInt32();
+	resonanceSinePosition = reader.readUInt32();
+	resonanceAmpSubtraction = reader.readUInt32();
+	resAmpDecayFactor = reader.readUInt32();
+	phase = static_cast<Phase>(reader.readIndex(NEGATIVE_RISING_SINE_SEGMENT + 1));
+	resonancePhase = static_cast<ResonancePhase>(reader.readIndex(NEGATIVE_RISING_RESONANCE_SINE_SEGMENT + 1));
+	restoreLogSample(reader, squareLogSample);
+	restoreLogSample(reader, resonanceLogSample);
+}
+
+void LA32IntPartialPair::saveState(StateWriter &writer) const {
+	writer.writeBool(ringModulated);
+	writer.writeBool(mixed);
+	master.saveState(writer);
+	slave.saveState(writer);
+}
+
+void LA32IntPartialPair::restoreState(StateReader &reader) {
+	ringModulated = reader.readBool();
+	mixed = reader.readBool();
+	master.restoreState(reader);
+	slave.restoreState(reader);
+}
+
 } // namespace MT32Emu
@@ -24,6 +24,9 @@
 
 namespace MT32Emu {
 
+class StateReader;
+class StateWriter;
+
 /**
  * LA32 performs wave generation in the log-space that allows replacing multiplications by cheap additions
  * It's assumed that only low-bit multiplications occur in a few places which are unavoidable like these:
@@ -133,7 +136,7 @@ class LA32WaveGenerator {
 	Bit32u pcmInterpolationFactor;
 
 	// Current phase of the square wave
-	enum {
+	enum Phase {
 		POSITIVE_RISING_SINE_SEGMENT,
 		POSITIVE_LINEAR_SEGMENT,
 		POSITIVE_FALLING_SINE_SEGMENT,
@@ -175,8 +178,11 @@ class LA32WaveGenerator {
 
 	void pcmSampleToLogSample(LogSample &logSample, const Bit16s pcmSample) const;
 	void generateNextPCMWaveLogSamples();
+	void advancePCMWavePosition();
 
 public:
+	LA32WaveGenerator();
+
 	// Initialise the WG engine for generation of synth partial samples and set up the invariant parameters
 	void initSynth(const bool sawtoothWaveform, const Bit8u pulseWidth, const Bit8u resonance);
 
@@ -186,6 +192,10 @@ public:
 	// Update parameters with respect to TVP, TVA and TVF, and generate next sample
 	void generateNextSample(const Bit32u amp, const Bit16u pitch, const Bit32u cutoff);
 
+	// Advance the PCM wave position with respect to TVP as generateNextSample() does, yet skip generating the sample.
+	// The position of synth waves is left intact
+	void skipNextSample(const Bit16u pitch);
+
 	// WG output in the log-space consists of two components which are to be added (or ring modulated) in the linear-space afterwards
 	LogSample getOutputLogSample(const bool first) const;
 
@@ -200,8 +210,21 @@ public:
 
 	// Return current PCM interpolation factor
 	Bit32u getPCMInterpolationFactor() const;
+
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 }; // class LA32WaveGenerator
 
+// Maximum number of samples a partial pair generates in a single run using precomputed values of amp, pitch and cutoff
+const Bit32u LA32_MAX_BLOCK_LENGTH = 128;
+
+// Holds values of amp, pitch and cutoff computed in advance by TVA, TVP and TVF for a run of samples of a single WG
+struct LA32WGControlBlock {
+	Bit32u amp[LA32_MAX_BLOCK_LENGTH];
+	Bit16u pitch[LA32_MAX_BLOCK_LENGTH];
+	Bit32u cutoff[LA32_MAX_BLOCK_LENGTH];
+};
+
 // LA32PartialPair contains a structure of two partials being mixed / ring modulated
 class LA32PartialPair {
 public:
@@ -225,6 +248,9 @@ public:
 
 	// Deactivate the WG engine
 	virtual void deactivate(const PairType master) = 0;
+
+	virtual void saveState(StateWriter &writer) const = 0;
+	virtual void restoreState(StateReader &reader) = 0;
 }; // class LA32PartialPair
 
 class LA32IntPartialPair : public LA32PartialPair {
@@ -234,8 +260,12 @@ class LA32IntPartialPair : public LA32PartialPair {
 	bool mixed;
 
 	static Bit16s unlogAndMixWGOutput(const LA32WaveGenerator &wg);
+	Bit16s unlogSlaveWGOutput() const;
+	Bit16s mixWGOutput(const Bit16s masterSample, const Bit16s slaveSample) const;
 
 public:
+	LA32IntPartialPair();
+
 	// ringModulated should be set to false for the structures with mixing or stereo output
 	// ringModulated should be set to true for the structures with ring modulation
 	// mixed is used for the structures with ring modulation and indicates whether the master partial output is mixed to the ring modulator output
@@ -250,15 +280,26 @@ public:
 	// Update parameters with respect to TVP, TVA and TVF, and generate next sample
 	void generateNextSample(const PairType master, const Bit32u amp, const Bit16u pitch, const Bit32u cutoff);
 
+	// Advance the PCM wave position with respect to TVP, yet skip generating the sample
+	void skipNextSample(const PairType master, const Bit16u pitch);
+
 	// Perform mixing / ring modulation of WG output and return the result
 	// Although, LA32 applies panning itself, we assume it is applied in the mixer, not within a pair
 	Bit16s nextOutSample();
 
+	// Generate a run of samples using the values of amp, pitch and cutoff precomputed for each WG,
+	// perform mixing / ring modulation of WG output and store the result in outBuf.
+	// slaveControls is NULL when the slave WG isn't used in the structure.
+	void generateNextSamples(Bit16s *outBuf, const LA32WGControlBlock &masterControls, const LA32WGControlBlock *slaveControls, const Bit32u length);
+
 	// Deactivate the WG engine
 	void deactivate(const PairType master);
 
 	// Return active state of the WG engine
 	bool isActive(const PairType master) const;
+
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 }; // class LA32IntPartialPair
 
 } // namespace MT32Emu
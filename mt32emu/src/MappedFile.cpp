@@ -0,0 +1,119 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined _WIN32 && !defined _POSIX_C_SOURCE
+// Needed for mmap() and fstat() when compiling in strict ANSI mode.
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "internals.h"
+
+#include "MappedFile.h"
+#include "RealtimeCheck.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MT32Emu {
+
+MappedFile::MappedFile() : data(NULL), size(0)
+{}
+
+MappedFile::~MappedFile() {
+	unmap();
+}
+
+size_t MappedFile::getSize() {
+	return size;
+}
+
+const Bit8u *MappedFile::getData() {
+	return data;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *filename) {
+	unmap();
+	RealtimeCheck::reportFileIO();
+	HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0 || ULONGLONG(fileSize.QuadPart) > ULONGLONG(size_t(-1))) {
+		CloseHandle(fileHandle);
+		return false;
+	}
+	HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(fileHandle);
+	if (mappingHandle == NULL) return false;
+	// The view keeps the mapping object alive.
+	const void *view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mappingHandle);
+	if (view == NULL) return false;
+	data = static_cast<const Bit8u *>(view);
+	size = size_t(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::unmap() {
+	if (data == NULL) return;
+	UnmapViewOfFile(data);
+	data = NULL;
+	size = 0;
+}
+
+#else // #ifdef _WIN32
+
+bool MappedFile::open(const char *filename) {
+	unmap();
+	RealtimeCheck::reportFileIO();
+	int fd = ::open(filename, O_RDONLY);
+	if (fd == -1) return false;
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || fileStat.st_size <= 0) {
+		::close(fd);
+		return false;
+	}
+	const size_t fileSize = size_t(fileStat.st_size);
+	// The mapping stays valid after the file descriptor is closed.
+	void *mapping = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) return false;
+	data = static_cast<const Bit8u *>(mapping);
+	size = fileSize;
+	return true;
+}
+
+void MappedFile::unmap() {
+	if (data == NULL) return;
+	munmap(const_cast<Bit8u *>(data), size);
+	data = NULL;
+	size = 0;
+}
+
+#endif // #ifdef _WIN32
+
+void MappedFile::close() {
+	// The file is closed right after mapping, only the mapping remains until destruction.
+}
+
+} // namespace MT32Emu
@@ -0,0 +1,50 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_MAPPED_FILE_H
+#define MT32EMU_MAPPED_FILE_H
+
+#include <cstddef>
+
+#include "globals.h"
+#include "Types.h"
+#include "File.h"
+
+namespace MT32Emu {
+
+// Provides the contents of a file mapped into memory read-only, so that no copy of the data is made and the pages
+// are shared via the OS page cache between all the processes that map the same file. The mapping persists after
+// close() until the object is destroyed. Unlike FileStream, opening fails when the file is empty or when memory
+// mapping is unsupported on the platform, so FileStream may be used as a fallback.
+class MappedFile : public AbstractFile {
+public:
+	MT32EMU_EXPORT MappedFile();
+	MT32EMU_EXPORT ~MappedFile();
+	MT32EMU_EXPORT size_t getSize();
+	MT32EMU_EXPORT const Bit8u *getData();
+	MT32EMU_EXPORT bool open(const char *filename);
+	MT32EMU_EXPORT void close();
+
+private:
+	const Bit8u *data;
+	size_t size;
+
+	void unmap();
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_MAPPED_FILE_H
@@ -18,6 +18,8 @@
 #ifndef MT32EMU_MIDI_EVENT_QUEUE_H
 #define MT32EMU_MIDI_EVENT_QUEUE_H
 
+#include <cstddef>
+
 #include "globals.h"
 #include "Types.h"
 
@@ -31,41 +33,148 @@ namespace MT32Emu {
  * - extend the synth interface with the default implementation of a typical rendering loop.
  * THREAD SAFETY:
  * It is safe to use either in a single thread environment or when there are only two threads - one performs only reading
- * and one performs only writing. More complicated usage requires external synchronisation.
+ * and one performs only writing. More complicated usage requires external synchronisation, unless the queue is created
+ * in the multi-producer mode. In this mode, each slot of the ring buffer carries a sequence number, and a writing thread
+ * reserves a slot using an atomic compare-and-swap operation, so that any number of threads may write concurrently
+ * without locking while a single thread performs reading. The SysEx data is always stored in dynamically allocated
+ * buffers in the multi-producer mode, each retained by its slot, which is only accessed by the reserving producer.
+ * When the queue is full, a writing thread may wait for the reading thread to free slots. The reading thread signals
+ * the waiting threads as it drops events, which only involves locking while a writing thread is actually waiting.
+ * COALESCING:
+ * Optionally, a short message that sets a continuous controller or the pitch bender replaces the value in the latest event
+ * of the same kind pending on the channel, provided no other event for the channel came in between and the timestamps
+ * are within the coalescing window. The replaced event keeps its timestamp. The reading thread may be about to play
+ * the event being updated, so the writing thread re-checks that it is still pending after the update and enqueues
+ * the message anew otherwise, which is harmless as such messages are idempotent. Only supported in the single-producer
+ * mode, as the writing thread needs to know which events it has pushed.
  */
+class WaitableSignal;
+struct MIDIEventQueueStatistics;
+
 class MidiEventQueue {
 public:
 	class SysexDataStorage;
 
+	// Operations performed by short messages on each part assigned to the channel.
+	enum ShortMessageOpcode {
+		ShortMessageOpcode_UNKNOWN_MESSAGE,
+		ShortMessageOpcode_UNKNOWN_CONTROL,
+		ShortMessageOpcode_NOTE_OFF,
+		ShortMessageOpcode_NOTE_ON,
+		ShortMessageOpcode_MODULATION,
+		ShortMessageOpcode_DATA_ENTRY_MSB,
+		ShortMessageOpcode_VOLUME,
+		ShortMessageOpcode_PAN,
+		ShortMessageOpcode_EXPRESSION,
+		ShortMessageOpcode_HOLD_PEDAL,
+		ShortMessageOpcode_NRPN,
+		ShortMessageOpcode_RPN_LSB,
+		ShortMessageOpcode_RPN_MSB,
+		ShortMessageOpcode_RESET_ALL_CONTROLLERS,
+		ShortMessageOpcode_ALL_NOTES_OFF,
+		ShortMessageOpcode_MODE_CHANGE,
+		ShortMessageOpcode_PROGRAM_CHANGE,
+		ShortMessageOpcode_PITCH_BEND,
+		ShortMessageOpcode_COUNT
+	};
+
 	struct MidiEvent {
 		const Bit8u *sysexData;
 		union {
 			Bit32u sysexLength;
 			Bit32u shortMessageData;
 		};
+		// Short message decoded by the pushing thread, see decodeShortMessage(). Unused for SysEx.
+		Bit32u decodedShortMessage;
 		Bit32u timestamp;
+		// Only used in the multi-producer mode.
+		volatile Bit32u sequenceNumber;
 	};
 
 	explicit MidiEventQueue(
 		// Must be a power of 2
 		Bit32u ringBufferSize,
-		Bit32u storageBufferSize
+		Bit32u storageBufferSize,
+		bool multiProducer = false,
+		// Number of samples at the native sample rate the coalesced events may span, 0 disables coalescing
+		Bit32u coalescingWindow = 0
 	);
 	~MidiEventQueue();
+
+	// Splits a short message into the opcode (in the lowest byte), the MIDI channel (in the next byte) and the two
+	// data bytes (in the upper bytes), so that playing the message only requires a lookup of the opcode handler.
+	// The parts the message is played on are looked up later, as the channel assignment may change in the meantime.
+	static Bit32u decodeShortMessage(Bit32u shortMessageData);
+	static ShortMessageOpcode getShortMessageOpcode(Bit32u decodedShortMessage) { return ShortMessageOpcode(decodedShortMessage & 0xFF); }
+	static Bit8u getShortMessageChannel(Bit32u decodedShortMessage) { return Bit8u((decodedShortMessage >> 8) & 0x0F); }
+	static Bit8u getShortMessageData1(Bit32u decodedShortMessage) { return Bit8u((decodedShortMessage >> 16) & 0x7F); }
+	static Bit8u getShortMessageData2(Bit32u decodedShortMessage) { return Bit8u((decodedShortMessage >> 24) & 0x7F); }
+	// Returns true for the messages that only set a value, which makes any preceding message of the same kind redundant.
+	// Notes, the hold pedal, the (N)RPN data entry and the mode changes are order-sensitive and never coalesced.
+	static bool isCoalescable(ShortMessageOpcode opcode);
+
 	void reset();
 	bool pushShortMessage(Bit32u shortMessageData, Bit32u timestamp);
 	bool pushSysex(const Bit8u *sysexData, Bit32u sysexLength, Bit32u timestamp);
+	// Pushes as many of the given events as the queue can hold, and publishes them at once. The SysEx data is copied
+	// to the queue storage. Returns the number of events pushed.
+	Bit32u pushMidiEvents(const MidiEvent *events, Bit32u count);
 	const volatile MidiEvent *peekMidiEvent();
+	// Returns the event that follows the next one to be read by the specified number of events, or NULL if there are fewer.
+	// Must only be used by the reading thread.
+	const volatile MidiEvent *peekMidiEvent(Bit32u offset);
 	void dropMidiEvent();
 	inline bool isEmpty() const;
+	// Returns the number of events that can be pushed without failing, unless other producers are pushing concurrently.
+	// Must only be used by the writing threads. Note, SysEx events may also fail to push if the storage buffer is exhausted.
+	Bit32u getFreeCapacity() const;
+	// Blocks the writing thread until the given number of slots is free or the timeout expires. Returns true if the slots
+	// are free. Always returns immediately when the library is built without multithreading support.
+	bool waitForFreeCapacity(Bit32u eventCount, Bit32u timeoutMillis);
+	// Returns the amount of memory allocated by the queue, apart from the SysEx data buffers allocated on demand.
+	size_t getAllocatedMemorySize() const;
+	// Returns the amount of memory held by the SysEx data buffers allocated on demand. As the producers allocate these,
+	// the value may be slightly outdated when read concurrently with pushing.
+	size_t getSysexBufferMemorySize() const;
+	// Accounts an event the reading thread is playing later than intended by the specified number of samples.
+	void recordLateEvent(Bit32u lateness);
+	void getStatistics(MIDIEventQueueStatistics &statistics) const;
+	// Must be synchronised with the reading thread.
+	void resetStatistics();
 
 private:
 	SysexDataStorage &sysexDataStorage;
 
 	MidiEvent * const ringBuffer;
 	const Bit32u ringBufferMask;
+	const bool multiProducer;
+	const Bit32u coalescingWindow;
+	// In the multi-producer mode, the positions aren't wrapped but grow monotonically.
 	volatile Bit32u startPosition;
 	volatile Bit32u endPosition;
+	// NULL when multithreading support is unavailable.
+	WaitableSignal * const freeCapacitySignal;
+
+	// Statistics updated by the reading thread.
+	Bit32u eventCountHighWaterMark;
+	Bit32u lateEventCount;
+	Bit32u latenessHistogram[16];
+	// Statistics updated by the writing threads, atomically in the multi-producer mode.
+	volatile Bit32u overflowEventCount;
+	volatile Bit32u sysexStorageOverflowCount;
+
+	// Producer state used to coalesce events. Bit i of the mask tells that the position of the latest event pushed
+	// for channel i is known.
+	Bit32u trackedChannelMask;
+	Bit32u lastChannelEventPositions[16];
+
+	volatile MidiEvent *reserveEvent(Bit32u &position);
+	void commitEvent(volatile MidiEvent &event, Bit32u position);
+	bool storeEvent(volatile MidiEvent &slot, const MidiEvent &event);
+	void countOverflow(volatile Bit32u &counter, Bit32u eventCount);
+	bool coalesceShortMessage(Bit32u shortMessageData, Bit32u decodedShortMessage, Bit32u timestamp);
+	bool isPendingBehindHead(Bit32u position) const;
+	void trackEvent(Bit32u position, const volatile MidiEvent &event);
 };
 
 } // namespace MT32Emu
@@ -20,11 +20,29 @@
 
 #include "internals.h"
 
+#include "CPUFeatures.h"
 #include "MidiStreamParser.h"
 #include "Synth.h"
 
 using namespace MT32Emu;
 
+// Returns the offset of the first status byte (i.e. >= 0x80) in the stream, or length if there is none.
+// Bulk data, like SysEx dumps, is mostly made of long runs of data bytes, so they are skipped a block at a time if possible.
+static Bit32u findStatusByte(const Bit8u *stream, const Bit32u length) {
+	Bit32u offset = 0;
+#if MT32EMU_SIMD_SSE2
+	while (offset + 16 <= length) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(stream + offset));
+		if (_mm_movemask_epi8(bytes) != 0) break;
+		offset += 16;
+	}
+#endif
+	while (offset < length && stream[offset] < 0x80) {
+		offset++;
+	}
+	return offset;
+}
+
 DefaultMidiStreamParser::DefaultMidiStreamParser(Synth &useSynth, Bit32u initialStreamBufferCapacity) :
 	MidiStreamParser(initialStreamBufferCapacity), synth(useSynth), timestampSet(false) {}
 
@@ -107,7 +125,8 @@ void MidiStreamParserImpl::parseStream(const Bit8u *stream, Bit32u length) {
 				runningStatus = 0; // SysEx clears the running status
 				parsedMessageLength = parseSysex(stream, length);
 			} else {
-				parsedMessageLength = parseShortMessageStatus(stream);
+				parsedMessageLength = parseShortMessageRun(stream, length);
+				if (parsedMessageLength == 0) parsedMessageLength = parseShortMessageStatus(stream);
 			}
 		}
 
@@ -177,6 +196,35 @@ Bit32u MidiStreamParserImpl::parseShortMessageStatus(const Bit8u stream[]) {
 	return parsedLength;
 }
 
+// Fast path for complete channel messages, that are entirely contained in the stream. Consecutive messages are handled
+// at once, including those relying on the running status. Anything else is left for the generic byte-wise parsing.
+// Returns # of bytes parsed
+Bit32u MidiStreamParserImpl::parseShortMessageRun(const Bit8u stream[], const Bit32u length) {
+	Bit32u parsedLength = 0;
+	while (parsedLength < length) {
+		Bit8u status = stream[parsedLength];
+		Bit32u messageStart = parsedLength;
+		if (status < 0x80) {
+			if (runningStatus < 0x80) break;
+			status = runningStatus;
+		} else if (status < 0xF0) {
+			messageStart++;
+		} else {
+			break;
+		}
+		const Bit32u dataLength = Synth::getShortMessageLength(status) - 1;
+		if (length - messageStart < dataLength) break;
+		const Bit8u *data = stream + messageStart;
+		if (data[0] >= 0x80 || (dataLength > 1 && data[1] >= 0x80)) break;
+		runningStatus = status;
+		Bit32u shortMessage = status | (data[0] << 8);
+		if (dataLength > 1) shortMessage |= data[1] << 16;
+		midiReceiver.handleShortMessage(shortMessage);
+		parsedLength = messageStart + dataLength;
+	}
+	return parsedLength;
+}
+
 // Returns # of bytes parsed
 Bit32u MidiStreamParserImpl::parseShortMessageDataBytes(const Bit8u stream[], Bit32u length) {
 	const Bit32u shortMessageLength = Synth::getShortMessageLength(*streamBuffer);
@@ -216,26 +264,23 @@ Bit32u MidiStreamParserImpl::parseShortMessageDataBytes(const Bit8u stream[], Bi
 // Returns # of bytes parsed
 Bit32u MidiStreamParserImpl::parseSysex(const Bit8u stream[], const Bit32u length) {
 	// Find SysEx length
-	Bit32u sysexLength = 1;
-	while (sysexLength < length) {
-		Bit8u nextByte = stream[sysexLength++];
-		if (0x80 <= nextByte) {
-			if (nextByte == 0xF7) {
-				// End of SysEx
-				midiReceiver.handleSysex(stream, sysexLength);
-				return sysexLength;
-			}
-			if (0xF8 <= nextByte) {
-				// The System Realtime message must be processed right after return
-				// but the SysEx is actually fragmented and to be reconstructed in streamBuffer
-				--sysexLength;
-				break;
-			}
+	Bit32u sysexLength = 1 + findStatusByte(stream + 1, length - 1);
+	if (sysexLength < length) {
+		Bit8u nextByte = stream[sysexLength];
+		if (nextByte == 0xF7) {
+			// End of SysEx
+			++sysexLength;
+			midiReceiver.handleSysex(stream, sysexLength);
+			return sysexLength;
+		}
+		if (nextByte < 0xF8) {
 			// Illegal status byte in SysEx message, aborting
 			midiReporter.printDebug("parseSysex: SysEx message lacks end-of-sysex (0xf7), ignored");
 			// Continue parsing from that point
-			return sysexLength - 1;
+			return sysexLength;
 		}
+		// The System Realtime message must be processed right after return
+		// but the SysEx is actually fragmented and to be reconstructed in streamBuffer
 	}
 
 	// Store incomplete SysEx message for further processing
@@ -254,12 +299,20 @@ Bit32u MidiStreamParserImpl::parseSysex(const Bit8u stream[], const Bit32u lengt
 Bit32u MidiStreamParserImpl::parseSysexFragment(const Bit8u stream[], const Bit32u length) {
 	Bit32u parsedLength = 0;
 	while (parsedLength < length) {
-		Bit8u nextByte = stream[parsedLength++];
-		if (nextByte < 0x80) {
-			// Add SysEx data byte to streamBuffer
-			if (checkStreamBufferCapacity(true)) streamBuffer[streamBufferSize++] = nextByte;
-			continue;
+		// Add SysEx data bytes to streamBuffer, those that don't fit are dropped
+		const Bit32u dataLength = findStatusByte(stream + parsedLength, length - parsedLength);
+		Bit32u addedLength = 0;
+		while (addedLength < dataLength && checkStreamBufferCapacity(true)) {
+			Bit32u chunkLength = streamBufferCapacity - streamBufferSize;
+			if (chunkLength > dataLength - addedLength) chunkLength = dataLength - addedLength;
+			memcpy(streamBuffer + streamBufferSize, stream + parsedLength + addedLength, chunkLength);
+			streamBufferSize += chunkLength;
+			addedLength += chunkLength;
 		}
+		parsedLength += dataLength;
+		if (parsedLength == length) break;
+
+		Bit8u nextByte = stream[parsedLength++];
 		if (0xF8 <= nextByte) {
 			// Bypass System Realtime message
 			midiReceiver.handleSystemRealtimeMessage(nextByte);
@@ -87,6 +87,7 @@ private:
 	bool checkStreamBufferCapacity(const bool preserveContent);
 	bool processStatusByte(Bit8u &status);
 	Bit32u parseShortMessageStatus(const Bit8u stream[]);
+	Bit32u parseShortMessageRun(const Bit8u stream[], const Bit32u length);
 	Bit32u parseShortMessageDataBytes(const Bit8u stream[], Bit32u length);
 	Bit32u parseSysex(const Bit8u stream[], const Bit32u length);
 	Bit32u parseSysexFragment(const Bit8u stream[], const Bit32u length);
@@ -0,0 +1,357 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "internals.h"
+
+#include "MixKernels.h"
+#include "CPUFeatures.h"
+#include "SIMDDispatch.h"
+#include "Synth.h"
+
+namespace MT32Emu {
+
+namespace MixKernels {
+
+typedef void (*IntMixer)(IntSample *leftBuf, IntSample *rightBuf, const IntSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue);
+typedef void (*FloatMixer)(FloatSample *leftBuf, FloatSample *rightBuf, const FloatSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue);
+
+typedef void (*IntPairCombiner)(Bit16s *masterBuf, const Bit16s *slaveBuf, Bit32u length, bool ringModulated, bool mixed);
+typedef void (*FloatPairCombiner)(float *masterBuf, const float *slaveBuf, Bit32u length, bool ringModulated, bool mixed);
+
+struct Implementation {
+	const char *instructionSetName;
+	IntMixer intMixer;
+	FloatMixer floatMixer;
+	IntPairCombiner intPairCombiner;
+	FloatPairCombiner floatPairCombiner;
+};
+
+static void mixScalar(IntSample *leftBuf, IntSample *rightBuf, const IntSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue) {
+	for (Bit32u i = 0; i < length; i++) {
+		IntSampleEx sample = buffer[i];
+		IntSampleEx leftOut = ((sample * leftPanValue) >> 13) + IntSampleEx(leftBuf[i]);
+		IntSampleEx rightOut = ((sample * rightPanValue) >> 13) + IntSampleEx(rightBuf[i]);
+		leftBuf[i] = Synth::clipSampleEx(leftOut);
+		rightBuf[i] = Synth::clipSampleEx(rightOut);
+	}
+}
+
+static void mixScalar(FloatSample *leftBuf, FloatSample *rightBuf, const FloatSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue) {
+	for (Bit32u i = 0; i < length; i++) {
+		FloatSample sample = buffer[i];
+		leftBuf[i] += (sample * leftPanValue) / 14.0f;
+		rightBuf[i] += (sample * rightPanValue) / 14.0f;
+	}
+}
+
+// Emulates the overflow of the ring modulator inputs, see LA32IntPartialPair::mixWGOutput().
+static inline Bit16s produceDistortedSample(Bit16s sample) {
+	return ((sample & 0x2000) == 0) ? Bit16s(sample & 0x1fff) : Bit16s(sample | ~0x1fff);
+}
+
+static inline float produceDistortedSample(float sample) {
+	if (sample < -1.0f) {
+		return sample + 2.0f;
+	} else if (1.0f < sample) {
+		return sample - 2.0f;
+	}
+	return sample;
+}
+
+static void combineScalar(Bit16s *masterBuf, const Bit16s *slaveBuf, Bit32u length, bool ringModulated, bool mixed) {
+	for (Bit32u i = 0; i < length; i++) {
+		const Bit16s masterSample = masterBuf[i];
+		const Bit16s slaveSample = slaveBuf[i];
+		if (!ringModulated) {
+			masterBuf[i] = masterSample + slaveSample;
+			continue;
+		}
+		const Bit16s ringModulatedSample = Bit16s((Bit32s(produceDistortedSample(masterSample)) * Bit32s(produceDistortedSample(slaveSample))) >> 13);
+		masterBuf[i] = mixed ? masterSample + ringModulatedSample : ringModulatedSample;
+	}
+}
+
+static void combineScalar(float *masterBuf, const float *slaveBuf, Bit32u length, bool ringModulated, bool mixed) {
+	for (Bit32u i = 0; i < length; i++) {
+		const float masterSample = masterBuf[i];
+		const float slaveSample = slaveBuf[i];
+		if (!ringModulated) {
+			masterBuf[i] = 0.25f * (masterSample + slaveSample);
+			continue;
+		}
+		const float ringModulatedSample = produceDistortedSample(masterSample) * produceDistortedSample(slaveSample);
+		masterBuf[i] = 0.25f * (mixed ? masterSample + ringModulatedSample : ringModulatedSample);
+	}
+}
+
+#if MT32EMU_SIMD_SSE2
+
+// Computes ((sample * panValue) >> 13) + outSample with saturation for 8 samples.
+// Since the pan values fit in 16 bits, the products are exactly formed from the low and high halves.
+static inline __m128i mixChannelSSE2(const __m128i samples, const __m128i panValue, const __m128i outSamples) {
+	const __m128i productsLow = _mm_mullo_epi16(samples, panValue);
+	const __m128i productsHigh = _mm_mulhi_epi16(samples, panValue);
+	const __m128i pannedLow = _mm_srai_epi32(_mm_unpacklo_epi16(productsLow, productsHigh), 13);
+	const __m128i pannedHigh = _mm_srai_epi32(_mm_unpackhi_epi16(productsLow, productsHigh), 13);
+	const __m128i outLow = _mm_srai_epi32(_mm_unpacklo_epi16(outSamples, outSamples), 16);
+	const __m128i outHigh = _mm_srai_epi32(_mm_unpackhi_epi16(outSamples, outSamples), 16);
+	return _mm_packs_epi32(_mm_add_epi32(pannedLow, outLow), _mm_add_epi32(pannedHigh, outHigh));
+}
+
+static void mixSSE2(IntSample *leftBuf, IntSample *rightBuf, const IntSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue) {
+	const __m128i leftPan = _mm_set1_epi16(Bit16s(leftPanValue));
+	const __m128i rightPan = _mm_set1_epi16(Bit16s(rightPanValue));
+	const Bit32u vectorLength = length & ~7U;
+	for (Bit32u i = 0; i < vectorLength; i += 8) {
+		const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buffer + i));
+		__m128i *left = reinterpret_cast<__m128i *>(leftBuf + i);
+		__m128i *right = reinterpret_cast<__m128i *>(rightBuf + i);
+		_mm_storeu_si128(left, mixChannelSSE2(samples, leftPan, _mm_loadu_si128(left)));
+		_mm_storeu_si128(right, mixChannelSSE2(samples, rightPan, _mm_loadu_si128(right)));
+	}
+	mixScalar(leftBuf + vectorLength, rightBuf + vectorLength, buffer + vectorLength, length - vectorLength, leftPanValue, rightPanValue);
+}
+
+static void mixSSE2(FloatSample *leftBuf, FloatSample *rightBuf, const FloatSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue) {
+	const __m128 leftPan = _mm_set1_ps(float(leftPanValue));
+	const __m128 rightPan = _mm_set1_ps(float(rightPanValue));
+	const __m128 divisor = _mm_set1_ps(14.0f);
+	const Bit32u vectorLength = length & ~3U;
+	for (Bit32u i = 0; i < vectorLength; i += 4) {
+		const __m128 samples = _mm_loadu_ps(buffer + i);
+		_mm_storeu_ps(leftBuf + i, _mm_add_ps(_mm_loadu_ps(leftBuf + i), _mm_div_ps(_mm_mul_ps(samples, leftPan), divisor)));
+		_mm_storeu_ps(rightBuf + i, _mm_add_ps(_mm_loadu_ps(rightBuf + i), _mm_div_ps(_mm_mul_ps(samples, rightPan), divisor)));
+	}
+	mixScalar(leftBuf + vectorLength, rightBuf + vectorLength, buffer + vectorLength, length - vectorLength, leftPanValue, rightPanValue);
+}
+
+// The distorted samples are in range [-8192, 8191], so the products shifted right by 13 bits fit in 16 bits
+// and the saturation never occurs when packing.
+static inline __m128i ringModulateSSE2(const __m128i masterSamples, const __m128i slaveSamples) {
+	const __m128i distortedMaster = _mm_srai_epi16(_mm_slli_epi16(masterSamples, 2), 2);
+	const __m128i distortedSlave = _mm_srai_epi16(_mm_slli_epi16(slaveSamples, 2), 2);
+	const __m128i productsLow = _mm_mullo_epi16(distortedMaster, distortedSlave);
+	const __m128i productsHigh = _mm_mulhi_epi16(distortedMaster, distortedSlave);
+	const __m128i modulatedLow = _mm_srai_epi32(_mm_unpacklo_epi16(productsLow, productsHigh), 13);
+	const __m128i modulatedHigh = _mm_srai_epi32(_mm_unpackhi_epi16(productsLow, productsHigh), 13);
+	return _mm_packs_epi32(modulatedLow, modulatedHigh);
+}
+
+static void combineSSE2(Bit16s *masterBuf, const Bit16s *slaveBuf, Bit32u length, bool ringModulated, bool mixed) {
+	const Bit32u vectorLength = length & ~7U;
+	for (Bit32u i = 0; i < vectorLength; i += 8) {
+		__m128i *master = reinterpret_cast<__m128i *>(masterBuf + i);
+		const __m128i masterSamples = _mm_loadu_si128(master);
+		const __m128i slaveSamples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(slaveBuf + i));
+		if (!ringModulated) {
+			_mm_storeu_si128(master, _mm_add_epi16(masterSamples, slaveSamples));
+			continue;
+		}
+		const __m128i ringModulatedSamples = ringModulateSSE2(masterSamples, slaveSamples);
+		_mm_storeu_si128(master, mixed ? _mm_add_epi16(masterSamples, ringModulatedSamples) : ringModulatedSamples);
+	}
+	combineScalar(masterBuf + vectorLength, slaveBuf + vectorLength, length - vectorLength, ringModulated, mixed);
+}
+
+static inline __m128 produceDistortedSamplesSSE2(const __m128 samples) {
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 belowRange = _mm_cmplt_ps(samples, _mm_set1_ps(-1.0f));
+	const __m128 aboveRange = _mm_cmplt_ps(_mm_set1_ps(1.0f), samples);
+	__m128 result = _mm_or_ps(_mm_and_ps(aboveRange, _mm_sub_ps(samples, two)), _mm_andnot_ps(aboveRange, samples));
+	result = _mm_or_ps(_mm_and_ps(belowRange, _mm_add_ps(samples, two)), _mm_andnot_ps(belowRange, result));
+	return result;
+}
+
+static void combineSSE2(float *masterBuf, const float *slaveBuf, Bit32u length, bool ringModulated, bool mixed) {
+	const __m128 factor = _mm_set1_ps(0.25f);
+	const Bit32u vectorLength = length & ~3U;
+	for (Bit32u i = 0; i < vectorLength; i += 4) {
+		const __m128 masterSamples = _mm_loadu_ps(masterBuf + i);
+		const __m128 slaveSamples = _mm_loadu_ps(slaveBuf + i);
+		if (!ringModulated) {
+			_mm_storeu_ps(masterBuf + i, _mm_mul_ps(factor, _mm_add_ps(masterSamples, slaveSamples)));
+			continue;
+		}
+		const __m128 ringModulatedSamples = _mm_mul_ps(produceDistortedSamplesSSE2(masterSamples), produceDistortedSamplesSSE2(slaveSamples));
+		_mm_storeu_ps(masterBuf + i, _mm_mul_ps(factor, mixed ? _mm_add_ps(masterSamples, ringModulatedSamples) : ringModulatedSamples));
+	}
+	combineScalar(masterBuf + vectorLength, slaveBuf + vectorLength, length - vectorLength, ringModulated, mixed);
+}
+
+#endif // #if MT32EMU_SIMD_SSE2
+
+#if MT32EMU_SIMD_AVX2
+
+// Same as mixChannelSSE2() for 16 samples. Unpacking and packing operate within 128-bit lanes, so the order is retained.
+MT32EMU_AVX2_TARGET static inline __m256i mixChannelAVX2(const __m256i samples, const __m256i panValue, const __m256i outSamples) {
+	const __m256i productsLow = _mm256_mullo_epi16(samples, panValue);
+	const __m256i productsHigh = _mm256_mulhi_epi16(samples, panValue);
+	const __m256i pannedLow = _mm256_srai_epi32(_mm256_unpacklo_epi16(productsLow, productsHigh), 13);
+	const __m256i pannedHigh = _mm256_srai_epi32(_mm256_unpackhi_epi16(productsLow, productsHigh), 13);
+	const __m256i outLow = _mm256_srai_epi32(_mm256_unpacklo_epi16(outSamples, outSamples), 16);
+	const __m256i outHigh = _mm256_srai_epi32(_mm256_unpackhi_epi16(outSamples, outSamples), 16);
+	return _mm256_packs_epi32(_mm256_add_epi32(pannedLow, outLow), _mm256_add_epi32(pannedHigh, outHigh));
+}
+
+MT32EMU_AVX2_TARGET static void mixAVX2(IntSample *leftBuf, IntSample *rightBuf, const IntSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue) {
+	const __m256i leftPan = _mm256_set1_epi16(Bit16s(leftPanValue));
+	const __m256i rightPan = _mm256_set1_epi16(Bit16s(rightPanValue));
+	const Bit32u vectorLength = length & ~15U;
+	for (Bit32u i = 0; i < vectorLength; i += 16) {
+		const __m256i samples = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buffer + i));
+		__m256i *left = reinterpret_cast<__m256i *>(leftBuf + i);
+		__m256i *right = reinterpret_cast<__m256i *>(rightBuf + i);
+		_mm256_storeu_si256(left, mixChannelAVX2(samples, leftPan, _mm256_loadu_si256(left)));
+		_mm256_storeu_si256(right, mixChannelAVX2(samples, rightPan, _mm256_loadu_si256(right)));
+	}
+	// The upper halves of the registers must be cleared explicitly, as the compiler may omit it before the tail call.
+	// Otherwise, the legacy SSE code that follows suffers from the state transition penalties.
+	_mm256_zeroupper();
+	mixSSE2(leftBuf + vectorLength, rightBuf + vectorLength, buffer + vectorLength, length - vectorLength, leftPanValue, rightPanValue);
+}
+
+MT32EMU_AVX2_TARGET static void mixAVX2(FloatSample *leftBuf, FloatSample *rightBuf, const FloatSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue) {
+	const __m256 leftPan = _mm256_set1_ps(float(leftPanValue));
+	const __m256 rightPan = _mm256_set1_ps(float(rightPanValue));
+	const __m256 divisor = _mm256_set1_ps(14.0f);
+	const Bit32u vectorLength = length & ~7U;
+	for (Bit32u i = 0; i < vectorLength; i += 8) {
+		const __m256 samples = _mm256_loadu_ps(buffer + i);
+		_mm256_storeu_ps(leftBuf + i, _mm256_add_ps(_mm256_loadu_ps(leftBuf + i), _mm256_div_ps(_mm256_mul_ps(samples, leftPan), divisor)));
+		_mm256_storeu_ps(rightBuf + i, _mm256_add_ps(_mm256_loadu_ps(rightBuf + i), _mm256_div_ps(_mm256_mul_ps(samples, rightPan), divisor)));
+	}
+	// The upper halves of the registers must be cleared explicitly, as the compiler may omit it before the tail call.
+	// Otherwise, the legacy SSE code that follows suffers from the state transition penalties.
+	_mm256_zeroupper();
+	mixSSE2(leftBuf + vectorLength, rightBuf + vectorLength, buffer + vectorLength, length - vectorLength, leftPanValue, rightPanValue);
+}
+
+// Same as ringModulateSSE2() for 16 samples.
+MT32EMU_AVX2_TARGET static inline __m256i ringModulateAVX2(const __m256i masterSamples, const __m256i slaveSamples) {
+	const __m256i distortedMaster = _mm256_srai_epi16(_mm256_slli_epi16(masterSamples, 2), 2);
+	const __m256i distortedSlave = _mm256_srai_epi16(_mm256_slli_epi16(slaveSamples, 2), 2);
+	const __m256i productsLow = _mm256_mullo_epi16(distortedMaster, distortedSlave);
+	const __m256i productsHigh = _mm256_mulhi_epi16(distortedMaster, distortedSlave);
+	const __m256i modulatedLow = _mm256_srai_epi32(_mm256_unpacklo_epi16(productsLow, productsHigh), 13);
+	const __m256i modulatedHigh = _mm256_srai_epi32(_mm256_unpackhi_epi16(productsLow, productsHigh), 13);
+	return _mm256_packs_epi32(modulatedLow, modulatedHigh);
+}
+
+MT32EMU_AVX2_TARGET static void combineAVX2(Bit16s *masterBuf, const Bit16s *slaveBuf, Bit32u length, bool ringModulated, bool mixed) {
+	const Bit32u vectorLength = length & ~15U;
+	for (Bit32u i = 0; i < vectorLength; i += 16) {
+		__m256i *master = reinterpret_cast<__m256i *>(masterBuf + i);
+		const __m256i masterSamples = _mm256_loadu_si256(master);
+		const __m256i slaveSamples = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(slaveBuf + i));
+		if (!ringModulated) {
+			_mm256_storeu_si256(master, _mm256_add_epi16(masterSamples, slaveSamples));
+			continue;
+		}
+		const __m256i ringModulatedSamples = ringModulateAVX2(masterSamples, slaveSamples);
+		_mm256_storeu_si256(master, mixed ? _mm256_add_epi16(masterSamples, ringModulatedSamples) : ringModulatedSamples);
+	}
+	_mm256_zeroupper();
+	combineSSE2(masterBuf + vectorLength, slaveBuf + vectorLength, length - vectorLength, ringModulated, mixed);
+}
+
+MT32EMU_AVX2_TARGET static inline __m256 produceDistortedSamplesAVX2(const __m256 samples) {
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 belowRange = _mm256_cmp_ps(samples, _mm256_set1_ps(-1.0f), _CMP_LT_OQ);
+	const __m256 aboveRange = _mm256_cmp_ps(_mm256_set1_ps(1.0f), samples, _CMP_LT_OQ);
+	const __m256 result = _mm256_blendv_ps(samples, _mm256_sub_ps(samples, two), aboveRange);
+	return _mm256_blendv_ps(result, _mm256_add_ps(samples, two), belowRange);
+}
+
+MT32EMU_AVX2_TARGET static void combineAVX2(float *masterBuf, const float *slaveBuf, Bit32u length, bool ringModulated, bool mixed) {
+	const __m256 factor = _mm256_set1_ps(0.25f);
+	const Bit32u vectorLength = length & ~7U;
+	for (Bit32u i = 0; i < vectorLength; i += 8) {
+		const __m256 masterSamples = _mm256_loadu_ps(masterBuf + i);
+		const __m256 slaveSamples = _mm256_loadu_ps(slaveBuf + i);
+		if (!ringModulated) {
+			_mm256_storeu_ps(masterBuf + i, _mm256_mul_ps(factor, _mm256_add_ps(masterSamples, slaveSamples)));
+			continue;
+		}
+		const __m256 ringModulatedSamples = _mm256_mul_ps(produceDistortedSamplesAVX2(masterSamples), produceDistortedSamplesAVX2(slaveSamples));
+		_mm256_storeu_ps(masterBuf + i, _mm256_mul_ps(factor, mixed ? _mm256_add_ps(masterSamples, ringModulatedSamples) : ringModulatedSamples));
+	}
+	_mm256_zeroupper();
+	combineSSE2(masterBuf + vectorLength, slaveBuf + vectorLength, length - vectorLength, ringModulated, mixed);
+}
+
+#endif // #if MT32EMU_SIMD_AVX2
+
+static Implementation createImplementation(const SIMDInstructionSet instructionSet) {
+	Implementation implementation;
+#if MT32EMU_SIMD_AVX2
+	if (instructionSet == SIMDInstructionSet_AVX2) {
+		implementation.instructionSetName = "AVX2";
+		implementation.intMixer = mixAVX2;
+		implementation.floatMixer = mixAVX2;
+		implementation.intPairCombiner = combineAVX2;
+		implementation.floatPairCombiner = combineAVX2;
+		return implementation;
+	}
+#endif
+#if MT32EMU_SIMD_SSE2
+	if (instructionSet != SIMDInstructionSet_NONE) {
+		implementation.instructionSetName = "SSE2";
+		implementation.intMixer = mixSSE2;
+		implementation.floatMixer = mixSSE2;
+		implementation.intPairCombiner = combineSSE2;
+		implementation.floatPairCombiner = combineSSE2;
+		return implementation;
+	}
+#endif
+	implementation.instructionSetName = "none";
+	implementation.intMixer = mixScalar;
+	implementation.floatMixer = mixScalar;
+	implementation.intPairCombiner = combineScalar;
+	implementation.floatPairCombiner = combineScalar;
+	return implementation;
+}
+
+// Selected during static initialisation and only re-selected by SIMDDispatch while no synth is rendering,
+// so that no synchronisation is needed.
+static Implementation implementation = createImplementation(SIMDDispatch::getSupportedInstructionSet());
+
+void selectImplementation(const SIMDInstructionSet instructionSet) {
+	implementation = createImplementation(instructionSet);
+}
+
+void mixPanned(IntSample *leftBuf, IntSample *rightBuf, const IntSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue) {
+	implementation.intMixer(leftBuf, rightBuf, buffer, length, leftPanValue, rightPanValue);
+}
+
+void mixPanned(FloatSample *leftBuf, FloatSample *rightBuf, const FloatSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue) {
+	implementation.floatMixer(leftBuf, rightBuf, buffer, length, leftPanValue, rightPanValue);
+}
+
+void combinePair(Bit16s *masterBuf, const Bit16s *slaveBuf, Bit32u length, bool ringModulated, bool mixed) {
+	implementation.intPairCombiner(masterBuf, slaveBuf, length, ringModulated, mixed);
+}
+
+void combinePair(float *masterBuf, const float *slaveBuf, Bit32u length, bool ringModulated, bool mixed) {
+	implementation.floatPairCombiner(masterBuf, slaveBuf, length, ringModulated, mixed);
+}
+
+const char *getInstructionSetName() {
+	return implementation.instructionSetName;
+}
+
+} // namespace MixKernels
+
+} // namespace MT32Emu
@@ -0,0 +1,53 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_MIX_KERNELS_H
+#define MT32EMU_MIX_KERNELS_H
+
+#include "internals.h"
+#include "Enumerations.h"
+
+namespace MT32Emu {
+
+// Mixing routines that multiply mono samples by the pan values and accumulate the result to a pair of stereo buffers.
+// For IntSample, the pan values are scaled by 8192 and the result is saturated. For FloatSample, the pan values
+// are in range 0-14. Negative pan values invert the phase as required to emulate the "non-nice" partial mixing.
+// The implementation is chosen upon loading the library according to the CPU capabilities, see SIMDDispatch.
+// All the implementations produce exactly the same output.
+namespace MixKernels {
+
+void mixPanned(IntSample *leftBuf, IntSample *rightBuf, const IntSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue);
+void mixPanned(FloatSample *leftBuf, FloatSample *rightBuf, const FloatSample *buffer, Bit32u length, Bit32s leftPanValue, Bit32s rightPanValue);
+
+// Routines that combine the output of the master and slave wave generators of a partial pair, see LA32PartialPair.
+// The master samples are replaced with their sum with the slave samples, or with the ring modulated samples when
+// ringModulated is set. In the latter case, the master samples are also added to the result when mixed is set.
+// The Bit16s samples come from the integer LA32 model and wrap around on overflow like the hardware does,
+// the float samples are additionally normalised by the factor 0.25 as LA32FloatPartialPair::nextOutSample() does.
+void combinePair(Bit16s *masterBuf, const Bit16s *slaveBuf, Bit32u length, bool ringModulated, bool mixed);
+void combinePair(float *masterBuf, const float *slaveBuf, Bit32u length, bool ringModulated, bool mixed);
+
+// Selects the implementation for the specified instruction set. Must not be invoked while mixing is in progress.
+void selectImplementation(SIMDInstructionSet instructionSet);
+
+// Returns the name of the instruction set used by the selected implementation, for diagnostic purposes.
+const char *getInstructionSetName();
+
+} // namespace MixKernels
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_MIX_KERNELS_H
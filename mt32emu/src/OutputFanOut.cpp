@@ -0,0 +1,399 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#include "internals.h"
+
+#include "OutputFanOut.h"
+#include "Analog.h"
+#include "Structures.h"
+#include "Synth.h"
+#include "ThreadPool.h"
+
+#include "srchelper/srctools/include/FloatSampleProvider.h"
+#if MT32EMU_WITH_INTERNAL_RESAMPLER
+#include "srchelper/srctools/include/ResamplerModel.h"
+#endif
+
+namespace MT32Emu {
+
+// Must exceed the number of samples the LPF and the resampler of any chain read ahead of their output.
+static const Bit32u FAN_OUT_LATENCY = 2048;
+// The DAC streams are rendered and passed through the chains in passes of up to this many samples.
+static const Bit32u FAN_OUT_PASS_LENGTH = 1024;
+// Keeps the samples that the chains may still read, with some margin for the chains that read less ahead than the others.
+static const Bit32u FAN_OUT_CACHE_LENGTH = 2 * FAN_OUT_LATENCY + FAN_OUT_PASS_LENGTH;
+static const Bit32u DAC_STREAM_COUNT = 6;
+
+// Keeps the DAC streams rendered recently, so that all the chains read the same samples.
+template <class Sample>
+class DACStreamsCache {
+public:
+	DACStreamsCache() : startPosition(0), length(0) {
+		memset(silence, 0, sizeof(silence));
+	}
+
+	// Drops the samples before keepPosition and renders more samples at the end.
+	void renderNext(Synth &synth, Bit32u keepPosition, Bit32u renderLength) {
+		Bit32u dropLength = keepPosition - startPosition;
+		if (length < dropLength) dropLength = length;
+		// Should the chains lag behind too far, the samples they haven't read yet are lost.
+		if (FAN_OUT_CACHE_LENGTH < length - dropLength + renderLength) dropLength = length + renderLength - FAN_OUT_CACHE_LENGTH;
+		if (dropLength > 0) {
+			for (Bit32u i = 0; i < DAC_STREAM_COUNT; i++) {
+				memmove(buffers[i], buffers[i] + dropLength, (length - dropLength) * sizeof(Sample));
+			}
+			startPosition += dropLength;
+			length -= dropLength;
+		}
+		DACOutputStreams<Sample> streams = {
+			buffers[0] + length, buffers[1] + length,
+			buffers[2] + length, buffers[3] + length,
+			buffers[4] + length, buffers[5] + length
+		};
+		synth.renderStreams(streams, renderLength);
+		length += renderLength;
+	}
+
+	// Returns false and points the streams to silence unless all the requested samples are in the cache.
+	bool getStreams(Bit32u position, Bit32u readLength, const Sample **streams) const {
+		const Bit32u offset = position - startPosition;
+		const bool available = offset <= length && readLength <= length - offset && readLength <= FAN_OUT_PASS_LENGTH;
+		for (Bit32u i = 0; i < DAC_STREAM_COUNT; i++) {
+			streams[i] = available ? buffers[i] + offset : silence;
+		}
+		return available;
+	}
+
+	Bit32u getStartPosition() const {
+		return startPosition;
+	}
+
+	Bit32u getEndPosition() const {
+		return startPosition + length;
+	}
+
+private:
+	Sample buffers[DAC_STREAM_COUNT][FAN_OUT_CACHE_LENGTH];
+	Sample silence[FAN_OUT_PASS_LENGTH];
+	Bit32u startPosition;
+	Bit32u length;
+};
+
+static inline bool processAnalog(Analog &analog, FloatSample *outBuffer, const FloatSample **streams, Bit32u length) {
+	const StereoOutputDescriptor<FloatSample> output = { outBuffer, outBuffer + 1, 2, false, 1.0f };
+	return analog.process(output, streams[0], streams[1], streams[2], streams[3], streams[4], streams[5], length);
+}
+
+static inline bool processAnalog(Analog &analog, FloatSample *outBuffer, const IntSample **streams, Bit32u length) {
+	IntSample intBuffer[2 * FAN_OUT_PASS_LENGTH];
+	const StereoOutputDescriptor<IntSample> output = { intBuffer, intBuffer + 1, 2, false, 1.0f };
+	const bool processed = analog.process(output, streams[0], streams[1], streams[2], streams[3], streams[4], streams[5], length);
+	for (Bit32u i = 0; i < 2 * length; i++) {
+		outBuffer[i] = Synth::convertSample(intBuffer[i]);
+	}
+	return processed;
+}
+
+static inline void storeSample(float &outSample, const float sample, const bool accumulate, const float gain) {
+	outSample = accumulate ? outSample + sample * gain : sample;
+}
+
+// As in the synth, the gain is limited to 256 and quantised to 1/256 for the 16-bit output.
+static inline void storeSample(Bit16s &outSample, const float sample, const bool accumulate, const float gain) {
+	const Bit16s convertedSample = Synth::convertSample(sample);
+	if (accumulate) {
+		const Bit32s intGain = Bit32s((256.0f < gain ? 256.0f : gain) * 256.0f);
+		outSample = Synth::clipSampleEx(Bit32s(outSample) + ((convertedSample * intGain) >> 8));
+	} else {
+		outSample = convertedSample;
+	}
+}
+
+// An output chain is a source of the analog output for its resampler, which in turn pulls the DAC streams from the cache.
+template <class Sample>
+class FanOutChain : public SRCTools::FloatSampleProvider {
+public:
+	FanOutChain(const DACStreamsCache<Sample> &useCache, Analog *useAnalog, double useSampleRate, SamplerateConversionQuality quality) :
+		cache(useCache),
+		analog(useAnalog),
+		sampleRate(useSampleRate),
+		position(useCache.getStartPosition()),
+		outputFrameCount(0),
+		outputOffset(0),
+		cacheMissed(false)
+	{
+		const double analogSampleRate = analog->getOutputSampleRate();
+#if MT32EMU_WITH_INTERNAL_RESAMPLER
+		model = &SRCTools::ResamplerModel::createResamplerModel(*this, analogSampleRate, sampleRate, static_cast<SRCTools::ResamplerModel::Quality>(quality));
+#else
+		(void)quality;
+		model = analogSampleRate == sampleRate ? this : NULL;
+#endif
+	}
+
+	~FanOutChain() {
+#if MT32EMU_WITH_INTERNAL_RESAMPLER
+		SRCTools::ResamplerModel::freeResamplerModel(*model, *this);
+#endif
+		delete analog;
+	}
+
+	// Produces the analog output at the analog output sample rate, as requested by the resampler.
+	void getOutputSamples(FloatSample *outBuffer, unsigned int size) {
+		while (size > 0) {
+			const Bit32u thisPassSize = size < FAN_OUT_PASS_LENGTH ? size : FAN_OUT_PASS_LENGTH;
+			const Bit32u dacStreamsLength = analog->getDACStreamsLength(thisPassSize);
+			const Sample *streams[DAC_STREAM_COUNT];
+			if (!cache.getStreams(position, dacStreamsLength, streams)) cacheMissed = true;
+			processAnalog(*analog, outBuffer, streams, thisPassSize);
+			position += dacStreamsLength;
+			outBuffer += 2 * thisPassSize;
+			size -= thisPassSize;
+		}
+	}
+
+	// Returns the number of frames to output once the specified number of samples is rendered in total.
+	Bit32u getOutputLength(double renderedLength) const {
+		if (renderedLength <= FAN_OUT_LATENCY) return 0;
+		return Bit32u(floor((renderedLength - FAN_OUT_LATENCY) * sampleRate / SAMPLE_RATE) - outputFrameCount);
+	}
+
+	bool isActive() const {
+		return model != NULL;
+	}
+
+	Bit32u getPosition() const {
+		return position;
+	}
+
+	bool takeCacheMissed() {
+		const bool missed = cacheMissed;
+		cacheMissed = false;
+		return missed;
+	}
+
+	void resetOutputOffset() {
+		outputOffset = 0;
+	}
+
+	// Stores the output corresponding to the samples rendered so far at the current offset in the output.
+	template <class O>
+	void produceOutput(const StereoOutputDescriptor<O> &output, double renderedLength) {
+		float floatBuffer[2 * MAX_SAMPLES_PER_RUN];
+		Bit32u length = getOutputLength(renderedLength);
+		outputFrameCount += length;
+		O *left = output.left == NULL ? NULL : output.left + outputOffset * output.stride;
+		O *right = output.right == NULL ? NULL : output.right + outputOffset * output.stride;
+		outputOffset += length;
+		while (length > 0) {
+			const Bit32u thisPassLength = MAX_SAMPLES_PER_RUN < length ? MAX_SAMPLES_PER_RUN : length;
+			if (model == NULL) {
+				Synth::muteSampleBuffer(floatBuffer, 2 * thisPassLength);
+			} else {
+				model->getOutputSamples(floatBuffer, thisPassLength);
+			}
+			if (left != NULL) {
+				for (Bit32u i = 0; i < thisPassLength; i++) {
+					storeSample(*left, floatBuffer[2 * i], output.accumulate, output.gain);
+					storeSample(*right, floatBuffer[2 * i + 1], output.accumulate, output.gain);
+					left += output.stride;
+					right += output.stride;
+				}
+			}
+			length -= thisPassLength;
+		}
+	}
+
+private:
+	const DACStreamsCache<Sample> &cache;
+	Analog * const analog;
+	const double sampleRate;
+	SRCTools::FloatSampleProvider *model;
+	// Position of the next DAC sample to read from the cache.
+	Bit32u position;
+	double outputFrameCount;
+	// Number of frames stored in the output during the current call to render().
+	Bit32u outputOffset;
+	bool cacheMissed;
+};
+
+template <class Sample, class O>
+class FanOutJob : public ThreadPool::Job {
+public:
+	FanOutJob(FanOutChain<Sample> **useChains, const StereoOutputDescriptor<O> *useOutputs, double useRenderedLength) :
+		chains(useChains),
+		outputs(useOutputs),
+		renderedLength(useRenderedLength)
+	{}
+
+	void runTask(Bit32u taskIx) {
+		chains[taskIx]->produceOutput(outputs[taskIx], renderedLength);
+	}
+
+private:
+	FanOutChain<Sample> ** const chains;
+	const StereoOutputDescriptor<O> * const outputs;
+	const double renderedLength;
+};
+
+class OutputFanOutEngine {
+public:
+	virtual ~OutputFanOutEngine() {}
+	virtual Bit32u getChainCount() const = 0;
+	virtual Bit32u getChainOutputLength(Bit32u chainIx, Bit32u length) const = 0;
+	virtual void render(const StereoOutputDescriptor<Bit16s> *outputs, Bit32u length) = 0;
+	virtual void render(const StereoOutputDescriptor<float> *outputs, Bit32u length) = 0;
+	// Returns true if any chain has read samples missing in the cache since the last call.
+	virtual bool takeCacheMissed() = 0;
+};
+
+template <class Sample>
+class OutputFanOutEngineImpl : public OutputFanOutEngine {
+public:
+	OutputFanOutEngineImpl(Synth &useSynth, const OutputChainSettings *chainSettings, Bit32u useChainCount, Bit32u threadCount, bool oldMT32AnalogLPF) :
+		synth(useSynth),
+		chainCount(useChainCount),
+		chains(new FanOutChain<Sample> *[useChainCount]),
+		threadPool(threadCount > 1 && useChainCount > 1 ? ThreadPool::createThreadPool(threadCount - 1) : NULL),
+		renderedLength(0)
+	{
+		for (Bit32u i = 0; i < chainCount; i++) {
+			const OutputChainSettings &settings = chainSettings[i];
+			Analog *analog = Analog::createAnalog(settings.analogOutputMode, oldMT32AnalogLPF, synth.getSelectedRendererType());
+			analog->setSynthOutputGain(settings.outputGain < 0.0f ? -settings.outputGain : settings.outputGain);
+			analog->setReverbOutputGain(settings.reverbOutputGain < 0.0f ? -settings.reverbOutputGain : settings.reverbOutputGain, synth.isMT32ReverbCompatibilityMode());
+			chains[i] = new FanOutChain<Sample>(cache, analog, settings.sampleRate, settings.quality);
+		}
+	}
+
+	~OutputFanOutEngineImpl() {
+		delete threadPool;
+		for (Bit32u i = 0; i < chainCount; i++) {
+			delete chains[i];
+		}
+		delete[] chains;
+	}
+
+	Bit32u getChainCount() const {
+		return chainCount;
+	}
+
+	Bit32u getChainOutputLength(Bit32u chainIx, Bit32u length) const {
+		return chainIx < chainCount ? chains[chainIx]->getOutputLength(renderedLength + length) : 0;
+	}
+
+	void render(const StereoOutputDescriptor<Bit16s> *outputs, Bit32u length) {
+		doRender(outputs, length);
+	}
+
+	void render(const StereoOutputDescriptor<float> *outputs, Bit32u length) {
+		doRender(outputs, length);
+	}
+
+	bool takeCacheMissed() {
+		bool missed = false;
+		for (Bit32u i = 0; i < chainCount; i++) {
+			missed |= chains[i]->takeCacheMissed();
+		}
+		return missed;
+	}
+
+private:
+	Synth &synth;
+	const Bit32u chainCount;
+	FanOutChain<Sample> ** const chains;
+	// NULL unless the chains are processed concurrently.
+	ThreadPool * const threadPool;
+	DACStreamsCache<Sample> cache;
+	// Total number of samples rendered, kept in a double so as not to wrap around.
+	double renderedLength;
+
+	// Returns the position of the first sample that the chains may still read.
+	Bit32u getKeepPosition() const {
+		Bit32u keepOffset = cache.getEndPosition() - cache.getStartPosition();
+		for (Bit32u i = 0; i < chainCount; i++) {
+			if (!chains[i]->isActive()) continue;
+			const Bit32u offset = chains[i]->getPosition() - cache.getStartPosition();
+			if (offset < keepOffset) keepOffset = offset;
+		}
+		return cache.getStartPosition() + keepOffset;
+	}
+
+	template <class O>
+	void doRender(const StereoOutputDescriptor<O> *outputs, Bit32u length) {
+		for (Bit32u i = 0; i < chainCount; i++) {
+			chains[i]->resetOutputOffset();
+		}
+		while (length > 0) {
+			const Bit32u thisPassLength = length < FAN_OUT_PASS_LENGTH ? length : FAN_OUT_PASS_LENGTH;
+			cache.renderNext(synth, getKeepPosition(), thisPassLength);
+			renderedLength += thisPassLength;
+			FanOutJob<Sample, O> job(chains, outputs, renderedLength);
+			if (threadPool != NULL) {
+				threadPool->runJob(job, chainCount);
+			} else {
+				for (Bit32u i = 0; i < chainCount; i++) {
+					job.runTask(i);
+				}
+			}
+			length -= thisPassLength;
+		}
+	}
+};
+
+static OutputFanOutEngine &createEngine(Synth &synth, const OutputChainSettings *chainSettings, Bit32u chainCount, Bit32u threadCount, bool oldMT32AnalogLPF) {
+	if (synth.getSelectedRendererType() == RendererType_FLOAT) {
+		return *new OutputFanOutEngineImpl<FloatSample>(synth, chainSettings, chainCount, threadCount, oldMT32AnalogLPF);
+	}
+	return *new OutputFanOutEngineImpl<IntSample>(synth, chainSettings, chainCount, threadCount, oldMT32AnalogLPF);
+}
+
+Bit32u OutputFanOut::getLatency() {
+	return FAN_OUT_LATENCY;
+}
+
+OutputFanOut::OutputFanOut(Synth &useSynth, const OutputChainSettings *chainSettings, Bit32u chainCount, Bit32u threadCount) :
+	synth(useSynth),
+	engine(createEngine(useSynth, chainSettings, chainCount, threadCount, useSynth.controlROMFeatures->oldMT32AnalogLPF))
+{}
+
+OutputFanOut::~OutputFanOut() {
+	delete &engine;
+}
+
+Bit32u OutputFanOut::getChainCount() const {
+	return engine.getChainCount();
+}
+
+Bit32u OutputFanOut::getChainOutputLength(Bit32u chainIx, Bit32u length) const {
+	return engine.getChainOutputLength(chainIx, length);
+}
+
+void OutputFanOut::render(const StereoOutputDescriptor<Bit16s> *outputs, Bit32u length) {
+	engine.render(outputs, length);
+	if (engine.takeCacheMissed()) synth.printDebug("OutputFanOut: An output chain has read past the cached DAC streams\n");
+}
+
+void OutputFanOut::render(const StereoOutputDescriptor<float> *outputs, Bit32u length) {
+	engine.render(outputs, length);
+	if (engine.takeCacheMissed()) synth.printDebug("OutputFanOut: An output chain has read past the cached DAC streams\n");
+}
+
+} // namespace MT32Emu
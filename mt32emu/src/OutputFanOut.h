@@ -0,0 +1,85 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_OUTPUT_FAN_OUT_H
+#define MT32EMU_OUTPUT_FAN_OUT_H
+
+#include "globals.h"
+#include "Types.h"
+#include "Enumerations.h"
+
+namespace MT32Emu {
+
+class Synth;
+class OutputFanOutEngine;
+
+template <class T>
+struct StereoOutputDescriptor;
+
+// Settings of an output chain of OutputFanOut. The gains have the same meaning as those set by Synth::setOutputGain()
+// and Synth::setReverbOutputGain().
+struct OutputChainSettings {
+	AnalogOutputMode analogOutputMode;
+	double sampleRate;
+	SamplerateConversionQuality quality;
+	float outputGain;
+	float reverbOutputGain;
+};
+
+/* OutputFanOut renders the streams that appear at the DAC entrance (see Synth::renderStreams()) once and feeds them
+ * to several independent output chains. Each chain consists of a separate analogue circuit emulation and a sample rate
+ * converter, so that the same performance can be delivered in several output formats at the cost of a single run
+ * of the synthesis engine plus the post-processing of each format. The renderer type and the DAC input mode of the synth
+ * apply to all the chains, while the analog output mode of the synth is not used.
+ *
+ * Each chain pulls the DAC streams at its own pace, which depends on the LPF and the resampler. So that the synth is rendered
+ * in step with the MIDI input, the output of the chains lags behind the rendered DAC streams by getLatency() samples
+ * at the DAC sample rate. Thus, the chains output nothing until that many samples are rendered, and the same number of samples
+ * should be rendered after the end of the performance to obtain the complete output.
+ *
+ * The chains may be processed concurrently in worker threads, the output doesn't depend on the number of threads.
+ * The sample rate conversion is only available with the internal resampler, otherwise the chains that require
+ * conversion output silence.
+ */
+class MT32EMU_EXPORT OutputFanOut {
+public:
+	// Returns the number of samples at the DAC sample rate (32000 Hz) the output of the chains lags behind the rendering.
+	static Bit32u getLatency();
+
+	// The synth must be open and must not be rendered otherwise while in use by the fan-out. The settings are copied.
+	// When threadCount is greater than 1, worker threads are created to process the chains concurrently.
+	OutputFanOut(Synth &synth, const OutputChainSettings *chainSettings, Bit32u chainCount, Bit32u threadCount = 1);
+	~OutputFanOut();
+
+	Bit32u getChainCount() const;
+
+	// Returns the number of frames the specified chain outputs upon rendering the specified number of samples next.
+	Bit32u getChainOutputLength(Bit32u chainIx, Bit32u length) const;
+
+	// Renders the specified number of samples at the DAC sample rate and passes them through all the chains.
+	// The outputs array contains an output descriptor per chain (see Synth::render()), each chain stores
+	// getChainOutputLength() frames.
+	void render(const StereoOutputDescriptor<Bit16s> *outputs, Bit32u length);
+	void render(const StereoOutputDescriptor<float> *outputs, Bit32u length);
+
+private:
+	Synth &synth;
+	OutputFanOutEngine &engine;
+}; // class OutputFanOut
+
+} // namespace MT32Emu
+
+#endif // MT32EMU_OUTPUT_FAN_OUT_H
@@ -25,6 +25,7 @@
 #include "PartialManager.h"
 #include "Poly.h"
 #include "Synth.h"
+#include "SynthState.h"
 
 namespace MT32Emu {
 
@@ -41,12 +42,15 @@ static const Bit8u PartialMixStruct[13] = {
 RhythmPart::RhythmPart(Synth *useSynth, unsigned int usePartNum): Part(useSynth, usePartNum) {
 	strcpy(name, "Rhythm");
 	rhythmTemp = &synth->mt32ram.rhythmTemp[0];
+	memset(drumCache, 0, sizeof(drumCache));
 	refresh();
 }
 
 Part::Part(Synth *useSynth, unsigned int usePartNum) {
 	synth = useSynth;
 	partNum = usePartNum;
+	timbreTempAbsTimbreNum = -1;
+	cachedAbsTimbreNum = -1;
 	patchCache[0].dirty = true;
 	holdpedal = false;
 	patchTemp = &synth->mt32ram.patchTemp[partNum];
@@ -62,15 +66,19 @@ Part::Part(Synth *useSynth, unsigned int usePartNum) {
 	modulation = 0;
 	expression = 100;
 	pitchBend = 0;
+	nrpn = false;
+	rpn = 0xFFFF;
 	activePartialCount = 0;
+	releasingPartialCount = 0;
+	for (int i = 0; i < POLY_Inactive; i++) {
+		firstPolyInState[i] = NULL;
+		lastPolyInState[i] = NULL;
+	}
 	memset(patchCache, 0, sizeof(patchCache));
 }
 
-Part::~Part() {
-	while (!activePolys.isEmpty()) {
-		delete activePolys.takeFirst();
-	}
-}
+// The active polys are owned by the partial manager, which destroys them.
+Part::~Part() {}
 
 void Part::setDataEntryMSB(unsigned char midiDataEntryMSB) {
 	if (nrpn) {
@@ -135,6 +143,9 @@ void Part::resetAllControllers() {
 }
 
 void Part::reset() {
+	// The timbre memory is reset as well
+	timbreTempAbsTimbreNum = -1;
+	cachedAbsTimbreNum = -1;
 	resetAllControllers();
 	allSoundOff();
 	rpn = 0xFFFF;
@@ -142,7 +153,14 @@ void Part::reset() {
 
 void RhythmPart::refresh() {
 	// (Re-)cache all the mapped timbres ahead of time
-	for (unsigned int drumNum = 0; drumNum < synth->controlROMMap->rhythmSettingsCount; drumNum++) {
+	refreshDrums(0, synth->controlROMMap->rhythmSettingsCount - 1);
+}
+
+void RhythmPart::refreshDrums(unsigned int firstDrum, unsigned int lastDrum) {
+	if (lastDrum >= synth->controlROMMap->rhythmSettingsCount) {
+		lastDrum = synth->controlROMMap->rhythmSettingsCount - 1;
+	}
+	for (unsigned int drumNum = firstDrum; drumNum <= lastDrum; drumNum++) {
 		int drumTimbreNum = rhythmTemp[drumNum].timbre;
 		if (drumTimbreNum >= 127) { // 94 on MT-32
 			continue;
@@ -182,7 +200,18 @@ void RhythmPart::refreshTimbre(unsigned int absTimbreNum) {
 	}
 }
 
+void Part::refreshTimbreTemp() {
+	timbreTempAbsTimbreNum = -1;
+	refresh();
+}
+
 void Part::refreshTimbre(unsigned int absTimbreNum) {
+	if (cachedAbsTimbreNum == int(absTimbreNum)) {
+		cachedAbsTimbreNum = -1;
+	}
+	if (timbreTempAbsTimbreNum == int(absTimbreNum)) {
+		timbreTempAbsTimbreNum = -1;
+	}
 	if (getAbsTimbreNum() == absTimbreNum) {
 		memcpy(currentInstr, timbreTemp->common.name, 10);
 		patchCache[0].dirty = true;
@@ -199,6 +228,8 @@ void RhythmPart::setTimbre(TimbreParam * /*timbre*/) {
 
 void Part::setTimbre(TimbreParam *timbre) {
 	*timbreTemp = *timbre;
+	const unsigned int absTimbreNum = getAbsTimbreNum();
+	timbreTempAbsTimbreNum = timbre == &synth->mt32ram.timbres[absTimbreNum].timbre ? int(absTimbreNum) : -1;
 }
 
 unsigned int RhythmPart::getAbsTimbreNum() const {
@@ -222,7 +253,7 @@ void Part::setProgram(unsigned int patchNum) {
 	setPatch(&synth->mt32ram.patches[patchNum]);
 	holdpedal = false;
 	allSoundOff();
-	setTimbre(&synth->mt32ram.timbres[getAbsTimbreNum()].timbre);
+	setTimbre(synth->getTimbre(getAbsTimbreNum()));
 	refresh();
 }
 
@@ -398,7 +429,7 @@ void RhythmPart::noteOn(unsigned int midiKey, unsigned int velocity) {
 		key = 0;
 	}
 	int absTimbreNum = drumTimbreNum + 128;
-	TimbreParam *timbre = &synth->mt32ram.timbres[absTimbreNum].timbre;
+	TimbreParam *timbre = synth->getTimbre(absTimbreNum);
 	memcpy(currentInstr, timbre->common.name, 10);
 	if (drumCache[drumNum][0].dirty) {
 		cacheTimbre(drumCache[drumNum], timbre);
@@ -418,7 +449,15 @@ void RhythmPart::noteOn(unsigned int midiKey, unsigned int velocity) {
 void Part::noteOn(unsigned int midiKey, unsigned int velocity) {
 	unsigned int key = midiKeyToKey(midiKey);
 	if (patchCache[0].dirty) {
-		cacheTimbre(patchCache, timbreTemp);
+		if (timbreTempAbsTimbreNum >= 0 && timbreTempAbsTimbreNum == cachedAbsTimbreNum) {
+			// The same timbre is reselected (typically, by a repeated program change), so the cache is up-to-date.
+			for (int t = 0; t < 4; t++) {
+				patchCache[t].dirty = false;
+			}
+		} else {
+			cacheTimbre(patchCache, timbreTemp);
+			cachedAbsTimbreNum = timbreTempAbsTimbreNum;
+		}
 	}
 #if MT32EMU_MONITOR_INSTRUMENTS > 0
 	synth->printDebug("%s (%s): Start poly: midiKey %u, key %u, velo %u, mod %u, exp %u, bend %u", name, currentInstr, midiKey, key, velocity, modulation, expression, pitchBend);
@@ -440,12 +479,11 @@ bool Part::abortFirstPoly(unsigned int key) {
 }
 
 bool Part::abortFirstPoly(PolyState polyState) {
-	for (Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
-		if (poly->getState() == polyState) {
-			return poly->startAbort();
-		}
+	if (polyState == POLY_Inactive) {
+		return false;
 	}
-	return false;
+	Poly *poly = firstPolyInState[polyState];
+	return poly != NULL && poly->startAbort();
 }
 
 bool Part::abortFirstPolyPreferHeld() {
@@ -587,21 +625,19 @@ const Poly *Part::getFirstActivePoly() const {
 }
 
 unsigned int Part::getActiveNonReleasingPartialCount() const {
-	unsigned int activeNonReleasingPartialCount = 0;
-	for (Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
-		if (poly->getState() != POLY_Releasing) {
-			activeNonReleasingPartialCount += poly->getActivePartialCount();
-		}
-	}
-	return activeNonReleasingPartialCount;
+	return activePartialCount - releasingPartialCount;
 }
 
 Synth *Part::getSynth() const {
 	return synth;
 }
 
-void Part::partialDeactivated(Poly *poly) {
+// The poly state is the one at the time the partial was deactivated, the poly may have become inactive meanwhile.
+void Part::partialDeactivated(Poly *poly, PolyState polyState) {
 	activePartialCount--;
+	if (polyState == POLY_Releasing) {
+		releasingPartialCount--;
+	}
 	if (!poly->isActive()) {
 		activePolys.remove(poly);
 		synth->partialManager->polyFreed(poly);
@@ -609,6 +645,155 @@ void Part::partialDeactivated(Poly *poly) {
 	}
 }
 
+void Part::polyStateChanged(Poly *poly, PolyState oldState) {
+	if (oldState != POLY_Inactive) {
+		unlinkPolyInState(poly, oldState);
+	}
+	if (oldState == POLY_Releasing) {
+		releasingPartialCount -= poly->getActivePartialCount();
+	}
+	if (poly->getState() != POLY_Inactive) {
+		linkPolyInState(poly);
+	}
+	if (poly->getState() == POLY_Releasing) {
+		releasingPartialCount += poly->getActivePartialCount();
+	}
+}
+
+// Inserts the poly before the next poly in activePolys that is in the same state. State changes mostly affect
+// recently started polys, so the search usually ends close to the poly or at the end of the list.
+void Part::linkPolyInState(Poly *poly) {
+	const PolyState polyState = poly->getState();
+	Poly *nextPoly = NULL;
+	if (poly != activePolys.getFirst()) {
+		for (nextPoly = poly->getNext(); nextPoly != NULL && nextPoly->getState() != polyState; nextPoly = nextPoly->getNext()) {}
+	} else {
+		nextPoly = firstPolyInState[polyState];
+	}
+	Poly *prevPoly = nextPoly == NULL ? lastPolyInState[polyState] : nextPoly->getPrevInState();
+	poly->setStateLinks(prevPoly, nextPoly);
+	if (prevPoly == NULL) {
+		firstPolyInState[polyState] = poly;
+	} else {
+		prevPoly->setStateLinks(prevPoly->getPrevInState(), poly);
+	}
+	if (nextPoly == NULL) {
+		lastPolyInState[polyState] = poly;
+	} else {
+		nextPoly->setStateLinks(poly, nextPoly->getNextInState());
+	}
+}
+
+void Part::unlinkPolyInState(Poly *poly, PolyState polyState) {
+	Poly *prevPoly = poly->getPrevInState();
+	Poly *nextPoly = poly->getNextInState();
+	if (prevPoly == NULL) {
+		firstPolyInState[polyState] = nextPoly;
+	} else {
+		prevPoly->setStateLinks(prevPoly->getPrevInState(), nextPoly);
+	}
+	if (nextPoly == NULL) {
+		lastPolyInState[polyState] = prevPoly;
+	} else {
+		nextPoly->setStateLinks(prevPoly, nextPoly->getNextInState());
+	}
+	poly->setStateLinks(NULL, NULL);
+}
+
+int Part::findPatchCache(const PatchCache *cache) const {
+	for (int t = 0; t < 4; t++) {
+		if (cache == &patchCache[t]) return t;
+	}
+	return -1;
+}
+
+const PatchCache *Part::getPatchCache(Bit32u cacheIx) const {
+	return cacheIx < 4 ? &patchCache[cacheIx] : NULL;
+}
+
+void Part::saveState(StateWriter &writer) const {
+	writer.writeBool(holdpedal);
+	writer.writeUInt32(activePartialCount);
+	for (int t = 0; t < 4; t++) {
+		writer.writePatchCache(patchCache[t]);
+	}
+	writer.writeBytes(currentInstr, sizeof(currentInstr));
+	writer.writeUInt8(modulation);
+	writer.writeUInt8(expression);
+	writer.writeInt32(pitchBend);
+	writer.writeBool(nrpn);
+	writer.writeUInt16(rpn);
+	writer.writeUInt16(pitchBenderRange);
+	Bit32u polyCount = 0;
+	for (const Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
+		polyCount++;
+	}
+	writer.writeUInt32(polyCount);
+	for (const Poly *poly = activePolys.getFirst(); poly != NULL; poly = poly->getNext()) {
+		poly->saveState(writer);
+	}
+}
+
+void Part::restoreState(StateReader &reader) {
+	holdpedal = reader.readBool();
+	activePartialCount = reader.readUInt32();
+	for (int t = 0; t < 4; t++) {
+		reader.readPatchCache(patchCache[t]);
+	}
+	reader.readBytes(currentInstr, sizeof(currentInstr));
+	currentInstr[10] = 0;
+	modulation = reader.readUInt8();
+	expression = reader.readUInt8();
+	pitchBend = reader.readInt32();
+	nrpn = reader.readBool();
+	rpn = reader.readUInt16();
+	pitchBenderRange = reader.readUInt16();
+	Bit32u polyCount = reader.readUInt32();
+	for (Bit32u i = 0; i < polyCount && !reader.isFailed(); i++) {
+		Poly *poly = synth->partialManager->assignPolyToPart(this);
+		if (poly == NULL) {
+			reader.fail();
+			break;
+		}
+		activePolys.append(poly);
+		reader.addPoly(poly);
+		poly->restoreState(reader);
+	}
+}
+
+int RhythmPart::findPatchCache(const PatchCache *cache) const {
+	int cacheIx = Part::findPatchCache(cache);
+	if (cacheIx >= 0) return cacheIx;
+	for (int drumCacheIx = 0; drumCacheIx < 85 * 4; drumCacheIx++) {
+		if (cache == &drumCache[drumCacheIx / 4][drumCacheIx % 4]) return 4 + drumCacheIx;
+	}
+	return -1;
+}
+
+const PatchCache *RhythmPart::getPatchCache(Bit32u cacheIx) const {
+	if (cacheIx < 4) return Part::getPatchCache(cacheIx);
+	cacheIx -= 4;
+	return cacheIx < 85 * 4 ? &drumCache[cacheIx / 4][cacheIx % 4] : NULL;
+}
+
+void RhythmPart::saveState(StateWriter &writer) const {
+	Part::saveState(writer);
+	for (int drumNum = 0; drumNum < 85; drumNum++) {
+		for (int t = 0; t < 4; t++) {
+			writer.writePatchCache(drumCache[drumNum][t]);
+		}
+	}
+}
+
+void RhythmPart::restoreState(StateReader &reader) {
+	Part::restoreState(reader);
+	for (int drumNum = 0; drumNum < 85; drumNum++) {
+		for (int t = 0; t < 4; t++) {
+			reader.readPatchCache(drumCache[drumNum][t]);
+		}
+	}
+}
+
 PolyList::PolyList() : firstPoly(NULL), lastPoly(NULL) {}
 
 bool PolyList::isEmpty() const {
@@ -26,6 +26,8 @@
 namespace MT32Emu {
 
 class Poly;
+class StateReader;
+class StateWriter;
 class Synth;
 
 class PolyList {
@@ -52,16 +54,30 @@ private:
 	// 0=Part 1, .. 7=Part 8, 8=Rhythm
 	unsigned int partNum;
 
+	// Absolute number of the timbre in memory that the timbre temp area was copied from,
+	// or -1 if the area has been modified otherwise since.
+	int timbreTempAbsTimbreNum;
+	// Absolute number of the timbre the patch cache was last built from, or -1 if unknown.
+	// The cache needn't be rebuilt when the timbre temp area holds the same timbre again.
+	int cachedAbsTimbreNum;
+
 	bool holdpedal;
 
 	unsigned int activePartialCount;
+	unsigned int releasingPartialCount;
 	PatchCache patchCache[4];
 	PolyList activePolys;
+	// The active polys in each state, in the same relative order as in activePolys. These let the poly to abort be found
+	// without walking activePolys.
+	Poly *firstPolyInState[POLY_Inactive];
+	Poly *lastPolyInState[POLY_Inactive];
 
 	void setPatch(const PatchParam *patch);
 	unsigned int midiKeyToKey(unsigned int midiKey);
 
 	bool abortFirstPoly(unsigned int key);
+	void linkPolyInState(Poly *poly);
+	void unlinkPolyInState(Poly *poly, PolyState polyState);
 
 protected:
 	Synth *synth;
@@ -109,6 +125,8 @@ public:
 	void stopPedalHold();
 	void updatePitchBenderRange();
 	virtual void refresh();
+	// Invoked when the timbre temp area is written directly.
+	void refreshTimbreTemp();
 	virtual void refreshTimbre(unsigned int absTimbreNum);
 	virtual void setTimbre(TimbreParam *timbre);
 	virtual unsigned int getAbsTimbreNum() const;
@@ -120,8 +138,18 @@ public:
 
 	const MemParams::PatchTemp *getPatchTemp() const;
 
-	// This should only be called by Poly
-	void partialDeactivated(Poly *poly);
+	// Returns the index of the patch cache entry if it is owned by this part, otherwise -1.
+	virtual int findPatchCache(const PatchCache *cache) const;
+	// Returns the patch cache entry with the index returned by findPatchCache(), or NULL if the index is out of range.
+	virtual const PatchCache *getPatchCache(Bit32u cacheIx) const;
+
+	virtual void saveState(StateWriter &writer) const;
+	// Must only be invoked on a newly constructed part, as the polys are appended.
+	virtual void restoreState(StateReader &reader);
+
+	// These should only be called by Poly
+	void partialDeactivated(Poly *poly, PolyState polyState);
+	void polyStateChanged(Poly *poly, PolyState oldState);
 
 	// These are rather specialised, and should probably only be used by PartialManager
 	bool abortFirstPoly(PolyState polyState);
@@ -139,6 +167,8 @@ class RhythmPart: public Part {
 public:
 	RhythmPart(Synth *synth, unsigned int usePartNum);
 	void refresh();
+	// Same as refresh() but only the drums in the specified range are affected.
+	void refreshDrums(unsigned int firstDrum, unsigned int lastDrum);
 	void refreshTimbre(unsigned int timbreNum);
 	void setTimbre(TimbreParam *timbre);
 	void noteOn(unsigned int key, unsigned int velocity);
@@ -146,6 +176,10 @@ public:
 	unsigned int getAbsTimbreNum() const;
 	void setPan(unsigned int midiPan);
 	void setProgram(unsigned int patchNum);
+	int findPatchCache(const PatchCache *cache) const;
+	const PatchCache *getPatchCache(Bit32u cacheIx) const;
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 };
 
 } // namespace MT32Emu
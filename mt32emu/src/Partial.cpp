@@ -16,14 +16,17 @@
  */
 
 #include <cstddef>
+#include <new>
 
 #include "internals.h"
 
 #include "Partial.h"
+#include "MixKernels.h"
 #include "Part.h"
 #include "PartialManager.h"
 #include "Poly.h"
 #include "Synth.h"
+#include "SynthState.h"
 #include "Tables.h"
 #include "TVA.h"
 #include "TVF.h"
@@ -51,34 +54,39 @@ static Bit32s getPanFactor(Bit32s panSetting) {
 	return PAN_FACTORS[panSetting];
 }
 
-Partial::Partial(Synth *useSynth, int usePartialIndex) :
+Partial::Partial(Synth *useSynth, int usePartialIndex, const PartialComponentPlacement &placement) :
 	synth(useSynth), partialIndex(usePartialIndex), sampleNum(0),
 	floatMode(useSynth->getSelectedRendererType() == RendererType_FLOAT) {
 	// Initialisation of tva, tvp and tvf uses 'this' pointer
 	// and thus should not be in the initializer list to avoid a compiler warning
-	tva = new TVA(this, &ampRamp);
-	tvp = new TVP(this);
-	tvf = new TVF(this, &cutoffModifierRamp);
+	tva = new(placement.tva) TVA(this, &ampRamp);
+	tvp = new(placement.tvp) TVP(this);
+	tvf = new(placement.tvf) TVF(this, &cutoffModifierRamp);
 	ownerPart = -1;
 	poly = NULL;
 	pair = NULL;
+	alreadyOutputed = false;
+	deactivationDeferred = false;
+	deferredDeactivationCount = 0;
 	switch (synth->getSelectedRendererType()) {
 	case RendererType_BIT16S:
-		la32Pair = new LA32IntPartialPair;
+		la32Pair = new(placement.la32Pair) LA32IntPartialPair;
 		break;
 	case RendererType_FLOAT:
-		la32Pair = new LA32FloatPartialPair;
+		la32Pair = new(placement.la32Pair) LA32FloatPartialPair;
 		break;
 	default:
 		la32Pair = NULL;
 	}
+	updateFloatWaveAccuracy();
 }
 
+// The components are placed in storage owned by PartialManager, so they are only destroyed here
 Partial::~Partial() {
-	delete la32Pair;
-	delete tva;
-	delete tvp;
-	delete tvf;
+	if (la32Pair != NULL) la32Pair->~LA32PartialPair();
+	tva->~TVA();
+	tvp->~TVP();
+	tvf->~TVF();
 }
 
 // Only used for debugging purposes
@@ -113,14 +121,12 @@ void Partial::deactivate() {
 		return;
 	}
 	ownerPart = -1;
-	synth->partialManager->partialDeactivated(partialIndex);
-	if (poly != NULL) {
-		poly->partialDeactivated(this);
+	Partial *renderingPartial = isRingModulatingSlave() ? pair : this;
+	if (renderingPartial->deactivationDeferred) {
+		renderingPartial->deferredDeactivations[renderingPartial->deferredDeactivationCount++] = this;
+	} else {
+		notifyDeactivated();
 	}
-#if MT32EMU_MONITOR_PARTIALS > 2
-	synth->printDebug("[+%lu] [Partial %d] Deactivated", sampleNum, partialIndex);
-	synth->printPartialUsage(sampleNum);
-#endif
 	if (isRingModulatingSlave()) {
 		pair->la32Pair->deactivate(LA32PartialPair::SLAVE);
 	} else {
@@ -130,11 +136,34 @@ void Partial::deactivate() {
 			pair = NULL;
 		}
 	}
-	if (pair != NULL) {
+	// Unless this is a ring modulating slave, the pair partial may be rendered concurrently, so unlinking is deferred as well.
+	if (pair != NULL && (renderingPartial != this || !deactivationDeferred)) {
 		pair->pair = NULL;
 	}
 }
 
+void Partial::notifyDeactivated() {
+	synth->partialManager->partialDeactivated(partialIndex);
+	if (poly != NULL) {
+		poly->partialDeactivated(this);
+	}
+#if MT32EMU_MONITOR_PARTIALS > 2
+	synth->printDebug("[+%lu] [Partial %d] Deactivated", sampleNum, partialIndex);
+	synth->printPartialUsage(sampleNum);
+#endif
+}
+
+void Partial::completeDeactivation() {
+	for (Bit32u i = 0; i < deferredDeactivationCount; i++) {
+		Partial *partial = deferredDeactivations[i];
+		partial->notifyDeactivated();
+		if (partial->pair != NULL && !partial->isRingModulatingSlave()) {
+			partial->pair->pair = NULL;
+		}
+	}
+	deferredDeactivationCount = 0;
+}
+
 void Partial::startPartial(const Part *part, Poly *usePoly, const PatchCache *usePatchCache, const MemParams::RhythmTemp *rhythmTemp, Partial *pairPartial) {
 	if (usePoly == NULL || usePatchCache == NULL) {
 		synth->printDebug("[Partial %d] *** Error: Starting partial for owner %d, usePoly=%s, usePatchCache=%s", partialIndex, ownerPart, usePoly == NULL ? "*** NULL ***" : "OK", usePatchCache == NULL ? "*** NULL ***" : "OK");
@@ -155,7 +184,7 @@ void Partial::startPartial(const Part *part, Poly *usePoly, const PatchCache *us
 		// Do a normal mix independent of any pair partial.
 		mixType = 0;
 		pairPartial = NULL;
-	} else if (!synth->isNicePanningEnabled()) {
+	} else if (!synth->isLatchedNicePanningEnabled()) {
 		// Mok wanted an option for smoother panning, and we love Mok.
 		// CONFIRMED by Mok: exactly bytes like this (right shifted) are sent to the LA32.
 		panSetting &= 0x0E;
@@ -182,7 +211,7 @@ void Partial::startPartial(const Part *part, Poly *usePoly, const PatchCache *us
 	// whole-quarter assignment or after some partials got aborted, even 4-partial timbres can be found sounding differently.
 	// This behaviour is also confirmed with two more special timbres: one with identical sawtooth partials, and one with PCM wave 02.
 	// For my personal taste, this behaviour rather enriches the sounding and should be emulated.
-	if (!synth->isNicePartialMixingEnabled() && (partialIndex & 4)) {
+	if (!synth->isLatchedNicePartialMixingEnabled() && (partialIndex & 4)) {
 		leftPanValue = -leftPanValue;
 		rightPanValue = -rightPanValue;
 	}
@@ -234,6 +263,12 @@ void Partial::startPartial(const Part *part, Poly *usePoly, const PatchCache *us
 	}
 }
 
+void Partial::updateFloatWaveAccuracy() {
+	if (floatMode) {
+		static_cast<LA32FloatPartialPair *>(la32Pair)->setAccuracy(synth->getEffectiveFloatWaveAccuracy());
+	}
+}
+
 Bit32u Partial::getAmpValue() {
 	// SEMI-CONFIRMED: From sample analysis:
 	// (1) Tested with a single partial playing PCM wave 77 with pitchCoarse 36 and no keyfollow, velocity follow, etc.
@@ -263,6 +298,14 @@ Bit32u Partial::getCutoffValue() {
 	return (tvf->getBaseCutoff() << 18) + cutoffModifierRampVal;
 }
 
+// NOTE: The order matters since TVP may update the TVA sustain level. It matches the right-to-left evaluation of call arguments
+// commonly used by compilers, as these values were computed when passed directly to LA32PartialPair::generateNextSample().
+void Partial::generateNextControls(Bit32u &amp, Bit16u &pitch, Bit32u &cutoff) {
+	cutoff = getCutoffValue();
+	pitch = tvp->nextPitch();
+	amp = getAmpValue();
+}
+
 bool Partial::hasRingModulatingSlave() const {
 	return pair != NULL && structurePosition == 0 && (mixType == 1 || mixType == 2);
 }
@@ -312,15 +355,26 @@ bool Partial::canProduceOutput() {
 	return true;
 }
 
+// Returns true when partial culling is enabled and neither this partial nor its ring modulating slave
+// may rise to the culling level before the next TVA interrupt.
+bool Partial::isInaudible(Bit8u cullingLevel) const {
+	if (cullingLevel == 0 || !ampRamp.staysBelow(cullingLevel)) return false;
+	return !hasRingModulatingSlave() || pair->ampRamp.staysBelow(cullingLevel);
+}
+
 template <class LA32PairImpl>
 bool Partial::generateNextSample(LA32PairImpl *la32PairImpl) {
 	if (!tva->isPlaying() || !la32PairImpl->isActive(LA32PartialPair::MASTER)) {
 		deactivate();
 		return false;
 	}
-	la32PairImpl->generateNextSample(LA32PartialPair::MASTER, getAmpValue(), tvp->nextPitch(), getCutoffValue());
+	Bit32u amp, cutoff;
+	Bit16u pitch;
+	generateNextControls(amp, pitch, cutoff);
+	la32PairImpl->generateNextSample(LA32PartialPair::MASTER, amp, pitch, cutoff);
 	if (hasRingModulatingSlave()) {
-		la32PairImpl->generateNextSample(LA32PartialPair::SLAVE, pair->getAmpValue(), pair->tvp->nextPitch(), pair->getCutoffValue());
+		pair->generateNextControls(amp, pitch, cutoff);
+		la32PairImpl->generateNextSample(LA32PartialPair::SLAVE, amp, pitch, cutoff);
 		if (!pair->tva->isPlaying() || !la32PairImpl->isActive(LA32PartialPair::SLAVE)) {
 			pair->deactivate();
 			if (mixType == 2) {
@@ -332,28 +386,102 @@ bool Partial::generateNextSample(LA32PairImpl *la32PairImpl) {
 	return true;
 }
 
-void Partial::produceAndMixSample(IntSample *&leftBuf, IntSample *&rightBuf, LA32IntPartialPair *la32IntPair) {
-	IntSampleEx sample = la32IntPair->nextOutSample();
-
-	// FIXME: LA32 may produce distorted sound in case if the absolute value of maximal amplitude of the input exceeds 8191
-	// when the panning value is non-zero. Most probably the distortion occurs in the same way it does with ring modulation,
-	// and it seems to be caused by limited precision of the common multiplication circuit.
-	// From analysis of this overflow, it is obvious that the right channel output is actually found
-	// by subtraction of the left channel output from the input.
-	// Though, it is unknown whether this overflow is exploited somewhere.
+// Returns true when neither WG of the pair may deactivate itself in the middle of a run. This allows to compute
+// the values of amp, pitch and cutoff for the entire run in advance, so that the WGs are only deactivated by TVA.
+template <class LA32PairImpl>
+bool Partial::canGenerateBlock(const LA32PairImpl *la32PairImpl) const {
+	if (!la32PairImpl->isActive(LA32PartialPair::MASTER) || (isPCM() && !pcmWave->loop)) {
+		return false;
+	}
+	if (!hasRingModulatingSlave()) {
+		return true;
+	}
+	return la32PairImpl->isActive(LA32PartialPair::SLAVE) && (!pair->isPCM() || pair->pcmWave->loop);
+}
 
-	IntSampleEx leftOut = ((sample * leftPanValue) >> 13) + IntSampleEx(*leftBuf);
-	IntSampleEx rightOut = ((sample * rightPanValue) >> 13) + IntSampleEx(*rightBuf);
-	*(leftBuf++) = Synth::clipSampleEx(leftOut);
-	*(rightBuf++) = Synth::clipSampleEx(rightOut);
+// Generates up to length samples in blockBuf. Upon return, length contains the number of samples generated.
+// Returns false if the partial has been deactivated.
+// NOTE: The values of amp, pitch and cutoff are computed for both partials of the pair sample-by-sample first,
+// exactly in the same order as generateNextSample() does, since TVP involves a random number generator.
+template <class Sample, class LA32PairImpl>
+bool Partial::generateNextBlock(Sample *blockBuf, Bit32u &length, LA32PairImpl *la32PairImpl) {
+	if (!tva->isPlaying()) {
+		deactivate();
+		length = 0;
+		return false;
+	}
+	const bool ringModulating = hasRingModulatingSlave();
+	bool slaveStopped = false;
+	LA32WGControlBlock masterControls;
+	LA32WGControlBlock slaveControls;
+	Bit32u controlsLength = 0;
+	do {
+		generateNextControls(masterControls.amp[controlsLength], masterControls.pitch[controlsLength], masterControls.cutoff[controlsLength]);
+		if (ringModulating) {
+			pair->generateNextControls(slaveControls.amp[controlsLength], slaveControls.pitch[controlsLength], slaveControls.cutoff[controlsLength]);
+			slaveStopped = !pair->tva->isPlaying();
+		}
+		sampleNum++;
+	} while (++controlsLength < length && !slaveStopped && tva->isPlaying());
+
+	if (!slaveStopped) {
+		la32PairImpl->generateNextSamples(blockBuf, masterControls, ringModulating ? &slaveControls : NULL, controlsLength);
+		if (controlsLength < length) {
+			// TVA has finished playing the master
+			length = controlsLength;
+			deactivate();
+			return false;
+		}
+		return true;
+	}
+	const Bit32u lastSampleIx = controlsLength - 1;
+	la32PairImpl->generateNextSamples(blockBuf, masterControls, &slaveControls, lastSampleIx);
+	if (mixType == 2) {
+		// Without mixing, the master stops along with the slave, and the last sample is dropped
+		pair->deactivate();
+		deactivate();
+		length = lastSampleIx;
+		return false;
+	}
+	// The slave is deactivated before the last sample is mixed
+	la32PairImpl->generateNextSample(LA32PartialPair::MASTER, masterControls.amp[lastSampleIx], masterControls.pitch[lastSampleIx], masterControls.cutoff[lastSampleIx]);
+	la32PairImpl->generateNextSample(LA32PartialPair::SLAVE, slaveControls.amp[lastSampleIx], slaveControls.pitch[lastSampleIx], slaveControls.cutoff[lastSampleIx]);
+	pair->deactivate();
+	blockBuf[lastSampleIx] = la32PairImpl->nextOutSample();
+	length = controlsLength;
+	return true;
 }
 
-void Partial::produceAndMixSample(FloatSample *&leftBuf, FloatSample *&rightBuf, LA32FloatPartialPair *la32FloatPair) {
-	FloatSample sample = la32FloatPair->nextOutSample();
-	FloatSample leftOut = (sample * leftPanValue) / 14.0f;
-	FloatSample rightOut = (sample * rightPanValue) / 14.0f;
-	*(leftBuf++) += leftOut;
-	*(rightBuf++) += rightOut;
+// Renders up to length samples in the buffer and returns the number of samples rendered.
+// The partial may only be deactivated if less than length samples are rendered.
+// When partial culling is enabled, the inaudible stretches are merely skipped and rendered as silence.
+template <class Sample, class LA32PairImpl>
+Bit32u Partial::generateSamples(Sample *buffer, Bit32u length, LA32PairImpl *la32PairImpl) {
+	const Bit8u cullingLevel = synth->getPartialCullingLevel();
+	Bit32u generatedLength = 0;
+	while (generatedLength < length) {
+		if (isInaudible(cullingLevel)) {
+			for (; generatedLength < length && isInaudible(cullingLevel); generatedLength++, sampleNum++) {
+				if (!skipNextSample(la32PairImpl)) return generatedLength;
+				buffer[generatedLength] = Sample(0);
+			}
+			continue;
+		}
+		if (!canGenerateBlock(la32PairImpl)) {
+			// Fall back to sample-by-sample rendering as a PCM wave may end at any moment
+			for (; generatedLength < length && !isInaudible(cullingLevel); generatedLength++, sampleNum++) {
+				if (!generateNextSample(la32PairImpl)) return generatedLength;
+				buffer[generatedLength] = la32PairImpl->nextOutSample();
+			}
+			continue;
+		}
+		Bit32u blockLength = length - generatedLength;
+		if (blockLength > LA32_MAX_BLOCK_LENGTH) blockLength = LA32_MAX_BLOCK_LENGTH;
+		bool stillActive = generateNextBlock(buffer + generatedLength, blockLength, la32PairImpl);
+		generatedLength += blockLength;
+		if (!stillActive) break;
+	}
+	return generatedLength;
 }
 
 template <class Sample, class LA32PairImpl>
@@ -361,14 +489,76 @@ bool Partial::doProduceOutput(Sample *leftBuf, Sample *rightBuf, Bit32u length,
 	if (!canProduceOutput()) return false;
 	alreadyOutputed = true;
 
-	for (sampleNum = 0; sampleNum < length; sampleNum++) {
-		if (!generateNextSample(la32PairImpl)) break;
-		produceAndMixSample(leftBuf, rightBuf, la32PairImpl);
+	sampleNum = 0;
+	for (Bit32u blockStart = 0; blockStart < length; blockStart += LA32_MAX_BLOCK_LENGTH) {
+		Sample blockBuf[LA32_MAX_BLOCK_LENGTH];
+		Bit32u blockLength = length - blockStart;
+		if (blockLength > LA32_MAX_BLOCK_LENGTH) blockLength = LA32_MAX_BLOCK_LENGTH;
+		Bit32u generatedLength = generateSamples(blockBuf, blockLength, la32PairImpl);
+		mixOutput(leftBuf + blockStart, rightBuf + blockStart, blockBuf, generatedLength);
+		if (generatedLength < blockLength) break;
 	}
 	sampleNum = 0;
 	return true;
 }
 
+template <class Sample, class LA32PairImpl>
+Bit32u Partial::doGenerateOutput(Sample *buffer, Bit32u length, LA32PairImpl *la32PairImpl) {
+	if (!canProduceOutput()) return 0;
+	alreadyOutputed = true;
+
+	deactivationDeferred = true;
+	sampleNum = 0;
+	Bit32u generatedLength = generateSamples(buffer, length, la32PairImpl);
+	sampleNum = 0;
+	deactivationDeferred = false;
+	return generatedLength;
+}
+
+// Same as generateNextSample() but the WGs merely advance the PCM wave positions.
+template <class LA32PairImpl>
+bool Partial::skipNextSample(LA32PairImpl *la32PairImpl) {
+	if (!tva->isPlaying() || !la32PairImpl->isActive(LA32PartialPair::MASTER)) {
+		deactivate();
+		return false;
+	}
+	Bit32u amp, cutoff;
+	Bit16u pitch;
+	generateNextControls(amp, pitch, cutoff);
+	la32PairImpl->skipNextSample(LA32PartialPair::MASTER, pitch);
+	if (hasRingModulatingSlave()) {
+		pair->generateNextControls(amp, pitch, cutoff);
+		la32PairImpl->skipNextSample(LA32PartialPair::SLAVE, pitch);
+		if (!pair->tva->isPlaying() || !la32PairImpl->isActive(LA32PartialPair::SLAVE)) {
+			pair->deactivate();
+			if (mixType == 2) {
+				deactivate();
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+template <class LA32PairImpl>
+void Partial::doFastForward(Bit32u length, LA32PairImpl *la32PairImpl) {
+	if (!canProduceOutput()) return;
+	alreadyOutputed = true;
+
+	for (sampleNum = 0; sampleNum < length; sampleNum++) {
+		if (!skipNextSample(la32PairImpl)) break;
+	}
+	sampleNum = 0;
+}
+
+void Partial::fastForward(Bit32u length) {
+	if (floatMode) {
+		doFastForward(length, static_cast<LA32FloatPartialPair *>(la32Pair));
+	} else {
+		doFastForward(length, static_cast<LA32IntPartialPair *>(la32Pair));
+	}
+}
+
 bool Partial::produceOutput(IntSample *leftBuf, IntSample *rightBuf, Bit32u length) {
 	if (floatMode) {
 		synth->printDebug("Partial: Invalid call to produceOutput()! Renderer = %d\n", synth->getSelectedRendererType());
@@ -385,6 +575,36 @@ bool Partial::produceOutput(FloatSample *leftBuf, FloatSample *rightBuf, Bit32u
 	return doProduceOutput(leftBuf, rightBuf, length, static_cast<LA32FloatPartialPair *>(la32Pair));
 }
 
+Bit32u Partial::generateOutput(IntSample *buffer, Bit32u length) {
+	if (floatMode) {
+		synth->printDebug("Partial: Invalid call to generateOutput()! Renderer = %d\n", synth->getSelectedRendererType());
+		return 0;
+	}
+	return doGenerateOutput(buffer, length, static_cast<LA32IntPartialPair *>(la32Pair));
+}
+
+Bit32u Partial::generateOutput(FloatSample *buffer, Bit32u length) {
+	if (!floatMode) {
+		synth->printDebug("Partial: Invalid call to generateOutput()! Renderer = %d\n", synth->getSelectedRendererType());
+		return 0;
+	}
+	return doGenerateOutput(buffer, length, static_cast<LA32FloatPartialPair *>(la32Pair));
+}
+
+void Partial::mixOutput(IntSample *leftBuf, IntSample *rightBuf, const IntSample *buffer, Bit32u length) const {
+	// FIXME: LA32 may produce distorted sound in case if the absolute value of maximal amplitude of the input exceeds 8191
+	// when the panning value is non-zero. Most probably the distortion occurs in the same way it does with ring modulation,
+	// and it seems to be caused by limited precision of the common multiplication circuit.
+	// From analysis of this overflow, it is obvious that the right channel output is actually found
+	// by subtraction of the left channel output from the input.
+	// Though, it is unknown whether this overflow is exploited somewhere.
+	MixKernels::mixPanned(leftBuf, rightBuf, buffer, length, leftPanValue, rightPanValue);
+}
+
+void Partial::mixOutput(FloatSample *leftBuf, FloatSample *rightBuf, const FloatSample *buffer, Bit32u length) const {
+	MixKernels::mixPanned(leftBuf, rightBuf, buffer, length, leftPanValue, rightPanValue);
+}
+
 bool Partial::shouldReverb() {
 	if (!isActive()) {
 		return false;
@@ -397,10 +617,76 @@ void Partial::startAbort() {
 	tva->startAbort();
 }
 
+Bit32u Partial::getSamplesUntilTVAInterrupt() const {
+	if (!tva->isPlaying() || (isPCM() && !pcmWave->loop)) return 0;
+	return ampRamp.getSamplesUntilInterrupt();
+}
+
+Bit32u Partial::startTimerJitter(Bit32u seed, Bit32u length) {
+	return tvp->startTimerJitter(seed, length);
+}
+
 void Partial::startDecayAll() {
 	tva->startDecay();
 	tvp->startDecay();
 	tvf->startDecay();
 }
 
+void Partial::saveState(StateWriter &writer) const {
+	writer.writeInt32(ownerPart);
+	tvp->saveState(writer);
+	if (!isActive()) return;
+	writer.writeUInt32(sampleNum);
+	writer.writeInt32(leftPanValue);
+	writer.writeInt32(rightPanValue);
+	writer.writeInt32(mixType);
+	writer.writeInt32(structurePosition);
+	writer.writeInt32(pcmNum);
+	writer.writePCMWaveRef(pcmWave);
+	writer.writeInt32(pulseWidthVal);
+	writer.writePolyRef(poly);
+	writer.writePartialRef(pair);
+	bool cacheBackedUp = patchCache == &cachebackup;
+	writer.writeBool(cacheBackedUp);
+	if (cacheBackedUp) {
+		writer.writePatchCache(cachebackup);
+	} else {
+		writer.writePatchCacheRef(patchCache);
+	}
+	tva->saveState(writer);
+	tvf->saveState(writer);
+	ampRamp.saveState(writer);
+	cutoffModifierRamp.saveState(writer);
+	la32Pair->saveState(writer);
+}
+
+void Partial::restoreState(StateReader &reader) {
+	ownerPart = reader.readInt32();
+	if (ownerPart < -1 || ownerPart > 8) reader.fail();
+	tvp->restoreState(reader);
+	if (!isActive()) return;
+	sampleNum = reader.readUInt32();
+	leftPanValue = reader.readInt32();
+	rightPanValue = reader.readInt32();
+	mixType = reader.readInt32();
+	structurePosition = reader.readInt32();
+	pcmNum = reader.readInt32();
+	pcmWave = reader.readPCMWaveRef();
+	pulseWidthVal = reader.readInt32();
+	poly = reader.readPolyRef();
+	pair = reader.readPartialRef();
+	if (reader.readBool()) {
+		reader.readPatchCache(cachebackup);
+		patchCache = &cachebackup;
+	} else {
+		patchCache = reader.readPatchCacheRef();
+	}
+	tva->restoreState(reader);
+	tvf->restoreState(reader);
+	ampRamp.restoreState(reader);
+	cutoffModifierRamp.restoreState(reader);
+	la32Pair->restoreState(reader);
+	if (poly == NULL || pair == this) reader.fail();
+}
+
 } // namespace MT32Emu
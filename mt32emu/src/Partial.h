@@ -30,12 +30,23 @@ namespace MT32Emu {
 
 class Part;
 class Poly;
+class StateReader;
+class StateWriter;
 class Synth;
 class TVA;
 class TVF;
 class TVP;
 struct ControlROMPCMStruct;
 
+// Locations where a Partial constructs its components. PartialManager hands out slots of arrays indexed by the partial index,
+// so that the state touched by the rendering loops is kept together in memory rather than scattered across the heap.
+struct PartialComponentPlacement {
+	void *tva;
+	void *tvp;
+	void *tvf;
+	void *la32Pair;
+};
+
 // A partial represents one of up to four waveform generators currently playing within a poly.
 class Partial {
 private:
@@ -57,7 +68,7 @@ private:
 	// Only used for PCM partials
 	int pcmNum;
 	// FIXME: Give this a better name (e.g. pcmWaveInfo)
-	PCMWaveEntry *pcmWave;
+	const PCMWaveEntry *pcmWave;
 
 	// Final pulse width value, with velfollow applied, matching what is sent to the LA32.
 	// Range: 0-255
@@ -82,19 +93,40 @@ private:
 
 	Bit32u getAmpValue();
 	Bit32u getCutoffValue();
+	void generateNextControls(Bit32u &amp, Bit16u &pitch, Bit32u &cutoff);
+
+	// While the partial is rendered by generateOutput(), the poly and the partial manager are not notified
+	// about deactivation of this partial and its ring modulating slave immediately. Instead, the deactivated partials
+	// are recorded here until completeDeactivation() is invoked.
+	bool deactivationDeferred;
+	Bit32u deferredDeactivationCount;
+	Partial *deferredDeactivations[2];
+
+	void notifyDeactivated();
 
-	template <class Sample, class LA32PairImpl>
-	bool doProduceOutput(Sample *leftBuf, Sample *rightBuf, Bit32u length, LA32PairImpl *la32PairImpl);
 	bool canProduceOutput();
+	bool isInaudible(Bit8u cullingLevel) const;
 	template <class LA32PairImpl>
 	bool generateNextSample(LA32PairImpl *la32PairImpl);
-	void produceAndMixSample(IntSample *&leftBuf, IntSample *&rightBuf, LA32IntPartialPair *la32IntPair);
-	void produceAndMixSample(FloatSample *&leftBuf, FloatSample *&rightBuf, LA32FloatPartialPair *la32FloatPair);
+	template <class LA32PairImpl>
+	bool canGenerateBlock(const LA32PairImpl *la32PairImpl) const;
+	template <class Sample, class LA32PairImpl>
+	bool generateNextBlock(Sample *blockBuf, Bit32u &length, LA32PairImpl *la32PairImpl);
+	template <class Sample, class LA32PairImpl>
+	Bit32u generateSamples(Sample *buffer, Bit32u length, LA32PairImpl *la32PairImpl);
+	template <class Sample, class LA32PairImpl>
+	bool doProduceOutput(Sample *leftBuf, Sample *rightBuf, Bit32u length, LA32PairImpl *la32PairImpl);
+	template <class Sample, class LA32PairImpl>
+	Bit32u doGenerateOutput(Sample *buffer, Bit32u length, LA32PairImpl *la32PairImpl);
+	template <class LA32PairImpl>
+	bool skipNextSample(LA32PairImpl *la32PairImpl);
+	template <class LA32PairImpl>
+	void doFastForward(Bit32u length, LA32PairImpl *la32PairImpl);
 
 public:
 	bool alreadyOutputed;
 
-	Partial(Synth *synth, int debugPartialNum);
+	Partial(Synth *synth, int debugPartialNum, const PartialComponentPlacement &placement);
 	~Partial();
 
 	int debugGetPartialNum() const;
@@ -107,6 +139,11 @@ public:
 	void deactivate(void);
 	void startPartial(const Part *part, Poly *usePoly, const PatchCache *useCache, const MemParams::RhythmTemp *rhythmTemp, Partial *pairPartial);
 	void startAbort();
+	// Returns the number of samples the partial is certain to keep playing for, with no TVA phase change.
+	// Returns 0 when that can't be known in advance, e.g. a non-looped PCM wave may end at any moment.
+	Bit32u getSamplesUntilTVAInterrupt() const;
+	// See TVP::startTimerJitter().
+	Bit32u startTimerJitter(Bit32u seed, Bit32u length);
 	void startDecayAll();
 	bool shouldReverb();
 	bool isRingModulatingNoMix() const;
@@ -119,11 +156,34 @@ public:
 
 	void backupCache(const PatchCache &cache);
 
+	// Applies the float wave accuracy set in the synth to the wave generators, does nothing for the integer renderer
+	void updateFloatWaveAccuracy();
+
 	// Returns true only if data written to buffer
 	// These functions produce processed stereo samples
 	// made from combining this single partial with its pair, if it has one.
 	bool produceOutput(IntSample *leftBuf, IntSample *rightBuf, Bit32u length);
 	bool produceOutput(FloatSample *leftBuf, FloatSample *rightBuf, Bit32u length);
+
+	// These functions render mono samples of this partial combined with its pair, if it has one,
+	// to be mixed in the stereo output buffers later using mixOutput(). Returns the number of samples rendered.
+	// Partials may be rendered this way concurrently, since the poly and the partial manager are not touched.
+	// Instead, completeDeactivation() must be invoked afterwards (in the same order as partials are rendered
+	// with produceOutput()), so that they get notified about partials deactivated in the meantime.
+	Bit32u generateOutput(IntSample *buffer, Bit32u length);
+	Bit32u generateOutput(FloatSample *buffer, Bit32u length);
+	void mixOutput(IntSample *leftBuf, IntSample *rightBuf, const IntSample *buffer, Bit32u length) const;
+	void mixOutput(FloatSample *leftBuf, FloatSample *rightBuf, const FloatSample *buffer, Bit32u length) const;
+	void completeDeactivation();
+
+	// Advances this partial and its pair, if it has one, by the specified number of samples without producing any output.
+	// TVA, TVP and TVF as well as the PCM wave positions are advanced exactly as in produceOutput(), so the partial
+	// deactivates at the same sample. Synth waves are not generated though, so their phase is left behind.
+	void fastForward(Bit32u length);
+
+	// The state can only be saved between rendering runs, when no deactivation is deferred.
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 }; // class Partial
 
 } // namespace MT32Emu
@@ -17,6 +17,7 @@
 
 #include <cstddef>
 #include <cstring>
+#include <new>
 
 #include "internals.h"
 
@@ -24,38 +25,111 @@
 #include "Part.h"
 #include "Partial.h"
 #include "Poly.h"
+#include "StageTimer.h"
 #include "Synth.h"
+#include "SynthState.h"
+#include "TVA.h"
+#include "TVF.h"
+#include "TVP.h"
 
 namespace MT32Emu {
 
-PartialManager::PartialManager(Synth *useSynth, Part **useParts) {
+// Each array placed in the storage starts at a multiple of this, which suffices for any fundamental type.
+static const size_t STORAGE_ALIGNMENT = 16;
+
+static size_t alignStorageSize(const size_t size) {
+	return (size + STORAGE_ALIGNMENT - 1) & ~(STORAGE_ALIGNMENT - 1);
+}
+
+static size_t getLA32PairSize(const RendererType rendererType) {
+	switch (rendererType) {
+	case RendererType_FLOAT:
+		return sizeof(LA32FloatPartialPair);
+	default:
+		return sizeof(LA32IntPartialPair);
+	}
+}
+
+// Offsets of the arrays placed in the storage, in the order of placement.
+struct PartialManagerStorageLayout {
+	size_t tva;
+	size_t tvp;
+	size_t tvf;
+	size_t la32Pair;
+	size_t polys;
+	size_t partialTable;
+	size_t freePolys;
+	size_t inactivePartials;
+	size_t activePartials;
+	size_t renderCosts;
+	size_t size;
+
+	PartialManagerStorageLayout(const Bit32u partialCount, const size_t la32PairSize) {
+		tva = alignStorageSize(partialCount * sizeof(Partial));
+		tvp = tva + alignStorageSize(partialCount * sizeof(TVA));
+		tvf = tvp + alignStorageSize(partialCount * sizeof(TVP));
+		la32Pair = tvf + alignStorageSize(partialCount * sizeof(TVF));
+		polys = la32Pair + alignStorageSize(partialCount * la32PairSize);
+		partialTable = polys + alignStorageSize(partialCount * sizeof(Poly));
+		freePolys = partialTable + alignStorageSize(partialCount * sizeof(Partial *));
+		inactivePartials = freePolys + alignStorageSize(partialCount * sizeof(Poly *));
+		activePartials = inactivePartials + alignStorageSize(partialCount * sizeof(int));
+		renderCosts = activePartials + alignStorageSize(partialCount * sizeof(Bit32u));
+		size = renderCosts + alignStorageSize(partialCount * sizeof(PartialManager::RenderCost));
+	}
+};
+
+size_t PartialManager::getStorageSize(const Bit32u partialCount, const RendererType rendererType) {
+	return PartialManagerStorageLayout(partialCount, getLA32PairSize(rendererType)).size;
+}
+
+PartialManager::PartialManager(Synth *useSynth, Part **useParts, Bit8u *storage) {
 	synth = useSynth;
 	parts = useParts;
 	inactivePartialCount = synth->getPartialCount();
-	partialTable = new Partial *[inactivePartialCount];
-	inactivePartials = new int[inactivePartialCount];
-	freePolys = new Poly *[synth->getPartialCount()];
+	const size_t la32PairSize = getLA32PairSize(synth->getSelectedRendererType());
+	const PartialManagerStorageLayout layout(synth->getMaxPartialCount(), la32PairSize);
+
+	Bit8u *partialStorage = storage;
+	Bit8u *tvaStorage = storage + layout.tva;
+	Bit8u *tvpStorage = storage + layout.tvp;
+	Bit8u *tvfStorage = storage + layout.tvf;
+	Bit8u *la32PairStorage = storage + layout.la32Pair;
+	polys = reinterpret_cast<Poly *>(storage + layout.polys);
+	partialTable = reinterpret_cast<Partial **>(storage + layout.partialTable);
+	freePolys = reinterpret_cast<Poly **>(storage + layout.freePolys);
+	inactivePartials = reinterpret_cast<int *>(storage + layout.inactivePartials);
+	activePartials = reinterpret_cast<Bit32u *>(storage + layout.activePartials);
+	renderCosts = reinterpret_cast<RenderCost *>(storage + layout.renderCosts);
+	activePartialCount = 0;
 	firstFreePolyIndex = 0;
-	for (unsigned int i = 0; i < synth->getPartialCount(); i++) {
-		partialTable[i] = new Partial(synth, i);
-		inactivePartials[i] = inactivePartialCount - i - 1;
-		freePolys[i] = new Poly();
+	timerJitterSeed = 0;
+	// The Partials beyond the partial count are spare, they only join the pool when it is resized.
+	for (unsigned int i = 0; i < synth->getMaxPartialCount(); i++) {
+		PartialComponentPlacement placement;
+		placement.tva = tvaStorage + i * sizeof(TVA);
+		placement.tvp = tvpStorage + i * sizeof(TVP);
+		placement.tvf = tvfStorage + i * sizeof(TVF);
+		placement.la32Pair = la32PairStorage + i * la32PairSize;
+		partialTable[i] = new(partialStorage + i * sizeof(Partial)) Partial(synth, i, placement);
+		if (i < inactivePartialCount) inactivePartials[i] = inactivePartialCount - i - 1;
+		freePolys[i] = new(&polys[i]) Poly();
 	}
 }
 
+// The polys remain owned by the partial manager while assigned to the parts.
 PartialManager::~PartialManager(void) {
-	for (unsigned int i = 0; i < synth->getPartialCount(); i++) {
-		delete partialTable[i];
-		if (freePolys[i] != NULL) delete freePolys[i];
+	for (unsigned int i = 0; i < synth->getMaxPartialCount(); i++) {
+		partialTable[i]->~Partial();
+		polys[i].~Poly();
 	}
-	delete[] partialTable;
-	delete[] inactivePartials;
-	delete[] freePolys;
 }
 
+// Inactive partials may be left marked, yet this doesn't matter, since the mark is only checked for active ones
+// and is reset when a partial starts.
 void PartialManager::clearAlreadyOutputed() {
-	for (unsigned int i = 0; i < synth->getPartialCount(); i++) {
-		partialTable[i]->alreadyOutputed = false;
+	for (Bit32u i = 0; i < activePartialCount; i++) {
+		partialTable[activePartials[i]]->alreadyOutputed = false;
 	}
 }
 
@@ -63,16 +137,88 @@ bool PartialManager::shouldReverb(int i) {
 	return partialTable[i]->shouldReverb();
 }
 
+// Classifies the partial before rendering, as it may get deactivated and lose the owner part and the slave meanwhile.
+// Only touches the partial being rendered, so that the partials may be rendered concurrently.
+void PartialManager::startRenderCost(int i, Bit32u bufferLength) {
+	const Partial *partial = partialTable[i];
+	RenderCost &renderCost = renderCosts[i];
+	renderCost.time = 0.0;
+	if (!partial->isActive() || partial->alreadyOutputed || partial->isRingModulatingSlave()) {
+		renderCost.sampleCount = 0;
+		return;
+	}
+	renderCost.sampleCount = bufferLength;
+	renderCost.partNum = partial->getOwnerPart();
+	if (partial->hasRingModulatingSlave()) {
+		renderCost.kind = RenderCost::Kind_RING_MODULATED;
+	} else {
+		renderCost.kind = partial->isPCM() ? RenderCost::Kind_PCM : RenderCost::Kind_SYNTH;
+	}
+}
+
+void PartialManager::accountRenderCost(int i, PartialRenderStatistics &statistics) const {
+	const RenderCost &renderCost = renderCosts[i];
+	if (renderCost.sampleCount == 0 || renderCost.partNum < 0 || 8 < renderCost.partNum) return;
+	statistics.partSampleCount[renderCost.partNum] += renderCost.sampleCount;
+	statistics.partTime[renderCost.partNum] += renderCost.time;
+	switch (renderCost.kind) {
+	case RenderCost::Kind_SYNTH:
+		statistics.synthSampleCount += renderCost.sampleCount;
+		statistics.synthTime += renderCost.time;
+		break;
+	case RenderCost::Kind_PCM:
+		statistics.pcmSampleCount += renderCost.sampleCount;
+		statistics.pcmTime += renderCost.time;
+		break;
+	case RenderCost::Kind_RING_MODULATED:
+		statistics.ringModulatedSampleCount += renderCost.sampleCount;
+		statistics.ringModulatedTime += renderCost.time;
+		break;
+	}
+}
+
 bool PartialManager::produceOutput(int i, IntSample *leftBuf, IntSample *rightBuf, Bit32u bufferLength) {
+	startRenderCost(i, bufferLength);
+	StageTimer renderTimer(renderCosts[i].time);
 	return partialTable[i]->produceOutput(leftBuf, rightBuf, bufferLength);
 }
 
 bool PartialManager::produceOutput(int i, FloatSample *leftBuf, FloatSample *rightBuf, Bit32u bufferLength) {
+	startRenderCost(i, bufferLength);
+	StageTimer renderTimer(renderCosts[i].time);
 	return partialTable[i]->produceOutput(leftBuf, rightBuf, bufferLength);
 }
 
+Bit32u PartialManager::generateOutput(int i, IntSample *buffer, Bit32u bufferLength) {
+	startRenderCost(i, bufferLength);
+	StageTimer renderTimer(renderCosts[i].time);
+	return partialTable[i]->generateOutput(buffer, bufferLength);
+}
+
+Bit32u PartialManager::generateOutput(int i, FloatSample *buffer, Bit32u bufferLength) {
+	startRenderCost(i, bufferLength);
+	StageTimer renderTimer(renderCosts[i].time);
+	return partialTable[i]->generateOutput(buffer, bufferLength);
+}
+
+void PartialManager::mixOutput(int i, IntSample *leftBuf, IntSample *rightBuf, const IntSample *buffer, Bit32u bufferLength) {
+	partialTable[i]->mixOutput(leftBuf, rightBuf, buffer, bufferLength);
+}
+
+void PartialManager::mixOutput(int i, FloatSample *leftBuf, FloatSample *rightBuf, const FloatSample *buffer, Bit32u bufferLength) {
+	partialTable[i]->mixOutput(leftBuf, rightBuf, buffer, bufferLength);
+}
+
+void PartialManager::completeDeactivation(int i) {
+	partialTable[i]->completeDeactivation();
+}
+
+void PartialManager::fastForward(int i, Bit32u length) {
+	partialTable[i]->fastForward(length);
+}
+
 void PartialManager::deactivateAll() {
-	for (unsigned int i = 0; i < synth->getPartialCount(); i++) {
+	for (unsigned int i = 0; i < synth->getMaxPartialCount(); i++) {
 		partialTable[i]->deactivate();
 	}
 }
@@ -88,12 +234,19 @@ unsigned int PartialManager::setReserve(Bit8u *rset) {
 
 Partial *PartialManager::allocPartial(int partNum) {
 	if (inactivePartialCount > 0) {
-		Partial *partial = partialTable[inactivePartials[--inactivePartialCount]];
+		const Bit32u partialIndex = Bit32u(inactivePartials[--inactivePartialCount]);
+		Partial *partial = partialTable[partialIndex];
 		partial->activate(partNum);
+		Bit32u insertPos = activePartialCount++;
+		while (insertPos > 0 && activePartials[insertPos - 1] > partialIndex) {
+			activePartials[insertPos] = activePartials[insertPos - 1];
+			insertPos--;
+		}
+		activePartials[insertPos] = partialIndex;
 		return partial;
 	}
 	synth->printDebug("PartialManager Error: No inactive partials to allocate for part %d, current partial state:\n", partNum);
-	for (Bit32u i = 0; i < synth->getPartialCount(); i++) {
+	for (Bit32u i = 0; i < synth->getMaxPartialCount(); i++) {
 		const Partial *partial = partialTable[i];
 		synth->printDebug("[Partial %d]: activation=%d, owner part=%d\n", i, partial->isActive(), partial->getOwnerPart());
 	}
@@ -101,15 +254,43 @@ Partial *PartialManager::allocPartial(int partNum) {
 }
 
 unsigned int PartialManager::getFreePartialCount() {
-	return inactivePartialCount;
+	// The Partials above the limit are kept out of reach of new notes
+	const Bit32u unavailablePartialCount = synth->getPartialCount() - synth->getPartialLimit();
+	return inactivePartialCount > unavailablePartialCount ? inactivePartialCount - unavailablePartialCount : 0;
+}
+
+Bit32u PartialManager::getActivePartialCount() const {
+	return activePartialCount;
+}
+
+Bit32u PartialManager::getActivePartials(Bit32u *partialIndices) const {
+	memcpy(partialIndices, activePartials, activePartialCount * sizeof(Bit32u));
+	return activePartialCount;
+}
+
+Bit32u PartialManager::getMinRemainingSampleCount() const {
+	Bit32u sampleCount = LA32Ramp::INFINITE_SAMPLE_COUNT;
+	for (Bit32u i = 0; i < activePartialCount && sampleCount > 0; i++) {
+		Bit32u partialSampleCount = partialTable[activePartials[i]]->getSamplesUntilTVAInterrupt();
+		if (partialSampleCount < sampleCount) sampleCount = partialSampleCount;
+	}
+	return sampleCount;
+}
+
+// Advances the shared jitter seed through the timer jitter of every active Partial in allocation order.
+void PartialManager::startTimerJitter(Bit32u length) {
+	for (Bit32u i = 0; i < activePartialCount; i++) {
+		timerJitterSeed = partialTable[activePartials[i]]->startTimerJitter(timerJitterSeed, length);
+	}
 }
 
 // This function is solely used to gather data for debug output at the moment.
 void PartialManager::getPerPartPartialUsage(unsigned int perPartPartialUsage[9]) {
 	memset(perPartPartialUsage, 0, 9 * sizeof(unsigned int));
-	for (unsigned int i = 0; i < synth->getPartialCount(); i++) {
-		if (partialTable[i]->isActive()) {
-			perPartPartialUsage[partialTable[i]->getOwnerPart()]++;
+	for (Bit32u i = 0; i < activePartialCount; i++) {
+		const Partial *partial = partialTable[activePartials[i]];
+		if (partial->isActive()) {
+			perPartPartialUsage[partial->getOwnerPart()]++;
 		}
 	}
 }
@@ -256,14 +437,21 @@ bool PartialManager::freePartials(unsigned int needed, int partNum) {
 }
 
 const Partial *PartialManager::getPartial(unsigned int partialNum) const {
-	if (partialNum > synth->getPartialCount() - 1) {
+	if (partialNum > synth->getMaxPartialCount() - 1) {
+		return NULL;
+	}
+	return partialTable[partialNum];
+}
+
+Partial *PartialManager::getPartial(unsigned int partialNum) {
+	if (partialNum > synth->getMaxPartialCount() - 1) {
 		return NULL;
 	}
 	return partialTable[partialNum];
 }
 
 Poly *PartialManager::assignPolyToPart(Part *part) {
-	if (firstFreePolyIndex < synth->getPartialCount()) {
+	if (firstFreePolyIndex < synth->getMaxPartialCount()) {
 		Poly *poly = freePolys[firstFreePolyIndex];
 		freePolys[firstFreePolyIndex] = NULL;
 		firstFreePolyIndex++;
@@ -293,15 +481,101 @@ void PartialManager::polyFreed(Poly *poly) {
 }
 
 void PartialManager::partialDeactivated(int partialIndex) {
-	if (inactivePartialCount < synth->getPartialCount()) {
-		inactivePartials[inactivePartialCount++] = partialIndex;
+	// The Partials left beyond the pool after shrinking it are retired instead of being returned to the inactive ones
+	const bool retired = Bit32u(partialIndex) >= synth->getPartialCount();
+	if (retired || inactivePartialCount < synth->getPartialCount()) {
+		if (!retired) inactivePartials[inactivePartialCount++] = partialIndex;
+		for (Bit32u i = 0; i < activePartialCount; i++) {
+			if (activePartials[i] == Bit32u(partialIndex)) {
+				activePartialCount--;
+				memmove(activePartials + i, activePartials + i + 1, (activePartialCount - i) * sizeof(Bit32u));
+				break;
+			}
+		}
 		return;
 	}
 	synth->printDebug("PartialManager Error: Cannot return deactivated partial %d, current partial state:\n", partialIndex);
-	for (Bit32u i = 0; i < synth->getPartialCount(); i++) {
+	for (Bit32u i = 0; i < synth->getMaxPartialCount(); i++) {
 		const Partial *partial = partialTable[i];
 		synth->printDebug("[Partial %d]: activation=%d, owner part=%d\n", i, partial->isActive(), partial->getOwnerPart());
 	}
 }
 
+void PartialManager::resizePool(Bit32u oldPartialCount, Bit32u newPartialCount) {
+	if (newPartialCount < oldPartialCount) {
+		// Only the inactive Partials are dropped right away, the playing ones are retired once deactivated
+		Bit32u keptCount = 0;
+		for (Bit32u i = 0; i < inactivePartialCount; i++) {
+			if (Bit32u(inactivePartials[i]) < newPartialCount) inactivePartials[keptCount++] = inactivePartials[i];
+		}
+		inactivePartialCount = keptCount;
+		return;
+	}
+	// The added Partials are put at the bottom of the stack, so that the lower indices are still allocated first.
+	// Those left playing since the pool was shrunk are returned upon deactivation as usual.
+	Bit32u addedCount = 0;
+	for (Bit32u i = oldPartialCount; i < newPartialCount; i++) {
+		if (!partialTable[i]->isActive()) addedCount++;
+	}
+	memmove(inactivePartials + addedCount, inactivePartials, inactivePartialCount * sizeof(int));
+	Bit32u stackPos = 0;
+	for (Bit32u i = newPartialCount; i-- > oldPartialCount;) {
+		if (!partialTable[i]->isActive()) inactivePartials[stackPos++] = int(i);
+	}
+	inactivePartialCount += addedCount;
+}
+
+void PartialManager::saveState(StateWriter &writer) const {
+	writer.writeBytes(numReservedPartialsForPart, sizeof(numReservedPartialsForPart));
+	writer.writeUInt32(timerJitterSeed);
+	// The order of the inactive partials determines which ones are allocated next, so it is preserved.
+	writer.writeUInt32(inactivePartialCount);
+	for (Bit32u i = 0; i < inactivePartialCount; i++) {
+		writer.writeUInt32(Bit32u(inactivePartials[i]));
+	}
+	// The partials still playing beyond the pool after shrinking it are neither inactive nor within the pool, so they are listed as well.
+	const Bit32u partialCount = synth->getPartialCount();
+	Bit32u retiredPartialCount = 0;
+	for (Bit32u i = 0; i < activePartialCount; i++) {
+		if (activePartials[i] >= partialCount) retiredPartialCount++;
+	}
+	writer.writeUInt32(retiredPartialCount);
+	for (Bit32u i = 0; i < activePartialCount; i++) {
+		if (activePartials[i] >= partialCount) writer.writeUInt32(activePartials[i]);
+	}
+}
+
+void PartialManager::restoreState(StateReader &reader) {
+	reader.readBytes(numReservedPartialsForPart, sizeof(numReservedPartialsForPart));
+	timerJitterSeed = reader.readUInt32();
+	inactivePartialCount = reader.readIndex(synth->getPartialCount() + 1);
+	for (Bit32u i = 0; i < inactivePartialCount; i++) {
+		inactivePartials[i] = int(reader.readIndex(synth->getPartialCount()));
+	}
+	rebuildActivePartials(reader);
+}
+
+// Partials within the pool that are not listed as inactive are the allocated ones, as well as the listed retired ones.
+void PartialManager::rebuildActivePartials(StateReader &reader) {
+	const Bit32u partialCount = synth->getPartialCount();
+	const Bit32u maxPartialCount = synth->getMaxPartialCount();
+	bool *allocated = new bool[maxPartialCount];
+	memset(allocated, 0, maxPartialCount * sizeof(bool));
+	memset(allocated, 1, partialCount * sizeof(bool));
+	for (Bit32u i = 0; i < inactivePartialCount; i++) {
+		allocated[inactivePartials[i]] = false;
+	}
+	const Bit32u retiredPartialCount = reader.readIndex(maxPartialCount - partialCount + 1);
+	for (Bit32u i = 0; i < retiredPartialCount && !reader.isFailed(); i++) {
+		const Bit32u partialIndex = reader.readIndex(maxPartialCount);
+		if (partialIndex < partialCount) reader.fail();
+		allocated[partialIndex] = true;
+	}
+	activePartialCount = 0;
+	for (Bit32u i = 0; i < maxPartialCount; i++) {
+		if (allocated[i]) activePartials[activePartialCount++] = i;
+	}
+	delete[] allocated;
+}
+
 } // namespace MT32Emu
@@ -18,8 +18,11 @@
 #ifndef MT32EMU_PARTIALMANAGER_H
 #define MT32EMU_PARTIALMANAGER_H
 
+#include <cstddef>
+
 #include "globals.h"
 #include "internals.h"
+#include "Enumerations.h"
 #include "Types.h"
 
 namespace MT32Emu {
@@ -27,39 +30,101 @@ namespace MT32Emu {
 class Part;
 class Partial;
 class Poly;
+class StateReader;
+class StateWriter;
 class Synth;
+struct PartialRenderStatistics;
 
 class PartialManager {
+public:
+	// Cost of the last rendering pass of a partial. It is recorded while the partial is rendered, possibly in a worker thread,
+	// and accounted to the render statistics afterwards.
+	struct RenderCost {
+		enum Kind {
+			Kind_SYNTH,
+			Kind_PCM,
+			Kind_RING_MODULATED
+		};
+
+		double time;
+		// Zero unless the partial has been rendered.
+		Bit32u sampleCount;
+		int partNum;
+		Kind kind;
+	};
+
 private:
 	Synth *synth;
 	Part **parts;
 	Poly **freePolys;
 	Partial **partialTable;
+	// Partials and their components live in contiguous arrays indexed by the partial index. These arrays as well as
+	// the polys and the tables below are all placed in the storage provided by the synth.
+	Poly *polys;
 	Bit8u numReservedPartialsForPart[9];
 	Bit32u firstFreePolyIndex;
 	int *inactivePartials; // Holds indices of inactive Partials in the Partial table
 	Bit32u inactivePartialCount;
+	// Holds indices of allocated Partials in ascending order, so that traversing them visits the same Partials in the same order
+	// as scanning the whole Partial table would, yet the cost scales with the number of playing voices rather than the table size
+	Bit32u *activePartials;
+	Bit32u activePartialCount;
+	// Indexed by the partial index.
+	RenderCost *renderCosts;
+	// State of the pseudo-random number generator the TVPs emulate the timer jitter with. It is shared by all the partials,
+	// yet stepped for each in turn before rendering, so the output doesn't depend on the number of rendering threads.
+	Bit32u timerJitterSeed;
+
+	void rebuildActivePartials(StateReader &reader);
+	void startRenderCost(int i, Bit32u bufferLength);
 
 	bool abortFirstReleasingPolyWhereReserveExceeded(int minPart);
 	bool abortFirstPolyPreferHeldWhereReserveExceeded(int minPart);
 
 public:
-	PartialManager(Synth *synth, Part **parts);
+	// Returns the size of the storage to be provided to the constructor, which must be aligned for any fundamental type.
+	static size_t getStorageSize(Bit32u partialCount, RendererType rendererType);
+
+	PartialManager(Synth *synth, Part **parts, Bit8u *storage);
 	~PartialManager();
 	Partial *allocPartial(int partNum);
+	// Returns the number of inactive Partials that may be allocated with respect to the partial limit set in the synth
 	unsigned int getFreePartialCount();
+	Bit32u getActivePartialCount() const;
+	// Copies the indices of the currently allocated Partials to the provided buffer (that must have room for all the Partials)
+	// in ascending order and returns their number. A copy is used, since Partials may get deactivated during rendering.
+	Bit32u getActivePartials(Bit32u *partialIndices) const;
+	// Returns the number of samples all the currently allocated Partials are certain to keep playing for without
+	// any of them deactivating, so that the order in which they are deactivated cannot depend on the rendering pass length.
+	Bit32u getMinRemainingSampleCount() const;
+	// Must be called before each rendering pass of the currently allocated Partials, see TVP::startTimerJitter().
+	void startTimerJitter(Bit32u length);
 	void getPerPartPartialUsage(unsigned int perPartPartialUsage[9]);
 	bool freePartials(unsigned int needed, int partNum);
 	unsigned int setReserve(Bit8u *rset);
 	void deactivateAll();
 	bool produceOutput(int i, IntSample *leftBuf, IntSample *rightBuf, Bit32u bufferLength);
 	bool produceOutput(int i, FloatSample *leftBuf, FloatSample *rightBuf, Bit32u bufferLength);
+	Bit32u generateOutput(int i, IntSample *buffer, Bit32u bufferLength);
+	Bit32u generateOutput(int i, FloatSample *buffer, Bit32u bufferLength);
+	// Adds the cost of the last call to produceOutput() or generateOutput() for the partial to the statistics.
+	void accountRenderCost(int i, PartialRenderStatistics &statistics) const;
+	void mixOutput(int i, IntSample *leftBuf, IntSample *rightBuf, const IntSample *buffer, Bit32u bufferLength);
+	void mixOutput(int i, FloatSample *leftBuf, FloatSample *rightBuf, const FloatSample *buffer, Bit32u bufferLength);
+	void completeDeactivation(int i);
+	void fastForward(int i, Bit32u length);
 	bool shouldReverb(int i);
 	void clearAlreadyOutputed();
 	const Partial *getPartial(unsigned int partialNum) const;
+	Partial *getPartial(unsigned int partialNum);
 	Poly *assignPolyToPart(Part *part);
 	void polyFreed(Poly *poly);
 	void partialDeactivated(int partialIndex);
+	// Adjusts the inactive Partials to the new partial count set in the synth, which must be within the storage capacity
+	void resizePool(Bit32u oldPartialCount, Bit32u newPartialCount);
+	void saveState(StateWriter &writer) const;
+	// Expects that all the polys are free, as they are reassigned while the parts are restored.
+	void restoreState(StateReader &reader);
 }; // class PartialManager
 
 } // namespace MT32Emu
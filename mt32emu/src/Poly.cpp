@@ -23,6 +23,7 @@
 #include "Part.h"
 #include "Partial.h"
 #include "Synth.h"
+#include "SynthState.h"
 
 namespace MT32Emu {
 
@@ -37,6 +38,8 @@ Poly::Poly() {
 	}
 	state = POLY_Inactive;
 	next = NULL;
+	prevInState = NULL;
+	nextInState = NULL;
 }
 
 void Poly::setPart(Part *usePart) {
@@ -53,7 +56,7 @@ void Poly::reset(unsigned int newKey, unsigned int newVelocity, bool newSustain,
 				activePartialCount--;
 			}
 		}
-		state = POLY_Inactive;
+		setState(POLY_Inactive);
 	}
 
 	key = newKey;
@@ -65,9 +68,19 @@ void Poly::reset(unsigned int newKey, unsigned int newVelocity, bool newSustain,
 		partials[i] = newPartials[i];
 		if (newPartials[i] != NULL) {
 			activePartialCount++;
-			state = POLY_Playing;
 		}
 	}
+	if (activePartialCount > 0) {
+		setState(POLY_Playing);
+	}
+}
+
+// The part keeps track of its polys by state, so every change is reported
+void Poly::setState(PolyState newState) {
+	const PolyState oldState = state;
+	if (oldState == newState) return;
+	state = newState;
+	part->polyStateChanged(this, oldState);
 }
 
 bool Poly::noteOff(bool pedalHeld) {
@@ -80,7 +93,7 @@ bool Poly::noteOff(bool pedalHeld) {
 		if (state == POLY_Held) {
 			return false;
 		}
-		state = POLY_Held;
+		setState(POLY_Held);
 	} else {
 		startDecay();
 	}
@@ -98,7 +111,7 @@ bool Poly::startDecay() {
 	if (state == POLY_Inactive || state == POLY_Releasing) {
 		return false;
 	}
-	state = POLY_Releasing;
+	setState(POLY_Releasing);
 
 	for (int t = 0; t < 4; t++) {
 		Partial *partial = partials[t];
@@ -164,6 +177,7 @@ bool Poly::isActive() const {
 
 // This is called by Partial to inform the poly that the Partial has deactivated
 void Poly::partialDeactivated(Partial *partial) {
+	const PolyState oldState = state;
 	for (int i = 0; i < 4; i++) {
 		if (partials[i] == partial) {
 			partials[i] = NULL;
@@ -171,12 +185,12 @@ void Poly::partialDeactivated(Partial *partial) {
 		}
 	}
 	if (activePartialCount == 0) {
-		state = POLY_Inactive;
+		setState(POLY_Inactive);
 		if (part->getSynth()->abortingPoly == this) {
 			part->getSynth()->abortingPoly = NULL;
 		}
 	}
-	part->partialDeactivated(this);
+	part->partialDeactivated(this, oldState);
 }
 
 Poly *Poly::getNext() const {
@@ -187,4 +201,39 @@ void Poly::setNext(Poly *poly) {
 	next = poly;
 }
 
+Poly *Poly::getPrevInState() const {
+	return prevInState;
+}
+
+Poly *Poly::getNextInState() const {
+	return nextInState;
+}
+
+void Poly::setStateLinks(Poly *prevPoly, Poly *nextPoly) {
+	prevInState = prevPoly;
+	nextInState = nextPoly;
+}
+
+void Poly::saveState(StateWriter &writer) const {
+	writer.writeUInt32(key);
+	writer.writeUInt32(velocity);
+	writer.writeUInt32(activePartialCount);
+	writer.writeBool(sustain);
+	writer.writeUInt32(state);
+	for (int i = 0; i < 4; i++) {
+		writer.writePartialRef(partials[i]);
+	}
+}
+
+void Poly::restoreState(StateReader &reader) {
+	key = reader.readUInt32();
+	velocity = reader.readUInt32();
+	activePartialCount = reader.readIndex(5);
+	sustain = reader.readBool();
+	setState(PolyState(reader.readIndex(POLY_Inactive + 1)));
+	for (int i = 0; i < 4; i++) {
+		partials[i] = reader.readPartialRef();
+	}
+}
+
 } // namespace MT32Emu
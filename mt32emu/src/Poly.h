@@ -25,6 +25,8 @@ namespace MT32Emu {
 
 class Part;
 class Partial;
+class StateReader;
+class StateWriter;
 struct PatchCache;
 
 class Poly {
@@ -41,6 +43,12 @@ private:
 
 	Poly *next;
 
+	// Links in the list of the part's polys in the same state
+	Poly *prevInState;
+	Poly *nextInState;
+
+	void setState(PolyState newState);
+
 public:
 	Poly();
 	void setPart(Part *usePart);
@@ -63,6 +71,12 @@ public:
 
 	Poly *getNext() const;
 	void setNext(Poly *poly);
+	Poly *getPrevInState() const;
+	Poly *getNextInState() const;
+	void setStateLinks(Poly *prevPoly, Poly *nextPoly);
+
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 }; // class Poly
 
 } // namespace MT32Emu
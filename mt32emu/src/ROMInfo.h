@@ -37,7 +37,8 @@ public:
 	enum PairType {Full, FirstHalf, SecondHalf, Mux0, Mux1} pairType;
 	ROMInfo *pairROMInfo;
 
-	// Returns a ROMInfo struct by inspecting the size and the SHA1 hash
+	// Returns a ROMInfo struct by inspecting the size and the SHA1 hash. The file data is only read and hashed
+	// if the size matches a known ROM, so scanning a directory of unrelated files is cheap.
 	MT32EMU_EXPORT static const ROMInfo* getROMInfo(File *file);
 
 	// Currently no-op
@@ -0,0 +1,271 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "internals.h"
+
+#include "ROMSet.h"
+#include "Atomics.h"
+#include "HotMemory.h"
+#include "MappedFile.h"
+
+namespace MT32Emu {
+
+// Header of a PCM ROM cache file, followed by the decoded samples in the native byte order. The samples are only valid for
+// the same format version and byte order, and for the PCM ROM with the same SHA1 digest, the one which the file is named after.
+struct PCMROMCacheHeader {
+	char magic[8];
+	Bit32u formatVersion;
+	Bit32u byteOrderMark;
+	Bit32u sampleCount;
+	Bit32u reserved;
+	char pcmROMDigest[48];
+};
+
+static const char PCM_ROM_CACHE_MAGIC[8] = {'M', 'T', '3', '2', 'P', 'C', 'M', 'C'};
+// Must be incremented whenever either the header layout or the PCM ROM decoding algorithm changes.
+static const Bit32u PCM_ROM_CACHE_FORMAT_VERSION = 1;
+static const Bit32u PCM_ROM_CACHE_BYTE_ORDER_MARK = 0x01020304;
+static const char PCM_ROM_CACHE_FILENAME_PREFIX[] = "mt32emu-pcm-";
+static const char PCM_ROM_CACHE_FILENAME_SUFFIX[] = ".bin";
+
+// Published sets, guarded by the spin lock. The lock is only held for list manipulation, so contention is negligible.
+static ROMSet *publishedSets = NULL;
+static volatile Bit32u publishedSetsLock = 0;
+
+static void lockPublishedSets() {
+	while (!Atomics::compareAndSwap(publishedSetsLock, 0, 1)) {}
+}
+
+static void unlockPublishedSets() {
+	Atomics::storeRelease(publishedSetsLock, 0);
+}
+
+// Returns a newly allocated path of the cache file for the PCM ROM with the given digest, with the extra suffix appended.
+static char *makePCMROMCachePath(const char *cacheDirectory, const File::SHA1Digest &pcmROMDigest, const char *extraSuffix) {
+	size_t length = strlen(cacheDirectory) + sizeof(PCM_ROM_CACHE_FILENAME_PREFIX) + strlen(pcmROMDigest) + sizeof(PCM_ROM_CACHE_FILENAME_SUFFIX) + strlen(extraSuffix);
+	char *path = new char[length];
+	strcpy(path, cacheDirectory);
+	strcat(path, PCM_ROM_CACHE_FILENAME_PREFIX);
+	strcat(path, pcmROMDigest);
+	strcat(path, PCM_ROM_CACHE_FILENAME_SUFFIX);
+	strcat(path, extraSuffix);
+	return path;
+}
+
+ROMSet::ROMSet(const File::SHA1Digest &useControlROMDigest, const File::SHA1Digest &usePCMROMDigest, size_t usePCMROMSize, const ControlROMPCMStruct *usePCMTable, Bit32u usePCMWaveCount) :
+	pcmROMSize(usePCMROMSize),
+	pcmWaves(new PCMWaveEntry[usePCMWaveCount]),
+	pcmWaveCount(usePCMWaveCount),
+	pcmTable(new ControlROMPCMStruct[usePCMWaveCount]),
+	decodedPCMROMData(NULL),
+	pcmROMHotMemoryBlock(NULL),
+	pcmROMCacheFile(NULL),
+	pcmROMData(NULL),
+	refCount(1),
+	next(NULL),
+	pcmROMLockCount(0),
+	pcmROMLockGuard(0),
+	pcmROMLocked(0)
+{
+	memcpy(controlROMDigest, useControlROMDigest, sizeof(controlROMDigest));
+	memcpy(pcmROMDigest, usePCMROMDigest, sizeof(pcmROMDigest));
+	memcpy(pcmTable, usePCMTable, usePCMWaveCount * sizeof(ControlROMPCMStruct));
+}
+
+ROMSet::~ROMSet() {
+	delete[] pcmTable;
+	delete[] pcmWaves;
+	if (pcmROMHotMemoryBlock == NULL) delete[] decodedPCMROMData;
+	delete pcmROMHotMemoryBlock;
+	delete pcmROMCacheFile;
+}
+
+const ControlROMPCMStruct *ROMSet::getPCMTable() const {
+	return pcmTable;
+}
+
+const File::SHA1Digest &ROMSet::getControlROMDigest() const {
+	return controlROMDigest;
+}
+
+const File::SHA1Digest &ROMSet::getPCMROMDigest() const {
+	return pcmROMDigest;
+}
+
+const Bit16s *ROMSet::getPCMROMData() const {
+	return pcmROMData;
+}
+
+Bit16s *ROMSet::allocatePCMROMData(bool hotMemory) {
+	if (decodedPCMROMData == NULL && hotMemory) {
+		pcmROMHotMemoryBlock = new HotMemoryBlock;
+		if (pcmROMHotMemoryBlock->allocate(pcmROMSize * sizeof(Bit16s))) {
+			decodedPCMROMData = reinterpret_cast<Bit16s *>(pcmROMHotMemoryBlock->getData());
+		} else {
+			delete pcmROMHotMemoryBlock;
+			pcmROMHotMemoryBlock = NULL;
+		}
+	}
+	if (decodedPCMROMData == NULL) decodedPCMROMData = new Bit16s[pcmROMSize];
+	pcmROMData = decodedPCMROMData;
+	return decodedPCMROMData;
+}
+
+// Locking is done while opening the synths, so the guard is held for as long as faulting the samples in takes.
+void ROMSet::lockPCMROMData() const {
+	while (!Atomics::compareAndSwap(pcmROMLockGuard, 0, 1)) {}
+	if (pcmROMLockCount++ == 0) {
+		const bool locked = pcmROMHotMemoryBlock != NULL ? pcmROMHotMemoryBlock->lock() : HotMemory::lockRange(pcmROMData, pcmROMSize * sizeof(Bit16s));
+		Atomics::storeRelease(pcmROMLocked, locked ? 1 : 0);
+	}
+	Atomics::storeRelease(pcmROMLockGuard, 0);
+}
+
+void ROMSet::unlockPCMROMData() const {
+	while (!Atomics::compareAndSwap(pcmROMLockGuard, 0, 1)) {}
+	// A hot memory block stays locked until it's freed along with the set.
+	if (--pcmROMLockCount == 0 && pcmROMHotMemoryBlock == NULL) {
+		if (Atomics::loadAcquire(pcmROMLocked) != 0) HotMemory::unlockRange(pcmROMData, pcmROMSize * sizeof(Bit16s));
+		Atomics::storeRelease(pcmROMLocked, 0);
+	}
+	Atomics::storeRelease(pcmROMLockGuard, 0);
+}
+
+bool ROMSet::isPCMROMDataLocked() const {
+	return Atomics::loadAcquire(pcmROMLocked) != 0;
+}
+
+size_t ROMSet::getAllocatedMemorySize() const {
+	size_t size = sizeof(*this) + pcmWaveCount * (sizeof(PCMWaveEntry) + sizeof(ControlROMPCMStruct));
+	if (decodedPCMROMData != NULL) size += pcmROMSize * sizeof(Bit16s);
+	return size;
+}
+
+size_t ROMSet::getMappedMemorySize() const {
+	return pcmROMCacheFile == NULL ? 0 : pcmROMSize * sizeof(Bit16s);
+}
+
+bool ROMSet::loadPCMROMCache(const char *cacheDirectory) {
+	char *path = makePCMROMCachePath(cacheDirectory, pcmROMDigest, "");
+	MappedFile *file = new MappedFile;
+	bool opened = file->open(path);
+	delete[] path;
+	if (opened && file->getSize() == sizeof(PCMROMCacheHeader) + pcmROMSize * sizeof(Bit16s)) {
+		PCMROMCacheHeader header;
+		memcpy(&header, file->getData(), sizeof(header));
+		if (memcmp(header.magic, PCM_ROM_CACHE_MAGIC, sizeof(header.magic)) == 0
+			&& header.formatVersion == PCM_ROM_CACHE_FORMAT_VERSION
+			&& header.byteOrderMark == PCM_ROM_CACHE_BYTE_ORDER_MARK
+			&& header.sampleCount == pcmROMSize
+			&& memchr(header.pcmROMDigest, 0, sizeof(header.pcmROMDigest)) != NULL
+			&& strcmp(header.pcmROMDigest, pcmROMDigest) == 0)
+		{
+			pcmROMCacheFile = file;
+			pcmROMData = reinterpret_cast<const Bit16s *>(file->getData() + sizeof(PCMROMCacheHeader));
+			return true;
+		}
+	}
+	delete file;
+	return false;
+}
+
+void ROMSet::savePCMROMCache(const char *cacheDirectory) const {
+	if (pcmROMData == NULL || pcmROMCacheFile != NULL) return;
+
+	PCMROMCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PCM_ROM_CACHE_MAGIC, sizeof(header.magic));
+	header.formatVersion = PCM_ROM_CACHE_FORMAT_VERSION;
+	header.byteOrderMark = PCM_ROM_CACHE_BYTE_ORDER_MARK;
+	header.sampleCount = Bit32u(pcmROMSize);
+	strcpy(header.pcmROMDigest, pcmROMDigest);
+
+	// The temporary name only needs to be unlikely to clash with one used concurrently by another process or thread.
+	static volatile Bit32u tempFileCounter = 0;
+	Bit32u tempFileNumber;
+	do {
+		tempFileNumber = Atomics::loadAcquire(tempFileCounter);
+	} while (!Atomics::compareAndSwap(tempFileCounter, tempFileNumber, tempFileNumber + 1));
+	char tempSuffix[64];
+	sprintf(tempSuffix, ".%lx-%lx-%lx.tmp", static_cast<unsigned long>(time(NULL)), static_cast<unsigned long>(reinterpret_cast<size_t>(this)), static_cast<unsigned long>(tempFileNumber));
+	char *tempPath = makePCMROMCachePath(cacheDirectory, pcmROMDigest, tempSuffix);
+	FILE *file = fopen(tempPath, "wb");
+	if (file != NULL) {
+		bool written = fwrite(&header, sizeof(header), 1, file) == 1
+			&& fwrite(pcmROMData, sizeof(Bit16s), pcmROMSize, file) == pcmROMSize;
+		written = fclose(file) == 0 && written;
+		char *path = makePCMROMCachePath(cacheDirectory, pcmROMDigest, "");
+		// On Windows, rename() fails when the target exists, which is fine, since another process has just created it.
+		if (!written || rename(tempPath, path) != 0) remove(tempPath);
+		delete[] path;
+	}
+	delete[] tempPath;
+}
+
+bool ROMSet::matches(const File::SHA1Digest &useControlROMDigest, const File::SHA1Digest &usePCMROMDigest) const {
+	return strcmp(controlROMDigest, useControlROMDigest) == 0 && strcmp(pcmROMDigest, usePCMROMDigest) == 0;
+}
+
+const ROMSet *ROMSet::acquire(const File::SHA1Digest &useControlROMDigest, const File::SHA1Digest &usePCMROMDigest) {
+	lockPublishedSets();
+	ROMSet *romSet = publishedSets;
+	while (romSet != NULL && !romSet->matches(useControlROMDigest, usePCMROMDigest)) {
+		romSet = romSet->next;
+	}
+	if (romSet != NULL) romSet->refCount++;
+	unlockPublishedSets();
+	return romSet;
+}
+
+const ROMSet *ROMSet::publish(ROMSet *newSet) {
+	lockPublishedSets();
+	ROMSet *romSet = publishedSets;
+	while (romSet != NULL && !romSet->matches(newSet->controlROMDigest, newSet->pcmROMDigest)) {
+		romSet = romSet->next;
+	}
+	if (romSet != NULL) {
+		romSet->refCount++;
+	} else {
+		newSet->next = publishedSets;
+		publishedSets = newSet;
+	}
+	unlockPublishedSets();
+	if (romSet == NULL) return newSet;
+	delete newSet;
+	return romSet;
+}
+
+void ROMSet::release(const ROMSet *romSet) {
+	if (romSet == NULL) return;
+	ROMSet *setToDelete = NULL;
+	lockPublishedSets();
+	for (ROMSet **link = &publishedSets; *link != NULL; link = &(*link)->next) {
+		if (*link != romSet) continue;
+		if (--(*link)->refCount == 0) {
+			setToDelete = *link;
+			*link = setToDelete->next;
+		}
+		break;
+	}
+	unlockPublishedSets();
+	delete setToDelete;
+}
+
+} // namespace MT32Emu
@@ -0,0 +1,116 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_ROM_SET_H
+#define MT32EMU_ROM_SET_H
+
+#include <cstddef>
+
+#include "internals.h"
+
+#include "File.h"
+#include "Structures.h"
+
+namespace MT32Emu {
+
+class HotMemoryBlock;
+class MappedFile;
+
+// Immutable data decoded from a pair of control and PCM ROMs: the PCM ROM converted to LA32 log samples and the wave list.
+// Decoding takes megabytes of memory per synth, so the sets are reference-counted and shared by all synths in the process
+// opened with the same ROM pair, as identified by the SHA1 digests of the ROM files. The timbres and the other parameters
+// parsed from the control ROM aren't shared, since they only seed the synth memory, which is writable via SysEx.
+// Optionally, the decoded PCM ROM is also cached in a file, which is memory-mapped on subsequent startups instead of decoding
+// the ROM again, so that the processes using the same cache directory share the samples via the OS page cache as well.
+class ROMSet {
+public:
+	// Number of decoded PCM ROM samples.
+	const size_t pcmROMSize;
+	// The wave list, the entries refer to the copy of the control ROM PCM table stored in the set.
+	PCMWaveEntry * const pcmWaves;
+	const Bit32u pcmWaveCount;
+
+	// Returns the set decoded from the ROM pair with the given digests after incrementing its reference count,
+	// or NULL if no such set is in use.
+	static const ROMSet *acquire(const File::SHA1Digest &controlROMDigest, const File::SHA1Digest &pcmROMDigest);
+
+	// Makes a newly created set, which the caller has filled in, available for sharing with the reference count of 1.
+	// If the same ROM pair has been decoded concurrently meanwhile, newSet is deleted and the existing set is acquired.
+	// Returns the set to use.
+	static const ROMSet *publish(ROMSet *newSet);
+
+	// Decrements the reference count and deletes the set when it is no longer used.
+	static void release(const ROMSet *romSet);
+
+	// Creates an unpublished set with the buffers allocated. The PCM table is copied from the control ROM.
+	ROMSet(const File::SHA1Digest &controlROMDigest, const File::SHA1Digest &pcmROMDigest, size_t usePCMROMSize, const ControlROMPCMStruct *usePCMTable, Bit32u usePCMWaveCount);
+	~ROMSet();
+
+	const ControlROMPCMStruct *getPCMTable() const;
+
+	const File::SHA1Digest &getControlROMDigest() const;
+	const File::SHA1Digest &getPCMROMDigest() const;
+
+	// Returns the decoded PCM ROM samples, NULL until either allocatePCMROMData() or loadPCMROMCache() succeeds.
+	const Bit16s *getPCMROMData() const;
+
+	// Allocates the buffer to decode the PCM ROM into, as a HotMemoryBlock if hotMemory is set.
+	Bit16s *allocatePCMROMData(bool hotMemory);
+
+	// Faults in and locks the PCM ROM samples into RAM on behalf of a synth that uses hot memory. The locks are counted,
+	// so the samples stay locked until all such synths call unlockPCMROMData().
+	void lockPCMROMData() const;
+	void unlockPCMROMData() const;
+	// Returns true if the OS has locked the samples.
+	bool isPCMROMDataLocked() const;
+
+	// Returns the amount of memory allocated by the set, including the decoded PCM ROM samples unless these are memory-mapped.
+	size_t getAllocatedMemorySize() const;
+	// Returns the size of the PCM ROM samples memory-mapped from the cache file, or 0 if they have been decoded.
+	size_t getMappedMemorySize() const;
+
+	// Attempts to map the decoded PCM ROM samples from the cache file in the specified directory (including the trailing
+	// path separator). Returns false if the file is missing or doesn't match the PCM ROM, so that it has to be decoded.
+	bool loadPCMROMCache(const char *cacheDirectory);
+
+	// Writes the decoded PCM ROM samples to the cache file in the specified directory. The file is written under a temporary
+	// name and renamed then, so concurrent processes never map a partially written file. Failures are silently ignored.
+	void savePCMROMCache(const char *cacheDirectory) const;
+
+private:
+	File::SHA1Digest controlROMDigest;
+	File::SHA1Digest pcmROMDigest;
+	ControlROMPCMStruct * const pcmTable;
+	// Exactly one of these owns the samples pointed to by pcmROMData. The decoded samples are either placed in the hot memory
+	// block or allocated with new[].
+	Bit16s *decodedPCMROMData;
+	HotMemoryBlock *pcmROMHotMemoryBlock;
+	MappedFile *pcmROMCacheFile;
+	const Bit16s *pcmROMData;
+	Bit32u refCount;
+	ROMSet *next;
+
+	// The synths holding a lock of the samples, guarded by the spin lock.
+	mutable Bit32u pcmROMLockCount;
+	mutable volatile Bit32u pcmROMLockGuard;
+	mutable volatile Bit32u pcmROMLocked;
+
+	bool matches(const File::SHA1Digest &useControlROMDigest, const File::SHA1Digest &usePCMROMDigest) const;
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_ROM_SET_H
@@ -0,0 +1,235 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "internals.h"
+
+#include "RealtimeCheck.h"
+
+#if MT32EMU_WITH_REALTIME_CHECKS
+
+#include "Atomics.h"
+
+#if defined(_MSC_VER)
+#define MT32EMU_THREAD_LOCAL __declspec(thread)
+#else
+#define MT32EMU_THREAD_LOCAL __thread
+#endif
+
+#if __cplusplus < 201103L
+#define MT32EMU_THROWS_BAD_ALLOC throw(std::bad_alloc)
+#define MT32EMU_THROWS_NOTHING throw()
+#else
+#define MT32EMU_THROWS_BAD_ALLOC
+#define MT32EMU_THROWS_NOTHING noexcept
+#endif
+
+namespace MT32Emu {
+
+namespace RealtimeCheck {
+
+enum ViolationType {
+	ViolationType_ALLOCATION,
+	ViolationType_DEALLOCATION,
+	ViolationType_LOCK,
+	ViolationType_FILE_IO
+};
+
+static const char * const VIOLATION_TYPE_NAMES[] = {"allocation", "deallocation", "lock", "file I/O"};
+
+// Only the outermost tags are recorded with violations that happen in deeper scopes.
+static const Bit32u MAX_TAG_DEPTH = 4;
+// Violations that differ in kind or tags once this many are recorded are only counted as lost.
+static const Bit32u MAX_RECORD_COUNT = 64;
+
+enum RecordState {
+	RecordState_FREE,
+	RecordState_FILLING,
+	RecordState_READY
+};
+
+// The records are claimed with a compare-and-swap, so that violations can be recorded concurrently without locking.
+struct ViolationRecord {
+	volatile Bit32u state;
+	ViolationType type;
+	Bit32u tagCount;
+	const char *tags[MAX_TAG_DEPTH];
+	volatile Bit32u count;
+};
+
+static ViolationRecord records[MAX_RECORD_COUNT];
+static volatile Bit32u lostViolationCount;
+
+static MT32EMU_THREAD_LOCAL Bit32u scopeDepth;
+static MT32EMU_THREAD_LOCAL const char *scopeTags[MAX_TAG_DEPTH];
+
+static void increment(volatile Bit32u &var) {
+	Bit32u value;
+	do {
+		value = Atomics::loadAcquire(var);
+	} while (!Atomics::compareAndSwap(var, value, value + 1));
+}
+
+static bool matchesCurrentScope(const ViolationRecord &record, ViolationType type, Bit32u tagCount) {
+	if (record.type != type || record.tagCount != tagCount) return false;
+	for (Bit32u tagIx = 0; tagIx < tagCount; tagIx++) {
+		if (record.tags[tagIx] != scopeTags[tagIx]) return false;
+	}
+	return true;
+}
+
+static void reportViolation(ViolationType type) {
+	if (scopeDepth == 0) return;
+	const Bit32u tagCount = scopeDepth < MAX_TAG_DEPTH ? scopeDepth : MAX_TAG_DEPTH;
+	for (Bit32u recordIx = 0; recordIx < MAX_RECORD_COUNT; recordIx++) {
+		ViolationRecord &record = records[recordIx];
+		Bit32u state = Atomics::loadAcquire(record.state);
+		if (state == RecordState_READY) {
+			if (matchesCurrentScope(record, type, tagCount)) {
+				increment(record.count);
+				return;
+			}
+		} else if (state == RecordState_FREE && Atomics::compareAndSwap(record.state, RecordState_FREE, RecordState_FILLING)) {
+			record.type = type;
+			record.tagCount = tagCount;
+			for (Bit32u tagIx = 0; tagIx < tagCount; tagIx++) {
+				record.tags[tagIx] = scopeTags[tagIx];
+			}
+			record.count = 1;
+			Atomics::storeRelease(record.state, RecordState_READY);
+			return;
+		}
+	}
+	increment(lostViolationCount);
+}
+
+void reportLock() {
+	reportViolation(ViolationType_LOCK);
+}
+
+void reportFileIO() {
+	reportViolation(ViolationType_FILE_IO);
+}
+
+// Appends the text to the description, truncating as necessary.
+static void append(char *description, size_t descriptionSize, const char *text) {
+	size_t length = strlen(description);
+	size_t textLength = strlen(text);
+	if (length + textLength >= descriptionSize) textLength = descriptionSize - length - 1;
+	memcpy(description + length, text, textLength);
+	description[length + textLength] = 0;
+}
+
+bool takeViolation(char *description, size_t descriptionSize) {
+	if (descriptionSize == 0) return false;
+	char number[16];
+	*description = 0;
+	for (Bit32u recordIx = 0; recordIx < MAX_RECORD_COUNT; recordIx++) {
+		ViolationRecord &record = records[recordIx];
+		if (Atomics::loadAcquire(record.state) != RecordState_READY) continue;
+		sprintf(number, "%u ", Atomics::loadAcquire(record.count));
+		append(description, descriptionSize, number);
+		append(description, descriptionSize, VIOLATION_TYPE_NAMES[record.type]);
+		append(description, descriptionSize, "(s) in ");
+		for (Bit32u tagIx = 0; tagIx < record.tagCount; tagIx++) {
+			if (tagIx > 0) append(description, descriptionSize, " > ");
+			append(description, descriptionSize, record.tags[tagIx]);
+		}
+		Atomics::storeRelease(record.state, RecordState_FREE);
+		return true;
+	}
+	Bit32u lostCount = Atomics::loadAcquire(lostViolationCount);
+	if (lostCount == 0) return false;
+	Atomics::compareAndSwap(lostViolationCount, lostCount, 0);
+	sprintf(number, "%u ", lostCount);
+	append(description, descriptionSize, number);
+	append(description, descriptionSize, "more violation(s) in other scopes");
+	return true;
+}
+
+} // namespace RealtimeCheck
+
+RealtimeScope::RealtimeScope(const char *tag) {
+	if (RealtimeCheck::scopeDepth < RealtimeCheck::MAX_TAG_DEPTH) {
+		RealtimeCheck::scopeTags[RealtimeCheck::scopeDepth] = tag;
+	}
+	RealtimeCheck::scopeDepth++;
+}
+
+RealtimeScope::~RealtimeScope() {
+	RealtimeCheck::scopeDepth--;
+}
+
+} // namespace MT32Emu
+
+// The replacements of the global allocation functions apply to the whole program when linked statically.
+// Within a shared library, they may only catch the allocations made by the library itself.
+
+void *operator new(std::size_t size) MT32EMU_THROWS_BAD_ALLOC {
+	MT32Emu::RealtimeCheck::reportViolation(MT32Emu::RealtimeCheck::ViolationType_ALLOCATION);
+	void *ptr = std::malloc(size == 0 ? 1 : size);
+	if (ptr == NULL) throw std::bad_alloc();
+	return ptr;
+}
+
+void *operator new[](std::size_t size) MT32EMU_THROWS_BAD_ALLOC {
+	return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) MT32EMU_THROWS_NOTHING {
+	MT32Emu::RealtimeCheck::reportViolation(MT32Emu::RealtimeCheck::ViolationType_ALLOCATION);
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &nothrow) MT32EMU_THROWS_NOTHING {
+	return operator new(size, nothrow);
+}
+
+void operator delete(void *ptr) MT32EMU_THROWS_NOTHING {
+	if (ptr == NULL) return;
+	MT32Emu::RealtimeCheck::reportViolation(MT32Emu::RealtimeCheck::ViolationType_DEALLOCATION);
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr) MT32EMU_THROWS_NOTHING {
+	operator delete(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) MT32EMU_THROWS_NOTHING {
+	operator delete(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) MT32EMU_THROWS_NOTHING {
+	operator delete(ptr);
+}
+
+#if __cplusplus >= 201402L
+
+void operator delete(void *ptr, std::size_t) noexcept {
+	operator delete(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+	operator delete(ptr);
+}
+
+#endif
+
+#endif // #if MT32EMU_WITH_REALTIME_CHECKS
@@ -0,0 +1,71 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_REALTIME_CHECK_H
+#define MT32EMU_REALTIME_CHECK_H
+
+#include <cstddef>
+
+#include "internals.h"
+
+namespace MT32Emu {
+
+#if MT32EMU_WITH_REALTIME_CHECKS
+
+// Marks the current thread as a rendering thread during its lifetime. While marked, heap allocations and deallocations,
+// locking and file I/O are recorded as violations of realtime safety, along with the tags of the enclosing scopes.
+// Scopes nest, so the tags form a stack that tells where the violation happened.
+class RealtimeScope {
+public:
+	explicit RealtimeScope(const char *tag);
+	~RealtimeScope();
+};
+
+namespace RealtimeCheck {
+
+// Record a lock or file I/O as a violation if the current thread is within a RealtimeScope. Never allocate or lock.
+// Allocations are caught by replacing the global operators new and delete, while the library reports its own locks
+// and file I/O using these.
+void reportLock();
+void reportFileIO();
+
+// Writes the description of a recorded violation to the buffer and forgets it. Returns false when no violation remains.
+// The violations are collected process-wide, by all the synth instances.
+bool takeViolation(char *description, size_t descriptionSize);
+
+} // namespace RealtimeCheck
+
+#else // #if MT32EMU_WITH_REALTIME_CHECKS
+
+// The scopes carry no state, and no violation is ever recorded or reported without the realtime checks.
+class RealtimeScope {
+public:
+	explicit RealtimeScope(const char *) {}
+};
+
+namespace RealtimeCheck {
+
+static inline void reportLock() {}
+static inline void reportFileIO() {}
+static inline bool takeViolation(char *, size_t) { return false; }
+
+} // namespace RealtimeCheck
+
+#endif // #if MT32EMU_WITH_REALTIME_CHECKS
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_REALTIME_CHECK_H
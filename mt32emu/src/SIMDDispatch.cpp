@@ -0,0 +1,103 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "internals.h"
+
+#include "SIMDDispatch.h"
+#include "CPUFeatures.h"
+#include "LA32FloatWaveKernels.h"
+#include "MixKernels.h"
+
+#if MT32EMU_WITH_INTERNAL_RESAMPLER
+#include "srchelper/srctools/include/FIRResampler.h"
+#include "srchelper/srctools/include/IIR2xResampler.h"
+#endif
+
+namespace MT32Emu {
+
+namespace SIMDDispatch {
+
+static SIMDInstructionSet detectInstructionSet() {
+#if MT32EMU_SIMD_SSE2
+#if MT32EMU_SIMD_AVX2
+	if (CPUFeatures::isAVX2Supported()) return SIMDInstructionSet_AVX2;
+	if (CPUFeatures::isSSE41Supported()) return SIMDInstructionSet_SSE4_1;
+#endif
+	return SIMDInstructionSet_SSE2;
+#else
+	return SIMDInstructionSet_NONE;
+#endif
+}
+
+// Both are initialised upon loading the library, the same way as the default kernel implementations.
+static SIMDInstructionSet instructionSet = detectInstructionSet();
+static SIMDInstructionSet forcedInstructionSet = instructionSet;
+
+SIMDInstructionSet getSupportedInstructionSet() {
+	return detectInstructionSet();
+}
+
+bool isInstructionSetSupported(SIMDInstructionSet requestedInstructionSet) {
+	const SIMDInstructionSet supportedInstructionSet = detectInstructionSet();
+	if (requestedInstructionSet == SIMDInstructionSet_NONE || requestedInstructionSet == supportedInstructionSet) return true;
+	// The x86 instruction sets are ordered, each one implies the preceding. The others are standalone.
+	if (requestedInstructionSet > SIMDInstructionSet_AVX2 || supportedInstructionSet > SIMDInstructionSet_AVX2) return false;
+	return requestedInstructionSet < supportedInstructionSet;
+}
+
+SIMDInstructionSet getInstructionSet() {
+	return instructionSet;
+}
+
+bool forceInstructionSet(SIMDInstructionSet requestedInstructionSet) {
+	if (!isInstructionSetSupported(requestedInstructionSet)) return false;
+	forcedInstructionSet = requestedInstructionSet;
+	return true;
+}
+
+SIMDInstructionSet getForcedInstructionSet() {
+	return forcedInstructionSet;
+}
+
+void dispatch() {
+	if (forcedInstructionSet == instructionSet) return;
+	instructionSet = forcedInstructionSet;
+	MixKernels::selectImplementation(instructionSet);
+	LA32FloatWaveKernels::selectImplementation(instructionSet);
+#if MT32EMU_WITH_INTERNAL_RESAMPLER
+	SRCTools::FIRResampler::setSIMDEnabled(isBaselineSIMDEnabled());
+	SRCTools::IIRResampler::setSIMDEnabled(isBaselineSIMDEnabled());
+#endif
+}
+
+const char *getInstructionSetName(SIMDInstructionSet instructionSetToName) {
+	switch (instructionSetToName) {
+		case SIMDInstructionSet_SSE2:
+			return "SSE2";
+		case SIMDInstructionSet_SSE4_1:
+			return "SSE4.1";
+		case SIMDInstructionSet_AVX2:
+			return "AVX2";
+		case SIMDInstructionSet_NEON:
+			return "NEON";
+		default:
+			return "none";
+	}
+}
+
+} // namespace SIMDDispatch
+
+} // namespace MT32Emu
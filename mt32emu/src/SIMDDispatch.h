@@ -0,0 +1,66 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_SIMD_DISPATCH_H
+#define MT32EMU_SIMD_DISPATCH_H
+
+#include "internals.h"
+
+#include "Enumerations.h"
+
+namespace MT32Emu {
+
+// Runtime selection of the SIMD instruction set the optimised kernels are dispatched for. The library is built
+// for the baseline instruction set of the target architecture, the kernels for the extended instruction sets
+// are only invoked when supported by the CPU. By default, the best supported instruction set is selected upon
+// loading the library. Another one may be forced, e.g. for benchmarking, which takes effect on the next Synth::open().
+// The kernels are only re-selected when the forced instruction set differs from the one in use, so that
+// synths already rendering are unaffected unless the selection is actually changed.
+namespace SIMDDispatch {
+
+// Returns the best instruction set supported by both the CPU and the library build.
+SIMDInstructionSet getSupportedInstructionSet();
+
+// Returns true if the kernels may be dispatched for the specified instruction set.
+bool isInstructionSetSupported(SIMDInstructionSet instructionSet);
+
+// Returns the instruction set the kernels are currently dispatched for.
+SIMDInstructionSet getInstructionSet();
+
+// Requests the kernels to be dispatched for the specified instruction set starting from the next Synth::open().
+// Returns false and leaves the request unchanged if the instruction set is not supported.
+bool forceInstructionSet(SIMDInstructionSet instructionSet);
+
+// Returns the instruction set to be used on the next Synth::open().
+SIMDInstructionSet getForcedInstructionSet();
+
+// Re-selects the kernels for the forced instruction set if it differs from the one in use. Invoked by Synth::open().
+// Must not run while any synth is rendering.
+void dispatch();
+
+// Returns true if the kernels that only have the baseline SIMD variant should use it rather than the plain C++ code.
+inline bool isBaselineSIMDEnabled() {
+	return getInstructionSet() != SIMDInstructionSet_NONE;
+}
+
+// Returns the name of the instruction set, for diagnostic purposes.
+const char *getInstructionSetName(SIMDInstructionSet instructionSet);
+
+} // namespace SIMDDispatch
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_SIMD_DISPATCH_H
@@ -0,0 +1,251 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "internals.h"
+
+#include "SampleFormatKernels.h"
+#include "CPUFeatures.h"
+#include "SIMDDispatch.h"
+#include "Synth.h"
+
+namespace MT32Emu {
+
+namespace SampleFormatKernels {
+
+// The vectorised loops below produce exactly the same output as the scalar code, which also handles the remaining samples.
+
+// In GENERATION1 units, the DAC is fed with the samples shifted left by 1 bit, the sign bit is retained.
+static inline IntSample shiftGeneration1(const IntSample sample) {
+	return IntSample((sample & 0x8000) | ((sample << 1) & 0x7FFE));
+}
+
+// In GENERATION2 units, the output from LA32 goes to the Boss chip already bit-shifted, the lowest bit is fed with bit 14.
+static inline IntSample shiftGeneration2(const IntSample sample) {
+	return IntSample((sample & 0x8000) | ((sample << 1) & 0x7FFE) | ((sample >> 14) & 0x0001));
+}
+
+// Same as Synth::convertSample() but the sample is clamped before the conversion, so that the values exceeding
+// the 32-bit range saturate rather than overflow as well.
+static inline IntSample convertSample(const FloatSample sample) {
+	const FloatSample scaledSample = sample * 32768.0f;
+	if (scaledSample < -32768.0f) return -32768;
+	if (32767.0f < scaledSample) return 32767;
+	return Synth::clipSampleEx(Bit32s(scaledSample));
+}
+
+static inline float produceDistortedSample(float sample) {
+	// Here we roughly simulate the distortion caused by the DAC bit shift.
+	if (sample < -1.0f) {
+		return sample + 2.0f;
+	} else if (1.0f < sample) {
+		return sample - 2.0f;
+	}
+	return sample;
+}
+
+#if MT32EMU_SIMD_SSE2
+
+static inline __m128i shiftGeneration1SSE2(const __m128i samples) {
+	const __m128i signBits = _mm_and_si128(samples, _mm_set1_epi16(Bit16s(0x8000)));
+	return _mm_or_si128(signBits, _mm_and_si128(_mm_slli_epi16(samples, 1), _mm_set1_epi16(0x7FFE)));
+}
+
+static inline __m128i shiftGeneration2SSE2(const __m128i samples) {
+	return _mm_or_si128(shiftGeneration1SSE2(samples), _mm_srli_epi16(_mm_slli_epi16(samples, 1), 15));
+}
+
+// Selects sample + 2 below -1, sample - 2 above 1 and the sample itself otherwise, without arithmetic on the latter.
+static inline __m128 produceDistortedSamplesSSE2(const __m128 samples) {
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 belowRange = _mm_cmplt_ps(samples, _mm_set1_ps(-1.0f));
+	const __m128 aboveRange = _mm_cmpgt_ps(samples, _mm_set1_ps(1.0f));
+	const __m128 wrapped = _mm_or_ps(_mm_and_ps(belowRange, _mm_add_ps(samples, two)), _mm_and_ps(aboveRange, _mm_sub_ps(samples, two)));
+	return _mm_or_ps(wrapped, _mm_andnot_ps(_mm_or_ps(belowRange, aboveRange), samples));
+}
+
+#endif
+
+void convertSampleFormat(const IntSample *inBuffer, FloatSample *outBuffer, Bit32u length) {
+#if MT32EMU_SIMD_SSE2
+	// Scaling by a power of two is exact, so multiplying by the reciprocal is the same as the division in Synth::convertSample().
+	const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	const Bit32u vectorLength = SIMDDispatch::isBaselineSIMDEnabled() ? length & ~7U : 0;
+	for (Bit32u i = 0; i < vectorLength; i += 8) {
+		const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(inBuffer + i));
+		const __m128i samplesLow = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+		const __m128i samplesHigh = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+		_mm_storeu_ps(outBuffer + i, _mm_mul_ps(_mm_cvtepi32_ps(samplesLow), scale));
+		_mm_storeu_ps(outBuffer + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(samplesHigh), scale));
+	}
+#else
+	const Bit32u vectorLength = 0;
+#endif
+	for (Bit32u i = vectorLength; i < length; i++) {
+		outBuffer[i] = Synth::convertSample(inBuffer[i]);
+	}
+}
+
+void convertSampleFormat(const FloatSample *inBuffer, IntSample *outBuffer, Bit32u length) {
+#if MT32EMU_SIMD_SSE2
+	// The samples are clamped before the truncating conversion, so the pack never saturates. NaNs are converted to -32768,
+	// like the scalar code does on x86.
+	const __m128 scale = _mm_set1_ps(32768.0f);
+	const __m128 minSample = _mm_set1_ps(-32768.0f);
+	const __m128 maxSample = _mm_set1_ps(32767.0f);
+	const Bit32u vectorLength = SIMDDispatch::isBaselineSIMDEnabled() ? length & ~7U : 0;
+	for (Bit32u i = 0; i < vectorLength; i += 8) {
+		const __m128 samplesLow = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(inBuffer + i), scale), minSample), maxSample);
+		const __m128 samplesHigh = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(inBuffer + i + 4), scale), minSample), maxSample);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(outBuffer + i), _mm_packs_epi32(_mm_cvttps_epi32(samplesLow), _mm_cvttps_epi32(samplesHigh)));
+	}
+#else
+	const Bit32u vectorLength = 0;
+#endif
+	for (Bit32u i = vectorLength; i < length; i++) {
+		outBuffer[i] = convertSample(inBuffer[i]);
+	}
+}
+
+static void shiftGeneration1(IntSample *buffer, Bit32u length) {
+#if MT32EMU_SIMD_SSE2
+	const Bit32u vectorLength = SIMDDispatch::isBaselineSIMDEnabled() ? length & ~7U : 0;
+	for (Bit32u i = 0; i < vectorLength; i += 8) {
+		__m128i *samples = reinterpret_cast<__m128i *>(buffer + i);
+		_mm_storeu_si128(samples, shiftGeneration1SSE2(_mm_loadu_si128(samples)));
+	}
+#else
+	const Bit32u vectorLength = 0;
+#endif
+	for (Bit32u i = vectorLength; i < length; i++) {
+		buffer[i] = shiftGeneration1(buffer[i]);
+	}
+}
+
+static void shiftGeneration2(IntSample *buffer, Bit32u length) {
+#if MT32EMU_SIMD_SSE2
+	const Bit32u vectorLength = SIMDDispatch::isBaselineSIMDEnabled() ? length & ~7U : 0;
+	for (Bit32u i = 0; i < vectorLength; i += 8) {
+		__m128i *samples = reinterpret_cast<__m128i *>(buffer + i);
+		_mm_storeu_si128(samples, shiftGeneration2SSE2(_mm_loadu_si128(samples)));
+	}
+#else
+	const Bit32u vectorLength = 0;
+#endif
+	for (Bit32u i = vectorLength; i < length; i++) {
+		buffer[i] = shiftGeneration2(buffer[i]);
+	}
+}
+
+// Doubles the samples with saturation.
+static void amplifySamples(IntSample *buffer, Bit32u length) {
+#if MT32EMU_SIMD_SSE2
+	const Bit32u vectorLength = SIMDDispatch::isBaselineSIMDEnabled() ? length & ~7U : 0;
+	for (Bit32u i = 0; i < vectorLength; i += 8) {
+		__m128i *samples = reinterpret_cast<__m128i *>(buffer + i);
+		const __m128i loadedSamples = _mm_loadu_si128(samples);
+		_mm_storeu_si128(samples, _mm_adds_epi16(loadedSamples, loadedSamples));
+	}
+#else
+	const Bit32u vectorLength = 0;
+#endif
+	for (Bit32u i = vectorLength; i < length; i++) {
+		buffer[i] = Synth::clipSampleEx(IntSampleEx(buffer[i]) << 1);
+	}
+}
+
+// Note, we do not do any clamping for floats here to avoid introducing distortions.
+// This means that the output signal may actually overshoot the unity when the volume is set too high.
+// We leave it up to the consumer whether the output is to be clamped or properly normalised further on.
+static void amplifySamples(FloatSample *buffer, Bit32u length) {
+#if MT32EMU_SIMD_SSE2
+	const __m128 two = _mm_set1_ps(2.0f);
+	const Bit32u vectorLength = SIMDDispatch::isBaselineSIMDEnabled() ? length & ~3U : 0;
+	for (Bit32u i = 0; i < vectorLength; i += 4) {
+		_mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i), two));
+	}
+#else
+	const Bit32u vectorLength = 0;
+#endif
+	for (Bit32u i = vectorLength; i < length; i++) {
+		buffer[i] *= 2.0f;
+	}
+}
+
+// Float counterpart of both bit shifting modes.
+static void produceDistortedSamples(FloatSample *buffer, Bit32u length) {
+#if MT32EMU_SIMD_SSE2
+	const __m128 two = _mm_set1_ps(2.0f);
+	const Bit32u vectorLength = SIMDDispatch::isBaselineSIMDEnabled() ? length & ~3U : 0;
+	for (Bit32u i = 0; i < vectorLength; i += 4) {
+		_mm_storeu_ps(buffer + i, produceDistortedSamplesSSE2(_mm_mul_ps(two, _mm_loadu_ps(buffer + i))));
+	}
+#else
+	const Bit32u vectorLength = 0;
+#endif
+	for (Bit32u i = vectorLength; i < length; i++) {
+		buffer[i] = produceDistortedSample(2.0f * buffer[i]);
+	}
+}
+
+static void leaveSamplesIntact(IntSample *, Bit32u) {}
+
+static void leaveSamplesIntact(FloatSample *, Bit32u) {}
+
+// In NICE mode, it's also better to increase volume before the reverb processing to preserve accuracy.
+// No DAC input mode alters the samples both before and after the reverb, hence the single pass for the streams
+// that bypass the reverb is the same kernel as either of the two.
+static const DACInputKernels<IntSample> INT_NICE_KERNELS = { amplifySamples, leaveSamplesIntact, amplifySamples };
+static const DACInputKernels<IntSample> INT_PURE_KERNELS = { leaveSamplesIntact, leaveSamplesIntact, leaveSamplesIntact };
+static const DACInputKernels<IntSample> INT_GENERATION1_KERNELS = { leaveSamplesIntact, shiftGeneration1, shiftGeneration1 };
+static const DACInputKernels<IntSample> INT_GENERATION2_KERNELS = { shiftGeneration2, leaveSamplesIntact, shiftGeneration2 };
+
+static const DACInputKernels<FloatSample> FLOAT_NICE_KERNELS = { amplifySamples, leaveSamplesIntact, amplifySamples };
+static const DACInputKernels<FloatSample> FLOAT_PURE_KERNELS = { leaveSamplesIntact, leaveSamplesIntact, leaveSamplesIntact };
+static const DACInputKernels<FloatSample> FLOAT_GENERATION1_KERNELS = { leaveSamplesIntact, produceDistortedSamples, produceDistortedSamples };
+static const DACInputKernels<FloatSample> FLOAT_GENERATION2_KERNELS = { produceDistortedSamples, leaveSamplesIntact, produceDistortedSamples };
+
+template <>
+const DACInputKernels<IntSample> &getDACInputKernels<IntSample>(DACInputMode dacInputMode) {
+	switch (dacInputMode) {
+	case DACInputMode_NICE:
+		return INT_NICE_KERNELS;
+	case DACInputMode_GENERATION1:
+		return INT_GENERATION1_KERNELS;
+	case DACInputMode_GENERATION2:
+		return INT_GENERATION2_KERNELS;
+	default:
+		return INT_PURE_KERNELS;
+	}
+}
+
+template <>
+const DACInputKernels<FloatSample> &getDACInputKernels<FloatSample>(DACInputMode dacInputMode) {
+	switch (dacInputMode) {
+	case DACInputMode_NICE:
+		return FLOAT_NICE_KERNELS;
+	case DACInputMode_GENERATION1:
+		return FLOAT_GENERATION1_KERNELS;
+	case DACInputMode_GENERATION2:
+		return FLOAT_GENERATION2_KERNELS;
+	default:
+		return FLOAT_PURE_KERNELS;
+	}
+}
+
+} // namespace SampleFormatKernels
+
+} // namespace MT32Emu
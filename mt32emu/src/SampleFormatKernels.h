@@ -0,0 +1,59 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MT32EMU_SAMPLE_FORMAT_KERNELS_H
+#define MT32EMU_SAMPLE_FORMAT_KERNELS_H
+
+#include "internals.h"
+#include "Enumerations.h"
+
+namespace MT32Emu {
+
+// Per-sample conversion routines applied to the output streams. Vectorised with the baseline SIMD instruction set
+// unless disabled by SIMDDispatch, the output is exactly the same either way.
+namespace SampleFormatKernels {
+
+// Converts the samples as Synth::convertSample() does, the float samples are truncated and clipped to 16 bits.
+// Unlike Synth::convertSample(), the float samples that exceed the 32-bit integer range once scaled are clipped as well.
+void convertSampleFormat(const IntSample *inBuffer, FloatSample *outBuffer, Bit32u length);
+void convertSampleFormat(const FloatSample *inBuffer, IntSample *outBuffer, Bit32u length);
+
+// Emulation of a DAC input mode. The kernels are looked up once when the mode is selected,
+// so that processing the output streams involves no decisions upon the mode.
+template <class Sample>
+struct DACInputKernels {
+	// Emulates the processing of the LA32 output that precedes the reverb.
+	void (*produceLA32Output)(Sample *buffer, Bit32u length);
+	// Emulates the DAC bit shift applied to the samples that leave the reverb stage.
+	void (*convertSamplesToOutput)(Sample *buffer, Bit32u length);
+	// Same as produceLA32Output() followed by convertSamplesToOutput() in a single pass, for the streams that bypass the reverb.
+	void (*produceDACOutput)(Sample *buffer, Bit32u length);
+};
+
+// Returns the kernels that emulate the specified DAC input mode, specialised for IntSample and FloatSample.
+template <class Sample>
+const DACInputKernels<Sample> &getDACInputKernels(DACInputMode dacInputMode);
+template <>
+const DACInputKernels<IntSample> &getDACInputKernels<IntSample>(DACInputMode dacInputMode);
+template <>
+const DACInputKernels<FloatSample> &getDACInputKernels<FloatSample>(DACInputMode dacInputMode);
+
+} // namespace SampleFormatKernels
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_SAMPLE_FORMAT_KERNELS_H
@@ -26,23 +26,65 @@
 #include "srchelper/InternalResampler.h"
 #endif
 
+#include "CPUFeatures.h"
+#include "RealtimeCheck.h"
 #include "Synth.h"
+#include "TraceSink.h"
 
 using namespace MT32Emu;
 
-static inline void *createDelegate(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality) {
+static inline void *createDelegate(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio, bool minimumPhase) {
 #if MT32EMU_WITH_LIBSOXR_RESAMPLER
-	return new SoxrAdapter(synth, targetSampleRate, quality);
+	(void)variableRatio;
+	return new SoxrAdapter(synth, targetSampleRate, quality, minimumPhase);
 #elif MT32EMU_WITH_LIBSAMPLERATE_RESAMPLER
+	(void)variableRatio, (void)minimumPhase;
 	return new SamplerateAdapter(synth, targetSampleRate, quality);
 #elif MT32EMU_WITH_INTERNAL_RESAMPLER
-	return new InternalResampler(synth, targetSampleRate, quality);
+	return new InternalResampler(synth, targetSampleRate, quality, variableRatio, minimumPhase);
 #else
-	(void)synth, (void)targetSampleRate, (void)quality;
+	(void)synth, (void)targetSampleRate, (void)quality, (void)variableRatio, (void)minimumPhase;
 	return NULL;
 #endif
 }
 
+static inline void storeSample(float &outSample, const float sample, const bool accumulate, const float gain) {
+	outSample = accumulate ? outSample + sample * gain : sample;
+}
+
+// As in the synth, the gain is limited to 256 and quantised to 1/256 for the 16-bit output.
+static inline void storeSample(Bit16s &outSample, const float sample, const bool accumulate, const float gain) {
+	const Bit16s convertedSample = Synth::convertSample(sample);
+	if (accumulate) {
+		const Bit32s intGain = Bit32s((256.0f < gain ? 256.0f : gain) * 256.0f);
+		outSample = Synth::clipSampleEx(Bit32s(outSample) + ((convertedSample * intGain) >> 8));
+	} else {
+		outSample = convertedSample;
+	}
+}
+
+template <class Sample>
+static void getDescribedOutputSamples(SampleRateConverter &src, const StereoOutputDescriptor<Sample> &output, unsigned int length) {
+	static const unsigned int CHANNEL_COUNT = 2;
+
+	float floatBuffer[CHANNEL_COUNT * MAX_SAMPLES_PER_RUN];
+	Sample *left = output.left;
+	Sample *right = output.right;
+	while (length > 0) {
+		const unsigned int size = MAX_SAMPLES_PER_RUN < length ? MAX_SAMPLES_PER_RUN : length;
+		src.getOutputSamples(floatBuffer, size);
+		if (left != NULL) {
+			for (unsigned int i = 0; i < size; i++) {
+				storeSample(*left, floatBuffer[CHANNEL_COUNT * i], output.accumulate, output.gain);
+				storeSample(*right, floatBuffer[CHANNEL_COUNT * i + 1], output.accumulate, output.gain);
+				left += output.stride;
+				right += output.stride;
+			}
+		}
+		length -= size;
+	}
+}
+
 AnalogOutputMode SampleRateConverter::getBestAnalogOutputMode(double targetSampleRate) {
 	if (Synth::getStereoOutputSampleRate(AnalogOutputMode_ACCURATE) < targetSampleRate) {
 		return AnalogOutputMode_OVERSAMPLED;
@@ -52,6 +94,21 @@ AnalogOutputMode SampleRateConverter::getBestAnalogOutputMode(double targetSampl
 	return AnalogOutputMode_COARSE;
 }
 
+OutputPipelinePlan SampleRateConverter::planOutputPipeline(double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio) {
+#if MT32EMU_WITH_INTERNAL_RESAMPLER && !MT32EMU_WITH_LIBSOXR_RESAMPLER && !MT32EMU_WITH_LIBSAMPLERATE_RESAMPLER
+	return InternalResampler::planOutputPipeline(targetSampleRate, quality, variableRatio);
+#else
+	(void)quality;
+	OutputPipelinePlan plan;
+	plan.analogOutputMode = getBestAnalogOutputMode(targetSampleRate);
+	plan.conversionNeeded = Synth::getStereoOutputSampleRate(plan.analogOutputMode) != targetSampleRate || variableRatio;
+	plan.lpfFused = false;
+	plan.passbandFrequency = 0;
+	plan.estimatedCost = 0;
+	return plan;
+#endif
+}
+
 double SampleRateConverter::getSupportedOutputSampleRate(double desiredSampleRate) {
 #if MT32EMU_WITH_LIBSOXR_RESAMPLER || MT32EMU_WITH_LIBSAMPLERATE_RESAMPLER || MT32EMU_WITH_INTERNAL_RESAMPLER
 	return desiredSampleRate > 0 ? desiredSampleRate : 0;
@@ -61,13 +118,29 @@ double SampleRateConverter::getSupportedOutputSampleRate(double desiredSampleRat
 #endif
 }
 
-SampleRateConverter::SampleRateConverter(Synth &useSynth, double targetSampleRate, SamplerateConversionQuality useQuality) :
-	synthInternalToTargetSampleRateRatio(SAMPLE_RATE / targetSampleRate),
-	useSynthDelegate(useSynth.getStereoOutputSampleRate() == targetSampleRate),
-	srcDelegate(useSynthDelegate ? &useSynth : createDelegate(useSynth, targetSampleRate, useQuality))
+bool SampleRateConverter::isDACStreamsConversionSupported() {
+#if MT32EMU_WITH_INTERNAL_RESAMPLER
+	return true;
+#else
+	return false;
+#endif
+}
+
+SampleRateConverter::SampleRateConverter(Synth &useSynth, double useTargetSampleRate, SamplerateConversionQuality useQuality, bool useVariableRatio, bool useMinimumPhase) :
+	synthInternalToTargetSampleRateRatio(SAMPLE_RATE / useTargetSampleRate),
+	useSynthDelegate(useSynth.getStereoOutputSampleRate() == useTargetSampleRate && !useVariableRatio),
+	srcDelegate(useSynthDelegate ? &useSynth : createDelegate(useSynth, useTargetSampleRate, useQuality, useVariableRatio, useMinimumPhase)),
+	synth(useSynth),
+	targetSampleRate(useTargetSampleRate),
+	quality(useQuality),
+	variableRatio(useVariableRatio),
+	dacStreamsDelegate(NULL)
 {}
 
 SampleRateConverter::~SampleRateConverter() {
+#if MT32EMU_WITH_INTERNAL_RESAMPLER
+	delete static_cast<InternalDACStreamsResampler *>(dacStreamsDelegate);
+#endif
 	if (!useSynthDelegate) {
 #if MT32EMU_WITH_LIBSOXR_RESAMPLER
 		delete static_cast<SoxrAdapter *>(srcDelegate);
@@ -85,6 +158,9 @@ void SampleRateConverter::getOutputSamples(float *buffer, unsigned int length) {
 		return;
 	}
 
+	RealtimeScope realtimeScope("SampleRateConverter");
+	TraceZone traceZone("SampleRateConverter", synth.getInternalRenderedSampleCount());
+	DenormalFlushScope denormalFlushScope(synth.isDenormalFlushingEnabled());
 #if MT32EMU_WITH_LIBSOXR_RESAMPLER
 	static_cast<SoxrAdapter *>(srcDelegate)->getOutputSamples(buffer, length);
 #elif MT32EMU_WITH_LIBSAMPLERATE_RESAMPLER
@@ -96,6 +172,19 @@ void SampleRateConverter::getOutputSamples(float *buffer, unsigned int length) {
 #endif
 }
 
+void SampleRateConverter::setOutputRateAdjustment(double factor) {
+	if (!variableRatio || factor <= 0) return;
+#if MT32EMU_WITH_LIBSOXR_RESAMPLER
+	(void)factor;
+#elif MT32EMU_WITH_LIBSAMPLERATE_RESAMPLER
+	static_cast<SamplerateAdapter *>(srcDelegate)->setOutputRateAdjustment(factor);
+#elif MT32EMU_WITH_INTERNAL_RESAMPLER
+	static_cast<InternalResampler *>(srcDelegate)->setOutputRateAdjustment(factor);
+#else
+	(void)factor;
+#endif
+}
+
 void SampleRateConverter::getOutputSamples(Bit16s *outBuffer, unsigned int length) {
 	static const unsigned int CHANNEL_COUNT = 2;
 
@@ -117,6 +206,131 @@ void SampleRateConverter::getOutputSamples(Bit16s *outBuffer, unsigned int lengt
 	}
 }
 
+Bit32u SampleRateConverter::getOutputSamplesWithEvents(const MIDIEvent *events, Bit32u eventCount, Bit16s *buffer, unsigned int length) {
+	synth.setInlineEvents(events, eventCount);
+	getOutputSamples(buffer, length);
+	return synth.clearInlineEvents();
+}
+
+Bit32u SampleRateConverter::getOutputSamplesWithEvents(const MIDIEvent *events, Bit32u eventCount, float *buffer, unsigned int length) {
+	synth.setInlineEvents(events, eventCount);
+	getOutputSamples(buffer, length);
+	return synth.clearInlineEvents();
+}
+
+Bit32u SampleRateConverter::getOutputSamplesWithEvents(const MIDIEvent *events, Bit32u eventCount, const StereoOutputDescriptor<Bit16s> &output, unsigned int length) {
+	synth.setInlineEvents(events, eventCount);
+	getOutputSamples(output, length);
+	return synth.clearInlineEvents();
+}
+
+Bit32u SampleRateConverter::getOutputSamplesWithEvents(const MIDIEvent *events, Bit32u eventCount, const StereoOutputDescriptor<float> &output, unsigned int length) {
+	synth.setInlineEvents(events, eventCount);
+	getOutputSamples(output, length);
+	return synth.clearInlineEvents();
+}
+
+void SampleRateConverter::getOutputSamples(const StereoOutputDescriptor<Bit16s> &output, unsigned int length) {
+	if (useSynthDelegate) {
+		static_cast<Synth *>(srcDelegate)->render(output, length);
+		return;
+	}
+	getDescribedOutputSamples(*this, output, length);
+}
+
+void SampleRateConverter::getOutputSamples(const StereoOutputDescriptor<float> &output, unsigned int length) {
+	if (useSynthDelegate) {
+		static_cast<Synth *>(srcDelegate)->render(output, length);
+		return;
+	}
+	// The resampler writes an interleaved stereo output directly, so the intermediate buffer is only needed for other layouts.
+	if (output.left != NULL && !output.accumulate && output.stride == 2 && output.right == output.left + 1) {
+		getOutputSamples(output.left, length);
+		return;
+	}
+	getDescribedOutputSamples(*this, output, length);
+}
+
+void SampleRateConverter::getOutputStreams(const DACOutputStreams<float> &streams, unsigned int length) {
+	if (targetSampleRate == SAMPLE_RATE) {
+		synth.renderStreams(streams, length);
+		return;
+	}
+
+#if MT32EMU_WITH_INTERNAL_RESAMPLER
+	if (dacStreamsDelegate == NULL) {
+		dacStreamsDelegate = new InternalDACStreamsResampler(synth, targetSampleRate, quality);
+	}
+	DenormalFlushScope denormalFlushScope(synth.isDenormalFlushingEnabled());
+	static_cast<InternalDACStreamsResampler *>(dacStreamsDelegate)->getOutputStreams(streams, length);
+#else
+	Synth::muteSampleBuffer(streams.nonReverbLeft, length);
+	Synth::muteSampleBuffer(streams.nonReverbRight, length);
+	Synth::muteSampleBuffer(streams.reverbDryLeft, length);
+	Synth::muteSampleBuffer(streams.reverbDryRight, length);
+	Synth::muteSampleBuffer(streams.reverbWetLeft, length);
+	Synth::muteSampleBuffer(streams.reverbWetRight, length);
+#endif
+}
+
+void SampleRateConverter::getOutputStreams(const DACOutputStreams<Bit16s> &outStreams, unsigned int length) {
+	if (targetSampleRate == SAMPLE_RATE) {
+		synth.renderStreams(outStreams, length);
+		return;
+	}
+
+	float floatBuffers[6][MAX_SAMPLES_PER_RUN];
+	Bit16s * const outBuffers[] = {
+		outStreams.nonReverbLeft, outStreams.nonReverbRight,
+		outStreams.reverbDryLeft, outStreams.reverbDryRight,
+		outStreams.reverbWetLeft, outStreams.reverbWetRight
+	};
+	unsigned int offset = 0;
+	while (offset < length) {
+		const unsigned int size = MAX_SAMPLES_PER_RUN < length - offset ? MAX_SAMPLES_PER_RUN : length - offset;
+		DACOutputStreams<float> floatStreams = {
+			outBuffers[0] == NULL ? NULL : floatBuffers[0], outBuffers[1] == NULL ? NULL : floatBuffers[1],
+			outBuffers[2] == NULL ? NULL : floatBuffers[2], outBuffers[3] == NULL ? NULL : floatBuffers[3],
+			outBuffers[4] == NULL ? NULL : floatBuffers[4], outBuffers[5] == NULL ? NULL : floatBuffers[5]
+		};
+		getOutputStreams(floatStreams, size);
+		for (unsigned int streamIx = 0; streamIx < 6; streamIx++) {
+			if (outBuffers[streamIx] == NULL) continue;
+			for (unsigned int i = 0; i < size; i++) {
+				outBuffers[streamIx][offset + i] = Synth::convertSample(floatBuffers[streamIx][i]);
+			}
+		}
+		offset += size;
+	}
+}
+
+double SampleRateConverter::getLatency() const {
+	if (useSynthDelegate) return 0.0;
+#if MT32EMU_WITH_LIBSOXR_RESAMPLER
+	return static_cast<const SoxrAdapter *>(srcDelegate)->getLatency();
+#elif MT32EMU_WITH_INTERNAL_RESAMPLER && !MT32EMU_WITH_LIBSAMPLERATE_RESAMPLER
+	return static_cast<const InternalResampler *>(srcDelegate)->getLatency();
+#else
+	return 0.0;
+#endif
+}
+
+size_t SampleRateConverter::getAllocatedMemorySize() const {
+	size_t size = sizeof(*this);
+#if MT32EMU_WITH_INTERNAL_RESAMPLER
+	if (dacStreamsDelegate != NULL) size += static_cast<const InternalDACStreamsResampler *>(dacStreamsDelegate)->getAllocatedMemorySize();
+#endif
+	if (useSynthDelegate) return size;
+#if MT32EMU_WITH_LIBSOXR_RESAMPLER
+	size += static_cast<const SoxrAdapter *>(srcDelegate)->getAllocatedMemorySize();
+#elif MT32EMU_WITH_LIBSAMPLERATE_RESAMPLER
+	size += static_cast<const SamplerateAdapter *>(srcDelegate)->getAllocatedMemorySize();
+#elif MT32EMU_WITH_INTERNAL_RESAMPLER
+	size += static_cast<const InternalResampler *>(srcDelegate)->getAllocatedMemorySize();
+#endif
+	return size;
+}
+
 double SampleRateConverter::convertOutputToSynthTimestamp(double outputTimestamp) const {
 	return outputTimestamp * synthInternalToTargetSampleRateRatio;
 }
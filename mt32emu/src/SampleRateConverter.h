@@ -17,6 +17,8 @@
 #ifndef MT32EMU_SAMPLE_RATE_CONVERTER_H
 #define MT32EMU_SAMPLE_RATE_CONVERTER_H
 
+#include <cstddef>
+
 #include "globals.h"
 #include "Types.h"
 #include "Enumerations.h"
@@ -24,6 +26,28 @@
 namespace MT32Emu {
 
 class Synth;
+struct MIDIEvent;
+
+template <class T>
+struct DACOutputStreams;
+
+template <class T>
+struct StereoOutputDescriptor;
+
+// Describes the output pipeline chosen by SampleRateConverter::planOutputPipeline().
+struct OutputPipelinePlan {
+	// Analog output mode to open the synth with.
+	AnalogOutputMode analogOutputMode;
+	// Whether the synth output is converted or rendered directly at the target sample rate.
+	bool conversionNeeded;
+	// Whether the analog LPF is applied within the sample rate conversion rather than by the synth.
+	bool lpfFused;
+	// Highest frequency the output retains, in Hz. Zero when not guaranteed by the conversion quality.
+	double passbandFrequency;
+	// Estimated number of multiply-accumulate operations spent in the analog LPF and the conversion per output sample
+	// of each channel. Only useful for comparing the pipelines, as the synthesis itself costs the same in each of them.
+	double estimatedCost;
+};
 
 /* SampleRateConverter class allows to convert the synthesiser output to any desired sample rate.
  * It processes the completely mixed stereo output signal as it passes the analogue circuit emulation,
@@ -37,15 +61,39 @@ public:
 	// at the sample rate specified by the targetSampleRate argument.
 	static AnalogOutputMode getBestAnalogOutputMode(double targetSampleRate);
 
+	// Chooses the analog output mode for which the synth output converted to the target sample rate with the specified quality
+	// costs the least yet retains the passband that the quality provides within the audible range. For each mode, the passband
+	// and the cost of the analog LPF and the conversion are estimated from the filters the internal resampler would set up,
+	// including the fusion of the LPF with the resampler. The returned plan reports the choice and may be logged or shown
+	// to the user. When the internal resampler isn't in use, the costs can't be estimated, so the mode is chosen by
+	// getBestAnalogOutputMode(), and the passband frequency and the estimated cost are left zero.
+	static OutputPipelinePlan planOutputPipeline(double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio = false);
+
 	// Returns the sample rate supported by the sample rate conversion implementation currently in effect
 	// that is closest to the one specified by the desiredSampleRate argument.
 	static double getSupportedOutputSampleRate(double desiredSampleRate);
 
+	// Returns whether getOutputStreams() can convert the DAC streams to a target sample rate other than 32000 Hz.
+	// This needs the internal resampler, so it returns false when the library is built with libsoxr or libsamplerate.
+	static bool isDACStreamsConversionSupported();
+
 	// Creates a SampleRateConverter instance that converts output signal from the synth to the given sample rate
-	// with the specified conversion quality.
-	SampleRateConverter(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality);
+	// with the specified conversion quality. When variableRatio is set, the conversion ratio may be adjusted while
+	// running using setOutputRateAdjustment(). In this case, the conversion is performed even if the sample rates match.
+	// When minimumPhase is set, minimum-phase filters are used instead of linear-phase ones where the implementation
+	// supports them (the internal resampler and libsoxr). This reduces the latency of the conversion considerably,
+	// while the phase response near the upper edge of the passband is no longer linear. Intended for live playing.
+	SampleRateConverter(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio = false, bool minimumPhase = false);
 	~SampleRateConverter();
 
+	// Scales the effective output sample rate by the given factor, e.g. to follow the actual sample rate of an audio device
+	// which clock drifts from the nominal rate, so that the output buffer fill level can be kept steady by a control loop.
+	// The factor is meant to stay close to 1, within a few percent at most, and takes effect smoothly with the following
+	// output samples. Only effective when the converter was created with variableRatio set. Supported by the internal
+	// resampler and libsamplerate, ignored with libsoxr. The streams converted by getOutputStreams() are not affected.
+	// The timestamp conversion functions below continue to use the nominal ratio.
+	void setOutputRateAdjustment(double factor);
+
 	// Fills the provided output buffer with the results of the sample rate conversion.
 	// The input samples are automatically retrieved from the synth as necessary.
 	void getOutputSamples(MT32Emu::Bit16s *buffer, unsigned int length);
@@ -54,6 +102,42 @@ public:
 	// The input samples are automatically retrieved from the synth as necessary.
 	void getOutputSamples(float *buffer, unsigned int length);
 
+	// Same as above but the output is stored according to the descriptor (see Synth::render()). When no conversion
+	// is necessary, the synth renders to the output buffers directly. Likewise, an interleaved float output that isn't
+	// accumulated is written by the resampler directly.
+	void getOutputSamples(const StereoOutputDescriptor<Bit16s> &output, unsigned int length);
+	void getOutputSamples(const StereoOutputDescriptor<float> &output, unsigned int length);
+
+	// Same as getOutputSamples() but also plays the given events while the input samples are retrieved from the synth,
+	// see Synth::renderWithEvents(). As the timestamps are measured at the internal synth sample rate, the events keep
+	// their timing relative to the synth output, even though the converter retrieves the input ahead of the output.
+	// Returns the number of events played.
+	Bit32u getOutputSamplesWithEvents(const MIDIEvent *events, Bit32u eventCount, Bit16s *buffer, unsigned int length);
+	Bit32u getOutputSamplesWithEvents(const MIDIEvent *events, Bit32u eventCount, float *buffer, unsigned int length);
+	Bit32u getOutputSamplesWithEvents(const MIDIEvent *events, Bit32u eventCount, const StereoOutputDescriptor<Bit16s> &output, unsigned int length);
+	Bit32u getOutputSamplesWithEvents(const MIDIEvent *events, Bit32u eventCount, const StereoOutputDescriptor<float> &output, unsigned int length);
+
+	// Fills the provided output streams with the results of the sample rate conversion of the streams that appear
+	// at the DAC entrance (see Synth::renderStreams()). The streams are converted from the DAC sample rate (32000 Hz)
+	// regardless of the analog output mode, and all six streams pass through a single resampler. NULL may be specified
+	// in place of any or all of the stream buffers to skip it. The resampler is set up upon the first call.
+	// The input samples are automatically retrieved from the synth, so this must not be combined with getOutputSamples().
+	// Unless isDACStreamsConversionSupported() returns true, the streams are filled with silence at target sample rates
+	// other than 32000 Hz, and the synth isn't advanced.
+	void getOutputStreams(const DACOutputStreams<Bit16s> &streams, unsigned int length);
+	// Same as above but outputs to float streams.
+	void getOutputStreams(const DACOutputStreams<float> &streams, unsigned int length);
+
+	// Returns the estimated delay the conversion introduces to the signal at low frequencies, measured in samples
+	// at the target sample rate. When the analog LPF is fused with the conversion, its delay is included as well.
+	// Returns 0 if no conversion is performed or the delay is unknown, as with libsamplerate.
+	// Intended for compensating the latency of the output, e.g. when scheduling MIDI events.
+	double getLatency() const;
+
+	// Returns the amount of memory in bytes allocated by the converter, including the buffers and the filters of the resampler
+	// that aren't shared with other converters. The internal state of libsoxr and libsamplerate is not accounted.
+	size_t getAllocatedMemorySize() const;
+
 	// Returns the number of samples produced at the internal synth sample rate (32000 Hz)
 	// that correspond to the number of samples at the target sample rate.
 	// Intended to facilitate audio time synchronisation.
@@ -68,6 +152,11 @@ private:
 	const double synthInternalToTargetSampleRateRatio;
 	const bool useSynthDelegate;
 	void * const srcDelegate;
+	Synth &synth;
+	const double targetSampleRate;
+	const SamplerateConversionQuality quality;
+	const bool variableRatio;
+	void *dacStreamsDelegate;
 }; // class SampleRateConverter
 
 } // namespace MT32Emu
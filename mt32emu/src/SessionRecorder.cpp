@@ -0,0 +1,81 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+#include <cstdio>
+
+#include "internals.h"
+
+#include "SessionRecorder.h"
+
+namespace MT32Emu {
+
+SessionRecorder *SessionRecorder::create(const char *filename, const SessionConfig &config, const Bit8u *state, size_t stateSize) {
+	FILE *file = fopen(filename, "wb");
+	if (file == NULL) return NULL;
+	SessionRecorder *recorder = new SessionRecorder(file);
+	fwrite(SESSION_RECORDING_MAGIC, 1, sizeof(SESSION_RECORDING_MAGIC), file);
+	recorder->writeUInt32(SESSION_RECORDING_VERSION);
+	recorder->writeUInt32(config.rendererType);
+	recorder->writeUInt32(config.analogOutputMode);
+	recorder->writeUInt32(config.partialCount);
+	recorder->writeUInt32(config.maxPartialCount);
+	recorder->writeUInt32(config.partialRenderingThreadCount);
+	recorder->writeUInt8(config.reverbPipelineEnabled ? 1 : 0);
+	recorder->writeUInt8(Bit8u(config.floatWaveAccuracy));
+	recorder->writeUInt32(Bit32u(stateSize));
+	if (fwrite(state, 1, stateSize, file) != stateSize || ferror(file)) {
+		delete recorder;
+		return NULL;
+	}
+	return recorder;
+}
+
+SessionRecorder::SessionRecorder(FILE *useFile) : file(useFile) {}
+
+SessionRecorder::~SessionRecorder() {
+	fclose(file);
+}
+
+void SessionRecorder::writeUInt8(Bit8u value) {
+	fputc(value, file);
+}
+
+void SessionRecorder::writeUInt32(Bit32u value) {
+	const Bit8u bytes[] = {Bit8u(value), Bit8u(value >> 8), Bit8u(value >> 16), Bit8u(value >> 24)};
+	fwrite(bytes, 1, sizeof(bytes), file);
+}
+
+void SessionRecorder::recordShortMessage(Bit32u timestamp, Bit32u message) {
+	writeUInt8(SessionRecordType_SHORT_MESSAGE);
+	writeUInt32(timestamp);
+	writeUInt32(message);
+}
+
+void SessionRecorder::recordSysex(Bit32u timestamp, const Bit8u *sysex, Bit32u length) {
+	writeUInt8(SessionRecordType_SYSEX);
+	writeUInt32(timestamp);
+	writeUInt32(length);
+	fwrite(sysex, 1, length, file);
+}
+
+void SessionRecorder::recordRenderCall(SessionRenderCallType callType, Bit32u length) {
+	writeUInt8(SessionRecordType_RENDER);
+	writeUInt8(Bit8u(callType));
+	writeUInt32(length);
+}
+
+} // namespace MT32Emu
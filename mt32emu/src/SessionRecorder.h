@@ -0,0 +1,92 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_SESSION_RECORDER_H
+#define MT32EMU_SESSION_RECORDER_H
+
+#include <cstddef>
+#include <cstdio>
+
+#include "globals.h"
+#include "Types.h"
+#include "Enumerations.h"
+
+namespace MT32Emu {
+
+// The session recording starts with a header composed of the magic, the format version, the SessionConfig fields in order
+// of declaration (the flag and the float wave accuracy are 8-bit, the rest are 32-bit) and the emulation state saved
+// by Synth::saveState() preceded by its size. The records follow, each starts with a byte of SessionRecordType.
+// All the numbers are little-endian. The format is replicated in mt32emu-bench.
+const Bit8u SESSION_RECORDING_MAGIC[8] = {'M', 'T', '3', '2', 'E', 'M', 'U', 'R'};
+const Bit32u SESSION_RECORDING_VERSION = 1;
+
+enum SessionRecordType {
+	// Followed by the timestamp and the message, 32-bit each.
+	SessionRecordType_SHORT_MESSAGE,
+	// Followed by the timestamp and the length, 32-bit each, and the bytes of the message.
+	SessionRecordType_SYSEX,
+	// Followed by a byte of SessionRenderCallType and the length in frames, 32-bit. The MIDI events recorded before
+	// a rendering call are those played during that call or in between it and the previous one.
+	SessionRecordType_RENDER
+};
+
+enum SessionRenderCallType {
+	SessionRenderCallType_STEREO_BIT16S,
+	SessionRenderCallType_STEREO_FLOAT,
+	SessionRenderCallType_DAC_STREAMS_BIT16S,
+	SessionRenderCallType_DAC_STREAMS_FLOAT,
+	SessionRenderCallType_PART_STREAMS_BIT16S,
+	SessionRenderCallType_PART_STREAMS_FLOAT,
+	SessionRenderCallType_BYPASSING_LPF,
+	SessionRenderCallType_FAST_FORWARD
+};
+
+// Configuration of the synth the emulation state can only be restored with.
+struct SessionConfig {
+	RendererType rendererType;
+	AnalogOutputMode analogOutputMode;
+	Bit32u partialCount;
+	Bit32u maxPartialCount;
+	Bit32u partialRenderingThreadCount;
+	bool reverbPipelineEnabled;
+	FloatWaveAccuracy floatWaveAccuracy;
+};
+
+// Writes the session recording for Synth::startSessionRecording(). The records are only written in the rendering
+// thread or synchronously with it, so no locking is needed. Writing is buffered by the C library.
+class SessionRecorder {
+public:
+	// Creates the file and writes the header, returns NULL on failure.
+	static SessionRecorder *create(const char *filename, const SessionConfig &config, const Bit8u *state, size_t stateSize);
+
+	~SessionRecorder();
+
+	void recordShortMessage(Bit32u timestamp, Bit32u message);
+	void recordSysex(Bit32u timestamp, const Bit8u *sysex, Bit32u length);
+	void recordRenderCall(SessionRenderCallType callType, Bit32u length);
+
+private:
+	FILE * const file;
+
+	explicit SessionRecorder(FILE *file);
+
+	void writeUInt8(Bit8u value);
+	void writeUInt32(Bit32u value);
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_SESSION_RECORDER_H
@@ -0,0 +1,65 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined _WIN32 && !defined _POSIX_C_SOURCE
+// Needed for clock_gettime() when compiling in strict ANSI mode.
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include "internals.h"
+
+#include "StageTimer.h"
+
+#if MT32EMU_WITH_RENDER_STATISTICS
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+namespace MT32Emu {
+
+#if MT32EMU_WITH_RENDER_STATISTICS
+
+#ifdef _WIN32
+
+static double getPerformanceCounterPeriod() {
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return 1.0 / double(frequency.QuadPart);
+}
+
+double StageTimer::getTime() {
+	static const double period = getPerformanceCounterPeriod();
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return double(counter.QuadPart) * period;
+}
+
+#else // #ifdef _WIN32
+
+double StageTimer::getTime() {
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+}
+
+#endif // #ifdef _WIN32
+
+#endif // #if MT32EMU_WITH_RENDER_STATISTICS
+
+} // namespace MT32Emu
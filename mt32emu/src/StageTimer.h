@@ -0,0 +1,51 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_STAGE_TIMER_H
+#define MT32EMU_STAGE_TIMER_H
+
+#include "internals.h"
+
+namespace MT32Emu {
+
+#if MT32EMU_WITH_RENDER_STATISTICS
+
+// Adds the time elapsed during its lifetime to the given accumulator, in seconds.
+class StageTimer {
+	double &accumulator;
+	const double startTime;
+
+public:
+	// Returns the current value of a monotonic clock in seconds.
+	static double getTime();
+
+	explicit StageTimer(double &useAccumulator) : accumulator(useAccumulator), startTime(getTime()) {}
+	~StageTimer() { accumulator += getTime() - startTime; }
+};
+
+#else // #if MT32EMU_WITH_RENDER_STATISTICS
+
+// Leaves the accumulator untouched, so the stage times read zero without the render statistics.
+class StageTimer {
+public:
+	explicit StageTimer(double &) {}
+};
+
+#endif // #if MT32EMU_WITH_RENDER_STATISTICS
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_STAGE_TIMER_H
@@ -15,22 +15,39 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstddef>
 #include <cstdio>
+#include <new>
 
 #include "internals.h"
 
 #include "Synth.h"
 #include "Analog.h"
+#include "Atomics.h"
 #include "BReverbModel.h"
+#include "CPUFeatures.h"
 #include "File.h"
+#include "HotMemory.h"
 #include "MemoryRegion.h"
 #include "MidiEventQueue.h"
+#include "MixKernels.h"
 #include "Part.h"
 #include "Partial.h"
 #include "PartialManager.h"
 #include "Poly.h"
 #include "ROMInfo.h"
+#include "ROMSet.h"
+#include "RealtimeCheck.h"
+#include "SIMDDispatch.h"
+#include "SessionRecorder.h"
+#include "SampleFormatKernels.h"
+#include "StageTimer.h"
+#include "SynthImpl.h"
+#include "SynthState.h"
+#include "ThreadPool.h"
+#include "TraceSink.h"
 #include "TVA.h"
+#include "WaitableSignal.h"
 
 #if MT32EMU_MONITOR_SYSEX > 0
 #include "mmath.h"
@@ -41,6 +58,10 @@ namespace MT32Emu {
 // MIDI interface data transfer rate in samples. Used to simulate the transfer delay.
 static const double MIDI_DATA_TRANSFER_RATE = double(SAMPLE_RATE) / 31250.0 * 8.0;
 
+// Number of samples the synth must stay silent before it is deactivated during rendering.
+// This is well beyond the delay of the analog LPF emulation, so the skipped output is silent anyway.
+const Bit32u IDLE_DEACTIVATION_DELAY = MAX_SAMPLES_PER_RUN;
+
 // FIXME: there should be more specific feature sets for various MT-32 control ROM versions
 static const ControlROMFeatureSet OLD_MT32_COMPATIBLE = {
 	true, // quirkBasePitchOverflow
@@ -88,127 +109,642 @@ static inline PartialState getPartialState(PartialManager *partialManager, unsig
 	return partial->isActive() ? PARTIAL_PHASE_TO_STATE[partial->getTVA()->getPhase()] : PartialState_INACTIVE;
 }
 
-template <class I, class O>
-static inline void convertSampleFormat(const I *inBuffer, O *outBuffer, const Bit32u len) {
+static inline void convertSampleFormat(const IntSample *inBuffer, FloatSample *outBuffer, const Bit32u len) {
+	if (inBuffer == NULL || outBuffer == NULL) return;
+	SampleFormatKernels::convertSampleFormat(inBuffer, outBuffer, len);
+}
+
+static inline void convertSampleFormat(const FloatSample *inBuffer, IntSample *outBuffer, const Bit32u len) {
 	if (inBuffer == NULL || outBuffer == NULL) return;
+	SampleFormatKernels::convertSampleFormat(inBuffer, outBuffer, len);
+}
+
+// Adds the source samples to the target buffer, the 16-bit samples are saturated.
+static inline void mixSampleBuffer(IntSample *target, const IntSample *source, Bit32u len) {
+	while (len--) {
+		*target = Synth::clipSampleEx(IntSampleEx(*target) + *(source++));
+		target++;
+	}
+}
 
-	const I *inBufferEnd = inBuffer + len;
-	while (inBuffer < inBufferEnd) {
-		*(outBuffer++) = Synth::convertSample(*(inBuffer++));
+static inline void mixSampleBuffer(FloatSample *target, const FloatSample *source, Bit32u len) {
+	while (len--) {
+		*(target++) += *(source++);
 	}
 }
 
-class Renderer {
-protected:
-	Synth &synth;
+// The gain is applied with the same precision as in the analog circuitry emulation, see StereoOutputDescriptor.
+static inline Bit16s accumulateSample(const Bit16s sample, const Bit16s addend, const float gain) {
+	const Bit32s intGain = Bit32s((256.0f < gain ? 256.0f : gain) * 256.0f);
+	return Synth::clipSampleEx(Bit32s(sample) + ((addend * intGain) >> 8));
+}
+
+static inline float accumulateSample(const float sample, const float addend, const float gain) {
+	return sample + addend * gain;
+}
+
+template <class Sample>
+static inline StereoOutputDescriptor<Sample> makeInterleavedOutput(Sample *stereoStream) {
+	StereoOutputDescriptor<Sample> output = { stereoStream, stereoStream == NULL ? NULL : stereoStream + 1, 2, false, 1.0f };
+	return output;
+}
 
-	void printDebug(const char *msg) const {
-		synth.printDebug("%s", msg);
+template <class Sample>
+static inline void advanceOutput(StereoOutputDescriptor<Sample> &output, Bit32u len) {
+	if (output.left != NULL) {
+		output.left += len * output.stride;
+		output.right += len * output.stride;
 	}
+}
 
-	bool isActivated() const {
-		return synth.activated;
+template <class Sample>
+static void muteOutput(const StereoOutputDescriptor<Sample> &output, Bit32u len) {
+	if (output.left == NULL || output.accumulate) return;
+	if (output.stride == 2 && output.right == output.left + 1) {
+		Synth::muteSampleBuffer(output.left, len << 1);
+		return;
+	}
+	Sample *left = output.left;
+	Sample *right = output.right;
+	while (len-- > 0) {
+		*left = 0;
+		*right = 0;
+		left += output.stride;
+		right += output.stride;
 	}
+}
 
-	bool isAbortingPoly() const {
-		return synth.isAbortingPoly();
+// Converts interleaved stereo samples to the other sample format storing them according to the output descriptor.
+template <class I, class O>
+static void convertStereoOutput(const I *stereoSamples, const StereoOutputDescriptor<O> &output, const Bit32u len) {
+	if (output.left == NULL) return;
+
+	O *left = output.left;
+	O *right = output.right;
+	const I *stereoSamplesEnd = stereoSamples + (len << 1);
+	if (output.accumulate) {
+		while (stereoSamples < stereoSamplesEnd) {
+			*left = accumulateSample(*left, Synth::convertSample(*(stereoSamples++)), output.gain);
+			*right = accumulateSample(*right, Synth::convertSample(*(stereoSamples++)), output.gain);
+			left += output.stride;
+			right += output.stride;
+		}
+	} else {
+		while (stereoSamples < stereoSamplesEnd) {
+			*left = Synth::convertSample(*(stereoSamples++));
+			*right = Synth::convertSample(*(stereoSamples++));
+			left += output.stride;
+			right += output.stride;
+		}
 	}
+}
 
-	Analog &getAnalog() const {
-		return *synth.analog;
+// The reverb pipeline processes the dry reverb input in blocks of this size, which is large enough to amortise
+// the thread synchronisation overhead but still keeps the latency moderate.
+static const Bit32u REVERB_PIPELINE_BLOCK_SIZE = 256;
+// While a block is being processed in the worker thread, the next one is collected, hence the latency of two blocks.
+static const Bit32u REVERB_PIPELINE_LATENCY = 2 * REVERB_PIPELINE_BLOCK_SIZE;
+// Must be a power of 2 and large enough to keep the latency and the wet output of one more block.
+static const Bit32u REVERB_PIPELINE_WET_BUFFER_SIZE = 4 * REVERB_PIPELINE_BLOCK_SIZE;
+
+// Runs the reverb model one block behind the rest of the rendering in a worker thread.
+// The dry reverb input is collected until a block is complete, then the block is handed over to the worker thread
+// while the next one is collected. The wet output is delivered with the latency of REVERB_PIPELINE_LATENCY samples,
+// and the non-reverb and dry streams are delayed by the same amount to keep all the DAC streams in sync. Whenever
+// the reverb model is to be accessed otherwise, the pipeline must be flushed first, so that the output is the same
+// as without the pipeline, only delayed.
+template <class Sample>
+class ReverbPipeline : public ThreadPool::Job {
+	ThreadPool &threadPool;
+
+	// The dry input collected since the last block has been handed over to the worker thread.
+	Sample pendingDryLeft[REVERB_PIPELINE_BLOCK_SIZE], pendingDryRight[REVERB_PIPELINE_BLOCK_SIZE];
+	Bit32u pendingLength;
+	BReverbModel *pendingReverbModel;
+
+	// The block being processed in the worker thread.
+	Sample jobDryLeft[REVERB_PIPELINE_BLOCK_SIZE], jobDryRight[REVERB_PIPELINE_BLOCK_SIZE];
+	Sample jobWetLeft[REVERB_PIPELINE_BLOCK_SIZE], jobWetRight[REVERB_PIPELINE_BLOCK_SIZE];
+	BReverbModel *jobReverbModel;
+	bool jobRunning;
+	bool jobProcessed;
+
+	// Ring buffer of the wet output ready to be delivered.
+	Sample wetLeft[REVERB_PIPELINE_WET_BUFFER_SIZE], wetRight[REVERB_PIPELINE_WET_BUFFER_SIZE];
+	Bit32u wetReadPosition;
+	Bit32u wetLength;
+
+	// Delay lines for the non-reverb and dry streams.
+	Sample delayLines[4][REVERB_PIPELINE_LATENCY];
+	Bit32u delayPosition;
+
+	void pushWet(const Sample *left, const Sample *right, Bit32u len) {
+		Bit32u writePosition = (wetReadPosition + wetLength) & (REVERB_PIPELINE_WET_BUFFER_SIZE - 1);
+		wetLength += len;
+		while (len-- > 0) {
+			wetLeft[writePosition] = left == NULL ? 0 : *(left++);
+			wetRight[writePosition] = right == NULL ? 0 : *(right++);
+			writePosition = (writePosition + 1) & (REVERB_PIPELINE_WET_BUFFER_SIZE - 1);
+		}
 	}
 
-	MidiEventQueue &getMidiQueue() {
-		return *synth.midiQueue;
+	void popWet(Sample *left, Sample *right, Bit32u len) {
+		wetLength -= len;
+		while (len-- > 0) {
+			if (left != NULL) *(left++) = wetLeft[wetReadPosition];
+			if (right != NULL) *(right++) = wetRight[wetReadPosition];
+			wetReadPosition = (wetReadPosition + 1) & (REVERB_PIPELINE_WET_BUFFER_SIZE - 1);
+		}
 	}
 
-	PartialManager &getPartialManager() {
-		return *synth.partialManager;
+	bool completeJob() {
+		if (!jobRunning) return true;
+		threadPool.waitForJob();
+		jobRunning = false;
+		pushWet(jobWetLeft, jobWetRight, REVERB_PIPELINE_BLOCK_SIZE);
+		return jobProcessed;
 	}
 
-	BReverbModel &getReverbModel() {
-		return *synth.reverbModel;
+	void startJob() {
+		memcpy(jobDryLeft, pendingDryLeft, sizeof(jobDryLeft));
+		memcpy(jobDryRight, pendingDryRight, sizeof(jobDryRight));
+		jobReverbModel = pendingReverbModel;
+		pendingLength = 0;
+		jobRunning = true;
+		threadPool.startJob(*this, 1);
 	}
 
-	Bit32u getRenderedSampleCount() {
-		return synth.renderedSampleCount;
+public:
+	explicit ReverbPipeline(ThreadPool &useThreadPool) : threadPool(useThreadPool), jobRunning(false) {
+		reset();
 	}
 
-	void incRenderedSampleCount(const Bit32u count) {
-		synth.renderedSampleCount += count;
+	~ReverbPipeline() {
+		completeJob();
 	}
 
-public:
-	Renderer(Synth &useSynth) : synth(useSynth) {}
+	static Bit32u getLatency() {
+		return REVERB_PIPELINE_LATENCY;
+	}
+
+	// Drops all the output in flight and fills the pipeline with silence.
+	void reset() {
+		completeJob();
+		pendingLength = 0;
+		pendingReverbModel = NULL;
+		wetReadPosition = 0;
+		wetLength = 0;
+		pushWet(NULL, NULL, REVERB_PIPELINE_LATENCY);
+		memset(delayLines, 0, sizeof(delayLines));
+		delayPosition = 0;
+	}
+
+	// Waits for the worker thread and processes the pending dry input, so that the reverb model is no longer in use.
+	bool flush() {
+		bool processed = completeJob();
+		if (pendingLength > 0) {
+			processed &= pendingReverbModel->process(pendingDryLeft, pendingDryRight, jobWetLeft, jobWetRight, pendingLength);
+			pushWet(jobWetLeft, jobWetRight, pendingLength);
+			pendingLength = 0;
+		}
+		return processed;
+	}
+
+	// Takes the dry input for the reverb model, which is NULL when reverb is disabled, and produces the delayed wet output.
+	// The output buffers may be NULL when the wet output is unused.
+	bool process(BReverbModel *reverbModel, const Sample *dryLeft, const Sample *dryRight, Sample *outLeft, Sample *outRight, Bit32u len) {
+		bool processed = true;
+		while (len > 0) {
+			Bit32u thisLen = REVERB_PIPELINE_BLOCK_SIZE - pendingLength;
+			if (thisLen > len) thisLen = len;
+			if (reverbModel == NULL) {
+				processed &= flush();
+				pushWet(NULL, NULL, thisLen);
+			} else {
+				if (pendingReverbModel != reverbModel) {
+					processed &= flush();
+					pendingReverbModel = reverbModel;
+				}
+				memcpy(pendingDryLeft + pendingLength, dryLeft, thisLen * sizeof(Sample));
+				memcpy(pendingDryRight + pendingLength, dryRight, thisLen * sizeof(Sample));
+				pendingLength += thisLen;
+				if (pendingLength == REVERB_PIPELINE_BLOCK_SIZE) {
+					processed &= completeJob();
+					startJob();
+				}
+			}
+			popWet(outLeft, outRight, thisLen);
+			dryLeft += thisLen;
+			dryRight += thisLen;
+			if (outLeft != NULL) outLeft += thisLen;
+			if (outRight != NULL) outRight += thisLen;
+			len -= thisLen;
+		}
+		return processed;
+	}
+
+	// Delays the given non-reverb and dry streams in place by the latency of the pipeline.
+	void delayStreams(Sample *nonReverbLeft, Sample *nonReverbRight, Sample *reverbDryLeft, Sample *reverbDryRight, Bit32u len) {
+		Sample * const buffers[] = { nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight };
+		for (int i = 0; i < 4; i++) {
+			Sample *buffer = buffers[i];
+			Sample *delayLine = delayLines[i];
+			Bit32u position = delayPosition;
+			for (Bit32u j = 0; j < len; j++) {
+				Sample sample = delayLine[position];
+				delayLine[position] = buffer[j];
+				buffer[j] = sample;
+				if (++position == REVERB_PIPELINE_LATENCY) position = 0;
+			}
+		}
+		delayPosition = (delayPosition + len) % REVERB_PIPELINE_LATENCY;
+	}
+
+	// The pipeline must be flushed. The ring buffers are saved starting from the current read positions.
+	void saveState(StateWriter &writer) const {
+		writer.writeUInt32(wetLength);
+		for (Bit32u i = 0; i < wetLength; i++) {
+			const Bit32u position = (wetReadPosition + i) & (REVERB_PIPELINE_WET_BUFFER_SIZE - 1);
+			writer.writeSamples(&wetLeft[position], 1);
+			writer.writeSamples(&wetRight[position], 1);
+		}
+		for (int i = 0; i < 4; i++) {
+			writer.writeSamples(delayLines[i] + delayPosition, REVERB_PIPELINE_LATENCY - delayPosition);
+			writer.writeSamples(delayLines[i], delayPosition);
+		}
+	}
 
-	virtual ~Renderer() {}
+	void restoreState(StateReader &reader) {
+		reset();
+		wetReadPosition = 0;
+		wetLength = reader.readIndex(REVERB_PIPELINE_WET_BUFFER_SIZE + 1);
+		for (Bit32u i = 0; i < wetLength; i++) {
+			reader.readSamples(&wetLeft[i], 1);
+			reader.readSamples(&wetRight[i], 1);
+		}
+		for (int i = 0; i < 4; i++) {
+			reader.readSamples(delayLines[i], REVERB_PIPELINE_LATENCY);
+		}
+		delayPosition = 0;
+	}
 
-	virtual void render(IntSample *stereoStream, Bit32u len) = 0;
-	virtual void render(FloatSample *stereoStream, Bit32u len) = 0;
-	virtual void renderStreams(const DACOutputStreams<IntSample> &streams, Bit32u len) = 0;
-	virtual void renderStreams(const DACOutputStreams<FloatSample> &streams, Bit32u len) = 0;
+	void runTask(Bit32u) {
+		RealtimeScope realtimeScope("reverb pipeline task");
+		jobProcessed = jobReverbModel->process(jobDryLeft, jobDryRight, jobWetLeft, jobWetRight, REVERB_PIPELINE_BLOCK_SIZE);
+	}
 };
 
+// The part streams are converted in shorter passes than the DAC streams, as there are many more of them to buffer.
+static const Bit32u PART_STREAMS_CONVERSION_LENGTH = 512;
+static const Bit32u PART_STREAMS_CONVERSION_BUFFER_COUNT = 2 * 9 + 2;
+
 template <class Sample>
 class RendererImpl : public Renderer {
+	static const Bit32u TMP_BUFFER_COUNT = 6;
+
+	// The maximum number of samples produced in a single pass, as configured when the synth was opened.
+	const Bit32u maxBlockLength;
+
+	// All the buffers below are carved out of this single allocation, sized according to maxBlockLength
+	// and the partial count. The arena is placed in hotMemoryBlock when hot memory locking is enabled.
+	Bit8u *arena;
+	size_t arenaSize;
+	HotMemoryBlock hotMemoryBlock;
+
 	// These buffers are used for building the output streams as they are found at the DAC entrance.
 	// The output is mixed down to stereo interleaved further in the analog circuitry emulation.
-	Sample tmpNonReverbLeft[MAX_SAMPLES_PER_RUN], tmpNonReverbRight[MAX_SAMPLES_PER_RUN];
-	Sample tmpReverbDryLeft[MAX_SAMPLES_PER_RUN], tmpReverbDryRight[MAX_SAMPLES_PER_RUN];
-	Sample tmpReverbWetLeft[MAX_SAMPLES_PER_RUN], tmpReverbWetRight[MAX_SAMPLES_PER_RUN];
+	Sample *tmpNonReverbLeft, *tmpNonReverbRight;
+	Sample *tmpReverbDryLeft, *tmpReverbDryRight;
+	Sample *tmpReverbWetLeft, *tmpReverbWetRight;
+
+	DACOutputStreams<Sample> tmpBuffers;
+
+	// Stays muted, the reverb model is fed from it while the reverb is drained by the degradation ladder.
+	Sample *silentReverbInput;
+
+	// Receives the output to be converted to the sample format requested, either interleaved stereo or the DAC streams
+	// of maxBlockLength samples, or the part streams of partStreamsConversionLength samples.
+	Sample *conversionBuffer;
+	const Bit32u partStreamsConversionLength;
+
+	// Receives the indices of the active partials to render.
+	Bit32u *partialIndices;
+
+	// These are only allocated when partials are rendered in worker threads. Each partial renders its mono output
+	// to a separate buffer first. The buffers are mixed afterwards in the same order as partials are rendered
+	// serially, so that the output is exactly the same.
+	bool *partialReverbFlags;
+	Bit8u *partialOwnerParts;
+	Bit32u *partialOutputLengths;
+	Sample *partialOutputBuffers;
+
+	// NULL unless reverb is processed in the pipeline worker thread.
+	ReverbPipeline<Sample> * const reverbPipeline;
+
+	// Set while MIDI events that are due wait for a poly abortion to complete. Such delays aren't counted as timing errors.
+	bool midiEventsHeldUp;
+
+	// Set during fastForward(), so that the partials are merely advanced instead of producing the streams.
+	bool fastForwarding;
+
+	// Set while the part streams are rendered without the reverb pipeline.
+	bool reverbPipelineBypassed;
+
+	// The DAC input mode the kernels are looked up for. They are only looked up again when the mode changes.
+	DACInputMode dacInputMode;
+	const SampleFormatKernels::DACInputKernels<Sample> *dacInputKernels;
+
+	// While the reverb is drained, the model receives silence instead of the dry streams, so that the tail decays naturally.
+	const Sample *getReverbInput(const Sample *reverbDry) const {
+		return isReverbDrained() ? silentReverbInput : reverbDry;
+	}
+
+	Bit32u renderPartialsConcurrently(Bit32u len);
+	void producePartialOutputConcurrently(Sample *nonReverbLeft, Sample *nonReverbRight, Sample *reverbDryLeft, Sample *reverbDryRight, Bit32u len);
+
+public:
+	RendererImpl(Synth &useSynth) :
+		Renderer(useSynth),
+		maxBlockLength(getMaxRenderBlockLength()),
+		partStreamsConversionLength(maxBlockLength < PART_STREAMS_CONVERSION_LENGTH ? maxBlockLength : PART_STREAMS_CONVERSION_LENGTH),
+		reverbPipeline(getReverbPipelineThreadPool() == NULL ? NULL : new ReverbPipeline<Sample>(*getReverbPipelineThreadPool())),
+		midiEventsHeldUp(false),
+		fastForwarding(false),
+		reverbPipelineBypassed(false),
+		dacInputMode(useSynth.getDACInputMode()),
+		dacInputKernels(&SampleFormatKernels::getDACInputKernels<Sample>(dacInputMode))
+	{
+		// The partials in excess of the current partial count may still play while the pool is shrinking.
+		const Bit32u partialCount = synth.getMaxPartialCount();
+		const bool concurrent = getPartialRenderingThreadPool() != NULL;
+
+		// The arrays are laid out in the order of decreasing alignment requirements, and the storage obtained
+		// with new[] is suitably aligned for any fundamental type, as are the pages of a HotMemoryBlock.
+		const size_t indexArraySize = (concurrent ? 2 : 1) * partialCount * sizeof(Bit32u);
+		const size_t tmpBufferSize = maxBlockLength * sizeof(Sample);
+		const size_t partialOutputBuffersSize = concurrent ? partialCount * tmpBufferSize : 0;
+		size_t conversionBufferSize = TMP_BUFFER_COUNT * tmpBufferSize;
+		if (conversionBufferSize < PART_STREAMS_CONVERSION_BUFFER_COUNT * partStreamsConversionLength * sizeof(Sample)) {
+			conversionBufferSize = PART_STREAMS_CONVERSION_BUFFER_COUNT * partStreamsConversionLength * sizeof(Sample);
+		}
+		arenaSize = indexArraySize + (TMP_BUFFER_COUNT + 1) * tmpBufferSize + conversionBufferSize + partialOutputBuffersSize + (concurrent ? partialCount * (sizeof(bool) + sizeof(Bit8u)) : 0);
+		if (isHotMemoryEnabled() && hotMemoryBlock.allocate(arenaSize)) {
+			hotMemoryBlock.lock();
+			arena = hotMemoryBlock.getData();
+		} else {
+			arena = new Bit8u[arenaSize];
+		}
+
+		Bit8u *position = arena;
+		partialIndices = reinterpret_cast<Bit32u *>(position);
+		position += partialCount * sizeof(Bit32u);
+		if (concurrent) {
+			partialOutputLengths = reinterpret_cast<Bit32u *>(position);
+			position += partialCount * sizeof(Bit32u);
+		} else {
+			partialOutputLengths = NULL;
+		}
+		Sample ** const tmpBufferPointers[TMP_BUFFER_COUNT] = {
+			&tmpNonReverbLeft, &tmpNonReverbRight,
+			&tmpReverbDryLeft, &tmpReverbDryRight,
+			&tmpReverbWetLeft, &tmpReverbWetRight
+		};
+		for (Bit32u i = 0; i < TMP_BUFFER_COUNT; i++) {
+			*tmpBufferPointers[i] = reinterpret_cast<Sample *>(position);
+			position += tmpBufferSize;
+		}
+		silentReverbInput = reinterpret_cast<Sample *>(position);
+		Synth::muteSampleBuffer(silentReverbInput, maxBlockLength);
+		position += tmpBufferSize;
+		conversionBuffer = reinterpret_cast<Sample *>(position);
+		position += conversionBufferSize;
+		if (concurrent) {
+			partialOutputBuffers = reinterpret_cast<Sample *>(position);
+			position += partialOutputBuffersSize;
+			partialReverbFlags = reinterpret_cast<bool *>(position);
+			position += partialCount * sizeof(bool);
+			partialOwnerParts = position;
+		} else {
+			partialOutputBuffers = NULL;
+			partialReverbFlags = NULL;
+			partialOwnerParts = NULL;
+		}
 
-	const DACOutputStreams<Sample> tmpBuffers;
-	DACOutputStreams<Sample> createTmpBuffers() {
 		DACOutputStreams<Sample> buffers = {
 			tmpNonReverbLeft, tmpNonReverbRight,
 			tmpReverbDryLeft, tmpReverbDryRight,
 			tmpReverbWetLeft, tmpReverbWetRight
 		};
-		return buffers;
+		tmpBuffers = buffers;
 	}
 
-public:
-	RendererImpl(Synth &useSynth) :
-		Renderer(useSynth),
-		tmpBuffers(createTmpBuffers())
-	{}
+	~RendererImpl() {
+		if (arena != hotMemoryBlock.getData()) delete[] arena;
+		delete reverbPipeline;
+	}
+
+	bool isMemoryLocked() const {
+		return hotMemoryBlock.isLocked();
+	}
 
-	void render(IntSample *stereoStream, Bit32u len);
-	void render(FloatSample *stereoStream, Bit32u len);
+	size_t getAllocatedMemorySize() const {
+		return sizeof(*this) + arenaSize + (reverbPipeline == NULL ? 0 : sizeof(ReverbPipeline<Sample>));
+	}
+
+	Bit32u getBlockLength() const {
+		return maxBlockLength;
+	}
+
+	void render(const StereoOutputDescriptor<IntSample> &output, Bit32u len);
+	void render(const StereoOutputDescriptor<FloatSample> &output, Bit32u len);
+	void renderBypassingLPF(FloatSample *stereoStream, Bit32u len);
 	void renderStreams(const DACOutputStreams<IntSample> &streams, Bit32u len);
 	void renderStreams(const DACOutputStreams<FloatSample> &streams, Bit32u len);
+	void renderPartStreams(const PartOutputStreams<IntSample> &streams, Bit32u len);
+	void renderPartStreams(const PartOutputStreams<FloatSample> &streams, Bit32u len);
+	void fastForward(Bit32u len);
 
 	template <class O>
-	void doRenderAndConvert(O *stereoStream, Bit32u len);
-	void doRender(Sample *stereoStream, Bit32u len);
+	void doRenderAndConvert(const StereoOutputDescriptor<O> &output, Bit32u len, bool bypassLPF = false);
+	void doRender(const StereoOutputDescriptor<Sample> &output, Bit32u len);
+	void doRenderBypassingLPF(Sample *stereoStream, Bit32u len);
 
 	template <class O>
 	void doRenderAndConvertStreams(const DACOutputStreams<O> &streams, Bit32u len);
-	void doRenderStreams(const DACOutputStreams<Sample> &streams, Bit32u len);
-	void produceLA32Output(Sample *buffer, Bit32u len);
-	void convertSamplesToOutput(Sample *buffer, Bit32u len);
+	template <class O>
+	void doRenderAndConvertStreams(const PartOutputStreams<O> &streams, Bit32u len);
+	template <class Streams>
+	void doRenderStreams(const Streams &streams, Bit32u len);
+	void updateDACInputKernels();
+
+	void produceLA32Output(Sample *buffer, Bit32u len) {
+		dacInputKernels->produceLA32Output(buffer, len);
+	}
+
+	void convertSamplesToOutput(Sample *buffer, Bit32u len) {
+		dacInputKernels->convertSamplesToOutput(buffer, len);
+	}
+
+	// Same as produceLA32Output() followed by convertSamplesToOutput(), for the streams that bypass the reverb.
+	void produceDACOutput(Sample *buffer, Bit32u len) {
+		dacInputKernels->produceDACOutput(buffer, len);
+	}
+
 	void produceStreams(const DACOutputStreams<Sample> &streams, Bit32u len);
+	void produceStreams(const PartOutputStreams<Sample> &streams, Bit32u len);
+	void skipStreams(Bit32u len);
+
+	Bit32u getReverbPipelineLatency() const {
+		return reverbPipeline == NULL ? 0 : reverbPipeline->getLatency();
+	}
+
+	void flushReverbPipeline() {
+		if (reverbPipeline != NULL && !reverbPipeline->flush()) {
+			printDebug("RendererImpl: Invalid call to BReverbModel::process()!\n");
+		}
+	}
+
+	void resetReverbPipeline() {
+		if (reverbPipeline != NULL) reverbPipeline->reset();
+	}
+
+	void saveState(StateWriter &writer) const {
+		Renderer::saveState(writer);
+		writer.writeBool(midiEventsHeldUp);
+		if (reverbPipeline != NULL) reverbPipeline->saveState(writer);
+	}
+
+	void restoreState(StateReader &reader) {
+		Renderer::restoreState(reader);
+		midiEventsHeldUp = reader.readBool();
+		if (reverbPipeline != NULL) reverbPipeline->restoreState(reader);
+	}
 };
 
-class Extensions {
-public:
-	RendererType selectedRendererType;
-	Bit32s masterTunePitchDelta;
-	bool niceAmpRamp;
-	bool nicePanning;
-	bool nicePartialMixing;
+// Returns the size of the arena blocks taken by the memory regions and the padded timbre max table.
+static size_t getMemoryRegionsArenaSize() {
+	return ObjectArena::alignSize(sizeof(PatchTempMemoryRegion)) + ObjectArena::alignSize(sizeof(RhythmTempMemoryRegion))
+		+ ObjectArena::alignSize(sizeof(TimbreTempMemoryRegion)) + ObjectArena::alignSize(sizeof(PatchesMemoryRegion))
+		+ ObjectArena::alignSize(sizeof(TimbresMemoryRegion)) + ObjectArena::alignSize(sizeof(SystemMemoryRegion))
+		+ ObjectArena::alignSize(sizeof(DisplayMemoryRegion)) + ObjectArena::alignSize(sizeof(ResetMemoryRegion))
+		+ ObjectArena::alignSize(sizeof(MemParams::PaddedTimbre));
+}
+
+// Returns the size of the arena blocks taken by the partial manager along with its storage and by the parts.
+static size_t getPartialsArenaSize(const Bit32u partialCapacity, const RendererType rendererType) {
+	return ObjectArena::alignSize(sizeof(PartialManager)) + ObjectArena::alignSize(PartialManager::getStorageSize(partialCapacity, rendererType))
+		+ 8 * ObjectArena::alignSize(sizeof(Part)) + ObjectArena::alignSize(sizeof(RhythmPart));
+}
+
+static void clearMemoryRefreshBatch(MemoryRefreshBatch &batch) {
+	memset(&batch, 0, sizeof(MemoryRefreshBatch));
+	batch.firstDrum = 1;
+}
+
+// The reverb models are all opened upon opening the synth when placed in hot memory, as they would be allocated
+// in the rendering thread otherwise.
+static bool isReverbMemoryPreallocated(const Extensions &extensions) {
+	return extensions.preallocatedReverbMemory || extensions.hotMemoryEnabled;
+}
+
+// Adds a MIDI event played from the queue or the inline events to the session recording, if any.
+static void recordMIDIEvent(Extensions &extensions, const volatile MidiEventQueue::MidiEvent *event, Bit32u timestamp, bool queued) {
+	if (extensions.sessionRecorder == NULL) return;
+	if (queued && extensions.sessionSkippedEventCount > 0) {
+		extensions.sessionSkippedEventCount--;
+		return;
+	}
+	if (event->sysexData == NULL) {
+		extensions.sessionRecorder->recordShortMessage(timestamp, event->shortMessageData);
+	} else {
+		extensions.sessionRecorder->recordSysex(timestamp, const_cast<const Bit8u *>(event->sysexData), event->sysexLength);
+	}
+}
+
+void Renderer::recordDispatchedEvent(const volatile MidiEventQueue::MidiEvent *event) {
+	Extensions &extensions = synth.extensions;
+	if (extensions.sessionHeldEventRecorded) return;
+	recordMIDIEvent(extensions, event, event->timestamp, !nextEventInline);
+}
+
+void Renderer::updateHeldEventRecorded() {
+	synth.extensions.sessionHeldEventRecorded = synth.isAbortingPoly();
+}
+
+void Renderer::updateActivationState(const Bit32u len) {
+	if (!synth.activated) return;
+	if (!getMidiQueue().isEmpty() || hasPendingInlineEvents() || synth.hasActivePartials()) {
+		idleSampleCount = 0;
+		return;
+	}
+	flushReverbPipeline();
+	if (synth.isReverbEnabled() && getReverbModel().isActive()) {
+		idleSampleCount = 0;
+		return;
+	}
+	idleSampleCount += len;
+	// The output still in the reverb pipeline must be delivered before deactivation.
+	if (idleSampleCount >= IDLE_DEACTIVATION_DELAY + getReverbPipelineLatency()) {
+		idleSampleCount = 0;
+		synth.activated = false;
+		// A MIDI event may have just been pushed from another thread, it must not remain stuck in the queue.
+		if (!getMidiQueue().isEmpty()) {
+			synth.activated = true;
+		} else {
+			resetReverbPipeline();
+		}
+	}
+}
+
+ThreadPool *Renderer::getPartialRenderingThreadPool() const {
+	return synth.extensions.partialRenderingThreadPool;
+}
+
+ThreadPool *Renderer::getReverbPipelineThreadPool() const {
+	return synth.extensions.reverbPipelineThreadPool;
+}
+
+Bit32u Renderer::getMaxRenderBlockLength() const {
+	return synth.extensions.maxRenderBlockLength;
+}
 
-	// Here we keep the reverse mapping of assigned parts per MIDI channel.
-	// NOTE: value above 8 means that the channel is not assigned
-	Bit8u chantable[16][9];
+bool Renderer::isHotMemoryEnabled() const {
+	return synth.extensions.hotMemoryEnabled;
+}
+
+Bit32u Renderer::getMIDIEventTimingQuantum() const {
+	return synth.extensions.midiEventTimingQuantum;
+}
 
-	// This stores the index of Part in chantable that failed to play and required partial abortion.
-	Bit32u abortingPartIx;
+void Renderer::updateMaxMIDIEventTimingError(Bit32u timingError) {
+	if (synth.extensions.maxMIDIEventTimingError < timingError) synth.extensions.maxMIDIEventTimingError = timingError;
+}
 
-	bool preallocatedReverbMemory;
+// Renders partials, which are listed in partialIndices, to the corresponding mono buffers.
+template <class Sample>
+class PartialRenderingJob : public ThreadPool::Job {
+public:
+	PartialManager &partialManager;
+	const Bit32u *partialIndices;
+	Bit32u *partialOutputLengths;
+	Sample *partialOutputBuffers;
+	Bit32u bufferLength;
+	Bit32u len;
+
+	PartialRenderingJob(PartialManager &usePartialManager, const Bit32u *usePartialIndices, Bit32u *usePartialOutputLengths, Sample *usePartialOutputBuffers, Bit32u useBufferLength, Bit32u useLen) :
+		partialManager(usePartialManager),
+		partialIndices(usePartialIndices),
+		partialOutputLengths(usePartialOutputLengths),
+		partialOutputBuffers(usePartialOutputBuffers),
+		bufferLength(useBufferLength),
+		len(useLen)
+	{}
 
-	Bit32u midiEventQueueSize;
-	Bit32u midiEventQueueSysexStorageBufferSize;
+	void runTask(Bit32u taskIx) {
+		RealtimeScope realtimeScope("partial rendering task");
+		Sample *buffer = partialOutputBuffers + taskIx * bufferLength;
+		partialOutputLengths[taskIx] = partialManager.generateOutput(partialIndices[taskIx], buffer, len);
+	}
 };
 
 Bit32u Synth::getLibraryVersionInt() {
@@ -233,6 +769,18 @@ Bit32u Synth::getStereoOutputSampleRate(AnalogOutputMode analogOutputMode) {
 	return SAMPLE_RATES[analogOutputMode];
 }
 
+SIMDInstructionSet Synth::getSupportedSIMDInstructionSet() {
+	return SIMDDispatch::getSupportedInstructionSet();
+}
+
+SIMDInstructionSet Synth::getSIMDInstructionSet() {
+	return SIMDDispatch::getInstructionSet();
+}
+
+bool Synth::forceSIMDInstructionSet(SIMDInstructionSet instructionSet) {
+	return SIMDDispatch::forceInstructionSet(instructionSet);
+}
+
 Synth::Synth(ReportHandler *useReportHandler) :
 	mt32ram(*new MemParams),
 	mt32default(*new MemParams),
@@ -253,6 +801,11 @@ Synth::Synth(ReportHandler *useReportHandler) :
 	}
 
 	extensions.preallocatedReverbMemory = false;
+	extensions.reverbSilenceThreshold = 0.0f;
+	extensions.realtimeParameterUpdateMask = 0;
+	extensions.hotMemoryLockingEnabled = false;
+	extensions.hotMemoryEnabled = false;
+	extensions.pcmROMLocked = false;
 	for (int i = REVERB_MODE_ROOM; i <= REVERB_MODE_TAP_DELAY; i++) {
 		reverbModels[i] = NULL;
 	}
@@ -267,7 +820,15 @@ Synth::Synth(ReportHandler *useReportHandler) :
 	setNiceAmpRampEnabled(true);
 	setNicePanningEnabled(false);
 	setNicePartialMixingEnabled(false);
+	latchRealtimeParameters(false);
 	selectRendererType(RendererType_BIT16S);
+	extensions.floatWaveAccuracy = FloatWaveAccuracy_REFERENCE;
+	extensions.degradationLevel = DegradationLevel_NONE;
+	extensions.partialCullingLevel = 0;
+	extensions.denormalFlushingEnabled = false;
+	extensions.partialLimit = 0;
+	extensions.maxPartialCount = 0;
+	extensions.partialCapacity = partialCount;
 
 	patchTempMemoryRegion = NULL;
 	rhythmTempMemoryRegion = NULL;
@@ -282,10 +843,31 @@ Synth::Synth(ReportHandler *useReportHandler) :
 	partialManager = NULL;
 	pcmWaves = NULL;
 	pcmROMData = NULL;
+	extensions.romSet = NULL;
+	extensions.romCacheDirectory = NULL;
+	extensions.partialManagerStorage = NULL;
+	extensions.memoryRefreshBatch = NULL;
+	clearMemoryRefreshBatch(extensions.pendingMemoryRefresh);
+	extensions.memoryRefreshPending = false;
+	extensions.openState = NULL;
+	extensions.openStateSize = 0;
+	extensions.sessionRecorder = NULL;
+	extensions.sessionSkippedEventCount = 0;
+	extensions.sessionHeldEventRecorded = false;
+	extensions.asyncOpenJob = NULL;
 	soundGroupNames = NULL;
 	midiQueue = NULL;
 	extensions.midiEventQueueSize = DEFAULT_MIDI_EVENT_QUEUE_SIZE;
 	extensions.midiEventQueueSysexStorageBufferSize = 0;
+	extensions.midiEventQueueMultiProducer = false;
+	extensions.midiEventQueueCoalescingWindow = 0;
+	extensions.partialRenderingThreadCount = 1;
+	extensions.partialRenderingThreadPool = NULL;
+	extensions.reverbPipelineEnabled = false;
+	extensions.reverbPipelineThreadPool = NULL;
+	extensions.maxRenderBlockLength = MAX_SAMPLES_PER_RUN;
+	extensions.midiEventTimingQuantum = 0;
+	extensions.maxMIDIEventTimingError = 0;
 	lastReceivedMIDIEventTimestamp = 0;
 	memset(parts, 0, sizeof(parts));
 	renderedSampleCount = 0;
@@ -298,6 +880,7 @@ Synth::~Synth() {
 	}
 	delete &mt32ram;
 	delete &mt32default;
+	delete[] extensions.romCacheDirectory;
 	delete &extensions;
 }
 
@@ -362,7 +945,8 @@ void Synth::setReverbEnabled(bool newReverbEnabled) {
 		refreshSystemReverbParameters();
 		reverbOverridden = oldReverbOverridden;
 	} else {
-		if (!extensions.preallocatedReverbMemory) {
+		flushReverbPipeline();
+		if (!isReverbMemoryPreallocated(extensions)) {
 			reverbModel->close();
 		}
 		reverbModel = NULL;
@@ -387,14 +971,15 @@ void Synth::setReverbCompatibilityMode(bool mt32CompatibleMode) {
 	setReverbEnabled(false);
 	for (int i = REVERB_MODE_ROOM; i <= REVERB_MODE_TAP_DELAY; i++) {
 		delete reverbModels[i];
+		reverbModels[i] = NULL;
 	}
 	initReverbModels(mt32CompatibleMode);
 	setReverbEnabled(oldReverbEnabled);
-	setReverbOutputGain(reverbOutputGain);
+	analog->setReverbOutputGain(reverbOutputGain, mt32CompatibleMode);
 }
 
 bool Synth::isMT32ReverbCompatibilityMode() const {
-	return opened && (reverbModels[REVERB_MODE_ROOM]->isMT32Compatible(REVERB_MODE_ROOM));
+	return opened && extensions.mt32CompatibleReverb;
 }
 
 bool Synth::isDefaultReverbMT32Compatible() const {
@@ -404,22 +989,93 @@ bool Synth::isDefaultReverbMT32Compatible() const {
 void Synth::preallocateReverbMemory(bool enabled) {
 	if (extensions.preallocatedReverbMemory == enabled) return;
 	extensions.preallocatedReverbMemory = enabled;
-	if (!opened) return;
+	// All the models stay open in hot memory regardless.
+	if (!opened || extensions.hotMemoryEnabled) return;
 	for (int i = REVERB_MODE_ROOM; i <= REVERB_MODE_TAP_DELAY; i++) {
 		if (enabled) {
-			reverbModels[i]->open();
-		} else if (reverbModel != reverbModels[i]) {
+			getReverbModel(Bit8u(i))->open();
+		} else if (reverbModels[i] != NULL && reverbModel != reverbModels[i]) {
 			reverbModels[i]->close();
 		}
 	}
 }
 
+void Synth::prepareReverbModel(Bit8u mode) {
+	if (!opened || mode > REVERB_MODE_TAP_DELAY) return;
+	getReverbModel(mode)->open();
+}
+
+void Synth::setReverbSilenceThreshold(float threshold) {
+	extensions.reverbSilenceThreshold = threshold;
+	flushReverbPipeline();
+	for (int i = REVERB_MODE_ROOM; i <= REVERB_MODE_TAP_DELAY; i++) {
+		if (reverbModels[i] != NULL) reverbModels[i]->setSilenceThreshold(threshold);
+	}
+}
+
+float Synth::getReverbSilenceThreshold() const {
+	return extensions.reverbSilenceThreshold;
+}
+
+static inline void setRealtimeParameter(Extensions &extensions, RealtimeParameter parameter, Bit32u value) {
+	Atomics::storeRelease(extensions.realtimeParameters[parameter], value);
+	Atomics::fetchOr(extensions.realtimeParameterUpdateMask, 1 << parameter);
+}
+
+static inline Bit32u getRealtimeParameter(const Extensions &extensions, RealtimeParameter parameter) {
+	return Atomics::loadAcquire(extensions.realtimeParameters[parameter]);
+}
+
+static inline void setRealtimeParameter(Extensions &extensions, RealtimeParameter parameter, float value) {
+	Bit32u bits;
+	memcpy(&bits, &value, sizeof(bits));
+	setRealtimeParameter(extensions, parameter, bits);
+}
+
+static inline float getFloatRealtimeParameter(const Extensions &extensions, RealtimeParameter parameter) {
+	const Bit32u bits = getRealtimeParameter(extensions, parameter);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// The update mask is cleared before the parameters are read, so a parameter set meanwhile is read again in the next pass.
+void Synth::latchRealtimeParameters(bool reapplyGains) {
+	if (!reapplyGains && Atomics::loadAcquire(extensions.realtimeParameterUpdateMask) == 0) return;
+	const Bit32u updateMask = Atomics::fetchAnd(extensions.realtimeParameterUpdateMask, 0);
+	dacInputMode = DACInputMode(getRealtimeParameter(extensions, RealtimeParameter_DAC_INPUT_MODE));
+	outputGain = getFloatRealtimeParameter(extensions, RealtimeParameter_OUTPUT_GAIN);
+	reverbOutputGain = getFloatRealtimeParameter(extensions, RealtimeParameter_REVERB_OUTPUT_GAIN);
+	reversedStereoEnabled = getRealtimeParameter(extensions, RealtimeParameter_REVERSED_STEREO) != 0;
+	extensions.niceAmpRamp = getRealtimeParameter(extensions, RealtimeParameter_NICE_AMP_RAMP) != 0;
+	extensions.nicePanning = getRealtimeParameter(extensions, RealtimeParameter_NICE_PANNING) != 0;
+	extensions.nicePartialMixing = getRealtimeParameter(extensions, RealtimeParameter_NICE_PARTIAL_MIXING) != 0;
+	if (analog == NULL) return;
+	// The actual reverb output gain depends on the reverb compatibility mode at the time it is set.
+	if (reapplyGains || (updateMask & (1 << RealtimeParameter_OUTPUT_GAIN))) analog->setSynthOutputGain(outputGain);
+	if (reapplyGains || (updateMask & (1 << RealtimeParameter_REVERB_OUTPUT_GAIN))) {
+		analog->setReverbOutputGain(reverbOutputGain, isMT32ReverbCompatibilityMode());
+	}
+}
+
+bool Synth::isLatchedNiceAmpRampEnabled() const {
+	return extensions.niceAmpRamp;
+}
+
+bool Synth::isLatchedNicePanningEnabled() const {
+	return extensions.nicePanning;
+}
+
+bool Synth::isLatchedNicePartialMixingEnabled() const {
+	return extensions.nicePartialMixing;
+}
+
 void Synth::setDACInputMode(DACInputMode mode) {
-	dacInputMode = mode;
+	setRealtimeParameter(extensions, RealtimeParameter_DAC_INPUT_MODE, Bit32u(mode));
 }
 
 DACInputMode Synth::getDACInputMode() const {
-	return dacInputMode;
+	return DACInputMode(getRealtimeParameter(extensions, RealtimeParameter_DAC_INPUT_MODE));
 }
 
 void Synth::setMIDIDelayMode(MIDIDelayMode mode) {
@@ -430,56 +1086,67 @@ MIDIDelayMode Synth::getMIDIDelayMode() const {
 	return midiDelayMode;
 }
 
+void Synth::setMIDIEventTimingQuantum(Bit32u quantum) {
+	extensions.midiEventTimingQuantum = quantum;
+	extensions.maxMIDIEventTimingError = 0;
+}
+
+Bit32u Synth::getMIDIEventTimingQuantum() const {
+	return extensions.midiEventTimingQuantum;
+}
+
+Bit32u Synth::getMaxMIDIEventTimingError() const {
+	return extensions.maxMIDIEventTimingError;
+}
+
 void Synth::setOutputGain(float newOutputGain) {
 	if (newOutputGain < 0.0f) newOutputGain = -newOutputGain;
-	outputGain = newOutputGain;
-	if (analog != NULL) analog->setSynthOutputGain(newOutputGain);
+	setRealtimeParameter(extensions, RealtimeParameter_OUTPUT_GAIN, newOutputGain);
 }
 
 float Synth::getOutputGain() const {
-	return outputGain;
+	return getFloatRealtimeParameter(extensions, RealtimeParameter_OUTPUT_GAIN);
 }
 
 void Synth::setReverbOutputGain(float newReverbOutputGain) {
 	if (newReverbOutputGain < 0.0f) newReverbOutputGain = -newReverbOutputGain;
-	reverbOutputGain = newReverbOutputGain;
-	if (analog != NULL) analog->setReverbOutputGain(newReverbOutputGain, isMT32ReverbCompatibilityMode());
+	setRealtimeParameter(extensions, RealtimeParameter_REVERB_OUTPUT_GAIN, newReverbOutputGain);
 }
 
 float Synth::getReverbOutputGain() const {
-	return reverbOutputGain;
+	return getFloatRealtimeParameter(extensions, RealtimeParameter_REVERB_OUTPUT_GAIN);
 }
 
 void Synth::setReversedStereoEnabled(bool enabled) {
-	reversedStereoEnabled = enabled;
+	setRealtimeParameter(extensions, RealtimeParameter_REVERSED_STEREO, Bit32u(enabled));
 }
 
 bool Synth::isReversedStereoEnabled() const {
-	return reversedStereoEnabled;
+	return getRealtimeParameter(extensions, RealtimeParameter_REVERSED_STEREO) != 0;
 }
 
 void Synth::setNiceAmpRampEnabled(bool enabled) {
-	extensions.niceAmpRamp = enabled;
+	setRealtimeParameter(extensions, RealtimeParameter_NICE_AMP_RAMP, Bit32u(enabled));
 }
 
 bool Synth::isNiceAmpRampEnabled() const {
-	return extensions.niceAmpRamp;
+	return getRealtimeParameter(extensions, RealtimeParameter_NICE_AMP_RAMP) != 0;
 }
 
 void Synth::setNicePanningEnabled(bool enabled) {
-	extensions.nicePanning = enabled;
+	setRealtimeParameter(extensions, RealtimeParameter_NICE_PANNING, Bit32u(enabled));
 }
 
 bool Synth::isNicePanningEnabled() const {
-	return extensions.nicePanning;
+	return getRealtimeParameter(extensions, RealtimeParameter_NICE_PANNING) != 0;
 }
 
 void Synth::setNicePartialMixingEnabled(bool enabled) {
-	extensions.nicePartialMixing = enabled;
+	setRealtimeParameter(extensions, RealtimeParameter_NICE_PARTIAL_MIXING, Bit32u(enabled));
 }
 
 bool Synth::isNicePartialMixingEnabled() const {
-	return extensions.nicePartialMixing;
+	return getRealtimeParameter(extensions, RealtimeParameter_NICE_PARTIAL_MIXING) != 0;
 }
 
 bool Synth::loadControlROM(const ROMImage &controlROMImage) {
@@ -516,7 +1183,37 @@ bool Synth::loadControlROM(const ROMImage &controlROMImage) {
 	return false;
 }
 
-bool Synth::loadPCMROM(const ROMImage &pcmROMImage) {
+// The PCM ROM lines are wired in a scrambled order. Each sample is stored as a pair of bytes,
+// the first byte supplies bits 15 and 13..7 of the LA32 log sample, the second byte supplies bits 14 and 6..0.
+// The loop is free of branches and lookups, so that the compiler can vectorise it.
+static void decodePCMROMSamples(const Bit8u *fileData, Bit16s *decodedData, size_t sampleCount) {
+	for (size_t i = 0; i < sampleCount; i++) {
+		Bit32u s = fileData[2 * i];
+		Bit32u c = fileData[2 * i + 1];
+		decodedData[i] = Bit16s(((s & 0x80) << 8) | ((c & 0x40) << 8) | ((s & 0x7F) << 7) | ((c & 0x3F) << 1) | (c >> 7));
+	}
+}
+
+// Decodes the PCM ROM in contiguous chunks, one per thread of the pool.
+class PCMROMDecodingJob : public ThreadPool::Job {
+	const Bit8u * const fileData;
+	Bit16s * const decodedData;
+	const size_t sampleCount;
+	const Bit32u chunkCount;
+
+public:
+	PCMROMDecodingJob(const Bit8u *useFileData, Bit16s *useDecodedData, size_t useSampleCount, Bit32u useChunkCount) :
+		fileData(useFileData), decodedData(useDecodedData), sampleCount(useSampleCount), chunkCount(useChunkCount)
+	{}
+
+	void runTask(Bit32u chunkIx) {
+		size_t chunkStart = sampleCount * chunkIx / chunkCount;
+		size_t chunkEnd = sampleCount * (chunkIx + 1) / chunkCount;
+		decodePCMROMSamples(fileData + 2 * chunkStart, decodedData + chunkStart, chunkEnd - chunkStart);
+	}
+};
+
+bool Synth::loadPCMROM(const ROMImage &pcmROMImage, Bit16s *decodedPCMROMData) {
 	File *file = pcmROMImage.getFile();
 	const ROMInfo *pcmROMInfo = pcmROMImage.getROMInfo();
 	if ((pcmROMInfo == NULL)
@@ -535,29 +1232,58 @@ bool Synth::loadPCMROM(const ROMImage &pcmROMImage) {
 		return false;
 	}
 	const Bit8u *fileData = file->getData();
-	for (size_t i = 0; i < pcmROMSize; i++) {
-		Bit8u s = *(fileData++);
-		Bit8u c = *(fileData++);
-
-		int order[16] = {0, 9, 1, 2, 3, 4, 5, 6, 7, 10, 11, 12, 13, 14, 15, 8};
+	ThreadPool *threadPool = extensions.partialRenderingThreadPool;
+	if (threadPool == NULL) {
+		decodePCMROMSamples(fileData, decodedPCMROMData, pcmROMSize);
+	} else {
+		PCMROMDecodingJob job(fileData, decodedPCMROMData, pcmROMSize, threadPool->getThreadCount());
+		threadPool->runJob(job, threadPool->getThreadCount());
+	}
+	return true;
+}
 
-		Bit16s log = 0;
-		for (int u = 0; u < 16; u++) {
-			int bit;
-			if (order[u] < 8) {
-				bit = (s >> (7 - order[u])) & 0x1;
-			} else {
-				bit = (c >> (7 - (order[u] - 8))) & 0x1;
+bool Synth::loadROMSet(const ROMImage &controlROMImage, const ROMImage &pcmROMImage) {
+	const File::SHA1Digest &controlROMDigest = controlROMImage.getFile()->getSHA1();
+	const File::SHA1Digest &pcmROMDigest = pcmROMImage.getFile()->getSHA1();
+	const ROMSet *romSet = ROMSet::acquire(controlROMDigest, pcmROMDigest);
+	if (romSet == NULL) {
+		const ControlROMPCMStruct *pcmTable = reinterpret_cast<const ControlROMPCMStruct *>(&controlROMData[controlROMMap->pcmTable]);
+		ROMSet *newROMSet = new ROMSet(controlROMDigest, pcmROMDigest, pcmROMSize, pcmTable, controlROMMap->pcmCount);
+		const char *cacheDirectory = extensions.romCacheDirectory;
+		if (cacheDirectory != NULL && newROMSet->loadPCMROMCache(cacheDirectory)) {
+#if MT32EMU_MONITOR_INIT
+			printDebug("Using decoded PCM ROM from cache");
+#endif
+		} else {
+			if (!loadPCMROM(pcmROMImage, newROMSet->allocatePCMROMData(extensions.hotMemoryEnabled))) {
+				delete newROMSet;
+				return false;
 			}
-			log = log | Bit16s(bit << (15 - u));
+			if (cacheDirectory != NULL) newROMSet->savePCMROMCache(cacheDirectory);
 		}
-		pcmROMData[i] = log;
+#if MT32EMU_MONITOR_INIT
+		printDebug("Initialising PCM List");
+#endif
+		initPCMList(newROMSet->pcmWaves, newROMSet->getPCMTable(), controlROMMap->pcmCount);
+		romSet = ROMSet::publish(newROMSet);
+	}
+#if MT32EMU_MONITOR_INIT
+	else {
+		printDebug("Using decoded PCM ROM shared with other synths");
+	}
+#endif
+	extensions.romSet = romSet;
+	pcmROMData = romSet->getPCMROMData();
+	pcmWaves = romSet->pcmWaves;
+	// The samples are locked in place, since the set may have been decoded or mapped by a synth that doesn't use hot memory.
+	if (extensions.hotMemoryEnabled) {
+		romSet->lockPCMROMData();
+		extensions.pcmROMLocked = true;
 	}
 	return true;
 }
 
-bool Synth::initPCMList(Bit16u mapAddress, Bit16u count) {
-	ControlROMPCMStruct *tps = reinterpret_cast<ControlROMPCMStruct *>(&controlROMData[mapAddress]);
+bool Synth::initPCMList(PCMWaveEntry *newPCMWaves, const ControlROMPCMStruct *tps, Bit16u count) {
 	for (int i = 0; i < count; i++) {
 		Bit32u rAddr = tps[i].pos * 0x800;
 		Bit32u rLenExp = (tps[i].len & 0x70) >> 4;
@@ -566,41 +1292,55 @@ bool Synth::initPCMList(Bit16u mapAddress, Bit16u count) {
 			printDebug("Control ROM error: Wave map entry %d points to invalid PCM address 0x%04X, length 0x%04X", i, rAddr, rLen);
 			return false;
 		}
-		pcmWaves[i].addr = rAddr;
-		pcmWaves[i].len = rLen;
-		pcmWaves[i].loop = (tps[i].len & 0x80) != 0;
-		pcmWaves[i].controlROMPCMStruct = &tps[i];
+		newPCMWaves[i].addr = rAddr;
+		newPCMWaves[i].len = rLen;
+		newPCMWaves[i].loop = (tps[i].len & 0x80) != 0;
+		newPCMWaves[i].controlROMPCMStruct = &tps[i];
 		//int pitch = (tps[i].pitchMSB << 8) | tps[i].pitchLSB;
 		//bool unaffectedByMasterTune = (tps[i].len & 0x01) == 0;
-		//printDebug("PCM %d: pos=%d, len=%d, pitch=%d, loop=%s, unaffectedByMasterTune=%s", i, rAddr, rLen, pitch, pcmWaves[i].loop ? "YES" : "NO", unaffectedByMasterTune ? "YES" : "NO");
+		//printDebug("PCM %d: pos=%d, len=%d, pitch=%d, loop=%s, unaffectedByMasterTune=%s", i, rAddr, rLen, pitch, newPCMWaves[i].loop ? "YES" : "NO", unaffectedByMasterTune ? "YES" : "NO");
 	}
 	return false;
 }
 
-bool Synth::initCompressedTimbre(Bit16u timbreNum, const Bit8u *src, Bit32u srcLen) {
-	// "Compressed" here means that muted partials aren't present in ROM (except in the case of partial 0 being muted).
-	// Instead the data from the previous unmuted partial is used.
-	if (srcLen < sizeof(TimbreParam::CommonParam)) {
-		return false;
-	}
-	TimbreParam *timbre = &mt32ram.timbres[timbreNum].timbre;
-	timbresMemoryRegion->write(timbreNum, 0, src, sizeof(TimbreParam::CommonParam), true);
+// "Compressed" here means that muted partials aren't present in ROM (except in the case of partial 0 being muted).
+// Instead the data from the previous unmuted partial is used. Fills in the offsets of the partials within the timbre data,
+// returns false if these don't fit in the ROM.
+static bool locateCompressedPartials(Bit8u partialMute, Bit32u srcLen, unsigned int *partialOffsets) {
 	unsigned int srcPos = sizeof(TimbreParam::CommonParam);
-	unsigned int memPos = sizeof(TimbreParam::CommonParam);
 	for (int t = 0; t < 4; t++) {
-		if (t != 0 && ((timbre->common.partialMute >> t) & 0x1) == 0x00) {
+		if (t != 0 && ((partialMute >> t) & 0x1) == 0x00) {
 			// This partial is muted - we'll copy the previously copied partial, then
 			srcPos -= sizeof(TimbreParam::PartialParam);
 		} else if (srcPos + sizeof(TimbreParam::PartialParam) >= srcLen) {
 			return false;
 		}
-		timbresMemoryRegion->write(timbreNum, memPos, src + srcPos, sizeof(TimbreParam::PartialParam));
+		partialOffsets[t] = srcPos;
 		srcPos += sizeof(TimbreParam::PartialParam);
+	}
+	return true;
+}
+
+bool Synth::initCompressedTimbre(Bit16u timbreNum, const Bit8u *src, Bit32u srcLen) {
+	if (srcLen < sizeof(TimbreParam::CommonParam)) {
+		return false;
+	}
+	TimbreParam *timbre = &mt32ram.timbres[timbreNum].timbre;
+	timbresMemoryRegion->write(timbreNum, 0, src, sizeof(TimbreParam::CommonParam), true);
+	unsigned int partialOffsets[4];
+	if (!locateCompressedPartials(timbre->common.partialMute, srcLen, partialOffsets)) {
+		return false;
+	}
+	unsigned int memPos = sizeof(TimbreParam::CommonParam);
+	for (int t = 0; t < 4; t++) {
+		timbresMemoryRegion->write(timbreNum, memPos, src + partialOffsets[t], sizeof(TimbreParam::PartialParam));
 		memPos += sizeof(TimbreParam::PartialParam);
 	}
 	return true;
 }
 
+// Merely validates the timbres and records where to find them, so that only those referenced are decompressed.
+
 bool Synth::initTimbres(Bit16u mapAddress, Bit16u offset, Bit16u count, Bit16u startTimbre, bool compressed) {
 	const Bit8u *timbreMap = &controlROMData[mapAddress];
 	for (Bit16u i = 0; i < count * 2; i += 2) {
@@ -611,28 +1351,81 @@ bool Synth::initTimbres(Bit16u mapAddress, Bit16u offset, Bit16u count, Bit16u s
 		}
 		address += offset;
 		if (compressed) {
-			if (!initCompressedTimbre(startTimbre, &controlROMData[address], CONTROL_ROM_SIZE - address)) {
+			// The partial mute bits are validated as they get clamped when written to the timbre memory
+			const Bit32u srcLen = CONTROL_ROM_SIZE - address;
+			bool valid = srcLen >= sizeof(TimbreParam::CommonParam);
+			if (valid) {
+				Bit8u partialMute = controlROMData[address + offsetof(TimbreParam::CommonParam, partialMute)];
+				const Bit8u maxPartialMute = paddedTimbreMaxTable[offsetof(TimbreParam::CommonParam, partialMute)];
+				if (partialMute > maxPartialMute) partialMute = maxPartialMute;
+				unsigned int partialOffsets[4];
+				valid = locateCompressedPartials(partialMute, srcLen, partialOffsets);
+			}
+			if (!valid) {
 				printDebug("Control ROM error: Timbre map entry 0x%04x for timbre %d points to invalid timbre at 0x%04x", i, startTimbre, address);
 				return false;
 			}
-		} else {
-			timbresMemoryRegion->write(startTimbre, 0, &controlROMData[address], sizeof(TimbreParam), true);
+			extensions.compressedROMTimbres[startTimbre >> 5] |= 1u << (startTimbre & 31);
 		}
+		extensions.romTimbreAddresses[startTimbre] = address;
+		extensions.pendingROMTimbres[startTimbre >> 5] |= 1u << (startTimbre & 31);
 		startTimbre++;
 	}
 	return true;
 }
 
-void Synth::initReverbModels(bool mt32CompatibleMode) {
-	for (int mode = REVERB_MODE_ROOM; mode <= REVERB_MODE_TAP_DELAY; mode++) {
-		reverbModels[mode] = BReverbModel::createBReverbModel(ReverbMode(mode), mt32CompatibleMode, getSelectedRendererType());
+void Synth::loadROMTimbre(Bit16u absTimbreNum) {
+	extensions.pendingROMTimbres[absTimbreNum >> 5] &= ~(1u << (absTimbreNum & 31));
+	const Bit16u address = extensions.romTimbreAddresses[absTimbreNum];
+	if ((extensions.compressedROMTimbres[absTimbreNum >> 5] & (1u << (absTimbreNum & 31))) != 0) {
+		// Validated upon opening
+		initCompressedTimbre(absTimbreNum, &controlROMData[address], CONTROL_ROM_SIZE - address);
+	} else {
+		timbresMemoryRegion->write(absTimbreNum, 0, &controlROMData[address], sizeof(TimbreParam), true);
+	}
+}
 
-		if (extensions.preallocatedReverbMemory) {
-			reverbModels[mode]->open();
+void Synth::loadROMTimbres(Bit32u firstTimbreNum, Bit32u lastTimbreNum) {
+	for (Bit32u absTimbreNum = firstTimbreNum; absTimbreNum <= lastTimbreNum && absTimbreNum < 256; absTimbreNum++) {
+		if ((extensions.pendingROMTimbres[absTimbreNum >> 5] & (1u << (absTimbreNum & 31))) != 0) {
+			loadROMTimbre(Bit16u(absTimbreNum));
 		}
 	}
 }
 
+TimbreParam *Synth::getTimbre(unsigned int absTimbreNum) {
+	if ((extensions.pendingROMTimbres[absTimbreNum >> 5] & (1u << (absTimbreNum & 31))) != 0) {
+		loadROMTimbre(Bit16u(absTimbreNum));
+	}
+	return &mt32ram.timbres[absTimbreNum].timbre;
+}
+
+void Synth::resetPendingROMTimbres() {
+	memcpy(extensions.pendingROMTimbres, extensions.defaultPendingROMTimbres, sizeof(extensions.pendingROMTimbres));
+}
+
+void Synth::prefetchTimbres(Bit32u firstTimbreNum, Bit32u timbreCount) {
+	if (!opened || timbreCount == 0) return;
+	loadROMTimbres(firstTimbreNum, firstTimbreNum + timbreCount - 1);
+}
+
+// Unless reverb memory is preallocated, the models are created on demand as the modes get selected.
+void Synth::initReverbModels(bool mt32CompatibleMode) {
+	extensions.mt32CompatibleReverb = mt32CompatibleMode;
+	if (!isReverbMemoryPreallocated(extensions)) return;
+	for (int mode = REVERB_MODE_ROOM; mode <= REVERB_MODE_TAP_DELAY; mode++) {
+		getReverbModel(Bit8u(mode))->open();
+	}
+}
+
+BReverbModel *Synth::getReverbModel(Bit8u mode) {
+	if (reverbModels[mode] == NULL) {
+		reverbModels[mode] = BReverbModel::createBReverbModel(ReverbMode(mode), extensions.mt32CompatibleReverb, getSelectedRendererType(), extensions.hotMemoryEnabled);
+		reverbModels[mode]->setSilenceThreshold(extensions.reverbSilenceThreshold);
+	}
+	return reverbModels[mode];
+}
+
 void Synth::initSoundGroups(char newSoundGroupNames[][9]) {
 	memcpy(soundGroupIx, &controlROMData[controlROMMap->soundGroupsTable - sizeof(soundGroupIx)], sizeof(soundGroupIx));
 	const SoundGroup *table = reinterpret_cast<SoundGroup *>(&controlROMData[controlROMMap->soundGroupsTable]);
@@ -646,10 +1439,15 @@ bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, A
 }
 
 bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, Bit32u usePartialCount, AnalogOutputMode analogOutputMode) {
-	if (opened) {
+	if (opened || extensions.asyncOpenJob != NULL) {
 		return false;
 	}
+	return doOpen(controlROMImage, pcmROMImage, usePartialCount, analogOutputMode);
+}
+
+bool Synth::doOpen(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, Bit32u usePartialCount, AnalogOutputMode analogOutputMode) {
 	partialCount = usePartialCount;
+	extensions.partialCapacity = partialCount < extensions.maxPartialCount ? extensions.maxPartialCount : partialCount;
 	abortingPoly = NULL;
 	extensions.abortingPartIx = 0;
 
@@ -665,24 +1463,48 @@ bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, B
 		dispose();
 		return false;
 	}
+	if (!reportOpenProgress(extensions.asyncOpenJob, 5)) {
+		dispose();
+		return false;
+	}
+
+	extensions.hotMemoryEnabled = extensions.hotMemoryLockingEnabled;
+	extensions.arena.allocate(getMemoryRegionsArenaSize() + getPartialsArenaSize(extensions.partialCapacity, getSelectedRendererType())
+		+ ObjectArena::alignSize(controlROMMap->soundGroupsCount * sizeof(*soundGroupNames)), extensions.hotMemoryEnabled);
 
 	initMemoryRegions();
 
+	// The worker threads also help decode the PCM ROM.
+	if (extensions.partialRenderingThreadCount > 1) {
+		extensions.partialRenderingThreadPool = ThreadPool::createThreadPool(extensions.partialRenderingThreadCount - 1);
+		if (extensions.partialRenderingThreadPool == NULL) {
+			printDebug("Synth: Failed to start worker threads, partials will be rendered in the rendering thread only\n");
+		}
+#if MT32EMU_MONITOR_INIT
+		else {
+			printDebug("Rendering partials using %d threads", extensions.partialRenderingThreadCount);
+		}
+#endif
+	}
+
 	// 512KB PCM ROM for MT-32, etc.
 	// 1MB PCM ROM for CM-32L, LAPC-I, CM-64, CM-500
 	// Note that the size below is given in samples (16-bit), not bytes
 	pcmROMSize = controlROMMap->pcmCount == 256 ? 512 * 1024 : 256 * 1024;
-	pcmROMData = new Bit16s[pcmROMSize];
 
 #if MT32EMU_MONITOR_INIT
 	printDebug("Loading PCM ROM");
 #endif
-	if (!loadPCMROM(pcmROMImage)) {
+	if (!loadROMSet(controlROMImage, pcmROMImage)) {
 		printDebug("Init Error - Missing PCM ROM image");
 		reportHandler->onErrorPCMROM();
 		dispose();
 		return false;
 	}
+	if (!reportOpenProgress(extensions.asyncOpenJob, 50)) {
+		dispose();
+		return false;
+	}
 
 #if MT32EMU_MONITOR_INIT
 	printDebug("Initialising Reverb Models");
@@ -692,14 +1514,24 @@ bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, B
 	printDebug("Using %s Compatible Reverb Models", mt32CompatibleReverb ? "MT-32" : "CM-32L");
 #endif
 	initReverbModels(mt32CompatibleReverb);
+	if (!reportOpenProgress(extensions.asyncOpenJob, 55)) {
+		dispose();
+		return false;
+	}
 
 #if MT32EMU_MONITOR_INIT
 	printDebug("Initialising Timbre Bank A");
 #endif
+	memset(extensions.pendingROMTimbres, 0, sizeof(extensions.pendingROMTimbres));
+	memset(extensions.compressedROMTimbres, 0, sizeof(extensions.compressedROMTimbres));
 	if (!initTimbres(controlROMMap->timbreAMap, controlROMMap->timbreAOffset, 0x40, 0, controlROMMap->timbreACompressed)) {
 		dispose();
 		return false;
 	}
+	if (!reportOpenProgress(extensions.asyncOpenJob, 65)) {
+		dispose();
+		return false;
+	}
 
 #if MT32EMU_MONITOR_INIT
 	printDebug("Initialising Timbre Bank B");
@@ -708,6 +1540,10 @@ bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, B
 		dispose();
 		return false;
 	}
+	if (!reportOpenProgress(extensions.asyncOpenJob, 75)) {
+		dispose();
+		return false;
+	}
 
 #if MT32EMU_MONITOR_INIT
 	printDebug("Initialising Timbre Bank R");
@@ -716,6 +1552,10 @@ bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, B
 		dispose();
 		return false;
 	}
+	if (!reportOpenProgress(extensions.asyncOpenJob, 80)) {
+		dispose();
+		return false;
+	}
 
 #if MT32EMU_MONITOR_INIT
 	printDebug("Initialising Timbre Bank M");
@@ -723,14 +1563,8 @@ bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, B
 	// CM-64 seems to initialise all bytes in this bank to 0.
 	memset(&mt32ram.timbres[128], 0, sizeof(mt32ram.timbres[128]) * 64);
 
-	partialManager = new PartialManager(this, parts);
-
-	pcmWaves = new PCMWaveEntry[controlROMMap->pcmCount];
-
-#if MT32EMU_MONITOR_INIT
-	printDebug("Initialising PCM List");
-#endif
-	initPCMList(controlROMMap->pcmTable, controlROMMap->pcmCount);
+	extensions.partialManagerStorage = extensions.arena.take(PartialManager::getStorageSize(extensions.partialCapacity, getSelectedRendererType()));
+	partialManager = new(extensions.arena.take(sizeof(PartialManager))) PartialManager(this, parts, extensions.partialManagerStorage);
 
 #if MT32EMU_MONITOR_INIT
 	printDebug("Initialising Rhythm Temp");
@@ -776,7 +1610,7 @@ bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, B
 	resetMasterTunePitchDelta();
 	reverbOverridden = oldReverbOverridden;
 
-	char(*writableSoundGroupNames)[9] = new char[controlROMMap->soundGroupsCount][9];
+	char(*writableSoundGroupNames)[9] = reinterpret_cast<char(*)[9]>(extensions.arena.take(controlROMMap->soundGroupsCount * sizeof(*soundGroupNames)));
 	soundGroupNames = writableSoundGroupNames;
 	initSoundGroups(writableSoundGroupNames);
 
@@ -799,25 +1633,38 @@ bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, B
 		patchTemp->dummyv[1] = 127;
 
 		if (i < 8) {
-			parts[i] = new Part(this, i);
+			parts[i] = new(extensions.arena.take(sizeof(Part))) Part(this, i);
 			parts[i]->setProgram(controlROMData[controlROMMap->programSettings + i]);
 		} else {
-			parts[i] = new RhythmPart(this, i);
+			parts[i] = new(extensions.arena.take(sizeof(RhythmPart))) RhythmPart(this, i);
 		}
 	}
 
+	discardPendingMemoryRefresh();
+
 	// For resetting mt32 mid-execution
 	mt32default = mt32ram;
+	memcpy(extensions.defaultPendingROMTimbres, extensions.pendingROMTimbres, sizeof(extensions.defaultPendingROMTimbres));
+	if (!reportOpenProgress(extensions.asyncOpenJob, 85)) {
+		dispose();
+		return false;
+	}
 
-	midiQueue = new MidiEventQueue(extensions.midiEventQueueSize, extensions.midiEventQueueSysexStorageBufferSize);
+	midiQueue = new MidiEventQueue(extensions.midiEventQueueSize, extensions.midiEventQueueSysexStorageBufferSize, extensions.midiEventQueueMultiProducer, extensions.midiEventQueueCoalescingWindow);
 
 	analog = Analog::createAnalog(analogOutputMode, controlROMFeatures->oldMT32AnalogLPF, getSelectedRendererType());
 #if MT32EMU_MONITOR_INIT
 	static const char *ANALOG_OUTPUT_MODES[] = { "Digital only", "Coarse", "Accurate", "Oversampled2x" };
 	printDebug("Using Analog output mode %s", ANALOG_OUTPUT_MODES[analogOutputMode]);
 #endif
-	setOutputGain(outputGain);
-	setReverbOutputGain(reverbOutputGain);
+	latchRealtimeParameters(true);
+
+	if (extensions.reverbPipelineEnabled) {
+		extensions.reverbPipelineThreadPool = ThreadPool::createThreadPool(1);
+		if (extensions.reverbPipelineThreadPool == NULL) {
+			printDebug("Synth: Failed to start reverb pipeline worker thread, reverb will be processed in the rendering thread\n");
+		}
+	}
 
 	switch (getSelectedRendererType()) {
 		case RendererType_BIT16S:
@@ -837,10 +1684,30 @@ bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, B
 			dispose();
 			return false;
 	}
+	if (!reportOpenProgress(extensions.asyncOpenJob, 95)) {
+		dispose();
+		return false;
+	}
+	SIMDDispatch::dispatch();
+#if MT32EMU_MONITOR_INIT
+	printDebug("Using SIMD instruction set: %s", SIMDDispatch::getInstructionSetName(SIMDDispatch::getInstructionSet()));
+	printDebug("Using SIMD instruction set for mixing partials: %s", MixKernels::getInstructionSetName());
+#endif
+
+	extensions.maxMIDIEventTimingError = 0;
 
 	opened = true;
 	activated = false;
 
+	StateWriter sizeCounter(*this, NULL);
+	saveStateContents(sizeCounter);
+	extensions.openStateSize = sizeCounter.getSize();
+	extensions.openState = new Bit8u[extensions.openStateSize];
+	StateWriter stateWriter(*this, extensions.openState);
+	saveStateContents(stateWriter);
+
+	reportOpenProgress(extensions.asyncOpenJob, 100);
+
 #if MT32EMU_MONITOR_INIT
 	printDebug("*** Initialisation complete ***");
 #endif
@@ -850,31 +1717,44 @@ bool Synth::open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, B
 void Synth::dispose() {
 	opened = false;
 
+	stopSessionRecording();
+
+	delete[] extensions.openState;
+	extensions.openState = NULL;
+	extensions.openStateSize = 0;
+
 	delete midiQueue;
 	midiQueue = NULL;
 
 	delete renderer;
 	renderer = NULL;
 
+	delete extensions.partialRenderingThreadPool;
+	extensions.partialRenderingThreadPool = NULL;
+
+	delete extensions.reverbPipelineThreadPool;
+	extensions.reverbPipelineThreadPool = NULL;
+
 	delete analog;
 	analog = NULL;
 
-	delete partialManager;
-	partialManager = NULL;
+	destroyArenaObject(partialManager);
+	extensions.partialManagerStorage = NULL;
 
 	for (int i = 0; i < 9; i++) {
-		delete parts[i];
-		parts[i] = NULL;
+		destroyArenaObject(parts[i]);
 	}
 
-	delete[] soundGroupNames;
 	soundGroupNames = NULL;
 
-	delete[] pcmWaves;
 	pcmWaves = NULL;
-
-	delete[] pcmROMData;
 	pcmROMData = NULL;
+	if (extensions.pcmROMLocked) {
+		extensions.romSet->unlockPCMROMData();
+		extensions.pcmROMLocked = false;
+	}
+	ROMSet::release(extensions.romSet);
+	extensions.romSet = NULL;
 
 	deleteMemoryRegions();
 
@@ -885,15 +1765,29 @@ void Synth::dispose() {
 	reverbModel = NULL;
 	controlROMFeatures = NULL;
 	controlROMMap = NULL;
+
+	extensions.arena.release();
+	extensions.hotMemoryEnabled = false;
+
+	char violation[256];
+	while (RealtimeCheck::takeViolation(violation, sizeof(violation))) {
+		printDebug("Realtime check: %s", violation);
+	}
 }
 
 void Synth::close() {
+	if (extensions.asyncOpenJob != NULL) {
+		cancelOpening();
+		finishOpening();
+	}
 	if (opened) {
 		dispose();
 	}
 }
 
 bool Synth::isOpen() const {
+	// While opening asynchronously, the flag is owned by the worker thread.
+	if (extensions.asyncOpenJob != NULL) return false;
 	return opened;
 }
 
@@ -902,10 +1796,12 @@ void Synth::flushMIDIQueue() {
 	for (;;) {
 		const volatile MidiEventQueue::MidiEvent *midiEvent = midiQueue->peekMidiEvent();
 		if (midiEvent == NULL) break;
+		if (!extensions.sessionHeldEventRecorded) recordMIDIEvent(extensions, midiEvent, renderedSampleCount, true);
+		extensions.sessionHeldEventRecorded = false;
 		if (midiEvent->sysexData == NULL) {
-			playMsgNow(midiEvent->shortMessageData);
+			playDecodedMsgNow(midiEvent->decodedShortMessage);
 		} else {
-			playSysexNow(midiEvent->sysexData, midiEvent->sysexLength);
+			playFramedSysex(midiEvent->sysexData, midiEvent->sysexLength);
 		}
 		midiQueue->dropMidiEvent();
 	}
@@ -929,7 +1825,7 @@ Bit32u Synth::setMIDIEventQueueSize(Bit32u useSize) {
 	if (midiQueue != NULL) {
 		flushMIDIQueue();
 		delete midiQueue;
-		midiQueue = new MidiEventQueue(binarySize, extensions.midiEventQueueSysexStorageBufferSize);
+		midiQueue = new MidiEventQueue(binarySize, extensions.midiEventQueueSysexStorageBufferSize, extensions.midiEventQueueMultiProducer, extensions.midiEventQueueCoalescingWindow);
 	}
 	return binarySize;
 }
@@ -941,8 +1837,55 @@ void Synth::configureMIDIEventQueueSysexStorage(Bit32u storageBufferSize) {
 	if (midiQueue != NULL) {
 		flushMIDIQueue();
 		delete midiQueue;
-		midiQueue = new MidiEventQueue(extensions.midiEventQueueSize, storageBufferSize);
+		midiQueue = new MidiEventQueue(extensions.midiEventQueueSize, storageBufferSize, extensions.midiEventQueueMultiProducer, extensions.midiEventQueueCoalescingWindow);
+	}
+}
+
+void Synth::configureMIDIEventQueueMultiProducer(bool enabled) {
+	if (extensions.midiEventQueueMultiProducer == enabled) return;
+
+	extensions.midiEventQueueMultiProducer = enabled;
+	if (midiQueue != NULL) {
+		flushMIDIQueue();
+		delete midiQueue;
+		midiQueue = new MidiEventQueue(extensions.midiEventQueueSize, extensions.midiEventQueueSysexStorageBufferSize, enabled, extensions.midiEventQueueCoalescingWindow);
+	}
+}
+
+bool Synth::isMIDIEventQueueMultiProducer() const {
+	return extensions.midiEventQueueMultiProducer;
+}
+
+void Synth::configureMIDIEventQueueCoalescing(Bit32u window) {
+	if (extensions.midiEventQueueCoalescingWindow == window) return;
+
+	extensions.midiEventQueueCoalescingWindow = window;
+	if (midiQueue != NULL) {
+		flushMIDIQueue();
+		delete midiQueue;
+		midiQueue = new MidiEventQueue(extensions.midiEventQueueSize, extensions.midiEventQueueSysexStorageBufferSize, extensions.midiEventQueueMultiProducer, window);
+	}
+}
+
+Bit32u Synth::getMIDIEventQueueCoalescingWindow() const {
+	return extensions.midiEventQueueCoalescingWindow;
+}
+
+Bit32u Synth::getMIDIEventQueueFreeCapacity() const {
+	return midiQueue == NULL ? 0 : midiQueue->getFreeCapacity();
+}
+
+bool Synth::waitForMIDIEventQueueFreeCapacity(Bit32u eventCount, Bit32u timeoutMillis) {
+	return midiQueue != NULL && midiQueue->waitForFreeCapacity(eventCount, timeoutMillis);
+}
+
+bool Synth::getMIDIEventQueueStatistics(MIDIEventQueueStatistics &statistics) const {
+	if (midiQueue == NULL) {
+		memset(&statistics, 0, sizeof(statistics));
+		return false;
 	}
+	midiQueue->getStatistics(statistics);
+	return true;
 }
 
 Bit32u Synth::getShortMessageLength(Bit32u msg) {
@@ -990,6 +1933,7 @@ bool Synth::playMsg(Bit32u msg, Bit32u timestamp) {
 	if (midiDelayMode != MIDIDelayMode_IMMEDIATE) {
 		timestamp = addMIDIInterfaceDelay(getShortMessageLength(msg), timestamp);
 	}
+	TraceZone traceZone("MIDI queue push", timestamp);
 	if (!activated) activated = true;
 	do {
 		if (midiQueue->pushShortMessage(msg, timestamp)) return true;
@@ -1006,6 +1950,7 @@ bool Synth::playSysex(const Bit8u *sysex, Bit32u len, Bit32u timestamp) {
 	if (midiDelayMode == MIDIDelayMode_DELAY_ALL) {
 		timestamp = addMIDIInterfaceDelay(len, timestamp);
 	}
+	TraceZone traceZone("MIDI queue push", timestamp);
 	if (!activated) activated = true;
 	do {
 		if (midiQueue->pushSysex(sysex, len, timestamp)) return true;
@@ -1013,30 +1958,173 @@ bool Synth::playSysex(const Bit8u *sysex, Bit32u len, Bit32u timestamp) {
 	return false;
 }
 
+Bit32u Synth::playEvents(const MIDIEvent *events, Bit32u count) {
+	static const Bit32u MAX_BATCH_SIZE = 64;
+
+	if (midiQueue == NULL) return 0;
+	MidiEventQueue::MidiEvent batch[MAX_BATCH_SIZE];
+	Bit32u playedCount = 0;
+	while (playedCount < count) {
+		// The batch is filled with events that follow contiguously, so that the number of events enqueued
+		// can be told when the queue overflows. System realtime messages are reported instantly, as usual,
+		// hence they terminate the batch.
+		Bit32u batchSize = 0;
+		while (batchSize < MAX_BATCH_SIZE && playedCount + batchSize < count) {
+			const MIDIEvent &event = events[playedCount + batchSize];
+			MidiEventQueue::MidiEvent &batchEvent = batch[batchSize];
+			Bit32u timestamp = event.timestamp;
+			if (event.sysexData == NULL) {
+				if ((event.shortMessage & 0xF8) == 0xF8) {
+					if (batchSize > 0) break;
+					reportHandler->onMIDISystemRealtime(Bit8u(event.shortMessage & 0xFF));
+					playedCount++;
+					continue;
+				}
+				if (midiDelayMode != MIDIDelayMode_IMMEDIATE) {
+					timestamp = addMIDIInterfaceDelay(getShortMessageLength(event.shortMessage), timestamp);
+				}
+				batchEvent.sysexData = NULL;
+				batchEvent.shortMessageData = event.shortMessage;
+			} else {
+				if (midiDelayMode == MIDIDelayMode_DELAY_ALL) {
+					timestamp = addMIDIInterfaceDelay(event.sysexLength, timestamp);
+				}
+				batchEvent.sysexData = event.sysexData;
+				batchEvent.sysexLength = event.sysexLength;
+			}
+			batchEvent.timestamp = timestamp;
+			batchSize++;
+		}
+		if (batchSize == 0) continue;
+		// The batch is marked with the timestamp of its first event, that is the earliest onset it contains.
+		TraceZone traceZone("MIDI queue push", batch[0].timestamp);
+		if (!activated) activated = true;
+		Bit32u pushedCount = 0;
+		for (;;) {
+			pushedCount += midiQueue->pushMidiEvents(batch + pushedCount, batchSize - pushedCount);
+			if (pushedCount == batchSize) break;
+			if (!reportHandler->onMIDIQueueOverflow()) return playedCount + pushedCount;
+		}
+		playedCount += batchSize;
+	}
+	return playedCount;
+}
+
+typedef void (*PartMessageHandler)(Part &part, Bit8u data1, Bit8u data2);
+
+static void playNoteOff(Part &part, Bit8u note, Bit8u) {
+	// The MT-32 ignores velocity for note off
+	part.noteOff(note);
+}
+
+static void playNoteOn(Part &part, Bit8u note, Bit8u velocity) {
+	part.noteOn(note, velocity);
+}
+
+static void playModulation(Part &part, Bit8u, Bit8u value) {
+	part.setModulation(value);
+}
+
+static void playDataEntryMSB(Part &part, Bit8u, Bit8u value) {
+	part.setDataEntryMSB(value);
+}
+
+static void playVolume(Part &part, Bit8u, Bit8u value) {
+	part.setVolume(value);
+}
+
+static void playPan(Part &part, Bit8u, Bit8u value) {
+	part.setPan(value);
+}
+
+static void playExpression(Part &part, Bit8u, Bit8u value) {
+	part.setExpression(value);
+}
+
+static void playHoldPedal(Part &part, Bit8u, Bit8u value) {
+	part.setHoldPedal(value >= 64);
+}
+
+static void playNRPN(Part &part, Bit8u, Bit8u) {
+	part.setNRPN();
+}
+
+static void playRPNLSB(Part &part, Bit8u, Bit8u value) {
+	part.setRPNLSB(value);
+}
+
+static void playRPNMSB(Part &part, Bit8u, Bit8u value) {
+	part.setRPNMSB(value);
+}
+
+static void playResetAllControllers(Part &part, Bit8u, Bit8u) {
+	part.resetAllControllers();
+}
+
+static void playAllNotesOff(Part &part, Bit8u, Bit8u) {
+	part.allNotesOff();
+}
+
+static void playModeChange(Part &part, Bit8u, Bit8u) {
+	// CONFIRMED:Mok: A real LAPC-I responds to these controllers as follows:
+	part.setHoldPedal(false);
+	part.allNotesOff();
+}
+
+static void playProgramChange(Part &part, Bit8u program, Bit8u) {
+	part.setProgram(program);
+}
+
+static void playPitchBend(Part &part, Bit8u lsb, Bit8u msb) {
+	part.setBend((msb << 7) | lsb);
+}
+
+// Indexed by MidiEventQueue::ShortMessageOpcode, NULL for the messages that are ignored.
+static const PartMessageHandler PART_MESSAGE_HANDLERS[] = {
+	NULL, // ShortMessageOpcode_UNKNOWN_MESSAGE
+	NULL, // ShortMessageOpcode_UNKNOWN_CONTROL
+	playNoteOff,
+	playNoteOn,
+	playModulation,
+	playDataEntryMSB,
+	playVolume,
+	playPan,
+	playExpression,
+	playHoldPedal,
+	playNRPN,
+	playRPNLSB,
+	playRPNMSB,
+	playResetAllControllers,
+	playAllNotesOff,
+	playModeChange,
+	playProgramChange,
+	playPitchBend
+};
+
 void Synth::playMsgNow(Bit32u msg) {
+	if (opened && extensions.sessionRecorder != NULL) extensions.sessionRecorder->recordShortMessage(renderedSampleCount, msg);
+	playDecodedMsgNow(MidiEventQueue::decodeShortMessage(msg));
+}
+
+void Synth::playDecodedMsgNow(Bit32u decodedMsg) {
 	if (!opened) return;
 
 	// NOTE: Active sense IS implemented in real hardware. However, realtime processing is clearly out of the library scope.
 	//       It is assumed that realtime consumers of the library respond to these MIDI events as appropriate.
 
-	Bit8u code = Bit8u((msg & 0x0000F0) >> 4);
-	Bit8u chan = Bit8u(msg & 0x00000F);
-	Bit8u note = Bit8u((msg & 0x007F00) >> 8);
-	Bit8u velocity = Bit8u((msg & 0x7F0000) >> 16);
-
-	//printDebug("Playing chan %d, code 0x%01x note: 0x%02x", chan, code, note);
+	const Bit8u chan = MidiEventQueue::getShortMessageChannel(decodedMsg);
 
 	Bit8u *chanParts = extensions.chantable[chan];
 	if (*chanParts > 8) {
 #if MT32EMU_MONITOR_MIDI > 0
-		printDebug("Play msg on unreg chan %d (%d): code=0x%01x, vel=%d", chan, *chanParts, code, velocity);
+		printDebug("Play msg on unreg chan %d (%d): opcode=%d, vel=%d", chan, *chanParts, MidiEventQueue::getShortMessageOpcode(decodedMsg), MidiEventQueue::getShortMessageData2(decodedMsg));
 #endif
 		return;
 	}
 	for (Bit32u i = extensions.abortingPartIx; i <= 8; i++) {
 		const Bit32u partNum = chanParts[i];
 		if (partNum > 8) break;
-		playMsgOnPart(partNum, code, note, velocity);
+		playDecodedMsgOnPart(Bit8u(partNum), decodedMsg);
 		if (isAbortingPoly()) {
 			extensions.abortingPartIx = i;
 			break;
@@ -1047,110 +2135,36 @@ void Synth::playMsgNow(Bit32u msg) {
 }
 
 void Synth::playMsgOnPart(Bit8u part, Bit8u code, Bit8u note, Bit8u velocity) {
-	if (!opened) return;
+	playDecodedMsgOnPart(part, MidiEventQueue::decodeShortMessage((code << 4) | (note << 8) | (velocity << 16)));
+}
 
-	Bit32u bend;
+void Synth::playDecodedMsgOnPart(Bit8u part, Bit32u decodedMsg) {
+	if (!opened) return;
+	applyPendingMemoryRefresh();
 
 	if (!activated) activated = true;
-	//printDebug("Synth::playMsgOnPart(%02x, %02x, %02x, %02x)", part, code, note, velocity);
-	switch (code) {
-	case 0x8:
-		//printDebug("Note OFF - Part %d", part);
-		// The MT-32 ignores velocity for note off
-		parts[part]->noteOff(note);
-		break;
-	case 0x9:
-		//printDebug("Note ON - Part %d, Note %d Vel %d", part, note, velocity);
-		if (velocity == 0) {
-			// MIDI defines note-on with velocity 0 as being the same as note-off with velocity 40
-			parts[part]->noteOff(note);
-		} else {
-			parts[part]->noteOn(note, velocity);
-		}
-		break;
-	case 0xB: // Control change
-		switch (note) {
-		case 0x01:  // Modulation
-			//printDebug("Modulation: %d", velocity);
-			parts[part]->setModulation(velocity);
-			break;
-		case 0x06:
-			parts[part]->setDataEntryMSB(velocity);
-			break;
-		case 0x07:  // Set volume
-			//printDebug("Volume set: %d", velocity);
-			parts[part]->setVolume(velocity);
-			break;
-		case 0x0A:  // Pan
-			//printDebug("Pan set: %d", velocity);
-			parts[part]->setPan(velocity);
-			break;
-		case 0x0B:
-			//printDebug("Expression set: %d", velocity);
-			parts[part]->setExpression(velocity);
-			break;
-		case 0x40: // Hold (sustain) pedal
-			//printDebug("Hold pedal set: %d", velocity);
-			parts[part]->setHoldPedal(velocity >= 64);
-			break;
-
-		case 0x62:
-		case 0x63:
-			parts[part]->setNRPN();
-			break;
-		case 0x64:
-			parts[part]->setRPNLSB(velocity);
-			break;
-		case 0x65:
-			parts[part]->setRPNMSB(velocity);
-			break;
-
-		case 0x79: // Reset all controllers
-			//printDebug("Reset all controllers");
-			parts[part]->resetAllControllers();
-			break;
-
-		case 0x7B: // All notes off
-			//printDebug("All notes off");
-			parts[part]->allNotesOff();
-			break;
-
-		case 0x7C:
-		case 0x7D:
-		case 0x7E:
-		case 0x7F:
-			// CONFIRMED:Mok: A real LAPC-I responds to these controllers as follows:
-			parts[part]->setHoldPedal(false);
-			parts[part]->allNotesOff();
-			break;
-
-		default:
+	const MidiEventQueue::ShortMessageOpcode opcode = MidiEventQueue::getShortMessageOpcode(decodedMsg);
+	const PartMessageHandler handler = PART_MESSAGE_HANDLERS[opcode];
+	if (handler == NULL) {
 #if MT32EMU_MONITOR_MIDI > 0
-			printDebug("Unknown MIDI Control code: 0x%02x - vel 0x%02x", note, velocity);
-#endif
-			return;
+		if (opcode == MidiEventQueue::ShortMessageOpcode_UNKNOWN_CONTROL) {
+			printDebug("Unknown MIDI Control code: 0x%02x - vel 0x%02x", MidiEventQueue::getShortMessageData1(decodedMsg), MidiEventQueue::getShortMessageData2(decodedMsg));
+		} else {
+			printDebug("Unknown Midi message - %02x - %02x", MidiEventQueue::getShortMessageData1(decodedMsg), MidiEventQueue::getShortMessageData2(decodedMsg));
 		}
-
-		break;
-	case 0xC: // Program change
-		//printDebug("Program change %01x", note);
-		parts[part]->setProgram(note);
-		break;
-	case 0xE: // Pitch bender
-		bend = (velocity << 7) | (note);
-		//printDebug("Pitch bender %02x", bend);
-		parts[part]->setBend(bend);
-		break;
-	default:
-#if MT32EMU_MONITOR_MIDI > 0
-		printDebug("Unknown Midi code: 0x%01x - %02x - %02x", code, note, velocity);
 #endif
 		return;
 	}
+	handler(*parts[part], MidiEventQueue::getShortMessageData1(decodedMsg), MidiEventQueue::getShortMessageData2(decodedMsg));
 	reportHandler->onMIDIMessagePlayed();
 }
 
 void Synth::playSysexNow(const Bit8u *sysex, Bit32u len) {
+	if (opened && extensions.sessionRecorder != NULL) extensions.sessionRecorder->recordSysex(renderedSampleCount, sysex, len);
+	playFramedSysex(sysex, len);
+}
+
+void Synth::playFramedSysex(const Bit8u *sysex, Bit32u len) {
 	if (len < 2) {
 		printDebug("playSysex: Message is too short for sysex (%d bytes)", len);
 	}
@@ -1371,7 +2385,7 @@ void Synth::initMemoryRegions() {
 	// Timbre max tables are slightly more complicated than the others, which are used directly from the ROM.
 	// The ROM (sensibly) just has maximums for TimbreParam.commonParam followed by just one TimbreParam.partialParam,
 	// so we produce a table with all partialParams filled out, as well as padding for PaddedTimbre, for quick lookup.
-	paddedTimbreMaxTable = new Bit8u[sizeof(MemParams::PaddedTimbre)];
+	paddedTimbreMaxTable = extensions.arena.take(sizeof(MemParams::PaddedTimbre));
 	memcpy(&paddedTimbreMaxTable[0], &controlROMData[controlROMMap->timbreMaxTable], sizeof(TimbreParam::CommonParam) + sizeof(TimbreParam::PartialParam)); // commonParam and one partialParam
 	int pos = sizeof(TimbreParam::CommonParam) + sizeof(TimbreParam::PartialParam);
 	for (int i = 0; i < 3; i++) {
@@ -1379,35 +2393,26 @@ void Synth::initMemoryRegions() {
 		pos += sizeof(TimbreParam::PartialParam);
 	}
 	memset(&paddedTimbreMaxTable[pos], 0, 10); // Padding
-	patchTempMemoryRegion = new PatchTempMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.patchTemp[0]), &controlROMData[controlROMMap->patchMaxTable]);
-	rhythmTempMemoryRegion = new RhythmTempMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.rhythmTemp[0]), &controlROMData[controlROMMap->rhythmMaxTable]);
-	timbreTempMemoryRegion = new TimbreTempMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.timbreTemp[0]), paddedTimbreMaxTable);
-	patchesMemoryRegion = new PatchesMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.patches[0]), &controlROMData[controlROMMap->patchMaxTable]);
-	timbresMemoryRegion = new TimbresMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.timbres[0]), paddedTimbreMaxTable);
-	systemMemoryRegion = new SystemMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.system), &controlROMData[controlROMMap->systemMaxTable]);
-	displayMemoryRegion = new DisplayMemoryRegion(this);
-	resetMemoryRegion = new ResetMemoryRegion(this);
+	patchTempMemoryRegion = new(extensions.arena.take(sizeof(PatchTempMemoryRegion))) PatchTempMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.patchTemp[0]), &controlROMData[controlROMMap->patchMaxTable]);
+	rhythmTempMemoryRegion = new(extensions.arena.take(sizeof(RhythmTempMemoryRegion))) RhythmTempMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.rhythmTemp[0]), &controlROMData[controlROMMap->rhythmMaxTable]);
+	timbreTempMemoryRegion = new(extensions.arena.take(sizeof(TimbreTempMemoryRegion))) TimbreTempMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.timbreTemp[0]), paddedTimbreMaxTable);
+	patchesMemoryRegion = new(extensions.arena.take(sizeof(PatchesMemoryRegion))) PatchesMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.patches[0]), &controlROMData[controlROMMap->patchMaxTable]);
+	timbresMemoryRegion = new(extensions.arena.take(sizeof(TimbresMemoryRegion))) TimbresMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.timbres[0]), paddedTimbreMaxTable);
+	systemMemoryRegion = new(extensions.arena.take(sizeof(SystemMemoryRegion))) SystemMemoryRegion(this, reinterpret_cast<Bit8u *>(&mt32ram.system), &controlROMData[controlROMMap->systemMaxTable]);
+	displayMemoryRegion = new(extensions.arena.take(sizeof(DisplayMemoryRegion))) DisplayMemoryRegion(this);
+	resetMemoryRegion = new(extensions.arena.take(sizeof(ResetMemoryRegion))) ResetMemoryRegion(this);
 }
 
 void Synth::deleteMemoryRegions() {
-	delete patchTempMemoryRegion;
-	patchTempMemoryRegion = NULL;
-	delete rhythmTempMemoryRegion;
-	rhythmTempMemoryRegion = NULL;
-	delete timbreTempMemoryRegion;
-	timbreTempMemoryRegion = NULL;
-	delete patchesMemoryRegion;
-	patchesMemoryRegion = NULL;
-	delete timbresMemoryRegion;
-	timbresMemoryRegion = NULL;
-	delete systemMemoryRegion;
-	systemMemoryRegion = NULL;
-	delete displayMemoryRegion;
-	displayMemoryRegion = NULL;
-	delete resetMemoryRegion;
-	resetMemoryRegion = NULL;
+	destroyArenaObject(patchTempMemoryRegion);
+	destroyArenaObject(rhythmTempMemoryRegion);
+	destroyArenaObject(timbreTempMemoryRegion);
+	destroyArenaObject(patchesMemoryRegion);
+	destroyArenaObject(timbresMemoryRegion);
+	destroyArenaObject(systemMemoryRegion);
+	destroyArenaObject(displayMemoryRegion);
+	destroyArenaObject(resetMemoryRegion);
 
-	delete[] paddedTimbreMaxTable;
 	paddedTimbreMaxTable = NULL;
 }
 
@@ -1439,6 +2444,10 @@ void Synth::readMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u len
 
 	unsigned int m;
 
+	if (region->type == MR_Timbres) {
+		loadROMTimbres(first, region->lastTouched(addr, len));
+	}
+
 	if (region->isReadable()) {
 		region->read(first, off, data, len);
 	} else {
@@ -1464,7 +2473,7 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 		for (unsigned int i = first; i <= last; i++) {
 			int absTimbreNum = mt32ram.patchTemp[i].patch.timbreGroup * 64 + mt32ram.patchTemp[i].patch.timbreNum;
 			char timbreName[11];
-			memcpy(timbreName, mt32ram.timbres[absTimbreNum].timbre.common.name, 10);
+			memcpy(timbreName, getTimbre(absTimbreNum)->common.name, 10);
 			timbreName[10] = 0;
 #if MT32EMU_MONITOR_SYSEX > 0
 			printDebug("WRITE-PARTPATCH (%d-%d@%d..%d): %d; timbre=%d (%s), outlevel=%d", first, last, off, off + len, i, absTimbreNum, timbreName, mt32ram.patchTemp[i].outputLevel);
@@ -1478,10 +2487,10 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 						printDebug(" (Not updating timbre, since those values weren't touched)");
 #endif
 					} else {
-						parts[i]->setTimbre(&mt32ram.timbres[parts[i]->getAbsTimbreNum()].timbre);
+						parts[i]->setTimbre(getTimbre(parts[i]->getAbsTimbreNum()));
 					}
 				}
-				parts[i]->refresh();
+				deferMemoryRefresh().patchTempParts |= 1 << i;
 			}
 		}
 		break;
@@ -1491,7 +2500,7 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 			int timbreNum = mt32ram.rhythmTemp[i].timbre;
 			char timbreName[11];
 			if (timbreNum < 94) {
-				memcpy(timbreName, mt32ram.timbres[128 + timbreNum].timbre.common.name, 10);
+				memcpy(timbreName, getTimbre(128 + timbreNum)->common.name, 10);
 				timbreName[10] = 0;
 			} else {
 				strcpy(timbreName, "[None]");
@@ -1500,8 +2509,16 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 			printDebug("WRITE-RHYTHM (%d-%d@%d..%d): %d; level=%02x, panpot=%02x, reverb=%02x, timbre=%d (%s)", first, last, off, off + len, i, mt32ram.rhythmTemp[i].outputLevel, mt32ram.rhythmTemp[i].panpot, mt32ram.rhythmTemp[i].reverbSwitch, mt32ram.rhythmTemp[i].timbre, timbreName);
 #endif
 		}
-		if (parts[8] != NULL) {
-			parts[8]->refresh();
+		// Only the drums touched need refreshing, which matters when the rhythm setup is uploaded in small pieces
+		{
+			MemoryRefreshBatch &batch = deferMemoryRefresh();
+			if (batch.firstDrum > batch.lastDrum) {
+				batch.firstDrum = first;
+				batch.lastDrum = last;
+			} else {
+				if (batch.firstDrum > first) batch.firstDrum = first;
+				if (batch.lastDrum < last) batch.lastDrum = last;
+			}
 		}
 		break;
 	case MR_TimbreTemp:
@@ -1513,9 +2530,7 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 #if MT32EMU_MONITOR_SYSEX > 0
 			printDebug("WRITE-PARTTIMBRE (%d-%d@%d..%d): timbre=%d (%s)", first, last, off, off + len, i, instrumentName);
 #endif
-			if (parts[i] != NULL) {
-				parts[i]->refresh();
-			}
+			deferMemoryRefresh().timbreTempParts |= 1 << i;
 		}
 		break;
 	case MR_Patches:
@@ -1525,7 +2540,7 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 			PatchParam *patch = &mt32ram.patches[i];
 			int patchAbsTimbreNum = patch->timbreGroup * 64 + patch->timbreNum;
 			char instrumentName[11];
-			memcpy(instrumentName, mt32ram.timbres[patchAbsTimbreNum].timbre.common.name, 10);
+			memcpy(instrumentName, getTimbre(patchAbsTimbreNum)->common.name, 10);
 			instrumentName[10] = 0;
 			Bit8u *n = reinterpret_cast<Bit8u *>(patch);
 			printDebug("WRITE-PATCH (%d-%d@%d..%d): %d; timbre=%d (%s) %02X%02X%02X%02X%02X%02X%02X%02X", first, last, off, off + len, i, patchAbsTimbreNum, instrumentName, n[0], n[1], n[2], n[3], n[4], n[5], n[6], n[7]);
@@ -1536,6 +2551,8 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 		// Timbres
 		first += 128;
 		last += 128;
+		// A partially written ROM timbre mustn't be decompressed over later
+		loadROMTimbres(first, last);
 		region->write(first, off, data, len);
 		for (unsigned int i = first; i <= last; i++) {
 #if MT32EMU_MONITOR_TIMBRES >= 1
@@ -1619,48 +2636,19 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 #undef DT
 #endif
 #endif
-			// FIXME:KG: Not sure if the stuff below should be done (for rhythm and/or parts)...
-			// Does the real MT-32 automatically do this?
-			for (unsigned int part = 0; part < 9; part++) {
-				if (parts[part] != NULL) {
-					parts[part]->refreshTimbre(i);
-				}
-			}
+			deferMemoryRefresh().timbres[i >> 5] |= 1u << (i & 31);
 		}
 		break;
 	case MR_System:
 		region->write(0, off, data, len);
-
-		reportHandler->onDeviceReconfig();
-		// FIXME: We haven't properly confirmed any of this behaviour
-		// In particular, we tend to reset things such as reverb even if the write contained
-		// the same parameters as were already set, which may be wrong.
-		// On the other hand, the real thing could be resetting things even when they aren't touched
-		// by the write at all.
-#if MT32EMU_MONITOR_SYSEX > 0
-		printDebug("WRITE-SYSTEM:");
-#endif
-		if (off <= SYSTEM_MASTER_TUNE_OFF && off + len > SYSTEM_MASTER_TUNE_OFF) {
-			refreshSystemMasterTune();
-		}
-		if (off <= SYSTEM_REVERB_LEVEL_OFF && off + len > SYSTEM_REVERB_MODE_OFF) {
-			refreshSystemReverbParameters();
-		}
-		if (off <= SYSTEM_RESERVE_SETTINGS_END_OFF && off + len > SYSTEM_RESERVE_SETTINGS_START_OFF) {
-			refreshSystemReserveSettings();
-		}
-		if (off <= SYSTEM_CHAN_ASSIGN_END_OFF && off + len > SYSTEM_CHAN_ASSIGN_START_OFF) {
-			int firstPart = off - SYSTEM_CHAN_ASSIGN_START_OFF;
-			if(firstPart < 0)
-				firstPart = 0;
-			int lastPart = off + len - SYSTEM_CHAN_ASSIGN_START_OFF;
-			if(lastPart > 8)
-				lastPart = 8;
-			refreshSystemChanAssign(Bit8u(firstPart), Bit8u(lastPart));
-		}
-		if (off <= SYSTEM_MASTER_VOL_OFF && off + len > SYSTEM_MASTER_VOL_OFF) {
-			refreshSystemMasterVol();
+		if (extensions.memoryRefreshBatch != NULL) {
+			MemoryRefreshBatch &batch = *extensions.memoryRefreshBatch;
+			if (batch.systemEndOff == 0 || batch.systemStartOff > off) batch.systemStartOff = off;
+			if (batch.systemEndOff < off + len) batch.systemEndOff = off + len;
+			break;
 		}
+		reportHandler->onDeviceReconfig();
+		refreshSystemArea(off, len);
 		break;
 	case MR_Display:
 		char buf[SYSEX_BUFFER_SIZE];
@@ -1677,42 +2665,172 @@ void Synth::writeMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u le
 	}
 }
 
-void Synth::refreshSystemMasterTune() {
-	// 171 is ~half a semitone.
-	extensions.masterTunePitchDelta = ((mt32ram.system.masterTune - 64) * 171) >> 6; // PORTABILITY NOTE: Assumes arithmetic shift.
+// Refreshes the system settings affected by a write of len bytes at offset off of the system area.
+void Synth::refreshSystemArea(Bit32u off, Bit32u len) {
+	// FIXME: We haven't properly confirmed any of this behaviour
+	// In particular, we tend to reset things such as reverb even if the write contained
+	// the same parameters as were already set, which may be wrong.
+	// On the other hand, the real thing could be resetting things even when they aren't touched
+	// by the write at all.
 #if MT32EMU_MONITOR_SYSEX > 0
-	//FIXME:KG: This is just an educated guess.
-	// The LAPC-I documentation claims a range of 427.5Hz-452.6Hz (similar to what we have here)
-	// The MT-32 documentation claims a range of 432.1Hz-457.6Hz
-	float masterTune = 440.0f * EXP2F((mt32ram.system.masterTune - 64.0f) / (128.0f * 12.0f));
-	printDebug(" Master Tune: %f", masterTune);
+	printDebug("WRITE-SYSTEM:");
 #endif
+	if (off <= SYSTEM_MASTER_TUNE_OFF && off + len > SYSTEM_MASTER_TUNE_OFF) {
+		refreshSystemMasterTune();
+	}
+	if (off <= SYSTEM_REVERB_LEVEL_OFF && off + len > SYSTEM_REVERB_MODE_OFF) {
+		refreshSystemReverbParameters();
+	}
+	if (off <= SYSTEM_RESERVE_SETTINGS_END_OFF && off + len > SYSTEM_RESERVE_SETTINGS_START_OFF) {
+		refreshSystemReserveSettings();
+	}
+	if (off <= SYSTEM_CHAN_ASSIGN_END_OFF && off + len > SYSTEM_CHAN_ASSIGN_START_OFF) {
+		int firstPart = off - SYSTEM_CHAN_ASSIGN_START_OFF;
+		if(firstPart < 0)
+			firstPart = 0;
+		int lastPart = off + len - SYSTEM_CHAN_ASSIGN_START_OFF;
+		if(lastPart > 8)
+			lastPart = 8;
+		refreshSystemChanAssign(Bit8u(firstPart), Bit8u(lastPart));
+	}
+	if (off <= SYSTEM_MASTER_VOL_OFF && off + len > SYSTEM_MASTER_VOL_OFF) {
+		refreshSystemMasterVol();
+	}
 }
 
-void Synth::refreshSystemReverbParameters() {
-#if MT32EMU_MONITOR_SYSEX > 0
-	printDebug(" Reverb: mode=%d, time=%d, level=%d", mt32ram.system.reverbMode, mt32ram.system.reverbTime, mt32ram.system.reverbLevel);
-#endif
-	if (reverbOverridden) {
-#if MT32EMU_MONITOR_SYSEX > 0
-		printDebug(" (Reverb overridden - ignoring)");
-#endif
-		return;
-	}
-	reportHandler->onNewReverbMode(mt32ram.system.reverbMode);
-	reportHandler->onNewReverbTime(mt32ram.system.reverbTime);
+void Synth::beginMemoryRefreshBatch(MemoryRefreshBatch &batch) {
+	clearMemoryRefreshBatch(batch);
+	extensions.memoryRefreshBatch = &batch;
+}
+
+void Synth::endMemoryRefreshBatch() {
+	const MemoryRefreshBatch &batch = *extensions.memoryRefreshBatch;
+	extensions.memoryRefreshBatch = NULL;
+	applyMemoryRefreshBatch(batch);
+}
+
+// Returns the batch the refreshes due after a write to the patch, timbre or rhythm areas are to be recorded in.
+MemoryRefreshBatch &Synth::deferMemoryRefresh() {
+	if (extensions.memoryRefreshBatch != NULL) return *extensions.memoryRefreshBatch;
+	extensions.memoryRefreshPending = true;
+	return extensions.pendingMemoryRefresh;
+}
+
+// Carries out the refreshes deferred since the last call. Invoked before anything that depends on the refreshed state,
+// i.e. playing a MIDI message on a part, rendering and saving the state.
+void Synth::applyPendingMemoryRefresh() {
+	if (!extensions.memoryRefreshPending) return;
+	extensions.memoryRefreshPending = false;
+	applyMemoryRefreshBatch(extensions.pendingMemoryRefresh);
+	clearMemoryRefreshBatch(extensions.pendingMemoryRefresh);
+}
+
+// Drops the refreshes deferred since the last call, when all the parts are refreshed anyway.
+void Synth::discardPendingMemoryRefresh() {
+	extensions.memoryRefreshPending = false;
+	clearMemoryRefreshBatch(extensions.pendingMemoryRefresh);
+}
+
+// Carries out the refreshes collected in the batch. The system settings go first, as the channel assignment and
+// the partial reserve are independent of the parts, then the memory timbres, so that the parts are refreshed last.
+void Synth::applyMemoryRefreshBatch(const MemoryRefreshBatch &batch) {
+	if (batch.systemEndOff != 0) {
+		reportHandler->onDeviceReconfig();
+		refreshSystemArea(batch.systemStartOff, batch.systemEndOff - batch.systemStartOff);
+	}
+	for (unsigned int absTimbreNum = 0; absTimbreNum < 256; absTimbreNum++) {
+		if ((batch.timbres[absTimbreNum >> 5] & (1u << (absTimbreNum & 31))) == 0) continue;
+		// FIXME:KG: Not sure if the stuff below should be done (for rhythm and/or parts)...
+		// Does the real MT-32 automatically do this?
+		for (unsigned int part = 0; part < 9; part++) {
+			if (parts[part] != NULL) {
+				parts[part]->refreshTimbre(absTimbreNum);
+			}
+		}
+	}
+	for (unsigned int part = 0; part < 9; part++) {
+		if (parts[part] == NULL) continue;
+		if (batch.patchTempParts & (1 << part)) parts[part]->refresh();
+		if (batch.timbreTempParts & (1 << part)) parts[part]->refreshTimbreTemp();
+	}
+	if (batch.firstDrum <= batch.lastDrum && parts[8] != NULL) {
+		static_cast<RhythmPart *>(parts[8])->refreshDrums(batch.firstDrum, batch.lastDrum);
+	}
+}
+
+Bit32u Synth::loadSysexBank(const Bit8u *data, Bit32u len) {
+	if (!opened) return 0;
+	MemoryRefreshBatch batch;
+	beginMemoryRefreshBatch(batch);
+	Bit32u messageCount = 0;
+	Bit32u pos = 0;
+	while (pos < len) {
+		if (data[pos] != 0xF0) {
+			pos++;
+			continue;
+		}
+		Bit32u endPos = pos + 1;
+		while (endPos < len && data[endPos] != 0xF7 && data[endPos] != 0xF0) {
+			endPos++;
+		}
+		if (endPos == len || data[endPos] == 0xF0) {
+			printDebug("loadSysexBank: Skipping message lacking end-of-sysex (0xF7) at offset %d", pos);
+			pos = endPos;
+			continue;
+		}
+		playSysexWithoutFraming(data + pos + 1, endPos - pos - 1);
+		messageCount++;
+		pos = endPos + 1;
+	}
+	endMemoryRefreshBatch();
+	return messageCount;
+}
+
+void Synth::writeMemory(Bit32u addr, Bit32u len, const Bit8u *data) {
+	if (!opened) return;
+	MemoryRefreshBatch batch;
+	beginMemoryRefreshBatch(batch);
+	writeSysexGlobal(addr, data, len);
+	endMemoryRefreshBatch();
+}
+
+void Synth::refreshSystemMasterTune() {
+	// 171 is ~half a semitone.
+	extensions.masterTunePitchDelta = ((mt32ram.system.masterTune - 64) * 171) >> 6; // PORTABILITY NOTE: Assumes arithmetic shift.
+#if MT32EMU_MONITOR_SYSEX > 0
+	//FIXME:KG: This is just an educated guess.
+	// The LAPC-I documentation claims a range of 427.5Hz-452.6Hz (similar to what we have here)
+	// The MT-32 documentation claims a range of 432.1Hz-457.6Hz
+	float masterTune = 440.0f * EXP2F((mt32ram.system.masterTune - 64.0f) / (128.0f * 12.0f));
+	printDebug(" Master Tune: %f", masterTune);
+#endif
+}
+
+void Synth::refreshSystemReverbParameters() {
+#if MT32EMU_MONITOR_SYSEX > 0
+	printDebug(" Reverb: mode=%d, time=%d, level=%d", mt32ram.system.reverbMode, mt32ram.system.reverbTime, mt32ram.system.reverbLevel);
+#endif
+	if (reverbOverridden) {
+#if MT32EMU_MONITOR_SYSEX > 0
+		printDebug(" (Reverb overridden - ignoring)");
+#endif
+		return;
+	}
+	reportHandler->onNewReverbMode(mt32ram.system.reverbMode);
+	reportHandler->onNewReverbTime(mt32ram.system.reverbTime);
 	reportHandler->onNewReverbLevel(mt32ram.system.reverbLevel);
 
+	flushReverbPipeline();
 	BReverbModel *oldReverbModel = reverbModel;
 	if (mt32ram.system.reverbTime == 0 && mt32ram.system.reverbLevel == 0) {
 		// Setting both time and level to 0 effectively disables wet reverb output on real devices.
 		// Take a shortcut in this case to reduce CPU load.
 		reverbModel = NULL;
 	} else {
-		reverbModel = reverbModels[mt32ram.system.reverbMode];
+		reverbModel = getReverbModel(mt32ram.system.reverbMode);
 	}
 	if (reverbModel != oldReverbModel) {
-		if (extensions.preallocatedReverbMemory) {
+		if (isReverbMemoryPreallocated(extensions)) {
 			if (isReverbEnabled()) {
 				reverbModel->mute();
 			}
@@ -1787,7 +2905,9 @@ void Synth::reset() {
 #endif
 	reportHandler->onDeviceReset();
 	partialManager->deactivateAll();
+	discardPendingMemoryRefresh();
 	mt32ram = mt32default;
+	resetPendingROMTimbres();
 	for (int i = 0; i < 9; i++) {
 		parts[i]->reset();
 		if (i != 8) {
@@ -1816,28 +2936,196 @@ Bit32s Synth::getMasterTunePitchDelta() const {
 	return extensions.masterTunePitchDelta;
 }
 
+bool Synth::startSessionRecording(const char *filename) {
+	stopSessionRecording();
+	if (!opened) return false;
+	const size_t stateSize = saveState(NULL, 0);
+	Bit8u *state = new Bit8u[stateSize];
+	saveState(state, stateSize);
+	SessionConfig config;
+	config.rendererType = getSelectedRendererType();
+	config.analogOutputMode = analog->getMode();
+	config.partialCount = getPartialCount();
+	config.maxPartialCount = getMaxPartialCount();
+	config.partialRenderingThreadCount = getPartialRenderingThreadCount();
+	config.reverbPipelineEnabled = isReverbPipelineEnabled();
+	config.floatWaveAccuracy = getFloatWaveAccuracy();
+	extensions.sessionRecorder = SessionRecorder::create(filename, config, state, stateSize);
+	delete[] state;
+	if (extensions.sessionRecorder == NULL) {
+		printDebug("Synth: Unable to create session recording %s\n", filename);
+		return false;
+	}
+	// The pending events are restored along with the state when replaying.
+	extensions.sessionSkippedEventCount = 0;
+	while (midiQueue->peekMidiEvent(extensions.sessionSkippedEventCount) != NULL) {
+		extensions.sessionSkippedEventCount++;
+	}
+	extensions.sessionHeldEventRecorded = false;
+	return true;
+}
+
+void Synth::stopSessionRecording() {
+	delete extensions.sessionRecorder;
+	extensions.sessionRecorder = NULL;
+}
+
+bool Synth::isSessionRecording() const {
+	return extensions.sessionRecorder != NULL;
+}
+
 /** Defines an interface of a class that maintains storage of variable-sized data of SysEx messages. */
 class MidiEventQueue::SysexDataStorage {
 public:
-	static MidiEventQueue::SysexDataStorage *create(Bit32u storageBufferSize);
+	static MidiEventQueue::SysexDataStorage *create(Bit32u storageBufferSize, Bit32u slotCount, bool multiProducer);
 
 	virtual ~SysexDataStorage() {}
-	virtual Bit8u *allocate(Bit32u sysexLength) = 0;
+	// Allocates space for the SysEx data of an event to be stored in the specified slot of the ring buffer.
+	virtual Bit8u *allocate(Bit32u slotIx, Bit32u sysexLength) = 0;
 	virtual void reclaimUnused(const Bit8u *sysexData, Bit32u sysexLength) = 0;
-	virtual void dispose(const Bit8u *sysexData, Bit32u sysexLength) = 0;
+	// Invoked when the specified slot of the ring buffer is reused for a short message.
+	virtual void releaseSlot(Bit32u slotIx) = 0;
+	virtual size_t getAllocatedMemorySize() const = 0;
+	virtual size_t getSysexBufferMemorySize() const = 0;
+	// Return the number of bytes of the preallocated storage buffer occupied by the pending SysEx data,
+	// and the maximum number occupied so far.
+	virtual Bit32u getStorageBufferUsage() const = 0;
+	virtual Bit32u getStorageBufferHighWaterMark() const = 0;
+	virtual void resetStorageBufferHighWaterMark() = 0;
 };
 
-/** Storage space for SysEx data is allocated dynamically on demand and is disposed lazily. */
+/**
+ * Storage space for SysEx data is allocated dynamically on demand. Each slot of the ring buffer retains its buffer
+ * for the subsequent SysEx events, so that no allocation happens once the buffers have grown to fit the typical
+ * messages, e.g. when a bulk dump is received. Since a slot is only accessed by the producer that has reserved it,
+ * this is also safe in the multi-producer mode.
+ * With a single producer, the buffers sized up to MAX_POOLED_BUFFER_SIZE additionally belong to power-of-two size
+ * classes. A buffer released by a slot, that is reused for a message of another size or a short message, is put
+ * to the free list of its class and handed out to the next slot that needs one. Both happen on the producing thread,
+ * while the rendering thread never releases any data, hence the free lists need no synchronisation, and neither
+ * thread touches the global heap in the steady state. Up to MAX_POOLED_BYTES are kept in the free lists.
+ */
 class DynamicSysexDataStorage : public MidiEventQueue::SysexDataStorage {
 public:
-	Bit8u *allocate(Bit32u sysexLength) {
-		return new Bit8u[sysexLength];
+	DynamicSysexDataStorage(Bit32u useSlotCount, bool usePool) :
+		slotBuffers(new SlotBuffer[useSlotCount]),
+		slotCount(useSlotCount),
+		pooled(usePool),
+		pooledBytes()
+	{
+		for (Bit32u i = 0; i < slotCount; i++) {
+			slotBuffers[i].data = NULL;
+			slotBuffers[i].capacity = 0;
+		}
+		for (Bit32u i = 0; i < SIZE_CLASS_COUNT; i++) {
+			freeLists[i] = NULL;
+		}
+	}
+
+	~DynamicSysexDataStorage() {
+		for (Bit32u i = 0; i < slotCount; i++) {
+			delete[] slotBuffers[i].data;
+		}
+		delete[] slotBuffers;
+		for (Bit32u i = 0; i < SIZE_CLASS_COUNT; i++) {
+			while (freeLists[i] != NULL) {
+				delete[] popFreeBuffer(i);
+			}
+		}
+	}
+
+	Bit8u *allocate(Bit32u slotIx, Bit32u sysexLength) {
+		SlotBuffer &slotBuffer = slotBuffers[slotIx];
+		if (slotBuffer.capacity >= sysexLength && slotBuffer.capacity <= MAX_POOLED_BUFFER_SIZE) {
+			// The pool rather keeps the buffers of the exact size class, so that the larger ones remain available.
+			if (!pooled || getSizeClass(sysexLength) == getSizeClass(slotBuffer.capacity)) return slotBuffer.data;
+		}
+		releaseBuffer(slotBuffer);
+		Bit32u sizeClass = getSizeClass(sysexLength);
+		if (sizeClass < SIZE_CLASS_COUNT) {
+			slotBuffer.capacity = MIN_BUFFER_SIZE << sizeClass;
+			slotBuffer.data = (pooled && freeLists[sizeClass] != NULL) ? popFreeBuffer(sizeClass) : new Bit8u[slotBuffer.capacity];
+		} else {
+			slotBuffer.capacity = sysexLength;
+			slotBuffer.data = new Bit8u[sysexLength];
+		}
+		return slotBuffer.data;
 	}
 
 	void reclaimUnused(const Bit8u *, Bit32u) {}
 
-	void dispose(const Bit8u *sysexData, Bit32u) {
-		delete[] sysexData;
+	void releaseSlot(Bit32u slotIx) {
+		SlotBuffer &slotBuffer = slotBuffers[slotIx];
+		if (pooled || slotBuffer.capacity > MAX_POOLED_BUFFER_SIZE) releaseBuffer(slotBuffer);
+	}
+
+	size_t getAllocatedMemorySize() const {
+		return sizeof(*this) + slotCount * sizeof(SlotBuffer);
+	}
+
+	size_t getSysexBufferMemorySize() const {
+		size_t size = pooledBytes;
+		for (Bit32u i = 0; i < slotCount; i++) {
+			size += slotBuffers[i].capacity;
+		}
+		return size;
+	}
+
+	Bit32u getStorageBufferUsage() const {
+		return 0;
+	}
+
+	Bit32u getStorageBufferHighWaterMark() const {
+		return 0;
+	}
+
+	void resetStorageBufferHighWaterMark() {}
+
+private:
+	static const Bit32u MIN_BUFFER_SIZE = 256;
+	// Fits the longest message the MIDI stream parser assembles from fragments.
+	static const Bit32u MAX_POOLED_BUFFER_SIZE = 32768;
+	static const Bit32u SIZE_CLASS_COUNT = 8;
+	static const Bit32u MAX_POOLED_BYTES = 256 * 1024;
+
+	struct SlotBuffer {
+		Bit8u *data;
+		Bit32u capacity;
+	};
+
+	SlotBuffer * const slotBuffers;
+	const Bit32u slotCount;
+	const bool pooled;
+	// The free buffers are chained through their first bytes.
+	Bit8u *freeLists[SIZE_CLASS_COUNT];
+	Bit32u pooledBytes;
+
+	// Returns SIZE_CLASS_COUNT when the length exceeds MAX_POOLED_BUFFER_SIZE.
+	static Bit32u getSizeClass(Bit32u length) {
+		Bit32u sizeClass = 0;
+		while (sizeClass < SIZE_CLASS_COUNT && (MIN_BUFFER_SIZE << sizeClass) < length) sizeClass++;
+		return sizeClass;
+	}
+
+	Bit8u *popFreeBuffer(Bit32u sizeClass) {
+		Bit8u *buffer = freeLists[sizeClass];
+		freeLists[sizeClass] = *reinterpret_cast<Bit8u **>(buffer);
+		pooledBytes -= MIN_BUFFER_SIZE << sizeClass;
+		return buffer;
+	}
+
+	void releaseBuffer(SlotBuffer &slotBuffer) {
+		if (slotBuffer.data == NULL) return;
+		if (pooled && slotBuffer.capacity <= MAX_POOLED_BUFFER_SIZE && pooledBytes + slotBuffer.capacity <= MAX_POOLED_BYTES) {
+			Bit32u sizeClass = getSizeClass(slotBuffer.capacity);
+			*reinterpret_cast<Bit8u **>(slotBuffer.data) = freeLists[sizeClass];
+			freeLists[sizeClass] = slotBuffer.data;
+			pooledBytes += slotBuffer.capacity;
+		} else {
+			delete[] slotBuffer.data;
+		}
+		slotBuffer.data = NULL;
+		slotBuffer.capacity = 0;
 	}
 };
 
@@ -1852,14 +3140,15 @@ public:
 		storageBuffer(new Bit8u[useStorageBufferSize]),
 		storageBufferSize(useStorageBufferSize),
 		startPosition(),
-		endPosition()
+		endPosition(),
+		highWaterMark()
 	{}
 
 	~BufferedSysexDataStorage() {
 		delete[] storageBuffer;
 	}
 
-	Bit8u *allocate(Bit32u sysexLength) {
+	Bit8u *allocate(Bit32u, Bit32u sysexLength) {
 		Bit32u myStartPosition = startPosition;
 		Bit32u myEndPosition = endPosition;
 
@@ -1882,6 +3171,8 @@ public:
 			myEndPosition = 0;
 		}
 		endPosition = myEndPosition + sysexLength;
+		Bit32u usage = getUsage(myStartPosition, myEndPosition + sysexLength);
+		if (highWaterMark < usage) highWaterMark = usage;
 		return storageBuffer + myEndPosition;
 	}
 
@@ -1896,7 +3187,27 @@ public:
 		}
 	}
 
-	void dispose(const Bit8u *, Bit32u) {}
+	void releaseSlot(Bit32u) {}
+
+	size_t getAllocatedMemorySize() const {
+		return sizeof(*this) + storageBufferSize;
+	}
+
+	size_t getSysexBufferMemorySize() const {
+		return 0;
+	}
+
+	Bit32u getStorageBufferUsage() const {
+		return getUsage(startPosition, endPosition);
+	}
+
+	Bit32u getStorageBufferHighWaterMark() const {
+		return highWaterMark;
+	}
+
+	void resetStorageBufferHighWaterMark() {
+		highWaterMark = 0;
+	}
 
 private:
 	Bit8u * const storageBuffer;
@@ -1904,90 +3215,575 @@ private:
 
 	volatile Bit32u startPosition;
 	volatile Bit32u endPosition;
+	// Only updated by the writing thread.
+	Bit32u highWaterMark;
+
+	// When the data has wrapped around, the space left unused at the buffer end counts as occupied.
+	Bit32u getUsage(Bit32u useStartPosition, Bit32u useEndPosition) const {
+		if (useStartPosition <= useEndPosition) return useEndPosition - useStartPosition;
+		return storageBufferSize - useStartPosition + useEndPosition;
+	}
 };
 
-MidiEventQueue::SysexDataStorage *MidiEventQueue::SysexDataStorage::create(Bit32u storageBufferSize) {
+MidiEventQueue::SysexDataStorage *MidiEventQueue::SysexDataStorage::create(Bit32u storageBufferSize, Bit32u slotCount, bool multiProducer) {
 	if (storageBufferSize > 0) {
 		return new BufferedSysexDataStorage(storageBufferSize);
 	} else {
-		return new DynamicSysexDataStorage;
+		return new DynamicSysexDataStorage(slotCount, !multiProducer);
 	}
 }
 
-MidiEventQueue::MidiEventQueue(Bit32u useRingBufferSize, Bit32u storageBufferSize) :
-	sysexDataStorage(*SysexDataStorage::create(storageBufferSize)),
-	ringBuffer(new MidiEvent[useRingBufferSize]), ringBufferMask(useRingBufferSize - 1)
+MidiEventQueue::MidiEventQueue(Bit32u useRingBufferSize, Bit32u storageBufferSize, bool useMultiProducer, Bit32u useCoalescingWindow) :
+	// Concurrent producers are unable to share a single storage buffer, as the SysEx data could end up allocated
+	// in an order that differs from the order of events in the queue.
+	sysexDataStorage(*SysexDataStorage::create(useMultiProducer ? 0 : storageBufferSize, useRingBufferSize, useMultiProducer)),
+	ringBuffer(new MidiEvent[useRingBufferSize]), ringBufferMask(useRingBufferSize - 1), multiProducer(useMultiProducer),
+	coalescingWindow(useMultiProducer ? 0 : useCoalescingWindow), freeCapacitySignal(WaitableSignal::createWaitableSignal())
 {
 	for (Bit32u i = 0; i <= ringBufferMask; i++) {
 		ringBuffer[i].sysexData = NULL;
 	}
 	reset();
+	resetStatistics();
 }
 
 MidiEventQueue::~MidiEventQueue() {
-	for (Bit32u i = 0; i <= ringBufferMask; i++) {
-		volatile MidiEvent &currentEvent = ringBuffer[i];
-		sysexDataStorage.dispose(currentEvent.sysexData, currentEvent.sysexLength);
-	}
+	delete freeCapacitySignal;
 	delete &sysexDataStorage;
 	delete[] ringBuffer;
 }
 
+Bit32u MidiEventQueue::decodeShortMessage(Bit32u shortMessageData) {
+	const Bit8u code = Bit8u((shortMessageData & 0x0000F0) >> 4);
+	const Bit8u note = Bit8u((shortMessageData & 0x007F00) >> 8);
+	const Bit8u velocity = Bit8u((shortMessageData & 0x7F0000) >> 16);
+	ShortMessageOpcode opcode;
+	switch (code) {
+	case 0x8:
+		opcode = ShortMessageOpcode_NOTE_OFF;
+		break;
+	case 0x9:
+		// MIDI defines note-on with velocity 0 as being the same as note-off with velocity 40
+		opcode = velocity == 0 ? ShortMessageOpcode_NOTE_OFF : ShortMessageOpcode_NOTE_ON;
+		break;
+	case 0xB: // Control change
+		switch (note) {
+		case 0x01:
+			opcode = ShortMessageOpcode_MODULATION;
+			break;
+		case 0x06:
+			opcode = ShortMessageOpcode_DATA_ENTRY_MSB;
+			break;
+		case 0x07:
+			opcode = ShortMessageOpcode_VOLUME;
+			break;
+		case 0x0A:
+			opcode = ShortMessageOpcode_PAN;
+			break;
+		case 0x0B:
+			opcode = ShortMessageOpcode_EXPRESSION;
+			break;
+		case 0x40:
+			opcode = ShortMessageOpcode_HOLD_PEDAL;
+			break;
+		case 0x62:
+		case 0x63:
+			opcode = ShortMessageOpcode_NRPN;
+			break;
+		case 0x64:
+			opcode = ShortMessageOpcode_RPN_LSB;
+			break;
+		case 0x65:
+			opcode = ShortMessageOpcode_RPN_MSB;
+			break;
+		case 0x79:
+			opcode = ShortMessageOpcode_RESET_ALL_CONTROLLERS;
+			break;
+		case 0x7B:
+			opcode = ShortMessageOpcode_ALL_NOTES_OFF;
+			break;
+		case 0x7C:
+		case 0x7D:
+		case 0x7E:
+		case 0x7F:
+			opcode = ShortMessageOpcode_MODE_CHANGE;
+			break;
+		default:
+			opcode = ShortMessageOpcode_UNKNOWN_CONTROL;
+			break;
+		}
+		break;
+	case 0xC:
+		opcode = ShortMessageOpcode_PROGRAM_CHANGE;
+		break;
+	case 0xE:
+		opcode = ShortMessageOpcode_PITCH_BEND;
+		break;
+	default:
+		opcode = ShortMessageOpcode_UNKNOWN_MESSAGE;
+		break;
+	}
+	return Bit32u(opcode) | ((shortMessageData & 0x0F) << 8) | (Bit32u(note) << 16) | (Bit32u(velocity) << 24);
+}
+
+bool MidiEventQueue::isCoalescable(ShortMessageOpcode opcode) {
+	switch (opcode) {
+	case ShortMessageOpcode_MODULATION:
+	case ShortMessageOpcode_VOLUME:
+	case ShortMessageOpcode_PAN:
+	case ShortMessageOpcode_EXPRESSION:
+	case ShortMessageOpcode_PITCH_BEND:
+		return true;
+	default:
+		return false;
+	}
+}
+
+size_t MidiEventQueue::getAllocatedMemorySize() const {
+	return sizeof(*this) + (ringBufferMask + 1) * sizeof(MidiEvent) + sysexDataStorage.getAllocatedMemorySize();
+}
+
+size_t MidiEventQueue::getSysexBufferMemorySize() const {
+	return sysexDataStorage.getSysexBufferMemorySize();
+}
+
+void MidiEventQueue::recordLateEvent(Bit32u lateness) {
+	lateEventCount++;
+	Bit32u bucket = 0;
+	while (bucket < 15 && (lateness >> (bucket + 1)) != 0) bucket++;
+	latenessHistogram[bucket]++;
+}
+
+void MidiEventQueue::getStatistics(MIDIEventQueueStatistics &statistics) const {
+	statistics.eventCountHighWaterMark = eventCountHighWaterMark;
+	statistics.overflowEventCount = overflowEventCount;
+	statistics.sysexStorageOverflowCount = sysexStorageOverflowCount;
+	statistics.sysexStorageUsage = sysexDataStorage.getStorageBufferUsage();
+	statistics.sysexStorageHighWaterMark = sysexDataStorage.getStorageBufferHighWaterMark();
+	statistics.lateEventCount = lateEventCount;
+	for (int i = 0; i < 16; i++) {
+		statistics.latenessHistogram[i] = latenessHistogram[i];
+	}
+}
+
+void MidiEventQueue::resetStatistics() {
+	eventCountHighWaterMark = 0;
+	lateEventCount = 0;
+	memset(latenessHistogram, 0, sizeof(latenessHistogram));
+	overflowEventCount = 0;
+	sysexStorageOverflowCount = 0;
+	sysexDataStorage.resetStorageBufferHighWaterMark();
+}
+
+void MidiEventQueue::countOverflow(volatile Bit32u &counter, Bit32u eventCount) {
+	if (multiProducer) {
+		Atomics::fetchAdd(counter, eventCount);
+	} else {
+		counter += eventCount;
+	}
+}
+
 void MidiEventQueue::reset() {
 	startPosition = 0;
 	endPosition = 0;
+	trackedChannelMask = 0;
+	if (multiProducer) {
+		// A slot is free for writing at the position that matches its sequence number.
+		for (Bit32u i = 0; i <= ringBufferMask; i++) {
+			ringBuffer[i].sequenceNumber = i;
+		}
+	}
+	if (freeCapacitySignal != NULL) freeCapacitySignal->notify();
+}
+
+volatile MidiEventQueue::MidiEvent *MidiEventQueue::reserveEvent(Bit32u &position) {
+	if (!multiProducer) {
+		position = endPosition;
+		// If ring buffer is full, bail out.
+		if (startPosition == ((position + 1) & ringBufferMask)) return NULL;
+		return &ringBuffer[position];
+	}
+	for (;;) {
+		position = endPosition;
+		volatile MidiEvent &event = ringBuffer[position & ringBufferMask];
+		Bit32s sequenceDelta = Bit32s(Atomics::loadAcquire(event.sequenceNumber) - position);
+		if (sequenceDelta == 0) {
+			if (Atomics::compareAndSwap(endPosition, position, position + 1)) return &event;
+		} else if (sequenceDelta < 0) {
+			// The slot still contains an event from the previous lap, which hasn't been read yet, so the ring buffer is full.
+			return NULL;
+		}
+		// Another producer has just reserved this slot, retrying with the updated position.
+	}
+}
+
+void MidiEventQueue::commitEvent(volatile MidiEvent &event, Bit32u position) {
+	if (multiProducer) {
+		// Publish the event to the consumer.
+		Atomics::storeRelease(event.sequenceNumber, position + 1);
+	} else {
+		endPosition = (position + 1) & ringBufferMask;
+	}
+}
+
+bool MidiEventQueue::isPendingBehindHead(Bit32u position) const {
+	const Bit32u offset = (position - startPosition) & ringBufferMask;
+	return offset != 0 && offset < ((endPosition - startPosition) & ringBufferMask);
+}
+
+void MidiEventQueue::trackEvent(Bit32u position, const volatile MidiEvent &event) {
+	if (coalescingWindow == 0) return;
+	if (event.sysexData != NULL) {
+		// The channel assignment may change, so nothing pushed before a SysEx event is coalesced with anything after it.
+		trackedChannelMask = 0;
+		return;
+	}
+	const Bit8u channel = getShortMessageChannel(event.decodedShortMessage);
+	lastChannelEventPositions[channel] = position;
+	trackedChannelMask |= 1 << channel;
+}
+
+bool MidiEventQueue::coalesceShortMessage(Bit32u shortMessageData, Bit32u decodedShortMessage, Bit32u timestamp) {
+	if (coalescingWindow == 0 || !isCoalescable(getShortMessageOpcode(decodedShortMessage))) return false;
+	const Bit8u channel = getShortMessageChannel(decodedShortMessage);
+	if ((trackedChannelMask & (1 << channel)) == 0) return false;
+	const Bit32u position = lastChannelEventPositions[channel];
+	volatile MidiEvent &event = ringBuffer[position];
+	// The opcode and the channel are in the lower half of the decoded message.
+	if (event.sysexData != NULL || ((event.decodedShortMessage ^ decodedShortMessage) & 0xFFFF) != 0) return false;
+	if (timestamp - event.timestamp >= coalescingWindow || !isPendingBehindHead(position)) return false;
+	event.shortMessageData = shortMessageData;
+	event.decodedShortMessage = decodedShortMessage;
+	// The reading thread makes the event the head before reading it, so unless it has done so by now, it reads the update.
+	Atomics::fullBarrier();
+	return isPendingBehindHead(position);
 }
 
 bool MidiEventQueue::pushShortMessage(Bit32u shortMessageData, Bit32u timestamp) {
-	Bit32u newEndPosition = (endPosition + 1) & ringBufferMask;
-	// If ring buffer is full, bail out.
-	if (startPosition == newEndPosition) return false;
-	volatile MidiEvent &newEvent = ringBuffer[endPosition];
-	sysexDataStorage.dispose(newEvent.sysexData, newEvent.sysexLength);
-	newEvent.sysexData = NULL;
-	newEvent.shortMessageData = shortMessageData;
-	newEvent.timestamp = timestamp;
-	endPosition = newEndPosition;
+	const Bit32u decodedShortMessage = decodeShortMessage(shortMessageData);
+	if (coalesceShortMessage(shortMessageData, decodedShortMessage, timestamp)) return true;
+	Bit32u position;
+	volatile MidiEvent *newEvent = reserveEvent(position);
+	if (newEvent == NULL) {
+		countOverflow(overflowEventCount, 1);
+		return false;
+	}
+	sysexDataStorage.releaseSlot(position & ringBufferMask);
+	newEvent->sysexData = NULL;
+	newEvent->shortMessageData = shortMessageData;
+	newEvent->decodedShortMessage = decodedShortMessage;
+	newEvent->timestamp = timestamp;
+	commitEvent(*newEvent, position);
+	trackEvent(position, *newEvent);
 	return true;
 }
 
 bool MidiEventQueue::pushSysex(const Bit8u *sysexData, Bit32u sysexLength, Bit32u timestamp) {
-	Bit32u newEndPosition = (endPosition + 1) & ringBufferMask;
-	// If ring buffer is full, bail out.
-	if (startPosition == newEndPosition) return false;
-	volatile MidiEvent &newEvent = ringBuffer[endPosition];
-	sysexDataStorage.dispose(newEvent.sysexData, newEvent.sysexLength);
-	Bit8u *dstSysexData = sysexDataStorage.allocate(sysexLength);
-	if (dstSysexData == NULL) return false;
+	Bit32u position;
+	volatile MidiEvent *newEvent = reserveEvent(position);
+	if (newEvent == NULL) {
+		countOverflow(overflowEventCount, 1);
+		return false;
+	}
+	// The dynamic storage, which is the only option in the multi-producer mode, never fails,
+	// so there is no need to release a reserved slot.
+	Bit8u *dstSysexData = sysexDataStorage.allocate(position & ringBufferMask, sysexLength);
+	if (dstSysexData == NULL) {
+		newEvent->sysexData = NULL;
+		countOverflow(sysexStorageOverflowCount, 1);
+		return false;
+	}
 	memcpy(dstSysexData, sysexData, sysexLength);
-	newEvent.sysexData = dstSysexData;
-	newEvent.sysexLength = sysexLength;
-	newEvent.timestamp = timestamp;
-	endPosition = newEndPosition;
+	newEvent->sysexData = dstSysexData;
+	newEvent->sysexLength = sysexLength;
+	newEvent->timestamp = timestamp;
+	commitEvent(*newEvent, position);
+	trackEvent(position, *newEvent);
+	return true;
+}
+
+Bit32u MidiEventQueue::pushMidiEvents(const MidiEvent *events, Bit32u count) {
+	Bit32u position;
+	if (multiProducer) {
+		for (;;) {
+			position = endPosition;
+			// The consumer frees slots in order, so the free slots are contiguous.
+			Bit32u freeCount = 0;
+			while (freeCount < count) {
+				const volatile MidiEvent &event = ringBuffer[(position + freeCount) & ringBufferMask];
+				if (Atomics::loadAcquire(event.sequenceNumber) != position + freeCount) break;
+				freeCount++;
+			}
+			if (freeCount == 0) {
+				Bit32s sequenceDelta = Bit32s(Atomics::loadAcquire(ringBuffer[position & ringBufferMask].sequenceNumber) - position);
+				if (sequenceDelta < 0) {
+					countOverflow(overflowEventCount, count);
+					return 0;
+				}
+				// Another producer has just reserved this slot, retrying with the updated position.
+				continue;
+			}
+			if (Atomics::compareAndSwap(endPosition, position, position + freeCount)) {
+				if (freeCount < count) countOverflow(overflowEventCount, count - freeCount);
+				count = freeCount;
+				break;
+			}
+		}
+		for (Bit32u i = 0; i < count; i++) {
+			volatile MidiEvent &newEvent = ringBuffer[(position + i) & ringBufferMask];
+			// The dynamic storage, which is the only option in the multi-producer mode, never fails.
+			storeEvent(newEvent, events[i]);
+			Atomics::storeRelease(newEvent.sequenceNumber, position + i + 1);
+		}
+		return count;
+	}
+	position = endPosition;
+	Bit32u freeCount = (startPosition - position - 1) & ringBufferMask;
+	if (count > freeCount) {
+		countOverflow(overflowEventCount, count - freeCount);
+		count = freeCount;
+	}
+	for (Bit32u i = 0; i < count; i++) {
+		if (!storeEvent(ringBuffer[(position + i) & ringBufferMask], events[i])) {
+			countOverflow(sysexStorageOverflowCount, 1);
+			count = i;
+			break;
+		}
+	}
+	endPosition = (position + count) & ringBufferMask;
+	// The events of a batch are published at once, so they are only tracked to be coalesced with the following events.
+	for (Bit32u i = 0; i < count; i++) {
+		trackEvent((position + i) & ringBufferMask, ringBuffer[(position + i) & ringBufferMask]);
+	}
+	return count;
+}
+
+bool MidiEventQueue::storeEvent(volatile MidiEvent &slot, const MidiEvent &event) {
+	const Bit32u slotIx = Bit32u(&slot - ringBuffer);
+	if (event.sysexData == NULL) {
+		sysexDataStorage.releaseSlot(slotIx);
+		slot.sysexData = NULL;
+		slot.shortMessageData = event.shortMessageData;
+		slot.decodedShortMessage = decodeShortMessage(event.shortMessageData);
+	} else {
+		Bit8u *dstSysexData = sysexDataStorage.allocate(slotIx, event.sysexLength);
+		if (dstSysexData == NULL) {
+			slot.sysexData = NULL;
+			return false;
+		}
+		memcpy(dstSysexData, event.sysexData, event.sysexLength);
+		slot.sysexData = dstSysexData;
+		slot.sysexLength = event.sysexLength;
+	}
+	slot.timestamp = event.timestamp;
 	return true;
 }
 
 const volatile MidiEventQueue::MidiEvent *MidiEventQueue::peekMidiEvent() {
-	return isEmpty() ? NULL : &ringBuffer[startPosition];
+	if (isEmpty()) return NULL;
+	return &ringBuffer[startPosition & ringBufferMask];
+}
+
+const volatile MidiEventQueue::MidiEvent *MidiEventQueue::peekMidiEvent(Bit32u offset) {
+	if (multiProducer) {
+		Bit32u position = startPosition + offset;
+		const volatile MidiEvent &event = ringBuffer[position & ringBufferMask];
+		if (offset > ringBufferMask || Atomics::loadAcquire(event.sequenceNumber) != position + 1) return NULL;
+		return &event;
+	}
+	if (offset >= ((endPosition - startPosition) & ringBufferMask)) return NULL;
+	return &ringBuffer[(startPosition + offset) & ringBufferMask];
 }
 
 void MidiEventQueue::dropMidiEvent() {
 	if (isEmpty()) return;
-	volatile MidiEvent &unusedEvent = ringBuffer[startPosition];
+	// In the multi-producer mode, the events being stored by the producers at the moment count as pending as well.
+	Bit32u pendingEventCount = multiProducer ? endPosition - startPosition : (endPosition - startPosition) & ringBufferMask;
+	if (eventCountHighWaterMark < pendingEventCount) eventCountHighWaterMark = pendingEventCount;
+	volatile MidiEvent &unusedEvent = ringBuffer[startPosition & ringBufferMask];
 	sysexDataStorage.reclaimUnused(unusedEvent.sysexData, unusedEvent.sysexLength);
-	startPosition = (startPosition + 1) & ringBufferMask;
+	if (multiProducer) {
+		// Hand the slot over to the producers for the next lap.
+		Atomics::storeRelease(unusedEvent.sequenceNumber, startPosition + ringBufferMask + 1);
+		startPosition = startPosition + 1;
+	} else {
+		startPosition = (startPosition + 1) & ringBufferMask;
+		// Pairs with the barrier in coalesceShortMessage(), so that the new head is read after it is published.
+		if (coalescingWindow != 0) Atomics::fullBarrier();
+	}
+	if (freeCapacitySignal != NULL) freeCapacitySignal->notify();
 }
 
 bool MidiEventQueue::isEmpty() const {
+	if (multiProducer) {
+		Bit32u position = startPosition;
+		return Atomics::loadAcquire(ringBuffer[position & ringBufferMask].sequenceNumber) != position + 1;
+	}
 	return startPosition == endPosition;
 }
 
-void Synth::selectRendererType(RendererType newRendererType) {
-	extensions.selectedRendererType = newRendererType;
+Bit32u MidiEventQueue::getFreeCapacity() const {
+	if (multiProducer) {
+		// The start position is read first, so that the count of the occupied slots may only be overestimated.
+		Bit32u position = startPosition;
+		return ringBufferMask + 1 - (endPosition - position);
+	}
+	return (startPosition - endPosition - 1) & ringBufferMask;
+}
+
+class FreeCapacityPredicate : public WaitableSignal::Predicate {
+	const MidiEventQueue &queue;
+	const Bit32u eventCount;
+
+public:
+	FreeCapacityPredicate(const MidiEventQueue &useQueue, Bit32u useEventCount) : queue(useQueue), eventCount(useEventCount) {}
+
+	bool isSatisfied() const {
+		return queue.getFreeCapacity() >= eventCount;
+	}
+};
+
+bool MidiEventQueue::waitForFreeCapacity(Bit32u eventCount, Bit32u timeoutMillis) {
+	FreeCapacityPredicate predicate(*this, eventCount);
+	if (freeCapacitySignal == NULL) return predicate.isSatisfied();
+	return freeCapacitySignal->waitFor(predicate, timeoutMillis);
+}
+
+void Synth::selectRendererType(RendererType newRendererType) {
+	extensions.selectedRendererType = newRendererType;
+}
+
+RendererType Synth::getSelectedRendererType() const {
+	return extensions.selectedRendererType;
+}
+
+void Synth::setFloatWaveAccuracy(FloatWaveAccuracy accuracy) {
+	extensions.floatWaveAccuracy = accuracy;
+	if (partialManager == NULL) return;
+	for (Bit32u i = 0; i < getMaxPartialCount(); i++) {
+		partialManager->getPartial(i)->updateFloatWaveAccuracy();
+	}
+}
+
+FloatWaveAccuracy Synth::getFloatWaveAccuracy() const {
+	return extensions.floatWaveAccuracy;
+}
+
+FloatWaveAccuracy Synth::getEffectiveFloatWaveAccuracy() const {
+	if (extensions.degradationLevel >= DegradationLevel_FAST_WAVES && extensions.floatWaveAccuracy < FloatWaveAccuracy_FAST) {
+		return FloatWaveAccuracy_FAST;
+	}
+	return extensions.floatWaveAccuracy;
+}
+
+void Synth::setDegradationLevel(DegradationLevel level) {
+	if (extensions.degradationLevel == level) return;
+	extensions.degradationLevel = level;
+	if (partialManager == NULL) return;
+	renderer->getStatistics().degradationLevelChangeCount++;
+	for (Bit32u i = 0; i < getMaxPartialCount(); i++) {
+		partialManager->getPartial(i)->updateFloatWaveAccuracy();
+	}
+}
+
+DegradationLevel Synth::getDegradationLevel() const {
+	return extensions.degradationLevel;
+}
+
+void Synth::setPartialCullingLevel(Bit8u level) {
+	extensions.partialCullingLevel = level;
+}
+
+Bit8u Synth::getPartialCullingLevel() const {
+	return extensions.partialCullingLevel;
+}
+
+void Synth::setDenormalFlushingEnabled(bool enabled) {
+	extensions.denormalFlushingEnabled = enabled;
+}
+
+bool Synth::isDenormalFlushingEnabled() const {
+	return extensions.denormalFlushingEnabled;
+}
+
+void Synth::setPartialRenderingThreadCount(Bit32u threadCount) {
+	extensions.partialRenderingThreadCount = threadCount;
+}
+
+Bit32u Synth::getPartialRenderingThreadCount() const {
+	return extensions.partialRenderingThreadCount;
+}
+
+void Synth::setReverbPipelineEnabled(bool enabled) {
+	extensions.reverbPipelineEnabled = enabled;
+}
+
+bool Synth::isReverbPipelineEnabled() const {
+	return extensions.reverbPipelineEnabled;
+}
+
+void Synth::setROMCacheDirectory(const char *cacheDirectory) {
+	delete[] extensions.romCacheDirectory;
+	extensions.romCacheDirectory = NULL;
+	if (cacheDirectory == NULL || *cacheDirectory == 0) return;
+	extensions.romCacheDirectory = new char[strlen(cacheDirectory) + 1];
+	strcpy(extensions.romCacheDirectory, cacheDirectory);
+}
+
+const char *Synth::getROMCacheDirectory() const {
+	return extensions.romCacheDirectory;
+}
+
+Bit32u Synth::getReverbPipelineLatency() const {
+	return opened ? renderer->getReverbPipelineLatency() : 0;
+}
+
+void Synth::setMaxRenderBlockLength(Bit32u length) {
+	if (length < MIN_RENDER_BLOCK_LENGTH) length = MIN_RENDER_BLOCK_LENGTH;
+	if (length > MAX_RENDER_BLOCK_LENGTH) length = MAX_RENDER_BLOCK_LENGTH;
+	extensions.maxRenderBlockLength = length;
+}
+
+Bit32u Synth::getMaxRenderBlockLength() const {
+	return extensions.maxRenderBlockLength;
+}
+
+size_t Synth::getAllocatedMemorySize() const {
+	MemoryUsage usage;
+	getMemoryUsage(usage);
+	return usage.total;
+}
+
+void Synth::getMemoryUsage(MemoryUsage &usage) const {
+	memset(&usage, 0, sizeof(usage));
+	usage.memoryRegions = 2 * sizeof(MemParams);
+	usage.synth = sizeof(Synth) + sizeof(Extensions);
+	if (extensions.romCacheDirectory != NULL) usage.synth += strlen(extensions.romCacheDirectory) + 1;
+	if (opened) {
+		usage.sharedPCMROM = extensions.romSet->getAllocatedMemorySize();
+		usage.mappedPCMROM = extensions.romSet->getMappedMemorySize();
+		// The rest of the arena holds the sound group names, which are accounted to the synth.
+		const size_t memoryRegionsArenaSize = getMemoryRegionsArenaSize();
+		const size_t partialsArenaSize = getPartialsArenaSize(extensions.partialCapacity, getSelectedRendererType());
+		usage.memoryRegions += memoryRegionsArenaSize;
+		usage.partials = partialsArenaSize;
+		usage.synth += extensions.arena.getSize() - memoryRegionsArenaSize - partialsArenaSize + extensions.openStateSize;
+		usage.midiEventQueue = midiQueue->getAllocatedMemorySize();
+		usage.sysexBuffers = midiQueue->getSysexBufferMemorySize();
+		for (int i = REVERB_MODE_ROOM; i <= REVERB_MODE_TAP_DELAY; i++) {
+			if (reverbModels[i] != NULL) usage.reverbModels[i] = reverbModels[i]->getAllocatedMemorySize();
+		}
+		usage.analog = analog->getAllocatedMemorySize();
+		usage.renderer = renderer->getAllocatedMemorySize();
+	}
+	usage.total = usage.memoryRegions + usage.partials + usage.midiEventQueue + usage.sysexBuffers + usage.analog + usage.renderer + usage.synth;
+	for (int i = REVERB_MODE_ROOM; i <= REVERB_MODE_TAP_DELAY; i++) {
+		usage.total += usage.reverbModels[i];
+	}
 }
 
-RendererType Synth::getSelectedRendererType() const {
-	return extensions.selectedRendererType;
+void Synth::flushReverbPipeline() {
+	if (renderer != NULL) renderer->flushReverbPipeline();
 }
 
 Bit32u Synth::getStereoOutputSampleRate() const {
@@ -1995,22 +3791,61 @@ Bit32u Synth::getStereoOutputSampleRate() const {
 }
 
 template <class Sample>
-void RendererImpl<Sample>::doRender(Sample *stereoStream, Bit32u len) {
-	if (!isActivated()) {
-		incRenderedSampleCount(getAnalog().getDACStreamsLength(len));
-		if (!getAnalog().process(NULL, NULL, NULL, NULL, NULL, NULL, stereoStream, len)) {
+void RendererImpl<Sample>::doRender(const StereoOutputDescriptor<Sample> &output, Bit32u len) {
+	StereoOutputDescriptor<Sample> stereoOutput = output;
+	while (len > 0) {
+		if (!isActivated()) {
+			incRenderedSampleCount(getAnalog().getDACStreamsLength(len));
+			StageTimer analogTimer(statistics.analogTime);
+			const StereoOutputDescriptor<Sample> noOutput = makeInterleavedOutput<Sample>(NULL);
+			if (!getAnalog().process(noOutput, NULL, NULL, NULL, NULL, NULL, NULL, len)) {
+				printDebug("RendererImpl: Invalid call to Analog::process()!\n");
+			}
+			muteOutput(stereoOutput, len);
+			return;
+		}
+
+		// As in AnalogOutputMode_ACCURATE mode output is upsampled, maxBlockLength is more than enough for the temp buffers.
+		Bit32u thisPassLen = len > maxBlockLength ? maxBlockLength : len;
+		const Bit32u blockFrame = getRenderedSampleCount();
+		doRenderStreams(tmpBuffers, getAnalog().getDACStreamsLength(thisPassLen));
+		bool processed;
+		{
+			StageTimer analogTimer(statistics.analogTime);
+			TraceZone traceZone("Analog", blockFrame);
+			processed = getAnalog().process(stereoOutput, tmpNonReverbLeft, tmpNonReverbRight, tmpReverbDryLeft, tmpReverbDryRight, tmpReverbWetLeft, tmpReverbWetRight, thisPassLen);
+		}
+		if (!processed) {
 			printDebug("RendererImpl: Invalid call to Analog::process()!\n");
+			muteOutput(stereoOutput, len);
+			return;
 		}
-		Synth::muteSampleBuffer(stereoStream, len << 1);
-		return;
+		advanceOutput(stereoOutput, thisPassLen);
+		len -= thisPassLen;
 	}
+}
 
+// The output is produced at the DAC sample rate, the analog circuitry emulation only mixes the DAC streams applying the gains.
+template <class Sample>
+void RendererImpl<Sample>::doRenderBypassingLPF(Sample *stereoStream, Bit32u len) {
 	while (len > 0) {
-		// As in AnalogOutputMode_ACCURATE mode output is upsampled, MAX_SAMPLES_PER_RUN is more than enough for the temp buffers.
-		Bit32u thisPassLen = len > MAX_SAMPLES_PER_RUN ? MAX_SAMPLES_PER_RUN : len;
-		doRenderStreams(tmpBuffers, getAnalog().getDACStreamsLength(thisPassLen));
-		if (!getAnalog().process(stereoStream, tmpNonReverbLeft, tmpNonReverbRight, tmpReverbDryLeft, tmpReverbDryRight, tmpReverbWetLeft, tmpReverbWetRight, thisPassLen)) {
-			printDebug("RendererImpl: Invalid call to Analog::process()!\n");
+		if (!isActivated()) {
+			incRenderedSampleCount(len);
+			Synth::muteSampleBuffer(stereoStream, len << 1);
+			return;
+		}
+
+		Bit32u thisPassLen = len > maxBlockLength ? maxBlockLength : len;
+		const Bit32u blockFrame = getRenderedSampleCount();
+		doRenderStreams(tmpBuffers, thisPassLen);
+		bool processed;
+		{
+			StageTimer analogTimer(statistics.analogTime);
+			TraceZone traceZone("Analog", blockFrame);
+			processed = getAnalog().mixDACStreams(stereoStream, tmpNonReverbLeft, tmpNonReverbRight, tmpReverbDryLeft, tmpReverbDryRight, tmpReverbWetLeft, tmpReverbWetRight, thisPassLen);
+		}
+		if (!processed) {
+			printDebug("RendererImpl: Invalid call to Analog::mixDACStreams()!\n");
 			Synth::muteSampleBuffer(stereoStream, len << 1);
 			return;
 		}
@@ -2021,52 +3856,132 @@ void RendererImpl<Sample>::doRender(Sample *stereoStream, Bit32u len) {
 
 template <class Sample>
 template <class O>
-void RendererImpl<Sample>::doRenderAndConvert(O *stereoStream, Bit32u len) {
-	Sample renderingBuffer[MAX_SAMPLES_PER_RUN << 1];
+void RendererImpl<Sample>::doRenderAndConvert(const StereoOutputDescriptor<O> &output, Bit32u len, bool bypassLPF) {
+	Sample * const renderingBuffer = conversionBuffer;
+	StereoOutputDescriptor<O> stereoOutput = output;
 	while (len > 0) {
-		Bit32u thisPassLen = len > MAX_SAMPLES_PER_RUN ? MAX_SAMPLES_PER_RUN : len;
-		doRender(renderingBuffer, thisPassLen);
-		convertSampleFormat(renderingBuffer, stereoStream, thisPassLen << 1);
-		stereoStream += thisPassLen << 1;
+		Bit32u thisPassLen = len > maxBlockLength ? maxBlockLength : len;
+		if (bypassLPF) {
+			doRenderBypassingLPF(renderingBuffer, thisPassLen);
+		} else {
+			doRender(makeInterleavedOutput(renderingBuffer), thisPassLen);
+		}
+		StageTimer conversionTimer(statistics.sampleFormatConversionTime);
+		convertStereoOutput(renderingBuffer, stereoOutput, thisPassLen);
+		advanceOutput(stereoOutput, thisPassLen);
 		len -= thisPassLen;
 	}
 }
 
 template<>
-void RendererImpl<IntSample>::render(IntSample *stereoStream, Bit32u len) {
-	doRender(stereoStream, len);
+void RendererImpl<IntSample>::render(const StereoOutputDescriptor<IntSample> &output, Bit32u len) {
+	doRender(output, len);
 }
 
 template<>
-void RendererImpl<IntSample>::render(FloatSample *stereoStream, Bit32u len) {
-	doRenderAndConvert(stereoStream, len);
+void RendererImpl<IntSample>::render(const StereoOutputDescriptor<FloatSample> &output, Bit32u len) {
+	doRenderAndConvert(output, len);
 }
 
 template<>
-void RendererImpl<FloatSample>::render(IntSample *stereoStream, Bit32u len) {
-	doRenderAndConvert(stereoStream, len);
+void RendererImpl<FloatSample>::render(const StereoOutputDescriptor<IntSample> &output, Bit32u len) {
+	doRenderAndConvert(output, len);
 }
 
 template<>
-void RendererImpl<FloatSample>::render(FloatSample *stereoStream, Bit32u len) {
-	doRender(stereoStream, len);
+void RendererImpl<FloatSample>::render(const StereoOutputDescriptor<FloatSample> &output, Bit32u len) {
+	doRender(output, len);
+}
+
+template<>
+void RendererImpl<IntSample>::renderBypassingLPF(FloatSample *stereoStream, Bit32u len) {
+	doRenderAndConvert(makeInterleavedOutput(stereoStream), len, true);
+}
+
+template<>
+void RendererImpl<FloatSample>::renderBypassingLPF(FloatSample *stereoStream, Bit32u len) {
+	doRenderBypassingLPF(stereoStream, len);
 }
 
 template <class S>
-static inline void renderStereo(bool opened, Renderer *renderer, S *stream, Bit32u len) {
+static inline void renderStereo(bool opened, Renderer *renderer, const StereoOutputDescriptor<S> &output, Bit32u len) {
 	if (opened) {
-		renderer->render(stream, len);
+		StageTimer renderTimer(renderer->getStatistics().totalTime);
+		RealtimeScope realtimeScope("Synth::render");
+		DenormalFlushScope denormalFlushScope(renderer->isDenormalFlushingEnabled());
+		TraceZone traceZone("Synth::render", renderer->getRenderedSampleCount());
+		renderer->render(output, len);
 	} else {
-		Synth::muteSampleBuffer(stream, len << 1);
+		muteOutput(output, len);
 	}
 }
 
 void Synth::render(Bit16s *stream, Bit32u len) {
-	renderStereo(opened, renderer, stream, len);
+	renderStereo(opened, renderer, makeInterleavedOutput(stream), len);
+	recordRenderCall(extensions, SessionRenderCallType_STEREO_BIT16S, len);
 }
 
 void Synth::render(float *stream, Bit32u len) {
-	renderStereo(opened, renderer, stream, len);
+	renderStereo(opened, renderer, makeInterleavedOutput(stream), len);
+	recordRenderCall(extensions, SessionRenderCallType_STEREO_FLOAT, len);
+}
+
+void Synth::render(const StereoOutputDescriptor<Bit16s> &output, Bit32u len) {
+	renderStereo(opened, renderer, output, len);
+	recordRenderCall(extensions, SessionRenderCallType_STEREO_BIT16S, len);
+}
+
+void Synth::render(const StereoOutputDescriptor<float> &output, Bit32u len) {
+	renderStereo(opened, renderer, output, len);
+	recordRenderCall(extensions, SessionRenderCallType_STEREO_FLOAT, len);
+}
+
+Bit32u Synth::renderWithEvents(const MIDIEvent *events, Bit32u eventCount, Bit16s *stream, Bit32u len) {
+	setInlineEvents(events, eventCount);
+	render(stream, len);
+	return clearInlineEvents();
+}
+
+Bit32u Synth::renderWithEvents(const MIDIEvent *events, Bit32u eventCount, float *stream, Bit32u len) {
+	setInlineEvents(events, eventCount);
+	render(stream, len);
+	return clearInlineEvents();
+}
+
+Bit32u Synth::renderWithEvents(const MIDIEvent *events, Bit32u eventCount, const StereoOutputDescriptor<Bit16s> &output, Bit32u len) {
+	setInlineEvents(events, eventCount);
+	render(output, len);
+	return clearInlineEvents();
+}
+
+Bit32u Synth::renderWithEvents(const MIDIEvent *events, Bit32u eventCount, const StereoOutputDescriptor<float> &output, Bit32u len) {
+	setInlineEvents(events, eventCount);
+	render(output, len);
+	return clearInlineEvents();
+}
+
+void Synth::setInlineEvents(const MIDIEvent *events, Bit32u eventCount) {
+	if (!opened) return;
+	// An idle synth skips the event dispatch entirely.
+	if (eventCount > 0 && !activated) activated = true;
+	renderer->setInlineEvents(events, eventCount);
+}
+
+Bit32u Synth::clearInlineEvents() {
+	return opened ? renderer->clearInlineEvents() : 0;
+}
+
+void Synth::renderBypassingLPF(float *stream, Bit32u len) {
+	if (opened) {
+		StageTimer renderTimer(renderer->getStatistics().totalTime);
+		RealtimeScope realtimeScope("Synth::renderBypassingLPF");
+		DenormalFlushScope denormalFlushScope(extensions.denormalFlushingEnabled);
+		TraceZone traceZone("Synth::renderBypassingLPF", renderer->getRenderedSampleCount());
+		renderer->renderBypassingLPF(stream, len);
+		recordRenderCall(extensions, SessionRenderCallType_BYPASSING_LPF, len);
+	} else {
+		muteSampleBuffer(stream, len << 1);
+	}
 }
 
 template <class Sample>
@@ -2107,59 +4022,162 @@ static inline void convertStreamsFormat(const DACOutputStreams<I> &inStreams, co
 }
 
 template <class Sample>
-void RendererImpl<Sample>::doRenderStreams(const DACOutputStreams<Sample> &streams, Bit32u len)
+static inline void advanceStreams(PartOutputStreams<Sample> &streams, Bit32u len) {
+	for (int partNum = 0; partNum < 9; partNum++) {
+		advanceStream(streams.partLeft[partNum], len);
+		advanceStream(streams.partRight[partNum], len);
+	}
+	advanceStream(streams.reverbWetLeft, len);
+	advanceStream(streams.reverbWetRight, len);
+}
+
+template <class Sample>
+static inline void muteStreams(const PartOutputStreams<Sample> &streams, Bit32u len) {
+	for (int partNum = 0; partNum < 9; partNum++) {
+		Synth::muteSampleBuffer(streams.partLeft[partNum], len);
+		Synth::muteSampleBuffer(streams.partRight[partNum], len);
+	}
+	Synth::muteSampleBuffer(streams.reverbWetLeft, len);
+	Synth::muteSampleBuffer(streams.reverbWetRight, len);
+}
+
+template <class I, class O>
+static inline void convertStreamsFormat(const PartOutputStreams<I> &inStreams, const PartOutputStreams<O> &outStreams, Bit32u len) {
+	for (int partNum = 0; partNum < 9; partNum++) {
+		convertSampleFormat(inStreams.partLeft[partNum], outStreams.partLeft[partNum], len);
+		convertSampleFormat(inStreams.partRight[partNum], outStreams.partRight[partNum], len);
+	}
+	convertSampleFormat(inStreams.reverbWetLeft, outStreams.reverbWetLeft, len);
+	convertSampleFormat(inStreams.reverbWetRight, outStreams.reverbWetRight, len);
+}
+
+template <class Sample>
+template <class Streams>
+void RendererImpl<Sample>::doRenderStreams(const Streams &streams, Bit32u len)
 {
-	DACOutputStreams<Sample> tmpStreams = streams;
+	latchRealtimeParameters();
+	const Bit32u timingQuantum = getMIDIEventTimingQuantum();
+	Streams tmpStreams = streams;
 	while (len > 0) {
 		// We need to ensure zero-duration notes will play so add minimum 1-sample delay.
 		Bit32u thisLen = 1;
 		if (!isAbortingPoly()) {
-			const volatile MidiEventQueue::MidiEvent *nextEvent = getMidiQueue().peekMidiEvent();
-			Bit32s samplesToNextEvent = (nextEvent != NULL) ? Bit32s(nextEvent->timestamp - getRenderedSampleCount()) : MAX_SAMPLES_PER_RUN;
+			const volatile MidiEventQueue::MidiEvent *nextEvent = peekMidiEvent();
+			Bit32s samplesToNextEvent = (nextEvent != NULL) ? Bit32s(nextEvent->timestamp - getRenderedSampleCount()) : Bit32s(maxBlockLength);
 			if (samplesToNextEvent > 0) {
-				thisLen = len > MAX_SAMPLES_PER_RUN ? MAX_SAMPLES_PER_RUN : len;
+				midiEventsHeldUp = false;
+				if (nextEvent != NULL && timingQuantum > 1) {
+					// Postpone the event up to the next grid point.
+					Bit32u gridOffset = nextEvent->timestamp % timingQuantum;
+					if (gridOffset > 0) samplesToNextEvent += timingQuantum - gridOffset;
+				}
+				thisLen = len > maxBlockLength ? maxBlockLength : len;
 				if (thisLen > Bit32u(samplesToNextEvent)) {
 					thisLen = samplesToNextEvent;
 				}
 			} else {
+				if (!midiEventsHeldUp) {
+					Bit32u lateness = Bit32u(-samplesToNextEvent);
+					updateMaxMIDIEventTimingError(lateness);
+					// The delay up to the next grid point is intended, unlike that of an event which has arrived late.
+					if (timingQuantum > 1) {
+						Bit32u gridOffset = nextEvent->timestamp % timingQuantum;
+						if (gridOffset > 0) lateness = lateness > timingQuantum - gridOffset ? lateness - (timingQuantum - gridOffset) : 0;
+					}
+					if (lateness > 0) getMidiQueue().recordLateEvent(lateness);
+				}
+				StageTimer dispatchTimer(statistics.midiEventDispatchTime);
+				RealtimeScope realtimeScope("MIDI event dispatch");
+				TraceZone traceZone("MIDI event dispatch", nextEvent->timestamp);
+				statistics.midiEventCount++;
+				bool noteOn = false;
+				recordDispatchedEvent(nextEvent);
 				if (nextEvent->sysexData == NULL) {
-					synth.playMsgNow(nextEvent->shortMessageData);
+					const Bit32u decodedMsg = nextEvent->decodedShortMessage;
+					noteOn = MidiEventQueue::getShortMessageOpcode(decodedMsg) == MidiEventQueue::ShortMessageOpcode_NOTE_ON;
+					playDecodedMsgNow(decodedMsg);
+					updateHeldEventRecorded();
 					// If a poly is aborting we don't drop the event from the queue.
 					// Instead, we'll return to it again when the abortion is done.
 					if (!isAbortingPoly()) {
-						getMidiQueue().dropMidiEvent();
+						dropMidiEvent();
 					}
 				} else {
-					synth.playSysexNow(nextEvent->sysexData, nextEvent->sysexLength);
-					getMidiQueue().dropMidiEvent();
+					playFramedSysex(nextEvent->sysexData, nextEvent->sysexLength);
+					dropMidiEvent();
 				}
+				// With quantised timing, the events that are due are all played before rendering continues.
+				if (timingQuantum > 1 && !noteOn && !isAbortingPoly()) continue;
+			}
+		} else {
+			midiEventsHeldUp = true;
+			// The held up event is played right after the aborting poly finishes. Until any partial may deactivate, rendering
+			// a block is equivalent to rendering sample by sample. Beyond that, the order of deactivations would change
+			// the order in which the freed partials are reused, so the remaining samples still go one by one.
+			Bit32u remainingSampleCount = getPartialManager().getMinRemainingSampleCount();
+			if (remainingSampleCount > 1) {
+				thisLen = len > maxBlockLength ? maxBlockLength : len;
+				if (thisLen > remainingSampleCount) thisLen = remainingSampleCount;
 			}
 		}
-		produceStreams(tmpStreams, thisLen);
-		advanceStreams(tmpStreams, thisLen);
+		applyPendingMemoryRefresh();
+		getPartialManager().startTimerJitter(thisLen);
+		if (fastForwarding) {
+			skipStreams(thisLen);
+		} else {
+			TraceZone traceZone("produce streams", getRenderedSampleCount());
+			produceStreams(tmpStreams, thisLen);
+			advanceStreams(tmpStreams, thisLen);
+		}
 		len -= thisLen;
+		updateActivationState(thisLen);
 	}
 }
 
 template <class Sample>
 template <class O>
 void RendererImpl<Sample>::doRenderAndConvertStreams(const DACOutputStreams<O> &streams, Bit32u len) {
-	Sample cnvNonReverbLeft[MAX_SAMPLES_PER_RUN], cnvNonReverbRight[MAX_SAMPLES_PER_RUN];
-	Sample cnvReverbDryLeft[MAX_SAMPLES_PER_RUN], cnvReverbDryRight[MAX_SAMPLES_PER_RUN];
-	Sample cnvReverbWetLeft[MAX_SAMPLES_PER_RUN], cnvReverbWetRight[MAX_SAMPLES_PER_RUN];
-
 	const DACOutputStreams<Sample> cnvStreams = {
-		cnvNonReverbLeft, cnvNonReverbRight,
-		cnvReverbDryLeft, cnvReverbDryRight,
-		cnvReverbWetLeft, cnvReverbWetRight
+		conversionBuffer, conversionBuffer + maxBlockLength,
+		conversionBuffer + 2 * maxBlockLength, conversionBuffer + 3 * maxBlockLength,
+		conversionBuffer + 4 * maxBlockLength, conversionBuffer + 5 * maxBlockLength
 	};
 
 	DACOutputStreams<O> tmpStreams = streams;
 
 	while (len > 0) {
-		Bit32u thisPassLen = len > MAX_SAMPLES_PER_RUN ? MAX_SAMPLES_PER_RUN : len;
+		Bit32u thisPassLen = len > maxBlockLength ? maxBlockLength : len;
+		doRenderStreams(cnvStreams, thisPassLen);
+		{
+			StageTimer conversionTimer(statistics.sampleFormatConversionTime);
+			convertStreamsFormat(cnvStreams, tmpStreams, thisPassLen);
+		}
+		advanceStreams(tmpStreams, thisPassLen);
+		len -= thisPassLen;
+	}
+}
+
+template <class Sample>
+template <class O>
+void RendererImpl<Sample>::doRenderAndConvertStreams(const PartOutputStreams<O> &streams, Bit32u len) {
+	// Skipped streams are also skipped when rendering, so that their post-processing is avoided.
+	PartOutputStreams<Sample> cnvStreams;
+	for (int partNum = 0; partNum < 9; partNum++) {
+		cnvStreams.partLeft[partNum] = streams.partLeft[partNum] == NULL ? NULL : conversionBuffer + 2 * partNum * partStreamsConversionLength;
+		cnvStreams.partRight[partNum] = streams.partRight[partNum] == NULL ? NULL : conversionBuffer + (2 * partNum + 1) * partStreamsConversionLength;
+	}
+	cnvStreams.reverbWetLeft = streams.reverbWetLeft == NULL ? NULL : conversionBuffer + 2 * 9 * partStreamsConversionLength;
+	cnvStreams.reverbWetRight = streams.reverbWetRight == NULL ? NULL : conversionBuffer + (2 * 9 + 1) * partStreamsConversionLength;
+
+	PartOutputStreams<O> tmpStreams = streams;
+
+	while (len > 0) {
+		Bit32u thisPassLen = len > partStreamsConversionLength ? partStreamsConversionLength : len;
 		doRenderStreams(cnvStreams, thisPassLen);
-		convertStreamsFormat(cnvStreams, tmpStreams, thisPassLen);
+		{
+			StageTimer conversionTimer(statistics.sampleFormatConversionTime);
+			convertStreamsFormat(cnvStreams, tmpStreams, thisPassLen);
+		}
 		advanceStreams(tmpStreams, thisPassLen);
 		len -= thisPassLen;
 	}
@@ -2185,9 +4203,53 @@ void RendererImpl<FloatSample>::renderStreams(const DACOutputStreams<FloatSample
 	doRenderStreams(streams, len);
 }
 
+template<>
+void RendererImpl<IntSample>::renderPartStreams(const PartOutputStreams<IntSample> &streams, Bit32u len) {
+	doRenderStreams(streams, len);
+}
+
+template<>
+void RendererImpl<IntSample>::renderPartStreams(const PartOutputStreams<FloatSample> &streams, Bit32u len) {
+	doRenderAndConvertStreams(streams, len);
+}
+
+template<>
+void RendererImpl<FloatSample>::renderPartStreams(const PartOutputStreams<IntSample> &streams, Bit32u len) {
+	doRenderAndConvertStreams(streams, len);
+}
+
+template<>
+void RendererImpl<FloatSample>::renderPartStreams(const PartOutputStreams<FloatSample> &streams, Bit32u len) {
+	doRenderStreams(streams, len);
+}
+
+template <class Sample>
+void RendererImpl<Sample>::fastForward(Bit32u len) {
+	// Without the LA32 output, the reverb input is unknown, so the reverb tail is dropped rather than left stale.
+	resetReverbPipeline();
+	if (synth.isReverbEnabled()) getReverbModel().mute();
+	fastForwarding = true;
+	doRenderStreams(tmpBuffers, len);
+	fastForwarding = false;
+}
+
+void Synth::fastForward(Bit32u len) {
+	if (opened) {
+		StageTimer renderTimer(renderer->getStatistics().totalTime);
+		RealtimeScope realtimeScope("Synth::fastForward");
+		DenormalFlushScope denormalFlushScope(extensions.denormalFlushingEnabled);
+		renderer->fastForward(len);
+		recordRenderCall(extensions, SessionRenderCallType_FAST_FORWARD, len);
+	}
+}
+
 template <class S>
 static inline void renderStreams(bool opened, Renderer *renderer, const DACOutputStreams<S> &streams, Bit32u len) {
 	if (opened) {
+		StageTimer renderTimer(renderer->getStatistics().totalTime);
+		RealtimeScope realtimeScope("Synth::renderStreams");
+		DenormalFlushScope denormalFlushScope(renderer->isDenormalFlushingEnabled());
+		TraceZone traceZone("Synth::renderStreams", renderer->getRenderedSampleCount());
 		renderer->renderStreams(streams, len);
 	} else {
 		muteStreams(streams, len);
@@ -2196,10 +4258,35 @@ static inline void renderStreams(bool opened, Renderer *renderer, const DACOutpu
 
 void Synth::renderStreams(const DACOutputStreams<Bit16s> &streams, Bit32u len) {
 	MT32Emu::renderStreams(opened, renderer, streams, len);
+	recordRenderCall(extensions, SessionRenderCallType_DAC_STREAMS_BIT16S, len);
 }
 
 void Synth::renderStreams(const DACOutputStreams<float> &streams, Bit32u len) {
 	MT32Emu::renderStreams(opened, renderer, streams, len);
+	recordRenderCall(extensions, SessionRenderCallType_DAC_STREAMS_FLOAT, len);
+}
+
+template <class S>
+static inline void renderPartStreams(bool opened, Renderer *renderer, const PartOutputStreams<S> &streams, Bit32u len) {
+	if (opened) {
+		StageTimer renderTimer(renderer->getStatistics().totalTime);
+		RealtimeScope realtimeScope("Synth::renderPartStreams");
+		DenormalFlushScope denormalFlushScope(renderer->isDenormalFlushingEnabled());
+		TraceZone traceZone("Synth::renderPartStreams", renderer->getRenderedSampleCount());
+		renderer->renderPartStreams(streams, len);
+	} else {
+		muteStreams(streams, len);
+	}
+}
+
+void Synth::renderPartStreams(const PartOutputStreams<Bit16s> &streams, Bit32u len) {
+	MT32Emu::renderPartStreams(opened, renderer, streams, len);
+	recordRenderCall(extensions, SessionRenderCallType_PART_STREAMS_BIT16S, len);
+}
+
+void Synth::renderPartStreams(const PartOutputStreams<float> &streams, Bit32u len) {
+	MT32Emu::renderPartStreams(opened, renderer, streams, len);
+	recordRenderCall(extensions, SessionRenderCallType_PART_STREAMS_FLOAT, len);
 }
 
 void Synth::renderStreams(
@@ -2230,77 +4317,57 @@ void Synth::renderStreams(
 	renderStreams(streams, len);
 }
 
-// In GENERATION2 units, the output from LA32 goes to the Boss chip already bit-shifted.
-// In NICE mode, it's also better to increase volume before the reverb processing to preserve accuracy.
-template <>
-void RendererImpl<IntSample>::produceLA32Output(IntSample *buffer, Bit32u len) {
-	switch (synth.getDACInputMode()) {
-		case DACInputMode_GENERATION2:
-			while (len--) {
-				*buffer = (*buffer & 0x8000) | ((*buffer << 1) & 0x7FFE) | ((*buffer >> 14) & 0x0001);
-				++buffer;
-			}
-			break;
-		case DACInputMode_NICE:
-			while (len--) {
-				*buffer = Synth::clipSampleEx(IntSampleEx(*buffer) << 1);
-				++buffer;
-			}
-			break;
-		default:
-			break;
-	}
-}
-
-template <>
-void RendererImpl<IntSample>::convertSamplesToOutput(IntSample *buffer, Bit32u len) {
-	if (synth.getDACInputMode() == DACInputMode_GENERATION1) {
-		while (len--) {
-			*buffer = IntSample((*buffer & 0x8000) | ((*buffer << 1) & 0x7FFE));
-			++buffer;
-		}
+template <class Sample>
+void RendererImpl<Sample>::updateDACInputKernels() {
+	const DACInputMode newDACInputMode = getDACInputMode();
+	if (newDACInputMode != dacInputMode) {
+		dacInputMode = newDACInputMode;
+		dacInputKernels = &SampleFormatKernels::getDACInputKernels<Sample>(newDACInputMode);
 	}
 }
 
-static inline float produceDistortedSample(float sample) {
-	// Here we roughly simulate the distortion caused by the DAC bit shift.
-	if (sample < -1.0f) {
-		return sample + 2.0f;
-	} else if (1.0f < sample) {
-		return sample - 2.0f;
+// Renders the active partials to separate mono buffers in worker threads. Returns the number of rendered partials, their indices,
+// reverb flags and owner parts are stored in partialIndices, partialReverbFlags and partialOwnerParts respectively.
+template <class Sample>
+Bit32u RendererImpl<Sample>::renderPartialsConcurrently(Bit32u len) {
+	PartialManager &partialManager = getPartialManager();
+
+	// Only partials that produce output are rendered, ring modulating slaves are rendered along with their masters.
+	// Neither may get activated or become a slave during rendering, hence the list is exactly the same as
+	// if partials were rendered serially. The active partial list is filtered in place.
+	const Bit32u activePartialCount = partialManager.getActivePartials(partialIndices);
+	Bit32u renderedPartialCount = 0;
+	for (Bit32u partialIx = 0; partialIx < activePartialCount; partialIx++) {
+		const Bit32u i = partialIndices[partialIx];
+		const Partial *partial = partialManager.getPartial(i);
+		if (!partial->isActive() || partial->isRingModulatingSlave()) continue;
+		partialIndices[renderedPartialCount] = i;
+		partialReverbFlags[renderedPartialCount] = partialManager.shouldReverb(i);
+		partialOwnerParts[renderedPartialCount] = Bit8u(partial->getOwnerPart());
+		renderedPartialCount++;
 	}
-	return sample;
-}
+	if (renderedPartialCount == 0) return 0;
 
-template <>
-void RendererImpl<FloatSample>::produceLA32Output(FloatSample *buffer, Bit32u len) {
-	switch (synth.getDACInputMode()) {
-	case DACInputMode_NICE:
-		// Note, we do not do any clamping for floats here to avoid introducing distortions.
-		// This means that the output signal may actually overshoot the unity when the volume is set too high.
-		// We leave it up to the consumer whether the output is to be clamped or properly normalised further on.
-		while (len--) {
-			*buffer *= 2.0f;
-			buffer++;
-		}
-		break;
-	case DACInputMode_GENERATION2:
-		while (len--) {
-			*buffer = produceDistortedSample(2.0f * *buffer);
-			buffer++;
-		}
-		break;
-	default:
-		break;
+	PartialRenderingJob<Sample> job(partialManager, partialIndices, partialOutputLengths, partialOutputBuffers, maxBlockLength, len);
+	getPartialRenderingThreadPool()->runJob(job, renderedPartialCount);
+	for (Bit32u partialIx = 0; partialIx < renderedPartialCount; partialIx++) {
+		partialManager.accountRenderCost(partialIndices[partialIx], partialStatistics);
 	}
+	return renderedPartialCount;
 }
 
-template <>
-void RendererImpl<FloatSample>::convertSamplesToOutput(FloatSample *buffer, Bit32u len) {
-	if (synth.getDACInputMode() == DACInputMode_GENERATION1) {
-		while (len--) {
-			*buffer = produceDistortedSample(2.0f * *buffer);
-			buffer++;
+template <class Sample>
+void RendererImpl<Sample>::producePartialOutputConcurrently(Sample *nonReverbLeft, Sample *nonReverbRight, Sample *reverbDryLeft, Sample *reverbDryRight, Bit32u len) {
+	PartialManager &partialManager = getPartialManager();
+	const Bit32u renderedPartialCount = renderPartialsConcurrently(len);
+	for (Bit32u partialIx = 0; partialIx < renderedPartialCount; partialIx++) {
+		const Bit32u i = partialIndices[partialIx];
+		partialManager.completeDeactivation(i);
+		const Sample *buffer = partialOutputBuffers + partialIx * maxBlockLength;
+		if (partialReverbFlags[partialIx]) {
+			partialManager.mixOutput(i, reverbDryLeft, reverbDryRight, buffer, partialOutputLengths[partialIx]);
+		} else {
+			partialManager.mixOutput(i, nonReverbLeft, nonReverbRight, buffer, partialOutputLengths[partialIx]);
 		}
 	}
 }
@@ -2308,6 +4375,8 @@ void RendererImpl<FloatSample>::convertSamplesToOutput(FloatSample *buffer, Bit3
 template <class Sample>
 void RendererImpl<Sample>::produceStreams(const DACOutputStreams<Sample> &streams, Bit32u len) {
 	if (isActivated()) {
+		updateDACInputKernels();
+
 		// Even if LA32 output isn't desired, we proceed anyway with temp buffers
 		Sample *nonReverbLeft = streams.nonReverbLeft == NULL ? tmpNonReverbLeft : streams.nonReverbLeft;
 		Sample *nonReverbRight = streams.nonReverbRight == NULL ? tmpNonReverbRight : streams.nonReverbRight;
@@ -2319,19 +4388,53 @@ void RendererImpl<Sample>::produceStreams(const DACOutputStreams<Sample> &stream
 		Synth::muteSampleBuffer(reverbDryLeft, len);
 		Synth::muteSampleBuffer(reverbDryRight, len);
 
-		for (unsigned int i = 0; i < synth.getPartialCount(); i++) {
-			if (getPartialManager().shouldReverb(i)) {
-				getPartialManager().produceOutput(i, reverbDryLeft, reverbDryRight, len);
+		{
+			StageTimer la32Timer(statistics.la32Time);
+			RealtimeScope realtimeScope("LA32");
+			TraceZone traceZone("LA32", getRenderedSampleCount());
+			if (partialOutputBuffers != NULL) {
+				producePartialOutputConcurrently(nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, len);
 			} else {
-				getPartialManager().produceOutput(i, nonReverbLeft, nonReverbRight, len);
+				const Bit32u activePartialCount = getPartialManager().getActivePartials(partialIndices);
+				for (Bit32u partialIx = 0; partialIx < activePartialCount; partialIx++) {
+					const Bit32u i = partialIndices[partialIx];
+					if (getPartialManager().shouldReverb(i)) {
+						getPartialManager().produceOutput(i, reverbDryLeft, reverbDryRight, len);
+					} else {
+						getPartialManager().produceOutput(i, nonReverbLeft, nonReverbRight, len);
+					}
+					getPartialManager().accountRenderCost(i, partialStatistics);
+				}
 			}
 		}
 
 		produceLA32Output(reverbDryLeft, len);
 		produceLA32Output(reverbDryRight, len);
 
-		if (synth.isReverbEnabled()) {
-			if (!getReverbModel().process(reverbDryLeft, reverbDryRight, streams.reverbWetLeft, streams.reverbWetRight, len)) {
+		if (reverbPipeline != NULL) {
+			// After the part streams have been rendered, the pipeline is already reset and filled with silence.
+			reverbPipelineBypassed = false;
+			bool processed;
+			{
+				StageTimer reverbTimer(statistics.reverbTime);
+				TraceZone traceZone("reverb", getRenderedSampleCount());
+				BReverbModel *reverbModel = synth.isReverbEnabled() ? &getReverbModel() : NULL;
+				processed = reverbPipeline->process(reverbModel, getReverbInput(reverbDryLeft), getReverbInput(reverbDryRight), streams.reverbWetLeft, streams.reverbWetRight, len);
+			}
+			if (!processed) {
+				printDebug("RendererImpl: Invalid call to BReverbModel::process()!\n");
+			}
+			if (streams.reverbWetLeft != NULL) convertSamplesToOutput(streams.reverbWetLeft, len);
+			if (streams.reverbWetRight != NULL) convertSamplesToOutput(streams.reverbWetRight, len);
+			reverbPipeline->delayStreams(nonReverbLeft, nonReverbRight, reverbDryLeft, reverbDryRight, len);
+		} else if (synth.isReverbEnabled()) {
+			bool processed;
+			{
+				StageTimer reverbTimer(statistics.reverbTime);
+				TraceZone traceZone("reverb", getRenderedSampleCount());
+				processed = getReverbModel().process(getReverbInput(reverbDryLeft), getReverbInput(reverbDryRight), streams.reverbWetLeft, streams.reverbWetRight, len);
+			}
+			if (!processed) {
 				printDebug("RendererImpl: Invalid call to BReverbModel::process()!\n");
 			}
 			if (streams.reverbWetLeft != NULL) convertSamplesToOutput(streams.reverbWetLeft, len);
@@ -2342,14 +4445,8 @@ void RendererImpl<Sample>::produceStreams(const DACOutputStreams<Sample> &stream
 		}
 
 		// Don't bother with conversion if the output is going to be unused
-		if (streams.nonReverbLeft != NULL) {
-			produceLA32Output(nonReverbLeft, len);
-			convertSamplesToOutput(nonReverbLeft, len);
-		}
-		if (streams.nonReverbRight != NULL) {
-			produceLA32Output(nonReverbRight, len);
-			convertSamplesToOutput(nonReverbRight, len);
-		}
+		if (streams.nonReverbLeft != NULL) produceDACOutput(nonReverbLeft, len);
+		if (streams.nonReverbRight != NULL) produceDACOutput(nonReverbRight, len);
 		if (streams.reverbDryLeft != NULL) convertSamplesToOutput(reverbDryLeft, len);
 		if (streams.reverbDryRight != NULL) convertSamplesToOutput(reverbDryRight, len);
 	} else {
@@ -2360,13 +4457,122 @@ void RendererImpl<Sample>::produceStreams(const DACOutputStreams<Sample> &stream
 	incRenderedSampleCount(len);
 }
 
+template <class Sample>
+void RendererImpl<Sample>::produceStreams(const PartOutputStreams<Sample> &streams, Bit32u len) {
+	if (isActivated()) {
+		updateDACInputKernels();
+
+		if (reverbPipeline != NULL && !reverbPipelineBypassed) {
+			// The reverb is processed synchronously, hence the pending input is processed and the delayed output is dropped.
+			flushReverbPipeline();
+			reverbPipeline->reset();
+			reverbPipelineBypassed = true;
+		}
+
+		PartialManager &partialManager = getPartialManager();
+		const bool concurrent = partialOutputBuffers != NULL;
+		Synth::muteSampleBuffer(tmpReverbDryLeft, len);
+		Synth::muteSampleBuffer(tmpReverbDryRight, len);
+
+		{
+			StageTimer la32Timer(statistics.la32Time);
+			RealtimeScope realtimeScope("LA32");
+			TraceZone traceZone("LA32", getRenderedSampleCount());
+			Bit32u partialCount;
+			if (concurrent) {
+				partialCount = renderPartialsConcurrently(len);
+				for (Bit32u partialIx = 0; partialIx < partialCount; partialIx++) {
+					partialManager.completeDeactivation(partialIndices[partialIx]);
+				}
+			} else {
+				partialCount = partialManager.getActivePartials(partialIndices);
+			}
+			// The partials are rendered (or mixed) part by part, the skipped parts are rendered to a temp buffer
+			// as they may still feed the reverb. The partials sent to reverb go first, so that their sum makes
+			// the reverb input of the part. Either way, the output doesn't depend on the number of rendering threads.
+			for (Bit32u partNum = 0; partNum < 9; partNum++) {
+				Sample *partLeft = streams.partLeft[partNum] == NULL ? tmpNonReverbLeft : streams.partLeft[partNum];
+				Sample *partRight = streams.partRight[partNum] == NULL ? tmpNonReverbRight : streams.partRight[partNum];
+				Synth::muteSampleBuffer(partLeft, len);
+				Synth::muteSampleBuffer(partRight, len);
+				for (int pass = 0; pass < 2; pass++) {
+					const bool reverbPass = pass == 0;
+					bool reverbSent = false;
+					for (Bit32u partialIx = 0; partialIx < partialCount; partialIx++) {
+						const Bit32u i = partialIndices[partialIx];
+						if (concurrent) {
+							if (partialOwnerParts[partialIx] != partNum || partialReverbFlags[partialIx] != reverbPass) continue;
+							const Sample *buffer = partialOutputBuffers + partialIx * maxBlockLength;
+							partialManager.mixOutput(i, partLeft, partRight, buffer, partialOutputLengths[partialIx]);
+						} else {
+							// The ring modulating slaves are deactivated along with their masters, so they are skipped.
+							if (partialManager.getPartial(i)->getOwnerPart() != int(partNum) || partialManager.shouldReverb(i) != reverbPass) continue;
+							partialManager.produceOutput(i, partLeft, partRight, len);
+							partialManager.accountRenderCost(i, partialStatistics);
+						}
+						reverbSent = reverbPass;
+					}
+					if (reverbSent) {
+						mixSampleBuffer(tmpReverbDryLeft, partLeft, len);
+						mixSampleBuffer(tmpReverbDryRight, partRight, len);
+					}
+				}
+			}
+		}
+
+		produceLA32Output(tmpReverbDryLeft, len);
+		produceLA32Output(tmpReverbDryRight, len);
+
+		if (synth.isReverbEnabled()) {
+			bool processed;
+			{
+				StageTimer reverbTimer(statistics.reverbTime);
+				TraceZone traceZone("reverb", getRenderedSampleCount());
+				processed = getReverbModel().process(getReverbInput(tmpReverbDryLeft), getReverbInput(tmpReverbDryRight), streams.reverbWetLeft, streams.reverbWetRight, len);
+			}
+			if (!processed) {
+				printDebug("RendererImpl: Invalid call to BReverbModel::process()!\n");
+			}
+			if (streams.reverbWetLeft != NULL) convertSamplesToOutput(streams.reverbWetLeft, len);
+			if (streams.reverbWetRight != NULL) convertSamplesToOutput(streams.reverbWetRight, len);
+		} else {
+			Synth::muteSampleBuffer(streams.reverbWetLeft, len);
+			Synth::muteSampleBuffer(streams.reverbWetRight, len);
+		}
+
+		for (int partNum = 0; partNum < 9; partNum++) {
+			if (streams.partLeft[partNum] != NULL) produceDACOutput(streams.partLeft[partNum], len);
+			if (streams.partRight[partNum] != NULL) produceDACOutput(streams.partRight[partNum], len);
+		}
+	} else {
+		muteStreams(streams, len);
+	}
+
+	getPartialManager().clearAlreadyOutputed();
+	incRenderedSampleCount(len);
+}
+
+template <class Sample>
+void RendererImpl<Sample>::skipStreams(Bit32u len) {
+	if (isActivated()) {
+		StageTimer la32Timer(statistics.la32Time);
+		const Bit32u activePartialCount = getPartialManager().getActivePartials(partialIndices);
+		for (Bit32u partialIx = 0; partialIx < activePartialCount; partialIx++) {
+			getPartialManager().fastForward(partialIndices[partialIx], len);
+		}
+	}
+
+	getPartialManager().clearAlreadyOutputed();
+	incRenderedSampleCount(len);
+}
+
 void Synth::printPartialUsage(Bit32u sampleOffset) {
 	unsigned int partialUsage[9];
 	partialManager->getPerPartPartialUsage(partialUsage);
 	if (sampleOffset > 0) {
-		printDebug("[+%u] Partial Usage: 1:%02d 2:%02d 3:%02d 4:%02d 5:%02d 6:%02d 7:%02d 8:%02d R: %02d  TOTAL: %02d", sampleOffset, partialUsage[0], partialUsage[1], partialUsage[2], partialUsage[3], partialUsage[4], partialUsage[5], partialUsage[6], partialUsage[7], partialUsage[8], getPartialCount() - partialManager->getFreePartialCount());
+		printDebug("[+%u] Partial Usage: 1:%02d 2:%02d 3:%02d 4:%02d 5:%02d 6:%02d 7:%02d 8:%02d R: %02d  TOTAL: %02d", sampleOffset, partialUsage[0], partialUsage[1], partialUsage[2], partialUsage[3], partialUsage[4], partialUsage[5], partialUsage[6], partialUsage[7], partialUsage[8], partialManager->getActivePartialCount());
 	} else {
-		printDebug("Partial Usage: 1:%02d 2:%02d 3:%02d 4:%02d 5:%02d 6:%02d 7:%02d 8:%02d R: %02d  TOTAL: %02d", partialUsage[0], partialUsage[1], partialUsage[2], partialUsage[3], partialUsage[4], partialUsage[5], partialUsage[6], partialUsage[7], partialUsage[8], getPartialCount() - partialManager->getFreePartialCount());
+		printDebug("Partial Usage: 1:%02d 2:%02d 3:%02d 4:%02d 5:%02d 6:%02d 7:%02d 8:%02d R: %02d  TOTAL: %02d", partialUsage[0], partialUsage[1], partialUsage[2], partialUsage[3], partialUsage[4], partialUsage[5], partialUsage[6], partialUsage[7], partialUsage[8], partialManager->getActivePartialCount());
 	}
 }
 
@@ -2374,7 +4580,7 @@ bool Synth::hasActivePartials() const {
 	if (!opened) {
 		return false;
 	}
-	for (unsigned int partialNum = 0; partialNum < getPartialCount(); partialNum++) {
+	for (unsigned int partialNum = 0; partialNum < getMaxPartialCount(); partialNum++) {
 		if (partialManager->getPartial(partialNum)->isActive()) {
 			return true;
 		}
@@ -2382,6 +4588,13 @@ bool Synth::hasActivePartials() const {
 	return false;
 }
 
+Bit32u Synth::getMinRemainingPartialSampleCount() const {
+	if (!opened || !midiQueue->isEmpty()) {
+		return 0;
+	}
+	return partialManager->getActivePartialCount() > 0 ? partialManager->getMinRemainingSampleCount() : 0;
+}
+
 bool Synth::isActive() {
 	if (!opened) {
 		return false;
@@ -2389,17 +4602,101 @@ bool Synth::isActive() {
 	if (!midiQueue->isEmpty() || hasActivePartials()) {
 		return true;
 	}
+	flushReverbPipeline();
 	if (isReverbEnabled() && reverbModel->isActive()) {
 		return true;
 	}
+	if (!renderer->isReverbPipelineDrained()) {
+		return true;
+	}
+	renderer->resetReverbPipeline();
 	activated = false;
 	return false;
 }
 
+bool Synth::getRenderStatistics(RenderStatistics &statistics) const {
+#if MT32EMU_WITH_RENDER_STATISTICS
+	if (opened) {
+		statistics = renderer->getStatistics();
+		statistics.degradationLevel = extensions.degradationLevel;
+		return true;
+	}
+#endif
+	memset(&statistics, 0, sizeof(statistics));
+	if (opened) {
+		// The degradation is reported regardless, as the realtime hosts rely on it.
+		const RenderStatistics &rendererStatistics = renderer->getStatistics();
+		statistics.degradationLevel = extensions.degradationLevel;
+		statistics.degradationLevelChangeCount = rendererStatistics.degradationLevelChangeCount;
+		statistics.degradedSampleCount = rendererStatistics.degradedSampleCount;
+	}
+	return false;
+}
+
+bool Synth::getPartialRenderStatistics(PartialRenderStatistics &statistics) const {
+#if MT32EMU_WITH_RENDER_STATISTICS
+	if (opened) {
+		statistics = renderer->getPartialStatistics();
+		return true;
+	}
+#endif
+	memset(&statistics, 0, sizeof(statistics));
+	return false;
+}
+
+void Synth::resetRenderStatistics() {
+	if (opened) renderer->resetStatistics();
+	if (midiQueue != NULL) midiQueue->resetStatistics();
+}
+
 Bit32u Synth::getPartialCount() const {
 	return partialCount;
 }
 
+void Synth::setHotMemoryLockingEnabled(bool enabled) {
+	extensions.hotMemoryLockingEnabled = enabled;
+}
+
+bool Synth::isHotMemoryLockingEnabled() const {
+	return extensions.hotMemoryLockingEnabled;
+}
+
+bool Synth::isHotMemoryLocked() const {
+	if (!opened || !extensions.hotMemoryEnabled) return false;
+	if (!extensions.arena.isLocked() || !extensions.romSet->isPCMROMDataLocked() || !renderer->isMemoryLocked()) return false;
+	for (int i = REVERB_MODE_ROOM; i <= REVERB_MODE_TAP_DELAY; i++) {
+		if (reverbModels[i] != NULL && !reverbModels[i]->isMemoryLocked()) return false;
+	}
+	return true;
+}
+
+void Synth::setMaxPartialCount(Bit32u maxPartialCount) {
+	extensions.maxPartialCount = maxPartialCount;
+}
+
+Bit32u Synth::getMaxPartialCount() const {
+	if (opened) return extensions.partialCapacity;
+	return partialCount < extensions.maxPartialCount ? extensions.maxPartialCount : partialCount;
+}
+
+bool Synth::resizePartialPool(Bit32u newPartialCount) {
+	if (!opened || newPartialCount == 0 || newPartialCount > extensions.partialCapacity) return false;
+	if (newPartialCount != partialCount) {
+		partialManager->resizePool(partialCount, newPartialCount);
+		partialCount = newPartialCount;
+	}
+	return true;
+}
+
+void Synth::setPartialLimit(Bit32u partialLimit) {
+	extensions.partialLimit = partialLimit;
+}
+
+Bit32u Synth::getPartialLimit() const {
+	const Bit32u partialLimit = extensions.partialLimit;
+	return (partialLimit == 0 || partialLimit > partialCount) ? partialCount : partialLimit;
+}
+
 void Synth::getPartStates(bool *partStates) const {
 	if (!opened) {
 		memset(partStates, 0, 9 * sizeof(bool));
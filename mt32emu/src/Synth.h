@@ -31,6 +31,7 @@ namespace MT32Emu {
 class Analog;
 class BReverbModel;
 class Extensions;
+struct MemoryRefreshBatch;
 class MemoryRegion;
 class MidiEventQueue;
 class Part;
@@ -39,6 +40,9 @@ class Partial;
 class PartialManager;
 class Renderer;
 class ROMImage;
+class ROMSet;
+class StateReader;
+class StateWriter;
 
 class PatchTempMemoryRegion;
 class RhythmTempMemoryRegion;
@@ -51,8 +55,10 @@ class ResetMemoryRegion;
 
 struct ControlROMFeatureSet;
 struct ControlROMMap;
+struct ControlROMPCMStruct;
 struct PCMWaveEntry;
 struct MemParams;
+struct TimbreParam;
 
 const Bit8u SYSEX_MANUFACTURER_ROLAND = 0x41;
 
@@ -82,6 +88,147 @@ struct DACOutputStreams {
 	T *reverbWetRight;
 };
 
+// Set of output streams that carry the output of each part separately, see Synth::renderPartStreams().
+// Parts 0-7 are the melodic parts, part 8 is the rhythm part.
+template <class T>
+struct PartOutputStreams {
+	T *partLeft[9];
+	T *partRight[9];
+	T *reverbWetLeft;
+	T *reverbWetRight;
+};
+
+// Describes where the stereo output goes in buffers provided by the caller. The samples of each channel are written starting
+// at the respective pointer, the pointers are advanced by stride samples per frame. So, stride 2 with right pointing to the sample
+// following left describes an interleaved stereo buffer, stride 1 describes a pair of planar buffers, and a larger stride allows
+// writing a stereo pair into frames of a multichannel buffer. When accumulate is true, the output is multiplied by gain and added
+// to the samples already in the buffers (with clipping for 16-bit samples), so that several synths can be mixed into a shared bus
+// without a scratch buffer. Otherwise, the buffers are overwritten and gain is ignored. NULL in place of left skips the output.
+// For the 16-bit output, the gain is limited to 256 and quantised to 1/256.
+template <class T>
+struct StereoOutputDescriptor {
+	T *left;
+	T *right;
+	Bit32u stride;
+	bool accumulate;
+	float gain;
+};
+
+// Cumulative time spent in the stages of the rendering pipeline since the synth was opened or the statistics were reset.
+// The times are measured in seconds only when the library is built with MT32EMU_WITH_RENDER_STATISTICS.
+struct RenderStatistics {
+	// Number of samples rendered at the native sample rate 32000 Hz. Wraps around as getInternalRenderedSampleCount() does.
+	Bit32u renderedSampleCount;
+	// Number of MIDI events played from the MIDI event queue.
+	Bit32u midiEventCount;
+	// Total time spent in render() and renderStreams(), including all the stages below.
+	double totalTime;
+	// Time spent generating and mixing the output of the LA32 partials.
+	double la32Time;
+	// Time spent in the reverb model.
+	double reverbTime;
+	// Time spent in the analog circuitry emulation.
+	double analogTime;
+	// Time spent converting samples between the integer and the float format.
+	double sampleFormatConversionTime;
+	// Time spent playing MIDI events from the MIDI event queue.
+	double midiEventDispatchTime;
+	// The degradation level in effect when the statistics are retrieved, see DegradationLevel.
+	Bit32u degradationLevel;
+	// Number of times the degradation level has been changed.
+	Bit32u degradationLevelChangeCount;
+	// Number of samples rendered with any degradation in effect. Wraps around as renderedSampleCount does.
+	Bit32u degradedSampleCount;
+};
+
+// Cumulative cost of generating the output of the LA32 partials since the synth was opened or the statistics were reset,
+// attributed to the parts owning the partials and to the kinds of the partials. A partial that ring modulates its slave
+// is rendered along with the slave, so the pair is accounted once, as a ring modulated partial. The sample counts
+// are the lengths of the rendering passes the partials took part in and wrap around. The times are measured in seconds
+// only when the library is built with MT32EMU_WITH_RENDER_STATISTICS.
+struct PartialRenderStatistics {
+	// Indexed by the part number, the rhythm part goes last.
+	Bit32u partSampleCount[9];
+	double partTime[9];
+	// Partials that generate a square or sawtooth wave on their own.
+	Bit32u synthSampleCount;
+	double synthTime;
+	// Partials that play a PCM sample on their own.
+	Bit32u pcmSampleCount;
+	double pcmTime;
+	// Partials that ring modulate their slaves, either kind.
+	Bit32u ringModulatedSampleCount;
+	double ringModulatedTime;
+};
+
+// Telemetry of the MIDI event queue since the queue was created or the statistics were reset, see Synth::getMIDIEventQueueStatistics().
+// The counters are updated by the producing and the rendering threads without synchronisation, so the values may be slightly
+// inconsistent when read concurrently. All the counters wrap around.
+struct MIDIEventQueueStatistics {
+	// The maximum number of events pending in the queue, as seen by the rendering thread upon processing an event.
+	Bit32u eventCountHighWaterMark;
+	// Number of events refused because the queue was full. Each refused attempt counts, including the retries requested
+	// by ReportHandler::onMIDIQueueOverflow().
+	Bit32u overflowEventCount;
+	// Number of SysEx events refused because the preallocated SysEx storage buffer had no room for the data.
+	Bit32u sysexStorageOverflowCount;
+	// The amount of the preallocated SysEx storage buffer in bytes occupied by the pending SysEx events, and the maximum
+	// amount occupied so far. Both are zero when the SysEx data is stored in buffers allocated on demand instead,
+	// see Synth::configureMIDIEventQueueSysexStorage().
+	Bit32u sysexStorageUsage;
+	Bit32u sysexStorageHighWaterMark;
+	// Number of events played later than their timestamps, i.e. the events that arrived when the synth had already rendered
+	// past the timestamp. With a MIDI event timing quantum set, the lateness is measured from the grid point the event
+	// would be postponed to. Like in Synth::getMaxMIDIEventTimingError(), the events held up until partials are freed
+	// don't count, but note, the sample that follows each note-on before the next event is played adds to the lateness.
+	Bit32u lateEventCount;
+	// Histogram of the lateness of the late events. The element i counts the events played late by at least 2^i samples
+	// but less than 2^(i+1) samples at the native sample rate 32000 Hz, the last one counts all the events late by 2^15 samples (about 1 second) or more.
+	Bit32u latenessHistogram[16];
+};
+
+// Breakdown of the memory in bytes allocated by a synth instance by subsystem, see Synth::getMemoryUsage().
+// The subsystems that are only created upon opening report zero while the synth is closed.
+struct MemoryUsage {
+	// The decoded PCM ROM samples and the wave list. These are shared by the synths open with the same ROM pair,
+	// hence not included in the total.
+	size_t sharedPCMROM;
+	// The PCM ROM samples memory-mapped from the cache file instead, see setROMCacheDirectory(). Not included in the total.
+	size_t mappedPCMROM;
+	// The emulated memory of the device along with the memory regions that provide access to it.
+	size_t memoryRegions;
+	// The partial manager with the partials, their components and the polys, as well as the parts.
+	size_t partials;
+	// The ring buffer of the MIDI event queue along with the preallocated SysEx storage buffer.
+	size_t midiEventQueue;
+	// The SysEx data buffers the MIDI event queue allocates on demand, if the storage buffer isn't preallocated.
+	size_t sysexBuffers;
+	// The reverb models indexed by ReverbMode, including their buffers. The models not created so far report zero.
+	size_t reverbModels[4];
+	// The analog circuitry emulation including the LPFs.
+	size_t analog;
+	// The renderer with its temporary buffers, including those for rendering the partials and the reverb concurrently.
+	size_t renderer;
+	// A SampleRateConverter processing the output of the synth. Synth::getMemoryUsage() always reports zero here,
+	// as the synth doesn't know about the converters. The C interface fills in the converter of the context though.
+	size_t sampleRateConverter;
+	// The synth object itself and the rest of the data it keeps, e.g. the snapshot of the state upon opening.
+	size_t synth;
+	// The sum of all the above except for the PCM ROM.
+	size_t total;
+};
+
+// Describes a single MIDI event to be enqueued along with others using Synth::playEvents().
+struct MIDIEvent {
+	// The time to play the event at, measured the same way as with Synth::playMsg(Bit32u, Bit32u).
+	Bit32u timestamp;
+	// A short MIDI message containing a status byte. Ignored when sysexData is not NULL.
+	Bit32u shortMessage;
+	// A well formed System Exclusive MIDI message or NULL if the event represents a short MIDI message.
+	const Bit8u *sysexData;
+	Bit32u sysexLength;
+};
+
 // Class for the client to supply callbacks for reporting various errors and information
 class MT32EMU_EXPORT ReportHandler {
 public:
@@ -114,16 +261,22 @@ public:
 };
 
 class Synth {
+friend class AsyncOpenJob;
 friend class DefaultMidiStreamParser;
+friend class InternalResampler;
 friend class MemoryRegion;
+friend class OutputFanOut;
 friend class Part;
 friend class Partial;
 friend class PartialManager;
 friend class Poly;
 friend class Renderer;
 friend class RhythmPart;
+friend class SampleRateConverter;
 friend class SamplerateAdapter;
 friend class SoxrAdapter;
+friend class StateReader;
+friend class StateWriter;
 friend class TVA;
 friend class TVF;
 friend class TVP;
@@ -142,12 +295,12 @@ private:
 
 	Bit8u *paddedTimbreMaxTable;
 
-	PCMWaveEntry *pcmWaves; // Array
+	const PCMWaveEntry *pcmWaves; // Array, shared via ROMSet
 
 	const ControlROMFeatureSet *controlROMFeatures;
 	const ControlROMMap *controlROMMap;
 	Bit8u controlROMData[CONTROL_ROM_SIZE];
-	Bit16s *pcmROMData;
+	const Bit16s *pcmROMData; // Shared via ROMSet
 	size_t pcmROMSize; // This is in 16-bit samples, therefore half the number of bytes in the ROM
 
 	Bit8u soundGroupIx[128]; // For each standard timbre
@@ -167,6 +320,8 @@ private:
 	bool reverbOverridden;
 
 	MIDIDelayMode midiDelayMode;
+
+	// The realtime parameters as latched for the current rendering pass, see latchRealtimeParameters().
 	DACInputMode dacInputMode;
 
 	float outputGain;
@@ -198,6 +353,33 @@ private:
 
 	Bit32u addMIDIInterfaceDelay(Bit32u len, Bit32u timestamp);
 	bool isAbortingPoly() const { return abortingPoly != NULL; }
+	// Returns the float wave accuracy set in the synth, unless a lower one is imposed by the degradation level.
+	FloatWaveAccuracy getEffectiveFloatWaveAccuracy() const;
+
+	// Same as playMsgNow() and playMsgOnPart() but take a message already decoded by MidiEventQueue::decodeShortMessage().
+	void playDecodedMsgNow(Bit32u decodedMsg);
+	void playDecodedMsgOnPart(Bit8u part, Bit32u decodedMsg);
+	// Same as playSysexNow() but the message is never added to the session recording.
+	void playFramedSysex(const Bit8u *sysex, Bit32u len);
+
+	// Takes the realtime parameters set since the previous rendering pass into use, if any. The output gains are only
+	// passed on to the analog circuitry when set, unless reapplyGains is true.
+	void latchRealtimeParameters(bool reapplyGains);
+	bool isLatchedNiceAmpRampEnabled() const;
+	bool isLatchedNicePanningEnabled() const;
+	bool isLatchedNicePartialMixingEnabled() const;
+
+	// Same as render() but the output is mixed at the DAC sample rate and the analog LPF emulation is bypassed.
+	// InternalResampler uses this to apply the LPF response within its own FIR instead.
+	void renderBypassingLPF(float *stream, Bit32u len);
+
+	// Support for renderLockstep().
+	bool isLockstepCapable() const;
+	static void renderLockstepGroup(Synth * const *synths, float * const *streams, Bit32u synthCount, Bit32u len);
+
+	// Support for renderWithEvents() and SampleRateConverter::getOutputSamplesWithEvents().
+	void setInlineEvents(const MIDIEvent *events, Bit32u eventCount);
+	Bit32u clearInlineEvents();
 
 	void writeSysexGlobal(Bit32u addr, const Bit8u *sysex, Bit32u len);
 	void readSysex(Bit8u channel, const Bit8u *sysex, Bit32u len) const;
@@ -208,22 +390,38 @@ private:
 	void readMemoryRegion(const MemoryRegion *region, Bit32u addr, Bit32u len, Bit8u *data);
 
 	bool loadControlROM(const ROMImage &controlROMImage);
-	bool loadPCMROM(const ROMImage &pcmROMImage);
+	bool loadPCMROM(const ROMImage &pcmROMImage, Bit16s *decodedPCMROMData);
+	bool loadROMSet(const ROMImage &controlROMImage, const ROMImage &pcmROMImage);
 
-	bool initPCMList(Bit16u mapAddress, Bit16u count);
+	bool initPCMList(PCMWaveEntry *newPCMWaves, const ControlROMPCMStruct *pcmTable, Bit16u count);
 	bool initTimbres(Bit16u mapAddress, Bit16u offset, Bit16u timbreCount, Bit16u startTimbre, bool compressed);
 	bool initCompressedTimbre(Bit16u drumNum, const Bit8u *mem, Bit32u memLen);
+	void loadROMTimbre(Bit16u absTimbreNum);
+	void loadROMTimbres(Bit32u firstTimbreNum, Bit32u lastTimbreNum);
+	void resetPendingROMTimbres();
+	// Returns the timbre in the timbre memory, decompressing it from the control ROM upon the first reference.
+	TimbreParam *getTimbre(unsigned int absTimbreNum);
 	void initReverbModels(bool mt32CompatibleMode);
+	BReverbModel *getReverbModel(Bit8u mode);
 	void initSoundGroups(char newSoundGroupNames[][9]);
 
+	void refreshSystemArea(Bit32u off, Bit32u len);
+	void beginMemoryRefreshBatch(MemoryRefreshBatch &batch);
+	void endMemoryRefreshBatch();
+	MemoryRefreshBatch &deferMemoryRefresh();
+	void applyPendingMemoryRefresh();
+	void discardPendingMemoryRefresh();
+	void applyMemoryRefreshBatch(const MemoryRefreshBatch &batch);
 	void refreshSystemMasterTune();
 	void refreshSystemReverbParameters();
+	void flushReverbPipeline();
 	void refreshSystemReserveSettings();
 	void refreshSystemChanAssign(Bit8u firstPart, Bit8u lastPart);
 	void refreshSystemMasterVol();
 	void refreshSystem();
 	void reset();
 	void dispose();
+	bool doOpen(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, Bit32u usePartialCount, AnalogOutputMode analogOutputMode);
 
 	void printPartialUsage(Bit32u sampleOffset = 0);
 
@@ -236,6 +434,13 @@ private:
 	void resetMasterTunePitchDelta();
 	Bit32s getMasterTunePitchDelta() const;
 
+	void recreatePartials();
+	void saveStateContents(StateWriter &writer) const;
+	bool restoreStateContents(StateReader &reader, bool restoreSettings);
+	void discardRestoredState();
+	bool checkState(const Bit8u *state, size_t stateSize, Bit32u &checksum);
+	bool restoreStatePayload(const Bit8u *payload, size_t payloadSize);
+
 public:
 	static inline Bit16s clipSampleEx(Bit32s sampleEx) {
 		// Clamp values above 32767 to 32767, and values below -32768 to -32768
@@ -286,6 +491,17 @@ public:
 	// See comment for AnalogOutputMode.
 	MT32EMU_EXPORT static Bit32u getStereoOutputSampleRate(AnalogOutputMode analogOutputMode);
 
+	// Returns the best SIMD instruction set supported by both the CPU and the library build.
+	// See comment for SIMDInstructionSet.
+	MT32EMU_EXPORT static SIMDInstructionSet getSupportedSIMDInstructionSet();
+	// Returns the SIMD instruction set the optimised kernels are currently dispatched for.
+	MT32EMU_EXPORT static SIMDInstructionSet getSIMDInstructionSet();
+	// Forces the optimised kernels of all synths to be dispatched for the specified SIMD instruction set, which is mainly
+	// useful for benchmarking. Takes effect upon the next successful call to open() of any synth, which must not happen
+	// while another synth is rendering. Returns false if the instruction set is unsupported, leaving the setting unchanged.
+	// By default, the instruction set returned by getSupportedSIMDInstructionSet() is used.
+	MT32EMU_EXPORT static bool forceSIMDInstructionSet(SIMDInstructionSet instructionSet);
+
 	// Optionally sets callbacks for reporting various errors, information and debug messages
 	MT32EMU_EXPORT explicit Synth(ReportHandler *useReportHandler = NULL);
 	MT32EMU_EXPORT ~Synth();
@@ -300,6 +516,28 @@ public:
 	// Overloaded method which opens the synth with default partial count.
 	MT32EMU_EXPORT bool open(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, AnalogOutputMode analogOutputMode);
 
+	// Starts opening the synth with the same arguments as open() in a worker thread, so that the caller may proceed meanwhile.
+	// The ROM images must remain valid until opening completes. Until then, the synth is reported closed by isOpen() and only
+	// getOpenProgress(), isOpening(), cancelOpening(), finishOpening() and close() may be invoked. When the library is built
+	// without multithreading support, the synth is opened synchronously. The ReportHandler may be invoked in the worker thread.
+	// Returns false if the synth is already open or opening.
+	MT32EMU_EXPORT bool startOpening(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, Bit32u usePartialCount = DEFAULT_MAX_PARTIALS, AnalogOutputMode analogOutputMode = AnalogOutputMode_COARSE);
+
+	// Returns the approximate progress of opening the synth started with startOpening(), in percent.
+	// Once opening completes, returns 100 if the synth is open and 0 otherwise.
+	MT32EMU_EXPORT Bit32u getOpenProgress() const;
+
+	// Returns true while the worker thread started with startOpening() is still opening the synth. As soon as it is done,
+	// the synth switches to the resulting state at once, so that isOpen() tells whether opening succeeded.
+	MT32EMU_EXPORT bool isOpening();
+
+	// Requests the worker thread started with startOpening() to abandon opening the synth at the next stage. Returns immediately,
+	// the synth remains closed once isOpening() returns false.
+	MT32EMU_EXPORT void cancelOpening();
+
+	// Waits for the worker thread started with startOpening() to complete. Returns true if the synth is open.
+	MT32EMU_EXPORT bool finishOpening();
+
 	// Closes the MT-32 and deallocates any memory used by the synthesizer
 	MT32EMU_EXPORT void close();
 
@@ -316,8 +554,10 @@ public:
 
 	// Configures the SysEx storage of the internal MIDI event queue.
 	// Supplying 0 in the storageBufferSize argument makes the SysEx data stored
-	// in multiple dynamically allocated buffers per MIDI event. These buffers are only disposed
-	// when a new MIDI event replaces the SysEx event in the queue, thus never on the rendering thread.
+	// in dynamically allocated buffers, one per slot of the queue. These buffers are retained and reused
+	// by the subsequent SysEx events, so that once grown, they are only reallocated to fit a larger message,
+	// and never disposed on the rendering thread. Unless in the multi-producer mode, the released buffers are also
+	// pooled for reuse by other slots, so that the heap isn't accessed in the steady state.
 	// This is the default behaviour.
 	// In contrast, when a positive value is specified, SysEx data will be stored in a single preallocated buffer,
 	// which makes this kind of storage safe for use in a realtime thread. Additionally, the space retained
@@ -325,6 +565,47 @@ public:
 	// Note, the queue is flushed and recreated in the process so that its size remains intact.
 	MT32EMU_EXPORT void configureMIDIEventQueueSysexStorage(Bit32u storageBufferSize);
 
+	// Enables or disables the multi-producer mode of the internal MIDI event queue. In this mode, the methods that enqueue
+	// MIDI events may be invoked concurrently from multiple threads without external synchronisation, as the queue slots
+	// are reserved using lock-free atomic operations. Note, the events coming from different threads are processed
+	// in the order they have been enqueued, and the state used to emulate the MIDI interface delays is shared
+	// by all the threads, so MIDIDelayMode_IMMEDIATE is the best fit when the timestamps of the events are prepared
+	// by the client. Also, the SysEx data is always stored in per-slot dynamically allocated buffers in this mode,
+	// regardless of configureMIDIEventQueueSysexStorage(). By default, the multi-producer mode is disabled.
+	// The queue is flushed and recreated in the process so that its size remains intact.
+	MT32EMU_EXPORT void configureMIDIEventQueueMultiProducer(bool enabled);
+	// Returns whether the internal MIDI event queue operates in the multi-producer mode.
+	MT32EMU_EXPORT bool isMIDIEventQueueMultiProducer() const;
+
+	// Configures coalescing of the MIDI events that merely set a value, intended to relieve the rendering thread
+	// when a controller or the pitch bender floods the queue. A modulation, volume, pan, expression or pitch bend message
+	// replaces the value in the latest event of the same kind pending for the channel, provided no other event
+	// for the channel was enqueued in between and the timestamp is less than the specified window (in samples at the native
+	// sample rate 32000 Hz) behind that event, which keeps its timestamp. Notes, SysEx and the order-sensitive controllers
+	// are never coalesced. A window no longer than the rendering block keeps the timing intact. The value 0 disables
+	// coalescing, which is the default. Has no effect in the multi-producer mode.
+	// The queue is flushed and recreated in the process so that its size remains intact.
+	MT32EMU_EXPORT void configureMIDIEventQueueCoalescing(Bit32u window);
+	// Returns the window configured with configureMIDIEventQueueCoalescing().
+	MT32EMU_EXPORT Bit32u getMIDIEventQueueCoalescingWindow() const;
+
+	// Returns the number of MIDI events that can currently be enqueued without failing, so that a client feeding events
+	// in advance (e.g. while rendering a MIDI file) can fill the queue in batches. The value may be underestimated while
+	// the rendering thread processes events, and overestimated if other producers enqueue events concurrently.
+	// Note, a SysEx message may still fail to enqueue if the SysEx storage buffer is exhausted.
+	// Returns 0 if the synth is closed.
+	MT32EMU_EXPORT Bit32u getMIDIEventQueueFreeCapacity() const;
+	// Blocks the calling thread until the MIDI event queue can accept the specified number of events or the timeout expires,
+	// whichever comes first. The thread is parked rather than spinning and gets woken up once the rendering thread processes
+	// enough events. Unless the capacity is sufficient already, this requires the synth to be rendered concurrently
+	// in another thread, or the call will merely time out. Returns true if the events can now be enqueued.
+	// Without multithreading support in the library, never blocks and only reports whether the capacity is sufficient.
+	MT32EMU_EXPORT bool waitForMIDIEventQueueFreeCapacity(Bit32u eventCount, Bit32u timeoutMillis);
+	// Fills in the telemetry of the MIDI event queue, see MIDIEventQueueStatistics. Unlike the render statistics, this is
+	// collected regardless of MT32EMU_WITH_RENDER_STATISTICS. Returns false and zeroes out the statistics if the synth is closed.
+	// The statistics are reset along with the render statistics by resetRenderStatistics() and whenever the queue is recreated.
+	MT32EMU_EXPORT bool getMIDIEventQueueStatistics(MIDIEventQueueStatistics &statistics) const;
+
 	// Returns current value of the global counter of samples rendered since the synth was created (at the native sample rate 32000 Hz).
 	// This method helps to compute accurate timestamp of a MIDI message to use with the methods below.
 	MT32EMU_EXPORT Bit32u getInternalRenderedSampleCount() const;
@@ -334,7 +615,8 @@ public:
 	// The timestamp is measured as the global rendered sample count since the synth was created (at the native sample rate 32000 Hz).
 	// The minimum delay involves emulation of the delay introduced while the event is transferred via MIDI interface
 	// and emulation of the MCU busy-loop while it frees partials for use by a new Poly.
-	// Calls from multiple threads must be synchronised, although, no synchronisation is required with the rendering thread.
+	// Calls from multiple threads must be synchronised unless the queue operates in the multi-producer mode,
+	// although, no synchronisation is required with the rendering thread.
 	// The methods return false if the MIDI event queue is full and the message cannot be enqueued.
 
 	// Enqueues a single short MIDI message to play at specified time. The message must contain a status byte.
@@ -347,6 +629,12 @@ public:
 	// Enqueues a single well formed System Exclusive MIDI message to be processed ASAP.
 	MT32EMU_EXPORT bool playSysex(const Bit8u *sysex, Bit32u len);
 
+	// Enqueues a sequence of MIDI events, each to play at the specified time. This is equivalent to calling playMsg()
+	// or playSysex() for each event in turn, but the events are published to the MIDI event queue in batches, which
+	// is notably cheaper when many events are enqueued at once (e.g. while playing back a MIDI file).
+	// Returns the number of events enqueued, which is less than count if the MIDI event queue is full.
+	MT32EMU_EXPORT Bit32u playEvents(const MIDIEvent *events, Bit32u count);
+
 	// WARNING:
 	// The methods below don't ensure minimum 1-sample delay between sequential MIDI events,
 	// and a sequence of NoteOn and immediately succeeding NoteOff messages is always silent.
@@ -391,10 +679,28 @@ public:
 	MT32EMU_EXPORT bool isMT32ReverbCompatibilityMode() const;
 	// Returns whether default reverb compatibility mode is the old MT-32 compatibility mode.
 	MT32EMU_EXPORT bool isDefaultReverbMT32Compatible() const;
-	// If enabled, reverb buffers for all modes are keept around allocated all the time to avoid memory
+	// If enabled, reverb models and buffers for all modes are keept around allocated all the time to avoid memory
 	// allocating/freeing in the rendering thread, which may be required for realtime operation.
-	// Otherwise, reverb buffers that are not in use are deleted to save memory (the default behaviour).
+	// Otherwise, reverb models are only created when a mode is first selected, and reverb buffers that are not in use
+	// are deleted to save memory (the default behaviour).
 	MT32EMU_EXPORT void preallocateReverbMemory(bool enabled);
+	// Creates the reverb model for the specified mode (0-3, as in the system area) and allocates its buffers unless
+	// already done, so that selecting the mode later doesn't allocate memory in the rendering thread. Intended to be
+	// invoked ahead of time, e.g. while the upcoming MIDI data is being parsed, when reverb memory is not preallocated.
+	// The buffers are deleted again once another mode is selected. Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT void prepareReverbModel(Bit8u mode);
+	// Sets the level below which the reverb tail is considered decayed, as a fraction of the full scale, so that 1.0
+	// stands for 32768 LSBs of the 16-bit output and 1.0 of the float output. As soon as the contents of the reverb
+	// filters and the reverb input are all below this level, the reverb model mutes itself and stops processing until
+	// a louder input arrives, which also lets the synth become inactive sooner. The default of 0 (or any non-positive
+	// value) disables the mute, so the output is unaffected. Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT void setReverbSilenceThreshold(float threshold);
+	// Returns the reverb silence threshold as set by setReverbSilenceThreshold().
+	MT32EMU_EXPORT float getReverbSilenceThreshold() const;
+	// The DAC input mode, the output gains, the reversed stereo and the Nice* modes below are realtime parameters,
+	// which may be set from any thread without synchronisation with the rendering thread. The rendering thread takes
+	// the new values into use at the start of the next rendering pass, while the getters return the latest values set.
+
 	// Sets new DAC input mode. See DACInputMode for details.
 	MT32EMU_EXPORT void setDACInputMode(DACInputMode mode);
 	// Returns current DAC input mode. See DACInputMode for details.
@@ -403,6 +709,19 @@ public:
 	MT32EMU_EXPORT void setMIDIDelayMode(MIDIDelayMode mode);
 	// Returns current MIDI delay mode. See MIDIDelayMode for details.
 	MT32EMU_EXPORT MIDIDelayMode getMIDIDelayMode() const;
+	// Sets the length in samples of the grid MIDI events are aligned to when they are played from the MIDI queue.
+	// By default (and with the quantum set to 0 or 1), each event is played exactly at its timestamp, which requires
+	// the rendering to be split at every event. With a larger quantum, the events are delayed up to the next grid point
+	// and all the events that fall into the same grid cell are played at once, so dense MIDI streams are rendered
+	// in fewer, longer runs at the cost of less accurate timing. Note that a note-on is still followed by at least one
+	// rendered sample before the next event, so that zero-duration notes are played.
+	MT32EMU_EXPORT void setMIDIEventTimingQuantum(Bit32u quantum);
+	// Returns the length of the grid MIDI events are aligned to, as set by setMIDIEventTimingQuantum().
+	MT32EMU_EXPORT Bit32u getMIDIEventTimingQuantum() const;
+	// Returns the maximum delay in samples a MIDI event has been played with relative to its timestamp since the synth
+	// was opened or the MIDI event timing quantum was last changed. Events that have been waiting for partials to be freed
+	// when the synth runs out of partials are not taken into account.
+	MT32EMU_EXPORT Bit32u getMaxMIDIEventTimingError() const;
 
 	// Sets output gain factor for synth output channels. Applied to all output samples and unrelated with the synth's Master volume,
 	// it rather corresponds to the gain of the output analog circuitry of the hardware units. However, together with setReverbOutputGain()
@@ -469,6 +788,91 @@ public:
 	// See RendererType for details.
 	MT32EMU_EXPORT RendererType getSelectedRendererType() const;
 
+	// Sets the accuracy of the transcendental functions the float renderer synthesises the square and sawtooth waves with.
+	// The change also applies to the partials currently playing.
+	// By default, FloatWaveAccuracy_REFERENCE is used, so the output is the same as in the previous versions.
+	// See FloatWaveAccuracy for details.
+	MT32EMU_EXPORT void setFloatWaveAccuracy(FloatWaveAccuracy accuracy);
+	// Returns the accuracy of the transcendental functions used by the float renderer.
+	MT32EMU_EXPORT FloatWaveAccuracy getFloatWaveAccuracy() const;
+
+	// Selects the step of the ladder of cheaper processing modes a realtime host may go through automatically
+	// when rendering is at risk of missing its deadlines. See DegradationLevel for details.
+	// The change applies to the partials currently playing and takes effect with the next rendered sample,
+	// so when made between render calls, the processing switches exactly at the block boundary without glitches.
+	// The level in effect and the number of changes are reported by getRenderStatistics().
+	// By default, DegradationLevel_NONE is used. The setting is retained across reopening the synth.
+	// Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT void setDegradationLevel(DegradationLevel level);
+	// Returns the degradation level currently in effect.
+	MT32EMU_EXPORT DegradationLevel getDegradationLevel() const;
+
+	// Enables culling of inaudible partials, meant for throughput-critical batch rendering. While the TVA level
+	// of a partial, and of its ring modulating slave, stays below the specified level, the waves are not generated.
+	// Instead, TVA, TVP and TVF as well as the PCM wave positions are merely advanced and silence is rendered,
+	// so the partial deactivates at the same sample. Synth waves lose their phase though, hence the output
+	// is no longer accurate. The TVA level ranges from 0 to 255, each step attenuating by about 0.375 dB.
+	// The change applies to the partials currently playing. Level 0 disables culling.
+	// By default, culling is disabled. The setting is retained across reopening the synth.
+	// Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT void setPartialCullingLevel(Bit8u level);
+	// Returns the TVA level below which partials are culled, 0 if culling is disabled.
+	MT32EMU_EXPORT Bit8u getPartialCullingLevel() const;
+
+	// Enables or disables the flush-to-zero and denormals-are-zero modes of the floating-point unit while rendering.
+	// When enabled, each rendering call switches the modes on for its duration, including the worker threads it employs
+	// and the sample rate conversion, and restores the control state of the calling thread on return. Denormal numbers,
+	// which decaying reverb tails and filters produce and which are exceedingly slow to process on x86, are then replaced
+	// with zeros. This only affects the float renderer, the float analog circuitry and the sample rate conversion.
+	// Effective on x86 with SSE and AArch64 only. By default, disabled. The setting is retained across reopening the synth.
+	MT32EMU_EXPORT void setDenormalFlushingEnabled(bool enabled);
+	// Returns whether the denormal numbers are flushed to zero while rendering.
+	MT32EMU_EXPORT bool isDenormalFlushingEnabled() const;
+
+	// Sets the number of threads to be used for rendering partials during subsequent calls to open().
+	// When more than one thread is requested, the rendering thread is supplemented by worker threads
+	// that render partials in parallel. The output is exactly the same as when partials are rendered
+	// in the rendering thread only, which is the default (and the only option when the library is built
+	// without multithreading support).
+	MT32EMU_EXPORT void setPartialRenderingThreadCount(Bit32u threadCount);
+	// Returns the number of threads to be used for rendering partials, as set by setPartialRenderingThreadCount().
+	MT32EMU_EXPORT Bit32u getPartialRenderingThreadCount() const;
+	// Enables or disables, during subsequent calls to open(), pipelined processing of the reverb model in a worker thread.
+	// While the rendering thread produces the next block of the LA32 output, the reverb model processes the previous one,
+	// so the output is delayed by the latency reported by getReverbPipelineLatency(). Otherwise, the output is the same
+	// as without the pipeline, except that a decayed reverb tail may get muted a few samples apart when the mute
+	// is enabled (see setReverbSilenceThreshold()). Disabled by default, and unavailable when the library is built without
+	// multithreading support.
+	MT32EMU_EXPORT void setReverbPipelineEnabled(bool enabled);
+	// Returns whether the reverb pipeline is to be used, as set by setReverbPipelineEnabled().
+	MT32EMU_EXPORT bool isReverbPipelineEnabled() const;
+	// Returns the extra output latency introduced by the reverb pipeline, in samples at the DAC sample rate (32000 Hz),
+	// or 0 if the synth is not open or the pipeline is not in use.
+	MT32EMU_EXPORT Bit32u getReverbPipelineLatency() const;
+	// Sets the maximum number of samples rendered in a single pass during subsequent calls to open(). This determines the size
+	// of the rendering buffers held by the synth, notably the per-partial buffers used when partials are rendered in worker
+	// threads and the buffers used to convert the output to the sample format requested. Smaller blocks reduce the memory
+	// footprint of the synth and keep the buffers in cache at the cost of a higher per-pass overhead, while larger blocks
+	// let offline rendering go in fewer passes. Just like rendering in chunks of a different length, this may alter
+	// the output slightly, as the emulation is advanced in steps of a different size. The value is clamped to the range
+	// [MIN_RENDER_BLOCK_LENGTH, MAX_RENDER_BLOCK_LENGTH], the default being MAX_SAMPLES_PER_RUN.
+	MT32EMU_EXPORT void setMaxRenderBlockLength(Bit32u length);
+	// Returns the maximum number of samples rendered in a single pass, as set by setMaxRenderBlockLength().
+	MT32EMU_EXPORT Bit32u getMaxRenderBlockLength() const;
+	// Returns the amount of memory in bytes allocated by this synth instance. The data shared between instances, such as
+	// the decoded PCM ROM and the lookup tables, and the worker threads are not accounted. Same as the total reported
+	// by getMemoryUsage().
+	MT32EMU_EXPORT size_t getAllocatedMemorySize() const;
+	// Fills in the breakdown of the memory allocated by this synth instance by subsystem, see MemoryUsage.
+	MT32EMU_EXPORT void getMemoryUsage(MemoryUsage &usage) const;
+	// Sets the directory (including the trailing path separator) to cache the decoded PCM ROM in during subsequent calls
+	// to open(). When the cache file for the PCM ROM in use exists, it is memory-mapped instead of decoding the ROM, which
+	// speeds up startup and lets the processes using the same directory share the samples. Otherwise, the decoded PCM ROM
+	// is written to the cache. The directory must exist. NULL or an empty string disables caching, which is the default.
+	MT32EMU_EXPORT void setROMCacheDirectory(const char *cacheDirectory);
+	// Returns the directory to cache the decoded PCM ROM in, as set by setROMCacheDirectory(), or NULL if caching is disabled.
+	MT32EMU_EXPORT const char *getROMCacheDirectory() const;
+
 	// Returns actual sample rate used in emulation of stereo analog circuitry of hardware units.
 	// See comment for render() below.
 	MT32EMU_EXPORT Bit32u getStereoOutputSampleRate() const;
@@ -481,6 +885,35 @@ public:
 	MT32EMU_EXPORT void render(Bit16s *stream, Bit32u len);
 	// Same as above but outputs to a float stereo stream.
 	MT32EMU_EXPORT void render(float *stream, Bit32u len);
+	// Same as above but the output is stored according to the descriptor directly, without any intermediate buffer
+	// (unless the sample format differs from the one the renderer uses internally).
+	MT32EMU_EXPORT void render(const StereoOutputDescriptor<Bit16s> &output, Bit32u len);
+	MT32EMU_EXPORT void render(const StereoOutputDescriptor<float> &output, Bit32u len);
+
+	// Same as render() but also plays the given events at their timestamps while rendering, without enqueuing them.
+	// This suits offline rendering, as neither the size of the MIDI event queue nor its SysEx storage limit the number
+	// of events, and the SysEx data is read directly from the caller's buffers. The events must be sorted by timestamp.
+	// Unlike with playEvents(), the timestamps are honoured exactly, as the MIDI interface delays aren't emulated.
+	// Events already due are played immediately, events pending in the MIDI event queue are played as well, in the order
+	// of timestamps. The events that aren't due by the end of the rendered period are left unplayed. Returns the number
+	// of events played, so that the caller can supply the rest, along with the following events, with the next call.
+	// The event array must remain valid only for the duration of the call.
+	MT32EMU_EXPORT Bit32u renderWithEvents(const MIDIEvent *events, Bit32u eventCount, Bit16s *stream, Bit32u len);
+	// Same as above but outputs to a float stereo stream.
+	MT32EMU_EXPORT Bit32u renderWithEvents(const MIDIEvent *events, Bit32u eventCount, float *stream, Bit32u len);
+	// Same as above but stores the output according to the descriptor, like render() does.
+	MT32EMU_EXPORT Bit32u renderWithEvents(const MIDIEvent *events, Bit32u eventCount, const StereoOutputDescriptor<Bit16s> &output, Bit32u len);
+	MT32EMU_EXPORT Bit32u renderWithEvents(const MIDIEvent *events, Bit32u eventCount, const StereoOutputDescriptor<float> &output, Bit32u len);
+
+	// Renders float stereo output of several synths as though render() was called for each synth with the respective stream.
+	// The synths are processed in groups of getLockstepGroupSize() that advance block by block together, and the analog LPF
+	// emulation of each group is applied at once with the channels of all the synths occupying the lanes of SIMD vectors.
+	// This only benefits the synths opened with RendererType_FLOAT in AnalogOutputMode_COARSE, the rest are rendered one by one.
+	// The output is exactly the same as with render() provided that the synths in a group have been opened with the same
+	// maximum render block length and have the same denormal flushing setting. Distinct groups may be rendered concurrently.
+	MT32EMU_EXPORT static void renderLockstep(Synth * const *synths, float * const *streams, Bit32u synthCount, Bit32u len);
+	// Returns the number of synths renderLockstep() processes together.
+	MT32EMU_EXPORT static Bit32u getLockstepGroupSize();
 
 	// Renders samples to the specified output streams as if they appeared at the DAC entrance.
 	// No further processing performed in analog circuitry emulation is applied to the signal.
@@ -492,17 +925,97 @@ public:
 	MT32EMU_EXPORT void renderStreams(float *nonReverbLeft, float *nonReverbRight, float *reverbDryLeft, float *reverbDryRight, float *reverbWetLeft, float *reverbWetRight, Bit32u len);
 	MT32EMU_EXPORT void renderStreams(const DACOutputStreams<float> &streams, Bit32u len);
 
+	// Renders the output of each part to a separate pair of streams along with the wet reverb output in a single pass,
+	// so that the parts can be remixed afterwards. Like with renderStreams(), the streams appear at the DAC entrance.
+	// Each part stream holds both the non-reverb and the dry reverb signal of the part. The reverb is fed by the partials
+	// of all the parts that are sent to reverb as usual, so the wet reverb output is the same as that of renderStreams().
+	// The sum of the part streams equals the sum of the non-reverb and dry reverb streams, except that the clipping
+	// and the distortions of the DAC input mode are applied to each part separately.
+	// The reverb pipeline, if enabled, is bypassed while rendering the part streams, so the wet reverb output isn't delayed.
+	// Switching between this method and the other rendering methods drops the reverb output held in the pipeline.
+	// NULL may be specified in place of any or all of the stream buffers to skip it.
+	// The length is in samples, not bytes. Uses NATIVE byte ordering.
+	MT32EMU_EXPORT void renderPartStreams(const PartOutputStreams<Bit16s> &streams, Bit32u len);
+	// Same as above but outputs to float streams.
+	MT32EMU_EXPORT void renderPartStreams(const PartOutputStreams<float> &streams, Bit32u len);
+
+	// Advances the emulation by the specified number of samples at the native sample rate 32000 Hz without producing any output,
+	// which is much cheaper than rendering. The MIDI events are played at the same time as during rendering, and the envelopes,
+	// pitch and filter controls of the partials are advanced exactly, so the notes end and the partials are allocated in the same
+	// way as if the samples were rendered. The PCM wave positions are tracked exactly as well. The following state is approximated:
+	// - the wave generators of partials that play synthesised waves keep their phase as of before fast-forwarding;
+	// - the reverb is muted on entry, so neither the reverb tail of the preceding output nor the reverb of the notes played
+	//   while fast-forwarding are heard afterwards;
+	// - the analog circuitry retains the signal history from before fast-forwarding, which decays within a few samples.
+	// The sample rate converter of the C API isn't advanced by this method.
+	MT32EMU_EXPORT void fastForward(Bit32u len);
+
 	// Returns true when there is at least one active partial, otherwise false.
 	MT32EMU_EXPORT bool hasActivePartials() const;
 
+	// Returns the number of samples that can be rendered before any active partial may become inactive, provided no further
+	// MIDI events are played. Rendering that many samples at once is therefore equivalent to rendering them one by one while
+	// polling hasActivePartials(). Returns 0 when there are no active partials or when the events pending in the MIDI queue
+	// may change the set of active partials meanwhile. May return a very large value for the partials sustaining indefinitely.
+	MT32EMU_EXPORT Bit32u getMinRemainingPartialSampleCount() const;
+
 	// Returns true if the synth is active and subsequent calls to render() may result in non-trivial output (i.e. silence).
 	// The synth is considered active when either there are pending MIDI events in the queue, there is at least one active partial,
 	// or the reverb is (somewhat unreliably) detected as being active.
 	MT32EMU_EXPORT bool isActive();
 
+	// Fills in the statistics of time spent in the stages of the rendering pipeline. Returns false when the synth is not open
+	// or the library is built without MT32EMU_WITH_RENDER_STATISTICS, and the statistics are zeroed out in this case,
+	// except for the degradation fields, which are filled in whenever the synth is open.
+	// The statistics are updated by the rendering thread without synchronisation, so the values may be slightly inconsistent
+	// when read concurrently with rendering.
+	MT32EMU_EXPORT bool getRenderStatistics(RenderStatistics &statistics) const;
+	// Fills in the cost of generating the partials per part and per kind of partial, see PartialRenderStatistics.
+	// Returns false and zeroes out the statistics when the synth is not open or the library is built without
+	// MT32EMU_WITH_RENDER_STATISTICS. Like the render statistics, these are read without synchronisation.
+	MT32EMU_EXPORT bool getPartialRenderStatistics(PartialRenderStatistics &statistics) const;
+	// Resets all the render statistics, including the partial ones and those of the MIDI event queue, to zero.
+	// Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT void resetRenderStatistics();
+
 	// Returns the maximum number of partials playing simultaneously.
 	MT32EMU_EXPORT Bit32u getPartialCount() const;
 
+	// Enables placing the memory touched while rendering in blocks obtained directly from the OS, which are faulted in
+	// upon opening and locked into RAM, so that the rendering thread never page-faults on them after idle periods or under
+	// memory pressure. The blocks spanning a huge page or more are backed by huge pages where available. This covers
+	// the parts and the partials, the renderer buffers, the reverb models (all of which are opened upon opening then)
+	// and the decoded PCM ROM samples, which are locked in place if shared with another synth or memory-mapped.
+	// Locking is subject to RLIMIT_MEMLOCK on POSIX systems and to the working set size on Windows, where huge pages also
+	// require the SeLockMemoryPrivilege. Takes effect on the next open(), the setting is retained across reopening the synth.
+	MT32EMU_EXPORT void setHotMemoryLockingEnabled(bool enabled);
+	MT32EMU_EXPORT bool isHotMemoryLockingEnabled() const;
+	// Returns true if the synth is open with hot memory locking enabled and the OS has locked all of it. Otherwise,
+	// the memory is still faulted in upon opening, yet it may be paged out later.
+	MT32EMU_EXPORT bool isHotMemoryLocked() const;
+
+	// Sets the number of partials to preallocate upon opening, so that the partial pool can be grown up to this size later
+	// using resizePartialPool() without reopening the synth. Values below the partial count specified in open() have no effect.
+	// Takes effect on the next open(), the setting is retained across reopening the synth. 0 disables preallocation.
+	MT32EMU_EXPORT void setMaxPartialCount(Bit32u maxPartialCount);
+	// Returns the number of partials the pool can grow up to. While the synth is closed, this is the value expected upon opening.
+	MT32EMU_EXPORT Bit32u getMaxPartialCount() const;
+	// Changes the partial count of the open synth in range [1..getMaxPartialCount()], the emulation state is preserved.
+	// The added partials become available to new notes immediately. When shrinking, the playing partials in excess
+	// of the new count are not stopped, yet they leave the pool as soon as they finish, and no new notes get them.
+	// The states of those partials are no longer reported by getPartialStates() meanwhile.
+	// Must be synchronised with the rendering thread. Returns false if the synth is not open or the count is out of range.
+	MT32EMU_EXPORT bool resizePartialPool(Bit32u newPartialCount);
+
+	// Limits the number of partials that new notes may occupy to a value below the partial count set upon opening.
+	// Lowering the limit doesn't stop any playing partials. Instead, when new notes arrive, the partials in excess
+	// of the limit are freed by aborting the playing polys following the regular rules of partial allocation.
+	// This allows to shed the rendering load in realtime without reopening the synth. 0 lifts the limit.
+	// Must be synchronised with the rendering thread, the setting is retained across reopening the synth.
+	MT32EMU_EXPORT void setPartialLimit(Bit32u partialLimit);
+	// Returns the number of partials available for new notes, which equals to getPartialCount() unless a lower limit is set.
+	MT32EMU_EXPORT Bit32u getPartialLimit() const;
+
 	// Fills in current states of all the parts into the array provided. The array must have at least 9 entries to fit values for all the parts.
 	// If the value returned for a part is true, there is at least one active non-releasing partial playing on this part.
 	// This info is useful in emulating behaviour of LCD display of the hardware units.
@@ -529,10 +1042,70 @@ public:
 
 	// Returns name of the patch set on the specified part.
 	// Argument partNumber should be 0..7 for Part 1..8, or 8 for Rhythm.
+	// A change by a System Exclusive message shows once the next MIDI message is played or the next block is rendered.
 	MT32EMU_EXPORT const char *getPatchName(Bit8u partNumber) const;
 
 	// Stores internal state of emulated synth into an array provided (as it would be acquired from hardware).
 	MT32EMU_EXPORT void readMemory(Bit32u addr, Bit32u len, Bit8u *data);
+
+	// The timbres of the control ROM are only decompressed into the timbre memory upon the first reference, e.g. by
+	// a program change, which takes a few microseconds each. This decompresses the timbres given by the absolute numbers
+	// (0-255, i.e. 64 per group A, B, memory and rhythm) ahead of time, e.g. to avoid that while rendering in realtime.
+	// Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT void prefetchTimbres(Bit32u firstTimbreNum, Bit32u timbreCount);
+
+	// Loads a bank of complete SysEx messages (e.g. the contents of a .syx file) directly into the synth memory,
+	// bypassing the MIDI queue and the MIDI delay emulation. The affected parts, timbres and system settings are refreshed
+	// once after the whole bank is written rather than after each message. Bytes outside F0..F7 framing are skipped.
+	// Returns the number of messages processed. Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT Bit32u loadSysexBank(const Bit8u *data, Bit32u len);
+
+	// Writes a block of the synth memory at the address given in the same form as for readMemory(), bypassing the MIDI queue.
+	// As with loadSysexBank(), the affected state is refreshed once. Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT void writeMemory(Bit32u addr, Bit32u len, const Bit8u *data);
+
+	// Saves a snapshot of the complete emulation state to the buffer provided, which includes the synth memory, the notes
+	// being played, the state of the reverb model and the analog circuitry, the pending MIDI events as well as the runtime
+	// settings (such as the output gains). Returns the size of the state in bytes, or 0 if the synth is not open. If the buffer
+	// is NULL or too small to fit the state, nothing is written, so that the required size can be found out in advance.
+	// The state is portable between hosts and library builds. Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT size_t saveState(Bit8u *buffer, size_t bufferSize);
+	// Restores the emulation state previously saved by saveState(), after which rendering continues exactly as it would have
+	// from the moment of saving. The synth must be open with the same ROMs, renderer type, partial count, analog output mode
+	// and reverb pipeline setting as the one that has saved the state, otherwise false is returned and the synth is left intact.
+	// False is also returned when the state is corrupted, and the synth is reset in case this is only detected midway.
+	// Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT bool restoreState(const Bit8u *state, size_t stateSize);
+	// Saves the emulation state as a delta against a base state saved by saveState() earlier. Only the parts of the state
+	// that differ from the base are stored, while the unchanged ones (e.g. the bulk of the synth memory) and the runs of zeros
+	// (e.g. muted reverb buffers) are encoded compactly. That makes frequent checkpoints affordable when they share a base.
+	// Returns the size of the delta in bytes, or 0 if the synth is not open or the base state is invalid. The buffer
+	// is handled as in saveState(). Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT size_t saveStateDelta(const Bit8u *baseState, size_t baseStateSize, Bit8u *buffer, size_t bufferSize);
+	// Restores the emulation state from a delta saved by saveStateDelta() against the same base state, otherwise
+	// false is returned. Apart from that, behaves as restoreState(). Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT bool restoreStateDelta(const Bit8u *baseState, size_t baseStateSize, const Bit8u *delta, size_t deltaSize);
+	// Quickly brings the emulation back to the state captured right after open(): the synth memory, the parts, the partials,
+	// the reverb and the analog circuitry are restored from a snapshot, and the pending MIDI events are dropped. Unlike reset(),
+	// this also silences any notes and reverb tail at once, so that a subsequent song starts from the same clean state
+	// as after reopening the synth. The runtime settings are retained, while the rendered sample count starts over from 0,
+	// so the timestamps of subsequent MIDI events must be based on the new count. Returns false if
+	// the synth is not open or has been reconfigured since (e.g. the partial pool has been resized), the synth is left intact
+	// in this case. Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT bool resetToOpenState();
+
+	// Starts recording the rendering session to a compact binary file for replaying it later in a benchmark
+	// (see mt32emu-bench). The recording comprises the configuration of the synth, the emulation state saved upon starting,
+	// the played MIDI events with timestamps and the lengths and types of the rendering calls in order. The events are
+	// recorded as they are played, whether queued, passed with renderWithEvents() or played immediately, while the direct
+	// writes of the synth memory are not. The previous recording is stopped first. Returns false if the synth is not open
+	// or the file cannot be created. The recording is stopped when the synth is closed. Restoring a saved state meanwhile
+	// makes the replay diverge. Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT bool startSessionRecording(const char *filename);
+	// Stops recording the rendering session and closes the file. Must be synchronised with the rendering thread.
+	MT32EMU_EXPORT void stopSessionRecording();
+	// Returns true while a rendering session is being recorded.
+	MT32EMU_EXPORT bool isSessionRecording() const;
 }; // class Synth
 
 } // namespace MT32Emu
@@ -0,0 +1,107 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "internals.h"
+
+#include "Synth.h"
+#include "Atomics.h"
+#include "SynthImpl.h"
+#include "ThreadPool.h"
+
+namespace MT32Emu {
+
+// Opens the synth in a worker thread on behalf of Synth::startOpening().
+class AsyncOpenJob : public ThreadPool::Job {
+	Synth &synth;
+	const ROMImage &controlROMImage;
+	const ROMImage &pcmROMImage;
+	const Bit32u partialCount;
+	const AnalogOutputMode analogOutputMode;
+
+public:
+	// NULL if the synth is opened synchronously.
+	ThreadPool * const threadPool;
+	// Percentage of the opening stages complete, updated by the worker thread.
+	volatile Bit32u progress;
+	volatile Bit32u cancelled;
+	volatile Bit32u done;
+
+	AsyncOpenJob(Synth &useSynth, const ROMImage &useControlROMImage, const ROMImage &usePCMROMImage, Bit32u usePartialCount, AnalogOutputMode useAnalogOutputMode) :
+		synth(useSynth), controlROMImage(useControlROMImage), pcmROMImage(usePCMROMImage), partialCount(usePartialCount),
+		analogOutputMode(useAnalogOutputMode), threadPool(ThreadPool::createThreadPool(1)), progress(0), cancelled(0), done(0)
+	{}
+
+	~AsyncOpenJob() {
+		delete threadPool;
+	}
+
+	void runTask(Bit32u) {
+		synth.doOpen(controlROMImage, pcmROMImage, partialCount, analogOutputMode);
+		Atomics::storeRelease(done, 1);
+	}
+};
+
+bool reportOpenProgress(AsyncOpenJob *job, Bit32u percent) {
+	if (job == NULL) return true;
+	if (Atomics::loadAcquire(job->cancelled) != 0) return false;
+	Atomics::storeRelease(job->progress, percent);
+	return true;
+}
+
+bool Synth::startOpening(const ROMImage &controlROMImage, const ROMImage &pcmROMImage, Bit32u usePartialCount, AnalogOutputMode analogOutputMode) {
+	if (opened || extensions.asyncOpenJob != NULL) {
+		return false;
+	}
+	AsyncOpenJob *job = new AsyncOpenJob(*this, controlROMImage, pcmROMImage, usePartialCount, analogOutputMode);
+	extensions.asyncOpenJob = job;
+	if (job->threadPool == NULL) {
+		job->runTask(0);
+	} else {
+		job->threadPool->startJob(*job, 1);
+	}
+	return true;
+}
+
+Bit32u Synth::getOpenProgress() const {
+	const AsyncOpenJob *job = extensions.asyncOpenJob;
+	if (job == NULL) return opened ? 100 : 0;
+	return Atomics::loadAcquire(job->progress);
+}
+
+bool Synth::isOpening() {
+	AsyncOpenJob *job = extensions.asyncOpenJob;
+	if (job == NULL) return false;
+	if (Atomics::loadAcquire(job->done) == 0) return true;
+	finishOpening();
+	return false;
+}
+
+void Synth::cancelOpening() {
+	AsyncOpenJob *job = extensions.asyncOpenJob;
+	if (job != NULL) Atomics::storeRelease(job->cancelled, 1);
+}
+
+bool Synth::finishOpening() {
+	AsyncOpenJob *job = extensions.asyncOpenJob;
+	if (job != NULL) {
+		if (job->threadPool != NULL) job->threadPool->waitForJob();
+		extensions.asyncOpenJob = NULL;
+		delete job;
+	}
+	return opened;
+}
+
+} // namespace MT32Emu
@@ -0,0 +1,467 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_SYNTH_IMPL_H
+#define MT32EMU_SYNTH_IMPL_H
+
+#include <cstring>
+
+#include "globals.h"
+#include "Types.h"
+#include "HotMemory.h"
+#include "MidiEventQueue.h"
+#include "SessionRecorder.h"
+#include "Synth.h"
+#include "SynthState.h"
+
+// The internal classes of Synth, shared by the translation units that implement it.
+
+namespace MT32Emu {
+
+class ThreadPool;
+
+class Renderer {
+	// Counts samples rendered since the synth has become idle.
+	Bit32u idleSampleCount;
+	// As selected when the synth was opened.
+	const RendererType rendererType;
+
+	// Caller-owned events supplied to Synth::renderWithEvents(), only set for the duration of the call.
+	const MIDIEvent *inlineEvents;
+	Bit32u inlineEventCount;
+	Bit32u playedInlineEventCount;
+	// The next inline event in the form the queue stores it, valid while nextEventInline is set.
+	MidiEventQueue::MidiEvent nextInlineEvent;
+	// Tells whether the event last returned by peekMidiEvent() comes from the inline events rather than the queue.
+	bool nextEventInline;
+
+	bool hasPendingInlineEvents() const {
+		return playedInlineEventCount < inlineEventCount;
+	}
+
+protected:
+	Synth &synth;
+	RenderStatistics statistics;
+	PartialRenderStatistics partialStatistics;
+
+	void printDebug(const char *msg) const {
+		synth.printDebug("%s", msg);
+	}
+
+	bool isActivated() const {
+		return synth.activated;
+	}
+
+	bool isAbortingPoly() const {
+		return synth.isAbortingPoly();
+	}
+
+	void playDecodedMsgNow(Bit32u decodedMsg) {
+		synth.playDecodedMsgNow(decodedMsg);
+	}
+
+	void playFramedSysex(const Bit8u *sysex, Bit32u len) {
+		synth.playFramedSysex(sysex, len);
+	}
+
+	Analog &getAnalog() const {
+		return *synth.analog;
+	}
+
+	void latchRealtimeParameters() {
+		synth.latchRealtimeParameters(false);
+	}
+
+	void applyPendingMemoryRefresh() {
+		synth.applyPendingMemoryRefresh();
+	}
+
+	DACInputMode getDACInputMode() const {
+		return synth.dacInputMode;
+	}
+
+	MidiEventQueue &getMidiQueue() {
+		return *synth.midiQueue;
+	}
+
+	// Returns the earliest of the events pending in the MIDI event queue and the inline events, or NULL if there are none.
+	// The queued event goes first if the timestamps are equal.
+	const volatile MidiEventQueue::MidiEvent *peekMidiEvent() {
+		const volatile MidiEventQueue::MidiEvent *queuedEvent = getMidiQueue().peekMidiEvent();
+		nextEventInline = false;
+		while (hasPendingInlineEvents()) {
+			const MIDIEvent &inlineEvent = inlineEvents[playedInlineEventCount];
+			if (queuedEvent != NULL && Bit32s(queuedEvent->timestamp - inlineEvent.timestamp) <= 0) break;
+			if (inlineEvent.sysexData == NULL && (inlineEvent.shortMessage & 0xF8) == 0xF8) {
+				// System realtime messages are only reported, as when enqueued.
+				synth.reportHandler->onMIDISystemRealtime(Bit8u(inlineEvent.shortMessage & 0xFF));
+				playedInlineEventCount++;
+				continue;
+			}
+			nextInlineEvent.sysexData = inlineEvent.sysexData;
+			if (inlineEvent.sysexData == NULL) {
+				nextInlineEvent.shortMessageData = inlineEvent.shortMessage;
+				nextInlineEvent.decodedShortMessage = MidiEventQueue::decodeShortMessage(inlineEvent.shortMessage);
+			} else {
+				nextInlineEvent.sysexLength = inlineEvent.sysexLength;
+			}
+			nextInlineEvent.timestamp = inlineEvent.timestamp;
+			nextEventInline = true;
+			return &nextInlineEvent;
+		}
+		return queuedEvent;
+	}
+
+	// Adds the event last returned by peekMidiEvent() to the session recording before it is played, unless it is
+	// held up by an aborting poly and has been recorded already.
+	void recordDispatchedEvent(const volatile MidiEventQueue::MidiEvent *event);
+	// Tells whether the event just played is held up, so that it isn't recorded again when played anew.
+	void updateHeldEventRecorded();
+
+	// Drops the event last returned by peekMidiEvent().
+	void dropMidiEvent() {
+		if (nextEventInline) {
+			playedInlineEventCount++;
+		} else {
+			getMidiQueue().dropMidiEvent();
+		}
+	}
+
+	PartialManager &getPartialManager() {
+		return *synth.partialManager;
+	}
+
+	BReverbModel &getReverbModel() {
+		return *synth.reverbModel;
+	}
+
+	void incRenderedSampleCount(const Bit32u count) {
+		synth.renderedSampleCount += count;
+		statistics.renderedSampleCount += count;
+		if (synth.getDegradationLevel() != DegradationLevel_NONE) statistics.degradedSampleCount += count;
+	}
+
+	bool isReverbDrained() const {
+		return synth.getDegradationLevel() >= DegradationLevel_REVERB_DRAINED;
+	}
+
+	ThreadPool *getPartialRenderingThreadPool() const;
+	ThreadPool *getReverbPipelineThreadPool() const;
+	Bit32u getMaxRenderBlockLength() const;
+	bool isHotMemoryEnabled() const;
+	Bit32u getMIDIEventTimingQuantum() const;
+	void updateMaxMIDIEventTimingError(Bit32u timingError);
+
+	// Once there are no pending MIDI events, no active partials and the reverb model is silent for a while,
+	// the synth gets deactivated, so the following rendering passes bypass the LA32 and reverb emulation
+	// as well as the analog circuitry entirely until the next MIDI event arrives.
+	void updateActivationState(const Bit32u len);
+
+public:
+	Renderer(Synth &useSynth) :
+		idleSampleCount(0), rendererType(useSynth.getSelectedRendererType()),
+		inlineEvents(NULL), inlineEventCount(0), playedInlineEventCount(0), nextEventInline(false),
+		synth(useSynth)
+	{
+		resetStatistics();
+	}
+
+	virtual ~Renderer() {}
+
+	RenderStatistics &getStatistics() {
+		return statistics;
+	}
+
+	const PartialRenderStatistics &getPartialStatistics() const {
+		return partialStatistics;
+	}
+
+	Bit32u getRenderedSampleCount() const {
+		return synth.renderedSampleCount;
+	}
+
+	bool isDenormalFlushingEnabled() const {
+		return synth.isDenormalFlushingEnabled();
+	}
+
+	void resetStatistics() {
+		memset(&statistics, 0, sizeof(statistics));
+		memset(&partialStatistics, 0, sizeof(partialStatistics));
+	}
+
+	void setInlineEvents(const MIDIEvent *events, Bit32u eventCount) {
+		inlineEvents = events;
+		inlineEventCount = eventCount;
+		playedInlineEventCount = 0;
+	}
+
+	// Forgets the inline events, returns the number of those played.
+	Bit32u clearInlineEvents() {
+		Bit32u playedCount = playedInlineEventCount;
+		setInlineEvents(NULL, 0);
+		return playedCount;
+	}
+
+	virtual void render(const StereoOutputDescriptor<IntSample> &output, Bit32u len) = 0;
+	virtual void render(const StereoOutputDescriptor<FloatSample> &output, Bit32u len) = 0;
+	virtual void renderBypassingLPF(FloatSample *stereoStream, Bit32u len) = 0;
+	virtual void renderStreams(const DACOutputStreams<IntSample> &streams, Bit32u len) = 0;
+	virtual void renderStreams(const DACOutputStreams<FloatSample> &streams, Bit32u len) = 0;
+	virtual void renderPartStreams(const PartOutputStreams<IntSample> &streams, Bit32u len) = 0;
+	virtual void renderPartStreams(const PartOutputStreams<FloatSample> &streams, Bit32u len) = 0;
+	virtual void fastForward(Bit32u len) = 0;
+
+	virtual size_t getAllocatedMemorySize() const = 0;
+	// Returns true if the buffers are placed in hot memory locked into RAM.
+	virtual bool isMemoryLocked() const = 0;
+
+	// Returns the maximum number of samples rendered in a single pass, as fixed when the synth was opened.
+	virtual Bit32u getBlockLength() const = 0;
+
+	// Returns true unless the reverb pipeline holds some output that hasn't been delivered since the synth has become idle.
+	bool isReverbPipelineDrained() const {
+		return !synth.activated || idleSampleCount >= getReverbPipelineLatency();
+	}
+
+	RendererType getRendererType() const {
+		return rendererType;
+	}
+
+	virtual Bit32u getReverbPipelineLatency() const = 0;
+	virtual void flushReverbPipeline() = 0;
+	virtual void resetReverbPipeline() = 0;
+
+	// The reverb pipeline must be flushed before saving the state.
+	virtual void saveState(StateWriter &writer) const {
+		writer.writeUInt32(idleSampleCount);
+	}
+
+	virtual void restoreState(StateReader &reader) {
+		idleSampleCount = reader.readUInt32();
+	}
+};
+
+// Holds the objects that are created in open() and live until the synth is closed in a single allocation, so that
+// the related objects end up adjacent in memory. The blocks are handed out in order and only released all at once.
+class ObjectArena {
+public:
+	static size_t alignSize(const size_t blockSize) {
+		return (blockSize + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	ObjectArena() : storage(NULL), size(0), usedSize(0) {}
+
+	~ObjectArena() {
+		release();
+	}
+
+	// With hotMemory set, the storage is a HotMemoryBlock locked into RAM, see Synth::setHotMemoryLockingEnabled().
+	// Falls back to the heap if the OS refuses to provide the block.
+	void allocate(const size_t totalSize, const bool hotMemory) {
+		release();
+		if (hotMemory && hotMemoryBlock.allocate(totalSize)) {
+			hotMemoryBlock.lock();
+			storage = hotMemoryBlock.getData();
+		} else {
+			storage = new Bit8u[totalSize];
+		}
+		size = totalSize;
+	}
+
+	void release() {
+		if (storage != hotMemoryBlock.getData()) delete[] storage;
+		hotMemoryBlock.release();
+		storage = NULL;
+		size = 0;
+		usedSize = 0;
+	}
+
+	bool isLocked() const {
+		return hotMemoryBlock.isLocked();
+	}
+
+	Bit8u *take(const size_t blockSize) {
+		Bit8u *block = storage + usedSize;
+		usedSize += alignSize(blockSize);
+		return block;
+	}
+
+	size_t getSize() const {
+		return size;
+	}
+
+private:
+	// Storage obtained with new[] is suitably aligned for any fundamental type, and so is each block.
+	static const size_t ALIGNMENT = 16;
+
+	Bit8u *storage;
+	size_t size;
+	size_t usedSize;
+	HotMemoryBlock hotMemoryBlock;
+};
+
+// The objects placed in the arena are destroyed explicitly, while the storage is released along with the arena.
+template <class T>
+void destroyArenaObject(T *&object) {
+	if (object != NULL) object->~T();
+	object = NULL;
+}
+
+// Collects the refreshes due after writes to the synth memory, so that each affected part, timbre and system setting
+// is refreshed once after all the data is written.
+struct MemoryRefreshBatch {
+	// Bit N stands for part N, 8 is rhythm.
+	Bit32u patchTempParts;
+	Bit32u timbreTempParts;
+	// Bit N % 32 of element N / 32 stands for the absolute timbre number N.
+	Bit32u timbres[8];
+	// Drums touched, none if firstDrum > lastDrum.
+	Bit32u firstDrum;
+	Bit32u lastDrum;
+	// Offsets of the system area touched, none if systemEndOff is 0.
+	Bit32u systemStartOff;
+	Bit32u systemEndOff;
+};
+
+class AsyncOpenJob;
+
+// The settings the client may change from any thread while rendering, see Synth::latchRealtimeParameters().
+enum RealtimeParameter {
+	RealtimeParameter_DAC_INPUT_MODE,
+	RealtimeParameter_OUTPUT_GAIN,
+	RealtimeParameter_REVERB_OUTPUT_GAIN,
+	RealtimeParameter_REVERSED_STEREO,
+	RealtimeParameter_NICE_AMP_RAMP,
+	RealtimeParameter_NICE_PANNING,
+	RealtimeParameter_NICE_PARTIAL_MIXING,
+	RealtimeParameter_COUNT
+};
+
+class Extensions {
+public:
+	RendererType selectedRendererType;
+	FloatWaveAccuracy floatWaveAccuracy;
+	DegradationLevel degradationLevel;
+	// TVA level below which partials are culled, 0 if culling is disabled
+	Bit8u partialCullingLevel;
+	bool denormalFlushingEnabled;
+	// Limit of partials available for new notes, 0 if not limited
+	Bit32u partialLimit;
+	// Number of partials to preallocate upon opening as requested, 0 if not set
+	Bit32u maxPartialCount;
+	// Number of partials the storage is allocated for, never less than the partial count while the synth is open
+	Bit32u partialCapacity;
+	Bit32s masterTunePitchDelta;
+	// The Nice* modes as latched for the current rendering pass.
+	bool niceAmpRamp;
+	bool nicePanning;
+	bool nicePartialMixing;
+
+	// The realtime parameters as set by the client. Each one takes a word of its own, so that it is updated atomically,
+	// floats are stored as their bit patterns. Bit N of the update mask is set after parameter N is stored, so that
+	// the rendering thread only rereads the parameters when any of them is set.
+	volatile Bit32u realtimeParameters[RealtimeParameter_COUNT];
+	volatile Bit32u realtimeParameterUpdateMask;
+
+	// Here we keep the reverse mapping of assigned parts per MIDI channel.
+	// NOTE: value above 8 means that the channel is not assigned
+	Bit8u chantable[16][9];
+
+	// This stores the index of Part in chantable that failed to play and required partial abortion.
+	Bit32u abortingPartIx;
+
+	bool preallocatedReverbMemory;
+	float reverbSilenceThreshold;
+
+	// Applied upon opening, see Synth::setHotMemoryLockingEnabled().
+	bool hotMemoryLockingEnabled;
+	// Set while open if the memory touched while rendering is allocated as HotMemoryBlocks.
+	bool hotMemoryEnabled;
+	// Set while the synth holds a lock of the PCM ROM samples of the ROM set.
+	bool pcmROMLocked;
+
+	Bit32u midiEventQueueSize;
+	Bit32u midiEventQueueSysexStorageBufferSize;
+	bool midiEventQueueMultiProducer;
+	Bit32u midiEventQueueCoalescingWindow;
+
+	Bit32u partialRenderingThreadCount;
+	// NULL unless partials are rendered using multiple threads.
+	ThreadPool *partialRenderingThreadPool;
+
+	bool reverbPipelineEnabled;
+	// NULL unless reverb is processed in the pipeline worker thread.
+	ThreadPool *reverbPipelineThreadPool;
+
+	Bit32u maxRenderBlockLength;
+
+	Bit32u midiEventTimingQuantum;
+	Bit32u maxMIDIEventTimingError;
+
+	// Decoded PCM ROM and wave list shared with the other synths that use the same ROMs. NULL unless open.
+	const ROMSet *romSet;
+	// Copy of the directory to cache the decoded PCM ROM in, NULL if caching is disabled.
+	char *romCacheDirectory;
+
+	// Determines the reverb models created on demand.
+	bool mt32CompatibleReverb;
+
+	ObjectArena arena;
+	// Placed in the arena along with the partial manager.
+	Bit8u *partialManagerStorage;
+
+	// NULL unless loading into the synth memory in bulk.
+	MemoryRefreshBatch *memoryRefreshBatch;
+	// Otherwise, the refreshes due after the writes to the patch, timbre and rhythm areas are collected here until
+	// the next MIDI message is played or the next block is rendered, so that a burst of sysex messages is applied once.
+	// The system area is still refreshed straight away, as the channel assignment affects the following messages.
+	MemoryRefreshBatch pendingMemoryRefresh;
+	bool memoryRefreshPending;
+
+	// The ROM timbres are only decompressed into the timbre memory upon the first reference, see Synth::getTimbre().
+	// These hold a bit per absolute timbre number for the timbres yet to be decompressed, currently and in the default
+	// memory contents, which the synth memory is reset to.
+	Bit32u pendingROMTimbres[8];
+	Bit32u defaultPendingROMTimbres[8];
+	// Control ROM addresses of the timbres along with a bit for each compressed one, valid while pending.
+	Bit16u romTimbreAddresses[256];
+	Bit32u compressedROMTimbres[8];
+
+	// Contents of the state saved right after opening the synth, restored by resetToOpenState().
+	Bit8u *openState;
+	size_t openStateSize;
+
+	// NULL unless a session is being recorded.
+	SessionRecorder *sessionRecorder;
+	// Number of the queued events yet to be played that the state in the recording contains already.
+	Bit32u sessionSkippedEventCount;
+	// Set while the event held up by an aborting poly has been recorded.
+	bool sessionHeldEventRecorded;
+
+	// NULL unless the synth is being opened asynchronously, owned by the host thread.
+	AsyncOpenJob *asyncOpenJob;
+};
+
+inline void recordRenderCall(Extensions &extensions, SessionRenderCallType callType, Bit32u len) {
+	if (extensions.sessionRecorder != NULL) extensions.sessionRecorder->recordRenderCall(callType, len);
+}
+
+// Publishes the progress of opening the synth asynchronously. Returns false if opening is to be abandoned.
+bool reportOpenProgress(AsyncOpenJob *job, Bit32u percent);
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_SYNTH_IMPL_H
@@ -0,0 +1,115 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "internals.h"
+
+#include "Synth.h"
+#include "Analog.h"
+#include "CPUFeatures.h"
+#include "RealtimeCheck.h"
+#include "SessionRecorder.h"
+#include "StageTimer.h"
+#include "SynthImpl.h"
+#include "TraceSink.h"
+
+namespace MT32Emu {
+
+// Synth::renderLockstep() pairs the synths, so that the stereo output of both fits a four-lane SIMD vector.
+static const Bit32u LOCKSTEP_GROUP_SIZE = 2;
+
+bool Synth::isLockstepCapable() const {
+	return opened && analog->isLockstepCapable();
+}
+
+Bit32u Synth::getLockstepGroupSize() {
+	return LOCKSTEP_GROUP_SIZE;
+}
+
+void Synth::renderLockstep(Synth * const *synths, float * const *streams, Bit32u synthCount, Bit32u len) {
+	for (Bit32u firstSynth = 0; firstSynth < synthCount; firstSynth += LOCKSTEP_GROUP_SIZE) {
+		Synth *group[LOCKSTEP_GROUP_SIZE];
+		float *groupStreams[LOCKSTEP_GROUP_SIZE];
+		Bit32u groupSize = 0;
+		for (Bit32u i = firstSynth; i < synthCount && i < firstSynth + LOCKSTEP_GROUP_SIZE; i++) {
+			if (synths[i]->isLockstepCapable()) {
+				group[groupSize] = synths[i];
+				groupStreams[groupSize++] = streams[i];
+			} else {
+				synths[i]->render(streams[i], len);
+			}
+		}
+		if (groupSize > 1) {
+			renderLockstepGroup(group, groupStreams, groupSize, len);
+		} else if (groupSize > 0) {
+			group[0]->render(groupStreams[0], len);
+		}
+	}
+}
+
+// Each synth renders a block bypassing the LPF, then the LPFs of the group are applied to the blocks at once. The blocks
+// are no longer than a single rendering pass of any synth, so the passes are split exactly as in render().
+void Synth::renderLockstepGroup(Synth * const *synths, float * const *streams, Bit32u synthCount, Bit32u len) {
+	Bit32u blockLength = synths[0]->renderer->getBlockLength();
+	for (Bit32u i = 1; i < synthCount; i++) {
+		const Bit32u synthBlockLength = synths[i]->renderer->getBlockLength();
+		if (synthBlockLength < blockLength) blockLength = synthBlockLength;
+	}
+	Synth *filteredSynths[LOCKSTEP_GROUP_SIZE];
+	Analog *analogs[LOCKSTEP_GROUP_SIZE];
+	float *filteredStreams[LOCKSTEP_GROUP_SIZE];
+	Bit32u offset = 0;
+	while (offset < len) {
+		const Bit32u thisBlockLength = len - offset < blockLength ? len - offset : blockLength;
+		Bit32u filteredCount = 0;
+		for (Bit32u i = 0; i < synthCount; i++) {
+			Synth &synth = *synths[i];
+			float * const stream = streams[i] + (offset << 1);
+			// An idle synth merely mutes the output, that is left to render().
+			if (!synth.activated) {
+				synth.render(stream, thisBlockLength);
+				continue;
+			}
+			{
+				StageTimer renderTimer(synth.renderer->getStatistics().totalTime);
+				RealtimeScope realtimeScope("Synth::renderLockstep");
+				DenormalFlushScope denormalFlushScope(synth.renderer->isDenormalFlushingEnabled());
+				TraceZone traceZone("Synth::renderLockstep", synth.renderer->getRenderedSampleCount());
+				synth.renderer->renderBypassingLPF(stream, thisBlockLength);
+			}
+			recordRenderCall(synth.extensions, SessionRenderCallType_STEREO_FLOAT, thisBlockLength);
+			filteredSynths[filteredCount] = &synth;
+			analogs[filteredCount] = synth.analog;
+			filteredStreams[filteredCount++] = stream;
+		}
+		if (filteredCount > 0) {
+			// The time spent is shared evenly among the synths filtered.
+			double lpfTime = 0;
+			{
+				StageTimer lpfTimer(lpfTime);
+				DenormalFlushScope denormalFlushScope(filteredSynths[0]->renderer->isDenormalFlushingEnabled());
+				Analog::processLockstep(analogs, filteredStreams, filteredCount, thisBlockLength);
+			}
+			for (Bit32u i = 0; i < filteredCount; i++) {
+				RenderStatistics &statistics = filteredSynths[i]->renderer->getStatistics();
+				statistics.analogTime += lpfTime / filteredCount;
+				statistics.totalTime += lpfTime / filteredCount;
+			}
+		}
+		offset += thisBlockLength;
+	}
+}
+
+} // namespace MT32Emu
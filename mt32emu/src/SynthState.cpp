@@ -0,0 +1,874 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <new>
+
+#include "internals.h"
+
+#include "SynthState.h"
+#include "Analog.h"
+#include "BReverbModel.h"
+#include "File.h"
+#include "MidiEventQueue.h"
+#include "Part.h"
+#include "Partial.h"
+#include "PartialManager.h"
+#include "Poly.h"
+#include "ROMSet.h"
+#include "Structures.h"
+#include "Synth.h"
+#include "SynthImpl.h"
+
+namespace MT32Emu {
+
+// Marks a NULL reference.
+static const Bit32u NULL_REF = 0xFFFFFFFF;
+
+Bit32u calcStateChecksum(const Bit8u *data, size_t size) {
+	static const Bit32u ADLER_MODULUS = 65521;
+	// Largest number of bytes that may be summed up before the sums can overflow.
+	static const size_t MAX_RUN_LENGTH = 5552;
+
+	Bit32u a = 1, b = 0;
+	while (size > 0) {
+		size_t runLength = size < MAX_RUN_LENGTH ? size : MAX_RUN_LENGTH;
+		size -= runLength;
+		while (runLength-- > 0) {
+			a += *(data++);
+			b += a;
+		}
+		a %= ADLER_MODULUS;
+		b %= ADLER_MODULUS;
+	}
+	return (b << 16) | a;
+}
+
+// Runs shorter than this are merged into the surrounding literal, as the run header would outweigh the savings.
+static const size_t MIN_DELTA_RUN_LENGTH = 8;
+
+enum DeltaRunType {
+	DeltaRunType_COPY,
+	DeltaRunType_ZERO,
+	DeltaRunType_LITERAL
+};
+
+// Writes the run type and the length as a base-128 varint, returns the number of bytes written.
+static size_t writeDeltaRun(Bit8u *buffer, DeltaRunType type, size_t length) {
+	size_t size = 0;
+	if (buffer != NULL) buffer[size] = Bit8u(type);
+	size++;
+	do {
+		Bit8u nextByte = length & 0x7F;
+		length >>= 7;
+		if (length > 0) nextByte |= 0x80;
+		if (buffer != NULL) buffer[size] = nextByte;
+		size++;
+	} while (length > 0);
+	return size;
+}
+
+static size_t writeDeltaLiteral(Bit8u *buffer, const Bit8u *data, size_t length) {
+	if (length == 0) return 0;
+	const size_t runSize = writeDeltaRun(buffer, DeltaRunType_LITERAL, length);
+	if (buffer != NULL) memcpy(buffer + runSize, data, length);
+	return runSize + length;
+}
+
+size_t encodeStateDelta(const Bit8u *basePayload, size_t basePayloadSize, const Bit8u *payload, size_t payloadSize, Bit8u *buffer) {
+	const size_t comparableSize = basePayloadSize < payloadSize ? basePayloadSize : payloadSize;
+	size_t deltaSize = 0;
+	size_t literalStart = 0;
+	size_t position = 0;
+	while (position < payloadSize) {
+		size_t copyLength = 0;
+		while (position + copyLength < comparableSize && payload[position + copyLength] == basePayload[position + copyLength]) {
+			copyLength++;
+		}
+		size_t zeroLength = 0;
+		while (position + zeroLength < payloadSize && payload[position + zeroLength] == 0) {
+			zeroLength++;
+		}
+		if (copyLength < MIN_DELTA_RUN_LENGTH && zeroLength < MIN_DELTA_RUN_LENGTH) {
+			position++;
+			continue;
+		}
+		deltaSize += writeDeltaLiteral(buffer == NULL ? NULL : buffer + deltaSize, payload + literalStart, position - literalStart);
+		if (copyLength >= zeroLength) {
+			deltaSize += writeDeltaRun(buffer == NULL ? NULL : buffer + deltaSize, DeltaRunType_COPY, copyLength);
+			position += copyLength;
+		} else {
+			deltaSize += writeDeltaRun(buffer == NULL ? NULL : buffer + deltaSize, DeltaRunType_ZERO, zeroLength);
+			position += zeroLength;
+		}
+		literalStart = position;
+	}
+	deltaSize += writeDeltaLiteral(buffer == NULL ? NULL : buffer + deltaSize, payload + literalStart, position - literalStart);
+	return deltaSize;
+}
+
+bool decodeStateDelta(const Bit8u *basePayload, size_t basePayloadSize, const Bit8u *delta, size_t deltaSize, Bit8u *payload, size_t payloadSize) {
+	size_t deltaPosition = 0;
+	size_t position = 0;
+	while (deltaPosition < deltaSize) {
+		const Bit8u type = delta[deltaPosition++];
+		size_t length = 0;
+		for (unsigned int shift = 0;; shift += 7) {
+			if (deltaPosition == deltaSize || shift >= 8 * sizeof(size_t)) return false;
+			const Bit8u nextByte = delta[deltaPosition++];
+			length |= size_t(nextByte & 0x7F) << shift;
+			if ((nextByte & 0x80) == 0) break;
+		}
+		if (length > payloadSize - position) return false;
+		switch (type) {
+		case DeltaRunType_COPY:
+			if (position + length > basePayloadSize) return false;
+			memcpy(payload + position, basePayload + position, length);
+			break;
+		case DeltaRunType_ZERO:
+			memset(payload + position, 0, length);
+			break;
+		case DeltaRunType_LITERAL:
+			if (length > deltaSize - deltaPosition) return false;
+			memcpy(payload + position, delta + deltaPosition, length);
+			deltaPosition += length;
+			break;
+		default:
+			return false;
+		}
+		position += length;
+	}
+	return position == payloadSize;
+}
+
+StateWriter::StateWriter(const Synth &useSynth, Bit8u *useBuffer) : synth(useSynth), buffer(useBuffer), position(0) {}
+
+void StateWriter::writeBool(bool value) {
+	writeUInt8(value ? 1 : 0);
+}
+
+void StateWriter::writeUInt8(Bit8u value) {
+	if (buffer != NULL) buffer[position] = value;
+	position++;
+}
+
+void StateWriter::writeUInt16(Bit16u value) {
+	writeUInt8(Bit8u(value));
+	writeUInt8(Bit8u(value >> 8));
+}
+
+void StateWriter::writeUInt32(Bit32u value) {
+	writeUInt16(Bit16u(value));
+	writeUInt16(Bit16u(value >> 16));
+}
+
+void StateWriter::writeInt8(Bit8s value) {
+	writeUInt8(Bit8u(value));
+}
+
+void StateWriter::writeInt16(Bit16s value) {
+	writeUInt16(Bit16u(value));
+}
+
+void StateWriter::writeInt32(Bit32s value) {
+	writeUInt32(Bit32u(value));
+}
+
+void StateWriter::writeFloat(float value) {
+	Bit32u bits;
+	memcpy(&bits, &value, sizeof(bits));
+	writeUInt32(bits);
+}
+
+void StateWriter::writeBytes(const void *data, size_t length) {
+	if (buffer != NULL) memcpy(buffer + position, data, length);
+	position += length;
+}
+
+void StateWriter::writeSamples(const Bit16s *samples, Bit32u count) {
+	for (Bit32u i = 0; i < count; i++) {
+		writeInt16(samples[i]);
+	}
+}
+
+void StateWriter::writeSamples(const Bit32s *samples, Bit32u count) {
+	for (Bit32u i = 0; i < count; i++) {
+		writeInt32(samples[i]);
+	}
+}
+
+void StateWriter::writeSamples(const float *samples, Bit32u count) {
+	for (Bit32u i = 0; i < count; i++) {
+		writeFloat(samples[i]);
+	}
+}
+
+void StateWriter::writePartRef(const Part *part) {
+	for (Bit8u partNum = 0; partNum < 9; partNum++) {
+		if (part == synth.parts[partNum]) {
+			writeUInt8(partNum);
+			return;
+		}
+	}
+	writeUInt8(0xFF);
+}
+
+void StateWriter::writePolyRef(const Poly *poly) {
+	Bit32u polyIx = 0;
+	for (Bit8u partNum = 0; partNum < 9 && poly != NULL; partNum++) {
+		for (const Poly *activePoly = synth.parts[partNum]->getFirstActivePoly(); activePoly != NULL; activePoly = activePoly->getNext()) {
+			if (activePoly == poly) {
+				writeUInt32(polyIx);
+				return;
+			}
+			polyIx++;
+		}
+	}
+	writeUInt32(NULL_REF);
+}
+
+void StateWriter::writePartialRef(const Partial *partial) {
+	writeUInt32(partial == NULL ? NULL_REF : Bit32u(partial->debugGetPartialNum()));
+}
+
+void StateWriter::writeMemoryRef(const void *pointer) {
+	if (pointer == NULL) {
+		writeUInt32(NULL_REF);
+		return;
+	}
+	writeUInt32(Bit32u(static_cast<const Bit8u *>(pointer) - reinterpret_cast<const Bit8u *>(&synth.mt32ram)));
+}
+
+void StateWriter::writePCMRef(const Bit16s *pointer) {
+	writeUInt32(pointer == NULL ? NULL_REF : Bit32u(pointer - synth.pcmROMData));
+}
+
+void StateWriter::writePCMWaveRef(const PCMWaveEntry *pcmWave) {
+	writeUInt32(pcmWave == NULL ? NULL_REF : Bit32u(pcmWave - synth.pcmWaves));
+}
+
+void StateWriter::writePatchCache(const PatchCache &patchCache) {
+	writeBool(patchCache.playPartial);
+	writeBool(patchCache.PCMPartial);
+	writeInt32(patchCache.pcm);
+	writeUInt8(patchCache.waveform);
+	writeUInt32(patchCache.structureMix);
+	writeInt32(patchCache.structurePosition);
+	writeInt32(patchCache.structurePair);
+	writeBool(patchCache.dirty);
+	writeUInt32(patchCache.partialCount);
+	writeBool(patchCache.sustain);
+	writeBool(patchCache.reverb);
+	writeBytes(&patchCache.srcPartial, sizeof(patchCache.srcPartial));
+	writeMemoryRef(patchCache.partialParam);
+}
+
+void StateWriter::writePatchCacheRef(const PatchCache *patchCache) {
+	for (Bit8u partNum = 0; partNum < 9; partNum++) {
+		int cacheIx = synth.parts[partNum]->findPatchCache(patchCache);
+		if (cacheIx >= 0) {
+			writeUInt8(partNum);
+			writeUInt32(Bit32u(cacheIx));
+			return;
+		}
+	}
+	writeUInt8(0xFF);
+	writeUInt32(NULL_REF);
+}
+
+StateReader::StateReader(Synth &useSynth, const Bit8u *useData, size_t useSize) :
+	synth(useSynth), data(useData), size(useSize), position(0), failed(false),
+	polys(new Poly *[useSynth.getMaxPartialCount()]), polyCount(0)
+{}
+
+StateReader::~StateReader() {
+	delete[] polys;
+}
+
+const Bit8u *StateReader::readData(size_t length) {
+	if (failed || size - position < length) {
+		failed = true;
+		return NULL;
+	}
+	const Bit8u *result = data + position;
+	position += length;
+	return result;
+}
+
+bool StateReader::readBool() {
+	return readUInt8() != 0;
+}
+
+Bit8u StateReader::readUInt8() {
+	const Bit8u *bytes = readData(1);
+	return bytes == NULL ? 0 : bytes[0];
+}
+
+Bit16u StateReader::readUInt16() {
+	const Bit8u *bytes = readData(2);
+	return bytes == NULL ? 0 : Bit16u(bytes[0] | (bytes[1] << 8));
+}
+
+Bit32u StateReader::readUInt32() {
+	const Bit8u *bytes = readData(4);
+	return bytes == NULL ? 0 : Bit32u(bytes[0] | (bytes[1] << 8) | (bytes[2] << 16)) | (Bit32u(bytes[3]) << 24);
+}
+
+Bit8s StateReader::readInt8() {
+	return Bit8s(readUInt8());
+}
+
+Bit16s StateReader::readInt16() {
+	return Bit16s(readUInt16());
+}
+
+Bit32s StateReader::readInt32() {
+	return Bit32s(readUInt32());
+}
+
+float StateReader::readFloat() {
+	Bit32u bits = readUInt32();
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+void StateReader::readBytes(void *outData, size_t length) {
+	const Bit8u *bytes = readData(length);
+	if (bytes == NULL) {
+		memset(outData, 0, length);
+	} else {
+		memcpy(outData, bytes, length);
+	}
+}
+
+void StateReader::readSamples(Bit16s *samples, Bit32u count) {
+	for (Bit32u i = 0; i < count; i++) {
+		samples[i] = readInt16();
+	}
+}
+
+void StateReader::readSamples(Bit32s *samples, Bit32u count) {
+	for (Bit32u i = 0; i < count; i++) {
+		samples[i] = readInt32();
+	}
+}
+
+void StateReader::readSamples(float *samples, Bit32u count) {
+	for (Bit32u i = 0; i < count; i++) {
+		samples[i] = readFloat();
+	}
+}
+
+Bit32u StateReader::readIndex(Bit32u limit) {
+	Bit32u index = readUInt32();
+	if (index < limit) return index;
+	failed = true;
+	return 0;
+}
+
+Part *StateReader::readPartRef() {
+	Bit8u partNum = readUInt8();
+	if (partNum == 0xFF) return NULL;
+	if (partNum < 9) return synth.parts[partNum];
+	failed = true;
+	return NULL;
+}
+
+Poly *StateReader::readPolyRef() {
+	Bit32u polyIx = readUInt32();
+	if (polyIx == NULL_REF) return NULL;
+	if (polyIx < polyCount) return polys[polyIx];
+	failed = true;
+	return NULL;
+}
+
+void StateReader::addPoly(Poly *poly) {
+	// There are never more polys than partials, as the partial manager allocates as many.
+	polys[polyCount++] = poly;
+}
+
+Partial *StateReader::readPartialRef() {
+	Bit32u partialIx = readUInt32();
+	if (partialIx == NULL_REF) return NULL;
+	if (partialIx < synth.getMaxPartialCount()) return synth.partialManager->getPartial(partialIx);
+	failed = true;
+	return NULL;
+}
+
+// Checks whether the offset within the emulated memory points at an object in an array of count entries placed stride bytes apart.
+// Each entry holds objectCount objects of objectSize bytes, the first of them is at the same place as firstObject in the first entry.
+static bool isMemoryObjectOffset(const MemParams &mt32ram, Bit32u offset, const void *array, size_t count, size_t stride, const void *firstObject, size_t objectCount, size_t objectSize) {
+	const Bit8u *memory = reinterpret_cast<const Bit8u *>(&mt32ram);
+	const size_t arrayOffset = size_t(static_cast<const Bit8u *>(array) - memory);
+	if (offset < arrayOffset || (offset - arrayOffset) / stride >= count) return false;
+	const size_t entryOffset = (offset - arrayOffset) % stride;
+	const size_t firstObjectOffset = size_t(static_cast<const Bit8u *>(firstObject) - static_cast<const Bit8u *>(array));
+	if (entryOffset < firstObjectOffset) return false;
+	const size_t objectOffset = entryOffset - firstObjectOffset;
+	return objectOffset % objectSize == 0 && objectOffset / objectSize < objectCount;
+}
+
+// Normally, the values are limited by the max table as they are written to the emulated memory, and the emulation relies on that.
+// The bytes with the limit 0 are write-protected and may hold anything.
+static bool isWithinMaxTable(const void *object, const Bit8u *maxTable, size_t size) {
+	const Bit8u *data = static_cast<const Bit8u *>(object);
+	for (size_t i = 0; i < size; i++) {
+		if (maxTable[i] != 0 && data[i] > maxTable[i]) return false;
+	}
+	return true;
+}
+
+void StateReader::readMemoryRef(const TimbreParam::PartialParam *&partialParam) {
+	const MemParams &mt32ram = synth.mt32ram;
+	const Bit32u offset = readUInt32();
+	partialParam = NULL;
+	if (offset == NULL_REF) return;
+	// The parts refer to their timbres, yet the rhythm part uses the timbre memory directly.
+	if (isMemoryObjectOffset(mt32ram, offset, mt32ram.timbreTemp, 8, sizeof(TimbreParam), mt32ram.timbreTemp[0].partial, 4, sizeof(TimbreParam::PartialParam))
+		|| isMemoryObjectOffset(mt32ram, offset, mt32ram.timbres, 4 * 64, sizeof(MemParams::PaddedTimbre), mt32ram.timbres[0].timbre.partial, 4, sizeof(TimbreParam::PartialParam)))
+	{
+		partialParam = reinterpret_cast<const TimbreParam::PartialParam *>(reinterpret_cast<const Bit8u *>(&mt32ram) + offset);
+		const Bit8u *maxTable = &synth.controlROMData[synth.controlROMMap->timbreMaxTable + sizeof(TimbreParam::CommonParam)];
+		if (!isWithinMaxTable(partialParam, maxTable, sizeof(TimbreParam::PartialParam))) failed = true;
+	} else {
+		failed = true;
+	}
+}
+
+void StateReader::readMemoryRef(const MemParams::PatchTemp *&patchTemp) {
+	const MemParams &mt32ram = synth.mt32ram;
+	const Bit32u offset = readUInt32();
+	patchTemp = NULL;
+	if (offset == NULL_REF) return;
+	if (isMemoryObjectOffset(mt32ram, offset, mt32ram.patchTemp, 9, sizeof(MemParams::PatchTemp), mt32ram.patchTemp, 1, sizeof(MemParams::PatchTemp))) {
+		patchTemp = reinterpret_cast<const MemParams::PatchTemp *>(reinterpret_cast<const Bit8u *>(&mt32ram) + offset);
+		if (!isWithinMaxTable(patchTemp, &synth.controlROMData[synth.controlROMMap->patchMaxTable], sizeof(MemParams::PatchTemp))) failed = true;
+	} else {
+		failed = true;
+	}
+}
+
+void StateReader::readMemoryRef(const MemParams::RhythmTemp *&rhythmTemp) {
+	const MemParams &mt32ram = synth.mt32ram;
+	const Bit32u offset = readUInt32();
+	rhythmTemp = NULL;
+	if (offset == NULL_REF) return;
+	if (isMemoryObjectOffset(mt32ram, offset, mt32ram.rhythmTemp, 85, sizeof(MemParams::RhythmTemp), mt32ram.rhythmTemp, 1, sizeof(MemParams::RhythmTemp))) {
+		rhythmTemp = reinterpret_cast<const MemParams::RhythmTemp *>(reinterpret_cast<const Bit8u *>(&mt32ram) + offset);
+		if (!isWithinMaxTable(rhythmTemp, &synth.controlROMData[synth.controlROMMap->rhythmMaxTable], sizeof(MemParams::RhythmTemp))) failed = true;
+	} else {
+		failed = true;
+	}
+}
+
+const Bit16s *StateReader::readPCMRef(Bit32u length) {
+	Bit32u offset = readUInt32();
+	if (offset == NULL_REF) return NULL;
+	if (offset <= synth.pcmROMSize && length <= synth.pcmROMSize - offset) return synth.pcmROMData + offset;
+	failed = true;
+	return NULL;
+}
+
+const PCMWaveEntry *StateReader::readPCMWaveRef() {
+	Bit32u pcmWaveIx = readUInt32();
+	if (pcmWaveIx == NULL_REF) return NULL;
+	if (pcmWaveIx < synth.controlROMMap->pcmCount) return &synth.pcmWaves[pcmWaveIx];
+	failed = true;
+	return NULL;
+}
+
+void StateReader::readPatchCache(PatchCache &patchCache) {
+	patchCache.playPartial = readBool();
+	patchCache.PCMPartial = readBool();
+	patchCache.pcm = readInt32();
+	patchCache.waveform = readUInt8();
+	patchCache.structureMix = readUInt32();
+	patchCache.structurePosition = readInt32();
+	patchCache.structurePair = readInt32();
+	patchCache.dirty = readBool();
+	patchCache.partialCount = readUInt32();
+	patchCache.sustain = readBool();
+	patchCache.reverb = readBool();
+	readBytes(&patchCache.srcPartial, sizeof(patchCache.srcPartial));
+	readMemoryRef(patchCache.partialParam);
+
+	// The values used to look up the tables and the objects must be within the limits.
+	if (patchCache.pcm < 0 || patchCache.pcm > 127 || patchCache.structureMix > 3 || patchCache.structurePosition < 0
+		|| patchCache.structurePosition > 1 || patchCache.structurePair < 0 || patchCache.structurePair > 3 || patchCache.partialCount > 4)
+	{
+		failed = true;
+	}
+	const Bit8u *maxTable = &synth.controlROMData[synth.controlROMMap->timbreMaxTable + sizeof(TimbreParam::CommonParam)];
+	if (!isWithinMaxTable(&patchCache.srcPartial, maxTable, sizeof(TimbreParam::PartialParam))) failed = true;
+}
+
+const PatchCache *StateReader::readPatchCacheRef() {
+	Part *part = readPartRef();
+	Bit32u cacheIx = readUInt32();
+	const PatchCache *patchCache = part == NULL ? NULL : part->getPatchCache(cacheIx);
+	if (patchCache == NULL) failed = true;
+	return patchCache;
+}
+
+// Replaces the parts, the polys and the partials with fresh ones, as though the synth was just opened,
+// except that the parts don't set up their programs, so it is only useful before restoring the state.
+void Synth::recreatePartials() {
+	// The fresh objects take the places of the old ones in the arena.
+	void *partialManagerPlacement = partialManager;
+	void *partPlacements[9];
+	destroyArenaObject(partialManager);
+	for (int i = 0; i < 9; i++) {
+		partPlacements[i] = parts[i];
+		destroyArenaObject(parts[i]);
+	}
+	partialManager = new(partialManagerPlacement) PartialManager(this, parts, extensions.partialManagerStorage);
+	for (int i = 0; i < 8; i++) {
+		parts[i] = new(partPlacements[i]) Part(this, i);
+	}
+	parts[8] = new(partPlacements[8]) RhythmPart(this, 8);
+	abortingPoly = NULL;
+	discardPendingMemoryRefresh();
+}
+
+size_t Synth::saveState(Bit8u *buffer, size_t bufferSize) {
+	if (!opened) return 0;
+	applyPendingMemoryRefresh();
+	flushReverbPipeline();
+	// The saved synth memory must be complete
+	loadROMTimbres(0, 255);
+
+	StateWriter sizeCounter(*this, NULL);
+	saveStateContents(sizeCounter);
+	const size_t payloadSize = sizeCounter.getSize();
+	const size_t stateSize = STATE_HEADER_SIZE + payloadSize;
+	if (buffer == NULL || bufferSize < stateSize) return stateSize;
+
+	StateWriter payloadWriter(*this, buffer + STATE_HEADER_SIZE);
+	saveStateContents(payloadWriter);
+	StateWriter headerWriter(*this, buffer);
+	headerWriter.writeBytes(STATE_MAGIC, sizeof(STATE_MAGIC));
+	headerWriter.writeUInt32(STATE_VERSION);
+	headerWriter.writeUInt32(Bit32u(payloadSize));
+	headerWriter.writeUInt32(calcStateChecksum(buffer + STATE_HEADER_SIZE, payloadSize));
+	return stateSize;
+}
+
+// Validates the header and the checksum of the state saved by saveState(), the checksum is returned on success.
+bool Synth::checkState(const Bit8u *state, size_t stateSize, Bit32u &checksum) {
+	if (state == NULL || stateSize < STATE_HEADER_SIZE) return false;
+
+	StateReader headerReader(*this, state, STATE_HEADER_SIZE);
+	Bit8u magic[sizeof(STATE_MAGIC)];
+	headerReader.readBytes(magic, sizeof(magic));
+	const Bit32u version = headerReader.readUInt32();
+	const Bit32u payloadSize = headerReader.readUInt32();
+	checksum = headerReader.readUInt32();
+	if (memcmp(magic, STATE_MAGIC, sizeof(magic)) != 0 || version != STATE_VERSION) {
+		printDebug("Synth: Unsupported state format\n");
+		return false;
+	}
+	if (payloadSize != stateSize - STATE_HEADER_SIZE || checksum != calcStateChecksum(state + STATE_HEADER_SIZE, payloadSize)) {
+		printDebug("Synth: State is corrupted\n");
+		return false;
+	}
+	return true;
+}
+
+bool Synth::restoreState(const Bit8u *state, size_t stateSize) {
+	Bit32u checksum;
+	if (!opened || !checkState(state, stateSize, checksum)) return false;
+	return restoreStatePayload(state + STATE_HEADER_SIZE, stateSize - STATE_HEADER_SIZE);
+}
+
+bool Synth::restoreStatePayload(const Bit8u *payload, size_t payloadSize) {
+	StateReader reader(*this, payload, payloadSize);
+	if (!restoreStateContents(reader, true)) {
+		printDebug("Synth: State is saved by a synth configured differently\n");
+		return false;
+	}
+	if (reader.isFailed() || !reader.isAtEnd()) {
+		printDebug("Synth: State is invalid, resetting\n");
+		discardRestoredState();
+		return false;
+	}
+	return true;
+}
+
+size_t Synth::saveStateDelta(const Bit8u *baseState, size_t baseStateSize, Bit8u *buffer, size_t bufferSize) {
+	Bit32u baseChecksum;
+	if (!opened || !checkState(baseState, baseStateSize, baseChecksum)) return 0;
+	applyPendingMemoryRefresh();
+	flushReverbPipeline();
+	loadROMTimbres(0, 255);
+
+	StateWriter sizeCounter(*this, NULL);
+	saveStateContents(sizeCounter);
+	const size_t payloadSize = sizeCounter.getSize();
+	Bit8u *payload = new Bit8u[payloadSize];
+	StateWriter payloadWriter(*this, payload);
+	saveStateContents(payloadWriter);
+
+	const Bit8u *basePayload = baseState + STATE_HEADER_SIZE;
+	const size_t basePayloadSize = baseStateSize - STATE_HEADER_SIZE;
+	const size_t deltaSize = STATE_DELTA_HEADER_SIZE + encodeStateDelta(basePayload, basePayloadSize, payload, payloadSize, NULL);
+	if (buffer != NULL && bufferSize >= deltaSize) {
+		encodeStateDelta(basePayload, basePayloadSize, payload, payloadSize, buffer + STATE_DELTA_HEADER_SIZE);
+		StateWriter headerWriter(*this, buffer);
+		headerWriter.writeBytes(STATE_DELTA_MAGIC, sizeof(STATE_DELTA_MAGIC));
+		headerWriter.writeUInt32(STATE_VERSION);
+		headerWriter.writeUInt32(baseChecksum);
+		headerWriter.writeUInt32(Bit32u(payloadSize));
+		headerWriter.writeUInt32(calcStateChecksum(payload, payloadSize));
+	}
+	delete[] payload;
+	return deltaSize;
+}
+
+bool Synth::restoreStateDelta(const Bit8u *baseState, size_t baseStateSize, const Bit8u *delta, size_t deltaSize) {
+	Bit32u baseChecksum;
+	if (!opened || delta == NULL || deltaSize < STATE_DELTA_HEADER_SIZE || !checkState(baseState, baseStateSize, baseChecksum)) {
+		return false;
+	}
+
+	StateReader headerReader(*this, delta, STATE_DELTA_HEADER_SIZE);
+	Bit8u magic[sizeof(STATE_DELTA_MAGIC)];
+	headerReader.readBytes(magic, sizeof(magic));
+	const Bit32u version = headerReader.readUInt32();
+	const Bit32u deltaBaseChecksum = headerReader.readUInt32();
+	const Bit32u payloadSize = headerReader.readUInt32();
+	const Bit32u checksum = headerReader.readUInt32();
+	if (memcmp(magic, STATE_DELTA_MAGIC, sizeof(magic)) != 0 || version != STATE_VERSION) {
+		printDebug("Synth: Unsupported state delta format\n");
+		return false;
+	}
+	if (deltaBaseChecksum != baseChecksum) {
+		printDebug("Synth: State delta is saved against a different base state\n");
+		return false;
+	}
+
+	Bit8u *payload = new Bit8u[payloadSize];
+	const Bit8u *basePayload = baseState + STATE_HEADER_SIZE;
+	const size_t basePayloadSize = baseStateSize - STATE_HEADER_SIZE;
+	bool restored = decodeStateDelta(basePayload, basePayloadSize, delta + STATE_DELTA_HEADER_SIZE, deltaSize - STATE_DELTA_HEADER_SIZE, payload, payloadSize)
+		&& checksum == calcStateChecksum(payload, payloadSize);
+	if (restored) {
+		restored = restoreStatePayload(payload, payloadSize);
+	} else {
+		printDebug("Synth: State delta is corrupted\n");
+	}
+	delete[] payload;
+	return restored;
+}
+
+bool Synth::resetToOpenState() {
+	if (!opened) return false;
+	const bool reverbEnabled = isReverbEnabled();
+	StateReader reader(*this, extensions.openState, extensions.openStateSize);
+	if (!restoreStateContents(reader, false)) {
+		printDebug("Synth: Synth is reconfigured since opening, unable to reset to the open state\n");
+		return false;
+	}
+	// Unlike the other states, the open state is saved before the ROM timbres are referenced
+	resetPendingROMTimbres();
+	reportHandler->onDeviceReset();
+	if (reader.isFailed() || !reader.isAtEnd()) {
+		printDebug("Synth: Open state is invalid, resetting\n");
+		discardRestoredState();
+	}
+	// Enabling or disabling the reverb with the override is a runtime setting as well.
+	if (reverbOverridden) setReverbEnabled(reverbEnabled);
+	return true;
+}
+
+// Brings the synth to a consistent state after restoring an invalid state was abandoned midway.
+void Synth::discardRestoredState() {
+	mt32ram = mt32default;
+	resetPendingROMTimbres();
+	recreatePartials();
+	reset();
+	while (midiQueue->peekMidiEvent() != NULL) {
+		midiQueue->dropMidiEvent();
+	}
+	renderer->resetReverbPipeline();
+}
+
+void Synth::saveStateContents(StateWriter &writer) const {
+	// The configuration that must match.
+	writer.writeUInt8(Bit8u(renderer->getRendererType()));
+	writer.writeUInt32(extensions.partialCapacity);
+	writer.writeBytes(extensions.romSet->getControlROMDigest(), sizeof(File::SHA1Digest) - 1);
+	writer.writeBytes(extensions.romSet->getPCMROMDigest(), sizeof(File::SHA1Digest) - 1);
+	writer.writeUInt8(Bit8u(analog->getMode()));
+	writer.writeUInt32(renderer->getReverbPipelineLatency());
+
+	// The runtime settings.
+	writer.writeUInt32(partialCount);
+	writer.writeBool(reverbOverridden);
+	writer.writeBool(isMT32ReverbCompatibilityMode());
+	writer.writeFloat(extensions.reverbSilenceThreshold);
+	writer.writeUInt32(getDACInputMode());
+	writer.writeUInt32(midiDelayMode);
+	writer.writeFloat(getOutputGain());
+	writer.writeFloat(getReverbOutputGain());
+	writer.writeBool(isReversedStereoEnabled());
+	writer.writeBool(isNiceAmpRampEnabled());
+	writer.writeBool(isNicePanningEnabled());
+	writer.writeBool(isNicePartialMixingEnabled());
+	writer.writeUInt32(extensions.midiEventTimingQuantum);
+
+	// The emulation state.
+	writer.writeBytes(&mt32ram, sizeof(MemParams));
+	writer.writeInt32(extensions.masterTunePitchDelta);
+	writer.writeBytes(extensions.chantable, sizeof(extensions.chantable));
+	writer.writeUInt32(extensions.abortingPartIx);
+	writer.writeUInt32(renderedSampleCount);
+	writer.writeUInt32(lastReceivedMIDIEventTimestamp);
+	writer.writeBool(activated);
+	partialManager->saveState(writer);
+	for (int i = 0; i < 9; i++) {
+		parts[i]->saveState(writer);
+	}
+	for (Bit32u i = 0; i < extensions.partialCapacity; i++) {
+		partialManager->getPartial(i)->saveState(writer);
+	}
+	writer.writePolyRef(abortingPoly);
+
+	Bit8s reverbModelIx = -1;
+	for (int i = REVERB_MODE_ROOM; i <= REVERB_MODE_TAP_DELAY; i++) {
+		if (reverbModel == reverbModels[i]) reverbModelIx = Bit8s(i);
+	}
+	writer.writeInt8(reverbModelIx);
+	if (reverbModel != NULL) reverbModel->saveState(writer);
+	analog->saveState(writer);
+	renderer->saveState(writer);
+
+	Bit32u midiEventCount = 0;
+	while (midiQueue->peekMidiEvent(midiEventCount) != NULL) {
+		midiEventCount++;
+	}
+	writer.writeUInt32(midiEventCount);
+	for (Bit32u i = 0; i < midiEventCount; i++) {
+		const volatile MidiEventQueue::MidiEvent *midiEvent = midiQueue->peekMidiEvent(i);
+		writer.writeUInt32(midiEvent->timestamp);
+		writer.writeBool(midiEvent->sysexData != NULL);
+		if (midiEvent->sysexData == NULL) {
+			writer.writeUInt32(midiEvent->shortMessageData);
+		} else {
+			writer.writeUInt32(midiEvent->sysexLength);
+			writer.writeBytes(midiEvent->sysexData, midiEvent->sysexLength);
+		}
+	}
+}
+
+// Returns false if the configuration doesn't match, nothing is changed in this case.
+// Otherwise, the caller has to check the reader for errors. Unless restoreSettings is true,
+// the saved runtime settings are skipped, and the current ones are kept.
+bool Synth::restoreStateContents(StateReader &reader, bool restoreSettings) {
+	bool configMatches = reader.readUInt8() == renderer->getRendererType();
+	configMatches &= reader.readUInt32() == extensions.partialCapacity;
+	char digest[sizeof(File::SHA1Digest)] = { 0 };
+	reader.readBytes(digest, sizeof(digest) - 1);
+	configMatches &= memcmp(digest, extensions.romSet->getControlROMDigest(), sizeof(digest)) == 0;
+	reader.readBytes(digest, sizeof(digest) - 1);
+	configMatches &= memcmp(digest, extensions.romSet->getPCMROMDigest(), sizeof(digest)) == 0;
+	configMatches &= reader.readUInt8() == analog->getMode();
+	configMatches &= reader.readUInt32() == renderer->getReverbPipelineLatency();
+	if (!configMatches || reader.isFailed()) return false;
+
+	const Bit32u savedPartialCount = reader.readIndex(extensions.partialCapacity + 1);
+	if (savedPartialCount == 0) reader.fail();
+	const bool savedReverbOverridden = reader.readBool();
+	const bool savedReverbCompatibilityMode = reader.readBool();
+	const float savedReverbSilenceThreshold = reader.readFloat();
+	const DACInputMode savedDACInputMode = DACInputMode(reader.readIndex(DACInputMode_GENERATION2 + 1));
+	const MIDIDelayMode savedMIDIDelayMode = MIDIDelayMode(reader.readIndex(MIDIDelayMode_DELAY_ALL + 1));
+	const float savedOutputGain = reader.readFloat();
+	const float savedReverbOutputGain = reader.readFloat();
+	const bool savedReversedStereoEnabled = reader.readBool();
+	const bool savedNiceAmpRampEnabled = reader.readBool();
+	const bool savedNicePanningEnabled = reader.readBool();
+	const bool savedNicePartialMixingEnabled = reader.readBool();
+	const Bit32u savedMIDIEventTimingQuantum = reader.readUInt32();
+	if (restoreSettings) {
+		if (!reader.isFailed()) partialCount = savedPartialCount;
+		setReverbOverridden(savedReverbOverridden);
+		setReverbCompatibilityMode(savedReverbCompatibilityMode);
+		setReverbSilenceThreshold(savedReverbSilenceThreshold);
+		setDACInputMode(savedDACInputMode);
+		setMIDIDelayMode(savedMIDIDelayMode);
+		setOutputGain(savedOutputGain);
+		setReverbOutputGain(savedReverbOutputGain);
+		setReversedStereoEnabled(savedReversedStereoEnabled);
+		setNiceAmpRampEnabled(savedNiceAmpRampEnabled);
+		setNicePanningEnabled(savedNicePanningEnabled);
+		setNicePartialMixingEnabled(savedNicePartialMixingEnabled);
+		setMIDIEventTimingQuantum(savedMIDIEventTimingQuantum);
+	}
+	// The analog circuitry state restored below includes the gains as actually applied.
+	latchRealtimeParameters(true);
+
+	renderer->resetReverbPipeline();
+	reader.readBytes(&mt32ram, sizeof(MemParams));
+	memset(extensions.pendingROMTimbres, 0, sizeof(extensions.pendingROMTimbres));
+	recreatePartials();
+	extensions.masterTunePitchDelta = reader.readInt32();
+	reader.readBytes(extensions.chantable, sizeof(extensions.chantable));
+	extensions.abortingPartIx = reader.readIndex(9);
+	renderedSampleCount = reader.readUInt32();
+	lastReceivedMIDIEventTimestamp = reader.readUInt32();
+	activated = reader.readBool();
+	partialManager->restoreState(reader);
+	for (int i = 0; i < 9 && !reader.isFailed(); i++) {
+		parts[i]->restoreState(reader);
+	}
+	for (Bit32u i = 0; i < extensions.partialCapacity && !reader.isFailed(); i++) {
+		partialManager->getPartial(i)->restoreState(reader);
+	}
+	abortingPoly = reader.readPolyRef();
+
+	setReverbEnabled(false);
+	Bit8s reverbModelIx = reader.readInt8();
+	if (REVERB_MODE_ROOM <= reverbModelIx && reverbModelIx <= REVERB_MODE_TAP_DELAY) {
+		reverbModel = getReverbModel(Bit8u(reverbModelIx));
+		reverbModel->open();
+		reverbModel->restoreState(reader);
+	} else if (reverbModelIx != -1) {
+		reader.fail();
+	}
+	analog->restoreState(reader);
+	renderer->restoreState(reader);
+
+	while (midiQueue->peekMidiEvent() != NULL) {
+		midiQueue->dropMidiEvent();
+	}
+	const Bit32u midiEventCount = reader.readUInt32();
+	for (Bit32u i = 0; i < midiEventCount && !reader.isFailed(); i++) {
+		MidiEventQueue::MidiEvent midiEvent;
+		midiEvent.timestamp = reader.readUInt32();
+		const bool sysex = reader.readBool();
+		// Note, the SysEx data is copied to the queue storage.
+		midiEvent.shortMessageData = reader.readUInt32();
+		midiEvent.sysexData = sysex ? reader.readData(midiEvent.sysexLength) : NULL;
+		if (!reader.isFailed() && midiQueue->pushMidiEvents(&midiEvent, 1) == 0) {
+			printDebug("Synth: MIDI event queue is too small to fit the state\n");
+			reader.fail();
+		}
+	}
+	return true;
+}
+
+} // namespace MT32Emu
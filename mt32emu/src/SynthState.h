@@ -0,0 +1,164 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_SYNTH_STATE_H
+#define MT32EMU_SYNTH_STATE_H
+
+#include <cstddef>
+
+#include "globals.h"
+#include "Types.h"
+#include "Structures.h"
+
+namespace MT32Emu {
+
+class Part;
+class Partial;
+class Poly;
+class Synth;
+// The state saved by Synth::saveState() starts with a header composed of the magic, the format version,
+// the size of the payload that follows and its checksum.
+const Bit8u STATE_MAGIC[8] = {'M', 'T', '3', '2', 'E', 'M', 'U', 'S'};
+const Bit32u STATE_VERSION = 3;
+const size_t STATE_HEADER_SIZE = sizeof(STATE_MAGIC) + 3 * 4;
+
+// Computes the Adler-32 checksum of the data.
+Bit32u calcStateChecksum(const Bit8u *data, size_t size);
+
+// The delta saved by Synth::saveStateDelta() starts with a header composed of the magic, the format version,
+// the checksum of the base payload, the size and the checksum of the payload the delta reconstructs.
+const Bit8u STATE_DELTA_MAGIC[8] = {'M', 'T', '3', '2', 'E', 'M', 'U', 'D'};
+const size_t STATE_DELTA_HEADER_SIZE = sizeof(STATE_DELTA_MAGIC) + 4 * 4;
+
+// Encodes the payload as a sequence of runs, each being either copied from the base payload at the same position,
+// or filled with zeros, or stored literally. Returns the size of the encoded delta, nothing is written if the buffer is NULL.
+size_t encodeStateDelta(const Bit8u *basePayload, size_t basePayloadSize, const Bit8u *payload, size_t payloadSize, Bit8u *buffer);
+// Reconstructs the payload of the given size encoded by encodeStateDelta(). Returns false if the delta is malformed.
+bool decodeStateDelta(const Bit8u *basePayload, size_t basePayloadSize, const Bit8u *delta, size_t deltaSize, Bit8u *payload, size_t payloadSize);
+
+// Serialises the emulation state in the little-endian byte order, regardless of the host. The objects are written
+// as plain values, and the pointers between them are translated to indices (or offsets into the emulated memory
+// and the PCM ROM), so that the state can be restored by a different process. When the buffer is NULL, the bytes
+// are merely counted, which lets the size of the state be found out in advance.
+class StateWriter {
+public:
+	StateWriter(const Synth &synth, Bit8u *buffer);
+
+	size_t getSize() const {
+		return position;
+	}
+
+	void writeBool(bool value);
+	void writeUInt8(Bit8u value);
+	void writeUInt16(Bit16u value);
+	void writeUInt32(Bit32u value);
+	void writeInt8(Bit8s value);
+	void writeInt16(Bit16s value);
+	void writeInt32(Bit32s value);
+	void writeFloat(float value);
+	void writeBytes(const void *data, size_t length);
+	void writeSamples(const Bit16s *samples, Bit32u count);
+	void writeSamples(const Bit32s *samples, Bit32u count);
+	void writeSamples(const float *samples, Bit32u count);
+
+	// The references below may be NULL.
+	void writePartRef(const Part *part);
+	void writePolyRef(const Poly *poly);
+	void writePartialRef(const Partial *partial);
+	// The pointer must point into the emulated memory.
+	void writeMemoryRef(const void *pointer);
+	// The pointer must point into the PCM ROM.
+	void writePCMRef(const Bit16s *pointer);
+	void writePCMWaveRef(const PCMWaveEntry *pcmWave);
+
+	// Writes the contents of a patch cache entry.
+	void writePatchCache(const PatchCache &patchCache);
+	// Writes a reference to a patch cache entry owned by a part, which must not be NULL.
+	void writePatchCacheRef(const PatchCache *patchCache);
+
+private:
+	const Synth &synth;
+	Bit8u * const buffer;
+	size_t position;
+};
+
+// Deserialises the emulation state written by StateWriter. The references are validated against the objects
+// and the memory of the synth, and a violation marks the state invalid. Once that happens, the subsequent reads
+// return zeros or NULL, so that the callers needn't bail out immediately, yet the results must be discarded.
+class StateReader {
+public:
+	StateReader(Synth &synth, const Bit8u *data, size_t size);
+	~StateReader();
+
+	bool isFailed() const {
+		return failed;
+	}
+
+	bool isAtEnd() const {
+		return position == size;
+	}
+
+	void fail() {
+		failed = true;
+	}
+
+	bool readBool();
+	Bit8u readUInt8();
+	Bit16u readUInt16();
+	Bit32u readUInt32();
+	Bit8s readInt8();
+	Bit16s readInt16();
+	Bit32s readInt32();
+	float readFloat();
+	void readBytes(void *data, size_t length);
+	// Returns a pointer to the specified number of bytes within the state, or NULL if there are fewer.
+	const Bit8u *readData(size_t length);
+	void readSamples(Bit16s *samples, Bit32u count);
+	void readSamples(Bit32s *samples, Bit32u count);
+	void readSamples(float *samples, Bit32u count);
+	// Reads a value that must be less than the limit.
+	Bit32u readIndex(Bit32u limit);
+
+	Part *readPartRef();
+	// Polys are referenced in the order they are registered while the parts are restored.
+	Poly *readPolyRef();
+	void addPoly(Poly *poly);
+	Partial *readPartialRef();
+	// The references into the emulated memory must point exactly at an object of the expected type.
+	void readMemoryRef(const TimbreParam::PartialParam *&partialParam);
+	void readMemoryRef(const MemParams::PatchTemp *&patchTemp);
+	void readMemoryRef(const MemParams::RhythmTemp *&rhythmTemp);
+	// Validates that the referenced PCM data spans at least the specified number of samples.
+	const Bit16s *readPCMRef(Bit32u length);
+	const PCMWaveEntry *readPCMWaveRef();
+
+	void readPatchCache(PatchCache &patchCache);
+	const PatchCache *readPatchCacheRef();
+
+private:
+	Synth &synth;
+	const Bit8u * const data;
+	const size_t size;
+	size_t position;
+	bool failed;
+
+	Poly **polys;
+	Bit32u polyCount;
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_SYNTH_STATE_H
@@ -27,6 +27,7 @@
 #include "Partial.h"
 #include "Poly.h"
 #include "Synth.h"
+#include "SynthState.h"
 #include "Tables.h"
 
 namespace MT32Emu {
@@ -240,7 +241,7 @@ void TVA::recalcSustain() {
 	} else {
 		newIncrement = (tables->envLogarithmicTime[Bit8u(-targetDelta)] - 2) | 0x80;
 	}
-	if (part->getSynth()->isNiceAmpRampEnabled() && (descending != ampRamp->isBelowCurrent(newTarget))) {
+	if (part->getSynth()->isLatchedNiceAmpRampEnabled() && (descending != ampRamp->isBelowCurrent(newTarget))) {
 		newIncrement ^= 0x80;
 	}
 
@@ -378,4 +379,31 @@ void TVA::nextPhase() {
 	startRamp(Bit8u(newTarget), Bit8u(newIncrement), newPhase);
 }
 
+void TVA::saveState(StateWriter &writer) const {
+	writer.writePartRef(part);
+	writer.writeMemoryRef(partialParam);
+	writer.writeMemoryRef(patchTemp);
+	writer.writeMemoryRef(rhythmTemp);
+	writer.writeBool(playing);
+	writer.writeInt32(biasAmpSubtraction);
+	writer.writeInt32(veloAmpSubtraction);
+	writer.writeInt32(keyTimeSubtraction);
+	writer.writeUInt8(target);
+	writer.writeUInt32(Bit32u(phase));
+}
+
+void TVA::restoreState(StateReader &reader) {
+	part = reader.readPartRef();
+	reader.readMemoryRef(partialParam);
+	reader.readMemoryRef(patchTemp);
+	reader.readMemoryRef(rhythmTemp);
+	playing = reader.readBool();
+	biasAmpSubtraction = reader.readInt32();
+	veloAmpSubtraction = reader.readInt32();
+	keyTimeSubtraction = reader.readInt32();
+	target = reader.readUInt8();
+	phase = int(reader.readIndex(TVA_PHASE_DEAD + 1));
+	if (part == NULL || partialParam == NULL || patchTemp == NULL) reader.fail();
+}
+
 } // namespace MT32Emu
@@ -22,6 +22,7 @@
 #include "Partial.h"
 #include "Poly.h"
 #include "Synth.h"
+#include "SynthState.h"
 #include "Tables.h"
 
 namespace MT32Emu {
@@ -237,4 +238,23 @@ void TVF::nextPhase() {
 	startRamp(newTarget, newIncrement, newPhase);
 }
 
+void TVF::saveState(StateWriter &writer) const {
+	writer.writeMemoryRef(partialParam);
+	writer.writeUInt8(baseCutoff);
+	writer.writeInt32(keyTimeSubtraction);
+	writer.writeUInt32(levelMult);
+	writer.writeUInt8(target);
+	writer.writeUInt32(phase);
+}
+
+void TVF::restoreState(StateReader &reader) {
+	reader.readMemoryRef(partialParam);
+	baseCutoff = reader.readUInt8();
+	keyTimeSubtraction = reader.readInt32();
+	levelMult = reader.readUInt32();
+	target = reader.readUInt8();
+	phase = reader.readIndex(PHASE_DONE + 1);
+	if (partialParam == NULL) reader.fail();
+}
+
 } // namespace MT32Emu
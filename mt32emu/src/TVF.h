@@ -26,6 +26,8 @@ namespace MT32Emu {
 
 class LA32Ramp;
 class Partial;
+class StateReader;
+class StateWriter;
 
 class TVF {
 private:
@@ -54,6 +56,9 @@ public:
 	Bit8u getBaseCutoff() const;
 	void handleInterrupt();
 	void startDecay();
+
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 }; // class TVF
 
 } // namespace MT32Emu
@@ -24,6 +24,7 @@
 #include "Partial.h"
 #include "Poly.h"
 #include "Synth.h"
+#include "SynthState.h"
 #include "TVA.h"
 
 namespace MT32Emu {
@@ -59,7 +60,33 @@ static const int NOMINAL_PROCESS_TIMER_PERIOD_SAMPLES = SAMPLE_RATE / 4000;
 static const int PROCESS_TIMER_INCREMENT_x8 = 8 * 500000 / SAMPLE_RATE;
 
 TVP::TVP(const Partial *usePartial) :
-	partial(usePartial), system(&usePartial->getSynth()->mt32ram.system) {
+	partial(usePartial), system(&usePartial->getSynth()->mt32ram.system), randomSeed(0) {
+}
+
+// A simple linear congruential generator, as suggested by the C standard for rand(), is perfectly enough here.
+static inline Bit32u nextRandomSeed(const Bit32u seed) {
+	return seed * 1103515245 + 12345;
+}
+
+static inline int getProcessTimerPeriod(const Bit32u random) {
+	// This roughly emulates pitch deviations observed on real units when playing a single partial that uses TVP/LFO.
+	return NOMINAL_PROCESS_TIMER_PERIOD_SAMPLES + int(random & 3);
+}
+
+Bit32u TVP::nextRandom() {
+	randomSeed = nextRandomSeed(randomSeed);
+	return (randomSeed >> 16) & 0x7FFF;
+}
+
+Bit32u TVP::startTimerJitter(Bit32u seed, Bit32u length) {
+	randomSeed = seed;
+	// The timer fires when the counter reaches zero within the pass, and each time it draws a random number for the next period.
+	Bit32u sampleOffset = Bit32u(counter);
+	while (sampleOffset < length) {
+		seed = nextRandomSeed(seed);
+		sampleOffset += Bit32u(getProcessTimerPeriod((seed >> 16) & 0x7FFF));
+	}
+	return seed;
 }
 
 static Bit16s keyToPitch(unsigned int key) {
@@ -306,16 +333,41 @@ Bit16u TVP::nextPitch() {
 	// However, accurate emulation is quite complicated because the timer is not guaranteed to fire in time.
 	// This makes pitch variations on real unit non-deterministic and dependent on various factors.
 	if (counter == 0) {
-		timeElapsed = (timeElapsed + processTimerIncrement) & 0x00FFFFFF;
-		// This roughly emulates pitch deviations observed on real units when playing a single partial that uses TVP/LFO.
-		counter = NOMINAL_PROCESS_TIMER_PERIOD_SAMPLES + (rand() & 3);
-		processTimerIncrement = (PROCESS_TIMER_INCREMENT_x8 * counter) >> 3;
-		process();
+		fireTimer();
 	}
 	counter--;
 	return pitch;
 }
 
+Bit32u TVP::getSamplesUntilStateChange() const {
+	return Bit32u(counter);
+}
+
+Bit16u TVP::nextPitches(Bit16u *buffer, Bit32u sampleCount) {
+	while (sampleCount > 0) {
+		if (counter == 0) {
+			fireTimer();
+		}
+		// The pitch stays intact until the timer fires again
+		Bit32u runLength = Bit32u(counter) < sampleCount ? Bit32u(counter) : sampleCount;
+		if (buffer != NULL) {
+			for (Bit32u i = 0; i < runLength; i++) {
+				*(buffer++) = pitch;
+			}
+		}
+		counter -= int(runLength);
+		sampleCount -= runLength;
+	}
+	return pitch;
+}
+
+void TVP::fireTimer() {
+	timeElapsed = (timeElapsed + processTimerIncrement) & 0x00FFFFFF;
+	counter = getProcessTimerPeriod(nextRandom());
+	processTimerIncrement = (PROCESS_TIMER_INCREMENT_x8 * counter) >> 3;
+	process();
+}
+
 void TVP::process() {
 	if (phase == 0) {
 		targetPitchOffsetReached();
@@ -349,4 +401,46 @@ void TVP::process() {
 	updatePitch();
 }
 
+void TVP::saveState(StateWriter &writer) const {
+	if (!partial->isActive()) return;
+	writer.writePartRef(part);
+	writer.writeMemoryRef(partialParam);
+	writer.writeMemoryRef(patchTemp);
+	writer.writeInt32(processTimerIncrement);
+	writer.writeInt32(counter);
+	writer.writeUInt32(timeElapsed);
+	writer.writeInt32(phase);
+	writer.writeUInt32(basePitch);
+	writer.writeInt32(targetPitchOffsetWithoutLFO);
+	writer.writeInt32(currentPitchOffset);
+	writer.writeInt16(lfoPitchOffset);
+	writer.writeInt8(timeKeyfollowSubtraction);
+	writer.writeInt16(pitchOffsetChangePerBigTick);
+	writer.writeUInt16(targetPitchOffsetReachedBigTick);
+	writer.writeUInt32(shifts);
+	writer.writeUInt16(pitch);
+}
+
+void TVP::restoreState(StateReader &reader) {
+	if (!partial->isActive()) return;
+	part = reader.readPartRef();
+	reader.readMemoryRef(partialParam);
+	reader.readMemoryRef(patchTemp);
+	processTimerIncrement = reader.readInt32();
+	counter = int(reader.readIndex(NOMINAL_PROCESS_TIMER_PERIOD_SAMPLES + 4));
+	timeElapsed = reader.readUInt32();
+	phase = int(reader.readIndex(9));
+	basePitch = reader.readUInt32();
+	targetPitchOffsetWithoutLFO = reader.readInt32();
+	currentPitchOffset = reader.readInt32();
+	lfoPitchOffset = reader.readInt16();
+	timeKeyfollowSubtraction = reader.readInt8();
+	pitchOffsetChangePerBigTick = reader.readInt16();
+	targetPitchOffsetReachedBigTick = reader.readUInt16();
+	// Both the shifts in updatePitch() must stay within the width of int.
+	shifts = reader.readIndex(13 + 32);
+	pitch = reader.readUInt16();
+	if (part == NULL || partialParam == NULL || patchTemp == NULL) reader.fail();
+}
+
 } // namespace MT32Emu
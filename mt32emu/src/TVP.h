@@ -26,6 +26,8 @@ namespace MT32Emu {
 
 class Part;
 class Partial;
+class StateReader;
+class StateWriter;
 
 class TVP {
 private:
@@ -55,6 +57,12 @@ private:
 
 	Bit16u pitch;
 
+	// Copy of the state of the synth-wide pseudo-random number generator used to emulate the timer jitter,
+	// taken by startTimerJitter() for the current rendering pass.
+	Bit32u randomSeed;
+
+	Bit32u nextRandom();
+	void fireTimer();
 	void updatePitch();
 	void setupPitchChange(int targetPitchOffset, Bit8u changeDuration);
 	void targetPitchOffsetReached();
@@ -65,7 +73,22 @@ public:
 	void reset(const Part *part, const TimbreParam::PartialParam *partialParam);
 	Bit32u getBasePitch() const;
 	Bit16u nextPitch();
+	// Returns the number of upcoming calls to nextPitch() that return the current pitch without processing,
+	// i.e. before the emulated MCU timer fires next time. Besides the timer, only startDecay() changes the state.
+	Bit32u getSamplesUntilStateChange() const;
+	// Equivalent to calling nextPitch() sampleCount times. If buffer is not NULL, it receives the pitch for each sample.
+	// Returns the last pitch. Note, processing may also update the TVA sustain level, so that a caller that interleaves
+	// TVA and TVP evaluation per sample should only batch the runs within getSamplesUntilStateChange().
+	Bit16u nextPitches(Bit16u *buffer, Bit32u sampleCount);
 	void startDecay();
+	// Takes the state of the synth-wide generator of the timer jitter before the next length samples are rendered.
+	// Returns the state after the random numbers the timer draws meanwhile, so that the generator is stepped
+	// in the order of the partials regardless of the order or the threads they are actually rendered in.
+	Bit32u startTimerJitter(Bit32u seed, Bit32u length);
+
+	// Nothing is saved unless the partial is active.
+	void saveState(StateWriter &writer) const;
+	void restoreState(StateReader &reader);
 }; // class TVP
 
 } // namespace MT32Emu
@@ -18,80 +18,430 @@
 #include "internals.h"
 
 #include "Tables.h"
-#include "mmath.h"
 
 namespace MT32Emu {
 
 // UNUSED: const int MIDDLEC = 60;
 
-const Tables &Tables::getInstance() {
-	static const Tables instance;
-	return instance;
-}
+// found from sample analysis
+static const Bit8u RES_AMP_DECAY_FACTOR_TABLE[] = {31, 16, 12, 8, 5, 3, 2, 1};
 
-Tables::Tables() {
-	for (int lf = 0; lf <= 100; lf++) {
-		// CONFIRMED:KG: This matches a ROM table found by Mok
-		float fVal = (2.0f - LOG10F(float(lf) + 1.0f)) * 128.0f;
-		int val = int(fVal + 1.0);
-		if (val > 255) {
-			val = 255;
-		}
-		levelToAmpSubtraction[lf] = Bit8u(val);
-	}
+// The tables are constant data, so that they are shared read-only and need no initialisation at run time.
+// The formulas they were generated with are given below each comment, the float maths is evaluated in single precision.
+static const Tables TABLES = {
+	// levelToAmpSubtraction
+	// CONFIRMED:KG: This matches a ROM table found by Mok
+	// val = int((2.0f - LOG10F(float(lf) + 1.0f)) * 128.0f + 1.0), clamped to 255, for lf = 0..100
+	{
+		255, 218, 195, 179, 167, 157, 148, 141, 134, 129, 123, 118, 114, 110, 106, 102,
+		99, 96, 93, 90, 87, 85, 82, 80, 78, 75, 73, 71, 69, 67, 66, 64,
+		62, 60, 59, 57, 56, 54, 53, 51, 50, 49, 47, 46, 45, 44, 42, 41,
+		40, 39, 38, 37, 36, 35, 34, 33, 32, 31, 30, 29, 28, 27, 26, 25,
+		24, 24, 23, 22, 21, 20, 20, 19, 18, 17, 16, 16, 15, 14, 14, 13,
+		12, 12, 11, 10, 10, 9, 8, 8, 7, 6, 6, 5, 5, 4, 3, 3,
+		2, 2, 1, 1, 0
+	},
 
-	envLogarithmicTime[0] = 64;
-	for (int lf = 1; lf <= 255; lf++) {
-		// CONFIRMED:KG: This matches a ROM table found by Mok
-		envLogarithmicTime[lf] = Bit8u(ceil(64.0f + LOG2F(float(lf)) * 8.0f));
-	}
+	// envLogarithmicTime
+	// CONFIRMED:KG: This matches a ROM table found by Mok
+	// 64 for lf = 0, Bit8u(ceil(64.0f + LOG2F(float(lf)) * 8.0f)) for lf = 1..255
+	{
+		64, 64, 72, 77, 80, 83, 85, 87, 88, 90, 91, 92, 93, 94, 95, 96,
+		96, 97, 98, 98, 99, 100, 100, 101, 101, 102, 102, 103, 103, 103, 104, 104,
+		104, 105, 105, 106, 106, 106, 106, 107, 107, 107, 108, 108, 108, 108, 109, 109,
+		109, 109, 110, 110, 110, 110, 111, 111, 111, 111, 111, 112, 112, 112, 112, 112,
+		112, 113, 113, 113, 113, 113, 114, 114, 114, 114, 114, 114, 114, 115, 115, 115,
+		115, 115, 115, 116, 116, 116, 116, 116, 116, 116, 116, 117, 117, 117, 117, 117,
+		117, 117, 117, 118, 118, 118, 118, 118, 118, 118, 118, 118, 119, 119, 119, 119,
+		119, 119, 119, 119, 119, 119, 120, 120, 120, 120, 120, 120, 120, 120, 120, 120,
+		120, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 121, 122, 122, 122, 122,
+		122, 122, 122, 122, 122, 122, 122, 122, 122, 123, 123, 123, 123, 123, 123, 123,
+		123, 123, 123, 123, 123, 123, 124, 124, 124, 124, 124, 124, 124, 124, 124, 124,
+		124, 124, 124, 124, 124, 124, 125, 125, 125, 125, 125, 125, 125, 125, 125, 125,
+		125, 125, 125, 125, 125, 125, 126, 126, 126, 126, 126, 126, 126, 126, 126, 126,
+		126, 126, 126, 126, 126, 126, 126, 126, 127, 127, 127, 127, 127, 127, 127, 127,
+		127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 127, 128, 128, 128, 128, 128,
+		128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128
+	},
 
-#if 0
-	// The table below is to be used in conjunction with emulation of VCA of newer generation units which is currently missing.
-	// These relatively small values are rather intended to fine-tune the overall amplification of the VCA.
-	// CONFIRMED: Based on a table found by Mok in the LAPC-I control ROM
-	// Note that this matches the MT-32 table, but with the values clamped to a maximum of 8.
-	memset(masterVolToAmpSubtraction, 8, 71);
-	memset(masterVolToAmpSubtraction + 71, 7, 3);
-	memset(masterVolToAmpSubtraction + 74, 6, 4);
-	memset(masterVolToAmpSubtraction + 78, 5, 3);
-	memset(masterVolToAmpSubtraction + 81, 4, 4);
-	memset(masterVolToAmpSubtraction + 85, 3, 3);
-	memset(masterVolToAmpSubtraction + 88, 2, 4);
-	memset(masterVolToAmpSubtraction + 92, 1, 4);
-	memset(masterVolToAmpSubtraction + 96, 0, 5);
-#else
+	// masterVolToAmpSubtraction
 	// CONFIRMED: Based on a table found by Mok in the MT-32 control ROM
-	masterVolToAmpSubtraction[0] = 255;
-	for (int masterVol = 1; masterVol <= 100; masterVol++) {
-		masterVolToAmpSubtraction[masterVol] = Bit8u(106.31 - 16.0f * LOG2F(float(masterVol)));
-	}
-#endif
+	// 255 for masterVol = 0, Bit8u(106.31 - 16.0f * LOG2F(float(masterVol))) for masterVol = 1..100
+	// The LAPC-I control ROM contains a similar table intended to be used in conjunction with emulation of VCA
+	// of newer generation units which is currently missing. It matches the MT-32 table, but with the values clamped
+	// to a maximum of 8. These relatively small values are rather intended to fine-tune the overall amplification of the VCA.
+	{
+		255, 106, 90, 80, 74, 69, 64, 61, 58, 55, 53, 50, 48, 47, 45, 43,
+		42, 40, 39, 38, 37, 36, 34, 33, 32, 32, 31, 30, 29, 28, 27, 27,
+		26, 25, 24, 24, 23, 22, 22, 21, 21, 20, 20, 19, 18, 18, 17, 17,
+		16, 16, 16, 15, 15, 14, 14, 13, 13, 12, 12, 12, 11, 11, 11, 10,
+		10, 9, 9, 9, 8, 8, 8, 7, 7, 7, 6, 6, 6, 6, 5, 5,
+		5, 4, 4, 4, 4, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1,
+		0, 0, 0, 0, 0
+	},
 
-	for (int i = 0; i <= 100; i++) {
-		pulseWidth100To255[i] = Bit8u(i * 255 / 100.0f + 0.5f);
-		//synth->printDebug("%d: %d", i, pulseWidth100To255[i]);
-	}
+	// pulseWidth100To255
+	// Bit8u(i * 255 / 100.0f + 0.5f) for i = 0..100
+	{
+		0, 3, 5, 8, 10, 13, 15, 18, 20, 23, 26, 28, 31, 33, 36, 38,
+		41, 43, 46, 48, 51, 54, 56, 59, 61, 64, 66, 69, 71, 74, 77, 79,
+		82, 84, 87, 89, 92, 94, 97, 99, 102, 105, 107, 110, 112, 115, 117, 120,
+		122, 125, 128, 130, 133, 135, 138, 140, 143, 145, 148, 150, 153, 156, 158, 161,
+		163, 166, 168, 171, 173, 176, 179, 181, 184, 186, 189, 191, 194, 196, 199, 201,
+		204, 207, 209, 212, 214, 217, 219, 222, 224, 227, 230, 232, 235, 237, 240, 242,
+		245, 247, 250, 252, 255
+	},
 
+	// exp9
 	// The LA32 chip contains an exponent table inside. The table contains 12-bit integer values.
 	// The actual table size is 512 rows. The 9 higher bits of the fractional part of the argument are used as a lookup address.
 	// To improve the precision of computations, the lower bits are supposed to be used for interpolation as the LA32 chip also
 	// contains another 512-row table with inverted differences between the main table values.
-	for (int i = 0; i < 512; i++) {
-		exp9[i] = Bit16u(8191.5f - EXP2F(13.0f + ~i / 512.0f));
-	}
+	// Bit16u(8191.5f - EXP2F(13.0f + ~i / 512.0f)) for i = 0..511
+	{
+		10, 21, 32, 43, 54, 65, 76, 87, 98, 109, 120, 131, 142, 153, 164, 175,
+		185, 196, 207, 218, 229, 239, 250, 261, 272, 282, 293, 304, 314, 325, 336, 346,
+		357, 368, 378, 389, 399, 410, 420, 431, 441, 452, 462, 473, 483, 494, 504, 514,
+		525, 535, 546, 556, 566, 577, 587, 597, 607, 618, 628, 638, 648, 659, 669, 679,
+		689, 699, 709, 719, 730, 740, 750, 760, 770, 780, 790, 800, 810, 820, 830, 840,
+		850, 860, 870, 880, 889, 899, 909, 919, 929, 939, 949, 958, 968, 978, 988, 997,
+		1007, 1017, 1027, 1036, 1046, 1056, 1065, 1075, 1085, 1094, 1104, 1113, 1123, 1132, 1142, 1152,
+		1161, 1171, 1180, 1190, 1199, 1208, 1218, 1227, 1237, 1246, 1256, 1265, 1274, 1284, 1293, 1302,
+		1312, 1321, 1330, 1340, 1349, 1358, 1367, 1377, 1386, 1395, 1404, 1413, 1423, 1432, 1441, 1450,
+		1459, 1468, 1477, 1486, 1495, 1505, 1514, 1523, 1532, 1541, 1550, 1559, 1568, 1577, 1585, 1594,
+		1603, 1612, 1621, 1630, 1639, 1648, 1657, 1665, 1674, 1683, 1692, 1701, 1710, 1718, 1727, 1736,
+		1745, 1753, 1762, 1771, 1779, 1788, 1797, 1805, 1814, 1823, 1831, 1840, 1848, 1857, 1866, 1874,
+		1883, 1891, 1900, 1908, 1917, 1925, 1934, 1942, 1951, 1959, 1967, 1976, 1984, 1993, 2001, 2009,
+		2018, 2026, 2035, 2043, 2051, 2059, 2068, 2076, 2084, 2093, 2101, 2109, 2117, 2126, 2134, 2142,
+		2150, 2158, 2166, 2175, 2183, 2191, 2199, 2207, 2215, 2223, 2231, 2239, 2247, 2255, 2264, 2272,
+		2280, 2288, 2296, 2304, 2311, 2319, 2327, 2335, 2343, 2351, 2359, 2367, 2375, 2383, 2391, 2398,
+		2406, 2414, 2422, 2430, 2437, 2445, 2453, 2461, 2469, 2476, 2484, 2492, 2499, 2507, 2515, 2523,
+		2530, 2538, 2545, 2553, 2561, 2568, 2576, 2584, 2591, 2599, 2606, 2614, 2621, 2629, 2636, 2644,
+		2651, 2659, 2666, 2674, 2681, 2689, 2696, 2704, 2711, 2719, 2726, 2733, 2741, 2748, 2755, 2763,
+		2770, 2778, 2785, 2792, 2799, 2807, 2814, 2821, 2829, 2836, 2843, 2850, 2858, 2865, 2872, 2879,
+		2886, 2894, 2901, 2908, 2915, 2922, 2929, 2936, 2943, 2951, 2958, 2965, 2972, 2979, 2986, 2993,
+		3000, 3007, 3014, 3021, 3028, 3035, 3042, 3049, 3056, 3063, 3070, 3077, 3084, 3091, 3097, 3104,
+		3111, 3118, 3125, 3132, 3139, 3146, 3152, 3159, 3166, 3173, 3180, 3186, 3193, 3200, 3207, 3213,
+		3220, 3227, 3234, 3240, 3247, 3254, 3260, 3267, 3274, 3280, 3287, 3294, 3300, 3307, 3313, 3320,
+		3327, 3333, 3340, 3346, 3353, 3359, 3366, 3372, 3379, 3386, 3392, 3398, 3405, 3411, 3418, 3424,
+		3431, 3437, 3444, 3450, 3457, 3463, 3469, 3476, 3482, 3488, 3495, 3501, 3508, 3514, 3520, 3527,
+		3533, 3539, 3545, 3552, 3558, 3564, 3571, 3577, 3583, 3589, 3595, 3602, 3608, 3614, 3620, 3626,
+		3633, 3639, 3645, 3651, 3657, 3663, 3670, 3676, 3682, 3688, 3694, 3700, 3706, 3712, 3718, 3724,
+		3730, 3736, 3742, 3748, 3754, 3760, 3766, 3772, 3778, 3784, 3790, 3796, 3802, 3808, 3814, 3820,
+		3826, 3832, 3838, 3844, 3849, 3855, 3861, 3867, 3873, 3879, 3885, 3890, 3896, 3902, 3908, 3914,
+		3919, 3925, 3931, 3937, 3943, 3948, 3954, 3960, 3965, 3971, 3977, 3983, 3988, 3994, 4000, 4005,
+		4011, 4017, 4022, 4028, 4034, 4039, 4045, 4050, 4056, 4062, 4067, 4073, 4078, 4084, 4089, 4095
+	},
 
-	// There is a logarithmic sine table inside the LA32 chip. The table contains 13-bit integer values.
-	for (int i = 1; i < 512; i++) {
-		logsin9[i] = Bit16u(0.5f - LOG2F(sin((i + 0.5f) / 1024.0f * FLOAT_PI)) * 1024.0f);
-	}
+	// interpolatedExp
+	// The result of the exponent table lookup with interpolation for every 12-bit fractional argument, as computed by the LA32 chip.
+	// This removes the interpolation from the conversion of each wave sample from the logarithmic domain.
+	// With expTabIndex = fract >> 3, extraBits = ~fract & 7, expTabEntry2 = 8191 - exp9[expTabIndex] and
+	// expTabEntry1 = 8191 - exp9[expTabIndex - 1] (8191 if expTabIndex == 0):
+	// Bit16u(expTabEntry2 + (((expTabEntry1 - expTabEntry2) * extraBits) >> 3)) for fract = 0..4095
+	{
+		8189, 8188, 8187, 8186, 8184, 8183, 8182, 8181, 8179, 8178, 8176, 8175, 8174, 8172, 8171, 8170,
+		8168, 8167, 8165, 8164, 8163, 8161, 8160, 8159, 8157, 8156, 8154, 8153, 8152, 8150, 8149, 8148,
+		8146, 8145, 8143, 8142, 8141, 8139, 8138, 8137, 8135, 8134, 8132, 8131, 8130, 8128, 8127, 8126,
+		8124, 8123, 8121, 8120, 8119, 8117, 8116, 8115, 8113, 8112, 8110, 8109, 8108, 8106, 8105, 8104,
+		8102, 8101, 8099, 8098, 8097, 8095, 8094, 8093, 8091, 8090, 8088, 8087, 8086, 8084, 8083, 8082,
+		8080, 8079, 8077, 8076, 8075, 8073, 8072, 8071, 8069, 8068, 8066, 8065, 8064, 8062, 8061, 8060,
+		8058, 8057, 8055, 8054, 8053, 8051, 8050, 8049, 8047, 8046, 8044, 8043, 8042, 8040, 8039, 8038,
+		8036, 8035, 8033, 8032, 8031, 8029, 8028, 8027, 8025, 8024, 8022, 8021, 8020, 8018, 8017, 8016,
+		8014, 8013, 8012, 8011, 8009, 8008, 8007, 8006, 8004, 8003, 8001, 8000, 7999, 7997, 7996, 7995,
+		7993, 7992, 7990, 7989, 7988, 7986, 7985, 7984, 7982, 7981, 7979, 7978, 7977, 7975, 7974, 7973,
+		7971, 7970, 7968, 7967, 7966, 7964, 7963, 7962, 7960, 7959, 7958, 7957, 7955, 7954, 7953, 7952,
+		7950, 7949, 7947, 7946, 7945, 7943, 7942, 7941, 7939, 7938, 7936, 7935, 7934, 7932, 7931, 7930,
+		7928, 7927, 7925, 7924, 7923, 7921, 7920, 7919, 7917, 7916, 7915, 7914, 7912, 7911, 7910, 7909,
+		7907, 7906, 7904, 7903, 7902, 7900, 7899, 7898, 7896, 7895, 7893, 7892, 7891, 7889, 7888, 7887,
+		7885, 7884, 7883, 7882, 7880, 7879, 7878, 7877, 7875, 7874, 7872, 7871, 7870, 7868, 7867, 7866,
+		7864, 7863, 7861, 7860, 7859, 7857, 7856, 7855, 7853, 7852, 7851, 7850, 7848, 7847, 7846, 7845,
+		7843, 7842, 7840, 7839, 7838, 7836, 7835, 7834, 7832, 7831, 7829, 7828, 7827, 7825, 7824, 7823,
+		7821, 7820, 7819, 7818, 7816, 7815, 7814, 7813, 7811, 7810, 7808, 7807, 7806, 7804, 7803, 7802,
+		7800, 7799, 7798, 7797, 7795, 7794, 7793, 7792, 7790, 7789, 7787, 7786, 7785, 7783, 7782, 7781,
+		7779, 7778, 7777, 7776, 7774, 7773, 7772, 7771, 7769, 7768, 7766, 7765, 7764, 7762, 7761, 7760,
+		7758, 7757, 7756, 7755, 7753, 7752, 7751, 7750, 7748, 7747, 7745, 7744, 7743, 7741, 7740, 7739,
+		7737, 7736, 7735, 7734, 7732, 7731, 7730, 7729, 7727, 7726, 7724, 7723, 7722, 7720, 7719, 7718,
+		7716, 7715, 7714, 7713, 7711, 7710, 7709, 7708, 7706, 7705, 7703, 7702, 7701, 7699, 7698, 7697,
+		7695, 7694, 7693, 7692, 7690, 7689, 7688, 7687, 7685, 7684, 7683, 7682, 7680, 7679, 7678, 7677,
+		7675, 7674, 7672, 7671, 7670, 7668, 7667, 7666, 7664, 7663, 7662, 7661, 7659, 7658, 7657, 7656,
+		7654, 7653, 7651, 7650, 7649, 7647, 7646, 7645, 7643, 7642, 7641, 7640, 7638, 7637, 7636, 7635,
+		7633, 7632, 7631, 7630, 7628, 7627, 7626, 7625, 7623, 7622, 7620, 7619, 7618, 7616, 7615, 7614,
+		7612, 7611, 7610, 7609, 7607, 7606, 7605, 7604, 7602, 7601, 7600, 7599, 7597, 7596, 7595, 7594,
+		7592, 7591, 7590, 7589, 7587, 7586, 7585, 7584, 7582, 7581, 7579, 7578, 7577, 7575, 7574, 7573,
+		7571, 7570, 7569, 7568, 7566, 7565, 7564, 7563, 7561, 7560, 7559, 7558, 7556, 7555, 7554, 7553,
+		7551, 7550, 7549, 7548, 7546, 7545, 7544, 7543, 7541, 7540, 7538, 7537, 7536, 7534, 7533, 7532,
+		7530, 7529, 7528, 7527, 7525, 7524, 7523, 7522, 7520, 7519, 7518, 7517, 7515, 7514, 7513, 7512,
+		7510, 7509, 7508, 7507, 7505, 7504, 7503, 7502, 7500, 7499, 7498, 7497, 7495, 7494, 7493, 7492,
+		7490, 7489, 7488, 7487, 7485, 7484, 7483, 7482, 7480, 7479, 7478, 7477, 7475, 7474, 7473, 7472,
+		7470, 7469, 7467, 7466, 7465, 7463, 7462, 7461, 7459, 7458, 7457, 7456, 7454, 7453, 7452, 7451,
+		7449, 7448, 7447, 7446, 7444, 7443, 7442, 7441, 7439, 7438, 7437, 7436, 7434, 7433, 7432, 7431,
+		7429, 7428, 7427, 7426, 7424, 7423, 7422, 7421, 7419, 7418, 7417, 7416, 7414, 7413, 7412, 7411,
+		7409, 7408, 7407, 7406, 7404, 7403, 7402, 7401, 7399, 7398, 7397, 7396, 7394, 7393, 7392, 7391,
+		7389, 7388, 7387, 7386, 7384, 7383, 7382, 7381, 7379, 7378, 7377, 7376, 7374, 7373, 7372, 7371,
+		7369, 7368, 7367, 7366, 7364, 7363, 7362, 7361, 7359, 7358, 7357, 7356, 7354, 7353, 7352, 7351,
+		7349, 7348, 7347, 7346, 7344, 7343, 7342, 7341, 7339, 7338, 7337, 7336, 7334, 7333, 7332, 7331,
+		7329, 7328, 7327, 7326, 7324, 7323, 7322, 7321, 7319, 7318, 7317, 7316, 7314, 7313, 7312, 7311,
+		7309, 7308, 7307, 7306, 7305, 7304, 7303, 7302, 7300, 7299, 7298, 7297, 7295, 7294, 7293, 7292,
+		7290, 7289, 7288, 7287, 7285, 7284, 7283, 7282, 7280, 7279, 7278, 7277, 7275, 7274, 7273, 7272,
+		7270, 7269, 7268, 7267, 7265, 7264, 7263, 7262, 7260, 7259, 7258, 7257, 7255, 7254, 7253, 7252,
+		7250, 7249, 7248, 7247, 7245, 7244, 7243, 7242, 7240, 7239, 7238, 7237, 7236, 7235, 7234, 7233,
+		7231, 7230, 7229, 7228, 7226, 7225, 7224, 7223, 7221, 7220, 7219, 7218, 7216, 7215, 7214, 7213,
+		7211, 7210, 7209, 7208, 7206, 7205, 7204, 7203, 7201, 7200, 7199, 7198, 7197, 7196, 7195, 7194,
+		7192, 7191, 7190, 7189, 7187, 7186, 7185, 7184, 7182, 7181, 7180, 7179, 7177, 7176, 7175, 7174,
+		7172, 7171, 7170, 7169, 7167, 7166, 7165, 7164, 7162, 7161, 7160, 7159, 7158, 7157, 7156, 7155,
+		7153, 7152, 7151, 7150, 7148, 7147, 7146, 7145, 7143, 7142, 7141, 7140, 7138, 7137, 7136, 7135,
+		7133, 7132, 7131, 7130, 7129, 7128, 7127, 7126, 7124, 7123, 7122, 7121, 7119, 7118, 7117, 7116,
+		7114, 7113, 7112, 7111, 7109, 7108, 7107, 7106, 7104, 7103, 7102, 7101, 7100, 7099, 7098, 7097,
+		7095, 7094, 7093, 7092, 7090, 7089, 7088, 7087, 7085, 7084, 7083, 7082, 7081, 7080, 7079, 7078,
+		7076, 7075, 7074, 7073, 7071, 7070, 7069, 7068, 7066, 7065, 7064, 7063, 7062, 7061, 7060, 7059,
+		7057, 7056, 7055, 7054, 7052, 7051, 7050, 7049, 7047, 7046, 7045, 7044, 7042, 7041, 7040, 7039,
+		7037, 7036, 7035, 7034, 7033, 7032, 7031, 7030, 7028, 7027, 7026, 7025, 7023, 7022, 7021, 7020,
+		7018, 7017, 7016, 7015, 7014, 7013, 7012, 7011, 7009, 7008, 7007, 7006, 7004, 7003, 7002, 7001,
+		6999, 6998, 6997, 6996, 6995, 6994, 6993, 6992, 6990, 6989, 6988, 6987, 6986, 6985, 6984, 6983,
+		6981, 6980, 6979, 6978, 6976, 6975, 6974, 6973, 6971, 6970, 6969, 6968, 6967, 6966, 6965, 6964,
+		6962, 6961, 6960, 6959, 6957, 6956, 6955, 6954, 6952, 6951, 6950, 6949, 6948, 6947, 6946, 6945,
+		6943, 6942, 6941, 6940, 6938, 6937, 6936, 6935, 6933, 6932, 6931, 6930, 6929, 6928, 6927, 6926,
+		6924, 6923, 6922, 6921, 6920, 6919, 6918, 6917, 6915, 6914, 6913, 6912, 6910, 6909, 6908, 6907,
+		6905, 6904, 6903, 6902, 6901, 6900, 6899, 6898, 6896, 6895, 6894, 6893, 6892, 6891, 6890, 6889,
+		6887, 6886, 6885, 6884, 6882, 6881, 6880, 6879, 6877, 6876, 6875, 6874, 6873, 6872, 6871, 6870,
+		6868, 6867, 6866, 6865, 6864, 6863, 6862, 6861, 6859, 6858, 6857, 6856, 6854, 6853, 6852, 6851,
+		6849, 6848, 6847, 6846, 6845, 6844, 6843, 6842, 6840, 6839, 6838, 6837, 6836, 6835, 6834, 6833,
+		6831, 6830, 6829, 6828, 6827, 6826, 6825, 6824, 6822, 6821, 6820, 6819, 6817, 6816, 6815, 6814,
+		6812, 6811, 6810, 6809, 6808, 6807, 6806, 6805, 6803, 6802, 6801, 6800, 6799, 6798, 6797, 6796,
+		6794, 6793, 6792, 6791, 6790, 6789, 6788, 6787, 6785, 6784, 6783, 6782, 6781, 6780, 6779, 6778,
+		6776, 6775, 6774, 6773, 6771, 6770, 6769, 6768, 6766, 6765, 6764, 6763, 6762, 6761, 6760, 6759,
+		6757, 6756, 6755, 6754, 6753, 6752, 6751, 6750, 6748, 6747, 6746, 6745, 6744, 6743, 6742, 6741,
+		6739, 6738, 6737, 6736, 6735, 6734, 6733, 6732, 6730, 6729, 6728, 6727, 6726, 6725, 6724, 6723,
+		6721, 6720, 6719, 6718, 6717, 6716, 6715, 6714, 6712, 6711, 6710, 6709, 6708, 6707, 6706, 6705,
+		6703, 6702, 6701, 6700, 6699, 6698, 6697, 6696, 6694, 6693, 6692, 6691, 6689, 6688, 6687, 6686,
+		6684, 6683, 6682, 6681, 6680, 6679, 6678, 6677, 6675, 6674, 6673, 6672, 6671, 6670, 6669, 6668,
+		6666, 6665, 6664, 6663, 6662, 6661, 6660, 6659, 6657, 6656, 6655, 6654, 6653, 6652, 6651, 6650,
+		6648, 6647, 6646, 6645, 6644, 6643, 6642, 6641, 6639, 6638, 6637, 6636, 6635, 6634, 6633, 6632,
+		6630, 6629, 6628, 6627, 6626, 6625, 6624, 6623, 6621, 6620, 6619, 6618, 6617, 6616, 6615, 6614,
+		6613, 6612, 6611, 6610, 6609, 6608, 6607, 6606, 6604, 6603, 6602, 6601, 6600, 6599, 6598, 6597,
+		6595, 6594, 6593, 6592, 6591, 6590, 6589, 6588, 6586, 6585, 6584, 6583, 6582, 6581, 6580, 6579,
+		6577, 6576, 6575, 6574, 6573, 6572, 6571, 6570, 6568, 6567, 6566, 6565, 6564, 6563, 6562, 6561,
+		6559, 6558, 6557, 6556, 6555, 6554, 6553, 6552, 6550, 6549, 6548, 6547, 6546, 6545, 6544, 6543,
+		6541, 6540, 6539, 6538, 6537, 6536, 6535, 6534, 6533, 6532, 6531, 6530, 6529, 6528, 6527, 6526,
+		6524, 6523, 6522, 6521, 6520, 6519, 6518, 6517, 6515, 6514, 6513, 6512, 6511, 6510, 6509, 6508,
+		6506, 6505, 6504, 6503, 6502, 6501, 6500, 6499, 6497, 6496, 6495, 6494, 6493, 6492, 6491, 6490,
+		6488, 6487, 6486, 6485, 6484, 6483, 6482, 6481, 6480, 6479, 6478, 6477, 6476, 6475, 6474, 6473,
+		6471, 6470, 6469, 6468, 6467, 6466, 6465, 6464, 6462, 6461, 6460, 6459, 6458, 6457, 6456, 6455,
+		6453, 6452, 6451, 6450, 6449, 6448, 6447, 6446, 6445, 6444, 6443, 6442, 6441, 6440, 6439, 6438,
+		6436, 6435, 6434, 6433, 6432, 6431, 6430, 6429, 6427, 6426, 6425, 6424, 6423, 6422, 6421, 6420,
+		6419, 6418, 6417, 6416, 6415, 6414, 6413, 6412, 6410, 6409, 6408, 6407, 6406, 6405, 6404, 6403,
+		6401, 6400, 6399, 6398, 6397, 6396, 6395, 6394, 6393, 6392, 6391, 6390, 6389, 6388, 6387, 6386,
+		6384, 6383, 6382, 6381, 6380, 6379, 6378, 6377, 6375, 6374, 6373, 6372, 6371, 6370, 6369, 6368,
+		6367, 6366, 6365, 6364, 6363, 6362, 6361, 6360, 6358, 6357, 6356, 6355, 6354, 6353, 6352, 6351,
+		6350, 6349, 6348, 6347, 6346, 6345, 6344, 6343, 6341, 6340, 6339, 6338, 6337, 6336, 6335, 6334,
+		6332, 6331, 6330, 6329, 6328, 6327, 6326, 6325, 6324, 6323, 6322, 6321, 6320, 6319, 6318, 6317,
+		6315, 6314, 6313, 6312, 6311, 6310, 6309, 6308, 6307, 6306, 6305, 6304, 6303, 6302, 6301, 6300,
+		6298, 6297, 6296, 6295, 6294, 6293, 6292, 6291, 6290, 6289, 6288, 6287, 6286, 6285, 6284, 6283,
+		6281, 6280, 6279, 6278, 6277, 6276, 6275, 6274, 6273, 6272, 6271, 6270, 6269, 6268, 6267, 6266,
+		6264, 6263, 6262, 6261, 6260, 6259, 6258, 6257, 6256, 6255, 6254, 6253, 6252, 6251, 6250, 6249,
+		6247, 6246, 6245, 6244, 6243, 6242, 6241, 6240, 6239, 6238, 6237, 6236, 6235, 6234, 6233, 6232,
+		6231, 6230, 6229, 6228, 6227, 6226, 6225, 6224, 6222, 6221, 6220, 6219, 6218, 6217, 6216, 6215,
+		6214, 6213, 6212, 6211, 6210, 6209, 6208, 6207, 6205, 6204, 6203, 6202, 6201, 6200, 6199, 6198,
+		6197, 6196, 6195, 6194, 6193, 6192, 6191, 6190, 6189, 6188, 6187, 6186, 6185, 6184, 6183, 6182,
+		6180, 6179, 6178, 6177, 6176, 6175, 6174, 6173, 6172, 6171, 6170, 6169, 6168, 6167, 6166, 6165,
+		6163, 6162, 6161, 6160, 6159, 6158, 6157, 6156, 6155, 6154, 6153, 6152, 6151, 6150, 6149, 6148,
+		6147, 6146, 6145, 6144, 6143, 6142, 6141, 6140, 6139, 6138, 6137, 6136, 6135, 6134, 6133, 6132,
+		6130, 6129, 6128, 6127, 6126, 6125, 6124, 6123, 6122, 6121, 6120, 6119, 6118, 6117, 6116, 6115,
+		6114, 6113, 6112, 6111, 6110, 6109, 6108, 6107, 6105, 6104, 6103, 6102, 6101, 6100, 6099, 6098,
+		6097, 6096, 6095, 6094, 6093, 6092, 6091, 6090, 6089, 6088, 6087, 6086, 6085, 6084, 6083, 6082,
+		6081, 6080, 6079, 6078, 6077, 6076, 6075, 6074, 6072, 6071, 6070, 6069, 6068, 6067, 6066, 6065,
+		6064, 6063, 6062, 6061, 6060, 6059, 6058, 6057, 6056, 6055, 6054, 6053, 6052, 6051, 6050, 6049,
+		6048, 6047, 6046, 6045, 6044, 6043, 6042, 6041, 6040, 6039, 6038, 6037, 6036, 6035, 6034, 6033,
+		6032, 6031, 6030, 6029, 6028, 6027, 6026, 6025, 6023, 6022, 6021, 6020, 6019, 6018, 6017, 6016,
+		6015, 6014, 6013, 6012, 6011, 6010, 6009, 6008, 6007, 6006, 6005, 6004, 6003, 6002, 6001, 6000,
+		5999, 5998, 5997, 5996, 5995, 5994, 5993, 5992, 5991, 5990, 5989, 5988, 5987, 5986, 5985, 5984,
+		5983, 5982, 5981, 5980, 5979, 5978, 5977, 5976, 5975, 5974, 5973, 5972, 5971, 5970, 5969, 5968,
+		5967, 5966, 5965, 5964, 5963, 5962, 5961, 5960, 5959, 5958, 5957, 5956, 5955, 5954, 5953, 5952,
+		5951, 5950, 5949, 5948, 5947, 5946, 5945, 5944, 5943, 5942, 5941, 5940, 5939, 5938, 5937, 5936,
+		5934, 5933, 5932, 5931, 5930, 5929, 5928, 5927, 5926, 5925, 5924, 5923, 5922, 5921, 5920, 5919,
+		5918, 5917, 5916, 5915, 5914, 5913, 5912, 5911, 5910, 5909, 5908, 5907, 5906, 5905, 5904, 5903,
+		5902, 5901, 5900, 5899, 5898, 5897, 5896, 5895, 5894, 5893, 5892, 5891, 5890, 5889, 5888, 5887,
+		5886, 5885, 5884, 5883, 5882, 5881, 5880, 5880, 5879, 5878, 5877, 5876, 5875, 5874, 5873, 5872,
+		5871, 5870, 5869, 5868, 5867, 5866, 5865, 5864, 5863, 5862, 5861, 5860, 5859, 5858, 5857, 5856,
+		5855, 5854, 5853, 5852, 5851, 5850, 5849, 5848, 5847, 5846, 5845, 5844, 5843, 5842, 5841, 5840,
+		5839, 5838, 5837, 5836, 5835, 5834, 5833, 5832, 5831, 5830, 5829, 5828, 5827, 5826, 5825, 5824,
+		5823, 5822, 5821, 5820, 5819, 5818, 5817, 5816, 5815, 5814, 5813, 5812, 5811, 5810, 5809, 5808,
+		5807, 5806, 5805, 5804, 5803, 5802, 5801, 5800, 5799, 5798, 5797, 5796, 5795, 5794, 5793, 5793,
+		5792, 5791, 5790, 5789, 5788, 5787, 5786, 5785, 5784, 5783, 5782, 5781, 5780, 5779, 5778, 5777,
+		5776, 5775, 5774, 5773, 5772, 5771, 5770, 5769, 5768, 5767, 5766, 5765, 5764, 5763, 5762, 5761,
+		5760, 5759, 5758, 5757, 5756, 5755, 5754, 5754, 5753, 5752, 5751, 5750, 5749, 5748, 5747, 5746,
+		5745, 5744, 5743, 5742, 5741, 5740, 5739, 5738, 5737, 5736, 5735, 5734, 5733, 5732, 5731, 5730,
+		5729, 5728, 5727, 5726, 5725, 5724, 5723, 5722, 5721, 5720, 5719, 5718, 5717, 5716, 5715, 5715,
+		5714, 5713, 5712, 5711, 5710, 5709, 5708, 5707, 5706, 5705, 5704, 5703, 5702, 5701, 5700, 5699,
+		5698, 5697, 5696, 5695, 5694, 5693, 5692, 5692, 5691, 5690, 5689, 5688, 5687, 5686, 5685, 5684,
+		5683, 5682, 5681, 5680, 5679, 5678, 5677, 5676, 5675, 5674, 5673, 5672, 5671, 5670, 5669, 5668,
+		5667, 5666, 5665, 5664, 5663, 5662, 5661, 5661, 5660, 5659, 5658, 5657, 5656, 5655, 5654, 5653,
+		5652, 5651, 5650, 5649, 5648, 5647, 5646, 5646, 5645, 5644, 5643, 5642, 5641, 5640, 5639, 5638,
+		5637, 5636, 5635, 5634, 5633, 5632, 5631, 5630, 5629, 5628, 5627, 5626, 5625, 5624, 5623, 5623,
+		5622, 5621, 5620, 5619, 5618, 5617, 5616, 5615, 5614, 5613, 5612, 5611, 5610, 5609, 5608, 5607,
+		5606, 5605, 5604, 5603, 5602, 5601, 5600, 5600, 5599, 5598, 5597, 5596, 5595, 5594, 5593, 5592,
+		5591, 5590, 5589, 5588, 5587, 5586, 5585, 5585, 5584, 5583, 5582, 5581, 5580, 5579, 5578, 5577,
+		5576, 5575, 5574, 5573, 5572, 5571, 5570, 5570, 5569, 5568, 5567, 5566, 5565, 5564, 5563, 5562,
+		5561, 5560, 5559, 5558, 5557, 5556, 5555, 5555, 5554, 5553, 5552, 5551, 5550, 5549, 5548, 5547,
+		5546, 5545, 5544, 5543, 5542, 5541, 5540, 5540, 5539, 5538, 5537, 5536, 5535, 5534, 5533, 5532,
+		5531, 5530, 5529, 5528, 5527, 5526, 5525, 5525, 5524, 5523, 5522, 5521, 5520, 5519, 5518, 5517,
+		5516, 5515, 5514, 5513, 5512, 5511, 5510, 5510, 5509, 5508, 5507, 5506, 5505, 5504, 5503, 5502,
+		5501, 5500, 5499, 5498, 5497, 5496, 5495, 5495, 5494, 5493, 5492, 5491, 5490, 5489, 5488, 5487,
+		5486, 5485, 5484, 5483, 5482, 5481, 5480, 5480, 5479, 5478, 5477, 5476, 5475, 5474, 5473, 5472,
+		5471, 5470, 5469, 5468, 5467, 5466, 5465, 5465, 5464, 5463, 5462, 5461, 5460, 5459, 5458, 5458,
+		5457, 5456, 5455, 5454, 5453, 5452, 5451, 5450, 5449, 5448, 5447, 5446, 5445, 5444, 5443, 5443,
+		5442, 5441, 5440, 5439, 5438, 5437, 5436, 5436, 5435, 5434, 5433, 5432, 5431, 5430, 5429, 5428,
+		5427, 5426, 5425, 5424, 5423, 5422, 5421, 5421, 5420, 5419, 5418, 5417, 5416, 5415, 5414, 5413,
+		5412, 5411, 5410, 5409, 5408, 5407, 5406, 5406, 5405, 5404, 5403, 5402, 5401, 5400, 5399, 5399,
+		5398, 5397, 5396, 5395, 5394, 5393, 5392, 5392, 5391, 5390, 5389, 5388, 5387, 5386, 5385, 5384,
+		5383, 5382, 5381, 5380, 5379, 5378, 5377, 5377, 5376, 5375, 5374, 5373, 5372, 5371, 5370, 5370,
+		5369, 5368, 5367, 5366, 5365, 5364, 5363, 5362, 5361, 5360, 5359, 5358, 5357, 5356, 5355, 5355,
+		5354, 5353, 5352, 5351, 5350, 5349, 5348, 5348, 5347, 5346, 5345, 5344, 5343, 5342, 5341, 5341,
+		5340, 5339, 5338, 5337, 5336, 5335, 5334, 5333, 5332, 5331, 5330, 5329, 5328, 5327, 5326, 5326,
+		5325, 5324, 5323, 5322, 5321, 5320, 5319, 5319, 5318, 5317, 5316, 5315, 5314, 5313, 5312, 5312,
+		5311, 5310, 5309, 5308, 5307, 5306, 5305, 5305, 5304, 5303, 5302, 5301, 5300, 5299, 5298, 5297,
+		5296, 5295, 5294, 5293, 5292, 5291, 5290, 5290, 5289, 5288, 5287, 5286, 5285, 5284, 5283, 5283,
+		5282, 5281, 5280, 5279, 5278, 5277, 5276, 5276, 5275, 5274, 5273, 5272, 5271, 5270, 5269, 5269,
+		5268, 5267, 5266, 5265, 5264, 5263, 5262, 5262, 5261, 5260, 5259, 5258, 5257, 5256, 5255, 5255,
+		5254, 5253, 5252, 5251, 5250, 5249, 5248, 5248, 5247, 5246, 5245, 5244, 5243, 5242, 5241, 5240,
+		5239, 5238, 5237, 5236, 5235, 5234, 5233, 5233, 5232, 5231, 5230, 5229, 5228, 5227, 5226, 5226,
+		5225, 5224, 5223, 5222, 5221, 5220, 5219, 5219, 5218, 5217, 5216, 5215, 5214, 5213, 5212, 5212,
+		5211, 5210, 5209, 5208, 5207, 5206, 5205, 5205, 5204, 5203, 5202, 5201, 5200, 5199, 5198, 5198,
+		5197, 5196, 5195, 5194, 5193, 5192, 5191, 5191, 5190, 5189, 5188, 5187, 5186, 5185, 5184, 5184,
+		5183, 5182, 5181, 5180, 5179, 5178, 5177, 5177, 5176, 5175, 5174, 5173, 5172, 5171, 5170, 5170,
+		5169, 5168, 5167, 5166, 5165, 5164, 5163, 5163, 5162, 5161, 5160, 5159, 5158, 5157, 5156, 5156,
+		5155, 5154, 5153, 5152, 5151, 5150, 5149, 5149, 5148, 5147, 5146, 5145, 5144, 5143, 5142, 5142,
+		5141, 5140, 5139, 5138, 5137, 5136, 5135, 5135, 5134, 5133, 5132, 5131, 5130, 5129, 5128, 5128,
+		5127, 5126, 5125, 5124, 5123, 5122, 5121, 5121, 5120, 5119, 5118, 5117, 5116, 5115, 5114, 5114,
+		5113, 5112, 5111, 5110, 5109, 5108, 5107, 5107, 5106, 5105, 5104, 5103, 5102, 5101, 5100, 5100,
+		5099, 5098, 5097, 5097, 5096, 5095, 5094, 5094, 5093, 5092, 5091, 5090, 5089, 5088, 5087, 5087,
+		5086, 5085, 5084, 5083, 5082, 5081, 5080, 5080, 5079, 5078, 5077, 5076, 5075, 5074, 5073, 5073,
+		5072, 5071, 5070, 5069, 5068, 5067, 5066, 5066, 5065, 5064, 5063, 5062, 5061, 5060, 5059, 5059,
+		5058, 5057, 5056, 5055, 5054, 5053, 5052, 5052, 5051, 5050, 5049, 5048, 5047, 5046, 5045, 5045,
+		5044, 5043, 5042, 5042, 5041, 5040, 5039, 5039, 5038, 5037, 5036, 5035, 5034, 5033, 5032, 5032,
+		5031, 5030, 5029, 5028, 5027, 5026, 5025, 5025, 5024, 5023, 5022, 5021, 5020, 5019, 5018, 5018,
+		5017, 5016, 5015, 5014, 5013, 5012, 5011, 5011, 5010, 5009, 5008, 5008, 5007, 5006, 5005, 5005,
+		5004, 5003, 5002, 5001, 5000, 4999, 4998, 4998, 4997, 4996, 4995, 4994, 4993, 4992, 4991, 4991,
+		4990, 4989, 4988, 4987, 4986, 4985, 4984, 4984, 4983, 4982, 4981, 4981, 4980, 4979, 4978, 4978,
+		4977, 4976, 4975, 4974, 4973, 4972, 4971, 4971, 4970, 4969, 4968, 4967, 4966, 4965, 4964, 4964,
+		4963, 4962, 4961, 4960, 4959, 4958, 4957, 4957, 4956, 4955, 4954, 4954, 4953, 4952, 4951, 4951,
+		4950, 4949, 4948, 4947, 4946, 4945, 4944, 4944, 4943, 4942, 4941, 4940, 4939, 4938, 4937, 4937,
+		4936, 4935, 4934, 4934, 4933, 4932, 4931, 4931, 4930, 4929, 4928, 4927, 4926, 4925, 4924, 4924,
+		4923, 4922, 4921, 4920, 4919, 4918, 4917, 4917, 4916, 4915, 4914, 4914, 4913, 4912, 4911, 4911,
+		4910, 4909, 4908, 4907, 4906, 4905, 4904, 4904, 4903, 4902, 4901, 4900, 4899, 4898, 4897, 4897,
+		4896, 4895, 4894, 4894, 4893, 4892, 4891, 4891, 4890, 4889, 4888, 4887, 4886, 4885, 4884, 4884,
+		4883, 4882, 4881, 4881, 4880, 4879, 4878, 4878, 4877, 4876, 4875, 4874, 4873, 4872, 4871, 4871,
+		4870, 4869, 4868, 4867, 4866, 4865, 4864, 4864, 4863, 4862, 4861, 4861, 4860, 4859, 4858, 4858,
+		4857, 4856, 4855, 4854, 4853, 4852, 4851, 4851, 4850, 4849, 4848, 4848, 4847, 4846, 4845, 4845,
+		4844, 4843, 4842, 4841, 4840, 4839, 4838, 4838, 4837, 4836, 4835, 4835, 4834, 4833, 4832, 4832,
+		4831, 4830, 4829, 4828, 4827, 4826, 4825, 4825, 4824, 4823, 4822, 4822, 4821, 4820, 4819, 4819,
+		4818, 4817, 4816, 4815, 4814, 4813, 4812, 4812, 4811, 4810, 4809, 4808, 4807, 4806, 4805, 4805,
+		4804, 4803, 4802, 4802, 4801, 4800, 4799, 4799, 4798, 4797, 4796, 4796, 4795, 4794, 4793, 4793,
+		4792, 4791, 4790, 4789, 4788, 4787, 4786, 4786, 4785, 4784, 4783, 4783, 4782, 4781, 4780, 4780,
+		4779, 4778, 4777, 4776, 4775, 4774, 4773, 4773, 4772, 4771, 4770, 4770, 4769, 4768, 4767, 4767,
+		4766, 4765, 4764, 4763, 4762, 4761, 4760, 4760, 4759, 4758, 4757, 4757, 4756, 4755, 4754, 4754,
+		4753, 4752, 4751, 4750, 4749, 4748, 4747, 4747, 4746, 4745, 4744, 4744, 4743, 4742, 4741, 4741,
+		4740, 4739, 4738, 4737, 4736, 4735, 4734, 4734, 4733, 4732, 4731, 4731, 4730, 4729, 4728, 4728,
+		4727, 4726, 4725, 4725, 4724, 4723, 4722, 4722, 4721, 4720, 4719, 4718, 4717, 4716, 4715, 4715,
+		4714, 4713, 4712, 4712, 4711, 4710, 4709, 4709, 4708, 4707, 4706, 4706, 4705, 4704, 4703, 4703,
+		4702, 4701, 4700, 4699, 4698, 4697, 4696, 4696, 4695, 4694, 4693, 4693, 4692, 4691, 4690, 4690,
+		4689, 4688, 4687, 4686, 4685, 4684, 4683, 4683, 4682, 4681, 4680, 4680, 4679, 4678, 4677, 4677,
+		4676, 4675, 4674, 4674, 4673, 4672, 4671, 4671, 4670, 4669, 4668, 4667, 4666, 4665, 4664, 4664,
+		4663, 4662, 4661, 4661, 4660, 4659, 4658, 4658, 4657, 4656, 4655, 4655, 4654, 4653, 4652, 4652,
+		4651, 4650, 4649, 4649, 4648, 4647, 4646, 4646, 4645, 4644, 4643, 4642, 4641, 4640, 4639, 4639,
+		4638, 4637, 4636, 4636, 4635, 4634, 4633, 4633, 4632, 4631, 4630, 4630, 4629, 4628, 4627, 4627,
+		4626, 4625, 4624, 4623, 4622, 4621, 4620, 4620, 4619, 4618, 4617, 4617, 4616, 4615, 4614, 4614,
+		4613, 4612, 4611, 4611, 4610, 4609, 4608, 4608, 4607, 4606, 4605, 4605, 4604, 4603, 4602, 4602,
+		4601, 4600, 4599, 4599, 4598, 4597, 4596, 4596, 4595, 4594, 4593, 4592, 4591, 4590, 4589, 4589,
+		4588, 4587, 4586, 4586, 4585, 4584, 4583, 4583, 4582, 4581, 4580, 4580, 4579, 4578, 4577, 4577,
+		4576, 4575, 4574, 4574, 4573, 4572, 4571, 4571, 4570, 4569, 4568, 4568, 4567, 4566, 4565, 4565,
+		4564, 4563, 4562, 4561, 4560, 4559, 4558, 4558, 4557, 4556, 4555, 4555, 4554, 4553, 4552, 4552,
+		4551, 4550, 4549, 4549, 4548, 4547, 4546, 4546, 4545, 4544, 4543, 4543, 4542, 4541, 4540, 4540,
+		4539, 4538, 4537, 4537, 4536, 4535, 4534, 4534, 4533, 4532, 4531, 4531, 4530, 4529, 4528, 4528,
+		4527, 4526, 4525, 4524, 4523, 4522, 4521, 4521, 4520, 4519, 4518, 4518, 4517, 4516, 4515, 4515,
+		4514, 4513, 4512, 4512, 4511, 4510, 4509, 4509, 4508, 4507, 4506, 4506, 4505, 4504, 4503, 4503,
+		4502, 4501, 4500, 4500, 4499, 4498, 4497, 4497, 4496, 4495, 4494, 4494, 4493, 4492, 4491, 4491,
+		4490, 4489, 4488, 4488, 4487, 4486, 4485, 4485, 4484, 4483, 4482, 4482, 4481, 4480, 4479, 4479,
+		4478, 4477, 4476, 4476, 4475, 4474, 4473, 4473, 4472, 4471, 4470, 4470, 4469, 4468, 4467, 4467,
+		4466, 4465, 4464, 4464, 4463, 4462, 4461, 4461, 4460, 4459, 4458, 4458, 4457, 4456, 4455, 4455,
+		4454, 4453, 4452, 4452, 4451, 4450, 4449, 4449, 4448, 4447, 4446, 4446, 4445, 4444, 4443, 4443,
+		4442, 4441, 4440, 4440, 4439, 4438, 4437, 4437, 4436, 4435, 4434, 4434, 4433, 4432, 4431, 4431,
+		4430, 4429, 4428, 4428, 4427, 4426, 4425, 4425, 4424, 4423, 4422, 4422, 4421, 4420, 4419, 4419,
+		4418, 4417, 4416, 4416, 4415, 4414, 4413, 4413, 4412, 4411, 4410, 4410, 4409, 4408, 4407, 4407,
+		4406, 4405, 4404, 4404, 4403, 4402, 4401, 4401, 4400, 4399, 4398, 4398, 4397, 4396, 4395, 4395,
+		4394, 4393, 4392, 4392, 4391, 4390, 4389, 4389, 4388, 4387, 4386, 4386, 4385, 4384, 4383, 4383,
+		4382, 4381, 4380, 4380, 4379, 4378, 4377, 4377, 4376, 4375, 4374, 4374, 4373, 4372, 4371, 4371,
+		4370, 4369, 4368, 4368, 4367, 4366, 4365, 4365, 4364, 4363, 4362, 4362, 4361, 4360, 4359, 4359,
+		4358, 4357, 4356, 4356, 4355, 4354, 4353, 4353, 4352, 4351, 4350, 4350, 4349, 4348, 4347, 4347,
+		4346, 4345, 4345, 4344, 4343, 4343, 4342, 4342, 4341, 4340, 4339, 4339, 4338, 4337, 4336, 4336,
+		4335, 4334, 4333, 4333, 4332, 4331, 4330, 4330, 4329, 4328, 4327, 4327, 4326, 4325, 4324, 4324,
+		4323, 4322, 4321, 4321, 4320, 4319, 4318, 4318, 4317, 4316, 4315, 4315, 4314, 4313, 4312, 4312,
+		4311, 4310, 4309, 4309, 4308, 4307, 4306, 4306, 4305, 4304, 4304, 4303, 4302, 4302, 4301, 4301,
+		4300, 4299, 4298, 4298, 4297, 4296, 4295, 4295, 4294, 4293, 4292, 4292, 4291, 4290, 4289, 4289,
+		4288, 4287, 4286, 4286, 4285, 4284, 4283, 4283, 4282, 4281, 4280, 4280, 4279, 4278, 4277, 4277,
+		4276, 4275, 4275, 4274, 4273, 4273, 4272, 4272, 4271, 4270, 4269, 4269, 4268, 4267, 4266, 4266,
+		4265, 4264, 4263, 4263, 4262, 4261, 4260, 4260, 4259, 4258, 4257, 4257, 4256, 4255, 4254, 4254,
+		4253, 4252, 4251, 4251, 4250, 4249, 4248, 4248, 4247, 4246, 4246, 4245, 4244, 4244, 4243, 4243,
+		4242, 4241, 4240, 4240, 4239, 4238, 4237, 4237, 4236, 4235, 4234, 4234, 4233, 4232, 4231, 4231,
+		4230, 4229, 4229, 4228, 4227, 4227, 4226, 4226, 4225, 4224, 4223, 4223, 4222, 4221, 4220, 4220,
+		4219, 4218, 4217, 4217, 4216, 4215, 4214, 4214, 4213, 4212, 4211, 4211, 4210, 4209, 4208, 4208,
+		4207, 4206, 4206, 4205, 4204, 4204, 4203, 4203, 4202, 4201, 4200, 4200, 4199, 4198, 4197, 4197,
+		4196, 4195, 4194, 4194, 4193, 4192, 4191, 4191, 4190, 4189, 4189, 4188, 4187, 4187, 4186, 4186,
+		4185, 4184, 4183, 4183, 4182, 4181, 4180, 4180, 4179, 4178, 4177, 4177, 4176, 4175, 4174, 4174,
+		4173, 4172, 4172, 4171, 4170, 4170, 4169, 4169, 4168, 4167, 4166, 4166, 4165, 4164, 4163, 4163,
+		4162, 4161, 4160, 4160, 4159, 4158, 4157, 4157, 4156, 4155, 4155, 4154, 4153, 4153, 4152, 4152,
+		4151, 4150, 4149, 4149, 4148, 4147, 4146, 4146, 4145, 4144, 4144, 4143, 4142, 4142, 4141, 4141,
+		4140, 4139, 4138, 4138, 4137, 4136, 4135, 4135, 4134, 4133, 4132, 4132, 4131, 4130, 4129, 4129,
+		4128, 4127, 4127, 4126, 4125, 4125, 4124, 4124, 4123, 4122, 4121, 4121, 4120, 4119, 4118, 4118,
+		4117, 4116, 4116, 4115, 4114, 4114, 4113, 4113, 4112, 4111, 4110, 4110, 4109, 4108, 4107, 4107,
+		4106, 4105, 4105, 4104, 4103, 4103, 4102, 4102, 4101, 4100, 4099, 4099, 4098, 4097, 4096, 4096
+	},
 
+	// logsin9
+	// There is a logarithmic sine table inside the LA32 chip. The table contains 13-bit integer values.
+	// Bit16u(0.5f - LOG2F(sin((i + 0.5f) / 1024.0f * FLOAT_PI)) * 1024.0f) for i = 1..511
 	// The very first value is clamped to the maximum possible 13-bit integer
-	logsin9[0] = 8191;
+	{
+		8191, 7950, 7195, 6698, 6327, 6030, 5784, 5572, 5387, 5223, 5075, 4941, 4818, 4704, 4599, 4500,
+		4408, 4321, 4239, 4161, 4088, 4017, 3950, 3886, 3825, 3766, 3709, 3655, 3602, 3551, 3502, 3454,
+		3408, 3364, 3320, 3278, 3238, 3198, 3159, 3121, 3085, 3049, 3014, 2980, 2946, 2914, 2882, 2851,
+		2820, 2790, 2761, 2732, 2704, 2676, 2649, 2623, 2596, 2571, 2546, 2521, 2496, 2473, 2449, 2426,
+		2403, 2381, 2359, 2337, 2315, 2294, 2274, 2253, 2233, 2213, 2193, 2174, 2155, 2136, 2117, 2099,
+		2081, 2063, 2046, 2028, 2011, 1994, 1977, 1961, 1944, 1928, 1912, 1896, 1881, 1865, 1850, 1835,
+		1820, 1805, 1790, 1776, 1762, 1748, 1734, 1720, 1706, 1692, 1679, 1666, 1652, 1639, 1626, 1614,
+		1601, 1588, 1576, 1564, 1552, 1539, 1527, 1516, 1504, 1492, 1481, 1469, 1458, 1447, 1436, 1425,
+		1414, 1403, 1392, 1381, 1371, 1360, 1350, 1340, 1329, 1319, 1309, 1299, 1289, 1279, 1270, 1260,
+		1250, 1241, 1232, 1222, 1213, 1204, 1195, 1185, 1176, 1167, 1159, 1150, 1141, 1132, 1124, 1115,
+		1107, 1098, 1090, 1082, 1073, 1065, 1057, 1049, 1041, 1033, 1025, 1017, 1010, 1002, 994, 987,
+		979, 972, 964, 957, 949, 942, 935, 928, 920, 913, 906, 899, 892, 885, 879, 872,
+		865, 858, 851, 845, 838, 832, 825, 819, 812, 806, 799, 793, 787, 781, 774, 768,
+		762, 756, 750, 744, 738, 732, 726, 721, 715, 709, 703, 698, 692, 686, 681, 675,
+		670, 664, 659, 653, 648, 642, 637, 632, 627, 621, 616, 611, 606, 601, 596, 591,
+		586, 581, 576, 571, 566, 561, 556, 552, 547, 542, 537, 533, 528, 523, 519, 514,
+		510, 505, 501, 496, 492, 487, 483, 479, 474, 470, 466, 462, 457, 453, 449, 445,
+		441, 437, 433, 429, 425, 421, 417, 413, 409, 405, 401, 397, 394, 390, 386, 382,
+		378, 375, 371, 367, 364, 360, 357, 353, 350, 346, 343, 339, 336, 332, 329, 325,
+		322, 319, 315, 312, 309, 306, 302, 299, 296, 293, 290, 286, 283, 280, 277, 274,
+		271, 268, 265, 262, 259, 256, 253, 251, 248, 245, 242, 239, 236, 234, 231, 228,
+		225, 223, 220, 217, 215, 212, 209, 207, 204, 202, 199, 197, 194, 192, 189, 187,
+		184, 182, 180, 177, 175, 173, 170, 168, 166, 163, 161, 159, 157, 155, 152, 150,
+		148, 146, 144, 142, 140, 138, 136, 134, 132, 130, 128, 126, 124, 122, 120, 118,
+		116, 114, 112, 110, 109, 107, 105, 103, 102, 100, 98, 96, 95, 93, 91, 90,
+		88, 87, 85, 83, 82, 80, 79, 77, 76, 74, 73, 71, 70, 69, 67, 66,
+		64, 63, 62, 60, 59, 58, 56, 55, 54, 53, 51, 50, 49, 48, 47, 46,
+		44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, 32, 31, 30, 29,
+		28, 27, 26, 26, 25, 24, 23, 22, 22, 21, 20, 19, 19, 18, 17, 16,
+		16, 15, 14, 14, 13, 13, 12, 11, 11, 10, 10, 9, 9, 8, 8, 7,
+		7, 6, 6, 6, 5, 5, 5, 4, 4, 4, 3, 3, 3, 2, 2, 2,
+		2, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0
+	},
+
+	RES_AMP_DECAY_FACTOR_TABLE
+};
 
-	// found from sample analysis
-	static const Bit8u resAmpDecayFactorTable[] = {31, 16, 12, 8, 5, 3, 2, 1};
-	resAmpDecayFactor = resAmpDecayFactorTable;
+const Tables &Tables::getInstance() {
+	return TABLES;
 }
 
 } // namespace MT32Emu
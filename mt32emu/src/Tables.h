@@ -23,12 +23,8 @@
 
 namespace MT32Emu {
 
+// The tables are initialised statically, hence this must remain an aggregate.
 class Tables {
-private:
-	Tables();
-	Tables(Tables &);
-	~Tables() {}
-
 public:
 	static const Tables &getInstance();
 
@@ -52,6 +48,7 @@ public:
 	Bit8u pulseWidth100To255[101];
 
 	Bit16u exp9[512];
+	Bit16u interpolatedExp[4096];
 	Bit16u logsin9[512];
 
 	const Bit8u *resAmpDecayFactor;
@@ -0,0 +1,251 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+
+#include "internals.h"
+
+#include "CPUFeatures.h"
+#include "Executor.h"
+#include "ThreadPool.h"
+#include "Threads.h"
+
+namespace MT32Emu {
+
+#if MT32EMU_WITH_THREADS
+
+class ThreadPoolImpl;
+
+struct WorkerContext {
+	ThreadPoolImpl *pool;
+	Bit32u threadIx;
+};
+
+class ThreadPoolImpl : public ThreadPool {
+	const Bit32u workerThreadCount;
+	// When set, the shares of each job are submitted to the executor rather than picked up by own worker threads
+	Executor * const executor;
+	Thread * const workerThreads;
+	WorkerContext * const workerContexts;
+	Bit32u startedWorkerThreadCount;
+
+	// All the fields below are guarded by the mutex
+	Mutex mutex;
+	Condition jobStartedCondition;
+	Condition jobCompletedCondition;
+	Job *job;
+	Bit32u taskCount;
+	// Set when the tasks are distributed among the worker threads only
+	bool asyncJob;
+	// The worker threads take over the denormal handling mode of the thread that dispatches the job,
+	// as the tasks are logically a part of its work
+	bool flushDenormals;
+	// Incremented with each job, so that the worker threads can tell a new job from a spurious wakeup
+	Bit32u jobSerial;
+	Bit32u busyWorkerThreadCount;
+	bool quitting;
+
+	static void workerThreadProc(void *context) {
+		WorkerContext *workerContext = static_cast<WorkerContext *>(context);
+		workerContext->pool->runWorkerThread(workerContext->threadIx);
+	}
+
+	static void submittedShareProc(void *context) {
+		WorkerContext *workerContext = static_cast<WorkerContext *>(context);
+		workerContext->pool->runSubmittedShare(workerContext->threadIx);
+	}
+
+	void runTasks(Job &useJob, const Bit32u useTaskCount, const Bit32u firstTaskIx, const Bit32u threadCount) {
+		for (Bit32u taskIx = firstTaskIx; taskIx < useTaskCount; taskIx += threadCount) {
+			useJob.runTask(taskIx);
+		}
+	}
+
+	void runWorkerThread(const Bit32u threadIx) {
+		// The pool is created before any job is run
+		Bit32u lastJobSerial = 0;
+		mutex.lock();
+		for (;;) {
+			while (!quitting && jobSerial == lastJobSerial) {
+				jobStartedCondition.wait(mutex);
+			}
+			if (quitting) break;
+			lastJobSerial = jobSerial;
+			Job &currentJob = *job;
+			const Bit32u currentTaskCount = taskCount;
+			const bool currentJobAsync = asyncJob;
+			const bool currentFlushDenormals = flushDenormals;
+			mutex.unlock();
+
+			runWorkerShare(currentJob, currentTaskCount, threadIx, currentJobAsync, currentFlushDenormals);
+
+			mutex.lock();
+			if (--busyWorkerThreadCount == 0) {
+				jobCompletedCondition.signal();
+			}
+		}
+		mutex.unlock();
+	}
+
+	void runWorkerShare(Job &useJob, const Bit32u useTaskCount, const Bit32u threadIx, const bool async, const bool useFlushDenormals) {
+		DenormalFlushScope denormalFlushScope(useFlushDenormals);
+		if (async) {
+			runTasks(useJob, useTaskCount, threadIx - 1, workerThreadCount);
+		} else {
+			runTasks(useJob, useTaskCount, threadIx, workerThreadCount + 1);
+		}
+	}
+
+	// Runs the share of the current job that a worker thread would otherwise run. The job remains unchanged until
+	// all the shares complete, so it is safe to snapshot.
+	void runSubmittedShare(const Bit32u threadIx) {
+		mutex.lock();
+		Job &currentJob = *job;
+		const Bit32u currentTaskCount = taskCount;
+		const bool currentJobAsync = asyncJob;
+		const bool currentFlushDenormals = flushDenormals;
+		mutex.unlock();
+
+		runWorkerShare(currentJob, currentTaskCount, threadIx, currentJobAsync, currentFlushDenormals);
+
+		mutex.lock();
+		if (--busyWorkerThreadCount == 0) {
+			jobCompletedCondition.signal();
+		}
+		mutex.unlock();
+	}
+
+	void stopWorkerThreads() {
+		if (executor != NULL) {
+			// There are no own threads, only the shares that may still be running
+			waitForJob();
+			return;
+		}
+		mutex.lock();
+		quitting = true;
+		jobStartedCondition.broadcast();
+		mutex.unlock();
+		for (Bit32u i = 0; i < startedWorkerThreadCount; i++) {
+			workerThreads[i].join();
+		}
+		startedWorkerThreadCount = 0;
+	}
+
+	void dispatchJob(Job &useJob, const Bit32u useTaskCount, const bool async) {
+		const bool useFlushDenormals = DenormalFlushScope::isFlushingActive();
+		mutex.lock();
+		job = &useJob;
+		taskCount = useTaskCount;
+		asyncJob = async;
+		flushDenormals = useFlushDenormals;
+		jobSerial++;
+		busyWorkerThreadCount = workerThreadCount;
+		jobStartedCondition.broadcast();
+		mutex.unlock();
+		if (executor == NULL) return;
+		for (Bit32u i = 0; i < workerThreadCount; i++) {
+			if (!executor->execute(submittedShareProc, &workerContexts[i])) {
+				submittedShareProc(&workerContexts[i]);
+			}
+		}
+	}
+
+public:
+	ThreadPoolImpl(const Bit32u useWorkerThreadCount, Executor *useExecutor) :
+		workerThreadCount(useWorkerThreadCount),
+		executor(useExecutor),
+		workerThreads(useExecutor == NULL ? new Thread[useWorkerThreadCount] : NULL),
+		workerContexts(new WorkerContext[useWorkerThreadCount]),
+		startedWorkerThreadCount(0),
+		job(NULL),
+		taskCount(0),
+		asyncJob(false),
+		flushDenormals(false),
+		jobSerial(0),
+		busyWorkerThreadCount(0),
+		quitting(false)
+	{}
+
+	~ThreadPoolImpl() {
+		stopWorkerThreads();
+		delete[] workerThreads;
+		delete[] workerContexts;
+	}
+
+	bool startWorkerThreads() {
+		if (executor != NULL) {
+			for (Bit32u i = 0; i < workerThreadCount; i++) {
+				workerContexts[i].pool = this;
+				workerContexts[i].threadIx = i + 1;
+			}
+			return true;
+		}
+		while (startedWorkerThreadCount < workerThreadCount) {
+			WorkerContext &workerContext = workerContexts[startedWorkerThreadCount];
+			workerContext.pool = this;
+			workerContext.threadIx = startedWorkerThreadCount + 1;
+			if (!workerThreads[startedWorkerThreadCount].start(workerThreadProc, &workerContext)) {
+				stopWorkerThreads();
+				return false;
+			}
+			startedWorkerThreadCount++;
+		}
+		return true;
+	}
+
+	Bit32u getThreadCount() const {
+		return workerThreadCount + 1;
+	}
+
+	void runJob(Job &useJob, const Bit32u useTaskCount) {
+		dispatchJob(useJob, useTaskCount, false);
+		runTasks(useJob, useTaskCount, 0, workerThreadCount + 1);
+		waitForJob();
+	}
+
+	void startJob(Job &useJob, const Bit32u useTaskCount) {
+		dispatchJob(useJob, useTaskCount, true);
+	}
+
+	void waitForJob() {
+		mutex.lock();
+		while (busyWorkerThreadCount > 0) {
+			jobCompletedCondition.wait(mutex);
+		}
+		job = NULL;
+		mutex.unlock();
+	}
+};
+
+ThreadPool *ThreadPool::createThreadPool(const Bit32u workerThreadCount) {
+	if (workerThreadCount == 0) return NULL;
+	ThreadPoolImpl *threadPool = new ThreadPoolImpl(workerThreadCount, Executor::getExecutor());
+	if (!threadPool->startWorkerThreads()) {
+		delete threadPool;
+		return NULL;
+	}
+	return threadPool;
+}
+
+#else // #if MT32EMU_WITH_THREADS
+
+ThreadPool *ThreadPool::createThreadPool(const Bit32u) {
+	return NULL;
+}
+
+#endif // #if MT32EMU_WITH_THREADS
+
+} // namespace MT32Emu
@@ -0,0 +1,64 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_THREAD_POOL_H
+#define MT32EMU_THREAD_POOL_H
+
+#include "globals.h"
+#include "Types.h"
+
+namespace MT32Emu {
+
+/* ThreadPool runs tasks of a job concurrently in a set of worker threads and the calling thread.
+ * Tasks are identified by indices and distributed among the threads in a fixed round-robin manner, i.e. the calling thread
+ * runs tasks 0, N, 2N, etc. while the worker thread i runs tasks i, N + i, 2N + i, etc., where N is the total number of threads.
+ * This way, the distribution is independent of scheduling, and each task may safely own the data associated with its index.
+ * Alternatively, a job may be started asynchronously, in which case its tasks are distributed among the worker threads only,
+ * so that the calling thread may proceed with other work until it waits for the job to complete.
+ * When an Executor is installed upon creation, the pool spawns no threads. Instead, the share of each worker thread
+ * is submitted to the executor with every job, while the distribution of tasks remains the same.
+ * The pool is only available when the library is built with multithreading support (MT32EMU_WITH_THREADS).
+ */
+class ThreadPool {
+public:
+	class Job {
+	public:
+		virtual ~Job() {}
+		virtual void runTask(Bit32u taskIx) = 0;
+	};
+
+	// Returns NULL if the worker threads cannot be created or multithreading support is unavailable.
+	static ThreadPool *createThreadPool(const Bit32u workerThreadCount);
+
+	virtual ~ThreadPool() {}
+
+	// Returns the total number of threads that run tasks, including the calling thread.
+	virtual Bit32u getThreadCount() const = 0;
+
+	// Runs all tasks of the job and returns once they are complete. Must not be invoked concurrently.
+	virtual void runJob(Job &job, const Bit32u taskCount) = 0;
+
+	// Starts running all tasks of the job in the worker threads and returns immediately.
+	// The job must be completed by calling waitForJob() before another job is started.
+	virtual void startJob(Job &job, const Bit32u taskCount) = 0;
+
+	// Returns once all tasks of the job previously started with startJob() are complete.
+	virtual void waitForJob() = 0;
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_THREAD_POOL_H
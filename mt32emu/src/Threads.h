@@ -0,0 +1,164 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_THREADS_H
+#define MT32EMU_THREADS_H
+
+#include "internals.h"
+
+#include "RealtimeCheck.h"
+
+#if MT32EMU_WITH_THREADS
+#ifdef _WIN32
+#if !defined _WIN32_WINNT || _WIN32_WINNT < 0x0600
+#undef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/time.h>
+#endif
+#endif
+
+/* Thin wrappers of the native threading primitives shared by the internal classes that need them.
+ * Only available when the library is built with multithreading support (MT32EMU_WITH_THREADS).
+ * This header is deliberately kept private to the translation units that implement such classes,
+ * so that the system headers don't leak elsewhere.
+ */
+
+namespace MT32Emu {
+
+#if MT32EMU_WITH_THREADS
+
+#ifdef _WIN32
+
+// NOTE: Condition variables require Windows Vista or newer.
+class Mutex {
+public:
+	CRITICAL_SECTION handle;
+
+	Mutex() { InitializeCriticalSection(&handle); }
+	~Mutex() { DeleteCriticalSection(&handle); }
+	void lock() { RealtimeCheck::reportLock(); EnterCriticalSection(&handle); }
+	void unlock() { LeaveCriticalSection(&handle); }
+};
+
+class Condition {
+	CONDITION_VARIABLE handle;
+
+public:
+	Condition() { InitializeConditionVariable(&handle); }
+	void wait(Mutex &mutex) { RealtimeCheck::reportLock(); SleepConditionVariableCS(&handle, &mutex.handle, INFINITE); }
+	// Returns false if the timeout expired. Spurious wakeups are possible, so the elapsed time must be tracked by the caller.
+	bool wait(Mutex &mutex, Bit32u timeoutMillis) {
+		RealtimeCheck::reportLock();
+		return SleepConditionVariableCS(&handle, &mutex.handle, timeoutMillis) != 0;
+	}
+	void signal() { WakeConditionVariable(&handle); }
+	void broadcast() { WakeAllConditionVariable(&handle); }
+};
+
+class Thread {
+	HANDLE handle;
+	void (*proc)(void *);
+	void *context;
+
+	static DWORD WINAPI threadProc(LPVOID thread) {
+		Thread *that = static_cast<Thread *>(thread);
+		that->proc(that->context);
+		return 0;
+	}
+
+public:
+	bool start(void (*useProc)(void *), void *useContext) {
+		proc = useProc;
+		context = useContext;
+		handle = CreateThread(NULL, 0, threadProc, this, 0, NULL);
+		return handle != NULL;
+	}
+
+	void join() {
+		WaitForSingleObject(handle, INFINITE);
+		CloseHandle(handle);
+	}
+};
+
+#else // #ifdef _WIN32
+
+class Mutex {
+public:
+	pthread_mutex_t handle;
+
+	Mutex() { pthread_mutex_init(&handle, NULL); }
+	~Mutex() { pthread_mutex_destroy(&handle); }
+	void lock() { RealtimeCheck::reportLock(); pthread_mutex_lock(&handle); }
+	void unlock() { pthread_mutex_unlock(&handle); }
+};
+
+class Condition {
+	pthread_cond_t handle;
+
+public:
+	Condition() { pthread_cond_init(&handle, NULL); }
+	~Condition() { pthread_cond_destroy(&handle); }
+	void wait(Mutex &mutex) { RealtimeCheck::reportLock(); pthread_cond_wait(&handle, &mutex.handle); }
+	// Returns false if the timeout expired. Spurious wakeups are possible, so the elapsed time must be tracked by the caller.
+	bool wait(Mutex &mutex, Bit32u timeoutMillis) {
+		RealtimeCheck::reportLock();
+		timeval now;
+		gettimeofday(&now, NULL);
+		// Both terms are below 10^9, so the sum fits in a long.
+		long deadlineNanos = long(now.tv_usec) * 1000 + long(timeoutMillis % 1000) * 1000000;
+		timespec deadline;
+		deadline.tv_sec = now.tv_sec + time_t(timeoutMillis / 1000 + deadlineNanos / 1000000000);
+		deadline.tv_nsec = deadlineNanos % 1000000000;
+		return pthread_cond_timedwait(&handle, &mutex.handle, &deadline) == 0;
+	}
+	void signal() { pthread_cond_signal(&handle); }
+	void broadcast() { pthread_cond_broadcast(&handle); }
+};
+
+class Thread {
+	pthread_t handle;
+	void (*proc)(void *);
+	void *context;
+
+	static void *threadProc(void *thread) {
+		Thread *that = static_cast<Thread *>(thread);
+		that->proc(that->context);
+		return NULL;
+	}
+
+public:
+	bool start(void (*useProc)(void *), void *useContext) {
+		proc = useProc;
+		context = useContext;
+		return pthread_create(&handle, NULL, threadProc, this) == 0;
+	}
+
+	void join() {
+		pthread_join(handle, NULL);
+	}
+};
+
+#endif // #ifdef _WIN32
+
+#endif // #if MT32EMU_WITH_THREADS
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_THREADS_H
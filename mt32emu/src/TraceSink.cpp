@@ -0,0 +1,47 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+
+#include "internals.h"
+
+#include "TraceSink.h"
+
+namespace MT32Emu {
+
+#if MT32EMU_WITH_TRACE_MARKERS
+
+static TraceSink *volatile traceSink = NULL;
+
+void TraceSink::setTraceSink(TraceSink *sink) {
+	traceSink = sink;
+}
+
+TraceSink *TraceSink::getTraceSink() {
+	return traceSink;
+}
+
+#else // #if MT32EMU_WITH_TRACE_MARKERS
+
+void TraceSink::setTraceSink(TraceSink *) {}
+
+TraceSink *TraceSink::getTraceSink() {
+	return NULL;
+}
+
+#endif // #if MT32EMU_WITH_TRACE_MARKERS
+
+} // namespace MT32Emu
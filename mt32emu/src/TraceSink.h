@@ -0,0 +1,79 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_TRACE_SINK_H
+#define MT32EMU_TRACE_SINK_H
+
+#include <cstddef>
+
+#include "globals.h"
+#include "Types.h"
+
+namespace MT32Emu {
+
+// Receives the trace zones marked along the rendering pipeline when the library is built with the option
+// libmt32emu_WITH_TRACE_MARKERS, e.g. to forward them to a profiler like Tracy or to record a trace file.
+// The zones are reported by the threads that run them, so the implementation must be thread-safe and cheap enough
+// not to disturb rendering. The names are string literals that remain valid until the program exits.
+//
+// Each zone carries a frame number that relates it to the audio output. The zones that handle a MIDI message carry
+// its timestamp, i.e. the frame at which its onset is rendered, while the rendering zones carry the first frame
+// of the block they render. So, a message can be followed through to the block that contains its onset.
+// Within the library, the frames are counted at the internal sample rate, see Synth::getInternalRenderedSampleCount().
+class MT32EMU_EXPORT TraceSink {
+public:
+	virtual ~TraceSink() {}
+	virtual void beginZone(const char *name, Bit32u frame) = 0;
+	virtual void endZone(const char *name, Bit32u frame) = 0;
+
+	// Installs the sink that receives the zones of all the synth instances in the process, NULL removes it.
+	// The sink must remain valid until removed, and it should be installed or removed while nothing is rendering.
+	static void setTraceSink(TraceSink *sink);
+	static TraceSink *getTraceSink();
+};
+
+#if MT32EMU_WITH_TRACE_MARKERS
+
+// Reports a zone spanning its lifetime to the installed sink, if any.
+// Applications may mark their own zones this way, so that these appear in the same trace.
+class TraceZone {
+	TraceSink * const sink;
+	const char * const name;
+	const Bit32u frame;
+
+public:
+	TraceZone(const char *useName, Bit32u useFrame) : sink(TraceSink::getTraceSink()), name(useName), frame(useFrame) {
+		if (sink != NULL) sink->beginZone(name, frame);
+	}
+
+	~TraceZone() {
+		if (sink != NULL) sink->endZone(name, frame);
+	}
+};
+
+#else // #if MT32EMU_WITH_TRACE_MARKERS
+
+// Without MT32EMU_WITH_TRACE_MARKERS, the zones aren't reported, so an installed TraceSink receives nothing.
+class TraceZone {
+public:
+	TraceZone(const char *, Bit32u) {}
+};
+
+#endif // #if MT32EMU_WITH_TRACE_MARKERS
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_TRACE_SINK_H
@@ -0,0 +1,96 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstddef>
+
+#include "internals.h"
+
+#include "Atomics.h"
+#include "Threads.h"
+#include "WaitableSignal.h"
+
+namespace MT32Emu {
+
+#if MT32EMU_WITH_THREADS
+
+static Bit32u getMillis() {
+#ifdef _WIN32
+	return Bit32u(GetTickCount());
+#else
+	timeval now;
+	gettimeofday(&now, NULL);
+	return Bit32u(now.tv_sec) * 1000 + Bit32u(now.tv_usec / 1000);
+#endif
+}
+
+class WaitableSignalImpl : public WaitableSignal {
+	Mutex mutex;
+	Condition condition;
+	// Modified under the mutex, but read by notify() without locking.
+	volatile Bit32u waitingThreadCount;
+
+	void addWaitingThreads(Bit32u delta) {
+		for (;;) {
+			Bit32u count = waitingThreadCount;
+			if (Atomics::compareAndSwap(waitingThreadCount, count, count + delta)) return;
+		}
+	}
+
+public:
+	WaitableSignalImpl() : waitingThreadCount(0) {}
+
+	bool waitFor(const Predicate &predicate, Bit32u timeoutMillis) {
+		if (predicate.isSatisfied()) return true;
+		const Bit32u startMillis = getMillis();
+		mutex.lock();
+		// The full barrier of the atomic increment pairs with the one in notify(): either the waiting thread observes
+		// the updated state, or the notifying thread observes the waiting one, so a wakeup is never lost.
+		addWaitingThreads(1);
+		bool satisfied;
+		for (;;) {
+			satisfied = predicate.isSatisfied();
+			if (satisfied) break;
+			Bit32u elapsedMillis = getMillis() - startMillis;
+			if (elapsedMillis >= timeoutMillis) break;
+			condition.wait(mutex, timeoutMillis - elapsedMillis);
+		}
+		addWaitingThreads(Bit32u(-1));
+		mutex.unlock();
+		return satisfied;
+	}
+
+	void notify() {
+		// Compare-and-swap with no effect serves as a full barrier that orders the preceding state update before the check.
+		if (Atomics::compareAndSwap(waitingThreadCount, 0, 0)) return;
+		mutex.lock();
+		condition.broadcast();
+		mutex.unlock();
+	}
+};
+
+WaitableSignal *WaitableSignal::createWaitableSignal() {
+	return new WaitableSignalImpl;
+}
+
+#else // #if MT32EMU_WITH_THREADS
+
+WaitableSignal *WaitableSignal::createWaitableSignal() {
+	return NULL;
+}
+
+#endif // #if MT32EMU_WITH_THREADS
+
+} // namespace MT32Emu
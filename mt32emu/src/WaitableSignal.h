@@ -0,0 +1,53 @@
+/* Copyright (C) 2011-2020 Dean Beeler, Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_WAITABLE_SIGNAL_H
+#define MT32EMU_WAITABLE_SIGNAL_H
+
+#include "globals.h"
+#include "Types.h"
+
+namespace MT32Emu {
+
+/* WaitableSignal lets threads block until a condition, tested by a predicate supplied by the waiting thread, becomes true.
+ * A thread that changes the state the condition depends upon invokes notify() afterwards. As long as nobody is waiting,
+ * notify() is lock-free and merely involves a single atomic operation, so it is cheap enough for a realtime thread.
+ * The signal is only available when the library is built with multithreading support (MT32EMU_WITH_THREADS).
+ */
+class WaitableSignal {
+public:
+	class Predicate {
+	public:
+		virtual ~Predicate() {}
+		virtual bool isSatisfied() const = 0;
+	};
+
+	// Returns NULL if multithreading support is unavailable.
+	static WaitableSignal *createWaitableSignal();
+
+	virtual ~WaitableSignal() {}
+
+	// Blocks until the predicate is satisfied or the timeout expires. Returns the last result of the predicate.
+	virtual bool waitFor(const Predicate &predicate, Bit32u timeoutMillis) = 0;
+
+	// Wakes up the waiting threads, if any, so that they test the predicate again.
+	// Must be invoked after the state tested by the predicate is updated.
+	virtual void notify() = 0;
+};
+
+} // namespace MT32Emu
+
+#endif // #ifndef MT32EMU_WAITABLE_SIGNAL_H
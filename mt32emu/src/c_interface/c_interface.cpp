@@ -19,10 +19,13 @@
 #include "../Types.h"
 #include "../File.h"
 #include "../FileStream.h"
+#include "../MappedFile.h"
 #include "../ROMInfo.h"
 #include "../Synth.h"
 #include "../MidiStreamParser.h"
 #include "../SampleRateConverter.h"
+#include "../Executor.h"
+#include "../ThreadPool.h"
 
 #include "c_types.h"
 #include "c_interface.h"
@@ -35,13 +38,16 @@ struct SamplerateConversionState {
 	double outputSampleRate;
 	SamplerateConversionQuality srcQuality;
 	SampleRateConverter *src;
+	// The parameters the converter is created with, which the settings may no longer match.
+	double srcOutputSampleRate;
+	SamplerateConversionQuality srcOpenQuality;
 };
 
 static mt32emu_service_version getSynthVersionID(mt32emu_service_i) {
 	return MT32EMU_SERVICE_VERSION_CURRENT;
 }
 
-static const mt32emu_service_i_v3 SERVICE_VTABLE = {
+static const mt32emu_service_i_v4 SERVICE_VTABLE = {
 	getSynthVersionID,
 	mt32emu_get_supported_report_handler_version,
 	mt32emu_get_supported_midi_receiver_version,
@@ -118,7 +124,94 @@ static const mt32emu_service_i_v3 SERVICE_VTABLE = {
 	mt32emu_set_nice_partial_mixing_enabled,
 	mt32emu_is_nice_partial_mixing_enabled,
 	mt32emu_preallocate_reverb_memory,
-	mt32emu_configure_midi_event_queue_sysex_storage
+	mt32emu_configure_midi_event_queue_sysex_storage,
+	mt32emu_set_partial_rendering_thread_count,
+	mt32emu_get_partial_rendering_thread_count,
+	mt32emu_set_midi_event_timing_quantum,
+	mt32emu_get_midi_event_timing_quantum,
+	mt32emu_get_max_midi_event_timing_error,
+	mt32emu_get_render_statistics,
+	mt32emu_reset_render_statistics,
+	mt32emu_configure_midi_event_queue_multi_producer,
+	mt32emu_is_midi_event_queue_multi_producer,
+	mt32emu_play_events,
+	mt32emu_set_reverb_silence_threshold,
+	mt32emu_get_reverb_silence_threshold,
+	mt32emu_set_reverb_pipeline_enabled,
+	mt32emu_is_reverb_pipeline_enabled,
+	mt32emu_get_reverb_pipeline_latency,
+	mt32emu_get_supported_simd_instruction_set,
+	mt32emu_get_simd_instruction_set,
+	mt32emu_force_simd_instruction_set,
+	mt32emu_set_rom_cache_directory,
+	mt32emu_get_rom_cache_directory,
+	mt32emu_save_state,
+	mt32emu_restore_state,
+	mt32emu_create_engine,
+	mt32emu_free_engine,
+	mt32emu_get_engine_unit_count,
+	mt32emu_get_engine_context,
+	mt32emu_add_engine_rom_data,
+	mt32emu_add_engine_rom_file,
+	mt32emu_open_engine,
+	mt32emu_close_engine,
+	mt32emu_render_engine_bit16s,
+	mt32emu_render_engine_float,
+	mt32emu_mix_engine_bit16s,
+	mt32emu_mix_engine_float,
+	mt32emu_render_bit16s_output,
+	mt32emu_render_float_output,
+	mt32emu_set_max_render_block_length,
+	mt32emu_get_max_render_block_length,
+	mt32emu_get_allocated_memory_size,
+	mt32emu_prepare_reverb_model,
+	mt32emu_set_float_wave_accuracy,
+	mt32emu_get_float_wave_accuracy,
+	mt32emu_set_partial_limit,
+	mt32emu_get_partial_limit,
+	mt32emu_set_max_partial_count,
+	mt32emu_get_max_partial_count,
+	mt32emu_resize_partial_pool,
+	mt32emu_set_degradation_level,
+	mt32emu_get_degradation_level,
+	mt32emu_set_partial_culling_level,
+	mt32emu_get_partial_culling_level,
+	mt32emu_get_midi_event_queue_free_capacity,
+	mt32emu_wait_for_midi_event_queue_free_capacity,
+	mt32emu_render_bit16s_with_events,
+	mt32emu_render_float_with_events,
+	mt32emu_set_denormal_flushing_enabled,
+	mt32emu_is_denormal_flushing_enabled,
+	mt32emu_load_sysex_bank,
+	mt32emu_load_sysex_bank_file,
+	mt32emu_write_memory,
+	mt32emu_reset_to_open_state,
+	mt32emu_save_state_delta,
+	mt32emu_restore_state_delta,
+	mt32emu_start_session_recording,
+	mt32emu_stop_session_recording,
+	mt32emu_get_min_remaining_partial_frame_count,
+	mt32emu_start_opening_synth,
+	mt32emu_get_open_progress,
+	mt32emu_is_opening,
+	mt32emu_cancel_opening,
+	mt32emu_finish_opening_synth,
+	mt32emu_get_supported_executor_version,
+	mt32emu_set_executor,
+	mt32emu_prefetch_timbres,
+	mt32emu_get_partial_render_statistics,
+	mt32emu_get_memory_usage,
+	mt32emu_get_midi_event_queue_statistics,
+	mt32emu_render_engine_units_bit16s,
+	mt32emu_render_engine_units_float,
+	mt32emu_set_hot_memory_locking_enabled,
+	mt32emu_is_hot_memory_locking_enabled,
+	mt32emu_is_hot_memory_locked,
+	mt32emu_configure_midi_event_queue_coalescing,
+	mt32emu_get_midi_event_queue_coalescing_window,
+	mt32emu_render_bit16s_output_with_events,
+	mt32emu_render_float_output_with_events,
+	mt32emu_is_dac_streams_conversion_supported
 };
 
 } // namespace MT32Emu
@@ -134,6 +227,19 @@ struct mt32emu_data {
 	SamplerateConversionState *srcState;
 };
 
+struct mt32emu_engine_data {
+	mt32emu_context *contexts;
+	Bit32u unitCount;
+	ThreadPool *threadPool;
+	const ROMImage *controlROMImage;
+	const ROMImage *pcmROMImage;
+	// Buffers the units are rendered into when mixing, ENGINE_MIX_BUFFER_FRAMES stereo frames per unit.
+	Bit16s *bit16sMixBuffer;
+	Bit16s **bit16sMixStreams;
+	float *floatMixBuffer;
+	float **floatMixStreams;
+};
+
 // Internal C++ utility stuff
 
 namespace MT32Emu {
@@ -260,6 +366,27 @@ private:
 	}
 };
 
+class DelegatingExecutorAdapter : public Executor {
+public:
+	DelegatingExecutorAdapter() : delegate(), instanceData() {}
+
+	void setDelegate(mt32emu_executor_i useExecutor, void *useInstanceData) {
+		delegate = useExecutor;
+		instanceData = useInstanceData;
+	}
+
+private:
+	mt32emu_executor_i delegate;
+	void *instanceData;
+
+	bool execute(void (*proc)(void *), void *context) {
+		return delegate.v0->execute(instanceData, proc, context) != MT32EMU_BOOL_FALSE;
+	}
+};
+
+// There is only one executor per process, so is its adapter
+static DelegatingExecutorAdapter executorAdapter;
+
 class DelegatingMidiStreamParser : public DefaultMidiStreamParser {
 public:
 	DelegatingMidiStreamParser(const mt32emu_data *useData, mt32emu_midi_receiver_i useMIDIReceiver, void *useInstanceData) :
@@ -295,7 +422,15 @@ private:
 	}
 };
 
-static mt32emu_return_code addROMFile(mt32emu_data *data, File *file) {
+static void freeROMImage(const ROMImage *&romImage) {
+	if (romImage != NULL) {
+		delete romImage->getFile();
+		ROMImage::freeROMImage(romImage);
+		romImage = NULL;
+	}
+}
+
+static mt32emu_return_code addROMFile(const ROMImage *&controlROMImage, const ROMImage *&pcmROMImage, File *file) {
 	const ROMImage *image = ROMImage::makeROMImage(file);
 	const ROMInfo *info = image->getROMInfo();
 	if (info == NULL) {
@@ -303,24 +438,186 @@ static mt32emu_return_code addROMFile(mt32emu_data *data, File *file) {
 		return MT32EMU_RC_ROM_NOT_IDENTIFIED;
 	}
 	if (info->type == ROMInfo::Control) {
-		if (data->controlROMImage != NULL) {
-			delete data->controlROMImage->getFile();
-			ROMImage::freeROMImage(data->controlROMImage);
-		}
-		data->controlROMImage = image;
+		freeROMImage(controlROMImage);
+		controlROMImage = image;
 		return MT32EMU_RC_ADDED_CONTROL_ROM;
 	} else if (info->type == ROMInfo::PCM) {
-		if (data->pcmROMImage != NULL) {
-			delete data->pcmROMImage->getFile();
-			ROMImage::freeROMImage(data->pcmROMImage);
-		}
-		data->pcmROMImage = image;
+		freeROMImage(pcmROMImage);
+		pcmROMImage = image;
 		return MT32EMU_RC_ADDED_PCM_ROM;
 	}
 	ROMImage::freeROMImage(image);
 	return MT32EMU_RC_OK; // No support for reverb ROM yet.
 }
 
+static mt32emu_return_code addROMData(const ROMImage *&controlROMImage, const ROMImage *&pcmROMImage, const Bit8u *data, size_t dataSize, const mt32emu_sha1_digest *sha1Digest) {
+	if (sha1Digest == NULL) return addROMFile(controlROMImage, pcmROMImage, new ArrayFile(data, dataSize));
+	return addROMFile(controlROMImage, pcmROMImage, new ArrayFile(data, dataSize, *sha1Digest));
+}
+
+static mt32emu_return_code addROMFile(const ROMImage *&controlROMImage, const ROMImage *&pcmROMImage, const char *filename) {
+	// Memory mapping avoids copying the ROM data and shares the pages among processes. Reading the file is the fallback.
+	MappedFile *mappedFile = new MappedFile;
+	if (mappedFile->open(filename)) {
+		const mt32emu_return_code rc = addROMFile(controlROMImage, pcmROMImage, mappedFile);
+		if (rc <= 0) delete mappedFile;
+		return rc;
+	}
+	delete mappedFile;
+
+	mt32emu_return_code rc = MT32EMU_RC_OK;
+	FileStream *fs = new FileStream;
+	if (fs->open(filename)) {
+		if (fs->getData() != NULL) {
+			rc = addROMFile(controlROMImage, pcmROMImage, fs);
+			if (rc > 0) return rc;
+		} else {
+			rc = MT32EMU_RC_FILE_NOT_LOADED;
+		}
+	} else {
+		rc = MT32EMU_RC_FILE_NOT_FOUND;
+	}
+	delete fs;
+	return rc;
+}
+
+static void createSampleRateConverter(mt32emu_const_context context) {
+	SamplerateConversionState &srcState = *context->srcState;
+	const double outputSampleRate = (0.0 < srcState.outputSampleRate) ? srcState.outputSampleRate : context->synth->getStereoOutputSampleRate();
+
+	srcState.src = new SampleRateConverter(*context->synth, outputSampleRate, srcState.srcQuality);
+	srcState.srcOutputSampleRate = outputSampleRate;
+	srcState.srcOpenQuality = srcState.srcQuality;
+}
+
+static mt32emu_return_code openSynth(mt32emu_const_context context, const ROMImage *controlROMImage, const ROMImage *pcmROMImage) {
+	if ((controlROMImage == NULL) || (pcmROMImage == NULL)) {
+		return MT32EMU_RC_MISSING_ROMS;
+	}
+	if (!context->synth->open(*controlROMImage, *pcmROMImage, context->partialCount, context->analogOutputMode)) {
+		return MT32EMU_RC_FAILED;
+	}
+	createSampleRateConverter(context);
+	return MT32EMU_RC_OK;
+}
+
+template <class Sample, class CStereoOutput>
+static StereoOutputDescriptor<Sample> makeStereoOutputDescriptor(const CStereoOutput &cOutput) {
+	StereoOutputDescriptor<Sample> output = { cOutput.left, cOutput.right, cOutput.stride, cOutput.accumulate != MT32EMU_BOOL_FALSE, cOutput.gain };
+	return output;
+}
+
+static StereoOutputDescriptor<Bit16s> makeStereoOutputDescriptor(const mt32emu_stereo_output_bit16s &cOutput) {
+	return makeStereoOutputDescriptor<Bit16s>(cOutput);
+}
+
+static StereoOutputDescriptor<float> makeStereoOutputDescriptor(const mt32emu_stereo_output_float &cOutput) {
+	return makeStereoOutputDescriptor<float>(cOutput);
+}
+
+template <class Sample>
+static void renderOutput(mt32emu_const_context context, const StereoOutputDescriptor<Sample> &output, Bit32u len) {
+	if (context->srcState->src != NULL) {
+		context->srcState->src->getOutputSamples(output, len);
+	} else {
+		context->synth->render(output, len);
+	}
+}
+
+template <class Sample>
+static mt32emu_bit32u renderOutputWithEvents(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, const StereoOutputDescriptor<Sample> &output, Bit32u len) {
+	const MIDIEvent *midiEvents = reinterpret_cast<const MIDIEvent *>(events);
+	if (context->srcState->src != NULL) {
+		return context->srcState->src->getOutputSamplesWithEvents(midiEvents, event_count, output, len);
+	}
+	return context->synth->renderWithEvents(midiEvents, event_count, output, len);
+}
+
+static const Bit32u ENGINE_MIX_BUFFER_FRAMES = 512;
+
+static void renderUnit(mt32emu_const_context context, Bit16s *stream, Bit32u len) {
+	mt32emu_render_bit16s(context, stream, len);
+}
+
+static void renderUnit(mt32emu_const_context context, float *stream, Bit32u len) {
+	mt32emu_render_float(context, stream, len);
+}
+
+// Renders each unit of the engine as a separate task. Each unit is only touched by the thread the task is assigned to.
+// When the unit numbers are given, task i renders the unit units[i] into streams[i].
+template <class Sample>
+class EngineRenderingJob : public ThreadPool::Job {
+public:
+	EngineRenderingJob(mt32emu_const_engine useEngine, Sample * const *useStreams, Bit32u useLength, const Bit32u *useUnits = NULL) :
+		engine(useEngine), units(useUnits), streams(useStreams), length(useLength)
+	{}
+
+	void runTask(Bit32u taskIx) {
+		renderUnit(engine->contexts[units == NULL ? taskIx : units[taskIx]], streams[taskIx], length);
+	}
+
+private:
+	const mt32emu_const_engine engine;
+	const Bit32u * const units;
+	Sample * const * const streams;
+	const Bit32u length;
+};
+
+static void runEngineJob(mt32emu_const_engine engine, ThreadPool::Job &job, Bit32u taskCount) {
+	if (engine->threadPool == NULL) {
+		for (Bit32u taskIx = 0; taskIx < taskCount; taskIx++) {
+			job.runTask(taskIx);
+		}
+	} else {
+		engine->threadPool->runJob(job, taskCount);
+	}
+}
+
+template <class Sample>
+static void renderEngineUnits(mt32emu_const_engine engine, Sample * const *streams, Bit32u len) {
+	EngineRenderingJob<Sample> job(engine, streams, len);
+	runEngineJob(engine, job, engine->unitCount);
+}
+
+template <class Sample>
+static void renderSelectedEngineUnits(mt32emu_const_engine engine, const Bit32u *units, Bit32u unitCount, Sample * const *streams, Bit32u len) {
+	EngineRenderingJob<Sample> job(engine, streams, len, units);
+	runEngineJob(engine, job, unitCount);
+}
+
+static void mixUnitStreams(Bit16s *stream, Bit16s * const *unitStreams, Bit32u unitCount, Bit32u sampleCount) {
+	for (Bit32u i = 0; i < sampleCount; i++) {
+		Bit32s sample = 0;
+		for (Bit32u unit = 0; unit < unitCount; unit++) {
+			sample += unitStreams[unit][i];
+		}
+		if (sample < -32768) sample = -32768;
+		if (sample > 32767) sample = 32767;
+		stream[i] = Bit16s(sample);
+	}
+}
+
+static void mixUnitStreams(float *stream, float * const *unitStreams, Bit32u unitCount, Bit32u sampleCount) {
+	for (Bit32u i = 0; i < sampleCount; i++) {
+		float sample = 0.0f;
+		for (Bit32u unit = 0; unit < unitCount; unit++) {
+			sample += unitStreams[unit][i];
+		}
+		stream[i] = sample;
+	}
+}
+
+template <class Sample>
+static void mixEngineUnits(mt32emu_const_engine engine, Sample * const *mixStreams, Sample *stream, Bit32u len) {
+	while (len > 0) {
+		const Bit32u frames = (len < ENGINE_MIX_BUFFER_FRAMES) ? len : ENGINE_MIX_BUFFER_FRAMES;
+		renderEngineUnits(engine, mixStreams, frames);
+		mixUnitStreams(stream, mixStreams, engine->unitCount, frames << 1);
+		stream += frames << 1;
+		len -= frames;
+	}
+}
+
 } // namespace MT32Emu
 
 // C-visible implementation
@@ -329,7 +626,7 @@ extern "C" {
 
 mt32emu_service_i mt32emu_get_service_i() {
 	mt32emu_service_i i;
-	i.v3 = &SERVICE_VTABLE;
+	i.v4 = &SERVICE_VTABLE;
 	return i;
 }
 
@@ -357,6 +654,35 @@ mt32emu_analog_output_mode mt32emu_get_best_analog_output_mode(const double targ
 	return mt32emu_analog_output_mode(SampleRateConverter::getBestAnalogOutputMode(target_samplerate));
 }
 
+mt32emu_boolean mt32emu_is_dac_streams_conversion_supported() {
+	return SampleRateConverter::isDACStreamsConversionSupported() ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+mt32emu_simd_instruction_set mt32emu_get_supported_simd_instruction_set() {
+	return mt32emu_simd_instruction_set(Synth::getSupportedSIMDInstructionSet());
+}
+
+mt32emu_simd_instruction_set mt32emu_get_simd_instruction_set() {
+	return mt32emu_simd_instruction_set(Synth::getSIMDInstructionSet());
+}
+
+mt32emu_boolean mt32emu_force_simd_instruction_set(const mt32emu_simd_instruction_set instruction_set) {
+	return Synth::forceSIMDInstructionSet(static_cast<SIMDInstructionSet>(instruction_set)) ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+mt32emu_executor_version mt32emu_get_supported_executor_version() {
+	return MT32EMU_EXECUTOR_VERSION_CURRENT;
+}
+
+void mt32emu_set_executor(mt32emu_executor_i executor, void *instance_data) {
+	if (executor.v0 == NULL) {
+		Executor::setExecutor(NULL);
+		return;
+	}
+	executorAdapter.setDelegate(executor, instance_data);
+	Executor::setExecutor(&executorAdapter);
+}
+
 mt32emu_context mt32emu_create_context(mt32emu_report_handler_i report_handler, void *instance_data) {
 	mt32emu_data *data = new mt32emu_data;
 	data->reportHandler = (report_handler.v0 != NULL) ? new DelegatingReportHandlerAdapter(report_handler, instance_data) : new ReportHandler;
@@ -378,21 +704,15 @@ mt32emu_context mt32emu_create_context(mt32emu_report_handler_i report_handler,
 void mt32emu_free_context(mt32emu_context data) {
 	if (data == NULL) return;
 
+	// Also stops opening the synth in the worker thread, which may still use the ROM images freed below.
+	data->synth->close();
 	delete data->srcState->src;
 	data->srcState->src = NULL;
 	delete data->srcState;
 	data->srcState = NULL;
 
-	if (data->controlROMImage != NULL) {
-		delete data->controlROMImage->getFile();
-		ROMImage::freeROMImage(data->controlROMImage);
-		data->controlROMImage = NULL;
-	}
-	if (data->pcmROMImage != NULL) {
-		delete data->pcmROMImage->getFile();
-		ROMImage::freeROMImage(data->pcmROMImage);
-		data->pcmROMImage = NULL;
-	}
+	freeROMImage(data->controlROMImage);
+	freeROMImage(data->pcmROMImage);
 	delete data->midiParser;
 	data->midiParser = NULL;
 	delete data->synth;
@@ -403,25 +723,11 @@ void mt32emu_free_context(mt32emu_context data) {
 }
 
 mt32emu_return_code mt32emu_add_rom_data(mt32emu_context context, const mt32emu_bit8u *data, size_t data_size, const mt32emu_sha1_digest *sha1_digest) {
-	if (sha1_digest == NULL) return addROMFile(context, new ArrayFile(data, data_size));
-	return addROMFile(context, new ArrayFile(data, data_size, *sha1_digest));
+	return addROMData(context->controlROMImage, context->pcmROMImage, data, data_size, sha1_digest);
 }
 
 mt32emu_return_code mt32emu_add_rom_file(mt32emu_context context, const char *filename) {
-	mt32emu_return_code rc = MT32EMU_RC_OK;
-	FileStream *fs = new FileStream;
-	if (fs->open(filename)) {
-		if (fs->getData() != NULL) {
-			rc = addROMFile(context, fs);
-			if (rc > 0) return rc;
-		} else {
-			rc = MT32EMU_RC_FILE_NOT_LOADED;
-		}
-	} else {
-		rc = MT32EMU_RC_FILE_NOT_FOUND;
-	}
-	delete fs;
-	return rc;
+	return addROMFile(context->controlROMImage, context->pcmROMImage, filename);
 }
 
 void mt32emu_get_rom_info(mt32emu_const_context context, mt32emu_rom_info *rom_info) {
@@ -471,16 +777,119 @@ mt32emu_renderer_type mt32emu_get_selected_renderer_type(mt32emu_context context
 	return static_cast<mt32emu_renderer_type>(context->synth->getSelectedRendererType());
 }
 
+void mt32emu_set_float_wave_accuracy(mt32emu_const_context context, const mt32emu_float_wave_accuracy accuracy) {
+	context->synth->setFloatWaveAccuracy(static_cast<FloatWaveAccuracy>(accuracy));
+}
+
+mt32emu_float_wave_accuracy mt32emu_get_float_wave_accuracy(mt32emu_const_context context) {
+	return static_cast<mt32emu_float_wave_accuracy>(context->synth->getFloatWaveAccuracy());
+}
+
+void mt32emu_set_degradation_level(mt32emu_const_context context, const mt32emu_degradation_level level) {
+	context->synth->setDegradationLevel(static_cast<DegradationLevel>(level));
+}
+
+mt32emu_degradation_level mt32emu_get_degradation_level(mt32emu_const_context context) {
+	return static_cast<mt32emu_degradation_level>(context->synth->getDegradationLevel());
+}
+
+void mt32emu_set_partial_culling_level(mt32emu_const_context context, const mt32emu_bit8u level) {
+	context->synth->setPartialCullingLevel(level);
+}
+
+mt32emu_bit8u mt32emu_get_partial_culling_level(mt32emu_const_context context) {
+	return context->synth->getPartialCullingLevel();
+}
+
+void mt32emu_set_denormal_flushing_enabled(mt32emu_const_context context, const mt32emu_boolean enabled) {
+	context->synth->setDenormalFlushingEnabled(enabled != MT32EMU_BOOL_FALSE);
+}
+
+mt32emu_boolean mt32emu_is_denormal_flushing_enabled(mt32emu_const_context context) {
+	return context->synth->isDenormalFlushingEnabled() ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+void mt32emu_set_partial_rendering_thread_count(mt32emu_context context, const mt32emu_bit32u thread_count) {
+	context->synth->setPartialRenderingThreadCount(thread_count);
+}
+
+mt32emu_bit32u mt32emu_get_partial_rendering_thread_count(mt32emu_const_context context) {
+	return context->synth->getPartialRenderingThreadCount();
+}
+
+void mt32emu_set_reverb_pipeline_enabled(mt32emu_context context, const mt32emu_boolean enabled) {
+	context->synth->setReverbPipelineEnabled(enabled != MT32EMU_BOOL_FALSE);
+}
+
+mt32emu_boolean mt32emu_is_reverb_pipeline_enabled(mt32emu_const_context context) {
+	return context->synth->isReverbPipelineEnabled() ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+mt32emu_bit32u mt32emu_get_reverb_pipeline_latency(mt32emu_const_context context) {
+	return context->synth->getReverbPipelineLatency();
+}
+
+void mt32emu_set_max_render_block_length(mt32emu_context context, const mt32emu_bit32u length) {
+	context->synth->setMaxRenderBlockLength(length);
+}
+
+mt32emu_bit32u mt32emu_get_max_render_block_length(mt32emu_const_context context) {
+	return context->synth->getMaxRenderBlockLength();
+}
+
+size_t mt32emu_get_allocated_memory_size(mt32emu_const_context context) {
+	return context->synth->getAllocatedMemorySize();
+}
+
+void mt32emu_get_memory_usage(mt32emu_const_context context, mt32emu_memory_usage *usage) {
+	MemoryUsage &memoryUsage = *reinterpret_cast<MemoryUsage *>(usage);
+	context->synth->getMemoryUsage(memoryUsage);
+	if (context->srcState->src != NULL) {
+		memoryUsage.sampleRateConverter = context->srcState->src->getAllocatedMemorySize();
+		memoryUsage.total += memoryUsage.sampleRateConverter;
+	}
+}
+
+void mt32emu_set_rom_cache_directory(mt32emu_context context, const char *cache_directory) {
+	context->synth->setROMCacheDirectory(cache_directory);
+}
+
+const char *mt32emu_get_rom_cache_directory(mt32emu_const_context context) {
+	return context->synth->getROMCacheDirectory();
+}
+
 mt32emu_return_code mt32emu_open_synth(mt32emu_const_context context) {
+	return openSynth(context, context->controlROMImage, context->pcmROMImage);
+}
+
+mt32emu_return_code mt32emu_start_opening_synth(mt32emu_const_context context) {
 	if ((context->controlROMImage == NULL) || (context->pcmROMImage == NULL)) {
 		return MT32EMU_RC_MISSING_ROMS;
 	}
-	if (!context->synth->open(*context->controlROMImage, *context->pcmROMImage, context->partialCount, context->analogOutputMode)) {
+	if (!context->synth->startOpening(*context->controlROMImage, *context->pcmROMImage, context->partialCount, context->analogOutputMode)) {
 		return MT32EMU_RC_FAILED;
 	}
-	SamplerateConversionState &srcState = *context->srcState;
-	const double outputSampleRate = (0.0 < srcState.outputSampleRate) ? srcState.outputSampleRate : context->synth->getStereoOutputSampleRate();
-	srcState.src = new SampleRateConverter(*context->synth, outputSampleRate, srcState.srcQuality);
+	return MT32EMU_RC_OK;
+}
+
+mt32emu_bit32u mt32emu_get_open_progress(mt32emu_const_context context) {
+	return context->synth->getOpenProgress();
+}
+
+// The converter is only created once the synth is open, as it needs the output sample rate of the synth.
+mt32emu_boolean mt32emu_is_opening(mt32emu_const_context context) {
+	if (context->synth->isOpening()) return MT32EMU_BOOL_TRUE;
+	if (context->synth->isOpen() && context->srcState->src == NULL) createSampleRateConverter(context);
+	return MT32EMU_BOOL_FALSE;
+}
+
+void mt32emu_cancel_opening(mt32emu_const_context context) {
+	context->synth->cancelOpening();
+}
+
+mt32emu_return_code mt32emu_finish_opening_synth(mt32emu_const_context context) {
+	if (!context->synth->finishOpening()) return MT32EMU_RC_FAILED;
+	if (context->srcState->src == NULL) createSampleRateConverter(context);
 	return MT32EMU_RC_OK;
 }
 
@@ -527,6 +936,34 @@ void mt32emu_configure_midi_event_queue_sysex_storage(mt32emu_const_context cont
 	return context->synth->configureMIDIEventQueueSysexStorage(storage_buffer_size);
 }
 
+void mt32emu_configure_midi_event_queue_multi_producer(mt32emu_const_context context, const mt32emu_boolean enabled) {
+	context->synth->configureMIDIEventQueueMultiProducer(enabled != MT32EMU_BOOL_FALSE);
+}
+
+mt32emu_boolean mt32emu_is_midi_event_queue_multi_producer(mt32emu_const_context context) {
+	return context->synth->isMIDIEventQueueMultiProducer() ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+void mt32emu_configure_midi_event_queue_coalescing(mt32emu_const_context context, const mt32emu_bit32u window) {
+	context->synth->configureMIDIEventQueueCoalescing(window);
+}
+
+mt32emu_bit32u mt32emu_get_midi_event_queue_coalescing_window(mt32emu_const_context context) {
+	return context->synth->getMIDIEventQueueCoalescingWindow();
+}
+
+mt32emu_bit32u mt32emu_get_midi_event_queue_free_capacity(mt32emu_const_context context) {
+	return context->synth->getMIDIEventQueueFreeCapacity();
+}
+
+mt32emu_boolean mt32emu_wait_for_midi_event_queue_free_capacity(mt32emu_const_context context, const mt32emu_bit32u event_count, const mt32emu_bit32u timeout_millis) {
+	return context->synth->waitForMIDIEventQueueFreeCapacity(event_count, timeout_millis) ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+mt32emu_boolean mt32emu_get_midi_event_queue_statistics(mt32emu_const_context context, mt32emu_midi_event_queue_statistics *statistics) {
+	return context->synth->getMIDIEventQueueStatistics(*reinterpret_cast<MIDIEventQueueStatistics *>(statistics)) ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
 void mt32emu_set_midi_receiver(mt32emu_context context, mt32emu_midi_receiver_i midi_receiver, void *instance_data) {
 	delete context->midiParser;
 	context->midiParser = (midi_receiver.v0 != NULL) ? new DelegatingMidiStreamParser(context, midi_receiver, instance_data) : new DefaultMidiStreamParser(*context->synth);
@@ -576,6 +1013,11 @@ mt32emu_return_code mt32emu_play_sysex_at(mt32emu_const_context context, const m
 	return (context->synth->playSysex(sysex, len, timestamp)) ? MT32EMU_RC_OK : MT32EMU_RC_QUEUE_FULL;
 }
 
+mt32emu_bit32u mt32emu_play_events(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u count) {
+	if (!context->synth->isOpen()) return 0;
+	return context->synth->playEvents(reinterpret_cast<const MIDIEvent *>(events), count);
+}
+
 void mt32emu_play_msg_now(mt32emu_const_context context, mt32emu_bit32u msg) {
 	context->synth->playMsgNow(msg);
 }
@@ -624,6 +1066,18 @@ void mt32emu_preallocate_reverb_memory(mt32emu_const_context context, const mt32
 	return context->synth->preallocateReverbMemory(enabled != MT32EMU_BOOL_FALSE);
 }
 
+void mt32emu_prepare_reverb_model(mt32emu_const_context context, const mt32emu_bit8u mode) {
+	context->synth->prepareReverbModel(mode);
+}
+
+void mt32emu_set_reverb_silence_threshold(mt32emu_const_context context, const float threshold) {
+	context->synth->setReverbSilenceThreshold(threshold);
+}
+
+float mt32emu_get_reverb_silence_threshold(mt32emu_const_context context) {
+	return context->synth->getReverbSilenceThreshold();
+}
+
 void mt32emu_set_dac_input_mode(mt32emu_const_context context, const mt32emu_dac_input_mode mode) {
 	context->synth->setDACInputMode(static_cast<DACInputMode>(mode));
 }
@@ -640,6 +1094,18 @@ mt32emu_midi_delay_mode mt32emu_get_midi_delay_mode(mt32emu_const_context contex
 	return static_cast<mt32emu_midi_delay_mode>(context->synth->getMIDIDelayMode());
 }
 
+void mt32emu_set_midi_event_timing_quantum(mt32emu_const_context context, const mt32emu_bit32u quantum) {
+	context->synth->setMIDIEventTimingQuantum(quantum);
+}
+
+mt32emu_bit32u mt32emu_get_midi_event_timing_quantum(mt32emu_const_context context) {
+	return context->synth->getMIDIEventTimingQuantum();
+}
+
+mt32emu_bit32u mt32emu_get_max_midi_event_timing_error(mt32emu_const_context context) {
+	return context->synth->getMaxMIDIEventTimingError();
+}
+
 void mt32emu_set_output_gain(mt32emu_const_context context, float gain) {
 	context->synth->setOutputGain(gain);
 }
@@ -704,6 +1170,38 @@ void mt32emu_render_float(mt32emu_const_context context, float *stream, mt32emu_
 	}
 }
 
+mt32emu_bit32u mt32emu_render_bit16s_with_events(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, mt32emu_bit16s *stream, mt32emu_bit32u len) {
+	const MIDIEvent *midiEvents = reinterpret_cast<const MIDIEvent *>(events);
+	if (context->srcState->src != NULL) {
+		return context->srcState->src->getOutputSamplesWithEvents(midiEvents, event_count, stream, len);
+	}
+	return context->synth->renderWithEvents(midiEvents, event_count, stream, len);
+}
+
+mt32emu_bit32u mt32emu_render_float_with_events(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, float *stream, mt32emu_bit32u len) {
+	const MIDIEvent *midiEvents = reinterpret_cast<const MIDIEvent *>(events);
+	if (context->srcState->src != NULL) {
+		return context->srcState->src->getOutputSamplesWithEvents(midiEvents, event_count, stream, len);
+	}
+	return context->synth->renderWithEvents(midiEvents, event_count, stream, len);
+}
+
+void mt32emu_render_bit16s_output(mt32emu_const_context context, const mt32emu_stereo_output_bit16s *output, mt32emu_bit32u len) {
+	renderOutput(context, makeStereoOutputDescriptor(*output), len);
+}
+
+void mt32emu_render_float_output(mt32emu_const_context context, const mt32emu_stereo_output_float *output, mt32emu_bit32u len) {
+	renderOutput(context, makeStereoOutputDescriptor(*output), len);
+}
+
+mt32emu_bit32u mt32emu_render_bit16s_output_with_events(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, const mt32emu_stereo_output_bit16s *output, mt32emu_bit32u len) {
+	return renderOutputWithEvents(context, events, event_count, makeStereoOutputDescriptor(*output), len);
+}
+
+mt32emu_bit32u mt32emu_render_float_output_with_events(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, const mt32emu_stereo_output_float *output, mt32emu_bit32u len) {
+	return renderOutputWithEvents(context, events, event_count, makeStereoOutputDescriptor(*output), len);
+}
+
 void mt32emu_render_bit16s_streams(mt32emu_const_context context, const mt32emu_dac_output_bit16s_streams *streams, mt32emu_bit32u len) {
 	context->synth->renderStreams(*reinterpret_cast<const DACOutputStreams<Bit16s> *>(streams), len);
 }
@@ -716,14 +1214,67 @@ mt32emu_boolean mt32emu_has_active_partials(mt32emu_const_context context) {
 	return context->synth->hasActivePartials() ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
 }
 
+mt32emu_bit32u mt32emu_get_min_remaining_partial_frame_count(mt32emu_const_context context) {
+	Bit32u sampleCount = context->synth->getMinRemainingPartialSampleCount();
+	if (context->srcState->src == NULL || sampleCount == 0) {
+		return sampleCount;
+	}
+	// Rounding down keeps the estimate on the safe side, though the converter may still read ahead a little.
+	return mt32emu_bit32u(context->srcState->src->convertSynthToOutputTimestamp(sampleCount));
+}
+
 mt32emu_boolean mt32emu_is_active(mt32emu_const_context context) {
 	return context->synth->isActive() ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
 }
 
+mt32emu_boolean mt32emu_get_render_statistics(mt32emu_const_context context, mt32emu_render_statistics *statistics) {
+	return context->synth->getRenderStatistics(*reinterpret_cast<RenderStatistics *>(statistics)) ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+mt32emu_boolean mt32emu_get_partial_render_statistics(mt32emu_const_context context, mt32emu_partial_render_statistics *statistics) {
+	return context->synth->getPartialRenderStatistics(*reinterpret_cast<PartialRenderStatistics *>(statistics)) ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+void mt32emu_reset_render_statistics(mt32emu_const_context context) {
+	context->synth->resetRenderStatistics();
+}
+
 mt32emu_bit32u mt32emu_get_partial_count(mt32emu_const_context context) {
 	return context->synth->getPartialCount();
 }
 
+void mt32emu_set_partial_limit(mt32emu_const_context context, const mt32emu_bit32u partial_limit) {
+	context->synth->setPartialLimit(partial_limit);
+}
+
+mt32emu_bit32u mt32emu_get_partial_limit(mt32emu_const_context context) {
+	return context->synth->getPartialLimit();
+}
+
+void mt32emu_set_max_partial_count(mt32emu_const_context context, const mt32emu_bit32u max_partial_count) {
+	context->synth->setMaxPartialCount(max_partial_count);
+}
+
+mt32emu_bit32u mt32emu_get_max_partial_count(mt32emu_const_context context) {
+	return context->synth->getMaxPartialCount();
+}
+
+mt32emu_boolean mt32emu_resize_partial_pool(mt32emu_const_context context, const mt32emu_bit32u new_partial_count) {
+	return context->synth->resizePartialPool(new_partial_count) ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+void mt32emu_set_hot_memory_locking_enabled(mt32emu_const_context context, const mt32emu_boolean enabled) {
+	context->synth->setHotMemoryLockingEnabled(enabled != MT32EMU_BOOL_FALSE);
+}
+
+mt32emu_boolean mt32emu_is_hot_memory_locking_enabled(mt32emu_const_context context) {
+	return context->synth->isHotMemoryLockingEnabled() ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+mt32emu_boolean mt32emu_is_hot_memory_locked(mt32emu_const_context context) {
+	return context->synth->isHotMemoryLocked() ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
 mt32emu_bit32u mt32emu_get_part_states(mt32emu_const_context context) {
 	return context->synth->getPartStates();
 }
@@ -744,4 +1295,157 @@ void mt32emu_read_memory(mt32emu_const_context context, mt32emu_bit32u addr, mt3
 	context->synth->readMemory(addr, len, data);
 }
 
+mt32emu_bit32u mt32emu_load_sysex_bank(mt32emu_context context, const mt32emu_bit8u *data, mt32emu_bit32u len) {
+	return context->synth->loadSysexBank(data, len);
+}
+
+mt32emu_return_code mt32emu_load_sysex_bank_file(mt32emu_context context, const char *filename) {
+	if (!context->synth->isOpen()) return MT32EMU_RC_NOT_OPENED;
+	FileStream fs;
+	if (!fs.open(filename)) return MT32EMU_RC_FILE_NOT_FOUND;
+	const Bit8u *data = fs.getData();
+	if (data == NULL) return MT32EMU_RC_FILE_NOT_LOADED;
+	context->synth->loadSysexBank(data, Bit32u(fs.getSize()));
+	return MT32EMU_RC_OK;
+}
+
+void mt32emu_write_memory(mt32emu_context context, mt32emu_bit32u addr, mt32emu_bit32u len, const mt32emu_bit8u *data) {
+	context->synth->writeMemory(addr, len, data);
+}
+
+void mt32emu_prefetch_timbres(mt32emu_const_context context, mt32emu_bit32u first_timbre_num, mt32emu_bit32u timbre_count) {
+	context->synth->prefetchTimbres(first_timbre_num, timbre_count);
+}
+
+size_t mt32emu_save_state(mt32emu_context context, mt32emu_bit8u *buffer, size_t buffer_size) {
+	return context->synth->saveState(buffer, buffer_size);
+}
+
+mt32emu_boolean mt32emu_restore_state(mt32emu_context context, const mt32emu_bit8u *state, size_t state_size) {
+	return context->synth->restoreState(state, state_size) ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+size_t mt32emu_save_state_delta(mt32emu_context context, const mt32emu_bit8u *base_state, size_t base_state_size, mt32emu_bit8u *buffer, size_t buffer_size) {
+	return context->synth->saveStateDelta(base_state, base_state_size, buffer, buffer_size);
+}
+
+mt32emu_boolean mt32emu_restore_state_delta(mt32emu_context context, const mt32emu_bit8u *base_state, size_t base_state_size, const mt32emu_bit8u *delta, size_t delta_size) {
+	return context->synth->restoreStateDelta(base_state, base_state_size, delta, delta_size) ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+mt32emu_boolean mt32emu_reset_to_open_state(mt32emu_context context) {
+	if (!context->synth->resetToOpenState()) return MT32EMU_BOOL_FALSE;
+	// The sample rate converter retains the history of the output, so it is started afresh as well.
+	SamplerateConversionState &srcState = *context->srcState;
+	delete srcState.src;
+	srcState.src = new SampleRateConverter(*context->synth, srcState.srcOutputSampleRate, srcState.srcOpenQuality);
+	return MT32EMU_BOOL_TRUE;
+}
+
+mt32emu_boolean mt32emu_start_session_recording(mt32emu_context context, const char *filename) {
+	return context->synth->startSessionRecording(filename) ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+void mt32emu_stop_session_recording(mt32emu_context context) {
+	context->synth->stopSessionRecording();
+}
+
+mt32emu_engine mt32emu_create_engine(const mt32emu_bit32u unit_count, const mt32emu_bit32u thread_count, mt32emu_report_handler_i report_handler, void * const *instance_data) {
+	if (unit_count == 0) return NULL;
+	mt32emu_engine_data *engine = new mt32emu_engine_data;
+	engine->unitCount = unit_count;
+	engine->contexts = new mt32emu_context[unit_count];
+	for (Bit32u unit = 0; unit < unit_count; unit++) {
+		engine->contexts[unit] = mt32emu_create_context(report_handler, instance_data == NULL ? NULL : instance_data[unit]);
+	}
+	const Bit32u threadCount = (thread_count < unit_count) ? thread_count : unit_count;
+	engine->threadPool = (threadCount > 1) ? ThreadPool::createThreadPool(threadCount - 1) : NULL;
+	engine->controlROMImage = NULL;
+	engine->pcmROMImage = NULL;
+	engine->bit16sMixBuffer = new Bit16s[unit_count * ENGINE_MIX_BUFFER_FRAMES * 2];
+	engine->bit16sMixStreams = new Bit16s *[unit_count];
+	engine->floatMixBuffer = new float[unit_count * ENGINE_MIX_BUFFER_FRAMES * 2];
+	engine->floatMixStreams = new float *[unit_count];
+	for (Bit32u unit = 0; unit < unit_count; unit++) {
+		engine->bit16sMixStreams[unit] = engine->bit16sMixBuffer + unit * ENGINE_MIX_BUFFER_FRAMES * 2;
+		engine->floatMixStreams[unit] = engine->floatMixBuffer + unit * ENGINE_MIX_BUFFER_FRAMES * 2;
+	}
+	return engine;
+}
+
+void mt32emu_free_engine(mt32emu_engine engine) {
+	if (engine == NULL) return;
+	for (Bit32u unit = 0; unit < engine->unitCount; unit++) {
+		mt32emu_free_context(engine->contexts[unit]);
+	}
+	delete[] engine->contexts;
+	delete engine->threadPool;
+	freeROMImage(engine->controlROMImage);
+	freeROMImage(engine->pcmROMImage);
+	delete[] engine->bit16sMixBuffer;
+	delete[] engine->bit16sMixStreams;
+	delete[] engine->floatMixBuffer;
+	delete[] engine->floatMixStreams;
+	delete engine;
+}
+
+mt32emu_bit32u mt32emu_get_engine_unit_count(mt32emu_const_engine engine) {
+	return engine->unitCount;
+}
+
+mt32emu_context mt32emu_get_engine_context(mt32emu_const_engine engine, const mt32emu_bit32u unit) {
+	return (unit < engine->unitCount) ? engine->contexts[unit] : NULL;
+}
+
+mt32emu_return_code mt32emu_add_engine_rom_data(mt32emu_engine engine, const mt32emu_bit8u *data, size_t data_size, const mt32emu_sha1_digest *sha1_digest) {
+	return addROMData(engine->controlROMImage, engine->pcmROMImage, data, data_size, sha1_digest);
+}
+
+mt32emu_return_code mt32emu_add_engine_rom_file(mt32emu_engine engine, const char *filename) {
+	return addROMFile(engine->controlROMImage, engine->pcmROMImage, filename);
+}
+
+mt32emu_return_code mt32emu_open_engine(mt32emu_const_engine engine) {
+	for (Bit32u unit = 0; unit < engine->unitCount; unit++) {
+		const mt32emu_return_code rc = openSynth(engine->contexts[unit], engine->controlROMImage, engine->pcmROMImage);
+		if (rc != MT32EMU_RC_OK) {
+			while (unit > 0) {
+				mt32emu_close_synth(engine->contexts[--unit]);
+			}
+			return rc;
+		}
+	}
+	return MT32EMU_RC_OK;
+}
+
+void mt32emu_close_engine(mt32emu_const_engine engine) {
+	for (Bit32u unit = 0; unit < engine->unitCount; unit++) {
+		mt32emu_close_synth(engine->contexts[unit]);
+	}
+}
+
+void mt32emu_render_engine_bit16s(mt32emu_const_engine engine, mt32emu_bit16s * const *streams, mt32emu_bit32u len) {
+	renderEngineUnits(engine, streams, len);
+}
+
+void mt32emu_render_engine_float(mt32emu_const_engine engine, float * const *streams, mt32emu_bit32u len) {
+	renderEngineUnits(engine, streams, len);
+}
+
+void mt32emu_render_engine_units_bit16s(mt32emu_const_engine engine, const mt32emu_bit32u *units, mt32emu_bit32u unit_count, mt32emu_bit16s * const *streams, mt32emu_bit32u len) {
+	renderSelectedEngineUnits(engine, units, unit_count, streams, len);
+}
+
+void mt32emu_render_engine_units_float(mt32emu_const_engine engine, const mt32emu_bit32u *units, mt32emu_bit32u unit_count, float * const *streams, mt32emu_bit32u len) {
+	renderSelectedEngineUnits(engine, units, unit_count, streams, len);
+}
+
+void mt32emu_mix_engine_bit16s(mt32emu_const_engine engine, mt32emu_bit16s *stream, mt32emu_bit32u len) {
+	mixEngineUnits(engine, engine->bit16sMixStreams, stream, len);
+}
+
+void mt32emu_mix_engine_float(mt32emu_const_engine engine, float *stream, mt32emu_bit32u len) {
+	mixEngineUnits(engine, engine->floatMixStreams, stream, len);
+}
+
 } // extern "C"
@@ -80,6 +80,42 @@ MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_stereo_output_samplerate(const mt32emu
  */
 MT32EMU_EXPORT mt32emu_analog_output_mode mt32emu_get_best_analog_output_mode(const double target_samplerate);
 
+/**
+ * Returns whether the library build can convert the streams at the DAC entrance to sample rates other than 32000 Hz.
+ * This requires the internal resampler, so MT32EMU_BOOL_FALSE is returned when built with libsoxr or libsamplerate.
+ * Note, mt32emu_render_bit16s_streams() and mt32emu_render_float_streams() always render at 32000 Hz.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_is_dac_streams_conversion_supported(void);
+
+/**
+ * Returns the best SIMD instruction set supported by both the CPU and the library build.
+ * See comment for mt32emu_simd_instruction_set.
+ */
+MT32EMU_EXPORT mt32emu_simd_instruction_set mt32emu_get_supported_simd_instruction_set(void);
+
+/** Returns the SIMD instruction set the optimised kernels are currently dispatched for. */
+MT32EMU_EXPORT mt32emu_simd_instruction_set mt32emu_get_simd_instruction_set(void);
+
+/**
+ * Forces the optimised kernels of all contexts to be dispatched for the specified SIMD instruction set, which is mainly
+ * useful for benchmarking. Takes effect upon the next successful call to mt32emu_open_synth() in any context, which must
+ * not happen while another context is rendering. Returns MT32EMU_BOOL_FALSE if the instruction set is unsupported,
+ * leaving the setting unchanged.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_force_simd_instruction_set(const mt32emu_simd_instruction_set instruction_set);
+
+/** Returns the version ID of mt32emu_executor_i interface the library can use. */
+MT32EMU_EXPORT mt32emu_executor_version mt32emu_get_supported_executor_version(void);
+
+/**
+ * Installs the executor that runs the parallel work of all contexts and engines in the threads of the host application,
+ * so that the library spawns no threads of its own. Passing an executor with a NULL v0 pointer restores the built-in
+ * worker threads. The executor is picked up whenever the worker threads would be created, i.e. upon opening a synth
+ * or an engine, so it should be installed beforehand and must remain valid until all of them are closed.
+ * Has no effect unless the library is built with multithreading support.
+ */
+MT32EMU_EXPORT void mt32emu_set_executor(mt32emu_executor_i executor, void *instance_data);
+
 /* == Context-dependent functions == */
 
 /** Initialises a new emulation context and installs custom report handler if non-NULL. */
@@ -155,6 +191,112 @@ MT32EMU_EXPORT void mt32emu_select_renderer_type(mt32emu_context context, const
  */
 MT32EMU_EXPORT mt32emu_renderer_type mt32emu_get_selected_renderer_type(mt32emu_context context);
 
+/**
+ * Sets the accuracy of the transcendental functions the float renderer synthesises the square and sawtooth waves with.
+ * The change also applies to the partials currently playing.
+ * By default, MT32EMU_FWA_REFERENCE is used, so the output is the same as in the previous versions.
+ * See mt32emu_float_wave_accuracy for details.
+ */
+MT32EMU_EXPORT void mt32emu_set_float_wave_accuracy(mt32emu_const_context context, const mt32emu_float_wave_accuracy accuracy);
+/** Returns the accuracy of the transcendental functions used by the float renderer. */
+MT32EMU_EXPORT mt32emu_float_wave_accuracy mt32emu_get_float_wave_accuracy(mt32emu_const_context context);
+
+/**
+ * Selects the step of the ladder of cheaper processing modes a realtime host may go through automatically
+ * when rendering is at risk of missing its deadlines. See mt32emu_degradation_level for details.
+ * The change takes effect with the next rendered sample, so when made between render calls, the processing switches
+ * exactly at the block boundary without glitches. The level in effect and the number of changes are reported
+ * by mt32emu_get_render_statistics(). The setting is retained across reopening the synth.
+ * Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT void mt32emu_set_degradation_level(mt32emu_const_context context, const mt32emu_degradation_level level);
+/** Returns the degradation level currently in effect. */
+MT32EMU_EXPORT mt32emu_degradation_level mt32emu_get_degradation_level(mt32emu_const_context context);
+
+/**
+ * Enables culling of inaudible partials, meant for throughput-critical batch rendering. While the TVA level
+ * of a partial, and of its ring modulating slave, stays below the specified level, the waves are not generated.
+ * Instead, the envelopes and the PCM wave positions are merely advanced and silence is rendered, so the partial
+ * deactivates at the same sample, yet the output is no longer accurate. The TVA level ranges from 0 to 255,
+ * each step attenuating by about 0.375 dB. Level 0 disables culling, which is the default.
+ * The setting is retained across reopening the synth. Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT void mt32emu_set_partial_culling_level(mt32emu_const_context context, const mt32emu_bit8u level);
+/** Returns the TVA level below which partials are culled, 0 if culling is disabled. */
+MT32EMU_EXPORT mt32emu_bit8u mt32emu_get_partial_culling_level(mt32emu_const_context context);
+
+/**
+ * Enables or disables the flush-to-zero and denormals-are-zero modes of the floating-point unit while rendering.
+ * When enabled, each rendering call switches the modes on for its duration, including the worker threads it employs
+ * and the sample rate conversion, and restores the control state of the calling thread on return. Denormal numbers,
+ * which are exceedingly slow to process on x86, are then replaced with zeros. Effective on x86 with SSE and AArch64 only.
+ * By default, disabled. The setting is retained across reopening the synth.
+ */
+MT32EMU_EXPORT void mt32emu_set_denormal_flushing_enabled(mt32emu_const_context context, const mt32emu_boolean enabled);
+/** Returns whether the denormal numbers are flushed to zero while rendering. */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_is_denormal_flushing_enabled(mt32emu_const_context context);
+
+/**
+ * Sets the number of threads to be used for rendering partials during subsequent calls to mt32emu_open_synth().
+ * When more than one thread is requested, the rendering thread is supplemented by worker threads that render
+ * partials in parallel, with exactly the same output. By default, partials are rendered in the rendering thread only,
+ * which is also the only option when the library is built without multithreading support.
+ */
+MT32EMU_EXPORT void mt32emu_set_partial_rendering_thread_count(mt32emu_context context, const mt32emu_bit32u thread_count);
+
+/** Returns the number of threads to be used for rendering partials. */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_partial_rendering_thread_count(mt32emu_const_context context);
+
+/**
+ * Enables or disables, during subsequent calls to mt32emu_open_synth(), pipelined processing of the reverb model
+ * in a worker thread. The output is the same as without the pipeline, except it is delayed by the latency
+ * returned by mt32emu_get_reverb_pipeline_latency(), and a decayed reverb tail may get muted a few samples apart.
+ * Disabled by default, and unavailable when the library is built without multithreading support.
+ */
+MT32EMU_EXPORT void mt32emu_set_reverb_pipeline_enabled(mt32emu_context context, const mt32emu_boolean enabled);
+
+/** Returns whether the reverb pipeline is to be used. */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_is_reverb_pipeline_enabled(mt32emu_const_context context);
+
+/**
+ * Returns the extra output latency introduced by the reverb pipeline, in samples at the DAC sample rate (32000 Hz),
+ * or 0 if the synth is not open or the pipeline is not in use.
+ */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_reverb_pipeline_latency(mt32emu_const_context context);
+
+/**
+ * Sets the maximum number of samples rendered in a single pass during subsequent calls to mt32emu_open_synth().
+ * This determines the size of the rendering buffers held by the synth. Smaller blocks reduce the memory footprint
+ * at the cost of a higher per-pass overhead, while larger blocks let offline rendering go in fewer passes.
+ * The value is clamped to the range [MT32EMU_MIN_RENDER_BLOCK_LENGTH, MT32EMU_MAX_RENDER_BLOCK_LENGTH],
+ * the default being MT32EMU_MAX_SAMPLES_PER_RUN.
+ */
+MT32EMU_EXPORT void mt32emu_set_max_render_block_length(mt32emu_context context, const mt32emu_bit32u length);
+
+/** Returns the maximum number of samples rendered in a single pass. */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_max_render_block_length(mt32emu_const_context context);
+
+/**
+ * Returns the amount of memory in bytes allocated by the synth instance. The data shared between instances,
+ * such as the decoded PCM ROM, and the worker threads are not accounted.
+ */
+MT32EMU_EXPORT size_t mt32emu_get_allocated_memory_size(mt32emu_const_context context);
+/**
+ * Fills in the breakdown of the memory allocated by the synth instance by subsystem, see mt32emu_memory_usage.
+ * Unlike mt32emu_get_allocated_memory_size(), the sample rate converter of the context is accounted as well.
+ */
+MT32EMU_EXPORT void mt32emu_get_memory_usage(mt32emu_const_context context, mt32emu_memory_usage *usage);
+
+/**
+ * Sets the directory (including the trailing path separator) to cache the decoded PCM ROM in during subsequent calls
+ * to mt32emu_open_synth(). A cached PCM ROM is memory-mapped instead of decoding the ROM again, which speeds up startup.
+ * The directory must exist. NULL or an empty string disables caching, which is the default.
+ */
+MT32EMU_EXPORT void mt32emu_set_rom_cache_directory(mt32emu_context context, const char *cache_directory);
+
+/** Returns the directory to cache the decoded PCM ROM in, or NULL if caching is disabled. */
+MT32EMU_EXPORT const char *mt32emu_get_rom_cache_directory(mt32emu_const_context context);
+
 /**
  * Prepares the emulation context to receive MIDI messages and produce output audio data using aforehand added set of ROMs,
  * and optionally set the maximum partial count and the analog output mode.
@@ -162,6 +304,33 @@ MT32EMU_EXPORT mt32emu_renderer_type mt32emu_get_selected_renderer_type(mt32emu_
  */
 MT32EMU_EXPORT mt32emu_return_code mt32emu_open_synth(mt32emu_const_context context);
 
+/**
+ * Same as mt32emu_open_synth() but prepares the emulation context in a worker thread and returns immediately, so that
+ * the caller may keep servicing its UI and audio meanwhile. Until opening completes, the context is reported closed
+ * and only the functions below and mt32emu_close_synth() may be invoked, the added ROMs must not be changed either.
+ * When the library is built without multithreading support, the synth is opened synchronously.
+ * Returns MT32EMU_RC_OK if opening has started.
+ */
+MT32EMU_EXPORT mt32emu_return_code mt32emu_start_opening_synth(mt32emu_const_context context);
+
+/**
+ * Returns the approximate progress of opening the synth started with mt32emu_start_opening_synth(), in percent.
+ * Once opening completes, returns 100 if the synth is open and 0 otherwise.
+ */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_open_progress(mt32emu_const_context context);
+
+/**
+ * Returns true while the synth is still being opened in the worker thread. As soon as it returns false,
+ * the context is switched to the resulting state, so that mt32emu_is_open() tells whether opening succeeded.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_is_opening(mt32emu_const_context context);
+
+/** Requests to abandon opening the synth started with mt32emu_start_opening_synth() at the next stage. Returns immediately. */
+MT32EMU_EXPORT void mt32emu_cancel_opening(mt32emu_const_context context);
+
+/** Waits for opening the synth started with mt32emu_start_opening_synth() to complete. Returns MT32EMU_RC_OK if the synth is open. */
+MT32EMU_EXPORT mt32emu_return_code mt32emu_finish_opening_synth(mt32emu_const_context context);
+
 /** Closes the emulation context freeing allocated resources. Added ROMs remain unaffected and ready for reuse. */
 MT32EMU_EXPORT void mt32emu_close_synth(mt32emu_const_context context);
 
@@ -204,8 +373,10 @@ MT32EMU_EXPORT mt32emu_bit32u mt32emu_set_midi_event_queue_size(mt32emu_const_co
 /**
  * Configures the SysEx storage of the internal MIDI event queue.
  * Supplying 0 in the storage_buffer_size argument makes the SysEx data stored
- * in multiple dynamically allocated buffers per MIDI event. These buffers are only disposed
- * when a new MIDI event replaces the SysEx event in the queue, thus never on the rendering thread.
+ * in dynamically allocated buffers, one per slot of the queue. These buffers are retained and reused
+ * by the subsequent SysEx events, so that once grown, they are only reallocated to fit a larger message,
+ * and never disposed on the rendering thread. Unless in the multi-producer mode, the released buffers are also
+ * pooled for reuse by other slots, so that the heap isn't accessed in the steady state.
  * This is the default behaviour.
  * In contrast, when a positive value is specified, SysEx data will be stored in a single preallocated buffer,
  * which makes this kind of storage safe for use in a realtime thread. Additionally, the space retained
@@ -214,6 +385,51 @@ MT32EMU_EXPORT mt32emu_bit32u mt32emu_set_midi_event_queue_size(mt32emu_const_co
  */
 void mt32emu_configure_midi_event_queue_sysex_storage(mt32emu_const_context context, const mt32emu_bit32u storage_buffer_size);
 
+/**
+ * Enables or disables the multi-producer mode of the internal MIDI event queue. In this mode, the functions that enqueue
+ * MIDI events may be invoked concurrently from multiple threads without external synchronisation, as the queue slots
+ * are reserved using lock-free atomic operations. Note, the state used to emulate the MIDI interface delays is shared
+ * by all the threads, so MT32EMU_MDM_IMMEDIATE is the best fit when the timestamps of the events are prepared
+ * by the client. Also, the SysEx data is always stored in per-slot dynamically allocated buffers in this mode,
+ * regardless of mt32emu_configure_midi_event_queue_sysex_storage(). By default, the multi-producer mode is disabled.
+ * Note, the queue is flushed and recreated in the process so that its size remains intact.
+ */
+MT32EMU_EXPORT void mt32emu_configure_midi_event_queue_multi_producer(mt32emu_const_context context, const mt32emu_boolean enabled);
+/** Returns whether the internal MIDI event queue operates in the multi-producer mode. */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_is_midi_event_queue_multi_producer(mt32emu_const_context context);
+
+/**
+ * Configures coalescing of the MIDI events that merely set a value. A modulation, volume, pan, expression or pitch bend
+ * message replaces the value in the latest event of the same kind pending for the channel, provided no other event
+ * for the channel was enqueued in between and the timestamp is less than the window (in samples at the native sample rate
+ * 32000 Hz) behind that event, which keeps its timestamp. Notes, SysEx and the order-sensitive controllers are never
+ * coalesced. The value 0 disables coalescing, which is the default. Has no effect in the multi-producer mode.
+ * Note, the queue is flushed and recreated in the process so that its size remains intact.
+ */
+MT32EMU_EXPORT void mt32emu_configure_midi_event_queue_coalescing(mt32emu_const_context context, const mt32emu_bit32u window);
+/** Returns the window configured with mt32emu_configure_midi_event_queue_coalescing(). */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_midi_event_queue_coalescing_window(mt32emu_const_context context);
+
+/**
+ * Returns the number of MIDI events that can currently be enqueued without failing, so that a client feeding events
+ * in advance can fill the queue in batches. Note, a SysEx message may still fail to enqueue if the SysEx storage buffer
+ * is exhausted. Returns 0 if the synth is closed.
+ */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_midi_event_queue_free_capacity(mt32emu_const_context context);
+/**
+ * Blocks the calling thread until the MIDI event queue can accept the specified number of events or the timeout expires,
+ * whichever comes first. The thread is parked rather than spinning and gets woken up once the rendering thread processes
+ * enough events. Returns MT32EMU_BOOL_TRUE if the events can now be enqueued. Without multithreading support
+ * in the library, never blocks and only reports whether the capacity is sufficient.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_wait_for_midi_event_queue_free_capacity(mt32emu_const_context context, const mt32emu_bit32u event_count, const mt32emu_bit32u timeout_millis);
+/**
+ * Fills in the telemetry of the MIDI event queue: the depth reached, the events refused on overflow and the events played late
+ * along with a histogram of their lateness. This is collected regardless of MT32EMU_WITH_RENDER_STATISTICS. Returns false and
+ * zeroes out the statistics if the synth is closed. Reset by mt32emu_reset_render_statistics() and when the queue is recreated.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_get_midi_event_queue_statistics(mt32emu_const_context context, mt32emu_midi_event_queue_statistics *statistics);
+
 /**
  * Installs custom MIDI receiver object intended for receiving MIDI messages generated by MIDI stream parser.
  * MIDI stream parser is involved when functions mt32emu_parse_stream() and mt32emu_play_short_message() or the likes are called.
@@ -233,7 +449,8 @@ MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_internal_rendered_sample_count(mt32emu
  * The timestamp is measured as the global rendered sample count since the synth was created (at the native sample rate 32000 Hz).
  * The minimum delay involves emulation of the delay introduced while the event is transferred via MIDI interface
  * and emulation of the MCU busy-loop while it frees partials for use by a new Poly.
- * Calls from multiple threads must be synchronised, although, no synchronisation is required with the rendering thread.
+ * Calls from multiple threads must be synchronised unless the queue operates in the multi-producer mode,
+ * although, no synchronisation is required with the rendering thread.
  * onMIDIQueueOverflow callback is invoked when the MIDI event queue is full and the message cannot be enqueued.
  */
 
@@ -277,6 +494,14 @@ MT32EMU_EXPORT mt32emu_return_code mt32emu_play_msg_at(mt32emu_const_context con
 /** Enqueues a single well formed System Exclusive MIDI message to play at specified time. */
 MT32EMU_EXPORT mt32emu_return_code mt32emu_play_sysex_at(mt32emu_const_context context, const mt32emu_bit8u *sysex, mt32emu_bit32u len, mt32emu_bit32u timestamp);
 
+/**
+ * Enqueues a sequence of MIDI events, each to play at the specified time. This is equivalent to calling
+ * mt32emu_play_msg_at() or mt32emu_play_sysex_at() for each event in turn, but the events are published
+ * to the MIDI event queue in batches, which is notably cheaper when many events are enqueued at once.
+ * Returns the number of events enqueued, which is less than count if the synth is not open or the queue is full.
+ */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_play_events(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u count);
+
 /* WARNING:
  * The methods below don't ensure minimum 1-sample delay between sequential MIDI events,
  * and a sequence of NoteOn and immediately succeeding NoteOff messages is always silent.
@@ -330,12 +555,38 @@ MT32EMU_EXPORT mt32emu_boolean mt32emu_is_mt32_reverb_compatibility_mode(mt32emu
 MT32EMU_EXPORT mt32emu_boolean mt32emu_is_default_reverb_mt32_compatible(mt32emu_const_context context);
 
 /**
- * If enabled, reverb buffers for all modes are keept around allocated all the time to avoid memory
+ * If enabled, reverb models and buffers for all modes are keept around allocated all the time to avoid memory
  * allocating/freeing in the rendering thread, which may be required for realtime operation.
- * Otherwise, reverb buffers that are not in use are deleted to save memory (the default behaviour).
+ * Otherwise, reverb models are only created when a mode is first selected, and reverb buffers that are not in use
+ * are deleted to save memory (the default behaviour).
  */
 MT32EMU_EXPORT void mt32emu_preallocate_reverb_memory(mt32emu_const_context context, const mt32emu_boolean enabled);
 
+/**
+ * Creates the reverb model for the specified mode (0-3, as in the system area) and allocates its buffers unless
+ * already done, so that selecting the mode later doesn't allocate memory in the rendering thread. Intended to be
+ * invoked ahead of time, e.g. while the upcoming MIDI data is being parsed, when reverb memory is not preallocated.
+ * The buffers are deleted again once another mode is selected. Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT void mt32emu_prepare_reverb_model(mt32emu_const_context context, const mt32emu_bit8u mode);
+
+/**
+ * Sets the level below which the reverb tail is considered decayed, as a fraction of the full scale, so that 1.0
+ * stands for 32768 LSBs of the 16-bit output and 1.0 of the float output. As soon as the contents of the reverb
+ * filters and the reverb input are all below this level, the reverb model mutes itself and stops processing until
+ * a louder input arrives, which also lets the synth become inactive sooner. The default of 0 (or any non-positive
+ * value) disables the mute, so the output is unaffected.
+ */
+MT32EMU_EXPORT void mt32emu_set_reverb_silence_threshold(mt32emu_const_context context, const float threshold);
+/** Returns the reverb silence threshold as set by mt32emu_set_reverb_silence_threshold(). */
+MT32EMU_EXPORT float mt32emu_get_reverb_silence_threshold(mt32emu_const_context context);
+
+/*
+ * The DAC input mode, the output gains, the reversed stereo and the nice* modes below are realtime parameters,
+ * which may be set from any thread without synchronisation with the rendering thread. The rendering thread takes
+ * the new values into use at the start of the next rendering pass, while the getters return the latest values set.
+ */
+
 /** Sets new DAC input mode. See mt32emu_dac_input_mode for details. */
 MT32EMU_EXPORT void mt32emu_set_dac_input_mode(mt32emu_const_context context, const mt32emu_dac_input_mode mode);
 /** Returns current DAC input mode. See mt32emu_dac_input_mode for details. */
@@ -346,6 +597,24 @@ MT32EMU_EXPORT void mt32emu_set_midi_delay_mode(mt32emu_const_context context, c
 /** Returns current MIDI delay mode. See mt32emu_midi_delay_mode for details. */
 MT32EMU_EXPORT mt32emu_midi_delay_mode mt32emu_get_midi_delay_mode(mt32emu_const_context context);
 
+/**
+ * Sets the length in samples of the grid MIDI events are aligned to when they are played from the MIDI queue.
+ * By default (and with the quantum set to 0 or 1), each event is played exactly at its timestamp, which requires
+ * the rendering to be split at every event. With a larger quantum, the events are delayed up to the next grid point
+ * and all the events that fall into the same grid cell are played at once, so dense MIDI streams are rendered
+ * in fewer, longer runs at the cost of less accurate timing. Note that a note-on is still followed by at least one
+ * rendered sample before the next event, so that zero-duration notes are played.
+ */
+MT32EMU_EXPORT void mt32emu_set_midi_event_timing_quantum(mt32emu_const_context context, const mt32emu_bit32u quantum);
+/** Returns the length of the grid MIDI events are aligned to, as set by mt32emu_set_midi_event_timing_quantum(). */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_midi_event_timing_quantum(mt32emu_const_context context);
+/**
+ * Returns the maximum delay in samples a MIDI event has been played with relative to its timestamp since the synth
+ * was opened or the MIDI event timing quantum was last changed. Events that have been waiting for partials to be freed
+ * when the synth runs out of partials are not taken into account.
+ */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_max_midi_event_timing_error(mt32emu_const_context context);
+
 /**
  * Sets output gain factor for synth output channels. Applied to all output samples and unrelated with the synth's Master volume,
  * it rather corresponds to the gain of the output analog circuitry of the hardware units. However, together with mt32emu_set_reverb_output_gain()
@@ -423,6 +692,34 @@ MT32EMU_EXPORT void mt32emu_render_bit16s(mt32emu_const_context context, mt32emu
 /** Same as above but outputs to a float stereo stream. */
 MT32EMU_EXPORT void mt32emu_render_float(mt32emu_const_context context, float *stream, mt32emu_bit32u len);
 
+/**
+ * Same as mt32emu_render_bit16s() but also plays the given events at their timestamps while rendering, without enqueuing them,
+ * which suits offline rendering as the MIDI event queue limits don't apply. The events must be sorted by timestamp.
+ * The timestamps are honoured exactly, as the MIDI interface delays aren't emulated. The events that aren't due
+ * by the end of the rendered period are left unplayed. Returns the number of events played.
+ * The event array must remain valid only for the duration of the call.
+ */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_render_bit16s_with_events(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, mt32emu_bit16s *stream, mt32emu_bit32u len);
+/** Same as above but outputs to a float stereo stream. */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_render_float_with_events(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, float *stream, mt32emu_bit32u len);
+
+/**
+ * Same as mt32emu_render_bit16s() but stores the output according to the layout described, see mt32emu_stereo_output_bit16s.
+ * This allows writing to planar or multichannel host buffers directly. Unless sample rate conversion is necessary,
+ * the synth renders straight into the buffers.
+ */
+MT32EMU_EXPORT void mt32emu_render_bit16s_output(mt32emu_const_context context, const mt32emu_stereo_output_bit16s *output, mt32emu_bit32u len);
+/** Same as above but outputs to float buffers. */
+MT32EMU_EXPORT void mt32emu_render_float_output(mt32emu_const_context context, const mt32emu_stereo_output_float *output, mt32emu_bit32u len);
+
+/**
+ * Combines mt32emu_render_bit16s_output() with mt32emu_render_bit16s_with_events(), so that the events given are played
+ * at their timestamps while rendering to planar or multichannel host buffers. Returns the number of events played.
+ */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_render_bit16s_output_with_events(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, const mt32emu_stereo_output_bit16s *output, mt32emu_bit32u len);
+/** Same as above but outputs to float buffers. */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_render_float_output_with_events(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, const mt32emu_stereo_output_float *output, mt32emu_bit32u len);
+
 /**
  * Renders samples to the specified output streams as if they appeared at the DAC entrance.
  * No further processing performed in analog circuitry emulation is applied to the signal.
@@ -436,12 +733,82 @@ MT32EMU_EXPORT void mt32emu_render_float_streams(mt32emu_const_context context,
 /** Returns true when there is at least one active partial, otherwise false. */
 MT32EMU_EXPORT mt32emu_boolean mt32emu_has_active_partials(mt32emu_const_context context);
 
+/**
+ * Returns the number of frames that can be rendered before any active partial may become inactive, provided no further
+ * MIDI events are played. This allows to find the end of the sound without rendering one frame at a time while polling
+ * mt32emu_has_active_partials(). Returns 0 when there are no active partials or the events pending in the MIDI queue
+ * may change the set of active partials. When the sample rate conversion is in effect, the result is converted
+ * to the output sample rate and is only approximate.
+ */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_min_remaining_partial_frame_count(mt32emu_const_context context);
+
 /** Returns true if mt32emu_has_active_partials() returns true, or reverb is (somewhat unreliably) detected as being active. */
 MT32EMU_EXPORT mt32emu_boolean mt32emu_is_active(mt32emu_const_context context);
 
+/**
+ * Fills in the statistics of time spent in the stages of the rendering pipeline. Returns false when the synth is not open
+ * or the library is built without MT32EMU_WITH_RENDER_STATISTICS, and the statistics are zeroed out in this case,
+ * except for the degradation fields, which are filled in whenever the synth is open.
+ * The statistics are updated by the rendering thread without synchronisation, so the values may be slightly inconsistent
+ * when read concurrently with rendering.
+ * Note, when sample rate conversion is in effect, the time spent in the converter itself is not accounted for.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_get_render_statistics(mt32emu_const_context context, mt32emu_render_statistics *statistics);
+/**
+ * Fills in the cost of generating the partials per part and per kind of partial, which tells the expensive channels
+ * and timbres apart. Returns false and zeroes out the statistics when the synth is not open or the library is built
+ * without MT32EMU_WITH_RENDER_STATISTICS. Like the render statistics, these are read without synchronisation.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_get_partial_render_statistics(mt32emu_const_context context, mt32emu_partial_render_statistics *statistics);
+/**
+ * Resets all the render statistics, including the partial ones and those of the MIDI event queue, to zero.
+ * Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT void mt32emu_reset_render_statistics(mt32emu_const_context context);
+
 /** Returns the maximum number of partials playing simultaneously. */
 MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_partial_count(mt32emu_const_context context);
 
+/**
+ * Limits the number of partials that new notes may occupy to a value below the partial count set upon opening.
+ * Playing partials in excess of the limit are freed by aborting polys as new notes arrive, following the regular
+ * rules of partial allocation. 0 lifts the limit. The setting is retained across reopening the synth.
+ */
+MT32EMU_EXPORT void mt32emu_set_partial_limit(mt32emu_const_context context, const mt32emu_bit32u partial_limit);
+/** Returns the number of partials available for new notes, equal to the partial count unless a lower limit is set. */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_partial_limit(mt32emu_const_context context);
+
+/**
+ * Sets the number of partials to preallocate upon opening, so that the partial pool can be grown up to this size later
+ * using mt32emu_resize_partial_pool() without reopening the synth. Values below the partial count have no effect.
+ * Takes effect on the next opening, the setting is retained across reopening the synth. 0 disables preallocation.
+ */
+MT32EMU_EXPORT void mt32emu_set_max_partial_count(mt32emu_const_context context, const mt32emu_bit32u max_partial_count);
+/** Returns the number of partials the pool can grow up to. While the synth is closed, this is the value expected upon opening. */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_max_partial_count(mt32emu_const_context context);
+/**
+ * Changes the partial count of the open synth in range [1..mt32emu_get_max_partial_count()], preserving the emulation state.
+ * The added partials become available to new notes immediately. When shrinking, the playing partials in excess of the new count
+ * are not stopped, yet they leave the pool as soon as they finish. Must be synchronised with the rendering thread.
+ * Returns false if the synth is not open or the count is out of range.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_resize_partial_pool(mt32emu_const_context context, const mt32emu_bit32u new_partial_count);
+
+/**
+ * Enables placing the memory touched while rendering in blocks obtained directly from the OS, which are faulted in upon
+ * opening and locked into RAM, so that rendering never page-faults on them. The blocks spanning a huge page or more
+ * are backed by huge pages where available. This covers the partials, the renderer buffers, the reverb models and
+ * the decoded PCM ROM samples. Locking is subject to RLIMIT_MEMLOCK on POSIX systems and to the working set size on Windows.
+ * Takes effect on the next opening, the setting is retained across reopening the synth.
+ */
+MT32EMU_EXPORT void mt32emu_set_hot_memory_locking_enabled(mt32emu_const_context context, const mt32emu_boolean enabled);
+MT32EMU_EXPORT mt32emu_boolean mt32emu_is_hot_memory_locking_enabled(mt32emu_const_context context);
+/**
+ * Returns true if the synth is open with hot memory locking enabled and the OS has locked all of it. Otherwise,
+ * the memory is still faulted in upon opening, yet it may be paged out later.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_is_hot_memory_locked(mt32emu_const_context context);
+
 /**
  * Returns current states of all the parts as a bit set. The least significant bit corresponds to the state of part 1,
  * total of 9 bits hold the states of all the parts. If the returned bit for a part is set, there is at least one active
@@ -474,6 +841,156 @@ MT32EMU_EXPORT const char *mt32emu_get_patch_name(mt32emu_const_context context,
 /** Stores internal state of emulated synth into an array provided (as it would be acquired from hardware). */
 MT32EMU_EXPORT void mt32emu_read_memory(mt32emu_const_context context, mt32emu_bit32u addr, mt32emu_bit32u len, mt32emu_bit8u *data);
 
+/**
+ * Decompresses the control ROM timbres with the absolute numbers given (0-255) into the timbre memory ahead of their
+ * first reference, which would do that otherwise, e.g. upon a program change. Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT void mt32emu_prefetch_timbres(mt32emu_const_context context, mt32emu_bit32u first_timbre_num, mt32emu_bit32u timbre_count);
+
+/**
+ * Loads a bank of complete SysEx messages (e.g. the contents of a .syx file) directly into the synth memory,
+ * bypassing the MIDI queue and the MIDI delay emulation. The affected parts, timbres and system settings are refreshed
+ * once after the whole bank is written. Returns the number of messages processed.
+ * Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_load_sysex_bank(mt32emu_context context, const mt32emu_bit8u *data, mt32emu_bit32u len);
+/**
+ * Same as mt32emu_load_sysex_bank() but reads the bank from the file specified.
+ * Returns MT32EMU_RC_OK on success, MT32EMU_RC_NOT_OPENED if the synth is not open, or a file error code.
+ */
+MT32EMU_EXPORT mt32emu_return_code mt32emu_load_sysex_bank_file(mt32emu_context context, const char *filename);
+/**
+ * Writes a block of the synth memory at the address given in the same form as for mt32emu_read_memory(),
+ * bypassing the MIDI queue. The affected state is refreshed once. Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT void mt32emu_write_memory(mt32emu_context context, mt32emu_bit32u addr, mt32emu_bit32u len, const mt32emu_bit8u *data);
+
+/**
+ * Saves a snapshot of the complete emulation state to the buffer provided. Returns the size of the state in bytes,
+ * or 0 if the synth is not open. If the buffer is NULL or too small, nothing is written, so that the required size
+ * can be found out in advance. The state of the sample rate converter and the MIDI stream parser of the context
+ * is not included. Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT size_t mt32emu_save_state(mt32emu_context context, mt32emu_bit8u *buffer, size_t buffer_size);
+
+/**
+ * Restores the emulation state previously saved by mt32emu_save_state(). The synth must be open with the same ROMs,
+ * renderer type, partial count, analog output mode and reverb pipeline setting, otherwise MT32EMU_BOOL_FALSE is returned
+ * and the synth is left intact. MT32EMU_BOOL_FALSE is also returned when the state is corrupted, and the synth may be
+ * reset in this case. Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_restore_state(mt32emu_context context, const mt32emu_bit8u *state, size_t state_size);
+
+/**
+ * Saves the emulation state as a delta against a base state saved by mt32emu_save_state() earlier. Only the parts
+ * of the state that differ from the base are stored, so frequent checkpoints sharing a base take little memory.
+ * Returns the size of the delta in bytes, or 0 if the synth is not open or the base state is invalid.
+ * The buffer is handled as in mt32emu_save_state(). Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT size_t mt32emu_save_state_delta(mt32emu_context context, const mt32emu_bit8u *base_state, size_t base_state_size, mt32emu_bit8u *buffer, size_t buffer_size);
+
+/**
+ * Restores the emulation state from a delta saved by mt32emu_save_state_delta() against the same base state,
+ * otherwise MT32EMU_BOOL_FALSE is returned. Apart from that, behaves as mt32emu_restore_state().
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_restore_state_delta(mt32emu_context context, const mt32emu_bit8u *base_state, size_t base_state_size, const mt32emu_bit8u *delta, size_t delta_size);
+
+/**
+ * Quickly brings the emulation back to the state captured right after opening the synth, as though it was reopened,
+ * dropping the pending MIDI events and silencing any notes and reverb tail at once. The runtime settings are retained,
+ * while the rendered sample count starts over from 0.
+ * Returns MT32EMU_BOOL_FALSE if the synth is not open or has been reconfigured since (e.g. the partial pool has been resized).
+ * Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_reset_to_open_state(mt32emu_context context);
+
+/**
+ * Starts recording the rendering session to a compact binary file, which mt32emu-bench can replay to measure the rendering
+ * performance under a production workload. The recording comprises the configuration of the synth, the emulation state
+ * upon starting, the played MIDI events with timestamps and the rendering calls in order. The timestamps and lengths
+ * are in samples at the synth's internal sample rate, the sample rate conversion is not recorded.
+ * Returns MT32EMU_BOOL_FALSE if the synth is not open or the file cannot be created. The recording is stopped when
+ * the synth is closed. Must be synchronised with the rendering thread.
+ */
+MT32EMU_EXPORT mt32emu_boolean mt32emu_start_session_recording(mt32emu_context context, const char *filename);
+
+/** Stops recording the rendering session and closes the file. Must be synchronised with the rendering thread. */
+MT32EMU_EXPORT void mt32emu_stop_session_recording(mt32emu_context context);
+
+/* == Engine functions == */
+
+/*
+ * An engine owns a number of emulation contexts, one per emulated unit, and renders all of them with a single call
+ * using a pool of worker threads. The units are assigned to the threads in a fixed manner, so the output doesn't depend
+ * on scheduling. The ROMs are loaded once per engine, and the data decoded from them as well as the resampler kernels
+ * are shared by the units. The contexts are configured and receive MIDI data via the usual context-dependent functions,
+ * although they must not be opened, closed, rendered or freed on their own.
+ */
+
+/**
+ * Creates an engine with unit_count emulation contexts, which are rendered using up to thread_count threads including
+ * the calling thread. The thread count is clamped to the number of units, and 0 or 1 means that the units are rendered
+ * serially (the same applies when the library is built without multithreading support). The report handler is installed
+ * in each context if non-NULL, the instance data for unit i is taken from instance_data[i], or NULL if instance_data is NULL.
+ * Returns NULL if unit_count is 0.
+ */
+MT32EMU_EXPORT mt32emu_engine mt32emu_create_engine(const mt32emu_bit32u unit_count, const mt32emu_bit32u thread_count, mt32emu_report_handler_i report_handler, void * const *instance_data);
+
+/** Closes and destroys the engine along with all the contexts it owns. */
+MT32EMU_EXPORT void mt32emu_free_engine(mt32emu_engine engine);
+
+/** Returns the number of units the engine has been created with. */
+MT32EMU_EXPORT mt32emu_bit32u mt32emu_get_engine_unit_count(mt32emu_const_engine engine);
+
+/** Returns the emulation context of the specified unit, or NULL if the unit number is out of range. */
+MT32EMU_EXPORT mt32emu_context mt32emu_get_engine_context(mt32emu_const_engine engine, const mt32emu_bit32u unit);
+
+/**
+ * Same as mt32emu_add_rom_data() but adds the ROM to the engine. The ROMs of the engine are used to open all the units.
+ */
+MT32EMU_EXPORT mt32emu_return_code mt32emu_add_engine_rom_data(mt32emu_engine engine, const mt32emu_bit8u *data, size_t data_size, const mt32emu_sha1_digest *sha1_digest);
+
+/**
+ * Same as mt32emu_add_rom_file() but adds the ROM to the engine. The ROMs of the engine are used to open all the units.
+ */
+MT32EMU_EXPORT mt32emu_return_code mt32emu_add_engine_rom_file(mt32emu_engine engine, const char *filename);
+
+/**
+ * Opens the synths of all units with the ROMs added to the engine, using the configuration of each context.
+ * If any unit fails to open, the units opened so far are closed and the error code is returned.
+ * Returns MT32EMU_RC_OK upon success.
+ */
+MT32EMU_EXPORT mt32emu_return_code mt32emu_open_engine(mt32emu_const_engine engine);
+
+/** Closes the synths of all units. */
+MT32EMU_EXPORT void mt32emu_close_engine(mt32emu_const_engine engine);
+
+/**
+ * Renders len frames of each unit concurrently, the output of unit i is stored in streams[i] the same way as
+ * mt32emu_render_bit16s() does. Returns once all the units are rendered. The units must be open.
+ */
+MT32EMU_EXPORT void mt32emu_render_engine_bit16s(mt32emu_const_engine engine, mt32emu_bit16s * const *streams, mt32emu_bit32u len);
+/** Same as mt32emu_render_engine_bit16s() but outputs float samples like mt32emu_render_float() does. */
+MT32EMU_EXPORT void mt32emu_render_engine_float(mt32emu_const_engine engine, float * const *streams, mt32emu_bit32u len);
+
+/**
+ * Renders len frames of the unit_count units listed in the units array concurrently, the output of unit units[i] is stored
+ * in streams[i] as in mt32emu_render_engine_bit16s(). The other units are left intact, so that the units can progress
+ * independently, e.g. when each serves a different client. Each unit must be listed once at most. The units must be open.
+ */
+MT32EMU_EXPORT void mt32emu_render_engine_units_bit16s(mt32emu_const_engine engine, const mt32emu_bit32u *units, mt32emu_bit32u unit_count, mt32emu_bit16s * const *streams, mt32emu_bit32u len);
+/** Same as mt32emu_render_engine_units_bit16s() but outputs float samples like mt32emu_render_float() does. */
+MT32EMU_EXPORT void mt32emu_render_engine_units_float(mt32emu_const_engine engine, const mt32emu_bit32u *units, mt32emu_bit32u unit_count, float * const *streams, mt32emu_bit32u len);
+
+/**
+ * Renders len frames of each unit concurrently and stores the sum of their outputs in the stream, with clipping applied
+ * to 16-bit samples. The sum is always accumulated in the order of units, so the result is reproducible. The units
+ * are expected to have the same actual output sample rate. The units must be open.
+ */
+MT32EMU_EXPORT void mt32emu_mix_engine_bit16s(mt32emu_const_engine engine, mt32emu_bit16s *stream, mt32emu_bit32u len);
+/** Same as mt32emu_mix_engine_bit16s() but outputs float samples, which are not clipped. */
+MT32EMU_EXPORT void mt32emu_mix_engine_float(mt32emu_const_engine engine, float *stream, mt32emu_bit32u len);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
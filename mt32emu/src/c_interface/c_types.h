@@ -62,6 +62,10 @@ typedef enum {
 typedef struct mt32emu_data *mt32emu_context;
 typedef const struct mt32emu_data *mt32emu_const_context;
 
+/** Rendering engine that owns several emulation contexts and renders them concurrently */
+typedef struct mt32emu_engine_data *mt32emu_engine;
+typedef const struct mt32emu_engine_data *mt32emu_const_engine;
+
 /* Convenience aliases */
 #ifndef __cplusplus
 typedef enum mt32emu_analog_output_mode mt32emu_analog_output_mode;
@@ -70,6 +74,9 @@ typedef enum mt32emu_midi_delay_mode mt32emu_midi_delay_mode;
 typedef enum mt32emu_partial_state mt32emu_partial_state;
 typedef enum mt32emu_samplerate_conversion_quality mt32emu_samplerate_conversion_quality;
 typedef enum mt32emu_renderer_type mt32emu_renderer_type;
+typedef enum mt32emu_simd_instruction_set mt32emu_simd_instruction_set;
+typedef enum mt32emu_float_wave_accuracy mt32emu_float_wave_accuracy;
+typedef enum mt32emu_degradation_level mt32emu_degradation_level;
 #endif
 
 /** Contains identifiers and descriptions of ROM files being used. */
@@ -102,6 +109,150 @@ typedef struct {
 	float *reverbWetRight;
 } mt32emu_dac_output_float_streams;
 
+/**
+ * Layout of the stereo output in caller-provided 16-bit buffers. The samples of each channel are stored starting
+ * at the respective pointer, which is advanced by stride samples per frame. Thus, stride 2 with right = left + 1
+ * describes an interleaved stereo buffer, stride 1 describes a pair of planar buffers. If accumulate is not
+ * MT32EMU_BOOL_FALSE, the output is multiplied by gain and added to the samples in the buffers with clipping, which allows
+ * mixing several contexts into a shared bus directly. Otherwise, the buffers are overwritten and gain is ignored.
+ */
+typedef struct {
+	mt32emu_bit16s *left;
+	mt32emu_bit16s *right;
+	mt32emu_bit32u stride;
+	mt32emu_boolean accumulate;
+	float gain;
+} mt32emu_stereo_output_bit16s;
+
+/** Same as mt32emu_stereo_output_bit16s but describes float buffers. The accumulated samples are not clipped. */
+typedef struct {
+	float *left;
+	float *right;
+	mt32emu_bit32u stride;
+	mt32emu_boolean accumulate;
+	float gain;
+} mt32emu_stereo_output_float;
+
+/**
+ * Cumulative time spent in the stages of the rendering pipeline since the synth was opened or the statistics were reset.
+ * The times are measured in seconds only when the library is built with MT32EMU_WITH_RENDER_STATISTICS.
+ */
+typedef struct {
+	/** Number of samples rendered at the native sample rate 32000 Hz. */
+	mt32emu_bit32u renderedSampleCount;
+	/** Number of MIDI events played from the MIDI event queue. */
+	mt32emu_bit32u midiEventCount;
+	/** Total time spent rendering, including all the stages below. */
+	double totalTime;
+	/** Time spent generating and mixing the output of the LA32 partials. */
+	double la32Time;
+	/** Time spent in the reverb model. */
+	double reverbTime;
+	/** Time spent in the analog circuitry emulation. */
+	double analogTime;
+	/** Time spent converting samples between the integer and the float format. */
+	double sampleFormatConversionTime;
+	/** Time spent playing MIDI events from the MIDI event queue. */
+	double midiEventDispatchTime;
+	/** The degradation level in effect when the statistics are retrieved, see mt32emu_degradation_level. */
+	mt32emu_bit32u degradationLevel;
+	/** Number of times the degradation level has been changed. */
+	mt32emu_bit32u degradationLevelChangeCount;
+	/** Number of samples rendered with any degradation in effect. */
+	mt32emu_bit32u degradedSampleCount;
+} mt32emu_render_statistics;
+
+/**
+ * Cumulative cost of generating the output of the LA32 partials, attributed to the parts owning the partials
+ * and to the kinds of the partials. A partial that ring modulates its slave is accounted once along with the slave.
+ * The times are measured in seconds only when the library is built with MT32EMU_WITH_RENDER_STATISTICS.
+ */
+typedef struct {
+	/** Number of samples the partials of each part were rendered for, indexed by the part number, the rhythm part goes last. */
+	mt32emu_bit32u partSampleCount[9];
+	/** Time spent generating the partials of each part. */
+	double partTime[9];
+	/** Partials that generate a square or sawtooth wave on their own. */
+	mt32emu_bit32u synthSampleCount;
+	double synthTime;
+	/** Partials that play a PCM sample on their own. */
+	mt32emu_bit32u pcmSampleCount;
+	double pcmTime;
+	/** Partials that ring modulate their slaves, either kind. */
+	mt32emu_bit32u ringModulatedSampleCount;
+	double ringModulatedTime;
+} mt32emu_partial_render_statistics;
+
+/**
+ * Telemetry of the MIDI event queue since the queue was created or the statistics were reset. The counters are updated
+ * by the producing and the rendering threads without synchronisation, so the values may be slightly inconsistent
+ * when read concurrently. All the counters wrap around.
+ */
+typedef struct {
+	/** The maximum number of events pending in the queue, as seen by the rendering thread upon processing an event. */
+	mt32emu_bit32u eventCountHighWaterMark;
+	/** Number of events refused because the queue was full, including the retries requested by onMIDIQueueOverflow. */
+	mt32emu_bit32u overflowEventCount;
+	/** Number of SysEx events refused because the preallocated SysEx storage buffer had no room for the data. */
+	mt32emu_bit32u sysexStorageOverflowCount;
+	/** Bytes of the preallocated SysEx storage buffer occupied by the pending SysEx events. Zero with the buffers allocated on demand. */
+	mt32emu_bit32u sysexStorageUsage;
+	/** The maximum number of bytes of the preallocated SysEx storage buffer occupied so far. */
+	mt32emu_bit32u sysexStorageHighWaterMark;
+	/**
+	 * Number of events played later than their timestamps, measured from the grid point with a MIDI event timing quantum set.
+	 * The events held up until partials are freed don't count.
+	 */
+	mt32emu_bit32u lateEventCount;
+	/**
+	 * Element i counts the late events played late by at least 2^i samples but less than 2^(i+1) samples at 32000 Hz.
+	 * The last one counts all the events late by 2^15 samples or more.
+	 */
+	mt32emu_bit32u latenessHistogram[16];
+} mt32emu_midi_event_queue_statistics;
+
+/**
+ * Breakdown of the memory in bytes allocated by a synth instance by subsystem, see mt32emu_get_memory_usage().
+ * The subsystems that are only created upon opening report zero while the synth is closed.
+ */
+typedef struct {
+	/** The decoded PCM ROM samples and the wave list, shared by the synths open with the same ROM pair. Not in the total. */
+	size_t sharedPCMROM;
+	/** The PCM ROM samples memory-mapped from the cache file instead. Not included in the total. */
+	size_t mappedPCMROM;
+	/** The emulated memory of the device along with the memory regions that provide access to it. */
+	size_t memoryRegions;
+	/** The partial manager with the partials, their components and the polys, as well as the parts. */
+	size_t partials;
+	/** The ring buffer of the MIDI event queue along with the preallocated SysEx storage buffer. */
+	size_t midiEventQueue;
+	/** The SysEx data buffers the MIDI event queue allocates on demand, if the storage buffer isn't preallocated. */
+	size_t sysexBuffers;
+	/** The reverb models for the modes room, hall, plate and tap delay, including their buffers. The models not created so far report zero. */
+	size_t reverbModels[4];
+	/** The analog circuitry emulation including the LPFs. */
+	size_t analog;
+	/** The renderer with its temporary buffers, including those for rendering the partials and the reverb concurrently. */
+	size_t renderer;
+	/** The sample rate converter of the context, apart from the internal state of libsoxr and libsamplerate. */
+	size_t sampleRateConverter;
+	/** The synth object itself and the rest of the data it keeps, e.g. the snapshot of the state upon opening. */
+	size_t synth;
+	/** The sum of all the above except for the PCM ROM. */
+	size_t total;
+} mt32emu_memory_usage;
+
+/** Describes a single MIDI event to be enqueued along with others using mt32emu_play_events(). */
+typedef struct {
+	/** The time to play the event at, measured the same way as with mt32emu_play_msg_at(). */
+	mt32emu_bit32u timestamp;
+	/** A short MIDI message containing a status byte. Ignored when sysexData is not NULL. */
+	mt32emu_bit32u shortMessage;
+	/** A well formed System Exclusive MIDI message or NULL if the event represents a short MIDI message. */
+	const mt32emu_bit8u *sysexData;
+	mt32emu_bit32u sysexLength;
+} mt32emu_midi_event;
+
 /* === Interface handling === */
 
 /** Report handler interface versions */
@@ -116,13 +267,20 @@ typedef enum {
 	MT32EMU_MIDI_RECEIVER_VERSION_CURRENT = MT32EMU_MIDI_RECEIVER_VERSION_0
 } mt32emu_midi_receiver_version;
 
+/** Executor interface versions */
+typedef enum {
+	MT32EMU_EXECUTOR_VERSION_0 = 0,
+	MT32EMU_EXECUTOR_VERSION_CURRENT = MT32EMU_EXECUTOR_VERSION_0
+} mt32emu_executor_version;
+
 /** Synth interface versions */
 typedef enum {
 	MT32EMU_SERVICE_VERSION_0 = 0,
 	MT32EMU_SERVICE_VERSION_1 = 1,
 	MT32EMU_SERVICE_VERSION_2 = 2,
 	MT32EMU_SERVICE_VERSION_3 = 3,
-	MT32EMU_SERVICE_VERSION_CURRENT = MT32EMU_SERVICE_VERSION_3
+	MT32EMU_SERVICE_VERSION_4 = 4,
+	MT32EMU_SERVICE_VERSION_CURRENT = MT32EMU_SERVICE_VERSION_4
 } mt32emu_service_version;
 
 /* === Report Handler Interface === */
@@ -175,6 +333,32 @@ union mt32emu_report_handler_i {
 	const mt32emu_report_handler_i_v0 *v0;
 };
 
+/* === Executor Interface === */
+
+typedef union mt32emu_executor_i mt32emu_executor_i;
+
+/** Interface for running the parallel work of the library in the threads of the host application (initial version) */
+typedef struct {
+	/** Returns the actual interface version ID */
+	mt32emu_executor_version (*getVersionID)(mt32emu_executor_i i);
+
+	/**
+	 * Arranges proc(context) to be run in a thread of the host. The procedure must eventually run without waiting
+	 * for the submitting thread. Returns MT32EMU_BOOL_FALSE if the procedure cannot be accepted,
+	 * in which case the library runs it in the submitting thread instead.
+	 */
+	mt32emu_boolean (*execute)(void *instance_data, void (*proc)(void *context), void *context);
+} mt32emu_executor_i_v0;
+
+/**
+ * Extensible interface for running the parallel work of the library.
+ * Union intended to view an interface of any subsequent version as any parent interface not requiring a cast.
+ * It is caller's responsibility to check the actual interface version in runtime using the getVersionID() method.
+ */
+union mt32emu_executor_i {
+	const mt32emu_executor_i_v0 *v0;
+};
+
 /* === MIDI Receiver Interface === */
 
 typedef union mt32emu_midi_receiver_i mt32emu_midi_receiver_i;
@@ -312,6 +496,95 @@ typedef union mt32emu_service_i mt32emu_service_i;
 	void (*preallocateReverbMemory)(mt32emu_const_context context, const mt32emu_boolean enabled); \
 	void (*configureMIDIEventQueueSysexStorage)(mt32emu_const_context context, const mt32emu_bit32u storage_buffer_size);
 
+#define MT32EMU_SERVICE_I_V4 \
+	void (*setPartialRenderingThreadCount)(mt32emu_context context, const mt32emu_bit32u thread_count); \
+	mt32emu_bit32u (*getPartialRenderingThreadCount)(mt32emu_const_context context); \
+	void (*setMIDIEventTimingQuantum)(mt32emu_const_context context, const mt32emu_bit32u quantum); \
+	mt32emu_bit32u (*getMIDIEventTimingQuantum)(mt32emu_const_context context); \
+	mt32emu_bit32u (*getMaxMIDIEventTimingError)(mt32emu_const_context context); \
+	mt32emu_boolean (*getRenderStatistics)(mt32emu_const_context context, mt32emu_render_statistics *statistics); \
+	void (*resetRenderStatistics)(mt32emu_const_context context); \
+	void (*configureMIDIEventQueueMultiProducer)(mt32emu_const_context context, const mt32emu_boolean enabled); \
+	mt32emu_boolean (*isMIDIEventQueueMultiProducer)(mt32emu_const_context context); \
+	mt32emu_bit32u (*playEvents)(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u count); \
+	void (*setReverbSilenceThreshold)(mt32emu_const_context context, const float threshold); \
+	float (*getReverbSilenceThreshold)(mt32emu_const_context context); \
+	void (*setReverbPipelineEnabled)(mt32emu_context context, const mt32emu_boolean enabled); \
+	mt32emu_boolean (*isReverbPipelineEnabled)(mt32emu_const_context context); \
+	mt32emu_bit32u (*getReverbPipelineLatency)(mt32emu_const_context context); \
+	mt32emu_simd_instruction_set (*getSupportedSIMDInstructionSet)(void); \
+	mt32emu_simd_instruction_set (*getSIMDInstructionSet)(void); \
+	mt32emu_boolean (*forceSIMDInstructionSet)(const mt32emu_simd_instruction_set instruction_set); \
+	void (*setROMCacheDirectory)(mt32emu_context context, const char *cache_directory); \
+	const char *(*getROMCacheDirectory)(mt32emu_const_context context); \
+	size_t (*saveState)(mt32emu_context context, mt32emu_bit8u *buffer, size_t buffer_size); \
+	mt32emu_boolean (*restoreState)(mt32emu_context context, const mt32emu_bit8u *state, size_t state_size); \
+	mt32emu_engine (*createEngine)(const mt32emu_bit32u unit_count, const mt32emu_bit32u thread_count, mt32emu_report_handler_i report_handler, void * const *instance_data); \
+	void (*freeEngine)(mt32emu_engine engine); \
+	mt32emu_bit32u (*getEngineUnitCount)(mt32emu_const_engine engine); \
+	mt32emu_context (*getEngineContext)(mt32emu_const_engine engine, const mt32emu_bit32u unit); \
+	mt32emu_return_code (*addEngineROMData)(mt32emu_engine engine, const mt32emu_bit8u *data, size_t data_size, const mt32emu_sha1_digest *sha1_digest); \
+	mt32emu_return_code (*addEngineROMFile)(mt32emu_engine engine, const char *filename); \
+	mt32emu_return_code (*openEngine)(mt32emu_const_engine engine); \
+	void (*closeEngine)(mt32emu_const_engine engine); \
+	void (*renderEngineBit16s)(mt32emu_const_engine engine, mt32emu_bit16s * const *streams, mt32emu_bit32u len); \
+	void (*renderEngineFloat)(mt32emu_const_engine engine, float * const *streams, mt32emu_bit32u len); \
+	void (*mixEngineBit16s)(mt32emu_const_engine engine, mt32emu_bit16s *stream, mt32emu_bit32u len); \
+	void (*mixEngineFloat)(mt32emu_const_engine engine, float *stream, mt32emu_bit32u len); \
+	void (*renderBit16sOutput)(mt32emu_const_context context, const mt32emu_stereo_output_bit16s *output, mt32emu_bit32u len); \
+	void (*renderFloatOutput)(mt32emu_const_context context, const mt32emu_stereo_output_float *output, mt32emu_bit32u len); \
+	void (*setMaxRenderBlockLength)(mt32emu_context context, const mt32emu_bit32u length); \
+	mt32emu_bit32u (*getMaxRenderBlockLength)(mt32emu_const_context context); \
+	size_t (*getAllocatedMemorySize)(mt32emu_const_context context); \
+	void (*prepareReverbModel)(mt32emu_const_context context, const mt32emu_bit8u mode); \
+	void (*setFloatWaveAccuracy)(mt32emu_const_context context, const mt32emu_float_wave_accuracy accuracy); \
+	mt32emu_float_wave_accuracy (*getFloatWaveAccuracy)(mt32emu_const_context context); \
+	void (*setPartialLimit)(mt32emu_const_context context, const mt32emu_bit32u partial_limit); \
+	mt32emu_bit32u (*getPartialLimit)(mt32emu_const_context context); \
+	void (*setMaxPartialCount)(mt32emu_const_context context, const mt32emu_bit32u max_partial_count); \
+	mt32emu_bit32u (*getMaxPartialCount)(mt32emu_const_context context); \
+	mt32emu_boolean (*resizePartialPool)(mt32emu_const_context context, const mt32emu_bit32u new_partial_count); \
+	void (*setDegradationLevel)(mt32emu_const_context context, const mt32emu_degradation_level level); \
+	mt32emu_degradation_level (*getDegradationLevel)(mt32emu_const_context context); \
+	void (*setPartialCullingLevel)(mt32emu_const_context context, const mt32emu_bit8u level); \
+	mt32emu_bit8u (*getPartialCullingLevel)(mt32emu_const_context context); \
+	mt32emu_bit32u (*getMIDIEventQueueFreeCapacity)(mt32emu_const_context context); \
+	mt32emu_boolean (*waitForMIDIEventQueueFreeCapacity)(mt32emu_const_context context, const mt32emu_bit32u event_count, const mt32emu_bit32u timeout_millis); \
+	mt32emu_bit32u (*renderBit16sWithEvents)(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, mt32emu_bit16s *stream, mt32emu_bit32u len); \
+	mt32emu_bit32u (*renderFloatWithEvents)(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, float *stream, mt32emu_bit32u len); \
+	void (*setDenormalFlushingEnabled)(mt32emu_const_context context, const mt32emu_boolean enabled); \
+	mt32emu_boolean (*isDenormalFlushingEnabled)(mt32emu_const_context context); \
+	mt32emu_bit32u (*loadSysexBank)(mt32emu_context context, const mt32emu_bit8u *data, mt32emu_bit32u len); \
+	mt32emu_return_code (*loadSysexBankFile)(mt32emu_context context, const char *filename); \
+	void (*writeMemory)(mt32emu_context context, mt32emu_bit32u addr, mt32emu_bit32u len, const mt32emu_bit8u *data); \
+	mt32emu_boolean (*resetToOpenState)(mt32emu_context context); \
+	size_t (*saveStateDelta)(mt32emu_context context, const mt32emu_bit8u *base_state, size_t base_state_size, mt32emu_bit8u *buffer, size_t buffer_size); \
+	mt32emu_boolean (*restoreStateDelta)(mt32emu_context context, const mt32emu_bit8u *base_state, size_t base_state_size, const mt32emu_bit8u *delta, size_t delta_size); \
+	mt32emu_boolean (*startSessionRecording)(mt32emu_context context, const char *filename); \
+	void (*stopSessionRecording)(mt32emu_context context); \
+	mt32emu_bit32u (*getMinRemainingPartialFrameCount)(mt32emu_const_context context); \
+	mt32emu_return_code (*startOpeningSynth)(mt32emu_const_context context); \
+	mt32emu_bit32u (*getOpenProgress)(mt32emu_const_context context); \
+	mt32emu_boolean (*isOpening)(mt32emu_const_context context); \
+	void (*cancelOpening)(mt32emu_const_context context); \
+	mt32emu_return_code (*finishOpeningSynth)(mt32emu_const_context context); \
+	mt32emu_executor_version (*getSupportedExecutorVersionID)(void); \
+	void (*setExecutor)(mt32emu_executor_i executor, void *instance_data); \
+	void (*prefetchTimbres)(mt32emu_const_context context, mt32emu_bit32u first_timbre_num, mt32emu_bit32u timbre_count); \
+	mt32emu_boolean (*getPartialRenderStatistics)(mt32emu_const_context context, mt32emu_partial_render_statistics *statistics); \
+	void (*getMemoryUsage)(mt32emu_const_context context, mt32emu_memory_usage *usage); \
+	mt32emu_boolean (*getMIDIEventQueueStatistics)(mt32emu_const_context context, mt32emu_midi_event_queue_statistics *statistics); \
+	void (*renderEngineUnitsBit16s)(mt32emu_const_engine engine, const mt32emu_bit32u *units, mt32emu_bit32u unit_count, mt32emu_bit16s * const *streams, mt32emu_bit32u len); \
+	void (*renderEngineUnitsFloat)(mt32emu_const_engine engine, const mt32emu_bit32u *units, mt32emu_bit32u unit_count, float * const *streams, mt32emu_bit32u len); \
+	void (*setHotMemoryLockingEnabled)(mt32emu_const_context context, const mt32emu_boolean enabled); \
+	mt32emu_boolean (*isHotMemoryLockingEnabled)(mt32emu_const_context context); \
+	mt32emu_boolean (*isHotMemoryLocked)(mt32emu_const_context context); \
+	void (*configureMIDIEventQueueCoalescing)(mt32emu_const_context context, const mt32emu_bit32u window); \
+	mt32emu_bit32u (*getMIDIEventQueueCoalescingWindow)(mt32emu_const_context context); \
+	mt32emu_bit32u (*renderBit16sOutputWithEvents)(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, const mt32emu_stereo_output_bit16s *output, mt32emu_bit32u len); \
+	mt32emu_bit32u (*renderFloatOutputWithEvents)(mt32emu_const_context context, const mt32emu_midi_event *events, const mt32emu_bit32u event_count, const mt32emu_stereo_output_float *output, mt32emu_bit32u len); \
+	mt32emu_boolean (*isDACStreamsConversionSupported)(void);
+
 typedef struct {
 	MT32EMU_SERVICE_I_V0
 } mt32emu_service_i_v0;
@@ -334,6 +607,14 @@ typedef struct {
 	MT32EMU_SERVICE_I_V3
 } mt32emu_service_i_v3;
 
+typedef struct {
+	MT32EMU_SERVICE_I_V0
+	MT32EMU_SERVICE_I_V1
+	MT32EMU_SERVICE_I_V2
+	MT32EMU_SERVICE_I_V3
+	MT32EMU_SERVICE_I_V4
+} mt32emu_service_i_v4;
+
 /**
  * Extensible interface for all the library services.
  * Union intended to view an interface of any subsequent version as any parent interface not requiring a cast.
@@ -344,11 +625,13 @@ union mt32emu_service_i {
 	const mt32emu_service_i_v1 *v1;
 	const mt32emu_service_i_v2 *v2;
 	const mt32emu_service_i_v3 *v3;
+	const mt32emu_service_i_v4 *v4;
 };
 
 #undef MT32EMU_SERVICE_I_V0
 #undef MT32EMU_SERVICE_I_V1
 #undef MT32EMU_SERVICE_I_V2
 #undef MT32EMU_SERVICE_I_V3
+#undef MT32EMU_SERVICE_I_V4
 
 #endif /* #ifndef MT32EMU_C_TYPES_H */
@@ -41,6 +41,12 @@ mt32emu_service_i mt32emu_get_service_i();
 #define mt32emu_get_library_version_string i.v0->getLibraryVersionString
 #define mt32emu_get_stereo_output_samplerate i.v0->getStereoOutputSamplerate
 #define mt32emu_get_best_analog_output_mode iV1()->getBestAnalogOutputMode
+#define mt32emu_is_dac_streams_conversion_supported iV4()->isDACStreamsConversionSupported
+#define mt32emu_get_supported_simd_instruction_set iV4()->getSupportedSIMDInstructionSet
+#define mt32emu_get_simd_instruction_set iV4()->getSIMDInstructionSet
+#define mt32emu_force_simd_instruction_set iV4()->forceSIMDInstructionSet
+#define mt32emu_get_supported_executor_version iV4()->getSupportedExecutorVersionID
+#define mt32emu_set_executor iV4()->setExecutor
 #define mt32emu_create_context i.v0->createContext
 #define mt32emu_free_context i.v0->freeContext
 #define mt32emu_add_rom_data i.v0->addROMData
@@ -52,6 +58,67 @@ mt32emu_service_i mt32emu_get_service_i();
 #define mt32emu_set_samplerate_conversion_quality iV1()->setSamplerateConversionQuality
 #define mt32emu_select_renderer_type iV1()->selectRendererType
 #define mt32emu_get_selected_renderer_type iV1()->getSelectedRendererType
+#define mt32emu_set_partial_rendering_thread_count iV4()->setPartialRenderingThreadCount
+#define mt32emu_get_partial_rendering_thread_count iV4()->getPartialRenderingThreadCount
+#define mt32emu_set_reverb_pipeline_enabled iV4()->setReverbPipelineEnabled
+#define mt32emu_is_reverb_pipeline_enabled iV4()->isReverbPipelineEnabled
+#define mt32emu_get_reverb_pipeline_latency iV4()->getReverbPipelineLatency
+#define mt32emu_set_max_render_block_length iV4()->setMaxRenderBlockLength
+#define mt32emu_get_max_render_block_length iV4()->getMaxRenderBlockLength
+#define mt32emu_get_allocated_memory_size iV4()->getAllocatedMemorySize
+#define mt32emu_get_memory_usage iV4()->getMemoryUsage
+#define mt32emu_prepare_reverb_model iV4()->prepareReverbModel
+#define mt32emu_set_float_wave_accuracy iV4()->setFloatWaveAccuracy
+#define mt32emu_get_float_wave_accuracy iV4()->getFloatWaveAccuracy
+#define mt32emu_set_partial_limit iV4()->setPartialLimit
+#define mt32emu_get_partial_limit iV4()->getPartialLimit
+#define mt32emu_set_max_partial_count iV4()->setMaxPartialCount
+#define mt32emu_get_max_partial_count iV4()->getMaxPartialCount
+#define mt32emu_resize_partial_pool iV4()->resizePartialPool
+#define mt32emu_set_degradation_level iV4()->setDegradationLevel
+#define mt32emu_get_degradation_level iV4()->getDegradationLevel
+#define mt32emu_set_partial_culling_level iV4()->setPartialCullingLevel
+#define mt32emu_get_partial_culling_level iV4()->getPartialCullingLevel
+#define mt32emu_set_denormal_flushing_enabled iV4()->setDenormalFlushingEnabled
+#define mt32emu_is_denormal_flushing_enabled iV4()->isDenormalFlushingEnabled
+#define mt32emu_load_sysex_bank iV4()->loadSysexBank
+#define mt32emu_load_sysex_bank_file iV4()->loadSysexBankFile
+#define mt32emu_write_memory iV4()->writeMemory
+#define mt32emu_reset_to_open_state iV4()->resetToOpenState
+#define mt32emu_save_state_delta iV4()->saveStateDelta
+#define mt32emu_restore_state_delta iV4()->restoreStateDelta
+#define mt32emu_start_session_recording iV4()->startSessionRecording
+#define mt32emu_stop_session_recording iV4()->stopSessionRecording
+#define mt32emu_get_min_remaining_partial_frame_count iV4()->getMinRemainingPartialFrameCount
+#define mt32emu_start_opening_synth iV4()->startOpeningSynth
+#define mt32emu_get_open_progress iV4()->getOpenProgress
+#define mt32emu_is_opening iV4()->isOpening
+#define mt32emu_cancel_opening iV4()->cancelOpening
+#define mt32emu_finish_opening_synth iV4()->finishOpeningSynth
+#define mt32emu_prefetch_timbres iV4()->prefetchTimbres
+#define mt32emu_set_rom_cache_directory iV4()->setROMCacheDirectory
+#define mt32emu_get_rom_cache_directory iV4()->getROMCacheDirectory
+#define mt32emu_save_state iV4()->saveState
+#define mt32emu_restore_state iV4()->restoreState
+#define mt32emu_create_engine iV4()->createEngine
+#define mt32emu_free_engine iV4()->freeEngine
+#define mt32emu_get_engine_unit_count iV4()->getEngineUnitCount
+#define mt32emu_get_engine_context iV4()->getEngineContext
+#define mt32emu_add_engine_rom_data iV4()->addEngineROMData
+#define mt32emu_add_engine_rom_file iV4()->addEngineROMFile
+#define mt32emu_open_engine iV4()->openEngine
+#define mt32emu_close_engine iV4()->closeEngine
+#define mt32emu_render_engine_bit16s iV4()->renderEngineBit16s
+#define mt32emu_render_engine_float iV4()->renderEngineFloat
+#define mt32emu_mix_engine_bit16s iV4()->mixEngineBit16s
+#define mt32emu_mix_engine_float iV4()->mixEngineFloat
+#define mt32emu_render_engine_units_bit16s iV4()->renderEngineUnitsBit16s
+#define mt32emu_render_engine_units_float iV4()->renderEngineUnitsFloat
+#define mt32emu_set_hot_memory_locking_enabled iV4()->setHotMemoryLockingEnabled
+#define mt32emu_is_hot_memory_locking_enabled iV4()->isHotMemoryLockingEnabled
+#define mt32emu_is_hot_memory_locked iV4()->isHotMemoryLocked
+#define mt32emu_configure_midi_event_queue_coalescing iV4()->configureMIDIEventQueueCoalescing
+#define mt32emu_get_midi_event_queue_coalescing_window iV4()->getMIDIEventQueueCoalescingWindow
 #define mt32emu_open_synth i.v0->openSynth
 #define mt32emu_close_synth i.v0->closeSynth
 #define mt32emu_is_open i.v0->isOpen
@@ -61,6 +128,11 @@ mt32emu_service_i mt32emu_get_service_i();
 #define mt32emu_flush_midi_queue i.v0->flushMIDIQueue
 #define mt32emu_set_midi_event_queue_size i.v0->setMIDIEventQueueSize
 #define mt32emu_configure_midi_event_queue_sysex_storage iV3()->configureMIDIEventQueueSysexStorage
+#define mt32emu_configure_midi_event_queue_multi_producer iV4()->configureMIDIEventQueueMultiProducer
+#define mt32emu_is_midi_event_queue_multi_producer iV4()->isMIDIEventQueueMultiProducer
+#define mt32emu_get_midi_event_queue_free_capacity iV4()->getMIDIEventQueueFreeCapacity
+#define mt32emu_wait_for_midi_event_queue_free_capacity iV4()->waitForMIDIEventQueueFreeCapacity
+#define mt32emu_get_midi_event_queue_statistics iV4()->getMIDIEventQueueStatistics
 #define mt32emu_set_midi_receiver i.v0->setMIDIReceiver
 #define mt32emu_get_internal_rendered_sample_count iV2()->getInternalRenderedSampleCount
 #define mt32emu_parse_stream i.v0->parseStream
@@ -71,6 +143,7 @@ mt32emu_service_i mt32emu_get_service_i();
 #define mt32emu_play_sysex i.v0->playSysex
 #define mt32emu_play_msg_at i.v0->playMsgAt
 #define mt32emu_play_sysex_at i.v0->playSysexAt
+#define mt32emu_play_events iV4()->playEvents
 #define mt32emu_play_msg_now i.v0->playMsgNow
 #define mt32emu_play_msg_on_part i.v0->playMsgOnPart
 #define mt32emu_play_sysex_now i.v0->playSysexNow
@@ -83,10 +156,15 @@ mt32emu_service_i mt32emu_get_service_i();
 #define mt32emu_is_mt32_reverb_compatibility_mode i.v0->isMT32ReverbCompatibilityMode
 #define mt32emu_is_default_reverb_mt32_compatible i.v0->isDefaultReverbMT32Compatible
 #define mt32emu_preallocate_reverb_memory iV3()->preallocateReverbMemory
+#define mt32emu_set_reverb_silence_threshold iV4()->setReverbSilenceThreshold
+#define mt32emu_get_reverb_silence_threshold iV4()->getReverbSilenceThreshold
 #define mt32emu_set_dac_input_mode i.v0->setDACInputMode
 #define mt32emu_get_dac_input_mode i.v0->getDACInputMode
 #define mt32emu_set_midi_delay_mode i.v0->setMIDIDelayMode
 #define mt32emu_get_midi_delay_mode i.v0->getMIDIDelayMode
+#define mt32emu_set_midi_event_timing_quantum iV4()->setMIDIEventTimingQuantum
+#define mt32emu_get_midi_event_timing_quantum iV4()->getMIDIEventTimingQuantum
+#define mt32emu_get_max_midi_event_timing_error iV4()->getMaxMIDIEventTimingError
 #define mt32emu_set_output_gain i.v0->setOutputGain
 #define mt32emu_get_output_gain i.v0->getOutputGain
 #define mt32emu_set_reverb_output_gain i.v0->setReverbOutputGain
@@ -101,10 +179,19 @@ mt32emu_service_i mt32emu_get_service_i();
 #define mt32emu_is_nice_partial_mixing_enabled iV3()->isNicePartialMixingEnabled
 #define mt32emu_render_bit16s i.v0->renderBit16s
 #define mt32emu_render_float i.v0->renderFloat
+#define mt32emu_render_bit16s_with_events iV4()->renderBit16sWithEvents
+#define mt32emu_render_float_with_events iV4()->renderFloatWithEvents
 #define mt32emu_render_bit16s_streams i.v0->renderBit16sStreams
 #define mt32emu_render_float_streams i.v0->renderFloatStreams
+#define mt32emu_render_bit16s_output iV4()->renderBit16sOutput
+#define mt32emu_render_float_output iV4()->renderFloatOutput
+#define mt32emu_render_bit16s_output_with_events iV4()->renderBit16sOutputWithEvents
+#define mt32emu_render_float_output_with_events iV4()->renderFloatOutputWithEvents
 #define mt32emu_has_active_partials i.v0->hasActivePartials
 #define mt32emu_is_active i.v0->isActive
+#define mt32emu_get_render_statistics iV4()->getRenderStatistics
+#define mt32emu_get_partial_render_statistics iV4()->getPartialRenderStatistics
+#define mt32emu_reset_render_statistics iV4()->resetRenderStatistics
 #define mt32emu_get_partial_count i.v0->getPartialCount
 #define mt32emu_get_part_states i.v0->getPartStates
 #define mt32emu_get_partial_states i.v0->getPartialStates
@@ -123,8 +210,10 @@ namespace MT32Emu {
 namespace CppInterfaceImpl {
 
 static const mt32emu_report_handler_i NULL_REPORT_HANDLER = { NULL };
+static const mt32emu_executor_i NULL_EXECUTOR = { NULL };
 static mt32emu_report_handler_i getReportHandlerThunk();
 static mt32emu_midi_receiver_i getMidiReceiverThunk();
+static mt32emu_executor_i getExecutorThunk();
 
 }
 
@@ -171,6 +260,16 @@ protected:
 	~IMidiReceiver() {}
 };
 
+// Defines the interface for running the parallel work of the library in the threads of the host application.
+// Corresponds to the current version of mt32emu_executor_i interface.
+class IExecutor {
+public:
+	virtual bool execute(void (*proc)(void *), void *context) = 0;
+
+protected:
+	~IExecutor() {}
+};
+
 // Defines all the library services.
 // Corresponds to the current version of mt32emu_service_i interface.
 class Service {
@@ -195,6 +294,32 @@ public:
 
 	Bit32u getStereoOutputSamplerate(const AnalogOutputMode analog_output_mode) { return mt32emu_get_stereo_output_samplerate(static_cast<mt32emu_analog_output_mode>(analog_output_mode)); }
 	AnalogOutputMode getBestAnalogOutputMode(const double target_samplerate) { return static_cast<AnalogOutputMode>(mt32emu_get_best_analog_output_mode(target_samplerate)); }
+	bool isDACStreamsConversionSupported() { return mt32emu_is_dac_streams_conversion_supported() != MT32EMU_BOOL_FALSE; }
+
+	SIMDInstructionSet getSupportedSIMDInstructionSet() { return static_cast<SIMDInstructionSet>(mt32emu_get_supported_simd_instruction_set()); }
+	SIMDInstructionSet getSIMDInstructionSet() { return static_cast<SIMDInstructionSet>(mt32emu_get_simd_instruction_set()); }
+	bool forceSIMDInstructionSet(const SIMDInstructionSet instruction_set) { return mt32emu_force_simd_instruction_set(static_cast<mt32emu_simd_instruction_set>(instruction_set)) != MT32EMU_BOOL_FALSE; }
+
+	mt32emu_executor_version getSupportedExecutorVersionID() { return mt32emu_get_supported_executor_version(); }
+	void setExecutor(mt32emu_executor_i executor = CppInterfaceImpl::NULL_EXECUTOR, void *instance_data = NULL) { mt32emu_set_executor(executor, instance_data); }
+	void setExecutor(IExecutor &executor) { setExecutor(CppInterfaceImpl::getExecutorThunk(), &executor); }
+
+	// Engine methods
+
+	mt32emu_engine createEngine(const Bit32u unit_count, const Bit32u thread_count, mt32emu_report_handler_i report_handler = CppInterfaceImpl::NULL_REPORT_HANDLER, void * const *instance_data = NULL) { return mt32emu_create_engine(unit_count, thread_count, report_handler, instance_data); }
+	void freeEngine(mt32emu_engine engine) { mt32emu_free_engine(engine); }
+	Bit32u getEngineUnitCount(mt32emu_const_engine engine) { return mt32emu_get_engine_unit_count(engine); }
+	mt32emu_context getEngineContext(mt32emu_const_engine engine, const Bit32u unit) { return mt32emu_get_engine_context(engine, unit); }
+	mt32emu_return_code addEngineROMData(mt32emu_engine engine, const Bit8u *data, size_t data_size, const mt32emu_sha1_digest *sha1_digest = NULL) { return mt32emu_add_engine_rom_data(engine, data, data_size, sha1_digest); }
+	mt32emu_return_code addEngineROMFile(mt32emu_engine engine, const char *filename) { return mt32emu_add_engine_rom_file(engine, filename); }
+	mt32emu_return_code openEngine(mt32emu_const_engine engine) { return mt32emu_open_engine(engine); }
+	void closeEngine(mt32emu_const_engine engine) { mt32emu_close_engine(engine); }
+	void renderEngineBit16s(mt32emu_const_engine engine, Bit16s * const *streams, Bit32u len) { mt32emu_render_engine_bit16s(engine, streams, len); }
+	void renderEngineFloat(mt32emu_const_engine engine, float * const *streams, Bit32u len) { mt32emu_render_engine_float(engine, streams, len); }
+	void mixEngineBit16s(mt32emu_const_engine engine, Bit16s *stream, Bit32u len) { mt32emu_mix_engine_bit16s(engine, stream, len); }
+	void mixEngineFloat(mt32emu_const_engine engine, float *stream, Bit32u len) { mt32emu_mix_engine_float(engine, stream, len); }
+	void renderEngineUnitsBit16s(mt32emu_const_engine engine, const Bit32u *units, Bit32u unit_count, Bit16s * const *streams, Bit32u len) { mt32emu_render_engine_units_bit16s(engine, units, unit_count, streams, len); }
+	void renderEngineUnitsFloat(mt32emu_const_engine engine, const Bit32u *units, Bit32u unit_count, float * const *streams, Bit32u len) { mt32emu_render_engine_units_float(engine, units, unit_count, streams, len); }
 
 	// Context-dependent methods
 
@@ -211,15 +336,46 @@ public:
 	void setSamplerateConversionQuality(const SamplerateConversionQuality quality) { mt32emu_set_samplerate_conversion_quality(c, static_cast<mt32emu_samplerate_conversion_quality>(quality)); }
 	void selectRendererType(const RendererType newRendererType) { mt32emu_select_renderer_type(c, static_cast<mt32emu_renderer_type>(newRendererType)); }
 	RendererType getSelectedRendererType() { return static_cast<RendererType>(mt32emu_get_selected_renderer_type(c)); }
+	void setFloatWaveAccuracy(const FloatWaveAccuracy accuracy) { mt32emu_set_float_wave_accuracy(c, static_cast<mt32emu_float_wave_accuracy>(accuracy)); }
+	FloatWaveAccuracy getFloatWaveAccuracy() { return static_cast<FloatWaveAccuracy>(mt32emu_get_float_wave_accuracy(c)); }
+	void setDegradationLevel(const DegradationLevel level) { mt32emu_set_degradation_level(c, static_cast<mt32emu_degradation_level>(level)); }
+	DegradationLevel getDegradationLevel() { return static_cast<DegradationLevel>(mt32emu_get_degradation_level(c)); }
+	void setPartialCullingLevel(const Bit8u level) { mt32emu_set_partial_culling_level(c, level); }
+	Bit8u getPartialCullingLevel() { return mt32emu_get_partial_culling_level(c); }
+	void setDenormalFlushingEnabled(const bool enabled) { mt32emu_set_denormal_flushing_enabled(c, enabled ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE); }
+	bool isDenormalFlushingEnabled() { return mt32emu_is_denormal_flushing_enabled(c) != MT32EMU_BOOL_FALSE; }
+	void setPartialRenderingThreadCount(const Bit32u thread_count) { mt32emu_set_partial_rendering_thread_count(c, thread_count); }
+	Bit32u getPartialRenderingThreadCount() { return mt32emu_get_partial_rendering_thread_count(c); }
+	void setReverbPipelineEnabled(const bool enabled) { mt32emu_set_reverb_pipeline_enabled(c, enabled ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE); }
+	bool isReverbPipelineEnabled() { return mt32emu_is_reverb_pipeline_enabled(c) != MT32EMU_BOOL_FALSE; }
+	Bit32u getReverbPipelineLatency() { return mt32emu_get_reverb_pipeline_latency(c); }
+	void setMaxRenderBlockLength(const Bit32u length) { mt32emu_set_max_render_block_length(c, length); }
+	Bit32u getMaxRenderBlockLength() { return mt32emu_get_max_render_block_length(c); }
+	size_t getAllocatedMemorySize() { return mt32emu_get_allocated_memory_size(c); }
+	void getMemoryUsage(mt32emu_memory_usage *usage) { mt32emu_get_memory_usage(c, usage); }
+	void setROMCacheDirectory(const char *cache_directory) { mt32emu_set_rom_cache_directory(c, cache_directory); }
+	const char *getROMCacheDirectory() { return mt32emu_get_rom_cache_directory(c); }
 	mt32emu_return_code openSynth() { return mt32emu_open_synth(c); }
 	void closeSynth() { mt32emu_close_synth(c); }
 	bool isOpen() { return mt32emu_is_open(c) != MT32EMU_BOOL_FALSE; }
+	mt32emu_return_code startOpeningSynth() { return mt32emu_start_opening_synth(c); }
+	Bit32u getOpenProgress() { return mt32emu_get_open_progress(c); }
+	bool isOpening() { return mt32emu_is_opening(c) != MT32EMU_BOOL_FALSE; }
+	void cancelOpening() { mt32emu_cancel_opening(c); }
+	mt32emu_return_code finishOpeningSynth() { return mt32emu_finish_opening_synth(c); }
 	Bit32u getActualStereoOutputSamplerate() { return mt32emu_get_actual_stereo_output_samplerate(c); }
 	Bit32u convertOutputToSynthTimestamp(Bit32u output_timestamp) { return mt32emu_convert_output_to_synth_timestamp(c, output_timestamp); }
 	Bit32u convertSynthToOutputTimestamp(Bit32u synth_timestamp) { return mt32emu_convert_synth_to_output_timestamp(c, synth_timestamp); }
 	void flushMIDIQueue() { mt32emu_flush_midi_queue(c); }
 	Bit32u setMIDIEventQueueSize(const Bit32u queue_size) { return mt32emu_set_midi_event_queue_size(c, queue_size); }
 	void configureMIDIEventQueueSysexStorage(const Bit32u storage_buffer_size) { mt32emu_configure_midi_event_queue_sysex_storage(c, storage_buffer_size); }
+	void configureMIDIEventQueueMultiProducer(const bool enabled) { mt32emu_configure_midi_event_queue_multi_producer(c, enabled ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE); }
+	bool isMIDIEventQueueMultiProducer() { return mt32emu_is_midi_event_queue_multi_producer(c) != MT32EMU_BOOL_FALSE; }
+	void configureMIDIEventQueueCoalescing(const Bit32u window) { mt32emu_configure_midi_event_queue_coalescing(c, window); }
+	Bit32u getMIDIEventQueueCoalescingWindow() { return mt32emu_get_midi_event_queue_coalescing_window(c); }
+	Bit32u getMIDIEventQueueFreeCapacity() { return mt32emu_get_midi_event_queue_free_capacity(c); }
+	bool waitForMIDIEventQueueFreeCapacity(Bit32u event_count, Bit32u timeout_millis) { return mt32emu_wait_for_midi_event_queue_free_capacity(c, event_count, timeout_millis) != MT32EMU_BOOL_FALSE; }
+	bool getMIDIEventQueueStatistics(mt32emu_midi_event_queue_statistics *statistics) { return mt32emu_get_midi_event_queue_statistics(c, statistics) != MT32EMU_BOOL_FALSE; }
 	void setMIDIReceiver(mt32emu_midi_receiver_i midi_receiver, void *instance_data) { mt32emu_set_midi_receiver(c, midi_receiver, instance_data); }
 	void setMIDIReceiver(IMidiReceiver &midi_receiver) { setMIDIReceiver(CppInterfaceImpl::getMidiReceiverThunk(), &midi_receiver); }
 
@@ -232,6 +388,7 @@ public:
 	mt32emu_return_code playSysex(const Bit8u *sysex, Bit32u len) { return mt32emu_play_sysex(c, sysex, len); }
 	mt32emu_return_code playMsgAt(Bit32u msg, Bit32u timestamp) { return mt32emu_play_msg_at(c, msg, timestamp); }
 	mt32emu_return_code playSysexAt(const Bit8u *sysex, Bit32u len, Bit32u timestamp) { return mt32emu_play_sysex_at(c, sysex, len, timestamp); }
+	Bit32u playEvents(const mt32emu_midi_event *events, Bit32u count) { return mt32emu_play_events(c, events, count); }
 
 	void playMsgNow(Bit32u msg) { mt32emu_play_msg_now(c, msg); }
 	void playMsgOnPart(Bit8u part, Bit8u code, Bit8u note, Bit8u velocity) { mt32emu_play_msg_on_part(c, part, code, note, velocity); }
@@ -246,12 +403,18 @@ public:
 	bool isMT32ReverbCompatibilityMode() { return mt32emu_is_mt32_reverb_compatibility_mode(c) != MT32EMU_BOOL_FALSE; }
 	bool isDefaultReverbMT32Compatible() { return mt32emu_is_default_reverb_mt32_compatible(c) != MT32EMU_BOOL_FALSE; }
 	void preallocateReverbMemory(const bool enabled) { mt32emu_preallocate_reverb_memory(c, enabled ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE); }
+	void prepareReverbModel(const Bit8u mode) { mt32emu_prepare_reverb_model(c, mode); }
+	void setReverbSilenceThreshold(const float threshold) { mt32emu_set_reverb_silence_threshold(c, threshold); }
+	float getReverbSilenceThreshold() { return mt32emu_get_reverb_silence_threshold(c); }
 
 	void setDACInputMode(const DACInputMode mode) { mt32emu_set_dac_input_mode(c, static_cast<mt32emu_dac_input_mode>(mode)); }
 	DACInputMode getDACInputMode() { return static_cast<DACInputMode>(mt32emu_get_dac_input_mode(c)); }
 
 	void setMIDIDelayMode(const MIDIDelayMode mode) { mt32emu_set_midi_delay_mode(c, static_cast<mt32emu_midi_delay_mode>(mode)); }
 	MIDIDelayMode getMIDIDelayMode() { return static_cast<MIDIDelayMode>(mt32emu_get_midi_delay_mode(c)); }
+	void setMIDIEventTimingQuantum(const Bit32u quantum) { mt32emu_set_midi_event_timing_quantum(c, quantum); }
+	Bit32u getMIDIEventTimingQuantum() { return mt32emu_get_midi_event_timing_quantum(c); }
+	Bit32u getMaxMIDIEventTimingError() { return mt32emu_get_max_midi_event_timing_error(c); }
 
 	void setOutputGain(float gain) { mt32emu_set_output_gain(c, gain); }
 	float getOutputGain() { return mt32emu_get_output_gain(c); }
@@ -272,17 +435,46 @@ public:
 
 	void renderBit16s(Bit16s *stream, Bit32u len) { mt32emu_render_bit16s(c, stream, len); }
 	void renderFloat(float *stream, Bit32u len) { mt32emu_render_float(c, stream, len); }
+	Bit32u renderBit16sWithEvents(const mt32emu_midi_event *events, Bit32u event_count, Bit16s *stream, Bit32u len) { return mt32emu_render_bit16s_with_events(c, events, event_count, stream, len); }
+	Bit32u renderFloatWithEvents(const mt32emu_midi_event *events, Bit32u event_count, float *stream, Bit32u len) { return mt32emu_render_float_with_events(c, events, event_count, stream, len); }
+	void renderBit16sOutput(const mt32emu_stereo_output_bit16s *output, Bit32u len) { mt32emu_render_bit16s_output(c, output, len); }
+	void renderFloatOutput(const mt32emu_stereo_output_float *output, Bit32u len) { mt32emu_render_float_output(c, output, len); }
+	Bit32u renderBit16sOutputWithEvents(const mt32emu_midi_event *events, Bit32u event_count, const mt32emu_stereo_output_bit16s *output, Bit32u len) { return mt32emu_render_bit16s_output_with_events(c, events, event_count, output, len); }
+	Bit32u renderFloatOutputWithEvents(const mt32emu_midi_event *events, Bit32u event_count, const mt32emu_stereo_output_float *output, Bit32u len) { return mt32emu_render_float_output_with_events(c, events, event_count, output, len); }
 	void renderBit16sStreams(const mt32emu_dac_output_bit16s_streams *streams, Bit32u len) { mt32emu_render_bit16s_streams(c, streams, len); }
 	void renderFloatStreams(const mt32emu_dac_output_float_streams *streams, Bit32u len) { mt32emu_render_float_streams(c, streams, len); }
 
 	bool hasActivePartials() { return mt32emu_has_active_partials(c) != MT32EMU_BOOL_FALSE; }
+	Bit32u getMinRemainingPartialFrameCount() { return mt32emu_get_min_remaining_partial_frame_count(c); }
 	bool isActive() { return mt32emu_is_active(c) != MT32EMU_BOOL_FALSE; }
+	bool getRenderStatistics(mt32emu_render_statistics *statistics) { return mt32emu_get_render_statistics(c, statistics) != MT32EMU_BOOL_FALSE; }
+	bool getPartialRenderStatistics(mt32emu_partial_render_statistics *statistics) { return mt32emu_get_partial_render_statistics(c, statistics) != MT32EMU_BOOL_FALSE; }
+	void resetRenderStatistics() { mt32emu_reset_render_statistics(c); }
 	Bit32u getPartialCount() { return mt32emu_get_partial_count(c); }
+	void setPartialLimit(const Bit32u partialLimit) { mt32emu_set_partial_limit(c, partialLimit); }
+	Bit32u getPartialLimit() { return mt32emu_get_partial_limit(c); }
+	void setMaxPartialCount(const Bit32u maxPartialCount) { mt32emu_set_max_partial_count(c, maxPartialCount); }
+	Bit32u getMaxPartialCount() { return mt32emu_get_max_partial_count(c); }
+	bool resizePartialPool(const Bit32u newPartialCount) { return mt32emu_resize_partial_pool(c, newPartialCount) != MT32EMU_BOOL_FALSE; }
+	void setHotMemoryLockingEnabled(const bool enabled) { mt32emu_set_hot_memory_locking_enabled(c, enabled ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE); }
+	bool isHotMemoryLockingEnabled() { return mt32emu_is_hot_memory_locking_enabled(c) != MT32EMU_BOOL_FALSE; }
+	bool isHotMemoryLocked() { return mt32emu_is_hot_memory_locked(c) != MT32EMU_BOOL_FALSE; }
 	Bit32u getPartStates() { return mt32emu_get_part_states(c); }
 	void getPartialStates(Bit8u *partial_states) { mt32emu_get_partial_states(c, partial_states); }
 	Bit32u getPlayingNotes(Bit8u part_number, Bit8u *keys, Bit8u *velocities) { return mt32emu_get_playing_notes(c, part_number, keys, velocities); }
 	const char *getPatchName(Bit8u part_number) { return mt32emu_get_patch_name(c, part_number); }
 	void readMemory(Bit32u addr, Bit32u len, Bit8u *data) { mt32emu_read_memory(c, addr, len, data); }
+	void prefetchTimbres(Bit32u first_timbre_num, Bit32u timbre_count) { mt32emu_prefetch_timbres(c, first_timbre_num, timbre_count); }
+	Bit32u loadSysexBank(const Bit8u *data, Bit32u len) { return mt32emu_load_sysex_bank(c, data, len); }
+	mt32emu_return_code loadSysexBankFile(const char *filename) { return mt32emu_load_sysex_bank_file(c, filename); }
+	void writeMemory(Bit32u addr, Bit32u len, const Bit8u *data) { mt32emu_write_memory(c, addr, len, data); }
+	size_t saveState(Bit8u *buffer, size_t buffer_size) { return mt32emu_save_state(c, buffer, buffer_size); }
+	bool restoreState(const Bit8u *state, size_t state_size) { return mt32emu_restore_state(c, state, state_size) != MT32EMU_BOOL_FALSE; }
+	size_t saveStateDelta(const Bit8u *base_state, size_t base_state_size, Bit8u *buffer, size_t buffer_size) { return mt32emu_save_state_delta(c, base_state, base_state_size, buffer, buffer_size); }
+	bool restoreStateDelta(const Bit8u *base_state, size_t base_state_size, const Bit8u *delta, size_t delta_size) { return mt32emu_restore_state_delta(c, base_state, base_state_size, delta, delta_size) != MT32EMU_BOOL_FALSE; }
+	bool resetToOpenState() { return mt32emu_reset_to_open_state(c) != MT32EMU_BOOL_FALSE; }
+	bool startSessionRecording(const char *filename) { return mt32emu_start_session_recording(c, filename) != MT32EMU_BOOL_FALSE; }
+	void stopSessionRecording() { mt32emu_stop_session_recording(c); }
 
 private:
 #if MT32EMU_API_TYPE == 2
@@ -294,6 +486,7 @@ private:
 	const mt32emu_service_i_v1 *iV1() { return (getVersionID() < MT32EMU_SERVICE_VERSION_1) ? NULL : i.v1; }
 	const mt32emu_service_i_v2 *iV2() { return (getVersionID() < MT32EMU_SERVICE_VERSION_2) ? NULL : i.v2; }
 	const mt32emu_service_i_v3 *iV3() { return (getVersionID() < MT32EMU_SERVICE_VERSION_3) ? NULL : i.v3; }
+	const mt32emu_service_i_v4 *iV4() { return (getVersionID() < MT32EMU_SERVICE_VERSION_4) ? NULL : i.v4; }
 #endif
 };
 
@@ -412,6 +605,25 @@ static mt32emu_midi_receiver_i getMidiReceiverThunk() {
 	return MIDI_RECEIVER_THUNK;
 }
 
+static mt32emu_executor_version getExecutorVersionID(mt32emu_executor_i) {
+	return MT32EMU_EXECUTOR_VERSION_CURRENT;
+}
+
+static mt32emu_boolean execute(void *instance_data, void (*proc)(void *), void *context) {
+	return static_cast<IExecutor *>(instance_data)->execute(proc, context) ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE;
+}
+
+static mt32emu_executor_i getExecutorThunk() {
+	static const mt32emu_executor_i_v0 EXECUTOR_V0_THUNK = {
+		getExecutorVersionID,
+		execute
+	};
+
+	static const mt32emu_executor_i EXECUTOR_THUNK = { &EXECUTOR_V0_THUNK };
+
+	return EXECUTOR_THUNK;
+}
+
 } // namespace CppInterfaceImpl
 
 } // namespace MT32Emu
@@ -424,6 +636,12 @@ static mt32emu_midi_receiver_i getMidiReceiverThunk() {
 #undef mt32emu_get_library_version_string
 #undef mt32emu_get_stereo_output_samplerate
 #undef mt32emu_get_best_analog_output_mode
+#undef mt32emu_is_dac_streams_conversion_supported
+#undef mt32emu_get_supported_simd_instruction_set
+#undef mt32emu_get_simd_instruction_set
+#undef mt32emu_force_simd_instruction_set
+#undef mt32emu_get_supported_executor_version
+#undef mt32emu_set_executor
 #undef mt32emu_create_context
 #undef mt32emu_free_context
 #undef mt32emu_add_rom_data
@@ -435,6 +653,67 @@ static mt32emu_midi_receiver_i getMidiReceiverThunk() {
 #undef mt32emu_set_samplerate_conversion_quality
 #undef mt32emu_select_renderer_type
 #undef mt32emu_get_selected_renderer_type
+#undef mt32emu_set_partial_rendering_thread_count
+#undef mt32emu_get_partial_rendering_thread_count
+#undef mt32emu_set_reverb_pipeline_enabled
+#undef mt32emu_is_reverb_pipeline_enabled
+#undef mt32emu_get_reverb_pipeline_latency
+#undef mt32emu_set_max_render_block_length
+#undef mt32emu_get_max_render_block_length
+#undef mt32emu_get_allocated_memory_size
+#undef mt32emu_get_memory_usage
+#undef mt32emu_prepare_reverb_model
+#undef mt32emu_set_float_wave_accuracy
+#undef mt32emu_get_float_wave_accuracy
+#undef mt32emu_set_partial_limit
+#undef mt32emu_get_partial_limit
+#undef mt32emu_set_max_partial_count
+#undef mt32emu_get_max_partial_count
+#undef mt32emu_resize_partial_pool
+#undef mt32emu_set_degradation_level
+#undef mt32emu_get_degradation_level
+#undef mt32emu_set_partial_culling_level
+#undef mt32emu_get_partial_culling_level
+#undef mt32emu_set_denormal_flushing_enabled
+#undef mt32emu_is_denormal_flushing_enabled
+#undef mt32emu_load_sysex_bank
+#undef mt32emu_load_sysex_bank_file
+#undef mt32emu_write_memory
+#undef mt32emu_reset_to_open_state
+#undef mt32emu_save_state_delta
+#undef mt32emu_restore_state_delta
+#undef mt32emu_start_session_recording
+#undef mt32emu_stop_session_recording
+#undef mt32emu_get_min_remaining_partial_frame_count
+#undef mt32emu_start_opening_synth
+#undef mt32emu_get_open_progress
+#undef mt32emu_is_opening
+#undef mt32emu_cancel_opening
+#undef mt32emu_finish_opening_synth
+#undef mt32emu_prefetch_timbres
+#undef mt32emu_set_rom_cache_directory
+#undef mt32emu_get_rom_cache_directory
+#undef mt32emu_save_state
+#undef mt32emu_restore_state
+#undef mt32emu_create_engine
+#undef mt32emu_free_engine
+#undef mt32emu_get_engine_unit_count
+#undef mt32emu_get_engine_context
+#undef mt32emu_add_engine_rom_data
+#undef mt32emu_add_engine_rom_file
+#undef mt32emu_open_engine
+#undef mt32emu_close_engine
+#undef mt32emu_render_engine_bit16s
+#undef mt32emu_render_engine_float
+#undef mt32emu_mix_engine_bit16s
+#undef mt32emu_mix_engine_float
+#undef mt32emu_render_engine_units_bit16s
+#undef mt32emu_render_engine_units_float
+#undef mt32emu_set_hot_memory_locking_enabled
+#undef mt32emu_is_hot_memory_locking_enabled
+#undef mt32emu_is_hot_memory_locked
+#undef mt32emu_configure_midi_event_queue_coalescing
+#undef mt32emu_get_midi_event_queue_coalescing_window
 #undef mt32emu_open_synth
 #undef mt32emu_close_synth
 #undef mt32emu_is_open
@@ -444,6 +723,11 @@ static mt32emu_midi_receiver_i getMidiReceiverThunk() {
 #undef mt32emu_flush_midi_queue
 #undef mt32emu_set_midi_event_queue_size
 #undef mt32emu_configure_midi_event_queue_sysex_storage
+#undef mt32emu_configure_midi_event_queue_multi_producer
+#undef mt32emu_is_midi_event_queue_multi_producer
+#undef mt32emu_get_midi_event_queue_free_capacity
+#undef mt32emu_wait_for_midi_event_queue_free_capacity
+#undef mt32emu_get_midi_event_queue_statistics
 #undef mt32emu_set_midi_receiver
 #undef mt32emu_get_internal_rendered_sample_count
 #undef mt32emu_parse_stream
@@ -454,6 +738,7 @@ static mt32emu_midi_receiver_i getMidiReceiverThunk() {
 #undef mt32emu_play_sysex
 #undef mt32emu_play_msg_at
 #undef mt32emu_play_sysex_at
+#undef mt32emu_play_events
 #undef mt32emu_play_msg_now
 #undef mt32emu_play_msg_on_part
 #undef mt32emu_play_sysex_now
@@ -466,10 +751,15 @@ static mt32emu_midi_receiver_i getMidiReceiverThunk() {
 #undef mt32emu_is_mt32_reverb_compatibility_mode
 #undef mt32emu_is_default_reverb_mt32_compatible
 #undef mt32emu_preallocate_reverb_memory
+#undef mt32emu_set_reverb_silence_threshold
+#undef mt32emu_get_reverb_silence_threshold
 #undef mt32emu_set_dac_input_mode
 #undef mt32emu_get_dac_input_mode
 #undef mt32emu_set_midi_delay_mode
 #undef mt32emu_get_midi_delay_mode
+#undef mt32emu_set_midi_event_timing_quantum
+#undef mt32emu_get_midi_event_timing_quantum
+#undef mt32emu_get_max_midi_event_timing_error
 #undef mt32emu_set_output_gain
 #undef mt32emu_get_output_gain
 #undef mt32emu_set_reverb_output_gain
@@ -484,10 +774,19 @@ static mt32emu_midi_receiver_i getMidiReceiverThunk() {
 #undef mt32emu_is_nice_partial_mixing_enabled
 #undef mt32emu_render_bit16s
 #undef mt32emu_render_float
+#undef mt32emu_render_bit16s_with_events
+#undef mt32emu_render_float_with_events
 #undef mt32emu_render_bit16s_streams
 #undef mt32emu_render_float_streams
+#undef mt32emu_render_bit16s_output
+#undef mt32emu_render_float_output
+#undef mt32emu_render_bit16s_output_with_events
+#undef mt32emu_render_float_output_with_events
 #undef mt32emu_has_active_partials
 #undef mt32emu_is_active
+#undef mt32emu_get_render_statistics
+#undef mt32emu_get_partial_render_statistics
+#undef mt32emu_reset_render_statistics
 #undef mt32emu_get_partial_count
 #undef mt32emu_get_part_states
 #undef mt32emu_get_partial_states
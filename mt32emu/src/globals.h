@@ -67,10 +67,22 @@
  * called with will give no gain (but simply waste the memory).
  * Note that this value does *not* in any way impose limitations on the length given to render(), and has no effect
  * on the generated audio.
+ * This is the default maximum number of samples rendered by a synth instance in a single pass, which can be configured
+ * per synth instance (see Synth::setMaxRenderBlockLength()). It also sizes the passes of the sample rate converters.
  * This value must be >= 1.
  */
 #define MT32EMU_MAX_SAMPLES_PER_RUN 4096
 
+/* The lower limit for the maximum number of samples rendered in a single pass, that can be configured per synth instance
+ * in order to reduce the memory footprint (see Synth::setMaxRenderBlockLength()).
+ */
+#define MT32EMU_MIN_RENDER_BLOCK_LENGTH 32
+
+/* The upper limit for the maximum number of samples rendered in a single pass, that can be configured per synth instance
+ * in order to render in fewer passes offline (see Synth::setMaxRenderBlockLength()).
+ */
+#define MT32EMU_MAX_RENDER_BLOCK_LENGTH 65536
+
 /* The default size of the internal MIDI event queue.
  * It holds the incoming MIDI events before the rendering engine actually processes them.
  * The main goal is to fairly emulate the real hardware behaviour which obviously
@@ -104,6 +116,12 @@ const unsigned int DEFAULT_MAX_PARTIALS = MT32EMU_DEFAULT_MAX_PARTIALS;
 const unsigned int MAX_SAMPLES_PER_RUN = MT32EMU_MAX_SAMPLES_PER_RUN;
 #undef MT32EMU_MAX_SAMPLES_PER_RUN
 
+const unsigned int MIN_RENDER_BLOCK_LENGTH = MT32EMU_MIN_RENDER_BLOCK_LENGTH;
+#undef MT32EMU_MIN_RENDER_BLOCK_LENGTH
+
+const unsigned int MAX_RENDER_BLOCK_LENGTH = MT32EMU_MAX_RENDER_BLOCK_LENGTH;
+#undef MT32EMU_MAX_RENDER_BLOCK_LENGTH
+
 const unsigned int DEFAULT_MIDI_EVENT_QUEUE_SIZE = MT32EMU_DEFAULT_MIDI_EVENT_QUEUE_SIZE;
 #undef MT32EMU_DEFAULT_MIDI_EVENT_QUEUE_SIZE
 
@@ -87,6 +87,12 @@
 #define MT32EMU_BOSS_REVERB_PRECISE_MODE 0
 #endif
 
+// 0: Use portable code only.
+// 1: Use SIMD instructions where supported by the compiler and the CPU (SSE2 and AVX2).
+#ifndef MT32EMU_USE_SIMD
+#define MT32EMU_USE_SIMD 1
+#endif
+
 namespace MT32Emu {
 
 typedef Bit16s IntSample;
@@ -74,10 +74,15 @@
 #include "Types.h"
 #include "File.h"
 #include "FileStream.h"
+#include "MappedFile.h"
 #include "ROMInfo.h"
 #include "Synth.h"
 #include "MidiStreamParser.h"
 #include "SampleRateConverter.h"
+#include "OutputFanOut.h"
+#include "TraceSink.h"
+#include "Executor.h"
+#include "DeferredReportHandler.h"
 
 #endif /* #if !defined(__cplusplus) || MT32EMU_API_TYPE == 1 */
 
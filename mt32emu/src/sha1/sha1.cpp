@@ -55,6 +55,9 @@ namespace sha1
             }
         }
 
+        // Processes one 64 byte block held in w, which is used as a rolling buffer for the message schedule,
+        // so only its first 16 integers are touched. The rounds are unrolled, and the working variables rotate
+        // between the macro arguments instead of being shifted after each round.
         void innerHash(unsigned int* result, unsigned int* w)
         {
             unsigned int a = result[0];
@@ -63,49 +66,56 @@ namespace sha1
             unsigned int d = result[3];
             unsigned int e = result[4];
 
-            int round = 0;
-
-            #define sha1macro(func,val) \
-			{ \
-                const unsigned int t = rol(a, 5) + (func) + e + val + w[round]; \
-				e = d; \
-				d = c; \
-				c = rol(b, 30); \
-				b = a; \
-				a = t; \
-			}
-
-            while (round < 16)
-            {
-                sha1macro((b & c) | (~b & d), 0x5a827999)
-                ++round;
+            #define sha1f1(b, c, d) (d ^ (b & (c ^ d)))
+            #define sha1f2(b, c, d) (b ^ c ^ d)
+            #define sha1f3(b, c, d) ((b & c) | (d & (b | c)))
+            #define sha1w(round) (w[(round) & 15] = rol(w[((round) + 13) & 15] ^ w[((round) + 8) & 15] ^ w[((round) + 2) & 15] ^ w[(round) & 15], 1))
+            #define sha1macro(a, b, c, d, e, func, val, wval) \
+            { \
+                e += rol(a, 5) + func(b, c, d) + val + (wval); \
+                b = rol(b, 30); \
             }
-            while (round < 20)
-            {
-                w[round] = rol((w[round - 3] ^ w[round - 8] ^ w[round - 14] ^ w[round - 16]), 1);
-                sha1macro((b & c) | (~b & d), 0x5a827999)
-                ++round;
-            }
-            while (round < 40)
-            {
-                w[round] = rol((w[round - 3] ^ w[round - 8] ^ w[round - 14] ^ w[round - 16]), 1);
-                sha1macro(b ^ c ^ d, 0x6ed9eba1)
-                ++round;
+            #define sha1rounds5(first, func, val, wfunc) \
+            { \
+                sha1macro(a, b, c, d, e, func, val, wfunc(first)) \
+                sha1macro(e, a, b, c, d, func, val, wfunc((first) + 1)) \
+                sha1macro(d, e, a, b, c, func, val, wfunc((first) + 2)) \
+                sha1macro(c, d, e, a, b, func, val, wfunc((first) + 3)) \
+                sha1macro(b, c, d, e, a, func, val, wfunc((first) + 4)) \
             }
-            while (round < 60)
-            {
-                w[round] = rol((w[round - 3] ^ w[round - 8] ^ w[round - 14] ^ w[round - 16]), 1);
-                sha1macro((b & c) | (b & d) | (c & d), 0x8f1bbcdc)
-                ++round;
-            }
-            while (round < 80)
-            {
-                w[round] = rol((w[round - 3] ^ w[round - 8] ^ w[round - 14] ^ w[round - 16]), 1);
-                sha1macro(b ^ c ^ d, 0xca62c1d6)
-                ++round;
-            }
-
+            #define sha1w0(round) w[round]
+
+            sha1rounds5(0, sha1f1, 0x5a827999, sha1w0)
+            sha1rounds5(5, sha1f1, 0x5a827999, sha1w0)
+            sha1rounds5(10, sha1f1, 0x5a827999, sha1w0)
+            sha1macro(a, b, c, d, e, sha1f1, 0x5a827999, w[15])
+            sha1macro(e, a, b, c, d, sha1f1, 0x5a827999, sha1w(16))
+            sha1macro(d, e, a, b, c, sha1f1, 0x5a827999, sha1w(17))
+            sha1macro(c, d, e, a, b, sha1f1, 0x5a827999, sha1w(18))
+            sha1macro(b, c, d, e, a, sha1f1, 0x5a827999, sha1w(19))
+
+            sha1rounds5(20, sha1f2, 0x6ed9eba1, sha1w)
+            sha1rounds5(25, sha1f2, 0x6ed9eba1, sha1w)
+            sha1rounds5(30, sha1f2, 0x6ed9eba1, sha1w)
+            sha1rounds5(35, sha1f2, 0x6ed9eba1, sha1w)
+
+            sha1rounds5(40, sha1f3, 0x8f1bbcdc, sha1w)
+            sha1rounds5(45, sha1f3, 0x8f1bbcdc, sha1w)
+            sha1rounds5(50, sha1f3, 0x8f1bbcdc, sha1w)
+            sha1rounds5(55, sha1f3, 0x8f1bbcdc, sha1w)
+
+            sha1rounds5(60, sha1f2, 0xca62c1d6, sha1w)
+            sha1rounds5(65, sha1f2, 0xca62c1d6, sha1w)
+            sha1rounds5(70, sha1f2, 0xca62c1d6, sha1w)
+            sha1rounds5(75, sha1f2, 0xca62c1d6, sha1w)
+
+            #undef sha1w0
+            #undef sha1rounds5
             #undef sha1macro
+            #undef sha1w
+            #undef sha1f3
+            #undef sha1f2
+            #undef sha1f1
 
             result[0] += a;
             result[1] += b;
@@ -124,7 +134,7 @@ namespace sha1
         const unsigned char* sarray = static_cast<const unsigned char*>(src);
 
         // The reusable round buffer
-        unsigned int w[80];
+        unsigned int w[16];
 
         // Loop through all complete 64byte blocks.
         const int endOfFullBlocks = bytelength - 64;
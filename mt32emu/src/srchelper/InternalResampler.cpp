@@ -17,51 +17,171 @@
 #include "InternalResampler.h"
 
 #include "srctools/include/SincResampler.h"
+#include "srctools/include/IIR2xResampler.h"
 #include "srctools/include/ResamplerModel.h"
 
+#include "../Analog.h"
+#include "../SampleRateConverter.h"
 #include "../Synth.h"
 
 using namespace SRCTools;
 
 namespace MT32Emu {
 
-class SynthWrapper : public FloatSampleProvider {
+static const double MAX_AUDIBLE_FREQUENCY = 20000.0;
+
+class InternalResampler::SynthWrapper : public FloatSampleProvider {
 	Synth &synth;
+	const bool bypassLPF;
 
 public:
-	SynthWrapper(Synth &useSynth) : synth(useSynth)
+	SynthWrapper(Synth &useSynth, bool useBypassLPF) : synth(useSynth), bypassLPF(useBypassLPF)
 	{}
 
 	void getOutputSamples(FloatSample *outBuffer, unsigned int size) {
-		synth.render(outBuffer, size);
+		if (bypassLPF) {
+			synth.renderBypassingLPF(outBuffer, size);
+		} else {
+			synth.render(outBuffer, size);
+		}
 	}
 };
 
-static FloatSampleProvider &createModel(Synth &synth, SRCTools::FloatSampleProvider &synthSource, double targetSampleRate, SamplerateConversionQuality quality) {
-	static const double MAX_AUDIBLE_FREQUENCY = 20000.0;
+// In ACCURATE and OVERSAMPLED modes, the analog LPF upsamples the signal just to be resampled once again. Instead,
+// the LPF response is folded into the kernel of a single windowed sinc stage that takes the stereo mix at the DAC sample rate.
+bool InternalResampler::isLPFFusable(unsigned int lpfUpsampleFactor, SamplerateConversionQuality quality) {
+	return quality != SamplerateConversionQuality_FASTEST && lpfUpsampleFactor > 1;
+}
+
+bool InternalResampler::isLPFFusable(const Synth &synth, SamplerateConversionQuality quality) {
+	if (synth.analog == NULL) return false;
+	const FloatSample *lpfTaps;
+	unsigned int lpfUpsampleFactor;
+	synth.analog->getLPFKernel(lpfTaps, lpfUpsampleFactor);
+	return isLPFFusable(lpfUpsampleFactor, quality);
+}
+
+// The passband is limited to the audible range. Aliasing is only allowed to land above the passband.
+// The LPF attenuates the mirror spectra above 28kHz, so its images start at lpfSampleRate - 28kHz.
+void InternalResampler::computeFusedLPFBands(double &passband, double &stopband, double lpfSampleRate, double targetSampleRate, SamplerateConversionQuality quality) {
+	const double passbandFraction = IIRResampler::getPassbandFractionForQuality(static_cast<IIRResampler::Quality>(quality));
+	passband = 0.5 * targetSampleRate * passbandFraction;
+	if (MAX_AUDIBLE_FREQUENCY < passband) passband = MAX_AUDIBLE_FREQUENCY;
+	stopband = targetSampleRate - passband;
+	if (0.5 * lpfSampleRate + MAX_AUDIBLE_FREQUENCY < stopband) stopband = 0.5 * lpfSampleRate + MAX_AUDIBLE_FREQUENCY;
+}
+
+FloatSampleProvider &InternalResampler::createFusedLPFModel(const Synth &synth, SRCTools::FloatSampleProvider &synthSource, double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio, bool minimumPhase) {
+	const FloatSample *lpfTaps;
+	unsigned int lpfUpsampleFactor;
+	const unsigned int lpfLength = synth.analog->getLPFKernel(lpfTaps, lpfUpsampleFactor);
+	double passband;
+	double stopband;
+	computeFusedLPFBands(passband, stopband, double(SAMPLE_RATE) * lpfUpsampleFactor, targetSampleRate, quality);
+	ResamplerStage &resamplerStage = *SincResampler::createSincResampler(SAMPLE_RATE, targetSampleRate, passband, stopband, ResamplerModel::DEFAULT_DB_SNR, ResamplerModel::DEFAULT_WINDOWED_SINC_MAX_UPSAMPLE_FACTOR, lpfTaps, lpfLength, lpfUpsampleFactor, DEFAULT_CHANNEL_COUNT, variableRatio, minimumPhase);
+	return ResamplerModel::createResamplerModel(synthSource, resamplerStage);
+}
+
+FloatSampleProvider &InternalResampler::createModel(Synth &synth, SRCTools::FloatSampleProvider &synthSource, double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio, bool minimumPhase) {
+	if (isLPFFusable(synth, quality)) {
+		return createFusedLPFModel(synth, synthSource, targetSampleRate, quality, variableRatio, minimumPhase);
+	}
 
 	const double sourceSampleRate = synth.getStereoOutputSampleRate();
-	if (quality != SamplerateConversionQuality_FASTEST) {
-		const bool oversampledMode = synth.getStereoOutputSampleRate() == Synth::getStereoOutputSampleRate(AnalogOutputMode_OVERSAMPLED);
-		// Oversampled input allows to bypass IIR interpolation stage and, in some cases, IIR decimation stage
-		if (oversampledMode && (0.5 * sourceSampleRate) <= targetSampleRate) {
-			// NOTE: In the oversampled mode, the transition band starts at 20kHz and ends at 28kHz
-			double passband = MAX_AUDIBLE_FREQUENCY;
-			double stopband = 0.5 * sourceSampleRate + MAX_AUDIBLE_FREQUENCY;
-			ResamplerStage &resamplerStage = *SincResampler::createSincResampler(sourceSampleRate, targetSampleRate, passband, stopband, ResamplerModel::DEFAULT_DB_SNR, ResamplerModel::DEFAULT_WINDOWED_SINC_MAX_UPSAMPLE_FACTOR);
-			return ResamplerModel::createResamplerModel(synthSource, resamplerStage);
+	return ResamplerModel::createResamplerModel(synthSource, sourceSampleRate, targetSampleRate, static_cast<ResamplerModel::Quality>(quality), DEFAULT_CHANNEL_COUNT, variableRatio, minimumPhase);
+}
+
+// The cost of the analog LPF is counted as one phase of its kernel per sample at the analog output sample rate.
+// In COARSE mode, the output spectrum is limited by the DAC sample rate. Otherwise, the LPF is emulated accurately
+// in the audible range.
+void InternalResampler::estimateOutputPipeline(OutputPipelinePlan &plan, double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio) {
+	unsigned int lpfUpsampleFactor;
+	const unsigned int lpfLength = Analog::getLPFKernelLength(plan.analogOutputMode, lpfUpsampleFactor);
+	const double lpfCost = (lpfLength + lpfUpsampleFactor - 1) / lpfUpsampleFactor;
+	const double analogSampleRate = Synth::getStereoOutputSampleRate(plan.analogOutputMode);
+	const double analogPassband = lpfUpsampleFactor > 1 ? MAX_AUDIBLE_FREQUENCY : 0.5 * SAMPLE_RATE;
+
+	double passband;
+	plan.conversionNeeded = analogSampleRate != targetSampleRate || variableRatio;
+	plan.lpfFused = plan.conversionNeeded && isLPFFusable(lpfUpsampleFactor, quality);
+	if (!plan.conversionNeeded) {
+		plan.estimatedCost = lpfCost;
+		passband = 0.5 * targetSampleRate;
+	} else if (plan.lpfFused) {
+		double stopband;
+		computeFusedLPFBands(passband, stopband, double(SAMPLE_RATE) * lpfUpsampleFactor, targetSampleRate, quality);
+		plan.estimatedCost = SincResampler::estimateTapsPerOutputSample(SAMPLE_RATE, targetSampleRate, passband, stopband, ResamplerModel::DEFAULT_DB_SNR, ResamplerModel::DEFAULT_WINDOWED_SINC_MAX_UPSAMPLE_FACTOR, lpfLength, lpfUpsampleFactor, variableRatio);
+	} else {
+		// The IIR stage limits the passband relative to the lower sample rate, nothing is guaranteed in FASTEST quality.
+		const double passbandFraction = IIRResampler::getPassbandFractionForQuality(static_cast<IIRResampler::Quality>(quality));
+		passband = 0.5 * (analogSampleRate < targetSampleRate ? analogSampleRate : targetSampleRate) * passbandFraction;
+		plan.estimatedCost = lpfCost * analogSampleRate / targetSampleRate + ResamplerModel::estimateCost(analogSampleRate, targetSampleRate, static_cast<ResamplerModel::Quality>(quality), variableRatio);
+	}
+	plan.passbandFrequency = analogPassband < passband ? analogPassband : passband;
+}
+
+OutputPipelinePlan InternalResampler::planOutputPipeline(double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio) {
+	static const AnalogOutputMode CANDIDATE_MODES[] = { AnalogOutputMode_COARSE, AnalogOutputMode_ACCURATE, AnalogOutputMode_OVERSAMPLED };
+	static const unsigned int CANDIDATE_COUNT = sizeof(CANDIDATE_MODES) / sizeof(CANDIDATE_MODES[0]);
+
+	// The quality requires the passband the conversion retains when it's given the full audible spectrum.
+	const double passbandFraction = IIRResampler::getPassbandFractionForQuality(static_cast<IIRResampler::Quality>(quality));
+	double requiredPassband = 0.5 * targetSampleRate * passbandFraction;
+	if (MAX_AUDIBLE_FREQUENCY < requiredPassband) requiredPassband = MAX_AUDIBLE_FREQUENCY;
+
+	// Should no candidate retain the required passband, the one that retains the widest passband is preferred.
+	OutputPipelinePlan bestPlan;
+	for (unsigned int i = 0; i < CANDIDATE_COUNT; i++) {
+		OutputPipelinePlan plan;
+		plan.analogOutputMode = CANDIDATE_MODES[i];
+		estimateOutputPipeline(plan, targetSampleRate, quality, variableRatio);
+		if (i > 0) {
+			const bool qualityMet = requiredPassband <= plan.passbandFrequency;
+			const bool bestQualityMet = requiredPassband <= bestPlan.passbandFrequency;
+			if (qualityMet != bestQualityMet) {
+				if (!qualityMet) continue;
+			} else if (!qualityMet && plan.passbandFrequency != bestPlan.passbandFrequency) {
+				if (plan.passbandFrequency < bestPlan.passbandFrequency) continue;
+			} else if (bestPlan.estimatedCost <= plan.estimatedCost) {
+				continue;
+			}
 		}
+		bestPlan = plan;
 	}
-	return ResamplerModel::createResamplerModel(synthSource, sourceSampleRate, targetSampleRate, static_cast<ResamplerModel::Quality>(quality));
+	return bestPlan;
 }
 
+static const unsigned int DAC_STREAM_COUNT = 6;
+
+class InternalDACStreamsResampler::SynthStreamsWrapper : public FloatSampleProvider {
+	Synth &synth;
+	float streamBuffers[DAC_STREAM_COUNT][MAX_SAMPLES_PER_RUN];
+
+public:
+	SynthStreamsWrapper(Synth &useSynth) : synth(useSynth)
+	{}
+
+	void getOutputSamples(FloatSample *outBuffer, unsigned int size) {
+		while (size > 0) {
+			const unsigned int thisPassSize = size < MAX_SAMPLES_PER_RUN ? size : MAX_SAMPLES_PER_RUN;
+			synth.renderStreams(streamBuffers[0], streamBuffers[1], streamBuffers[2], streamBuffers[3], streamBuffers[4], streamBuffers[5], thisPassSize);
+			for (unsigned int i = 0; i < thisPassSize; i++) {
+				for (unsigned int streamIx = 0; streamIx < DAC_STREAM_COUNT; streamIx++) {
+					*(outBuffer++) = streamBuffers[streamIx][i];
+				}
+			}
+			size -= thisPassSize;
+		}
+	}
+};
+
 } // namespace MT32Emu
 
 using namespace MT32Emu;
 
-InternalResampler::InternalResampler(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality) :
-	synthSource(*new SynthWrapper(synth)),
-	model(createModel(synth, synthSource, targetSampleRate, quality))
+InternalResampler::InternalResampler(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio, bool minimumPhase) :
+	synthSource(*new SynthWrapper(synth, isLPFFusable(synth, quality))),
+	model(createModel(synth, synthSource, targetSampleRate, quality, variableRatio, minimumPhase))
 {}
 
 InternalResampler::~InternalResampler() {
@@ -72,3 +192,54 @@ InternalResampler::~InternalResampler() {
 void InternalResampler::getOutputSamples(float *buffer, unsigned int length) {
 	model.getOutputSamples(buffer, length);
 }
+
+void InternalResampler::setOutputRateAdjustment(double factor) {
+	ResamplerModel::setOutputRateAdjustment(model, synthSource, factor);
+}
+
+double InternalResampler::getLatency() const {
+	return ResamplerModel::getLatency(model, synthSource);
+}
+
+size_t InternalResampler::getAllocatedMemorySize() const {
+	return sizeof(*this) + sizeof(SynthWrapper) + ResamplerModel::getAllocatedMemorySize(model, synthSource);
+}
+
+InternalDACStreamsResampler::InternalDACStreamsResampler(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality) :
+	synthSource(*new SynthStreamsWrapper(synth)),
+	model(ResamplerModel::createResamplerModel(synthSource, SAMPLE_RATE, targetSampleRate, static_cast<ResamplerModel::Quality>(quality), DAC_STREAM_COUNT)),
+	interleavedBuffer(new float[DAC_STREAM_COUNT * MAX_SAMPLES_PER_RUN])
+{}
+
+InternalDACStreamsResampler::~InternalDACStreamsResampler() {
+	ResamplerModel::freeResamplerModel(model, synthSource);
+	delete &synthSource;
+	delete[] interleavedBuffer;
+}
+
+size_t InternalDACStreamsResampler::getAllocatedMemorySize() const {
+	return sizeof(*this) + sizeof(SynthStreamsWrapper) + DAC_STREAM_COUNT * MAX_SAMPLES_PER_RUN * sizeof(float)
+		+ ResamplerModel::getAllocatedMemorySize(model, synthSource);
+}
+
+void InternalDACStreamsResampler::getOutputStreams(const DACOutputStreams<float> &streams, unsigned int length) {
+	float * const outStreams[] = {
+		streams.nonReverbLeft, streams.nonReverbRight,
+		streams.reverbDryLeft, streams.reverbDryRight,
+		streams.reverbWetLeft, streams.reverbWetRight
+	};
+	unsigned int offset = 0;
+	while (offset < length) {
+		const unsigned int thisPassLength = length - offset < MAX_SAMPLES_PER_RUN ? length - offset : MAX_SAMPLES_PER_RUN;
+		model.getOutputSamples(interleavedBuffer, thisPassLength);
+		for (unsigned int streamIx = 0; streamIx < DAC_STREAM_COUNT; streamIx++) {
+			float *outStream = outStreams[streamIx];
+			if (outStream == NULL) continue;
+			outStream += offset;
+			for (unsigned int i = 0; i < thisPassLength; i++) {
+				outStream[i] = interleavedBuffer[i * DAC_STREAM_COUNT + streamIx];
+			}
+		}
+		offset += thisPassLength;
+	}
+}
@@ -17,7 +17,10 @@
 #ifndef MT32EMU_INTERNAL_RESAMPLER_H
 #define MT32EMU_INTERNAL_RESAMPLER_H
 
+#include <cstddef>
+
 #include "../Enumerations.h"
+#include "../Types.h"
 
 #include "srctools/include/FloatSampleProvider.h"
 
@@ -25,16 +28,54 @@ namespace MT32Emu {
 
 class Synth;
 
+template <class T>
+struct DACOutputStreams;
+
+struct OutputPipelinePlan;
+
 class InternalResampler {
 public:
-	InternalResampler(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality);
+	// Chooses the cheapest output pipeline that retains the passband of the quality, see SampleRateConverter::planOutputPipeline().
+	static OutputPipelinePlan planOutputPipeline(double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio);
+
+	InternalResampler(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio = false, bool minimumPhase = false);
 	~InternalResampler();
 
 	void getOutputSamples(float *buffer, unsigned int length);
+	void setOutputRateAdjustment(double factor);
+	double getLatency() const;
+	size_t getAllocatedMemorySize() const;
 
 private:
+	class SynthWrapper;
+
+	SRCTools::FloatSampleProvider &synthSource;
+	SRCTools::FloatSampleProvider &model;
+
+	static bool isLPFFusable(unsigned int lpfUpsampleFactor, SamplerateConversionQuality quality);
+	static bool isLPFFusable(const Synth &synth, SamplerateConversionQuality quality);
+	static void computeFusedLPFBands(double &passband, double &stopband, double lpfSampleRate, double targetSampleRate, SamplerateConversionQuality quality);
+	static void estimateOutputPipeline(OutputPipelinePlan &plan, double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio);
+	static SRCTools::FloatSampleProvider &createFusedLPFModel(const Synth &synth, SRCTools::FloatSampleProvider &synthSource, double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio, bool minimumPhase);
+	static SRCTools::FloatSampleProvider &createModel(Synth &synth, SRCTools::FloatSampleProvider &synthSource, double targetSampleRate, SamplerateConversionQuality quality, bool variableRatio, bool minimumPhase);
+};
+
+// Converts all six DAC output streams at once, the streams are interleaved to pass through a single resampler model.
+class InternalDACStreamsResampler {
+public:
+	InternalDACStreamsResampler(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality);
+	~InternalDACStreamsResampler();
+
+	void getOutputStreams(const DACOutputStreams<float> &streams, unsigned int length);
+	size_t getAllocatedMemorySize() const;
+
+private:
+	class SynthStreamsWrapper;
+
 	SRCTools::FloatSampleProvider &synthSource;
 	SRCTools::FloatSampleProvider &model;
+	// Receives the interleaved output of the model.
+	float * const interleavedBuffer;
 };
 
 } // namespace MT32Emu
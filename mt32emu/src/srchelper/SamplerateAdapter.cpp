@@ -35,8 +35,9 @@ SamplerateAdapter::SamplerateAdapter(Synth &useSynth, double targetSampleRate, S
 	synth(useSynth),
 	inBuffer(new float[CHANNEL_COUNT * MAX_SAMPLES_PER_RUN]),
 	inBufferSize(MAX_SAMPLES_PER_RUN),
+	nominalOutputToInputRatio(targetSampleRate / useSynth.getStereoOutputSampleRate()),
 	inputToOutputRatio(useSynth.getStereoOutputSampleRate() / targetSampleRate),
-	outputToInputRatio(targetSampleRate / useSynth.getStereoOutputSampleRate())
+	outputToInputRatio(nominalOutputToInputRatio)
 {
 	int error;
 	int conversionType;
@@ -97,3 +98,13 @@ void SamplerateAdapter::getOutputSamples(float *buffer, unsigned int length) {
 		length -= gotFrames;
 	}
 }
+
+// The callback API of libsamplerate accepts a new ratio with each call, so no special setup is needed.
+void SamplerateAdapter::setOutputRateAdjustment(double factor) {
+	outputToInputRatio = nominalOutputToInputRatio * factor;
+	inputToOutputRatio = 1.0 / outputToInputRatio;
+}
+
+size_t SamplerateAdapter::getAllocatedMemorySize() const {
+	return sizeof(*this) + CHANNEL_COUNT * MAX_SAMPLES_PER_RUN * sizeof(float);
+}
@@ -31,13 +31,17 @@ public:
 	~SamplerateAdapter();
 
 	void getOutputSamples(float *outBuffer, unsigned int length);
+	void setOutputRateAdjustment(double factor);
+	// The state of libsamplerate is not accounted, as the library doesn't report it.
+	size_t getAllocatedMemorySize() const;
 
 private:
 	Synth &synth;
 	float * const inBuffer;
 	unsigned int inBufferSize;
-	const double inputToOutputRatio;
-	const double outputToInputRatio;
+	const double nominalOutputToInputRatio;
+	double inputToOutputRatio;
+	double outputToInputRatio;
 	SRC_STATE *resampler;
 
 	static long getInputSamples(void *cb_data, float **data);
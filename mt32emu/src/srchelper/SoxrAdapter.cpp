@@ -30,7 +30,7 @@ size_t SoxrAdapter::getInputSamples(void *input_fn_state, soxr_in_t *data, size_
 	return length;
 }
 
-SoxrAdapter::SoxrAdapter(Synth &useSynth, double targetSampleRate, SamplerateConversionQuality quality) :
+SoxrAdapter::SoxrAdapter(Synth &useSynth, double targetSampleRate, SamplerateConversionQuality quality, bool minimumPhase) :
 	synth(useSynth),
 	inBuffer(new float[CHANNEL_COUNT * MAX_SAMPLES_PER_RUN])
 {
@@ -51,6 +51,7 @@ SoxrAdapter::SoxrAdapter(Synth &useSynth, double targetSampleRate, SamplerateCon
 		qualityRecipe = SOXR_16_BITQ;
 		break;
 	};
+	if (minimumPhase) qualityRecipe |= SOXR_MINIMUM_PHASE;
 	soxr_quality_spec_t qSpec = soxr_quality_spec(qualityRecipe, 0);
 	soxr_runtime_spec_t rtSpec = soxr_runtime_spec(1);
 	soxr_error_t error;
@@ -104,3 +105,11 @@ void SoxrAdapter::getOutputSamples(float *buffer, unsigned int length) {
 		length -= static_cast<unsigned int>(gotFrames);
 	}
 }
+
+double SoxrAdapter::getLatency() const {
+	return resampler != NULL ? soxr_delay(resampler) : 0.0;
+}
+
+size_t SoxrAdapter::getAllocatedMemorySize() const {
+	return sizeof(*this) + CHANNEL_COUNT * MAX_SAMPLES_PER_RUN * sizeof(float);
+}
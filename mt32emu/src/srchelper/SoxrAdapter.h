@@ -27,10 +27,13 @@ class Synth;
 
 class SoxrAdapter {
 public:
-	SoxrAdapter(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality);
+	SoxrAdapter(Synth &synth, double targetSampleRate, SamplerateConversionQuality quality, bool minimumPhase);
 	~SoxrAdapter();
 
 	void getOutputSamples(float *buffer, unsigned int length);
+	double getLatency() const;
+	// The state of libsoxr is not accounted, as the library doesn't report it.
+	size_t getAllocatedMemorySize() const;
 
 private:
 	Synth &synth;
@@ -23,43 +23,81 @@ namespace SRCTools {
 
 typedef FloatSample FIRCoefficient;
 
-static const unsigned int FIR_INTERPOLATOR_CHANNEL_COUNT = 2;
+// Filter coefficients rearranged for polyphase FIR resampling. The kernel is immutable once created,
+// so it may be shared by multiple FIRResampler instances.
+struct FIRPolyphaseKernel {
+	// Filter coefficients rearranged in a separate row per phase, so that each row applies to a contiguous span
+	// of the delay line, the oldest sample first. When phase interpolation is used, an extra row follows
+	// which is the phase 0 row shifted by one sample.
+	const FIRCoefficient *phaseTaps;
+	// Indicates whether to interpolate filter taps
+	bool usePhaseInterpolation;
+	// Number of elements in each phase row, padded to a multiple of the SIMD vector length
+	unsigned int rowLength;
+	// Upsampling factor
+	unsigned int numberOfPhases;
+	// Downsampling factor
+	double phaseIncrement;
+	// Group delay of the kernel at low frequencies, measured in samples at the upsampled rate
+	double groupDelay;
+
+	// Unless forcePhaseInterpolation is set, the taps are only interpolated when the downsampling factor is fractional.
+	FIRPolyphaseKernel(const unsigned int upsampleFactor, const double downsampleFactor, const FIRCoefficient kernel[], const unsigned int kernelLength, const bool forcePhaseInterpolation = false);
+	~FIRPolyphaseKernel();
+
+	size_t getAllocatedMemorySize() const;
+};
 
 class FIRResampler : public ResamplerStage {
 public:
-	FIRResampler(const unsigned int upsampleFactor, const double downsampleFactor, const FIRCoefficient kernel[], const unsigned int kernelLength);
+	typedef void (*KernelReleaser)(const FIRPolyphaseKernel &kernel);
+
+	FIRResampler(const unsigned int upsampleFactor, const double downsampleFactor, const FIRCoefficient kernel[], const unsigned int kernelLength, const unsigned int channelCount = DEFAULT_CHANNEL_COUNT);
+	// Creates an instance that uses a shared kernel. The kernel is handed over to releaseKernel upon destruction.
+	FIRResampler(const FIRPolyphaseKernel &kernel, KernelReleaser releaseKernel, const unsigned int channelCount = DEFAULT_CHANNEL_COUNT);
 	~FIRResampler();
 
+	// Enables or disables the use of SIMD instructions for all instances, e.g. for benchmarking. The output is the same
+	// either way. Enabled by default when supported by the build. Must not be invoked while any instance is processing.
+	static void setSIMDEnabled(const bool enabled);
+
 	void process(const FloatSample *&inSamples, unsigned int &inLength, FloatSample *&outSamples, unsigned int &outLength);
 	unsigned int estimateInLength(const unsigned int outLength) const;
+	// Only effective when the kernel interpolates the filter taps, as the output can't be delayed by a fraction of a phase otherwise.
+	void setOutputRateAdjustment(const double factor);
+	double getOutputToInputRatio() const;
+	double getLatency() const;
+	// The kernel is only accounted when owned by the resampler, since the cached kernels are shared.
+	size_t getAllocatedMemorySize() const;
 
 private:
-	const struct Constants {
-		// Filter coefficients
-		const FIRCoefficient *taps;
-		// Indicates whether to interpolate filter taps
-		bool usePhaseInterpolation;
-		// Size of array of filter coefficients
-		unsigned int numberOfTaps;
-		// Upsampling factor
-		unsigned int numberOfPhases;
-		// Downsampling factor
-		double phaseIncrement;
-		// Index of last delay line element, generally greater than numberOfTaps to form a proper binary mask
-		unsigned int delayLineMask;
-		// Delay line
-		FloatSample(*ringBuffer)[FIR_INTERPOLATOR_CHANNEL_COUNT];
-
-		Constants(const unsigned int upsampleFactor, const double downsampleFactor, const FIRCoefficient kernel[], const unsigned int kernelLength);
-	} constants;
-	// Index of current sample in delay line
-	unsigned int ringBufferPosition;
+	typedef void (FIRResampler::*FixedRatioProcessor)(const FloatSample *&inSamples, unsigned int &inLength, FloatSample *&outSamples, unsigned int &outLength);
+
+	const FIRPolyphaseKernel &kernel;
+	const KernelReleaser releaseKernel;
+	// Number of interleaved channels
+	const unsigned int channelCount;
+	// Delay line per channel, each sample is stored twice in order to always keep the last rowLength samples contiguous
+	FloatSample *delayLine[MAX_CHANNEL_COUNT];
+	// Index of the oldest sample in delay line
+	unsigned int delayLinePosition;
 	// Current phase
 	double phase;
+	// Phase advance per output sample, deviates from the kernel's downsampling factor when the output rate is adjusted
+	double phaseIncrement;
+	// Specialised loop for the kernel's resampling ratio, NULL if the ratio is fractional or uncommon
+	FixedRatioProcessor fixedRatioProcessor;
+	// Deinterleaved input samples preceded by the contents of the delay line, for each channel, used by fixedRatioProcessor
+	FloatSample *blockBuffer;
+
+	static FixedRatioProcessor getFixedRatioProcessor(const FIRPolyphaseKernel &kernel);
 
+	void initDelayLine();
 	bool needNextInSample() const;
 	void addInSamples(const FloatSample *&inSamples);
-	void getOutSamplesStereo(FloatSample *&outSamples);
+	void getOutSamples(FloatSample *&outSamples);
+	template <unsigned int PHASE_COUNT, unsigned int PHASE_INCREMENT>
+	void processFixedRatio(const FloatSample *&inSamples, unsigned int &inLength, FloatSample *&outSamples, unsigned int &outLength);
 }; // class FIRResampler
 
 } // namespace SRCTools
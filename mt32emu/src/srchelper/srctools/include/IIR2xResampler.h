@@ -21,13 +21,16 @@
 
 namespace SRCTools {
 
-static const unsigned int IIR_RESAMPER_CHANNEL_COUNT = 2;
 static const unsigned int IIR_SECTION_ORDER = 2;
 
+// Number of 2nd-order sections processed in parallel, which fit a SIMD register.
+static const unsigned int IIR_SECTION_GROUP_SIZE = 4;
+
 typedef FloatSample IIRCoefficient;
 typedef FloatSample BufferedSample;
 
-typedef BufferedSample SectionBuffer[IIR_SECTION_ORDER];
+// Delay line of a group of sections, each element holds the samples of all the sections in the group.
+typedef BufferedSample SectionGroupBuffer[IIR_SECTION_ORDER][IIR_SECTION_GROUP_SIZE];
 
 // Non-trivial coefficients of a 2nd-order section of a parallel bank
 // (zero-order numerator coefficient is always zero, zero-order denominator coefficient is always unity)
@@ -38,6 +41,16 @@ struct IIRSection {
 	IIRCoefficient den2;
 };
 
+// Coefficients of a group of sections rearranged so that each row holds the same coefficient of all the sections in the group.
+// The input bias is zero for the sections that pad the last group, so that their output remains zero.
+struct IIRSectionGroup {
+	IIRCoefficient num1[IIR_SECTION_GROUP_SIZE];
+	IIRCoefficient num2[IIR_SECTION_GROUP_SIZE];
+	IIRCoefficient den1[IIR_SECTION_GROUP_SIZE];
+	IIRCoefficient den2[IIR_SECTION_GROUP_SIZE];
+	BufferedSample bias[IIR_SECTION_GROUP_SIZE];
+};
+
 class IIRResampler : public ResamplerStage {
 public:
 	enum Quality {
@@ -54,45 +67,65 @@ public:
 	// Returns the retained fraction of the passband for the given standard quality value
 	static double getPassbandFractionForQuality(Quality quality);
 
+	// Returns the number of 2nd-order sections of the filter for the given standard quality value
+	static unsigned int getSectionsCountForQuality(Quality quality);
+
+	// Enables or disables the use of SIMD instructions for all instances, e.g. for benchmarking. The output is the same
+	// either way. Enabled by default when supported by the build. Must not be invoked while any instance is processing.
+	static void setSIMDEnabled(const bool enabled);
+
 protected:
-	explicit IIRResampler(const Quality quality);
-	explicit IIRResampler(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[]);
+	IIRResampler(const Quality quality, const unsigned int channelCount);
+	IIRResampler(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[], const unsigned int channelCount);
 	~IIRResampler();
 
+	// Returns the size of the sections and the delay lines.
+	size_t getConstantsMemorySize() const;
+
 	const struct Constants {
 		// Coefficient of the 0-order FIR part
 		IIRCoefficient fir;
-		// 2nd-order sections that comprise a parallel bank
-		const IIRSection *sections;
-		// Number of 2nd-order sections
-		unsigned int sectionsCount;
-		// Delay line per channel per section
-		SectionBuffer *buffer;
-
-		Constants(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[], const Quality quality);
+		// 2nd-order sections that comprise a parallel bank, arranged in groups
+		IIRSectionGroup *sectionGroups;
+		// Number of groups of 2nd-order sections
+		unsigned int sectionGroupsCount;
+		// Number of interleaved channels
+		unsigned int channelCount;
+		// Delay line per channel per group of sections
+		SectionGroupBuffer *buffer;
+		// Group delay of the filter at low frequencies, measured in samples at the higher sample rate
+		double groupDelay;
+
+		Constants(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[], const Quality quality, const unsigned int channelCount);
 	} constants;
 }; // class IIRResampler
 
 class IIR2xInterpolator : public IIRResampler {
 public:
-	explicit IIR2xInterpolator(const Quality quality);
-	explicit IIR2xInterpolator(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[]);
+	explicit IIR2xInterpolator(const Quality quality, const unsigned int channelCount = DEFAULT_CHANNEL_COUNT);
+	IIR2xInterpolator(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[], const unsigned int channelCount = DEFAULT_CHANNEL_COUNT);
 
 	void process(const FloatSample *&inSamples, unsigned int &inLength, FloatSample *&outSamples, unsigned int &outLength);
 	unsigned int estimateInLength(const unsigned int outLength) const;
+	double getOutputToInputRatio() const;
+	double getLatency() const;
+	size_t getAllocatedMemorySize() const;
 
 private:
-	FloatSample lastInputSamples[IIR_RESAMPER_CHANNEL_COUNT];
+	FloatSample lastInputSamples[MAX_CHANNEL_COUNT];
 	unsigned int phase;
 };
 
 class IIR2xDecimator : public IIRResampler {
 public:
-	explicit IIR2xDecimator(const Quality quality);
-	explicit IIR2xDecimator(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[]);
+	explicit IIR2xDecimator(const Quality quality, const unsigned int channelCount = DEFAULT_CHANNEL_COUNT);
+	IIR2xDecimator(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[], const unsigned int channelCount = DEFAULT_CHANNEL_COUNT);
 
 	void process(const FloatSample *&inSamples, unsigned int &inLength, FloatSample *&outSamples, unsigned int &outLength);
 	unsigned int estimateInLength(const unsigned int outLength) const;
+	double getOutputToInputRatio() const;
+	double getLatency() const;
+	size_t getAllocatedMemorySize() const;
 };
 
 } // namespace SRCTools
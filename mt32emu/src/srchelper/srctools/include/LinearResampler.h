@@ -21,20 +21,23 @@
 
 namespace SRCTools {
 
-static const unsigned int LINEAR_RESAMPER_CHANNEL_COUNT = 2;
-
 class LinearResampler : public ResamplerStage {
 public:
-	LinearResampler(double sourceSampleRate, double targetSampleRate);
+	LinearResampler(double sourceSampleRate, double targetSampleRate, const unsigned int channelCount = DEFAULT_CHANNEL_COUNT);
 	~LinearResampler() {}
 
 	unsigned int estimateInLength(const unsigned int outLength) const;
 	void process(const FloatSample *&inSamples, unsigned int &inLength, FloatSample *&outSamples, unsigned int &outLength);
+	void setOutputRateAdjustment(const double factor);
+	double getOutputToInputRatio() const;
+	size_t getAllocatedMemorySize() const;
 
 private:
-	const double inputToOutputRatio;
+	const double nominalInputToOutputRatio;
+	double inputToOutputRatio;
+	const unsigned int channelCount;
 	double position;
-	FloatSample lastInputSamples[LINEAR_RESAMPER_CHANNEL_COUNT];
+	FloatSample lastInputSamples[MAX_CHANNEL_COUNT];
 };
 
 } // namespace SRCTools
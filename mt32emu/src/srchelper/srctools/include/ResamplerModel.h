@@ -17,12 +17,10 @@
 #ifndef SRCTOOLS_RESAMPLER_MODEL_H
 #define SRCTOOLS_RESAMPLER_MODEL_H
 
-#include "FloatSampleProvider.h"
+#include "ResamplerStage.h"
 
 namespace SRCTools {
 
-class ResamplerStage;
-
 /** Model consists of one or more ResampleStage instances connected in a cascade. */
 namespace ResamplerModel {
 
@@ -50,12 +48,31 @@ enum Quality {
 	BEST
 };
 
-FloatSampleProvider &createResamplerModel(FloatSampleProvider &source, double sourceSampleRate, double targetSampleRate, Quality quality);
-FloatSampleProvider &createResamplerModel(FloatSampleProvider &source, ResamplerStage **stages, unsigned int stageCount);
-FloatSampleProvider &createResamplerModel(FloatSampleProvider &source, ResamplerStage &stage);
+// The source provides channelCount interleaved channels, the stages must be created for the same number of channels.
+// A variable ratio model always contains exactly one stage which output rate can be adjusted with setOutputRateAdjustment(),
+// even if the sample rates are equal or differ by a factor of 2, so it is more costly in such cases.
+// When minimumPhase is set, the windowed sinc stage uses a minimum-phase kernel to reduce the latency, see SincResampler.
+FloatSampleProvider &createResamplerModel(FloatSampleProvider &source, double sourceSampleRate, double targetSampleRate, Quality quality, unsigned int channelCount = DEFAULT_CHANNEL_COUNT, bool variableRatio = false, bool minimumPhase = false);
+FloatSampleProvider &createResamplerModel(FloatSampleProvider &source, ResamplerStage **stages, unsigned int stageCount, unsigned int channelCount = DEFAULT_CHANNEL_COUNT);
+FloatSampleProvider &createResamplerModel(FloatSampleProvider &source, ResamplerStage &stage, unsigned int channelCount = DEFAULT_CHANNEL_COUNT);
 
 void freeResamplerModel(FloatSampleProvider &model, FloatSampleProvider &source);
 
+// Returns the estimated number of multiply-accumulate operations per output sample of each channel performed by the model
+// created by createResamplerModel() with the same parameters. Intended for comparing the cost of alternative conversions.
+double estimateCost(double sourceSampleRate, double targetSampleRate, Quality quality, bool variableRatio = false);
+
+// Scales the output sample rate of the model by the factor, which should stay close to 1. Has no effect unless the model
+// was created with variableRatio set. Intended for compensating the clock drift of an audio device in a control loop.
+void setOutputRateAdjustment(FloatSampleProvider &model, FloatSampleProvider &source, double factor);
+
+// Returns the group delay the model introduces at low frequencies, measured in output samples. This is the sum of the latencies
+// reported by the stages, each scaled to the output sample rate of the model.
+double getLatency(FloatSampleProvider &model, FloatSampleProvider &source);
+
+// Returns the amount of memory allocated by the model, i.e. by the stages along with their buffers, excluding the source.
+size_t getAllocatedMemorySize(FloatSampleProvider &model, FloatSampleProvider &source);
+
 } // namespace ResamplerModel
 
 } // namespace SRCTools
@@ -17,10 +17,18 @@
 #ifndef SRCTOOLS_RESAMPLER_STAGE_H
 #define SRCTOOLS_RESAMPLER_STAGE_H
 
+#include <cstddef>
+
 #include "FloatSampleProvider.h"
 
 namespace SRCTools {
 
+/** Maximum number of interleaved channels a resampler stage can process, sufficient for the six DAC output streams. */
+static const unsigned int MAX_CHANNEL_COUNT = 6;
+
+/** Number of interleaved channels processed unless specified otherwise, i.e. a stereo stream. */
+static const unsigned int DEFAULT_CHANNEL_COUNT = 2;
+
 /** Interface defines an abstract source of samples. It can either define a single channel stream or a stream with interleaved channels. */
 class ResamplerStage {
 public:
@@ -31,6 +39,27 @@ public:
 
 	/** Generates output samples. The arguments are adjusted in accordance with the number of samples processed. */
 	virtual void process(const FloatSample *&inSamples, unsigned int &inLength, FloatSample *&outSamples, unsigned int &outLength) = 0;
+
+	/**
+	 * Scales the output sample rate the stage was created for by the specified factor, taking effect with the next output sample.
+	 * The factor is meant to stay close to 1, so that the filter characteristics remain valid. Stages that only support
+	 * fixed resampling ratios ignore the adjustment.
+	 */
+	virtual void setOutputRateAdjustment(const double) {}
+
+	/** Returns the nominal ratio of the output sample rate to the input sample rate. */
+	virtual double getOutputToInputRatio() const = 0;
+
+	/**
+	 * Returns the group delay the stage introduces at low frequencies, measured in output samples. Intended for estimating
+	 * the latency of the signal passing through a cascade of stages, see ResamplerModel::getLatency().
+	 */
+	virtual double getLatency() const {
+		return 0.0;
+	}
+
+	/** Returns the amount of memory allocated by the stage, apart from the data it shares with other stages. */
+	virtual size_t getAllocatedMemorySize() const = 0;
 };
 
 } // namespace SRCTools
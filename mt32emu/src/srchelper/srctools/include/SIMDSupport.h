@@ -0,0 +1,33 @@
+/* Copyright (C) 2015-2020 Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SRCTOOLS_SIMD_SUPPORT_H
+#define SRCTOOLS_SIMD_SUPPORT_H
+
+// SSE2 is used by the resampler stages unless SRCTOOLS_USE_SIMD is defined to 0.
+#ifndef SRCTOOLS_USE_SIMD
+#define SRCTOOLS_USE_SIMD 1
+#endif
+
+#if SRCTOOLS_USE_SIMD
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SRCTOOLS_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+#endif // #if SRCTOOLS_USE_SIMD
+
+#endif // SRCTOOLS_SIMD_SUPPORT_H
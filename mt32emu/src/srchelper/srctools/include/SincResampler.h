@@ -25,11 +25,30 @@ class ResamplerStage;
 
 namespace SincResampler {
 
-	ResamplerStage *createSincResampler(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor);
+	// When variableRatio is set, the filter taps are interpolated between maxUpsampleFactor phases regardless of the ratio
+	// of the frequencies, so that the output frequency of the resampler can be adjusted while running (see ResamplerStage).
+	// When minimumPhase is set, the kernel is converted to the minimum-phase one with the same magnitude response. It delays
+	// the signal much less than the linear-phase kernel, which is symmetric and thus delays by half its length, yet the phase
+	// response becomes non-linear in the vicinity of the transition band. Intended for live playing.
+	ResamplerStage *createSincResampler(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const unsigned int channelCount = DEFAULT_CHANNEL_COUNT, const bool variableRatio = false, const bool minimumPhase = false);
+
+	// Creates a resampler stage that also applies the given prefilter to the input signal within the same FIR pass.
+	// The prefilter kernel is specified at the input frequency multiplied by prefilterUpsampleFactor, as though applied
+	// to the input upsampled by zero-stuffing. The prefilter images above that rate must lie in the stopband.
+	// With minimumPhase set, the combined kernel is converted, so the prefilter only retains its phase response
+	// if it's minimum-phase itself, like the models of analogue filters are.
+	ResamplerStage *createSincResampler(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const FIRCoefficient prefilterKernel[], const unsigned int prefilterLength, const unsigned int prefilterUpsampleFactor, const unsigned int channelCount = DEFAULT_CHANNEL_COUNT, const bool variableRatio = false, const bool minimumPhase = false);
+
+	// Returns the number of FIR taps computed per output sample of each channel by the resampler created with the same parameters,
+	// without designing the kernel. Intended for comparing the cost of alternative resampler models.
+	unsigned int estimateTapsPerOutputSample(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const unsigned int prefilterLength = 1, const unsigned int prefilterUpsampleFactor = 1, const bool variableRatio = false);
 
 	namespace Utils {
 		void computeResampleFactors(unsigned int &upsampleFactor, double &downsampleFactor, const double inputFrequency, const double outputFrequency, const unsigned int maxUpsampleFactor);
 		unsigned int greatestCommonDivisor(unsigned int a, unsigned int b);
+		void convolve(FIRCoefficient result[], const FIRCoefficient kernelA[], const unsigned int lengthA, const FIRCoefficient kernelB[], const unsigned int lengthB, const unsigned int strideB);
+		void fft(double re[], double im[], const unsigned int size, const bool inverse);
+		void convertToMinimumPhase(FIRCoefficient kernel[], const unsigned int length);
 	}
 
 	namespace KaizerWindow {
@@ -18,36 +18,155 @@
 #include <cstring>
 
 #include "../include/FIRResampler.h"
+#include "../include/SIMDSupport.h"
 
 using namespace SRCTools;
 
-FIRResampler::Constants::Constants(const unsigned int upsampleFactor, const double downsampleFactor, const FIRCoefficient kernel[], const unsigned int kernelLength) {
-	usePhaseInterpolation = downsampleFactor != floor(downsampleFactor);
-	FIRCoefficient *kernelCopy = new FIRCoefficient[kernelLength];
-	memcpy(kernelCopy, kernel, kernelLength * sizeof(FIRCoefficient));
-	taps = kernelCopy;
-	numberOfTaps = kernelLength;
+// Phase rows are padded to fit a whole number of 8-float (AVX) vectors.
+static const unsigned int ROW_LENGTH_GRANULARITY = 8;
+
+static bool simdEnabled = true;
+
+// Maximum number of input samples per channel deinterleaved at once by the fixed ratio loops.
+static const unsigned int FIXED_RATIO_BLOCK_LENGTH = 240;
+
+// Computes the dot products of a phase row with the delay lines of both channels. The products are summed
+// in four interleaved partial sums, exactly as in the SIMD versions, so that the output doesn't depend
+// on the instruction set used.
+static inline void dotProductStereoScalar(const FIRCoefficient *taps, const FloatSample *leftSamples, const FloatSample *rightSamples, const unsigned int length, FloatSample &leftSample, FloatSample &rightSample) {
+	FloatSample leftSums[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	FloatSample rightSums[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (unsigned int i = 0; i < length; i += 4) {
+		for (unsigned int j = 0; j < 4; j++) {
+			leftSums[j] += taps[i + j] * leftSamples[i + j];
+			rightSums[j] += taps[i + j] * rightSamples[i + j];
+		}
+	}
+	leftSample = (leftSums[0] + leftSums[2]) + (leftSums[1] + leftSums[3]);
+	rightSample = (rightSums[0] + rightSums[2]) + (rightSums[1] + rightSums[3]);
+}
+
+static inline void dotProductStereo(const FIRCoefficient *taps, const FloatSample *leftSamples, const FloatSample *rightSamples, const unsigned int length, FloatSample &leftSample, FloatSample &rightSample) {
+#if SRCTOOLS_SIMD_SSE2
+	if (!simdEnabled) {
+		dotProductStereoScalar(taps, leftSamples, rightSamples, length, leftSample, rightSample);
+		return;
+	}
+	__m128 leftSums = _mm_setzero_ps();
+	__m128 rightSums = _mm_setzero_ps();
+	for (unsigned int i = 0; i < length; i += 4) {
+		const __m128 tapVector = _mm_loadu_ps(taps + i);
+		leftSums = _mm_add_ps(leftSums, _mm_mul_ps(tapVector, _mm_loadu_ps(leftSamples + i)));
+		rightSums = _mm_add_ps(rightSums, _mm_mul_ps(tapVector, _mm_loadu_ps(rightSamples + i)));
+	}
+	leftSums = _mm_add_ps(leftSums, _mm_movehl_ps(leftSums, leftSums));
+	rightSums = _mm_add_ps(rightSums, _mm_movehl_ps(rightSums, rightSums));
+	leftSample = _mm_cvtss_f32(_mm_add_ss(leftSums, _mm_shuffle_ps(leftSums, leftSums, 1)));
+	rightSample = _mm_cvtss_f32(_mm_add_ss(rightSums, _mm_shuffle_ps(rightSums, rightSums, 1)));
+#else
+	dotProductStereoScalar(taps, leftSamples, rightSamples, length, leftSample, rightSample);
+#endif
+}
+
+static void deleteKernel(const FIRPolyphaseKernel &kernel) {
+	delete &kernel;
+}
+
+FIRPolyphaseKernel::FIRPolyphaseKernel(const unsigned int upsampleFactor, const double downsampleFactor, const FIRCoefficient kernel[], const unsigned int kernelLength, const bool forcePhaseInterpolation) {
+	usePhaseInterpolation = forcePhaseInterpolation || downsampleFactor != floor(downsampleFactor);
 	numberOfPhases = upsampleFactor;
 	phaseIncrement = downsampleFactor;
-	unsigned int minDelayLineLength = static_cast<unsigned int>(ceil(double(kernelLength) / upsampleFactor));
-	unsigned int delayLineLength = 2;
-	while (delayLineLength < minDelayLineLength) delayLineLength <<= 1;
-	delayLineMask = delayLineLength - 1;
-	ringBuffer = new FloatSample[delayLineLength][FIR_INTERPOLATOR_CHANNEL_COUNT];
-	FloatSample *s = *ringBuffer;
-	FloatSample *e = ringBuffer[delayLineLength];
-	while (s < e) *(s++) = 0;
-}
-
-FIRResampler::FIRResampler(const unsigned int upsampleFactor, const double downsampleFactor, const FIRCoefficient kernel[], const unsigned int kernelLength) :
-	constants(upsampleFactor, downsampleFactor, kernel, kernelLength),
-	ringBufferPosition(0),
-	phase(constants.numberOfPhases)
-{}
+	const unsigned int tapsPerPhase = (kernelLength + upsampleFactor - 1) / upsampleFactor;
+	rowLength = (tapsPerPhase + ROW_LENGTH_GRANULARITY - 1) / ROW_LENGTH_GRANULARITY * ROW_LENGTH_GRANULARITY;
+	// The k-th newest sample is multiplied by the tap k * numberOfPhases + phase. The extra row for phase interpolation
+	// conforms to this as well, as phase numberOfPhases corresponds to phase 0 for the preceding sample.
+	const unsigned int rowCount = usePhaseInterpolation ? numberOfPhases + 1 : numberOfPhases;
+	FIRCoefficient *rows = new FIRCoefficient[rowCount * rowLength];
+	for (unsigned int rowIx = 0; rowIx < rowCount; rowIx++) {
+		FIRCoefficient *row = rows + rowIx * rowLength;
+		for (unsigned int delaySampleIx = 0; delaySampleIx < rowLength; delaySampleIx++) {
+			const unsigned int tapIx = rowIx + delaySampleIx * numberOfPhases;
+			row[rowLength - 1 - delaySampleIx] = tapIx < kernelLength ? kernel[tapIx] : 0;
+		}
+	}
+	phaseTaps = rows;
+	double tapSum = 0.0;
+	double weightedTapSum = 0.0;
+	for (unsigned int tapIx = 0; tapIx < kernelLength; tapIx++) {
+		tapSum += kernel[tapIx];
+		weightedTapSum += double(tapIx) * kernel[tapIx];
+	}
+	groupDelay = tapSum != 0.0 ? weightedTapSum / tapSum : 0.0;
+}
+
+FIRPolyphaseKernel::~FIRPolyphaseKernel() {
+	delete[] phaseTaps;
+}
+
+size_t FIRPolyphaseKernel::getAllocatedMemorySize() const {
+	const unsigned int rowCount = usePhaseInterpolation ? numberOfPhases + 1 : numberOfPhases;
+	return sizeof(*this) + rowCount * rowLength * sizeof(FIRCoefficient);
+}
+
+FIRResampler::FIRResampler(const unsigned int upsampleFactor, const double downsampleFactor, const FIRCoefficient useKernel[], const unsigned int kernelLength, const unsigned int useChannelCount) :
+	kernel(*new FIRPolyphaseKernel(upsampleFactor, downsampleFactor, useKernel, kernelLength)),
+	releaseKernel(deleteKernel),
+	channelCount(useChannelCount)
+{
+	initDelayLine();
+}
+
+FIRResampler::FIRResampler(const FIRPolyphaseKernel &useKernel, KernelReleaser useReleaseKernel, const unsigned int useChannelCount) :
+	kernel(useKernel),
+	releaseKernel(useReleaseKernel),
+	channelCount(useChannelCount)
+{
+	initDelayLine();
+}
 
 FIRResampler::~FIRResampler() {
-	delete[] constants.ringBuffer;
-	delete[] constants.taps;
+	for (unsigned int i = 0; i < channelCount; i++) {
+		delete[] delayLine[i];
+	}
+	delete[] blockBuffer;
+	releaseKernel(kernel);
+}
+
+void FIRResampler::initDelayLine() {
+	for (unsigned int i = 0; i < channelCount; i++) {
+		delayLine[i] = new FloatSample[2 * kernel.rowLength];
+		memset(delayLine[i], 0, 2 * kernel.rowLength * sizeof(FloatSample));
+	}
+	delayLinePosition = 0;
+	phase = kernel.numberOfPhases;
+	phaseIncrement = kernel.phaseIncrement;
+	fixedRatioProcessor = getFixedRatioProcessor(kernel);
+	blockBuffer = fixedRatioProcessor == NULL ? NULL : new FloatSample[channelCount * (kernel.rowLength + FIXED_RATIO_BLOCK_LENGTH)];
+}
+
+// Covers the kernels SincResampler designs for the common output sample rates 48, 64 and 96 kHz, both when the synth
+// output is resampled at 64 kHz after the IIR interpolator and when the analog LPF at 64 kHz is fused in the kernel.
+FIRResampler::FixedRatioProcessor FIRResampler::getFixedRatioProcessor(const FIRPolyphaseKernel &kernel) {
+	if (kernel.usePhaseInterpolation) return NULL;
+	const unsigned int phaseIncrement = static_cast<unsigned int>(kernel.phaseIncrement);
+	switch (kernel.numberOfPhases) {
+	case 2:
+		if (phaseIncrement == 1) return &FIRResampler::processFixedRatio<2, 1>;
+		break;
+	case 3:
+		if (phaseIncrement == 1) return &FIRResampler::processFixedRatio<3, 1>;
+		if (phaseIncrement == 2) return &FIRResampler::processFixedRatio<3, 2>;
+		if (phaseIncrement == 4) return &FIRResampler::processFixedRatio<3, 4>;
+		break;
+	case 6:
+		if (phaseIncrement == 3) return &FIRResampler::processFixedRatio<6, 3>;
+		break;
+	}
+	return NULL;
+}
+
+void FIRResampler::setSIMDEnabled(const bool enabled) {
+	simdEnabled = enabled;
 }
 
 void FIRResampler::process(const FloatSample *&inSamples, unsigned int &inLength, FloatSample *&outSamples, unsigned int &outLength) {
@@ -57,51 +176,122 @@ void FIRResampler::process(const FloatSample *&inSamples, unsigned int &inLength
 			addInSamples(inSamples);
 			--inLength;
 		}
-		getOutSamplesStereo(outSamples);
+		if (phase == 0 && fixedRatioProcessor != NULL) {
+			(this->*fixedRatioProcessor)(inSamples, inLength, outSamples, outLength);
+			if (outLength == 0) return;
+		}
+		getOutSamples(outSamples);
 		--outLength;
 	}
 }
 
 unsigned int FIRResampler::estimateInLength(const unsigned int outLength) const {
-	return static_cast<unsigned int>((outLength * constants.phaseIncrement + phase) / constants.numberOfPhases);
+	return static_cast<unsigned int>((outLength * phaseIncrement + phase) / kernel.numberOfPhases);
+}
+
+void FIRResampler::setOutputRateAdjustment(const double factor) {
+	if (kernel.usePhaseInterpolation) phaseIncrement = kernel.phaseIncrement / factor;
+}
+
+double FIRResampler::getOutputToInputRatio() const {
+	return kernel.numberOfPhases / kernel.phaseIncrement;
+}
+
+double FIRResampler::getLatency() const {
+	return kernel.groupDelay / kernel.phaseIncrement;
+}
+
+size_t FIRResampler::getAllocatedMemorySize() const {
+	size_t size = sizeof(*this) + channelCount * 2 * kernel.rowLength * sizeof(FloatSample);
+	if (blockBuffer != NULL) size += channelCount * (kernel.rowLength + FIXED_RATIO_BLOCK_LENGTH) * sizeof(FloatSample);
+	if (releaseKernel == deleteKernel) size += kernel.getAllocatedMemorySize();
+	return size;
 }
 
 bool FIRResampler::needNextInSample() const {
-	return constants.numberOfPhases <= phase;
+	return kernel.numberOfPhases <= phase;
 }
 
 void FIRResampler::addInSamples(const FloatSample *&inSamples) {
-	ringBufferPosition = (ringBufferPosition - 1) & constants.delayLineMask;
-	for (unsigned int i = 0; i < FIR_INTERPOLATOR_CHANNEL_COUNT; i++) {
-		constants.ringBuffer[ringBufferPosition][i] = *(inSamples++);
+	for (unsigned int i = 0; i < channelCount; i++) {
+		const FloatSample sample = *(inSamples++);
+		delayLine[i][delayLinePosition] = sample;
+		delayLine[i][delayLinePosition + kernel.rowLength] = sample;
 	}
-	phase -= constants.numberOfPhases;
-}
-
-// Optimised for processing stereo interleaved streams
-void FIRResampler::getOutSamplesStereo(FloatSample *&outSamples) {
-	FloatSample leftSample = 0.0;
-	FloatSample rightSample = 0.0;
-	unsigned int delaySampleIx = ringBufferPosition;
-	if (constants.usePhaseInterpolation) {
-		double phaseFraction = phase - floor(phase);
-		unsigned int maxTapIx = phaseFraction == 0 ? constants.numberOfTaps : constants.numberOfTaps - 1;
-		for (unsigned int tapIx = static_cast<unsigned int>(phase); tapIx < maxTapIx; tapIx += constants.numberOfPhases) {
-			FIRCoefficient tap = FIRCoefficient(constants.taps[tapIx] + (constants.taps[tapIx + 1] - constants.taps[tapIx]) * phaseFraction);
-			leftSample += tap * constants.ringBuffer[delaySampleIx][0];
-			rightSample += tap * constants.ringBuffer[delaySampleIx][1];
-			delaySampleIx = (delaySampleIx + 1) & constants.delayLineMask;
+	if (++delayLinePosition == kernel.rowLength) delayLinePosition = 0;
+	phase -= kernel.numberOfPhases;
+}
+
+// The channels are processed in pairs, so that each phase row is only loaded once per pair. The phase is shared by all channels.
+void FIRResampler::getOutSamples(FloatSample *&outSamples) {
+	const unsigned int phaseIx = static_cast<unsigned int>(phase);
+	const FIRCoefficient *row = kernel.phaseTaps + phaseIx * kernel.rowLength;
+	const FloatSample phaseFraction = kernel.usePhaseInterpolation ? FloatSample(phase - phaseIx) : 0;
+	for (unsigned int chIx = 0; chIx < channelCount; chIx += 2) {
+		// With an odd number of channels, the last one is paired with itself.
+		const unsigned int nextChIx = chIx + 1 < channelCount ? chIx + 1 : chIx;
+		const FloatSample *leftSamples = delayLine[chIx] + delayLinePosition;
+		const FloatSample *rightSamples = delayLine[nextChIx] + delayLinePosition;
+		FloatSample leftSample, rightSample;
+		dotProductStereo(row, leftSamples, rightSamples, kernel.rowLength, leftSample, rightSample);
+		if (phaseFraction != 0) {
+			// Interpolating the taps linearly is equivalent to interpolating the outputs of the adjacent phases
+			FloatSample nextLeftSample, nextRightSample;
+			dotProductStereo(row + kernel.rowLength, leftSamples, rightSamples, kernel.rowLength, nextLeftSample, nextRightSample);
+			leftSample += (nextLeftSample - leftSample) * phaseFraction;
+			rightSample += (nextRightSample - rightSample) * phaseFraction;
 		}
-	} else {
-		// Optimised for rational resampling ratios when phase is always integer
-		for (unsigned int tapIx = static_cast<unsigned int>(phase); tapIx < constants.numberOfTaps; tapIx += constants.numberOfPhases) {
-			FIRCoefficient tap = constants.taps[tapIx];
-			leftSample += tap * constants.ringBuffer[delaySampleIx][0];
-			rightSample += tap * constants.ringBuffer[delaySampleIx][1];
-			delaySampleIx = (delaySampleIx + 1) & constants.delayLineMask;
+		*(outSamples++) = leftSample;
+		if (nextChIx != chIx) *(outSamples++) = rightSample;
+	}
+	phase += phaseIncrement;
+}
+
+// Starting at phase 0, the sequence of phases repeats after PHASE_COUNT output samples that consume PHASE_INCREMENT input
+// samples. Whole cycles are processed with the phases and the input sample counts known at compile time, leaving the phase
+// at 0 again. The input is deinterleaved in blocks into linear per-channel buffers that continue the delay line, so that
+// the dot products don't read the samples stored just before. The output is the same as of the generic loop in process().
+template <unsigned int PHASE_COUNT, unsigned int PHASE_INCREMENT>
+void FIRResampler::processFixedRatio(const FloatSample *&inSamples, unsigned int &inLength, FloatSample *&outSamples, unsigned int &outLength) {
+	const unsigned int rowLength = kernel.rowLength;
+	const unsigned int bufferStride = rowLength + FIXED_RATIO_BLOCK_LENGTH;
+	while (PHASE_COUNT <= outLength && PHASE_INCREMENT <= inLength) {
+		unsigned int cycleCount = FIXED_RATIO_BLOCK_LENGTH / PHASE_INCREMENT;
+		if (outLength / PHASE_COUNT < cycleCount) cycleCount = outLength / PHASE_COUNT;
+		if (inLength / PHASE_INCREMENT < cycleCount) cycleCount = inLength / PHASE_INCREMENT;
+		const unsigned int blockInLength = cycleCount * PHASE_INCREMENT;
+		for (unsigned int chIx = 0; chIx < channelCount; chIx++) {
+			FloatSample *buffer = blockBuffer + chIx * bufferStride;
+			memcpy(buffer, delayLine[chIx] + delayLinePosition, rowLength * sizeof(FloatSample));
+			for (unsigned int i = 0; i < blockInLength; i++) {
+				buffer[rowLength + i] = inSamples[i * channelCount + chIx];
+			}
+		}
+		inSamples += blockInLength * channelCount;
+		inLength -= blockInLength;
+		outLength -= cycleCount * PHASE_COUNT;
+
+		const FloatSample *window = blockBuffer;
+		for (unsigned int cycleIx = 0; cycleIx < cycleCount; cycleIx++) {
+			for (unsigned int outIx = 0; outIx < PHASE_COUNT; outIx++) {
+				const FIRCoefficient *row = kernel.phaseTaps + ((outIx * PHASE_INCREMENT) % PHASE_COUNT) * rowLength;
+				for (unsigned int chIx = 0; chIx < channelCount; chIx += 2) {
+					const unsigned int nextChIx = chIx + 1 < channelCount ? chIx + 1 : chIx;
+					FloatSample leftSample, rightSample;
+					dotProductStereo(row, window + chIx * bufferStride, window + nextChIx * bufferStride, rowLength, leftSample, rightSample);
+					*(outSamples++) = leftSample;
+					if (nextChIx != chIx) *(outSamples++) = rightSample;
+				}
+				window += ((outIx + 1) * PHASE_INCREMENT) / PHASE_COUNT - (outIx * PHASE_INCREMENT) / PHASE_COUNT;
+			}
+		}
+
+		// The most recent samples go back to the delay line, which restarts at position 0.
+		for (unsigned int chIx = 0; chIx < channelCount; chIx++) {
+			const FloatSample *recentSamples = blockBuffer + chIx * bufferStride + blockInLength;
+			memcpy(delayLine[chIx], recentSamples, rowLength * sizeof(FloatSample));
+			memcpy(delayLine[chIx] + rowLength, recentSamples, rowLength * sizeof(FloatSample));
 		}
+		delayLinePosition = 0;
 	}
-	*(outSamples++) = leftSample;
-	*(outSamples++) = rightSample;
-	phase += constants.phaseIncrement;
 }
@@ -17,6 +17,7 @@
 #include <cstddef>
 
 #include "../include/IIR2xResampler.h"
+#include "../include/SIMDSupport.h"
 
 namespace SRCTools {
 
@@ -57,12 +58,107 @@ namespace SRCTools {
 		{ 0.180604082285806f,-0.00467624342403851f,-1.093486919012100f, 0.844904524843996f }
 	};
 
-	static inline BufferedSample calcNumerator(const IIRSection &section, const BufferedSample buffer1, const BufferedSample buffer2) {
-		return section.num1 * buffer1 + section.num2 * buffer2;
+	static bool simdEnabled = true;
+
+	// The output of all sections in a group is summed in separate lanes, and the lanes are finally summed pairwise
+	// exactly as in the SIMD versions, so that the output doesn't depend on the instruction set used.
+	static inline BufferedSample sumLanes(const BufferedSample sums[]) {
+		return (sums[0] + sums[2]) + (sums[1] + sums[3]);
 	}
 
-	static inline BufferedSample calcDenominator(const IIRSection &section, const BufferedSample input, const BufferedSample buffer1, const BufferedSample buffer2) {
-		return input - section.den1 * buffer1 - section.den2 * buffer2;
+	// Computes the next output sample of the sections for 2x interpolation. The numerator reduces to a single multiplication
+	// by numCoefficients depending on the phase, the denominator output is stored in the delay line element newIx.
+	static BufferedSample interpolateScalar(const IIRSectionGroup *group, const unsigned int groupsCount, SectionGroupBuffer *buffer, const bool oddPhase, const FloatSample lastInputSample) {
+		const unsigned int newIx = oddPhase ? 0 : 1;
+		const unsigned int oldIx = 1 - newIx;
+		BufferedSample sums[IIR_SECTION_GROUP_SIZE] = { 0, 0, 0, 0 };
+		for (const IIRSectionGroup *groupsEnd = group + groupsCount; group < groupsEnd; group++, buffer++) {
+			const IIRCoefficient *numCoefficients = oddPhase ? group->num2 : group->num1;
+			for (unsigned int j = 0; j < IIR_SECTION_GROUP_SIZE; j++) {
+				const BufferedSample input = group->bias[j] + numCoefficients[j] * lastInputSample;
+				const BufferedSample denOutSample = input - group->den1[j] * (*buffer)[oldIx][j] - group->den2[j] * (*buffer)[newIx][j];
+				(*buffer)[newIx][j] = denOutSample;
+				sums[j] += denOutSample;
+			}
+		}
+		return sumLanes(sums);
+	}
+
+	// Computes the numerator output for the even output sample and advances the delay line by two input samples.
+	// The numerator is not calculated for odd output samples which are to be omitted.
+	static BufferedSample decimateScalar(const IIRSectionGroup *group, const unsigned int groupsCount, SectionGroupBuffer *buffer, const FloatSample inSample0, const FloatSample inSample1) {
+		BufferedSample sums[IIR_SECTION_GROUP_SIZE] = { 0, 0, 0, 0 };
+		for (const IIRSectionGroup *groupsEnd = group + groupsCount; group < groupsEnd; group++, buffer++) {
+			BufferedSample *buffer0 = (*buffer)[0];
+			BufferedSample *buffer1 = (*buffer)[1];
+			for (unsigned int j = 0; j < IIR_SECTION_GROUP_SIZE; j++) {
+				sums[j] += group->num1[j] * buffer0[j] + group->num2[j] * buffer1[j];
+				buffer1[j] = (group->bias[j] + inSample0) - group->den1[j] * buffer0[j] - group->den2[j] * buffer1[j];
+				buffer0[j] = (group->bias[j] + inSample1) - group->den1[j] * buffer1[j] - group->den2[j] * buffer0[j];
+			}
+		}
+		return sumLanes(sums);
+	}
+
+#if SRCTOOLS_SIMD_SSE2
+
+	static inline BufferedSample sumLanesSSE2(const __m128 sums) {
+		const __m128 pairSums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+		return _mm_cvtss_f32(_mm_add_ss(pairSums, _mm_shuffle_ps(pairSums, pairSums, 1)));
+	}
+
+	static BufferedSample interpolateSSE2(const IIRSectionGroup *group, const unsigned int groupsCount, SectionGroupBuffer *buffer, const bool oddPhase, const FloatSample lastInputSample) {
+		const unsigned int newIx = oddPhase ? 0 : 1;
+		const unsigned int oldIx = 1 - newIx;
+		const __m128 lastInputSamples = _mm_set1_ps(lastInputSample);
+		__m128 sums = _mm_setzero_ps();
+		for (const IIRSectionGroup *groupsEnd = group + groupsCount; group < groupsEnd; group++, buffer++) {
+			const __m128 numCoefficients = _mm_loadu_ps(oddPhase ? group->num2 : group->num1);
+			const __m128 input = _mm_add_ps(_mm_loadu_ps(group->bias), _mm_mul_ps(numCoefficients, lastInputSamples));
+			const __m128 oldSamples = _mm_mul_ps(_mm_loadu_ps(group->den1), _mm_loadu_ps((*buffer)[oldIx]));
+			const __m128 newSamples = _mm_mul_ps(_mm_loadu_ps(group->den2), _mm_loadu_ps((*buffer)[newIx]));
+			const __m128 denOutSamples = _mm_sub_ps(_mm_sub_ps(input, oldSamples), newSamples);
+			_mm_storeu_ps((*buffer)[newIx], denOutSamples);
+			sums = _mm_add_ps(sums, denOutSamples);
+		}
+		return sumLanesSSE2(sums);
+	}
+
+	static BufferedSample decimateSSE2(const IIRSectionGroup *group, const unsigned int groupsCount, SectionGroupBuffer *buffer, const FloatSample inSample0, const FloatSample inSample1) {
+		const __m128 inSamples0 = _mm_set1_ps(inSample0);
+		const __m128 inSamples1 = _mm_set1_ps(inSample1);
+		__m128 sums = _mm_setzero_ps();
+		for (const IIRSectionGroup *groupsEnd = group + groupsCount; group < groupsEnd; group++, buffer++) {
+			const __m128 num1 = _mm_loadu_ps(group->num1);
+			const __m128 num2 = _mm_loadu_ps(group->num2);
+			const __m128 den1 = _mm_loadu_ps(group->den1);
+			const __m128 den2 = _mm_loadu_ps(group->den2);
+			const __m128 bias = _mm_loadu_ps(group->bias);
+			const __m128 buffer0 = _mm_loadu_ps((*buffer)[0]);
+			const __m128 buffer1 = _mm_loadu_ps((*buffer)[1]);
+			sums = _mm_add_ps(sums, _mm_add_ps(_mm_mul_ps(num1, buffer0), _mm_mul_ps(num2, buffer1)));
+			const __m128 newBuffer1 = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(bias, inSamples0), _mm_mul_ps(den1, buffer0)), _mm_mul_ps(den2, buffer1));
+			const __m128 newBuffer0 = _mm_sub_ps(_mm_sub_ps(_mm_add_ps(bias, inSamples1), _mm_mul_ps(den1, newBuffer1)), _mm_mul_ps(den2, buffer0));
+			_mm_storeu_ps((*buffer)[0], newBuffer0);
+			_mm_storeu_ps((*buffer)[1], newBuffer1);
+		}
+		return sumLanesSSE2(sums);
+	}
+
+#endif // #if SRCTOOLS_SIMD_SSE2
+
+	static inline BufferedSample interpolate(const IIRSectionGroup *group, const unsigned int groupsCount, SectionGroupBuffer *buffer, const bool oddPhase, const FloatSample lastInputSample) {
+#if SRCTOOLS_SIMD_SSE2
+		if (simdEnabled) return interpolateSSE2(group, groupsCount, buffer, oddPhase, lastInputSample);
+#endif
+		return interpolateScalar(group, groupsCount, buffer, oddPhase, lastInputSample);
+	}
+
+	static inline BufferedSample decimate(const IIRSectionGroup *group, const unsigned int groupsCount, SectionGroupBuffer *buffer, const FloatSample inSample0, const FloatSample inSample1) {
+#if SRCTOOLS_SIMD_SSE2
+		if (simdEnabled) return decimateSSE2(group, groupsCount, buffer, inSample0, inSample1);
+#endif
+		return decimateScalar(group, groupsCount, buffer, inSample0, inSample1);
 	}
 
 } // namespace SRCTools
@@ -82,7 +178,27 @@ double IIRResampler::getPassbandFractionForQuality(Quality quality) {
 	}
 }
 
-IIRResampler::Constants::Constants(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[], const Quality quality) {
+unsigned int IIRResampler::getSectionsCountForQuality(Quality quality) {
+	switch (quality) {
+	case FAST:
+		return sizeof(SECTIONS_FAST) / sizeof(IIRSection);
+	case GOOD:
+		return sizeof(SECTIONS_GOOD) / sizeof(IIRSection);
+	case BEST:
+		return sizeof(SECTIONS_BEST) / sizeof(IIRSection);
+	default:
+		return 0;
+	}
+}
+
+void IIRResampler::setSIMDEnabled(const bool enabled) {
+	simdEnabled = enabled;
+}
+
+IIRResampler::Constants::Constants(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[], const Quality quality, const unsigned int useChannelCount) {
+	channelCount = useChannelCount;
+	unsigned int sectionsCount;
+	const IIRSection *sections;
 	if (quality == CUSTOM) {
 		sectionsCount = useSectionsCount;
 		fir = useFIR;
@@ -111,39 +227,69 @@ IIRResampler::Constants::Constants(const unsigned int useSectionsCount, const II
 		}
 		sectionsCount = (sectionsSize / sizeof(IIRSection));
 	}
-	const unsigned int delayLineSize = IIR_RESAMPER_CHANNEL_COUNT * sectionsCount;
-	buffer = new SectionBuffer[delayLineSize];
-	BufferedSample *s = buffer[0];
-	BufferedSample *e = buffer[delayLineSize];
+	sectionGroupsCount = (sectionsCount + IIR_SECTION_GROUP_SIZE - 1) / IIR_SECTION_GROUP_SIZE;
+	sectionGroups = new IIRSectionGroup[sectionGroupsCount];
+	for (unsigned int i = 0; i < sectionGroupsCount * IIR_SECTION_GROUP_SIZE; ++i) {
+		IIRSectionGroup &group = sectionGroups[i / IIR_SECTION_GROUP_SIZE];
+		const unsigned int j = i % IIR_SECTION_GROUP_SIZE;
+		const bool isPadding = sectionsCount <= i;
+		group.num1[j] = isPadding ? 0 : sections[i].num1;
+		group.num2[j] = isPadding ? 0 : sections[i].num2;
+		group.den1[j] = isPadding ? 0 : sections[i].den1;
+		group.den2[j] = isPadding ? 0 : sections[i].den2;
+		group.bias[j] = isPadding ? 0 : BIAS;
+	}
+	// The derivative of the phase response at DC, each section contributes the difference between the weighted means
+	// of its numerator and denominator coefficients, weighted by its DC gain.
+	double dcGain = fir;
+	double dcPhaseDerivative = 0.0;
+	for (unsigned int i = 0; i < sectionsCount; ++i) {
+		const double num = double(sections[i].num1) + sections[i].num2;
+		const double den = 1.0 + sections[i].den1 + sections[i].den2;
+		const double weightedNum = double(sections[i].num1) + 2.0 * sections[i].num2;
+		const double weightedDen = double(sections[i].den1) + 2.0 * sections[i].den2;
+		dcGain += num / den;
+		dcPhaseDerivative += (weightedNum * den - num * weightedDen) / (den * den);
+	}
+	groupDelay = dcGain != 0.0 ? dcPhaseDerivative / dcGain : 0.0;
+	const unsigned int delayLineSize = channelCount * sectionGroupsCount;
+	buffer = new SectionGroupBuffer[delayLineSize];
+	BufferedSample *s = buffer[0][0];
+	BufferedSample *e = buffer[delayLineSize][0];
 	while (s < e) *(s++) = 0;
 }
 
-IIRResampler::IIRResampler(const Quality quality) :
-	constants(0, 0.0f, NULL, quality)
+IIRResampler::IIRResampler(const Quality quality, const unsigned int channelCount) :
+	constants(0, 0.0f, NULL, quality, channelCount)
 {}
 
-IIRResampler::IIRResampler(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[]) :
-	constants(useSectionsCount, useFIR, useSections, IIRResampler::CUSTOM)
+IIRResampler::IIRResampler(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[], const unsigned int channelCount) :
+	constants(useSectionsCount, useFIR, useSections, IIRResampler::CUSTOM, channelCount)
 {}
 
 IIRResampler::~IIRResampler() {
+	delete[] constants.sectionGroups;
 	delete[] constants.buffer;
 }
 
-IIR2xInterpolator::IIR2xInterpolator(const Quality quality) :
-	IIRResampler(quality),
+size_t IIRResampler::getConstantsMemorySize() const {
+	return constants.sectionGroupsCount * (sizeof(IIRSectionGroup) + constants.channelCount * sizeof(SectionGroupBuffer));
+}
+
+IIR2xInterpolator::IIR2xInterpolator(const Quality quality, const unsigned int channelCount) :
+	IIRResampler(quality, channelCount),
 	phase(1)
 {
-	for (unsigned int chIx = 0; chIx < IIR_RESAMPER_CHANNEL_COUNT; ++chIx) {
+	for (unsigned int chIx = 0; chIx < constants.channelCount; ++chIx) {
 		lastInputSamples[chIx] = 0;
 	}
 }
 
-IIR2xInterpolator::IIR2xInterpolator(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[]) :
-	IIRResampler(useSectionsCount, useFIR, useSections),
+IIR2xInterpolator::IIR2xInterpolator(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[], const unsigned int channelCount) :
+	IIRResampler(useSectionsCount, useFIR, useSections, channelCount),
 	phase(1)
 {
-	for (unsigned int chIx = 0; chIx < IIR_RESAMPER_CHANNEL_COUNT; ++chIx) {
+	for (unsigned int chIx = 0; chIx < constants.channelCount; ++chIx) {
 		lastInputSamples[chIx] = 0;
 	}
 }
@@ -152,36 +298,20 @@ void IIR2xInterpolator::process(const FloatSample *&inSamples, unsigned int &inL
 	static const IIRCoefficient INTERPOLATOR_AMP = 2.0;
 
 	while (outLength > 0 && inLength > 0) {
-		SectionBuffer *bufferp = constants.buffer;
-		for (unsigned int chIx = 0; chIx < IIR_RESAMPER_CHANNEL_COUNT; ++chIx) {
-			const FloatSample lastInputSample = lastInputSamples[chIx];
+		SectionGroupBuffer *bufferp = constants.buffer;
+		for (unsigned int chIx = 0; chIx < constants.channelCount; ++chIx) {
 			const FloatSample inSample = inSamples[chIx];
-			BufferedSample tmpOut = phase == 0 ? 0 : inSample * constants.fir;
-			for (unsigned int i = 0; i < constants.sectionsCount; ++i) {
-				const IIRSection &section = constants.sections[i];
-				SectionBuffer &buffer = *bufferp;
-				// For 2x interpolation, calculation of the numerator reduces to a single multiplication depending on the phase.
-				if (phase == 0) {
-					const BufferedSample numOutSample = section.num1 * lastInputSample;
-					const BufferedSample denOutSample = calcDenominator(section, BIAS + numOutSample, buffer[0], buffer[1]);
-					buffer[1] = denOutSample;
-					tmpOut += denOutSample;
-				} else {
-					const BufferedSample numOutSample = section.num2 * lastInputSample;
-					const BufferedSample denOutSample = calcDenominator(section, BIAS + numOutSample, buffer[1], buffer[0]);
-					buffer[0] = denOutSample;
-					tmpOut += denOutSample;
-				}
-				bufferp++;
-			}
+			const BufferedSample firOut = phase == 0 ? 0 : inSample * constants.fir;
+			const BufferedSample tmpOut = firOut + interpolate(constants.sectionGroups, constants.sectionGroupsCount, bufferp, phase > 0, lastInputSamples[chIx]);
 			*(outSamples++) = FloatSample(INTERPOLATOR_AMP * tmpOut);
 			if (phase > 0) {
 				lastInputSamples[chIx] = inSample;
 			}
+			bufferp += constants.sectionGroupsCount;
 		}
 		outLength--;
 		if (phase > 0) {
-			inSamples += IIR_RESAMPER_CHANNEL_COUNT;
+			inSamples += constants.channelCount;
 			inLength--;
 			phase = 0;
 		} else {
@@ -194,36 +324,54 @@ unsigned int IIR2xInterpolator::estimateInLength(const unsigned int outLength) c
 	return outLength >> 1;
 }
 
-IIR2xDecimator::IIR2xDecimator(const Quality quality) :
-	IIRResampler(quality)
+double IIR2xInterpolator::getOutputToInputRatio() const {
+	return 2.0;
+}
+
+double IIR2xInterpolator::getLatency() const {
+	return constants.groupDelay;
+}
+
+size_t IIR2xInterpolator::getAllocatedMemorySize() const {
+	return sizeof(*this) + getConstantsMemorySize();
+}
+
+IIR2xDecimator::IIR2xDecimator(const Quality quality, const unsigned int channelCount) :
+	IIRResampler(quality, channelCount)
 {}
 
-IIR2xDecimator::IIR2xDecimator(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[]) :
-	IIRResampler(useSectionsCount, useFIR, useSections)
+IIR2xDecimator::IIR2xDecimator(const unsigned int useSectionsCount, const IIRCoefficient useFIR, const IIRSection useSections[], const unsigned int channelCount) :
+	IIRResampler(useSectionsCount, useFIR, useSections, channelCount)
 {}
 
 void IIR2xDecimator::process(const FloatSample *&inSamples, unsigned int &inLength, FloatSample *&outSamples, unsigned int &outLength) {
 	while (outLength > 0 && inLength > 1) {
-		SectionBuffer *bufferp = constants.buffer;
-		for (unsigned int chIx = 0; chIx < IIR_RESAMPER_CHANNEL_COUNT; ++chIx) {
-			BufferedSample tmpOut = inSamples[chIx] * constants.fir;
-			for (unsigned int i = 0; i < constants.sectionsCount; ++i) {
-				const IIRSection &section = constants.sections[i];
-				SectionBuffer &buffer = *bufferp;
-				// For 2x decimation, calculation of the numerator is not performed for odd output samples which are to be omitted.
-				tmpOut += calcNumerator(section, buffer[0], buffer[1]);
-				buffer[1] = calcDenominator(section, BIAS + inSamples[chIx], buffer[0], buffer[1]);
-				buffer[0] = calcDenominator(section, BIAS + inSamples[chIx + IIR_RESAMPER_CHANNEL_COUNT], buffer[1], buffer[0]);
-				bufferp++;
-			}
-			*(outSamples++) = FloatSample(tmpOut);
+		SectionGroupBuffer *bufferp = constants.buffer;
+		for (unsigned int chIx = 0; chIx < constants.channelCount; ++chIx) {
+			const FloatSample inSample0 = inSamples[chIx];
+			const FloatSample inSample1 = inSamples[chIx + constants.channelCount];
+			const BufferedSample firOut = inSample0 * constants.fir;
+			*(outSamples++) = FloatSample(firOut + decimate(constants.sectionGroups, constants.sectionGroupsCount, bufferp, inSample0, inSample1));
+			bufferp += constants.sectionGroupsCount;
 		}
 		outLength--;
 		inLength -= 2;
-		inSamples += 2 * IIR_RESAMPER_CHANNEL_COUNT;
+		inSamples += 2 * constants.channelCount;
 	}
 }
 
 unsigned int IIR2xDecimator::estimateInLength(const unsigned int outLength) const {
 	return outLength << 1;
 }
+
+double IIR2xDecimator::getOutputToInputRatio() const {
+	return 0.5;
+}
+
+double IIR2xDecimator::getLatency() const {
+	return 0.5 * constants.groupDelay;
+}
+
+size_t IIR2xDecimator::getAllocatedMemorySize() const {
+	return sizeof(*this) + getConstantsMemorySize();
+}
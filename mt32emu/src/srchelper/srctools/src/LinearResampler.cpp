@@ -18,8 +18,10 @@
 
 using namespace SRCTools;
 
-LinearResampler::LinearResampler(double sourceSampleRate, double targetSampleRate) :
-	inputToOutputRatio(sourceSampleRate / targetSampleRate),
+LinearResampler::LinearResampler(double sourceSampleRate, double targetSampleRate, const unsigned int useChannelCount) :
+	nominalInputToOutputRatio(sourceSampleRate / targetSampleRate),
+	inputToOutputRatio(nominalInputToOutputRatio),
+	channelCount(useChannelCount),
 	position(1.0) // Preload delay line which effectively makes resampler zero phase
 {}
 
@@ -29,12 +31,12 @@ void LinearResampler::process(const FloatSample *&inSamples, unsigned int &inLen
 		while (1.0 <= position) {
 			position--;
 			inLength--;
-			for (unsigned int chIx = 0; chIx < LINEAR_RESAMPER_CHANNEL_COUNT; ++chIx) {
+			for (unsigned int chIx = 0; chIx < channelCount; ++chIx) {
 				lastInputSamples[chIx] = *(inSamples++);
 			}
 			if (inLength == 0) return;
 		}
-		for (unsigned int chIx = 0; chIx < LINEAR_RESAMPER_CHANNEL_COUNT; chIx++) {
+		for (unsigned int chIx = 0; chIx < channelCount; chIx++) {
 			*(outSamples++) = FloatSample(lastInputSamples[chIx] + position * (inSamples[chIx] - lastInputSamples[chIx]));
 		}
 		outLength--;
@@ -45,3 +47,15 @@ void LinearResampler::process(const FloatSample *&inSamples, unsigned int &inLen
 unsigned int LinearResampler::estimateInLength(const unsigned int outLength) const {
 	return static_cast<unsigned int>(outLength * inputToOutputRatio);
 }
+
+void LinearResampler::setOutputRateAdjustment(const double factor) {
+	inputToOutputRatio = nominalInputToOutputRatio / factor;
+}
+
+double LinearResampler::getOutputToInputRatio() const {
+	return 1.0 / nominalInputToOutputRatio;
+}
+
+size_t LinearResampler::getAllocatedMemorySize() const {
+	return sizeof(*this);
+}
@@ -28,13 +28,16 @@ namespace SRCTools {
 
 namespace ResamplerModel {
 
-static const unsigned int CHANNEL_COUNT = 2;
 static const unsigned int MAX_SAMPLES_PER_RUN = 4096;
 
 class CascadeStage : public FloatSampleProvider {
 friend void freeResamplerModel(FloatSampleProvider &model, FloatSampleProvider &source);
+friend void setOutputRateAdjustment(FloatSampleProvider &model, FloatSampleProvider &source, double factor);
+friend double getLatency(FloatSampleProvider &model, FloatSampleProvider &source);
+friend size_t getAllocatedMemorySize(FloatSampleProvider &model, FloatSampleProvider &source);
 public:
-	CascadeStage(FloatSampleProvider &source, ResamplerStage &resamplerStage);
+	CascadeStage(FloatSampleProvider &source, ResamplerStage &resamplerStage, unsigned int channelCount);
+	~CascadeStage();
 
 	void getOutputSamples(FloatSample *outBuffer, unsigned int size);
 
@@ -43,15 +46,16 @@ protected:
 
 private:
 	FloatSampleProvider &source;
-	FloatSample buffer[CHANNEL_COUNT * MAX_SAMPLES_PER_RUN];
+	const unsigned int channelCount;
+	FloatSample * const buffer;
 	const FloatSample *bufferPtr;
 	unsigned int size;
 };
 
 class InternalResamplerCascadeStage : public CascadeStage {
 public:
-	InternalResamplerCascadeStage(FloatSampleProvider &useSource, ResamplerStage &useResamplerStage) :
-		CascadeStage(useSource, useResamplerStage)
+	InternalResamplerCascadeStage(FloatSampleProvider &useSource, ResamplerStage &useResamplerStage, unsigned int useChannelCount) :
+		CascadeStage(useSource, useResamplerStage, useChannelCount)
 	{}
 
 	~InternalResamplerCascadeStage() {
@@ -65,55 +69,96 @@ public:
 
 using namespace SRCTools;
 
-FloatSampleProvider &ResamplerModel::createResamplerModel(FloatSampleProvider &source, double sourceSampleRate, double targetSampleRate, Quality quality) {
-	if (sourceSampleRate == targetSampleRate) {
+FloatSampleProvider &ResamplerModel::createResamplerModel(FloatSampleProvider &source, double sourceSampleRate, double targetSampleRate, Quality quality, unsigned int channelCount, bool variableRatio, bool minimumPhase) {
+	if (sourceSampleRate == targetSampleRate && !variableRatio) {
 		return source;
 	}
 	if (quality == FASTEST) {
-		return *new InternalResamplerCascadeStage(source, *new LinearResampler(sourceSampleRate, targetSampleRate));
+		return *new InternalResamplerCascadeStage(source, *new LinearResampler(sourceSampleRate, targetSampleRate, channelCount), channelCount);
 	}
 	const IIRResampler::Quality iirQuality = static_cast<IIRResampler::Quality>(quality);
 	const double iirPassbandFraction = IIRResampler::getPassbandFractionForQuality(iirQuality);
 	if (sourceSampleRate < targetSampleRate) {
-		ResamplerStage *iir2xInterpolator = new IIR2xInterpolator(iirQuality);
-		FloatSampleProvider &iir2xInterpolatorStage = *new InternalResamplerCascadeStage(source, *iir2xInterpolator);
+		ResamplerStage *iir2xInterpolator = new IIR2xInterpolator(iirQuality, channelCount);
+		FloatSampleProvider &iir2xInterpolatorStage = *new InternalResamplerCascadeStage(source, *iir2xInterpolator, channelCount);
 
-		if (2.0 * sourceSampleRate == targetSampleRate) {
+		if (2.0 * sourceSampleRate == targetSampleRate && !variableRatio) {
 			return iir2xInterpolatorStage;
 		}
 
 		double passband = 0.5 * sourceSampleRate * iirPassbandFraction;
 		double stopband = 1.5 * sourceSampleRate;
-		ResamplerStage *sincResampler = SincResampler::createSincResampler(2.0 * sourceSampleRate, targetSampleRate, passband, stopband, DEFAULT_DB_SNR, DEFAULT_WINDOWED_SINC_MAX_UPSAMPLE_FACTOR);
-		return *new InternalResamplerCascadeStage(iir2xInterpolatorStage, *sincResampler);
+		ResamplerStage *sincResampler = SincResampler::createSincResampler(2.0 * sourceSampleRate, targetSampleRate, passband, stopband, DEFAULT_DB_SNR, DEFAULT_WINDOWED_SINC_MAX_UPSAMPLE_FACTOR, channelCount, variableRatio, minimumPhase);
+		return *new InternalResamplerCascadeStage(iir2xInterpolatorStage, *sincResampler, channelCount);
 	}
 
-	if (sourceSampleRate == 2.0 * targetSampleRate) {
-		ResamplerStage *iir2xDecimator = new IIR2xDecimator(iirQuality);
-		return *new InternalResamplerCascadeStage(source, *iir2xDecimator);
+	if (sourceSampleRate == 2.0 * targetSampleRate && !variableRatio) {
+		ResamplerStage *iir2xDecimator = new IIR2xDecimator(iirQuality, channelCount);
+		return *new InternalResamplerCascadeStage(source, *iir2xDecimator, channelCount);
 	}
 
 	double passband = 0.5 * targetSampleRate * iirPassbandFraction;
 	double stopband = 1.5 * targetSampleRate;
 	double sincOutSampleRate = 2.0 * targetSampleRate;
 	const unsigned int maxUpsampleFactor = static_cast<unsigned int>(ceil(DEFAULT_WINDOWED_SINC_MAX_DOWNSAMPLE_FACTOR * sincOutSampleRate / sourceSampleRate));
-	ResamplerStage *sincResampler = SincResampler::createSincResampler(sourceSampleRate, sincOutSampleRate, passband, stopband, DEFAULT_DB_SNR, maxUpsampleFactor);
-	FloatSampleProvider &sincResamplerStage = *new InternalResamplerCascadeStage(source, *sincResampler);
+	ResamplerStage *sincResampler = SincResampler::createSincResampler(sourceSampleRate, sincOutSampleRate, passband, stopband, DEFAULT_DB_SNR, maxUpsampleFactor, channelCount, variableRatio, minimumPhase);
+	FloatSampleProvider &sincResamplerStage = *new InternalResamplerCascadeStage(source, *sincResampler, channelCount);
 
-	ResamplerStage *iir2xDecimator = new IIR2xDecimator(iirQuality);
-	return *new InternalResamplerCascadeStage(sincResamplerStage, *iir2xDecimator);
+	ResamplerStage *iir2xDecimator = new IIR2xDecimator(iirQuality, channelCount);
+	return *new InternalResamplerCascadeStage(sincResamplerStage, *iir2xDecimator, channelCount);
 }
 
-FloatSampleProvider &ResamplerModel::createResamplerModel(FloatSampleProvider &source, ResamplerStage **resamplerStages, unsigned int stageCount) {
+FloatSampleProvider &ResamplerModel::createResamplerModel(FloatSampleProvider &source, ResamplerStage **resamplerStages, unsigned int stageCount, unsigned int channelCount) {
 	FloatSampleProvider *prevStage = &source;
 	for (unsigned int i = 0; i < stageCount; i++) {
-		prevStage = new CascadeStage(*prevStage, *(resamplerStages[i]));
+		prevStage = new CascadeStage(*prevStage, *(resamplerStages[i]), channelCount);
 	}
 	return *prevStage;
 }
 
-FloatSampleProvider &ResamplerModel::createResamplerModel(FloatSampleProvider &source, ResamplerStage &stage) {
-	return *new CascadeStage(source, stage);
+FloatSampleProvider &ResamplerModel::createResamplerModel(FloatSampleProvider &source, ResamplerStage &stage, unsigned int channelCount) {
+	return *new CascadeStage(source, stage, channelCount);
+}
+
+double ResamplerModel::estimateCost(double sourceSampleRate, double targetSampleRate, Quality quality, bool variableRatio) {
+	// Each IIR section takes a MAC per coefficient, and all the sections of a group are computed at once.
+	// The interpolator only computes the denominator and a single numerator tap per output sample,
+	// while the decimator computes both numerator taps and the denominator twice.
+	static const double IIR_INTERPOLATOR_MACS_PER_SECTION = 3;
+	static const double IIR_DECIMATOR_MACS_PER_SECTION = 6;
+
+	if (sourceSampleRate == targetSampleRate && !variableRatio) {
+		return 0;
+	}
+	if (quality == FASTEST) {
+		return 1;
+	}
+	const IIRResampler::Quality iirQuality = static_cast<IIRResampler::Quality>(quality);
+	const double iirPassbandFraction = IIRResampler::getPassbandFractionForQuality(iirQuality);
+	const unsigned int iirSectionGroupsCount = (IIRResampler::getSectionsCountForQuality(iirQuality) + IIR_SECTION_GROUP_SIZE - 1) / IIR_SECTION_GROUP_SIZE;
+	const double iirSectionsCount = iirSectionGroupsCount * IIR_SECTION_GROUP_SIZE;
+	if (sourceSampleRate < targetSampleRate) {
+		const double iir2xInterpolatorCost = (IIR_INTERPOLATOR_MACS_PER_SECTION * iirSectionsCount + 0.5) * 2.0 * sourceSampleRate / targetSampleRate;
+
+		if (2.0 * sourceSampleRate == targetSampleRate && !variableRatio) {
+			return iir2xInterpolatorCost;
+		}
+
+		double passband = 0.5 * sourceSampleRate * iirPassbandFraction;
+		double stopband = 1.5 * sourceSampleRate;
+		return iir2xInterpolatorCost + SincResampler::estimateTapsPerOutputSample(2.0 * sourceSampleRate, targetSampleRate, passband, stopband, DEFAULT_DB_SNR, DEFAULT_WINDOWED_SINC_MAX_UPSAMPLE_FACTOR, 1, 1, variableRatio);
+	}
+
+	const double iir2xDecimatorCost = IIR_DECIMATOR_MACS_PER_SECTION * iirSectionsCount + 1;
+	if (sourceSampleRate == 2.0 * targetSampleRate && !variableRatio) {
+		return iir2xDecimatorCost;
+	}
+
+	double passband = 0.5 * targetSampleRate * iirPassbandFraction;
+	double stopband = 1.5 * targetSampleRate;
+	double sincOutSampleRate = 2.0 * targetSampleRate;
+	const unsigned int maxUpsampleFactor = static_cast<unsigned int>(ceil(DEFAULT_WINDOWED_SINC_MAX_DOWNSAMPLE_FACTOR * sincOutSampleRate / sourceSampleRate));
+	return 2.0 * SincResampler::estimateTapsPerOutputSample(sourceSampleRate, sincOutSampleRate, passband, stopband, DEFAULT_DB_SNR, maxUpsampleFactor, 1, 1, variableRatio) + iir2xDecimatorCost;
 }
 
 void ResamplerModel::freeResamplerModel(FloatSampleProvider &model, FloatSampleProvider &source) {
@@ -127,15 +172,60 @@ void ResamplerModel::freeResamplerModel(FloatSampleProvider &model, FloatSampleP
 	}
 }
 
+void ResamplerModel::setOutputRateAdjustment(FloatSampleProvider &model, FloatSampleProvider &source, double factor) {
+	FloatSampleProvider *currentStage = &model;
+	while (currentStage != &source) {
+		CascadeStage *cascadeStage = dynamic_cast<CascadeStage *>(currentStage);
+		if (cascadeStage == NULL) return;
+		cascadeStage->resamplerStage.setOutputRateAdjustment(factor);
+		currentStage = &cascadeStage->source;
+	}
+}
+
+double ResamplerModel::getLatency(FloatSampleProvider &model, FloatSampleProvider &source) {
+	double latency = 0.0;
+	// Number of output samples of the model per output sample of the current stage
+	double outputSampleScale = 1.0;
+	FloatSampleProvider *currentStage = &model;
+	while (currentStage != &source) {
+		CascadeStage *cascadeStage = dynamic_cast<CascadeStage *>(currentStage);
+		if (cascadeStage == NULL) break;
+		const ResamplerStage &resamplerStage = cascadeStage->resamplerStage;
+		latency += resamplerStage.getLatency() * outputSampleScale;
+		outputSampleScale *= resamplerStage.getOutputToInputRatio();
+		currentStage = &cascadeStage->source;
+	}
+	return latency;
+}
+
+size_t ResamplerModel::getAllocatedMemorySize(FloatSampleProvider &model, FloatSampleProvider &source) {
+	size_t size = 0;
+	FloatSampleProvider *currentStage = &model;
+	while (currentStage != &source) {
+		CascadeStage *cascadeStage = dynamic_cast<CascadeStage *>(currentStage);
+		if (cascadeStage == NULL) break;
+		size += sizeof(CascadeStage) + cascadeStage->channelCount * MAX_SAMPLES_PER_RUN * sizeof(FloatSample);
+		size += cascadeStage->resamplerStage.getAllocatedMemorySize();
+		currentStage = &cascadeStage->source;
+	}
+	return size;
+}
+
 using namespace ResamplerModel;
 
-CascadeStage::CascadeStage(FloatSampleProvider &useSource, ResamplerStage &useResamplerStage) :
+CascadeStage::CascadeStage(FloatSampleProvider &useSource, ResamplerStage &useResamplerStage, unsigned int useChannelCount) :
 	resamplerStage(useResamplerStage),
 	source(useSource),
+	channelCount(useChannelCount),
+	buffer(new FloatSample[useChannelCount * MAX_SAMPLES_PER_RUN]),
 	bufferPtr(buffer),
 	size()
 {}
 
+CascadeStage::~CascadeStage() {
+	delete[] buffer;
+}
+
 void CascadeStage::getOutputSamples(FloatSample *outBuffer, unsigned int length) {
 	while (length > 0) {
 		if (size == 0) {
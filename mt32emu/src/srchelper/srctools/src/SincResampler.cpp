@@ -15,6 +15,12 @@
  */
 
 #include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #ifdef SRCTOOLS_SINC_RESAMPLER_DEBUG_LOG
 #include <iostream>
@@ -32,6 +38,106 @@ using namespace SincResampler;
 
 using namespace Utils;
 
+namespace SRCTools {
+
+namespace SincResampler {
+
+// Kernels are cached while in use, so that resamplers created with the same parameters share the coefficient memory,
+// and all but the first one avoid the costly kernel design.
+struct CachedKernel {
+	CachedKernel *next;
+	unsigned int refCount;
+	const FIRPolyphaseKernel *kernel;
+
+	double inputFrequency;
+	double outputFrequency;
+	double passbandFrequency;
+	double stopbandFrequency;
+	double dbSNR;
+	unsigned int maxUpsampleFactor;
+	FIRCoefficient *prefilterKernel;
+	unsigned int prefilterLength;
+	unsigned int prefilterUpsampleFactor;
+	bool variableRatio;
+	bool minimumPhase;
+
+	bool matches(const double useInputFrequency, const double useOutputFrequency, const double usePassbandFrequency, const double useStopbandFrequency, const double useDbSNR, const unsigned int useMaxUpsampleFactor, const FIRCoefficient usePrefilterKernel[], const unsigned int usePrefilterLength, const unsigned int usePrefilterUpsampleFactor, const bool useVariableRatio, const bool useMinimumPhase) const {
+		return inputFrequency == useInputFrequency && outputFrequency == useOutputFrequency
+			&& passbandFrequency == usePassbandFrequency && stopbandFrequency == useStopbandFrequency
+			&& dbSNR == useDbSNR && maxUpsampleFactor == useMaxUpsampleFactor
+			&& prefilterLength == usePrefilterLength && prefilterUpsampleFactor == usePrefilterUpsampleFactor
+			&& variableRatio == useVariableRatio && minimumPhase == useMinimumPhase
+			&& memcmp(prefilterKernel, usePrefilterKernel, prefilterLength * sizeof(FIRCoefficient)) == 0;
+	}
+};
+
+static CachedKernel *cachedKernels = NULL;
+
+// The cache is only accessed when resamplers are created and destroyed, so a simple spin lock suffices.
+// Without a known compiler, the cache isn't thread-safe.
+static volatile long cacheLockState = 0;
+
+static void lockCache() {
+#if defined(_MSC_VER)
+	while (_InterlockedExchange(&cacheLockState, 1) != 0) {}
+#elif defined(__GNUC__)
+	while (__sync_lock_test_and_set(&cacheLockState, 1) != 0) {}
+#endif
+}
+
+static void unlockCache() {
+#if defined(_MSC_VER)
+	_InterlockedExchange(&cacheLockState, 0);
+#elif defined(__GNUC__)
+	__sync_lock_release(&cacheLockState);
+#endif
+}
+
+static const FIRPolyphaseKernel *findCachedKernel(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const FIRCoefficient prefilterKernel[], const unsigned int prefilterLength, const unsigned int prefilterUpsampleFactor, const bool variableRatio, const bool minimumPhase) {
+	for (CachedKernel *entry = cachedKernels; entry != NULL; entry = entry->next) {
+		if (entry->matches(inputFrequency, outputFrequency, passbandFrequency, stopbandFrequency, dbSNR, maxUpsampleFactor, prefilterKernel, prefilterLength, prefilterUpsampleFactor, variableRatio, minimumPhase)) {
+			entry->refCount++;
+			return entry->kernel;
+		}
+	}
+	return NULL;
+}
+
+static void releaseCachedKernel(const FIRPolyphaseKernel &kernel) {
+	lockCache();
+	for (CachedKernel **entryPtr = &cachedKernels; *entryPtr != NULL; entryPtr = &(*entryPtr)->next) {
+		CachedKernel *entry = *entryPtr;
+		if (entry->kernel != &kernel) continue;
+		if (--entry->refCount == 0) {
+			*entryPtr = entry->next;
+			delete[] entry->prefilterKernel;
+			delete entry->kernel;
+			delete entry;
+		}
+		break;
+	}
+	unlockCache();
+}
+
+// Resampling factors and dimensions of the kernel designed for the given parameters.
+struct KernelGeometry {
+	unsigned int prefilterOutputUpsampleFactor;
+	unsigned int upsampleFactor;
+	double downsampleFactor;
+	double fp;
+	double fs;
+	unsigned int order;
+	unsigned int kernelLength;
+
+	KernelGeometry(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const unsigned int prefilterLength, const unsigned int prefilterUpsampleFactor, const bool variableRatio);
+};
+
+static const FIRPolyphaseKernel *designKernel(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const FIRCoefficient prefilterKernel[], const unsigned int prefilterLength, const unsigned int prefilterUpsampleFactor, const bool variableRatio, const bool minimumPhase);
+
+} // namespace SincResampler
+
+} // namespace SRCTools
+
 void Utils::computeResampleFactors(unsigned int &upsampleFactor, double &downsampleFactor, const double inputFrequency, const double outputFrequency, const unsigned int maxUpsampleFactor) {
 	static const double RATIONAL_RATIO_ACCURACY_FACTOR = 1E15;
 
@@ -74,6 +180,112 @@ unsigned int Utils::greatestCommonDivisor(unsigned int a, unsigned int b) {
 	return a;
 }
 
+// Convolves kernelA with kernelB, which is upsampled by strideB by inserting zeros between the taps.
+// The result must fit lengthA + (lengthB - 1) * strideB taps.
+void Utils::convolve(FIRCoefficient result[], const FIRCoefficient kernelA[], const unsigned int lengthA, const FIRCoefficient kernelB[], const unsigned int lengthB, const unsigned int strideB) {
+	const unsigned int resultLength = lengthA + (lengthB - 1) * strideB;
+	for (unsigned int i = 0; i < resultLength; ++i) {
+		double sum = 0.0;
+		for (unsigned int j = 0; j < lengthB; ++j) {
+			const unsigned int offset = j * strideB;
+			if (i < offset) break;
+			if (i - offset < lengthA) sum += double(kernelB[j]) * kernelA[i - offset];
+		}
+		result[i] = FIRCoefficient(sum);
+	}
+}
+
+// In-place radix-2 complex FFT, size must be a power of 2. The inverse transform is scaled by 1 / size.
+void Utils::fft(double re[], double im[], const unsigned int size, const bool inverse) {
+	for (unsigned int i = 1, j = 0; i < size; ++i) {
+		unsigned int bit = size >> 1;
+		for (; (j & bit) != 0; bit >>= 1) j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			double t = re[i];
+			re[i] = re[j];
+			re[j] = t;
+			t = im[i];
+			im[i] = im[j];
+			im[j] = t;
+		}
+	}
+	for (unsigned int length = 2; length <= size; length <<= 1) {
+		const double angle = (inverse ? 2.0 : -2.0) * M_PI / length;
+		const unsigned int halfLength = length >> 1;
+		for (unsigned int k = 0; k < halfLength; ++k) {
+			const double wRe = cos(angle * k);
+			const double wIm = sin(angle * k);
+			for (unsigned int i = k; i < size; i += length) {
+				const unsigned int j = i + halfLength;
+				const double tRe = re[j] * wRe - im[j] * wIm;
+				const double tIm = re[j] * wIm + im[j] * wRe;
+				re[j] = re[i] - tRe;
+				im[j] = im[i] - tIm;
+				re[i] += tRe;
+				im[i] += tIm;
+			}
+		}
+	}
+	if (inverse) {
+		const double scale = 1.0 / size;
+		for (unsigned int i = 0; i < size; ++i) {
+			re[i] *= scale;
+			im[i] *= scale;
+		}
+	}
+}
+
+// Replaces the kernel with the minimum-phase one that has the same magnitude response, using the homomorphic method.
+// The real cepstrum of the magnitude response is folded onto its causal part, which yields the log spectrum
+// of the minimum-phase kernel. The transform is much longer than the kernel to keep the cepstrum aliasing low.
+// The magnitude is bounded from below, as the zeros of the stopband would make the logarithm diverge.
+void Utils::convertToMinimumPhase(FIRCoefficient kernel[], const unsigned int length) {
+	static const unsigned int FFT_SIZE_FACTOR = 16;
+	static const double MIN_RELATIVE_MAGNITUDE = 1E-10;
+
+	unsigned int size = 1;
+	while (size < FFT_SIZE_FACTOR * length) size <<= 1;
+	double *re = new double[size];
+	double *im = new double[size];
+	for (unsigned int i = 0; i < size; ++i) {
+		re[i] = i < length ? kernel[i] : 0.0;
+		im[i] = 0.0;
+	}
+	fft(re, im, size, false);
+	double peakMagnitude = 0.0;
+	for (unsigned int i = 0; i < size; ++i) {
+		re[i] = sqrt(re[i] * re[i] + im[i] * im[i]);
+		im[i] = 0.0;
+		if (peakMagnitude < re[i]) peakMagnitude = re[i];
+	}
+	const double minMagnitude = peakMagnitude * MIN_RELATIVE_MAGNITUDE;
+	for (unsigned int i = 0; i < size; ++i) {
+		re[i] = log(re[i] < minMagnitude ? minMagnitude : re[i]);
+	}
+	fft(re, im, size, true);
+	const unsigned int halfSize = size >> 1;
+	for (unsigned int i = 1; i < halfSize; ++i) {
+		re[i] *= 2.0;
+		re[size - i] = 0.0;
+	}
+	for (unsigned int i = 0; i < size; ++i) {
+		im[i] = 0.0;
+	}
+	fft(re, im, size, false);
+	for (unsigned int i = 0; i < size; ++i) {
+		const double magnitude = exp(re[i]);
+		re[i] = magnitude * cos(im[i]);
+		im[i] = magnitude * sin(im[i]);
+	}
+	fft(re, im, size, true);
+	for (unsigned int i = 0; i < length; ++i) {
+		kernel[i] = FIRCoefficient(re[i]);
+	}
+	delete[] re;
+	delete[] im;
+}
+
 double KaizerWindow::estimateBeta(double dbRipple) {
 	return 0.1102 * (dbRipple - 8.7);
 }
@@ -112,25 +324,104 @@ void KaizerWindow::windowedSinc(FIRCoefficient kernel[], const unsigned int orde
 	}
 }
 
-ResamplerStage *SincResampler::createSincResampler(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor) {
-	unsigned int upsampleFactor;
-	double downsampleFactor;
-	computeResampleFactors(upsampleFactor, downsampleFactor, inputFrequency, outputFrequency, maxUpsampleFactor);
+ResamplerStage *SincResampler::createSincResampler(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const unsigned int channelCount, const bool variableRatio, const bool minimumPhase) {
+	static const FIRCoefficient UNIT_KERNEL[] = { 1.0f };
+
+	return createSincResampler(inputFrequency, outputFrequency, passbandFrequency, stopbandFrequency, dbSNR, maxUpsampleFactor, UNIT_KERNEL, 1, 1, channelCount, variableRatio, minimumPhase);
+}
+
+KernelGeometry::KernelGeometry(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const unsigned int prefilterLength, const unsigned int prefilterUpsampleFactor, const bool variableRatio) {
+	// The resampling factors are found for the prefilter output, so that the overall upsampling factor is a multiple of prefilterUpsampleFactor.
+	const unsigned int maxPrefilterOutputUpsampleFactor = maxUpsampleFactor < 2 * prefilterUpsampleFactor ? 1 : maxUpsampleFactor / prefilterUpsampleFactor;
+	if (variableRatio) {
+		// The ratio may deviate from the nominal one later, so the taps are always interpolated between the maximum number of phases.
+		prefilterOutputUpsampleFactor = maxPrefilterOutputUpsampleFactor;
+		downsampleFactor = prefilterOutputUpsampleFactor * inputFrequency * prefilterUpsampleFactor / outputFrequency;
+	} else {
+		computeResampleFactors(prefilterOutputUpsampleFactor, downsampleFactor, inputFrequency * prefilterUpsampleFactor, outputFrequency, maxPrefilterOutputUpsampleFactor);
+	}
+	upsampleFactor = prefilterOutputUpsampleFactor * prefilterUpsampleFactor;
 	double baseSamplePeriod = 1.0 / (inputFrequency * upsampleFactor);
-	double fp = passbandFrequency * baseSamplePeriod;
-	double fs = stopbandFrequency * baseSamplePeriod;
+	fp = passbandFrequency * baseSamplePeriod;
+	fs = stopbandFrequency * baseSamplePeriod;
+	order = KaizerWindow::estimateOrder(dbSNR, fp, fs);
+	kernelLength = order + 1 + (prefilterLength - 1) * prefilterOutputUpsampleFactor;
+}
+
+unsigned int SincResampler::estimateTapsPerOutputSample(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const unsigned int prefilterLength, const unsigned int prefilterUpsampleFactor, const bool variableRatio) {
+	const KernelGeometry geometry(inputFrequency, outputFrequency, passbandFrequency, stopbandFrequency, dbSNR, maxUpsampleFactor, prefilterLength, prefilterUpsampleFactor, variableRatio);
+	const unsigned int tapsPerPhase = (geometry.kernelLength + geometry.upsampleFactor - 1) / geometry.upsampleFactor;
+	// With phase interpolation, the outputs of two adjacent phases are computed, see FIRPolyphaseKernel.
+	const bool usePhaseInterpolation = variableRatio || geometry.downsampleFactor != floor(geometry.downsampleFactor);
+	return usePhaseInterpolation ? 2 * tapsPerPhase : tapsPerPhase;
+}
+
+const FIRPolyphaseKernel *SincResampler::designKernel(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const FIRCoefficient prefilterKernel[], const unsigned int prefilterLength, const unsigned int prefilterUpsampleFactor, const bool variableRatio, const bool minimumPhase) {
+	const KernelGeometry geometry(inputFrequency, outputFrequency, passbandFrequency, stopbandFrequency, dbSNR, maxUpsampleFactor, prefilterLength, prefilterUpsampleFactor, variableRatio);
+	const unsigned int prefilterOutputUpsampleFactor = geometry.prefilterOutputUpsampleFactor;
+	const unsigned int upsampleFactor = geometry.upsampleFactor;
+	const double downsampleFactor = geometry.downsampleFactor;
+	double fp = geometry.fp;
+	double fs = geometry.fs;
 	double fc = 0.5 * (fp + fs);
 	double beta = KaizerWindow::estimateBeta(dbSNR);
-	unsigned int order = KaizerWindow::estimateOrder(dbSNR, fp, fs);
-	const unsigned int kernelLength = order + 1;
+	unsigned int order = geometry.order;
+	const unsigned int windowedSincKernelLength = order + 1;
+	const unsigned int kernelLength = geometry.kernelLength;
 
 #ifdef SRCTOOLS_SINC_RESAMPLER_DEBUG_LOG
 	std::clog << "FIR: " << upsampleFactor << "/" << downsampleFactor << ", N=" << kernelLength << ", NPh=" << kernelLength / double(upsampleFactor) << ", C=" << 0.5 / fc << ", fp=" << fp << ", fs=" << fs << ", M=" << maxUpsampleFactor << std::endl;
 #endif
 
-	FIRCoefficient *windowedSincKernel = new FIRCoefficient[kernelLength];
+	FIRCoefficient *windowedSincKernel = new FIRCoefficient[windowedSincKernelLength];
 	KaizerWindow::windowedSinc(windowedSincKernel, order, fc, beta, upsampleFactor);
-	ResamplerStage *windowedSincStage = new FIRResampler(upsampleFactor, downsampleFactor, windowedSincKernel, kernelLength);
+	const FIRPolyphaseKernel *polyphaseKernel;
+	if (prefilterLength == 1 && prefilterKernel[0] == 1.0f) {
+		if (minimumPhase) convertToMinimumPhase(windowedSincKernel, kernelLength);
+		polyphaseKernel = new FIRPolyphaseKernel(upsampleFactor, downsampleFactor, windowedSincKernel, kernelLength, variableRatio);
+	} else {
+		FIRCoefficient *kernel = new FIRCoefficient[kernelLength];
+		convolve(kernel, windowedSincKernel, windowedSincKernelLength, prefilterKernel, prefilterLength, prefilterOutputUpsampleFactor);
+		if (minimumPhase) convertToMinimumPhase(kernel, kernelLength);
+		polyphaseKernel = new FIRPolyphaseKernel(upsampleFactor, downsampleFactor, kernel, kernelLength, variableRatio);
+		delete[] kernel;
+	}
 	delete[] windowedSincKernel;
-	return windowedSincStage;
+	return polyphaseKernel;
+}
+
+ResamplerStage *SincResampler::createSincResampler(const double inputFrequency, const double outputFrequency, const double passbandFrequency, const double stopbandFrequency, const double dbSNR, const unsigned int maxUpsampleFactor, const FIRCoefficient prefilterKernel[], const unsigned int prefilterLength, const unsigned int prefilterUpsampleFactor, const unsigned int channelCount, const bool variableRatio, const bool minimumPhase) {
+	lockCache();
+	const FIRPolyphaseKernel *kernel = findCachedKernel(inputFrequency, outputFrequency, passbandFrequency, stopbandFrequency, dbSNR, maxUpsampleFactor, prefilterKernel, prefilterLength, prefilterUpsampleFactor, variableRatio, minimumPhase);
+	unlockCache();
+	if (kernel != NULL) return new FIRResampler(*kernel, releaseCachedKernel, channelCount);
+
+	// The kernel is designed without holding the lock. Should another thread cache an equivalent one meanwhile, that one is used.
+	const FIRPolyphaseKernel *newKernel = designKernel(inputFrequency, outputFrequency, passbandFrequency, stopbandFrequency, dbSNR, maxUpsampleFactor, prefilterKernel, prefilterLength, prefilterUpsampleFactor, variableRatio, minimumPhase);
+	lockCache();
+	kernel = findCachedKernel(inputFrequency, outputFrequency, passbandFrequency, stopbandFrequency, dbSNR, maxUpsampleFactor, prefilterKernel, prefilterLength, prefilterUpsampleFactor, variableRatio, minimumPhase);
+	if (kernel == NULL) {
+		CachedKernel *entry = new CachedKernel;
+		entry->next = cachedKernels;
+		entry->refCount = 1;
+		entry->kernel = newKernel;
+		entry->inputFrequency = inputFrequency;
+		entry->outputFrequency = outputFrequency;
+		entry->passbandFrequency = passbandFrequency;
+		entry->stopbandFrequency = stopbandFrequency;
+		entry->dbSNR = dbSNR;
+		entry->maxUpsampleFactor = maxUpsampleFactor;
+		entry->prefilterKernel = new FIRCoefficient[prefilterLength];
+		memcpy(entry->prefilterKernel, prefilterKernel, prefilterLength * sizeof(FIRCoefficient));
+		entry->prefilterLength = prefilterLength;
+		entry->prefilterUpsampleFactor = prefilterUpsampleFactor;
+		entry->variableRatio = variableRatio;
+		entry->minimumPhase = minimumPhase;
+		cachedKernels = entry;
+		kernel = newKernel;
+		newKernel = NULL;
+	}
+	unlockCache();
+	delete newKernel;
+	return new FIRResampler(*kernel, releaseCachedKernel, channelCount);
 }
@@ -23,9 +23,11 @@
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <unistd.h>
@@ -71,13 +73,17 @@ int uicmd_pipe[2];
 
 class SysexHandler : public MT32Emu::MidiStreamParser {
 public:
-	explicit SysexHandler(MT32Emu::Synth &useSynth) : synth(useSynth) {}
+	explicit SysexHandler(MT32Emu::Synth &useSynth) : synth(useSynth), timestamp(0) {}
+
+	void setTimestamp(MT32Emu::Bit32u useTimestamp) {
+		timestamp = useTimestamp;
+	}
 
 	void handleSystemRealtimeMessage(const MT32Emu::Bit8u realtime) { /* Not interesting */ }
 	void handleShortMessage(const MT32Emu::Bit32u message) { /* Not interesting */ }
 
 	void handleSysex(const MT32Emu::Bit8u stream[], const MT32Emu::Bit32u length) {
-		synth.playSysex(stream, length);
+		synth.playSysex(stream, length, timestamp);
 	}
 
 	void printDebug(const char *debugMessage) {
@@ -86,12 +92,33 @@ public:
 
 private:
 	MT32Emu::Synth &synth;
+	MT32Emu::Bit32u timestamp;
 };
 
+/* Every unit has a synth of its own, the units beyond the first render on worker threads. */
+typedef struct {
+	MT32Emu::Synth *synth;
+	SysexHandler *sysexHandler;
+	pthread_t thread;
+	MT32Emu::Bit16s *buffer;
+} unit_t;
+
+#define UNIT_BUFFER_FRAMES 256
+
+int num_units = 1;
+unit_t units[MAX_UNITS];
+
 MT32Emu::Synth *mt32;
-SysexHandler *sysexHandler;
 snd_seq_t *seq_handle = NULL;
 
+/* the workers are kicked off by advancing render_generation, the last one to finish signals render_done_cond */
+pthread_mutex_t render_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t render_start_cond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t render_done_cond = PTHREAD_COND_INITIALIZER;
+unsigned int render_generation = 0;
+unsigned int render_frames = 0;
+int units_pending = 0;
+
 
 /* Buffer infomation */
 #define FRAGMENT_SIZE 256 // 2 milliseconds
@@ -122,6 +149,8 @@ int channeluse[16];
 
 /* midi structures */
 int port_in_mt, port_in_gm;
+/* the unit each sequencer port drives, indexed by the port number */
+int port_unit[MAX_UNITS + 1];
 struct pollfd *fdbank;
 int consumer_types = 0;
 
@@ -131,11 +160,20 @@ snd_pcm_hw_params_t *pcm_hwparams;
 // char *pcm_name = "plughw:0,0";
 char *pcm_name = "default";
 
+/* set when the device accepts mmap access, the synth then renders straight into the ring buffer */
+int pcm_mmap = 0;
+
 double gain_multiplier = 1.0;
 
 /* midi queue control variables */
 int flush_events = 0;
 
+/* the synth sample that was being played at render_stamp, incoming events are timestamped relative to it
+ * and delayed by midi_latency_samples, so that they reach the output with a constant latency */
+struct timeval render_stamp;
+MT32Emu::Bit32u render_sample_count = 0;
+int midi_latency_samples = 0;
+
 
 /* template for reverb sysex events */
 MT32Emu::Bit8u rvsysex[] = {
@@ -180,9 +218,14 @@ int alsa_set_buffer_time(int msec)
 		return -1;
 	}
 	
-	if (snd_pcm_hw_params_set_access(pcm_handle, pcm_hwparams, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
-		fprintf(stderr, "Error setting access.\n");
-		return -1;
+	/* prefer mmap access, fall back to read/write transfers if the device lacks it */
+	pcm_mmap = 1;
+	if (snd_pcm_hw_params_set_access(pcm_handle, pcm_hwparams, SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0) {
+		pcm_mmap = 0;
+		if (snd_pcm_hw_params_set_access(pcm_handle, pcm_hwparams, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
+			fprintf(stderr, "Error setting access.\n");
+			return -1;
+		}
 	}
 			
 	/* Set sample format */
@@ -255,6 +298,7 @@ int alsa_set_buffer_time(int msec)
 		return -1;
 	}	
 	
+	midi_latency_samples = (int)((double)realmsec * MT32Emu::SAMPLE_RATE / 1000.0);
 	report(DRV_LATENCY, realmsec);
 	
 	return realmsec;
@@ -321,7 +365,8 @@ int alsa_init_pcm(unsigned int rate, int channels)
 
 int alsa_setup_midi()
 {
-	int port_in_mt;
+	int port_in_mt, port, i;
+	char port_name[32];
 	
 	/* open sequencer interface for input */
 	if (snd_seq_open(&seq_handle, "default", SND_SEQ_OPEN_DUPLEX, 0) < 0) {
@@ -350,16 +395,46 @@ int alsa_setup_midi()
 		fprintf(stderr, "Error creating sequencer port.\n");
 		return -1;
 	}	
+	port_unit[port_in_mt] = 0;
+	port_unit[port_in_gm] = 0;
+	
+	/* the following units only get a port each, the GM emulation is provided for the first unit */
+	for (i = 1; i < num_units; i++)
+	{
+		sprintf(port_name, "Unit %d", i + 1);
+		port = snd_seq_create_simple_port(seq_handle, port_name,
+						SND_SEQ_PORT_CAP_SUBS_WRITE |
+						SND_SEQ_PORT_CAP_WRITE,
+						SND_SEQ_PORT_TYPE_MIDI_MT32 |
+						SND_SEQ_PORT_TYPE_SYNTH);
+		if (port < 0 || port > MAX_UNITS) {
+			fprintf(stderr, "Error creating sequencer port.\n");
+			return -1;
+		}
+		port_unit[port] = i;
+		printf("Unit %d ALSA address is %d:%d\n", i + 1, snd_seq_client_id(seq_handle), port);
+	}
 	
 	printf("MT-32 emulator ALSA address is %d:0\n", snd_seq_client_id(seq_handle));
 	
 	return port_in_mt;
 }
 
-void attempt_realtime()
+/* switches the calling thread to SCHED_FIFO, priority_boost is added to the middle of the range.
+ * falls back to nice() when the user is not permitted to use realtime scheduling */
+void attempt_realtime(int priority_boost)
 {
+	struct sched_param param;
 	int status;
 	
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = (sched_get_priority_min(SCHED_FIFO) + sched_get_priority_max(SCHED_FIFO)) / 2 + priority_boost;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+	{
+		printf("Set thread scheduling to SCHED_FIFO, priority %d\n", param.sched_priority);
+		return;
+	}
+	
 	status = nice(-20);	
 	if (status != -1)
 		printf("Set thread priority to -20\n");
@@ -395,10 +470,28 @@ static inline struct timeval get_time()
 	return nt;
 }
 
-static inline void get_null_event(midiev_t *newev)
+/* converts the time an event was received at to a synth timestamp */
+static inline MT32Emu::Bit32u event_timestamp(const struct timeval *stamp)
+{
+	struct timeval diff;
+	double usec;
+	
+	timersub(stamp, &render_stamp, &diff);
+	usec = (double)diff.tv_sec * 1000000.0 + (double)diff.tv_usec;
+	
+	return render_sample_count + (MT32Emu::Bit32s)(usec * MT32Emu::SAMPLE_RATE / 1000000.0) + midi_latency_samples;
+}
+
+/* remembers which synth sample is being played right now, i.e. the rendered count less the frames queued in the device */
+static void update_render_stamp()
 {
-	newev->type = EVENT_NONE;
-	gettimeofday(&newev->stamp, NULL);
+	snd_pcm_sframes_t delay;
+	
+	/* the units render in lockstep, so the first one tells the sample count of all */
+	render_stamp = get_time();
+	render_sample_count = mt32->getInternalRenderedSampleCount();
+	if (snd_pcm_delay(pcm_handle, &delay) == 0 && delay > 0)
+		render_sample_count -= (MT32Emu::Bit32u)((double)delay * MT32Emu::SAMPLE_RATE / mt32->getStereoOutputSampleRate());
 }
 
 int remap(int channel)
@@ -438,19 +531,19 @@ int remap(int channel)
 void send_rvmode_sysex(int newmode)
 {
 	midiev_t newev;	
-	newev.type = EVENT_SET_RVMODE; newev.msg = newmode;
+	newev.type = EVENT_SET_RVMODE; newev.unit = 0; newev.msg = newmode;
 	write(eventpipe[1], &newev, sizeof(newev));
 }
 void send_rvtime_sysex(int newtime)
 {
 	midiev_t newev;	
-	newev.type = EVENT_SET_RVTIME; newev.msg = newtime;
+	newev.type = EVENT_SET_RVTIME; newev.unit = 0; newev.msg = newtime;
 	write(eventpipe[1], &newev, sizeof(newev));
 }
 void send_rvlevel_sysex(int newlevel)
 {
 	midiev_t newev;	
-	newev.type = EVENT_SET_RVLEVEL; newev.msg = newlevel;
+	newev.type = EVENT_SET_RVLEVEL; newev.unit = 0; newev.msg = newlevel;
 	write(eventpipe[1], &newev, sizeof(newev));
 }
 
@@ -459,7 +552,7 @@ void flush_mt32_emu()
 {
 	midiev_t newev;
 	unsigned int msg;
-	int i, j;
+	int i, j, unit;
 	
 	/* flush out events */
 	while(1)
@@ -469,12 +562,13 @@ void flush_mt32_emu()
 	}
 	
 	/* push note flush events */
-	for (i = 0; i < 16; i++)
-	{
-		msg  = 0xB0 | i;
-		msg |= 0x7b << 8;
-		mt32->playMsg(msg);
-	}
+	for (unit = 0; unit < num_units; unit++)
+		for (i = 0; i < 16; i++)
+		{
+			msg  = 0xB0 | i;
+			msg |= 0x7b << 8;
+			units[unit].synth->playMsg(msg);
+		}
 	
 	return;
 	
@@ -503,7 +597,7 @@ void client_subscribe_message(snd_seq_event_t *seq_ev)
 	if (status >= 0)
 	{
 		name = snd_seq_client_info_get_name(cinfo);
-		if (seq_ev->dest.port == 0)
+		if (seq_ev->dest.port != port_in_gm)
 			report(DRV_SUBMT32,  name);
 		else
 			report(DRV_SUBGMEMU, name);
@@ -846,7 +940,8 @@ void * event_startup(void *arg_data)
 	int status;
 	
 	events_qd = 0;	
-	attempt_realtime();
+	/* run above the render thread, so that the events are stamped promptly */
+	attempt_realtime(1);
 		
 	while(1)
 	{		
@@ -855,11 +950,12 @@ void * event_startup(void *arg_data)
 			continue;
 		
 		/* Does it need GM->MT mapping */
-		if (seq_ev->dest.port == 1)
+		if (seq_ev->dest.port == port_in_gm)
 			if (convert_to_mt(seq_ev))
 				continue; /* skip event */
 		
 		get_msg(seq_ev, &newev);
+		newev.unit = seq_ev->dest.port <= MAX_UNITS ? port_unit[seq_ev->dest.port] : 0;
 		gettimeofday(&newev.stamp, NULL);		
 				
 		status = write(eventpipe[1], &newev, sizeof(newev));
@@ -926,9 +1022,6 @@ int init_alsadrv()
 
 	pthread_create(&event_thread, NULL, event_startup, NULL);	
 	
-	/* attempt to increase priority, will only work if user is root */
-	attempt_realtime();
-	
 	/* Create UI command pipe */
 	pipe(uicmd_pipe);
 	if(fcntl(uicmd_pipe[0], F_SETFL, O_NONBLOCK) == -1)
@@ -979,11 +1072,16 @@ static void openROMFile(const char romDir[], const char romFile1[], const char r
 
 void reload_mt32_core(int rv)
 {
+	int unit;
+	
 	/* delete core if there is already an instance of it */
 	if (mt32 != NULL)
 	{
-		delete sysexHandler;
-		delete mt32;
+		for (unit = 0; unit < num_units; unit++)
+		{
+			delete units[unit].sysexHandler;
+			delete units[unit].synth;
+		}
 		printf("Restarting MT-32 core\n");
 		report(DRV_M32RESET);
 	} else 
@@ -1007,13 +1105,22 @@ void reload_mt32_core(int rv)
 	const MT32Emu::ROMImage *controlROMImage = MT32Emu::ROMImage::makeROMImage(&controlROMFile);
 	const MT32Emu::ROMImage *pcmROMImage = MT32Emu::ROMImage::makeROMImage(&pcmROMFile);
 
-	/* create MT32Synth object */
-	mt32 = new MT32Emu::Synth(mt32ReportHandler);
-	if (mt32->open(*controlROMImage, *pcmROMImage, analog_output_mode) == false) {
-		report(DRV_MT32FAIL);
-		exit(1);
+	/* create MT32Synth objects, the units share the data decoded from the ROMs.
+	 * only the first unit reports to the user interface */
+	for (unit = 0; unit < num_units; unit++)
+	{
+		MT32Emu::Synth *synth = new MT32Emu::Synth(unit == 0 ? mt32ReportHandler : NULL);
+		if (synth->open(*controlROMImage, *pcmROMImage, analog_output_mode) == false) {
+			report(DRV_MT32FAIL);
+			exit(1);
+		}
+		synth->setReverbEnabled(rv);
+		synth->setOutputGain(gain_multiplier);
+		synth->setReverbOutputGain(gain_multiplier);
+		units[unit].synth = synth;
+		units[unit].sysexHandler = new SysexHandler(*synth);
 	}
-	sysexHandler = new SysexHandler(*mt32);
+	mt32 = units[0].synth;
 
 	MT32Emu::ROMImage::freeROMImage(controlROMImage);
 	MT32Emu::ROMImage::freeROMImage(pcmROMImage);
@@ -1022,39 +1129,263 @@ void reload_mt32_core(int rv)
 	send_rvtime_sysex(rv_time);
 	send_rvlevel_sysex(rv_level);
 
-	mt32->setReverbEnabled(rv);
-	mt32->setOutputGain(gain_multiplier);
-	mt32->setReverbOutputGain(gain_multiplier);
+	/* keep the freshly allocated synth resident, page faults would stall the render thread */
+	mlockall(MCL_CURRENT);
+	update_render_stamp();
+}
+
+static void write_wav_data(const unsigned char *data, int size, signed int *total_bytes)
+{
+	int pos;
+	
+	*total_bytes += size;
+	fwrite(data, 1, size, recwav_file); 	
+	
+	pos = ftell(recwav_file);									
+	fseek(recwav_file, 0x28, SEEK_SET);
+	fwrite(total_bytes, 1, 4, recwav_file);
+	fseek(recwav_file, pos, SEEK_SET);
+}
+
+/* renders the units beyond the first into their own buffers whenever the main loop asks for */
+static void *unit_startup(void *arg_data)
+{
+	unit_t *unit = (unit_t *)arg_data;
+	unsigned int generation = 0;
+	
+	attempt_realtime(0);
+	
+	pthread_mutex_lock(&render_mutex);
+	while (1)
+	{
+		while (generation == render_generation)
+			pthread_cond_wait(&render_start_cond, &render_mutex);
+		generation = render_generation;
+		pthread_mutex_unlock(&render_mutex);
+		
+		unit->synth->render(unit->buffer, render_frames);
+		
+		pthread_mutex_lock(&render_mutex);
+		if (--units_pending == 0)
+			pthread_cond_signal(&render_done_cond);
+	}
+	
+	return NULL;
+}
+
+static void start_unit_threads()
+{
+	int unit;
+	
+	for (unit = 1; unit < num_units; unit++)
+	{
+		units[unit].buffer = new MT32Emu::Bit16s[UNIT_BUFFER_FRAMES * 2];
+		pthread_create(&units[unit].thread, NULL, unit_startup, &units[unit]);
+	}
+}
+
+/* renders the first unit into the stream while the others render concurrently, then mixes their output in */
+static void render_units(MT32Emu::Bit16s *stream, unsigned int frames)
+{
+	unsigned int chunk, i;
+	int unit, sample;
+	
+	if (num_units == 1)
+	{
+		mt32->render(stream, frames);
+		return;
+	}
+	
+	while (frames > 0)
+	{
+		chunk = frames < UNIT_BUFFER_FRAMES ? frames : UNIT_BUFFER_FRAMES;
+		
+		pthread_mutex_lock(&render_mutex);
+		render_frames = chunk;
+		units_pending = num_units - 1;
+		render_generation++;
+		pthread_cond_broadcast(&render_start_cond);
+		pthread_mutex_unlock(&render_mutex);
+		
+		mt32->render(stream, chunk);
+		
+		pthread_mutex_lock(&render_mutex);
+		while (units_pending > 0)
+			pthread_cond_wait(&render_done_cond, &render_mutex);
+		pthread_mutex_unlock(&render_mutex);
+		
+		for (i = 0; i < chunk << 1; i++)
+		{
+			sample = stream[i];
+			for (unit = 1; unit < num_units; unit++)
+				sample += units[unit].buffer[i];
+			if (sample < -32768) sample = -32768;
+			if (sample > 32767) sample = 32767;
+			stream[i] = (MT32Emu::Bit16s)sample;
+		}
+		
+		stream += chunk << 1;
+		frames -= chunk;
+	}
+}
+
+/* renders up to size bytes straight into the mmap'd device buffer. returns the number of bytes rendered or -1 */
+static int render_mmap(int size, signed int *total_bytes)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, frames;
+	snd_pcm_sframes_t committed;
+	unsigned char *data;
+	
+	frames = size >> 2;
+	if (snd_pcm_mmap_begin(pcm_handle, &areas, &offset, &frames) < 0 || frames == 0)
+		return -1;
+	
+	data = (unsigned char *)areas[0].addr + (areas[0].first >> 3) + offset * (areas[0].step >> 3);
+	render_units((MT32Emu::Bit16s *)data, frames);
+	
+	/* output to WAV file */
+	if (consumer_types & CONSUME_WAVOUT)
+		write_wav_data(data, frames << 2, total_bytes);
+	
+	committed = snd_pcm_mmap_commit(pcm_handle, offset, frames);
+	if (committed < 0 || (snd_pcm_uframes_t)committed != frames)
+		return -1;
+	
+	if (snd_pcm_state(pcm_handle) == SND_PCM_STATE_PREPARED)
+		snd_pcm_start(pcm_handle);
+	
+	return frames << 2;
+}
+
+/* the reverb settings made in the user interface apply to all the units */
+static void play_rvsysex()
+{
+	int unit;
+	
+	rvsysex[9] = 128-((rvsysex[5]+rvsysex[6]+rvsysex[7]+rvsysex[8])&127);
+	for (unit = 0; unit < num_units; unit++)
+		units[unit].synth->playSysex(rvsysex, 11);
+}
+
+static void process_event(midiev_t *newev, int rv)
+{
+	MT32Emu::Bit32u timestamp;
+	MT32Emu::Synth *synth = units[newev->unit].synth;
+	
+	switch(newev->type)
+	{
+	    case EVENT_MIDI:
+		synth->playMsg(newev->msg, event_timestamp(&newev->stamp));
+		break;
+		
+	    case EVENT_MIDI_TRIPLET: {
+		unsigned int *msg_buffer = (unsigned int *)newev->sysex;
+		timestamp = event_timestamp(&newev->stamp);
+		for(int i = 0; i < 3; i++) {
+			synth->playMsg(msg_buffer[i], timestamp);
+		}
+		delete[] msg_buffer;
+		break;
+	    }
+
+	    case EVENT_SYSEX:
+		/* record it if needed */
+		if (consumer_types & CONSUME_SYSEX)
+		{
+			fwrite((unsigned char *)newev->sysex, 1, newev->sysex_len, recsyx_file);
+			fflush(recsyx_file);
+		}			
+		units[newev->unit].sysexHandler->setTimestamp(event_timestamp(&newev->stamp));
+		units[newev->unit].sysexHandler->parseStream((MT32Emu::Bit8u *) newev->sysex, newev->sysex_len);
+		free(newev->sysex);
+		break;
+	
+	    case EVENT_SET_RVMODE:			
+		rvsysex[7]  = 1;
+		rvsysex[8] = newev->msg;	
+		play_rvsysex();
+		break;
+	    case EVENT_SET_RVTIME:			
+		rvsysex[7]  = 2;
+		rvsysex[8] = newev->msg;	
+		play_rvsysex();
+		break;
+	    case EVENT_SET_RVLEVEL:			
+		rvsysex[7]  = 3;
+		rvsysex[8] = newev->msg;	
+		play_rvsysex();
+		break;
+	
+	    case EVENT_RESET:
+		reload_mt32_core(rv);
+		break;
+		
+	    case EVENT_WAVREC_ON:
+		start_recordwav();
+		if (recwav_filename != NULL)
+			report(DRV_NEWWAV, recwav_filename);
+		break;
+	    case EVENT_WAVREC_OFF:
+		if (recwav_filename != NULL)
+		{
+			fclose(recwav_file); free(recwav_filename); 
+			recwav_file = NULL; recwav_filename = NULL;
+			report(DRV_WAVOUTPUT, 0);
+			consumer_types ^= CONSUME_WAVOUT;
+		}
+		break;			
+
+	    case EVENT_SYXREC_ON:
+		start_recordsyx();
+		if (recsyx_filename != NULL)
+			report(DRV_NEWSYX, recsyx_filename);
+		break;
+	    case EVENT_SYXREC_OFF:
+		if (recsyx_filename != NULL)
+		{
+			consumer_types ^= CONSUME_SYSEX;
+			fclose(recsyx_file); free(recsyx_filename);
+			recsyx_file = NULL; recsyx_filename = NULL;
+			report(DRV_SYXOUTPUT, 0);
+		}
+		break;			
+	}		
 }
 
 int process_loop(int rv)
 {
 	unsigned char processbuffer[FRAGMENT_SIZE];
-	unsigned int msg;
-	struct timeval ot;
-	int i, n, pos, csize, size, state;
-	signed int total_bytes, bufferused;
+	int n, csize, size, pcm_fd_count;
+	signed int total_bytes;
 	midiev_t newev;
-	struct pollfd event_poll;
+	struct pollfd *event_poll;
 	int status, cmdid;
-	snd_pcm_uframes_t frames;
+	snd_pcm_sframes_t frames;
 	snd_pcm_state_t pcmstate;
 	
 	mt32 = NULL;
-	sysexHandler = NULL;
 	rv_type = 0;
 	rv_time = 5;
 	rv_level = 3;
 	consumer_types = 0;
 	
+	/* attempt to switch the render thread to realtime scheduling, will only work if user is permitted */
+	attempt_realtime(0);
+	
 	reload_mt32_core(rv);
+	start_unit_threads();
 	
-	/* setup poll info */
-	event_poll.fd = eventpipe[0];
-	event_poll.events = POLLIN | POLLPRI;
+	/* setup poll info, wake up either on events or when the pcm device wants more data */
+	pcm_fd_count = snd_pcm_poll_descriptors_count(pcm_handle);
+	if (pcm_fd_count < 0)
+		pcm_fd_count = 0;
+	event_poll = new struct pollfd[1 + pcm_fd_count];
+	event_poll[0].fd = eventpipe[0];
+	event_poll[0].events = POLLIN | POLLPRI;
+	snd_pcm_poll_descriptors(pcm_handle, event_poll + 1, pcm_fd_count);
 	
 	/* init variables */
-	ot = get_time();
 	total_bytes = 0;
 	csize = 0;
 
@@ -1062,7 +1393,6 @@ int process_loop(int rv)
 	
 	/* the pcm output will usually underrun at this point because of the long running
 	 * time for the initialisation of the ClassicOpen call */
-	bufferused = 0;
 	memset(processbuffer, 0, FRAGMENT_SIZE);
 		
 	/* setup consumers */
@@ -1084,15 +1414,14 @@ int process_loop(int rv)
 
 	while (1) 
 	{		
-		n = poll(&event_poll, 1, 20);
+		n = poll(event_poll, 1 + pcm_fd_count, 20);
 		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			delete[] event_poll;
 			return -1;
-
-		if (n > 0)
-			read(eventpipe[0], &newev, sizeof(newev));
-		else
-			get_null_event(&newev);
-					
+		}
 		
 		/* flush events till an unsubscribe event is found */
 		if (flush_events)
@@ -1114,7 +1443,7 @@ int process_loop(int rv)
 		
 		/* get new time */
 		frames = snd_pcm_avail_update(pcm_handle);
-		csize = frames << 2;
+		csize = frames > 0 ? frames << 2 : 0;
 				
 		/* process data till offset */
 		while(csize > 0)
@@ -1130,111 +1459,36 @@ int process_loop(int rv)
 				}			
 
 			size = csize;
-			if (size > FRAGMENT_SIZE)
-				size = FRAGMENT_SIZE;
+			if (pcm_mmap && (consumer_types & CONSUME_PLAYING))
+			{
+				/* no intermediate buffer, render straight into the device */
+				size = render_mmap(size, &total_bytes);
+				if (size < 0)
+					break;
+			} else {
+				if (size > FRAGMENT_SIZE)
+					size = FRAGMENT_SIZE;
 
-			mt32->render((MT32Emu::Bit16s *)processbuffer, size >> 2);
+				render_units((MT32Emu::Bit16s *)processbuffer, size >> 2);
 
-			/* output to WAV file */
-			if (consumer_types & CONSUME_WAVOUT)
-			{
-				total_bytes += size;
-				fwrite(processbuffer, 1, size, recwav_file); 	
-				
-				pos = ftell(recwav_file);									
-				fseek(recwav_file, 0x28, SEEK_SET);
-				fwrite(&total_bytes, 1, 4, recwav_file);
-				fseek(recwav_file, pos, SEEK_SET);
-			} 
+				/* output to WAV file */
+				if (consumer_types & CONSUME_WAVOUT)
+					write_wav_data(processbuffer, size, &total_bytes);
 					      			
-			/* output data to sound card buffer */
-			if (consumer_types & CONSUME_PLAYING)
-				snd_pcm_writei(pcm_handle, processbuffer, size >> 2);
+				/* output data to sound card buffer */
+				if (consumer_types & CONSUME_PLAYING)
+					snd_pcm_writei(pcm_handle, processbuffer, size >> 2);
+			}
 			
 			csize -= size;			
 		}
 		
-		/* decide what to do */
-		switch(newev.type)
-		{
-		    case EVENT_MIDI:
-			mt32->playMsg(newev.msg);    
-			break;
-			
-		    case EVENT_MIDI_TRIPLET: {
-			unsigned int *msg_buffer = (unsigned int *)newev.sysex;
-			for(int i = 0; i < 3; i++) {
-				mt32->playMsg(msg_buffer[i]);
-			}
-			delete[] msg_buffer;
-			break;
-		    }
-
-		    case EVENT_SYSEX:
-			/* record it if needed */
-			if (consumer_types & CONSUME_SYSEX)
-			{
-				fwrite((unsigned char *)newev.sysex, 1, newev.sysex_len, recsyx_file);
-				fflush(recsyx_file);
-			}			
-			sysexHandler->parseStream((MT32Emu::Bit8u *) newev.sysex, newev.sysex_len);
-			free(newev.sysex);
-			break;
-		
-		    case EVENT_SET_RVMODE:			
-			rvsysex[7]  = 1;
-			rvsysex[8] = newev.msg;	
-			rvsysex[9] = 128-((rvsysex[5]+rvsysex[6]+rvsysex[7]+rvsysex[8])&127);
-			mt32->playSysex(rvsysex, 11);
-			break;
-		    case EVENT_SET_RVTIME:			
-			rvsysex[7]  = 2;
-			rvsysex[8] = newev.msg;	
-			rvsysex[9] = 128-((rvsysex[5]+rvsysex[6]+rvsysex[7]+rvsysex[8])&127);
-			mt32->playSysex(rvsysex, 11);
-			break;
-		    case EVENT_SET_RVLEVEL:			
-			rvsysex[7]  = 3;
-			rvsysex[8] = newev.msg;	
-			rvsysex[9] = 128-((rvsysex[5]+rvsysex[6]+rvsysex[7]+rvsysex[8])&127);
-			mt32->playSysex(rvsysex, 11);
-			break;
-		
-		    case EVENT_RESET:
-			reload_mt32_core(rv);
-			break;
-			
-		    case EVENT_WAVREC_ON:
-			start_recordwav();
-			if (recwav_filename != NULL)
-				report(DRV_NEWWAV, recwav_filename);
-			break;
-		    case EVENT_WAVREC_OFF:
-			if (recwav_filename != NULL)
-			{
-				fclose(recwav_file); free(recwav_filename); 
-				recwav_file = NULL; recwav_filename = NULL;
-				report(DRV_WAVOUTPUT, 0);
-				consumer_types ^= CONSUME_WAVOUT;
-			}
-			break;			
-
-		    case EVENT_SYXREC_ON:
-			start_recordsyx();
-			if (recsyx_filename != NULL)
-				report(DRV_NEWSYX, recsyx_filename);
-			break;
-		    case EVENT_SYXREC_OFF:
-			if (recsyx_filename != NULL)
-			{
-				consumer_types ^= CONSUME_SYSEX;
-				fclose(recsyx_file); free(recsyx_filename);
-				recsyx_file = NULL; recsyx_filename = NULL;
-				report(DRV_SYXOUTPUT, 0);
-			}
-			break;			
-		}		
+		/* decide what to do with the events that arrived meanwhile */
+		update_render_stamp();
+		while (read(eventpipe[0], &newev, sizeof(newev)) == sizeof(newev))
+			process_event(&newev, rv);
 	}
 	
+	delete[] event_poll;
 	return 0;
 }
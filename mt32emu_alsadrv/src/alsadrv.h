@@ -23,6 +23,8 @@
 
 typedef struct {
 	unsigned char type;	
+	/* the emulated unit the event is destined for */
+	unsigned char unit;
 	
 	unsigned int msg;
 	struct timeval stamp;
@@ -83,6 +85,11 @@ extern int alsa_buffer_size;
 extern int eventpipe[];
 extern char *pcm_name;
 
+/* Each unit is driven by a sequencer port of its own */
+#define MAX_UNITS            16
+
+extern int num_units;
+
 extern double gain_multiplier;
 extern MT32Emu::AnalogOutputMode analog_output_mode;
 extern unsigned int sample_rate;
@@ -97,6 +104,7 @@ extern enum rom_search_type_t {
 int init_alsadrv();
 int process_loop(int rv);
 
+/* the first unit, the user interface reflects its state */
 extern MT32Emu::Synth *mt32;
 
 
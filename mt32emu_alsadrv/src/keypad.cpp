@@ -202,7 +202,7 @@ void cb_sysexdump(int button)
 		newev.type = EVENT_SYXREC_ON;
 		LXPM(recordmenu.buttons[3], "yes", cb_sysexdump);		
 	}
-	newev.msg = 0;
+	newev.unit = 0; newev.msg = 0;
 	write(eventpipe[1], &newev, sizeof(newev));	
 
 	redraw_keypad();
@@ -218,7 +218,7 @@ void cb_wavdump(int button)
 		newev.type = EVENT_WAVREC_ON;
 		LXPM(recordmenu.buttons[4], "yes", cb_wavdump);		
 	}
-	newev.msg = 0;
+	newev.unit = 0; newev.msg = 0;
 	write(eventpipe[1], &newev, sizeof(newev));	
 
 	redraw_keypad();
@@ -256,7 +256,7 @@ void cb_clear(int button)
 void cb_reset(int button)
 {
 	midiev_t newev;
-	newev.type = EVENT_RESET; newev.msg = 0;
+	newev.type = EVENT_RESET; newev.unit = 0; newev.msg = 0;
 	write(eventpipe[1], &newev, sizeof(newev));	
 }
 
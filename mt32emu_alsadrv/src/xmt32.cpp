@@ -472,6 +472,8 @@ void usage(char *argv[])
 	printf("-e filename  : Sysex patch output (.syx file)\n");
 	printf("-r           : Enable reverb (default)\n");
 	printf("-n           : Disable reverb \n");
+	printf("-u count     : Number of emulated units, each on its own sequencer port\n"
+	       "               (default: 1, at most %d)\n", MAX_UNITS);
 	
 	printf("\n");
 	printf("-m           : Manual buffering mode (buffer does not grow)\n");
@@ -538,6 +540,10 @@ int main(int argc, char *argv[])
 			
 		    case 'r': xreverb_switch = 1; break;
 		    case 'n': xreverb_switch = 0; break;
+		    case 'u': i++; if (i == argc) usage(argv);
+			num_units = atoi(argv[i]);
+			if (num_units < 1 || MAX_UNITS < num_units) usage(argv);
+			break;
 			
 		    case 'a': buffer_mode = BUFFER_AUTO;   break;
 		    case 'm': buffer_mode = BUFFER_MANUAL; break;
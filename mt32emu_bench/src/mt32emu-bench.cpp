@@ -0,0 +1,1124 @@
+/*
+ * Copyright (C) 2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WIN32
+// Needed for clock_gettime() when compiling in strict ANSI mode.
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define MT32EMU_API_TYPE 3
+#include <mt32emu/mt32emu.h>
+
+#if MT32EMU_VERSION_MAJOR != 2 || MT32EMU_VERSION_MINOR < 4
+#error Incompatible mt32emu library version
+#endif
+
+using namespace MT32Emu;
+
+static const unsigned int DEFAULT_SECONDS = 10;
+static const unsigned int DEFAULT_BUFFER_FRAME_COUNT = 512;
+
+// Maximum length of sysex messages generated by workloads.
+static const Bit32u MAX_SYSEX_LENGTH = 32;
+
+// The MT-32 (and the emulator) by default assigns parts 1-8 to MIDI channels 2-9 and the rhythm part to MIDI channel 10.
+static const Bit8u FIRST_MELODIC_CHANNEL = 1;
+static const Bit8u MELODIC_CHANNEL_COUNT = 8;
+static const Bit8u RHYTHM_CHANNEL = 9;
+
+static const char * const RENDERER_TYPE_NAMES[] = {"int16", "float"};
+static const char * const DAC_INPUT_MODE_NAMES[] = {"nice", "pure", "gen1", "gen2"};
+static const char * const ANALOG_OUTPUT_MODE_NAMES[] = {"digital", "coarse", "accurate", "oversampled"};
+// Reverb modes are indexed as the MT-32 reverb mode + 1, the first one means that reverb is disabled.
+static const char * const REVERB_MODE_NAMES[] = {"off", "room", "hall", "plate", "tap-delay"};
+// Indexed by SIMDInstructionSet.
+static const char * const SIMD_INSTRUCTION_SET_NAMES[] = {"none", "sse2", "sse4.1", "avx2", "neon"};
+// Indexed by FloatWaveAccuracy.
+static const char * const FLOAT_WAVE_ACCURACY_NAMES[] = {"reference", "high", "fast"};
+
+static const int RENDERER_TYPE_COUNT = 2;
+static const int DAC_INPUT_MODE_COUNT = 4;
+static const int ANALOG_OUTPUT_MODE_COUNT = 4;
+static const int REVERB_MODE_COUNT = 5;
+static const int SIMD_INSTRUCTION_SET_COUNT = 5;
+static const int FLOAT_WAVE_ACCURACY_COUNT = 3;
+
+// Configuration the other parameters are swept against unless the full matrix is requested.
+static const int BASE_ANALOG_OUTPUT_MODE = 1;
+static const int BASE_REVERB_MODE = 1;
+
+// In the golden render mode, each combination also gets a run that renders the six DAC streams instead of the output.
+// The analog circuit is not involved then, so such runs are listed under this pseudo analog output mode.
+static const int DAC_STREAMS_OUTPUT = ANALOG_OUTPUT_MODE_COUNT;
+static const char DAC_STREAMS_OUTPUT_NAME[] = "dac-streams";
+static const int DAC_STREAM_COUNT = 6;
+
+static const Bit32u FNV_OFFSET_BASIS = 2166136261U;
+static const Bit32u FNV_PRIME = 16777619U;
+
+struct MidiEvent {
+	Bit32u timestamp;
+	Bit32u shortMessage;
+	Bit32u sysexLength;
+	Bit8u sysex[MAX_SYSEX_LENGTH];
+};
+
+typedef std::vector<MidiEvent> EventList;
+
+// Generates the MIDI events for a workload, with timestamps in synth samples (at SAMPLE_RATE) in range [0, length).
+typedef void (*WorkloadGenerator)(EventList &events, Bit32u length);
+
+struct Workload {
+	const char *name;
+	const char *description;
+	WorkloadGenerator generator;
+};
+
+struct Options {
+	const char *romDir;
+	unsigned int seconds;
+	unsigned int bufferFrameCount;
+	unsigned int partialCount;
+	unsigned int threadCount;
+	const char *workloadName;
+	int rendererType;
+	int dacInputMode;
+	int analogOutputMode;
+	int reverbMode;
+	int simdInstructionSet;
+	int floatWaveAccuracy;
+	bool fullMatrix;
+	// Reference file for the golden render mode, which runs all the combinations and hashes the output.
+	const char *recordFileName;
+	const char *verifyFileName;
+	// Session recording to replay instead of running the workloads.
+	const char *replayFileName;
+	bool printRenderCalls;
+};
+
+struct ROMData {
+	std::vector<Bit8u> controlROM;
+	std::vector<Bit8u> pcmROM;
+};
+
+// Hashes of the golden render keyed by the names of the workload and the configuration, as written by makeReferenceKey().
+typedef std::map<std::string, Bit32u> ReferenceMap;
+
+struct Result {
+	Bit32u frameCount;
+	Bit32u sampleRate;
+	double midiSeconds;
+	double renderSeconds;
+	Bit32u droppedEventCount;
+	// FNV-1a hash of the rendered samples, in little-endian byte order.
+	Bit32u hash;
+	// Only available when the library is built with render statistics support.
+	bool hasStatistics;
+	mt32emu_render_statistics statistics;
+};
+
+static double getTime() {
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return double(counter.QuadPart) / double(frequency.QuadPart);
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+#endif
+}
+
+// Simple LCG, to make workloads reproducible regardless of the C library.
+class Random {
+	Bit32u state;
+
+public:
+	explicit Random(Bit32u seed) : state(seed) {}
+
+	Bit32u next(Bit32u range) {
+		state = state * 1103515245 + 12345;
+		return ((state >> 16) & 0x7FFF) % range;
+	}
+};
+
+// Feeds the bytes of the value into the FNV-1a hash in little-endian order.
+static Bit32u updateHash(Bit32u hash, Bit32u value, int byteCount) {
+	for (int byteIx = 0; byteIx < byteCount; byteIx++) {
+		hash = (hash ^ ((value >> (byteIx << 3)) & 0xFF)) * FNV_PRIME;
+	}
+	return hash;
+}
+
+static Bit32u updateHash(Bit32u hash, const Bit16s *samples, Bit32u sampleCount) {
+	for (Bit32u i = 0; i < sampleCount; i++) {
+		hash = updateHash(hash, Bit16u(samples[i]), 2);
+	}
+	return hash;
+}
+
+static Bit32u updateHash(Bit32u hash, const float *samples, Bit32u sampleCount) {
+	for (Bit32u i = 0; i < sampleCount; i++) {
+		Bit32u sample;
+		memcpy(&sample, &samples[i], sizeof(sample));
+		hash = updateHash(hash, sample, 4);
+	}
+	return hash;
+}
+
+static bool isEarlier(const MidiEvent &event1, const MidiEvent &event2) {
+	return event1.timestamp < event2.timestamp;
+}
+
+static void addShortMessage(EventList &events, Bit32u timestamp, Bit8u status, Bit8u data1, Bit8u data2) {
+	MidiEvent event;
+	event.timestamp = timestamp;
+	event.shortMessage = status | (data1 << 8) | (data2 << 16);
+	event.sysexLength = 0;
+	events.push_back(event);
+}
+
+// Makes a Roland DT1 sysex message addressed to the MT-32 that writes data at the specified address.
+static Bit32u makeDT1Sysex(Bit8u *sysex, Bit32u address, const Bit8u *data, Bit32u dataLength) {
+	static const Bit8u HEADER[] = {0xF0, 0x41, 0x10, 0x16, 0x12};
+	memcpy(sysex, HEADER, sizeof(HEADER));
+	Bit8u *body = sysex + sizeof(HEADER);
+	body[0] = Bit8u((address >> 16) & 0x7F);
+	body[1] = Bit8u((address >> 8) & 0x7F);
+	body[2] = Bit8u(address & 0x7F);
+	memcpy(body + 3, data, dataLength);
+	Bit32u bodyLength = 3 + dataLength;
+	Bit32u checksum = 0;
+	for (Bit32u i = 0; i < bodyLength; i++) {
+		checksum += body[i];
+	}
+	body[bodyLength] = Bit8u((128 - (checksum & 0x7F)) & 0x7F);
+	body[bodyLength + 1] = 0xF7;
+	return Bit32u(sizeof(HEADER)) + bodyLength + 2;
+}
+
+static void addSysex(EventList &events, Bit32u timestamp, Bit32u address, const Bit8u *data, Bit32u dataLength) {
+	MidiEvent event;
+	event.timestamp = timestamp;
+	event.shortMessage = 0;
+	event.sysexLength = makeDT1Sysex(event.sysex, address, data, dataLength);
+	events.push_back(event);
+}
+
+// Keeps every partial busy: the hold pedal is pressed on all melodic parts, and more notes are played than there are partials.
+// The chords are restruck every two seconds, so that notes of decaying timbres do not fade out.
+static void generateSustainedWorkload(EventList &events, Bit32u length) {
+	Random random(1);
+	const Bit32u restrikeInterval = 2 * SAMPLE_RATE;
+	for (Bit8u channel = FIRST_MELODIC_CHANNEL; channel < FIRST_MELODIC_CHANNEL + MELODIC_CHANNEL_COUNT; channel++) {
+		addShortMessage(events, 0, 0xB0 | channel, 64, 127);
+	}
+	for (Bit32u timestamp = 0; timestamp < length; timestamp += restrikeInterval) {
+		for (Bit8u channel = FIRST_MELODIC_CHANNEL; channel < FIRST_MELODIC_CHANNEL + MELODIC_CHANNEL_COUNT; channel++) {
+			if (timestamp > 0) {
+				// All notes off. The notes held by the pedal keep sounding until they are stolen.
+				addShortMessage(events, timestamp, 0xB0 | channel, 123, 0);
+			}
+			for (Bit32u noteIx = 0; noteIx < 8; noteIx++) {
+				Bit32u noteTimestamp = timestamp + (channel * 8 + noteIx) * 64;
+				if (noteTimestamp >= length) break;
+				addShortMessage(events, noteTimestamp, 0x90 | channel, Bit8u(36 + random.next(48)), Bit8u(64 + random.next(64)));
+			}
+		}
+	}
+}
+
+// Plays a rhythm key each 10 milliseconds, which mostly results in PCM partials.
+static void generateDrumsWorkload(EventList &events, Bit32u length) {
+	Random random(2);
+	const Bit32u interval = SAMPLE_RATE / 100;
+	for (Bit32u timestamp = 0; timestamp < length; timestamp += interval) {
+		addShortMessage(events, timestamp, 0x90 | RHYTHM_CHANNEL, Bit8u(35 + random.next(47)), Bit8u(80 + random.next(48)));
+	}
+}
+
+// Plays short notes at a high rate on all melodic parts, each note is released 20 milliseconds after it is started.
+static void generateNotesWorkload(EventList &events, Bit32u length) {
+	Random random(3);
+	const Bit32u interval = SAMPLE_RATE / 500;
+	const Bit32u noteLength = SAMPLE_RATE / 50;
+	Bit8u channel = FIRST_MELODIC_CHANNEL;
+	for (Bit32u timestamp = 0; timestamp + noteLength < length; timestamp += interval) {
+		Bit8u key = Bit8u(24 + random.next(84));
+		addShortMessage(events, timestamp, 0x90 | channel, key, Bit8u(1 + random.next(127)));
+		addShortMessage(events, timestamp + noteLength, 0x80 | channel, key, 64);
+		if (++channel == FIRST_MELODIC_CHANNEL + MELODIC_CHANNEL_COUNT) channel = FIRST_MELODIC_CHANNEL;
+	}
+}
+
+// Sends a sysex message each millisecond while a few notes are playing. The messages alternately change the TVF cutoff
+// of the timbre assigned to part 1, which affects the playing partials, the fine tuning of part 2 and the master volume.
+static void generateSysexWorkload(EventList &events, Bit32u length) {
+	static const Bit32u TIMBRE_TEMP_PART1_PARTIAL1_TVF_CUTOFF_ADDRESS = 0x040025;
+	static const Bit32u PATCH_TEMP_PART2_FINE_TUNE_ADDRESS = 0x030013;
+	static const Bit32u SYSTEM_MASTER_VOLUME_ADDRESS = 0x100016;
+
+	Random random(4);
+	const Bit32u interval = SAMPLE_RATE / 1000;
+	const Bit32u restrikeInterval = SAMPLE_RATE / 2;
+	Bit32u messageIx = 0;
+	for (Bit32u timestamp = 0; timestamp < length; timestamp += interval) {
+		if (timestamp % restrikeInterval == 0) {
+			for (Bit8u channel = FIRST_MELODIC_CHANNEL; channel < FIRST_MELODIC_CHANNEL + 2; channel++) {
+				addShortMessage(events, timestamp, 0xB0 | channel, 123, 0);
+				for (Bit32u noteIx = 0; noteIx < 3; noteIx++) {
+					addShortMessage(events, timestamp, 0x90 | channel, Bit8u(48 + 4 * noteIx + random.next(4)), 100);
+				}
+			}
+		}
+		Bit8u data;
+		switch (messageIx++ % 3) {
+		case 0:
+			data = Bit8u(random.next(101));
+			addSysex(events, timestamp, TIMBRE_TEMP_PART1_PARTIAL1_TVF_CUTOFF_ADDRESS, &data, 1);
+			break;
+		case 1:
+			data = Bit8u(random.next(101));
+			addSysex(events, timestamp, PATCH_TEMP_PART2_FINE_TUNE_ADDRESS, &data, 1);
+			break;
+		default:
+			data = Bit8u(70 + random.next(31));
+			addSysex(events, timestamp, SYSTEM_MASTER_VOLUME_ADDRESS, &data, 1);
+			break;
+		}
+	}
+}
+
+static const Workload WORKLOADS[] = {
+	{"sustained", "all partials sustained", generateSustainedWorkload},
+	{"drums", "PCM-heavy rhythm part", generateDrumsWorkload},
+	{"notes", "rapid note-on/off", generateNotesWorkload},
+	{"sysex", "sysex flood", generateSysexWorkload}
+};
+
+static const int WORKLOAD_COUNT = int(sizeof(WORKLOADS) / sizeof(WORKLOADS[0]));
+
+static bool readFile(const char *romDir, const char *fileName, std::vector<Bit8u> &data) {
+	std::vector<char> pathName(strlen(romDir) + strlen(fileName) + 1);
+	strcpy(&pathName[0], romDir);
+	strcat(&pathName[0], fileName);
+	FILE *file = fopen(&pathName[0], "rb");
+	if (file == NULL) return false;
+	data.clear();
+	Bit8u buffer[65536];
+	size_t readSize;
+	while ((readSize = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + readSize);
+	}
+	fclose(file);
+	return !data.empty();
+}
+
+static bool loadROMs(const char *romDir, ROMData &roms) {
+	if (!readFile(romDir, "CM32L_CONTROL.ROM", roms.controlROM) && !readFile(romDir, "MT32_CONTROL.ROM", roms.controlROM)) {
+		fprintf(stderr, "Control ROM not found.\n");
+		return false;
+	}
+	if (!readFile(romDir, "CM32L_PCM.ROM", roms.pcmROM) && !readFile(romDir, "MT32_PCM.ROM", roms.pcmROM)) {
+		fprintf(stderr, "PCM ROM not found.\n");
+		return false;
+	}
+	return true;
+}
+
+// Format of the session recording written by mt32emu_start_session_recording(), see SessionRecorder.h in the library.
+static const char SESSION_MAGIC[] = "MT32EMUR";
+static const Bit32u SESSION_VERSION = 1;
+
+enum SessionRecordType {
+	SessionRecordType_SHORT_MESSAGE,
+	SessionRecordType_SYSEX,
+	SessionRecordType_RENDER
+};
+
+enum SessionRenderCallType {
+	SessionRenderCallType_STEREO_BIT16S,
+	SessionRenderCallType_STEREO_FLOAT,
+	SessionRenderCallType_DAC_STREAMS_BIT16S,
+	SessionRenderCallType_DAC_STREAMS_FLOAT,
+	SessionRenderCallType_PART_STREAMS_BIT16S,
+	SessionRenderCallType_PART_STREAMS_FLOAT,
+	SessionRenderCallType_BYPASSING_LPF,
+	SessionRenderCallType_FAST_FORWARD
+};
+
+static const char * const SESSION_RENDER_CALL_TYPE_NAMES[] = {"stereo-int16", "stereo-float", "dac-int16", "dac-float",
+	"parts-int16", "parts-float", "bypass-lpf", "fast-forward"};
+static const int SESSION_RENDER_CALL_TYPE_COUNT = 8;
+
+struct SessionEvent {
+	Bit32u timestamp;
+	Bit32u shortMessage;
+	// Offset of the message in Session::sysexData, valid unless sysexLength is 0.
+	size_t sysexOffset;
+	Bit32u sysexLength;
+};
+
+struct SessionRenderCall {
+	int callType;
+	Bit32u frameCount;
+	// The events played during the call or before it, in range [firstEventIx, endEventIx).
+	size_t firstEventIx;
+	size_t endEventIx;
+};
+
+struct Session {
+	RendererType rendererType;
+	AnalogOutputMode analogOutputMode;
+	Bit32u partialCount;
+	Bit32u maxPartialCount;
+	Bit32u partialRenderingThreadCount;
+	bool reverbPipelineEnabled;
+	FloatWaveAccuracy floatWaveAccuracy;
+	std::vector<Bit8u> state;
+	std::vector<SessionEvent> events;
+	std::vector<Bit8u> sysexData;
+	std::vector<SessionRenderCall> renderCalls;
+};
+
+class SessionReader {
+	const std::vector<Bit8u> &data;
+	size_t position;
+	bool failed;
+
+public:
+	explicit SessionReader(const std::vector<Bit8u> &useData) : data(useData), position(0), failed(false) {}
+
+	bool isFailed() const {
+		return failed;
+	}
+
+	bool isAtEnd() const {
+		return position == data.size();
+	}
+
+	const Bit8u *readBytes(size_t length) {
+		if (failed || data.size() - position < length) {
+			failed = true;
+			return NULL;
+		}
+		const Bit8u *bytes = &data[0] + position;
+		position += length;
+		return bytes;
+	}
+
+	Bit8u readUInt8() {
+		const Bit8u *bytes = readBytes(1);
+		return bytes == NULL ? 0 : bytes[0];
+	}
+
+	Bit32u readUInt32() {
+		const Bit8u *bytes = readBytes(4);
+		return bytes == NULL ? 0 : bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (Bit32u(bytes[3]) << 24);
+	}
+};
+
+static bool loadSession(const char *fileName, Session &session) {
+	std::vector<Bit8u> data;
+	if (!readFile("", fileName, data)) {
+		fprintf(stderr, "Cannot read session recording %s.\n", fileName);
+		return false;
+	}
+	SessionReader reader(data);
+	const Bit8u *magic = reader.readBytes(sizeof(SESSION_MAGIC) - 1);
+	if (magic == NULL || memcmp(magic, SESSION_MAGIC, sizeof(SESSION_MAGIC) - 1) != 0 || reader.readUInt32() != SESSION_VERSION) {
+		fprintf(stderr, "Unsupported session recording %s.\n", fileName);
+		return false;
+	}
+	session.rendererType = RendererType(reader.readUInt32());
+	session.analogOutputMode = AnalogOutputMode(reader.readUInt32());
+	session.partialCount = reader.readUInt32();
+	session.maxPartialCount = reader.readUInt32();
+	session.partialRenderingThreadCount = reader.readUInt32();
+	session.reverbPipelineEnabled = reader.readUInt8() != 0;
+	session.floatWaveAccuracy = FloatWaveAccuracy(reader.readUInt8());
+	const Bit32u stateSize = reader.readUInt32();
+	const Bit8u *state = reader.readBytes(stateSize);
+	if (state != NULL) session.state.assign(state, state + stateSize);
+	size_t firstEventIx = 0;
+	while (!reader.isFailed() && !reader.isAtEnd()) {
+		const Bit8u recordType = reader.readUInt8();
+		if (recordType == SessionRecordType_RENDER) {
+			SessionRenderCall call;
+			call.callType = reader.readUInt8();
+			call.frameCount = reader.readUInt32();
+			call.firstEventIx = firstEventIx;
+			call.endEventIx = session.events.size();
+			if (call.callType >= SESSION_RENDER_CALL_TYPE_COUNT) break;
+			session.renderCalls.push_back(call);
+			firstEventIx = call.endEventIx;
+			continue;
+		}
+		SessionEvent event;
+		event.timestamp = reader.readUInt32();
+		event.sysexOffset = session.sysexData.size();
+		event.sysexLength = 0;
+		if (recordType == SessionRecordType_SHORT_MESSAGE) {
+			event.shortMessage = reader.readUInt32();
+		} else if (recordType == SessionRecordType_SYSEX) {
+			event.shortMessage = 0;
+			event.sysexLength = reader.readUInt32();
+			const Bit8u *sysex = reader.readBytes(event.sysexLength);
+			if (sysex == NULL || event.sysexLength == 0) break;
+			session.sysexData.insert(session.sysexData.end(), sysex, sysex + event.sysexLength);
+		} else {
+			break;
+		}
+		session.events.push_back(event);
+	}
+	if (reader.isFailed() || !reader.isAtEnd() || session.state.empty()) {
+		fprintf(stderr, "Session recording %s is corrupted.\n", fileName);
+		return false;
+	}
+	return true;
+}
+
+static bool openSessionSynth(Service &service, const ROMData &roms, const Session &session) {
+	service.createContext();
+	if (service.addROMData(&roms.controlROM[0], roms.controlROM.size()) != MT32EMU_RC_ADDED_CONTROL_ROM
+		|| service.addROMData(&roms.pcmROM[0], roms.pcmROM.size()) != MT32EMU_RC_ADDED_PCM_ROM)
+	{
+		fprintf(stderr, "Unrecognised ROMs.\n");
+		return false;
+	}
+	service.setPartialCount(session.partialCount);
+	service.setMaxPartialCount(session.maxPartialCount);
+	service.setAnalogOutputMode(session.analogOutputMode);
+	service.selectRendererType(session.rendererType);
+	service.setFloatWaveAccuracy(session.floatWaveAccuracy);
+	service.setPartialRenderingThreadCount(session.partialRenderingThreadCount);
+	service.setReverbPipelineEnabled(session.reverbPipelineEnabled);
+	if (service.openSynth() != MT32EMU_RC_OK) {
+		fprintf(stderr, "Error opening MT32Emu synthesizer.\n");
+		return false;
+	}
+	if (!service.restoreState(&session.state[0], session.state.size())) {
+		fprintf(stderr, "Unable to restore the recorded state, the session must be replayed with the same ROMs.\n");
+		return false;
+	}
+	// The recorded timestamps already include the MIDI interface delay.
+	service.setMIDIDelayMode(MIDIDelayMode_IMMEDIATE);
+	return true;
+}
+
+// Replays the recorded rendering calls in order, each preceded by queueing the MIDI events played during the call,
+// and reports the timing of the calls. The calls that cannot be made through the C interface are replaced with
+// the closest ones: part streams with DAC streams, fast-forwarding and rendering that bypasses the LPF with the stereo output.
+static int replaySession(const Options &options, const ROMData &roms) {
+	Session session;
+	if (!loadSession(options.replayFileName, session)) return 1;
+	Service service;
+	if (!openSessionSynth(service, roms, session)) {
+		service.freeContext();
+		return 1;
+	}
+	service.resetRenderStatistics();
+	const Bit32u stereoSampleRate = service.getActualStereoOutputSamplerate();
+	printf("Replaying %s: %u render calls, %u MIDI events, renderer %s, analog %s, %u partials, %u threads\n\n", options.replayFileName,
+		Bit32u(session.renderCalls.size()), Bit32u(session.events.size()), RENDERER_TYPE_NAMES[session.rendererType],
+		ANALOG_OUTPUT_MODE_NAMES[session.analogOutputMode], session.partialCount, session.partialRenderingThreadCount);
+	if (options.printRenderCalls) printf("%8s %-12s %8s %8s %12s %8s\n", "call", "type", "frames", "events", "render us", "load");
+
+	Bit32u maxFrameCount = 0;
+	for (size_t callIx = 0; callIx < session.renderCalls.size(); callIx++) {
+		maxFrameCount = std::max(maxFrameCount, session.renderCalls[callIx].frameCount);
+	}
+	std::vector<Bit16s> bit16sBuffer(DAC_STREAM_COUNT * size_t(maxFrameCount));
+	std::vector<float> floatBuffer(DAC_STREAM_COUNT * size_t(maxFrameCount));
+	mt32emu_dac_output_bit16s_streams bit16sStreams;
+	mt32emu_dac_output_float_streams floatStreams;
+	Bit16s ** const bit16sStreamBuffers[DAC_STREAM_COUNT] = {&bit16sStreams.nonReverbLeft, &bit16sStreams.nonReverbRight,
+		&bit16sStreams.reverbDryLeft, &bit16sStreams.reverbDryRight, &bit16sStreams.reverbWetLeft, &bit16sStreams.reverbWetRight};
+	float ** const floatStreamBuffers[DAC_STREAM_COUNT] = {&floatStreams.nonReverbLeft, &floatStreams.nonReverbRight,
+		&floatStreams.reverbDryLeft, &floatStreams.reverbDryRight, &floatStreams.reverbWetLeft, &floatStreams.reverbWetRight};
+	for (int streamIx = 0; streamIx < DAC_STREAM_COUNT; streamIx++) {
+		*bit16sStreamBuffers[streamIx] = maxFrameCount == 0 ? NULL : &bit16sBuffer[streamIx * size_t(maxFrameCount)];
+		*floatStreamBuffers[streamIx] = maxFrameCount == 0 ? NULL : &floatBuffer[streamIx * size_t(maxFrameCount)];
+	}
+
+	std::vector<double> callSeconds(session.renderCalls.size());
+	double totalSeconds = 0.0;
+	double midiSeconds = 0.0;
+	double frameCount = 0.0;
+	Bit32u deadlineMissCount = 0;
+	Bit32u droppedEventCount = 0;
+	for (size_t callIx = 0; callIx < session.renderCalls.size(); callIx++) {
+		const SessionRenderCall &call = session.renderCalls[callIx];
+		double startTime = getTime();
+		for (size_t eventIx = call.firstEventIx; eventIx < call.endEventIx; eventIx++) {
+			const SessionEvent &event = session.events[eventIx];
+			mt32emu_return_code rc;
+			if (event.sysexLength == 0) {
+				rc = service.playMsgAt(event.shortMessage, event.timestamp);
+			} else {
+				rc = service.playSysexAt(&session.sysexData[event.sysexOffset], event.sysexLength, event.timestamp);
+			}
+			if (rc != MT32EMU_RC_OK) droppedEventCount++;
+		}
+		double midiEndTime = getTime();
+
+		Bit32u sampleRate = stereoSampleRate;
+		switch (call.callType) {
+		case SessionRenderCallType_DAC_STREAMS_BIT16S:
+		case SessionRenderCallType_PART_STREAMS_BIT16S:
+			service.renderBit16sStreams(&bit16sStreams, call.frameCount);
+			sampleRate = SAMPLE_RATE;
+			break;
+		case SessionRenderCallType_DAC_STREAMS_FLOAT:
+		case SessionRenderCallType_PART_STREAMS_FLOAT:
+			service.renderFloatStreams(&floatStreams, call.frameCount);
+			sampleRate = SAMPLE_RATE;
+			break;
+		case SessionRenderCallType_STEREO_BIT16S:
+			service.renderBit16s(&bit16sBuffer[0], call.frameCount);
+			break;
+		default:
+			service.renderFloat(&floatBuffer[0], call.frameCount);
+			break;
+		}
+		double renderEndTime = getTime();
+
+		const double renderSeconds = renderEndTime - midiEndTime;
+		const double deadlineSeconds = double(call.frameCount) / double(sampleRate);
+		callSeconds[callIx] = renderSeconds;
+		totalSeconds += renderSeconds;
+		midiSeconds += midiEndTime - startTime;
+		frameCount += call.frameCount;
+		if (renderSeconds > deadlineSeconds) deadlineMissCount++;
+		if (options.printRenderCalls) {
+			printf("%8u %-12s %8u %8u %12.1f %7.1f%%\n", Bit32u(callIx), SESSION_RENDER_CALL_TYPE_NAMES[call.callType], call.frameCount,
+				Bit32u(call.endEventIx - call.firstEventIx), 1e6 * renderSeconds, 100.0 * renderSeconds / deadlineSeconds);
+		}
+	}
+	service.closeSynth();
+	service.freeContext();
+
+	const size_t callCount = callSeconds.size();
+	if (callCount == 0) {
+		printf("No render calls recorded.\n");
+		return 0;
+	}
+	std::sort(callSeconds.begin(), callSeconds.end());
+	if (options.printRenderCalls) printf("\n");
+	printf("Render calls: %u, frames: %.0f, total render time: %.3f sec, MIDI queueing time: %.3f sec\n",
+		Bit32u(callCount), frameCount, totalSeconds, midiSeconds);
+	printf("Per call: mean %.1f us, median %.1f us, 99th percentile %.1f us, max %.1f us\n", 1e6 * totalSeconds / callCount,
+		1e6 * callSeconds[callCount / 2], 1e6 * callSeconds[callCount * 99 / 100], 1e6 * callSeconds[callCount - 1]);
+	printf("Calls that took longer than the duration of the rendered audio: %u\n", deadlineMissCount);
+	if (droppedEventCount > 0) {
+		fprintf(stderr, "%u MIDI events dropped due to MIDI queue overflow.\n", droppedEventCount);
+	}
+	return 0;
+}
+
+static bool openSynth(Service &service, const Options &options, const ROMData &roms, int rendererType, int dacInputMode, int analogOutputMode) {
+	service.createContext();
+	if (service.addROMData(&roms.controlROM[0], roms.controlROM.size()) != MT32EMU_RC_ADDED_CONTROL_ROM) {
+		fprintf(stderr, "Unrecognised control ROM.\n");
+		return false;
+	}
+	if (service.addROMData(&roms.pcmROM[0], roms.pcmROM.size()) != MT32EMU_RC_ADDED_PCM_ROM) {
+		fprintf(stderr, "Unrecognised PCM ROM.\n");
+		return false;
+	}
+	service.setPartialCount(options.partialCount);
+	// DAC streams are rendered at the synth sample rate, so the analog circuit is kept out of the way.
+	service.setAnalogOutputMode(analogOutputMode == DAC_STREAMS_OUTPUT ? AnalogOutputMode_DIGITAL_ONLY : AnalogOutputMode(analogOutputMode));
+	service.selectRendererType(RendererType(rendererType));
+	service.setFloatWaveAccuracy(FloatWaveAccuracy(options.floatWaveAccuracy));
+	service.setPartialRenderingThreadCount(options.threadCount);
+	if (service.openSynth() != MT32EMU_RC_OK) {
+		fprintf(stderr, "Error opening MT32Emu synthesizer.\n");
+		return false;
+	}
+	service.setDACInputMode(DACInputMode(dacInputMode));
+	return true;
+}
+
+static void setReverbMode(Service &service, int reverbMode) {
+	static const Bit32u SYSTEM_REVERB_MODE_ADDRESS = 0x100001;
+
+	if (reverbMode == 0) {
+		service.setReverbEnabled(false);
+		return;
+	}
+	// Reverb mode, time and level.
+	const Bit8u data[] = {Bit8u(reverbMode - 1), 5, 7};
+	Bit8u sysex[MAX_SYSEX_LENGTH];
+	Bit32u sysexLength = makeDT1Sysex(sysex, SYSTEM_REVERB_MODE_ADDRESS, data, sizeof(data));
+	service.playSysexNow(sysex, sysexLength);
+	// Prevent workloads from changing the reverb settings.
+	service.setReverbOverridden(true);
+}
+
+static bool runBenchmark(const Options &options, const ROMData &roms, const Workload &workload, const EventList &events, int rendererType, int dacInputMode, int analogOutputMode, int reverbMode, Result &result) {
+	Service service;
+	if (!openSynth(service, options, roms, rendererType, dacInputMode, analogOutputMode)) {
+		service.freeContext();
+		return false;
+	}
+	setReverbMode(service, reverbMode);
+	service.resetRenderStatistics();
+
+	const bool renderFloat = rendererType == RendererType_FLOAT;
+	const bool renderStreams = analogOutputMode == DAC_STREAMS_OUTPUT;
+	result.sampleRate = renderStreams ? SAMPLE_RATE : service.getActualStereoOutputSamplerate();
+	result.frameCount = options.seconds * result.sampleRate;
+	result.midiSeconds = 0.0;
+	result.renderSeconds = 0.0;
+	result.droppedEventCount = 0;
+
+	// The DAC streams are rendered into consecutive parts of the buffer and each is hashed separately,
+	// so the hashes do not depend on the buffer size.
+	const Bit32u streamCount = renderStreams ? DAC_STREAM_COUNT : 1;
+	Bit32u streamHashes[DAC_STREAM_COUNT];
+	for (Bit32u streamIx = 0; streamIx < streamCount; streamIx++) {
+		streamHashes[streamIx] = FNV_OFFSET_BASIS;
+	}
+	const Bit32u bufferSampleCount = renderStreams ? DAC_STREAM_COUNT * options.bufferFrameCount : options.bufferFrameCount << 1;
+	std::vector<Bit16s> bit16sBuffer(renderFloat ? 0 : bufferSampleCount);
+	std::vector<float> floatBuffer(renderFloat ? bufferSampleCount : 0);
+	mt32emu_dac_output_bit16s_streams bit16sStreams;
+	mt32emu_dac_output_float_streams floatStreams;
+	if (renderStreams) {
+		Bit16s * const bit16sBase = renderFloat ? NULL : &bit16sBuffer[0];
+		float * const floatBase = renderFloat ? &floatBuffer[0] : NULL;
+		Bit16s ** const bit16sStreamBuffers[DAC_STREAM_COUNT] = {&bit16sStreams.nonReverbLeft, &bit16sStreams.nonReverbRight,
+			&bit16sStreams.reverbDryLeft, &bit16sStreams.reverbDryRight, &bit16sStreams.reverbWetLeft, &bit16sStreams.reverbWetRight};
+		float ** const floatStreamBuffers[DAC_STREAM_COUNT] = {&floatStreams.nonReverbLeft, &floatStreams.nonReverbRight,
+			&floatStreams.reverbDryLeft, &floatStreams.reverbDryRight, &floatStreams.reverbWetLeft, &floatStreams.reverbWetRight};
+		for (int streamIx = 0; streamIx < DAC_STREAM_COUNT; streamIx++) {
+			*bit16sStreamBuffers[streamIx] = renderFloat ? NULL : bit16sBase + streamIx * options.bufferFrameCount;
+			*floatStreamBuffers[streamIx] = renderFloat ? floatBase + streamIx * options.bufferFrameCount : NULL;
+		}
+	}
+	size_t nextEventIx = 0;
+	Bit32u renderedFrameCount = 0;
+	while (renderedFrameCount < result.frameCount) {
+		Bit32u frameCount = result.frameCount - renderedFrameCount;
+		if (frameCount > options.bufferFrameCount) frameCount = options.bufferFrameCount;
+
+		// Only the events due within the upcoming buffer are queued, as a realtime MIDI source would do.
+		double startTime = getTime();
+		Bit32u bufferEndTimestamp = renderStreams ? renderedFrameCount + frameCount : service.convertOutputToSynthTimestamp(renderedFrameCount + frameCount);
+		while (nextEventIx < events.size() && events[nextEventIx].timestamp < bufferEndTimestamp) {
+			const MidiEvent &event = events[nextEventIx++];
+			mt32emu_return_code rc;
+			if (event.sysexLength == 0) {
+				rc = service.playMsgAt(event.shortMessage, event.timestamp);
+			} else {
+				rc = service.playSysexAt(event.sysex, event.sysexLength, event.timestamp);
+			}
+			if (rc != MT32EMU_RC_OK) result.droppedEventCount++;
+		}
+		double midiEndTime = getTime();
+
+		if (renderStreams) {
+			if (renderFloat) {
+				service.renderFloatStreams(&floatStreams, frameCount);
+			} else {
+				service.renderBit16sStreams(&bit16sStreams, frameCount);
+			}
+		} else if (renderFloat) {
+			service.renderFloat(&floatBuffer[0], frameCount);
+		} else {
+			service.renderBit16s(&bit16sBuffer[0], frameCount);
+		}
+		double renderEndTime = getTime();
+
+		if (options.recordFileName != NULL || options.verifyFileName != NULL) {
+			const Bit32u streamSampleCount = renderStreams ? frameCount : frameCount << 1;
+			const Bit32u streamStride = renderStreams ? options.bufferFrameCount : 0;
+			for (Bit32u streamIx = 0; streamIx < streamCount; streamIx++) {
+				if (renderFloat) {
+					streamHashes[streamIx] = updateHash(streamHashes[streamIx], &floatBuffer[streamIx * streamStride], streamSampleCount);
+				} else {
+					streamHashes[streamIx] = updateHash(streamHashes[streamIx], &bit16sBuffer[streamIx * streamStride], streamSampleCount);
+				}
+			}
+		}
+
+		result.midiSeconds += midiEndTime - startTime;
+		result.renderSeconds += renderEndTime - midiEndTime;
+		renderedFrameCount += frameCount;
+	}
+
+	result.hash = streamHashes[0];
+	if (renderStreams) {
+		result.hash = FNV_OFFSET_BASIS;
+		for (Bit32u streamIx = 0; streamIx < streamCount; streamIx++) {
+			result.hash = updateHash(result.hash, streamHashes[streamIx], 4);
+		}
+	}
+
+	result.hasStatistics = service.getRenderStatistics(&result.statistics);
+	service.closeSynth();
+	service.freeContext();
+	if (result.droppedEventCount > 0) {
+		fprintf(stderr, "Workload %s: %u MIDI events dropped due to MIDI queue overflow.\n", workload.name, result.droppedEventCount);
+	}
+	return true;
+}
+
+static bool isGoldenRender(const Options &options) {
+	return options.recordFileName != NULL || options.verifyFileName != NULL;
+}
+
+static const char *getAnalogOutputModeName(int analogOutputMode) {
+	return analogOutputMode == DAC_STREAMS_OUTPUT ? DAC_STREAMS_OUTPUT_NAME : ANALOG_OUTPUT_MODE_NAMES[analogOutputMode];
+}
+
+static std::string makeReferenceKey(const Workload &workload, int rendererType, int dacInputMode, int analogOutputMode, int reverbMode) {
+	std::string key = workload.name;
+	key = key + ' ' + RENDERER_TYPE_NAMES[rendererType] + ' ' + DAC_INPUT_MODE_NAMES[dacInputMode];
+	return key + ' ' + getAnalogOutputModeName(analogOutputMode) + ' ' + REVERB_MODE_NAMES[reverbMode];
+}
+
+// The reference file starts with a line that records the parameters the output depends on,
+// followed by a line per run with the reference key and the hash.
+static void writeReferenceHeader(FILE *file, const Options &options) {
+	fprintf(file, "# mt32emu-bench golden render, seconds %u, partials %u\n", options.seconds, options.partialCount);
+}
+
+static bool loadReferences(const Options &options, ReferenceMap &references) {
+	FILE *file = fopen(options.verifyFileName, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot open reference file %s.\n", options.verifyFileName);
+		return false;
+	}
+	char line[256];
+	unsigned int seconds, partialCount;
+	if (fgets(line, sizeof(line), file) == NULL
+		|| sscanf(line, "# mt32emu-bench golden render, seconds %u, partials %u", &seconds, &partialCount) != 2) {
+		fprintf(stderr, "Invalid reference file %s.\n", options.verifyFileName);
+		fclose(file);
+		return false;
+	}
+	if (seconds != options.seconds || partialCount != options.partialCount) {
+		fprintf(stderr, "Reference file %s was recorded with --seconds %u --max-partials %u.\n", options.verifyFileName, seconds, partialCount);
+		fclose(file);
+		return false;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char names[5][32];
+		unsigned int hash;
+		if (sscanf(line, "%31s %31s %31s %31s %31s %x", names[0], names[1], names[2], names[3], names[4], &hash) != 6) continue;
+		std::string key = names[0];
+		for (int i = 1; i < 5; i++) {
+			key = key + ' ' + names[i];
+		}
+		references[key] = Bit32u(hash);
+	}
+	fclose(file);
+	return true;
+}
+
+static void printResultHeader(const Options &options) {
+	printf("%-10s %-6s %-5s %-12s %-10s %12s %10s %10s %10s %8s", "workload", "type", "dac", "analog", "reverb",
+		"frames/s", "ns/frame", "midi ns", "render ns", "realtime");
+	if (isGoldenRender(options)) printf(" %8s", "hash");
+	printf("\n");
+}
+
+// In the golden render mode, the status of the hash is printed as well, unless it is NULL.
+static void printResult(const Workload &workload, int rendererType, int dacInputMode, int analogOutputMode, int reverbMode, const Result &result, const char *status) {
+	const double totalSeconds = result.midiSeconds + result.renderSeconds;
+	const double frameCount = double(result.frameCount);
+	printf("%-10s %-6s %-5s %-12s %-10s %12.0f %10.1f %10.1f %10.1f %7.1fx", workload.name, RENDERER_TYPE_NAMES[rendererType],
+		DAC_INPUT_MODE_NAMES[dacInputMode], getAnalogOutputModeName(analogOutputMode), REVERB_MODE_NAMES[reverbMode],
+		frameCount / totalSeconds, 1e9 * totalSeconds / frameCount,
+		1e9 * result.midiSeconds / frameCount, 1e9 * result.renderSeconds / frameCount,
+		frameCount / double(result.sampleRate) / totalSeconds);
+	if (status != NULL) printf(" %08x %s", result.hash, status);
+	printf("\n");
+	if (result.hasStatistics) {
+		const mt32emu_render_statistics &statistics = result.statistics;
+		printf("%-47s la32 %.1f, reverb %.1f, analog %.1f, conversion %.1f, midi dispatch %.1f ns/frame\n", "",
+			1e9 * statistics.la32Time / frameCount, 1e9 * statistics.reverbTime / frameCount,
+			1e9 * statistics.analogTime / frameCount, 1e9 * statistics.sampleFormatConversionTime / frameCount,
+			1e9 * statistics.midiEventDispatchTime / frameCount);
+	}
+	fflush(stdout);
+}
+
+static int findName(const char * const names[], int count, const char *name) {
+	for (int i = 0; i < count; i++) {
+		if (strcmp(names[i], name) == 0) return i;
+	}
+	return -1;
+}
+
+static void printUsage(const char *programName) {
+	printf("Usage: %s [options]\n\n", programName);
+	printf("Options:\n");
+	printf("  -m, --rom-dir <directory>         Directory in which ROMs are stored (including trailing path separator)\n");
+	printf("  -s, --seconds <count>             Seconds of output to render in each run (default: %u)\n", DEFAULT_SECONDS);
+	printf("  -b, --buffer-size <frame_count>   Number of frames rendered at once (default: %u)\n", DEFAULT_BUFFER_FRAME_COUNT);
+	printf("  -x, --max-partials <count>        The maximum number of partials playing simultaneously (default: %u)\n", DEFAULT_MAX_PARTIALS);
+	printf("  -t, --threads <count>             The number of threads used to render partials (default: 1)\n");
+	printf("  -w, --workload <name>             Only run the specified workload: sustained, drums, notes or sysex\n");
+	printf("  -r, --renderer-type <name>        Only use the specified renderer type: int16 or float\n");
+	printf("  -d, --dac-input-mode <name>       Only use the specified DAC input mode: nice, pure, gen1 or gen2 (default: nice)\n");
+	printf("  -a, --analog-output-mode <name>   Only use the specified analog output mode: digital, coarse, accurate or oversampled\n");
+	printf("  -v, --reverb-mode <name>          Only use the specified reverb mode: off, room, hall, plate or tap-delay\n");
+	printf("  -i, --simd <name>                 Force the SIMD instruction set: none, sse2, sse4.1 or avx2\n");
+	printf("  -q, --float-accuracy <name>       Accuracy of the float wave generator: reference, high or fast (default: reference)\n");
+	printf("  -f, --full                        Run all combinations of analog output and reverb modes\n");
+	printf("                                    (by default, each is only varied with the other fixed to coarse or room)\n");
+	printf("  -o, --record <file>               Run all combinations and store the hashes of the rendered output in the file\n");
+	printf("  -c, --verify <file>               Run all combinations and compare the hashes of the rendered output with the file\n");
+	printf("  -p, --replay <file>               Replay a session recording made with mt32emu_start_session_recording()\n");
+	printf("                                    and report the timing of the render calls\n");
+	printf("  -l, --list-calls                  Print the timing of each render call when replaying a session\n");
+	printf("  -h, --help                        Show this help\n");
+}
+
+static bool isOption(const char *arg, const char *shortName, const char *longName) {
+	return strcmp(arg, shortName) == 0 || strcmp(arg, longName) == 0;
+}
+
+static bool parseUnsigned(const char *arg, unsigned int &value) {
+	char *end;
+	long parsedValue = strtol(arg, &end, 10);
+	if (*arg == '\0' || *end != '\0' || parsedValue < 1) return false;
+	value = unsigned(parsedValue);
+	return true;
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+	options.romDir = "";
+	options.seconds = DEFAULT_SECONDS;
+	options.bufferFrameCount = DEFAULT_BUFFER_FRAME_COUNT;
+	options.partialCount = DEFAULT_MAX_PARTIALS;
+	options.threadCount = 1;
+	options.workloadName = NULL;
+	options.rendererType = -1;
+	options.dacInputMode = -1;
+	options.analogOutputMode = -1;
+	options.reverbMode = -1;
+	options.simdInstructionSet = -1;
+	options.floatWaveAccuracy = FloatWaveAccuracy_REFERENCE;
+	options.fullMatrix = false;
+	options.recordFileName = NULL;
+	options.verifyFileName = NULL;
+	options.replayFileName = NULL;
+	options.printRenderCalls = false;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (isOption(arg, "-h", "--help")) {
+			printUsage(argv[0]);
+			return false;
+		}
+		if (isOption(arg, "-f", "--full")) {
+			options.fullMatrix = true;
+			continue;
+		}
+		if (isOption(arg, "-l", "--list-calls")) {
+			options.printRenderCalls = true;
+			continue;
+		}
+		if (i + 1 == argc) {
+			fprintf(stderr, "Unknown option or missing value: %s\n", arg);
+			return false;
+		}
+		const char *value = argv[++i];
+		bool valid = true;
+		if (isOption(arg, "-m", "--rom-dir")) {
+			options.romDir = value;
+		} else if (isOption(arg, "-s", "--seconds")) {
+			valid = parseUnsigned(value, options.seconds);
+		} else if (isOption(arg, "-b", "--buffer-size")) {
+			valid = parseUnsigned(value, options.bufferFrameCount);
+		} else if (isOption(arg, "-x", "--max-partials")) {
+			valid = parseUnsigned(value, options.partialCount);
+		} else if (isOption(arg, "-t", "--threads")) {
+			valid = parseUnsigned(value, options.threadCount);
+		} else if (isOption(arg, "-w", "--workload")) {
+			options.workloadName = value;
+			valid = false;
+			for (int workloadIx = 0; workloadIx < WORKLOAD_COUNT; workloadIx++) {
+				if (strcmp(WORKLOADS[workloadIx].name, value) == 0) valid = true;
+			}
+		} else if (isOption(arg, "-r", "--renderer-type")) {
+			options.rendererType = findName(RENDERER_TYPE_NAMES, RENDERER_TYPE_COUNT, value);
+			valid = options.rendererType >= 0;
+		} else if (isOption(arg, "-d", "--dac-input-mode")) {
+			options.dacInputMode = findName(DAC_INPUT_MODE_NAMES, DAC_INPUT_MODE_COUNT, value);
+			valid = options.dacInputMode >= 0;
+		} else if (isOption(arg, "-a", "--analog-output-mode")) {
+			options.analogOutputMode = findName(ANALOG_OUTPUT_MODE_NAMES, ANALOG_OUTPUT_MODE_COUNT, value);
+			valid = options.analogOutputMode >= 0;
+		} else if (isOption(arg, "-v", "--reverb-mode")) {
+			options.reverbMode = findName(REVERB_MODE_NAMES, REVERB_MODE_COUNT, value);
+			valid = options.reverbMode >= 0;
+		} else if (isOption(arg, "-i", "--simd")) {
+			options.simdInstructionSet = findName(SIMD_INSTRUCTION_SET_NAMES, SIMD_INSTRUCTION_SET_COUNT, value);
+			valid = options.simdInstructionSet >= 0;
+		} else if (isOption(arg, "-q", "--float-accuracy")) {
+			options.floatWaveAccuracy = findName(FLOAT_WAVE_ACCURACY_NAMES, FLOAT_WAVE_ACCURACY_COUNT, value);
+			valid = options.floatWaveAccuracy >= 0;
+		} else if (isOption(arg, "-o", "--record")) {
+			options.recordFileName = value;
+		} else if (isOption(arg, "-c", "--verify")) {
+			options.verifyFileName = value;
+		} else if (isOption(arg, "-p", "--replay")) {
+			options.replayFileName = value;
+		} else {
+			fprintf(stderr, "Unknown option: %s\n", arg);
+			return false;
+		}
+		if (!valid) {
+			fprintf(stderr, "Invalid value for option %s: %s\n", arg, value);
+			return false;
+		}
+	}
+	if (options.recordFileName != NULL && options.verifyFileName != NULL) {
+		fprintf(stderr, "Options --record and --verify cannot be used together\n");
+		return false;
+	}
+	return true;
+}
+
+// Tells whether the given combination of DAC input, analog output and reverb modes is to be run.
+// The golden render mode runs the full matrix, including the DAC streams.
+static bool isSelectedConfiguration(const Options &options, int dacInputMode, int analogOutputMode, int reverbMode) {
+	if (options.dacInputMode >= 0 ? options.dacInputMode != dacInputMode : !isGoldenRender(options) && dacInputMode != DACInputMode_NICE) return false;
+	if (analogOutputMode == DAC_STREAMS_OUTPUT) {
+		if (!isGoldenRender(options) || options.analogOutputMode >= 0) return false;
+	} else if (options.analogOutputMode >= 0 && options.analogOutputMode != analogOutputMode) {
+		return false;
+	}
+	if (options.reverbMode >= 0 && options.reverbMode != reverbMode) return false;
+	if (options.fullMatrix || isGoldenRender(options) || options.analogOutputMode >= 0 || options.reverbMode >= 0) return true;
+	return analogOutputMode == BASE_ANALOG_OUTPUT_MODE || reverbMode == BASE_REVERB_MODE;
+}
+
+int main(int argc, char *argv[]) {
+	Options options;
+	printf("Munt MT32Emu Benchmark. Version %s\n", VERSION);
+	printf("  Copyright (C) 2020 Jerome Fisher, Sergey V. Mikayev\n");
+	printf("Using Munt MT32Emu Library Version %s\n", Service().getLibraryVersionString());
+	if (!parseOptions(argc, argv, options)) {
+		return -1;
+	}
+	Service service;
+	if (options.simdInstructionSet >= 0 && !service.forceSIMDInstructionSet(SIMDInstructionSet(options.simdInstructionSet))) {
+		fprintf(stderr, "SIMD instruction set %s is not supported.\n", SIMD_INSTRUCTION_SET_NAMES[options.simdInstructionSet]);
+		return 1;
+	}
+	const int simdInstructionSet = options.simdInstructionSet >= 0 ? options.simdInstructionSet : int(service.getSupportedSIMDInstructionSet());
+	ROMData roms;
+	if (!loadROMs(options.romDir, roms)) {
+		return 1;
+	}
+	if (options.replayFileName != NULL) {
+		return replaySession(options, roms);
+	}
+	ReferenceMap references;
+	if (options.verifyFileName != NULL && !loadReferences(options, references)) {
+		return 1;
+	}
+	FILE *recordFile = NULL;
+	if (options.recordFileName != NULL) {
+		recordFile = fopen(options.recordFileName, "w");
+		if (recordFile == NULL) {
+			fprintf(stderr, "Cannot create reference file %s.\n", options.recordFileName);
+			return 1;
+		}
+		writeReferenceHeader(recordFile, options);
+	}
+	printf("Rendering %u seconds in each run, buffer size %u frames, %u partials, %u threads, SIMD instruction set %s, float wave accuracy %s\n\n",
+		options.seconds, options.bufferFrameCount, options.partialCount, options.threadCount, SIMD_INSTRUCTION_SET_NAMES[simdInstructionSet],
+		FLOAT_WAVE_ACCURACY_NAMES[options.floatWaveAccuracy]);
+	printResultHeader(options);
+
+	double totalSeconds = 0.0;
+	unsigned int mismatchCount = 0;
+	unsigned int missingReferenceCount = 0;
+	for (int workloadIx = 0; workloadIx < WORKLOAD_COUNT; workloadIx++) {
+		const Workload &workload = WORKLOADS[workloadIx];
+		if (options.workloadName != NULL && strcmp(options.workloadName, workload.name) != 0) continue;
+		EventList events;
+		workload.generator(events, options.seconds * SAMPLE_RATE);
+		std::stable_sort(events.begin(), events.end(), isEarlier);
+		for (int rendererType = 0; rendererType < RENDERER_TYPE_COUNT; rendererType++) {
+			if (options.rendererType >= 0 && options.rendererType != rendererType) continue;
+			for (int dacInputMode = 0; dacInputMode < DAC_INPUT_MODE_COUNT; dacInputMode++) {
+				for (int analogOutputMode = 0; analogOutputMode <= DAC_STREAMS_OUTPUT; analogOutputMode++) {
+					for (int reverbMode = 0; reverbMode < REVERB_MODE_COUNT; reverbMode++) {
+						if (!isSelectedConfiguration(options, dacInputMode, analogOutputMode, reverbMode)) continue;
+						Result result;
+						if (!runBenchmark(options, roms, workload, events, rendererType, dacInputMode, analogOutputMode, reverbMode, result)) {
+							if (recordFile != NULL) fclose(recordFile);
+							return 1;
+						}
+						const std::string key = makeReferenceKey(workload, rendererType, dacInputMode, analogOutputMode, reverbMode);
+						const char *status = NULL;
+						if (recordFile != NULL) {
+							fprintf(recordFile, "%s %08x\n", key.c_str(), result.hash);
+							status = "recorded";
+						} else if (options.verifyFileName != NULL) {
+							ReferenceMap::const_iterator reference = references.find(key);
+							if (reference == references.end()) {
+								status = "missing";
+								missingReferenceCount++;
+							} else if (reference->second != result.hash) {
+								status = "MISMATCH";
+								mismatchCount++;
+							} else {
+								status = "ok";
+							}
+						}
+						printResult(workload, rendererType, dacInputMode, analogOutputMode, reverbMode, result, status);
+						totalSeconds += result.midiSeconds + result.renderSeconds;
+					}
+				}
+			}
+		}
+	}
+	printf("\nTotal time: %.3f sec\n", totalSeconds);
+	if (recordFile != NULL) {
+		fclose(recordFile);
+		printf("References recorded to %s\n", options.recordFileName);
+	}
+	if (options.verifyFileName != NULL) {
+		printf("Verification against %s: %u mismatches, %u runs without reference\n", options.verifyFileName, mismatchCount, missingReferenceCount);
+		if (mismatchCount > 0 || missingReferenceCount > 0) return 2;
+	}
+	return 0;
+}
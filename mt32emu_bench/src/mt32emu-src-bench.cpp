@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WIN32
+// Needed for clock_gettime() when compiling in strict ANSI mode.
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "../../mt32emu/src/srchelper/srctools/include/FIRResampler.h"
+#include "../../mt32emu/src/srchelper/srctools/include/IIR2xResampler.h"
+#include "../../mt32emu/src/srchelper/srctools/include/LinearResampler.h"
+#include "../../mt32emu/src/srchelper/srctools/include/ResamplerModel.h"
+#include "../../mt32emu/src/srchelper/srctools/include/SincResampler.h"
+
+using namespace SRCTools;
+
+static const unsigned int DEFAULT_SECONDS = 10;
+static const unsigned int DEFAULT_BUFFER_FRAME_COUNT = 512;
+
+// Length of the noise pattern fed to the resamplers, in frames.
+static const unsigned int NOISE_FRAME_COUNT = 65536;
+
+struct RatePair {
+	double inputSampleRate;
+	double outputSampleRate;
+};
+
+// The conversions typically requested from the emulator, which renders at 32 kHz or 48 kHz in the oversampled analog output mode.
+static const RatePair RATE_PAIRS[] = {
+	{32000, 44100},
+	{32000, 48000},
+	{48000, 96000}
+};
+static const int RATE_PAIR_COUNT = sizeof(RATE_PAIRS) / sizeof(RATE_PAIRS[0]);
+
+// Indexed by ResamplerModel::Quality.
+static const char * const QUALITY_NAMES[] = {"fastest", "fast", "good", "best"};
+static const int QUALITY_COUNT = 4;
+
+enum StageType {
+	StageType_LINEAR,
+	StageType_IIR_2X_INTERPOLATOR,
+	StageType_IIR_2X_DECIMATOR,
+	StageType_SINC
+};
+
+static const char * const STAGE_TYPE_NAMES[] = {"linear", "iir2x-interpolator", "iir2x-decimator", "sinc"};
+
+// Describes a stage of the resampler model, the parameters mirror ResamplerModel::createResamplerModel().
+struct StageSpec {
+	StageType type;
+	double inputSampleRate;
+	double outputSampleRate;
+	IIRResampler::Quality iirQuality;
+	double passbandFrequency;
+	double stopbandFrequency;
+	unsigned int maxUpsampleFactor;
+};
+
+// Length of the FIR kernel designed for a sinc stage, computed the same way as SincResampler does.
+struct KernelInfo {
+	unsigned int upsampleFactor;
+	double downsampleFactor;
+	unsigned int length;
+	unsigned int tapsPerPhase;
+};
+
+struct Options {
+	unsigned int seconds;
+	unsigned int bufferFrameCount;
+	unsigned int channelCount;
+	int quality;
+	bool simdEnabled;
+	bool userRatePair;
+	RatePair ratePair;
+};
+
+static double getTime() {
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return double(counter.QuadPart) / double(frequency.QuadPart);
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+#endif
+}
+
+// Provides white noise, repeating a pattern generated by a simple LCG so that the cost of the source is negligible.
+class NoiseSource : public FloatSampleProvider {
+	FloatSample *noise;
+	unsigned int noiseSampleCount;
+	unsigned int position;
+
+public:
+	explicit NoiseSource(unsigned int channelCount) :
+		noise(new FloatSample[NOISE_FRAME_COUNT * channelCount]),
+		noiseSampleCount(NOISE_FRAME_COUNT * channelCount),
+		position()
+	{
+		unsigned int state = 1;
+		for (unsigned int i = 0; i < noiseSampleCount; i++) {
+			state = state * 1103515245 + 12345;
+			noise[i] = FloatSample(int((state >> 16) & 0x7FFF) - 16384) / 16384.0f;
+		}
+	}
+
+	~NoiseSource() {
+		delete[] noise;
+	}
+
+	void getOutputSamples(FloatSample *outBuffer, unsigned int size) {
+		unsigned int sampleCount = size * (noiseSampleCount / NOISE_FRAME_COUNT);
+		while (sampleCount > 0) {
+			unsigned int chunk = noiseSampleCount - position;
+			if (sampleCount < chunk) chunk = sampleCount;
+			memcpy(outBuffer, noise + position, chunk * sizeof(FloatSample));
+			outBuffer += chunk;
+			sampleCount -= chunk;
+			position = (position + chunk) % noiseSampleCount;
+		}
+	}
+};
+
+// Fills the stages in the order they are applied and returns their count.
+static unsigned int describeModel(StageSpec stages[], const RatePair &ratePair, ResamplerModel::Quality quality) {
+	const double inputSampleRate = ratePair.inputSampleRate;
+	const double outputSampleRate = ratePair.outputSampleRate;
+	StageSpec spec;
+	spec.inputSampleRate = inputSampleRate;
+	spec.outputSampleRate = outputSampleRate;
+	spec.iirQuality = static_cast<IIRResampler::Quality>(quality);
+	spec.passbandFrequency = 0;
+	spec.stopbandFrequency = 0;
+	spec.maxUpsampleFactor = 0;
+	if (quality == ResamplerModel::FASTEST) {
+		spec.type = StageType_LINEAR;
+		stages[0] = spec;
+		return 1;
+	}
+	const double iirPassbandFraction = IIRResampler::getPassbandFractionForQuality(spec.iirQuality);
+	if (inputSampleRate < outputSampleRate) {
+		spec.type = StageType_IIR_2X_INTERPOLATOR;
+		spec.outputSampleRate = 2.0 * inputSampleRate;
+		stages[0] = spec;
+		if (2.0 * inputSampleRate == outputSampleRate) return 1;
+		spec.type = StageType_SINC;
+		spec.inputSampleRate = 2.0 * inputSampleRate;
+		spec.outputSampleRate = outputSampleRate;
+		spec.passbandFrequency = 0.5 * inputSampleRate * iirPassbandFraction;
+		spec.stopbandFrequency = 1.5 * inputSampleRate;
+		spec.maxUpsampleFactor = ResamplerModel::DEFAULT_WINDOWED_SINC_MAX_UPSAMPLE_FACTOR;
+		stages[1] = spec;
+		return 2;
+	}
+	spec.type = StageType_IIR_2X_DECIMATOR;
+	if (inputSampleRate == 2.0 * outputSampleRate) {
+		stages[0] = spec;
+		return 1;
+	}
+	spec.inputSampleRate = 2.0 * outputSampleRate;
+	stages[1] = spec;
+	spec.type = StageType_SINC;
+	spec.inputSampleRate = inputSampleRate;
+	spec.outputSampleRate = 2.0 * outputSampleRate;
+	spec.passbandFrequency = 0.5 * outputSampleRate * iirPassbandFraction;
+	spec.stopbandFrequency = 1.5 * outputSampleRate;
+	spec.maxUpsampleFactor = unsigned(ceil(ResamplerModel::DEFAULT_WINDOWED_SINC_MAX_DOWNSAMPLE_FACTOR * spec.outputSampleRate / inputSampleRate));
+	stages[0] = spec;
+	return 2;
+}
+
+static ResamplerStage *createStage(const StageSpec &spec, unsigned int channelCount) {
+	switch (spec.type) {
+	case StageType_LINEAR:
+		return new LinearResampler(spec.inputSampleRate, spec.outputSampleRate, channelCount);
+	case StageType_IIR_2X_INTERPOLATOR:
+		return new IIR2xInterpolator(spec.iirQuality, channelCount);
+	case StageType_IIR_2X_DECIMATOR:
+		return new IIR2xDecimator(spec.iirQuality, channelCount);
+	case StageType_SINC:
+		return SincResampler::createSincResampler(spec.inputSampleRate, spec.outputSampleRate, spec.passbandFrequency, spec.stopbandFrequency,
+			ResamplerModel::DEFAULT_DB_SNR, spec.maxUpsampleFactor, channelCount);
+	}
+	return NULL;
+}
+
+static KernelInfo computeKernelInfo(const StageSpec &spec) {
+	KernelInfo info;
+	SincResampler::Utils::computeResampleFactors(info.upsampleFactor, info.downsampleFactor, spec.inputSampleRate, spec.outputSampleRate, spec.maxUpsampleFactor);
+	const double baseSamplePeriod = 1.0 / (spec.inputSampleRate * info.upsampleFactor);
+	const double fp = spec.passbandFrequency * baseSamplePeriod;
+	const double fs = spec.stopbandFrequency * baseSamplePeriod;
+	info.length = SincResampler::KaizerWindow::estimateOrder(ResamplerModel::DEFAULT_DB_SNR, fp, fs) + 1;
+	info.tapsPerPhase = (info.length + info.upsampleFactor - 1) / info.upsampleFactor;
+	return info;
+}
+
+// Pulls frameCount frames from the model and returns the time spent.
+static double run(FloatSampleProvider &model, FloatSample *buffer, const Options &options, unsigned int frameCount) {
+	double startTime = getTime();
+	while (frameCount > 0) {
+		unsigned int chunk = frameCount < options.bufferFrameCount ? frameCount : options.bufferFrameCount;
+		model.getOutputSamples(buffer, chunk);
+		frameCount -= chunk;
+	}
+	return getTime() - startTime;
+}
+
+static void printResultHeader() {
+	printf("%-8s %-18s %8s %8s %7s %9s %6s %10s\n", "preset", "stage", "in Hz", "out Hz", "kernel", "up/down", "taps", "ns/frame");
+}
+
+// The time is divided by the number of frames output by the whole model, so that the stage times add up to the total.
+static void printResult(const char *qualityName, const char *stageName, const StageSpec *spec, double seconds, unsigned int frameCount) {
+	printf("%-8s %-18s ", qualityName, stageName);
+	if (spec == NULL) {
+		printf("%8s %8s ", "", "");
+	} else {
+		printf("%8.0f %8.0f ", spec->inputSampleRate, spec->outputSampleRate);
+	}
+	if (spec != NULL && spec->type == StageType_SINC) {
+		KernelInfo info = computeKernelInfo(*spec);
+		char factors[32];
+		sprintf(factors, "%u/%.3g", info.upsampleFactor, info.downsampleFactor);
+		printf("%7u %9s %6u ", info.length, factors, info.tapsPerPhase);
+	} else {
+		printf("%7s %9s %6s ", "-", "-", "-");
+	}
+	printf("%10.2f\n", seconds * 1e9 / frameCount);
+}
+
+static void benchmarkRatePair(const Options &options, const RatePair &ratePair, FloatSample *buffer) {
+	const unsigned int frameCount = options.seconds * unsigned(ratePair.outputSampleRate);
+	printf("Resampling %.0f Hz to %.0f Hz\n", ratePair.inputSampleRate, ratePair.outputSampleRate);
+	printResultHeader();
+	for (int qualityIx = 0; qualityIx < QUALITY_COUNT; qualityIx++) {
+		if (options.quality >= 0 && options.quality != qualityIx) continue;
+		const ResamplerModel::Quality quality = static_cast<ResamplerModel::Quality>(qualityIx);
+		StageSpec stages[2];
+		unsigned int stageCount = describeModel(stages, ratePair, quality);
+		for (unsigned int stageIx = 0; stageIx < stageCount; stageIx++) {
+			const StageSpec &spec = stages[stageIx];
+			NoiseSource source(options.channelCount);
+			ResamplerStage *stage = createStage(spec, options.channelCount);
+			FloatSampleProvider &model = ResamplerModel::createResamplerModel(source, *stage, options.channelCount);
+			// Render as many frames as the stage outputs within the whole model.
+			const unsigned int stageFrameCount = unsigned(frameCount * (spec.outputSampleRate / ratePair.outputSampleRate));
+			double seconds = run(model, buffer, options, stageFrameCount);
+			ResamplerModel::freeResamplerModel(model, source);
+			delete stage;
+			printResult(QUALITY_NAMES[qualityIx], STAGE_TYPE_NAMES[spec.type], &spec, seconds, frameCount);
+		}
+		NoiseSource source(options.channelCount);
+		FloatSampleProvider &model = ResamplerModel::createResamplerModel(source, ratePair.inputSampleRate, ratePair.outputSampleRate, quality, options.channelCount);
+		double seconds = run(model, buffer, options, frameCount);
+		ResamplerModel::freeResamplerModel(model, source);
+		printResult(QUALITY_NAMES[qualityIx], "total", NULL, seconds, frameCount);
+	}
+	printf("\n");
+}
+
+static void printUsage(const char *programName) {
+	printf("Usage: %s [options]\n\n", programName);
+	printf("Options:\n");
+	printf("  -s, --seconds <count>             Seconds of output to render in each run (default: %u)\n", DEFAULT_SECONDS);
+	printf("  -b, --buffer-size <frame_count>   Number of frames rendered at once (default: %u)\n", DEFAULT_BUFFER_FRAME_COUNT);
+	printf("  -n, --channels <count>            Number of interleaved channels, up to %u (default: %u)\n", MAX_CHANNEL_COUNT, DEFAULT_CHANNEL_COUNT);
+	printf("  -q, --quality <name>              Only run the specified preset: fastest, fast, good or best\n");
+	printf("  -p, --rates <in>:<out>            Only run the specified conversion instead of 32000:44100, 32000:48000 and 48000:96000\n");
+	printf("  -i, --no-simd                     Compute the FIR dot products and IIR sections without SIMD instructions\n");
+	printf("  -h, --help                        Show this help\n");
+}
+
+static bool isOption(const char *arg, const char *shortName, const char *longName) {
+	return strcmp(arg, shortName) == 0 || strcmp(arg, longName) == 0;
+}
+
+static bool parseUnsigned(const char *arg, unsigned int &value) {
+	char *end;
+	long parsedValue = strtol(arg, &end, 10);
+	if (*arg == '\0' || *end != '\0' || parsedValue < 1) return false;
+	value = unsigned(parsedValue);
+	return true;
+}
+
+static bool parseRatePair(const char *arg, RatePair &ratePair) {
+	char *end;
+	long inputSampleRate = strtol(arg, &end, 10);
+	if (end == arg || *end != ':') return false;
+	const char *outputArg = end + 1;
+	long outputSampleRate = strtol(outputArg, &end, 10);
+	if (end == outputArg || *end != '\0' || inputSampleRate < 1 || outputSampleRate < 1 || inputSampleRate == outputSampleRate) return false;
+	ratePair.inputSampleRate = double(inputSampleRate);
+	ratePair.outputSampleRate = double(outputSampleRate);
+	return true;
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+	options.seconds = DEFAULT_SECONDS;
+	options.bufferFrameCount = DEFAULT_BUFFER_FRAME_COUNT;
+	options.channelCount = DEFAULT_CHANNEL_COUNT;
+	options.quality = -1;
+	options.simdEnabled = true;
+	options.userRatePair = false;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (isOption(arg, "-h", "--help")) {
+			printUsage(argv[0]);
+			return false;
+		}
+		if (isOption(arg, "-i", "--no-simd")) {
+			options.simdEnabled = false;
+			continue;
+		}
+		if (i + 1 == argc) {
+			fprintf(stderr, "Unknown option or missing value: %s\n", arg);
+			return false;
+		}
+		const char *value = argv[++i];
+		bool valid = true;
+		if (isOption(arg, "-s", "--seconds")) {
+			valid = parseUnsigned(value, options.seconds);
+		} else if (isOption(arg, "-b", "--buffer-size")) {
+			valid = parseUnsigned(value, options.bufferFrameCount);
+		} else if (isOption(arg, "-n", "--channels")) {
+			valid = parseUnsigned(value, options.channelCount) && options.channelCount <= MAX_CHANNEL_COUNT;
+		} else if (isOption(arg, "-q", "--quality")) {
+			options.quality = -1;
+			for (int qualityIx = 0; qualityIx < QUALITY_COUNT; qualityIx++) {
+				if (strcmp(QUALITY_NAMES[qualityIx], value) == 0) options.quality = qualityIx;
+			}
+			valid = options.quality >= 0;
+		} else if (isOption(arg, "-p", "--rates")) {
+			valid = parseRatePair(value, options.ratePair);
+			options.userRatePair = true;
+		} else {
+			fprintf(stderr, "Unknown option: %s\n", arg);
+			return false;
+		}
+		if (!valid) {
+			fprintf(stderr, "Invalid value for option %s: %s\n", arg, value);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	Options options;
+	printf("Munt SRCTools Benchmark. Version %s\n", VERSION);
+	printf("  Copyright (C) 2020 Jerome Fisher, Sergey V. Mikayev\n");
+	if (!parseOptions(argc, argv, options)) {
+		return -1;
+	}
+	FIRResampler::setSIMDEnabled(options.simdEnabled);
+	IIRResampler::setSIMDEnabled(options.simdEnabled);
+	printf("Rendering %u seconds of output in each run, buffer size %u frames, %u channels, SIMD %s\n\n",
+		options.seconds, options.bufferFrameCount, options.channelCount, options.simdEnabled ? "enabled" : "disabled");
+
+	FloatSample *buffer = new FloatSample[options.bufferFrameCount * options.channelCount];
+	if (options.userRatePair) {
+		benchmarkRatePair(options, options.ratePair, buffer);
+	} else {
+		for (int ratePairIx = 0; ratePairIx < RATE_PAIR_COUNT; ratePairIx++) {
+			benchmarkRatePair(options, RATE_PAIRS[ratePairIx], buffer);
+		}
+	}
+	delete[] buffer;
+	return 0;
+}
@@ -0,0 +1,486 @@
+/*
+ * Copyright (C) 2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// CLAP instrument plugin wrapping a Synth directly. The host events of a block are converted to MIDIEvents
+// timestamped at their sample offsets and played while the block is rendered, without passing the MIDI event queue.
+// The output is rendered as planar float straight into the host buffers.
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <clap/clap.h>
+
+#include <mt32emu/mt32emu.h>
+
+using namespace MT32Emu;
+
+static const char PLUGIN_ID[] = "com.github.munt.mt32emu";
+// The events of a block exceeding this number are enqueued to the MIDI event queue of the synth at their timestamps.
+static const Bit32u MAX_BLOCK_EVENTS = 1024;
+static const Bit32u MIDI_EVENT_QUEUE_SIZE = 1024;
+
+static const char *const PLUGIN_FEATURES[] = {
+	CLAP_PLUGIN_FEATURE_INSTRUMENT,
+	CLAP_PLUGIN_FEATURE_SYNTHESIZER,
+	CLAP_PLUGIN_FEATURE_STEREO,
+	NULL
+};
+
+static const clap_plugin_descriptor_t PLUGIN_DESCRIPTOR = {
+	CLAP_VERSION_INIT,
+	PLUGIN_ID,
+	"Munt MT-32",
+	"Munt",
+	"https://github.com/munt/munt",
+	"",
+	"",
+	VERSION,
+	"Roland MT-32 and CM-32L emulation",
+	PLUGIN_FEATURES
+};
+
+// Guards the synth against the state being saved or loaded on the main thread while rendering. The audio thread
+// never waits for the lock, it renders silence instead in the rare case the lock is taken.
+class SynthLock {
+public:
+	SynthLock() {
+#ifdef _WIN32
+		InitializeCriticalSection(&mutex);
+#else
+		pthread_mutex_init(&mutex, NULL);
+#endif
+	}
+
+	~SynthLock() {
+#ifdef _WIN32
+		DeleteCriticalSection(&mutex);
+#else
+		pthread_mutex_destroy(&mutex);
+#endif
+	}
+
+	void lock() {
+#ifdef _WIN32
+		EnterCriticalSection(&mutex);
+#else
+		pthread_mutex_lock(&mutex);
+#endif
+	}
+
+	bool tryLock() {
+#ifdef _WIN32
+		return TryEnterCriticalSection(&mutex) != 0;
+#else
+		return pthread_mutex_trylock(&mutex) == 0;
+#endif
+	}
+
+	void unlock() {
+#ifdef _WIN32
+		LeaveCriticalSection(&mutex);
+#else
+		pthread_mutex_unlock(&mutex);
+#endif
+	}
+
+private:
+#ifdef _WIN32
+	CRITICAL_SECTION mutex;
+#else
+	pthread_mutex_t mutex;
+#endif
+};
+
+struct ClapSynth {
+	clap_plugin_t plugin;
+	const clap_host_t *host;
+	const ROMImage *controlROMImage;
+	const ROMImage *pcmROMImage;
+	Synth *synth;
+	SampleRateConverter *src;
+	SynthLock synthLock;
+	// Maps the sample offsets of the events to the timestamps of the synth.
+	Bit32u renderedSampleCountBase;
+	uint64_t outputFramesRendered;
+	// Kept while the plugin is deactivated, restored upon activation.
+	std::vector<Bit8u> savedState;
+	MIDIEvent events[MAX_BLOCK_EVENTS];
+};
+
+static ClapSynth *getClapSynth(const clap_plugin_t *plugin) {
+	return static_cast<ClapSynth *>(plugin->plugin_data);
+}
+
+static std::string getROMDir() {
+	const char *romDir = getenv("MT32EMU_ROM_DIR");
+	if (romDir != NULL && *romDir != 0) {
+		std::string path = romDir;
+		if (path[path.size() - 1] != '/' && path[path.size() - 1] != '\\') path += '/';
+		return path;
+	}
+	// Same default as mt32emu-qt.
+	const char *home = getenv("USERPROFILE");
+	if (home == NULL) home = getenv("HOME");
+	if (home == NULL) home = ".";
+	return std::string(home) + "/roms/";
+}
+
+static const ROMImage *makeROMImage(const std::string &romDir, const char *romFileName) {
+	FileStream *file = new FileStream;
+	if (file->open((romDir + romFileName).c_str())) {
+		const ROMImage *romImage = ROMImage::makeROMImage(file);
+		if (romImage->getROMInfo() != NULL) return romImage;
+		ROMImage::freeROMImage(romImage);
+	}
+	delete file;
+	return NULL;
+}
+
+static void freeROMImage(const ROMImage *&romImage) {
+	if (romImage == NULL) return;
+	File *file = romImage->getFile();
+	ROMImage::freeROMImage(romImage);
+	delete file;
+	romImage = NULL;
+}
+
+static bool pluginInit(const clap_plugin_t *plugin) {
+	ClapSynth *clapSynth = getClapSynth(plugin);
+	const std::string romDir = getROMDir();
+	clapSynth->controlROMImage = makeROMImage(romDir, "CM32L_CONTROL.ROM");
+	if (clapSynth->controlROMImage == NULL) clapSynth->controlROMImage = makeROMImage(romDir, "MT32_CONTROL.ROM");
+	clapSynth->pcmROMImage = makeROMImage(romDir, "CM32L_PCM.ROM");
+	if (clapSynth->pcmROMImage == NULL) clapSynth->pcmROMImage = makeROMImage(romDir, "MT32_PCM.ROM");
+	return clapSynth->controlROMImage != NULL && clapSynth->pcmROMImage != NULL;
+}
+
+static void pluginDestroy(const clap_plugin_t *plugin) {
+	ClapSynth *clapSynth = getClapSynth(plugin);
+	freeROMImage(clapSynth->controlROMImage);
+	freeROMImage(clapSynth->pcmROMImage);
+	delete clapSynth;
+}
+
+static bool pluginActivate(const clap_plugin_t *plugin, double sampleRate, uint32_t, uint32_t) {
+	ClapSynth *clapSynth = getClapSynth(plugin);
+	Synth *synth = new Synth;
+	synth->selectRendererType(RendererType_FLOAT);
+	synth->setMIDIEventQueueSize(MIDI_EVENT_QUEUE_SIZE);
+	if (!synth->open(*clapSynth->controlROMImage, *clapSynth->pcmROMImage, AnalogOutputMode_ACCURATE)) {
+		delete synth;
+		return false;
+	}
+	if (!clapSynth->savedState.empty()) synth->restoreState(&clapSynth->savedState[0], clapSynth->savedState.size());
+	clapSynth->synthLock.lock();
+	clapSynth->synth = synth;
+	clapSynth->src = new SampleRateConverter(*synth, sampleRate, SamplerateConversionQuality_GOOD);
+	clapSynth->renderedSampleCountBase = synth->getInternalRenderedSampleCount();
+	clapSynth->outputFramesRendered = 0;
+	clapSynth->synthLock.unlock();
+	return true;
+}
+
+static void pluginDeactivate(const clap_plugin_t *plugin) {
+	ClapSynth *clapSynth = getClapSynth(plugin);
+	clapSynth->synthLock.lock();
+	Synth *synth = clapSynth->synth;
+	clapSynth->savedState.resize(synth->saveState(NULL, 0));
+	if (!clapSynth->savedState.empty()) synth->saveState(&clapSynth->savedState[0], clapSynth->savedState.size());
+	delete clapSynth->src;
+	clapSynth->src = NULL;
+	clapSynth->synth = NULL;
+	clapSynth->synthLock.unlock();
+	synth->close();
+	delete synth;
+}
+
+static bool pluginStartProcessing(const clap_plugin_t *) {
+	return true;
+}
+
+static void pluginStopProcessing(const clap_plugin_t *) {}
+
+static void pluginReset(const clap_plugin_t *plugin) {
+	ClapSynth *clapSynth = getClapSynth(plugin);
+	clapSynth->synthLock.lock();
+	if (clapSynth->synth != NULL && clapSynth->synth->resetToOpenState()) {
+		// The rendered sample count starts over, while the converter may still hold some frames rendered before.
+		clapSynth->renderedSampleCountBase = 0 - Bit32u(uint64_t(clapSynth->src->convertOutputToSynthTimestamp(double(clapSynth->outputFramesRendered))));
+	}
+	clapSynth->synthLock.unlock();
+}
+
+// Converts a host event to a MIDIEvent. Returns false if the event does not affect the synth.
+static bool convertEvent(ClapSynth *clapSynth, const clap_event_header_t *header, MIDIEvent &event) {
+	if (header->space_id != CLAP_CORE_EVENT_SPACE_ID) return false;
+	switch (header->type) {
+	case CLAP_EVENT_NOTE_ON:
+	case CLAP_EVENT_NOTE_OFF: {
+		const clap_event_note_t *note = reinterpret_cast<const clap_event_note_t *>(header);
+		if (note->channel < 0 || note->channel > 15 || note->key < 0 || note->key > 127) return false;
+		Bit32u velocity = Bit32u(floor(note->velocity * 127.0 + 0.5));
+		if (velocity > 127) velocity = 127;
+		if (header->type == CLAP_EVENT_NOTE_ON) {
+			// A zero velocity would turn the note-on into a note-off.
+			if (velocity == 0) velocity = 1;
+			event.shortMessage = 0x90 | Bit32u(note->channel) | Bit32u(note->key) << 8 | velocity << 16;
+		} else {
+			event.shortMessage = 0x80 | Bit32u(note->channel) | Bit32u(note->key) << 8 | velocity << 16;
+		}
+		event.sysexData = NULL;
+		event.sysexLength = 0;
+		break;
+	}
+	case CLAP_EVENT_MIDI: {
+		const clap_event_midi_t *midi = reinterpret_cast<const clap_event_midi_t *>(header);
+		event.shortMessage = Bit32u(midi->data[0]) | Bit32u(midi->data[1]) << 8 | Bit32u(midi->data[2]) << 16;
+		event.sysexData = NULL;
+		event.sysexLength = 0;
+		break;
+	}
+	case CLAP_EVENT_MIDI_SYSEX: {
+		const clap_event_midi_sysex_t *sysex = reinterpret_cast<const clap_event_midi_sysex_t *>(header);
+		if (sysex->buffer == NULL || sysex->size == 0) return false;
+		event.shortMessage = 0;
+		event.sysexData = sysex->buffer;
+		event.sysexLength = sysex->size;
+		break;
+	}
+	default:
+		return false;
+	}
+	const double outputTimestamp = double(clapSynth->outputFramesRendered + header->time);
+	event.timestamp = clapSynth->renderedSampleCountBase + Bit32u(uint64_t(clapSynth->src->convertOutputToSynthTimestamp(outputTimestamp)));
+	return true;
+}
+
+static clap_process_status pluginProcess(const clap_plugin_t *plugin, const clap_process_t *process) {
+	ClapSynth *clapSynth = getClapSynth(plugin);
+	if (process->audio_outputs_count < 1) return CLAP_PROCESS_ERROR;
+	clap_audio_buffer_t &audioOutput = process->audio_outputs[0];
+	float *left = audioOutput.data32[0];
+	float *right = audioOutput.data32[audioOutput.channel_count > 1 ? 1 : 0];
+	const Bit32u frameCount = process->frames_count;
+
+	if (!clapSynth->synthLock.tryLock()) {
+		memset(left, 0, frameCount * sizeof(float));
+		memset(right, 0, frameCount * sizeof(float));
+		return CLAP_PROCESS_CONTINUE;
+	}
+
+	Bit32u eventCount = 0;
+	const clap_input_events_t *inEvents = process->in_events;
+	const Bit32u inEventCount = inEvents->size(inEvents);
+	for (Bit32u i = 0; i < inEventCount; i++) {
+		MIDIEvent event;
+		if (!convertEvent(clapSynth, inEvents->get(inEvents, i), event)) continue;
+		if (eventCount < MAX_BLOCK_EVENTS) {
+			clapSynth->events[eventCount++] = event;
+		} else if (event.sysexData == NULL) {
+			// The queued events are played in the order of timestamps along with the ones passed directly.
+			clapSynth->synth->playMsg(event.shortMessage, event.timestamp);
+		} else {
+			clapSynth->synth->playSysex(event.sysexData, event.sysexLength, event.timestamp);
+		}
+	}
+
+	const StereoOutputDescriptor<float> output = { left, right, 1, false, 1.0f };
+	clapSynth->src->getOutputSamplesWithEvents(clapSynth->events, eventCount, output, frameCount);
+	clapSynth->outputFramesRendered += frameCount;
+	clapSynth->synthLock.unlock();
+
+	audioOutput.constant_mask = 0;
+	return CLAP_PROCESS_CONTINUE;
+}
+
+static uint32_t audioPortsCount(const clap_plugin_t *, bool isInput) {
+	return isInput ? 0 : 1;
+}
+
+static bool audioPortsGet(const clap_plugin_t *, uint32_t index, bool isInput, clap_audio_port_info_t *info) {
+	if (isInput || index != 0) return false;
+	info->id = 0;
+	strcpy(info->name, "Output");
+	info->flags = CLAP_AUDIO_PORT_IS_MAIN;
+	info->channel_count = 2;
+	info->port_type = CLAP_PORT_STEREO;
+	info->in_place_pair = CLAP_INVALID_ID;
+	return true;
+}
+
+static const clap_plugin_audio_ports_t AUDIO_PORTS = {
+	audioPortsCount,
+	audioPortsGet
+};
+
+static uint32_t notePortsCount(const clap_plugin_t *, bool isInput) {
+	return isInput ? 1 : 0;
+}
+
+static bool notePortsGet(const clap_plugin_t *, uint32_t index, bool isInput, clap_note_port_info_t *info) {
+	if (!isInput || index != 0) return false;
+	info->id = 0;
+	info->supported_dialects = CLAP_NOTE_DIALECT_MIDI | CLAP_NOTE_DIALECT_CLAP;
+	info->preferred_dialect = CLAP_NOTE_DIALECT_MIDI;
+	strcpy(info->name, "MIDI In");
+	return true;
+}
+
+static const clap_plugin_note_ports_t NOTE_PORTS = {
+	notePortsCount,
+	notePortsGet
+};
+
+// The output is delayed by the sample rate conversion, the analog LPF fused with it included, and the reverb pipeline.
+static uint32_t latencyGet(const clap_plugin_t *plugin) {
+	ClapSynth *clapSynth = getClapSynth(plugin);
+	if (clapSynth->src == NULL) return 0;
+	double latency = clapSynth->src->getLatency();
+	if (clapSynth->synth->isReverbPipelineEnabled()) {
+		latency += clapSynth->src->convertSynthToOutputTimestamp(clapSynth->synth->getReverbPipelineLatency());
+	}
+	return uint32_t(floor(latency + 0.5));
+}
+
+static const clap_plugin_latency_t LATENCY = {
+	latencyGet
+};
+
+// The state is the emulation snapshot made by Synth::saveState(), restored upon loading with the same ROMs only.
+static bool stateSave(const clap_plugin_t *plugin, const clap_ostream_t *stream) {
+	ClapSynth *clapSynth = getClapSynth(plugin);
+	std::vector<Bit8u> state;
+	clapSynth->synthLock.lock();
+	if (clapSynth->synth == NULL) {
+		state = clapSynth->savedState;
+	} else {
+		state.resize(clapSynth->synth->saveState(NULL, 0));
+		if (!state.empty()) clapSynth->synth->saveState(&state[0], state.size());
+	}
+	clapSynth->synthLock.unlock();
+	for (size_t offset = 0; offset < state.size();) {
+		const int64_t written = stream->write(stream, &state[offset], state.size() - offset);
+		if (written <= 0) return false;
+		offset += size_t(written);
+	}
+	return true;
+}
+
+static bool stateLoad(const clap_plugin_t *plugin, const clap_istream_t *stream) {
+	ClapSynth *clapSynth = getClapSynth(plugin);
+	std::vector<Bit8u> state;
+	Bit8u buffer[4096];
+	for (;;) {
+		const int64_t read = stream->read(stream, buffer, sizeof(buffer));
+		if (read < 0) return false;
+		if (read == 0) break;
+		state.insert(state.end(), buffer, buffer + read);
+	}
+	bool result = true;
+	clapSynth->synthLock.lock();
+	if (clapSynth->synth == NULL) {
+		clapSynth->savedState.swap(state);
+	} else if (!state.empty()) {
+		const Bit32u renderedSampleCount = clapSynth->synth->getInternalRenderedSampleCount();
+		result = clapSynth->synth->restoreState(&state[0], state.size());
+		// Keeps the event timestamps in line with the rendered sample count restored.
+		if (result) clapSynth->renderedSampleCountBase += clapSynth->synth->getInternalRenderedSampleCount() - renderedSampleCount;
+	}
+	clapSynth->synthLock.unlock();
+	return result;
+}
+
+static const clap_plugin_state_t STATE = {
+	stateSave,
+	stateLoad
+};
+
+static const void *pluginGetExtension(const clap_plugin_t *, const char *id) {
+	if (strcmp(id, CLAP_EXT_AUDIO_PORTS) == 0) return &AUDIO_PORTS;
+	if (strcmp(id, CLAP_EXT_NOTE_PORTS) == 0) return &NOTE_PORTS;
+	if (strcmp(id, CLAP_EXT_LATENCY) == 0) return &LATENCY;
+	if (strcmp(id, CLAP_EXT_STATE) == 0) return &STATE;
+	return NULL;
+}
+
+static void pluginOnMainThread(const clap_plugin_t *) {}
+
+static const clap_plugin_t *createPlugin(const clap_plugin_factory_t *, const clap_host_t *host, const char *pluginId) {
+	if (!clap_version_is_compatible(host->clap_version) || strcmp(pluginId, PLUGIN_ID) != 0) return NULL;
+	ClapSynth *clapSynth = new ClapSynth;
+	clapSynth->host = host;
+	clapSynth->controlROMImage = NULL;
+	clapSynth->pcmROMImage = NULL;
+	clapSynth->synth = NULL;
+	clapSynth->src = NULL;
+	clapSynth->renderedSampleCountBase = 0;
+	clapSynth->outputFramesRendered = 0;
+	clap_plugin_t &plugin = clapSynth->plugin;
+	plugin.desc = &PLUGIN_DESCRIPTOR;
+	plugin.plugin_data = clapSynth;
+	plugin.init = pluginInit;
+	plugin.destroy = pluginDestroy;
+	plugin.activate = pluginActivate;
+	plugin.deactivate = pluginDeactivate;
+	plugin.start_processing = pluginStartProcessing;
+	plugin.stop_processing = pluginStopProcessing;
+	plugin.reset = pluginReset;
+	plugin.process = pluginProcess;
+	plugin.get_extension = pluginGetExtension;
+	plugin.on_main_thread = pluginOnMainThread;
+	return &plugin;
+}
+
+static uint32_t factoryGetPluginCount(const clap_plugin_factory_t *) {
+	return 1;
+}
+
+static const clap_plugin_descriptor_t *factoryGetPluginDescriptor(const clap_plugin_factory_t *, uint32_t index) {
+	return index == 0 ? &PLUGIN_DESCRIPTOR : NULL;
+}
+
+static const clap_plugin_factory_t PLUGIN_FACTORY = {
+	factoryGetPluginCount,
+	factoryGetPluginDescriptor,
+	createPlugin
+};
+
+static bool entryInit(const char *) {
+	return true;
+}
+
+static void entryDeinit() {}
+
+static const void *entryGetFactory(const char *factoryId) {
+	return strcmp(factoryId, CLAP_PLUGIN_FACTORY_ID) == 0 ? &PLUGIN_FACTORY : NULL;
+}
+
+extern "C" CLAP_EXPORT const clap_plugin_entry_t clap_entry = {
+	CLAP_VERSION_INIT,
+	entryInit,
+	entryDeinit,
+	entryGetFactory
+};
@@ -0,0 +1,244 @@
+/* Copyright (C) 2011-2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#if !(defined _GNU_SOURCE || defined _POSIX_C_SOURCE && (_POSIX_C_SOURCE - 0) >= 200112L)
+#undef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mt32emu_shm_audio.h"
+
+#define CHANNEL_COUNT 2
+
+struct mt32emu_shm_audio_reader {
+	mt32emu_shm_audio_header *header;
+	const int16_t *frames;
+	size_t mappingSize;
+	uint64_t readFrameCount;
+	uint64_t lostFrameCount;
+	/* Frames made available by the latest peek. */
+	uint32_t peekedFrameCount;
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+};
+
+int64_t mt32emu_shm_audio_get_clock_nanos(void) {
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (int64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000
+		+ (int64_t)((counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart);
+#else
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0;
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static void getCounters(const mt32emu_shm_audio_header *header, uint64_t *writtenFrameCount, uint64_t *reservedFrameCount, int64_t *writtenClockNanos) {
+	for (;;) {
+		const uint32_t sequence = header->clockSequence;
+		MT32EMU_SHM_AUDIO_BARRIER();
+		*writtenFrameCount = header->writtenFrameCount;
+		*reservedFrameCount = header->reservedFrameCount;
+		*writtenClockNanos = header->writtenClockNanos;
+		MT32EMU_SHM_AUDIO_BARRIER();
+		if ((sequence & 1) == 0 && sequence == header->clockSequence) return;
+	}
+}
+
+static void unmap(mt32emu_shm_audio_reader *reader, void *address) {
+#ifdef _WIN32
+	UnmapViewOfFile(address);
+	CloseHandle(reader->mapping);
+#else
+	munmap(address, reader->mappingSize);
+#endif
+}
+
+mt32emu_shm_audio_reader *mt32emu_shm_audio_open(unsigned int index) {
+	char name[64];
+	mt32emu_shm_audio_reader *reader;
+	void *address;
+	mt32emu_shm_audio_header *header;
+	uint64_t writtenFrameCount, reservedFrameCount;
+	int64_t writtenClockNanos;
+
+	reader = (mt32emu_shm_audio_reader *)calloc(1, sizeof(mt32emu_shm_audio_reader));
+	if (reader == NULL) return NULL;
+#ifdef _WIN32
+	sprintf(name, "Local\\" MT32EMU_SHM_AUDIO_NAME_PREFIX "%u", index);
+	reader->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+	if (reader->mapping == NULL) {
+		free(reader);
+		return NULL;
+	}
+	address = MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (address == NULL) {
+		CloseHandle(reader->mapping);
+		free(reader);
+		return NULL;
+	}
+	{
+		MEMORY_BASIC_INFORMATION info;
+		VirtualQuery(address, &info, sizeof(info));
+		reader->mappingSize = info.RegionSize;
+	}
+#else
+	{
+		struct stat fileStat;
+		int fd;
+		sprintf(name, "/" MT32EMU_SHM_AUDIO_NAME_PREFIX "%u", index);
+		fd = shm_open(name, O_RDONLY, 0);
+		if (fd < 0) {
+			free(reader);
+			return NULL;
+		}
+		if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < MT32EMU_SHM_AUDIO_HEADER_SIZE) {
+			close(fd);
+			free(reader);
+			return NULL;
+		}
+		reader->mappingSize = (size_t)fileStat.st_size;
+		address = mmap(NULL, reader->mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (address == MAP_FAILED) {
+			free(reader);
+			return NULL;
+		}
+	}
+#endif
+	header = (mt32emu_shm_audio_header *)address;
+	if (header->magic != MT32EMU_SHM_AUDIO_MAGIC || header->version != MT32EMU_SHM_AUDIO_VERSION
+		|| header->channelCount != CHANNEL_COUNT || header->capacityFrames == 0
+		|| (header->capacityFrames & (header->capacityFrames - 1)) != 0
+		|| reader->mappingSize < MT32EMU_SHM_AUDIO_HEADER_SIZE + (size_t)header->capacityFrames * CHANNEL_COUNT * sizeof(int16_t))
+	{
+		unmap(reader, address);
+		free(reader);
+		return NULL;
+	}
+	reader->header = header;
+	reader->frames = (const int16_t *)((const char *)address + MT32EMU_SHM_AUDIO_HEADER_SIZE);
+	getCounters(header, &writtenFrameCount, &reservedFrameCount, &writtenClockNanos);
+	reader->readFrameCount = writtenFrameCount;
+	return reader;
+}
+
+void mt32emu_shm_audio_close(mt32emu_shm_audio_reader *reader) {
+	if (reader == NULL) return;
+	unmap(reader, reader->header);
+	free(reader);
+}
+
+uint32_t mt32emu_shm_audio_get_sample_rate(const mt32emu_shm_audio_reader *reader) {
+	return reader->header->sampleRate;
+}
+
+uint32_t mt32emu_shm_audio_get_capacity_frames(const mt32emu_shm_audio_reader *reader) {
+	return reader->header->capacityFrames;
+}
+
+int mt32emu_shm_audio_is_writer_active(const mt32emu_shm_audio_reader *reader) {
+	return reader->header->writerActive != 0;
+}
+
+void mt32emu_shm_audio_get_clock(const mt32emu_shm_audio_reader *reader, mt32emu_shm_audio_clock *clock) {
+	uint64_t reservedFrameCount;
+	getCounters(reader->header, &clock->writtenFrameCount, &reservedFrameCount, &clock->writtenClockNanos);
+}
+
+uint64_t mt32emu_shm_audio_get_read_frame_count(const mt32emu_shm_audio_reader *reader) {
+	return reader->readFrameCount;
+}
+
+uint64_t mt32emu_shm_audio_get_lost_frame_count(const mt32emu_shm_audio_reader *reader) {
+	return reader->lostFrameCount;
+}
+
+uint32_t mt32emu_shm_audio_peek(mt32emu_shm_audio_reader *reader, const int16_t **first, uint32_t *firstFrameCount,
+	const int16_t **second, uint32_t *secondFrameCount)
+{
+	const uint32_t capacityFrames = reader->header->capacityFrames;
+	uint64_t writtenFrameCount, reservedFrameCount;
+	int64_t writtenClockNanos;
+	uint32_t availableFrameCount, readPosition;
+
+	getCounters(reader->header, &writtenFrameCount, &reservedFrameCount, &writtenClockNanos);
+	/* The frames below reservedFrameCount - capacityFrames may be being overwritten. */
+	if (reservedFrameCount - reader->readFrameCount > capacityFrames) {
+		reader->lostFrameCount += writtenFrameCount - reader->readFrameCount;
+		reader->readFrameCount = writtenFrameCount;
+	}
+	availableFrameCount = (uint32_t)(writtenFrameCount - reader->readFrameCount);
+	readPosition = (uint32_t)(reader->readFrameCount & (capacityFrames - 1));
+	*first = reader->frames + CHANNEL_COUNT * readPosition;
+	if (readPosition + availableFrameCount > capacityFrames) {
+		*firstFrameCount = capacityFrames - readPosition;
+		*second = reader->frames;
+		*secondFrameCount = availableFrameCount - *firstFrameCount;
+	} else {
+		*firstFrameCount = availableFrameCount;
+		*second = NULL;
+		*secondFrameCount = 0;
+	}
+	reader->peekedFrameCount = availableFrameCount;
+	return availableFrameCount;
+}
+
+int mt32emu_shm_audio_consume(mt32emu_shm_audio_reader *reader, uint32_t frameCount) {
+	uint64_t writtenFrameCount, reservedFrameCount;
+	int64_t writtenClockNanos;
+	int intact;
+
+	if (frameCount > reader->peekedFrameCount) frameCount = reader->peekedFrameCount;
+	MT32EMU_SHM_AUDIO_BARRIER();
+	getCounters(reader->header, &writtenFrameCount, &reservedFrameCount, &writtenClockNanos);
+	intact = reservedFrameCount - reader->readFrameCount <= reader->header->capacityFrames;
+	reader->readFrameCount += frameCount;
+	reader->peekedFrameCount -= frameCount;
+	return intact;
+}
+
+uint32_t mt32emu_shm_audio_read(mt32emu_shm_audio_reader *reader, int16_t *buffer, uint32_t frameCount) {
+	const int16_t *first, *second;
+	uint32_t firstFrameCount, secondFrameCount;
+	const uint32_t availableFrameCount = mt32emu_shm_audio_peek(reader, &first, &firstFrameCount, &second, &secondFrameCount);
+
+	if (frameCount > availableFrameCount) frameCount = availableFrameCount;
+	if (frameCount <= firstFrameCount) {
+		memcpy(buffer, first, frameCount * CHANNEL_COUNT * sizeof(int16_t));
+	} else {
+		memcpy(buffer, first, firstFrameCount * CHANNEL_COUNT * sizeof(int16_t));
+		memcpy(buffer + CHANNEL_COUNT * firstFrameCount, second, (frameCount - firstFrameCount) * CHANNEL_COUNT * sizeof(int16_t));
+	}
+	return mt32emu_shm_audio_consume(reader, frameCount) ? frameCount : 0;
+}
@@ -0,0 +1,131 @@
+/* Copyright (C) 2011-2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MT32EMU_SHM_AUDIO_H
+#define MT32EMU_SHM_AUDIO_H
+
+/*
+ * Reader of the audio output mt32emu-qt publishes in shared memory.
+ *
+ * With the "Shared memory" audio device, each synth of mt32emu-qt writes its output to a named shared-memory ring
+ * of interleaved stereo 16-bit frames. Any number of local processes may read a ring at their own pace. The writer
+ * never waits for the readers, it overwrites the oldest frames instead, so a reader that falls behind by more than
+ * the ring capacity loses frames. The ring header contains a frame clock, that is the total number of frames written
+ * and the time they were written at, which the readers can use to synchronise with the synth.
+ *
+ * The rings are named "mt32emu-qt-audio-N", where N is 1 for the first synth that uses the device, 2 for the second
+ * one open at the same time and so on.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MT32EMU_SHM_AUDIO_MAGIC 0x4133544DU /* "MT3A" */
+#define MT32EMU_SHM_AUDIO_VERSION 1
+#define MT32EMU_SHM_AUDIO_NAME_PREFIX "mt32emu-qt-audio-"
+/* The frames follow the header at this offset from the start of the shared memory. */
+#define MT32EMU_SHM_AUDIO_HEADER_SIZE 128
+
+#if defined _MSC_VER
+#define MT32EMU_SHM_AUDIO_BARRIER() MemoryBarrier()
+#else
+#define MT32EMU_SHM_AUDIO_BARRIER() __sync_synchronize()
+#endif
+
+/*
+ * Layout of the ring header. The fields are in the native byte order. The frame counters and the clock are published
+ * with a sequence lock: the writer makes clockSequence odd while it updates them and even again afterwards.
+ * Before rendering into the ring, the writer advances reservedFrameCount to the end of the frames it is about to write,
+ * so the frames from reservedFrameCount - capacityFrames onwards are intact. It advances writtenFrameCount once
+ * the frames are complete.
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t sampleRate;
+	uint32_t channelCount;
+	/* A power of 2. */
+	uint32_t capacityFrames;
+	/* Nonzero while the synth writes to the ring, the ring is abandoned once this is cleared. */
+	volatile uint32_t writerActive;
+	volatile uint32_t clockSequence;
+	uint32_t reserved;
+	volatile uint64_t writtenFrameCount;
+	volatile uint64_t reservedFrameCount;
+	/* The time writtenFrameCount was last advanced at, see mt32emu_shm_audio_get_clock_nanos(). */
+	volatile int64_t writtenClockNanos;
+} mt32emu_shm_audio_header;
+
+typedef struct mt32emu_shm_audio_reader mt32emu_shm_audio_reader;
+
+/* A consistent snapshot of the frame clock. */
+typedef struct {
+	uint64_t writtenFrameCount;
+	int64_t writtenClockNanos;
+} mt32emu_shm_audio_clock;
+
+/*
+ * Returns the current time of the clock used in the ring header in nanoseconds: CLOCK_MONOTONIC on POSIX systems
+ * and the performance counter on Windows.
+ */
+int64_t mt32emu_shm_audio_get_clock_nanos(void);
+
+/*
+ * Opens the ring with the given index, starting at the latest frame written. Returns NULL if no such ring exists
+ * or it has an incompatible format.
+ */
+mt32emu_shm_audio_reader *mt32emu_shm_audio_open(unsigned int index);
+void mt32emu_shm_audio_close(mt32emu_shm_audio_reader *reader);
+
+uint32_t mt32emu_shm_audio_get_sample_rate(const mt32emu_shm_audio_reader *reader);
+uint32_t mt32emu_shm_audio_get_capacity_frames(const mt32emu_shm_audio_reader *reader);
+/* Returns zero once the synth has stopped writing to the ring, the reader should be closed then. */
+int mt32emu_shm_audio_is_writer_active(const mt32emu_shm_audio_reader *reader);
+void mt32emu_shm_audio_get_clock(const mt32emu_shm_audio_reader *reader, mt32emu_shm_audio_clock *clock);
+/* Returns the number of frames the reader has consumed, counted the same way as writtenFrameCount. */
+uint64_t mt32emu_shm_audio_get_read_frame_count(const mt32emu_shm_audio_reader *reader);
+/* Returns the number of frames skipped since the reader was opened because it fell behind the writer too far. */
+uint64_t mt32emu_shm_audio_get_lost_frame_count(const mt32emu_shm_audio_reader *reader);
+
+/*
+ * Provides direct access to the frames available for reading, which are in one or two parts due to the wrap-around.
+ * The second part is empty (NULL, 0) if the frames are contiguous. Returns the total number of frames available.
+ * If the reader has fallen behind by more than the ring capacity, it skips to the latest frame written first.
+ */
+uint32_t mt32emu_shm_audio_peek(mt32emu_shm_audio_reader *reader, const int16_t **first, uint32_t *firstFrameCount,
+	const int16_t **second, uint32_t *secondFrameCount);
+
+/*
+ * Marks the frames obtained with mt32emu_shm_audio_peek() as consumed. Returns zero if the writer may have overwritten
+ * some of them meanwhile, in which case the data used should be discarded.
+ */
+int mt32emu_shm_audio_consume(mt32emu_shm_audio_reader *reader, uint32_t frameCount);
+
+/*
+ * Copies up to frameCount available frames to the buffer and consumes them. Returns the number of frames copied,
+ * which is 0 if the frames were overwritten while being copied.
+ */
+uint32_t mt32emu_shm_audio_read(mt32emu_shm_audio_reader *reader, int16_t *buffer, uint32_t frameCount);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MT32EMU_SHM_AUDIO_H */
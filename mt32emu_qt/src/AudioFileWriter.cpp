@@ -16,13 +16,22 @@
 
 #include <QMessageBox>
 
+#ifdef WITH_FLAC
+#include <FLAC/stream_encoder.h>
+#endif
+
 #include "AudioFileWriter.h"
 #include "MasterClock.h"
 #include "Master.h"
 #include "MidiParser.h"
 #include "QSynth.h"
+#include "QAtomicHelper.h"
+#include "QRingBuffer.h"
 
 static const unsigned int FRAME_SIZE = 4; // Stereo, 16-bit
+static const unsigned int FLOAT_FRAME_SIZE = 8; // Stereo, float
+// The recorder thread wakes up this often to store the frames accumulated in the ring buffer.
+static const unsigned long RECORDER_POLL_MILLIS = 20;
 static const unsigned char WAVE_HEADER[] = {
 	0x52, 0x49, 0x46, 0x46, 0x00, 0x00, 0x00, 0x00, 0x57, 0x41, 0x56, 0x45, 0x66, 0x6D, 0x74, 0x20,
 	0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0x02, 0x00, 0x44, 0xAC, 0x00, 0x00, 0x10, 0xB1, 0x02, 0x00,
@@ -30,11 +39,141 @@ static const unsigned char WAVE_HEADER[] = {
 };
 static const unsigned int RIFF_PAYLOAD_SIZE_OFFSET = 4;
 static const unsigned int RIFF_HEADER_LENGTH = 8;
+static const unsigned int WAVE_FORMAT_TAG_OFFSET = 20;
 static const unsigned int WAVE_SAMPLE_RATE_OFFSET = 24;
 static const unsigned int WAVE_BYTE_RATE_OFFSET = 28;
+static const unsigned int WAVE_BLOCK_ALIGN_OFFSET = 32;
+static const unsigned int WAVE_BITS_PER_SAMPLE_OFFSET = 34;
 static const unsigned int WAVE_DATA_SIZE_OFFSET = 40;
 static const unsigned int WAVE_HEADER_LENGTH = 44;
 
+#ifdef WITH_FLAC
+
+static const int FLAC_MAX_QUEUED_BLOCKS = 16;
+static const unsigned int FLAC_COMPRESSION_LEVEL = 5;
+
+// Encodes the samples to FLAC in a separate thread, so that rendering isn't stalled by the encoder.
+// The rendering thread only waits when the encoder falls behind by more than FLAC_MAX_QUEUED_BLOCKS blocks.
+class FLACEncoder : public QThread {
+public:
+	FLACEncoder(QFile &useFile) : file(useFile), encoder(NULL), finishing(false), failed(false) {}
+
+	~FLACEncoder() {
+		if (encoder != NULL) finish();
+	}
+
+	bool start(uint sampleRate, uint bitsPerSample) {
+		encoder = FLAC__stream_encoder_new();
+		if (encoder == NULL) return false;
+		FLAC__stream_encoder_set_channels(encoder, 2);
+		FLAC__stream_encoder_set_bits_per_sample(encoder, bitsPerSample);
+		FLAC__stream_encoder_set_sample_rate(encoder, sampleRate);
+		FLAC__stream_encoder_set_compression_level(encoder, FLAC_COMPRESSION_LEVEL);
+		if (FLAC__stream_encoder_init_stream(encoder, writeCallback, seekCallback, tellCallback, NULL, this) != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+			FLAC__stream_encoder_delete(encoder);
+			encoder = NULL;
+			return false;
+		}
+		QThread::start();
+		return true;
+	}
+
+	bool enqueue(const qint16 *buffer, uint frameCount) {
+		QVector<FLAC__int32> block(frameCount << 1);
+		for (int i = 0; i < block.size(); i++) {
+			block[i] = buffer[i];
+		}
+		return enqueue(block);
+	}
+
+	bool enqueue(const QVector<FLAC__int32> &block) {
+		QMutexLocker locker(&mutex);
+		while (queue.size() >= FLAC_MAX_QUEUED_BLOCKS && !failed) {
+			queueChanged.wait(&mutex);
+		}
+		if (failed) return false;
+		queue.append(block);
+		queueChanged.wakeAll();
+		return true;
+	}
+
+	// Waits for the queued samples to be encoded and completes the stream.
+	bool finish() {
+		mutex.lock();
+		finishing = true;
+		queueChanged.wakeAll();
+		mutex.unlock();
+		wait();
+		bool success = FLAC__stream_encoder_finish(encoder) && !failed;
+		FLAC__stream_encoder_delete(encoder);
+		encoder = NULL;
+		return success;
+	}
+
+private:
+	QFile &file;
+	FLAC__StreamEncoder *encoder;
+	QMutex mutex;
+	QWaitCondition queueChanged;
+	QList<QVector<FLAC__int32> > queue;
+	bool finishing;
+	bool failed;
+
+	static FLAC__StreamEncoderWriteStatus writeCallback(const FLAC__StreamEncoder *, const FLAC__byte buffer[], size_t bytes, unsigned, unsigned, void *clientData) {
+		QFile &file = static_cast<FLACEncoder *>(clientData)->file;
+		if (file.write((const char *)buffer, bytes) != qint64(bytes)) {
+			qDebug() << "AudioFileWriter: error writing into the audio file:" << file.errorString();
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		}
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+	}
+
+	static FLAC__StreamEncoderSeekStatus seekCallback(const FLAC__StreamEncoder *, FLAC__uint64 absoluteByteOffset, void *clientData) {
+		QFile &file = static_cast<FLACEncoder *>(clientData)->file;
+		return file.seek(qint64(absoluteByteOffset)) ? FLAC__STREAM_ENCODER_SEEK_STATUS_OK : FLAC__STREAM_ENCODER_SEEK_STATUS_ERROR;
+	}
+
+	static FLAC__StreamEncoderTellStatus tellCallback(const FLAC__StreamEncoder *, FLAC__uint64 *absoluteByteOffset, void *clientData) {
+		*absoluteByteOffset = FLAC__uint64(static_cast<FLACEncoder *>(clientData)->file.pos());
+		return FLAC__STREAM_ENCODER_TELL_STATUS_OK;
+	}
+
+	void run() {
+		QMutexLocker locker(&mutex);
+		for (;;) {
+			while (queue.isEmpty() && !finishing) {
+				queueChanged.wait(&mutex);
+			}
+			if (queue.isEmpty()) break;
+			QVector<FLAC__int32> block = queue.takeFirst();
+			queueChanged.wakeAll();
+			locker.unlock();
+			bool encoded = FLAC__stream_encoder_process_interleaved(encoder, block.constData(), block.size() >> 1);
+			locker.relock();
+			if (!encoded) {
+				qDebug() << "AudioFileWriter: FLAC encoder failed:" << FLAC__StreamEncoderStateString[FLAC__stream_encoder_get_state(encoder)];
+				failed = true;
+				queue.clear();
+				queueChanged.wakeAll();
+				break;
+			}
+		}
+	}
+};
+
+#endif
+
+static inline qint32 convertSampleToS24(float sample) {
+	return qBound(-0x800000, qRound(sample * 8388608.0f), 0x7FFFFF);
+}
+
+AudioFileWriter::SampleFormat AudioFileWriter::getConfiguredSampleFormat() {
+	const QString sampleFormatName = Master::getInstance()->getSettings()->value("Master/audioFileSampleFormat", "s16").toString();
+	if (sampleFormatName == "s24") return SampleFormat_S24;
+	if (sampleFormatName == "float") return SampleFormat_FLOAT;
+	return SampleFormat_S16;
+}
+
 bool AudioFileWriter::convertSamplesFromNativeEndian(const qint16 *sourceBuffer, qint16 *targetBuffer, uint sampleCount, QSysInfo::Endian targetByteOrder) {
 	if (QSysInfo::ByteOrder == targetByteOrder) return false;
 	while ((sampleCount--) > 0) {
@@ -43,8 +182,8 @@ bool AudioFileWriter::convertSamplesFromNativeEndian(const qint16 *sourceBuffer,
 	return true;
 }
 
-AudioFileWriter::AudioFileWriter(uint sampleRate, const QString &fileName) :
-	sampleRate(sampleRate), fileName(fileName), waveMode(fileName.endsWith(".wav")), file(fileName)
+AudioFileWriter::AudioFileWriter(uint sampleRate, const QString &fileName, SampleFormat sampleFormat) :
+	sampleRate(sampleRate), fileName(fileName), sampleFormat(sampleFormat), waveMode(fileName.endsWith(".wav")), file(fileName), flacEncoder(NULL)
 {}
 
 AudioFileWriter::~AudioFileWriter() {
@@ -57,6 +196,18 @@ bool AudioFileWriter::open(bool skipInitialSilence) {
 		return false;
 	}
 	if (waveMode) file.seek(WAVE_HEADER_LENGTH);
+#ifdef WITH_FLAC
+	if (fileName.endsWith(".flac")) {
+		flacEncoder = new FLACEncoder(file);
+		if (!flacEncoder->start(sampleRate, sampleFormat == SampleFormat_S16 ? 16 : 24)) {
+			qDebug() << "AudioFileWriter: Can't initialise FLAC encoder for file '" + fileName + "'";
+			delete flacEncoder;
+			flacEncoder = NULL;
+			file.close();
+			return false;
+		}
+	}
+#endif
 	skipSilence = skipInitialSilence;
 	return true;
 }
@@ -81,6 +232,16 @@ bool AudioFileWriter::write(const qint16 *buffer, uint totalFrames) {
 		}
 	}
 
+#ifdef WITH_FLAC
+	if (flacEncoder != NULL) {
+		if (totalFrames > 0 && !flacEncoder->enqueue(buffer, totalFrames)) {
+			close();
+			return false;
+		}
+		return true;
+	}
+#endif
+
 	qint16 cnvBuffer[MAX_FRAMES_PER_RUN << 1];
 	while (totalFrames > 0) {
 		uint framesToWrite = qMin(MAX_FRAMES_PER_RUN, totalFrames);
@@ -105,22 +266,110 @@ bool AudioFileWriter::write(const qint16 *buffer, uint totalFrames) {
 	return true;
 }
 
+bool AudioFileWriter::write(const float *buffer, uint totalFrames) {
+	static const uint MAX_FRAMES_PER_RUN = 4096;
+
+	if (!file.isOpen()) return false;
+
+	if (skipSilence) {
+		const float *endPos = buffer + (totalFrames << 1);
+		totalFrames = 0;
+		for (const float *p = buffer; p < endPos; p += 2) {
+			if (p[0] != 0.0f || p[1] != 0.0f) {
+				skipSilence = false;
+				totalFrames = uint(endPos - p) >> 1;
+				buffer = p;
+				break;
+			}
+		}
+	}
+
+#ifdef WITH_FLAC
+	if (flacEncoder != NULL) {
+		if (totalFrames == 0) return true;
+		QVector<FLAC__int32> block(totalFrames << 1);
+		for (int i = 0; i < block.size(); i++) {
+			block[i] = convertSampleToS24(buffer[i]);
+		}
+		if (!flacEncoder->enqueue(block)) {
+			close();
+			return false;
+		}
+		return true;
+	}
+#endif
+
+	const bool littleEndian = waveMode;
+	const uint bytesPerSample = sampleFormat == SampleFormat_S24 ? 3 : 4;
+	uchar cnvBuffer[MAX_FRAMES_PER_RUN << 3];
+	while (totalFrames > 0) {
+		const uint framesToWrite = qMin(MAX_FRAMES_PER_RUN, totalFrames);
+		uchar *cnvBufferPos = cnvBuffer;
+		for (const float *bufferEnd = buffer + (framesToWrite << 1); buffer < bufferEnd; buffer++) {
+			if (sampleFormat == SampleFormat_S24) {
+				const qint32 sample = convertSampleToS24(*buffer);
+				cnvBufferPos[littleEndian ? 0 : 2] = uchar(sample);
+				cnvBufferPos[1] = uchar(sample >> 8);
+				cnvBufferPos[littleEndian ? 2 : 0] = uchar(sample >> 16);
+			} else {
+				quint32 sampleBits;
+				memcpy(&sampleBits, buffer, 4);
+				if (littleEndian) {
+					qToLittleEndian(sampleBits, cnvBufferPos);
+				} else {
+					qToBigEndian(sampleBits, cnvBufferPos);
+				}
+			}
+			cnvBufferPos += bytesPerSample;
+		}
+
+		const char *bufferPos = (const char *)cnvBuffer;
+		qint64 bytesToWrite = cnvBufferPos - cnvBuffer;
+		while (bytesToWrite > 0) {
+			qint64 bytesWritten = file.write(bufferPos, bytesToWrite);
+			if (bytesWritten == -1) {
+				qDebug() << "AudioFileWriter: error writing into the audio file:" << file.errorString();
+				file.close();
+				return false;
+			}
+			bytesToWrite -= bytesWritten;
+			bufferPos += bytesWritten;
+		}
+		totalFrames -= framesToWrite;
+	}
+	return true;
+}
+
 void AudioFileWriter::close() {
+#ifdef WITH_FLAC
+	if (flacEncoder != NULL) {
+		if (!flacEncoder->finish()) qDebug() << "AudioFileWriter: error encoding FLAC stream into the audio file";
+		delete flacEncoder;
+		flacEncoder = NULL;
+	}
+#endif
 	if (waveMode) {
 		uchar headerBuffer[WAVE_HEADER_LENGTH];
 		quint32 fileSize = (quint32)file.size();
+		// 1 - integer PCM, 3 - IEEE float
+		const quint16 formatTag = sampleFormat == SampleFormat_FLOAT ? 3 : 1;
+		const quint16 bitsPerSample = sampleFormat == SampleFormat_S16 ? 16 : (sampleFormat == SampleFormat_S24 ? 24 : 32);
+		const quint16 frameSize = bitsPerSample >> 2;
 		memcpy(headerBuffer, WAVE_HEADER, WAVE_HEADER_LENGTH);
 		qToLittleEndian(fileSize - RIFF_HEADER_LENGTH, headerBuffer + RIFF_PAYLOAD_SIZE_OFFSET);
 		qToLittleEndian(fileSize - WAVE_HEADER_LENGTH, headerBuffer + WAVE_DATA_SIZE_OFFSET);
+		qToLittleEndian(formatTag, headerBuffer + WAVE_FORMAT_TAG_OFFSET);
 		qToLittleEndian(sampleRate, headerBuffer + WAVE_SAMPLE_RATE_OFFSET);
-		qToLittleEndian(sampleRate * FRAME_SIZE, headerBuffer + WAVE_BYTE_RATE_OFFSET);
+		qToLittleEndian(sampleRate * frameSize, headerBuffer + WAVE_BYTE_RATE_OFFSET);
+		qToLittleEndian(frameSize, headerBuffer + WAVE_BLOCK_ALIGN_OFFSET);
+		qToLittleEndian(bitsPerSample, headerBuffer + WAVE_BITS_PER_SAMPLE_OFFSET);
 		file.seek(0);
 		file.write((char *)headerBuffer, WAVE_HEADER_LENGTH);
 	}
 	file.close();
 }
 
-AudioFileRenderer::AudioFileRenderer() : buffer(NULL), parsers(NULL) {
+AudioFileRenderer::AudioFileRenderer() : buffer(NULL), floatBuffer(NULL), parsers(NULL), offlineMode(), offlineNanos(), renderedNanos(), clockOffsetNanos() {
 	audioRenderer.synth = NULL;
 	connect(this, SIGNAL(parsingFailed(const QString &, const QString &)), Master::getInstance(), SLOT(showBalloon(const QString &, const QString &)));
 }
@@ -133,10 +382,13 @@ AudioFileRenderer::~AudioFileRenderer() {
 	}
 	delete[] parsers;
 	delete[] buffer;
+	delete[] floatBuffer;
 }
 
-bool AudioFileRenderer::convertMIDIFiles(QString useOutFileName, QStringList midiFileNameList, QString synthProfileName, unsigned int useBufferSize) {
+bool AudioFileRenderer::convertMIDIFiles(QString useOutFileName, QStringList midiFileNameList, QString synthProfileName, bool preview, unsigned int useBufferSize) {
 	if (useOutFileName.isEmpty() || midiFileNameList.isEmpty()) return false;
+	// The previous conversion thread may still be quitting after it signalled completion.
+	wait();
 	delete[] parsers;
 	parsersCount = midiFileNameList.size();
 	parsers = new MidiParser[parsersCount];
@@ -159,6 +411,7 @@ bool AudioFileRenderer::convertMIDIFiles(QString useOutFileName, QStringList mid
 		delete audioRenderer.synth;
 	}
 	audioRenderer.synth = new QSynth(this);
+	audioRenderer.synth->setPreviewMode(preview);
 	sampleRate = 0;
 	if (!audioRenderer.synth->open(sampleRate, MT32Emu::SamplerateConversionQuality_BEST, synthProfileName)) {
 		audioRenderer.synth->close();
@@ -170,35 +423,106 @@ bool AudioFileRenderer::convertMIDIFiles(QString useOutFileName, QStringList mid
 		QMessageBox::critical(NULL, "Error", "Failed to open synth");
 		return false;
 	}
-	Master::getInstance()->setAudioFileWriterSynth(audioRenderer.synth);
+	Master::getInstance()->addAudioFileWriterSynth(audioRenderer.synth);
 	bufferSize = useBufferSize;
 	outFileName = useOutFileName;
 	realtimeMode = false;
 	stopProcessing = false;
-	delete[] buffer;
-	buffer = new qint16[2 * bufferSize];
+	sampleFormat = AudioFileWriter::getConfiguredSampleFormat();
+	allocateBuffers();
 	QThread::start();
 	return true;
 }
 
+void AudioFileRenderer::allocateBuffers() {
+	delete[] buffer;
+	delete[] floatBuffer;
+	// Formats beyond 16-bit are written straight from the synth float output, avoiding the integer round-trip.
+	if (sampleFormat == AudioFileWriter::SampleFormat_S16) {
+		buffer = new qint16[2 * bufferSize];
+		floatBuffer = NULL;
+	} else {
+		buffer = NULL;
+		floatBuffer = new float[2 * bufferSize];
+	}
+}
+
 void AudioFileRenderer::startRealtimeProcessing(SynthRoute *useSynthRoute, unsigned int useSampleRate, QString useOutFileName, unsigned int useBufferSize) {
 	if (useOutFileName.isEmpty()) return;
 	audioRenderer.synthRoute = useSynthRoute;
 	sampleRate = useSampleRate;
 	bufferSize = useBufferSize;
 	outFileName = useOutFileName;
-	delete[] buffer;
-	buffer = new qint16[2 * bufferSize];
+	sampleFormat = AudioFileWriter::getConfiguredSampleFormat();
+	allocateBuffers();
 	realtimeMode = true;
 	stopProcessing = false;
+	offlineMode = false;
+	renderedNanos = MasterClock::getClockNanos();
+	clockOffsetNanos = 0;
 	QThread::start();
 }
 
 void AudioFileRenderer::stop() {
 	stopProcessing = true;
+	offlineMutex.lock();
+	offlineCondition.wakeAll();
+	offlineMutex.unlock();
 	wait();
 }
 
+MasterClockNanos AudioFileRenderer::startOfflineMode() {
+	QMutexLocker offlineLocker(&offlineMutex);
+	if (!realtimeMode || !isRunning()) return 0;
+	offlineNanos = MasterClock::getClockNanos() + clockOffsetNanos;
+	offlineMode = true;
+	return offlineNanos;
+}
+
+void AudioFileRenderer::advanceOfflineTime(MasterClockNanos nanos) {
+	QMutexLocker offlineLocker(&offlineMutex);
+	if (!offlineMode) return;
+	if (offlineNanos < nanos) offlineNanos = nanos;
+	offlineCondition.wakeAll();
+	const MasterClockNanos maxLagNanos = 2 * MasterClock::NANOS_PER_SECOND * bufferSize / sampleRate;
+	while (!stopProcessing && isRunning() && maxLagNanos < offlineNanos - renderedNanos) {
+		// The timeout guards against the rendering thread quitting on an error.
+		offlineCondition.wait(&offlineMutex, 100);
+	}
+}
+
+void AudioFileRenderer::stopOfflineMode() {
+	QMutexLocker offlineLocker(&offlineMutex);
+	if (!offlineMode) return;
+	offlineMode = false;
+	clockOffsetNanos = offlineNanos - MasterClock::getClockNanos();
+	offlineCondition.wakeAll();
+}
+
+MasterClockNanos AudioFileRenderer::getStreamNanos(MasterClockNanos clockNanos) {
+	QMutexLocker offlineLocker(&offlineMutex);
+	if (offlineMode) return clockNanos == 0 ? offlineNanos : clockNanos;
+	return (clockNanos == 0 ? MasterClock::getClockNanos() : clockNanos) + clockOffsetNanos;
+}
+
+// Returns the number of frames to render in the realtime processing, or 0 after waiting for them to become due.
+uint AudioFileRenderer::waitForRealtimeFrames(MasterClockNanos firstSampleNanos) {
+	QMutexLocker offlineLocker(&offlineMutex);
+	renderedNanos = firstSampleNanos;
+	offlineCondition.wakeAll();
+	MasterClockNanos streamNanos = offlineMode ? offlineNanos : MasterClock::getClockNanos() + clockOffsetNanos;
+	MasterClockNanos dueNanos = streamNanos - firstSampleNanos;
+	if (MasterClock::NANOS_PER_SECOND * bufferSize <= sampleRate * dueNanos) return bufferSize;
+	if (offlineMode) {
+		offlineCondition.wait(&offlineMutex);
+	} else {
+		offlineLocker.unlock();
+		uint frameCount = dueNanos < 0 ? 0 : uint((sampleRate * dueNanos) / MasterClock::NANOS_PER_SECOND);
+		usleep(ulong((MasterClock::MICROS_PER_SECOND * (bufferSize - frameCount)) / sampleRate));
+	}
+	return 0;
+}
+
 inline void AudioFileRenderer::closeAudioRenderer() {
 	if (realtimeMode) {
 		audioRenderer.synthRoute->audioStreamFailed();
@@ -214,11 +538,20 @@ inline void AudioFileRenderer::render(qint16 *buffer, uint length) {
 		audioRenderer.synth->render(buffer, length);
 	}
 }
+
+inline void AudioFileRenderer::render(float *buffer, uint length) {
+	if (realtimeMode) {
+		audioRenderer.synthRoute->render(buffer, length);
+	} else {
+		audioRenderer.synth->render(buffer, length);
+	}
+}
+
 void AudioFileRenderer::run() {
-	AudioFileWriter writer(sampleRate, outFileName);
+	AudioFileWriter writer(sampleRate, outFileName, sampleFormat);
 	if (!writer.open(!realtimeMode)) {
 		closeAudioRenderer();
-		if (!realtimeMode) Master::getInstance()->setAudioFileWriterSynth(NULL);
+		if (!realtimeMode) Master::getInstance()->removeAudioFileWriterSynth(audioRenderer.synth);
 		emit conversionFinished();
 		return;
 	}
@@ -239,13 +572,8 @@ void AudioFileRenderer::run() {
 	while (!stopProcessing) {
 		uint frameCount = 0;
 		if (realtimeMode) {
-			frameCount = uint((sampleRate * (MasterClock::getClockNanos() - firstSampleNanos)) / MasterClock::NANOS_PER_SECOND);
-			if (frameCount < bufferSize) {
-				usleep(ulong((MasterClock::MICROS_PER_SECOND * (bufferSize - frameCount)) / sampleRate));
-				continue;
-			} else {
-				frameCount = bufferSize;
-			}
+			frameCount = waitForRealtimeFrames(firstSampleNanos);
+			if (frameCount == 0) continue;
 		} else {
 			while (midiEventIx < midiEvents.count()) {
 				const QMidiEvent &e = midiEvents.at(midiEventIx);
@@ -262,7 +590,7 @@ void AudioFileRenderer::run() {
 						eventPushed = audioRenderer.synth->playMIDIShortMessage(e.getShortMessage(), nextEventFrames);
 						break;
 					case SYSEX:
-						eventPushed = audioRenderer.synth->playMIDISysex(e.getSysexData(), e.getSysexLen(), nextEventFrames);
+						eventPushed = audioRenderer.synth->playMIDISysex(midiEvents.getSysexData(e), e.getSysexLen(), nextEventFrames);
 						break;
 					case SET_TEMPO:
 						midiTick = parsers[parserIx].getMidiTick(e.getShortMessage());
@@ -293,10 +621,17 @@ void AudioFileRenderer::run() {
 		}
 		while (frameCount > 0) {
 			uint framesToRender = qMin(bufferSize, frameCount);
-			render(buffer, framesToRender);
-			if (!writer.write(buffer, framesToRender)) {
+			bool written;
+			if (floatBuffer != NULL) {
+				render(floatBuffer, framesToRender);
+				written = writer.write(floatBuffer, framesToRender);
+			} else {
+				render(buffer, framesToRender);
+				written = writer.write(buffer, framesToRender);
+			}
+			if (!written) {
 				closeAudioRenderer();
-				if (!realtimeMode) Master::getInstance()->setAudioFileWriterSynth(NULL);
+				if (!realtimeMode) Master::getInstance()->removeAudioFileWriterSynth(audioRenderer.synth);
 				emit conversionFinished();
 				return;
 			}
@@ -309,6 +644,145 @@ void AudioFileRenderer::run() {
 	if (!realtimeMode) qDebug() << "AudioFileRenderer: Elapsed seconds: " << 1e-9 * (MasterClock::getClockNanos() - startNanos);
 	writer.close();
 	closeAudioRenderer();
-	if (!realtimeMode) Master::getInstance()->setAudioFileWriterSynth(NULL);
+	if (!realtimeMode) Master::getInstance()->removeAudioFileWriterSynth(audioRenderer.synth);
 	if (!stopProcessing) emit conversionFinished();
 }
+
+static AudioFileRecorder::OverflowPolicy getConfiguredOverflowPolicy() {
+	const QString policyName = Master::getInstance()->getSettings()->value("Master/audioRecorderOverflowPolicy", "silence").toString();
+	return policyName == "skip" ? AudioFileRecorder::OverflowPolicy_SKIP : AudioFileRecorder::OverflowPolicy_SILENCE;
+}
+
+// The memory budget is given as the duration of the float stream the ring buffer can hold, 16-bit streams fit twice as long.
+static quint32 getRecorderRingBufferSize(uint sampleRate) {
+	const uint bufferMillis = qBound(100U, Master::getInstance()->getSettings()->value("Master/audioRecorderBufferMillis", 5000).toUInt(), 60000U);
+	return quint32(quint64(sampleRate) * bufferMillis / 1000) * FLOAT_FRAME_SIZE;
+}
+
+AudioFileRecorder::AudioFileRecorder(uint useSampleRate, const QString &useFileName) :
+	sampleRate(useSampleRate), fileName(useFileName), floatSampleFormat(AudioFileWriter::getConfiguredSampleFormat()),
+	overflowPolicy(getConfiguredOverflowPolicy()), ringBuffer(new Utility::QRingBuffer(getRecorderRingBufferSize(useSampleRate))),
+	frameSize(0), failed(0), stopRequested(0), pendingSilenceFrames(0), droppedFrameCount(0)
+{
+	start();
+}
+
+AudioFileRecorder::~AudioFileRecorder() {
+	close();
+	delete ringBuffer;
+}
+
+bool AudioFileRecorder::write(const qint16 *buffer, uint frameCount) {
+	return writeFrames(buffer, NULL, frameCount);
+}
+
+bool AudioFileRecorder::write(const float *buffer, uint frameCount) {
+	return writeFrames(buffer, NULL, frameCount);
+}
+
+bool AudioFileRecorder::write(const float *leftBuffer, const float *rightBuffer, uint frameCount) {
+	return writeFrames(leftBuffer, rightBuffer, frameCount);
+}
+
+void AudioFileRecorder::close() {
+	if (isFinished()) return;
+	QAtomicHelper::storeRelease(stopRequested, 1);
+	wait();
+	if (droppedFrameCount > 0) {
+		qDebug() << "AudioFileRecorder: Dropped" << droppedFrameCount << "frames while the file writing lagged behind";
+	}
+}
+
+void AudioFileRecorder::dropFrames(uint frameCount) {
+	droppedFrameCount += frameCount;
+	if (overflowPolicy == OverflowPolicy_SILENCE) pendingSilenceFrames += frameCount;
+}
+
+template <class Sample>
+bool AudioFileRecorder::writeFrames(const Sample *buffer, const float *rightBuffer, uint frameCount) {
+	if (QAtomicHelper::loadRelaxed(failed) != 0) return false;
+	const uint sampleFrameSize = 2 * sizeof(Sample);
+	const uint currentFrameSize = QAtomicHelper::loadRelaxed(frameSize);
+	if (currentFrameSize == 0) {
+		// The ring buffer publishes it to the recorder thread along with the first frames.
+		QAtomicHelper::storeRelease(frameSize, sampleFrameSize);
+	} else if (currentFrameSize != sampleFrameSize) {
+		// The file can't follow a stream that changes the sample format midway.
+		droppedFrameCount += frameCount;
+		return true;
+	}
+	if (pendingSilenceFrames > 0) {
+		pendingSilenceFrames -= pushFrames(NULL, NULL, pendingSilenceFrames, sampleFrameSize);
+		if (pendingSilenceFrames > 0) {
+			dropFrames(frameCount);
+			return true;
+		}
+	}
+	const uint pushedFrameCount = pushFrames(reinterpret_cast<const uchar *>(buffer), rightBuffer, frameCount, sampleFrameSize);
+	if (pushedFrameCount < frameCount) dropFrames(frameCount - pushedFrameCount);
+	return true;
+}
+
+// Copies the interleaved frames or interleaves the planar float ones into the ring buffer as long as there is room.
+// Silence is pushed when the buffer is NULL. Returns the number of frames pushed.
+uint AudioFileRecorder::pushFrames(const uchar *buffer, const float *rightBuffer, uint frameCount, uint useFrameSize) {
+	uint pushedFrameCount = 0;
+	while (pushedFrameCount < frameCount) {
+		quint32 bytesFree;
+		bool freeSpaceContiguous;
+		uchar *target = static_cast<uchar *>(ringBuffer->writePointer(bytesFree, freeSpaceContiguous));
+		const uint framesToPush = qMin(frameCount - pushedFrameCount, uint(bytesFree / useFrameSize));
+		if (framesToPush == 0) break;
+		if (buffer == NULL) {
+			memset(target, 0, framesToPush * useFrameSize);
+		} else if (rightBuffer == NULL) {
+			memcpy(target, buffer + pushedFrameCount * useFrameSize, framesToPush * useFrameSize);
+		} else {
+			const float *left = reinterpret_cast<const float *>(buffer) + pushedFrameCount;
+			const float *right = rightBuffer + pushedFrameCount;
+			float *interleaved = reinterpret_cast<float *>(target);
+			for (uint i = 0; i < framesToPush; i++) {
+				*(interleaved++) = left[i];
+				*(interleaved++) = right[i];
+			}
+		}
+		ringBuffer->advanceWritePointer(framesToPush * useFrameSize);
+		pushedFrameCount += framesToPush;
+	}
+	return pushedFrameCount;
+}
+
+void AudioFileRecorder::fail() {
+	QAtomicHelper::storeRelease(failed, 1);
+	emit recordingFailed();
+}
+
+void AudioFileRecorder::run() {
+	AudioFileWriter *writer = NULL;
+	forever {
+		// Once the stop is requested, nothing is written any more, so the ring buffer only needs draining.
+		const bool stopping = QAtomicHelper::loadAcquire(stopRequested) != 0;
+		quint32 bytesReady;
+		const uchar *data = static_cast<const uchar *>(ringBuffer->readPointer(bytesReady));
+		if (bytesReady == 0) {
+			if (stopping) break;
+			msleep(RECORDER_POLL_MILLIS);
+			continue;
+		}
+		const uint currentFrameSize = QAtomicHelper::loadAcquire(frameSize);
+		const uint frameCount = bytesReady / currentFrameSize;
+		const bool floatFrames = currentFrameSize == FLOAT_FRAME_SIZE;
+		if (writer == NULL) {
+			writer = new AudioFileWriter(sampleRate, fileName, floatFrames ? floatSampleFormat : AudioFileWriter::SampleFormat_S16);
+			if (!writer->open()) fail();
+		}
+		if (QAtomicHelper::loadRelaxed(failed) == 0) {
+			const bool written = floatFrames ? writer->write(reinterpret_cast<const float *>(data), frameCount)
+				: writer->write(reinterpret_cast<const qint16 *>(data), frameCount);
+			if (!written) fail();
+		}
+		ringBuffer->advanceReadPointer(frameCount * currentFrameSize);
+	}
+	// Closes the file unless it has failed already
+	delete writer;
+}
@@ -3,23 +3,99 @@
 
 #include <QtCore>
 
+#include "MasterClock.h"
+
+class FLACEncoder;
+
 class AudioFileWriter {
 public:
+	enum SampleFormat {
+		SampleFormat_S16,
+		SampleFormat_S24,
+		SampleFormat_FLOAT
+	};
+
 	static bool convertSamplesFromNativeEndian(const qint16 *sourceBuffer, qint16 *targetBuffer, uint sampleCount, QSysInfo::Endian targetByteOrder);
+	// Returns the sample format of the audio files configured in the settings, 16-bit by default.
+	static SampleFormat getConfiguredSampleFormat();
 
-	AudioFileWriter(uint sampleRate, const QString &fileName);
+	AudioFileWriter(uint sampleRate, const QString &fileName, SampleFormat sampleFormat = SampleFormat_S16);
 	virtual ~AudioFileWriter();
 
 	bool open(bool skipInitialSilence = true);
+	// Only suitable for SampleFormat_S16.
 	bool write(const qint16 *buffer, uint framesToWrite);
+	// Converts the float samples straight into the sample format of the file, so that the precision of the float renderer is kept.
+	// FLAC files get 24-bit samples instead of float.
+	bool write(const float *buffer, uint framesToWrite);
 	void close();
 
 private:
 	const uint sampleRate;
 	const QString fileName;
+	const SampleFormat sampleFormat;
 	const bool waveMode;
 	QFile file;
 	bool skipSilence;
+	FLACEncoder *flacEncoder;
+};
+
+namespace Utility {
+	class QRingBuffer;
+}
+
+// Records the audio stream rendered in realtime to a file without ever blocking the rendering thread.
+// The rendered blocks are passed through a lock-free ring buffer of bounded size to a dedicated thread that writes them
+// to the file, so that a slow disk holds up neither the rendering nor the MIDI and settings calls that lock the synth.
+// The samples are stored in the format they are rendered in, float streams are written to the file in the configured
+// sample format, while 16-bit streams are always written as 16-bit. When the writer falls behind so that the ring fills up,
+// the frames that don't fit are dropped. Depending on the overflow policy, these are either replaced with silence as soon
+// as there is room again, so that the recording keeps in sync with the session, or skipped.
+class AudioFileRecorder : public QThread {
+	Q_OBJECT
+
+public:
+	enum OverflowPolicy {
+		OverflowPolicy_SILENCE,
+		OverflowPolicy_SKIP
+	};
+
+	// The memory budget and the overflow policy are taken from the settings.
+	AudioFileRecorder(uint sampleRate, const QString &fileName);
+	~AudioFileRecorder();
+
+	// Invoked in the rendering thread, never block. Return false once the recording has failed.
+	bool write(const qint16 *buffer, uint frameCount);
+	bool write(const float *buffer, uint frameCount);
+	bool write(const float *leftBuffer, const float *rightBuffer, uint frameCount);
+
+	// Waits until the frames written so far are stored and closes the file. Must not race with write().
+	void close();
+
+private:
+	const uint sampleRate;
+	const QString fileName;
+	const AudioFileWriter::SampleFormat floatSampleFormat;
+	const OverflowPolicy overflowPolicy;
+	Utility::QRingBuffer * const ringBuffer;
+	// Size of the frames in the ring, set upon the first write and published along with the frames.
+	QAtomicInt frameSize;
+	QAtomicInt failed;
+	QAtomicInt stopRequested;
+
+	// Accessed in the rendering thread only.
+	quint32 pendingSilenceFrames;
+	quint64 droppedFrameCount;
+
+	void dropFrames(uint frameCount);
+	template <class Sample>
+	bool writeFrames(const Sample *buffer, const float *rightBuffer, uint frameCount);
+	uint pushFrames(const uchar *buffer, const float *rightBuffer, uint frameCount, uint useFrameSize);
+	void fail();
+	void run();
+
+signals:
+	void recordingFailed();
 };
 
 class MidiParser;
@@ -33,10 +109,23 @@ public:
 	AudioFileRenderer();
 	~AudioFileRenderer();
 
-	bool convertMIDIFiles(QString useOutFileName, QStringList useMIDIFileNameList, QString synthProfileName, quint32 bufferSize = 65536);
+	// In the preview mode, a deliberately cheap synth pipeline is used, see QSynth::setPreviewMode().
+	bool convertMIDIFiles(QString useOutFileName, QStringList useMIDIFileNameList, QString synthProfileName, bool preview = false, quint32 bufferSize = 65536);
 	void startRealtimeProcessing(SynthRoute *synthRoute, quint32 useSampleRate, QString useOutFileName, quint32 bufferSize);
 	void stop();
 
+	// In the realtime processing, the offline mode lets a MIDI source drive the stream time instead of the MasterClock,
+	// so that the rendering runs as fast as the MIDI data is supplied. Returns the stream time to continue from.
+	MasterClockNanos startOfflineMode();
+	// Lets the rendering proceed up to the specified stream time. Blocks while the rendering lags behind by more than
+	// two buffers, so that the MIDI source doesn't run far ahead.
+	void advanceOfflineTime(MasterClockNanos nanos);
+	// Resumes the realtime processing from the stream time reached in the offline mode.
+	void stopOfflineMode();
+	// Converts the MasterClock time to the stream time, which only differ after the offline mode was used. In the offline mode,
+	// the time is expected to be the stream time already. Zero stands for the current time.
+	MasterClockNanos getStreamNanos(MasterClockNanos clockNanos);
+
 private:
 	union {
 		QSynth *synth;
@@ -45,14 +134,28 @@ private:
 	uint sampleRate;
 	QString outFileName;
 	unsigned int bufferSize;
+	AudioFileWriter::SampleFormat sampleFormat;
 	qint16 *buffer;
+	// Used instead of buffer unless the samples are written in the 16-bit format.
+	float *floatBuffer;
 	MidiParser *parsers;
 	uint parsersCount;
 	bool realtimeMode;
 	volatile bool stopProcessing;
 
+	QMutex offlineMutex;
+	// Wakes up both the rendering thread when the stream time advances and the MIDI source when the rendering proceeds.
+	QWaitCondition offlineCondition;
+	bool offlineMode;
+	MasterClockNanos offlineNanos;
+	MasterClockNanos renderedNanos;
+	MasterClockNanos clockOffsetNanos;
+
 	inline void closeAudioRenderer();
 	inline void render(qint16 *buffer, uint length);
+	inline void render(float *buffer, uint length);
+	void allocateBuffers();
+	uint waitForRealtimeFrames(MasterClockNanos firstSampleNanos);
 	void run();
 
 signals:
@@ -34,9 +34,12 @@ AudioPropertiesDialog::~AudioPropertiesDialog()
 void AudioPropertiesDialog::getData(AudioDriverSettings &driverSettings) {
 	driverSettings.sampleRate = ui->sampleRate->currentText().toUInt();
 	driverSettings.srcQuality = MT32Emu::SamplerateConversionQuality(ui->srcQuality->currentIndex());
+	driverSettings.minimumPhaseSRC = ui->minimumPhaseSRC->isChecked();
+	driverSettings.nativeSampleRate = ui->nativeSampleRate->isChecked();
 	driverSettings.chunkLen = ui->chunkLen->text().toInt();
 	driverSettings.audioLatency = ui->audioLatency->text().toInt();
 	driverSettings.midiLatency = ui->midiLatency->text().toInt();
+	driverSettings.renderAhead = ui->renderAhead->text().toUInt();
 	driverSettings.advancedTiming = ui->advancedTiming->isChecked();
 }
 
@@ -49,9 +52,12 @@ void AudioPropertiesDialog::setData(const AudioDriverSettings &driverSettings) {
 		ui->sampleRate->setCurrentIndex(ix);
 	}
 	ui->srcQuality->setCurrentIndex(driverSettings.srcQuality);
+	ui->minimumPhaseSRC->setChecked(driverSettings.minimumPhaseSRC);
+	ui->nativeSampleRate->setChecked(driverSettings.nativeSampleRate);
 	ui->chunkLen->setText(QString().setNum(driverSettings.chunkLen));
 	ui->audioLatency->setText(QString().setNum(driverSettings.audioLatency));
 	ui->midiLatency->setText(QString().setNum(driverSettings.midiLatency));
+	ui->renderAhead->setText(QString().setNum(driverSettings.renderAhead));
 	ui->advancedTiming->setChecked(driverSettings.advancedTiming);
 }
 
@@ -15,10 +15,108 @@
  */
 
 #include "JACKClient.h"
+#include "Master.h"
+#include "MasterClock.h"
 #include "MidiSession.h"
+#include "QAtomicHelper.h"
 #include "mididrv/JACKMidiDriver.h"
 #include "audiodrv/JACKAudioDriver.h"
 
+static const char CLIENT_NAME[] = "mt32emu-qt";
+
+class JACKRenderWorker : public QThread {
+	JACKClient &jackClient;
+	const ThreadPolicy threadPolicy;
+	// Released once per cycle the worker takes part in, and to stop the worker.
+	QSemaphore cycleStarts;
+	volatile bool stopProcessing;
+
+	void run() {
+		const MasterClockNanos cycleNanos = (jackClient.bufferSize * MasterClock::NANOS_PER_SECOND) / jackClient.getSampleRate();
+		ThreadPolicyScope threadPolicyScope(threadPolicy, "JACKRenderWorker", cycleNanos);
+		forever {
+			cycleStarts.acquire();
+			if (stopProcessing) return;
+			jackClient.processPendingPortSets();
+			jackClient.renderWorkersDone.release();
+		}
+	}
+
+public:
+	JACKRenderWorker(JACKClient &useJACKClient, const ThreadPolicy &useThreadPolicy) :
+		jackClient(useJACKClient),
+		threadPolicy(useThreadPolicy),
+		stopProcessing()
+	{}
+
+	void start() {
+		QThread::start(QThread::TimeCriticalPriority);
+	}
+
+	void stop() {
+		stopProcessing = true;
+		cycleStarts.release();
+		wait();
+	}
+
+	void startCycle() {
+		cycleStarts.release();
+	}
+};
+
+QMutex JACKClient::sharedClientMutex;
+JACKClient *JACKClient::sharedClient = NULL;
+
+JACKClient *JACKClient::addAudioStream(JACKAudioStream *audioStream, MidiSession *midiSession) {
+	QMutexLocker sharedClientLocker(&sharedClientMutex);
+	const bool clientCreated = sharedClient == NULL;
+	if (clientCreated) {
+		// Rendering in parallel only pays off with several synths, whereas waking up the workers adds to the cycle time.
+		bool parallelRendering = Master::getInstance()->getSettings()->value("Audio/jackaudio/ParallelRendering", false).toBool();
+		sharedClient = new JACKClient;
+		// The workers follow the thread policy of the audio driver settings in effect when the client is opened.
+		int renderWorkerCount = parallelRendering ? qMax(0, QThread::idealThreadCount() - 1) : 0;
+		if (!sharedClient->openClient(renderWorkerCount, audioStream->getThreadPolicy())) {
+			delete sharedClient;
+			sharedClient = NULL;
+			return NULL;
+		}
+	}
+	PortSet portSet = { midiSession, audioStream, 0, NULL, NULL, NULL };
+	// The client being shut down is only deleted once all the streams are removed.
+	if (sharedClient->state != JACKClientState_OPEN || !audioStream->checkSampleRate(sharedClient->getSampleRate())
+		|| !sharedClient->addPortSet(portSet))
+	{
+		if (clientCreated) {
+			delete sharedClient;
+			sharedClient = NULL;
+		}
+		return NULL;
+	}
+	return sharedClient;
+}
+
+void JACKClient::removeAudioStream(JACKAudioStream *audioStream) {
+	QMutexLocker sharedClientLocker(&sharedClientMutex);
+	if (sharedClient == NULL) return;
+	if (sharedClient->removePortSet(audioStream)) {
+		qDebug() << "JACKClient: Last audio stream removed, closing shared client";
+		delete sharedClient;
+		sharedClient = NULL;
+	}
+}
+
+quint32 JACKClient::getSystemSampleRate() {
+	QMutexLocker sharedClientLocker(&sharedClientMutex);
+	if (sharedClient != NULL && sharedClient->state == JACKClientState_OPEN) return sharedClient->getSampleRate();
+	// A short-lived client is enough to query the server, which must not be started just for that.
+	jack_client_t *probeClient = jack_client_open(CLIENT_NAME, JackNoStartServer, NULL);
+	if (probeClient == NULL) return 0;
+	quint32 sampleRate = jack_get_sample_rate(probeClient);
+	jack_client_close(probeClient);
+	return sampleRate;
+}
+
 int JACKClient::onJACKProcess(jack_nframes_t nframes, void *instance) {
 	JACKClient *jackClient = static_cast<JACKClient *>(instance);
 	jackClient->process(nframes);
@@ -27,10 +125,17 @@ int JACKClient::onJACKProcess(jack_nframes_t nframes, void *instance) {
 
 int JACKClient::onBufferSizeChange(jack_nframes_t newFrameSize, void *instance) {
 	JACKClient *jackClient = static_cast<JACKClient *>(instance);
-	if (jackClient->audioStream != NULL && jackClient->bufferSize != newFrameSize) {
+	bool streamsNotified = false;
+	if (jackClient->bufferSize != newFrameSize) {
 		jackClient->bufferSize = newFrameSize;
-		jackClient->audioStream->onJACKBufferSizeChange(newFrameSize);
-	} else {
+		QVector<PortSet> portSets = jackClient->getPortSets();
+		for (int i = 0; i < portSets.size(); i++) {
+			if (portSets.at(i).audioStream == NULL) continue;
+			portSets.at(i).audioStream->onJACKBufferSizeChange(newFrameSize);
+			streamsNotified = true;
+		}
+	}
+	if (!streamsNotified) {
 		qDebug() << "JACKClient: Got buffer size change:" << newFrameSize;
 	}
 	return 0;
@@ -44,61 +149,58 @@ int JACKClient::onSampleRateChange(jack_nframes_t newSystemSampleRate, void *) {
 void JACKClient::onJACKShutdown(void *instance) {
 	JACKClient *jackClient = static_cast<JACKClient *>(instance);
 	jackClient->state = JACKClientState_CLOSING;
-	if (jackClient->midiSession != NULL) {
-		// This eventually deletes jackClient
-		Master::getInstance()->deleteJACKMidiPort(jackClient->midiSession);
-	} else if (jackClient->audioStream != NULL) {
-		jackClient->audioStream->onJACKShutdown();
-		jackClient->close();
+	// The notified sessions and streams eventually remove their port sets, which requires the lock.
+	QVector<PortSet> portSets = jackClient->getPortSets();
+	for (int i = 0; i < portSets.size(); i++) {
+		const PortSet &portSet = portSets.at(i);
+		if (portSet.midiSession != NULL) {
+			// This eventually deletes jackClient or removes the audio stream
+			Master::getInstance()->deleteJACKMidiPort(portSet.midiSession);
+		} else if (portSet.audioStream != NULL) {
+			portSet.audioStream->onJACKShutdown();
+		}
 	}
 }
 
 JACKClient::JACKClient() :
 	state(JACKClientState_CLOSED),
 	client(),
-	midiSession(),
-	audioStream(),
-	midiInPort(),
-	leftAudioOutPort(),
-	rightAudioOutPort()
+	bufferSize(),
+	portSets(),
+	processCallbackActive(),
+	nextPortSetIx(),
+	cyclePortSets(),
+	cycleFrameCount()
 {}
 
 JACKClient::~JACKClient() {
 	close();
+	// No more process callbacks, so the workers can't be waited for anymore.
+	stopRenderWorkers();
+	delete QAtomicHelper::loadRelaxed(portSets);
 }
 
-JACKClientState JACKClient::open(MidiSession *useMidiSession, JACKAudioStream *useAudioStream) {
+JACKClientState JACKClient::open(MidiSession *midiSession) {
 	if (state != JACKClientState_CLOSED) return state;
-	client = jack_client_open("mt32emu-qt", JackNullOption, NULL);
-	if (client == NULL) return state;
+	if (!openClient(0, ThreadPolicy())) return state;
+	PortSet portSet = { midiSession, NULL, 0, NULL, NULL, NULL };
+	if (!addPortSet(portSet)) close();
+	return state;
+}
 
-	if (useAudioStream != NULL && !useAudioStream->checkSampleRate(getSampleRate())) {
+JACKClientState JACKClient::close() {
+	if (state == JACKClientState_CLOSED) return state;
+	if (state == JACKClientState_OPEN) {
 		jack_client_close(client);
-		client = NULL;
-		return state;
 	}
+	client = NULL;
+	state = JACKClientState_CLOSED;
+	return state;
+}
 
-	if (useMidiSession != NULL) {
-		midiInPort = jack_port_register(client, "midi_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
-		if (midiInPort == NULL) {
-			jack_client_close(client);
-			client = NULL;
-			return state;
-		}
-		midiSession = useMidiSession;
-		char *actualClientName = jack_get_client_name(client);
-		midiSession->getSynthRoute()->setMidiSessionName(midiSession, midiSession->getName() + " for " + actualClientName);
-	}
-	if (useAudioStream != NULL) {
-		leftAudioOutPort = jack_port_register(client, "left_audio_out", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
-		rightAudioOutPort = jack_port_register(client, "right_audio_out", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
-		if (leftAudioOutPort == NULL || rightAudioOutPort == NULL) {
-			jack_client_close(client);
-			client = NULL;
-			return state;
-		}
-		audioStream = useAudioStream;
-	}
+bool JACKClient::openClient(int renderWorkerCount, const ThreadPolicy &renderWorkerPolicy) {
+	client = jack_client_open(CLIENT_NAME, JackNullOption, NULL);
+	if (client == NULL) return false;
 
 	bufferSize = jack_get_buffer_size(client);
 
@@ -107,33 +209,145 @@ JACKClientState JACKClient::open(MidiSession *useMidiSession, JACKAudioStream *u
 	jack_set_sample_rate_callback(client, onSampleRateChange, this);
 	jack_set_process_callback(client, onJACKProcess, this);
 
+	// The workers are never changed while the client is active.
+	startRenderWorkers(renderWorkerCount, renderWorkerPolicy);
+
 	if (jack_activate(client) != 0) {
 		jack_client_close(client);
 		client = NULL;
-		return state;
+		stopRenderWorkers();
+		return false;
 	}
 
 	state = JACKClientState_OPEN;
-	return state;
+	return true;
 }
 
-JACKClientState JACKClient::close() {
-	if (state == JACKClientState_CLOSED) return state;
-	if (state == JACKClientState_OPEN) {
-		jack_client_close(client);
+// The ports may be registered while the client is active, so that the port sets are added and removed on the fly.
+bool JACKClient::registerPorts(PortSet &portSet) {
+	const QString suffix = portSet.number > 1 ? QString("_%1").arg(portSet.number) : QString();
+	if (portSet.midiSession != NULL) {
+		portSet.midiInPort = jack_port_register(client, QString("midi_in" + suffix).toLatin1().constData(), JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+		if (portSet.midiInPort == NULL) return false;
 	}
-	client = NULL;
-	state = JACKClientState_CLOSED;
-	return state;
+	if (portSet.audioStream != NULL) {
+		portSet.leftAudioOutPort = jack_port_register(client, QString("left_audio_out" + suffix).toLatin1().constData(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+		portSet.rightAudioOutPort = jack_port_register(client, QString("right_audio_out" + suffix).toLatin1().constData(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+		if (portSet.leftAudioOutPort == NULL || portSet.rightAudioOutPort == NULL) {
+			unregisterPorts(portSet);
+			return false;
+		}
+	}
+	if (portSet.midiSession != NULL) {
+		MidiSession *midiSession = portSet.midiSession;
+		midiSession->getSynthRoute()->setMidiSessionName(midiSession, midiSession->getName() + " for " + jack_port_name(portSet.midiInPort));
+	}
+	return true;
+}
+
+void JACKClient::unregisterPorts(PortSet &portSet) {
+	if (state != JACKClientState_OPEN) return;
+	if (portSet.midiInPort != NULL) jack_port_unregister(client, portSet.midiInPort);
+	if (portSet.leftAudioOutPort != NULL) jack_port_unregister(client, portSet.leftAudioOutPort);
+	if (portSet.rightAudioOutPort != NULL) jack_port_unregister(client, portSet.rightAudioOutPort);
+	portSet.midiInPort = NULL;
+	portSet.leftAudioOutPort = NULL;
+	portSet.rightAudioOutPort = NULL;
+}
+
+bool JACKClient::addPortSet(PortSet &portSet) {
+	QMutexLocker portSetsLocker(&portSetsMutex);
+	const PortSetList *currentPortSets = QAtomicHelper::loadRelaxed(portSets);
+	QVector<PortSet> newPortSets;
+	if (currentPortSets != NULL) newPortSets = currentPortSets->portSets;
+	// Reuse the lowest free number, so that the port names stay the same when a synth is reopened.
+	portSet.number = 1;
+	for (int i = 0; i < newPortSets.size(); i++) {
+		if (newPortSets.at(i).number == portSet.number) {
+			portSet.number++;
+			i = -1;
+		}
+	}
+	if (!registerPorts(portSet)) return false;
+	newPortSets.append(portSet);
+	PortSetList *newPortSetList = new PortSetList;
+	newPortSetList->portSets = newPortSets;
+	newPortSetList->portBuffers.resize(newPortSets.size());
+	publishPortSets(newPortSetList);
+	return true;
+}
+
+// Returns true if no port sets are left.
+bool JACKClient::removePortSet(const JACKAudioStream *audioStream) {
+	QMutexLocker portSetsLocker(&portSetsMutex);
+	const PortSetList *currentPortSets = QAtomicHelper::loadRelaxed(portSets);
+	if (currentPortSets == NULL) return true;
+	QVector<PortSet> newPortSets;
+	PortSet removedPortSet = { NULL, NULL, 0, NULL, NULL, NULL };
+	for (int i = 0; i < currentPortSets->portSets.size(); i++) {
+		const PortSet &portSet = currentPortSets->portSets.at(i);
+		if (portSet.audioStream == audioStream) {
+			removedPortSet = portSet;
+		} else {
+			newPortSets.append(portSet);
+		}
+	}
+	if (removedPortSet.audioStream == NULL) return newPortSets.isEmpty();
+	PortSetList *newPortSetList = new PortSetList;
+	newPortSetList->portSets = newPortSets;
+	newPortSetList->portBuffers.resize(newPortSets.size());
+	publishPortSets(newPortSetList);
+	// The process callback no longer refers to the removed ports.
+	unregisterPorts(removedPortSet);
+	return newPortSets.isEmpty();
+}
+
+// Replaces the port sets used by the process callback without blocking it. The callback raises processCallbackActive
+// before it loads the list, so once the flag is seen clear after the store, any further cycle takes the new list.
+void JACKClient::publishPortSets(PortSetList *newPortSets) {
+	PortSetList *oldPortSets = portSets.fetchAndStoreOrdered(newPortSets);
+	while (processCallbackActive.fetchAndAddOrdered(0) != 0) {
+		MasterClock::sleepForNanos(MasterClock::NANOS_PER_MILLISECOND);
+	}
+	delete oldPortSets;
 }
 
-void JACKClient::connectToPhysicalPorts() {
+QVector<JACKClient::PortSet> JACKClient::getPortSets() {
+	QMutexLocker portSetsLocker(&portSetsMutex);
+	const PortSetList *currentPortSets = QAtomicHelper::loadRelaxed(portSets);
+	return currentPortSets == NULL ? QVector<PortSet>() : currentPortSets->portSets;
+}
+
+void JACKClient::startRenderWorkers(int workerCount, const ThreadPolicy &renderWorkerPolicy) {
+	for (int i = 0; i < workerCount; i++) {
+		JACKRenderWorker *renderWorker = new JACKRenderWorker(*this, renderWorkerPolicy);
+		renderWorker->start();
+		renderWorkers.append(renderWorker);
+	}
+	if (workerCount > 0) qDebug() << "JACKClient: Rendering synths in parallel using" << workerCount << "worker threads";
+}
+
+void JACKClient::stopRenderWorkers() {
+	while (!renderWorkers.isEmpty()) {
+		JACKRenderWorker *renderWorker = renderWorkers.takeLast();
+		renderWorker->stop();
+		delete renderWorker;
+	}
+}
+
+void JACKClient::connectToPhysicalPorts(const JACKAudioStream *audioStream) {
+	QVector<PortSet> currentPortSets = getPortSets();
+	const PortSet *portSet = NULL;
+	for (int i = 0; i < currentPortSets.size(); i++) {
+		if (currentPortSets.at(i).audioStream == audioStream) portSet = &currentPortSets.at(i);
+	}
+	if (portSet == NULL) return;
 	const char **ports = jack_get_ports(client, NULL, NULL, JackPortIsPhysical | JackPortIsInput);
 	if (ports == NULL || ports[0] == NULL || ports[1] == NULL) {
 		qDebug() << "JACKClient: No physical playback ports detected, autoconnection failed";
-	} else if (0 != jack_connect(client, jack_port_name(leftAudioOutPort), ports[0])) {
+	} else if (0 != jack_connect(client, jack_port_name(portSet->leftAudioOutPort), ports[0])) {
 		qDebug() << "JACKClient: Autoconnection to port" << ports[0] << "failed";
-	} else if (0 != jack_connect(client, jack_port_name(rightAudioOutPort), ports[1])) {
+	} else if (0 != jack_connect(client, jack_port_name(portSet->rightAudioOutPort), ports[1])) {
 		qDebug() << "JACKClient: Autoconnection to port" << ports[1] << "failed";
 	}
 	jack_free(ports);
@@ -151,12 +365,29 @@ quint32 JACKClient::getFramesSinceCycleStart() const {
 	return jack_frames_since_cycle_start(client);
 }
 
-void JACKClient::process(jack_nframes_t nframes) {
+quint32 JACKClient::getLastFrameTime() const {
+	return jack_last_frame_time(client);
+}
+
+// Invoked in the process callback thread and in the render workers, each port set is processed exactly once per cycle.
+void JACKClient::processPendingPortSets() {
+	const int portSetCount = cyclePortSets->portSets.size();
+	const PortBuffers *portBuffers = cyclePortSets->portBuffers.constData();
+	forever {
+		const int portSetIx = nextPortSetIx.fetchAndAddRelaxed(1);
+		if (portSetCount <= portSetIx) return;
+		processPortSet(cyclePortSets->portSets.at(portSetIx), portBuffers[portSetIx], cycleFrameCount);
+	}
+}
+
+void JACKClient::processPortSet(const PortSet &portSet, const PortBuffers &portBuffers, jack_nframes_t nframes) {
+	MidiSession *midiSession = portSet.midiSession;
+	JACKAudioStream *audioStream = portSet.audioStream;
 	if (midiSession != NULL) {
 		quint32 cycleStartFrameTime = audioStream != NULL ? 0 : jack_last_frame_time(client);
 		jack_time_t jackTimeNow = audioStream != NULL ? 0 : jack_get_time();
 		MasterClockNanos nanosNow = audioStream != NULL ? 0 : MasterClock::getClockNanos();
-		void *midiInBuffer = jack_port_get_buffer(midiInPort, nframes);
+		void *midiInBuffer = portBuffers.midiInBuffer;
 		uint eventCount = uint(jack_midi_get_event_count(midiInBuffer));
 		for (uint eventIx = 0; eventIx < eventCount; eventIx++) {
 			jack_midi_event_t eventData;
@@ -170,14 +401,48 @@ void JACKClient::process(jack_nframes_t nframes) {
 				quint32 eventFrameTime = cycleStartFrameTime + eventData.time;
 				quint64 eventJackTime = jack_frames_to_time(client, eventFrameTime);
 				MasterClockNanos eventNanoTime = JACKMidiDriver::jackFrameTimeToMasterClockNanos(nanosNow, eventJackTime, jackTimeNow);
-				eventConsumed = JACKMidiDriver::pushMIDIMessage(midiSession, eventNanoTime, eventData.size, eventData.buffer);
+				quint64 eventTimestamp;
+				if (midiSession->getSynthRoute()->convertJACKFrameTime(eventFrameTime, eventTimestamp)) {
+					// The synth is driven by this JACK server, so the frame time maps to the timestamp exactly.
+					JACKMidiDriver::recordMIDIMessage(midiSession, eventNanoTime, eventData.size, eventData.buffer);
+					eventConsumed = JACKMidiDriver::playMIDIMessage(midiSession, eventTimestamp, eventData.size, eventData.buffer);
+				} else {
+					eventConsumed = JACKMidiDriver::pushMIDIMessage(midiSession, eventNanoTime, eventData.size, eventData.buffer);
+				}
 			}
 			if (!eventConsumed) break;
 		}
 	}
 	if (audioStream != NULL) {
-		jack_default_audio_sample_t *leftOutBuffer = static_cast<jack_default_audio_sample_t *>(jack_port_get_buffer(leftAudioOutPort, nframes));
-		jack_default_audio_sample_t *rightOutBuffer = static_cast<jack_default_audio_sample_t *>(jack_port_get_buffer(rightAudioOutPort, nframes));
-		audioStream->renderStreams(nframes, leftOutBuffer, rightOutBuffer);
+		audioStream->renderStreams(*this, nframes, portBuffers.leftOutBuffer, portBuffers.rightOutBuffer);
+	}
+}
+
+void JACKClient::process(jack_nframes_t nframes) {
+	processCallbackActive.fetchAndStoreOrdered(1);
+	PortSetList *currentPortSets = QAtomicHelper::loadAcquire(portSets);
+	if (currentPortSets != NULL && !currentPortSets->portSets.isEmpty()) {
+		const int portSetCount = currentPortSets->portSets.size();
+		// The list isn't shared, so the non-const access doesn't detach.
+		PortBuffers *portBuffers = currentPortSets->portBuffers.data();
+		for (int i = 0; i < portSetCount; i++) {
+			const PortSet &portSet = currentPortSets->portSets.at(i);
+			portBuffers[i].midiInBuffer = portSet.midiInPort == NULL ? NULL : jack_port_get_buffer(portSet.midiInPort, nframes);
+			portBuffers[i].leftOutBuffer = portSet.leftAudioOutPort == NULL ? NULL
+				: static_cast<jack_default_audio_sample_t *>(jack_port_get_buffer(portSet.leftAudioOutPort, nframes));
+			portBuffers[i].rightOutBuffer = portSet.rightAudioOutPort == NULL ? NULL
+				: static_cast<jack_default_audio_sample_t *>(jack_port_get_buffer(portSet.rightAudioOutPort, nframes));
+		}
+		cyclePortSets = currentPortSets;
+		cycleFrameCount = nframes;
+		QAtomicHelper::storeRelease(nextPortSetIx, 0);
+		// The semaphores publish the cycle data to the workers. All the synths are rendered before the callback returns.
+		const int workerCount = qMin(renderWorkers.size(), portSetCount - 1);
+		for (int i = 0; i < workerCount; i++) {
+			renderWorkers.at(i)->startCycle();
+		}
+		processPendingPortSets();
+		if (workerCount > 0) renderWorkersDone.acquire(workerCount);
 	}
+	processCallbackActive.fetchAndStoreOrdered(0);
 }
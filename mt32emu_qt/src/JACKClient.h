@@ -6,6 +6,8 @@
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
+#include "ThreadPolicy.h"
+
 enum JACKClientState {
 	JACKClientState_OPEN,
 	JACKClientState_CLOSING,
@@ -14,37 +16,96 @@ enum JACKClientState {
 
 class MidiSession;
 class JACKAudioStream;
+class JACKRenderWorker;
 
 class JACKClient {
+friend class JACKRenderWorker;
+
 public:
+	// Audio streams of all synth routes share a single client, so that they are rendered in one process callback.
+	// Each stream gets a pair of output ports and, when the route is driven by an exclusive MIDI session, a MIDI input port.
+	// The shared client is opened with the first stream and closed once the last stream is removed. Returns NULL on failure.
+	static JACKClient *addAudioStream(JACKAudioStream *audioStream, MidiSession *midiSession);
+	static void removeAudioStream(JACKAudioStream *audioStream);
+	// Returns the sample rate the JACK server runs at, or 0 if the server isn't running.
+	static quint32 getSystemSampleRate();
+
 	JACKClient();
 	virtual ~JACKClient();
 
-	JACKClientState open(MidiSession *midiSession, JACKAudioStream *audioStream);
+	// Opens a dedicated client with a single MIDI input port, used by the JACK MIDI driver.
+	JACKClientState open(MidiSession *midiSession);
 	JACKClientState close();
-	void connectToPhysicalPorts();
+	void connectToPhysicalPorts(const JACKAudioStream *audioStream);
 	bool isRealtimeProcessing() const;
 	quint32 getSampleRate() const;
 	quint32 getFramesSinceCycleStart() const;
+	quint32 getLastFrameTime() const;
 	quint32 getBufferSize() const {
 		return bufferSize;
 	}
 
 private:
+	struct PortSet {
+		MidiSession *midiSession;
+		JACKAudioStream *audioStream;
+		// Starts from 1, the ports of the sets other than the first one have this number appended to the names
+		uint number;
+		jack_port_t *midiInPort;
+		jack_port_t *leftAudioOutPort;
+		jack_port_t *rightAudioOutPort;
+	};
+
+	struct PortBuffers {
+		void *midiInBuffer;
+		jack_default_audio_sample_t *leftOutBuffer;
+		jack_default_audio_sample_t *rightOutBuffer;
+	};
+
+	// The port sets are immutable once published. The port buffers of the current cycle are obtained
+	// in the process callback thread before the rendering is distributed.
+	struct PortSetList {
+		QVector<PortSet> portSets;
+		QVector<PortBuffers> portBuffers;
+	};
+
+	static QMutex sharedClientMutex;
+	static JACKClient *sharedClient;
+
 	JACKClientState state;
 	jack_client_t *client;
-	MidiSession *midiSession;
-	JACKAudioStream *audioStream;
-	jack_port_t *midiInPort;
-	jack_port_t *leftAudioOutPort;
-	jack_port_t *rightAudioOutPort;
 	quint32 bufferSize;
 
+	// The list used by the process callback is replaced as a whole, the previous one is deleted after the callback
+	// no longer refers to it, as indicated by processCallbackActive. Modifications are serialised with portSetsMutex.
+	QAtomicPointer<PortSetList> portSets;
+	QAtomicInt processCallbackActive;
+	QMutex portSetsMutex;
+
+	// Optional pool of threads that render the port sets in parallel with the process callback thread.
+	// In each cycle, the port sets are taken in turn using nextPortSetIx.
+	QList<JACKRenderWorker *> renderWorkers;
+	QSemaphore renderWorkersDone;
+	QAtomicInt nextPortSetIx;
+	PortSetList *cyclePortSets;
+	jack_nframes_t cycleFrameCount;
+
 	static int onJACKProcess(jack_nframes_t nframes, void *instance);
 	static int onBufferSizeChange(jack_nframes_t newFrameSize, void *instance);
 	static int onSampleRateChange(jack_nframes_t newSystemSampleRate, void *instance);
 	static void onJACKShutdown(void *instance);
 
+	bool openClient(int renderWorkerCount, const ThreadPolicy &renderWorkerPolicy);
+	bool registerPorts(PortSet &portSet);
+	void unregisterPorts(PortSet &portSet);
+	bool addPortSet(PortSet &portSet);
+	bool removePortSet(const JACKAudioStream *audioStream);
+	void publishPortSets(PortSetList *newPortSets);
+	QVector<PortSet> getPortSets();
+	void startRenderWorkers(int workerCount, const ThreadPolicy &renderWorkerPolicy);
+	void stopRenderWorkers();
+	void processPendingPortSets();
+	void processPortSet(const PortSet &portSet, const PortBuffers &portBuffers, jack_nframes_t nframes);
 	void process(jack_nframes_t nframes);
 };
 
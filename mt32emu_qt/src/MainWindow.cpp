@@ -47,6 +47,8 @@ MainWindow::MainWindow(Master *master, QWidget *parent) :
 	ui(new Ui::MainWindow),
 	master(master),
 	testMidiDriver(NULL),
+	latencyTestMidiDriver(NULL),
+	loadTestMidiDriver(NULL),
 	audioFileWriter(NULL),
 	midiPlayerDialog(NULL),
 	midiConverterDialog(NULL)
@@ -108,6 +110,14 @@ void MainWindow::on_actionExit_triggered() {
 		delete testMidiDriver;
 		testMidiDriver = NULL;
 	}
+	if (latencyTestMidiDriver != NULL) {
+		delete latencyTestMidiDriver;
+		latencyTestMidiDriver = NULL;
+	}
+	if (loadTestMidiDriver != NULL) {
+		delete loadTestMidiDriver;
+		loadTestMidiDriver = NULL;
+	}
 	if (audioFileWriter != NULL) {
 		delete audioFileWriter;
 		audioFileWriter = NULL;
@@ -205,6 +215,36 @@ void MainWindow::on_actionTest_MIDI_Driver_toggled(bool checked) {
 	}
 }
 
+// The results are printed to the debug output.
+void MainWindow::on_actionMeasure_MIDI_latency_toggled(bool checked) {
+	bool running = latencyTestMidiDriver != NULL;
+	if (running != checked) {
+		if (running) {
+			latencyTestMidiDriver->stop();
+			delete latencyTestMidiDriver;
+			latencyTestMidiDriver = NULL;
+		} else {
+			latencyTestMidiDriver = new TestMidiDriver(master, TestMidiDriver::TestMode_LATENCY);
+			latencyTestMidiDriver->start();
+		}
+	}
+}
+
+// The profiles are configured in the settings file, the results are printed to the debug output.
+void MainWindow::on_actionGenerate_MIDI_load_toggled(bool checked) {
+	bool running = loadTestMidiDriver != NULL;
+	if (running != checked) {
+		if (running) {
+			loadTestMidiDriver->stop();
+			delete loadTestMidiDriver;
+			loadTestMidiDriver = NULL;
+		} else {
+			loadTestMidiDriver = new TestMidiDriver(master, TestMidiDriver::TestMode_LOAD);
+			loadTestMidiDriver->start();
+		}
+	}
+}
+
 void MainWindow::on_actionPlay_MIDI_file_triggered() {
 	if (midiPlayerDialog == NULL) {
 		midiPlayerDialog = new MidiPlayerDialog(master, this);
@@ -34,6 +34,8 @@ private:
 	Ui::MainWindow *ui;
 	Master *master;
 	MidiDriver *testMidiDriver;
+	MidiDriver *latencyTestMidiDriver;
+	MidiDriver *loadTestMidiDriver;
 	AudioFileWriter *audioFileWriter;
 	MidiPlayerDialog *midiPlayerDialog;
 	MidiConverterDialog *midiConverterDialog;
@@ -50,6 +52,8 @@ private slots:
 	void on_menuMIDI_aboutToShow();
 	void on_actionNew_MIDI_port_triggered();
 	void on_actionTest_MIDI_Driver_toggled(bool checked);
+	void on_actionMeasure_MIDI_latency_toggled(bool checked);
+	void on_actionGenerate_MIDI_load_toggled(bool checked);
 	void on_actionPlay_MIDI_file_triggered();
 	void on_actionConvert_MIDI_to_Wave_triggered();
 	void on_menuOptions_aboutToShow();
@@ -17,6 +17,7 @@
 #include <QSystemTrayIcon>
 #include <QDropEvent>
 #include <QMessageBox>
+#include <QTimer>
 
 #include "Master.h"
 #include "MasterClock.h"
@@ -25,6 +26,9 @@
 #ifdef WITH_WINMM_AUDIO_DRIVER
 #include "audiodrv/WinMMAudioDriver.h"
 #endif
+#ifdef WITH_WASAPI_AUDIO_DRIVER
+#include "audiodrv/WASAPIAudioDriver.h"
+#endif
 #ifdef WITH_COREAUDIO_DRIVER
 #include "audiodrv/CoreAudioDriver.h"
 #endif
@@ -46,6 +50,9 @@
 #ifdef WITH_QT_AUDIO_DRIVER
 #include "audiodrv/QtAudioDriver.h"
 #endif
+#ifdef WITH_SHM_AUDIO_DRIVER
+#include "audiodrv/SharedMemoryAudioDriver.h"
+#endif
 
 #include "audiodrv/AudioFileWriterDriver.h"
 
@@ -63,10 +70,28 @@
 #include "mididrv/JACKMidiDriver.h"
 #endif
 
+#ifdef WITH_RTP_MIDI_DRIVER
+#include "mididrv/RTPMidiDriver.h"
+#endif
+
 static const int ACTUAL_SETTINGS_VERSION = 2;
 
 static Master *instance = NULL;
 
+// Enumerates the devices of an audio driver in a worker thread, as some drivers block for long while probing for a sound server.
+class AudioDeviceProbe : public QThread {
+public:
+	AudioDriver * const audioDriver;
+	QList<const AudioDevice *> audioDevices;
+
+	explicit AudioDeviceProbe(AudioDriver *useAudioDriver) : audioDriver(useAudioDriver) {}
+
+private:
+	void run() {
+		audioDevices = audioDriver->createDeviceList();
+	}
+};
+
 static void migrateSettings(QSettings &settings, const int fromVersion) {
 	qDebug() << "Migrating settings from version" << fromVersion << "to version" << ACTUAL_SETTINGS_VERSION;
 	switch (fromVersion) {
@@ -110,10 +135,11 @@ Master::Master() {
 
 	initAudioDrivers();
 	initMidiDrivers();
+	// The audio devices are only enumerated once needed, starting with the default device, see findDefaultAudioDevice().
 	lastAudioDeviceScan = -4 * MasterClock::NANOS_PER_SECOND;
-	getAudioDevices();
+	audioDevicesScanned = false;
 	pinnedSynthRoute = NULL;
-	audioFileWriterSynth = NULL;
+	spareSynthRouteCount = settings->value("Master/SpareSynthRoutes", 0).toUInt();
 
 	qRegisterMetaType<MidiDriver *>("MidiDriver*");
 	qRegisterMetaType<MidiSession *>("MidiSession*");
@@ -138,11 +164,18 @@ Master::~Master() {
 	jackMidiDriver = NULL;
 #endif
 
+#ifdef WITH_RTP_MIDI_DRIVER
+	rtpMidiDriver->stop();
+	delete rtpMidiDriver;
+	rtpMidiDriver = NULL;
+#endif
+
 	QMutableListIterator<SynthRoute *> synthRouteIt(synthRoutes);
 	while (synthRouteIt.hasNext()) {
 		delete synthRouteIt.next();
 		synthRouteIt.remove();
 	}
+	dropSpareSynthRoutes();
 
 	QMutableListIterator<const AudioDevice *> audioDeviceIt(audioDevices);
 	while (audioDeviceIt.hasNext()) {
@@ -163,6 +196,9 @@ void Master::initAudioDrivers() {
 #ifdef WITH_WINMM_AUDIO_DRIVER
 	audioDrivers.append(new WinMMAudioDriver(this));
 #endif
+#ifdef WITH_WASAPI_AUDIO_DRIVER
+	audioDrivers.append(new WASAPIAudioDriver(this));
+#endif
 #ifdef WITH_COREAUDIO_DRIVER
 	audioDrivers.append(new CoreAudioDriver(this));
 #endif
@@ -183,6 +219,9 @@ void Master::initAudioDrivers() {
 #endif
 #ifdef WITH_QT_AUDIO_DRIVER
 	audioDrivers.append(new QtAudioDriver(this));
+#endif
+#ifdef WITH_SHM_AUDIO_DRIVER
+	audioDrivers.append(new SharedMemoryAudioDriver(this));
 #endif
 	audioDrivers.append(new AudioFileWriterDriver(this));
 }
@@ -201,6 +240,10 @@ void Master::initMidiDrivers() {
 #ifdef WITH_JACK_MIDI_DRIVER
 	jackMidiDriver = new JACKMidiDriver(this);
 #endif
+
+#ifdef WITH_RTP_MIDI_DRIVER
+	rtpMidiDriver = new RTPMidiDriver(this);
+#endif
 }
 
 void Master::startMidiProcessing() {
@@ -211,6 +254,11 @@ void Master::startMidiProcessing() {
 #ifdef WITH_JACK_MIDI_DRIVER
 	jackMidiDriver->start();
 #endif
+
+#ifdef WITH_RTP_MIDI_DRIVER
+	rtpMidiDriver->start();
+#endif
+	scheduleSpareSynthRoutesRefill();
 }
 
 Master *Master::getInstance() {
@@ -303,13 +351,26 @@ const QList<const AudioDevice *> Master::getAudioDevices() {
 	MasterClockNanos nanosNow = MasterClock::getClockNanos();
 	if ((nanosNow - lastAudioDeviceScan) > 3 * MasterClock::NANOS_PER_SECOND) {
 		lastAudioDeviceScan = nanosNow;
+		audioDevicesScanned = true;
 		qDebug() << "Scanning audio devices ...";
 		audioDevices.clear();
+		// The drivers are probed concurrently, so the scan takes as long as the slowest driver rather than all of them.
+		QList<AudioDeviceProbe *> probes;
 		QListIterator<AudioDriver *> audioDriverIt(audioDrivers);
 		while(audioDriverIt.hasNext()) {
-			AudioDriver *audioDriver = audioDriverIt.next();
-			audioDevices.append(audioDriver->createDeviceList());
+			AudioDeviceProbe *probe = new AudioDeviceProbe(audioDriverIt.next());
+			probe->start();
+			probes.append(probe);
+		}
+		QListIterator<AudioDeviceProbe *> probeIt(probes);
+		while(probeIt.hasNext()) {
+			AudioDeviceProbe *probe = probeIt.next();
+			probe->wait();
+			audioDevices.append(probe->audioDevices);
+			delete probe;
 		}
+		MasterClockNanos scanNanos = MasterClock::getClockNanos() - nanosNow;
+		qDebug() << "Found" << audioDevices.size() << "audio devices in" << scanNanos / MasterClock::NANOS_PER_MILLISECOND << "ms";
 	}
 	return audioDevices;
 }
@@ -325,6 +386,33 @@ const AudioDevice *Master::findAudioDevice(QString driverId, QString name) const
 	return audioDevices.first();
 }
 
+// Before the audio devices are scanned, only the driver of the last used device is probed, so that the first synth route
+// starts without waiting for the other drivers. Returns NULL if there are no audio devices at all.
+const AudioDevice *Master::findDefaultAudioDevice() {
+	if (!audioDevicesScanned) {
+		QListIterator<AudioDriver *> audioDriverIt(audioDrivers);
+		while(audioDriverIt.hasNext()) {
+			AudioDriver *audioDriver = audioDriverIt.next();
+			if (audioDriver->id != defaultAudioDriverId) continue;
+			const QList<const AudioDevice *> driverAudioDevices = audioDriver->createDeviceList();
+			QListIterator<const AudioDevice *> audioDeviceIt(driverAudioDevices);
+			while(audioDeviceIt.hasNext()) {
+				const AudioDevice *audioDevice = audioDeviceIt.next();
+				if (audioDevice->name == defaultAudioDeviceName) {
+					// Kept until the full scan replaces them, like the devices of any previous scan.
+					audioDevices = driverAudioDevices;
+					return audioDevice;
+				}
+			}
+			qDeleteAll(driverAudioDevices);
+			break;
+		}
+	}
+	getAudioDevices();
+	if (audioDevices.isEmpty()) return NULL;
+	return findAudioDevice(defaultAudioDriverId, defaultAudioDeviceName);
+}
+
 QSettings *Master::getSettings() const {
 	return settings;
 }
@@ -336,8 +424,10 @@ QString Master::getDefaultSynthProfileName() {
 bool Master::setDefaultSynthProfileName(QString name) {
 	const QStringList profiles = enumSynthProfiles();
 	if (profiles.contains(name, Qt::CaseInsensitive)) {
+		if (synthProfileName != name) dropSpareSynthRoutes();
 		synthProfileName = name;
 		settings->setValue("Master/defaultSynthProfile", synthProfileName);
+		scheduleSpareSynthRoutesRefill();
 		return true;
 	}
 	return false;
@@ -357,12 +447,14 @@ const QString Master::getROMPathName(const QDir &romDir, QString romFileName) {
 
 void Master::findROMImages(const SynthProfile &synthProfile, const MT32Emu::ROMImage *&controlROMImage, const MT32Emu::ROMImage *&pcmROMImage) const {
 	if (controlROMImage != NULL && pcmROMImage != NULL) return;
+	QMutexLocker romImagesLocker(&romImagesMutex);
 	const MT32Emu::ROMImage *synthControlROMImage = NULL;
 	const MT32Emu::ROMImage *synthPCMROMImage = NULL;
-	if (audioFileWriterSynth != NULL) {
-		audioFileWriterSynth->getROMImages(controlROMImage, pcmROMImage);
+	foreach (const QSynth *qSynth, audioFileWriterSynths) {
+		if (controlROMImage != NULL && pcmROMImage != NULL) return;
+		qSynth->getROMImages(synthControlROMImage, synthPCMROMImage);
 		if (controlROMImage == NULL) controlROMImage = synthControlROMImage;
-		if (pcmROMImage == NULL) controlROMImage = synthPCMROMImage;
+		if (pcmROMImage == NULL) pcmROMImage = synthPCMROMImage;
 	}
 	foreach (SynthRoute *synthRoute, synthRoutes) {
 		if (controlROMImage != NULL && pcmROMImage != NULL) return;
@@ -375,14 +467,21 @@ void Master::findROMImages(const SynthProfile &synthProfile, const MT32Emu::ROMI
 	}
 }
 
-void Master::freeROMImages(const MT32Emu::ROMImage *&controlROMImage, const MT32Emu::ROMImage *&pcmROMImage) const {
+void Master::freeROMImages(const MT32Emu::ROMImage *&ownedControlROMImage, const MT32Emu::ROMImage *&ownedPCMROMImage) const {
+	QMutexLocker romImagesLocker(&romImagesMutex);
+	// The images are detached while locked, so that the synths closed concurrently never free them twice.
+	const MT32Emu::ROMImage *controlROMImage = ownedControlROMImage;
+	ownedControlROMImage = NULL;
+	const MT32Emu::ROMImage *pcmROMImage = ownedPCMROMImage;
+	ownedPCMROMImage = NULL;
 	if (controlROMImage == NULL && pcmROMImage == NULL) return;
 	bool controlROMInUse = false;
 	bool pcmROMInUse = false;
 	const MT32Emu::ROMImage *synthControlROMImage = NULL;
 	const MT32Emu::ROMImage *synthPCMROMImage = NULL;
-	if (audioFileWriterSynth != NULL) {
-		audioFileWriterSynth->getROMImages(synthControlROMImage, synthPCMROMImage);
+	foreach (const QSynth *qSynth, audioFileWriterSynths) {
+		if (controlROMInUse && pcmROMInUse) break;
+		qSynth->getROMImages(synthControlROMImage, synthPCMROMImage);
 		controlROMInUse = controlROMInUse || (synthControlROMImage == controlROMImage);
 		pcmROMInUse = pcmROMInUse || (synthPCMROMImage == pcmROMImage);
 	}
@@ -461,8 +560,12 @@ void Master::loadSynthProfile(SynthProfile &synthProfile, QString name) {
 	settings->endGroup();
 }
 
-void Master::storeSynthProfile(const SynthProfile &synthProfile, QString name) const {
+void Master::storeSynthProfile(const SynthProfile &synthProfile, QString name) {
 	if (name.isEmpty()) name = synthProfileName;
+	if (name == synthProfileName) {
+		dropSpareSynthRoutes();
+		scheduleSpareSynthRoutesRefill();
+	}
 	settings->beginGroup("Profiles/" + name);
 	settings->setValue("romDir", synthProfile.romDir.absolutePath());
 	settings->setValue("controlROM", synthProfile.controlROMFileName);
@@ -506,20 +609,47 @@ void Master::startPinnedSynthRoute() {
 SynthRoute *Master::startSynthRoute() {
 	SynthRoute *synthRoute = pinnedSynthRoute;
 	if (synthRoute == NULL) {
-		synthRoute = new SynthRoute(this);
-		const AudioDevice *audioDevice = NULL;
-		getAudioDevices();
-		if (!audioDevices.isEmpty()) {
-			audioDevice = findAudioDevice(defaultAudioDriverId, defaultAudioDeviceName);
+		synthRoute = spareSynthRoutes.isEmpty() ? new SynthRoute(this) : spareSynthRoutes.takeFirst();
+		const AudioDevice *audioDevice = findDefaultAudioDevice();
+		if (audioDevice != NULL) {
 			synthRoute->setAudioDevice(audioDevice);
 			synthRoute->open();
 			synthRoutes.append(synthRoute);
 			emit synthRouteAdded(synthRoute, audioDevice, true);
 		}
+		scheduleSpareSynthRoutesRefill();
 	}
 	return synthRoute;
 }
 
+// The pool is refilled from the event loop, one synth at a time, so that the route just taken is served first.
+void Master::scheduleSpareSynthRoutesRefill() {
+	if (uint(spareSynthRoutes.size()) < spareSynthRouteCount) QTimer::singleShot(0, this, SLOT(refillSpareSynthRoutes()));
+}
+
+void Master::refillSpareSynthRoutes() {
+	if (uint(spareSynthRoutes.size()) >= spareSynthRouteCount) return;
+	const AudioDevice *audioDevice = findDefaultAudioDevice();
+	if (audioDevice == NULL) return;
+	SynthRoute *synthRoute = new SynthRoute(this);
+	synthRoute->setAudioDevice(audioDevice);
+	if (!synthRoute->preopen()) {
+		qDebug() << "Master: Failed to open a spare synth";
+		delete synthRoute;
+		return;
+	}
+	spareSynthRoutes.append(synthRoute);
+	qDebug() << "Master: Spare synths ready:" << spareSynthRoutes.size();
+	scheduleSpareSynthRoutesRefill();
+}
+
+// The spare synths are opened with the settings of the default profile, so they are dropped once these change.
+void Master::dropSpareSynthRoutes() {
+	while (!spareSynthRoutes.isEmpty()) {
+		delete spareSynthRoutes.takeLast();
+	}
+}
+
 QSystemTrayIcon *Master::getTrayIcon() const {
 	return trayIcon;
 }
@@ -607,8 +737,14 @@ void Master::setMidiPortProperties(MidiPropertiesDialog *mpd, MidiSession *midiS
 
 // A quick hack to prevent ROMImages used in SMF converter from being freed
 // when closing another synth which uses the same ROMImages
-void Master::setAudioFileWriterSynth(const QSynth *qSynth) {
-	audioFileWriterSynth = qSynth;
+void Master::addAudioFileWriterSynth(const QSynth *qSynth) {
+	QMutexLocker romImagesLocker(&romImagesMutex);
+	audioFileWriterSynths.append(qSynth);
+}
+
+void Master::removeAudioFileWriterSynth(const QSynth *qSynth) {
+	QMutexLocker romImagesLocker(&romImagesMutex);
+	audioFileWriterSynths.removeOne(qSynth);
 }
 
 void Master::isSupportedDropEvent(QDropEvent *e) {
@@ -2,6 +2,7 @@
 #define MASTER_H
 
 #include <QObject>
+#include <QMutex>
 
 #include "SynthRoute.h"
 
@@ -23,7 +24,13 @@ private:
 	QList<const AudioDevice *> audioDevices;
 	MidiDriver *midiDriver;
 	SynthRoute *pinnedSynthRoute;
-	const QSynth *audioFileWriterSynth;
+	// Routes with the synth opened in advance using the default profile and audio device. New routes are taken from here,
+	// so that they only need to start the audio stream. Only configurable in the settings file, 0 disables the pool.
+	QList<SynthRoute *> spareSynthRoutes;
+	uint spareSynthRouteCount;
+	QList<const QSynth *> audioFileWriterSynths;
+	// Guards the ROM images sharing, as the converter synths are closed in their rendering threads.
+	mutable QMutex romImagesMutex;
 
 	QSettings *settings;
 	QString synthProfileName;
@@ -31,6 +38,7 @@ private:
 	QString defaultAudioDriverId;
 	QString defaultAudioDeviceName;
 	qint64 lastAudioDeviceScan;
+	bool audioDevicesScanned;
 
 	unsigned int maxSessions;
 
@@ -41,7 +49,10 @@ private:
 	void initAudioDrivers();
 	void initMidiDrivers();
 	const AudioDevice *findAudioDevice(QString driverId, QString name) const;
+	const AudioDevice *findDefaultAudioDevice();
 	SynthRoute *startSynthRoute();
+	void scheduleSpareSynthRoutesRefill();
+	void dropSpareSynthRoutes();
 
 public:
 	static Master *getInstance();
@@ -58,8 +69,9 @@ public:
 	bool setDefaultSynthProfileName(QString name);
 	const QStringList enumSynthProfiles() const;
 	void loadSynthProfile(SynthProfile &synthProfile, QString name);
-	void storeSynthProfile(const SynthProfile &synthProfile, QString name) const;
+	void storeSynthProfile(const SynthProfile &synthProfile, QString name);
 	void findROMImages(const SynthProfile &synthProfile, const MT32Emu::ROMImage *&controlROMImage, const MT32Emu::ROMImage *&pcmROMImage) const;
+	// Detaches the ROM images from the owner and frees those no other synth uses.
 	void freeROMImages(const MT32Emu::ROMImage *&controlROMImage, const MT32Emu::ROMImage *&pcmROMImage) const;
 	bool handleROMSLoadFailed(QString usedSynthProfileName);
 	QSystemTrayIcon *getTrayIcon() const;
@@ -76,13 +88,15 @@ public:
 	void deleteMidiPort(MidiSession *midiSession);
 	void setMidiPortProperties(MidiPropertiesDialog *mpd, MidiSession *midiSession);
 	QString getDefaultROMSearchPath();
-	void setAudioFileWriterSynth(const QSynth *);
+	void addAudioFileWriterSynth(const QSynth *);
+	void removeAudioFileWriterSynth(const QSynth *);
 
 private slots:
 	void createMidiSession(MidiSession **returnVal, MidiDriver *midiDriver, QString name);
 	void deleteMidiSession(MidiSession *midiSession);
 	void showBalloon(const QString &title, const QString &text);
 	void updateMainWindowTitleContribution(const QString &titleContribution);
+	void refillSpareSynthRoutes();
 
 signals:
 	void synthRouteAdded(SynthRoute *route, const AudioDevice *audioDevice, bool pinnable);
@@ -95,6 +109,11 @@ signals:
 	void mainWindowTitleUpdated(const QString &);
 	void maxSessionsFinished();
 
+#ifdef WITH_RTP_MIDI_DRIVER
+private:
+	MidiDriver *rtpMidiDriver;
+#endif
+
 #ifdef WITH_JACK_MIDI_DRIVER
 private:
 	MidiDriver *jackMidiDriver;
@@ -24,6 +24,13 @@
 #include <time.h>
 #include <cerrno>
 
+#if defined __GNUC__ && (defined __i386__ || defined __x86_64__)
+#define WITH_TSC_CLOCK
+#include <cpuid.h>
+#include <x86intrin.h>
+#include <QFile>
+#endif
+
 #endif
 
 #include <QtGlobal>
@@ -58,7 +65,7 @@ void MasterClock::sleepUntilClockNanos(MasterClockNanos clockNanos) {
 	}
 }
 
-MasterClockNanos MasterClock::getClockNanos() {
+static MasterClockNanos getMonotonicClockNanos() {
 	timespec ts;
 	ts.tv_sec = 0;
 	ts.tv_nsec = 0;
@@ -70,6 +77,145 @@ MasterClockNanos MasterClock::getClockNanos() {
 	return timespecToNanos(ts);
 }
 
+#ifdef WITH_TSC_CLOCK
+
+// Where reading the monotonic clock involves a syscall (e.g. on some VMs), the TSC is read instead and converted
+// to the monotonic clock time linearly. The conversion is recalibrated against the monotonic clock periodically,
+// so that the drift doesn't accumulate. The error found is slewed away over the next period rather than stepped,
+// so the time reported stays monotonic.
+struct TSCConversion {
+	quint64 baseTSC;
+	MasterClockNanos baseNanos;
+	double nanosPerTick;
+	// Once the TSC advances by this many ticks past the base, the conversion is recalibrated.
+	quint64 recalibrationTicks;
+};
+
+static const MasterClockNanos TSC_RECALIBRATION_PERIOD_NANOS = MasterClock::NANOS_PER_SECOND;
+static const MasterClockNanos TSC_CALIBRATION_NANOS = 20 * MasterClock::NANOS_PER_MILLISECOND;
+// The rate of the clock never deviates from the measured TSC frequency by more than this fraction while slewing.
+static const double TSC_MAX_SLEW_RATE = 0.01;
+// A larger discrepancy means the TSC can't be trusted, e.g. it was reset while the system was suspended.
+static const MasterClockNanos TSC_MAX_ERROR_NANOS = 50 * MasterClock::NANOS_PER_MILLISECOND;
+
+static bool tscClockEnabled;
+// Guards tscConversion in the manner of a seqlock: odd values indicate that the conversion is being updated.
+static quint32 tscConversionSequence;
+static TSCConversion tscConversion;
+// Only accessed by the thread that recalibrates the conversion.
+static bool tscRecalibrating;
+static quint64 tscReferenceTicks;
+static MasterClockNanos tscReferenceNanos;
+
+// Samples the TSC along with the monotonic clock, retrying when the thread is likely preempted in between.
+static void sampleTSC(quint64 &tsc, MasterClockNanos &nanos) {
+	quint64 bestWindow = ~quint64(0);
+	tsc = 0;
+	nanos = 0;
+	for (int attempt = 0; attempt < 5; attempt++) {
+		quint64 startTSC = __rdtsc();
+		MasterClockNanos sampleNanos = getMonotonicClockNanos();
+		quint64 window = __rdtsc() - startTSC;
+		if (window < bestWindow) {
+			bestWindow = window;
+			tsc = startTSC + window / 2;
+			nanos = sampleNanos;
+		}
+	}
+}
+
+static bool isTSCSafe() {
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007) return false;
+	__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	if ((edx & (1 << 8)) == 0) {
+		qDebug() << "MasterClock: TSC isn't invariant";
+		return false;
+	}
+	// The kernel withdraws the TSC from the clock sources once it finds it unstable or not synchronised between CPUs.
+	QFile clockSourcesFile("/sys/devices/system/clocksource/clocksource0/available_clocksource");
+	if (!clockSourcesFile.open(QIODevice::ReadOnly)) return false;
+	if (!clockSourcesFile.readAll().simplified().split(' ').contains("tsc")) {
+		qDebug() << "MasterClock: TSC isn't considered a reliable clock source by the kernel";
+		return false;
+	}
+	return true;
+}
+
+static void publishTSCConversion(const TSCConversion &conversion) {
+	__atomic_fetch_add(&tscConversionSequence, 1, __ATOMIC_ACQ_REL);
+	tscConversion = conversion;
+	__atomic_fetch_add(&tscConversionSequence, 1, __ATOMIC_RELEASE);
+}
+
+static void initTSCClock() {
+	if (!isTSCSafe()) return;
+	sampleTSC(tscReferenceTicks, tscReferenceNanos);
+	MasterClock::sleepForNanos(TSC_CALIBRATION_NANOS);
+	TSCConversion conversion;
+	sampleTSC(conversion.baseTSC, conversion.baseNanos);
+	if (conversion.baseTSC <= tscReferenceTicks || conversion.baseNanos <= tscReferenceNanos) return;
+	conversion.nanosPerTick = double(conversion.baseNanos - tscReferenceNanos) / double(conversion.baseTSC - tscReferenceTicks);
+	conversion.recalibrationTicks = quint64(TSC_RECALIBRATION_PERIOD_NANOS / conversion.nanosPerTick);
+	publishTSCConversion(conversion);
+	tscClockEnabled = true;
+	qDebug() << "MasterClock: Using TSC calibrated against POSIX monotonic clock. Found TSC frequency:" << 1e3 / conversion.nanosPerTick << "MHz";
+}
+
+// Invoked by the thread that finds the conversion due for recalibration, returns the current time.
+static MasterClockNanos recalibrateTSCClock(const TSCConversion &oldConversion) {
+	quint64 tsc;
+	MasterClockNanos monotonicNanos;
+	sampleTSC(tsc, monotonicNanos);
+	MasterClockNanos nanos = oldConversion.baseNanos + MasterClockNanos(qint64(tsc - oldConversion.baseTSC) * oldConversion.nanosPerTick);
+	MasterClockNanos error = monotonicNanos - nanos;
+	if (tsc < oldConversion.baseTSC || qAbs(error) > TSC_MAX_ERROR_NANOS) {
+		qDebug() << "MasterClock: TSC diverged from POSIX monotonic clock by" << error << "nanos, falling back to the latter";
+		__atomic_store_n(&tscClockEnabled, false, __ATOMIC_RELAXED);
+		return monotonicNanos;
+	}
+	double measuredNanosPerTick = double(monotonicNanos - tscReferenceNanos) / double(tsc - tscReferenceTicks);
+	double slewRate = qBound(-TSC_MAX_SLEW_RATE, double(error) / TSC_RECALIBRATION_PERIOD_NANOS, TSC_MAX_SLEW_RATE);
+	TSCConversion conversion;
+	conversion.baseTSC = tsc;
+	conversion.baseNanos = nanos;
+	conversion.nanosPerTick = measuredNanosPerTick * (1.0 + slewRate);
+	conversion.recalibrationTicks = quint64(TSC_RECALIBRATION_PERIOD_NANOS / measuredNanosPerTick);
+	publishTSCConversion(conversion);
+	return nanos;
+}
+
+static MasterClockNanos getTSCClockNanos() {
+	forever {
+		quint32 sequence = __atomic_load_n(&tscConversionSequence, __ATOMIC_ACQUIRE);
+		if ((sequence & 1) != 0) continue;
+		const TSCConversion conversion = tscConversion;
+		quint64 tsc = __rdtsc();
+		// The fence prevents the copying from being reordered past the sequence check.
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&tscConversionSequence, __ATOMIC_RELAXED) != sequence) continue;
+		quint64 elapsedTicks = tsc - conversion.baseTSC;
+		if (elapsedTicks >= conversion.recalibrationTicks && !__atomic_exchange_n(&tscRecalibrating, true, __ATOMIC_ACQUIRE)) {
+			MasterClockNanos nanos = recalibrateTSCClock(conversion);
+			__atomic_store_n(&tscRecalibrating, false, __ATOMIC_RELEASE);
+			return nanos;
+		}
+		// While another thread is recalibrating, the old conversion is still good. The TSC of this CPU may however lag
+		// behind the base slightly, which is clamped.
+		if (qint64(elapsedTicks) < 0) return conversion.baseNanos;
+		return conversion.baseNanos + MasterClockNanos(elapsedTicks * conversion.nanosPerTick);
+	}
+}
+
+#endif // WITH_TSC_CLOCK
+
+MasterClockNanos MasterClock::getClockNanos() {
+#ifdef WITH_TSC_CLOCK
+	if (__atomic_load_n(&tscClockEnabled, __ATOMIC_RELAXED)) return getTSCClockNanos();
+#endif
+	return getMonotonicClockNanos();
+}
+
 void MasterClock::init() {
 	timespec ts;
 	if (clock_getres(CLOCK_MONOTONIC, &ts) != 0) {
@@ -77,6 +223,9 @@ void MasterClock::init() {
 		return;
 	}
 	qDebug() << "MasterClock: Using POSIX monotonic clock. Found clock resolution:" << timespecToNanos(ts) << "nanos.";
+#ifdef WITH_TSC_CLOCK
+	initTSCClock();
+#endif
 }
 
 void MasterClock::cleanup() {}
@@ -19,6 +19,7 @@
 
 #include "MidiConverterDialog.h"
 #include "Master.h"
+#include "QSynth.h"
 
 static inline bool isSyxFileName(const QString &fileName) {
 	return fileName.endsWith(".syx", Qt::CaseInsensitive);
@@ -28,11 +29,18 @@ static inline bool isSmfFileName(const QString &fileName) {
 	return fileName.endsWith(".mid", Qt::CaseInsensitive) || fileName.endsWith(".smf", Qt::CaseInsensitive);
 }
 
-MidiConverterDialog::MidiConverterDialog(Master *master, QWidget *parent) : QDialog(parent), ui(new Ui::MidiConverterDialog), batchMode(false) {
+MidiConverterDialog::MidiConverterDialog(Master *master, QWidget *parent) : QDialog(parent), ui(new Ui::MidiConverterDialog), jobsTotal(0), jobsFinished(0), batchMode(false) {
 	ui->setupUi(this);
 	loadProfileCombo();
-	connect(&converter, SIGNAL(conversionFinished()), SLOT(handleConversionFinished()));
-	connect(&converter, SIGNAL(midiEventProcessed(int, int)), SLOT(updateConversionProgress(int, int)));
+	ui->previewCheckBox->setToolTip("Render a draft for quick auditioning, trading emulation accuracy for speed.\nApproximations used: "
+		+ QSynth::getPreviewApproximations());
+	const int converterCount = qMax(1, QThread::idealThreadCount());
+	for (int i = 0; i < converterCount; i++) {
+		AudioFileRenderer *converter = new AudioFileRenderer;
+		connect(converter, SIGNAL(conversionFinished()), SLOT(handleConversionFinished()));
+		connect(converter, SIGNAL(midiEventProcessed(int, int)), SLOT(updateConversionProgress(int, int)));
+		converters.append(converter);
+	}
 	connect(this, SIGNAL(conversionFinished(const QString &, const QString &)), master, SLOT(showBalloon(const QString &, const QString &)));
 #if (QT_VERSION >= QT_VERSION_CHECK(4, 6, 0))
 	ui->midiList->setDefaultDropAction(Qt::MoveAction);
@@ -41,6 +49,8 @@ MidiConverterDialog::MidiConverterDialog(Master *master, QWidget *parent) : QDia
 }
 
 MidiConverterDialog::~MidiConverterDialog() {
+	stopConverters();
+	qDeleteAll(converters);
 	delete ui;
 }
 
@@ -191,16 +201,44 @@ void MidiConverterDialog::on_startButton_clicked() {
 		return;
 	}
 	enableControls(false);
-	ui->pcmList->setCurrentRow(0);
-	const QStringList midiFileNames = getMidiFileNames();
-	if (!converter.convertMIDIFiles(ui->pcmList->currentItem()->text(), midiFileNames, ui->profileComboBox->currentText())) enableControls(true);
+	// The MIDI files of the other PCM files are kept in the items, make it so for the current one as well.
+	ui->pcmList->currentItem()->setData(Qt::UserRole, getMidiFileNames());
+	jobsTotal = ui->pcmList->count();
+	jobsFinished = 0;
+	foreach (AudioFileRenderer *converter, converters) {
+		if (!startNextJob(converter)) break;
+	}
+	if (runningJobs.isEmpty()) enableControls(true);
 }
 
 void MidiConverterDialog::on_stopButton_clicked() {
-	converter.stop();
+	stopConverters();
 	enableControls(true);
 }
 
+// Starts converting the first PCM file not yet in progress, returns false if there is none or the conversion fails to start.
+bool MidiConverterDialog::startNextJob(AudioFileRenderer *converter) {
+	for (int i = 0; i < ui->pcmList->count(); i++) {
+		QListWidgetItem *pcmItem = ui->pcmList->item(i);
+		if (runningJobs.key(pcmItem) != NULL) continue;
+		const QStringList midiFileNames = pcmItem->data(Qt::UserRole).value<QStringList>();
+		if (!converter->convertMIDIFiles(pcmItem->text(), midiFileNames, ui->profileComboBox->currentText(), ui->previewCheckBox->isChecked())) return false;
+		runningJobs.insert(converter, pcmItem);
+		runningJobsProgress.insert(converter, 0.0);
+		return true;
+	}
+	return false;
+}
+
+void MidiConverterDialog::stopConverters() {
+	// Forget the jobs first, so that the completion signals still pending are ignored.
+	runningJobs.clear();
+	runningJobsProgress.clear();
+	foreach (AudioFileRenderer *converter, converters) {
+		converter->stop();
+	}
+}
+
 void MidiConverterDialog::loadProfileCombo() {
 	Master &master = *Master::getInstance();
 	QStringList profiles = master.enumSynthProfiles();
@@ -242,16 +280,37 @@ void MidiConverterDialog::on_pcmList_currentItemChanged(QListWidgetItem *current
 }
 
 void MidiConverterDialog::handleConversionFinished() {
+	AudioFileRenderer *converter = static_cast<AudioFileRenderer *>(sender());
+	QListWidgetItem *pcmItem = runningJobs.take(converter);
+	if (pcmItem == NULL) return;
+	runningJobsProgress.remove(converter);
+	jobsFinished++;
 	if (Master::getInstance()->getSettings()->value("Master/showConnectionBalloons", "1").toBool()) {
-		emit conversionFinished("MIDI file converted", ui->pcmList->currentItem()->text());
+		if (ui->previewCheckBox->isChecked()) {
+			emit conversionFinished("MIDI file converted in preview quality", pcmItem->text() + "\nApproximations used: " + QSynth::getPreviewApproximations());
+		} else {
+			emit conversionFinished("MIDI file converted", pcmItem->text());
+		}
 	}
-	ui->midiList->clear();
-	delete ui->pcmList->takeItem(ui->pcmList->currentRow());
-	on_startButton_clicked();
+	if (pcmItem == ui->pcmList->currentItem()) ui->midiList->clear();
+	delete ui->pcmList->takeItem(ui->pcmList->row(pcmItem));
+	if (startNextJob(converter) || !runningJobs.isEmpty()) return;
+	if (batchMode && ui->pcmList->count() == 0) {
+		emit batchConversionFinished();
+		return;
+	}
+	enableControls(true);
 }
 
 void MidiConverterDialog::updateConversionProgress(int midiEventsProcessed, int midiEventsTotal) {
-	double percentage = (100.0 * midiEventsProcessed) / midiEventsTotal;
+	AudioFileRenderer *converter = static_cast<AudioFileRenderer *>(sender());
+	if (!runningJobsProgress.contains(converter)) return;
+	runningJobsProgress[converter] = double(midiEventsProcessed) / midiEventsTotal;
+	double jobsDone = jobsFinished;
+	foreach (double jobProgress, runningJobsProgress) {
+		jobsDone += jobProgress;
+	}
+	double percentage = (100.0 * jobsDone) / jobsTotal;
 	ui->progressBar->setValue((int)percentage);
 }
 
@@ -262,6 +321,7 @@ void MidiConverterDialog::enableControls(bool enable) {
 	ui->stopButton->setEnabled(!enable);
 	ui->startButton->setEnabled(enable && ui->pcmList->count() > 0);
 	ui->profileComboBox->setEnabled(enable);
+	ui->previewCheckBox->setEnabled(enable);
 	ui->midiList->setEnabled(enable);
 	ui->pcmList->setEnabled(enable);
 	ui->newPcmButton->setEnabled(enable);
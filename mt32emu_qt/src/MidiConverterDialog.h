@@ -26,10 +26,17 @@ protected:
 
 private:
 	Ui::MidiConverterDialog *ui;
-	AudioFileRenderer converter;
+	// The conversion jobs run concurrently, one per converter, each with its own synth.
+	QList<AudioFileRenderer *> converters;
+	QHash<AudioFileRenderer *, QListWidgetItem *> runningJobs;
+	QHash<AudioFileRenderer *, double> runningJobsProgress;
+	int jobsTotal;
+	int jobsFinished;
 	bool batchMode;
 
 	void enableControls(bool enable);
+	bool startNextJob(AudioFileRenderer *converter);
+	void stopConverters();
 	void loadProfileCombo();
 	QStringList getMidiFileNames();
 	QStringList showAddMidiFilesDialog();
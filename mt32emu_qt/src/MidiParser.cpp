@@ -93,7 +93,7 @@ bool MidiParser::parseTrack(QMidiEventList &midiEventList) {
 					quint32 sysexLength = parseVarLenInt(++data);
 					if (sysexLength < 1) {
 						// No SysEx data, keep the time in sync
-						midiEventList.newMidiEvent().assignSyncMessage(time);
+						midiEventList.appendSyncMessage(time);
 						continue;
 					}
 					if (MT32Emu::SYSEX_BUFFER_SIZE <= sysexLength) {
@@ -103,11 +103,11 @@ bool MidiParser::parseTrack(QMidiEventList &midiEventList) {
 					data += sysexLength - 1;
 					if (*(data++) == 0xF7) {
 						// Complete SysEx event
-						midiEventList.newMidiEvent().assignSysex(time, sysexBuffer.constData(), sysexBuffer.size());
+						midiEventList.appendSysex(time, sysexBuffer.constData(), sysexBuffer.size());
 						sysexBuffer.clear();
 					} else {
 						// SysEx fragment, just keep the time in sync
-						midiEventList.newMidiEvent().assignSyncMessage(time);
+						midiEventList.appendSyncMessage(time);
 					}
 					continue;
 				} else if (status == 0xF7) {
@@ -121,11 +121,11 @@ bool MidiParser::parseTrack(QMidiEventList &midiEventList) {
 						data += len - 1;
 						if (*(data++) == 0xF7) {
 							// Last SysEx fragment
-							midiEventList.newMidiEvent().assignSysex(time, sysexBuffer.constData(), sysexBuffer.size());
+							midiEventList.appendSysex(time, sysexBuffer.constData(), sysexBuffer.size());
 							sysexBuffer.clear();
 						} else {
 							// SysEx is still incomplete, just keep the time in sync
-							midiEventList.newMidiEvent().assignSyncMessage(time);
+							midiEventList.appendSyncMessage(time);
 						}
 						continue;
 					}
@@ -139,13 +139,13 @@ bool MidiParser::parseTrack(QMidiEventList &midiEventList) {
 						if (time > 0) {
 							// Assign a special marker event to end the track in time
 							qDebug() << "MidiParser: Adding sync event for" << time << "divisions";
-							midiEventList.newMidiEvent().assignSyncMessage(time);
+							midiEventList.appendSyncMessage(time);
 						}
 						runningStatus = 0x2F;
 						break;
 					} else if (metaType == 0x51) {
 						uint newTempo = qFromBigEndian<quint32>(data) >> 8;
-						midiEventList.newMidiEvent().assignSetTempoMessage(time, newTempo);
+						midiEventList.appendSetTempoMessage(time, newTempo);
 						qDebug() << "MidiParser: Meta-event: Set tempo:" << newTempo;
 						data += len;
 						continue;
@@ -160,7 +160,7 @@ bool MidiParser::parseTrack(QMidiEventList &midiEventList) {
 				if (time > 0) {
 					// The event is unsupported. Nevertheless, assign a special marker event to retain timing information
 					qDebug() << "MidiParser: Adding sync event for" << time << "divisions";
-					midiEventList.newMidiEvent().assignSyncMessage(time);
+					midiEventList.appendSyncMessage(time);
 				}
 				continue;
 			} else if ((status & 0xE0) == 0xC0) {
@@ -190,7 +190,7 @@ bool MidiParser::parseTrack(QMidiEventList &midiEventList) {
 				data += 2;
 			}
 		}
-		midiEventList.newMidiEvent().assignShortMessage(time, message);
+		midiEventList.appendShortMessage(time, message);
 	}
 	if (runningStatus != 0x2F) {
 		qDebug() << "MidiParser: End-of-track Meta-event isn't the last event, file is probably corrupted.";
@@ -212,56 +212,8 @@ quint32 MidiParser::parseVarLenInt(const uchar * &data) {
 }
 
 void MidiParser::mergeMidiEventLists(QVector<QMidiEventList> &trackList) {
-	int totalEventCount = 0;
-
-	// Remove empty tracks & allocate memory exactly needed
-	for (int i = trackList.count() - 1; i >=0; i--) {
-		int eventCount = trackList.at(i).count();
-		if (eventCount == 0) {
-			trackList.remove(i);
-		} else {
-			totalEventCount += eventCount;
-		}
-	}
-	midiEventList.reserve(totalEventCount);
-	qDebug() << "MidiParser: Expected" << totalEventCount << "events";
-
-	// Append events from all the tracks to the output list in sequence
-	QVarLengthArray<int> currentIx(trackList.count());	            // The index of the event to be added next
-	QVarLengthArray<SynthTimestamp> currentTime(trackList.count()); // The time in MIDI ticks of the event to be added next
-	for (int i = 0; i < trackList.count(); i++) {
-		currentIx[i] = 0;
-		currentTime[i] = trackList.at(i).at(0).getTimestamp();
-	}
-	SynthTimestamp lastEventTime = 0; // Timestamp of the last added event
-	forever {
-		int trackIx = -1;
-		SynthTimestamp nextEventTime = 0x10000000;
-
-		// Find lowest track index with earliest event
-		for (int i = 0; i < trackList.count(); i++) {
-			if (trackList.at(i).count() <= currentIx[i]) continue;
-			if (currentTime[i] < nextEventTime) {
-				nextEventTime = currentTime[i];
-				trackIx = i;
-			}
-		}
-		if (trackIx == -1) break;
-		const QMidiEvent *e = &trackList.at(trackIx).at(currentIx[trackIx]);
-		forever {
-			midiEventList.append(*e);
-			midiEventList.last().setTimestamp(nextEventTime - lastEventTime);
-			lastEventTime = nextEventTime;
-			if (trackList.at(trackIx).count() <= ++currentIx[trackIx]) break;
-			e = &trackList.at(trackIx).at(currentIx[trackIx]);
-			SynthTimestamp nextDeltaTime = e->getTimestamp();
-			if (nextDeltaTime != 0) {
-				currentTime[trackIx] += nextDeltaTime;
-				break;
-			}
-		}
-	}
-	qDebug() << "MidiParser: Actually" << midiEventList.count() << "events";
+	midiEventList.mergeTracks(trackList);
+	qDebug() << "MidiParser: Merged" << midiEventList.count() << "events";
 }
 
 bool MidiParser::parseSysex() {
@@ -280,7 +232,7 @@ bool MidiParser::parseSysex() {
 		}
 		if (sysexBeginIx != -1 && data[i] == 0xF7) {
 			int sysexLen = i - sysexBeginIx + 1;
-			midiEventList.newMidiEvent().assignSysex(1, &data[sysexBeginIx], sysexLen);
+			midiEventList.appendSysex(1, &data[sysexBeginIx], sysexLen);
 			sysexBeginIx = -1;
 		}
 	}
@@ -335,6 +287,15 @@ bool MidiParser::parse(const QString fileName) {
 	return parseResult;
 }
 
+void MidiParser::takeOver(MidiParser &parsedFile) {
+	// The event list is implicitly shared, so this copies no events.
+	midiEventList = parsedFile.midiEventList;
+	parsedFile.midiEventList.clear();
+	format = parsedFile.format;
+	numberOfTracks = parsedFile.numberOfTracks;
+	division = parsedFile.division;
+}
+
 const QMidiEventList &MidiParser::getMIDIEvents() {
 	return midiEventList;
 }
@@ -355,10 +316,10 @@ void MidiParser::addChannelsReset() {
 	for (quint8 i = 0; i < 16; i++) {
 		// All notes off
 		quint32 msg = 0x7FB0 | i;
-		midiEventList.newMidiEvent().assignShortMessage(0, msg);
+		midiEventList.appendShortMessage(0, msg);
 
 		// Reset all controllers
 		msg = 0x79B0 | i;
-		midiEventList.newMidiEvent().assignShortMessage(0, msg);
+		midiEventList.appendShortMessage(0, msg);
 	}
 }
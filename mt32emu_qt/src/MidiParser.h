@@ -12,6 +12,8 @@ public:
 	static const uint DEFAULT_TEMPO = MICROSECONDS_PER_MINUTE / DEFAULT_BPM;
 
 	bool parse(const QString fileName);
+	// Takes over the events and the timebase of a file parsed by another parser, which is left empty.
+	void takeOver(MidiParser &parsedFile);
 	const QMidiEventList &getMIDIEvents();
 	SynthTimestamp getMidiTick(uint tempo = DEFAULT_TEMPO);
 	void addChannelsReset();
@@ -27,6 +27,10 @@ MidiPlayerDialog::MidiPlayerDialog(Master *master, QWidget *parent) : QDialog(pa
 	connect(&smfDriver, SIGNAL(playbackTimeChanged(quint64, quint32)), SLOT(handlePlaybackTimeChanged(quint64, quint32)));
 	connect(&smfDriver, SIGNAL(tempoUpdated(quint32)), SLOT(handleTempoSet(quint32)));
 	connect(this, SIGNAL(playbackStarted(const QString &, const QString &)), master, SLOT(showBalloon(const QString &, const QString &)));
+	// Whatever way the playlist is edited, the files due to be played next may change.
+	connect(ui->playList->model(), SIGNAL(rowsInserted(const QModelIndex &, int, int)), SLOT(prefetchUpcomingFiles()));
+	connect(ui->playList->model(), SIGNAL(rowsRemoved(const QModelIndex &, int, int)), SLOT(prefetchUpcomingFiles()));
+	connect(ui->playList->model(), SIGNAL(rowsMoved(const QModelIndex &, int, int, const QModelIndex &, int)), SLOT(prefetchUpcomingFiles()));
 #if (QT_VERSION >= QT_VERSION_CHECK(4, 6, 0))
 	ui->playList->setDefaultDropAction(Qt::MoveAction);
 #endif // (QT_VERSION >= QT_VERSION_CHECK(4, 6, 0))
@@ -213,6 +217,7 @@ void MidiPlayerDialog::handlePlaybackFinished() {
 		updateCurrentItem();
 	}
 	smfDriver.start(currentItem->text());
+	prefetchUpcomingFiles();
 	if (Master::getInstance()->getSettings()->value("Master/showConnectionBalloons", "1").toBool()) {
 		emit playbackStarted("Playing MIDI file", QFileInfo(ui->playList->currentItem()->text()).fileName());
 	}
@@ -234,6 +239,17 @@ void MidiPlayerDialog::handleTempoSet(quint32 tempo) {
 	ui->tempoSpinBox->setValue(tempo == 0 ? MidiParser::DEFAULT_BPM : tempo);
 }
 
+void MidiPlayerDialog::prefetchUpcomingFiles() {
+	QStringList fileNames;
+	if (!stopped && currentItem != NULL) {
+		int row = ui->playList->row(currentItem);
+		while (row != -1 && ++row < ui->playList->count() && fileNames.count() < SMFPrefetcher::MAX_PREFETCHED_FILES) {
+			fileNames += ui->playList->item(row)->text();
+		}
+	}
+	smfDriver.prefetch(fileNames);
+}
+
 void MidiPlayerDialog::dragEnterEvent(QDragEnterEvent *e) {
 	Master::isSupportedDropEvent(e);
 }
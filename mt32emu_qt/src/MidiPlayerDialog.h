@@ -58,6 +58,7 @@ private slots:
 	void handlePlaybackFinished();
 	void handlePlaybackTimeChanged(quint64 currentNanos, quint32 totalSeconds);
 	void handleTempoSet(quint32 tempo);
+	void prefetchUpcomingFiles();
 
 signals:
 	void playbackStarted(const QString &, const QString &);
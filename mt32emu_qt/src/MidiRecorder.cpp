@@ -19,56 +19,122 @@
 static const char headerID[] = "MThd\x00\x00\x00\x06";
 static const char trackID[] = "MTrk";
 static const MasterClockNanos DEFAULT_NANOS_PER_QUARTER_NOTE = 500000000;
-static const uint MEMORY_RESERVE = 16384;
+// How often the writer thread encodes the queued events to the file.
+static const MasterClockNanos WRITE_INTERVAL_NANOS = 50 * MasterClock::NANOS_PER_MILLISECOND;
 
-MidiRecorder::MidiRecorder() : startNanos(0), endNanos(0) {
+MidiRecorder::MidiRecorder() : file(), startNanos(0), endNanos(0), midiTick(), stopProcessing(), writeFailed() {
 }
 
-void MidiRecorder::startRecording() {
+MidiRecorder::~MidiRecorder() {
+	stopRecording();
+	delete file;
+}
+
+bool MidiRecorder::startRecording(MasterClockNanos useMidiTick) {
+	stopRecording();
+	delete file;
+	file = new QTemporaryFile(QDir::tempPath() + "/mt32emu-qt-XXXXXX.mid");
+	uint division = uint(DEFAULT_NANOS_PER_QUARTER_NOTE / useMidiTick);
+
+	// Clamp division to fit to 16-bit signed integer
+	if (division > 32767) {
+		division = 32767;
+		useMidiTick = DEFAULT_NANOS_PER_QUARTER_NOTE / division;
+	}
+	midiTick = useMidiTick;
+	if (!file->open() || !writeHeader(division)) {
+		qDebug() << "MidiRecorder: Failed to create temporary file";
+		delete file;
+		file = NULL;
+		return false;
+	}
+
+	eventTicks = 0;
+	runningStatus = 0;
+	eventCount = 0;
+	writeFailed = false;
+	stopProcessing = false;
 	startNanos = MasterClock::getClockNanos();
 	endNanos = -1;
-	midiEventList.clear();
-	midiEventList.reserve(MEMORY_RESERVE);
+	start();
+	return true;
 }
 
 void MidiRecorder::recordShortMessage(quint32 msg, MasterClockNanos midiNanos) {
-	if (isRecording()) {
-		midiEventList.newMidiEvent().assignShortMessage(midiNanos, msg);
+	if (!isRecording()) return;
+	QMutexLocker midiBufferLocker(&midiBufferMutex);
+	if (!isRecording()) return;
+	if (midiBuffer.pushShortMessage(quint64(midiNanos), msg)) {
+		midiBuffer.flush();
+	} else {
+		qDebug() << "MidiRecorder: Buffer overflow, short message dropped";
 	}
 }
 
 void MidiRecorder::recordSysex(const uchar *sysexData, quint32 sysexLen, MasterClockNanos midiNanos) {
-	if (isRecording()) {
-		midiEventList.newMidiEvent().assignSysex(midiNanos, sysexData, sysexLen);
+	if (!isRecording()) return;
+	QMutexLocker midiBufferLocker(&midiBufferMutex);
+	if (!isRecording()) return;
+	if (midiBuffer.pushSysexMessage(quint64(midiNanos), sysexLen, sysexData)) {
+		midiBuffer.flush();
+	} else {
+		qDebug() << "MidiRecorder: Buffer overflow, sysex dropped";
 	}
 }
 
 void MidiRecorder::stopRecording() {
-	endNanos = MasterClock::getClockNanos();
+	if (!isRecording()) return;
+	{
+		// Ensures no MIDI thread is still pushing an event, so the writer thread gets them all.
+		QMutexLocker midiBufferLocker(&midiBufferMutex);
+		endNanos = MasterClock::getClockNanos();
+	}
+	stopProcessing = true;
+	wait();
 }
 
 bool MidiRecorder::isRecording() {
 	return endNanos == -1;
 }
 
-bool MidiRecorder::saveSMF(QString fileName, MasterClockNanos midiTick) {
-	uint division = uint(DEFAULT_NANOS_PER_QUARTER_NOTE / midiTick);
-
-	// Clamp division to fit to 16-bit signed integer
-	if (division > 32767) {
-		division = 32767;
-		midiTick = DEFAULT_NANOS_PER_QUARTER_NOTE / division;
+bool MidiRecorder::saveSMF(QString fileName) {
+	if (isRecording() || file == NULL || writeFailed) return false;
+	QString tempFileName = file->fileName();
+	QFile::remove(fileName);
+	file->setAutoRemove(false);
+	if (!file->rename(fileName)) {
+		// Likely on a different file system.
+		file->setAutoRemove(true);
+		if (!QFile::copy(tempFileName, fileName)) {
+			qDebug() << "MidiRecorder: Error saving file";
+			return false;
+		}
 	}
-	file.setFileName(fileName);
+	delete file;
+	file = NULL;
+	return true;
+}
+
+void MidiRecorder::run() {
 	forever {
-		if (!file.open(QIODevice::WriteOnly)) break;
-		if (!writeHeader(division)) break;
-		if (!writeTrack(midiTick)) break;
-		file.close();
-		return true;
+		// All the events are pushed by the time the flag is seen set, so it must be read before the last pass.
+		bool lastPass = stopProcessing;
+		writeEvents();
+		if (lastPass) break;
+		MasterClock::sleepForNanos(WRITE_INTERVAL_NANOS);
 	}
-	file.close();
-	return false;
+	if (!writeFailed) writeFailed = !writeTrackEnd();
+	file->close();
+}
+
+void MidiRecorder::writeEvents() {
+	if (!midiBuffer.retieveEvents()) return;
+	do {
+		const uchar *sysexData;
+		quint32 data = midiBuffer.getEventData(sysexData);
+		// After a write error, the events are still consumed to keep the buffer from overflowing.
+		if (!writeFailed) writeFailed = !writeEvent(MasterClockNanos(midiBuffer.getEventTimestamp()), data, sysexData);
+	} while (midiBuffer.nextEvent());
 }
 
 bool MidiRecorder::writeHeader(uint division) {
@@ -78,99 +144,99 @@ bool MidiRecorder::writeHeader(uint division) {
 	qToBigEndian<quint16>(1, (uchar *)&header[2]); // number of tracks 1
 	qToBigEndian<qint16>(division, (uchar *)&header[4]); // division
 	if (!writeFile(header, 6)) return false;
-	return true;
-}
-
-bool MidiRecorder::writeTrack(MasterClockNanos midiTick) {
 
-	// Writing track header, we'll fill length field later
+	// Writing track header, we'll fill length field when the recording stops
 	if (!writeFile(trackID, 4)) return false;
-	quint64 trackLenPos = file.pos();
+	trackLenPos = file->pos();
 	quint32 trackLen = 0;
 	if (!writeFile((char *)&trackLen, 4)) return false;
+	return true;
+}
 
-	// Writing actual MIDI events
-	uint runningStatus = 0;
-	quint32 eventTicks = 0; // Number of ticks from start of recording
+bool MidiRecorder::writeEvent(MasterClockNanos timestamp, quint32 message, const uchar *sysexData) {
 	uchar eventData[16]; // Buffer for single short event / sysex header
-	for (int i = 0; i < midiEventList.count(); i++) {
-		// Compute timestamp
-		const QMidiEvent &evt = midiEventList.at(i);
-		uchar *data = eventData;
-		quint32 deltaTicks = (evt.getTimestamp() - startNanos) / midiTick - eventTicks;
-		eventTicks += deltaTicks;
-		writeVarLenInt(data, deltaTicks);
-
-		uchar *sysexData = evt.getSysexData();
-		if (sysexData != NULL) {
-			// Process Sysex
-			quint32 sysexLen = evt.getSysexLen();
-			if (sysexLen < 4 || sysexData[0] != 0xF0 || sysexData[sysexLen - 1] != 0xF7) {
-				// Invalid sysex, skipping
-				qDebug() << "MidiRecorder: wrong sysex skipped at:" << evt.getTimestamp() - startNanos << "nanos, length:" << sysexLen;
-				eventTicks -= deltaTicks;
-				continue;
+	uchar *data = eventData;
+
+	// Compute timestamp, the events of several MIDI sources may come slightly out of order
+	quint32 deltaTicks = 0;
+	if (startNanos < timestamp) {
+		quint32 ticks = quint32((timestamp - startNanos) / midiTick);
+		if (eventTicks < ticks) deltaTicks = ticks - eventTicks;
+	}
+	writeVarLenInt(data, deltaTicks);
+
+	if (sysexData != NULL) {
+		// Process Sysex
+		quint32 sysexLen = message;
+		if (sysexLen < 4 || sysexData[0] != 0xF0 || sysexData[sysexLen - 1] != 0xF7) {
+			// Invalid sysex, skipping
+			qDebug() << "MidiRecorder: wrong sysex skipped at:" << timestamp - startNanos << "nanos, length:" << sysexLen;
+			return true;
+		}
+		*(data++) = sysexData[0];
+		writeVarLenInt(data, sysexLen - 1);
+		if (!writeFile((char *)eventData, data - eventData)) return false;
+		if (!writeFile((char *)&sysexData[1], sysexLen - 1)) return false;
+		runningStatus = 0;
+	} else {
+		// Process short message
+		uint newStatus = message & 0xFF;
+		if (0xF0 <= newStatus) {
+			// No support for escaping System messages, ignore
+			qDebug() << "MidiRecorder: unsupported System message skipped at:" << timestamp - startNanos << "nanos, code:" << newStatus;
+			return true;
+		}
+		if (newStatus == runningStatus) {
+			message >>= 8;
+			if ((newStatus & 0xE0) == 0xC0) {
+				// It's a short message with one data byte
+				*(data++) = uchar(message);
+			} else {
+				// It's a short message with two data bytes
+				qToLittleEndian<quint16>(message, data);
+				data += 2;
 			}
-			*(data++) = sysexData[0];
-			writeVarLenInt(data, sysexLen - 1);
-			if (!writeFile((char *)eventData, data - eventData)) return false;
-			if (!writeFile((char *)&sysexData[1], sysexLen - 1)) return false;
-			runningStatus = 0;
 		} else {
-			// Process short message
-			quint32 message = evt.getShortMessage();
-			uint newStatus = message & 0xFF;
-			if (0xF0 <= newStatus) {
-				// No support for escaping System messages, ignore
-				qDebug() << "MidiRecorder: unsupported System message skipped at:" << evt.getTimestamp() - startNanos << "nanos, code:" << newStatus;
-				continue;
-			}
-			if (newStatus == runningStatus) {
-				message >>= 8;
-				if ((newStatus & 0xE0) == 0xC0) {
-					// It's a short message with one data byte
-					*(data++) = uchar(message);
-				} else {
-					// It's a short message with two data bytes
-					qToLittleEndian<quint16>(message, data);
-					data += 2;
-				}
+			if ((newStatus & 0xE0) == 0xC0) {
+				// It's a short message with one data byte
+				qToLittleEndian<quint16>(message, data);
+				data += 2;
 			} else {
-				if ((newStatus & 0xE0) == 0xC0) {
-					// It's a short message with one data byte
-					qToLittleEndian<quint16>(message, data);
-					data += 2;
-				} else {
-					// It's a short message with two data bytes
-					qToLittleEndian<quint32>(message, data);
-					data += 3;
-				}
-				runningStatus = newStatus;
+				// It's a short message with two data bytes
+				qToLittleEndian<quint32>(message, data);
+				data += 3;
 			}
-			if (!writeFile((char *)eventData, data - eventData)) return false;
+			runningStatus = newStatus;
 		}
+		if (!writeFile((char *)eventData, data - eventData)) return false;
 	}
+	eventTicks += deltaTicks;
+	eventCount++;
+	return true;
+}
 
+bool MidiRecorder::writeTrackEnd() {
 	// Writing end-of-track meta-event
+	uchar eventData[8];
 	uchar *data = eventData;
-	quint32 deltaTicks = (endNanos - startNanos) / midiTick - eventTicks;
-	writeVarLenInt(data, deltaTicks);
+	quint32 endTicks = quint32((endNanos - startNanos) / midiTick);
+	writeVarLenInt(data, eventTicks < endTicks ? endTicks - eventTicks : 0);
 	qToLittleEndian<quint32>(0x002FFF, data);
 	data += 3;
 	if (!writeFile((char *)eventData, data - eventData)) return false;
 
 	// Writing track length
-	quint64 trackEndPos = file.pos();
-	trackLen = quint32(trackEndPos - trackLenPos - 4);
+	qint64 trackEndPos = file->pos();
+	quint32 trackLen = quint32(trackEndPos - trackLenPos - 4);
 	qToBigEndian<quint32>(trackLen, eventData);
-	file.seek(trackLenPos);
+	if (!file->seek(trackLenPos)) return false;
 	if (!writeFile((char *)eventData, 4)) return false;
-	qDebug() << "MidiRecorder: Processed" << midiEventList.count() << "MIDI events, written" << trackLen << "bytes";
+	qDebug() << "MidiRecorder: Processed" << eventCount << "MIDI events, written" << trackLen << "bytes";
 	return true;
 }
 
 bool MidiRecorder::writeFile(const char *data, qint64 len) {
-	qint64 writtenLen = file.write(data, len);
+	qint64 writtenLen = file->write(data, len);
 	if (writtenLen == len) return true;
 	qDebug() << "MidiRecorder: Error writing file";
 	return false;
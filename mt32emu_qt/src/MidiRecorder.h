@@ -4,25 +4,43 @@
 #include <QtCore>
 
 #include "MasterClock.h"
-#include "QMidiEvent.h"
+#include "QMidiBuffer.h"
 
-class MidiRecorder {
+// Records the incoming MIDI events straight into an SMF in a temporary file, so that the memory used stays constant
+// however long the recording goes. The events are queued by the MIDI threads and encoded to the file by a background
+// thread as they arrive, stopping the recording merely completes the track.
+class MidiRecorder : private QThread {
 public:
 	MidiRecorder();
-	void startRecording();
+	~MidiRecorder();
+	bool startRecording(MasterClockNanos midiTick = MasterClock::NANOS_PER_MILLISECOND);
 	void recordShortMessage(quint32 msg, MasterClockNanos midiNanos);
 	void recordSysex(const uchar *sysexData, quint32 sysexLen, MasterClockNanos midiNanos);
 	void stopRecording();
 	bool isRecording();
-	bool saveSMF(QString fileName, MasterClockNanos midiTick);
+	// Moves the recorded file to the destination, only possible once after the recording is stopped.
+	bool saveSMF(QString fileName);
 
 private:
-	QMidiEventList midiEventList;
-	QFile file;
+	QMutex midiBufferMutex;
+	QMidiBuffer midiBuffer;
+	QTemporaryFile *file;
 	MasterClockNanos startNanos, endNanos;
+	MasterClockNanos midiTick;
+	volatile bool stopProcessing;
+	bool writeFailed;
 
+	// Accessed from the writer thread while recording.
+	qint64 trackLenPos;
+	quint32 eventTicks;
+	uint runningStatus;
+	uint eventCount;
+
+	void run();
+	void writeEvents();
 	bool writeHeader(uint division);
-	bool writeTrack(MasterClockNanos midiTick);
+	bool writeEvent(MasterClockNanos timestamp, quint32 data, const uchar *sysexData);
+	bool writeTrackEnd();
 	bool writeFile(const char *data, qint64 len);
 	void writeVarLenInt(uchar * &data, quint32 value);
 };
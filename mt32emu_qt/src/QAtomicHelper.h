@@ -15,9 +15,10 @@
  */
 
 #ifndef QATOMIC_HELPER_H
-#define AUDIO_DRIVER_H
+#define QATOMIC_HELPER_H
 
 #include "QAtomicInt"
+#include "QAtomicPointer"
 
 // The Qt API for atomic access looks a bit unstable yet.
 // This helper wraps the atomic load or store operations that suddenly got
@@ -57,6 +58,47 @@ static inline void storeRelease(QAtomicInt &atomicInt, quint32 value) {
 #endif
 }
 
+template <class T>
+static inline T *loadRelaxed(const QAtomicPointer<T> &atomicPointer) {
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	return atomicPointer;
+#elif QT_VERSION < QT_VERSION_CHECK(5, 14, 0)
+	return atomicPointer.load();
+#else
+	return atomicPointer.loadRelaxed();
+#endif
+}
+
+template <class T>
+static inline T *loadAcquire(const QAtomicPointer<T> &atomicPointer) {
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	QAtomicPointer<T> helper(atomicPointer);
+	return helper.fetchAndStoreAcquire(NULL);
+#else
+	return atomicPointer.loadAcquire();
+#endif
+}
+
+template <class T>
+static inline void storeRelaxed(QAtomicPointer<T> &atomicPointer, T *value) {
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	atomicPointer = value;
+#elif QT_VERSION < QT_VERSION_CHECK(5, 14, 0)
+	atomicPointer.store(value);
+#else
+	atomicPointer.storeRelaxed(value);
+#endif
+}
+
+template <class T>
+static inline void storeRelease(QAtomicPointer<T> &atomicPointer, T *value) {
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+	atomicPointer.fetchAndStoreRelease(value);
+#else
+	atomicPointer.storeRelease(value);
+#endif
+}
+
 } // namespace QAtomicHelper
 
 #endif // QATOMIC_HELPER_H
@@ -16,16 +16,14 @@
 
 #include <cstring>
 
+#include <QMutex>
+
 #include "QMidiBuffer.h"
+#include "QAtomicHelper.h"
 
 enum MidiEventType {
 	MidiEventType_SHORT_MESSAGE,
-	MidiEventType_SYSEX_MESSAGE,
-	MidiEventType_PAD
-};
-
-struct PadHeader {
-	MidiEventType eventType;
+	MidiEventType_SYSEX_MESSAGE
 };
 
 struct ShortMessageEntry {
@@ -43,13 +41,77 @@ struct SysexMessageHeader {
 union MidiEventPointer {
 	void *writePointer;
 	void *readPointer;
-	PadHeader *padHeader;
 	ShortMessageEntry *shortMessageEntry;
 	SysexMessageHeader *sysexMessageHeader;
 	uchar *sysexMessageData;
 };
 
-static const quint32 BUFFER_SIZE = 32768;
+// Also limits the length of a single SysEx message.
+static const quint32 SEGMENT_SIZE = 32768;
+// Segments allocated upfront, enough for the usual number of MIDI sessions to run without allocating memory at all.
+static const quint32 PREALLOCATED_SEGMENT_COUNT = 8;
+// Drained segments beyond this count are freed rather than kept in the pool.
+static const quint32 MAX_POOLED_SEGMENT_COUNT = 64;
+// Limits the growth of a single buffer (2 MiB) when the rendering thread stops consuming the events.
+static const quint32 MAX_SEGMENT_COUNT = 64;
+
+struct QMidiBufferSegment {
+	// Linked by the MIDI source thread when the segment is full, only after the final write position is committed.
+	QAtomicPointer<QMidiBufferSegment> nextSegment;
+	// Count of bytes committed by the MIDI source thread.
+	QAtomicInt writePosition;
+	// Links the segments kept in the pool.
+	QMidiBufferSegment *nextFreeSegment;
+	uchar data[SEGMENT_SIZE];
+
+	QMidiBufferSegment() : nextSegment(), writePosition(), nextFreeSegment() {}
+};
+
+// Keeps the drained segments of all the buffers for reuse. Only accessed from the MIDI source threads.
+class SegmentPool {
+public:
+	SegmentPool() : freeSegments(), freeSegmentCount() {
+		for (quint32 i = 0; i < PREALLOCATED_SEGMENT_COUNT; i++) {
+			release(new QMidiBufferSegment);
+		}
+	}
+
+	~SegmentPool() {
+		while (freeSegments != NULL) {
+			QMidiBufferSegment *segment = freeSegments;
+			freeSegments = segment->nextFreeSegment;
+			delete segment;
+		}
+	}
+
+	QMidiBufferSegment *acquire() {
+		QMutexLocker locker(&mutex);
+		if (freeSegments == NULL) return new QMidiBufferSegment;
+		QMidiBufferSegment *segment = freeSegments;
+		freeSegments = segment->nextFreeSegment;
+		freeSegmentCount--;
+		return segment;
+	}
+
+	// The segment must be in the initial state, i.e. not linked and empty.
+	void release(QMidiBufferSegment *segment) {
+		QMutexLocker locker(&mutex);
+		if (freeSegmentCount == MAX_POOLED_SEGMENT_COUNT) {
+			delete segment;
+			return;
+		}
+		segment->nextFreeSegment = freeSegments;
+		freeSegments = segment;
+		freeSegmentCount++;
+	}
+
+private:
+	QMutex mutex;
+	QMidiBufferSegment *freeSegments;
+	quint32 freeSegmentCount;
+};
+
+static SegmentPool segmentPool;
 
 // The allocated SysEx data length is rounded, so that the events are aligned to the quint32 boundary.
 static inline size_t alignSysexDataLength(quint32 dataLength) {
@@ -57,27 +119,40 @@ static inline size_t alignSysexDataLength(quint32 dataLength) {
 }
 
 QMidiBuffer::QMidiBuffer() :
-	ringBuffer(BUFFER_SIZE),
-	writePointer(),
+	writeSegment(segmentPool.acquire()),
+	writePosition(),
 	bytesWritten(),
-	bytesToWrite(),
+	oldestSegment(writeSegment),
+	spareSegment(),
+	segmentCount(1),
+	readSegment(writeSegment),
+	readPosition(),
 	readPointer(),
 	bytesRead(),
-	bytesToRead()
+	bytesToRead(),
+	consumerSegment(writeSegment)
 {}
 
+QMidiBuffer::~QMidiBuffer() {
+	while (oldestSegment != NULL) {
+		QMidiBufferSegment *segment = oldestSegment;
+		oldestSegment = QAtomicHelper::loadRelaxed(segment->nextSegment);
+		QAtomicHelper::storeRelaxed(segment->nextSegment, (QMidiBufferSegment *)NULL);
+		QAtomicHelper::storeRelease(segment->writePosition, 0);
+		segmentPool.release(segment);
+	}
+	if (spareSegment != NULL) segmentPool.release(spareSegment);
+}
+
 bool QMidiBuffer::pushShortMessage(quint64 timestamp, quint32 data) {
 	static const quint32 entrySize = sizeof(ShortMessageEntry);
 	if (!requestSpace(entrySize)) return false;
 	MidiEventPointer eventPointer;
-	eventPointer.writePointer = writePointer;
+	eventPointer.writePointer = writeSegment->data + writePosition + bytesWritten;
 	eventPointer.shortMessageEntry->eventType = MidiEventType_SHORT_MESSAGE;
 	eventPointer.shortMessageEntry->shortMessageData = data;
 	eventPointer.shortMessageEntry->timestamp = timestamp;
-	eventPointer.shortMessageEntry++;
-	writePointer = eventPointer.writePointer;
 	bytesWritten += entrySize;
-	bytesToWrite -= entrySize;
 	return true;
 }
 
@@ -86,36 +161,43 @@ bool QMidiBuffer::pushSysexMessage(quint64 timestamp, quint32 dataLength, const
 	const quint32 entrySize = quint32(sizeof(SysexMessageHeader) + alignedDataLength);
 	if (!requestSpace(entrySize)) return false;
 	MidiEventPointer eventPointer;
-	eventPointer.writePointer = writePointer;
+	eventPointer.writePointer = writeSegment->data + writePosition + bytesWritten;
 	eventPointer.sysexMessageHeader->eventType = MidiEventType_SYSEX_MESSAGE;
 	eventPointer.sysexMessageHeader->sysexDataLength = dataLength;
 	eventPointer.sysexMessageHeader->timestamp = timestamp;
 	eventPointer.sysexMessageHeader++;
 	memcpy(eventPointer.sysexMessageData, data, dataLength);
-	eventPointer.sysexMessageData += alignedDataLength;
-	writePointer = eventPointer.writePointer;
 	bytesWritten += entrySize;
-	bytesToWrite -= entrySize;
 	return true;
 }
 
 void QMidiBuffer::flush() {
-	if (writePointer == NULL) return;
-	ringBuffer.advanceWritePointer(bytesWritten);
-	writePointer = NULL;
-	bytesWritten = 0;
-	bytesToWrite = 0;
+	if (bytesWritten > 0) {
+		writePosition += bytesWritten;
+		bytesWritten = 0;
+		// Release barrier ensures that data is fully written prior to updating the position.
+		QAtomicHelper::storeRelease(writeSegment->writePosition, writePosition);
+	}
+	reclaimSegments();
 }
 
 bool QMidiBuffer::retieveEvents() {
 	popEvents();
-	readPointer = ringBuffer.readPointer(bytesToRead);
-	if (bytesToRead == 0) return false;
-	MidiEventPointer eventPointer;
-	eventPointer.readPointer = readPointer;
-	if (eventPointer.padHeader->eventType != MidiEventType_PAD) return true;
-	bytesRead += bytesToRead;
-	return retieveEvents();
+	forever {
+		// Acquire barrier ensures that data is never read ahead of the position.
+		bytesToRead = QAtomicHelper::loadAcquire(readSegment->writePosition) - readPosition;
+		if (bytesToRead > 0) break;
+		QMidiBufferSegment *nextSegment = QAtomicHelper::loadAcquire(readSegment->nextSegment);
+		if (nextSegment == NULL) return false;
+		// The next segment is linked after the final write position is committed, which is visible by now.
+		if (QAtomicHelper::loadRelaxed(readSegment->writePosition) != readPosition) continue;
+		readSegment = nextSegment;
+		readPosition = 0;
+		// Release barrier ensures that the drained segment is no longer accessed when the MIDI source thread takes it back.
+		QAtomicHelper::storeRelease(consumerSegment, nextSegment);
+	}
+	readPointer = readSegment->data + readPosition;
+	return true;
 }
 
 quint64 QMidiBuffer::getEventTimestamp() const {
@@ -156,10 +238,7 @@ bool QMidiBuffer::nextEvent() {
 	readPointer = eventPointer.readPointer;
 	bytesRead += entrySize;
 	bytesToRead -= entrySize;
-	if (bytesToRead > 0) {
-		if (eventPointer.padHeader->eventType != MidiEventType_PAD) return true;
-		bytesRead += bytesToRead;
-	}
+	if (bytesToRead > 0) return true;
 	return retieveEvents();
 }
 
@@ -170,26 +249,46 @@ void QMidiBuffer::discardEvents() {
 
 void QMidiBuffer::popEvents() {
 	if (readPointer == NULL) return;
-	ringBuffer.advanceReadPointer(bytesRead);
+	readPosition += bytesRead;
 	readPointer = NULL;
 	bytesRead = 0;
 	bytesToRead = 0;
 }
 
+// When the current segment is full, the chain is continued with a drained segment or another one from the pool.
 bool QMidiBuffer::requestSpace(quint32 eventLength) {
-	if (writePointer == NULL) {
-		writePointer = ringBuffer.writePointer(bytesToWrite, freeSpaceContiguous);
-	}
-	while (bytesToWrite < (eventLength + sizeof(PadHeader))) {
-		if (freeSpaceContiguous) return eventLength <= bytesToWrite;
-		// When the free space isn't contiguous, pad the rest of the ring buffer
-		// and restart from the beginning.
-		MidiEventPointer eventPointer;
-		eventPointer.writePointer = writePointer;
-		eventPointer.padHeader->eventType = MidiEventType_PAD;
-		bytesWritten += bytesToWrite;
-		flush();
-		writePointer = ringBuffer.writePointer(bytesToWrite, freeSpaceContiguous);
+	if (eventLength <= SEGMENT_SIZE - writePosition - bytesWritten) return true;
+	if (SEGMENT_SIZE < eventLength) return false;
+	reclaimSegments();
+	QMidiBufferSegment *newSegment = spareSegment;
+	if (newSegment != NULL) {
+		spareSegment = NULL;
+	} else {
+		if (segmentCount == MAX_SEGMENT_COUNT) return false;
+		newSegment = segmentPool.acquire();
+		segmentCount++;
 	}
+	flush();
+	QAtomicHelper::storeRelease(writeSegment->nextSegment, newSegment);
+	writeSegment = newSegment;
+	writePosition = 0;
 	return true;
 }
+
+// Takes back the segments drained by the rendering thread. One is kept as the spare, the rest is returned to the pool.
+void QMidiBuffer::reclaimSegments() {
+	if (oldestSegment == writeSegment) return;
+	QMidiBufferSegment *segmentBeingRead = QAtomicHelper::loadAcquire(consumerSegment);
+	while (oldestSegment != segmentBeingRead) {
+		QMidiBufferSegment *drainedSegment = oldestSegment;
+		oldestSegment = QAtomicHelper::loadRelaxed(drainedSegment->nextSegment);
+		QAtomicHelper::storeRelaxed(drainedSegment->nextSegment, (QMidiBufferSegment *)NULL);
+		QAtomicHelper::storeRelease(drainedSegment->writePosition, 0);
+		if (spareSegment == NULL) {
+			spareSegment = drainedSegment;
+		} else {
+			segmentPool.release(drainedSegment);
+			segmentCount--;
+		}
+	}
+}
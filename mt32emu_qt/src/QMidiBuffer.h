@@ -2,16 +2,21 @@
 #define QMIDI_BUFFER_H
 
 #include <QtGlobal>
+#include <QAtomicPointer>
 
-#include "QRingBuffer.h"
+struct QMidiBufferSegment;
 
 /**
- * A semi-lock-free queue intended to collect MIDI events coming from a single MIDI source before rendering audio output.
+ * A lock-free queue intended to collect MIDI events coming from a single MIDI source before rendering audio output.
  * The MIDI events are expected to be in chronological order, timestamped using the count of frames rendered by QSynth.
+ * The events are stored in a chain of fixed-size segments taken from a pool shared by all the buffers, so the queue grows
+ * during bursts of events, such as lengthy SysEx dumps, and gives the segments back once they are drained. The pool is only
+ * accessed from the MIDI source thread, the rendering thread merely follows the chain and never locks or allocates memory.
  */
 class QMidiBuffer {
 public:
 	QMidiBuffer();
+	~QMidiBuffer();
 
 	// Accessible from the MIDI source thread.
 	bool pushShortMessage(quint64 timestamp, quint32 data);
@@ -27,20 +32,34 @@ public:
 	void popEvents();
 
 private:
-	Utility::QRingBuffer ringBuffer;
+	// Common cache line size of contemporary CPUs, larger lines merely render the padding less effective.
+	static const size_t CACHE_LINE_SIZE = 64;
 
 	// Accessed from the MIDI source thread.
-	void *writePointer;
+	QMidiBufferSegment *writeSegment;
+	quint32 writePosition;
 	quint32 bytesWritten;
-	quint32 bytesToWrite;
-	bool freeSpaceContiguous;
+	// The oldest segment not yet taken back from the chain. All the segments preceding the one being read are drained.
+	QMidiBufferSegment *oldestSegment;
+	// A drained segment kept to continue the chain with, so that the pool isn't accessed while the buffer stays small.
+	QMidiBufferSegment *spareSegment;
+	// Number of segments in the chain, including the spare one.
+	quint32 segmentCount;
 
+	char consumerLinePadding[CACHE_LINE_SIZE];
 	// Accessed from the rendering thread.
+	QMidiBufferSegment *readSegment;
+	quint32 readPosition;
 	void *readPointer;
 	quint32 bytesRead;
 	quint32 bytesToRead;
+	// The segment being read, published for the MIDI source thread to take back the segments preceding it.
+	QAtomicPointer<QMidiBufferSegment> consumerSegment;
+
+	char trailingPadding[CACHE_LINE_SIZE];
 
 	bool requestSpace(quint32 length);
+	void reclaimSegments();
 };
 
 #endif
@@ -16,34 +16,29 @@
 
 #include "QMidiEvent.h"
 
-#include <cstring>
+#include <QVarLengthArray>
+
+#include <algorithm>
 
 using namespace MT32Emu;
 
+struct TrackPosition {
+	SynthTimestamp time; // The time in MIDI ticks of the event to be added next
+	int trackIx;
+};
+
+// Ordering for a min-heap of the tracks, so that the track with the earliest event and the lowest index is on top.
+static bool isLater(const TrackPosition &a, const TrackPosition &b) {
+	return b.time < a.time || (a.time == b.time && b.trackIx < a.trackIx);
+}
+
 QMidiEvent::QMidiEvent() :
+	timestamp(),
 	type(SHORT_MESSAGE),
 	msg(),
-	sysexData()
+	sysexOffset()
 {}
 
-QMidiEvent::QMidiEvent(const QMidiEvent &copyOf) :
-	timestamp(copyOf.timestamp),
-	type(copyOf.type)
-{
-	if (type == SYSEX && copyOf.sysexData != NULL) {
-		sysexLen = copyOf.sysexLen;
-		sysexData = new uchar[sysexLen];
-		memcpy(sysexData, copyOf.sysexData, sysexLen);
-	} else {
-		msg = copyOf.msg;
-		sysexData = NULL;
-	}
-}
-
-QMidiEvent::~QMidiEvent() {
-	delete[] sysexData;
-}
-
 SynthTimestamp QMidiEvent::getTimestamp() const {
 	return timestamp;
 }
@@ -52,10 +47,6 @@ MidiEventType QMidiEvent::getType() const {
 	return type;
 }
 
-uchar *QMidiEvent::getSysexData() const {
-	return sysexData;
-}
-
 Bit32u QMidiEvent::getShortMessage() const {
 	return msg;
 }
@@ -68,42 +59,134 @@ void QMidiEvent::setTimestamp(SynthTimestamp newTimestamp) {
 	timestamp = newTimestamp;
 }
 
-void QMidiEvent::assignShortMessage(SynthTimestamp newTimestamp, Bit32u newMsg) {
-	timestamp = newTimestamp;
-	type = SHORT_MESSAGE;
-	msg = newMsg;
-	delete[] sysexData;
-	sysexData = NULL;
+int QMidiEventList::count() const {
+	return events.count();
 }
 
-void QMidiEvent::assignSysex(SynthTimestamp newTimestamp, uchar const * const newSysexData, Bit32u newSysexLen) {
-	timestamp = newTimestamp;
-	type = SYSEX;
-	sysexLen = newSysexLen;
-	delete[] sysexData;
-	uchar *copy = new uchar[newSysexLen];
-	memcpy(copy, newSysexData, newSysexLen);
-	sysexData = copy;
+bool QMidiEventList::isEmpty() const {
+	return events.isEmpty();
 }
 
-void QMidiEvent::assignSetTempoMessage(SynthTimestamp newTimestamp, MT32Emu::Bit32u newTempo) {
-	timestamp = newTimestamp;
-	type = SET_TEMPO;
-	msg = newTempo;
-	delete[] sysexData;
-	sysexData = NULL;
+const QMidiEvent &QMidiEventList::at(int i) const {
+	return events.at(i);
 }
 
-void QMidiEvent::assignSyncMessage(SynthTimestamp newTimestamp) {
-	timestamp = newTimestamp;
-	type = SYNC;
-	msg = 0;
-	delete[] sysexData;
-	sysexData = NULL;
+const uchar *QMidiEventList::getSysexData(const QMidiEvent &event) const {
+	return reinterpret_cast<const uchar *>(sysexData.constData()) + event.sysexOffset;
 }
 
-QMidiEvent &QMidiEventList::newMidiEvent() {
-	uint s = size();
-	resize(s + 1);
-	return last();
+void QMidiEventList::clear() {
+	events.clear();
+	sysexData.clear();
+}
+
+void QMidiEventList::reserve(int eventCount, int sysexDataSize) {
+	events.reserve(eventCount);
+	if (sysexDataSize > 0) sysexData.reserve(sysexDataSize);
+}
+
+QMidiEvent &QMidiEventList::newMidiEvent(SynthTimestamp timestamp, MidiEventType type) {
+	events.resize(events.size() + 1);
+	QMidiEvent &event = events.last();
+	event.timestamp = timestamp;
+	event.type = type;
+	return event;
+}
+
+void QMidiEventList::appendShortMessage(SynthTimestamp timestamp, Bit32u msg) {
+	newMidiEvent(timestamp, SHORT_MESSAGE).msg = msg;
+}
+
+void QMidiEventList::appendSysex(SynthTimestamp timestamp, const uchar *newSysexData, Bit32u sysexLen) {
+	QMidiEvent &event = newMidiEvent(timestamp, SYSEX);
+	event.sysexLen = sysexLen;
+	event.sysexOffset = sysexData.size();
+	sysexData.append(reinterpret_cast<const char *>(newSysexData), sysexLen);
+}
+
+void QMidiEventList::appendSetTempoMessage(SynthTimestamp timestamp, Bit32u tempo) {
+	newMidiEvent(timestamp, SET_TEMPO).msg = tempo;
+}
+
+void QMidiEventList::appendSyncMessage(SynthTimestamp timestamp) {
+	newMidiEvent(timestamp, SYNC).msg = 0;
+}
+
+void QMidiEventList::append(const QMidiEventList &source, const QMidiEvent &event) {
+	if (event.type == SYSEX) {
+		appendSysex(event.timestamp, source.getSysexData(event), event.sysexLen);
+	} else {
+		events.append(event);
+	}
+}
+
+QMidiEventList &QMidiEventList::operator+=(const QMidiEventList &source) {
+	const int firstEventIx = events.size();
+	const Bit32u sysexDataOffset = sysexData.size();
+	events += source.events;
+	sysexData += source.sysexData;
+	if (sysexDataOffset > 0) {
+		for (int i = firstEventIx; i < events.size(); i++) {
+			if (events.at(i).type == SYSEX) events[i].sysexOffset += sysexDataOffset;
+		}
+	}
+	return *this;
+}
+
+void QMidiEventList::mergeTracks(const QVector<QMidiEventList> &tracks) {
+	// Allocate memory exactly needed. The sysex data of the tracks is concatenated as is,
+	// so that the events only need their offsets adjusted.
+	int totalEventCount = 0;
+	int totalSysexDataSize = sysexData.size();
+	QVarLengthArray<Bit32u> sysexDataOffsets(tracks.count());
+	QVarLengthArray<TrackPosition> heap;
+	for (int i = 0; i < tracks.count(); i++) {
+		const QMidiEventList &track = tracks.at(i);
+		sysexDataOffsets[i] = totalSysexDataSize;
+		totalEventCount += track.count();
+		totalSysexDataSize += track.sysexData.size();
+		if (track.isEmpty()) continue;
+		TrackPosition position = { track.at(0).getTimestamp(), i };
+		heap.append(position);
+	}
+	sysexData.reserve(totalSysexDataSize);
+	for (int i = 0; i < tracks.count(); i++) {
+		sysexData += tracks.at(i).sysexData;
+	}
+	int eventIx = events.size();
+	events.resize(eventIx + totalEventCount);
+	QMidiEvent *mergedEvents = events.data();
+
+	// The track with the earliest event is taken from the heap, its events that follow at the same time are added
+	// in sequence, then it is put back with the time of the next event.
+	QVarLengthArray<int> currentIx(tracks.count()); // The index of the event to be added next
+	for (int i = 0; i < tracks.count(); i++) {
+		currentIx[i] = 0;
+	}
+	std::make_heap(heap.begin(), heap.end(), isLater);
+	SynthTimestamp lastEventTime = 0; // Timestamp of the last added event
+	while (!heap.isEmpty()) {
+		std::pop_heap(heap.begin(), heap.end(), isLater);
+		TrackPosition &position = heap.last();
+		const QMidiEventList &track = tracks.at(position.trackIx);
+		int &trackEventIx = currentIx[position.trackIx];
+		forever {
+			QMidiEvent &event = mergedEvents[eventIx++];
+			event = track.events.at(trackEventIx);
+			if (event.type == SYSEX) event.sysexOffset += sysexDataOffsets[position.trackIx];
+			event.timestamp = position.time - lastEventTime;
+			lastEventTime = position.time;
+			if (track.count() <= ++trackEventIx) break;
+			SynthTimestamp nextDeltaTime = track.at(trackEventIx).getTimestamp();
+			if (nextDeltaTime != 0) {
+				position.time += nextDeltaTime;
+				break;
+			}
+		}
+		if (trackEventIx < track.count()) {
+			std::push_heap(heap.begin(), heap.end(), isLater);
+		} else {
+			heap.removeLast();
+		}
+	}
 }
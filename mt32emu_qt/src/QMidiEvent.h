@@ -3,6 +3,7 @@
 
 #include <QtGlobal>
 #include <QVector>
+#include <QByteArray>
 
 #include <mt32emu/mt32emu.h>
 
@@ -17,7 +18,10 @@ enum MidiEventType {
 
 typedef MasterClockNanos SynthTimestamp;
 
+// Plain value, the sysex data is kept by the QMidiEventList the event belongs to and referenced by offset.
 class QMidiEvent {
+	friend class QMidiEventList;
+
 private:
 	SynthTimestamp timestamp;
 	MidiEventType type;
@@ -25,29 +29,52 @@ private:
 		MT32Emu::Bit32u msg;
 		MT32Emu::Bit32u sysexLen;
 	};
-	uchar *sysexData;
+	MT32Emu::Bit32u sysexOffset;
 
 public:
 	QMidiEvent();
-	QMidiEvent(const QMidiEvent &copyOf);
-	~QMidiEvent();
 
 	SynthTimestamp getTimestamp() const;
 	MidiEventType getType() const;
 	MT32Emu::Bit32u getShortMessage() const;
 	MT32Emu::Bit32u getSysexLen() const;
-	uchar *getSysexData() const;
 
 	void setTimestamp(SynthTimestamp newTimestamp);
-	void assignShortMessage(SynthTimestamp newTimestamp, MT32Emu::Bit32u newMsg);
-	void assignSysex(SynthTimestamp newTimestamp, uchar const * const newSysexData, MT32Emu::Bit32u newSysexLen);
-	void assignSetTempoMessage(SynthTimestamp newTimestamp, MT32Emu::Bit32u newTempo);
-	void assignSyncMessage(SynthTimestamp newTimestamp);
 };
 
-class QMidiEventList : public QVector<QMidiEvent> {
+Q_DECLARE_TYPEINFO(QMidiEvent, Q_MOVABLE_TYPE);
+
+// Flat array of events along with a single contiguous blob that holds the data of all the sysex events.
+// Copies are implicitly shared, like the Qt containers the list is made of.
+class QMidiEventList {
 public:
-	QMidiEvent &newMidiEvent();
+	int count() const;
+	bool isEmpty() const;
+	const QMidiEvent &at(int i) const;
+	// Returns the data of a sysex event from this list.
+	const uchar *getSysexData(const QMidiEvent &event) const;
+
+	void clear();
+	void reserve(int eventCount, int sysexDataSize = 0);
+
+	void appendShortMessage(SynthTimestamp timestamp, MT32Emu::Bit32u msg);
+	void appendSysex(SynthTimestamp timestamp, const uchar *sysexData, MT32Emu::Bit32u sysexLen);
+	void appendSetTempoMessage(SynthTimestamp timestamp, MT32Emu::Bit32u tempo);
+	void appendSyncMessage(SynthTimestamp timestamp);
+	// Appends an event of another list along with its sysex data, if any.
+	void append(const QMidiEventList &source, const QMidiEvent &event);
+	// Appends all events of another list.
+	QMidiEventList &operator+=(const QMidiEventList &source);
+
+	// Merges the event lists of the tracks, where the timestamps are delta times in MIDI ticks, into this list ordered by time.
+	// When several tracks have events at the same time, the events of the track with the lowest index come first.
+	void mergeTracks(const QVector<QMidiEventList> &tracks);
+
+private:
+	QVector<QMidiEvent> events;
+	QByteArray sysexData;
+
+	QMidiEvent &newMidiEvent(SynthTimestamp timestamp, MidiEventType type);
 };
 
 #endif
@@ -20,19 +20,24 @@
 using namespace Utility;
 
 QRingBuffer::QRingBuffer(const quint32 byteSize) :
-	buffer(new uchar[byteSize]), bufferSize(byteSize)
+	buffer(new uchar[byteSize]), bufferSize(byteSize), producerReadPosition(0), consumerWritePosition(0)
 {}
 
 QRingBuffer::~QRingBuffer() {
 	delete[] buffer;
 }
 
-void *QRingBuffer::writePointer(quint32 &bytesFree, bool &freeSpaceContiguous) const {
-	// Aquire barrier ensures that data is never written ahead of the indices, when the buffer
-	// space might still be in use. In practice however, this is barely possible, because all
-	// subsequent data writes depend on values of the indices, but shouldn't hurt anyway.
-	quint32 myReadPosition = QAtomicHelper::loadAcquire(readPosition);
+void *QRingBuffer::writePointer(quint32 &bytesFree, bool &freeSpaceContiguous) {
 	quint32 myWritePosition = QAtomicHelper::loadRelaxed(writePosition);
+	// Unless the free space wraps around, the consumer can't move the read position past the write position,
+	// so the free space up to the end of the buffer is determined by the cached read position already.
+	// Otherwise, the read position is reloaded. Aquire barrier ensures that data is never written ahead
+	// of the indices, when the buffer space might still be in use. In practice however, this is barely
+	// possible, because all subsequent data writes depend on values of the indices, but shouldn't hurt anyway.
+	if (myWritePosition < producerReadPosition || producerReadPosition == 0) {
+		producerReadPosition = QAtomicHelper::loadAcquire(readPosition);
+	}
+	quint32 myReadPosition = producerReadPosition;
 	bool wrapped = myWritePosition < myReadPosition;
 	bytesFree = (wrapped ? myReadPosition : bufferSize) - myWritePosition;
 	freeSpaceContiguous = wrapped || myReadPosition == 0;
@@ -51,12 +56,18 @@ void QRingBuffer::advanceWritePointer(quint32 bytesWritten) {
 	QAtomicHelper::storeRelease(writePosition, myWritePosition);
 }
 
-void *QRingBuffer::readPointer(quint32 &bytesReady) const {
-	// Aquire barrier ensures that data is never read ahead of the indices, when the buffer
-	// space might not contain valid data yet. In practice however, this is barely possible,
-	// because all subsequent data reads depend on values of the indices, but shouldn't hurt anyway.
+void *QRingBuffer::readPointer(quint32 &bytesReady) {
 	quint32 myReadPosition = QAtomicHelper::loadRelaxed(readPosition);
-	quint32 myWritePosition = QAtomicHelper::loadAcquire(writePosition);
+	// When the data wraps around, the producer can't move the write position past the read position,
+	// so the data up to the end of the buffer is determined by the cached write position already.
+	// Otherwise, the write position is reloaded. Aquire barrier ensures that data is never read ahead
+	// of the indices, when the buffer space might not contain valid data yet. In practice however,
+	// this is barely possible, because all subsequent data reads depend on values of the indices,
+	// but shouldn't hurt anyway.
+	if (myReadPosition <= consumerWritePosition) {
+		consumerWritePosition = QAtomicHelper::loadAcquire(writePosition);
+	}
+	quint32 myWritePosition = consumerWritePosition;
 	bytesReady = (myWritePosition < myReadPosition ? bufferSize : myWritePosition) - myReadPosition;
 	return buffer + myReadPosition;
 }
@@ -6,8 +6,11 @@
 namespace Utility {
 
 /**
- * A semi-lock-free byte buffer that facilitates communication between two threads (producer and consumer).
- * Depending on the Qt implementation, it may well appear "wait-free" on certain architectures.
+ * A lock-free byte buffer that facilitates communication between two threads (single producer and single consumer).
+ * The positions are only synchronised with acquire / release semantics. Each thread owns a cache line holding its own
+ * position and a cached copy of the position of the other thread, which it only reloads when the copy may be stale
+ * in a way that affects the result. So, the threads don't contend for a cache line while the ring isn't about to fill
+ * or drain up, and there is no false sharing between the positions.
  */
 class QRingBuffer {
 public:
@@ -15,18 +18,29 @@ public:
 	~QRingBuffer();
 
 	// Accessible from the producer thread.
-	void *writePointer(quint32 &bytesFree, bool &freeSpaceContiguous) const;
+	void *writePointer(quint32 &bytesFree, bool &freeSpaceContiguous);
 	void advanceWritePointer(quint32 bytesWritten);
 
 	// Accessible from the consumer thread.
-	void *readPointer(quint32 &bytesUsed) const;
+	void *readPointer(quint32 &bytesUsed);
 	void advanceReadPointer(quint32 bytesRead);
 
 private:
+	// Common cache line size of contemporary CPUs, larger lines merely render the padding less effective.
+	static const size_t CACHE_LINE_SIZE = 64;
+
 	uchar * const buffer;
 	const quint32 bufferSize;
-	QAtomicInt readPosition;
+
+	char producerLinePadding[CACHE_LINE_SIZE];
 	QAtomicInt writePosition;
+	quint32 producerReadPosition;
+
+	char consumerLinePadding[CACHE_LINE_SIZE];
+	QAtomicInt readPosition;
+	quint32 consumerWritePosition;
+
+	char trailingPadding[CACHE_LINE_SIZE];
 };
 
 }
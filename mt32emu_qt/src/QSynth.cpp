@@ -22,6 +22,7 @@
 #include "AudioFileWriter.h"
 #include "Master.h"
 #include "MasterClock.h"
+#include "QAtomicHelper.h"
 
 using namespace MT32Emu;
 
@@ -33,6 +34,11 @@ const int PART_COUNT = 9;
 const int SOUND_GROUP_NAME_LENGTH = 9; // 0-terminated
 const int TIMBRE_NAME_LENGTH = 11; // 0-terminated
 const int NO_UPDATE_VALUE = -1;
+// In the preview mode, partials are culled and the reverb tail is cut once they decay to about -48 dB.
+const Bit8u PREVIEW_PARTIAL_CULLING_LEVEL = 128;
+const float PREVIEW_REVERB_SILENCE_THRESHOLD = 0.004f;
+// Holds several seconds of dense MIDI data, which the SMF player pushes in advance to have the audio prerendered.
+const Bit32u MIDI_EVENT_QUEUE_SIZE = 8192;
 
 static const ROMImage *makeROMImage(const QDir &romDir, QString romFileName) {
 	FileStream *file = new FileStream;
@@ -72,6 +78,18 @@ static int readMasterVolume(Synth *synth) {
 	return masterVolume;
 }
 
+static quint32 floatToBits(float value) {
+	quint32 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float bitsToFloat(quint32 bits) {
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
 class RealtimeLocker {
 private:
 	QMutex &mutex;
@@ -91,6 +109,64 @@ public:
 	}
 };
 
+// Steps down the ladder of cheaper processing modes while rendering takes too much of the audio block duration,
+// and then lowers the number of partials available for new notes, so that bursts of notes steal the playing ones
+// rather than make the audio callback miss its deadline. The load is smoothed over a few blocks, and the polyphony
+// and then the quality are restored gradually once the load falls. The changes are made between render calls, so they
+// switch at the block boundaries. The thresholds are read from the settings in percent of the audio block duration.
+class PolyphonyGovernor {
+private:
+	static const int LOAD_SMOOTHING_BLOCK_COUNT = 4;
+	// Minimum time to wait for the effect of the previous change before lowering or raising the limit again
+	static const qint64 LOWER_HOLD_NANOS = 50 * MasterClock::NANOS_PER_MILLISECOND;
+	static const qint64 RAISE_HOLD_NANOS = MasterClock::NANOS_PER_SECOND;
+
+	bool enabled;
+	double highLoad;
+	double lowLoad;
+	double averageLoad;
+	qint64 nanosSinceLastChange;
+
+public:
+	PolyphonyGovernor() : averageLoad(), nanosSinceLastChange() {
+		QSettings *settings = Master::getInstance()->getSettings();
+		enabled = settings->value("Master/polyphonyGovernorEnabled", true).toBool();
+		highLoad = settings->value("Master/polyphonyGovernorHighLoad", 85).toInt() / 100.0;
+		lowLoad = settings->value("Master/polyphonyGovernorLowLoad", 50).toInt() / 100.0;
+	}
+
+	void blockRendered(Synth &synth, qint64 renderNanos, uint length, uint sampleRate) {
+		if (!enabled || sampleRate == 0) return;
+		const qint64 blockNanos = length * MasterClock::NANOS_PER_SECOND / sampleRate;
+		if (blockNanos == 0) return;
+		averageLoad += (double(renderNanos) / blockNanos - averageLoad) / LOAD_SMOOTHING_BLOCK_COUNT;
+		nanosSinceLastChange += blockNanos;
+
+		const Bit32u partialCount = synth.getPartialCount();
+		const Bit32u partialLimit = synth.getPartialLimit();
+		const DegradationLevel degradationLevel = synth.getDegradationLevel();
+		const Bit32u step = qMax(partialCount / 8, 1U);
+		if (averageLoad > highLoad && nanosSinceLastChange >= LOWER_HOLD_NANOS) {
+			const Bit32u minPartialLimit = qMin(qMax(partialCount / 4, Bit32u(MIN_PARTIAL_COUNT)), partialCount);
+			if (degradationLevel < DegradationLevel_REVERB_DRAINED) {
+				synth.setDegradationLevel(DegradationLevel(degradationLevel + 1));
+				nanosSinceLastChange = 0;
+			} else if (partialLimit > minPartialLimit) {
+				synth.setPartialLimit(partialLimit > minPartialLimit + step ? partialLimit - step : minPartialLimit);
+				nanosSinceLastChange = 0;
+			}
+		} else if (averageLoad < lowLoad && nanosSinceLastChange >= RAISE_HOLD_NANOS) {
+			if (partialLimit < partialCount) {
+				synth.setPartialLimit(partialLimit + step < partialCount ? partialLimit + step : 0);
+				nanosSinceLastChange = 0;
+			} else if (degradationLevel > DegradationLevel_NONE) {
+				synth.setDegradationLevel(DegradationLevel(degradationLevel - 1));
+				nanosSinceLastChange = 0;
+			}
+		}
+	}
+};
+
 class RealtimeHelper : public QThread {
 private:
 	enum SynthControlEvent {
@@ -105,13 +181,20 @@ private:
 		NICE_AMP_RAMP_ENABLED_CHANGED,
 		EMU_DAC_INPUT_MODE_CHANGED,
 		MIDI_DELAY_MODE_CHANGED,
-		MIDI_CHANNELS_ASSIGNMENT_RESET
+		MIDI_CHANNELS_ASSIGNMENT_RESET,
+		PARTIAL_COUNT_CHANGED
 	};
+	static const int SYNTH_CONTROL_EVENT_COUNT = PARTIAL_COUNT_CHANGED + 1;
 
 	QSynth &qsynth;
 	bool stopProcessing;
 
-	QQueue<SynthControlEvent> synthControlEvents;
+	// The synth control events are posted by storing the value the event carries, if any, and then raising the flag.
+	// The rendering thread takes them without locking at the start of each block, in the order of declaration, so that
+	// the settings changed along with a reset are applied on top of it. Posting an event again before it is taken merely
+	// replaces the value.
+	QAtomicInt pendingSynthControlEvents[SYNTH_CONTROL_EVENT_COUNT];
+	QAtomicInt synthControlEventValues[SYNTH_CONTROL_EVENT_COUNT];
 
 	// Synth settings, guarded by settingsMutex.
 	int masterVolume;
@@ -124,6 +207,7 @@ private:
 	DACInputMode emuDACInputMode;
 	MIDIDelayMode midiDelayMode;
 	bool midiChannelsAssignmentChannel1Engaged;
+	uint partialCount;
 
 	// Temp synth state collected while rendering, only accessed from the rendering thread.
 	// On backpressure, the latest values are kept.
@@ -164,54 +248,60 @@ private:
 	} stateSnapshot;
 
 
-	/** Ensures atomicity of collecting changes to be applied to the synth settings. */
+	/** Serialises the changes to the synth settings made by the other threads, never taken by the rendering thread. */
 	QMutex settingsMutex;
 	/** Ensures atomicity of handling the output signals of the synth and capturing its internal state. */
 	QMutex stateSnapshotMutex;
 	/** Used to block this thread until each rendering pass completes. */
 	QWaitCondition renderCompleteCondition;
 
+	/** Only accessed from the rendering thread. */
+	PolyphonyGovernor polyphonyGovernor;
+
 	void applyChangesRealtime() {
-		RealtimeLocker settingsLocker(settingsMutex);
-		if (!settingsLocker.isLocked()) return;
 		Synth *synth = qsynth.synth;
-		while (!synthControlEvents.isEmpty()) {
-			switch (synthControlEvents.dequeue()) {
+		for (int event = 0; event < SYNTH_CONTROL_EVENT_COUNT; event++) {
+			if (pendingSynthControlEvents[event].fetchAndStoreAcquire(0) == 0) continue;
+			const quint32 value = QAtomicHelper::loadAcquire(synthControlEventValues[event]);
+			switch (SynthControlEvent(event)) {
 			case SYNTH_RESET:
 				writeSystemResetSysex(synth);
 				break;
 			case MASTER_VOLUME_CHANGED:
-				writeMasterVolumeSysex(synth, masterVolume);
+				writeMasterVolumeSysex(synth, int(value));
 				break;
 			case OUTPUT_GAIN_CHANGED:
-				synth->setOutputGain(outputGain);
+				synth->setOutputGain(bitsToFloat(value));
 				break;
 			case REVERB_OUTPUT_GAIN_CHANGED:
-				synth->setReverbOutputGain(reverbOutputGain);
+				synth->setReverbOutputGain(bitsToFloat(value));
 				break;
 			case REVERB_ENABLED_CHANGED:
-				synth->setReverbEnabled(reverbEnabled);
+				synth->setReverbEnabled(value != 0);
 				break;
 			case REVERB_OVERRIDDEN_CHANGED:
-				synth->setReverbOverridden(reverbOverridden);
+				synth->setReverbOverridden(value != 0);
 				break;
 			case REVERB_SETTINGS_CHANGED:
-				overrideReverbSettings(synth, qsynth.reverbMode, qsynth.reverbTime, qsynth.reverbLevel);
+				overrideReverbSettings(synth, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF);
 				break;
 			case REVERSED_STEREO_ENABLED_CHANGED:
-				synth->setReversedStereoEnabled(reversedStereoEnabled);
+				synth->setReversedStereoEnabled(value != 0);
 				break;
 			case NICE_AMP_RAMP_ENABLED_CHANGED:
-				synth->setNiceAmpRampEnabled(niceAmpRampEnabled);
+				synth->setNiceAmpRampEnabled(value != 0);
 				break;
 			case EMU_DAC_INPUT_MODE_CHANGED:
-				synth->setDACInputMode(emuDACInputMode);
+				synth->setDACInputMode(DACInputMode(value));
 				break;
 			case MIDI_DELAY_MODE_CHANGED:
-				synth->setMIDIDelayMode(midiDelayMode);
+				synth->setMIDIDelayMode(MIDIDelayMode(value));
 				break;
 			case MIDI_CHANNELS_ASSIGNMENT_RESET:
-				writeMIDIChannelsAssignmentResetSysex(synth, midiChannelsAssignmentChannel1Engaged);
+				writeMIDIChannelsAssignmentResetSysex(synth, value != 0);
+				break;
+			case PARTIAL_COUNT_CHANGED:
+				synth->resizePartialPool(value);
 				break;
 			}
 		}
@@ -263,9 +353,9 @@ private:
 		synth->getPartialStates(stateSnapshot.partialStates);
 	}
 
-	void enqueueSynthControlEvent(SynthControlEvent value) {
-		synthControlEvents.removeOne(value);
-		synthControlEvents.enqueue(value);
+	void postSynthControlEvent(SynthControlEvent event, quint32 value) {
+		QAtomicHelper::storeRelease(synthControlEventValues[event], value);
+		QAtomicHelper::storeRelease(pendingSynthControlEvents[event], 1);
 	}
 
 	void run() {
@@ -330,6 +420,7 @@ public:
 		niceAmpRampEnabled(qsynth.synth->isNiceAmpRampEnabled()),
 		emuDACInputMode(qsynth.synth->getDACInputMode()),
 		midiDelayMode(qsynth.synth->getMIDIDelayMode()),
+		partialCount(qsynth.synth->getPartialCount()),
 		tempState(),
 		stateSnapshot()
 	{
@@ -365,31 +456,31 @@ public:
 	void setMasterVolume(int useMasterVolume) {
 		QMutexLocker settingsLocker(&settingsMutex);
 		masterVolume = useMasterVolume;
-		enqueueSynthControlEvent(MASTER_VOLUME_CHANGED);
+		postSynthControlEvent(MASTER_VOLUME_CHANGED, masterVolume);
 	}
 
 	void setOutputGain(float useOutputGain) {
 		QMutexLocker settingsLocker(&settingsMutex);
 		outputGain = useOutputGain;
-		enqueueSynthControlEvent(OUTPUT_GAIN_CHANGED);
+		postSynthControlEvent(OUTPUT_GAIN_CHANGED, floatToBits(outputGain));
 	}
 
 	void setReverbOutputGain(float useReverbOutputGain) {
 		QMutexLocker settingsLocker(&settingsMutex);
 		reverbOutputGain = useReverbOutputGain;
-		enqueueSynthControlEvent(REVERB_OUTPUT_GAIN_CHANGED);
+		postSynthControlEvent(REVERB_OUTPUT_GAIN_CHANGED, floatToBits(reverbOutputGain));
 	}
 
 	void setReverbEnabled(bool useReverbEnabled) {
 		QMutexLocker settingsLocker(&settingsMutex);
 		reverbEnabled = useReverbEnabled;
-		enqueueSynthControlEvent(REVERB_ENABLED_CHANGED);
+		postSynthControlEvent(REVERB_ENABLED_CHANGED, reverbEnabled);
 	}
 
 	void setReverbOverridden(bool useReverbOverridden) {
 		QMutexLocker settingsLocker(&settingsMutex);
 		reverbOverridden = useReverbOverridden;
-		enqueueSynthControlEvent(REVERB_OVERRIDDEN_CHANGED);
+		postSynthControlEvent(REVERB_OVERRIDDEN_CHANGED, reverbOverridden);
 	}
 
 	void setReverbSettings(int useReverbMode, int useReverbTime, int useReverbLevel) {
@@ -397,42 +488,48 @@ public:
 		qsynth.reverbMode = useReverbMode;
 		qsynth.reverbTime = useReverbTime;
 		qsynth.reverbLevel = useReverbLevel;
-		enqueueSynthControlEvent(REVERB_SETTINGS_CHANGED);
+		postSynthControlEvent(REVERB_SETTINGS_CHANGED, (quint32(useReverbMode & 0xFF) << 16) | ((useReverbTime & 0xFF) << 8) | (useReverbLevel & 0xFF));
 	}
 
 	void setReversedStereoEnabled(bool useReversedStereoEnabled) {
 		QMutexLocker settingsLocker(&settingsMutex);
 		reversedStereoEnabled = useReversedStereoEnabled;
-		enqueueSynthControlEvent(REVERSED_STEREO_ENABLED_CHANGED);
+		postSynthControlEvent(REVERSED_STEREO_ENABLED_CHANGED, reversedStereoEnabled);
 	}
 
 	void setNiceAmpRampEnabled(bool useNiceAmpRampEnabled) {
 		QMutexLocker settingsLocker(&settingsMutex);
 		niceAmpRampEnabled = useNiceAmpRampEnabled;
-		enqueueSynthControlEvent(NICE_AMP_RAMP_ENABLED_CHANGED);
+		postSynthControlEvent(NICE_AMP_RAMP_ENABLED_CHANGED, niceAmpRampEnabled);
 	}
 
 	void setDACInputMode(DACInputMode useEmuDACInputMode) {
 		QMutexLocker settingsLocker(&settingsMutex);
 		emuDACInputMode = useEmuDACInputMode;
-		enqueueSynthControlEvent(EMU_DAC_INPUT_MODE_CHANGED);
+		postSynthControlEvent(EMU_DAC_INPUT_MODE_CHANGED, emuDACInputMode);
 	}
 
 	void setMIDIDelayMode(MIDIDelayMode useMIDIDelayMode) {
 		QMutexLocker settingsLocker(&settingsMutex);
 		midiDelayMode = useMIDIDelayMode;
-		enqueueSynthControlEvent(MIDI_DELAY_MODE_CHANGED);
+		postSynthControlEvent(MIDI_DELAY_MODE_CHANGED, midiDelayMode);
 	}
 
 	void resetMidiChannelsAssignment(bool useMidiChannelsAssignmentChannel1Engaged) {
 		QMutexLocker settingsLocker(&settingsMutex);
 		midiChannelsAssignmentChannel1Engaged = useMidiChannelsAssignmentChannel1Engaged;
-		enqueueSynthControlEvent(MIDI_CHANNELS_ASSIGNMENT_RESET);
+		postSynthControlEvent(MIDI_CHANNELS_ASSIGNMENT_RESET, midiChannelsAssignmentChannel1Engaged);
+	}
+
+	void setPartialCount(uint usePartialCount) {
+		QMutexLocker settingsLocker(&settingsMutex);
+		partialCount = usePartialCount;
+		postSynthControlEvent(PARTIAL_COUNT_CHANGED, partialCount);
 	}
 
 	void resetSynth() {
 		QMutexLocker settingsLocker(&settingsMutex);
-		enqueueSynthControlEvent(SYNTH_RESET);
+		postSynthControlEvent(SYNTH_RESET, 0);
 	}
 
 	bool playMIDIShortMessageRealtime(Bit32u msg, quint64 timestamp) const {
@@ -445,15 +542,50 @@ public:
 		return midiLocker.isLocked() && qsynth.isOpen() && qsynth.synth->playSysex(sysex, sysexLen, qsynth.convertOutputToSynthTimestamp(timestamp));
 	}
 
-	void renderRealtime(float *buffer, uint length) {
+	bool playMIDIEventsRealtime(QMidiEventSource &eventSource) const {
+		RealtimeLocker midiLocker(*qsynth.midiMutex);
+		if (!midiLocker.isLocked()) return false;
+		qsynth.playMIDIEventsLocked(eventSource);
+		return true;
+	}
+
+	template <class Sample>
+	void renderRealtime(Sample *buffer, uint length) {
 		RealtimeLocker synthLocker(*qsynth.synthMutex);
 		if (synthLocker.isLocked() && qsynth.isOpen()) {
 			applyChangesRealtime();
+			QElapsedTimer renderTimer;
+			renderTimer.start();
 			qsynth.sampleRateConverter->getOutputSamples(buffer, length);
+			polyphonyGovernor.blockRendered(*qsynth.synth, renderTimer.nsecsElapsed(), length, qsynth.outputSampleRate);
+			// A failed recorder is merely ignored here, it is stopped from the GUI thread.
+			if (qsynth.isRecordingAudio()) qsynth.audioRecorder->write(buffer, length);
+			qsynth.updateOutputActivity();
+			saveStateRealtime();
+			qsynth.publishStateSnapshot();
+			renderCompleteCondition.wakeOne();
+		} else {
+			Synth::muteSampleBuffer(buffer, 2 * length);
+		}
+	}
+
+	void renderRealtime(float *leftBuffer, float *rightBuffer, uint length) {
+		RealtimeLocker synthLocker(*qsynth.synthMutex);
+		if (synthLocker.isLocked() && qsynth.isOpen()) {
+			applyChangesRealtime();
+			const StereoOutputDescriptor<float> output = { leftBuffer, rightBuffer, 1, false, 1.0f };
+			QElapsedTimer renderTimer;
+			renderTimer.start();
+			qsynth.sampleRateConverter->getOutputSamples(output, length);
+			polyphonyGovernor.blockRendered(*qsynth.synth, renderTimer.nsecsElapsed(), length, qsynth.outputSampleRate);
+			if (qsynth.isRecordingAudio()) qsynth.audioRecorder->write(leftBuffer, rightBuffer, length);
+			qsynth.updateOutputActivity();
 			saveStateRealtime();
+			qsynth.publishStateSnapshot();
 			renderCompleteCondition.wakeOne();
 		} else {
-			Synth::muteSampleBuffer(buffer, length);
+			Synth::muteSampleBuffer(leftBuffer, length);
+			Synth::muteSampleBuffer(rightBuffer, length);
 		}
 	}
 
@@ -622,8 +754,8 @@ void QReportHandler::doShowLCDMessage(const char *message) {
 
 QSynth::QSynth(QObject *parent) :
 	QObject(parent), state(SynthState_CLOSED), midiMutex(new QMutex), synthMutex(new QMutex),
-	controlROMImage(), pcmROMImage(), reportHandler(this), sampleRateConverter(),
-	audioRecorder(), realtimeHelper()
+	controlROMImage(), pcmROMImage(), previewMode(), minimumPhaseSRC(), reportHandler(this), sampleRateConverter(), outputSampleRate(),
+	outputSRCQuality(), outputMinimumPhaseSRC(), outputTimestampOffset(), streamFrameCount(), outputActive(), audioRecorder(), realtimeHelper(), stateSnapshotSequence(), stateSnapshotEnabled(), stateSnapshot(new SynthStateSnapshot)
 {
 	synth = new Synth(&reportHandler);
 }
@@ -636,6 +768,30 @@ QSynth::~QSynth() {
 	delete synth;
 	delete synthMutex;
 	delete midiMutex;
+	delete stateSnapshot;
+}
+
+void QSynth::setPreviewMode(bool enabled) {
+	previewMode = enabled;
+}
+
+void QSynth::setMinimumPhaseSRC(bool enabled) {
+	minimumPhaseSRC = enabled;
+}
+
+quint32 QSynth::getConversionLatencyFrames() const {
+	if (sampleRateConverter == NULL) return 0;
+	return quint32(sampleRateConverter->getLatency() + 0.5);
+}
+
+uint QSynth::getOutputSampleRate() const {
+	if (sampleRateConverter == NULL) return 0;
+	return outputSampleRate;
+}
+
+QString QSynth::getPreviewApproximations() {
+	return QString("float renderer with fast wave functions, partials culled below TVA level %1 (about -48 dB), "
+		"no analogue low-pass filter, fastest sample rate conversion, reverb tail cut at about -48 dB").arg(int(PREVIEW_PARTIAL_CULLING_LEVEL));
 }
 
 bool QSynth::isOpen() const {
@@ -676,11 +832,40 @@ bool QSynth::playMIDISysex(const Bit8u *sysex, Bit32u sysexLen, quint64 timestam
 	}
 }
 
+// Unlike the single messages, the whole batch is played under one MIDI lock. In realtime mode, when the lock
+// is contended, false is returned and none of the events are taken from the source.
+bool QSynth::playMIDIEvents(QMidiEventSource &eventSource) const {
+	if (isRealtime()) return realtimeHelper->playMIDIEventsRealtime(eventSource);
+	QMutexLocker midiLocker(midiMutex);
+	playMIDIEventsLocked(eventSource);
+	return true;
+}
+
+void QSynth::playMIDIEventsLocked(QMidiEventSource &eventSource) const {
+	const bool open = isOpen();
+	quint32 eventData;
+	const uchar *sysexData;
+	quint64 timestamp;
+	while (eventSource.nextMidiEvent(eventData, sysexData, timestamp)) {
+		if (!open) continue;
+		if (sysexData == NULL) {
+			synth->playMsg(eventData, convertOutputToSynthTimestamp(timestamp));
+		} else {
+			synth->playSysex(sysexData, eventData, convertOutputToSynthTimestamp(timestamp));
+		}
+	}
+}
+
 Bit32u QSynth::convertOutputToSynthTimestamp(quint64 timestamp) const {
-	return Bit32u(sampleRateConverter->convertOutputToSynthTimestamp(timestamp));
+	return Bit32u(sampleRateConverter->convertOutputToSynthTimestamp(double(outputTimestampOffset + timestamp)));
 }
 
 void QSynth::render(Bit16s *buffer, uint length) {
+	streamFrameCount += length;
+	if (isRealtime()) {
+		realtimeHelper->renderRealtime(buffer, length);
+		return;
+	}
 	QMutexLocker synthLocker(synthMutex);
 	if (!isOpen()) {
 		synthLocker.unlock();
@@ -691,14 +876,15 @@ void QSynth::render(Bit16s *buffer, uint length) {
 		return;
 	}
 	sampleRateConverter->getOutputSamples(buffer, length);
-	if (isRecordingAudio()) {
-		if (!audioRecorder->write(buffer, length)) stopRecordingAudio();
-	}
+	if (isRecordingAudio()) audioRecorder->write(buffer, length);
+	updateOutputActivity();
+	publishStateSnapshot();
 	synthLocker.unlock();
 	emit audioBlockRendered();
 }
 
 void QSynth::render(float *buffer, uint length) {
+	streamFrameCount += length;
 	if (isRealtime()) {
 		realtimeHelper->renderRealtime(buffer, length);
 		return;
@@ -713,8 +899,35 @@ void QSynth::render(float *buffer, uint length) {
 		return;
 	}
 	sampleRateConverter->getOutputSamples(buffer, length);
+	if (isRecordingAudio()) audioRecorder->write(buffer, length);
+	updateOutputActivity();
+	publishStateSnapshot();
+	synthLocker.unlock();
+	emit audioBlockRendered();
+}
+
+void QSynth::render(float *leftBuffer, float *rightBuffer, uint length) {
+	streamFrameCount += length;
+	if (isRealtime()) {
+		realtimeHelper->renderRealtime(leftBuffer, rightBuffer, length);
+		return;
+	}
+	QMutexLocker synthLocker(synthMutex);
+	if (!isOpen()) {
+		synthLocker.unlock();
+
+		// Synth is closed, simply erase buffer content
+		Synth::muteSampleBuffer(leftBuffer, length);
+		Synth::muteSampleBuffer(rightBuffer, length);
+		emit audioBlockRendered();
+		return;
+	}
+	const StereoOutputDescriptor<float> output = { leftBuffer, rightBuffer, 1, false, 1.0f };
+	sampleRateConverter->getOutputSamples(output, length);
+	if (isRecordingAudio()) audioRecorder->write(leftBuffer, rightBuffer, length);
+	updateOutputActivity();
+	publishStateSnapshot();
 	synthLocker.unlock();
-	// TODO: Add support for recording to float WAVs
 	emit audioBlockRendered();
 }
 
@@ -740,6 +953,13 @@ bool QSynth::open(uint &targetSampleRate, SamplerateConversionQuality srcQuality
 	if (actualAnalogOutputMode == AnalogOutputMode_ACCURATE && bestAnalogOutputMode == AnalogOutputMode_OVERSAMPLED) {
 		actualAnalogOutputMode = bestAnalogOutputMode;
 	}
+	if (previewMode) {
+		synthProfile.rendererType = RendererType_FLOAT;
+		synthProfile.analogOutputMode = AnalogOutputMode_DIGITAL_ONLY;
+		actualAnalogOutputMode = AnalogOutputMode_DIGITAL_ONLY;
+		srcQuality = SamplerateConversionQuality_FASTEST;
+		qDebug() << "Using preview mode:" << getPreviewApproximations();
+	}
 	setRendererType(synthProfile.rendererType);
 
 	static const char *ANALOG_OUTPUT_MODES[] = {"Digital only", "Coarse", "Accurate", "Oversampled2x"};
@@ -749,13 +969,27 @@ bool QSynth::open(uint &targetSampleRate, SamplerateConversionQuality srcQuality
 
 	targetSampleRate = SampleRateConverter::getSupportedOutputSampleRate(targetSampleRate);
 
+	// The polyphony governor starts anew with each stream.
+	synth->setPartialLimit(0);
+	synth->setDegradationLevel(DegradationLevel_NONE);
+	synth->setPartialCullingLevel(previewMode ? PREVIEW_PARTIAL_CULLING_LEVEL : 0);
+	synth->setFloatWaveAccuracy(previewMode ? FloatWaveAccuracy_FAST : FloatWaveAccuracy_REFERENCE);
+	synth->setReverbSilenceThreshold(previewMode ? PREVIEW_REVERB_SILENCE_THRESHOLD : 0.0f);
+	// Spare partials are preallocated, so that the partial count can be changed later without reopening.
+	synth->setMaxPartialCount(MAX_PARTIAL_COUNT);
+	synth->setMIDIEventQueueSize(MIDI_EVENT_QUEUE_SIZE);
 	if (synth->open(*controlROMImage, *pcmROMImage, Bit32u(synthProfile.partialCount), actualAnalogOutputMode)) {
 		setState(SynthState_OPEN);
 		reportHandler.onDeviceReconfig();
 		setSynthProfile(synthProfile, synthProfileName);
 		if (engageChannel1OnOpen) resetMIDIChannelsAssignment(true);
 		if (targetSampleRate == 0) targetSampleRate = getSynthSampleRate();
-		sampleRateConverter = new SampleRateConverter(*synth, targetSampleRate, srcQuality);
+		sampleRateConverter = new SampleRateConverter(*synth, targetSampleRate, srcQuality, false, minimumPhaseSRC);
+		outputSampleRate = targetSampleRate;
+		outputSRCQuality = srcQuality;
+		outputMinimumPhaseSRC = minimumPhaseSRC;
+		outputTimestampOffset = 0;
+		streamFrameCount = 0;
 		return true;
 	}
 	delete synth;
@@ -892,6 +1126,12 @@ void QSynth::setRendererType(RendererType useRendererType) {
 
 void QSynth::setPartialCount(int newPartialCount) {
 	partialCount = qBound(MIN_PARTIAL_COUNT, newPartialCount, MAX_PARTIAL_COUNT);
+	if (isRealtime()) {
+		realtimeHelper->setPartialCount(partialCount);
+	} else {
+		QMutexLocker synthLocker(synthMutex);
+		if (isOpen()) synth->resizePartialPool(partialCount);
+	}
 }
 
 const QString QSynth::getPatchName(int partNum) const {
@@ -933,6 +1173,36 @@ uint QSynth::getPartialCount() const {
 	return synth->getPartialCount();
 }
 
+void QSynth::setStateSnapshotEnabled(bool enabled) const {
+	QAtomicHelper::storeRelease(stateSnapshotEnabled, enabled ? 1 : 0);
+}
+
+// Invoked by the rendering thread with synthMutex locked, so there is only one writer at a time.
+void QSynth::publishStateSnapshot() {
+	if (QAtomicHelper::loadRelaxed(stateSnapshotEnabled) == 0) return;
+	stateSnapshotSequence.fetchAndAddOrdered(1);
+	stateSnapshot->partialCount = synth->getPartialCount();
+	synth->getPartialStates(stateSnapshot->partialStates);
+	synth->getPartStates(stateSnapshot->partStates);
+	for (uint partIx = 0; partIx < SynthStateSnapshot::PART_COUNT; partIx++) {
+		stateSnapshot->playingNotesCount[partIx] = synth->getPlayingNotes(partIx, stateSnapshot->keysOfPlayingNotes[partIx], stateSnapshot->velocitiesOfPlayingNotes[partIx]);
+	}
+	stateSnapshotSequence.fetchAndAddRelease(1);
+}
+
+bool QSynth::getStateSnapshot(SynthStateSnapshot &snapshot) const {
+	// Rather than spinning against the rendering thread, give up after a few attempts and let the caller retry later.
+	for (int attempt = 0; attempt < 3; attempt++) {
+		quint32 sequence = QAtomicHelper::loadAcquire(stateSnapshotSequence);
+		if (sequence == 0) return false;
+		if ((sequence & 1) != 0) continue;
+		memcpy(&snapshot, stateSnapshot, sizeof(SynthStateSnapshot));
+		// The full barrier prevents the copying from being reordered past the sequence check.
+		if (quint32(stateSnapshotSequence.fetchAndAddOrdered(0)) == sequence) return true;
+	}
+	return false;
+}
+
 uint QSynth::getSynthSampleRate() const {
 	return synth->getStereoOutputSampleRate();
 }
@@ -942,6 +1212,15 @@ bool QSynth::isActive() const {
 	return isOpen() && synth->isActive();
 }
 
+bool QSynth::isOutputActive() const {
+	return QAtomicHelper::loadAcquire(outputActive) != 0;
+}
+
+// Only called from the rendering thread with the synth locked.
+void QSynth::updateOutputActivity() {
+	QAtomicHelper::storeRelease(outputActive, synth->isActive() ? 1 : 0);
+}
+
 void QSynth::reset() const {
 	if (isRealtime()) {
 		realtimeHelper->resetSynth();
@@ -971,6 +1250,29 @@ void QSynth::setState(SynthState newState) {
 	emit stateChanged(newState);
 }
 
+bool QSynth::restartOutput(uint &targetSampleRate, SamplerateConversionQuality srcQuality) {
+	QMutexLocker midiLocker(midiMutex);
+	QMutexLocker synthLocker(synthMutex);
+	if (!isOpen()) return false;
+	targetSampleRate = SampleRateConverter::getSupportedOutputSampleRate(targetSampleRate);
+	if (targetSampleRate == 0) targetSampleRate = getSynthSampleRate();
+	if (targetSampleRate == outputSampleRate && srcQuality == outputSRCQuality && minimumPhaseSRC == outputMinimumPhaseSRC) {
+		// The new stream continues where the previous one stopped requesting frames from the converter.
+		outputTimestampOffset += streamFrameCount;
+	} else {
+		qDebug() << "QSynth: Recreating sample rate converter for" << targetSampleRate << "Hz";
+		delete sampleRateConverter;
+		sampleRateConverter = new SampleRateConverter(*synth, targetSampleRate, srcQuality, false, minimumPhaseSRC);
+		outputSampleRate = targetSampleRate;
+		outputSRCQuality = srcQuality;
+		outputMinimumPhaseSRC = minimumPhaseSRC;
+		// The new converter starts consuming the synth output from the current position.
+		outputTimestampOffset = quint64(sampleRateConverter->convertSynthToOutputTimestamp(synth->getInternalRenderedSampleCount()));
+	}
+	streamFrameCount = 0;
+	return true;
+}
+
 void QSynth::close() {
 	if (!isOpen()) return;
 	setState(SynthState_CLOSING);
@@ -1025,9 +1327,9 @@ void QSynth::setSynthProfile(const SynthProfile &synthProfile, QString useSynthP
 	pcmROMFileName = synthProfile.pcmROMFileName;
 	setAnalogOutputMode(synthProfile.analogOutputMode);
 	setRendererType(synthProfile.rendererType);
-	setPartialCount(synthProfile.partialCount);
 
 	// Settings below take effect immediately.
+	setPartialCount(synthProfile.partialCount);
 	setReverbCompatibilityMode(synthProfile.reverbCompatibilityMode);
 	setMIDIDelayMode(synthProfile.midiDelayMode);
 	setDACInputMode(synthProfile.emuDACInputMode);
@@ -1050,30 +1352,29 @@ void QSynth::getROMImages(const ROMImage *&cri, const ROMImage *&pri) const {
 
 void QSynth::freeROMImages() {
 	// Ensure our ROM images get freed even if the synth is still in use
-	const ROMImage *cri = controlROMImage;
-	controlROMImage = NULL;
-	const ROMImage *pri = pcmROMImage;
-	pcmROMImage = NULL;
-	Master::getInstance()->freeROMImages(cri, pri);
+	Master::getInstance()->freeROMImages(controlROMImage, pcmROMImage);
 }
 
 const QReportHandler *QSynth::getReportHandler() const {
 	return &reportHandler;
 }
 
+// The file is only written in the recorder thread, so the synth is merely locked to swap the recorder.
 void QSynth::startRecordingAudio(const QString &fileName) {
 	QMutexLocker synthLocker(synthMutex);
-	if (isRecordingAudio()) delete audioRecorder;
-	audioRecorder = new AudioFileWriter(sampleRateConverter->convertSynthToOutputTimestamp(SAMPLE_RATE), fileName);
-	audioRecorder->open();
+	AudioFileRecorder *previousRecorder = audioRecorder;
+	audioRecorder = new AudioFileRecorder(sampleRateConverter->convertSynthToOutputTimestamp(SAMPLE_RATE), fileName);
+	connect(audioRecorder, SIGNAL(recordingFailed()), SLOT(stopRecordingAudio()), Qt::QueuedConnection);
+	synthLocker.unlock();
+	delete previousRecorder;
 }
 
 void QSynth::stopRecordingAudio() {
 	QMutexLocker synthLocker(synthMutex);
-	if (!isRecordingAudio()) return;
-	audioRecorder->close();
-	delete audioRecorder;
+	AudioFileRecorder *stoppedRecorder = audioRecorder;
 	audioRecorder = NULL;
+	synthLocker.unlock();
+	delete stoppedRecorder;
 }
 
 bool QSynth::isRecordingAudio() const {
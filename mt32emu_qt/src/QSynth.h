@@ -4,10 +4,21 @@
 #include <QtCore>
 #include <mt32emu/mt32emu.h>
 
-class AudioFileWriter;
+class AudioFileRecorder;
 class RealtimeHelper;
 class QSynth;
 
+// Supplies a sequence of timestamped MIDI messages to be played by QSynth::playMIDIEvents() in one go.
+class QMidiEventSource {
+public:
+	// Returns false when there are no more events. For a short message, sysexData is set to NULL.
+	// The returned data must stay valid until the next call.
+	virtual bool nextMidiEvent(quint32 &eventData, const uchar *&sysexData, quint64 &timestamp) = 0;
+
+protected:
+	~QMidiEventSource() {}
+};
+
 enum SynthState {
 	SynthState_CLOSED,
 	SynthState_OPEN,
@@ -42,6 +53,20 @@ struct SynthProfile {
 	bool niceAmpRamp;
 };
 
+// Compact copy of the synth state shown by the synth state monitor.
+// It is published by the rendering thread after each audio block and can be read without locking the synth.
+struct SynthStateSnapshot {
+	static const uint MAX_PARTIAL_COUNT = 256;
+	static const uint PART_COUNT = 9;
+
+	uint partialCount;
+	MT32Emu::PartialState partialStates[MAX_PARTIAL_COUNT];
+	bool partStates[PART_COUNT];
+	uint playingNotesCount[PART_COUNT];
+	MT32Emu::Bit8u keysOfPlayingNotes[PART_COUNT][MAX_PARTIAL_COUNT];
+	MT32Emu::Bit8u velocitiesOfPlayingNotes[PART_COUNT][MAX_PARTIAL_COUNT];
+};
+
 class QReportHandler : public QObject, public MT32Emu::ReportHandler {
 	Q_OBJECT
 
@@ -109,19 +134,39 @@ private:
 	MT32Emu::AnalogOutputMode analogOutputMode;
 	ReverbCompatibilityMode reverbCompatibilityMode;
 	bool engageChannel1OnOpen;
+	bool previewMode;
+	bool minimumPhaseSRC;
 
 	MT32Emu::Synth *synth;
 	QReportHandler reportHandler;
 	QString synthProfileName;
 
 	MT32Emu::SampleRateConverter *sampleRateConverter;
-	AudioFileWriter *audioRecorder;
+	uint outputSampleRate;
+	MT32Emu::SamplerateConversionQuality outputSRCQuality;
+	bool outputMinimumPhaseSRC;
+	// The MIDI timestamps of each audio stream start from 0, while the synth continues its timeline when the stream is restarted.
+	// The offset maps the stream timestamps to the output timeline of the sample rate converter.
+	quint64 outputTimestampOffset;
+	// Frames requested by the current audio stream so far, only accessed in the rendering thread while the stream runs.
+	quint64 streamFrameCount;
+	// Whether the synth remained active after the last block rendered, see isOutputActive().
+	QAtomicInt outputActive;
+	AudioFileRecorder *audioRecorder;
 
 	RealtimeHelper *realtimeHelper;
 
+	// Guards stateSnapshot in the manner of a seqlock: odd values indicate that the snapshot is being written.
+	mutable QAtomicInt stateSnapshotSequence;
+	mutable QAtomicInt stateSnapshotEnabled;
+	SynthStateSnapshot *stateSnapshot;
+
 	void setState(SynthState newState);
+	void publishStateSnapshot();
+	void updateOutputActivity();
 	void freeROMImages();
 	MT32Emu::Bit32u convertOutputToSynthTimestamp(quint64 timestamp) const;
+	void playMIDIEventsLocked(QMidiEventSource &eventSource) const;
 
 public:
 	explicit QSynth(QObject *parent = NULL);
@@ -129,17 +174,35 @@ public:
 	bool isOpen() const;
 	bool open(uint &targetSampleRate, MT32Emu::SamplerateConversionQuality srcQuality = MT32Emu::SamplerateConversionQuality_GOOD, const QString useSynthProfileName = "");
 	void close();
+	// Prepares the open synth for a new audio stream, which replaces the previous one that must be stopped by now.
+	// The synth state is retained, and the sample rate converter is only recreated if the sample rate or the conversion
+	// settings change. Returns false if the synth is not open.
+	bool restartOutput(uint &targetSampleRate, MT32Emu::SamplerateConversionQuality srcQuality);
 	void reset() const;
 	bool isRealtime() const;
 	void enableRealtime();
+	// Makes subsequent calls to open() select a deliberately cheap pipeline, trading emulation accuracy for speed
+	// when converted files are only auditioned. The approximations used are described by getPreviewApproximations().
+	void setPreviewMode(bool enabled);
+	static QString getPreviewApproximations();
+	// Makes subsequent calls to open() use minimum-phase sample rate conversion filters with lower latency.
+	void setMinimumPhaseSRC(bool enabled);
+	// Returns the delay introduced by the sample rate converter in output frames, 0 if the synth isn't open.
+	quint32 getConversionLatencyFrames() const;
+	// Returns the sample rate the synth output is converted to, 0 if the synth isn't open.
+	// No conversion takes place when it equals getSynthSampleRate().
+	uint getOutputSampleRate() const;
 
 	void flushMIDIQueue() const;
 	void playMIDIShortMessageNow(MT32Emu::Bit32u msg) const;
 	void playMIDISysexNow(const MT32Emu::Bit8u *sysex, MT32Emu::Bit32u sysexLen) const;
 	bool playMIDIShortMessage(MT32Emu::Bit32u msg, quint64 timestamp) const;
 	bool playMIDISysex(const MT32Emu::Bit8u *sysex, MT32Emu::Bit32u sysexLen, quint64 timestamp) const;
+	bool playMIDIEvents(QMidiEventSource &eventSource) const;
 	void render(MT32Emu::Bit16s *buffer, uint length);
 	void render(float *buffer, uint length);
+	// Renders directly into a pair of planar buffers, e.g. provided by the audio API.
+	void render(float *leftBuffer, float *rightBuffer, uint length);
 
 	const QReportHandler *getReportHandler() const;
 
@@ -169,13 +232,23 @@ public:
 	void getPartialStates(MT32Emu::PartialState *partialStates) const;
 	uint getPlayingNotes(unsigned int partNumber, MT32Emu::Bit8u *keys, MT32Emu::Bit8u *velocities) const;
 	uint getPartialCount() const;
+	void setStateSnapshotEnabled(bool enabled) const;
+	// Copies the state snapshot published after the last rendered audio block. Never blocks the rendering thread.
+	// Returns false when no consistent snapshot is available at the moment.
+	bool getStateSnapshot(SynthStateSnapshot &snapshot) const;
 	uint getSynthSampleRate() const;
 	bool isActive() const;
+	// Same as isActive() but evaluated by the rendering thread after each block, so it never waits for the synth.
+	// It is updated while the audio stream runs and returns false before the first block is rendered.
+	bool isOutputActive() const;
 
 	void startRecordingAudio(const QString &fileName);
-	void stopRecordingAudio();
 	bool isRecordingAudio() const;
 
+public slots:
+	// Also invoked when the recording fails.
+	void stopRecordingAudio();
+
 signals:
 	void stateChanged(SynthState state);
 	void audioBlockRendered() const;
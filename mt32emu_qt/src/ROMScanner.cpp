@@ -0,0 +1,105 @@
+/* Copyright (C) 2011-2019 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include <mt32emu/mt32emu.h>
+
+#include "ROMScanner.h"
+#include "Master.h"
+
+using namespace MT32Emu;
+
+static const QString CACHE_KEY = "Master/ROMInfoCache";
+
+ROMScanner::ROMScanner() : cacheChanged(), cancelled() {
+	cache = Master::getInstance()->getSettings()->value(CACHE_KEY).toMap();
+	connect(this, SIGNAL(finished()), SLOT(storeCache()));
+}
+
+ROMScanner::~ROMScanner() {
+	cancel();
+	storeCache();
+}
+
+void ROMScanner::scan(const QDir &useROMDir, const QStringList &useFileFilter) {
+	cancel();
+	// The cache is only accessed by the UI thread while the scanning thread isn't running.
+	storeCache();
+	romDir = useROMDir;
+	fileFilter = useFileFilter;
+	cancelled = false;
+	start(QThread::LowPriority);
+}
+
+void ROMScanner::cancel() {
+	cancelled = true;
+	wait();
+}
+
+void ROMScanner::storeCache() {
+	if (!cacheChanged || isRunning()) return;
+	cacheChanged = false;
+	Master::getInstance()->getSettings()->setValue(CACHE_KEY, cache);
+}
+
+const ROMInfo *ROMScanner::findROMInfo(const QString &sha1Digest) {
+	const QByteArray digest = sha1Digest.toLatin1();
+	const ROMInfo **romInfoList = ROMInfo::getROMInfoList(0xFF, 0xFF);
+	const ROMInfo *romInfo = NULL;
+	for (const ROMInfo **it = romInfoList; *it != NULL; it++) {
+		if (strcmp((*it)->sha1Digest, digest.constData()) == 0) {
+			romInfo = *it;
+			break;
+		}
+	}
+	ROMInfo::freeROMInfoList(romInfoList);
+	return romInfo;
+}
+
+void ROMScanner::run() {
+	const QString dirPath = romDir.absolutePath();
+	const QStringList dirEntries = romDir.entryList(fileFilter);
+	for (QStringListIterator it(dirEntries); it.hasNext();) {
+		if (cancelled) return;
+		const QString fileName = it.next();
+		const QFileInfo fileInfo(romDir, fileName);
+		const QString fileSize = QString::number(fileInfo.size());
+		const QString fileTime = QString::number(fileInfo.lastModified().toTime_t());
+		QStringList cacheEntry = cache.value(fileInfo.absoluteFilePath()).toStringList();
+		if (cacheEntry.size() != 3 || cacheEntry.at(0) != fileSize || cacheEntry.at(1) != fileTime) {
+			FileStream file;
+			if (!file.open(Master::getROMPathName(romDir, fileName).toLocal8Bit())) continue;
+			const ROMInfo *romInfo = ROMInfo::getROMInfo(&file);
+			cacheEntry.clear();
+			cacheEntry << fileSize << fileTime << (romInfo == NULL ? QString() : QString(romInfo->sha1Digest));
+			ROMInfo::freeROMInfo(romInfo);
+			cache.insert(fileInfo.absoluteFilePath(), cacheEntry);
+			cacheChanged = true;
+		}
+		if (!cacheEntry.at(2).isEmpty()) emit romFound(fileName, cacheEntry.at(2));
+	}
+
+	// Forget the files removed from the directory, so that the cache doesn't grow indefinitely.
+	QMutableMapIterator<QString, QVariant> cacheIt(cache);
+	while (cacheIt.hasNext()) {
+		const QFileInfo cachedFileInfo(cacheIt.next().key());
+		if (cachedFileInfo.absolutePath() == dirPath && !cachedFileInfo.exists()) {
+			cacheIt.remove();
+			cacheChanged = true;
+		}
+	}
+}
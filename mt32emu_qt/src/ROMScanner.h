@@ -0,0 +1,46 @@
+#ifndef ROM_SCANNER_H
+#define ROM_SCANNER_H
+
+#include <QtCore>
+
+namespace MT32Emu {
+struct ROMInfo;
+}
+
+// Identifies the ROM files in a directory in a background thread, so that slow (e.g. network-mounted) directories
+// don't block the UI. The SHA1 digests are cached in the settings by the file path, size and modification time,
+// so that only the files changed since the previous scan need reading. The ROMs found are reported as they come.
+class ROMScanner : public QThread {
+	Q_OBJECT
+
+public:
+	ROMScanner();
+	~ROMScanner();
+
+	// Cancels the scan in progress, if any, and starts scanning the directory anew.
+	void scan(const QDir &romDir, const QStringList &fileFilter);
+	void cancel();
+
+	// Resolves the ROMInfo reported by romFound() without reading the file. Returns NULL for an unknown digest.
+	static const MT32Emu::ROMInfo *findROMInfo(const QString &sha1Digest);
+
+signals:
+	// Emitted for each known ROM in the directory, in the directory listing order.
+	void romFound(const QString &fileName, const QString &sha1Digest);
+
+private:
+	QDir romDir;
+	QStringList fileFilter;
+	// Maps an absolute file path to a list of its size, modification time and SHA1 digest.
+	// The digest is empty for the files that aren't known ROMs.
+	QVariantMap cache;
+	bool cacheChanged;
+	volatile bool cancelled;
+
+	void run();
+
+private slots:
+	void storeCache();
+};
+
+#endif // ROM_SCANNER_H
@@ -35,6 +35,7 @@ ROMSelectionDialog::ROMSelectionDialog(SynthProfile &useSynthProfile, QWidget *p
 		synthProfile(useSynthProfile)
 {
 	ui->setupUi(this);
+	connect(&romScanner, SIGNAL(romFound(const QString &, const QString &)), SLOT(handleROMFound(const QString &, const QString &)));
 
 	QStringList fileFilter;
 
@@ -54,6 +55,7 @@ ROMSelectionDialog::ROMSelectionDialog(SynthProfile &useSynthProfile, QWidget *p
 }
 
 ROMSelectionDialog::~ROMSelectionDialog() {
+	romScanner.cancel();
 	delete ui;
 }
 
@@ -79,92 +81,88 @@ void ROMSelectionDialog::clearButtonGroup(QButtonGroup &group) {
 }
 
 void ROMSelectionDialog::refreshROMInfos() {
-	QString controlROMFileName = synthProfile.controlROMFileName;
-	QString pcmROMFileName = synthProfile.pcmROMFileName;
+	romScanner.cancel();
+	// Drop the results of the cancelled scan still queued to the dialog.
+	QCoreApplication::removePostedEvents(this, QEvent::MetaCall);
 
 	clearButtonGroup(controlROMGroup);
 	clearButtonGroup(pcmROMGroup);
 	controlROMRow = -1;
 	pcmROMRow = -1;
 
-	QStringList fileFilter = ui->fileFilterCombo->itemData(ui->fileFilterCombo->currentIndex()).value<QStringList>();
-	QStringList dirEntries = synthProfile.romDir.entryList(fileFilter);
 	ui->romInfoTable->clearContents();
-	ui->romInfoTable->setRowCount(dirEntries.size());
-
-	int row = 0;
-	for (QStringListIterator it(dirEntries); it.hasNext();) {
-		QString fileName = it.next();
-		FileStream file;
-		if (!file.open(Master::getROMPathName(synthProfile.romDir, fileName).toLocal8Bit())) continue;
-		const ROMInfo *romInfoPtr = ROMInfo::getROMInfo(&file);
-		if (romInfoPtr == NULL) continue;
-		const ROMInfo &romInfo = *romInfoPtr;
-
-		QButtonGroup *romGroup;
-		QString romType;
-		switch (romInfo.type) {
-			case ROMInfo::PCM:
-				romType = QString("PCM");
-				romGroup = &pcmROMGroup;
-				if (pcmROMRow == -1) pcmROMRow = row;
-				break;
-			case ROMInfo::Control:
-				romType = QString("Control");
-				romGroup = &controlROMGroup;
-				if (controlROMRow == -1) controlROMRow = row;
-				break;
-			case ROMInfo::Reverb:
-				romType = QString("Reverb");
-				romGroup = NULL;
-				break;
-			default:
-				MT32Emu::ROMInfo::freeROMInfo(romInfoPtr);
-				continue;
-		}
-
-		if (fileName == controlROMFileName) {
-			controlROMRow = row;
-		} else if (fileName == pcmROMFileName) {
-			pcmROMRow = row;
-		}
-
-		int column = 0;
-		QCheckBox *checkBox = new QCheckBox();
-		if (romInfo.type != ROMInfo::Reverb) {
-			romGroup->addButton(checkBox);
-			romGroup->setId(checkBox, row);
-		} else checkBox->setDisabled(true);
-		ui->romInfoTable->setCellWidget(row, column++, checkBox);
-
-		if (controlROMRow == row || pcmROMRow == row) {
-			checkBox->setChecked(true);
-		}
-
-		QTableWidgetItem *item = new QTableWidgetItem(fileName);
-		item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
-		ui->romInfoTable->setItem(row, column++, item);
-
-		item = new QTableWidgetItem(QString(romInfo.shortName));
-		item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
-		ui->romInfoTable->setItem(row, column++, item);
-
-		item = new QTableWidgetItem(QString(romInfo.description));
-		item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
-		ui->romInfoTable->setItem(row, column++, item);
-
-		item = new QTableWidgetItem(romType);
-		item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
-		ui->romInfoTable->setItem(row, column++, item);
-
-		item = new QTableWidgetItem(QString(romInfo.sha1Digest));
-		item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
-		ui->romInfoTable->setItem(row, column++, item);
-
-		MT32Emu::ROMInfo::freeROMInfo(romInfoPtr);
-		row++;
+	ui->romInfoTable->setRowCount(0);
+
+	QStringList fileFilter = ui->fileFilterCombo->itemData(ui->fileFilterCombo->currentIndex()).value<QStringList>();
+	romScanner.scan(synthProfile.romDir, fileFilter);
+}
+
+void ROMSelectionDialog::handleROMFound(const QString &fileName, const QString &sha1Digest) {
+	const ROMInfo *romInfoPtr = ROMScanner::findROMInfo(sha1Digest);
+	if (romInfoPtr == NULL) return;
+	const ROMInfo &romInfo = *romInfoPtr;
+
+	int row = ui->romInfoTable->rowCount();
+	QButtonGroup *romGroup;
+	QString romType;
+	switch (romInfo.type) {
+		case ROMInfo::PCM:
+			romType = QString("PCM");
+			romGroup = &pcmROMGroup;
+			if (pcmROMRow == -1) pcmROMRow = row;
+			break;
+		case ROMInfo::Control:
+			romType = QString("Control");
+			romGroup = &controlROMGroup;
+			if (controlROMRow == -1) controlROMRow = row;
+			break;
+		case ROMInfo::Reverb:
+			romType = QString("Reverb");
+			romGroup = NULL;
+			break;
+		default:
+			return;
+	}
+
+	if (fileName == synthProfile.controlROMFileName) {
+		controlROMRow = row;
+	} else if (fileName == synthProfile.pcmROMFileName) {
+		pcmROMRow = row;
 	}
-	ui->romInfoTable->setRowCount(row);
+
+	ui->romInfoTable->setRowCount(row + 1);
+	int column = 0;
+	QCheckBox *checkBox = new QCheckBox();
+	if (romInfo.type != ROMInfo::Reverb) {
+		romGroup->addButton(checkBox);
+		romGroup->setId(checkBox, row);
+	} else checkBox->setDisabled(true);
+	ui->romInfoTable->setCellWidget(row, column++, checkBox);
+
+	if (controlROMRow == row || pcmROMRow == row) {
+		checkBox->setChecked(true);
+	}
+
+	QTableWidgetItem *item = new QTableWidgetItem(fileName);
+	item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+	ui->romInfoTable->setItem(row, column++, item);
+
+	item = new QTableWidgetItem(QString(romInfo.shortName));
+	item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+	ui->romInfoTable->setItem(row, column++, item);
+
+	item = new QTableWidgetItem(QString(romInfo.description));
+	item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+	ui->romInfoTable->setItem(row, column++, item);
+
+	item = new QTableWidgetItem(romType);
+	item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+	ui->romInfoTable->setItem(row, column++, item);
+
+	item = new QTableWidgetItem(QString(romInfo.sha1Digest));
+	item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+	ui->romInfoTable->setItem(row, column++, item);
+
 	ui->romInfoTable->resizeColumnsToContents();
 }
 
@@ -5,6 +5,8 @@
 #include <QButtonGroup>
 #include <QDir>
 
+#include "ROMScanner.h"
+
 namespace Ui {
 	class ROMSelectionDialog;
 }
@@ -25,6 +27,8 @@ private:
 	QButtonGroup controlROMGroup;
 	QButtonGroup pcmROMGroup;
 
+	ROMScanner romScanner;
+
 	SynthProfile &synthProfile;
 	int controlROMRow;
 	int pcmROMRow;
@@ -34,6 +38,7 @@ private:
 	void refreshROMInfos();
 
 private slots:
+	void handleROMFound(const QString &fileName, const QString &sha1Digest);
 	void on_romDirButton_clicked();
 	void on_refreshButton_clicked();
 	void on_fileFilterCombo_currentIndexChanged(int);
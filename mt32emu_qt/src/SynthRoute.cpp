@@ -20,19 +20,109 @@
  *  - Initial setup
  *  - Sample rate changes
  *  - Pausing/unpausing when the QSynth becomes unavailable (NYI)
+ *  - Stopping the audio stream while the synth is idle (standby)
  * - Maintaining a list of MIDI sessions for the synth
  * - Merging MIDI streams coming from several MIDI sessions
  */
 
+#include <algorithm>
 #include <climits>
 
 #include "SynthRoute.h"
+#include "Master.h"
 #include "MidiSession.h"
+#include "QAtomicHelper.h"
 #include "QMidiBuffer.h"
 #include "audiodrv/AudioDriver.h"
 
 using namespace MT32Emu;
 
+namespace {
+
+struct MidiStreamHead {
+	quint64 timestamp;
+	int sessionIx;
+	QMidiBuffer *midiBuffer;
+};
+
+// Inverts the order for the std heap functions, so that the earliest event is on top.
+// Simultaneous events are taken from the session connected first.
+bool isEventLater(const MidiStreamHead &a, const MidiStreamHead &b) {
+	if (a.timestamp != b.timestamp) return a.timestamp > b.timestamp;
+	return a.sessionIx > b.sessionIx;
+}
+
+// Merges the MIDI streams of several sessions in the timestamp order, maintaining a min-heap of the stream heads.
+// An event is only consumed from its buffer upon the following call, as its data must stay valid till then.
+class MidiStreamMerger : public QMidiEventSource {
+public:
+	explicit MidiStreamMerger(quint64 useEndTimestamp) : endTimestamp(useEndTimestamp), topEventTaken(false) {}
+
+	void addStream(QMidiBuffer *midiBuffer, int sessionIx) {
+		if (!midiBuffer->retieveEvents()) return;
+		MidiStreamHead head = { midiBuffer->getEventTimestamp(), sessionIx, midiBuffer };
+		if (head.timestamp >= endTimestamp) return;
+		heads.append(head);
+		std::push_heap(heads.data(), heads.data() + heads.size(), isEventLater);
+	}
+
+	bool isEmpty() const {
+		return heads.isEmpty();
+	}
+
+	bool nextMidiEvent(quint32 &eventData, const uchar *&sysexData, quint64 &timestamp) {
+		if (topEventTaken) advanceTopStream();
+		if (heads.isEmpty()) return false;
+		const MidiStreamHead &top = heads[0];
+		eventData = top.midiBuffer->getEventData(sysexData);
+		timestamp = top.timestamp;
+		topEventTaken = true;
+		return true;
+	}
+
+private:
+	const quint64 endTimestamp;
+	QVarLengthArray<MidiStreamHead, 16> heads;
+	bool topEventTaken;
+
+	void advanceTopStream() {
+		topEventTaken = false;
+		MidiStreamHead *heapEnd = heads.data() + heads.size();
+		std::pop_heap(heads.data(), heapEnd, isEventLater);
+		MidiStreamHead &head = heapEnd[-1];
+		if (head.midiBuffer->nextEvent()) {
+			head.timestamp = head.midiBuffer->getEventTimestamp();
+			if (head.timestamp < endTimestamp) {
+				std::push_heap(heads.data(), heapEnd, isEventLater);
+				return;
+			}
+		}
+		heads.removeLast();
+	}
+};
+
+// The level of the first non-silent sample of the latency probe, about -40 dBFS.
+const float LATENCY_PROBE_ONSET_LEVEL = 0.01f;
+const int LATENCY_PROBE_ONSET_LEVEL_INT = 328;
+
+inline bool isLatencyProbeOnset(Bit16s sample) {
+	return qAbs(int(sample)) >= LATENCY_PROBE_ONSET_LEVEL_INT;
+}
+
+inline bool isLatencyProbeOnset(float sample) {
+	return qAbs(sample) >= LATENCY_PROBE_ONSET_LEVEL;
+}
+
+template <class Sample>
+uint findLatencyProbeOnset(const Sample *samples, uint stride, uint startFrame, uint endFrame) {
+	for (uint frame = startFrame; frame < endFrame; frame++) {
+		if (isLatencyProbeOnset(samples[frame * stride])) return frame;
+	}
+	return endFrame;
+}
+
+} // namespace
+
 SynthRoute::SynthRoute(QObject *parent) :
 	QObject(parent),
 	state(SynthRouteState_CLOSED),
@@ -41,8 +131,16 @@ SynthRoute::SynthRoute(QObject *parent) :
 	multiMidiMode(),
 	audioDevice(NULL),
 	audioStream(NULL),
-	debugLastEventTimestamp(0)
+	debugLastEventTimestamp(0),
+	latencyProbeState(LatencyProbeState_IDLE),
+	standbyTimeoutFrames(),
+	standbyIdleFrames(),
+	standbyIdleMidiEventCount(),
+	midiEventCount(),
+	standby()
 {
+	// Disabled by default, the route then streams silence while idle as long as it is open.
+	standbyTimeoutSeconds = Master::getInstance()->getSettings()->value("Master/AudioStandbyTimeout", 0).toUInt();
 	connect(&qSynth, SIGNAL(stateChanged(SynthState)), SLOT(handleQSynthState(SynthState)));
 }
 
@@ -52,7 +150,11 @@ SynthRoute::~SynthRoute() {
 
 void SynthRoute::setAudioDevice(const AudioDevice *newAudioDevice) {
 	audioDevice = newAudioDevice;
-	close();
+	if (state != SynthRouteState_OPEN || !restartAudioStream()) close();
+}
+
+const AudioDevice *SynthRoute::getAudioDevice() const {
+	return audioDevice;
 }
 
 void SynthRoute::setState(SynthRouteState newState) {
@@ -76,19 +178,22 @@ bool SynthRoute::open(AudioStreamFactory audioStreamFactory) {
 	setState(SynthRouteState_OPENING);
 	if (audioDevice != NULL) {
 		uint sampleRate = audioDevice->driver.getAudioSettings().sampleRate;
-		if (qSynth.open(sampleRate, audioDevice->driver.getAudioSettings().srcQuality)) {
-			double debugDeltaMean = sampleRate * (8.0 / MasterClock::MILLIS_PER_SECOND);
-			double debugDeltaLimit = debugDeltaMean * 0.01;
-			debugDeltaLowerLimit = qint64(floor(debugDeltaMean - debugDeltaLimit));
-			debugDeltaUpperLimit = qint64(ceil(debugDeltaMean + debugDeltaLimit));
-			qDebug() << "Using sample rate:" << sampleRate;
-
-			if (exclusiveMidiMode && audioStreamFactory != NULL) {
-				audioStream = audioStreamFactory(audioDevice, *this, sampleRate, midiSessions.first());
-			} else {
-				audioStream = audioDevice->startAudioStream(*this, sampleRate);
-			}
-			if (audioStream != NULL) {
+		const SamplerateConversionQuality srcQuality = audioDevice->driver.getAudioSettings().srcQuality;
+		qSynth.setMinimumPhaseSRC(audioDevice->driver.getAudioSettings().minimumPhaseSRC);
+		// A preopened synth only gets its output adjusted to the current audio settings.
+		bool synthOpen;
+		if (qSynth.isOpen()) {
+			preferSynthSampleRate(sampleRate);
+			synthOpen = qSynth.restartOutput(sampleRate, srcQuality);
+		} else {
+			// The synth output rate depends on the analogue output mode chosen for the configured rate.
+			synthOpen = qSynth.open(sampleRate, srcQuality);
+			if (synthOpen && preferSynthSampleRate(sampleRate)) synthOpen = qSynth.restartOutput(sampleRate, srcQuality);
+		}
+		if (synthOpen) {
+			// The audio callbacks must never wait for the GUI thread, so the synth settings and state are exchanged via RealtimeHelper.
+			qSynth.enableRealtime();
+			if (startAudioStream(audioStreamFactory, sampleRate)) {
 				setState(SynthRouteState_OPEN);
 				return true;
 			} else {
@@ -105,6 +210,182 @@ bool SynthRoute::open(AudioStreamFactory audioStreamFactory) {
 	return false;
 }
 
+bool SynthRoute::preopen() {
+	if (state != SynthRouteState_CLOSED || audioDevice == NULL || qSynth.isOpen()) return false;
+	const AudioDriverSettings &audioSettings = audioDevice->driver.getAudioSettings();
+	uint sampleRate = audioSettings.sampleRate;
+	qSynth.setMinimumPhaseSRC(audioSettings.minimumPhaseSRC);
+	if (!qSynth.open(sampleRate, audioSettings.srcQuality)) return false;
+	if (preferSynthSampleRate(sampleRate) && !qSynth.restartOutput(sampleRate, audioSettings.srcQuality)) return false;
+	qSynth.enableRealtime();
+	return true;
+}
+
+bool SynthRoute::startAudioStream(AudioStreamFactory audioStreamFactory, const uint sampleRate) {
+	double debugDeltaMean = sampleRate * (8.0 / MasterClock::MILLIS_PER_SECOND);
+	double debugDeltaLimit = debugDeltaMean * 0.01;
+	debugDeltaLowerLimit = qint64(floor(debugDeltaMean - debugDeltaLimit));
+	debugDeltaUpperLimit = qint64(ceil(debugDeltaMean + debugDeltaLimit));
+	qDebug() << "Using sample rate:" << sampleRate << "conversion latency:" << qSynth.getConversionLatencyFrames() << "frames";
+	// A probe left from the previous stream refers to its timeline.
+	QAtomicHelper::storeRelease(latencyProbeState, LatencyProbeState_IDLE);
+	// The stream bound to a MIDI session in the exclusive mode cannot be restarted on demand.
+	const bool standbyEnabled = standbyTimeoutSeconds > 0 && !exclusiveMidiMode && audioDevice->isStandbySupported();
+	standbyTimeoutFrames = standbyEnabled ? quint64(standbyTimeoutSeconds) * sampleRate : 0;
+	standbyIdleFrames = 0;
+	standbyIdleMidiEventCount = QAtomicHelper::loadRelaxed(midiEventCount);
+
+	if (exclusiveMidiMode && audioStreamFactory != NULL) {
+		audioStream = audioStreamFactory(audioDevice, *this, sampleRate, midiSessions.first());
+	} else {
+		audioStream = audioDevice->startAudioStream(*this, sampleRate);
+	}
+	return audioStream != NULL;
+}
+
+// Replaces the configured sample rate with the synth output rate when the audio device supports it,
+// so that the sample rate converter passes the synth output through. Returns true if the rate is replaced.
+bool SynthRoute::preferSynthSampleRate(uint &sampleRate) const {
+	const uint synthSampleRate = qSynth.getSynthSampleRate();
+	// The configured rate of 0 stands for the synth output rate already.
+	if (sampleRate == 0 || sampleRate == synthSampleRate || !audioDevice->driver.getAudioSettings().nativeSampleRate) return false;
+	if (!audioDevice->isSampleRateSupported(synthSampleRate)) return false;
+	qDebug() << "SynthRoute: Audio device supports the synth output sample rate" << synthSampleRate << "Hz, bypassing sample rate conversion";
+	sampleRate = synthSampleRate;
+	return true;
+}
+
+bool SynthRoute::restartAudioStream() {
+	// In the exclusive mode, the stream is bound to the MIDI session it was created for, so the route is reopened instead.
+	if (state != SynthRouteState_OPEN || exclusiveMidiMode || audioDevice == NULL) return false;
+	if (standby) {
+		// Resuming starts the stream on the current audio device with its current settings anyway.
+		resumeFromStandby();
+		return state == SynthRouteState_OPEN;
+	}
+	AudioStream *oldAudioStream = audioStream;
+	audioStream = NULL;
+	// Stops the callbacks, the MIDI events that arrive meanwhile are dropped.
+	delete oldAudioStream;
+	const AudioDriverSettings &audioSettings = audioDevice->driver.getAudioSettings();
+	uint sampleRate = audioSettings.sampleRate;
+	qSynth.setMinimumPhaseSRC(audioSettings.minimumPhaseSRC);
+	preferSynthSampleRate(sampleRate);
+	if (qSynth.restartOutput(sampleRate, audioSettings.srcQuality) && startAudioStream(NULL, sampleRate)) {
+		qDebug() << "SynthRoute: Audio stream restarted on" << audioDevice->driver.name << audioDevice->name;
+		return true;
+	}
+	qDebug() << "Failed to restart audioStream";
+	close();
+	return false;
+}
+
+// Only called from the rendering thread after rendering a block. Any MIDI event received since the previous block
+// restarts the idle period, even if it is yet to reach the synth.
+void SynthRoute::updateStandbyState(uint length) {
+	if (standbyTimeoutFrames == 0) return;
+	const uint eventCount = QAtomicHelper::loadRelaxed(midiEventCount);
+	if (eventCount != standbyIdleMidiEventCount || qSynth.isOutputActive() || qSynth.isRecordingAudio()) {
+		standbyIdleMidiEventCount = eventCount;
+		standbyIdleFrames = 0;
+		return;
+	}
+	if (standbyIdleFrames >= standbyTimeoutFrames) return;
+	standbyIdleFrames += length;
+	// Only the GUI thread may stop the stream. It checks again whether the route is idle once the rendering has stopped.
+	if (standbyIdleFrames >= standbyTimeoutFrames) QMetaObject::invokeMethod(this, "enterStandby", Qt::QueuedConnection);
+}
+
+void SynthRoute::enterStandby() {
+	if (state != SynthRouteState_OPEN || standby || audioStream == NULL || standbyTimeoutFrames == 0) return;
+	{
+		// From now on, the MIDI events are held till the stream is resumed.
+		QMutexLocker standbyLocker(&standbyMutex);
+		standby = true;
+	}
+	AudioStream *oldAudioStream = audioStream;
+	audioStream = NULL;
+	delete oldAudioStream;
+	// The events pushed to the MIDI buffers before the flag was raised are timestamped for the stopped stream,
+	// so they are handed over to the synth while its output timeline still matches.
+	if (multiMidiMode) mergeMidiStreams(0);
+	const bool idle = standbyIdleFrames >= standbyTimeoutFrames
+		&& QAtomicHelper::loadRelaxed(midiEventCount) == standbyIdleMidiEventCount && !qSynth.isActive();
+	if (!idle) {
+		resumeFromStandby();
+		return;
+	}
+	qDebug() << "SynthRoute: Idle for" << standbyTimeoutSeconds << "s, audio stream stopped";
+}
+
+void SynthRoute::resumeFromStandby() {
+	QMutexLocker standbyLocker(&standbyMutex);
+	if (!standby) return;
+	const AudioDriverSettings &audioSettings = audioDevice->driver.getAudioSettings();
+	uint sampleRate = audioSettings.sampleRate;
+	qSynth.setMinimumPhaseSRC(audioSettings.minimumPhaseSRC);
+	preferSynthSampleRate(sampleRate);
+	bool resumed = qSynth.restartOutput(sampleRate, audioSettings.srcQuality);
+	if (resumed) {
+		// The events received in standby are due at the very first frame of the new stream, in the order received.
+		// So, the first block the device requests already contains their output, with no MIDI latency added
+		// on top of the time it took to start the stream.
+		playStandbyMidiEvents(NULL);
+	}
+	// Starting the device may take a while, so the MIDI receiving threads are not kept waiting meanwhile.
+	standbyLocker.unlock();
+	if (resumed) resumed = startAudioStream(NULL, sampleRate);
+	standbyLocker.relock();
+	if (resumed) {
+		// The events that arrived while the stream was starting are timed as usual.
+		playStandbyMidiEvents(audioStream);
+		qDebug() << "SynthRoute: Audio stream resumed on" << audioDevice->driver.name << audioDevice->name;
+	}
+	standby = false;
+	standbyMidiEvents.clear();
+	standbyLocker.unlock();
+	if (!resumed) {
+		qDebug() << "Failed to resume audioStream";
+		close();
+	}
+}
+
+// Plays the held events straight to the synth, either timed by the given stream or all at once at the start
+// of the stream to be started if none. Only called from the GUI thread with standbyMutex locked.
+void SynthRoute::playStandbyMidiEvents(AudioStream *stream) {
+	for (int i = 0; i < standbyMidiEvents.count(); i++) {
+		const QMidiEvent &event = standbyMidiEvents.at(i);
+		const quint64 timestamp = stream == NULL ? 0 : stream->estimateMIDITimestamp(event.getTimestamp());
+		if (event.getType() == SHORT_MESSAGE) {
+			qSynth.playMIDIShortMessage(event.getShortMessage(), timestamp);
+		} else {
+			qSynth.playMIDISysex(standbyMidiEvents.getSysexData(event), event.getSysexLen(), timestamp);
+		}
+	}
+	standbyMidiEvents.clear();
+}
+
+// Only called from the MIDI receiving threads. Returns true if the event is kept till the audio stream is resumed.
+bool SynthRoute::holdInStandby(Bit32u msg, const Bit8u *sysex, Bit32u sysexLen, MasterClockNanos refNanos) {
+	if (!standby) return false;
+	QMutexLocker standbyLocker(&standbyMutex);
+	if (!standby) return false;
+	if (standbyMidiEvents.isEmpty()) QMetaObject::invokeMethod(this, "resumeFromStandby", Qt::QueuedConnection);
+	if (refNanos == 0) refNanos = MasterClock::getClockNanos();
+	if (sysex == NULL) {
+		standbyMidiEvents.appendShortMessage(refNanos, msg);
+	} else {
+		standbyMidiEvents.appendSysex(refNanos, sysex, sysexLen);
+	}
+	return true;
+}
+
+void SynthRoute::cancelStandby() {
+	QMutexLocker standbyLocker(&standbyMutex);
+	standby = false;
+	standbyMidiEvents.clear();
+}
+
 bool SynthRoute::close() {
 	switch (state) {
 	case SynthRouteState_CLOSING:
@@ -116,6 +397,7 @@ bool SynthRoute::close() {
 		break;
 	}
 	setState(SynthRouteState_CLOSING);
+	cancelStandby();
 	delete audioStream;
 	audioStream = NULL;
 	qSynth.close();
@@ -200,6 +482,7 @@ void SynthRoute::handleQSynthState(SynthState synthState) {
 		setState(SynthRouteState_CLOSING);
 		break;
 	case SynthState_CLOSED:
+		cancelStandby();
 		delete audioStream;
 		audioStream = NULL;
 		setState(SynthRouteState_CLOSED);
@@ -222,9 +505,14 @@ bool SynthRoute::connectReportHandler(const char *signal, const QObject *receive
 
 bool SynthRoute::pushMIDIShortMessage(MidiSession &midiSession, Bit32u msg, MasterClockNanos refNanos) {
 	recorder.recordShortMessage(msg, refNanos);
+	midiEventCount.ref();
+	if (msg != 0 && holdInStandby(msg, NULL, 0, refNanos)) return true;
 	AudioStream *stream = audioStream;
 	if (stream == NULL) return false;
 	quint64 timestamp = stream->estimateMIDITimestamp(refNanos);
+	// The zones marked here are related to the audio output via the timestamps in the frames of the audio stream.
+	// These are converted to the internal sample rate of the synth for the zones marked within the library.
+	TraceZone traceZone("MIDI receive", Bit32u(timestamp));
 	if (msg == 0) {
 		// This is a special event sent by the test driver
 		qint64 delta = qint64(timestamp - debugLastEventTimestamp);
@@ -240,14 +528,18 @@ bool SynthRoute::pushMIDIShortMessage(MidiSession &midiSession, Bit32u msg, Mast
 
 bool SynthRoute::pushMIDISysex(MidiSession &midiSession, const Bit8u *sysexData, unsigned int sysexLen, MasterClockNanos refNanos) {
 	recorder.recordSysex(sysexData, sysexLen, refNanos);
+	midiEventCount.ref();
+	if (holdInStandby(0, sysexData, sysexLen, refNanos)) return true;
 	AudioStream *stream = audioStream;
 	if (stream == NULL) return false;
 	quint64 timestamp = stream->estimateMIDITimestamp(refNanos);
+	TraceZone traceZone("MIDI receive", Bit32u(timestamp));
 	return playMIDISysex(midiSession, sysexData, sysexLen, timestamp);
 }
 
 bool SynthRoute::playMIDIShortMessage(MidiSession &midiSession, Bit32u msg, quint64 timestamp) {
 	if (multiMidiMode) {
+		TraceZone traceZone("QMidiBuffer push", Bit32u(timestamp));
 		QMidiBuffer *qMidiBuffer = midiSession.getQMidiBuffer();
 		if (qMidiBuffer->pushShortMessage(timestamp, msg)) {
 			qMidiBuffer->flush();
@@ -261,6 +553,7 @@ bool SynthRoute::playMIDIShortMessage(MidiSession &midiSession, Bit32u msg, quin
 
 bool SynthRoute::playMIDISysex(MidiSession &midiSession, const Bit8u *sysex, Bit32u sysexLen, quint64 timestamp) {
 	if (multiMidiMode) {
+		TraceZone traceZone("QMidiBuffer push", Bit32u(timestamp));
 		QMidiBuffer *qMidiBuffer = midiSession.getQMidiBuffer();
 		if (qMidiBuffer->pushSysexMessage(timestamp, sysexLen, sysex)) {
 			qMidiBuffer->flush();
@@ -272,6 +565,56 @@ bool SynthRoute::playMIDISysex(MidiSession &midiSession, const Bit8u *sysex, Bit
 	}
 }
 
+bool SynthRoute::pushLatencyProbe(MidiSession &midiSession, Bit32u noteOnMsg, MasterClockNanos refNanos) {
+	AudioStream *stream = audioStream;
+	if (stream == NULL || QAtomicHelper::loadAcquire(latencyProbeState) != LatencyProbeState_IDLE) return false;
+	quint64 timestamp = stream->estimateMIDITimestamp(refNanos);
+	latencyProbeNanos = refNanos;
+	latencyProbeTimestamp = timestamp;
+	QAtomicHelper::storeRelease(latencyProbeState, LatencyProbeState_ARMED);
+	// Should the message be rejected, the probe just fails in a second.
+	return playMIDIShortMessage(midiSession, noteOnMsg, timestamp);
+}
+
+LatencyProbeState SynthRoute::takeLatencyMeasurement(LatencyMeasurement &measurement) {
+	LatencyProbeState probeState = LatencyProbeState(QAtomicHelper::loadAcquire(latencyProbeState));
+	if (probeState == LatencyProbeState_MEASURED) measurement = latencyMeasurement;
+	if (probeState == LatencyProbeState_MEASURED || probeState == LatencyProbeState_FAILED) {
+		QAtomicHelper::storeRelease(latencyProbeState, LatencyProbeState_IDLE);
+	}
+	return probeState;
+}
+
+// Only called from the rendering thread after rendering a block, before the audio stream counts the rendered frames.
+template <class Sample>
+void SynthRoute::detectLatencyProbeOnset(AudioStream &stream, const Sample *left, const Sample *right, uint stride, uint length) {
+	if (QAtomicHelper::loadAcquire(latencyProbeState) != LatencyProbeState_ARMED) return;
+	const quint64 blockTimestamp = stream.computeMIDITimestamp(0);
+	const quint64 blockEndTimestamp = blockTimestamp + length;
+	if (blockEndTimestamp <= latencyProbeTimestamp) return;
+	const uint startFrame = latencyProbeTimestamp > blockTimestamp ? uint(latencyProbeTimestamp - blockTimestamp) : 0;
+	const uint onsetFrame = qMin(findLatencyProbeOnset(left, stride, startFrame, length), findLatencyProbeOnset(right, stride, startFrame, length));
+	const quint32 sampleRate = stream.getSampleRate();
+	if (onsetFrame == length) {
+		if (blockEndTimestamp - latencyProbeTimestamp > sampleRate) {
+			QAtomicHelper::storeRelease(latencyProbeState, LatencyProbeState_FAILED);
+		}
+		return;
+	}
+	const quint64 onsetTimestamp = blockTimestamp + onsetFrame;
+	if (onsetTimestamp == latencyProbeTimestamp) {
+		// The output was not silent when the note-on was scheduled, so the onset cannot be told.
+		QAtomicHelper::storeRelease(latencyProbeState, LatencyProbeState_FAILED);
+		return;
+	}
+	latencyMeasurement.inputToOutputNanos = stream.estimatePlaybackNanos(onsetTimestamp) - latencyProbeNanos;
+	latencyMeasurement.synthOnsetNanos = MasterClockNanos(((onsetTimestamp - latencyProbeTimestamp) * MasterClock::NANOS_PER_SECOND) / sampleRate);
+	latencyMeasurement.sampleRate = sampleRate;
+	latencyMeasurement.audioLatencyFrames = stream.getAudioLatencyFrames();
+	latencyMeasurement.midiLatencyFrames = stream.getMIDILatencyFrames();
+	QAtomicHelper::storeRelease(latencyProbeState, LatencyProbeState_MEASURED);
+}
+
 void SynthRoute::discardMidiBuffers() {
 	if (!multiMidiMode) return;
 	QMutexLocker midiSessionsLocker(&midiSessionsMutex);
@@ -294,75 +637,131 @@ void SynthRoute::flushMIDIQueue() {
 
 // When renderingPassFrameLength == 0, all pending messages are merged.
 void SynthRoute::mergeMidiStreams(uint renderingPassFrameLength) {
+	TraceZone traceZone("mergeMidiStreams", renderingPassFrameLength == 0 ? 0 : Bit32u(audioStream->computeMIDITimestamp(0)));
 	QMutexLocker midiSessionsLocker(&midiSessionsMutex);
-	QVarLengthArray<QMidiBuffer *, 16> streamBuffers;
 	const quint64 renderingPassEndTimestamp = renderingPassFrameLength == 0
 		? std::numeric_limits<quint64>::max()
 		: audioStream->computeMIDITimestamp(renderingPassFrameLength);
-
+	MidiStreamMerger merger(renderingPassEndTimestamp);
 	for (int i = 0; i < midiSessions.size(); i++) {
-		QMidiBuffer *midiBuffer = midiSessions[i]->getQMidiBuffer();
-		if (midiBuffer->retieveEvents() && midiBuffer->getEventTimestamp() < renderingPassEndTimestamp) {
-			streamBuffers.append(midiBuffer);
-		}
-	}
-
-	while (!streamBuffers.isEmpty()) {
-		int nextEventBufferIx = 0;
-		quint64 nextEventTimestamp = streamBuffers[nextEventBufferIx]->getEventTimestamp();
-		for (int i = 1; i < streamBuffers.size(); i++) {
-			quint64 eventTimestamp = streamBuffers[i]->getEventTimestamp();
-			if (eventTimestamp < nextEventTimestamp) {
-				nextEventBufferIx = i;
-				nextEventTimestamp = eventTimestamp;
-			}
-		}
-		QMidiBuffer * const midiBuffer = streamBuffers[nextEventBufferIx];
-		do {
-			const uchar *sysexData;
-			quint32 eventData = midiBuffer->getEventData(sysexData);
-			if (sysexData == NULL) {
-				qSynth.playMIDIShortMessage(eventData, nextEventTimestamp);
-			} else {
-				qSynth.playMIDISysex(sysexData, eventData, nextEventTimestamp);
-			}
-			if (!(midiBuffer->nextEvent() && midiBuffer->getEventTimestamp() < renderingPassEndTimestamp)) {
-#if QT_VERSION < QT_VERSION_CHECK(4, 7, 0)
-				if (nextEventBufferIx < streamBuffers.count() - 1) {
-					streamBuffers[nextEventBufferIx] = streamBuffers[streamBuffers.count() - 1];
-				}
-				streamBuffers.removeLast();
-#else
-				streamBuffers.remove(nextEventBufferIx);
-#endif
-				break;
-			}
-		} while (midiBuffer->getEventTimestamp() <= nextEventTimestamp);
+		merger.addStream(midiSessions[i]->getQMidiBuffer(), i);
 	}
+	// Should the batch be rejected by the synth, the events stay in the buffers till the next rendering pass.
+	if (!merger.isEmpty()) qSynth.playMIDIEvents(merger);
 }
 
 void SynthRoute::render(MT32Emu::Bit16s *buffer, uint length) {
+	const MasterClockNanos startNanos = MasterClock::getClockNanos();
 	// Occasionally, audioStream may appear NULL during startup.
-	if (multiMidiMode && audioStream != NULL) mergeMidiStreams(length);
+	AudioStream *stream = audioStream;
+	TraceZone traceZone("SynthRoute::render", stream == NULL ? 0 : Bit32u(stream->computeMIDITimestamp(0)));
+	if (multiMidiMode && stream != NULL) mergeMidiStreams(length);
 	qSynth.render(buffer, length);
+	if (stream != NULL) {
+		detectLatencyProbeOnset(*stream, buffer, buffer + 1, 2, length);
+		updateStandbyState(length);
+		stream->renderCompleted(startNanos, length);
+	}
 }
 
 void SynthRoute::render(float *buffer, uint length) {
+	const MasterClockNanos startNanos = MasterClock::getClockNanos();
 	// Occasionally, audioStream may appear NULL during startup.
-	if (multiMidiMode && audioStream != NULL) mergeMidiStreams(length);
+	AudioStream *stream = audioStream;
+	TraceZone traceZone("SynthRoute::render", stream == NULL ? 0 : Bit32u(stream->computeMIDITimestamp(0)));
+	if (multiMidiMode && stream != NULL) mergeMidiStreams(length);
 	qSynth.render(buffer, length);
+	if (stream != NULL) {
+		detectLatencyProbeOnset(*stream, buffer, buffer + 1, 2, length);
+		updateStandbyState(length);
+		stream->renderCompleted(startNanos, length);
+	}
+}
+
+void SynthRoute::render(float *leftBuffer, float *rightBuffer, uint length) {
+	const MasterClockNanos startNanos = MasterClock::getClockNanos();
+	// Occasionally, audioStream may appear NULL during startup.
+	AudioStream *stream = audioStream;
+	TraceZone traceZone("SynthRoute::render", stream == NULL ? 0 : Bit32u(stream->computeMIDITimestamp(0)));
+	if (multiMidiMode && stream != NULL) mergeMidiStreams(length);
+	qSynth.render(leftBuffer, rightBuffer, length);
+	if (stream != NULL) {
+		detectLatencyProbeOnset(*stream, leftBuffer, rightBuffer, 1, length);
+		updateStandbyState(length);
+		stream->renderCompleted(startNanos, length);
+	}
 }
 
 void SynthRoute::audioStreamFailed() {
 	qSynth.close();
 }
 
-// QSynth delegation
+bool SynthRoute::getAudioStreamStats(AudioStreamStats &stats) const {
+	AudioStream *stream = audioStream;
+	if (stream == NULL) return false;
+	stream->getRenderStats(stats);
+	return true;
+}
 
-void SynthRoute::enableRealtimeMode() {
-	qSynth.enableRealtime();
+quint32 SynthRoute::getConversionLatencyFrames() const {
+	return qSynth.getConversionLatencyFrames();
+}
+
+uint SynthRoute::getSynthSampleRate() const {
+	return qSynth.getSynthSampleRate();
 }
 
+uint SynthRoute::getOutputSampleRate() const {
+	return qSynth.getOutputSampleRate();
+}
+
+void SynthRoute::resetAudioStreamStats() {
+	AudioStream *stream = audioStream;
+	if (stream != NULL) stream->resetRenderStats();
+}
+
+bool SynthRoute::convertJACKFrameTime(quint32 jackFrameTime, quint64 &timestamp) const {
+	AudioStream *stream = audioStream;
+	return stream != NULL && stream->convertJACKFrameTime(jackFrameTime, timestamp);
+}
+
+MasterClockNanos SynthRoute::startOfflinePlayback() {
+	AudioStream *stream = audioStream;
+	return stream == NULL ? 0 : stream->startOfflineMode();
+}
+
+void SynthRoute::advanceOfflinePlayback(MasterClockNanos nanos) {
+	AudioStream *stream = audioStream;
+	if (stream != NULL) stream->advanceOfflineTime(nanos);
+}
+
+void SynthRoute::stopOfflinePlayback() {
+	AudioStream *stream = audioStream;
+	if (stream != NULL) stream->stopOfflineMode();
+}
+
+MasterClockNanos SynthRoute::startLookAheadPlayback() {
+	AudioStream *stream = audioStream;
+	return stream == NULL ? 0 : stream->startLookAheadMode();
+}
+
+void SynthRoute::advanceLookAheadPlayback(MasterClockNanos nanos) {
+	AudioStream *stream = audioStream;
+	if (stream != NULL) stream->advanceLookAhead(nanos);
+}
+
+void SynthRoute::discardLookAheadPlayback() {
+	AudioStream *stream = audioStream;
+	if (stream != NULL) stream->discardLookAhead();
+}
+
+void SynthRoute::stopLookAheadPlayback() {
+	AudioStream *stream = audioStream;
+	if (stream != NULL) stream->stopLookAheadMode();
+}
+
+// QSynth delegation
+
 void SynthRoute::playMIDIShortMessageNow(Bit32u msg) {
 	qSynth.playMIDIShortMessageNow(msg);
 }
@@ -471,6 +870,14 @@ uint SynthRoute::getPlayingNotes(unsigned int partNumber, MT32Emu::Bit8u *keys,
 	return qSynth.getPlayingNotes(partNumber, keys, velocities);
 }
 
+void SynthRoute::setStateSnapshotEnabled(bool enabled) const {
+	qSynth.setStateSnapshotEnabled(enabled);
+}
+
+bool SynthRoute::getStateSnapshot(SynthStateSnapshot &snapshot) const {
+	return qSynth.getStateSnapshot(snapshot);
+}
+
 void SynthRoute::startRecordingAudio(const QString &fileName) {
 	qSynth.startRecordingAudio(fileName);
 }
@@ -8,11 +8,33 @@
 #include "QSynth.h"
 #include "MasterClock.h"
 #include "MidiRecorder.h"
+#include "QMidiEvent.h"
 
 class MidiSession;
 class AudioStream;
+struct AudioStreamStats;
 class AudioDevice;
 
+// Result of a MIDI-to-audio latency measurement, see SynthRoute::pushLatencyProbe().
+struct LatencyMeasurement {
+	// From the clock time the note-on was received till the estimated time the audio device plays its onset.
+	MasterClockNanos inputToOutputNanos;
+	// The part of the above from the frame the note-on was scheduled at till the first non-silent frame
+	// in the output. It comes from the emulated MIDI interface delay, the attack of the partial and the resampler.
+	MasterClockNanos synthOnsetNanos;
+	// The latencies in effect, as configured or adjusted by the audio stream.
+	quint32 sampleRate;
+	quint32 audioLatencyFrames;
+	quint32 midiLatencyFrames;
+};
+
+enum LatencyProbeState {
+	LatencyProbeState_IDLE,
+	LatencyProbeState_ARMED,
+	LatencyProbeState_MEASURED,
+	LatencyProbeState_FAILED
+};
+
 enum SynthRouteState {
 	SynthRouteState_CLOSED,
 	SynthRouteState_OPENING,
@@ -39,15 +61,50 @@ private:
 	quint64 debugLastEventTimestamp;
 	qint64 debugDeltaLowerLimit, debugDeltaUpperLimit;
 
+	// The latency probe is armed in a MIDI receiving thread and resolved in the rendering thread.
+	// The other fields are only accessed by the thread that owns the probe according to latencyProbeState.
+	QAtomicInt latencyProbeState;
+	MasterClockNanos latencyProbeNanos;
+	quint64 latencyProbeTimestamp;
+	LatencyMeasurement latencyMeasurement;
+
+	// Standby of an idle route. The rendering thread counts the frames rendered with the synth inactive and no MIDI input,
+	// and once the timeout elapses, the GUI thread stops the audio stream while the synth stays open. The next MIDI event
+	// starts the stream again. The events received meanwhile are kept along with the standby flag under standbyMutex.
+	// The flag only changes in the GUI thread, the idle frame counting is owned by the rendering thread.
+	// The timeout is configured in seconds with "Master/AudioStandbyTimeout" in the settings file, 0 disables the standby.
+	uint standbyTimeoutSeconds;
+	quint64 standbyTimeoutFrames;
+	quint64 standbyIdleFrames;
+	uint standbyIdleMidiEventCount;
+	QAtomicInt midiEventCount;
+	volatile bool standby;
+	QMutex standbyMutex;
+	QMidiEventList standbyMidiEvents;
+
 	void setState(SynthRouteState newState);
+	bool startAudioStream(AudioStreamFactory audioStreamFactory, const uint sampleRate);
+	bool preferSynthSampleRate(uint &sampleRate) const;
 	void disableExclusiveMidiMode();
 	void mergeMidiStreams(uint renderingPassFrameLength);
+	template <class Sample>
+	void detectLatencyProbeOnset(AudioStream &stream, const Sample *left, const Sample *right, uint stride, uint length);
+	void updateStandbyState(uint length);
+	bool holdInStandby(MT32Emu::Bit32u msg, const MT32Emu::Bit8u *sysex, MT32Emu::Bit32u sysexLen, MasterClockNanos refNanos);
+	void playStandbyMidiEvents(AudioStream *stream);
+	void cancelStandby();
 
 public:
 	SynthRoute(QObject *parent = NULL);
 	~SynthRoute();
 	bool open(AudioStreamFactory audioStreamFactory = NULL);
+	// Opens the synth of the closed route in advance without starting an audio stream, so that a later open()
+	// only needs to start the stream. The route remains closed meanwhile.
+	bool preopen();
 	bool close();
+	// Replaces the audio stream of the open route with one started on the current audio device and its current settings.
+	// The synth keeps playing with its state intact. The route gets closed if the new stream fails to start.
+	bool restartAudioStream();
 	void reset();
 	bool enableExclusiveMidiMode(MidiSession *midiSession);
 	bool isExclusiveMidiModeEnabled();
@@ -57,6 +114,8 @@ public:
 	void getPartStates(bool *partStates) const;
 	void getPartialStates(MT32Emu::PartialState *partialStates) const;
 	uint getPlayingNotes(unsigned int partNumber, MT32Emu::Bit8u *keys, MT32Emu::Bit8u *velocities) const;
+	void setStateSnapshotEnabled(bool enabled) const;
+	bool getStateSnapshot(SynthStateSnapshot &snapshot) const;
 	uint getPartialCount() const;
 
 	void flushMIDIQueue();
@@ -66,12 +125,38 @@ public:
 	bool playMIDISysex(MidiSession &midiSession, const MT32Emu::Bit8u *sysex, MT32Emu::Bit32u sysexLen, quint64 timestamp);
 	bool pushMIDIShortMessage(MidiSession &midiSession, MT32Emu::Bit32u msg, MasterClockNanos midiNanos);
 	bool pushMIDISysex(MidiSession &midiSession, const MT32Emu::Bit8u *sysex, unsigned int sysexLen, MasterClockNanos midiNanos);
+	// Plays a note-on received at refNanos and measures when its onset reaches the audio output.
+	// Only one probe is handled at a time, so this returns false while another one is pending.
+	// The preceding sound must have decayed, otherwise the measurement fails.
+	bool pushLatencyProbe(MidiSession &midiSession, MT32Emu::Bit32u noteOnMsg, MasterClockNanos refNanos);
+	// Returns the state of the latency probe, and the result once measured. A measured or failed probe is released,
+	// so that the next one may be pushed. The probe fails unless the onset is detected within a second.
+	LatencyProbeState takeLatencyMeasurement(LatencyMeasurement &measurement);
 	void discardMidiBuffers();
 	void render(MT32Emu::Bit16s *buffer, uint length);
 	void render(float *buffer, uint length);
+	void render(float *leftBuffer, float *rightBuffer, uint length);
 	void audioStreamFailed();
+	// Fills in the render timing statistics of the audio stream, returns false if no stream is running.
+	bool getAudioStreamStats(AudioStreamStats &stats) const;
+	quint32 getConversionLatencyFrames() const;
+	// The sample rates the synth renders at and the audio stream plays at, the latter is 0 unless the synth is open.
+	uint getSynthSampleRate() const;
+	uint getOutputSampleRate() const;
+	void resetAudioStreamStats();
+	bool convertJACKFrameTime(quint32 jackFrameTime, quint64 &timestamp) const;
+	// Offline playback lets a MIDI source drive the time of an audio stream that renders into a file, see AudioStream.
+	// Returns the stream time to start from, or 0 if the audio stream only plays in realtime.
+	MasterClockNanos startOfflinePlayback();
+	void advanceOfflinePlayback(MasterClockNanos nanos);
+	void stopOfflinePlayback();
+	// Look-ahead playback lets a MIDI source that plays a file push its events in advance, so that the audio is prerendered.
+	// Returns how far ahead to push the events, or 0 if the audio stream renders just in time.
+	MasterClockNanos startLookAheadPlayback();
+	void advanceLookAheadPlayback(MasterClockNanos nanos);
+	void discardLookAheadPlayback();
+	void stopLookAheadPlayback();
 
-	void enableRealtimeMode();
 	void setMasterVolume(int masterVolume);
 	void setOutputGain(float outputGain);
 	void setReverbOutputGain(float reverbOutputGain);
@@ -99,6 +184,7 @@ public:
 	bool hasMIDISessions() const;
 	SynthRouteState getState() const;
 	void setAudioDevice(const AudioDevice *newAudioDevice);
+	const AudioDevice *getAudioDevice() const;
 	MidiRecorder *getMidiRecorder();
 	void getSynthProfile(SynthProfile &synthProfile) const;
 	void setSynthProfile(const SynthProfile &synthProfile, QString useSynthProfileName);
@@ -108,6 +194,8 @@ public:
 
 private slots:
 	void handleQSynthState(SynthState synthState);
+	void enterStandby();
+	void resumeFromStandby();
 
 signals:
 	void stateChanged(SynthRouteState state);
@@ -14,6 +14,8 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstring>
+
 #include "SynthStateMonitor.h"
 
 #include "SynthRoute.h"
@@ -23,24 +25,77 @@
 static const MasterClockNanos LCD_MESSAGE_DISPLAYING_NANOS = 200 * MasterClock::NANOS_PER_MILLISECOND;
 static const MasterClockNanos LCD_TIMBRE_NAME_DISPLAYING_NANOS = 1200 * MasterClock::NANOS_PER_MILLISECOND;
 static const MasterClockNanos MIDI_MESSAGE_LED_MINIMUM_NANOS = 60 * MasterClock::NANOS_PER_MILLISECOND;
-static const MasterClockNanos MINIMUM_UPDATE_INTERVAL_NANOS = 30 * MasterClock::NANOS_PER_MILLISECOND;
+static const int UPDATE_INTERVAL_MILLIS = 30;
 
 static const QColor COLOR_GRAY = QColor(100, 100, 100);
 static const QColor COLOR_GREEN = Qt::green;
 static const QColor lcdBgColor(98, 127, 0);
 static const QColor lcdFgColor(232, 254, 0);
 static const QColor partialStateColor[] = {COLOR_GRAY, Qt::red, Qt::yellow, Qt::green};
+static const uint PARTIAL_STATE_COUNT = sizeof(partialStateColor) / sizeof(*partialStateColor);
+
+static const int PARTIAL_LED_SIZE = 16;
+static const int PARTIAL_LED_SPACING = 6;
+
+static const int LCD_CHAR_COUNT = 20;
+static const int LCD_FONT_CHAR_COUNT = 96;
+static const int LCD_GLYPH_WIDTH = 10;
+static const int LCD_GLYPH_HEIGHT = 18;
+static const int LCD_TEXT_LEFT = 7;
+static const int LCD_TEXT_TOP = 10;
 
 using namespace MT32Emu;
 
+// Draws each character of the font as it looks on the LCD, the dots are 2x2 pixels. The second row of the atlas contains
+// the masked characters with the upper 7 rows of dots lit. The gap above the cursor row is left transparent,
+// so that the background shows through as before.
+static QPixmap makeLCDGlyphAtlas() {
+	QImage atlas(LCD_FONT_CHAR_COUNT * LCD_GLYPH_WIDTH, 2 * LCD_GLYPH_HEIGHT, QImage::Format_ARGB32_Premultiplied);
+	atlas.fill(0);
+	QPainter painter(&atlas);
+	for (int c = 0; c < LCD_FONT_CHAR_COUNT; c++) {
+		for (int masked = 0; masked < 2; masked++) {
+			int yat = masked * LCD_GLYPH_HEIGHT;
+			for (int t = 0; t < 8; t++) {
+				unsigned char fval = (masked && (t != 7)) ? 0x1f : Font_6x8[c][t];
+				int xat = c * LCD_GLYPH_WIDTH;
+				for (int m = 4; m >= 0; --m) {
+					painter.fillRect(xat, yat, 2, 2, ((fval >> m) & 1) ? lcdFgColor : lcdBgColor);
+					xat += 2;
+				}
+				yat += 2;
+				if (t == 6) yat += 2;
+			}
+		}
+	}
+	painter.end();
+	return QPixmap::fromImage(atlas);
+}
+
+static void clearStateSnapshot(SynthStateSnapshot &stateSnapshot) {
+	stateSnapshot.partialCount = 0;
+	for (uint partNum = 0; partNum < SynthStateSnapshot::PART_COUNT; partNum++) {
+		stateSnapshot.partStates[partNum] = false;
+		stateSnapshot.playingNotesCount[partNum] = 0;
+	}
+}
+
 SynthStateMonitor::SynthStateMonitor(Ui::SynthWidget *ui, SynthRoute *useSynthRoute) :
 	synthRoute(useSynthRoute),
 	ui(ui),
 	lcdWidget(*this, ui->synthFrame),
-	midiMessageLED(&COLOR_GRAY, ui->midiMessageFrame)
+	midiMessageLED(&COLOR_GRAY, ui->midiMessageFrame),
+	partialStateWidget(ui->partialStateGrid->widget()),
+	stateSnapshot(new SynthStateSnapshot),
+	newStateSnapshot(new SynthStateSnapshot)
 {
+	clearStateSnapshot(*stateSnapshot);
+	updateTimer.setInterval(UPDATE_INTERVAL_MILLIS);
+	connect(&updateTimer, SIGNAL(timeout()), SLOT(handleUpdate()));
+
 	partialCount = useSynthRoute->getPartialCount();
-	allocatePartialsData();
+	partialStateWidget.setPartialCount(partialCount);
+	ui->partialStateGrid->addWidget(&partialStateWidget, 0, 0);
 
 	lcdWidget.setMinimumSize(254, 40);
 	ui->synthFrameLayout->insertWidget(1, &lcdWidget);
@@ -59,9 +114,7 @@ SynthStateMonitor::SynthStateMonitor(Ui::SynthWidget *ui, SynthRoute *useSynthRo
 
 	handleSynthStateChange(synthRoute->getState() == SynthRouteState_OPEN ? SynthState_OPEN : SynthState_CLOSED);
 	synthRoute->connectSynth(SIGNAL(stateChanged(SynthState)), this, SLOT(handleSynthStateChange(SynthState)));
-	synthRoute->connectSynth(SIGNAL(audioBlockRendered()), this, SLOT(handleUpdate()));
 	synthRoute->connectReportHandler(SIGNAL(programChanged(int, QString, QString)), this, SLOT(handleProgramChanged(int, QString, QString)));
-	synthRoute->connectReportHandler(SIGNAL(polyStateChanged(int)), this, SLOT(handlePolyStateChanged(int)));
 	synthRoute->connectReportHandler(SIGNAL(lcdMessageDisplayed(const QString)), &lcdWidget, SLOT(handleLCDMessageDisplayed(const QString)));
 	synthRoute->connectReportHandler(SIGNAL(midiMessagePlayed()), this, SLOT(handleMIDIMessagePlayed()));
 	synthRoute->connectReportHandler(SIGNAL(masterVolumeChanged(int)), &lcdWidget, SLOT(handleMasterVolumeChanged(int)));
@@ -72,32 +125,33 @@ SynthStateMonitor::~SynthStateMonitor() {
 		delete partStateWidget[i];
 		delete patchNameLabel[i];
 	}
-	freePartialsData();
+	synthRoute->setStateSnapshotEnabled(false);
+	delete newStateSnapshot;
+	delete stateSnapshot;
 }
 
 void SynthStateMonitor::enableMonitor(bool enable) {
+	// The renderer only bothers to publish the state snapshots while they are actually displayed.
+	synthRoute->setStateSnapshotEnabled(enable);
 	if (enable) {
-		enabled = true;
-		previousUpdateNanos = MasterClock::getClockNanos() - MINIMUM_UPDATE_INTERVAL_NANOS;
+		updateTimer.start();
 	} else {
-		enabled = false;
+		updateTimer.stop();
 	}
 }
 
 void SynthStateMonitor::handleSynthStateChange(SynthState state) {
 	enableMonitor(state == SynthState_OPEN);
+	clearStateSnapshot(*stateSnapshot);
 	lcdWidget.reset();
 	midiMessageLED.setColor(&COLOR_GRAY);
 
 	uint newPartialCount = synthRoute->getPartialCount();
 	if (partialCount == newPartialCount || state != SynthState_OPEN) {
-		for (unsigned int i = 0; i < partialCount; i++) {
-			partialStateLED[i]->setColor(&partialStateColor[PartialState_INACTIVE]);
-		}
+		partialStateWidget.resetPartialStates();
 	} else {
-		freePartialsData();
 		partialCount = newPartialCount;
-		allocatePartialsData();
+		partialStateWidget.setPartialCount(partialCount);
 	}
 
 	for (int i = 0; i < 9; i++) {
@@ -113,40 +167,56 @@ void SynthStateMonitor::handleMIDIMessagePlayed() {
 	}
 }
 
-void SynthStateMonitor::handlePolyStateChanged(int partNum) {
-	partStateWidget[partNum]->update();
-}
-
 void SynthStateMonitor::handleProgramChanged(int partNum, QString soundGroupName, QString patchName) {
 	patchNameLabel[partNum]->setText(patchName);
 	lcdWidget.setProgramChangeLCDText(partNum + 1, soundGroupName, patchName);
 }
 
+bool SynthStateMonitor::isPlayingNotesChanged(uint partNum) const {
+	uint playingNotesCount = stateSnapshot->playingNotesCount[partNum];
+	if (newStateSnapshot->playingNotesCount[partNum] != playingNotesCount) return true;
+	return memcmp(newStateSnapshot->keysOfPlayingNotes[partNum], stateSnapshot->keysOfPlayingNotes[partNum], playingNotesCount) != 0
+		|| memcmp(newStateSnapshot->velocitiesOfPlayingNotes[partNum], stateSnapshot->velocitiesOfPlayingNotes[partNum], playingNotesCount) != 0;
+}
+
 void SynthStateMonitor::handleUpdate() {
-	if (!enabled) return;
 	MasterClockNanos nanosNow = MasterClock::getClockNanos();
-	if (nanosNow - previousUpdateNanos < MINIMUM_UPDATE_INTERVAL_NANOS) return;
-	previousUpdateNanos = nanosNow;
-	bool midiMessageOn = false;
-	synthRoute->getPartialStates(partialStates);
-	for (unsigned int partialNum = 0; partialNum < partialCount; partialNum++) {
-		partialStateLED[partialNum]->setColor(&partialStateColor[partialStates[partialNum]]);
+	// Only the widgets affected by the changes since the previous snapshot are repainted.
+	if (synthRoute->getStateSnapshot(*newStateSnapshot)) {
+		// The partial count may change on the fly, the snapshot is published along with it.
+		if (newStateSnapshot->partialCount != 0 && newStateSnapshot->partialCount != partialCount) {
+			partialCount = newStateSnapshot->partialCount;
+			partialStateWidget.setPartialCount(partialCount);
+		}
+		partialStateWidget.setPartialStates(newStateSnapshot->partialStates, qMin(partialCount, newStateSnapshot->partialCount));
+		for (unsigned int partNum = 0; partNum < 9; partNum++) {
+			if (isPlayingNotesChanged(partNum)) partStateWidget[partNum]->update();
+		}
+		qSwap(stateSnapshot, newStateSnapshot);
 	}
-	bool partActiveNonReleasing[9] = {false};
-	synthRoute->getPartStates(partActiveNonReleasing);
+	const bool *partActiveNonReleasing = stateSnapshot->partStates;
+	bool midiMessageOn = false;
 	for (unsigned int partNum = 0; partNum < 9; partNum++) {
 		midiMessageOn = midiMessageOn || partActiveNonReleasing[partNum];
 	}
+	bool lcdChanged = false;
 	if ((lcdWidget.lcdState == LCDWidget::DISPLAYING_TIMBRE_NAME) && (nanosNow - lcdWidget.lcdStateStartNanos > LCD_TIMBRE_NAME_DISPLAYING_NANOS)) {
 		lcdWidget.setPartStateLCDText();
+		lcdChanged = true;
 	}
 	if (lcdWidget.lcdState == LCDWidget::DISPLAYING_PART_STATE) {
+		bool maskedChar[6];
 		for (int partNum = 0; partNum < 5; partNum++) {
-			lcdWidget.maskedChar[partNum << 1] = partActiveNonReleasing[partNum];
+			maskedChar[partNum] = partActiveNonReleasing[partNum];
+		}
+		maskedChar[5] = partActiveNonReleasing[8]; // mapping for the rhythm channel
+		for (int charNum = 0; charNum < 6; charNum++) {
+			if (lcdWidget.maskedChar[charNum << 1] == maskedChar[charNum]) continue;
+			lcdWidget.maskedChar[charNum << 1] = maskedChar[charNum];
+			lcdChanged = true;
 		}
-		lcdWidget.maskedChar[5 << 1] = partActiveNonReleasing[8]; // mapping for the rhythm channel
-		lcdWidget.update();
 	}
+	if (lcdChanged) lcdWidget.update();
 
 	if (midiMessageOn) {
 		midiMessageLED.setColor(&COLOR_GREEN);
@@ -156,42 +226,6 @@ void SynthStateMonitor::handleUpdate() {
 	}
 }
 
-void SynthStateMonitor::allocatePartialsData() {
-	partialStates = new PartialState[partialCount];
-	keysOfPlayingNotes = new Bit8u[partialCount];
-	velocitiesOfPlayingNotes = new Bit8u[partialCount];
-
-	partialStateLED = new LEDWidget*[partialCount];
-	unsigned int partialColumnWidth;
-	if (partialCount < 64) {
-		partialColumnWidth = 4;
-	} else if (partialCount < 128) {
-		partialColumnWidth = 8;
-	} else {
-		partialColumnWidth = 16;
-	}
-	for (unsigned int i = 0; i < partialCount; i++) {
-		partialStateLED[i] = new LEDWidget(&COLOR_GRAY, ui->partialStateGrid->widget());
-		partialStateLED[i]->setMinimumSize(16, 16);
-		partialStateLED[i]->setMaximumSize(16, 16);
-		ui->partialStateGrid->addWidget(partialStateLED[i], i / partialColumnWidth, i % partialColumnWidth);
-	}
-}
-
-void SynthStateMonitor::freePartialsData() {
-	if (partialStateLED != NULL) {
-		for (unsigned int i = 0; i < partialCount; i++) delete partialStateLED[i];
-	}
-	delete[] partialStateLED;
-	partialStateLED = NULL;
-	delete[] velocitiesOfPlayingNotes;
-	velocitiesOfPlayingNotes = NULL;
-	delete[] keysOfPlayingNotes;
-	keysOfPlayingNotes = NULL;
-	delete[] partialStates;
-	partialStates = NULL;
-}
-
 LEDWidget::LEDWidget(const QColor *color, QWidget *parent) : QWidget(parent), colorProperty(color) {}
 
 const QColor *LEDWidget::color() const {
@@ -212,18 +246,73 @@ void LEDWidget::paintEvent(QPaintEvent *paintEvent) {
 	}
 }
 
+PartialStateWidget::PartialStateWidget(QWidget *parent) : QWidget(parent), columnCount(1) {}
+
+void PartialStateWidget::setPartialCount(uint newPartialCount) {
+	partialStates.fill(PartialState_INACTIVE, newPartialCount);
+	if (newPartialCount < 64) {
+		columnCount = 4;
+	} else if (newPartialCount < 128) {
+		columnCount = 8;
+	} else {
+		columnCount = 16;
+	}
+	const int rowCount = (newPartialCount + columnCount - 1) / columnCount;
+	setFixedSize(columnCount * (PARTIAL_LED_SIZE + PARTIAL_LED_SPACING) - PARTIAL_LED_SPACING,
+		qMax(rowCount * (PARTIAL_LED_SIZE + PARTIAL_LED_SPACING) - PARTIAL_LED_SPACING, 0));
+	update();
+}
+
+void PartialStateWidget::setPartialStates(const PartialState *newPartialStates, uint count) {
+	QRegion changedRegion;
+	count = qMin(count, uint(partialStates.size()));
+	for (uint partialNum = 0; partialNum < count; partialNum++) {
+		if (partialStates[partialNum] == newPartialStates[partialNum]) continue;
+		partialStates[partialNum] = newPartialStates[partialNum];
+		changedRegion += QRegion(getLEDRect(partialNum));
+	}
+	if (!changedRegion.isEmpty()) update(changedRegion);
+}
+
+void PartialStateWidget::resetPartialStates() {
+	partialStates.fill(PartialState_INACTIVE);
+	update();
+}
+
+QRect PartialStateWidget::getLEDRect(uint partialNum) const {
+	return QRect((partialNum % columnCount) * (PARTIAL_LED_SIZE + PARTIAL_LED_SPACING),
+		(partialNum / columnCount) * (PARTIAL_LED_SIZE + PARTIAL_LED_SPACING), PARTIAL_LED_SIZE, PARTIAL_LED_SIZE);
+}
+
+void PartialStateWidget::paintEvent(QPaintEvent *paintEvent) {
+	QVector<QRect> ledRects[PARTIAL_STATE_COUNT];
+	const QRegion &paintRegion = paintEvent->region();
+	for (uint partialNum = 0; partialNum < uint(partialStates.size()); partialNum++) {
+		QRect ledRect = getLEDRect(partialNum);
+		if (paintRegion.intersects(ledRect)) ledRects[partialStates[partialNum]].append(ledRect);
+	}
+	QPainter painter(this);
+	painter.setPen(Qt::NoPen);
+	for (uint state = 0; state < PARTIAL_STATE_COUNT; state++) {
+		if (ledRects[state].isEmpty()) continue;
+		painter.setBrush(partialStateColor[state]);
+		painter.drawRects(ledRects[state]);
+	}
+}
+
 PartStateWidget::PartStateWidget(int partNum, const SynthStateMonitor &monitor, QWidget *parent) : QWidget(parent), partNum(partNum), monitor(monitor) {}
 
 void PartStateWidget::paintEvent(QPaintEvent *) {
 	QPainter painter(this);
 	painter.fillRect(rect(), COLOR_GRAY);
 	if (monitor.synthRoute->getState() != SynthRouteState_OPEN) return;
-	uint playingNotes = monitor.synthRoute->getPlayingNotes(partNum, monitor.keysOfPlayingNotes, monitor.velocitiesOfPlayingNotes);
+	const SynthStateSnapshot &stateSnapshot = *monitor.stateSnapshot;
+	uint playingNotes = stateSnapshot.playingNotesCount[partNum];
 	while (playingNotes-- > 0) {
-		uint velocity = monitor.velocitiesOfPlayingNotes[playingNotes];
+		uint velocity = stateSnapshot.velocitiesOfPlayingNotes[partNum][playingNotes];
 		if (velocity == 0) continue;
 		QColor color(2 * velocity, 255 - 2 * velocity, 0);
-		uint x  = 5 * (monitor.keysOfPlayingNotes[playingNotes] - 12);
+		uint x  = 5 * (stateSnapshot.keysOfPlayingNotes[partNum][playingNotes] - 12);
 		painter.fillRect(x, 0, 5, 16, color);
 	}
 }
@@ -232,7 +321,8 @@ LCDWidget::LCDWidget(const SynthStateMonitor &monitor, QWidget *parent) :
 	QWidget(parent),
 	monitor(monitor),
 	lcdOffBackground(":/images/LCDOff.gif"),
-	lcdOnBackground(":/images/LCDOn.gif")
+	lcdOnBackground(":/images/LCDOn.gif"),
+	glyphAtlas(makeLCDGlyphAtlas())
 {
 	reset();
 }
@@ -240,7 +330,7 @@ LCDWidget::LCDWidget(const SynthStateMonitor &monitor, QWidget *parent) :
 void LCDWidget::reset() {
 	lcdState = DISPLAYING_PART_STATE;
 	lcdStateStartNanos = 0;
-	for (int i = 0; i < 20; i++) maskedChar[i] = false;
+	for (int i = 0; i < LCD_CHAR_COUNT; i++) maskedChar[i] = false;
 	masterVolume = 100;
 	setPartStateLCDText();
 }
@@ -252,15 +342,9 @@ void LCDWidget::paintEvent(QPaintEvent *) {
 		return;
 	}
 	lcdPainter.drawPixmap(0, 0, lcdOnBackground);
-	lcdPainter.translate(7, 9);
-
-	int xat, xstart, yat;
-	xstart = 0;
-	yat = 0;
 
-	for (int i = 0; i < 20; i++) {
-		unsigned char c;
-		c = 0x20;
+	for (int i = 0; i < LCD_CHAR_COUNT; i++) {
+		unsigned char c = 0x20;
 		if (i < lcdText.size()) {
 			c = lcdText[i];
 		}
@@ -269,29 +353,9 @@ void LCDWidget::paintEvent(QPaintEvent *) {
 		if (c < 0x20) c = 0x20;
 		if (c > 0x7f) c = 0x20;
 
-		c -= 0x20;
-
-		yat = 1;
-		for (int t = 0; t < 8; t++) {
-			xat = xstart;
-			unsigned char fval;
-			if (maskedChar[i] && (t != 7) && (lcdState == DISPLAYING_PART_STATE)) {
-				fval = 0x1f;
-			} else {
-				fval = Font_6x8[c][t];
-			}
-			for (int m = 4; m >= 0; --m) {
-				if ((fval >> m) & 1) {
-					lcdPainter.fillRect(xat, yat, 2, 2, lcdFgColor);
-				} else {
-					lcdPainter.fillRect(xat, yat, 2, 2, lcdBgColor);
-				}
-				xat += 2;
-			}
-			yat += 2;
-			if (t == 6) yat += 2;
-		}
-		xstart += 12;
+		const bool masked = maskedChar[i] && (lcdState == DISPLAYING_PART_STATE);
+		lcdPainter.drawPixmap(LCD_TEXT_LEFT + 12 * i, LCD_TEXT_TOP, glyphAtlas,
+			(c - 0x20) * LCD_GLYPH_WIDTH, masked ? LCD_GLYPH_HEIGHT : 0, LCD_GLYPH_WIDTH, LCD_GLYPH_HEIGHT);
 	}
 }
 
@@ -9,6 +9,7 @@
 
 class SynthRoute;
 class QLabel;
+struct SynthStateSnapshot;
 
 namespace Ui {
 	class SynthWidget;
@@ -29,6 +30,27 @@ private:
 	const QColor *colorProperty;
 };
 
+// Displays the states of all the partials as a grid of LEDs. Only the LEDs that change are repainted,
+// and the LEDs of the same colour are filled together.
+class PartialStateWidget : public QWidget {
+	Q_OBJECT
+
+public:
+	explicit PartialStateWidget(QWidget *parent = 0);
+	void setPartialCount(uint newPartialCount);
+	void setPartialStates(const MT32Emu::PartialState *newPartialStates, uint count);
+	void resetPartialStates();
+
+protected:
+	void paintEvent(QPaintEvent *);
+
+private:
+	QVector<MT32Emu::PartialState> partialStates;
+	uint columnCount;
+
+	QRect getLEDRect(uint partialNum) const;
+};
+
 class PartStateWidget : public QWidget {
 	Q_OBJECT
 
@@ -65,6 +87,8 @@ private:
 	const SynthStateMonitor &monitor;
 	const QPixmap lcdOffBackground;
 	const QPixmap lcdOnBackground;
+	// All the characters of the font as drawn on the LCD, the masked ones in the second row.
+	const QPixmap glyphAtlas;
 
 	QByteArray lcdText;
 	LCDState lcdState;
@@ -97,27 +121,24 @@ private:
 	const Ui::SynthWidget * const ui;
 	LCDWidget lcdWidget;
 	LEDWidget midiMessageLED;
-	LEDWidget **partialStateLED;
+	PartialStateWidget partialStateWidget;
 	QLabel *patchNameLabel[9];
 	PartStateWidget *partStateWidget[9];
 
-	MT32Emu::PartialState *partialStates;
-	MT32Emu::Bit8u *keysOfPlayingNotes;
-	MT32Emu::Bit8u *velocitiesOfPlayingNotes;
+	// The last synth state snapshot displayed and the one being compared against it.
+	SynthStateSnapshot *stateSnapshot;
+	SynthStateSnapshot *newStateSnapshot;
+	QTimer updateTimer;
 
 	MasterClockNanos midiMessageLEDStartNanos;
-	MasterClockNanos previousUpdateNanos;
-	bool enabled;
 	uint partialCount;
 
-	void allocatePartialsData();
-	void freePartialsData();
+	bool isPlayingNotesChanged(uint partNum) const;
 
 private slots:
 	void handleUpdate();
 	void handleSynthStateChange(SynthState);
 	void handleMIDIMessagePlayed();
-	void handlePolyStateChanged(int partNum);
 	void handleProgramChanged(int partNum, QString soundGroupName, QString patchName);
 };
 
@@ -14,6 +14,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QDateTime>
 #include <QFileDialog>
 
 #include "audiodrv/AudioDriver.h"
@@ -23,6 +24,8 @@
 #include "MidiSession.h"
 #include "SynthStateMonitor.h"
 
+static const int AUDIO_STATS_UPDATE_INTERVAL_MILLIS = 1000;
+
 static void updateMidiAddActionEnabled(Ui::SynthWidget *ui) {
 	ui->midiAdd->setEnabled(ui->pinCheckBox->isEnabled() && Master::getInstance()->canCreateMidiPort());
 }
@@ -57,6 +60,8 @@ SynthWidget::SynthWidget(Master *master, SynthRoute *useSynthRoute, bool pinnabl
 	connect(synthRoute, SIGNAL(midiSessionNameChanged(MidiSession *)), SLOT(handleMIDISessionNameChanged(MidiSession *)));
 	connect(master, SIGNAL(synthRoutePinned()), SLOT(handleSynthRoutePinned()));
 	connect(ui->synthPropertiesButton, SIGNAL(clicked()), &spd, SLOT(exec()));
+	connect(&audioStatsTimer, SIGNAL(timeout()), SLOT(updateAudioStats()));
+	connect(ui->audioStatsLabel, SIGNAL(linkActivated(const QString &)), SLOT(resetAudioStats()));
 
 	synthRoute->connectReportHandler(SIGNAL(masterVolumeChanged(int)), this, SLOT(handleMasterVolumeChanged(int)));
 
@@ -106,9 +111,10 @@ void SynthWidget::handleSynthRouteState(SynthRouteState SynthRouteState) {
 	case SynthRouteState_OPEN:
 		ui->startButton->setEnabled(false);
 		ui->stopButton->setEnabled(true);
-		ui->audioDeviceComboBox->setEnabled(false);
-		ui->refreshButton->setEnabled(false);
-		ui->audioPropertiesButton->setEnabled(false);
+		// The audio stream is swapped while the synth keeps running, unless the stream is bound to an exclusive MIDI session.
+		ui->audioDeviceComboBox->setEnabled(!synthRoute->isExclusiveMidiModeEnabled());
+		ui->refreshButton->setEnabled(!synthRoute->isExclusiveMidiModeEnabled());
+		ui->audioPropertiesButton->setEnabled(!synthRoute->isExclusiveMidiModeEnabled());
 		ui->statusLabel->setText("Open");
 		break;
 	case SynthRouteState_OPENING:
@@ -136,6 +142,7 @@ void SynthWidget::handleSynthRouteState(SynthRouteState SynthRouteState) {
 		ui->statusLabel->setText("Closed");
 		break;
 	}
+	enableAudioStats(SynthRouteState == SynthRouteState_OPEN && isVisible());
 	setEmuModeText();
 }
 
@@ -149,6 +156,7 @@ void SynthWidget::on_audioPropertiesButton_clicked()
 		AudioDriverSettings newDriverSettings;
 		apd.getData(newDriverSettings);
 		device->driver.setAudioSettings(newDriverSettings);
+		if (synthRoute->getState() == SynthRouteState_OPEN && synthRoute->getAudioDevice() == device) synthRoute->restartAudioStream();
 	}
 }
 
@@ -242,11 +250,10 @@ void SynthWidget::on_midiRecord_clicked() {
 		QString fileName = QFileDialog::getSaveFileName(this, NULL, currentDir, "Standard MIDI files (*.mid)");
 		if (!fileName.isEmpty()) {
 			currentDir = QDir(fileName).absolutePath();
-			recorder.saveSMF(fileName, MasterClock::NANOS_PER_MILLISECOND);
+			recorder.saveSMF(fileName);
 		}
-	} else {
+	} else if (recorder.startRecording()) {
 		ui->midiRecord->setText("Stop");
-		recorder.startRecording();
 	}
 }
 
@@ -275,12 +282,71 @@ void SynthWidget::handleMasterVolumeChanged(int volume) {
 
 void SynthWidget::hideEvent(QHideEvent *) {
 	synthStateMonitor->enableMonitor(false);
+	enableAudioStats(false);
 }
 
 void SynthWidget::showEvent(QShowEvent *) {
 	if (synthRoute->getState() == SynthRouteState_OPEN) {
 		synthStateMonitor->enableMonitor(true);
+		enableAudioStats(true);
+	}
+}
+
+void SynthWidget::enableAudioStats(bool enable) {
+	if (enable) {
+		if (!audioStatsTimer.isActive()) audioStatsTimer.start(AUDIO_STATS_UPDATE_INTERVAL_MILLIS);
+		updateAudioStats();
+	} else {
+		audioStatsTimer.stop();
+		ui->audioStatsLabel->clear();
+		ui->audioStatsLabel->setToolTip(QString());
+	}
+}
+
+static QString formatSpikeTime(qint64 timestamp) {
+	return QDateTime::fromMSecsSinceEpoch(timestamp).toString("hh:mm:ss");
+}
+
+void SynthWidget::updateAudioStats() {
+	AudioStreamStats stats;
+	if (!synthRoute->getAudioStreamStats(stats)) {
+		ui->audioStatsLabel->clear();
+		return;
+	}
+	const uint outputSampleRate = synthRoute->getOutputSampleRate();
+	const uint synthSampleRate = synthRoute->getSynthSampleRate();
+	QString text = QString("%1 Hz").arg(outputSampleRate);
+	text += outputSampleRate == synthSampleRate ? QString(" native") : QString(" resampled from %1 Hz").arg(synthSampleRate);
+	text += QString(", peak load: %1%").arg(stats.worstSpike.renderLoad);
+	if (stats.worstSpike.renderLoad > 0) text += " at " + formatSpikeTime(stats.worstSpike.timestamp);
+	text += QString(", deadline misses: %1, underruns: %2 <a href=\"reset\">Reset</a>").arg(stats.deadlineMissCount).arg(stats.underrunCount);
+	ui->audioStatsLabel->setText(text);
+
+	QString toolTip = QString("Render load histogram, %1 renders:").arg(stats.renderCount);
+	quint32 lowerLimit = 0;
+	for (uint rangeIx = 0; rangeIx < AudioStreamStats::RENDER_LOAD_HISTOGRAM_SIZE; rangeIx++) {
+		if (rangeIx < AudioStreamStats::RENDER_LOAD_HISTOGRAM_SIZE - 1) {
+			quint32 upperLimit = AudioStreamStats::RENDER_LOAD_LIMITS[rangeIx];
+			toolTip += QString("\n  %1-%2%: ").arg(lowerLimit).arg(upperLimit);
+			lowerLimit = upperLimit;
+		} else {
+			toolTip += QString("\n  %1% and more: ").arg(lowerLimit);
+		}
+		toolTip += QString::number(stats.renderLoadHistogram[rangeIx]);
+	}
+	if (stats.deadlineMissCount > 0) {
+		toolTip += "\nRecent deadline misses:";
+		quint32 spikeCount = qMin(stats.deadlineMissCount, quint32(AudioStreamStats::RECENT_SPIKE_COUNT));
+		for (quint32 i = 1; i <= spikeCount; i++) {
+			const AudioStreamStats::Spike &spike = stats.recentSpikes[(stats.deadlineMissCount - i) % AudioStreamStats::RECENT_SPIKE_COUNT];
+			toolTip += QString("\n  %1: %2% of %3 frames").arg(formatSpikeTime(spike.timestamp)).arg(spike.renderLoad).arg(spike.frameCount);
+		}
 	}
+	ui->audioStatsLabel->setToolTip(toolTip);
+}
+
+void SynthWidget::resetAudioStats() {
+	synthRoute->resetAudioStreamStats();
 }
 
 void SynthWidget::on_detailsButton_clicked() {
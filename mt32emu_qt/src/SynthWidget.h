@@ -37,6 +37,7 @@ private:
 	SynthPropertiesDialog spd;
 	AudioPropertiesDialog apd;
 	MidiPropertiesDialog mpd;
+	QTimer audioStatsTimer;
 
 	static const QIcon &getSynthDetailsIcon(bool visible);
 
@@ -44,6 +45,7 @@ private:
 	int findMIDISession(MidiSession *midiSession);
 	MidiSession *getSelectedMIDISession();
 	void setEmuModeText();
+	void enableAudioStats(bool enable);
 
 private slots:
 	void on_startButton_clicked();
@@ -66,6 +68,8 @@ private slots:
 	void handleMIDISessionRemoved(MidiSession *midiSession);
 	void handleMIDISessionNameChanged(MidiSession *midiSession);
 	void handleMasterVolumeChanged(int volume);
+	void updateAudioStats();
+	void resetAudioStats();
 };
 
 #endif // SYNTHWIDGET_H
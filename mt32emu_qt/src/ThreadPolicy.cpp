@@ -0,0 +1,208 @@
+/* Copyright (C) 2011-2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <pthread.h>
+#include <sched.h>
+
+#if defined __APPLE__
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#endif
+
+#endif
+
+#include <QDebug>
+#include <QSettings>
+#include <QStringList>
+
+#include "ThreadPolicy.h"
+
+static const int DEFAULT_REALTIME_PRIORITY = 50;
+static const uint MAX_CPU_COUNT = 64;
+
+static quint64 parseCPUList(const QString &cpuList) {
+	quint64 mask = 0;
+	QStringList items = cpuList.split(',', QString::SkipEmptyParts);
+	for (int itemIx = 0; itemIx < items.size(); itemIx++) {
+		QStringList bounds = items.at(itemIx).trimmed().split('-');
+		bool firstValid, lastValid;
+		uint firstCPU = bounds.first().trimmed().toUInt(&firstValid);
+		uint lastCPU = bounds.last().trimmed().toUInt(&lastValid);
+		if (bounds.size() > 2 || !firstValid || !lastValid || lastCPU < firstCPU || lastCPU >= MAX_CPU_COUNT) {
+			qDebug() << "ThreadPolicy: Ignoring invalid CPU list item" << items.at(itemIx);
+			continue;
+		}
+		for (uint cpu = firstCPU; cpu <= lastCPU; cpu++) {
+			mask |= quint64(1) << cpu;
+		}
+	}
+	return mask;
+}
+
+ThreadPolicy::ThreadPolicy() :
+	scheduling(Scheduling_DEFAULT),
+	priority(DEFAULT_REALTIME_PRIORITY),
+	cpuAffinityMask(0),
+	mmcssProAudio(false),
+	timeConstraint(false)
+{}
+
+void ThreadPolicy::load(const QSettings &qSettings, const QString &prefix) {
+	QString schedulingName = qSettings.value(prefix + "/ThreadScheduling", "default").toString().toLower();
+	if (schedulingName == "fifo") {
+		scheduling = Scheduling_FIFO;
+	} else if (schedulingName == "rr") {
+		scheduling = Scheduling_RR;
+	} else {
+		scheduling = Scheduling_DEFAULT;
+	}
+	priority = qSettings.value(prefix + "/ThreadPriority", DEFAULT_REALTIME_PRIORITY).toInt();
+	cpuAffinityMask = parseCPUList(qSettings.value(prefix + "/ThreadCPUs").toString());
+	mmcssProAudio = qSettings.value(prefix + "/ThreadMMCSS", false).toBool();
+	timeConstraint = qSettings.value(prefix + "/ThreadTimeConstraint", false).toBool();
+}
+
+bool ThreadPolicy::isDefault() const {
+	return scheduling == Scheduling_DEFAULT && cpuAffinityMask == 0 && !mmcssProAudio && !timeConstraint;
+}
+
+#if defined _WIN32
+
+typedef HANDLE (WINAPI *AvSetMmThreadCharacteristicsFunction)(LPCWSTR taskName, LPDWORD taskIndex);
+typedef BOOL (WINAPI *AvRevertMmThreadCharacteristicsFunction)(HANDLE avrtHandle);
+
+// The MMCSS API is resolved dynamically, so that the application still starts on systems that lack avrt.dll.
+static FARPROC getAvrtFunction(const char *name) {
+	HMODULE avrtModule = GetModuleHandleA("avrt.dll");
+	if (avrtModule == NULL) avrtModule = LoadLibraryA("avrt.dll");
+	return avrtModule == NULL ? NULL : GetProcAddress(avrtModule, name);
+}
+
+ThreadPolicyScope::ThreadPolicyScope(const ThreadPolicy &policy, const char *threadName, const MasterClockNanos) :
+	mmcssHandle(NULL)
+{
+	if (policy.isDefault()) return;
+	if (policy.scheduling != ThreadPolicy::Scheduling_DEFAULT) {
+		qDebug() << "ThreadPolicy:" << threadName << "- POSIX scheduling policies are unsupported on this platform";
+	}
+	if (policy.timeConstraint) {
+		qDebug() << "ThreadPolicy:" << threadName << "- the time-constraint policy is unsupported on this platform";
+	}
+	if (policy.cpuAffinityMask != 0) {
+		DWORD_PTR affinityMask = DWORD_PTR(policy.cpuAffinityMask);
+		if (affinityMask == 0 || SetThreadAffinityMask(GetCurrentThread(), affinityMask) == 0) {
+			qDebug() << "ThreadPolicy:" << threadName << "- failed to set CPU affinity:" << GetLastError();
+		}
+	}
+	if (policy.mmcssProAudio) {
+		AvSetMmThreadCharacteristicsFunction avSetMmThreadCharacteristics =
+			AvSetMmThreadCharacteristicsFunction(getAvrtFunction("AvSetMmThreadCharacteristicsW"));
+		DWORD taskIndex = 0;
+		if (avSetMmThreadCharacteristics != NULL) mmcssHandle = avSetMmThreadCharacteristics(L"Pro Audio", &taskIndex);
+		if (mmcssHandle == NULL) {
+			qDebug() << "ThreadPolicy:" << threadName << "- failed to register with MMCSS:" << GetLastError();
+		} else {
+			qDebug() << "ThreadPolicy:" << threadName << "- registered with MMCSS, task index:" << taskIndex;
+		}
+	}
+}
+
+ThreadPolicyScope::~ThreadPolicyScope() {
+	if (mmcssHandle == NULL) return;
+	AvRevertMmThreadCharacteristicsFunction avRevertMmThreadCharacteristics =
+		AvRevertMmThreadCharacteristicsFunction(getAvrtFunction("AvRevertMmThreadCharacteristics"));
+	if (avRevertMmThreadCharacteristics != NULL) avRevertMmThreadCharacteristics(mmcssHandle);
+}
+
+#else // defined _WIN32
+
+static void setRealtimeScheduling(const ThreadPolicy &policy, const char *threadName) {
+	int schedulingPolicy = policy.scheduling == ThreadPolicy::Scheduling_FIFO ? SCHED_FIFO : SCHED_RR;
+	sched_param param;
+	param.sched_priority = qBound(sched_get_priority_min(schedulingPolicy), policy.priority, sched_get_priority_max(schedulingPolicy));
+	int error = pthread_setschedparam(pthread_self(), schedulingPolicy, &param);
+	if (error != 0) {
+		// Typically EPERM, unless the user is permitted to use realtime scheduling, e.g. via RLIMIT_RTPRIO.
+		qDebug() << "ThreadPolicy:" << threadName << "- failed to set realtime scheduling:" << error;
+	} else {
+		qDebug() << "ThreadPolicy:" << threadName << "- realtime scheduling set, priority:" << param.sched_priority;
+	}
+}
+
+static void setCPUAffinity(const ThreadPolicy &policy, const char *threadName) {
+#if defined __linux__ && defined _GNU_SOURCE
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	for (uint cpu = 0; cpu < MAX_CPU_COUNT; cpu++) {
+		if ((policy.cpuAffinityMask >> cpu) & 1) CPU_SET(cpu, &cpuSet);
+	}
+	int error = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+	if (error != 0) {
+		qDebug() << "ThreadPolicy:" << threadName << "- failed to set CPU affinity:" << error;
+	}
+#else
+	Q_UNUSED(policy);
+	qDebug() << "ThreadPolicy:" << threadName << "- CPU affinity is unsupported on this platform";
+#endif
+}
+
+static void setTimeConstraintPolicy(const MasterClockNanos periodNanos, const char *threadName) {
+#if defined __APPLE__
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+	const double ticksPerNano = double(timebase.denom) / timebase.numer;
+	thread_time_constraint_policy_data_t timeConstraintPolicy;
+	timeConstraintPolicy.period = uint32_t(periodNanos * ticksPerNano);
+	// The thread is expected to need up to a half of each period to complete the work.
+	timeConstraintPolicy.computation = uint32_t((periodNanos / 2) * ticksPerNano);
+	timeConstraintPolicy.constraint = timeConstraintPolicy.period;
+	timeConstraintPolicy.preemptible = TRUE;
+	kern_return_t result = thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+		thread_policy_t(&timeConstraintPolicy), THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+	if (result != KERN_SUCCESS) {
+		qDebug() << "ThreadPolicy:" << threadName << "- failed to set time-constraint policy:" << result;
+	}
+#else
+	Q_UNUSED(periodNanos);
+	qDebug() << "ThreadPolicy:" << threadName << "- the time-constraint policy is unsupported on this platform";
+#endif
+}
+
+ThreadPolicyScope::ThreadPolicyScope(const ThreadPolicy &policy, const char *threadName, const MasterClockNanos periodNanos) :
+	mmcssHandle(NULL)
+{
+	if (policy.isDefault()) return;
+	if (policy.mmcssProAudio) {
+		qDebug() << "ThreadPolicy:" << threadName << "- MMCSS is unsupported on this platform";
+	}
+	if (policy.timeConstraint) {
+		setTimeConstraintPolicy(periodNanos, threadName);
+	} else if (policy.scheduling != ThreadPolicy::Scheduling_DEFAULT) {
+		setRealtimeScheduling(policy, threadName);
+	}
+	if (policy.cpuAffinityMask != 0) setCPUAffinity(policy, threadName);
+}
+
+ThreadPolicyScope::~ThreadPolicyScope() {}
+
+#endif // defined _WIN32
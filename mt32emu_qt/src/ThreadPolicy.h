@@ -0,0 +1,74 @@
+/* Copyright (C) 2011-2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THREAD_POLICY_H
+#define THREAD_POLICY_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "MasterClock.h"
+
+class QSettings;
+
+// Scheduling parameters of the threads that render audio or process MIDI in real time, on top of the priority
+// these threads are started with. Each part only takes effect where supported by the platform, and is ignored otherwise.
+struct ThreadPolicy {
+	enum Scheduling {
+		// Keep the scheduling policy the thread is started with.
+		Scheduling_DEFAULT,
+		// POSIX realtime scheduling policies SCHED_FIFO and SCHED_RR.
+		Scheduling_FIFO,
+		Scheduling_RR
+	};
+
+	Scheduling scheduling;
+	// The realtime priority used with the POSIX scheduling policies, clamped to the range the system supports.
+	int priority;
+	// The CPUs the thread is allowed to run on, bit N stands for CPU N. 0 - no restriction.
+	quint64 cpuAffinityMask;
+	// Whether to register the thread with the Windows Multimedia Class Scheduler Service as a "Pro Audio" task.
+	bool mmcssProAudio;
+	// Whether to switch the thread to the time-constraint policy on macOS, using the period the thread wakes up with.
+	bool timeConstraint;
+
+	ThreadPolicy();
+	// The settings are not exposed in the GUI. The keys are prefixed by the group, e.g. "Audio/pulseaudio/ThreadScheduling":
+	//   ThreadScheduling - "fifo", "rr" or "default"
+	//   ThreadPriority - integer
+	//   ThreadCPUs - comma-separated list of CPU numbers or ranges, e.g. "2,3" or "2-3"
+	//   ThreadMMCSS - boolean
+	//   ThreadTimeConstraint - boolean
+	void load(const QSettings &qSettings, const QString &prefix);
+	bool isDefault() const;
+};
+
+// Applies a ThreadPolicy to the calling thread for the lifetime of the object, intended to be created on the stack
+// at the beginning of the thread function. The MMCSS registration is reverted upon destruction, other changes persist.
+// The period is the usual time between the wake-ups of the thread, used for the time-constraint policy.
+class ThreadPolicyScope {
+public:
+	ThreadPolicyScope(const ThreadPolicy &policy, const char *threadName, const MasterClockNanos periodNanos);
+	~ThreadPolicyScope();
+
+private:
+	void *mmcssHandle;
+
+	ThreadPolicyScope(const ThreadPolicyScope &);
+	ThreadPolicyScope &operator=(const ThreadPolicyScope &);
+};
+
+#endif
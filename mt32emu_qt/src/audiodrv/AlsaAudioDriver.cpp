@@ -14,7 +14,11 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cerrno>
+#include <cstring>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
 
 #include "AlsaAudioDriver.h"
 
@@ -27,9 +31,12 @@ static const unsigned int FRAME_SIZE = 4; // Stereo, 16-bit
 static const unsigned int DEFAULT_CHUNK_MS = 16;
 static const unsigned int DEFAULT_AUDIO_LATENCY = 64;
 static const unsigned int DEFAULT_MIDI_LATENCY = 32;
+// In the mmap mode, the processing thread wakes up at least this often to check for the stop request.
+static const int MMAP_WAIT_TIMEOUT_MS = 100;
 
 AlsaAudioStream::AlsaAudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, const quint32 useSampleRate) :
-  AudioStream(useSettings, useSynthRoute, useSampleRate), stream(NULL), processingThreadID(0), stopProcessing(false)
+  AudioStream(useSettings, useSynthRoute, useSampleRate), stream(NULL), processingThreadID(0), stopProcessing(false),
+  mmapMode(false), memoryLocked(false)
 {
 	bufferSize = settings.chunkLen * sampleRate / MasterClock::MILLIS_PER_SECOND;
 	buffer = new Bit16s[/* channels */ 2 * bufferSize];
@@ -45,10 +52,26 @@ void *AlsaAudioStream::processingThread(void *userData) {
 	bool isErrorOccured = false;
 	AlsaAudioStream &audioStream = *(AlsaAudioStream *)userData;
 	qDebug() << "ALSA audio: Processing thread started";
+	ThreadPolicyScope threadPolicyScope(audioStream.settings.threadPolicy, "ALSA audio", audioStream.getChunkNanos());
+	const bool autoLatency = audioStream.isAutoLatencyMode();
 	while (!audioStream.stopProcessing) {
+		if (audioStream.mmapMode) {
+			error = audioStream.waitForMMapSpace();
+			if (error < 0) {
+				qDebug() << "ALSA audio: Waiting for buffer space failed:" << snd_strerror(error) << "-> recovering...";
+				if (error == -EPIPE) audioStream.audioUnderrunOccurred(MasterClock::getClockNanos());
+				error = snd_pcm_recover(audioStream.stream, error, 0);
+				if (error != 0) {
+					qDebug() << "snd_pcm_recover failed:" << snd_strerror(error) << "-> closing...";
+					isErrorOccured = true;
+					break;
+				}
+			}
+			if (error <= 0) continue;
+		}
 		MasterClockNanos nanosNow = MasterClock::getClockNanos();
 		quint32 framesInAudioBuffer = 0;
-		if (audioStream.settings.advancedTiming) {
+		if (audioStream.settings.advancedTiming || autoLatency) {
 			snd_pcm_sframes_t delayp;
 			error = snd_pcm_delay(audioStream.stream, &delayp);
 			if (error < 0) {
@@ -59,23 +82,41 @@ void *AlsaAudioStream::processingThread(void *userData) {
 				framesInAudioBuffer = (quint32)delayp;
 			}
 		}
+		if (autoLatency) {
+			// Rather than filling the whole device buffer, only keep the adaptive target amount of audio there.
+			quint32 targetFrames = audioStream.updateAudioLatencyTarget(nanosNow, framesInAudioBuffer);
+			if (framesInAudioBuffer + audioStream.bufferSize > targetFrames) {
+				quint32 excessFrames = framesInAudioBuffer + audioStream.bufferSize - targetFrames;
+				MasterClock::sleepForNanos((excessFrames * MasterClock::NANOS_PER_SECOND) / audioStream.sampleRate);
+				continue;
+			}
+		}
 		audioStream.updateTimeInfo(nanosNow, framesInAudioBuffer);
-		audioStream.synthRoute.render(audioStream.buffer, audioStream.bufferSize);
-		error = snd_pcm_writei(audioStream.stream, audioStream.buffer, audioStream.bufferSize);
-		if (error < 0) {
-			qDebug() << "snd_pcm_writei failed:" << snd_strerror(error) << "-> recovering...";
+		quint32 renderedFrames;
+		snd_pcm_sframes_t framesWritten;
+		if (audioStream.mmapMode) {
+			framesWritten = audioStream.renderMMap(renderedFrames);
+		} else {
+			audioStream.synthRoute.render(audioStream.buffer, audioStream.bufferSize);
+			renderedFrames = audioStream.bufferSize;
+			framesWritten = snd_pcm_writei(audioStream.stream, audioStream.buffer, audioStream.bufferSize);
+		}
+		if (framesWritten < 0) {
+			error = int(framesWritten);
+			qDebug() << "ALSA audio: Writing to the buffer failed:" << snd_strerror(error) << "-> recovering...";
+			if (error == -EPIPE) audioStream.audioUnderrunOccurred(nanosNow);
 			error = snd_pcm_recover(audioStream.stream, error, 0);
 			if (error != 0) {
 				qDebug() << "snd_pcm_recover failed:" << snd_strerror(error) << "-> closing...";
 				isErrorOccured = true;
 				break;
 			}
-		} else if (error != (int)audioStream.bufferSize) {
-			qDebug() << "snd_pcm_writei failed. Written frames:" << error;
+		} else if (framesWritten != (snd_pcm_sframes_t)renderedFrames) {
+			qDebug() << "ALSA audio: Writing to the buffer failed. Written frames:" << framesWritten;
 //			isErrorOccured = true;
 //			break;
 		}
-		audioStream.framesRendered(audioStream.bufferSize);
+		audioStream.framesRendered(renderedFrames);
 	}
 	if (isErrorOccured) {
 		snd_pcm_close(audioStream.stream);
@@ -88,13 +129,55 @@ void *AlsaAudioStream::processingThread(void *userData) {
 	return NULL;
 }
 
-bool AlsaAudioStream::start(const char *deviceID) {
+// Returns 1 when a chunk can be rendered to the hardware buffer, 0 if the wait has timed out, or a negative error code.
+int AlsaAudioStream::waitForMMapSpace() {
+	snd_pcm_sframes_t framesAvailable = snd_pcm_avail_update(stream);
+	if (framesAvailable < 0) return int(framesAvailable);
+	if (framesAvailable >= (snd_pcm_sframes_t)bufferSize) return 1;
+	// Sleeps in poll() till the next period boundary.
+	int error = snd_pcm_wait(stream, MMAP_WAIT_TIMEOUT_MS);
+	return error < 0 ? error : 0;
+}
+
+// Renders up to a chunk straight into the hardware buffer, fewer frames are rendered at the end of the ring.
+// Returns the number of frames committed or a negative error code.
+snd_pcm_sframes_t AlsaAudioStream::renderMMap(quint32 &renderedFrames) {
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset;
+	snd_pcm_uframes_t frames = bufferSize;
+	renderedFrames = 0;
+	int error = snd_pcm_mmap_begin(stream, &areas, &offset, &frames);
+	if (error < 0) return error;
+	// With the interleaved access, the first area describes the whole frame.
+	Bit16s *data = (Bit16s *)((char *)areas[0].addr + (areas[0].first >> 3) + offset * (areas[0].step >> 3));
+	synthRoute.render(data, uint(frames));
+	renderedFrames = quint32(frames);
+	return snd_pcm_mmap_commit(stream, offset, frames);
+}
+
+// Both the realtime policy and memory locking commonly require privileges, so they are only attempted.
+void AlsaAudioStream::setRealtimeScheduling() {
+	struct sched_param param;
+	param.sched_priority = (sched_get_priority_min(SCHED_FIFO) + sched_get_priority_max(SCHED_FIFO)) / 2;
+	int error = pthread_setschedparam(processingThreadID, SCHED_FIFO, &param);
+	if (error != 0) {
+		qDebug() << "ALSA audio: Failed to set SCHED_FIFO policy for the processing thread:" << strerror(error);
+	}
+	// Only the pages mapped so far are locked, the future allocations might fail otherwise when the limit is hit.
+	memoryLocked = mlockall(MCL_CURRENT) == 0;
+	if (!memoryLocked) {
+		qDebug() << "ALSA audio: Failed to lock memory:" << strerror(errno);
+	}
+}
+
+bool AlsaAudioStream::start(const char *deviceID, bool useMMap) {
 	int error;
 	if (buffer == NULL) return false;
 	memset(buffer, 0, FRAME_SIZE * bufferSize);
 	if (stream != NULL) close();
 
-	qDebug() << "Using ALSA audio device:" << deviceID;
+	mmapMode = useMMap;
+	qDebug() << "Using ALSA audio device:" << deviceID << (mmapMode ? "in the mmap mode" : "");
 
 	// Create a new playback stream
 	error = snd_pcm_open(&stream, deviceID, SND_PCM_STREAM_PLAYBACK, 0);
@@ -105,7 +188,8 @@ bool AlsaAudioStream::start(const char *deviceID) {
 	}
 
 	// Set Sample format to use
-	error = snd_pcm_set_params(stream, SND_PCM_FORMAT_S16, SND_PCM_ACCESS_RW_INTERLEAVED, /* channels */ 2,
+	error = snd_pcm_set_params(stream, SND_PCM_FORMAT_S16,
+	  mmapMode ? SND_PCM_ACCESS_MMAP_INTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED, /* channels */ 2,
 	  sampleRate, /* allow resampling */ 1, settings.audioLatency * MasterClock::MICROS_PER_MILLISECOND);
 	if (error < 0) {
 		qDebug() << "snd_pcm_set_params failed:" << snd_strerror(error);
@@ -123,12 +207,15 @@ bool AlsaAudioStream::start(const char *deviceID) {
 	qDebug() << "Using audio latency:" << audioLatencyFrames << "frames, chunk size:" << bufferSize << "frames";
 
 	// Setup initial MIDI latency
-	if (isAutoLatencyMode()) midiLatencyFrames = audioLatencyFrames + ((DEFAULT_MIDI_LATENCY * sampleRate) / MasterClock::MILLIS_PER_SECOND);
+	if (isAutoLatencyMode()) {
+		midiLatencyFrames = audioLatencyFrames + ((DEFAULT_MIDI_LATENCY * sampleRate) / MasterClock::MILLIS_PER_SECOND);
+		startAudioLatencyControl(bufferSize);
+	}
 
 	// Start playing to fill audio buffers
 	int initFrames = audioLatencyFrames;
 	while (initFrames > 0) {
-		error = snd_pcm_writei(stream, buffer, bufferSize);
+		error = mmapMode ? snd_pcm_mmap_writei(stream, buffer, bufferSize) : snd_pcm_writei(stream, buffer, bufferSize);
 		if (error < 0) {
 			qDebug() << "snd_pcm_writei failed:" << snd_strerror(error);
 			snd_pcm_close(stream);
@@ -151,6 +238,7 @@ bool AlsaAudioStream::start(const char *deviceID) {
 		stream = NULL;
 		return false;
 	}
+	if (mmapMode) setRealtimeScheduling();
 	return true;
 }
 
@@ -171,18 +259,36 @@ void AlsaAudioStream::close() {
 			qDebug() << "snd_pcm_close failed:" << snd_strerror(error);
 		}
 	}
+	if (memoryLocked) {
+		munlockall();
+		memoryLocked = false;
+	}
 	return;
 }
 
-AlsaAudioDevice::AlsaAudioDevice(AlsaAudioDriver &driver, const char *useDeviceID, const QString name) : AudioDevice(driver, name), deviceID(useDeviceID) {}
+AlsaAudioDevice::AlsaAudioDevice(AlsaAudioDriver &driver, const char *useDeviceID, const QString name, bool useMMap) :
+	AudioDevice(driver, name), deviceID(useDeviceID), mmapMode(useMMap) {}
 
 AudioStream *AlsaAudioDevice::startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const {
 	AlsaAudioStream *stream = new AlsaAudioStream(driver.getAudioSettings(), synthRoute, sampleRate);
-	if (stream->start(deviceID)) return stream;
+	if (stream->start(deviceID, mmapMode)) return stream;
 	delete stream;
 	return NULL;
 }
 
+bool AlsaAudioDevice::isSampleRateSupported(const uint sampleRate) const {
+	snd_pcm_t *pcm;
+	if (snd_pcm_open(&pcm, deviceID, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK) < 0) return false;
+	snd_pcm_hw_params_t *hwParams;
+	snd_pcm_hw_params_alloca(&hwParams);
+	// With the resampling in the plugins disabled, only the rates the hardware plays remain.
+	bool supported = snd_pcm_hw_params_any(pcm, hwParams) >= 0
+		&& snd_pcm_hw_params_set_rate_resample(pcm, hwParams, 0) >= 0
+		&& snd_pcm_hw_params_test_rate(pcm, hwParams, sampleRate, 0) == 0;
+	snd_pcm_close(pcm);
+	return supported;
+}
+
 AlsaAudioDriver::AlsaAudioDriver(Master *master) : AudioDriver("alsa", "ALSA") {
 	Q_UNUSED(master);
 
@@ -194,6 +300,7 @@ const QList<const AudioDevice *> AlsaAudioDriver::createDeviceList() {
 	deviceList.append(new AlsaAudioDevice(*this, "default", "Default"));
 	deviceList.append(new AlsaAudioDevice(*this, "sysdefault", "System default"));
 	deviceList.append(new AlsaAudioDevice(*this, "plug:hw", "Exclusive mode"));
+	deviceList.append(new AlsaAudioDevice(*this, "plug:hw", "Exclusive mode, mmap", true));
 	return deviceList;
 }
 
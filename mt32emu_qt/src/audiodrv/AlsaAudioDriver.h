@@ -20,13 +20,18 @@ private:
 	uint bufferSize;
 	pthread_t processingThreadID;
 	volatile bool stopProcessing;
+	bool mmapMode;
+	bool memoryLocked;
 
 	static void *processingThread(void *);
+	int waitForMMapSpace();
+	snd_pcm_sframes_t renderMMap(quint32 &renderedFrames);
+	void setRealtimeScheduling();
 
 public:
 	AlsaAudioStream(const AudioDriverSettings &settings, SynthRoute &synthRoute, const quint32 sampleRate);
 	~AlsaAudioStream();
-	bool start(const char *deviceID);
+	bool start(const char *deviceID, bool useMMap);
 	void close();
 };
 
@@ -34,11 +39,15 @@ class AlsaAudioDevice : public AudioDevice {
 friend class AlsaAudioDriver;
 private:
 	const char *deviceID;
+	// In the mmap mode, the synth renders straight into the hardware buffer, and the processing thread
+	// wakes up on period boundaries with the realtime scheduling policy, when permitted.
+	const bool mmapMode;
 
-	AlsaAudioDevice(AlsaAudioDriver &driver, const char *useDeviceID, const QString name);
+	AlsaAudioDevice(AlsaAudioDriver &driver, const char *useDeviceID, const QString name, bool useMMap = false);
 
 public:
 	AudioStream *startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const;
+	bool isSampleRateSupported(const uint sampleRate) const;
 };
 
 class AlsaAudioDriver : public AudioDriver {
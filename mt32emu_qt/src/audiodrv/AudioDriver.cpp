@@ -14,10 +14,28 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstring>
+
 #include "AudioDriver.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QMutex>
 #include <QSettings>
+#include <QThread>
+#include <QVector>
 #include "../Master.h"
 #include "../QAtomicHelper.h"
+#include "../QRingBuffer.h"
+#include "../SynthRoute.h"
+
+using namespace MT32Emu;
+
+// The audio latency target is only decreased after this long a period without an underrun.
+static const MasterClockNanos AUDIO_LATENCY_DECREASE_PERIOD_NANOS = 10 * MasterClock::NANOS_PER_SECOND;
+// How far the render-ahead stage may prerender in the look-ahead mode.
+static const quint32 LOOK_AHEAD_MILLIS = 4000;
+
+const quint32 AudioStreamStats::RENDER_LOAD_LIMITS[] = {10, 25, 50, 75, 90, 100, 200};
 
 template<class T>
 static inline void takeSnapshot(T &snapshot, const T snapshots[], const QAtomicInt &changeCount) {
@@ -44,17 +62,36 @@ static inline void publishSnapshot(QAtomicInt &changeCount) {
 }
 
 AudioStream::AudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, const quint32 useSampleRate) :
-	synthRoute(useSynthRoute), sampleRate(useSampleRate), settings(useSettings), lastEstimatedPlayedFramesCount(0),
-	resetScheduled(true)
+	synthRoute(useSynthRoute), sampleRate(useSampleRate), settings(useSettings),
+	conversionLatencyFrames(useSynthRoute.getConversionLatencyFrames()), lastEstimatedPlayedFramesCount(0),
+	resetScheduled(true), minAudioLatencyFrames(0), audioLatencyStepFrames(0), midiLatencyMarginFrames(0),
+	audioLatencyPeriodStartNanos(0), lowestFramesInAudioBuffer(0), targetAudioLatencyFrames(0), underrunCount(0),
+	renderStatsChangeCount(0), renderStatsResetRequested(0), renderAheadJob(NULL), renderAheadBuffer(NULL),
+	renderAheadFrames(0), renderAheadQueuedFrames(0), renderAheadDeviceFrames(0), renderAheadOutputStarted(false),
+	renderAheadOutputFramesCount(0), lookAheadFrames(0), lookAheadEndChangeCount(0), lookAheadDiscardRequested(0)
 {
 	audioLatencyFrames = settings.audioLatency * sampleRate / MasterClock::MILLIS_PER_SECOND;
 	midiLatencyFrames = settings.midiLatency * sampleRate / MasterClock::MILLIS_PER_SECOND;
 	renderedFramesCounts[0] = 0;
 	renderedFramesCounts[1] = 0;
+	lookAheadEndTimestamps[0] = 0;
+	lookAheadEndTimestamps[1] = 0;
 	timeInfos[0].lastPlayedNanos = MasterClock::getClockNanos();
 	timeInfos[0].lastPlayedFramesCount = 0;
 	timeInfos[0].actualSampleRate = sampleRate;
 	timeInfos[1] = timeInfos[0];
+	memset(&renderStats[0], 0, sizeof(AudioStreamStats));
+	renderStats[1] = renderStats[0];
+}
+
+AudioStream::~AudioStream() {
+	stopRenderAhead();
+	AudioStreamStats stats;
+	getRenderStats(stats);
+	if (stats.renderCount != 0) {
+		qDebug() << "AudioStream: Renders:" << stats.renderCount << "deadline misses:" << stats.deadlineMissCount
+			<< "underruns:" << stats.underrunCount << "peak render load:" << stats.worstSpike.renderLoad << "%";
+	}
 }
 
 // Intended to be called from MIDI receiving threads.
@@ -66,7 +103,12 @@ quint64 AudioStream::estimateMIDITimestamp(const MasterClockNanos refNanos) {
 	takeSnapshot(renderedFramesCount, renderedFramesCounts, renderedFramesChangeCount);
 
 	qint64 refFrameOffset = qint64(((midiNanos - timeInfo.lastPlayedNanos) * timeInfo.actualSampleRate) / MasterClock::NANOS_PER_SECOND);
-	qint64 timestamp = qint64(timeInfo.lastPlayedFramesCount) + refFrameOffset + qint64(midiLatencyFrames);
+	// The events are heard later by the delay of the sample rate converter, so that much is subtracted
+	// as long as the timestamp still leads the audio buffer.
+	quint32 currentAudioLatencyFrames = getAudioLatencyFrames();
+	quint32 midiLatencyMargin = midiLatencyFrames > currentAudioLatencyFrames ? midiLatencyFrames - currentAudioLatencyFrames : 0;
+	quint32 effectiveMIDILatencyFrames = midiLatencyFrames - qMin(conversionLatencyFrames, midiLatencyMargin);
+	qint64 timestamp = qint64(timeInfo.lastPlayedFramesCount) + refFrameOffset + qint64(effectiveMIDILatencyFrames);
 	qint64 delay = timestamp - qint64(renderedFramesCount);
 	if (delay < 0) {
 		// Negative delay means our timing is broken. We want to absort all the jitter while keeping the latency at the minimum.
@@ -78,11 +120,64 @@ quint64 AudioStream::estimateMIDITimestamp(const MasterClockNanos refNanos) {
 	return timestamp < 0 ? 0 : quint64(timestamp);
 }
 
+MasterClockNanos AudioStream::estimatePlaybackNanos(const quint64 timestamp) const {
+	TimeInfo timeInfo;
+	takeSnapshot(timeInfo, timeInfos, timeInfoChangeCount);
+	qint64 frameOffset = qint64(timestamp - timeInfo.lastPlayedFramesCount);
+	return timeInfo.lastPlayedNanos + MasterClockNanos((frameOffset * MasterClock::NANOS_PER_SECOND) / timeInfo.actualSampleRate);
+}
+
+quint32 AudioStream::getSampleRate() const {
+	return sampleRate;
+}
+
 // Only called from the rendering thread.
 quint64 AudioStream::computeMIDITimestamp(uint relativeFrameTime) const {
 	return getRenderedFramesCount() + relativeFrameTime;
 }
 
+bool AudioStream::convertJACKFrameTime(quint32, quint64 &) const {
+	return false;
+}
+
+MasterClockNanos AudioStream::startOfflineMode() {
+	return 0;
+}
+
+void AudioStream::advanceOfflineTime(MasterClockNanos) {}
+
+void AudioStream::stopOfflineMode() {}
+
+MasterClockNanos AudioStream::startLookAheadMode() {
+	if (!isRenderAheadEnabled()) return 0;
+	qDebug() << "AudioStream: Looking ahead by" << lookAheadFrames << "frames";
+	return (lookAheadFrames * MasterClock::NANOS_PER_SECOND) / sampleRate;
+}
+
+// Only called from the thread of the MIDI source in the look-ahead mode.
+void AudioStream::advanceLookAhead(MasterClockNanos nanos) {
+	if (!isRenderAheadEnabled()) return;
+	quint64 timestamp = estimateMIDITimestamp(nanos);
+	if (timestamp > lookAheadEndTimestamps[getSnapshotReadIx(lookAheadEndChangeCount)]) setLookAheadEndTimestamp(timestamp);
+}
+
+// Only called from the thread of the MIDI source in the look-ahead mode. The frames are dropped in the next audio callback,
+// the synth may only render a chunk started earlier meanwhile.
+void AudioStream::discardLookAhead() {
+	if (!isRenderAheadEnabled()) return;
+	setLookAheadEndTimestamp(0);
+	QAtomicHelper::storeRelease(lookAheadDiscardRequested, 1);
+}
+
+void AudioStream::stopLookAheadMode() {
+	if (isRenderAheadEnabled()) setLookAheadEndTimestamp(0);
+}
+
+void AudioStream::setLookAheadEndTimestamp(const quint64 timestamp) {
+	lookAheadEndTimestamps[getSnapshotWriteIx(lookAheadEndChangeCount)] = timestamp;
+	publishSnapshot(lookAheadEndChangeCount);
+}
+
 // Only called from the rendering thread.
 void AudioStream::updateTimeInfo(const MasterClockNanos measuredNanos, const quint32 framesInAudioBuffer) {
 	const TimeInfo &timeInfo = timeInfos[getSnapshotReadIx(timeInfoChangeCount)];
@@ -168,8 +263,422 @@ quint64 AudioStream::getRenderedFramesCount() const {
 	return renderedFramesCounts[getSnapshotReadIx(renderedFramesChangeCount)];
 }
 
+// Called by the driver once audioLatencyFrames and midiLatencyFrames are configured. The control starts
+// with the configured audio latency, which is then the upper limit, and never goes below two steps.
+void AudioStream::startAudioLatencyControl(const quint32 stepFrames) {
+	audioLatencyStepFrames = stepFrames;
+	minAudioLatencyFrames = qMin(2 * stepFrames, audioLatencyFrames);
+	midiLatencyMarginFrames = midiLatencyFrames > audioLatencyFrames ? midiLatencyFrames - audioLatencyFrames : 0;
+	audioLatencyPeriodStartNanos = MasterClock::getClockNanos();
+	lowestFramesInAudioBuffer = audioLatencyFrames;
+	QAtomicHelper::storeRelease(targetAudioLatencyFrames, audioLatencyFrames);
+}
+
+// Only called from the rendering thread. Returns the number of frames that should be kept in the audio buffer.
+quint32 AudioStream::updateAudioLatencyTarget(const MasterClockNanos measuredNanos, const quint32 framesInAudioBuffer) {
+	quint32 targetFrames = QAtomicHelper::loadRelaxed(targetAudioLatencyFrames);
+	if (framesInAudioBuffer < lowestFramesInAudioBuffer) lowestFramesInAudioBuffer = framesInAudioBuffer;
+	if (measuredNanos - audioLatencyPeriodStartNanos >= AUDIO_LATENCY_DECREASE_PERIOD_NANOS) {
+		// The buffer had at least two steps to spare during the whole period, so one may be given up.
+		if (lowestFramesInAudioBuffer > 2 * audioLatencyStepFrames && targetFrames > minAudioLatencyFrames) {
+			targetFrames = qMax(minAudioLatencyFrames, targetFrames - audioLatencyStepFrames);
+			setAudioLatencyTarget(targetFrames);
+		}
+		audioLatencyPeriodStartNanos = measuredNanos;
+		lowestFramesInAudioBuffer = audioLatencyFrames;
+	}
+	return targetFrames;
+}
+
+// Only called from the rendering thread.
+void AudioStream::audioUnderrunOccurred(const MasterClockNanos measuredNanos) {
+	underrunCount.fetchAndAddRelaxed(1);
+	quint32 targetFrames = QAtomicHelper::loadRelaxed(targetAudioLatencyFrames);
+	if (targetFrames == 0) return;
+	targetFrames = qMin(audioLatencyFrames, targetFrames + qMax(targetFrames / 2, audioLatencyStepFrames));
+	setAudioLatencyTarget(targetFrames);
+	audioLatencyPeriodStartNanos = measuredNanos;
+	lowestFramesInAudioBuffer = audioLatencyFrames;
+}
+
+void AudioStream::setAudioLatencyTarget(const quint32 newTargetFrames) {
+	QAtomicHelper::storeRelease(targetAudioLatencyFrames, newTargetFrames);
+	if (isAutoLatencyMode()) midiLatencyFrames = newTargetFrames + midiLatencyMarginFrames;
+	qDebug() << "AudioStream: Audio latency target set to" << newTargetFrames << "frames, underruns so far:" << getUnderrunCount();
+}
+
+quint32 AudioStream::getAudioLatencyFrames() const {
+	quint32 targetFrames = QAtomicHelper::loadAcquire(targetAudioLatencyFrames);
+	return targetFrames == 0 ? audioLatencyFrames : targetFrames;
+}
+
+quint32 AudioStream::getMIDILatencyFrames() const {
+	return midiLatencyFrames;
+}
+
+quint32 AudioStream::getUnderrunCount() const {
+	return QAtomicHelper::loadRelaxed(underrunCount);
+}
+
+const ThreadPolicy &AudioStream::getThreadPolicy() const {
+	return settings.threadPolicy;
+}
+
+MasterClockNanos AudioStream::getChunkNanos() const {
+	return settings.chunkLen * MasterClock::NANOS_PER_MILLISECOND;
+}
+
+// Only called from the rendering thread.
+void AudioStream::renderCompleted(const MasterClockNanos startNanos, const quint32 frameCount) {
+	if (frameCount == 0) return;
+	const MasterClockNanos renderNanos = MasterClock::getClockNanos() - startNanos;
+	const AudioStreamStats &stats = renderStats[getSnapshotReadIx(renderStatsChangeCount)];
+	AudioStreamStats &nextStats = renderStats[getSnapshotWriteIx(renderStatsChangeCount)];
+	if (renderStatsResetRequested.testAndSetRelaxed(1, 0)) {
+		memset(&nextStats, 0, sizeof(AudioStreamStats));
+	} else {
+		nextStats = stats;
+	}
+	const quint32 renderLoad = quint32((renderNanos * sampleRate * 100) / (frameCount * MasterClock::NANOS_PER_SECOND));
+	uint rangeIx = 0;
+	while (rangeIx < AudioStreamStats::RENDER_LOAD_HISTOGRAM_SIZE - 1 && renderLoad >= AudioStreamStats::RENDER_LOAD_LIMITS[rangeIx]) {
+		rangeIx++;
+	}
+	nextStats.renderCount++;
+	nextStats.renderLoadHistogram[rangeIx]++;
+	// Spikes are rare, so taking the wall-clock time is affordable.
+	if (renderLoad > nextStats.worstSpike.renderLoad || renderLoad >= 100) {
+		AudioStreamStats::Spike spike;
+		spike.timestamp = QDateTime::currentMSecsSinceEpoch();
+		spike.renderLoad = renderLoad;
+		spike.frameCount = frameCount;
+		if (renderLoad > nextStats.worstSpike.renderLoad) nextStats.worstSpike = spike;
+		if (renderLoad >= 100) {
+			nextStats.recentSpikes[nextStats.deadlineMissCount % AudioStreamStats::RECENT_SPIKE_COUNT] = spike;
+			nextStats.deadlineMissCount++;
+		}
+	}
+	nextStats.underrunCount = getUnderrunCount();
+	publishSnapshot(renderStatsChangeCount);
+}
+
+// Intended to be called from any thread.
+void AudioStream::getRenderStats(AudioStreamStats &stats) const {
+	takeSnapshot(stats, renderStats, renderStatsChangeCount);
+}
+
+// Intended to be called from any thread. The underrun count is only reset together with the statistics.
+void AudioStream::resetRenderStats() {
+	QAtomicHelper::storeRelease(underrunCount, 0);
+	QAtomicHelper::storeRelease(renderStatsResetRequested, 1);
+}
+
+struct RenderAheadJob {
+	AudioStream &stream;
+	const quint32 chunkFrames;
+	// The worker that prefers this job, others only steal it when they have no job of their own due.
+	uint homeWorkerIx;
+	// Set while a worker renders the stream, so that each stream is rendered by one thread at a time.
+	QAtomicInt busy;
+
+	RenderAheadJob(AudioStream &useStream, quint32 useChunkFrames) :
+		stream(useStream), chunkFrames(useChunkFrames), homeWorkerIx(0), busy(0)
+	{}
+};
+
+class RenderWorker;
+
+// App-wide pool of realtime threads that keep the render-ahead buffers of all streams filled. Rather than rendering
+// each synth route in a thread of its own, which oversubscribes the CPU with many routes, a fixed set of workers takes
+// the due jobs in order of their deadlines, i.e. the stream that runs out of buffered audio first is rendered first.
+// Each job is assigned to the least loaded worker, and idle workers steal the most urgent jobs of the others.
+// The pool is started with the first job and stopped once the last job is removed.
+class RenderScheduler {
+friend class RenderWorker;
+
+public:
+	static void addJob(RenderAheadJob &job);
+	static void removeJob(RenderAheadJob &job);
+
+	RenderAheadJob *claimJob(const uint workerIx, MasterClockNanos &idleNanos);
+	void renderJob(RenderAheadJob &job);
+
+private:
+	// Used when there is no job to take the idle period from.
+	static const MasterClockNanos DEFAULT_IDLE_NANOS = MasterClock::NANOS_PER_MILLISECOND;
+
+	// Guards the instance and the job list, only held by the workers while picking a job.
+	static QMutex jobsMutex;
+	static RenderScheduler *instance;
+
+	// Taken from the stream that starts the pool.
+	const ThreadPolicy threadPolicy;
+	const MasterClockNanos periodNanos;
+
+	QList<RenderAheadJob *> jobs;
+	QVector<uint> homeJobCounts;
+	QList<RenderWorker *> workers;
+
+	RenderScheduler(const ThreadPolicy &useThreadPolicy, const MasterClockNanos usePeriodNanos);
+	~RenderScheduler();
+};
+
+class RenderWorker : public QThread {
+public:
+	RenderWorker(RenderScheduler &useScheduler, uint useWorkerIx) :
+		scheduler(useScheduler), workerIx(useWorkerIx), stopRequested(false)
+	{}
+
+	void stop() {
+		stopRequested = true;
+		wait();
+	}
+
+protected:
+	void run() {
+		ThreadPolicyScope threadPolicyScope(scheduler.threadPolicy, "RenderWorker", scheduler.periodNanos);
+		while (!stopRequested) {
+			MasterClockNanos idleNanos;
+			RenderAheadJob *job = scheduler.claimJob(workerIx, idleNanos);
+			if (job == NULL) {
+				MasterClock::sleepForNanos(idleNanos);
+				continue;
+			}
+			scheduler.renderJob(*job);
+		}
+	}
+
+private:
+	RenderScheduler &scheduler;
+	const uint workerIx;
+	volatile bool stopRequested;
+};
+
+QMutex RenderScheduler::jobsMutex;
+RenderScheduler *RenderScheduler::instance = NULL;
+
+RenderScheduler::RenderScheduler(const ThreadPolicy &useThreadPolicy, const MasterClockNanos usePeriodNanos) :
+	threadPolicy(useThreadPolicy), periodNanos(usePeriodNanos)
+{
+	const int workerCount = qMax(1, QThread::idealThreadCount());
+	qDebug() << "RenderScheduler: Starting" << workerCount << "render workers";
+	homeJobCounts.fill(0, workerCount);
+	for (int workerIx = 0; workerIx < workerCount; workerIx++) {
+		RenderWorker *worker = new RenderWorker(*this, uint(workerIx));
+		workers.append(worker);
+		worker->start(QThread::TimeCriticalPriority);
+	}
+}
+
+RenderScheduler::~RenderScheduler() {
+	qDebug() << "RenderScheduler: Stopping render workers";
+	for (int workerIx = 0; workerIx < workers.size(); workerIx++) {
+		workers.at(workerIx)->stop();
+		delete workers.at(workerIx);
+	}
+}
+
+void RenderScheduler::addJob(RenderAheadJob &job) {
+	QMutexLocker jobsLocker(&jobsMutex);
+	if (instance == NULL) {
+		const MasterClockNanos chunkNanos = (job.chunkFrames * MasterClock::NANOS_PER_SECOND) / job.stream.sampleRate;
+		instance = new RenderScheduler(job.stream.settings.threadPolicy, chunkNanos);
+	}
+	uint homeWorkerIx = 0;
+	for (int workerIx = 1; workerIx < instance->homeJobCounts.size(); workerIx++) {
+		if (instance->homeJobCounts.at(workerIx) < instance->homeJobCounts.at(homeWorkerIx)) homeWorkerIx = uint(workerIx);
+	}
+	job.homeWorkerIx = homeWorkerIx;
+	instance->homeJobCounts[homeWorkerIx]++;
+	instance->jobs.append(&job);
+}
+
+// Once the job is out of the list, no worker can claim it anymore, so it only remains to wait for the current render to finish.
+void RenderScheduler::removeJob(RenderAheadJob &job) {
+	QMutexLocker jobsLocker(&jobsMutex);
+	RenderScheduler *scheduler = instance;
+	if (scheduler == NULL || !scheduler->jobs.removeOne(&job)) return;
+	scheduler->homeJobCounts[job.homeWorkerIx]--;
+	if (scheduler->jobs.isEmpty()) {
+		instance = NULL;
+	} else {
+		scheduler = NULL;
+	}
+	jobsLocker.unlock();
+	while (QAtomicHelper::loadAcquire(job.busy) != 0) {
+		MasterClock::sleepForNanos(MasterClock::NANOS_PER_MILLISECOND);
+	}
+	delete scheduler;
+}
+
+// Picks the due job with the earliest deadline among those of the worker, or the most urgent job of the others to steal.
+// When nothing is due, returns NULL and the time to sleep, which is half the chunk duration of the shortest chunk.
+RenderAheadJob *RenderScheduler::claimJob(const uint workerIx, MasterClockNanos &idleNanos) {
+	QMutexLocker jobsLocker(&jobsMutex);
+	idleNanos = DEFAULT_IDLE_NANOS;
+	RenderAheadJob *ownJob = NULL;
+	RenderAheadJob *stolenJob = NULL;
+	MasterClockNanos ownBufferedNanos = 0;
+	MasterClockNanos stolenBufferedNanos = 0;
+	bool idleNanosSet = false;
+	for (int jobIx = 0; jobIx < jobs.size(); jobIx++) {
+		RenderAheadJob *job = jobs.at(jobIx);
+		if (QAtomicHelper::loadAcquire(job->busy) != 0) continue;
+		const MasterClockNanos jobIdleNanos = (job->chunkFrames * MasterClock::NANOS_PER_SECOND) / (2 * job->stream.sampleRate);
+		if (!idleNanosSet || jobIdleNanos < idleNanos) {
+			idleNanos = jobIdleNanos;
+			idleNanosSet = true;
+		}
+		MasterClockNanos bufferedNanos;
+		if (!job->stream.isRenderAheadDue(job->chunkFrames, bufferedNanos)) continue;
+		if (job->homeWorkerIx == workerIx) {
+			if (ownJob == NULL || bufferedNanos < ownBufferedNanos) {
+				ownJob = job;
+				ownBufferedNanos = bufferedNanos;
+			}
+		} else if (stolenJob == NULL || bufferedNanos < stolenBufferedNanos) {
+			stolenJob = job;
+			stolenBufferedNanos = bufferedNanos;
+		}
+	}
+	RenderAheadJob *job = ownJob != NULL ? ownJob : stolenJob;
+	// Jobs are only claimed while holding the mutex, so this never fails.
+	if (job != NULL) job->busy.testAndSetAcquire(0, 1);
+	return job;
+}
+
+void RenderScheduler::renderJob(RenderAheadJob &job) {
+	job.stream.renderAheadChunk(job.chunkFrames);
+	QAtomicHelper::storeRelease(job.busy, 0);
+}
+
+// Called by the driver once the audio latency is configured and before the callbacks start, does nothing unless
+// enabled in the settings. The look-ahead is never shorter than one chunk, which the callback requests at a time.
+// The rendered frames are played that much later, so the MIDI latency grows likewise, whether it is set manually or not.
+void AudioStream::startRenderAhead(const quint32 chunkFrames) {
+	if (settings.renderAhead == 0 || renderAheadJob != NULL) return;
+	renderAheadFrames = qMax(quint32((settings.renderAhead * sampleRate) / MasterClock::MILLIS_PER_SECOND), chunkFrames);
+	lookAheadFrames = quint32((quint64(LOOK_AHEAD_MILLIS) * sampleRate) / MasterClock::MILLIS_PER_SECOND);
+	// The ring buffer never gets completely full, so one more frame is reserved.
+	renderAheadBuffer = new Utility::QRingBuffer((renderAheadFrames + lookAheadFrames + 1) << 2);
+	midiLatencyFrames += renderAheadFrames;
+	qDebug() << "AudioStream: Rendering ahead by" << renderAheadFrames << "frames, MIDI latency:" << midiLatencyFrames << "frames";
+	renderAheadJob = new RenderAheadJob(*this, chunkFrames);
+	RenderScheduler::addJob(*renderAheadJob);
+}
+
+// Must be called once the callbacks are stopped.
+void AudioStream::stopRenderAhead() {
+	if (renderAheadJob == NULL) return;
+	RenderScheduler::removeJob(*renderAheadJob);
+	delete renderAheadJob;
+	renderAheadJob = NULL;
+	delete renderAheadBuffer;
+	renderAheadBuffer = NULL;
+}
+
+bool AudioStream::isRenderAheadEnabled() const {
+	return renderAheadJob != NULL;
+}
+
+// Only called by the render scheduler while no worker renders the stream. Rendering in chunks keeps the overhead low,
+// so a chunk is only due once there is enough free space, except for the space left at the end of the ring.
+bool AudioStream::isRenderAheadDue(const quint32 chunkFrames, MasterClockNanos &bufferedNanos) {
+	quint32 bytesFree;
+	bool freeSpaceContiguous;
+	renderAheadBuffer->writePointer(bytesFree, freeSpaceContiguous);
+	quint32 framesFree = bytesFree >> 2;
+	quint32 framesNeeded = freeSpaceContiguous ? chunkFrames : qMin(framesFree, chunkFrames);
+	if (framesNeeded == 0 || framesFree < framesNeeded || getRenderAheadAllowance() < framesNeeded) return false;
+	quint32 queuedFrames = QAtomicHelper::loadRelaxed(renderAheadQueuedFrames);
+	quint32 deviceFrames = QAtomicHelper::loadRelaxed(renderAheadDeviceFrames);
+	bufferedNanos = ((queuedFrames + deviceFrames) * MasterClock::NANOS_PER_SECOND) / sampleRate;
+	return true;
+}
+
+// Only called by the render worker that has claimed the stream.
+void AudioStream::renderAheadChunk(const quint32 chunkFrames) {
+	quint32 bytesFree;
+	bool freeSpaceContiguous;
+	Bit16s *buffer = static_cast<Bit16s *>(renderAheadBuffer->writePointer(bytesFree, freeSpaceContiguous));
+	quint32 frameCount = qMin(qMin(bytesFree >> 2, chunkFrames), getRenderAheadAllowance());
+	quint32 queuedFrames = QAtomicHelper::loadRelaxed(renderAheadQueuedFrames);
+	quint32 deviceFrames = QAtomicHelper::loadRelaxed(renderAheadDeviceFrames);
+	updateTimeInfo(MasterClock::getClockNanos(), deviceFrames + queuedFrames);
+	synthRoute.render(buffer, frameCount);
+	framesRendered(frameCount);
+	// The count is increased first, so that it never goes negative when the frames are consumed right away.
+	renderAheadQueuedFrames.fetchAndAddOrdered(int(frameCount));
+	renderAheadBuffer->advanceWritePointer(frameCount << 2);
+}
+
+// Returns the number of frames the render worker may render next. The ring is kept filled with renderAheadFrames,
+// and in the look-ahead mode, it is filled further as far as the MIDI source has pushed the events.
+quint32 AudioStream::getRenderAheadAllowance() const {
+	quint32 queuedFrames = QAtomicHelper::loadRelaxed(renderAheadQueuedFrames);
+	quint32 allowance = queuedFrames < renderAheadFrames ? renderAheadFrames - queuedFrames : 0;
+	quint64 lookAheadEndTimestamp;
+	takeSnapshot(lookAheadEndTimestamp, lookAheadEndTimestamps, lookAheadEndChangeCount);
+	quint64 renderedFramesCount = getRenderedFramesCount();
+	if (lookAheadEndTimestamp > renderedFramesCount) {
+		allowance = qMax(allowance, quint32(qMin(lookAheadEndTimestamp - renderedFramesCount, quint64(lookAheadFrames))));
+	}
+	return allowance;
+}
+
+// Called from the audio callback instead of rendering. When the render scheduler lags behind,
+// the missing frames are filled with silence, and that is counted as an underrun.
+void AudioStream::readRenderedFrames(Bit16s *buffer, const quint32 frameCount, const quint32 framesInAudioBuffer) {
+	if (lookAheadDiscardRequested.testAndSetAcquire(1, 0)) {
+		// The stream timing gets reset as the played position jumps ahead, and the ring refills from scratch.
+		for (;;) {
+			quint32 bytesReady;
+			renderAheadBuffer->readPointer(bytesReady);
+			if (bytesReady == 0) break;
+			renderAheadBuffer->advanceReadPointer(bytesReady);
+			renderAheadQueuedFrames.fetchAndAddOrdered(-int(bytesReady >> 2));
+		}
+		renderAheadOutputStarted = false;
+	}
+	QAtomicHelper::storeRelease(renderAheadDeviceFrames, framesInAudioBuffer);
+	renderAheadOutputFramesCount += frameCount;
+	quint32 framesLeft = frameCount;
+	while (framesLeft > 0) {
+		quint32 bytesReady;
+		const void *readPointer = renderAheadBuffer->readPointer(bytesReady);
+		quint32 framesReady = qMin(bytesReady >> 2, framesLeft);
+		if (framesReady == 0) break;
+		memcpy(buffer, readPointer, framesReady << 2);
+		renderAheadBuffer->advanceReadPointer(framesReady << 2);
+		renderAheadQueuedFrames.fetchAndAddOrdered(-int(framesReady));
+		buffer += framesReady << 1;
+		framesLeft -= framesReady;
+	}
+	if (framesLeft > 0) {
+		memset(buffer, 0, framesLeft << 2);
+		// Missing frames are expected while the stream is starting up.
+		if (renderAheadOutputStarted) underrunCount.fetchAndAddRelaxed(1);
+	} else {
+		renderAheadOutputStarted = true;
+	}
+}
+
+// Returns the number of frames handed over to the audio device so far. Only called from the audio callback,
+// which is also the rendering thread unless rendering ahead.
+quint64 AudioStream::getOutputFramesCount() const {
+	return isRenderAheadEnabled() ? renderAheadOutputFramesCount : getRenderedFramesCount();
+}
+
 AudioDevice::AudioDevice(AudioDriver &useDriver, QString useName) : driver(useDriver), name(useName) {}
 
+bool AudioDevice::isSampleRateSupported(const uint) const {
+	return false;
+}
+
+bool AudioDevice::isStandbySupported() const {
+	return true;
+}
+
 AudioDriver::AudioDriver(QString useID, QString useName) : id(useID), name(useName) {}
 
 void AudioDriver::loadAudioSettings() {
@@ -177,10 +686,14 @@ void AudioDriver::loadAudioSettings() {
 	QString prefix = "Audio/" + id;
 	settings.sampleRate = qSettings->value(prefix + "/SampleRate", 0).toUInt();
 	settings.srcQuality = MT32Emu::SamplerateConversionQuality(qSettings->value(prefix + "/SRCQuality", MT32Emu::SamplerateConversionQuality_GOOD).toUInt());
+	settings.minimumPhaseSRC = qSettings->value(prefix + "/MinimumPhaseSRC", false).toBool();
+	settings.nativeSampleRate = qSettings->value(prefix + "/NativeSampleRate", true).toBool();
 	settings.chunkLen = qSettings->value(prefix + "/ChunkLen").toInt();
 	settings.audioLatency = qSettings->value(prefix + "/AudioLatency").toInt();
 	settings.midiLatency = qSettings->value(prefix + "/MidiLatency").toInt();
+	settings.renderAhead = qSettings->value(prefix + "/RenderAhead", 0).toUInt();
 	settings.advancedTiming = qSettings->value(prefix + "/AdvancedTiming", true).toBool();
+	settings.threadPolicy.load(*qSettings, prefix);
 	validateAudioSettings(settings);
 }
 
@@ -196,9 +709,12 @@ void AudioDriver::setAudioSettings(AudioDriverSettings &useSettings) {
 	QString prefix = "Audio/" + id;
 	qSettings->setValue(prefix + "/SampleRate", settings.sampleRate);
 	qSettings->setValue(prefix + "/SRCQuality", settings.srcQuality);
+	qSettings->setValue(prefix + "/MinimumPhaseSRC", settings.minimumPhaseSRC);
+	qSettings->setValue(prefix + "/NativeSampleRate", settings.nativeSampleRate);
 	qSettings->setValue(prefix + "/ChunkLen", settings.chunkLen);
 	qSettings->setValue(prefix + "/AudioLatency", settings.audioLatency);
 	qSettings->setValue(prefix + "/MidiLatency", settings.midiLatency);
+	qSettings->setValue(prefix + "/RenderAhead", settings.renderAhead);
 	qSettings->setValue(prefix + "/AdvancedTiming", settings.advancedTiming);
 }
 
@@ -9,18 +9,57 @@
 #include <mt32emu/mt32emu.h>
 
 #include "../MasterClock.h"
+#include "../ThreadPolicy.h"
 
 class AudioDriver;
 class SynthRoute;
+class RenderScheduler;
+struct RenderAheadJob;
 struct AudioDriverSettings;
 
+namespace Utility {
+	class QRingBuffer;
+}
+
+// Timing of the render calls of an audio stream, collected since the stream started or the last reset.
+// The render load is the time spent rendering in % of the time it takes to play the rendered frames,
+// so the rendering misses the deadline and the output is likely to break up when the load exceeds 100%.
+struct AudioStreamStats {
+	static const uint RENDER_LOAD_HISTOGRAM_SIZE = 8;
+	static const uint RECENT_SPIKE_COUNT = 4;
+	// Upper bounds of the render load ranges counted in the histogram, the last range is unbounded.
+	static const quint32 RENDER_LOAD_LIMITS[RENDER_LOAD_HISTOGRAM_SIZE - 1];
+
+	struct Spike {
+		// Wall-clock time in milliseconds since the epoch, as returned by QDateTime::currentMSecsSinceEpoch().
+		qint64 timestamp;
+		quint32 renderLoad;
+		quint32 frameCount;
+	};
+
+	quint32 renderCount;
+	quint32 renderLoadHistogram[RENDER_LOAD_HISTOGRAM_SIZE];
+	// Renders that exceeded the deadline.
+	quint32 deadlineMissCount;
+	// Underruns reported by the audio API, only some drivers detect them.
+	quint32 underrunCount;
+	Spike worstSpike;
+	// The latest deadline misses, the last one is at index (deadlineMissCount - 1) % RECENT_SPIKE_COUNT.
+	Spike recentSpikes[RECENT_SPIKE_COUNT];
+};
+
 class AudioStream {
+friend class RenderScheduler;
+struct RenderAheadJob;
+
 protected:
 	SynthRoute &synthRoute;
 	const quint32 sampleRate;
 	const AudioDriverSettings &settings;
 	quint32 audioLatencyFrames;
 	quint32 midiLatencyFrames;
+	// Delay introduced by the sample rate converter, it is taken out of the MIDI latency margin.
+	const quint32 conversionLatencyFrames;
 
 	quint64 lastEstimatedPlayedFramesCount;
 	bool resetScheduled;
@@ -40,16 +79,103 @@ protected:
 	} timeInfos[2];
 	QAtomicInt timeInfoChangeCount;
 
+	// Closed-loop control of the amount of audio kept in the device buffer, for the drivers that write at their own pace.
+	// The target grows after an underrun and is slowly reduced while the buffer never drains close to empty,
+	// staying within the range from minAudioLatencyFrames to audioLatencyFrames. The MIDI latency follows
+	// in the auto-latency mode. The target and the underrun count are published for other threads to read.
+	quint32 minAudioLatencyFrames;
+	quint32 audioLatencyStepFrames;
+	quint32 midiLatencyMarginFrames;
+	MasterClockNanos audioLatencyPeriodStartNanos;
+	quint32 lowestFramesInAudioBuffer;
+	QAtomicInt targetAudioLatencyFrames;
+	QAtomicInt underrunCount;
+
+	// Render timing statistics are updated in the rendering thread and published the same way as timeInfos.
+	// A reset requested by another thread is carried out with the next update.
+	AudioStreamStats renderStats[2];
+	QAtomicInt renderStatsChangeCount;
+	QAtomicInt renderStatsResetRequested;
+
+	// Optional render-ahead stage for the drivers that pull audio in a callback. The app-wide render scheduler keeps
+	// the ring buffer filled with up to renderAheadFrames, while the callback only copies the frames out.
+	// The frames in the ring count as buffered for the timing estimation, and the auto MIDI latency includes them.
+	RenderAheadJob *renderAheadJob;
+	Utility::QRingBuffer *renderAheadBuffer;
+	quint32 renderAheadFrames;
+	QAtomicInt renderAheadQueuedFrames;
+	QAtomicInt renderAheadDeviceFrames;
+	bool renderAheadOutputStarted;
+	quint64 renderAheadOutputFramesCount;
+
+	// Look-ahead extends the render-ahead stage for a MIDI source that knows its events in advance, like the SMF player.
+	// The ring has room for lookAheadFrames more, which are only rendered up to the timestamp published by the source.
+	// The timestamp is written in the thread of the source and published the same way as timeInfos.
+	quint32 lookAheadFrames;
+	quint64 lookAheadEndTimestamps[2];
+	QAtomicInt lookAheadEndChangeCount;
+	QAtomicInt lookAheadDiscardRequested;
+
 	void updateTimeInfo(const MasterClockNanos measuredNanos, const quint32 framesInAudioBuffer);
 	bool isAutoLatencyMode() const;
 	void framesRendered(quint32 frameCount);
 	quint64 getRenderedFramesCount() const;
 
+	void startAudioLatencyControl(const quint32 stepFrames);
+	quint32 updateAudioLatencyTarget(const MasterClockNanos measuredNanos, const quint32 framesInAudioBuffer);
+	void audioUnderrunOccurred(const MasterClockNanos measuredNanos);
+	void setAudioLatencyTarget(const quint32 newTargetFrames);
+
+	void startRenderAhead(const quint32 chunkFrames);
+	void stopRenderAhead();
+	bool isRenderAheadEnabled() const;
+	bool isRenderAheadDue(const quint32 chunkFrames, MasterClockNanos &bufferedNanos);
+	void renderAheadChunk(const quint32 chunkFrames);
+	quint32 getRenderAheadAllowance() const;
+	void setLookAheadEndTimestamp(const quint64 timestamp);
+	void readRenderedFrames(MT32Emu::Bit16s *buffer, const quint32 frameCount, const quint32 framesInAudioBuffer);
+	quint64 getOutputFramesCount() const;
+
 public:
 	AudioStream(const AudioDriverSettings &settings, SynthRoute &synthRoute, const quint32 sampleRate);
-	virtual ~AudioStream() {}
+	virtual ~AudioStream();
 	virtual quint64 estimateMIDITimestamp(const MasterClockNanos refNanos = 0);
 	quint64 computeMIDITimestamp(uint relativeFrameTime) const;
+	// Converts a frame time of the JACK server clock to a MIDI timestamp, provided the stream is driven by the same JACK server.
+	// Returns false otherwise, then the timestamp is to be estimated from the MasterClock time instead.
+	virtual bool convertJACKFrameTime(quint32 jackFrameTime, quint64 &timestamp) const;
+	// Streams that render into a file may run as fast as the MIDI data is supplied rather than at the wall-clock pace.
+	// In the offline mode, the stream time only advances with advanceOfflineTime(), and the MIDI events are timestamped
+	// in that time base, which starts from the returned value. Returns 0 if the offline mode is unsupported.
+	virtual MasterClockNanos startOfflineMode();
+	// Blocks while the rendering lags behind the specified stream time too far.
+	virtual void advanceOfflineTime(MasterClockNanos nanos);
+	virtual void stopOfflineMode();
+	// In the look-ahead mode, a MIDI source pushes the events up to the returned time in advance, and the stream prerenders
+	// the audio as far as the events are pushed. Returns 0 unless the stream renders ahead. Live MIDI input arrives late then,
+	// so this is only meant for the sources that play a file.
+	MasterClockNanos startLookAheadMode();
+	// Lets the stream render up to the specified time, all the events due before it must have been pushed by then.
+	void advanceLookAhead(MasterClockNanos nanos);
+	// Drops the prerendered audio, so that stopping or seeking is heard without the look-ahead delay.
+	void discardLookAhead();
+	void stopLookAheadMode();
+	// Estimates the clock time when the frame with the given MIDI timestamp is played by the audio device.
+	// This relies on the same timing estimation as estimateMIDITimestamp(), thus it accounts for the latency
+	// reported by the audio API when the advanced timing is enabled.
+	MasterClockNanos estimatePlaybackNanos(const quint64 timestamp) const;
+	quint32 getSampleRate() const;
+	// Returns the current amount of audio the stream aims to keep buffered, in frames.
+	quint32 getAudioLatencyFrames() const;
+	quint32 getMIDILatencyFrames() const;
+	quint32 getUnderrunCount() const;
+	// The thread policy to apply in the threads that render the stream, and the usual period they wake up with.
+	const ThreadPolicy &getThreadPolicy() const;
+	MasterClockNanos getChunkNanos() const;
+	// Called by SynthRoute after rendering the frames in the rendering thread, with the clock time the rendering started.
+	void renderCompleted(const MasterClockNanos startNanos, const quint32 frameCount);
+	void getRenderStats(AudioStreamStats &stats) const;
+	void resetRenderStats();
 };
 
 class AudioDevice {
@@ -60,6 +186,11 @@ public:
 	AudioDevice(AudioDriver &driver, const QString name);
 	virtual ~AudioDevice() {}
 	virtual AudioStream *startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const = 0;
+	// Whether the device plays at the sample rate as is, with no resampling in the audio system. False if unknown.
+	virtual bool isSampleRateSupported(const uint sampleRate) const;
+	// Whether the stream may be stopped while the synth is idle and started again on demand, see SynthRoute.
+	// False for the devices whose consumers rely on the stream running continuously.
+	virtual bool isStandbySupported() const;
 };
 
 Q_DECLARE_METATYPE(const AudioDevice *)
@@ -69,15 +200,25 @@ struct AudioDriverSettings {
 	unsigned int sampleRate;
 	// The quality of sample rate conversion if applicable
 	MT32Emu::SamplerateConversionQuality srcQuality;
+	// Whether to use minimum-phase resampling filters that trade the linear phase response for lower latency
+	bool minimumPhaseSRC;
+	// Whether to run the audio device at the synth output sample rate instead when the device supports it,
+	// so that no sample rate conversion takes place
+	bool nativeSampleRate;
 	// The maximum number of milliseconds to render at once
 	unsigned int chunkLen;
 	// The total latency of audio stream buffers in milliseconds
 	unsigned int audioLatency;
 	// The number of milliseconds by which to delay MIDI events to ensure accurate relative timing
 	unsigned int midiLatency;
+	// The number of milliseconds to render ahead of the audio callback in the app-wide render threads, 0 - render in the callback.
+	// Only supported by the drivers that pull audio in a callback
+	unsigned int renderAhead;
 	// true - use advanced timing functions provided by audio API
 	// false - instead, rely on count of rendered samples to compute average actual sample rate
 	bool advancedTiming;
+	// Scheduling of the threads that render the streams, only configurable in the settings file
+	ThreadPolicy threadPolicy;
 };
 
 class AudioDriver {
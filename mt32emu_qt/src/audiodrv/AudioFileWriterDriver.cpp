@@ -41,10 +41,22 @@ void AudioFileWriterStream::close() {
 }
 
 quint64 AudioFileWriterStream::estimateMIDITimestamp(const MasterClockNanos refNanos) {
-	MasterClockNanos midiNanos = (refNanos == 0) ? MasterClock::getClockNanos() : refNanos;
+	MasterClockNanos midiNanos = writer.getStreamNanos(refNanos);
 	return quint64(((midiNanos - timeInfos[0].lastPlayedNanos) * sampleRate) / MasterClock::NANOS_PER_SECOND) + midiLatencyFrames;
 }
 
+MasterClockNanos AudioFileWriterStream::startOfflineMode() {
+	return writer.startOfflineMode();
+}
+
+void AudioFileWriterStream::advanceOfflineTime(MasterClockNanos nanos) {
+	writer.advanceOfflineTime(nanos);
+}
+
+void AudioFileWriterStream::stopOfflineMode() {
+	writer.stopOfflineMode();
+}
+
 AudioFileWriterDevice::AudioFileWriterDevice(AudioFileWriterDriver &driver, QString useDeviceName) :
 	AudioDevice(driver, useDeviceName) {}
 
@@ -57,6 +69,11 @@ AudioStream *AudioFileWriterDevice::startAudioStream(SynthRoute &synthRoute, con
 	return NULL;
 }
 
+bool AudioFileWriterDevice::isStandbySupported() const {
+	// The file is to keep the silence, so that the recording stays in time with the MIDI input.
+	return false;
+}
+
 AudioFileWriterDriver::AudioFileWriterDriver(Master *master) : AudioDriver("fileWriter", "AudioFileWriter") {
 	Q_UNUSED(master);
 
@@ -18,6 +18,9 @@ private:
 public:
 	AudioFileWriterStream(const AudioDriverSettings &settings, SynthRoute &useSynthRoute, const quint32 useSampleRate);
 	quint64 estimateMIDITimestamp(const MasterClockNanos refNanos = 0);
+	MasterClockNanos startOfflineMode();
+	void advanceOfflineTime(MasterClockNanos nanos);
+	void stopOfflineMode();
 	bool start();
 	void close();
 };
@@ -28,6 +31,7 @@ private:
 	AudioFileWriterDevice(AudioFileWriterDriver &driver, QString useDeviceName);
 public:
 	AudioStream *startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const;
+	bool isStandbySupported() const;
 };
 
 class AudioFileWriterDriver : public AudioDriver {
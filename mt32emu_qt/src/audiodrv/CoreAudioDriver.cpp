@@ -16,6 +16,8 @@
 
 #include "CoreAudioDriver.h"
 
+#include <CoreAudio/HostTime.h>
+
 #include "../Master.h"
 #include "../SynthRoute.h"
 
@@ -53,10 +55,17 @@ static QString cfStringToQString(CFStringRef string) {
 #endif
 }
 
-CoreAudioStream::CoreAudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, quint32 useSampleRate) :
-	AudioStream(useSettings, useSynthRoute, useSampleRate), audioQueue(NULL)
+CoreAudioStream::CoreAudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, quint32 useSampleRate, const bool useRenderCallbackMode) :
+	AudioStream(useSettings, useSynthRoute, useSampleRate), renderCallbackMode(useRenderCallbackMode), audioQueue(NULL), buffers(NULL), audioUnit(NULL)
 {
 	const uint bufferSize = (settings.chunkLen * sampleRate) / MasterClock::MILLIS_PER_SECOND;
+	if (renderCallbackMode) {
+		// Refined when the AudioUnit reports the device period actually set
+		bufferFrames = bufferSize;
+		audioLatencyFrames = 2 * bufferFrames;
+		if (isAutoLatencyMode()) midiLatencyFrames = audioLatencyFrames;
+		return;
+	}
 	bufferByteSize = bufferSize << 2;
 	// Number of buffers should be ceil(audioLatencyFrames / bufferSize)
 	numberOfBuffers = (audioLatencyFrames + bufferSize - 1) / bufferSize;
@@ -88,22 +97,144 @@ void CoreAudioStream::renderOutputBuffer(void *userData, AudioQueueRef queue, Au
 		if (res) {
 			qDebug() << "CoreAudio: AudioQueueGetCurrentTime() failed with error code:" << res;
 		} else if (audioTimeStamp.mFlags & kAudioTimeStampSampleTimeValid) {
-			framesInAudioBuffer = quint32(stream->getRenderedFramesCount() - audioTimeStamp.mSampleTime);
+			framesInAudioBuffer = quint32(stream->getOutputFramesCount() - audioTimeStamp.mSampleTime);
 		} else {
 			qDebug() << "CoreAudio: AudioQueueGetCurrentTime() returns invalid sample time";
 		}
 	}
-	stream->updateTimeInfo(nanosNow, framesInAudioBuffer);
-
 	uint frameCount = buffer->mAudioDataByteSize >> 2;
-	stream->synthRoute.render((MT32Emu::Bit16s *)buffer->mAudioData, frameCount);
-	stream->framesRendered(frameCount);
+	if (stream->isRenderAheadEnabled()) {
+		stream->readRenderedFrames((MT32Emu::Bit16s *)buffer->mAudioData, frameCount, framesInAudioBuffer);
+	} else {
+		stream->updateTimeInfo(nanosNow, framesInAudioBuffer);
+		stream->synthRoute.render((MT32Emu::Bit16s *)buffer->mAudioData, frameCount);
+		stream->framesRendered(frameCount);
+	}
 
 	OSStatus res = AudioQueueEnqueueBuffer(queue, buffer, 0, NULL);
 	if (res) qDebug() << "CoreAudio: AudioQueueEnqueueBuffer() failed with error code:" << res;
 }
 
+OSStatus CoreAudioStream::renderCallback(void *userData, AudioUnitRenderActionFlags *actionFlags, const AudioTimeStamp *timeStamp,
+	UInt32 busNumber, UInt32 frameCount, AudioBufferList *bufferList)
+{
+	Q_UNUSED(actionFlags);
+	Q_UNUSED(busNumber);
+
+	CoreAudioStream *stream = (CoreAudioStream *)userData;
+	const MasterClockNanos nanosNow = MasterClock::getClockNanos();
+	if (bufferList->mNumberBuffers < 2) return kAudioUnitErr_FormatNotSupported;
+	quint32 framesInAudioBuffer = 0;
+	if (stream->settings.advancedTiming && (timeStamp->mFlags & kAudioTimeStampHostTimeValid)) {
+		// The host time is when the first frame being rendered is going to be played
+		UInt64 hostTimeNow = AudioGetCurrentHostTime();
+		if (hostTimeNow < timeStamp->mHostTime) {
+			UInt64 nanosAhead = AudioConvertHostTimeToNanos(timeStamp->mHostTime - hostTimeNow);
+			framesInAudioBuffer = quint32((nanosAhead * stream->sampleRate) / MasterClock::NANOS_PER_SECOND);
+		}
+	}
+	stream->updateTimeInfo(nanosNow, framesInAudioBuffer);
+	stream->synthRoute.render((float *)bufferList->mBuffers[0].mData, (float *)bufferList->mBuffers[1].mData, frameCount);
+	stream->framesRendered(frameCount);
+	return noErr;
+}
+
 bool CoreAudioStream::start(const QString deviceUid) {
+	return renderCallbackMode ? startAudioUnit(deviceUid) : startAudioQueue(deviceUid);
+}
+
+bool CoreAudioStream::startAudioUnit(const QString deviceUid) {
+	if (audioUnit != NULL) {
+		return true;
+	}
+
+	AudioComponentDescription description = {kAudioUnitType_Output, deviceUid.isEmpty() ? kAudioUnitSubType_DefaultOutput : kAudioUnitSubType_HALOutput, kAudioUnitManufacturer_Apple, 0, 0};
+	AudioComponent component = AudioComponentFindNext(NULL, &description);
+	if (component == NULL) {
+		qDebug() << "CoreAudio: Output AudioUnit not found";
+		return false;
+	}
+	OSStatus res = AudioComponentInstanceNew(component, &audioUnit);
+	if (res || audioUnit == NULL) {
+		qDebug() << "CoreAudio: AudioComponentInstanceNew() failed with error code:" << res;
+		audioUnit = NULL;
+		return false;
+	}
+
+	// Set audio output device
+	if (deviceUid.isEmpty()) {
+		qDebug() << "CoreAudio: Using default audio output device";
+	} else {
+		AudioObjectPropertyAddress propertyAddress = {kAudioHardwarePropertyTranslateUIDToDevice, kAudioObjectPropertyScopeGlobal, kAudioObjectPropertyElementMaster};
+		CFStringRef deviceUidRef = qStringToCFString(deviceUid);
+		AudioDeviceID deviceID = kAudioObjectUnknown;
+		UInt32 propertySize = sizeof(AudioDeviceID);
+		res = AudioObjectGetPropertyData(kAudioObjectSystemObject, &propertyAddress, sizeof(CFStringRef), &deviceUidRef, &propertySize, &deviceID);
+		CFRelease(deviceUidRef);
+		if (!res && deviceID != kAudioObjectUnknown) {
+			res = AudioUnitSetProperty(audioUnit, kAudioOutputUnitProperty_CurrentDevice, kAudioUnitScope_Global, 0, &deviceID, sizeof(AudioDeviceID));
+		} else if (!res) {
+			res = kAudioHardwareBadDeviceError;
+		}
+		if (res) {
+			qDebug() << "CoreAudio: Failed to select audio output device, error code:" << res;
+			disposeAudioUnit();
+			return false;
+		}
+		qDebug() << "CoreAudio: Using audio output device:" << deviceUid;
+	}
+
+	AudioStreamBasicDescription dataFormat = {(Float64)sampleRate, kAudioFormatLinearPCM, kAudioFormatFlagsNativeFloatPacked | kAudioFormatFlagIsNonInterleaved, 4, 1, 4, 2, 32, 0};
+	res = AudioUnitSetProperty(audioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &dataFormat, sizeof(AudioStreamBasicDescription));
+	if (res) {
+		qDebug() << "CoreAudio: Failed to set stream format, error code:" << res;
+		disposeAudioUnit();
+		return false;
+	}
+
+	// The device may not support the period requested, then it keeps its own
+	UInt32 deviceBufferFrames = bufferFrames;
+	res = AudioUnitSetProperty(audioUnit, kAudioDevicePropertyBufferFrameSize, kAudioUnitScope_Global, 0, &deviceBufferFrames, sizeof(UInt32));
+	if (res) qDebug() << "CoreAudio: Failed to set device buffer size, error code:" << res;
+	UInt32 propertySize = sizeof(UInt32);
+	if (!AudioUnitGetProperty(audioUnit, kAudioDevicePropertyBufferFrameSize, kAudioUnitScope_Global, 0, &deviceBufferFrames, &propertySize)) {
+		bufferFrames = deviceBufferFrames;
+		audioLatencyFrames = 2 * bufferFrames;
+		if (isAutoLatencyMode()) midiLatencyFrames = audioLatencyFrames;
+	}
+
+	AURenderCallbackStruct callback = {renderCallback, this};
+	res = AudioUnitSetProperty(audioUnit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0, &callback, sizeof(AURenderCallbackStruct));
+	if (res) {
+		qDebug() << "CoreAudio: Failed to set render callback, error code:" << res;
+		disposeAudioUnit();
+		return false;
+	}
+	res = AudioUnitInitialize(audioUnit);
+	if (res) {
+		qDebug() << "CoreAudio: AudioUnitInitialize() failed with error code:" << res;
+		disposeAudioUnit();
+		return false;
+	}
+	qDebug() << "CoreAudio: Using render callback, buffer size:" << bufferFrames << "frames, MIDI latency:" << midiLatencyFrames << "frames";
+	res = AudioOutputUnitStart(audioUnit);
+	if (res) {
+		qDebug() << "CoreAudio: AudioOutputUnitStart() failed with error code:" << res;
+		disposeAudioUnit();
+		return false;
+	}
+	return true;
+}
+
+void CoreAudioStream::disposeAudioUnit() {
+	AudioOutputUnitStop(audioUnit);
+	AudioUnitUninitialize(audioUnit);
+	OSStatus res = AudioComponentInstanceDispose(audioUnit);
+	if (res) qDebug() << "CoreAudio: AudioComponentInstanceDispose() failed with error code" << res;
+	audioUnit = NULL;
+}
+
+bool CoreAudioStream::startAudioQueue(const QString deviceUid) {
 	if (audioQueue != NULL) {
 		return true;
 	}
@@ -132,6 +263,7 @@ bool CoreAudioStream::start(const QString deviceUid) {
 		CFRelease(deviceUidRef);
 	}
 
+	startRenderAhead(bufferByteSize >> 2);
 	for (uint i = 0; i < numberOfBuffers; i++) {
 		res = AudioQueueAllocateBuffer(audioQueue, bufferByteSize, buffers + i);
 		if (res || buffers[i] == NULL) {
@@ -159,17 +291,19 @@ bool CoreAudioStream::start(const QString deviceUid) {
 }
 
 void CoreAudioStream::close() {
+	if (audioUnit != NULL) disposeAudioUnit();
 	if (audioQueue == NULL) return;
 	OSStatus res = AudioQueueDispose(audioQueue, true);
 	if (res) qDebug() << "CoreAudio: AudioQueueDispose() failed with error code" << res;
 	audioQueue = NULL;
+	stopRenderAhead();
 }
 
-CoreAudioDevice::CoreAudioDevice(CoreAudioDriver &driver, const QString uid, const QString name) :
-	AudioDevice(driver, name), uid(uid) {}
+CoreAudioDevice::CoreAudioDevice(CoreAudioDriver &driver, const QString uid, const QString name, const bool renderCallbackMode) :
+	AudioDevice(driver, name), uid(uid), renderCallbackMode(renderCallbackMode) {}
 
 AudioStream *CoreAudioDevice::startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const {
-	CoreAudioStream *stream = new CoreAudioStream(driver.getAudioSettings(), synthRoute, sampleRate);
+	CoreAudioStream *stream = new CoreAudioStream(driver.getAudioSettings(), synthRoute, sampleRate, renderCallbackMode);
 	if (stream->start(uid)) {
 		return (AudioStream *)stream;
 	}
@@ -189,6 +323,7 @@ CoreAudioDriver::~CoreAudioDriver() {
 const QList<const AudioDevice *> CoreAudioDriver::createDeviceList() {
 	QList<const AudioDevice *> deviceList;
 	deviceList.append(new CoreAudioDevice(*this)); // default device
+	deviceList.append(new CoreAudioDevice(*this, NULL, "Default output device (render callback)", true));
 
 	// Get system output devices
 	UInt32 propertySize = 0;
@@ -230,6 +365,7 @@ const QList<const AudioDevice *> CoreAudioDriver::createDeviceList() {
 								QString uid = cfStringToQString(devUidRef);
 								QString name = cfStringToQString(devNameRef);
 								deviceList.append(new CoreAudioDevice(*this, uid, name));
+								deviceList.append(new CoreAudioDevice(*this, uid, name + " (render callback)", true));
 							}
 							CFRelease(devNameRef);
 						}
@@ -2,6 +2,7 @@
 #define CORE_AUDIO_DRIVER_H
 
 #include <AudioToolbox/AudioQueue.h>
+#include <AudioUnit/AudioUnit.h>
 #include <CoreAudio/AudioHardware.h>
 
 #include "AudioDriver.h"
@@ -10,17 +11,30 @@ class SynthRoute;
 class Master;
 class CoreAudioDriver;
 
+// By default, the synth renders into AudioQueue buffers which are enqueued in turn, so that the audio latency setting
+// determines the amount of audio queued. In the render callback mode, an output AudioUnit pulls the audio instead,
+// and the synth renders non-interleaved float samples straight into the buffers provided by the callback.
+// The device period is set to the chunk length then, and the latency is merely the period being played plus the one rendered.
 class CoreAudioStream : public AudioStream {
 private:
+	const bool renderCallbackMode;
 	AudioQueueRef audioQueue;
 	AudioQueueBufferRef *buffers;
 	uint numberOfBuffers;
 	uint bufferByteSize;
+	AudioUnit audioUnit;
+	quint32 bufferFrames;
 
 	static void renderOutputBuffer(void *userData, AudioQueueRef queue, AudioQueueBufferRef buffer);
+	static OSStatus renderCallback(void *userData, AudioUnitRenderActionFlags *actionFlags, const AudioTimeStamp *timeStamp,
+		UInt32 busNumber, UInt32 frameCount, AudioBufferList *bufferList);
+
+	bool startAudioQueue(const QString deviceUid);
+	bool startAudioUnit(const QString deviceUid);
+	void disposeAudioUnit();
 
 public:
-	CoreAudioStream(const AudioDriverSettings &settings, SynthRoute &synthRoute, const quint32 sampleRate);
+	CoreAudioStream(const AudioDriverSettings &settings, SynthRoute &synthRoute, const quint32 sampleRate, const bool renderCallbackMode);
 	~CoreAudioStream();
 	bool start(const QString deviceUid);
 	void close();
@@ -30,8 +44,9 @@ class CoreAudioDevice : public AudioDevice {
 friend class CoreAudioDriver;
 private:
 	const QString uid;
+	const bool renderCallbackMode;
 
-	CoreAudioDevice(CoreAudioDriver &driver, const QString uid = NULL, const QString name = "Default output device");
+	CoreAudioDevice(CoreAudioDriver &driver, const QString uid = NULL, const QString name = "Default output device", const bool renderCallbackMode = false);
 
 public:
 	AudioStream *startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const;
@@ -21,6 +21,7 @@
 #include "../Master.h"
 #include "../QSynth.h"
 #include "../JACKClient.h"
+#include "../QAtomicHelper.h"
 #include "../QRingBuffer.h"
 
 static const uint CHANNEL_COUNT = 2;
@@ -31,6 +32,8 @@ class JACKAudioProcessor : QThread {
 	SynthRoute &synthRoute;
 	Utility::QRingBuffer *buffer;
 	volatile bool stopProcessing;
+	ThreadPolicy threadPolicy;
+	MasterClockNanos periodNanos;
 
 	// Used to block this thread until there is some available space in the buffer.
 	// Each time the JACK thread retrieves some data from the buffer, it releases one semaphore resource.
@@ -44,6 +47,7 @@ class JACKAudioProcessor : QThread {
 	volatile quint32 pendingUpdateBufferSize;
 
 	void run() {
+		ThreadPolicyScope threadPolicyScope(threadPolicy, "JACKAudioProcessor", periodNanos);
 		forever {
 			// Catch the available resources early to avoid blocking should the JACK thread
 			// free some buffer space in the meantime.
@@ -74,6 +78,7 @@ public:
 		synthRoute(useSynthRoute),
 		buffer(),
 		stopProcessing(),
+		periodNanos(),
 		pendingUpdateBufferSize()
 	{}
 
@@ -81,7 +86,9 @@ public:
 		delete buffer;
 	}
 
-	void start() {
+	void start(const ThreadPolicy &useThreadPolicy, const MasterClockNanos usePeriodNanos) {
+		threadPolicy = useThreadPolicy;
+		periodNanos = usePeriodNanos;
 		QThread::start(QThread::TimeCriticalPriority);
 	}
 
@@ -126,28 +133,28 @@ public:
 
 JACKAudioStream::JACKAudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, const quint32 useSampleRate) :
 	AudioStream(useSettings, useSynthRoute, useSampleRate),
-	jackClient(new JACKClient),
-	buffer(),
+	jackClient(),
 	processor(),
-	configuredAudioLatencyFrames(audioLatencyFrames)
+	configuredAudioLatencyFrames(audioLatencyFrames),
+	jackBufferSizeFrames(),
+	jackFrameTimeOffset(),
+	jackFrameTimeOffsetValid()
 {}
 
 JACKAudioStream::~JACKAudioStream() {
 	stop();
-	delete jackClient;
-	delete[] buffer;
 	delete processor;
 }
 
 bool JACKAudioStream::start(MidiSession *midiSession) {
-	JACKClientState state = jackClient->open(midiSession, this);
-	if (JACKClientState_OPEN != state) {
+	jackClient = JACKClient::addAudioStream(this, midiSession);
+	if (jackClient == NULL) {
 		qDebug() << "JACKAudioDriver: Failed to open JACK client connection";
 		return false;
 	}
-	jackClient->connectToPhysicalPorts();
+	jackClient->connectToPhysicalPorts(this);
 
-	const quint32 jackBufferSizeFrames = jackClient->getBufferSize();
+	jackBufferSizeFrames = jackClient->getBufferSize();
 	qDebug() << "JACKAudioDriver: JACK reported initial audio buffer size (frames / s):"
 		<< jackBufferSizeFrames << "/" << double(jackBufferSizeFrames) / sampleRate;
 	if (midiSession == NULL && jackClient->isRealtimeProcessing()) {
@@ -156,13 +163,12 @@ bool JACKAudioStream::start(MidiSession *midiSession) {
 		if (audioLatencyFrames < jackBufferSizeFrames) audioLatencyFrames = jackBufferSizeFrames;
 		processor = new JACKAudioProcessor(synthRoute);
 		processor->reallocateBuffer(audioLatencyFrames);
-		processor->start();
+		processor->start(settings.threadPolicy, (jackBufferSizeFrames * MasterClock::NANOS_PER_SECOND) / sampleRate);
 		qDebug() << "JACKAudioDriver: Configured prerendering audio buffer size (frames / s):"
 			<< audioLatencyFrames << "/" << double(audioLatencyFrames) / sampleRate;
 	} else {
-		// Rendering is synchronous, zero additional latency introduced.
+		// Rendering is synchronous, directly into the JACK port buffers, zero additional latency introduced.
 		audioLatencyFrames = 0;
-		buffer = new float[CHANNEL_COUNT * MT32Emu::MAX_SAMPLES_PER_RUN];
 	}
 
 	if (midiSession == NULL) {
@@ -174,16 +180,19 @@ bool JACKAudioStream::start(MidiSession *midiSession) {
 		// MIDI processing is synchronous, zero latency introduced
 		midiLatencyFrames = 0;
 		qDebug() << "JACKAudioDriver: Configured synchronous MIDI processing";
-		if (jackClient->isRealtimeProcessing()) synthRoute.enableRealtimeMode();
 	}
 
 	return true;
 }
 
 void JACKAudioStream::stop() {
-	qDebug() << "JACKAudioDriver: Stopping JACK client";
-	jackClient->close();
-	qDebug() << "JACKAudioDriver: JACK client stopped";
+	if (jackClient != NULL) {
+		qDebug() << "JACKAudioDriver: Removing audio stream from JACK client";
+		QAtomicHelper::storeRelease(jackFrameTimeOffsetValid, 0);
+		JACKClient::removeAudioStream(this);
+		jackClient = NULL;
+		qDebug() << "JACKAudioDriver: Audio stream removed";
+	}
 	if (processor != NULL) {
 		processor->stop();
 	}
@@ -198,6 +207,7 @@ bool JACKAudioStream::checkSampleRate(quint32 jackSampleRate) const {
 }
 
 void JACKAudioStream::onJACKBufferSizeChange(const quint32 newBufferSize) {
+	jackBufferSizeFrames = newBufferSize;
 	bool reallocationNeeded = processor != NULL;
 	qDebug() << "JACKAudioDriver: JACK reported new buffer size" << newBufferSize
 		<< (reallocationNeeded ? "reallocating buffer..." : "ignored");
@@ -213,45 +223,60 @@ void JACKAudioStream::onJACKShutdown() {
 	synthRoute.audioStreamFailed();
 }
 
-void JACKAudioStream::renderStreams(const quint32 totalFrameCount, JACKAudioSample *leftOutBuffer, JACKAudioSample *rightOutBuffer) {
+// Invoked in the process callback of the shared client, possibly in a render worker thread along with other streams.
+void JACKAudioStream::renderStreams(const JACKClient &client, const quint32 totalFrameCount, JACKAudioSample *leftOutBuffer, JACKAudioSample *rightOutBuffer) {
+	// The offset only changes after an x-run, yet it is cheap to refresh every cycle.
+	QAtomicHelper::storeRelease(jackFrameTimeOffset, quint32(getRenderedFramesCount()) - client.getLastFrameTime());
+	QAtomicHelper::storeRelease(jackFrameTimeOffsetValid, 1);
 	// Only bother with updating TimeInfo when MIDI processing is asynchronous
 	if (midiLatencyFrames != 0) {
 		quint32 framesInAudioBuffer;
 		if (settings.advancedTiming) {
-			framesInAudioBuffer = qMin(0U, jackClient->getBufferSize() - jackClient->getFramesSinceCycleStart());
+			framesInAudioBuffer = qMin(0U, client.getBufferSize() - client.getFramesSinceCycleStart());
 		} else {
 			framesInAudioBuffer = 0U;
 		}
 		updateTimeInfo(MasterClock::getClockNanos(), framesInAudioBuffer);
 	}
+	if (processor == NULL) {
+		// The MIDI events received in this cycle are already queued with the sample-accurate timestamps,
+		// so the synth renders the entire period straight into the planar port buffers.
+		synthRoute.render(leftOutBuffer, rightOutBuffer, totalFrameCount);
+		framesRendered(totalFrameCount);
+		return;
+	}
 	for (quint32 framesLeft = totalFrameCount; framesLeft > 0;) {
-		float *bufferPtr;
-		uint framesToRender;
-		if (processor != NULL) {
-			framesToRender = framesLeft;
-			bufferPtr = processor->getAvailableChunk(framesToRender);
-			if (framesToRender == 0) {
-				for (JACKAudioSample *leftOutBufferEnd = leftOutBuffer + framesLeft; leftOutBuffer < leftOutBufferEnd;) {
-					*(leftOutBuffer++) = 0;
-					*(rightOutBuffer++) = 0;
-				}
-				return;
+		quint32 framesToRender = framesLeft;
+		const float *bufferPtr = processor->getAvailableChunk(framesToRender);
+		if (framesToRender == 0) {
+			for (JACKAudioSample *leftOutBufferEnd = leftOutBuffer + framesLeft; leftOutBuffer < leftOutBufferEnd;) {
+				*(leftOutBuffer++) = 0;
+				*(rightOutBuffer++) = 0;
 			}
-		} else {
-			bufferPtr = buffer;
-			framesToRender = qMin(framesLeft, MT32Emu::MAX_SAMPLES_PER_RUN);
-			synthRoute.render(buffer, framesToRender);
+			return;
 		}
 		for (JACKAudioSample *leftOutBufferEnd = leftOutBuffer + framesToRender; leftOutBuffer < leftOutBufferEnd;) {
 			*(leftOutBuffer++) = JACKAudioSample(*(bufferPtr++));
 			*(rightOutBuffer++) = JACKAudioSample(*(bufferPtr++));
 		}
-		if (processor != NULL) processor->markChunkProcessed(framesToRender);
+		processor->markChunkProcessed(framesToRender);
 		framesLeft -= framesToRender;
 	}
 	framesRendered(totalFrameCount);
 }
 
+// Intended to be called from JACK MIDI clients connected to the same JACK server.
+bool JACKAudioStream::convertJACKFrameTime(quint32 jackFrameTime, quint64 &timestamp) const {
+	if (QAtomicHelper::loadAcquire(jackFrameTimeOffsetValid) == 0) return false;
+	const quint64 renderedFramesCount = getRenderedFramesCount();
+	const quint32 eventFramesCount = jackFrameTime + QAtomicHelper::loadAcquire(jackFrameTimeOffset);
+	// The process callback of the MIDI client may run after this stream has rendered the current cycle, so the event is
+	// delayed by one JACK period plus the prerendered audio, if any. The latency is constant, hence no jitter is introduced.
+	timestamp = renderedFramesCount + qint64(qint32(eventFramesCount - quint32(renderedFramesCount)))
+		+ jackBufferSizeFrames + audioLatencyFrames;
+	return true;
+}
+
 JACKAudioDefaultDevice::JACKAudioDefaultDevice(JACKAudioDriver &useDriver) :
 	AudioDevice(useDriver, "Default")
 {}
@@ -260,6 +285,16 @@ AudioStream *JACKAudioDefaultDevice::startAudioStream(SynthRoute &synthRoute, co
 	return startAudioStream(this, synthRoute, sampleRate, NULL);
 }
 
+bool JACKAudioDefaultDevice::isSampleRateSupported(const uint sampleRate) const {
+	// JACK only takes streams at the rate the server runs at.
+	return JACKClient::getSystemSampleRate() == sampleRate;
+}
+
+bool JACKAudioDefaultDevice::isStandbySupported() const {
+	// Stopping the stream unregisters the ports, which loses their connections in the JACK graph.
+	return false;
+}
+
 AudioStream *JACKAudioDefaultDevice::startAudioStream(const AudioDevice *audioDevice, SynthRoute &synthRoute, const uint sampleRate, MidiSession *midiSession) {
 	JACKAudioStream *stream = new JACKAudioStream(audioDevice->driver.getAudioSettings(), synthRoute, sampleRate);
 	if (stream->start(midiSession)) return stream;
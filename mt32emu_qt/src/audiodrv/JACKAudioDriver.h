@@ -23,13 +23,19 @@ public:
 	bool checkSampleRate(quint32 sampleRate) const;
 	void onJACKBufferSizeChange(const quint32 bufferSize);
 	void onJACKShutdown();
-	void renderStreams(const quint32 frameCount, JACKAudioSample *leftOutBuffer, JACKAudioSample *rightOutBuffer);
+	void renderStreams(const JACKClient &client, const quint32 frameCount, JACKAudioSample *leftOutBuffer, JACKAudioSample *rightOutBuffer);
+	bool convertJACKFrameTime(quint32 jackFrameTime, quint64 &timestamp) const;
 
 private:
-	JACKClient * const jackClient;
-	float *buffer;
+	// The client shared by all JACK audio streams, set while the stream is started
+	JACKClient *jackClient;
 	JACKAudioProcessor *processor;
 	const quint32 configuredAudioLatencyFrames;
+	quint32 jackBufferSizeFrames;
+	// The rendered frames count less the JACK frame time at the start of the last process cycle, modulo 2^32.
+	// Published for the JACK MIDI clients, which may run in other threads, once jackFrameTimeOffsetValid is set.
+	QAtomicInt jackFrameTimeOffset;
+	QAtomicInt jackFrameTimeOffsetValid;
 };
 
 class JACKAudioDefaultDevice : public AudioDevice {
@@ -38,6 +44,8 @@ public:
 	static AudioStream *startAudioStream(const AudioDevice *audioDevice, SynthRoute &synthRoute, const uint sampleRate, MidiSession *midiSession);
 
 	AudioStream *startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const;
+	bool isSampleRateSupported(const uint sampleRate) const;
+	bool isStandbySupported() const;
 
 private:
 	JACKAudioDefaultDevice(JACKAudioDriver &driver);
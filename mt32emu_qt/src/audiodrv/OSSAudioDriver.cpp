@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <pthread.h>
 #include <sys/soundcard.h>
 
@@ -34,14 +35,16 @@ static const unsigned int DEFAULT_AUDIO_LATENCY = 32;
 static const unsigned int DEFAULT_MIDI_LATENCY = 16;
 static const char deviceName[] = "/dev/dsp";
 
-OSSAudioStream::OSSAudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, const quint32 useSampleRate) :
-	AudioStream(useSettings, useSynthRoute, useSampleRate), buffer(NULL), stream(0), processingThreadID(0), stopProcessing(false)
+OSSAudioStream::OSSAudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, const quint32 useSampleRate, const bool useMmapMode) :
+	AudioStream(useSettings, useSynthRoute, useSampleRate), mmapMode(useMmapMode), buffer(NULL), stream(0), processingThreadID(0), stopProcessing(false),
+	dmaBuffer(NULL), dmaBufferFrames(0), dmaPlayFrame(0), dmaWriteFrame(0), framesQueued(0)
 {
 	bufferSize = settings.chunkLen * sampleRate / MasterClock::MILLIS_PER_SECOND;
 }
 
 OSSAudioStream::~OSSAudioStream() {
 	if (stream != 0) stop();
+	unmapDMABuffer();
 	delete[] buffer;
 }
 
@@ -50,6 +53,7 @@ void *OSSAudioStream::processingThread(void *userData) {
 	bool isErrorOccured = false;
 	OSSAudioStream &audioStream = *(OSSAudioStream *)userData;
 	qDebug() << "OSS audio: Processing thread started";
+	ThreadPolicyScope threadPolicyScope(audioStream.settings.threadPolicy, "OSS audio", audioStream.getChunkNanos());
 	while (!audioStream.stopProcessing) {
 		MasterClockNanos nanosNow = MasterClock::getClockNanos();
 		quint32 framesInAudioBuffer;
@@ -79,23 +83,137 @@ void *OSSAudioStream::processingThread(void *userData) {
 		audioStream.framesRendered(audioStream.bufferSize);
 	}
 	if (isErrorOccured) {
-		close(audioStream.stream);
-		audioStream.stream = 0;
-		audioStream.synthRoute.audioStreamFailed();
-	} else {
-		audioStream.stopProcessing = false;
+		audioStream.processingFailed();
+		return NULL;
+	}
+	audioStream.stopProcessing = false;
+	audioStream.processingThreadID = 0;
+	return NULL;
+}
+
+void *OSSAudioStream::mmapProcessingThread(void *userData) {
+	OSSAudioStream &audioStream = *(OSSAudioStream *)userData;
+	qDebug() << "OSS audio: Processing thread started in mmap mode";
+	ThreadPolicyScope threadPolicyScope(audioStream.settings.threadPolicy, "OSS audio", audioStream.getChunkNanos());
+	const MasterClockNanos chunkNanos = (audioStream.bufferSize * MasterClock::NANOS_PER_SECOND) / audioStream.sampleRate;
+	while (!audioStream.stopProcessing) {
+		MasterClockNanos nanosNow = MasterClock::getClockNanos();
+		if (!audioStream.updatePlayPosition(nanosNow)) {
+			audioStream.processingFailed();
+			return NULL;
+		}
+		audioStream.updateTimeInfo(nanosNow, audioStream.settings.advancedTiming ? audioStream.framesQueued : 0);
+		if (audioStream.framesQueued < audioStream.audioLatencyFrames) {
+			audioStream.renderToDMABuffer(audioStream.audioLatencyFrames - audioStream.framesQueued);
+		}
+		// Another fragment is due to be refilled once a chunk is played
+		MasterClock::sleepUntilClockNanos(nanosNow + chunkNanos);
 	}
+	audioStream.stopProcessing = false;
 	audioStream.processingThreadID = 0;
 	return NULL;
 }
 
+// Advances to the current play pointer and clears the frames played since the last call.
+bool OSSAudioStream::updatePlayPosition(const MasterClockNanos nanosNow) {
+	count_info countInfo;
+	if (ioctl(stream, SNDCTL_DSP_GETOPTR, &countInfo) == -1) {
+		qDebug() << "OSS audio: SNDCTL_DSP_GETOPTR failed:" << errno;
+		return false;
+	}
+	const uint playFrame = (uint(countInfo.ptr) / FRAME_SIZE) % dmaBufferFrames;
+	const quint32 playedFrames = (playFrame + dmaBufferFrames - dmaPlayFrame) % dmaBufferFrames;
+	// The play pointer wraps around, so a whole pass through the buffer is only told by the count of fragments played.
+	if (playedFrames > framesQueued || quint32(countInfo.blocks) * bufferSize >= dmaBufferFrames) {
+		audioUnderrunOccurred(nanosNow);
+		clearDMABuffer(0, dmaBufferFrames);
+		dmaWriteFrame = playFrame;
+		framesQueued = 0;
+	} else {
+		clearDMABuffer(dmaPlayFrame, playedFrames);
+		framesQueued -= playedFrames;
+	}
+	dmaPlayFrame = playFrame;
+	return true;
+}
+
+void OSSAudioStream::renderToDMABuffer(quint32 frameCount) {
+	while (frameCount > 0) {
+		const quint32 framesToRender = qMin(frameCount, quint32(dmaBufferFrames - dmaWriteFrame));
+		synthRoute.render(dmaBuffer + 2 * dmaWriteFrame, framesToRender);
+		framesRendered(framesToRender);
+		dmaWriteFrame = (dmaWriteFrame + framesToRender) % dmaBufferFrames;
+		framesQueued += framesToRender;
+		frameCount -= framesToRender;
+	}
+}
+
+void OSSAudioStream::clearDMABuffer(uint startFrame, quint32 frameCount) {
+	while (frameCount > 0) {
+		const quint32 framesToClear = qMin(frameCount, quint32(dmaBufferFrames - startFrame));
+		memset(dmaBuffer + 2 * startFrame, 0, framesToClear * FRAME_SIZE);
+		startFrame = (startFrame + framesToClear) % dmaBufferFrames;
+		frameCount -= framesToClear;
+	}
+}
+
+void OSSAudioStream::unmapDMABuffer() {
+	if (dmaBuffer == NULL) return;
+	munmap(dmaBuffer, dmaBufferFrames * FRAME_SIZE);
+	dmaBuffer = NULL;
+}
+
+// Only called from the processing thread, which exits then.
+void OSSAudioStream::processingFailed() {
+	close(stream);
+	stream = 0;
+	processingThreadID = 0;
+	synthRoute.audioStreamFailed();
+}
+
+// Maps the DMA buffer and starts the output, expects the device configured with bufferSize and dmaBufferFrames set.
+bool OSSAudioStream::startMmap() {
+	dmaBuffer = (Bit16s *)mmap(NULL, dmaBufferFrames * FRAME_SIZE, PROT_WRITE, MAP_SHARED, stream, 0);
+	if (dmaBuffer == MAP_FAILED) {
+		qDebug() << "OSS audio: mmap failed:" << errno;
+		dmaBuffer = NULL;
+		return false;
+	}
+	// The fragment being played is never written
+	audioLatencyFrames = dmaBufferFrames - bufferSize;
+	if (isAutoLatencyMode()) midiLatencyFrames = audioLatencyFrames + ((DEFAULT_MIDI_LATENCY * sampleRate) / MasterClock::MILLIS_PER_SECOND);
+	qDebug() << "OSS audio setup: DMA buffer size:" << dmaBufferFrames << "frames, fragment size:" << bufferSize << "frames";
+
+	clearDMABuffer(0, dmaBufferFrames);
+	dmaPlayFrame = 0;
+	dmaWriteFrame = 0;
+	framesQueued = 0;
+	int trigger = 0;
+	if (ioctl(stream, SNDCTL_DSP_SETTRIGGER, &trigger) == -1) {
+		qDebug() << "OSS audio: SNDCTL_DSP_SETTRIGGER failed:" << errno;
+		return false;
+	}
+	trigger = PCM_ENABLE_OUTPUT;
+	if (ioctl(stream, SNDCTL_DSP_SETTRIGGER, &trigger) == -1) {
+		qDebug() << "OSS audio: SNDCTL_DSP_SETTRIGGER failed:" << errno;
+		return false;
+	}
+	int error = pthread_create(&processingThreadID, NULL, mmapProcessingThread, this);
+	if (error != 0) {
+		processingThreadID = 0;
+		qDebug() << "OSS audio: Processing Thread creation failed:" << error;
+		return false;
+	}
+	return true;
+}
+
 bool OSSAudioStream::start() {
 	if (stream != 0) stop();
 
 	qDebug() << "Using OSS default audio device";
 
 	// Open audio device
-	stream = open(deviceName, O_WRONLY, 0);
+	stream = open(deviceName, mmapMode ? O_RDWR : O_WRONLY, 0);
 	if (stream == -1) {
 		qDebug() << "OSS audio: open failed:" << errno;
 		stream = 0;
@@ -103,12 +221,23 @@ bool OSSAudioStream::start() {
 	}
 
 	int tmp = 0;
-	uint fragSize = (FRAME_SIZE * audioLatencyFrames) / NUM_OF_FRAGMENTS;
+	if (mmapMode) {
+		if (ioctl(stream, SNDCTL_DSP_GETCAPS, &tmp) == -1 || (tmp & DSP_CAP_MMAP) == 0 || (tmp & DSP_CAP_TRIGGER) == 0) {
+			qDebug() << "OSS audio: The device doesn't support mmap mode";
+			close(stream);
+			stream = 0;
+			return false;
+		}
+		tmp = 0;
+	}
+	// In the mmap mode, the fragments are as long as the chunk, and there is one fragment more than needed for the audio latency
+	uint fragmentCount = mmapMode ? (audioLatencyFrames + bufferSize - 1) / bufferSize + 1 : NUM_OF_FRAGMENTS;
+	uint fragSize = mmapMode ? FRAME_SIZE * bufferSize : (FRAME_SIZE * audioLatencyFrames) / NUM_OF_FRAGMENTS;
 	while (fragSize > 1) {
 		tmp++;
 		fragSize >>= 1;
 	}
-	tmp |= (NUM_OF_FRAGMENTS << 16);
+	tmp |= (fragmentCount << 16);
 	if (ioctl(stream, SNDCTL_DSP_SETFRAGMENT, &tmp) == -1) {
 		qDebug() << "OSS audio: SNDCTL_DSP_SETFRAGMENT failed:" << errno;
 		close(stream);
@@ -173,8 +302,16 @@ bool OSSAudioStream::start() {
 		stream = 0;
 		return false;
 	}
-	audioLatencyFrames = bi.bytes / FRAME_SIZE;
 	bufferSize = bi.fragsize / FRAME_SIZE;
+	if (mmapMode) {
+		dmaBufferFrames = (bi.fragstotal * bi.fragsize) / FRAME_SIZE;
+		if (startMmap()) return true;
+		unmapDMABuffer();
+		close(stream);
+		stream = 0;
+		return false;
+	}
+	audioLatencyFrames = bi.bytes / FRAME_SIZE;
 	buffer = new Bit16s[/* number of channels */ 2 * bufferSize];
 	if (buffer == NULL) {
 		qDebug() << "OSS audio setup: Memory allocation error, driver died";
@@ -227,13 +364,13 @@ void OSSAudioStream::stop() {
 		close(stream);
 		stream = 0;
 	}
-	return;
+	unmapDMABuffer();
 }
 
-OSSAudioDefaultDevice::OSSAudioDefaultDevice(OSSAudioDriver &driver) : AudioDevice(driver, "Default") {}
+OSSAudioDevice::OSSAudioDevice(OSSAudioDriver &driver, const QString name, const bool useMmapMode) : AudioDevice(driver, name), mmapMode(useMmapMode) {}
 
-AudioStream *OSSAudioDefaultDevice::startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const {
-	OSSAudioStream *stream = new OSSAudioStream(driver.getAudioSettings(), synthRoute, sampleRate);
+AudioStream *OSSAudioDevice::startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const {
+	OSSAudioStream *stream = new OSSAudioStream(driver.getAudioSettings(), synthRoute, sampleRate, mmapMode);
 	if (stream->start()) return stream;
 	delete stream;
 	return NULL;
@@ -247,7 +384,8 @@ OSSAudioDriver::OSSAudioDriver(Master *master) : AudioDriver("OSS", "OSS") {
 
 const QList<const AudioDevice *> OSSAudioDriver::createDeviceList() {
 	QList<const AudioDevice *> deviceList;
-	deviceList.append(new OSSAudioDefaultDevice(*this));
+	deviceList.append(new OSSAudioDevice(*this, "Default", false));
+	deviceList.append(new OSSAudioDevice(*this, "Default (mmap mode)", true));
 	return deviceList;
 }
 
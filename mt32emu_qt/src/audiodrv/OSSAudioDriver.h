@@ -11,26 +11,47 @@ class Master;
 class SynthRoute;
 class OSSAudioDriver;
 
+// By default, the rendered chunks are written to the device, which blocks while its buffer is full.
+// In the mmap mode, the DMA buffer of the device is mapped instead and the synth renders straight into it,
+// ahead of the play pointer queried with SNDCTL_DSP_GETOPTR. The buffer is made of fragments as long as the chunk,
+// all but one of them are kept filled, while the fragments already played are cleared so that an underrun plays silence.
 class OSSAudioStream : public AudioStream {
 private:
+	const bool mmapMode;
 	MT32Emu::Bit16s *buffer;
 	int stream;
 	uint bufferSize;
 	pthread_t processingThreadID;
 	volatile bool stopProcessing;
 
+	// The mapped DMA buffer and the state of the mmap mode, only used in the processing thread once started.
+	MT32Emu::Bit16s *dmaBuffer;
+	uint dmaBufferFrames;
+	uint dmaPlayFrame;
+	uint dmaWriteFrame;
+	quint32 framesQueued;
+
 	static void *processingThread(void *);
+	static void *mmapProcessingThread(void *);
+
+	bool startMmap();
+	bool updatePlayPosition(const MasterClockNanos nanosNow);
+	void renderToDMABuffer(quint32 frameCount);
+	void clearDMABuffer(uint startFrame, quint32 frameCount);
+	void unmapDMABuffer();
+	void processingFailed();
 
 public:
-	OSSAudioStream(const AudioDriverSettings &settings, SynthRoute &synthRoute, const quint32 sampleRate);
+	OSSAudioStream(const AudioDriverSettings &settings, SynthRoute &synthRoute, const quint32 sampleRate, const bool mmapMode);
 	~OSSAudioStream();
 	bool start();
 	void stop();
 };
 
-class OSSAudioDefaultDevice : public AudioDevice {
+class OSSAudioDevice : public AudioDevice {
 friend class OSSAudioDriver;
-	OSSAudioDefaultDevice(OSSAudioDriver &driver);
+	const bool mmapMode;
+	OSSAudioDevice(OSSAudioDriver &driver, const QString name, const bool mmapMode);
 public:
 	AudioStream *startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const;
 };
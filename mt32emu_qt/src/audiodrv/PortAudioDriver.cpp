@@ -21,6 +21,7 @@
 using namespace MT32Emu;
 
 static bool paInitialised = false;
+static bool paInitialiseAttempted = false;
 
 static void dumpPortAudioDevices() {
 	PaHostApiIndex hostApiCount = Pa_GetHostApiCount();
@@ -58,7 +59,7 @@ static void dumpPortAudioDevices() {
 }
 
 PortAudioStream::PortAudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, quint32 useSampleRate) :
-  AudioStream(useSettings, useSynthRoute, useSampleRate), stream(NULL) {}
+  AudioStream(useSettings, useSynthRoute, useSampleRate), stream(NULL), floatOutput(false) {}
 
 PortAudioStream::~PortAudioStream() {
 	close();
@@ -93,7 +94,10 @@ bool PortAudioStream::start(PaDeviceIndex deviceIndex) {
 	if (audioLatency == 0) {
 		audioLatency = deviceInfo->defaultHighOutputLatency * MasterClock::NANOS_PER_SECOND;
 	}
-	PaStreamParameters outStreamParameters = {deviceIndex, 2, paInt16, (double)audioLatency / MasterClock::NANOS_PER_SECOND, NULL};
+	PaStreamParameters outStreamParameters = {deviceIndex, 2, paFloat32 | paNonInterleaved, (double)audioLatency / MasterClock::NANOS_PER_SECOND, NULL};
+	floatOutput = Pa_IsFormatSupported(NULL, &outStreamParameters, sampleRate) == paFormatIsSupported;
+	if (!floatOutput) outStreamParameters.sampleFormat = paInt16;
+	qDebug() << "PortAudio: using" << (floatOutput ? "non-interleaved float" : "interleaved 16-bit") << "output";
 	PaError err =  Pa_OpenStream(&stream, NULL, &outStreamParameters, sampleRate, paFramesPerBufferUnspecified, paNoFlag, paCallback, this);
 	if(err != paNoError) {
 		qDebug() << "Pa_OpenStream() returned PaError" << err << "-" << Pa_GetErrorText(err);
@@ -122,10 +126,10 @@ bool PortAudioStream::start(PaDeviceIndex deviceIndex) {
 
 int PortAudioStream::paCallback(const void *inputBuffer, void *outputBuffer, unsigned long frameCount, const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags, void *userData) {
 	Q_UNUSED(inputBuffer);
-	Q_UNUSED(statusFlags);
 
 	PortAudioStream *stream = (PortAudioStream *)userData;
 	MasterClockNanos nanosNow = MasterClock::getClockNanos();
+	if (statusFlags & paOutputUnderflow) stream->audioUnderrunOccurred(nanosNow);
 	quint32 framesInAudioBuffer;
 	if (stream->settings.advancedTiming) {
 		double currentTime = Pa_GetStreamTime(stream->stream);
@@ -136,7 +140,12 @@ int PortAudioStream::paCallback(const void *inputBuffer, void *outputBuffer, uns
 	}
 	stream->updateTimeInfo(nanosNow, framesInAudioBuffer);
 
-	stream->synthRoute.render((Bit16s *)outputBuffer, frameCount);
+	if (stream->floatOutput) {
+		float **channelBuffers = (float **)outputBuffer;
+		stream->synthRoute.render(channelBuffers[0], channelBuffers[1], uint(frameCount));
+	} else {
+		stream->synthRoute.render((Bit16s *)outputBuffer, frameCount);
+	}
 	stream->framesRendered(quint32(frameCount));
 	return paContinue;
 }
@@ -162,19 +171,16 @@ AudioStream *PortAudioDevice::startAudioStream(SynthRoute &synthRoute, const uin
 	return NULL;
 }
 
+bool PortAudioDevice::isSampleRateSupported(const uint sampleRate) const {
+	const PaDeviceInfo *deviceInfo = Pa_GetDeviceInfo(deviceIndex);
+	if (deviceInfo == NULL) return false;
+	PaStreamParameters outStreamParameters = {deviceIndex, 2, paInt16, deviceInfo->defaultHighOutputLatency, NULL};
+	return Pa_IsFormatSupported(NULL, &outStreamParameters, sampleRate) == paFormatIsSupported;
+}
+
 PortAudioDriver::PortAudioDriver(Master *useMaster) : AudioDriver("portaudio", "PortAudio") {
 	Q_UNUSED(useMaster);
 
-	if (!paInitialised) {
-		PaError err = Pa_Initialize();
-		if (err != paNoError) {
-			qDebug() << "Error initializing PortAudio";
-			// FIXME: Do something drastic instead of continuing on happily
-		} else {
-			paInitialised = true;
-		}
-	}
-	dumpPortAudioDevices();
 	loadAudioSettings();
 }
 
@@ -191,6 +197,19 @@ PortAudioDriver::~PortAudioDriver() {
 
 const QList<const AudioDevice *> PortAudioDriver::createDeviceList() {
 	QList<const AudioDevice *> deviceList;
+	// PortAudio is initialised along with the first device scan rather than at startup, as it probes all the host APIs,
+	// which may take long when a sound server doesn't respond.
+	if (!paInitialised && !paInitialiseAttempted) {
+		paInitialiseAttempted = true;
+		PaError err = Pa_Initialize();
+		if (err != paNoError) {
+			qDebug() << "Error initializing PortAudio";
+			// FIXME: Do something drastic instead of continuing on happily
+		} else {
+			paInitialised = true;
+			dumpPortAudioDevices();
+		}
+	}
 	PaDeviceIndex deviceCount = paInitialised ? Pa_GetDeviceCount() : 0;
 	if (deviceCount < 0) {
 		qDebug() << "Pa_GetDeviceCount() returned error" << deviceCount;
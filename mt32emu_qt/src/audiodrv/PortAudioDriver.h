@@ -14,9 +14,12 @@ class Master;
 class PortAudioDriver;
 class PortAudioDevice;
 
+// The synth renders in the stream callback straight into the output buffer. Non-interleaved float samples are preferred,
+// so that the host API converts the format at most once, and the native 16-bit interleaved format is used otherwise.
 class PortAudioStream : public AudioStream {
 private:
 	PaStream *stream;
+	bool floatOutput;
 
 	static int paCallback(const void *inputBuffer, void *outputBuffer, unsigned long frameCount, const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags, void *userData);
 
@@ -35,6 +38,7 @@ private:
 
 public:
 	AudioStream *startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const;
+	bool isSampleRateSupported(const uint sampleRate) const;
 };
 
 class PortAudioDriver : public AudioDriver {
@@ -14,12 +14,8 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <unistd.h>
-#include <pthread.h>
 #include <dlfcn.h>
 
-#include <pulse/error.h>
-
 #include "PulseAudioDriver.h"
 
 #include "../Master.h"
@@ -33,42 +29,63 @@ static const unsigned int DEFAULT_CHUNK_MS = 10;
 static const unsigned int DEFAULT_AUDIO_LATENCY = 40;
 static const unsigned int DEFAULT_MIDI_LATENCY = 20;
 
+// The PulseAudio functions in use, called through pointers so that the library may be loaded dynamically
+#define PA_FUNCTIONS(F) \
+	F(pa_threaded_mainloop_new) \
+	F(pa_threaded_mainloop_free) \
+	F(pa_threaded_mainloop_start) \
+	F(pa_threaded_mainloop_stop) \
+	F(pa_threaded_mainloop_lock) \
+	F(pa_threaded_mainloop_unlock) \
+	F(pa_threaded_mainloop_wait) \
+	F(pa_threaded_mainloop_signal) \
+	F(pa_threaded_mainloop_get_api) \
+	F(pa_context_new) \
+	F(pa_context_set_state_callback) \
+	F(pa_context_connect) \
+	F(pa_context_disconnect) \
+	F(pa_context_get_state) \
+	F(pa_context_errno) \
+	F(pa_context_unref) \
+	F(pa_stream_new) \
+	F(pa_stream_set_state_callback) \
+	F(pa_stream_set_write_callback) \
+	F(pa_stream_set_underflow_callback) \
+	F(pa_stream_connect_playback) \
+	F(pa_stream_disconnect) \
+	F(pa_stream_get_state) \
+	F(pa_stream_get_buffer_attr) \
+	F(pa_stream_get_latency) \
+	F(pa_stream_begin_write) \
+	F(pa_stream_cancel_write) \
+	F(pa_stream_write) \
+	F(pa_stream_unref) \
+	F(pa_strerror)
+
 #ifdef USE_PULSEAUDIO_DYNAMIC_LOADING
 
-static const char PA_LIB_NAME[] = "libpulse-simple.so"; // PulseAudio library filename
-static const char PA_LIB_NAME_MAJOR_VERSION[] = "libpulse-simple.so.0"; // PulseAudio library filename with major version appended
+static const char PA_LIB_NAME[] = "libpulse.so"; // PulseAudio library filename
+static const char PA_LIB_NAME_MAJOR_VERSION[] = "libpulse.so.0"; // PulseAudio library filename with major version appended
 
-// Pointers for PulseAudio simple functions
-	static __typeof__ (pa_simple_new) *_pa_simple_new = NULL;
-	static __typeof__ (pa_simple_free) *_pa_simple_free = NULL;
-	static __typeof__ (pa_simple_write) *_pa_simple_write = NULL;
-	static __typeof__ (pa_simple_drain) *_pa_simple_drain = NULL;
-	static __typeof__ (pa_simple_get_latency) *_pa_simple_get_latency = NULL;
-	static __typeof__ (pa_strerror) *_pa_strerror = NULL;
+#define PA_DECLARE_FUNCTION(name) static __typeof__ (name) *_##name = NULL;
 #else
-	static __typeof__ (pa_simple_new) *_pa_simple_new = pa_simple_new;
-	static __typeof__ (pa_simple_free) *_pa_simple_free = pa_simple_free;
-	static __typeof__ (pa_simple_write) *_pa_simple_write = pa_simple_write;
-	static __typeof__ (pa_simple_drain) *_pa_simple_drain = pa_simple_drain;
-	static __typeof__ (pa_simple_get_latency) *_pa_simple_get_latency = pa_simple_get_latency;
-	static __typeof__ (pa_strerror) *_pa_strerror = pa_strerror;
+#define PA_DECLARE_FUNCTION(name) static __typeof__ (name) *_##name = name;
 #endif
 
+PA_FUNCTIONS(PA_DECLARE_FUNCTION)
+
 static bool loadLibrary(bool loadNeeded) {
 #ifdef USE_PULSEAUDIO_DYNAMIC_LOADING
 	static void *dlHandle = NULL;
-	char *error;
+	char *error = NULL;
 
 	if (!loadNeeded) {
 		if (dlHandle) {
 			if (dlclose(dlHandle) == 0) {
 				dlHandle = NULL;
-				_pa_simple_new = NULL;
-				_pa_simple_free = NULL;
-				_pa_simple_write = NULL;
-				_pa_simple_drain = NULL;
-				_pa_simple_get_latency = NULL;
-				_pa_strerror = NULL;
+#define PA_RESET_FUNCTION(name) _##name = NULL;
+				PA_FUNCTIONS(PA_RESET_FUNCTION)
+#undef PA_RESET_FUNCTION
 			} else {
 				qDebug() << "PulseAudio library unload failed:" << dlerror();
 			}
@@ -94,28 +111,13 @@ static bool loadLibrary(bool loadNeeded) {
 	}
 
 	// Getting function pointers
-	_pa_simple_new = (__typeof__(_pa_simple_new)) dlsym(dlHandle, "pa_simple_new");
-	error = dlerror();
-	if (!error) {
-		_pa_simple_free = (__typeof__(_pa_simple_free)) dlsym(dlHandle, "pa_simple_free");
-		error = dlerror();
-	}
-	if (!error) {
-		_pa_simple_write = (__typeof__(_pa_simple_write)) dlsym(dlHandle, "pa_simple_write");
-		error = dlerror();
-	}
-	if (!error) {
-		_pa_simple_drain = (__typeof__(_pa_simple_drain)) dlsym(dlHandle, "pa_simple_drain");
-		error = dlerror();
-	}
-	if (!error) {
-		_pa_simple_get_latency = (__typeof__(_pa_simple_get_latency)) dlsym(dlHandle, "pa_simple_get_latency");
-		error = dlerror();
-	}
-	if (!error) {
-		_pa_strerror = (__typeof__(_pa_strerror)) dlsym(dlHandle, "pa_strerror");
-		error = dlerror();
+#define PA_LOAD_FUNCTION(name) \
+	if (!error) { \
+		_##name = (__typeof__(_##name)) dlsym(dlHandle, #name); \
+		error = dlerror(); \
 	}
+	PA_FUNCTIONS(PA_LOAD_FUNCTION)
+#undef PA_LOAD_FUNCTION
 	if (error) {
 		qDebug() << "Failed to get addresses of PulseAudio library functions, dlsym() returned:" << error;
 		loadLibrary(false);
@@ -128,122 +130,194 @@ static bool loadLibrary(bool loadNeeded) {
 }
 
 PulseAudioStream::PulseAudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, const quint32 useSampleRate) :
-	AudioStream(useSettings, useSynthRoute, useSampleRate), stream(NULL), processingThreadID(0), stopProcessing(false)
+	AudioStream(useSettings, useSynthRoute, useSampleRate), mainloop(NULL), context(NULL), stream(NULL), streamStarted(false), streamFailed(false)
 {
 	bufferSize = settings.chunkLen * sampleRate / MasterClock::MILLIS_PER_SECOND;
-	buffer = new Bit16s[/* channels */ 2 * bufferSize];
 }
 
 PulseAudioStream::~PulseAudioStream() {
-	if (stream != NULL) close();
-	delete[] buffer;
+	close();
+}
+
+void PulseAudioStream::contextStateCallback(pa_context *context, void *userData) {
+	Q_UNUSED(context);
+	PulseAudioStream &audioStream = *(PulseAudioStream *)userData;
+	_pa_threaded_mainloop_signal(audioStream.mainloop, 0);
 }
 
-void *PulseAudioStream::processingThread(void *userData) {
-	int error;
+void PulseAudioStream::streamStateCallback(pa_stream *stream, void *userData) {
 	PulseAudioStream &audioStream = *(PulseAudioStream *)userData;
-	qDebug() << "PulseAudio: Processing thread started";
-	while (!audioStream.stopProcessing) {
-		MasterClockNanos nanosNow = MasterClock::getClockNanos();
-		quint32 framesInAudioBuffer;
-		if (audioStream.settings.advancedTiming) {
-			framesInAudioBuffer = quint32(audioStream.sampleRate * ((double)_pa_simple_get_latency(audioStream.stream, &error) / MasterClock::MICROS_PER_SECOND));
-		} else {
-			framesInAudioBuffer = 0;
+	if (_pa_stream_get_state(stream) == PA_STREAM_FAILED && audioStream.streamStarted && !audioStream.streamFailed) {
+		audioStream.failed("pa_stream");
+		return;
+	}
+	_pa_threaded_mainloop_signal(audioStream.mainloop, 0);
+}
+
+void PulseAudioStream::streamWriteCallback(pa_stream *stream, size_t requestedBytes, void *userData) {
+	PulseAudioStream &audioStream = *(PulseAudioStream *)userData;
+	if (audioStream.streamFailed) return;
+	MasterClockNanos nanosNow = MasterClock::getClockNanos();
+	quint32 framesInAudioBuffer = 0;
+	if (audioStream.settings.advancedTiming) {
+		// The timing info is interpolated by the library, no round trip to the server is made here
+		pa_usec_t latency;
+		int negative;
+		if (_pa_stream_get_latency(stream, &latency, &negative) == 0 && !negative) {
+			framesInAudioBuffer = quint32((latency * audioStream.sampleRate) / MasterClock::MICROS_PER_SECOND);
+		}
+	}
+	audioStream.updateTimeInfo(nanosNow, framesInAudioBuffer);
+	const size_t chunkBytes = audioStream.bufferSize * FRAME_SIZE;
+	while (requestedBytes >= size_t(FRAME_SIZE)) {
+		void *data = NULL;
+		size_t bytes = qMin(requestedBytes, chunkBytes);
+		if (_pa_stream_begin_write(stream, &data, &bytes) < 0 || data == NULL) {
+			audioStream.failed("pa_stream_begin_write()");
+			return;
+		}
+		quint32 frameCount = quint32(qMin(requestedBytes, bytes) / FRAME_SIZE);
+		if (frameCount == 0) {
+			_pa_stream_cancel_write(stream);
+			break;
 		}
-		audioStream.updateTimeInfo(nanosNow, framesInAudioBuffer);
-		audioStream.synthRoute.render(audioStream.buffer, audioStream.bufferSize);
-		if (_pa_simple_write(audioStream.stream, audioStream.buffer, audioStream.bufferSize * FRAME_SIZE, &error) < 0) {
-			qDebug() << "pa_simple_write() failed:" << _pa_strerror(error);
-			_pa_simple_free(audioStream.stream);
-			audioStream.stream = NULL;
-			qDebug() << "PulseAudio: Processing thread stopped";
-			audioStream.synthRoute.audioStreamFailed();
-			audioStream.processingThreadID = 0;
-			return NULL;
+		audioStream.synthRoute.render((Bit16s *)data, frameCount);
+		if (_pa_stream_write(stream, data, frameCount * FRAME_SIZE, NULL, 0, PA_SEEK_RELATIVE) < 0) {
+			audioStream.failed("pa_stream_write()");
+			return;
 		}
-		audioStream.framesRendered(audioStream.bufferSize);
+		audioStream.framesRendered(frameCount);
+		requestedBytes -= frameCount * FRAME_SIZE;
+	}
+}
+
+void PulseAudioStream::streamUnderflowCallback(pa_stream *stream, void *userData) {
+	Q_UNUSED(stream);
+	PulseAudioStream &audioStream = *(PulseAudioStream *)userData;
+	audioStream.audioUnderrunOccurred(MasterClock::getClockNanos());
+}
+
+// Called in the main loop thread, thus the stream is closed asynchronously by the synth.
+void PulseAudioStream::failed(const char *functionName) {
+	qDebug() << "PulseAudio:" << functionName << "failed:" << _pa_strerror(_pa_context_errno(context));
+	streamFailed = true;
+	synthRoute.audioStreamFailed();
+}
+
+// Waits with the main loop locked until both the context and the stream are ready, returns false if either fails.
+bool PulseAudioStream::waitUntilReady() {
+	for (;;) {
+		pa_context_state_t contextState = _pa_context_get_state(context);
+		if (!PA_CONTEXT_IS_GOOD(contextState)) return false;
+		if (contextState == PA_CONTEXT_READY) {
+			if (stream == NULL) return true;
+			pa_stream_state_t streamState = _pa_stream_get_state(stream);
+			if (!PA_STREAM_IS_GOOD(streamState)) return false;
+			if (streamState == PA_STREAM_READY) return true;
+		}
+		_pa_threaded_mainloop_wait(mainloop);
 	}
-	audioStream.stopProcessing = false;
-	audioStream.processingThreadID = 0;
-	return NULL;
 }
 
 bool PulseAudioStream::start() {
-	int error;
-	if (buffer == NULL) return false;
-	memset(buffer, 0, FRAME_SIZE * bufferSize);
-	if (stream != NULL) close();
+	if (mainloop != NULL) close();
 
 	qDebug() << "Using PulseAudio default device";
 
 	// The Sample format to use
-	static const pa_sample_spec ss = {
-		PA_SAMPLE_S16NE, // format
-		sampleRate,
-		2 // channels
-	};
+	pa_sample_spec ss;
+	ss.format = PA_SAMPLE_S16NE;
+	ss.rate = sampleRate;
+	ss.channels = 2;
 
-	// Configuring desired audio latency
+	// Configuring desired audio latency. The server requests more audio when the buffer falls by the chunk length.
 	qDebug() << "Using audio latency:" << settings.audioLatency;
-	static const pa_buffer_attr ba = {
-		audioLatencyFrames * FRAME_SIZE, // uint32_t maxlength;
-		audioLatencyFrames * FRAME_SIZE, // uint32_t tlength;
-		(uint32_t)-1, // uint32_t prebuf;
-		(uint32_t)-1, // uint32_t minreq;
-		(uint32_t)-1 // uint32_t fragsize;
-	};
-
-	// Create a new playback stream
-	stream = _pa_simple_new(NULL, "mt32emu-qt", PA_STREAM_PLAYBACK, NULL, "playback", &ss, NULL, &ba, &error);
-	if (stream == NULL) {
-		qDebug() << "pa_simple_new() failed:" << _pa_strerror(error);
-		return false;
-	}
+	pa_buffer_attr ba;
+	ba.maxlength = (uint32_t)-1;
+	ba.tlength = audioLatencyFrames * FRAME_SIZE;
+	ba.prebuf = (uint32_t)-1;
+	ba.minreq = bufferSize * FRAME_SIZE;
+	ba.fragsize = (uint32_t)-1;
 
 	// Setup initial MIDI latency
 	if (isAutoLatencyMode()) midiLatencyFrames = audioLatencyFrames + ((DEFAULT_MIDI_LATENCY * sampleRate) / MasterClock::MILLIS_PER_SECOND);
 
-	// Start playing to fill audio buffers
-	int initFrames = audioLatencyFrames;
-	while (initFrames > 0) {
-		if (_pa_simple_write(stream, buffer, FRAME_SIZE * bufferSize, &error) < 0) {
-			qDebug() << "pa_simple_write() failed:" << _pa_strerror(error);
-			_pa_simple_free(stream); 
-			stream = NULL;
-			return false;
-		}
-		initFrames -= bufferSize;
+	mainloop = _pa_threaded_mainloop_new();
+	if (mainloop == NULL) {
+		qDebug() << "pa_threaded_mainloop_new() failed";
+		return false;
 	}
-	error = pthread_create(&processingThreadID, NULL, processingThread, this);
-	if (error != 0) {
-		processingThreadID = 0;
-		qDebug() << "PulseAudio: Processing Thread creation failed:" << error;
-		_pa_simple_free(stream);
-		stream = NULL;
+	context = _pa_context_new(_pa_threaded_mainloop_get_api(mainloop), "mt32emu-qt");
+	if (context == NULL) {
+		qDebug() << "pa_context_new() failed";
+		close();
 		return false;
 	}
-	return true;
+	_pa_context_set_state_callback(context, contextStateCallback, this);
+	if (_pa_context_connect(context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0) {
+		qDebug() << "pa_context_connect() failed:" << _pa_strerror(_pa_context_errno(context));
+		close();
+		return false;
+	}
+	_pa_threaded_mainloop_lock(mainloop);
+	if (_pa_threaded_mainloop_start(mainloop) < 0) {
+		_pa_threaded_mainloop_unlock(mainloop);
+		qDebug() << "pa_threaded_mainloop_start() failed";
+		close();
+		return false;
+	}
+	bool ready = waitUntilReady();
+	if (ready) {
+		stream = _pa_stream_new(context, "playback", &ss, NULL);
+		ready = stream != NULL;
+	}
+	if (ready) {
+		_pa_stream_set_state_callback(stream, streamStateCallback, this);
+		_pa_stream_set_write_callback(stream, streamWriteCallback, this);
+		_pa_stream_set_underflow_callback(stream, streamUnderflowCallback, this);
+		pa_stream_flags_t flags = pa_stream_flags_t(PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE);
+		ready = _pa_stream_connect_playback(stream, NULL, &ba, flags, NULL, NULL) == 0 && waitUntilReady();
+	}
+	if (ready) {
+		// The server may have adjusted the buffer
+		const pa_buffer_attr *actualBufferAttr = _pa_stream_get_buffer_attr(stream);
+		if (actualBufferAttr != NULL && actualBufferAttr->tlength != (uint32_t)-1) {
+			audioLatencyFrames = actualBufferAttr->tlength / FRAME_SIZE;
+			if (isAutoLatencyMode()) midiLatencyFrames = audioLatencyFrames + ((DEFAULT_MIDI_LATENCY * sampleRate) / MasterClock::MILLIS_PER_SECOND);
+		}
+		streamStarted = true;
+		qDebug() << "PulseAudio: Stream ready, audio latency:" << audioLatencyFrames << "frames, MIDI latency:" << midiLatencyFrames << "frames";
+	} else {
+		qDebug() << "PulseAudio: Failed to set up playback stream:" << _pa_strerror(_pa_context_errno(context));
+	}
+	_pa_threaded_mainloop_unlock(mainloop);
+	if (!ready) close();
+	return ready;
 }
 
 void PulseAudioStream::close() {
-	int error;
+	if (mainloop == NULL) return;
+	_pa_threaded_mainloop_lock(mainloop);
 	if (stream != NULL) {
-		if (processingThreadID != 0) {
-			qDebug() << "PulseAudio: Stopping processing thread...";
-			stopProcessing = true;
-			pthread_join(processingThreadID, NULL);
-			stopProcessing = false;
-			processingThreadID = 0;
-			qDebug() << "PulseAudio: Processing thread stopped";
-		}
-		if (_pa_simple_drain(stream, &error) < 0) {
-			qDebug() << "pa_simple_drain() failed:" << _pa_strerror(error);
-		}
-		_pa_simple_free(stream); 
+		_pa_stream_set_write_callback(stream, NULL, NULL);
+		_pa_stream_set_underflow_callback(stream, NULL, NULL);
+		_pa_stream_set_state_callback(stream, NULL, NULL);
+		_pa_stream_disconnect(stream);
+		_pa_stream_unref(stream);
 		stream = NULL;
 	}
-	return;
+	if (context != NULL) {
+		_pa_context_set_state_callback(context, NULL, NULL);
+		_pa_context_disconnect(context);
+		_pa_context_unref(context);
+		context = NULL;
+	}
+	_pa_threaded_mainloop_unlock(mainloop);
+	_pa_threaded_mainloop_stop(mainloop);
+	_pa_threaded_mainloop_free(mainloop);
+	mainloop = NULL;
+	streamStarted = false;
+	streamFailed = false;
 }
 
 PulseAudioDefaultDevice::PulseAudioDefaultDevice(PulseAudioDriver &driver) : AudioDevice(driver, "Default") {}
@@ -3,7 +3,7 @@
 
 #include <QtCore>
 
-#include <pulse/simple.h>
+#include <pulse/pulseaudio.h>
 
 #include <mt32emu/mt32emu.h>
 
@@ -13,15 +13,25 @@ class Master;
 class SynthRoute;
 class PulseAudioDriver;
 
+// The stream is driven by the write requests of the server, which are issued in the thread of a threaded main loop
+// whenever the amount of audio buffered falls by the chunk length below the audio latency. The synth renders straight
+// into the memory blocks of the server obtained with pa_stream_begin_write(), so there is no intermediate buffer to copy from.
 class PulseAudioStream : public AudioStream {
 private:
-	MT32Emu::Bit16s *buffer;
-	pa_simple *stream;
+	pa_threaded_mainloop *mainloop;
+	pa_context *context;
+	pa_stream *stream;
 	uint bufferSize;
-	pthread_t processingThreadID;
-	volatile bool stopProcessing;
+	bool streamStarted;
+	bool streamFailed;
 
-	static void *processingThread(void *);
+	static void contextStateCallback(pa_context *context, void *userData);
+	static void streamStateCallback(pa_stream *stream, void *userData);
+	static void streamWriteCallback(pa_stream *stream, size_t requestedBytes, void *userData);
+	static void streamUnderflowCallback(pa_stream *stream, void *userData);
+
+	bool waitUntilReady();
+	void failed(const char *functionName);
 
 public:
 	PulseAudioStream(const AudioDriverSettings &settings, SynthRoute &synthRoute, const quint32 sampleRate);
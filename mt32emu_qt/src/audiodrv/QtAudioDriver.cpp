@@ -18,8 +18,10 @@
 
 #ifdef USE_QT_MULTIMEDIAKIT
 #include <QtMultimediaKit/QAudioOutput>
+#include <QtMultimediaKit/QAudioDeviceInfo>
 #else
 #include <QtMultimedia/QAudioOutput>
+#include <QtMultimedia/QAudioDeviceInfo>
 #endif
 
 #include <mt32emu/mt32emu.h>
@@ -29,6 +31,17 @@
 
 using namespace MT32Emu;
 
+static QAudioFormat makeAudioFormat(const quint32 sampleRate) {
+	QAudioFormat format;
+	format.setSampleRate(sampleRate);
+	format.setChannelCount(2);
+	format.setSampleSize(16);
+	format.setCodec("audio/pcm");
+	// libmt32emu produces samples in native byte order which is the default byte order used in QAudioFormat
+	format.setSampleType(QAudioFormat::SignedInt);
+	return format;
+}
+
 class WaveGenerator : public QIODevice {
 private:
 	QtAudioStream &stream;
@@ -51,8 +64,12 @@ public:
 		} else {
 			framesInAudioBuffer = 0;
 		}
-		stream.updateTimeInfo(nanosNow, framesInAudioBuffer);
 		uint framesToRender = uint(len >> 2);
+		if (stream.isRenderAheadEnabled()) {
+			stream.readRenderedFrames((Bit16s *)data, framesToRender, framesInAudioBuffer);
+			return len;
+		}
+		stream.updateTimeInfo(nanosNow, framesInAudioBuffer);
 		stream.synthRoute.render((Bit16s *)data, framesToRender);
 		stream.framesRendered(framesToRender);
 		return len;
@@ -73,6 +90,7 @@ public:
 	ProcessingThread(QtAudioStream &useStream) : stream(useStream) {}
 
 	void run() {
+		ThreadPolicyScope threadPolicyScope(stream.getThreadPolicy(), "QAudioDriver", stream.getChunkNanos());
 		stream.start();
 		exec();
 		stream.close();
@@ -97,14 +115,7 @@ QtAudioStream::~QtAudioStream() {
 }
 
 void QtAudioStream::start() {
-	QAudioFormat format;
-	format.setSampleRate(sampleRate);
-	format.setChannelCount(2);
-	format.setSampleSize(16);
-	format.setCodec("audio/pcm");
-	// libmt32emu produces samples in native byte order which is the default byte order used in QAudioFormat
-	format.setSampleType(QAudioFormat::SignedInt);
-	audioOutput = new QAudioOutput(format);
+	audioOutput = new QAudioOutput(makeAudioFormat(sampleRate));
 	waveGenerator = new WaveGenerator(*this);
 	if (settings.audioLatency != 0) {
 		audioOutput->setBufferSize((sampleRate * settings.audioLatency << 2) / MasterClock::MILLIS_PER_SECOND);
@@ -117,11 +128,13 @@ void QtAudioStream::start() {
 
 	// Setup initial MIDI latency
 	if (isAutoLatencyMode()) midiLatencyFrames = audioLatencyFrames;
+	startRenderAhead(quint32(audioOutput->periodSize() >> 2));
 	qDebug() << "QAudioDriver: MIDI latency set to:" << (double)midiLatencyFrames / sampleRate << "sec";
 }
 
 void QtAudioStream::close() {
 	audioOutput->stop();
+	stopRenderAhead();
 	delete audioOutput;
 	delete waveGenerator;
 }
@@ -132,6 +145,10 @@ AudioStream *QtAudioDefaultDevice::startAudioStream(SynthRoute &synthRoute, cons
 	return new QtAudioStream(driver.getAudioSettings(), synthRoute, sampleRate);
 }
 
+bool QtAudioDefaultDevice::isSampleRateSupported(const uint sampleRate) const {
+	return QAudioDeviceInfo::defaultOutputDevice().isFormatSupported(makeAudioFormat(sampleRate));
+}
+
 QtAudioDriver::QtAudioDriver(Master *useMaster) : AudioDriver("qtaudio", "QtAudio") {
 	Q_UNUSED(useMaster);
 
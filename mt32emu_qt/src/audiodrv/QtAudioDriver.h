@@ -33,6 +33,7 @@ private:
 	QtAudioDefaultDevice(QtAudioDriver &driver);
 public:
 	AudioStream *startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const;
+	bool isSampleRateSupported(const uint sampleRate) const;
 };
 
 class QtAudioDriver : public AudioDriver {
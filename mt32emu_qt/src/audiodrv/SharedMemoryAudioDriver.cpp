@@ -0,0 +1,260 @@
+/* Copyright (C) 2011-2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SharedMemoryAudioDriver.h"
+
+#include <cstring>
+
+#ifdef Q_OS_WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "../SynthRoute.h"
+
+using namespace MT32Emu;
+
+static const unsigned int FRAME_SIZE = 4; // Stereo, 16-bit
+static const unsigned int DEFAULT_CHUNK_MS = 10;
+static const unsigned int DEFAULT_AUDIO_LATENCY = 500;
+static const unsigned int DEFAULT_MIDI_LATENCY = 10;
+// Limits the number of rings open at once, a new ring takes the lowest free index.
+static const uint MAX_RING_COUNT = 64;
+
+static QMutex ringIndexMutex;
+static bool ringIndexUsed[MAX_RING_COUNT];
+
+SharedMemoryAudioProcessor::SharedMemoryAudioProcessor(SharedMemoryAudioStream &useStream) : stream(useStream) {}
+
+void SharedMemoryAudioProcessor::run() {
+	stream.processingLoop();
+}
+
+SharedMemoryAudioStream::SharedMemoryAudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, const quint32 useSampleRate) :
+	AudioStream(useSettings, useSynthRoute, useSampleRate), ringIndex(0), mappingSize(0), mapping(NULL), header(NULL), ringFrames(NULL),
+	capacityFrames(0), processor(*this), stopProcessing(false)
+{
+	chunkFrames = settings.chunkLen * sampleRate / MasterClock::MILLIS_PER_SECOND;
+}
+
+SharedMemoryAudioStream::~SharedMemoryAudioStream() {
+	stop();
+}
+
+bool SharedMemoryAudioStream::createRing() {
+	capacityFrames = 1;
+	while (capacityFrames < audioLatencyFrames || capacityFrames < 2 * chunkFrames) capacityFrames <<= 1;
+	mappingSize = MT32EMU_SHM_AUDIO_HEADER_SIZE + capacityFrames * FRAME_SIZE;
+
+	QMutexLocker ringIndexLocker(&ringIndexMutex);
+	for (uint index = 1; index <= MAX_RING_COUNT; index++) {
+		if (ringIndexUsed[index - 1]) continue;
+		void *address;
+#ifdef Q_OS_WIN32
+		// The name is taken by another instance if the mapping exists, the next index is tried then.
+		const QByteArray name = QString("Local\\" MT32EMU_SHM_AUDIO_NAME_PREFIX "%1").arg(index).toLatin1();
+		HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, DWORD(mappingSize), name.constData());
+		if (handle == NULL) {
+			qDebug() << "Shared memory audio: CreateFileMapping failed:" << GetLastError();
+			return false;
+		}
+		if (GetLastError() == ERROR_ALREADY_EXISTS) {
+			CloseHandle(handle);
+			continue;
+		}
+		address = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, mappingSize);
+		if (address == NULL) {
+			qDebug() << "Shared memory audio: MapViewOfFile failed:" << GetLastError();
+			CloseHandle(handle);
+			return false;
+		}
+		mapping = handle;
+#else
+		// The name is taken by another instance (or left behind by a crashed one) if it exists, the next index is tried then.
+		const QByteArray name = QString("/" MT32EMU_SHM_AUDIO_NAME_PREFIX "%1").arg(index).toLatin1();
+		int fd = shm_open(name.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0) {
+			if (errno == EEXIST) continue;
+			qDebug() << "Shared memory audio: shm_open failed:" << errno;
+			return false;
+		}
+		if (ftruncate(fd, off_t(mappingSize)) != 0) {
+			qDebug() << "Shared memory audio: ftruncate failed:" << errno;
+			close(fd);
+			shm_unlink(name.constData());
+			return false;
+		}
+		address = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (address == MAP_FAILED) {
+			qDebug() << "Shared memory audio: mmap failed:" << errno;
+			shm_unlink(name.constData());
+			return false;
+		}
+#endif
+		ringIndexUsed[index - 1] = true;
+		ringIndex = index;
+		memset(address, 0, mappingSize);
+		header = (mt32emu_shm_audio_header *)address;
+		ringFrames = (Bit16s *)((char *)address + MT32EMU_SHM_AUDIO_HEADER_SIZE);
+		header->sampleRate = sampleRate;
+		header->channelCount = 2;
+		header->capacityFrames = capacityFrames;
+		header->writerActive = 1;
+		header->writtenClockNanos = mt32emu_shm_audio_get_clock_nanos();
+		// The readers check the magic last, so they never see a partially initialised header.
+		MT32EMU_SHM_AUDIO_BARRIER();
+		header->version = MT32EMU_SHM_AUDIO_VERSION;
+		header->magic = MT32EMU_SHM_AUDIO_MAGIC;
+		qDebug() << "Shared memory audio: Publishing to" << name << "ring size:" << capacityFrames << "frames";
+		return true;
+	}
+	qDebug() << "Shared memory audio: No free ring name";
+	return false;
+}
+
+void SharedMemoryAudioStream::destroyRing() {
+	if (header == NULL) return;
+	header->writerActive = 0;
+	MT32EMU_SHM_AUDIO_BARRIER();
+#ifdef Q_OS_WIN32
+	UnmapViewOfFile(header);
+	CloseHandle(mapping);
+	mapping = NULL;
+#else
+	munmap(header, mappingSize);
+	// The readers keep their mappings, the name is only removed so that no new reader attaches to the abandoned ring.
+	shm_unlink(QString("/" MT32EMU_SHM_AUDIO_NAME_PREFIX "%1").arg(ringIndex).toLatin1().constData());
+#endif
+	header = NULL;
+	ringFrames = NULL;
+	QMutexLocker ringIndexLocker(&ringIndexMutex);
+	ringIndexUsed[ringIndex - 1] = false;
+}
+
+// Renders the next chunk straight into the ring, after reserving the space so that the readers know which frames
+// are being overwritten. The frame clock is updated once the chunk is complete.
+void SharedMemoryAudioStream::renderChunk() {
+	const quint64 writtenFrameCount = header->writtenFrameCount;
+	header->clockSequence++;
+	MT32EMU_SHM_AUDIO_BARRIER();
+	header->reservedFrameCount = writtenFrameCount + chunkFrames;
+	MT32EMU_SHM_AUDIO_BARRIER();
+	header->clockSequence++;
+	MT32EMU_SHM_AUDIO_BARRIER();
+
+	const quint32 writePosition = quint32(writtenFrameCount & (capacityFrames - 1));
+	const quint32 firstFrameCount = qMin(chunkFrames, capacityFrames - writePosition);
+	synthRoute.render(ringFrames + 2 * writePosition, firstFrameCount);
+	if (firstFrameCount < chunkFrames) synthRoute.render(ringFrames, chunkFrames - firstFrameCount);
+
+	MT32EMU_SHM_AUDIO_BARRIER();
+	header->clockSequence++;
+	MT32EMU_SHM_AUDIO_BARRIER();
+	header->writtenFrameCount = writtenFrameCount + chunkFrames;
+	header->writtenClockNanos = mt32emu_shm_audio_get_clock_nanos();
+	MT32EMU_SHM_AUDIO_BARRIER();
+	header->clockSequence++;
+	framesRendered(chunkFrames);
+}
+
+void SharedMemoryAudioStream::processingLoop() {
+	qDebug() << "Shared memory audio: Processing thread started";
+	ThreadPolicyScope threadPolicyScope(settings.threadPolicy, "Shared memory audio", getChunkNanos());
+	const MasterClockNanos chunkNanos = (chunkFrames * MasterClock::NANOS_PER_SECOND) / sampleRate;
+	MasterClockNanos nextChunkNanos = MasterClock::getClockNanos();
+	while (!stopProcessing) {
+		const MasterClockNanos nanosNow = MasterClock::getClockNanos();
+		// The frames are available to the readers as soon as they are written.
+		updateTimeInfo(nanosNow, 0);
+		renderChunk();
+		nextChunkNanos += chunkNanos;
+		// Catch up with the clock after a stall rather than rendering a burst of chunks.
+		if (nextChunkNanos < nanosNow - chunkNanos) nextChunkNanos = nanosNow;
+		MasterClock::sleepUntilClockNanos(nextChunkNanos);
+	}
+	qDebug() << "Shared memory audio: Processing thread stopped";
+}
+
+bool SharedMemoryAudioStream::start() {
+	if (chunkFrames == 0 || !createRing()) return false;
+	// Nothing is buffered but the chunk being rendered, the readers add their own latency.
+	audioLatencyFrames = chunkFrames;
+	if (isAutoLatencyMode()) midiLatencyFrames = chunkFrames + ((DEFAULT_MIDI_LATENCY * sampleRate) / MasterClock::MILLIS_PER_SECOND);
+	stopProcessing = false;
+	processor.start(QThread::TimeCriticalPriority);
+	return true;
+}
+
+void SharedMemoryAudioStream::stop() {
+	if (processor.isRunning()) {
+		stopProcessing = true;
+		processor.wait();
+		stopProcessing = false;
+	}
+	destroyRing();
+}
+
+SharedMemoryAudioDevice::SharedMemoryAudioDevice(SharedMemoryAudioDriver &driver) : AudioDevice(driver, "Shared memory ring") {}
+
+AudioStream *SharedMemoryAudioDevice::startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const {
+	SharedMemoryAudioStream *stream = new SharedMemoryAudioStream(driver.getAudioSettings(), synthRoute, sampleRate);
+	if (stream->start()) return stream;
+	delete stream;
+	return NULL;
+}
+
+bool SharedMemoryAudioDevice::isSampleRateSupported(const uint) const {
+	// The readers get the frames as rendered, any conversion is up to them.
+	return true;
+}
+
+bool SharedMemoryAudioDevice::isStandbySupported() const {
+	// The readers take a stopped ring for an abandoned one and close it.
+	return false;
+}
+
+SharedMemoryAudioDriver::SharedMemoryAudioDriver(Master *master) : AudioDriver("sharedMemory", "Shared memory") {
+	Q_UNUSED(master);
+
+	loadAudioSettings();
+}
+
+const QList<const AudioDevice *> SharedMemoryAudioDriver::createDeviceList() {
+	QList<const AudioDevice *> deviceList;
+	deviceList.append(new SharedMemoryAudioDevice(*this));
+	return deviceList;
+}
+
+void SharedMemoryAudioDriver::validateAudioSettings(AudioDriverSettings &settings) const {
+	if (settings.audioLatency == 0) {
+		settings.audioLatency = DEFAULT_AUDIO_LATENCY;
+	}
+	if (settings.chunkLen == 0) {
+		settings.chunkLen = DEFAULT_CHUNK_MS;
+	}
+	if (settings.chunkLen > settings.audioLatency) {
+		settings.chunkLen = settings.audioLatency;
+	}
+	if ((settings.midiLatency != 0) && (settings.midiLatency < settings.chunkLen)) {
+		settings.midiLatency = settings.chunkLen;
+	}
+	settings.renderAhead = 0;
+}
@@ -0,0 +1,74 @@
+#ifndef SHARED_MEMORY_AUDIO_DRIVER_H
+#define SHARED_MEMORY_AUDIO_DRIVER_H
+
+#include <QtCore>
+
+#include <mt32emu/mt32emu.h>
+
+#include "AudioDriver.h"
+
+#include "../../shmaudio/mt32emu_shm_audio.h"
+
+class Master;
+class SynthRoute;
+class SharedMemoryAudioDriver;
+class SharedMemoryAudioStream;
+
+class SharedMemoryAudioProcessor : public QThread {
+public:
+	SharedMemoryAudioProcessor(SharedMemoryAudioStream &stream);
+
+protected:
+	void run();
+
+private:
+	SharedMemoryAudioStream &stream;
+};
+
+// Publishes the output in a named shared-memory ring that other local processes read with the mt32emu_shm_audio library.
+// The synth renders straight into the ring at the wall-clock pace, a chunk at a time, and never waits for the readers.
+// The ring is as long as the audio latency setting, rounded up to a power of 2, the readers choose their latency themselves.
+class SharedMemoryAudioStream : public AudioStream {
+friend class SharedMemoryAudioProcessor;
+private:
+	uint ringIndex;
+	size_t mappingSize;
+	// A HANDLE on Windows, a file descriptor is not kept open otherwise.
+	void *mapping;
+	mt32emu_shm_audio_header *header;
+	MT32Emu::Bit16s *ringFrames;
+	quint32 capacityFrames;
+	quint32 chunkFrames;
+	SharedMemoryAudioProcessor processor;
+	volatile bool stopProcessing;
+
+	bool createRing();
+	void destroyRing();
+	void processingLoop();
+	void renderChunk();
+
+public:
+	SharedMemoryAudioStream(const AudioDriverSettings &settings, SynthRoute &synthRoute, const quint32 sampleRate);
+	~SharedMemoryAudioStream();
+	bool start();
+	void stop();
+};
+
+class SharedMemoryAudioDevice : public AudioDevice {
+friend class SharedMemoryAudioDriver;
+	SharedMemoryAudioDevice(SharedMemoryAudioDriver &driver);
+public:
+	AudioStream *startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const;
+	bool isSampleRateSupported(const uint sampleRate) const;
+	bool isStandbySupported() const;
+};
+
+class SharedMemoryAudioDriver : public AudioDriver {
+private:
+	void validateAudioSettings(AudioDriverSettings &settings) const;
+public:
+	SharedMemoryAudioDriver(Master *useMaster);
+	const QList<const AudioDevice *> createDeviceList();
+};
+
+#endif
@@ -0,0 +1,342 @@
+/* Copyright (C) 2011-2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <objbase.h>
+#include <mmdeviceapi.h>
+#include <audioclient.h>
+
+#include "WASAPIAudioDriver.h"
+#include "../QSynth.h"
+#include "../Master.h"
+
+using namespace MT32Emu;
+
+// The engine of the shared mode runs with 10 ms period
+static const uint DEFAULT_CHUNK_MS = 10;
+static const uint DEFAULT_AUDIO_LATENCY = 40;
+// Stereo, 16-bit samples
+static const uint FRAME_SIZE = 4;
+// Latency for MIDI processing. 15 ms is the offset of interprocess timeGetTime() difference.
+static const uint DEFAULT_MIDI_LATENCY = 15;
+// Waiting for the buffer event longer than that means the endpoint has stopped
+static const DWORD EVENT_TIMEOUT_MS = 2000;
+static const REFERENCE_TIME REFTIMES_PER_SECOND = 10000000;
+
+// Defined here rather than taken from uuid.lib, since the MinGW import libraries lack some of them
+static const CLSID CLSID_MT32EMU_MMDeviceEnumerator = {0xBCDE0395, 0xE52F, 0x467C, {0x8E, 0x3D, 0xC4, 0x57, 0x92, 0x91, 0x69, 0x2E}};
+static const IID IID_MT32EMU_IMMDeviceEnumerator = {0xA95664D2, 0x9614, 0x4F35, {0xA7, 0x46, 0xDE, 0x8D, 0xB6, 0x36, 0x17, 0xE6}};
+static const IID IID_MT32EMU_IAudioClient = {0x1CB9AD4C, 0xDBFA, 0x4C32, {0xB1, 0x78, 0xC2, 0xF5, 0x68, 0xA7, 0x03, 0xB2}};
+static const IID IID_MT32EMU_IAudioRenderClient = {0xF294ACFC, 0x3146, 0x4483, {0xA7, 0xBF, 0xAD, 0xDC, 0xA7, 0xC2, 0x60, 0xE2}};
+static const IID IID_MT32EMU_IAudioClock = {0xCD63314F, 0x3FBA, 0x4A1B, {0x81, 0x2C, 0xEF, 0x96, 0x35, 0x87, 0x28, 0xE7}};
+static const PROPERTYKEY PKEY_MT32EMU_Device_FriendlyName = {{0xA45C254E, 0xDF1C, 0x4EFD, {0x80, 0x20, 0x67, 0xD1, 0x46, 0xA8, 0x50, 0xE0}}, 14};
+
+#ifndef AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM
+#define AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM 0x80000000
+#endif
+#ifndef AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY
+#define AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY 0x08000000
+#endif
+
+template <class T>
+static void safeRelease(T *&object) {
+	if (object != NULL) {
+		object->Release();
+		object = NULL;
+	}
+}
+
+static IMMDevice *openEndpoint(const QString &endpointId) {
+	IMMDeviceEnumerator *enumerator = NULL;
+	if (FAILED(CoCreateInstance(CLSID_MT32EMU_MMDeviceEnumerator, NULL, CLSCTX_ALL, IID_MT32EMU_IMMDeviceEnumerator, (void **)&enumerator))) {
+		qDebug() << "WASAPIAudioDriver: Failed to create device enumerator";
+		return NULL;
+	}
+	IMMDevice *device = NULL;
+	HRESULT hr;
+	if (endpointId.isEmpty()) {
+		hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &device);
+	} else {
+		hr = enumerator->GetDevice((LPCWSTR)endpointId.utf16(), &device);
+	}
+	enumerator->Release();
+	if (FAILED(hr)) {
+		qDebug() << "WASAPIAudioDriver: Failed to open endpoint" << endpointId << "error:" << QString::number(uint(hr), 16);
+		return NULL;
+	}
+	return device;
+}
+
+WASAPIAudioStream::WASAPIAudioStream(const AudioDriverSettings &useSettings, SynthRoute &useSynthRoute, const uint useSampleRate, const QString &useEndpointId, bool useExclusiveMode) :
+	AudioStream(useSettings, useSynthRoute, useSampleRate),
+	audioClient(NULL), renderClient(NULL), audioClock(NULL), clockFrequency(0), hEvent(NULL), endpointId(useEndpointId),
+	exclusiveMode(useExclusiveMode), bufferFrames(0), stopProcessing(false), startSucceeded(false), processor(*this)
+{}
+
+WASAPIAudioStream::~WASAPIAudioStream() {
+	close();
+}
+
+bool WASAPIAudioStream::initAudioClient() {
+	IMMDevice *device = openEndpoint(endpointId);
+	if (device == NULL) return false;
+
+	WAVEFORMATEX format;
+	format.wFormatTag = WAVE_FORMAT_PCM;
+	format.nChannels = 2;
+	format.nSamplesPerSec = sampleRate;
+	format.nAvgBytesPerSec = sampleRate * FRAME_SIZE;
+	format.nBlockAlign = FRAME_SIZE;
+	format.wBitsPerSample = 16;
+	format.cbSize = 0;
+
+	HRESULT hr = device->Activate(IID_MT32EMU_IAudioClient, CLSCTX_ALL, NULL, (void **)&audioClient);
+	if (SUCCEEDED(hr)) {
+		if (exclusiveMode) {
+			REFERENCE_TIME defaultPeriod, minPeriod;
+			hr = audioClient->GetDevicePeriod(&defaultPeriod, &minPeriod);
+			REFERENCE_TIME period = qMax(minPeriod, REFERENCE_TIME(settings.chunkLen) * REFTIMES_PER_SECOND / MasterClock::MILLIS_PER_SECOND);
+			if (SUCCEEDED(hr)) {
+				hr = audioClient->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK | AUDCLNT_STREAMFLAGS_NOPERSIST,
+					period, period, &format, NULL);
+			}
+			if (hr == AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED) {
+				// The client has to be recreated with the period matching the aligned buffer size
+				UINT32 alignedFrames;
+				hr = audioClient->GetBufferSize(&alignedFrames);
+				safeRelease(audioClient);
+				if (SUCCEEDED(hr)) {
+					period = REFERENCE_TIME((double)REFTIMES_PER_SECOND * alignedFrames / sampleRate + 0.5);
+					hr = device->Activate(IID_MT32EMU_IAudioClient, CLSCTX_ALL, NULL, (void **)&audioClient);
+				}
+				if (SUCCEEDED(hr)) {
+					hr = audioClient->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK | AUDCLNT_STREAMFLAGS_NOPERSIST,
+						period, period, &format, NULL);
+				}
+			}
+		} else {
+			REFERENCE_TIME duration = REFERENCE_TIME(settings.audioLatency) * REFTIMES_PER_SECOND / MasterClock::MILLIS_PER_SECOND;
+			hr = audioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK | AUDCLNT_STREAMFLAGS_NOPERSIST
+				| AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM | AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY, duration, 0, &format, NULL);
+		}
+	}
+	device->Release();
+	if (FAILED(hr)) {
+		qDebug() << "WASAPIAudioDriver: Failed to initialise audio client, error:" << QString::number(uint(hr), 16);
+		return false;
+	}
+	hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (hEvent == NULL || FAILED(audioClient->SetEventHandle(hEvent)) || FAILED(audioClient->GetBufferSize(&bufferFrames))
+		|| FAILED(audioClient->GetService(IID_MT32EMU_IAudioRenderClient, (void **)&renderClient))) {
+		qDebug() << "WASAPIAudioDriver: Failed to set up audio client";
+		return false;
+	}
+	if (settings.advancedTiming && (FAILED(audioClient->GetService(IID_MT32EMU_IAudioClock, (void **)&audioClock))
+		|| FAILED(audioClock->GetFrequency(&clockFrequency)) || clockFrequency == 0)) {
+		qDebug() << "WASAPIAudioDriver: Audio clock is unavailable";
+		safeRelease(audioClock);
+	}
+
+	// In the exclusive mode, another period is being played while the buffer is rendered
+	audioLatencyFrames = exclusiveMode ? 2 * bufferFrames : bufferFrames;
+	if (isAutoLatencyMode()) midiLatencyFrames = audioLatencyFrames + ((DEFAULT_MIDI_LATENCY * sampleRate) / MasterClock::MILLIS_PER_SECOND);
+	qDebug() << "WASAPIAudioDriver: Using" << (exclusiveMode ? "exclusive" : "shared") << "mode, buffer size:" << bufferFrames << "frames, MIDI latency:" << midiLatencyFrames << "frames";
+	return true;
+}
+
+void WASAPIAudioStream::releaseAudioClient() {
+	if (audioClient != NULL) audioClient->Stop();
+	safeRelease(audioClock);
+	safeRelease(renderClient);
+	safeRelease(audioClient);
+	if (hEvent != NULL) {
+		CloseHandle(hEvent);
+		hEvent = NULL;
+	}
+}
+
+// Renders straight into the endpoint buffer
+bool WASAPIAudioStream::renderFrames(quint32 frameCount, quint32 framesInAudioBuffer) {
+	BYTE *data;
+	if (FAILED(renderClient->GetBuffer(frameCount, &data))) return false;
+	if (isRenderAheadEnabled()) {
+		readRenderedFrames((Bit16s *)data, frameCount, framesInAudioBuffer);
+	} else {
+		updateTimeInfo(MasterClock::getClockNanos(), framesInAudioBuffer);
+		synthRoute.render((Bit16s *)data, frameCount);
+		framesRendered(frameCount);
+	}
+	return SUCCEEDED(renderClient->ReleaseBuffer(frameCount, 0));
+}
+
+void WASAPIAudioStream::processingLoop() {
+	// Pre-fill the buffer before starting, as recommended
+	if (!renderFrames(bufferFrames, 0) || FAILED(audioClient->Start())) {
+		qDebug() << "WASAPIAudioDriver: Failed to start audio client";
+		return;
+	}
+	startSucceeded = true;
+	startSemaphore.release();
+
+	while (!stopProcessing) {
+		if (WaitForSingleObject(hEvent, EVENT_TIMEOUT_MS) != WAIT_OBJECT_0) {
+			qDebug() << "WASAPIAudioDriver: Buffer event timed out, thread stopped";
+			break;
+		}
+		quint32 frameCount = bufferFrames;
+		quint32 framesInAudioBuffer = bufferFrames;
+		if (exclusiveMode) {
+			UINT64 position;
+			if (audioClock != NULL && SUCCEEDED(audioClock->GetPosition(&position, NULL))) {
+				quint64 playedFramesCount = position * sampleRate / clockFrequency;
+				quint64 outputFramesCount = getOutputFramesCount();
+				if (playedFramesCount < outputFramesCount) framesInAudioBuffer = quint32(outputFramesCount - playedFramesCount);
+			}
+		} else {
+			UINT32 padding;
+			if (FAILED(audioClient->GetCurrentPadding(&padding))) {
+				qDebug() << "WASAPIAudioDriver: GetCurrentPadding failed, thread stopped";
+				break;
+			}
+			frameCount = bufferFrames - padding;
+			framesInAudioBuffer = padding;
+			if (frameCount == 0) continue;
+		}
+		if (!renderFrames(frameCount, framesInAudioBuffer)) {
+			qDebug() << "WASAPIAudioDriver: Failed to render into endpoint buffer, thread stopped";
+			break;
+		}
+	}
+	if (!stopProcessing) {
+		stopProcessing = true;
+		synthRoute.audioStreamFailed();
+	}
+}
+
+WASAPIAudioProcessor::WASAPIAudioProcessor(WASAPIAudioStream &useStream) : stream(useStream) {}
+
+void WASAPIAudioProcessor::run() {
+	ThreadPolicyScope threadPolicyScope(stream.settings.threadPolicy, "WASAPIAudioDriver", stream.getChunkNanos());
+	HRESULT comInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	if (stream.initAudioClient()) {
+		stream.startRenderAhead(stream.exclusiveMode ? stream.bufferFrames : stream.bufferFrames / 2);
+		stream.processingLoop();
+	}
+	if (!stream.startSucceeded) stream.startSemaphore.release();
+	stream.releaseAudioClient();
+	if (SUCCEEDED(comInit)) CoUninitialize();
+}
+
+bool WASAPIAudioStream::start() {
+	stopProcessing = false;
+	startSucceeded = false;
+	processor.start(QThread::TimeCriticalPriority);
+	startSemaphore.acquire();
+	if (!startSucceeded) {
+		processor.wait();
+		stopRenderAhead();
+	}
+	return startSucceeded;
+}
+
+void WASAPIAudioStream::close() {
+	if (processor.isRunning()) {
+		qDebug() << "WASAPIAudioDriver: Stopping processing thread";
+		stopProcessing = true;
+		processor.wait();
+		qDebug() << "WASAPIAudioDriver: Processing thread stopped";
+	}
+	stopRenderAhead();
+}
+
+WASAPIAudioDevice::WASAPIAudioDevice(WASAPIAudioDriver &driver, const QString &useEndpointId, bool useExclusiveMode, QString useDeviceName) :
+	AudioDevice(driver, useDeviceName), endpointId(useEndpointId), exclusiveMode(useExclusiveMode) {
+}
+
+AudioStream *WASAPIAudioDevice::startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const {
+	WASAPIAudioStream *stream = new WASAPIAudioStream(driver.getAudioSettings(), synthRoute, sampleRate, endpointId, exclusiveMode);
+	if (stream->start()) {
+		return stream;
+	}
+	delete stream;
+	return NULL;
+}
+
+WASAPIAudioDriver::WASAPIAudioDriver(Master *master) : AudioDriver("wasapi", "WASAPI") {
+	Q_UNUSED(master);
+
+	loadAudioSettings();
+}
+
+const QList<const AudioDevice *> WASAPIAudioDriver::createDeviceList() {
+	QList<const AudioDevice *> deviceList;
+	// The devices may be enumerated in a worker thread, where COM isn't initialised otherwise.
+	HRESULT comInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	IMMDeviceEnumerator *enumerator = NULL;
+	if (FAILED(CoCreateInstance(CLSID_MT32EMU_MMDeviceEnumerator, NULL, CLSCTX_ALL, IID_MT32EMU_IMMDeviceEnumerator, (void **)&enumerator))) {
+		qDebug() << "WASAPIAudioDriver: WASAPI is unavailable";
+		if (SUCCEEDED(comInit)) CoUninitialize();
+		return deviceList;
+	}
+	deviceList.append(new WASAPIAudioDevice(*this, QString(), false, "Default device"));
+	deviceList.append(new WASAPIAudioDevice(*this, QString(), true, "Default device (exclusive mode)"));
+
+	IMMDeviceCollection *collection = NULL;
+	UINT deviceCount = 0;
+	if (FAILED(enumerator->EnumAudioEndpoints(eRender, DEVICE_STATE_ACTIVE, &collection)) || FAILED(collection->GetCount(&deviceCount))) {
+		deviceCount = 0;
+	}
+	for (UINT deviceIndex = 0; deviceIndex < deviceCount; deviceIndex++) {
+		IMMDevice *device = NULL;
+		LPWSTR endpointId = NULL;
+		IPropertyStore *properties = NULL;
+		if (SUCCEEDED(collection->Item(deviceIndex, &device)) && SUCCEEDED(device->GetId(&endpointId))
+			&& SUCCEEDED(device->OpenPropertyStore(STGM_READ, &properties))) {
+			PROPVARIANT friendlyName;
+			PropVariantInit(&friendlyName);
+			if (SUCCEEDED(properties->GetValue(PKEY_MT32EMU_Device_FriendlyName, &friendlyName)) && friendlyName.vt == VT_LPWSTR) {
+				QString id = QString::fromWCharArray(endpointId);
+				QString name = QString::fromWCharArray(friendlyName.pwszVal);
+				deviceList.append(new WASAPIAudioDevice(*this, id, false, name));
+				deviceList.append(new WASAPIAudioDevice(*this, id, true, name + " (exclusive mode)"));
+			}
+			PropVariantClear(&friendlyName);
+		} else {
+			qDebug() << "WASAPIAudioDriver: Failed to get endpoint properties for" << deviceIndex;
+		}
+		safeRelease(properties);
+		CoTaskMemFree(endpointId);
+		safeRelease(device);
+	}
+	safeRelease(collection);
+	enumerator->Release();
+	if (SUCCEEDED(comInit)) CoUninitialize();
+	return deviceList;
+}
+
+void WASAPIAudioDriver::validateAudioSettings(AudioDriverSettings &useSettings) const {
+	if (useSettings.audioLatency == 0) {
+		useSettings.audioLatency = DEFAULT_AUDIO_LATENCY;
+	}
+	if (useSettings.chunkLen == 0) {
+		useSettings.chunkLen = DEFAULT_CHUNK_MS;
+	}
+	if (useSettings.audioLatency < useSettings.chunkLen) {
+		useSettings.chunkLen = useSettings.audioLatency;
+	}
+	if ((useSettings.midiLatency != 0) && (useSettings.midiLatency < useSettings.chunkLen)) {
+		useSettings.midiLatency = useSettings.chunkLen;
+	}
+}
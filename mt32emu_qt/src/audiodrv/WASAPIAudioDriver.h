@@ -0,0 +1,83 @@
+#ifndef WASAPI_AUDIO_DRIVER_H
+#define WASAPI_AUDIO_DRIVER_H
+
+#include <QtCore>
+#include <windows.h>
+#include <mt32emu/mt32emu.h>
+#include "AudioDriver.h"
+#include "../MasterClock.h"
+
+struct IAudioClient;
+struct IAudioRenderClient;
+struct IAudioClock;
+
+class Master;
+class SynthRoute;
+class WASAPIAudioDriver;
+class WASAPIAudioDevice;
+class WASAPIAudioStream;
+
+class WASAPIAudioProcessor : public QThread {
+public:
+	WASAPIAudioProcessor(WASAPIAudioStream &stream);
+
+protected:
+	void run();
+
+private:
+	WASAPIAudioStream &stream;
+};
+
+// Event-driven WASAPI stream. In the shared mode, the engine converts the format as necessary and the buffer
+// is as long as the audio latency setting. In the exclusive mode, the synth renders in the device format directly,
+// the device period is derived from the chunk length and the buffer holds a single period, played in turn with
+// the one being filled. With advanced timing, the device clock gives the amount of audio buffered in the exclusive mode.
+// The audio client is set up and driven entirely in the processing thread.
+class WASAPIAudioStream : public AudioStream {
+	friend class WASAPIAudioProcessor;
+private:
+	IAudioClient *audioClient;
+	IAudioRenderClient *renderClient;
+	IAudioClock *audioClock;
+	quint64 clockFrequency;
+	HANDLE hEvent;
+
+	const QString endpointId;
+	const bool exclusiveMode;
+	quint32 bufferFrames;
+	bool volatile stopProcessing;
+	bool startSucceeded;
+	QSemaphore startSemaphore;
+	WASAPIAudioProcessor processor;
+
+	bool initAudioClient();
+	void releaseAudioClient();
+	bool renderFrames(quint32 frameCount, quint32 framesInAudioBuffer);
+	void processingLoop();
+
+public:
+	WASAPIAudioStream(const AudioDriverSettings &useSettings, SynthRoute &synthRoute, uint useSampleRate, const QString &useEndpointId, bool useExclusiveMode);
+	~WASAPIAudioStream();
+	bool start();
+	void close();
+};
+
+class WASAPIAudioDevice : public AudioDevice {
+friend class WASAPIAudioDriver;
+private:
+	const QString endpointId;
+	const bool exclusiveMode;
+	WASAPIAudioDevice(WASAPIAudioDriver &driver, const QString &useEndpointId, bool useExclusiveMode, QString useDeviceName);
+public:
+	AudioStream *startAudioStream(SynthRoute &synthRoute, const uint sampleRate) const;
+};
+
+class WASAPIAudioDriver : public AudioDriver {
+private:
+	void validateAudioSettings(AudioDriverSettings &useSettings) const;
+public:
+	WASAPIAudioDriver(Master *useMaster);
+	const QList<const AudioDevice *> createDeviceList();
+};
+
+#endif
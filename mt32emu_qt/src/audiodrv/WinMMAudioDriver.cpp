@@ -97,6 +97,7 @@ DWORD WinMMAudioStream::getCurrentPlayPosition() {
 WinMMAudioProcessor::WinMMAudioProcessor(WinMMAudioStream &stream) : stream(stream) {}
 
 void WinMMAudioProcessor::run() {
+	ThreadPolicyScope threadPolicyScope(stream.settings.threadPolicy, "WinMMAudioDriver", stream.getChunkNanos());
 	const double samplePeriod = (double)MasterClock::NANOS_PER_SECOND / (double)stream.sampleRate;
 	while (!stream.stopProcessing) {
 		const DWORD playCursor = stream.getCurrentPlayPosition();
@@ -17,8 +17,11 @@
 #include "ALSADriver.h"
 
 #include <cstdlib>
+#include <cerrno>
 #include <poll.h>
 #include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <QtCore>
 
 #include "../MasterClock.h"
@@ -37,23 +40,24 @@ void ALSAMidiDriver::processSeqEvents() {
 	int pollFDCount;
 	struct pollfd *pollFDs;
 
+	// The last descriptor is the eventfd that stop() signals, so that no timeout is needed to notice stopProcessing.
 	pollFDCount = snd_seq_poll_descriptors_count(snd_seq, POLLIN);
-	pollFDs = (struct pollfd *)malloc(pollFDCount * sizeof(struct pollfd));
+	pollFDs = (struct pollfd *)malloc((pollFDCount + 1) * sizeof(struct pollfd));
 	snd_seq_poll_descriptors(snd_seq, pollFDs, pollFDCount, POLLIN);
-	for (;;) {
-		// 200ms poll() timeout means that stopProcessing may take approximately this long to be noticed.
-		// FIXME: Polling with a timeout is lame.
-		int pollEventCount = poll(pollFDs, pollFDCount, 200);
+	pollFDs[pollFDCount].fd = wakeupFD;
+	pollFDs[pollFDCount].events = POLLIN;
+	pollFDs[pollFDCount].revents = 0;
+	bool exitRequested = false;
+	while (!exitRequested) {
+		int pollEventCount = poll(pollFDs, pollFDCount + 1, -1);
 		if (pollEventCount < 0) {
+			if (errno == EINTR) continue;
 			qDebug() << "ALSAMidiDriver: poll() returned " << pollEventCount << ", errno=" << errno;
 			break;
 		}
 		if (stopProcessing) {
 			break;
 		}
-		if (pollEventCount == 0) {
-			continue;
-		}
 		unsigned short revents = 0;
 		int err = snd_seq_poll_descriptors_revents(snd_seq, pollFDs, pollFDCount, &revents);
 		if (err < 0) {
@@ -67,16 +71,20 @@ void ALSAMidiDriver::processSeqEvents() {
 		if ((revents & POLLIN) == 0) {
 			continue;
 		}
-		snd_seq_event_t *seq_event = NULL;
-		do {
+		// The events are stamped by the queue when they arrive, so they are mapped to the master clock relative
+		// to the current queue time. Reading both clocks once per wakeup is enough, since the whole batch is drained at once.
+		MasterClockNanos nowNanos = MasterClock::getClockNanos();
+		MasterClockNanos queueNanos = getQueueNanos();
+		// The sequencer is non-blocking, so all the pending events are read until it reports -EAGAIN.
+		for (;;) {
+			snd_seq_event_t *seq_event = NULL;
 			int status = snd_seq_event_input(snd_seq, &seq_event);
 			if (status < 0) {
-				switch (status) {
-				case -EAGAIN:
-				case -ENOSPC:
+				if (status == -ENOSPC) {
+					qDebug() << "ALSAMidiDriver: Input queue overrun, events lost";
 					continue;
 				}
-				qDebug() << "ALSAMidiDriver: Status: " << status;
+				if (status != -EAGAIN) qDebug() << "ALSAMidiDriver: Status: " << status;
 				break;
 			}
 			unsigned int clientAddr = getSourceAddr(seq_event);
@@ -92,12 +100,21 @@ void ALSAMidiDriver::processSeqEvents() {
 				showBalloon("Connected application:", appName);
 				qDebug() << "ALSAMidiDriver: Connected application" << appName;
 			}
-			if (processSeqEvent(seq_event, midiSession)) {
+			MasterClockNanos eventNanos = nowNanos;
+			if (queueNanos >= 0 && (seq_event->flags & SND_SEQ_TIME_STAMP_MASK) == SND_SEQ_TIME_STAMP_REAL) {
+				eventNanos += realTimeToNanos(seq_event->time.time) - queueNanos;
+			}
+			if (processSeqEvent(seq_event, midiSession, eventNanos)) {
+				exitRequested = true;
 				break;
 			}
-		} while (!stopProcessing && snd_seq_event_input_pending(snd_seq, 1));
+		}
 	}
 	free(pollFDs);
+	if (seqQueue >= 0) {
+		snd_seq_free_queue(snd_seq, seqQueue);
+		seqQueue = -1;
+	}
 	snd_seq_close(snd_seq);
 	qDebug() << "ALSAMidiDriver: MIDI processing loop finished";
 
@@ -134,7 +151,19 @@ MidiSession *ALSAMidiDriver::findMidiSessionForClient(unsigned int clientAddr) {
 	return midiSessions.at(i);
 }
 
-bool ALSAMidiDriver::processSeqEvent(snd_seq_event_t *seq_event, MidiSession *midiSession) {
+MasterClockNanos ALSAMidiDriver::getQueueNanos() {
+	if (seqQueue < 0) return -1;
+	snd_seq_queue_status_t *queueStatus;
+	snd_seq_queue_status_alloca(&queueStatus);
+	if (snd_seq_get_queue_status(snd_seq, seqQueue, queueStatus) < 0) return -1;
+	return realTimeToNanos(*snd_seq_queue_status_get_real_time(queueStatus));
+}
+
+MasterClockNanos ALSAMidiDriver::realTimeToNanos(const snd_seq_real_time_t &realTime) {
+	return MasterClockNanos(realTime.tv_sec) * MasterClock::NANOS_PER_SECOND + realTime.tv_nsec;
+}
+
+bool ALSAMidiDriver::processSeqEvent(snd_seq_event_t *seq_event, MidiSession *midiSession, MasterClockNanos eventNanos) {
 	SynthRoute *synthRoute = midiSession->getSynthRoute();
 	MT32Emu::Bit32u msg = 0;
 	switch(seq_event->type) {
@@ -143,7 +172,7 @@ bool ALSAMidiDriver::processSeqEvent(snd_seq_event_t *seq_event, MidiSession *mi
 		msg |= seq_event->data.note.channel;
 		msg |= seq_event->data.note.note << 8;
 		msg |= seq_event->data.note.velocity << 16;
-		synthRoute->pushMIDIShortMessage(*midiSession, msg, MasterClock::getClockNanos());
+		synthRoute->pushMIDIShortMessage(*midiSession, msg, eventNanos);
 		break;
 
 	case SND_SEQ_EVENT_NOTEOFF:
@@ -151,7 +180,7 @@ bool ALSAMidiDriver::processSeqEvent(snd_seq_event_t *seq_event, MidiSession *mi
 		msg |= seq_event->data.note.channel;
 		msg |= seq_event->data.note.note << 8;
 		msg |= seq_event->data.note.velocity << 16;
-		synthRoute->pushMIDIShortMessage(*midiSession, msg, MasterClock::getClockNanos());
+		synthRoute->pushMIDIShortMessage(*midiSession, msg, eventNanos);
 		break;
 
 	case SND_SEQ_EVENT_CONTROLLER:
@@ -159,7 +188,7 @@ bool ALSAMidiDriver::processSeqEvent(snd_seq_event_t *seq_event, MidiSession *mi
 		msg |= seq_event->data.control.channel;
 		msg |= seq_event->data.control.param << 8;
 		msg |= seq_event->data.control.value << 16;
-		synthRoute->pushMIDIShortMessage(*midiSession, msg, MasterClock::getClockNanos());
+		synthRoute->pushMIDIShortMessage(*midiSession, msg, eventNanos);
 		break;
 
 	case SND_SEQ_EVENT_CONTROL14:
@@ -170,7 +199,7 @@ bool ALSAMidiDriver::processSeqEvent(snd_seq_event_t *seq_event, MidiSession *mi
 		msg |= seq_event->data.control.channel;
 		msg |= seq_event->data.control.param << 8;
 		msg |= (seq_event->data.control.value >> 7) << 16;
-		synthRoute->pushMIDIShortMessage(*midiSession, msg, MasterClock::getClockNanos());
+		synthRoute->pushMIDIShortMessage(*midiSession, msg, eventNanos);
 		break;
 
 	case SND_SEQ_EVENT_NONREGPARAM:
@@ -182,23 +211,23 @@ bool ALSAMidiDriver::processSeqEvent(snd_seq_event_t *seq_event, MidiSession *mi
 		if (seq_event->data.control.param != 0) break;
 		msg = 0x64B0;
 		msg |= seq_event->data.control.channel;
-		synthRoute->pushMIDIShortMessage(*midiSession, msg, MasterClock::getClockNanos());
+		synthRoute->pushMIDIShortMessage(*midiSession, msg, eventNanos);
 
 		msg &= 0xFF;
 		msg |= 0x6500;
-		synthRoute->pushMIDIShortMessage(*midiSession, msg, MasterClock::getClockNanos());
+		synthRoute->pushMIDIShortMessage(*midiSession, msg, eventNanos);
 
 		msg &= 0xFF;
 		msg |= 0x0600;
 		msg |= ((seq_event->data.control.value >> 7) & 0x7F) << 16;
-		synthRoute->pushMIDIShortMessage(*midiSession, msg, MasterClock::getClockNanos());
+		synthRoute->pushMIDIShortMessage(*midiSession, msg, eventNanos);
 		break;
 
 	case SND_SEQ_EVENT_PGMCHANGE:
 		msg = 0xC0;
 		msg |= seq_event->data.control.channel;
 		msg |= seq_event->data.control.value << 8;
-		synthRoute->pushMIDIShortMessage(*midiSession, msg, MasterClock::getClockNanos());
+		synthRoute->pushMIDIShortMessage(*midiSession, msg, eventNanos);
 		break;
 
 	case SND_SEQ_EVENT_PITCHBEND:
@@ -208,7 +237,7 @@ bool ALSAMidiDriver::processSeqEvent(snd_seq_event_t *seq_event, MidiSession *mi
 		bend = seq_event->data.control.value + 8192;
 		msg |= (bend & 0x7F) << 8;
 		msg |= ((bend >> 7) & 0x7F) << 16;
-		synthRoute->pushMIDIShortMessage(*midiSession, msg, MasterClock::getClockNanos());
+		synthRoute->pushMIDIShortMessage(*midiSession, msg, eventNanos);
 		break;
 
 	case SND_SEQ_EVENT_SYSEX: {
@@ -222,13 +251,13 @@ bool ALSAMidiDriver::processSeqEvent(snd_seq_event_t *seq_event, MidiSession *mi
 		bool hasSysexStart = sysexData[0] == MIDI_CMD_COMMON_SYSEX;
 		bool hasSysexEnd = sysexData[sysexLength - 1] == MIDI_CMD_COMMON_SYSEX_END;
 		if (hasSysexStart && hasSysexEnd) {
-			synthRoute->pushMIDISysex(*midiSession, sysexData, sysexLength, MasterClock::getClockNanos());
+			synthRoute->pushMIDISysex(*midiSession, sysexData, sysexLength, eventNanos);
 			break;
 		}
 		// OK, accumulate SysEx data received so far and commit when ready.
 		sysexBuffer.append(sysexData, sysexLength);
 		if (hasSysexEnd) {
-			synthRoute->pushMIDISysex(*midiSession, sysexBuffer.constData(), sysexBuffer.size(), MasterClock::getClockNanos());
+			synthRoute->pushMIDISysex(*midiSession, sysexBuffer.constData(), sysexBuffer.size(), eventNanos);
 			sysexBuffer.clear();
 		}
 		break;
@@ -276,40 +305,70 @@ int ALSAMidiDriver::alsa_setup_midi() {
 	}
 
 	snd_seq_set_client_name(snd_seq, "Munt MT-32");
-	seqPort = snd_seq_create_simple_port(
-		snd_seq,
-		"Standard",
-		SND_SEQ_PORT_CAP_SUBS_WRITE |
-		SND_SEQ_PORT_CAP_WRITE,
-		SND_SEQ_PORT_TYPE_MIDI_GENERIC |
-		SND_SEQ_PORT_TYPE_MIDI_MT32 |
-		SND_SEQ_PORT_TYPE_SYNTHESIZER
-	);
-	if (seqPort < 0) {
+	snd_seq_nonblock(snd_seq, 1);
+
+	// The events are stamped with the real time of a dedicated queue on arrival, so that the timing survives the batching.
+	// Without the queue, the events are simply stamped with the time they are read.
+	seqQueue = snd_seq_alloc_named_queue(snd_seq, "Munt MT-32");
+	if (seqQueue < 0) {
+		qDebug() << "ALSAMidiDriver: Error allocating sequencer queue, timestamping disabled";
+	}
+
+	snd_seq_port_info_t *portInfo;
+	snd_seq_port_info_alloca(&portInfo);
+	snd_seq_port_info_set_name(portInfo, "Standard");
+	snd_seq_port_info_set_capability(portInfo, SND_SEQ_PORT_CAP_SUBS_WRITE | SND_SEQ_PORT_CAP_WRITE);
+	snd_seq_port_info_set_type(portInfo, SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_MIDI_MT32 | SND_SEQ_PORT_TYPE_SYNTHESIZER);
+	snd_seq_port_info_set_midi_channels(portInfo, 16);
+	if (seqQueue >= 0) {
+		snd_seq_port_info_set_timestamping(portInfo, 1);
+		snd_seq_port_info_set_timestamp_real(portInfo, 1);
+		snd_seq_port_info_set_timestamp_queue(portInfo, seqQueue);
+	}
+	if (snd_seq_create_port(snd_seq, portInfo) < 0) {
 		qDebug() << "ALSAMidiDriver: Error creating sequencer port";
+		if (seqQueue >= 0) snd_seq_free_queue(snd_seq, seqQueue);
+		seqQueue = -1;
+		snd_seq_close(snd_seq);
 		return -1;
 	}
+	seqPort = snd_seq_port_info_get_port(portInfo);
+
+	if (seqQueue >= 0) {
+		snd_seq_start_queue(snd_seq, seqQueue, NULL);
+		snd_seq_drain_output(snd_seq);
+	}
 	QString midiPortStr = QString().setNum(snd_seq_client_id(snd_seq)) + ":0";
 	qDebug() << "MT-32 emulator ALSA address is:" << midiPortStr;
 	emit mainWindowTitleContributionUpdated("ALSA MIDI Port " + midiPortStr);
 	return seqPort;
 }
 
-ALSAMidiDriver::ALSAMidiDriver(Master *useMaster) : MidiDriver(useMaster), processingThreadID(0), rawMidiPortDriver(useMaster) {}
+ALSAMidiDriver::ALSAMidiDriver(Master *useMaster) : MidiDriver(useMaster), seqQueue(-1), processingThreadID(0), rawMidiPortDriver(useMaster) {
+	wakeupFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeupFD < 0) qDebug() << "ALSAMidiDriver: eventfd() failed, errno=" << errno;
+}
 
 ALSAMidiDriver::~ALSAMidiDriver() {
 	stop();
+	if (wakeupFD >= 0) close(wakeupFD);
 }
 
 void ALSAMidiDriver::start() {
 	rawMidiPortDriver.start();
 	connect(this, SIGNAL(mainWindowTitleContributionUpdated(const QString &)), master, SLOT(updateMainWindowTitleContribution(const QString &)));
+	if (wakeupFD < 0) return;
 	if (alsa_setup_midi() < 0) return;
+	// Reset a wakeup left pending by a stop() that raced with the thread exiting on its own.
+	eventfd_t pendingWakeups;
+	eventfd_read(wakeupFD, &pendingWakeups);
 	stopProcessing = false;
 	int error = pthread_create(&processingThreadID, NULL, processingThread, this);
 	if (error != 0) {
 		processingThreadID = 0;
 		qDebug() << "ALSAMidiDriver: Processing Thread creation failed:" << error;
+		if (seqQueue >= 0) snd_seq_free_queue(snd_seq, seqQueue);
+		seqQueue = -1;
 		snd_seq_close(snd_seq);
 	}
 }
@@ -319,6 +378,7 @@ void ALSAMidiDriver::stop() {
 	if (processingThreadID == 0) return;
 	qDebug() << "ALSAMidiDriver: Stopping MIDI processing loop...";
 	stopProcessing = true;
+	eventfd_write(wakeupFD, 1);
 	pthread_join(processingThreadID, NULL);
 	processingThreadID = 0;
 }
@@ -4,6 +4,7 @@
 #include <alsa/asoundlib.h>
 
 #include "OSSMidiPortDriver.h"
+#include "../MasterClock.h"
 
 class ALSAMidiDriver : public MidiDriver {
 	Q_OBJECT
@@ -22,6 +23,10 @@ public:
 
 private:
 	snd_seq_t *snd_seq;
+	// The queue that the incoming events are stamped with real time from, -1 if not allocated.
+	int seqQueue;
+	// Signalled to wake up the processing thread when it needs to stop.
+	int wakeupFD;
 	pthread_t processingThreadID;
 	volatile bool stopProcessing;
 	QList<unsigned int> clients;
@@ -31,7 +36,9 @@ private:
 	static void *processingThread(void *userData);
 	int alsa_setup_midi();
 	void processSeqEvents();
-	bool processSeqEvent(snd_seq_event_t *seq_event, MidiSession *midiSession);
+	MasterClockNanos getQueueNanos();
+	static MasterClockNanos realTimeToNanos(const snd_seq_real_time_t &realTime);
+	bool processSeqEvent(snd_seq_event_t *seq_event, MidiSession *midiSession, MasterClockNanos eventNanos);
 	unsigned int getSourceAddr(snd_seq_event_t *seq_event);
 	QString getClientName(unsigned int clientAddr);
 	MidiSession *findMidiSessionForClient(unsigned int clientAddr);
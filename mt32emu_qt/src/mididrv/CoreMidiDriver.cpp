@@ -16,12 +16,24 @@
 
 #include <QtGlobal>
 
+#include <mach/mach_time.h>
+
 #include "CoreMidiDriver.h"
 #include "../MasterClock.h"
 #include "../MidiPropertiesDialog.h"
 
 static CoreMidiDriver *driver;
 
+static mach_timebase_info_data_t hostTimebase;
+
+// Maps the host time of a packet to the master clock relative to the current time. Zero means the packet is to be played now.
+// The difference is converted rather than the absolute host time, so that it can't overflow.
+static MasterClockNanos hostTimeToClockNanos(MIDITimeStamp hostTime, MIDITimeStamp nowHostTime, MasterClockNanos nowNanos) {
+	if (hostTime == 0 || hostTimebase.denom == 0) return nowNanos;
+	qint64 hostTicks = qint64(hostTime - nowHostTime);
+	return nowNanos + hostTicks * hostTimebase.numer / hostTimebase.denom;
+}
+
 void CoreMidiDriver::readProc(const MIDIPacketList *packetList, void *readProcRefCon, void *srcConnRefCon) {
 Q_UNUSED(srcConnRefCon)
 
@@ -30,12 +42,15 @@ Q_UNUSED(srcConnRefCon)
 		data->midiSession = driver->createMidiSession(data->sessionID);
 	}
 	QMidiStreamParser &qMidiStreamParser = *data->midiSession->getQMidiStreamParser();
-	qMidiStreamParser.setTimestamp(MasterClock::getClockNanos());
+	// The packets sent by sequencers are typically scheduled ahead, so each one is stamped with its own host time.
+	MasterClockNanos nowNanos = MasterClock::getClockNanos();
+	MIDITimeStamp nowHostTime = mach_absolute_time();
 	MIDIPacket const *packet = &packetList->packet[0];
 	UInt32 numPackets = packetList->numPackets;
 	while (numPackets > 0) {
 		UInt32 packetLen = packet->length;
 		if (packetLen > 0) {
+			qMidiStreamParser.setTimestamp(hostTimeToClockNanos(packet->timeStamp, nowHostTime, nowNanos));
 			qMidiStreamParser.parseStream(packet->data, packetLen);
 		}
 		packet = MIDIPacketNext(packet);
@@ -60,6 +75,10 @@ CoreMidiDriver::CoreMidiDriver(Master *useMaster) : MidiDriver(useMaster) {
 	master = useMaster;
 	name = "CoreMidi";
 	driver = this;
+	if (mach_timebase_info(&hostTimebase) != KERN_SUCCESS) {
+		qDebug() << "Core MIDI Driver: Unable to get host timebase, packet timestamps ignored";
+		hostTimebase.denom = 0;
+	}
 	qDebug() << "Core MIDI Driver started";
 }
 
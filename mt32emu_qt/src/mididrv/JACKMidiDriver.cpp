@@ -19,6 +19,7 @@
 #include <QtCore>
 
 #include "../MasterClock.h"
+#include "../MidiRecorder.h"
 #include "../MidiSession.h"
 #include "../JACKClient.h"
 
@@ -55,6 +56,15 @@ bool JACKMidiDriver::playMIDIMessage(MidiSession *midiSession, quint64 eventTime
 	return synthRoute->playMIDIShortMessage(*midiSession, message, eventTimestamp);
 }
 
+void JACKMidiDriver::recordMIDIMessage(MidiSession *midiSession, MasterClockNanos eventTimestamp, size_t midiBufferSize, uchar *midiBuffer) {
+	MidiRecorder *recorder = midiSession->getSynthRoute()->getMidiRecorder();
+	if (*midiBuffer == 0xF0) {
+		recorder->recordSysex(midiBuffer, quint32(midiBufferSize), eventTimestamp);
+	} else {
+		recorder->recordShortMessage(midiBufferToShortMessage(midiBufferSize, midiBuffer), eventTimestamp);
+	}
+}
+
 JACKMidiDriver::JACKMidiDriver(Master *master) : MidiDriver(master) {
 	name = "JACK MIDI Driver";
 	disconnect(SIGNAL(midiSessionInitiated(MidiSession **, MidiDriver *, QString)));
@@ -105,7 +115,7 @@ bool JACKMidiDriver::createJACKPort(bool exclusive) {
 	}
 	MidiSession *midiSession = createMidiSession(portName);
 	JACKClient *jackClient = new JACKClient;
-	JACKClientState state = jackClient->open(midiSession, NULL);
+	JACKClientState state = jackClient->open(midiSession);
 	if (JACKClientState_OPEN == state) {
 		jackClients.append(jackClient);
 		if (jackClient->isRealtimeProcessing()) {
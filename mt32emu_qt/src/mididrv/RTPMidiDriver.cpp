@@ -0,0 +1,380 @@
+/* Copyright (C) 2011-2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore>
+#include <QUdpSocket>
+
+#include "RTPMidiDriver.h"
+
+#include "../MidiSession.h"
+
+static const char LOCAL_SESSION_NAME[] = "mt32emu-qt";
+static const quint32 APPLEMIDI_PROTOCOL_VERSION = 2;
+static const uchar RTP_MIDI_PAYLOAD_TYPE = 0x61;
+// AppleMIDI peers count the RTP timestamps in units of 100 microseconds.
+static const MasterClockNanos NANOS_PER_RTP_TICK = 100 * MasterClock::NANOS_PER_MICROSECOND;
+
+// The jitter buffer delays the events by the recent peak of the transit time excess, within these bounds.
+static const MasterClockNanos MIN_JITTER_DELAY = 1 * MasterClock::NANOS_PER_MILLISECOND;
+static const MasterClockNanos MAX_JITTER_DELAY = 30 * MasterClock::NANOS_PER_MILLISECOND;
+// The peak decays by 1/64 with each packet, so that the delay shrinks again once the network calms down.
+static const int JITTER_DECAY_SHIFT = 6;
+// The least transit time creeps up by 1/1024 of the excess with each packet, following a remote clock that runs slower.
+static const int TRANSIT_DRIFT_SHIFT = 10;
+
+static const uint RECEIVER_FEEDBACK_INTERVAL = 32;
+static const MasterClockNanos PARTICIPANT_TIMEOUT = 60 * MasterClock::NANOS_PER_SECOND;
+static const int IDLE_CHECK_INTERVAL_MILLIS = 10000;
+static const MasterClockNanos STOP_WAIT_TIME = 100 * MasterClock::NANOS_PER_MILLISECOND;
+
+static int getDataByteCount(uchar status) {
+	switch (status & 0xF0) {
+	case 0xC0:
+	case 0xD0:
+		return 1;
+	case 0xF0:
+		switch (status) {
+		case 0xF1:
+		case 0xF3:
+			return 1;
+		case 0xF2:
+			return 2;
+		default:
+			return 0;
+		}
+	default:
+		return 2;
+	}
+}
+
+RTPMidiProcessor::RTPMidiProcessor(RTPMidiDriver &useDriver) :
+	driver(useDriver), controlPort(), localSSRC(), controlSocket(), dataSocket()
+{}
+
+void RTPMidiProcessor::start(quint16 useControlPort) {
+	controlPort = useControlPort;
+	localSSRC = quint32(MasterClock::getClockNanos()) ^ quint32(QCoreApplication::applicationPid() << 16);
+	QThread::start(QThread::TimeCriticalPriority);
+}
+
+void RTPMidiProcessor::run() {
+	QUdpSocket useControlSocket;
+	QUdpSocket useDataSocket;
+	// The AppleMIDI session protocol uses a pair of adjacent ports, the data port follows the control port.
+	if (!useControlSocket.bind(QHostAddress::Any, controlPort) || !useDataSocket.bind(QHostAddress::Any, controlPort + 1)) {
+		qDebug() << "RTPMidiDriver: Failed to bind UDP ports" << controlPort << "and" << controlPort + 1;
+		return;
+	}
+	controlSocket = &useControlSocket;
+	dataSocket = &useDataSocket;
+	// The receiver lives in the GUI thread, so the direct connections are needed to serve the sockets in this thread.
+	connect(controlSocket, SIGNAL(readyRead()), SLOT(readControlSocket()), Qt::DirectConnection);
+	connect(dataSocket, SIGNAL(readyRead()), SLOT(readDataSocket()), Qt::DirectConnection);
+	QTimer idleTimer;
+	connect(&idleTimer, SIGNAL(timeout()), SLOT(dropIdleParticipants()), Qt::DirectConnection);
+	idleTimer.start(IDLE_CHECK_INTERVAL_MILLIS);
+	qDebug() << "RTPMidiDriver: Listening for session invitations on UDP port" << controlPort;
+
+	exec();
+
+	while (!participants.isEmpty()) removeParticipant(participants.last());
+	controlSocket = NULL;
+	dataSocket = NULL;
+	qDebug() << "RTPMidiDriver: Processing thread stopped";
+}
+
+RTPMidiProcessor::Participant *RTPMidiProcessor::findParticipant(quint32 ssrc) const {
+	foreach (Participant *participant, participants) {
+		if (participant->ssrc == ssrc) return participant;
+	}
+	return NULL;
+}
+
+void RTPMidiProcessor::removeParticipant(Participant *participant) {
+	qDebug() << "RTPMidiDriver: Session ended with" << participant->name;
+	participants.removeOne(participant);
+	if (participant->midiSession != NULL) driver.deleteMidiSession(participant->midiSession);
+	delete participant;
+}
+
+void RTPMidiProcessor::readControlSocket() {
+	while (controlSocket->hasPendingDatagrams()) {
+		QByteArray packet(int(controlSocket->pendingDatagramSize()), 0);
+		QHostAddress address;
+		quint16 port;
+		controlSocket->readDatagram(packet.data(), packet.size(), &address, &port);
+		handleSessionCommand(*controlSocket, packet, address, port);
+	}
+}
+
+void RTPMidiProcessor::readDataSocket() {
+	while (dataSocket->hasPendingDatagrams()) {
+		QByteArray packet(int(dataSocket->pendingDatagramSize()), 0);
+		QHostAddress address;
+		quint16 port;
+		dataSocket->readDatagram(packet.data(), packet.size(), &address, &port);
+		// The arrival time is taken before anything else, it anchors the timing of the events.
+		MasterClockNanos arrivalNanos = MasterClock::getClockNanos();
+		if (packet.size() >= 4 && uchar(packet.at(0)) == 0xFF && uchar(packet.at(1)) == 0xFF) {
+			handleSessionCommand(*dataSocket, packet, address, port);
+		} else {
+			handleRTPPacket(packet, arrivalNanos);
+		}
+	}
+}
+
+void RTPMidiProcessor::dropIdleParticipants() {
+	MasterClockNanos nanosNow = MasterClock::getClockNanos();
+	for (int i = participants.count() - 1; i >= 0; i--) {
+		if (nanosNow - participants.at(i)->lastActivityNanos > PARTICIPANT_TIMEOUT) removeParticipant(participants.at(i));
+	}
+}
+
+void RTPMidiProcessor::handleSessionCommand(QUdpSocket &socket, const QByteArray &packet, const QHostAddress &address, quint16 port) {
+	const uchar *data = reinterpret_cast<const uchar *>(packet.constData());
+	if (packet.size() < 4 || data[0] != 0xFF || data[1] != 0xFF) return;
+	const bool onDataPort = &socket == dataSocket;
+	if (data[2] == 'I' && data[3] == 'N' && packet.size() >= 16) {
+		quint32 initiatorToken = qFromBigEndian<quint32>(data + 8);
+		quint32 ssrc = qFromBigEndian<quint32>(data + 12);
+		Participant *participant = findParticipant(ssrc);
+		if (participant == NULL) {
+			participant = new Participant;
+			participant->ssrc = ssrc;
+			participant->name = packet.size() > 16 ? QString::fromUtf8(packet.constData() + 16) : address.toString();
+			participant->controlPort = 0;
+			participant->dataPort = 0;
+			participant->midiSession = NULL;
+			participant->sequenceNumberValid = false;
+			participant->lastSequenceNumber = 0;
+			participant->packetsSinceFeedback = 0;
+			participant->lastRTPTimestamp = 0;
+			participant->extendedRTPTimestamp = 0;
+			participant->runningStatus = 0;
+			participant->transitValid = false;
+			participant->minTransitNanos = 0;
+			participant->jitterNanos = 0;
+			participants.append(participant);
+		}
+		participant->address = address;
+		participant->lastActivityNanos = MasterClock::getClockNanos();
+		if (onDataPort) {
+			participant->dataPort = port;
+			// The session is complete once the invitation has come on both ports.
+			if (participant->midiSession == NULL) {
+				participant->midiSession = driver.createMidiSession("RTP-MIDI: " + participant->name);
+				driver.showBalloon("Connected RTP-MIDI session:", participant->name);
+				qDebug() << "RTPMidiDriver: Session started with" << participant->name << "at" << address.toString();
+			}
+		} else {
+			participant->controlPort = port;
+		}
+		sendInvitationAccepted(socket, initiatorToken, address, port);
+	} else if (data[2] == 'B' && data[3] == 'Y' && packet.size() >= 16) {
+		Participant *participant = findParticipant(qFromBigEndian<quint32>(data + 12));
+		if (participant != NULL) removeParticipant(participant);
+	} else if (data[2] == 'C' && data[3] == 'K' && packet.size() >= 36 && onDataPort) {
+		Participant *participant = findParticipant(qFromBigEndian<quint32>(data + 4));
+		if (participant == NULL) return;
+		participant->lastActivityNanos = MasterClock::getClockNanos();
+		// The remote peer measures the round trip by the timestamps, only the one of this side needs filling in.
+		// The event timing is derived from the arrival times of the MIDI packets instead, which is immune to the clock offset.
+		if (data[8] == 0) {
+			QByteArray reply(packet);
+			uchar *replyData = reinterpret_cast<uchar *>(reply.data());
+			qToBigEndian<quint32>(localSSRC, replyData + 4);
+			replyData[8] = 1;
+			qToBigEndian<quint64>(quint64(MasterClock::getClockNanos() / NANOS_PER_RTP_TICK), replyData + 20);
+			socket.writeDatagram(reply, address, port);
+		} else if (data[8] == 2) {
+			sendReceiverFeedback(*participant);
+		}
+	}
+}
+
+void RTPMidiProcessor::handleRTPPacket(const QByteArray &packet, MasterClockNanos arrivalNanos) {
+	const uchar *data = reinterpret_cast<const uchar *>(packet.constData());
+	int length = packet.size();
+	if (length < 13 || (data[0] & 0xC0) != 0x80 || (data[1] & 0x7F) != RTP_MIDI_PAYLOAD_TYPE) return;
+	Participant *participant = findParticipant(qFromBigEndian<quint32>(data + 8));
+	if (participant == NULL || participant->midiSession == NULL) return;
+	participant->lastActivityNanos = arrivalNanos;
+
+	quint16 sequenceNumber = qFromBigEndian<quint16>(data + 2);
+	if (participant->sequenceNumberValid) {
+		qint16 sequenceDelta = qint16(sequenceNumber - participant->lastSequenceNumber);
+		// A duplicate is dropped, whereas a packet that comes out of order is played late rather than never.
+		if (sequenceDelta == 0) return;
+		if (sequenceDelta > 1) qDebug() << "RTPMidiDriver: Lost" << sequenceDelta - 1 << "packets from" << participant->name;
+		if (sequenceDelta > 0) participant->lastSequenceNumber = sequenceNumber;
+	} else {
+		participant->sequenceNumberValid = true;
+		participant->lastSequenceNumber = sequenceNumber;
+	}
+
+	quint32 rtpTimestamp = qFromBigEndian<quint32>(data + 4);
+	qint64 extendedRTPTimestamp = participant->transitValid
+		? participant->extendedRTPTimestamp + qint32(rtpTimestamp - participant->lastRTPTimestamp)
+		: qint64(rtpTimestamp);
+	if (!participant->transitValid || qint32(rtpTimestamp - participant->lastRTPTimestamp) > 0) {
+		participant->lastRTPTimestamp = rtpTimestamp;
+		participant->extendedRTPTimestamp = extendedRTPTimestamp;
+	}
+
+	// The remote timestamps are mapped onto the local clock via the least transit time, and the events are delayed
+	// by the recent peak of the excess transit time, so that the packets that are late by that much still play in time.
+	MasterClockNanos remoteNanos = extendedRTPTimestamp * NANOS_PER_RTP_TICK;
+	MasterClockNanos transitNanos = arrivalNanos - remoteNanos;
+	if (!participant->transitValid) {
+		participant->transitValid = true;
+		participant->minTransitNanos = transitNanos;
+		participant->jitterNanos = 0;
+	} else if (transitNanos < participant->minTransitNanos) {
+		participant->minTransitNanos = transitNanos;
+	} else {
+		participant->minTransitNanos += (transitNanos - participant->minTransitNanos) >> TRANSIT_DRIFT_SHIFT;
+	}
+	MasterClockNanos excessTransitNanos = transitNanos - participant->minTransitNanos;
+	participant->jitterNanos -= participant->jitterNanos >> JITTER_DECAY_SHIFT;
+	if (participant->jitterNanos < excessTransitNanos) participant->jitterNanos = excessTransitNanos;
+	MasterClockNanos jitterDelayNanos = qBound(MIN_JITTER_DELAY, participant->jitterNanos, MAX_JITTER_DELAY);
+	MasterClockNanos eventNanos = remoteNanos + participant->minTransitNanos + jitterDelayNanos;
+
+	// Skip the RTP header along with the contributing sources and the header extension, if any.
+	int offset = 12 + 4 * (data[0] & 0x0F);
+	if (data[0] & 0x10) {
+		if (length < offset + 4) return;
+		offset += 4 + 4 * qFromBigEndian<quint16>(data + offset + 2);
+	}
+	if (length <= offset) return;
+	// MIDI command section header: B, J, Z and P flags along with the length of the MIDI list, which is 12-bit if B is set.
+	uchar flags = data[offset++];
+	int listLength = flags & 0x0F;
+	if (flags & 0x80) {
+		if (length <= offset) return;
+		listLength = (listLength << 8) | data[offset++];
+	}
+	// The recovery journal that may follow is ignored, as the lost packets are only reported.
+	if (length < offset + listLength) return;
+	parseMIDIList(*participant, data + offset, listLength, (flags & 0x20) != 0, eventNanos);
+
+	if (++participant->packetsSinceFeedback >= RECEIVER_FEEDBACK_INTERVAL) sendReceiverFeedback(*participant);
+}
+
+void RTPMidiProcessor::parseMIDIList(Participant &participant, const uchar *data, int length, bool firstDeltaTimePresent, MasterClockNanos eventNanos) {
+	QMidiStreamParser &parser = *participant.midiSession->getQMidiStreamParser();
+	int position = 0;
+	bool deltaTimePresent = firstDeltaTimePresent;
+	while (position < length) {
+		if (deltaTimePresent) {
+			quint32 deltaTime = 0;
+			for (int i = 0; i < 4; i++) {
+				if (length <= position) return;
+				uchar deltaTimeByte = data[position++];
+				deltaTime = (deltaTime << 7) | (deltaTimeByte & 0x7F);
+				if ((deltaTimeByte & 0x80) == 0) break;
+			}
+			eventNanos += deltaTime * NANOS_PER_RTP_TICK;
+		}
+		deltaTimePresent = true;
+		if (length <= position) return;
+
+		const uchar status = data[position];
+		if (status == 0xF0 || status == 0xF7) {
+			// A SysEx segment ends with F7 when the message is complete, with F0 when continued in a later command,
+			// and with F4 when cancelled. The continuing segments start with F7. Only the message bytes are passed on.
+			int end = position + 1;
+			while (end < length && data[end] != 0xF7 && data[end] != 0xF0 && data[end] != 0xF4) end++;
+			if (length <= end) return;
+			int segmentStart = status == 0xF7 ? position + 1 : position;
+			int segmentEnd = data[end] == 0xF7 ? end + 1 : end;
+			participant.runningStatus = 0;
+			position = end + 1;
+			if (data[end] == 0xF4) continue;
+			parser.setTimestamp(eventNanos);
+			parser.parseStream(data + segmentStart, segmentEnd - segmentStart);
+			continue;
+		}
+		int commandLength;
+		if (status & 0x80) {
+			commandLength = 1 + getDataByteCount(status);
+			if (status < 0xF0) {
+				participant.runningStatus = status;
+			} else if (status < 0xF8) {
+				participant.runningStatus = 0;
+			}
+		} else {
+			// The status may be omitted in the first command of a packet as well, then the running status carries on.
+			if (participant.runningStatus == 0) return;
+			commandLength = getDataByteCount(participant.runningStatus);
+		}
+		if (length < position + commandLength) return;
+		parser.setTimestamp(eventNanos);
+		parser.parseStream(data + position, commandLength);
+		position += commandLength;
+	}
+}
+
+void RTPMidiProcessor::sendInvitationAccepted(QUdpSocket &socket, quint32 initiatorToken, const QHostAddress &address, quint16 port) {
+	QByteArray reply(16, 0);
+	uchar *replyData = reinterpret_cast<uchar *>(reply.data());
+	replyData[0] = 0xFF;
+	replyData[1] = 0xFF;
+	replyData[2] = 'O';
+	replyData[3] = 'K';
+	qToBigEndian<quint32>(APPLEMIDI_PROTOCOL_VERSION, replyData + 4);
+	qToBigEndian<quint32>(initiatorToken, replyData + 8);
+	qToBigEndian<quint32>(localSSRC, replyData + 12);
+	reply.append(LOCAL_SESSION_NAME, sizeof(LOCAL_SESSION_NAME));
+	socket.writeDatagram(reply, address, port);
+}
+
+void RTPMidiProcessor::sendReceiverFeedback(Participant &participant) {
+	// Lets the sender trim the recovery journal up to the last packet received.
+	participant.packetsSinceFeedback = 0;
+	if (!participant.sequenceNumberValid || participant.controlPort == 0) return;
+	QByteArray feedback(12, 0);
+	uchar *feedbackData = reinterpret_cast<uchar *>(feedback.data());
+	feedbackData[0] = 0xFF;
+	feedbackData[1] = 0xFF;
+	feedbackData[2] = 'R';
+	feedbackData[3] = 'S';
+	qToBigEndian<quint32>(localSSRC, feedbackData + 4);
+	qToBigEndian<quint16>(participant.lastSequenceNumber, feedbackData + 8);
+	controlSocket->writeDatagram(feedback, participant.address, participant.controlPort);
+}
+
+RTPMidiDriver::RTPMidiDriver(Master *useMaster) : MidiDriver(useMaster), processor(*this) {
+	name = "RTP-MIDI";
+}
+
+RTPMidiDriver::~RTPMidiDriver() {
+	stop();
+}
+
+void RTPMidiDriver::start() {
+	// The network sessions are only accepted once a port is configured, as this opens the synth to the whole network.
+	uint controlPort = master->getSettings()->value("Master/RTPMidiPort", 0).toUInt();
+	if (controlPort == 0 || 0xFFFF <= controlPort || processor.isRunning()) return;
+	processor.start(quint16(controlPort));
+}
+
+void RTPMidiDriver::stop() {
+	if (!processor.isRunning()) return;
+	processor.quit();
+	// The processing thread may be waiting for a MIDI session to be created or deleted in the GUI thread meanwhile.
+	waitForProcessingThread(processor, STOP_WAIT_TIME);
+}
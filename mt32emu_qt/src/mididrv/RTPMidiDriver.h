@@ -0,0 +1,84 @@
+#ifndef RTP_MIDI_DRIVER_H
+#define RTP_MIDI_DRIVER_H
+
+#include <QThread>
+#include <QHostAddress>
+
+#include "MidiDriver.h"
+
+class QUdpSocket;
+class RTPMidiDriver;
+
+// Receives the MIDI streams of the remote participants of RTP-MIDI network sessions (RFC 6295) set up with
+// the AppleMIDI session protocol. Each participant gets a MIDI session of its own, which is routed to a synth
+// as any other. The sockets are served by an event loop in this thread, so that the timing does not depend
+// on the GUI thread.
+class RTPMidiProcessor : public QThread {
+	Q_OBJECT
+
+public:
+	RTPMidiProcessor(RTPMidiDriver &useDriver);
+	void start(quint16 useControlPort);
+
+private:
+	struct Participant {
+		quint32 ssrc;
+		QString name;
+		QHostAddress address;
+		quint16 controlPort;
+		quint16 dataPort;
+		MidiSession *midiSession;
+		MasterClockNanos lastActivityNanos;
+
+		bool sequenceNumberValid;
+		quint16 lastSequenceNumber;
+		quint32 packetsSinceFeedback;
+		// The RTP timestamps extended beyond 32 bits, so that they never wrap around.
+		quint32 lastRTPTimestamp;
+		qint64 extendedRTPTimestamp;
+		quint8 runningStatus;
+
+		// Jitter buffer state. The transit time is the arrival time less the remote timestamp, the least one seen
+		// is taken for the network delay with no jitter. The packets that take longer are delayed by the excess.
+		bool transitValid;
+		MasterClockNanos minTransitNanos;
+		MasterClockNanos jitterNanos;
+	};
+
+	RTPMidiDriver &driver;
+	quint16 controlPort;
+	quint32 localSSRC;
+	QUdpSocket *controlSocket;
+	QUdpSocket *dataSocket;
+	QList<Participant *> participants;
+
+	void run();
+	Participant *findParticipant(quint32 ssrc) const;
+	void removeParticipant(Participant *participant);
+	void handleSessionCommand(QUdpSocket &socket, const QByteArray &packet, const QHostAddress &address, quint16 port);
+	void handleRTPPacket(const QByteArray &packet, MasterClockNanos arrivalNanos);
+	void parseMIDIList(Participant &participant, const uchar *data, int length, bool firstDeltaTimePresent, MasterClockNanos eventNanos);
+	void sendInvitationAccepted(QUdpSocket &socket, quint32 initiatorToken, const QHostAddress &address, quint16 port);
+	void sendReceiverFeedback(Participant &participant);
+
+private slots:
+	void readControlSocket();
+	void readDataSocket();
+	void dropIdleParticipants();
+};
+
+class RTPMidiDriver : public MidiDriver {
+	Q_OBJECT
+	friend class RTPMidiProcessor;
+
+public:
+	RTPMidiDriver(Master *useMaster);
+	~RTPMidiDriver();
+	void start();
+	void stop();
+
+private:
+	RTPMidiProcessor processor;
+};
+
+#endif
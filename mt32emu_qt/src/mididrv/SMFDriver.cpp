@@ -23,6 +23,9 @@
 #include "../MidiSession.h"
 
 static const MasterClockNanos MAX_SLEEP_TIME = 200 * MasterClock::NANOS_PER_MILLISECOND;
+// Events due within this time are pushed at once with their own timestamps, so that the synth queue keeps the timing exact,
+// and the thread only needs to wake up once per batch, with no precision required.
+static const MasterClockNanos PUSH_AHEAD_TIME = 20 * MasterClock::NANOS_PER_MILLISECOND;
 
 static void sendAllSoundOff(SynthRoute *synthRoute, bool resetAllControllers) {
 	if (synthRoute->getState() != SynthRouteState_OPEN) return;
@@ -43,34 +46,125 @@ static void sendAllSoundOff(SynthRoute *synthRoute, bool resetAllControllers) {
 	}
 }
 
+SMFPrefetcher::SMFPrefetcher() : stopProcessing(false) {
+}
+
+SMFPrefetcher::~SMFPrefetcher() {
+	mutex.lock();
+	stopProcessing = true;
+	prefetchChanged.wakeAll();
+	mutex.unlock();
+	wait();
+	discardParsedFiles(true);
+}
+
+void SMFPrefetcher::prefetch(const QStringList &fileNames) {
+	QMutexLocker locker(&mutex);
+	expectedFileNames = fileNames.mid(0, MAX_PREFETCHED_FILES);
+	discardParsedFiles(false);
+	if (!isRunning() && !expectedFileNames.isEmpty()) start(QThread::LowPriority);
+	prefetchChanged.wakeAll();
+}
+
+MidiParser *SMFPrefetcher::takeParsedFile(const QString &fileName) {
+	QMutexLocker locker(&mutex);
+	while (parsingFileName == fileName) parseFinished.wait(&mutex);
+	expectedFileNames.removeOne(fileName);
+	for (int i = 0; i < parsedFiles.count(); i++) {
+		if (parsedFiles.at(i).fileName == fileName) return parsedFiles.takeAt(i).parser;
+	}
+	return NULL;
+}
+
+void SMFPrefetcher::run() {
+	QMutexLocker locker(&mutex);
+	while (!stopProcessing) {
+		QString fileName;
+		foreach (const QString &expectedFileName, expectedFileNames) {
+			if (!isParsed(expectedFileName)) {
+				fileName = expectedFileName;
+				break;
+			}
+		}
+		if (fileName.isEmpty()) {
+			prefetchChanged.wait(&mutex);
+			continue;
+		}
+		parsingFileName = fileName;
+		locker.unlock();
+		MidiParser *parser = new MidiParser;
+		bool parsed = parser->parse(fileName);
+		locker.relock();
+		parsingFileName.clear();
+		if (parsed && expectedFileNames.contains(fileName)) {
+			ParsedFile parsedFile = { fileName, parser };
+			parsedFiles.append(parsedFile);
+		} else {
+			// A broken file is left to be reported once it is due to play.
+			if (!parsed) expectedFileNames.removeOne(fileName);
+			delete parser;
+		}
+		parseFinished.wakeAll();
+	}
+}
+
+bool SMFPrefetcher::isParsed(const QString &fileName) const {
+	foreach (const ParsedFile &parsedFile, parsedFiles) {
+		if (parsedFile.fileName == fileName) return true;
+	}
+	return false;
+}
+
+void SMFPrefetcher::discardParsedFiles(bool all) {
+	for (int i = parsedFiles.count() - 1; i >= 0; i--) {
+		if (all || !expectedFileNames.contains(parsedFiles.at(i).fileName)) delete parsedFiles.takeAt(i).parser;
+	}
+}
+
 SMFProcessor::SMFProcessor(SMFDriver *useSMFDriver) : driver(useSMFDriver) {
 }
 
-void SMFProcessor::start(QString useFileName) {
+void SMFProcessor::start(QString useFileName, MidiParser *parsedFile) {
 	driver->stopProcessing = false;
 	driver->pauseProcessing = false;
 	driver->bpmUpdate = 0;
 	driver->fastForwardingFactor = 0;
 	driver->seekPosition = -1;
 	fileName = useFileName;
-	if (!parser.parse(fileName)) {
+	if (parsedFile != NULL) {
+		parser.takeOver(*parsedFile);
+		delete parsedFile;
+	} else if (!parser.parse(fileName)) {
 		qDebug() << "SMFDriver: Error parsing MIDI file:" << fileName;
 		QMessageBox::warning(NULL, "Error", "Error encountered while loading MIDI file");
 		emit driver->playbackFinished();
 		return;
 	}
+	threadPolicy.load(*Master::getInstance()->getSettings(), "Midi");
 	QThread::start(QThread::TimeCriticalPriority);
 }
 
 void SMFProcessor::run() {
+	ThreadPolicyScope threadPolicyScope(threadPolicy, "SMFProcessor", PUSH_AHEAD_TIME);
 	MidiSession *session = driver->createMidiSession(QFileInfo(fileName).fileName());
 	SynthRoute *synthRoute = session->getSynthRoute();
 	bool paused = false;
 	const QMidiEventList &midiEvents = parser.getMIDIEvents();
 	midiTick = parser.getMidiTick();
 	quint32 totalSeconds = estimateRemainingTime(midiEvents, 0);
-	MasterClockNanos startNanos = MasterClock::getClockNanos();
+	// Playing into a file, the stream time is driven by this thread, and the rendering runs as fast as the CPU allows.
+	MasterClockNanos offlineNanos = synthRoute->startOfflinePlayback();
+	const bool offline = offlineNanos != 0;
+	if (offline) qDebug() << "SMFDriver: Using offline playback";
+	// Playing in realtime, the events are pushed that much further ahead so that the audio stream may prerender them.
+	// Nothing is to be heard of the prerendered audio once stopped, paused or repositioned, so it is discarded then.
+	const MasterClockNanos lookAheadNanos = offline ? 0 : synthRoute->startLookAheadPlayback();
+	const MasterClockNanos pushAheadNanos = PUSH_AHEAD_TIME + lookAheadNanos;
+	// The events pushed ahead are consumed when paused, so the playback resumes from the position heard then.
+	MasterClockNanos resumeNanosSinceStart = -1;
+	MasterClockNanos startNanos = offline ? offlineNanos : MasterClock::getClockNanos();
 	MasterClockNanos currentNanos = startNanos;
+	MasterClockNanos lastReportedSecond = -1;
 	for (int currentEventIx = 0; currentEventIx < midiEvents.count(); currentEventIx++) {
 		currentNanos += midiEvents.at(currentEventIx).getTimestamp() * midiTick;
 		while (!driver->stopProcessing && synthRoute->getState() == SynthRouteState_OPEN) {
@@ -79,13 +173,19 @@ void SMFProcessor::run() {
 				midiTick = parser.getMidiTick(MidiParser::MICROSECONDS_PER_MINUTE / bpmUpdate);
 				totalSeconds = (currentNanos - startNanos) / MasterClock::NANOS_PER_SECOND + estimateRemainingTime(midiEvents, currentEventIx + 1);
 			}
-			MasterClockNanos nanosNow = MasterClock::getClockNanos();
+			MasterClockNanos nanosNow = offline ? offlineNanos : MasterClock::getClockNanos();
 			if (driver->pauseProcessing) {
 				if (!paused) {
 					paused = true;
 					sendAllSoundOff(synthRoute, false);
+					if (lookAheadNanos != 0) {
+						synthRoute->discardLookAheadPlayback();
+						resumeNanosSinceStart = nanosNow - startNanos;
+					}
 				}
-				usleep(MAX_SLEEP_TIME / MasterClock::NANOS_PER_MICROSECOND);
+				MasterClock::sleepUntilClockNanos(MasterClock::getClockNanos() + MAX_SLEEP_TIME);
+				// The stream time stands still while paused in the offline playback.
+				if (offline) continue;
 				MasterClockNanos delay = MasterClock::getClockNanos() - nanosNow;
 				startNanos += delay;
 				currentNanos += delay;
@@ -93,8 +193,10 @@ void SMFProcessor::run() {
 			}
 			if (paused) paused = false;
 			int seekPosition = driver->seekPosition.fetchAndStoreRelaxed(-1);
-			if (seekPosition > -1) {
-				MasterClockNanos seekNanosSinceStart = totalSeconds * seekPosition * MasterClock::NANOS_PER_MILLISECOND;
+			MasterClockNanos seekNanosSinceStart = resumeNanosSinceStart;
+			if (seekPosition > -1) seekNanosSinceStart = totalSeconds * seekPosition * MasterClock::NANOS_PER_MILLISECOND;
+			resumeNanosSinceStart = -1;
+			if (seekNanosSinceStart > -1) {
 				MasterClockNanos currentNanosSinceStart = currentNanos - startNanos;
 				MasterClockNanos lastEventNanosSinceStart = currentNanosSinceStart - midiEvents.at(currentEventIx).getTimestamp() * midiTick;
 				bool resetAllControllers;
@@ -108,12 +210,19 @@ void SMFProcessor::run() {
 					resetAllControllers = false;
 				}
 				sendAllSoundOff(synthRoute, resetAllControllers);
+				if (lookAheadNanos != 0) synthRoute->discardLookAheadPlayback();
 				seek(synthRoute, midiEvents, currentEventIx, currentNanosSinceStart, seekNanosSinceStart);
-				nanosNow = MasterClock::getClockNanos();
+				nanosNow = offline ? offlineNanos : MasterClock::getClockNanos();
 				startNanos = nanosNow - seekNanosSinceStart;
 				currentNanos = currentNanosSinceStart + startNanos;
 			}
-			emit driver->playbackTimeChanged(nanosNow - startNanos, totalSeconds);
+			if (!offline) {
+				emit driver->playbackTimeChanged(nanosNow - startNanos, totalSeconds);
+			} else if ((nanosNow - startNanos) / MasterClock::NANOS_PER_SECOND != lastReportedSecond) {
+				// Avoid flooding the GUI thread, the offline playback time may run many times faster.
+				lastReportedSecond = (nanosNow - startNanos) / MasterClock::NANOS_PER_SECOND;
+				emit driver->playbackTimeChanged(nanosNow - startNanos, totalSeconds);
+			}
 			MasterClockNanos delay = currentNanos - nanosNow;
 			uint fastForwardingFactor = driver->fastForwardingFactor;
 			if (fastForwardingFactor > 1) {
@@ -122,8 +231,17 @@ void SMFProcessor::run() {
 				currentNanos -= timeShift;
 				startNanos -= timeShift;
 			}
-			if (delay < MasterClock::NANOS_PER_MILLISECOND) break;
-			usleep(((delay < MAX_SLEEP_TIME ? delay : MAX_SLEEP_TIME) - MasterClock::NANOS_PER_MILLISECOND) / MasterClock::NANOS_PER_MICROSECOND);
+			if (offline) {
+				// Let the stream render up to the event time, this only blocks while the rendering lags behind.
+				synthRoute->advanceOfflinePlayback(currentNanos);
+				offlineNanos = currentNanos;
+				break;
+			}
+			if (delay < pushAheadNanos) break;
+			// All the events due before the next one have been pushed. A margin is left for the drift of the timing estimation.
+			if (lookAheadNanos != 0) synthRoute->advanceLookAheadPlayback(currentNanos - PUSH_AHEAD_TIME);
+			// Wake up when the next batch is due, yet stay responsive to the playback controls.
+			MasterClock::sleepUntilClockNanos(nanosNow + qMin(delay - pushAheadNanos, MAX_SLEEP_TIME));
 		}
 		const QMidiEvent &e = midiEvents.at(currentEventIx);
 		if (driver->stopProcessing || synthRoute->getState() != SynthRouteState_OPEN) break;
@@ -132,7 +250,7 @@ void SMFProcessor::run() {
 				synthRoute->pushMIDIShortMessage(*session, e.getShortMessage(), currentNanos);
 				break;
 			case SYSEX:
-				synthRoute->pushMIDISysex(*session, e.getSysexData(), e.getSysexLen(), currentNanos);
+				synthRoute->pushMIDISysex(*session, midiEvents.getSysexData(e), e.getSysexLen(), currentNanos);
 				break;
 			case SET_TEMPO: {
 				uint tempo = e.getShortMessage();
@@ -144,6 +262,18 @@ void SMFProcessor::run() {
 				break;
 		}
 	}
+	if (offline) synthRoute->stopOfflinePlayback();
+	if (lookAheadNanos != 0) {
+		// Once the file has ended, the events pushed ahead are still to be played before the sound is cut off.
+		synthRoute->advanceLookAheadPlayback(currentNanos);
+		MasterClockNanos nanosNow = MasterClock::getClockNanos();
+		while (!driver->stopProcessing && synthRoute->getState() == SynthRouteState_OPEN && nanosNow < currentNanos) {
+			MasterClock::sleepUntilClockNanos(nanosNow + qMin(currentNanos - nanosNow, MAX_SLEEP_TIME));
+			nanosNow = MasterClock::getClockNanos();
+		}
+		if (driver->stopProcessing) synthRoute->discardLookAheadPlayback();
+		synthRoute->stopLookAheadPlayback();
+	}
 	sendAllSoundOff(synthRoute, true);
 	emit driver->playbackTimeChanged(0, 0);
 	qDebug() << "SMFDriver: processor thread stopped";
@@ -173,7 +303,7 @@ void SMFProcessor::seek(SynthRoute *synthRoute, const QMidiEventList &midiEvents
 				break;
 			}
 			case SYSEX:
-				synthRoute->playMIDISysexNow(e.getSysexData(), e.getSysexLen());
+				synthRoute->playMIDISysexNow(midiEvents.getSysexData(e), e.getSysexLen());
 				break;
 			case SET_TEMPO: {
 				uint tempo = e.getShortMessage();
@@ -185,7 +315,7 @@ void SMFProcessor::seek(SynthRoute *synthRoute, const QMidiEventList &midiEvents
 				break;
 		}
 		int nextEventIx = currentEventIx + 1;
-		if (midiEvents.size() <= nextEventIx) break;
+		if (midiEvents.count() <= nextEventIx) break;
 		currentEventIx = nextEventIx;
 		currentEventNanos += midiEvents.at(currentEventIx).getTimestamp() * midiTick;
 	}
@@ -208,7 +338,7 @@ void SMFDriver::start() {
 void SMFDriver::start(QString fileName) {
 	if (!fileName.isEmpty()) {
 		stop();
-		processor.start(fileName);
+		processor.start(fileName, prefetcher.takeParsedFile(fileName));
 	}
 }
 
@@ -233,6 +363,10 @@ void SMFDriver::jump(int newPosition) {
 	seekPosition = newPosition;
 }
 
+void SMFDriver::prefetch(const QStringList &fileNames) {
+	prefetcher.prefetch(fileNames);
+}
+
 SMFDriver::~SMFDriver() {
 	stop();
 }
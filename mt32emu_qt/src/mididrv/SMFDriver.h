@@ -7,21 +7,57 @@
 #include "../Master.h"
 #include "../MidiParser.h"
 #include "../MasterClock.h"
+#include "../ThreadPolicy.h"
 
 class SMFDriver;
 
+// Parses the files due to be played next in the background, so that a playlist moves on to the next file with no gap.
+// The parsed files are kept until taken for playback or no longer expected, hence at most MAX_PREFETCHED_FILES of them.
+class SMFPrefetcher : public QThread {
+public:
+	static const int MAX_PREFETCHED_FILES = 2;
+
+	SMFPrefetcher();
+	~SMFPrefetcher();
+	// Replaces the files expected to be played next, in the order of playback.
+	void prefetch(const QStringList &fileNames);
+	// Returns the parsed file, owned by the caller since then, or NULL if the file has not been prefetched.
+	// Waits for the file to be parsed if that is underway.
+	MidiParser *takeParsedFile(const QString &fileName);
+
+private:
+	struct ParsedFile {
+		QString fileName;
+		MidiParser *parser;
+	};
+
+	QMutex mutex;
+	QWaitCondition prefetchChanged;
+	QWaitCondition parseFinished;
+	QStringList expectedFileNames;
+	QList<ParsedFile> parsedFiles;
+	QString parsingFileName;
+	bool stopProcessing;
+
+	void run();
+	bool isParsed(const QString &fileName) const;
+	void discardParsedFiles(bool all);
+};
+
 class SMFProcessor : public QThread {
 	Q_OBJECT
 
 public:
 	SMFProcessor(SMFDriver *useSMFDriver);
-	void start(QString fileName);
+	// Takes over and deletes parsedFile unless it is NULL, otherwise the file is parsed right away.
+	void start(QString fileName, MidiParser *parsedFile = NULL);
 
 private:
 	MidiParser parser;
 	SMFDriver *driver;
 	MasterClockNanos midiTick;
 	QString fileName;
+	ThreadPolicy threadPolicy;
 
 	void run();
 	quint32 estimateRemainingTime(const QMidiEventList &midiEvents, int currentEventIx);
@@ -42,9 +78,12 @@ public:
 	void setBPM(quint32 newBPM);
 	void setFastForwardingFactor(uint useFastForwardingFactor);
 	void jump(int newPosition);
+	// Lets the files to be played next be parsed in the background.
+	void prefetch(const QStringList &fileNames);
 
 private:
 	SMFProcessor processor;
+	SMFPrefetcher prefetcher;
 	volatile bool stopProcessing;
 	volatile bool pauseProcessing;
 	QAtomicInt bpmUpdate;
@@ -16,13 +16,244 @@
 
 #include "TestDriver.h"
 
+#include <cstring>
+
 #include <QtCore>
 
 #include "../MasterClock.h"
 #include "../MidiSession.h"
+#include "../SynthRoute.h"
+#include "../audiodrv/AudioDriver.h"
 
 static const qint64 TEST1_EVENT_INTERVAL_NANOS = 8000000; // 256 samples;
 
+// The latency probe is long enough for the preceding note to decay, and the synth route gives up waiting for its onset in a second.
+static const MasterClockNanos LATENCY_PROBE_INTERVAL_NANOS = 1500 * MasterClock::NANOS_PER_MILLISECOND;
+static const MasterClockNanos LATENCY_PROBE_NOTE_LENGTH_NANOS = 100 * MasterClock::NANOS_PER_MILLISECOND;
+// Middle C on MIDI channel 2, which controls part 1 by default.
+static const MT32Emu::Bit32u LATENCY_PROBE_NOTE_ON = 0x7F3C91;
+static const MT32Emu::Bit32u LATENCY_PROBE_NOTE_OFF = 0x003C81;
+
+// The load test sends the events that are due in steps of this length, each with the exact timestamp it is scheduled at.
+static const MasterClockNanos LOAD_TICK_NANOS = 2 * MasterClock::NANOS_PER_MILLISECOND;
+static const MasterClockNanos LOAD_REPORT_INTERVAL_NANOS = 5 * MasterClock::NANOS_PER_SECOND;
+static const uint LOAD_MELODIC_PART_COUNT = 8;
+static const uint LOAD_CHORD_SIZE = 4;
+static const uint LOAD_PATCH_COUNT = 128;
+static const uint LOAD_PATCH_SIZE = 8;
+static const uint LOAD_PATCHES_PER_SYSEX = 32;
+static const uint LOAD_MAX_SESSION_COUNT = 8;
+
+// Profiles of the load test. Each is enabled by a non-zero rate in the settings, and all of them may run together.
+enum LoadProfile {
+	// Chords of 4 notes on each of the 8 melodic parts, which take more partials than the synth has. Rate in chords per second.
+	LoadProfile_CHORDS,
+	// Hits on the rhythm part cycling through the drums. Rate in hits per second.
+	LoadProfile_DRUM_ROLLS,
+	// Pitch bends, modulation, expression and panpot changes cycling through the melodic parts while a chord is held.
+	// Rate in messages per second.
+	LoadProfile_CONTROLLER_STORM,
+	// Uploads of the whole patch memory in SysEx messages of 32 patches, which restore the factory patches.
+	// Rate in messages per second.
+	LoadProfile_SYSEX_UPLOAD,
+	// Extra MIDI sessions, each playing a note at the same time as the others. Rate in notes per second per session.
+	// The sessions are merged into the pinned synth, otherwise each of them starts a synth of its own.
+	LoadProfile_MULTI_SESSION,
+	LoadProfile_COUNT
+};
+
+struct LoadProfileSetting {
+	const char *name;
+	uint defaultRate;
+};
+
+static const LoadProfileSetting LOAD_PROFILE_SETTINGS[LoadProfile_COUNT] = {
+	{"Master/LoadTestChordRate", 4},
+	{"Master/LoadTestDrumRollRate", 40},
+	{"Master/LoadTestControllerRate", 2000},
+	{"Master/LoadTestSysexRate", 8},
+	{"Master/LoadTestSessionRate", 20}
+};
+
+static const MT32Emu::Bit8u LOAD_DRUM_KEYS[] = {38, 40, 45, 47, 48, 50, 42, 36};
+
+// Generates the events of the load test profiles and counts them.
+struct LoadGenerator {
+	MidiSession *mainSession;
+	QList<MidiSession *> extraSessions;
+	quint32 sentEventCount;
+	quint32 refusedEventCount;
+	quint32 profileEventCounts[LoadProfile_COUNT];
+	bool controllerChordStarted;
+
+	void send(MidiSession &session, MT32Emu::Bit32u msg, MasterClockNanos nanos) {
+		if (session.getSynthRoute()->pushMIDIShortMessage(session, msg, nanos)) {
+			sentEventCount++;
+		} else {
+			refusedEventCount++;
+		}
+	}
+
+	void sendChord(MasterClockNanos nanos) {
+		const quint32 chordIx = profileEventCounts[LoadProfile_CHORDS];
+		for (uint part = 0; part < LOAD_MELODIC_PART_COUNT; part++) {
+			const MT32Emu::Bit32u channel = 1 + part;
+			for (uint noteIx = 0; noteIx < LOAD_CHORD_SIZE; noteIx++) {
+				static const MT32Emu::Bit32u CHORD_INTERVALS[LOAD_CHORD_SIZE] = {0, 4, 7, 12};
+				if (chordIx > 0) {
+					const MT32Emu::Bit32u lastKey = 48 + ((chordIx - 1) * 5) % 12 + CHORD_INTERVALS[noteIx];
+					send(*mainSession, 0x80 | channel | lastKey << 8, nanos);
+				}
+				const MT32Emu::Bit32u key = 48 + (chordIx * 5) % 12 + CHORD_INTERVALS[noteIx];
+				send(*mainSession, 0x90 | channel | key << 8 | 100 << 16, nanos);
+			}
+		}
+	}
+
+	void sendDrumHit(MasterClockNanos nanos) {
+		const quint32 hitIx = profileEventCounts[LoadProfile_DRUM_ROLLS];
+		const MT32Emu::Bit32u key = LOAD_DRUM_KEYS[hitIx % sizeof(LOAD_DRUM_KEYS)];
+		const MT32Emu::Bit32u velocity = (hitIx & 1) ? 80 : 127;
+		send(*mainSession, 0x99 | key << 8 | velocity << 16, nanos);
+	}
+
+	void sendController(MasterClockNanos nanos) {
+		if (!controllerChordStarted) {
+			for (uint part = 0; part < LOAD_MELODIC_PART_COUNT; part++) {
+				send(*mainSession, 0x90 | (1 + part) | (60 + part) << 8 | 100 << 16, nanos);
+			}
+			controllerChordStarted = true;
+		}
+		const quint32 messageIx = profileEventCounts[LoadProfile_CONTROLLER_STORM];
+		const MT32Emu::Bit32u channel = 1 + messageIx % LOAD_MELODIC_PART_COUNT;
+		// A triangle wave sweeping the whole range of 7-bit values.
+		const quint32 phase = (messageIx / LOAD_MELODIC_PART_COUNT) & 0xFF;
+		const MT32Emu::Bit32u value = phase < 0x80 ? phase : 0xFF - phase;
+		switch ((messageIx / LOAD_MELODIC_PART_COUNT) % 4) {
+		case 0:
+			send(*mainSession, 0xE0 | channel | (value & 0x7F) << 8 | value << 16, nanos);
+			break;
+		case 1:
+			send(*mainSession, 0xB0 | channel | 0x01 << 8 | value << 16, nanos);
+			break;
+		case 2:
+			send(*mainSession, 0xB0 | channel | 0x0B << 8 | (0x40 | value >> 1) << 16, nanos);
+			break;
+		default:
+			send(*mainSession, 0xB0 | channel | 0x0A << 8 | value << 16, nanos);
+			break;
+		}
+	}
+
+	void sendPatchUpload(MasterClockNanos nanos) {
+		static const uint HEADER_SIZE = 8;
+		MT32Emu::Bit8u sysex[HEADER_SIZE + LOAD_PATCHES_PER_SYSEX * LOAD_PATCH_SIZE + 2];
+		const uint firstPatch = (profileEventCounts[LoadProfile_SYSEX_UPLOAD] * LOAD_PATCHES_PER_SYSEX) % LOAD_PATCH_COUNT;
+		// The patch memory starts at 05 00 00, the address is made of 7-bit bytes.
+		const uint address = (0x05 << 14) + firstPatch * LOAD_PATCH_SIZE;
+		sysex[0] = 0xF0;
+		sysex[1] = 0x41;
+		sysex[2] = 0x10;
+		sysex[3] = 0x16;
+		sysex[4] = 0x12;
+		sysex[5] = MT32Emu::Bit8u((address >> 14) & 0x7F);
+		sysex[6] = MT32Emu::Bit8u((address >> 7) & 0x7F);
+		sysex[7] = MT32Emu::Bit8u(address & 0x7F);
+		MT32Emu::Bit8u *data = sysex + HEADER_SIZE;
+		for (uint patch = firstPatch; patch < firstPatch + LOAD_PATCHES_PER_SYSEX; patch++) {
+			// Timbre group (A or B), timbre number, key shift, fine tune, bender range, assign mode, reverb switch, dummy.
+			const MT32Emu::Bit8u patchData[LOAD_PATCH_SIZE] = {MT32Emu::Bit8u(patch / 64), MT32Emu::Bit8u(patch % 64), 24, 50, 12, 0, 1, 0};
+			memcpy(data, patchData, LOAD_PATCH_SIZE);
+			data += LOAD_PATCH_SIZE;
+		}
+		uint checksum = 0;
+		for (MT32Emu::Bit8u *p = sysex + 5; p < data; p++) checksum += *p;
+		*data++ = MT32Emu::Bit8u((128 - checksum % 128) & 0x7F);
+		*data++ = 0xF7;
+		if (mainSession->getSynthRoute()->pushMIDISysex(*mainSession, sysex, uint(data - sysex), nanos)) {
+			sentEventCount++;
+		} else {
+			refusedEventCount++;
+		}
+	}
+
+	void sendSessionNotes(MasterClockNanos nanos) {
+		const quint32 noteIx = profileEventCounts[LoadProfile_MULTI_SESSION];
+		for (int sessionIx = 0; sessionIx < extraSessions.size(); sessionIx++) {
+			const MT32Emu::Bit32u channel = 1 + sessionIx % LOAD_MELODIC_PART_COUNT;
+			if (noteIx > 0) send(*extraSessions[sessionIx], 0x80 | channel | (72 + (noteIx - 1) % 12) << 8, nanos);
+			send(*extraSessions[sessionIx], 0x90 | channel | (72 + noteIx % 12) << 8 | 90 << 16, nanos);
+		}
+	}
+
+	void sendEvent(LoadProfile profile, MasterClockNanos nanos) {
+		switch (profile) {
+		case LoadProfile_CHORDS:
+			sendChord(nanos);
+			break;
+		case LoadProfile_DRUM_ROLLS:
+			sendDrumHit(nanos);
+			break;
+		case LoadProfile_CONTROLLER_STORM:
+			sendController(nanos);
+			break;
+		case LoadProfile_SYSEX_UPLOAD:
+			sendPatchUpload(nanos);
+			break;
+		default:
+			sendSessionNotes(nanos);
+			break;
+		}
+		profileEventCounts[profile]++;
+	}
+
+	// Silences the notes and resets the controllers on all channels of all sessions.
+	void sendAllNotesOff(MasterClockNanos nanos) {
+		QList<MidiSession *> sessions = extraSessions;
+		sessions.prepend(mainSession);
+		foreach (MidiSession *session, sessions) {
+			for (MT32Emu::Bit32u channel = 0; channel < 16; channel++) {
+				send(*session, 0xB0 | channel | 0x79 << 8, nanos);
+				send(*session, 0xB0 | channel | 0x7B << 8, nanos);
+				send(*session, 0xE0 | channel | 0x40 << 16, nanos);
+			}
+		}
+	}
+};
+
+static QList<SynthRoute *> getLoadTestSynthRoutes(const LoadGenerator &generator) {
+	QList<SynthRoute *> synthRoutes;
+	synthRoutes.append(generator.mainSession->getSynthRoute());
+	foreach (MidiSession *session, generator.extraSessions) {
+		if (!synthRoutes.contains(session->getSynthRoute())) synthRoutes.append(session->getSynthRoute());
+	}
+	return synthRoutes;
+}
+
+static void reportLoadTestStats(const LoadGenerator &generator, MasterClockNanos elapsedNanos) {
+	const double elapsedSeconds = double(elapsedNanos) / MasterClock::NANOS_PER_SECOND;
+	qDebug() << "Load test:" << elapsedSeconds << "s, MIDI events sent:" << generator.sentEventCount
+		<< "refused:" << generator.refusedEventCount << "rate:" << int(generator.sentEventCount / qMax(elapsedSeconds, 1e-3)) << "per second";
+	QList<SynthRoute *> synthRoutes = getLoadTestSynthRoutes(generator);
+	for (int routeIx = 0; routeIx < synthRoutes.size(); routeIx++) {
+		AudioStreamStats stats;
+		if (!synthRoutes[routeIx]->getAudioStreamStats(stats)) {
+			qDebug() << "Load test: Synth" << routeIx + 1 << "has no audio stream";
+			continue;
+		}
+		qDebug() << "Load test: Synth" << routeIx + 1 << "renders:" << stats.renderCount << "deadline misses:" << stats.deadlineMissCount
+			<< "underruns:" << stats.underrunCount << "peak render load:" << stats.worstSpike.renderLoad << "%";
+	}
+}
+
+static double nanosToMillis(MasterClockNanos nanos) {
+	return double(nanos) / MasterClock::NANOS_PER_MILLISECOND;
+}
+
+static double framesToMillis(quint32 frames, quint32 sampleRate) {
+	return double(frames) * MasterClock::MILLIS_PER_SECOND / sampleRate;
+}
+
 TestProcessor::TestProcessor(TestMidiDriver *useTestMidiDriver) : testMidiDriver(useTestMidiDriver), stopProcessing(false) {
 }
 
@@ -36,6 +267,16 @@ void TestProcessor::stop() {
 }
 
 void TestProcessor::run() {
+	if (testMidiDriver->testMode == TestMidiDriver::TestMode_LATENCY) {
+		runLatencyTest();
+	} else if (testMidiDriver->testMode == TestMidiDriver::TestMode_LOAD) {
+		runLoadTest();
+	} else {
+		runTimingTest();
+	}
+}
+
+void TestProcessor::runTimingTest() {
 	MidiSession *session1 = testMidiDriver->createMidiSession("Test 1");
 	MidiSession *session2 = NULL;//testMidiDriver->createMidiSession("Test 2");
 	qint64 currentNanos = MasterClock::getClockNanos();
@@ -57,9 +298,134 @@ void TestProcessor::run() {
 	}
 }
 
+void TestProcessor::runLatencyTest() {
+	MidiSession *session = testMidiDriver->createMidiSession("Latency Test");
+	SynthRoute *synthRoute = session->getSynthRoute();
+	const AudioDevice *audioDevice = synthRoute->getAudioDevice();
+	if (audioDevice != NULL) {
+		const AudioDriverSettings &settings = audioDevice->driver.getAudioSettings();
+		qDebug() << "Latency test: Audio device:" << audioDevice->driver.name << "/" << audioDevice->name
+			<< "sample rate:" << settings.sampleRate << "chunk:" << settings.chunkLen << "ms audio latency:" << settings.audioLatency
+			<< "ms MIDI latency:" << settings.midiLatency << "ms render ahead:" << settings.renderAhead
+			<< "ms advanced timing:" << settings.advancedTiming;
+	}
+	quint32 measuredCount = 0;
+	quint32 failedCount = 0;
+	MasterClockNanos minLatencyNanos = 0;
+	MasterClockNanos maxLatencyNanos = 0;
+	MasterClockNanos totalLatencyNanos = 0;
+	MasterClockNanos probeNanos = MasterClock::getClockNanos();
+	while (!stopProcessing) {
+		LatencyMeasurement measurement;
+		switch (synthRoute->takeLatencyMeasurement(measurement)) {
+		case LatencyProbeState_MEASURED:
+			qDebug() << "Latency test: Input to output:" << nanosToMillis(measurement.inputToOutputNanos)
+				<< "ms, synth onset:" << nanosToMillis(measurement.synthOnsetNanos)
+				<< "ms, audio latency:" << framesToMillis(measurement.audioLatencyFrames, measurement.sampleRate)
+				<< "ms, MIDI latency:" << framesToMillis(measurement.midiLatencyFrames, measurement.sampleRate) << "ms";
+			if (measuredCount == 0 || measurement.inputToOutputNanos < minLatencyNanos) minLatencyNanos = measurement.inputToOutputNanos;
+			if (measuredCount == 0 || measurement.inputToOutputNanos > maxLatencyNanos) maxLatencyNanos = measurement.inputToOutputNanos;
+			totalLatencyNanos += measurement.inputToOutputNanos;
+			measuredCount++;
+			break;
+		case LatencyProbeState_FAILED:
+			qDebug() << "Latency test: Onset not detected, is the synth muted or still sounding?";
+			failedCount++;
+			break;
+		default:
+			break;
+		}
+		probeNanos = MasterClock::getClockNanos();
+		synthRoute->pushLatencyProbe(*session, LATENCY_PROBE_NOTE_ON, probeNanos);
+		sleepUntilClockNanos(probeNanos + LATENCY_PROBE_NOTE_LENGTH_NANOS);
+		synthRoute->pushMIDIShortMessage(*session, LATENCY_PROBE_NOTE_OFF, MasterClock::getClockNanos());
+		sleepUntilClockNanos(probeNanos + LATENCY_PROBE_INTERVAL_NANOS);
+	}
+	if (measuredCount > 0) {
+		qDebug() << "Latency test: Input to output min:" << nanosToMillis(minLatencyNanos)
+			<< "ms, mean:" << nanosToMillis(totalLatencyNanos / measuredCount) << "ms, max:" << nanosToMillis(maxLatencyNanos)
+			<< "ms, measured:" << measuredCount << "failed:" << failedCount;
+	}
+	testMidiDriver->deleteMidiSession(session);
+}
+
+// The render timing statistics of the synths are reset at the start, so that the reports reflect the generated load only.
+void TestProcessor::runLoadTest() {
+	QSettings *settings = Master::getInstance()->getSettings();
+	MasterClockNanos intervalNanos[LoadProfile_COUNT];
+	for (uint profile = 0; profile < LoadProfile_COUNT; profile++) {
+		const uint rate = settings->value(LOAD_PROFILE_SETTINGS[profile].name, LOAD_PROFILE_SETTINGS[profile].defaultRate).toUInt();
+		intervalNanos[profile] = rate == 0 ? 0 : MasterClock::NANOS_PER_SECOND / rate;
+		qDebug() << "Load test:" << LOAD_PROFILE_SETTINGS[profile].name << rate;
+	}
+	LoadGenerator generator;
+	generator.mainSession = testMidiDriver->createMidiSession("Load Test");
+	generator.sentEventCount = 0;
+	generator.refusedEventCount = 0;
+	memset(generator.profileEventCounts, 0, sizeof(generator.profileEventCounts));
+	generator.controllerChordStarted = false;
+	if (intervalNanos[LoadProfile_MULTI_SESSION] != 0) {
+		const uint sessionCount = qBound(1U, settings->value("Master/LoadTestSessionCount", 3).toUInt(), LOAD_MAX_SESSION_COUNT);
+		for (uint sessionIx = 0; sessionIx < sessionCount; sessionIx++) {
+			generator.extraSessions.append(testMidiDriver->createMidiSession(QString("Load Test %1").arg(sessionIx + 2)));
+		}
+	}
+	foreach (SynthRoute *synthRoute, getLoadTestSynthRoutes(generator)) {
+		synthRoute->resetAudioStreamStats();
+	}
+
+	const MasterClockNanos startNanos = MasterClock::getClockNanos();
+	MasterClockNanos nextEventNanos[LoadProfile_COUNT];
+	for (uint profile = 0; profile < LoadProfile_COUNT; profile++) {
+		nextEventNanos[profile] = startNanos;
+	}
+	MasterClockNanos nextReportNanos = startNanos + LOAD_REPORT_INTERVAL_NANOS;
+	MasterClockNanos nanosNow = startNanos;
+	while (!stopProcessing) {
+		nanosNow = MasterClock::getClockNanos();
+		for (uint profile = 0; profile < LoadProfile_COUNT; profile++) {
+			if (intervalNanos[profile] == 0) continue;
+			while (nextEventNanos[profile] <= nanosNow) {
+				generator.sendEvent(LoadProfile(profile), nextEventNanos[profile]);
+				nextEventNanos[profile] += intervalNanos[profile];
+			}
+		}
+		if (nanosNow >= nextReportNanos) {
+			reportLoadTestStats(generator, nanosNow - startNanos);
+			nextReportNanos += LOAD_REPORT_INTERVAL_NANOS;
+		}
+		MasterClock::sleepUntilClockNanos(nanosNow + LOAD_TICK_NANOS);
+	}
+	generator.sendAllNotesOff(MasterClock::getClockNanos());
+	reportLoadTestStats(generator, MasterClock::getClockNanos() - startNanos);
+	foreach (MidiSession *session, generator.extraSessions) {
+		testMidiDriver->deleteMidiSession(session);
+	}
+	testMidiDriver->deleteMidiSession(generator.mainSession);
+}
 
-TestMidiDriver::TestMidiDriver(Master *useMaster) : MidiDriver(useMaster), processor(this) {
-	name = "Test Driver";
+// Sleeps in short steps so that a stop request is handled promptly.
+void TestProcessor::sleepUntilClockNanos(MasterClockNanos clockNanos) {
+	static const MasterClockNanos MAX_SLEEP_NANOS = 20 * MasterClock::NANOS_PER_MILLISECOND;
+	while (!stopProcessing) {
+		MasterClockNanos nanosLeft = clockNanos - MasterClock::getClockNanos();
+		if (nanosLeft <= 0) return;
+		MasterClock::sleepForNanos(qMin(nanosLeft, MAX_SLEEP_NANOS));
+	}
+}
+
+TestMidiDriver::TestMidiDriver(Master *useMaster, TestMode useTestMode) : MidiDriver(useMaster), testMode(useTestMode), processor(this) {
+	switch (testMode) {
+	case TestMode_LATENCY:
+		name = "Latency Test Driver";
+		break;
+	case TestMode_LOAD:
+		name = "Load Test Driver";
+		break;
+	default:
+		name = "Test Driver";
+		break;
+	}
 }
 
 void TestMidiDriver::start() {
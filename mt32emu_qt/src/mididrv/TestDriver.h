@@ -19,6 +19,11 @@ protected:
 	void run();
 
 private:
+	void runTimingTest();
+	void runLatencyTest();
+	void runLoadTest();
+	void sleepUntilClockNanos(MasterClockNanos clockNanos);
+
 	TestMidiDriver *testMidiDriver;
 	volatile bool stopProcessing;
 };
@@ -27,11 +32,21 @@ class TestMidiDriver : public MidiDriver {
 	Q_OBJECT
 	friend class TestProcessor;
 public:
-	TestMidiDriver(Master *master);
+	enum TestMode {
+		// Sends a special event every 8 ms and reports the jitter of the MIDI timestamps.
+		TestMode_TIMING,
+		// Plays a note every second and reports the MIDI-to-audio latency measured by the synth route.
+		TestMode_LATENCY,
+		// Generates a configurable MIDI load and reports the render timing statistics of the audio streams.
+		TestMode_LOAD
+	};
+
+	TestMidiDriver(Master *master, TestMode testMode = TestMode_TIMING);
 	~TestMidiDriver();
 	void start();
 	void stop();
 private:
+	const TestMode testMode;
 	TestProcessor processor;
 };
 
@@ -48,6 +48,29 @@
 
 #endif // _WIN32_WINNT < 0x0500
 
+// The MME driver uses a shared-memory ring per client session since protocol version 2.
+// The layout must match winmm_drv.cpp in mt32emu_win32drv.
+#define MIDI_RING_PROTOCOL_VERSION 2
+#define MIDI_RING_MAGIC 0x474E4952 // "RING"
+#define MIDI_RING_DATA_SIZE 0x40000
+#define MIDI_RING_RECORD_SHORT_MESSAGE 1
+#define MIDI_RING_RECORD_SYSEX 2
+#define MIDI_RING_RECORD_WRAP 3
+
+struct MidiRingHeader {
+	DWORD magic;
+	DWORD dataSize;
+	volatile LONG writePosition;
+	volatile LONG readPosition;
+};
+
+struct MidiRingRecordHeader {
+	DWORD type;
+	DWORD length;
+	DWORD timestampLow;
+	DWORD timestampHigh;
+};
+
 static Win32MidiDriver *driver;
 static HWND hwnd = NULL;
 static MasterClockNanos startMasterClock; // FIXME: Should actually be per-session but doesn't seem to be a real win
@@ -65,6 +88,7 @@ LRESULT CALLBACK Win32MidiDriver::midiInProc(HWND hwnd, UINT uMsg, WPARAM wParam
 			return 0;
 		}
 		qDebug() << "Win32MidiDriver: Session ID =" << "0x" + QString::number(midiSessionID, 16) << "finished";
+		driver->deleteMidiRingReader(midiSessionID);
 		driver->deleteMidiSession(midiSession);
 		return 1;
 	}
@@ -163,6 +187,17 @@ LRESULT CALLBACK Win32MidiDriver::midiInProc(HWND hwnd, UINT uMsg, WPARAM wParam
 					midiSessionID = (quint32)qrand();
 				while (midiSessionID == 0 || driver->midiSessionIDs.indexOf(midiSessionID) >= 0);
 				driver->midiSessionIDs.append(midiSessionID);
+				if (data[2] >= MIDI_RING_PROTOCOL_VERSION) {
+					// Should the ring fail to be created, the driver keeps sending the messages synchronously.
+					Win32MidiRingReader *midiRingReader = new Win32MidiRingReader(midiSession, midiSessionID);
+					if (midiRingReader->isCreated()) {
+						driver->midiRingReaders.insert(midiSessionID, midiRingReader);
+						midiRingReader->start(QThread::TimeCriticalPriority);
+					} else {
+						qDebug() << "Win32MidiDriver: Failed to create shared-memory ring for session ID:" << "0x" + QString::number(midiSessionID, 16);
+						delete midiRingReader;
+					}
+				}
 				driver->showBalloon("Connected application:", appName);
 				qDebug() << "Win32MidiDriver: Connected application" << appName;
 				qDebug() << "Win32MidiDriver: Session ID:" << "0x" + QString::number(midiSessionID, 16) << "with protocol version" << data[2];
@@ -202,8 +237,101 @@ MidiSession *Win32MidiDriver::findMidiSession(quint32 midiSessionID) {
 	return ((midiSessionIx < 0) || (midiSessions.size() <= midiSessionIx)) ? NULL : midiSessions.at(midiSessionIx);
 }
 
+void Win32MidiDriver::deleteMidiRingReader(quint32 midiSessionID) {
+	Win32MidiRingReader *midiRingReader = midiRingReaders.take(midiSessionID);
+	if (midiRingReader == NULL) return;
+	midiRingReader->stop();
+	delete midiRingReader;
+}
+
+Win32MidiRingReader::Win32MidiRingReader(MidiSession *useMidiSession, quint32 midiSessionID) :
+	midiSession(useMidiSession), hMapping(NULL), hEvent(NULL), header(NULL), data(NULL), stopProcessing(false)
+{
+	char name[64];
+	qsnprintf(name, sizeof(name), "Local\\mt32emu_midi_ring_%08X", midiSessionID);
+	hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(MidiRingHeader) + MIDI_RING_DATA_SIZE, name);
+	if (hMapping == NULL) return;
+	header = (MidiRingHeader *)MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+	if (header == NULL) return;
+	qsnprintf(name, sizeof(name), "Local\\mt32emu_midi_ring_event_%08X", midiSessionID);
+	hEvent = CreateEventA(NULL, FALSE, FALSE, name);
+	data = (BYTE *)(header + 1);
+	header->dataSize = MIDI_RING_DATA_SIZE;
+	header->writePosition = 0;
+	header->readPosition = 0;
+	header->magic = MIDI_RING_MAGIC;
+}
+
+Win32MidiRingReader::~Win32MidiRingReader() {
+	if (header != NULL) UnmapViewOfFile(header);
+	if (hMapping != NULL) CloseHandle(hMapping);
+	if (hEvent != NULL) CloseHandle(hEvent);
+}
+
+bool Win32MidiRingReader::isCreated() const {
+	return header != NULL && hEvent != NULL;
+}
+
+void Win32MidiRingReader::stop() {
+	stopProcessing = true;
+	SetEvent(hEvent);
+	wait();
+}
+
+void Win32MidiRingReader::run() {
+	ThreadPolicyScope threadPolicyScope(driver->threadPolicy, "Win32MidiRingReader", MasterClock::NANOS_PER_MILLISECOND);
+	while (!stopProcessing) {
+		drain();
+		WaitForSingleObject(hEvent, INFINITE);
+	}
+	drain();
+}
+
+// Plays all the records available in a batch. Since the ring is writable by other processes, the records are validated.
+void Win32MidiRingReader::drain() {
+	SynthRoute *synthRoute = midiSession->getSynthRoute();
+	LONG readPosition = header->readPosition;
+	for (;;) {
+		// The write position is checked again after publishing the read position, so that no record written meanwhile
+		// is left unnoticed, as the driver only signals the event when it finds the ring empty.
+		const LONG writePosition = InterlockedCompareExchange(&header->writePosition, 0, 0);
+		if (readPosition == writePosition) return;
+		while (readPosition != writePosition) {
+			if (readPosition < 0 || MIDI_RING_DATA_SIZE - sizeof(MidiRingRecordHeader) < DWORD(readPosition)) {
+				qDebug() << "Win32MidiRingReader: Invalid read position:" << readPosition;
+				readPosition = writePosition;
+				break;
+			}
+			const MidiRingRecordHeader *record = (const MidiRingRecordHeader *)&data[readPosition];
+			if (record->type == MIDI_RING_RECORD_WRAP) {
+				readPosition = 0;
+				continue;
+			}
+			const DWORD payloadLength = record->length;
+			const DWORD recordLength = (sizeof(MidiRingRecordHeader) + payloadLength + 7) & ~7;
+			if (MIDI_RING_DATA_SIZE / 2 < payloadLength || MIDI_RING_DATA_SIZE - DWORD(readPosition) < recordLength) {
+				qDebug() << "Win32MidiRingReader: Invalid record length:" << payloadLength;
+				readPosition = writePosition;
+				break;
+			}
+			LARGE_INTEGER t = {{record->timestampLow, (LONG)record->timestampHigh}};
+			const MasterClockNanos refNanos = t.QuadPart - startMasterClock;
+			const MT32Emu::Bit8u *payload = (const MT32Emu::Bit8u *)(record + 1);
+			if (record->type == MIDI_RING_RECORD_SHORT_MESSAGE && payloadLength == sizeof(DWORD)) {
+				synthRoute->pushMIDIShortMessage(*midiSession, *(const DWORD *)payload, refNanos);
+			} else if (record->type == MIDI_RING_RECORD_SYSEX) {
+				synthRoute->pushMIDISysex(*midiSession, payload, payloadLength, refNanos);
+			}
+			readPosition += recordLength;
+			if (readPosition == MIDI_RING_DATA_SIZE) readPosition = 0;
+		}
+		InterlockedExchange(&header->readPosition, readPosition);
+	}
+}
+
 void Win32MidiInProcessor::run() {
 	qDebug() << "Win32MidiDriver: Win32MidiInProcessor started";
+	ThreadPolicyScope threadPolicyScope(driver->threadPolicy, "Win32MidiInProcessor", MasterClock::NANOS_PER_MILLISECOND);
 	HINSTANCE hInstance = GetModuleHandle(NULL);
 	LPCTSTR mt32emuClassName = "mt32emu_class";
 	WNDCLASS wc;
@@ -264,6 +392,7 @@ Win32MidiDriver::Win32MidiDriver(Master *useMaster) : MidiDriver(useMaster) {
 }
 
 void Win32MidiDriver::start() {
+	threadPolicy.load(*Master::getInstance()->getSettings(), "Midi");
 	midiInProcessor.start(QThread::TimeCriticalPriority);
 }
 
@@ -272,6 +401,9 @@ void Win32MidiDriver::stop() {
 		PostMessage(hwnd, WM_QUIT, 0, 0);
 		waitForProcessingThread(midiInProcessor, 10 * MasterClock::NANOS_PER_MILLISECOND);
 	}
+	while (!midiRingReaders.isEmpty()) {
+		deleteMidiRingReader(midiRingReaders.begin().key());
+	}
 	for (int i = 0; i < midiInPorts.size(); i++) {
 		delete midiInPorts[i];
 		deleteMidiSession(midiInSessions[i]);
@@ -309,6 +441,7 @@ void Win32MidiDriver::deletePort(MidiSession *midiSession) {
 		int i = midiSessions.indexOf(midiSession);
 		if ((0 <= i) && (i < midiSessionIDs.size())) {
 			quint32 id = midiSessionIDs.at(i);
+			deleteMidiRingReader(id);
 			midiSessionIDs.removeAll(id);
 			midiSessions.removeAt(i);
 		}
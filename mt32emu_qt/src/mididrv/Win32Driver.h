@@ -6,6 +6,7 @@
 #include "MidiDriver.h"
 #include "../MasterClock.h"
 #include "../MidiSession.h"
+#include "../ThreadPolicy.h"
 
 class Win32MidiIn {
 private:
@@ -22,6 +23,34 @@ public:
 	UINT getID();
 };
 
+struct MidiRingHeader;
+
+// Drains the shared-memory ring the MME driver writes the MIDI messages of a client session to, see winmm_drv.cpp.
+// The reading thread sleeps until the driver signals the event as it writes to the empty ring.
+class Win32MidiRingReader : public QThread {
+	Q_OBJECT
+
+public:
+	Win32MidiRingReader(MidiSession *midiSession, quint32 midiSessionID);
+	~Win32MidiRingReader();
+	bool isCreated() const;
+	// Stops the thread once the records written so far are played.
+	void stop();
+
+protected:
+	void run();
+
+private:
+	MidiSession * const midiSession;
+	HANDLE hMapping;
+	HANDLE hEvent;
+	MidiRingHeader *header;
+	BYTE *data;
+	volatile bool stopProcessing;
+
+	void drain();
+};
+
 class Win32MidiInProcessor : public QThread {
 	Q_OBJECT
 
@@ -31,6 +60,7 @@ protected:
 
 class Win32MidiDriver : public MidiDriver {
 	friend class Win32MidiInProcessor;
+	friend class Win32MidiRingReader;
 private:
 	static LRESULT CALLBACK midiInProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 	static void enumPorts(QList<QString> &midiInPortNames);
@@ -39,8 +69,12 @@ private:
 	QList<unsigned int> midiSessionIDs;
 	QList<Win32MidiIn *> midiInPorts;
 	QList<MidiSession *> midiInSessions;
+	QHash<quint32, Win32MidiRingReader *> midiRingReaders;
+	// Applied in the threads that receive MIDI, loaded as the driver starts.
+	ThreadPolicy threadPolicy;
 
 	MidiSession *findMidiSession(quint32 midiSessionID);
+	void deleteMidiRingReader(quint32 midiSessionID);
 
 public:
 	Win32MidiDriver(Master *useMaster);
@@ -0,0 +1,764 @@
+/*
+ * Copyright (C) 2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Needed for the socket functions and clock_gettime() when compiling in strict ANSI mode.
+#define _POSIX_C_SOURCE 200112L
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MT32EMU_API_TYPE 1
+#include <mt32emu/mt32emu.h>
+
+#if MT32EMU_VERSION_MAJOR != 2 || MT32EMU_VERSION_MINOR < 4
+#error Incompatible mt32emu library version
+#endif
+
+static const unsigned int DEFAULT_PORT = 7632;
+static const char DEFAULT_POOL[] = "default:44100:8";
+static const unsigned int LISTEN_BACKLOG = 16;
+static const unsigned int DEFAULT_MAX_PARTIALS = 32;
+
+// The units of all sessions are rendered in rounds of up to this many frames.
+static const mt32emu_bit32u ROUND_FRAME_COUNT = 1024;
+// A session is skipped in a round while the audio queued for sending exceeds this size, so slow clients throttle themselves.
+static const size_t MAX_OUTPUT_BACKLOG = 1 << 20;
+static const mt32emu_bit32u MAX_MESSAGE_LENGTH = 1 << 20;
+// Limits the size of a completed file, a WAVE message cannot exceed 4 GiB anyway.
+static const mt32emu_bit32u MAX_FILE_SECONDS = 3600;
+static const mt32emu_bit32u MIDI_EVENT_QUEUE_SIZE = 8192;
+
+// Rounds shorter than this are too noisy to update the measured render cost.
+static const mt32emu_bit32u MIN_COST_SAMPLE_FRAMES = 256;
+static const double COST_SMOOTHING = 0.05;
+static const mt32emu_bit32u CALIBRATION_MILLIS = 500;
+
+static const char * const ANALOG_OUTPUT_MODE_NAMES[] = {"digital", "coarse", "accurate", "oversampled"};
+static const int ANALOG_OUTPUT_MODE_COUNT = 4;
+
+// Each message starts with a 4-character tag followed by the payload length as a little-endian 32-bit number.
+static const size_t MESSAGE_HEADER_LENGTH = 8;
+
+// Client requests.
+static const char OPEN_TAG[] = "OPEN";
+static const char MIDI_TAG[] = "MIDI";
+static const char RENDER_TAG[] = "REND";
+static const char DONE_TAG[] = "DONE";
+static const char CLOSE_TAG[] = "CLOS";
+
+// Server replies.
+static const char OKAY_TAG[] = "OKAY";
+static const char FAIL_TAG[] = "FAIL";
+static const char AUDIO_TAG[] = "AUDI";
+static const char WAVE_TAG[] = "WAVE";
+
+struct MidiChunk {
+	// In frames at the output sample rate, counted from the start of the session.
+	mt32emu_bit32u timestamp;
+	std::vector<mt32emu_bit8u> data;
+};
+
+struct Pool;
+
+struct Session {
+	int socket;
+	std::vector<mt32emu_bit8u> input;
+	std::string output;
+	size_t outputOffset;
+	bool closing;
+
+	Pool *pool;
+	mt32emu_bit32u unit;
+	std::deque<MidiChunk> midi;
+	mt32emu_bit32u renderedFrameCount;
+	// Frames requested with REND that are still to be rendered and sent.
+	mt32emu_bit32u requestedFrameCount;
+	// Set by DONE, the session is rendered until the end and the output is collected into a file.
+	bool finishing;
+	mt32emu_bit32u tailFrameLimit;
+	mt32emu_bit32u tailFrameCount;
+	std::string file;
+};
+
+// A pool of pre-opened synths with the same configuration, which are the units of an engine sharing the ROMs.
+struct Pool {
+	std::string name;
+	unsigned int sampleRate;
+	int analogOutputMode;
+	unsigned int unitCount;
+	mt32emu_engine engine;
+	// The session each unit is assigned to, or NULL if the unit is free.
+	std::vector<Session *> sessions;
+	unsigned int activeSessionCount;
+	// Moving average of the CPU time spent per second of output rendered by a unit.
+	double unitCost;
+	std::vector<mt32emu_bit16s> renderBuffer;
+};
+
+struct Options {
+	const char *romDir;
+	unsigned int port;
+	unsigned int threadCount;
+	unsigned int partialCount;
+	double maxLoad;
+	bool lockMemory;
+	std::vector<const char *> poolSpecs;
+};
+
+struct ROMData {
+	std::vector<mt32emu_bit8u> controlROM;
+	std::vector<mt32emu_bit8u> pcmROM;
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void handleStopSignal(int) {
+	stopRequested = 1;
+}
+
+static double getProcessCPUSeconds() {
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return double(ts.tv_sec) + 1e-9 * double(ts.tv_nsec);
+}
+
+static bool readFile(const char *romDir, const char *fileName, std::vector<mt32emu_bit8u> &data) {
+	std::vector<char> pathName(strlen(romDir) + strlen(fileName) + 1);
+	strcpy(&pathName[0], romDir);
+	strcat(&pathName[0], fileName);
+	FILE *file = fopen(&pathName[0], "rb");
+	if (file == NULL) return false;
+	data.clear();
+	mt32emu_bit8u buffer[65536];
+	size_t readSize;
+	while ((readSize = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + readSize);
+	}
+	fclose(file);
+	return !data.empty();
+}
+
+static bool loadROMs(const char *romDir, ROMData &roms) {
+	if (!readFile(romDir, "CM32L_CONTROL.ROM", roms.controlROM) && !readFile(romDir, "MT32_CONTROL.ROM", roms.controlROM)) {
+		fprintf(stderr, "Control ROM not found.\n");
+		return false;
+	}
+	if (!readFile(romDir, "CM32L_PCM.ROM", roms.pcmROM) && !readFile(romDir, "MT32_PCM.ROM", roms.pcmROM)) {
+		fprintf(stderr, "PCM ROM not found.\n");
+		return false;
+	}
+	return true;
+}
+
+static void putBit32u(std::string &out, mt32emu_bit32u value) {
+	out += char(value & 0xFF);
+	out += char((value >> 8) & 0xFF);
+	out += char((value >> 16) & 0xFF);
+	out += char(value >> 24);
+}
+
+static void putBit16u(std::string &out, mt32emu_bit16u value) {
+	out += char(value & 0xFF);
+	out += char(value >> 8);
+}
+
+static mt32emu_bit32u getBit32u(const mt32emu_bit8u *data) {
+	return mt32emu_bit32u(data[0]) | (mt32emu_bit32u(data[1]) << 8) | (mt32emu_bit32u(data[2]) << 16) | (mt32emu_bit32u(data[3]) << 24);
+}
+
+static void putMessageHeader(std::string &out, const char *tag, mt32emu_bit32u length) {
+	out.append(tag, 4);
+	putBit32u(out, length);
+}
+
+static void sendMessage(Session &session, const char *tag, const std::string &payload) {
+	putMessageHeader(session.output, tag, mt32emu_bit32u(payload.size()));
+	session.output += payload;
+}
+
+static void appendSamples(std::string &out, const mt32emu_bit16s *samples, mt32emu_bit32u sampleCount) {
+	for (mt32emu_bit32u i = 0; i < sampleCount; i++) {
+		putBit16u(out, mt32emu_bit16u(samples[i]));
+	}
+}
+
+static void putWaveHeader(std::string &out, unsigned int sampleRate, mt32emu_bit32u dataSize) {
+	out.append("RIFF", 4);
+	putBit32u(out, 36 + dataSize);
+	out.append("WAVEfmt ", 8);
+	putBit32u(out, 16);
+	putBit16u(out, 1);
+	putBit16u(out, 2);
+	putBit32u(out, sampleRate);
+	putBit32u(out, sampleRate * 4);
+	putBit16u(out, 4);
+	putBit16u(out, 16);
+	out.append("data", 4);
+	putBit32u(out, dataSize);
+}
+
+// Returns the CPU time all the sessions are expected to take per second, assuming each renders in real time.
+static double getProjectedLoad(const std::vector<Pool *> &pools) {
+	double load = 0.0;
+	for (size_t i = 0; i < pools.size(); i++) {
+		load += pools[i]->activeSessionCount * pools[i]->unitCost;
+	}
+	return load;
+}
+
+static void renderUnits(Pool &pool, const std::vector<mt32emu_bit32u> &units, mt32emu_bit32u frameCount) {
+	std::vector<mt32emu_bit16s *> streams(units.size());
+	for (size_t i = 0; i < units.size(); i++) {
+		streams[i] = &pool.renderBuffer[i * ROUND_FRAME_COUNT * 2];
+	}
+	const double startSeconds = getProcessCPUSeconds();
+	mt32emu_render_engine_units_bit16s(pool.engine, &units[0], mt32emu_bit32u(units.size()), &streams[0], frameCount);
+	const double cpuSeconds = getProcessCPUSeconds() - startSeconds;
+	if (frameCount < MIN_COST_SAMPLE_FRAMES) return;
+	const double unitCost = cpuSeconds * pool.sampleRate / (double(frameCount) * units.size());
+	pool.unitCost += (unitCost - pool.unitCost) * COST_SMOOTHING;
+}
+
+// Renders all the units with a chord playing on every part to pre-warm the synths and to get an initial estimate
+// of the render cost, then brings them back to the state they were opened in.
+static void calibratePool(Pool &pool) {
+	std::vector<mt32emu_bit32u> units(pool.unitCount);
+	for (mt32emu_bit32u unit = 0; unit < pool.unitCount; unit++) {
+		units[unit] = unit;
+		const mt32emu_context context = mt32emu_get_engine_context(pool.engine, unit);
+		for (mt32emu_bit8u channel = 1; channel <= 9; channel++) {
+			for (mt32emu_bit8u key = 60; key <= 67; key += 7) {
+				mt32emu_play_msg_now(context, 0x7F0090 | (mt32emu_bit32u(key) << 8) | channel);
+			}
+		}
+	}
+	pool.unitCost = 0.0;
+	double cpuSeconds = 0.0;
+	mt32emu_bit32u framesLeft = pool.sampleRate * CALIBRATION_MILLIS / 1000;
+	mt32emu_bit32u totalFrames = 0;
+	while (framesLeft > 0) {
+		const mt32emu_bit32u frameCount = framesLeft < ROUND_FRAME_COUNT ? framesLeft : ROUND_FRAME_COUNT;
+		const double startSeconds = getProcessCPUSeconds();
+		renderUnits(pool, units, frameCount);
+		cpuSeconds += getProcessCPUSeconds() - startSeconds;
+		totalFrames += frameCount;
+		framesLeft -= frameCount;
+	}
+	pool.unitCost = cpuSeconds * pool.sampleRate / (double(totalFrames) * pool.unitCount);
+	for (mt32emu_bit32u unit = 0; unit < pool.unitCount; unit++) {
+		mt32emu_reset_to_open_state(mt32emu_get_engine_context(pool.engine, unit));
+	}
+}
+
+static Pool *createPool(const Options &options, const ROMData &roms, const char *spec) {
+	// <name>:<sample rate>:<unit count>[:<analog output mode>]
+	std::string specString = spec;
+	std::vector<std::string> fields;
+	size_t start = 0;
+	for (;;) {
+		const size_t end = specString.find(':', start);
+		fields.push_back(specString.substr(start, end == std::string::npos ? std::string::npos : end - start));
+		if (end == std::string::npos) break;
+		start = end + 1;
+	}
+	Pool *pool = new Pool;
+	pool->analogOutputMode = MT32EMU_AOM_COARSE;
+	bool valid = (fields.size() == 3 || fields.size() == 4) && !fields[0].empty();
+	if (valid) {
+		pool->name = fields[0];
+		pool->sampleRate = unsigned(atoi(fields[1].c_str()));
+		pool->unitCount = unsigned(atoi(fields[2].c_str()));
+		valid = pool->sampleRate >= 8000 && pool->sampleRate <= 192000 && pool->unitCount > 0;
+	}
+	if (valid && fields.size() == 4) {
+		pool->analogOutputMode = -1;
+		for (int i = 0; i < ANALOG_OUTPUT_MODE_COUNT; i++) {
+			if (fields[3] == ANALOG_OUTPUT_MODE_NAMES[i]) pool->analogOutputMode = i;
+		}
+		valid = pool->analogOutputMode >= 0;
+	}
+	if (!valid) {
+		fprintf(stderr, "Invalid pool specification: %s\n", spec);
+		delete pool;
+		return NULL;
+	}
+
+	mt32emu_report_handler_i reportHandler = { NULL };
+	pool->engine = mt32emu_create_engine(pool->unitCount, options.threadCount, reportHandler, NULL);
+	if (mt32emu_add_engine_rom_data(pool->engine, &roms.controlROM[0], roms.controlROM.size(), NULL) != MT32EMU_RC_ADDED_CONTROL_ROM
+		|| mt32emu_add_engine_rom_data(pool->engine, &roms.pcmROM[0], roms.pcmROM.size(), NULL) != MT32EMU_RC_ADDED_PCM_ROM)
+	{
+		fprintf(stderr, "Unrecognised ROMs.\n");
+		mt32emu_free_engine(pool->engine);
+		delete pool;
+		return NULL;
+	}
+	for (mt32emu_bit32u unit = 0; unit < pool->unitCount; unit++) {
+		const mt32emu_context context = mt32emu_get_engine_context(pool->engine, unit);
+		mt32emu_set_partial_count(context, options.partialCount);
+		mt32emu_set_analog_output_mode(context, mt32emu_analog_output_mode(pool->analogOutputMode));
+		mt32emu_set_stereo_output_samplerate(context, pool->sampleRate);
+		mt32emu_set_max_render_block_length(context, ROUND_FRAME_COUNT);
+		mt32emu_set_hot_memory_locking_enabled(context, options.lockMemory ? MT32EMU_BOOL_TRUE : MT32EMU_BOOL_FALSE);
+	}
+	if (mt32emu_open_engine(pool->engine) != MT32EMU_RC_OK) {
+		fprintf(stderr, "Unable to open the synths of pool %s.\n", pool->name.c_str());
+		mt32emu_free_engine(pool->engine);
+		delete pool;
+		return NULL;
+	}
+	bool memoryLocked = true;
+	for (mt32emu_bit32u unit = 0; unit < pool->unitCount; unit++) {
+		const mt32emu_context context = mt32emu_get_engine_context(pool->engine, unit);
+		mt32emu_set_midi_event_queue_size(context, MIDI_EVENT_QUEUE_SIZE);
+		if (!mt32emu_is_hot_memory_locked(context)) memoryLocked = false;
+	}
+	if (options.lockMemory && !memoryLocked) {
+		fprintf(stderr, "Pool %s: Unable to lock the synth memory into RAM, check RLIMIT_MEMLOCK (ulimit -l).\n", pool->name.c_str());
+	}
+	pool->sessions.assign(pool->unitCount, (Session *)NULL);
+	pool->activeSessionCount = 0;
+	pool->renderBuffer.resize(pool->unitCount * ROUND_FRAME_COUNT * 2);
+	calibratePool(*pool);
+	printf("Pool %s: %u units at %u Hz, analog output mode %s, %.1f%% of a CPU per unit\n", pool->name.c_str(), pool->unitCount,
+		mt32emu_get_actual_stereo_output_samplerate(mt32emu_get_engine_context(pool->engine, 0)),
+		ANALOG_OUTPUT_MODE_NAMES[pool->analogOutputMode], 100.0 * pool->unitCost);
+	return pool;
+}
+
+static void freePool(Pool *pool) {
+	mt32emu_free_engine(pool->engine);
+	delete pool;
+}
+
+static void releaseUnit(Session &session) {
+	if (session.pool == NULL) return;
+	Pool &pool = *session.pool;
+	const mt32emu_context context = mt32emu_get_engine_context(pool.engine, session.unit);
+	// Quicker than reopening the synth, so the unit is ready for the next session right away.
+	if (!mt32emu_reset_to_open_state(context)) {
+		fprintf(stderr, "Unable to reset unit %u of pool %s.\n", session.unit, pool.name.c_str());
+	}
+	pool.sessions[session.unit] = NULL;
+	pool.activeSessionCount--;
+	session.pool = NULL;
+	session.midi.clear();
+	session.finishing = false;
+	session.file.clear();
+}
+
+static void handleOpen(Session &session, const std::string &request, std::vector<Pool *> &pools, const Options &options) {
+	if (session.pool != NULL) {
+		sendMessage(session, FAIL_TAG, "session already open");
+		return;
+	}
+	// <pool name>[ <sample rate>]
+	const size_t separator = request.find(' ');
+	const std::string name = request.substr(0, separator);
+	const unsigned int sampleRate = separator == std::string::npos ? 0 : unsigned(atoi(request.c_str() + separator + 1));
+	Pool *pool = NULL;
+	for (size_t i = 0; i < pools.size(); i++) {
+		if (pools[i]->name == name && (sampleRate == 0 || pools[i]->sampleRate == sampleRate)) {
+			pool = pools[i];
+			break;
+		}
+	}
+	if (pool == NULL) {
+		sendMessage(session, FAIL_TAG, "no such pool");
+		return;
+	}
+	if (pool->activeSessionCount == pool->unitCount || getProjectedLoad(pools) + pool->unitCost > options.maxLoad) {
+		sendMessage(session, FAIL_TAG, "busy");
+		return;
+	}
+	mt32emu_bit32u unit = 0;
+	while (pool->sessions[unit] != NULL) unit++;
+	pool->sessions[unit] = &session;
+	pool->activeSessionCount++;
+	session.pool = pool;
+	session.unit = unit;
+	session.renderedFrameCount = 0;
+	session.requestedFrameCount = 0;
+	session.finishing = false;
+	char reply[16];
+	sprintf(reply, "%u", pool->sampleRate);
+	sendMessage(session, OKAY_TAG, reply);
+}
+
+// Returns false if the message is malformed, the connection is closed then.
+static bool handleMessage(Session &session, const char *tag, const mt32emu_bit8u *payload, mt32emu_bit32u length, std::vector<Pool *> &pools, const Options &options) {
+	if (memcmp(tag, OPEN_TAG, 4) == 0) {
+		handleOpen(session, std::string((const char *)payload, length), pools, options);
+		return true;
+	}
+	if (memcmp(tag, CLOSE_TAG, 4) == 0) {
+		releaseUnit(session);
+		session.closing = true;
+		return true;
+	}
+	if (session.pool == NULL) return false;
+	if (memcmp(tag, MIDI_TAG, 4) == 0) {
+		if (length < 4 || session.finishing) return false;
+		MidiChunk chunk;
+		chunk.timestamp = getBit32u(payload);
+		chunk.data.assign(payload + 4, payload + length);
+		// The chunks are played in order, so a timestamp earlier than that of the previous chunk is clamped.
+		if (!session.midi.empty() && chunk.timestamp < session.midi.back().timestamp) {
+			chunk.timestamp = session.midi.back().timestamp;
+		}
+		session.midi.push_back(chunk);
+		return true;
+	}
+	if (memcmp(tag, RENDER_TAG, 4) == 0) {
+		if (length != 4 || session.finishing) return false;
+		session.requestedFrameCount += getBit32u(payload);
+		return true;
+	}
+	if (memcmp(tag, DONE_TAG, 4) == 0) {
+		if (length != 4 || session.finishing) return false;
+		session.finishing = true;
+		session.tailFrameLimit = getBit32u(payload);
+		session.tailFrameCount = 0;
+		session.file.clear();
+		return true;
+	}
+	return false;
+}
+
+static bool readSocket(Session &session, std::vector<Pool *> &pools, const Options &options) {
+	mt32emu_bit8u buffer[65536];
+	const ssize_t readSize = recv(session.socket, buffer, sizeof(buffer), 0);
+	if (readSize == 0) return false;
+	if (readSize < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	session.input.insert(session.input.end(), buffer, buffer + readSize);
+	size_t offset = 0;
+	while (!session.closing && session.input.size() - offset >= MESSAGE_HEADER_LENGTH) {
+		const mt32emu_bit8u *header = &session.input[offset];
+		const mt32emu_bit32u length = getBit32u(header + 4);
+		if (length > MAX_MESSAGE_LENGTH) return false;
+		if (session.input.size() - offset < MESSAGE_HEADER_LENGTH + length) break;
+		if (!handleMessage(session, (const char *)header, header + MESSAGE_HEADER_LENGTH, length, pools, options)) return false;
+		offset += MESSAGE_HEADER_LENGTH + length;
+	}
+	session.input.erase(session.input.begin(), session.input.begin() + offset);
+	return true;
+}
+
+static bool writeSocket(Session &session) {
+	const ssize_t writtenSize = send(session.socket, session.output.data() + session.outputOffset, session.output.size() - session.outputOffset, 0);
+	if (writtenSize < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	session.outputOffset += size_t(writtenSize);
+	if (session.outputOffset == session.output.size()) {
+		session.output.clear();
+		session.outputOffset = 0;
+	}
+	return true;
+}
+
+static void completeFile(Session &session) {
+	std::string message;
+	putMessageHeader(message, WAVE_TAG, mt32emu_bit32u(44 + session.file.size()));
+	putWaveHeader(message, session.pool->sampleRate, mt32emu_bit32u(session.file.size()));
+	session.output += message;
+	session.output += session.file;
+	session.file.clear();
+	session.finishing = false;
+}
+
+// Returns the number of frames the session can be rendered in this round, or 0 if it has no work to do.
+static mt32emu_bit32u getPendingFrameCount(Session &session) {
+	if (session.output.size() - session.outputOffset > MAX_OUTPUT_BACKLOG) return 0;
+	if (session.finishing) {
+		const mt32emu_context context = mt32emu_get_engine_context(session.pool->engine, session.unit);
+		if (session.midi.empty() && (!mt32emu_is_active(context) || session.tailFrameCount >= session.tailFrameLimit)) {
+			completeFile(session);
+			return 0;
+		}
+		if (session.file.size() / 4 >= size_t(MAX_FILE_SECONDS) * session.pool->sampleRate) {
+			session.file.clear();
+			session.finishing = false;
+			sendMessage(session, FAIL_TAG, "file too long");
+			return 0;
+		}
+		return ROUND_FRAME_COUNT;
+	}
+	return session.requestedFrameCount < ROUND_FRAME_COUNT ? session.requestedFrameCount : ROUND_FRAME_COUNT;
+}
+
+// Renders a round of all the sessions of the pool that have work to do, concurrently. Returns true if any were rendered.
+static bool renderPool(Pool &pool) {
+	std::vector<mt32emu_bit32u> units;
+	mt32emu_bit32u frameCount = ROUND_FRAME_COUNT;
+	for (mt32emu_bit32u unit = 0; unit < pool.unitCount; unit++) {
+		Session *session = pool.sessions[unit];
+		if (session == NULL) continue;
+		const mt32emu_bit32u pendingFrameCount = getPendingFrameCount(*session);
+		if (pendingFrameCount == 0) continue;
+		units.push_back(unit);
+		if (pendingFrameCount < frameCount) frameCount = pendingFrameCount;
+	}
+	if (units.empty()) return false;
+
+	for (size_t i = 0; i < units.size(); i++) {
+		Session &session = *pool.sessions[units[i]];
+		const mt32emu_context context = mt32emu_get_engine_context(pool.engine, units[i]);
+		const mt32emu_bit32u roundEnd = session.renderedFrameCount + frameCount;
+		while (!session.midi.empty() && session.midi.front().timestamp < roundEnd) {
+			const MidiChunk &chunk = session.midi.front();
+			if (!chunk.data.empty()) {
+				const mt32emu_bit32u timestamp = mt32emu_convert_output_to_synth_timestamp(context, chunk.timestamp);
+				mt32emu_parse_stream_at(context, &chunk.data[0], mt32emu_bit32u(chunk.data.size()), timestamp);
+			}
+			session.midi.pop_front();
+		}
+	}
+	renderUnits(pool, units, frameCount);
+	for (size_t i = 0; i < units.size(); i++) {
+		Session &session = *pool.sessions[units[i]];
+		const mt32emu_bit16s *samples = &pool.renderBuffer[i * ROUND_FRAME_COUNT * 2];
+		session.renderedFrameCount += frameCount;
+		if (session.finishing) {
+			appendSamples(session.file, samples, frameCount << 1);
+			if (session.midi.empty()) session.tailFrameCount += frameCount;
+		} else {
+			putMessageHeader(session.output, AUDIO_TAG, frameCount << 2);
+			appendSamples(session.output, samples, frameCount << 1);
+			session.requestedFrameCount -= frameCount;
+		}
+	}
+	return true;
+}
+
+static int openListenSocket(unsigned int port) {
+	const int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+	if (listenSocket < 0) return -1;
+	int reuse = 1;
+	setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(listenSocket, (const sockaddr *)&address, sizeof(address)) != 0 || listen(listenSocket, LISTEN_BACKLOG) != 0) {
+		close(listenSocket);
+		return -1;
+	}
+	fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL) | O_NONBLOCK);
+	return listenSocket;
+}
+
+static void acceptSessions(int listenSocket, std::vector<Session *> &sessions) {
+	for (;;) {
+		const int clientSocket = accept(listenSocket, NULL, NULL);
+		if (clientSocket < 0) return;
+		fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL) | O_NONBLOCK);
+		Session *session = new Session;
+		session->socket = clientSocket;
+		session->outputOffset = 0;
+		session->closing = false;
+		session->pool = NULL;
+		session->unit = 0;
+		session->renderedFrameCount = 0;
+		session->requestedFrameCount = 0;
+		session->finishing = false;
+		session->tailFrameLimit = 0;
+		session->tailFrameCount = 0;
+		sessions.push_back(session);
+	}
+}
+
+static void closeSession(Session *session) {
+	releaseUnit(*session);
+	close(session->socket);
+	delete session;
+}
+
+static void serve(int listenSocket, std::vector<Pool *> &pools, const Options &options) {
+	std::vector<Session *> sessions;
+	std::vector<pollfd> pollFDs;
+	bool rendering = false;
+	while (!stopRequested) {
+		pollFDs.resize(sessions.size() + 1);
+		pollFDs[0].fd = listenSocket;
+		pollFDs[0].events = POLLIN;
+		for (size_t i = 0; i < sessions.size(); i++) {
+			pollFDs[i + 1].fd = sessions[i]->socket;
+			pollFDs[i + 1].events = (sessions[i]->closing ? 0 : POLLIN) | (sessions[i]->output.empty() ? 0 : POLLOUT);
+			pollFDs[i + 1].revents = 0;
+		}
+		// While there is rendering to do, the sockets are only checked between the rounds.
+		if (poll(&pollFDs[0], nfds_t(pollFDs.size()), rendering ? 0 : -1) < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+		for (size_t i = sessions.size(); i-- > 0;) {
+			Session *session = sessions[i];
+			const short revents = pollFDs[i + 1].revents;
+			bool alive = (revents & (POLLERR | POLLNVAL)) == 0;
+			if (alive && (revents & (POLLIN | POLLHUP))) alive = readSocket(*session, pools, options);
+			if (alive && (revents & POLLOUT)) alive = writeSocket(*session);
+			if (alive && session->closing && session->output.empty()) alive = false;
+			if (!alive) {
+				closeSession(session);
+				sessions.erase(sessions.begin() + i);
+			}
+		}
+		if (pollFDs[0].revents & POLLIN) acceptSessions(listenSocket, sessions);
+		rendering = false;
+		for (size_t i = 0; i < pools.size(); i++) {
+			if (renderPool(*pools[i])) rendering = true;
+		}
+	}
+	for (size_t i = 0; i < sessions.size(); i++) {
+		closeSession(sessions[i]);
+	}
+}
+
+static void printUsage(const char *programName) {
+	printf("Usage: %s [options]\n\n", programName);
+	printf("Options:\n");
+	printf("  -m, --rom-dir <directory>         Directory in which ROMs are stored (including trailing path separator)\n");
+	printf("  -l, --listen <port>               TCP port to accept clients on (default: %u)\n", DEFAULT_PORT);
+	printf("  -p, --pool <spec>                 Add a pool of synths, may be repeated (default: %s)\n", DEFAULT_POOL);
+	printf("                                    spec is <name>:<sample rate>:<units>[:<analog output mode>], the analog\n");
+	printf("                                    output mode is digital, coarse, accurate or oversampled (default: coarse)\n");
+	printf("  -t, --threads <count>             The number of threads used to render the units of each pool (default: 1)\n");
+	printf("  -x, --max-partials <count>        The maximum number of partials playing simultaneously (default: %u)\n", DEFAULT_MAX_PARTIALS);
+	printf("  -L, --max-load <cpus>             Refuse new sessions when the measured render cost of the sessions would\n");
+	printf("                                    exceed this number of CPUs when rendering in real time (default: threads)\n");
+	printf("  -k, --lock-memory                 Lock the memory the synths render from into RAM, using huge pages\n");
+	printf("                                    where available, so that rendering never page-faults\n");
+	printf("  -h, --help                        Show this help\n");
+}
+
+static bool isOption(const char *arg, const char *shortName, const char *longName) {
+	return strcmp(arg, shortName) == 0 || strcmp(arg, longName) == 0;
+}
+
+static bool parseUnsigned(const char *arg, unsigned int &value) {
+	char *end;
+	long parsedValue = strtol(arg, &end, 10);
+	if (*arg == '\0' || *end != '\0' || parsedValue < 1) return false;
+	value = unsigned(parsedValue);
+	return true;
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options) {
+	options.romDir = "";
+	options.port = DEFAULT_PORT;
+	options.threadCount = 1;
+	options.partialCount = DEFAULT_MAX_PARTIALS;
+	options.maxLoad = 0.0;
+	options.lockMemory = false;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (isOption(arg, "-h", "--help")) {
+			printUsage(argv[0]);
+			return false;
+		}
+		if (isOption(arg, "-k", "--lock-memory")) {
+			options.lockMemory = true;
+			continue;
+		}
+		if (i + 1 == argc) {
+			fprintf(stderr, "Unknown option or missing value: %s\n", arg);
+			return false;
+		}
+		const char *value = argv[++i];
+		bool valid = true;
+		if (isOption(arg, "-m", "--rom-dir")) {
+			options.romDir = value;
+		} else if (isOption(arg, "-l", "--listen")) {
+			valid = parseUnsigned(value, options.port) && options.port <= 65535;
+		} else if (isOption(arg, "-p", "--pool")) {
+			options.poolSpecs.push_back(value);
+		} else if (isOption(arg, "-t", "--threads")) {
+			valid = parseUnsigned(value, options.threadCount);
+		} else if (isOption(arg, "-x", "--max-partials")) {
+			valid = parseUnsigned(value, options.partialCount);
+		} else if (isOption(arg, "-L", "--max-load")) {
+			options.maxLoad = atof(value);
+			valid = options.maxLoad > 0.0;
+		} else {
+			fprintf(stderr, "Unknown option: %s\n", arg);
+			return false;
+		}
+		if (!valid) {
+			fprintf(stderr, "Invalid value for option %s: %s\n", arg, value);
+			return false;
+		}
+	}
+	if (options.poolSpecs.empty()) options.poolSpecs.push_back(DEFAULT_POOL);
+	if (options.maxLoad == 0.0) options.maxLoad = options.threadCount;
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	Options options;
+	printf("Munt MT32Emu Render Server. Version %s\n", VERSION);
+	printf("  Copyright (C) 2020 Jerome Fisher, Sergey V. Mikayev\n");
+	printf("Using Munt MT32Emu Library Version %s\n", mt32emu_get_library_version_string());
+	if (!parseOptions(argc, argv, options)) {
+		return -1;
+	}
+	ROMData roms;
+	if (!loadROMs(options.romDir, roms)) {
+		return 1;
+	}
+	std::vector<Pool *> pools;
+	for (size_t i = 0; i < options.poolSpecs.size(); i++) {
+		Pool *pool = createPool(options, roms, options.poolSpecs[i]);
+		if (pool == NULL) {
+			for (size_t j = 0; j < pools.size(); j++) freePool(pools[j]);
+			return 1;
+		}
+		pools.push_back(pool);
+	}
+	const int listenSocket = openListenSocket(options.port);
+	if (listenSocket < 0) {
+		fprintf(stderr, "Unable to listen on port %u: %s\n", options.port, strerror(errno));
+		for (size_t i = 0; i < pools.size(); i++) freePool(pools[i]);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, handleStopSignal);
+	signal(SIGTERM, handleStopSignal);
+	printf("Listening on port %u, admitting sessions up to %.1f CPUs of measured load\n", options.port, options.maxLoad);
+	fflush(stdout);
+
+	serve(listenSocket, pools, options);
+
+	close(listenSocket);
+	for (size_t i = 0; i < pools.size(); i++) {
+		freePool(pools[i]);
+	}
+	return 0;
+}
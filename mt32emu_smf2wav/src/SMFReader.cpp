@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2012-2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "SMFReader.h"
+
+using namespace MT32Emu;
+
+static const unsigned int CHUNK_HEADER_SIZE = 8;
+static const unsigned int MTHD_LENGTH = 6;
+static const Bit32u DEFAULT_MICROSECONDS_PER_QUARTER_NOTE = 500000;
+static const Bit8u META_END_OF_TRACK = 0x2F;
+static const Bit8u META_SET_TEMPO = 0x51;
+
+static Bit32u getUInt32BE(const Bit8u *data) {
+	return (Bit32u(data[0]) << 24) | (Bit32u(data[1]) << 16) | (Bit32u(data[2]) << 8) | data[3];
+}
+
+static unsigned int getUInt16BE(const Bit8u *data) {
+	return (data[0] << 8) | data[1];
+}
+
+// Reads a variable length quantity of up to 4 bytes, returns false if it doesn't fit the buffer.
+static bool readVLQ(const Bit8u *&data, const Bit8u *end, Bit32u &value) {
+	value = 0;
+	for (int i = 0; i < 4; i++) {
+		if (data >= end) return false;
+		Bit8u c = *(data++);
+		value = (value << 7) | (c & 0x7F);
+		if ((c & 0x80) == 0) return true;
+	}
+	return false;
+}
+
+// Returns the length of a MIDI message including the status byte, or 0 for status bytes that may not appear in SMF.
+static unsigned int getMessageLength(Bit8u status) {
+	switch (status & 0xF0) {
+	case 0xC0:
+	case 0xD0:
+		return 2;
+	case 0xF0:
+		break;
+	default:
+		return 3;
+	}
+	switch (status) {
+	case 0xF2:
+		return 3;
+	case 0xF1:
+	case 0xF3:
+		return 2;
+	case 0xF6:
+	case 0xF8:
+	case 0xF9:
+	case 0xFA:
+	case 0xFB:
+	case 0xFC:
+	case 0xFE:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+SMFReader::SMFReader() :
+	format(0), division(0), lengthSeconds(0.0), tempoTick(0), tempoSeconds(0.0),
+	microsecondsPerQuarterNote(DEFAULT_MICROSECONDS_PER_QUARTER_NOTE)
+{}
+
+bool SMFReader::load(const Bit8u *fileBuffer, size_t fileBufferLength) {
+	tracks.clear();
+	trackHeap.clear();
+	if (fileBufferLength < CHUNK_HEADER_SIZE + MTHD_LENGTH || memcmp(fileBuffer, "MThd", 4) != 0) {
+		fprintf(stderr, "SMF error: MThd signature not found, is that a MIDI file?\n");
+		return false;
+	}
+	Bit32u headerLength = getUInt32BE(fileBuffer + 4);
+	if (headerLength < MTHD_LENGTH || fileBufferLength - CHUNK_HEADER_SIZE < headerLength) {
+		fprintf(stderr, "SMF error: MThd chunk length %u, must be 6.\n", headerLength);
+		return false;
+	}
+	format = getUInt16BE(fileBuffer + 8);
+	unsigned int expectedTrackCount = getUInt16BE(fileBuffer + 10);
+	division = getUInt16BE(fileBuffer + 12);
+	if (format > 1) {
+		fprintf(stderr, "SMF error: MThd format %u is not supported.\n", format);
+		return false;
+	}
+	if (expectedTrackCount == 0) {
+		fprintf(stderr, "SMF error: bad number of tracks: 0, must be greater than zero.\n");
+		return false;
+	}
+	if (division == 0 || division >= 0x8000) {
+		fprintf(stderr, "SMF error: division %u is not supported, only PPQN timing is.\n", division);
+		return false;
+	}
+
+	// Chunks of unknown types are skipped, the track chunks are only located here.
+	const Bit8u *fileEnd = fileBuffer + fileBufferLength;
+	const Bit8u *chunk = fileBuffer + CHUNK_HEADER_SIZE + headerLength;
+	while (tracks.size() < expectedTrackCount && size_t(fileEnd - chunk) >= CHUNK_HEADER_SIZE) {
+		Bit32u chunkLength = getUInt32BE(chunk + 4);
+		const Bit8u *chunkData = chunk + CHUNK_HEADER_SIZE;
+		if (size_t(fileEnd - chunkData) < chunkLength) {
+			fprintf(stderr, "SMF warning: malformed chunk; truncated file?\n");
+			chunkLength = Bit32u(fileEnd - chunkData);
+		}
+		if (memcmp(chunk, "MTrk", 4) == 0) {
+			Track track = {chunkData, chunkData + chunkLength, chunkData, 0, false};
+			tracks.push_back(track);
+		}
+		chunk = chunkData + chunkLength;
+	}
+	if (tracks.empty()) {
+		fprintf(stderr, "SMF error: no tracks found.\n");
+		return false;
+	}
+	if (tracks.size() != expectedTrackCount) {
+		fprintf(stderr, "SMF warning: MThd header declared %u tracks, but only %u found; continuing anyway.\n", expectedTrackCount, getTrackCount());
+	}
+
+	// Go through all the events once, so that the malformed ones are reported just here and the tracks are cut short before them.
+	rewind();
+	SMFEvent event;
+	while (nextEvent(event, true)) {
+		lengthSeconds = event.timeSeconds;
+	}
+	rewind();
+	return true;
+}
+
+void SMFReader::rewind() {
+	trackHeap.clear();
+	for (unsigned int trackIx = 0; trackIx < tracks.size(); trackIx++) {
+		Track &track = tracks[trackIx];
+		track.position = track.start;
+		track.runningStatus = 0;
+		track.unterminatedSysex = false;
+		Bit32u deltaTime;
+		if (!readVLQ(track.position, track.end, deltaTime)) {
+			track.end = track.start;
+			continue;
+		}
+		TrackPosition position = {deltaTime, trackIx};
+		trackHeap.push_back(position);
+	}
+	std::make_heap(trackHeap.begin(), trackHeap.end(), isLater);
+	tempoTick = 0;
+	tempoSeconds = 0.0;
+	microsecondsPerQuarterNote = DEFAULT_MICROSECONDS_PER_QUARTER_NOTE;
+}
+
+bool SMFReader::nextEvent(SMFEvent &event) {
+	return nextEvent(event, false);
+}
+
+double SMFReader::getLengthSeconds() const {
+	return lengthSeconds;
+}
+
+unsigned int SMFReader::getFormat() const {
+	return format;
+}
+
+unsigned int SMFReader::getTrackCount() const {
+	return (unsigned int)tracks.size();
+}
+
+unsigned int SMFReader::getDivision() const {
+	return division;
+}
+
+bool SMFReader::isLater(const TrackPosition &a, const TrackPosition &b) {
+	return b.tick < a.tick || (a.tick == b.tick && b.trackIx < a.trackIx);
+}
+
+bool SMFReader::nextEvent(SMFEvent &event, bool reportErrors) {
+	while (!trackHeap.empty()) {
+		std::pop_heap(trackHeap.begin(), trackHeap.end(), isLater);
+		TrackPosition &trackPosition = trackHeap.back();
+		Track &track = tracks[trackPosition.trackIx];
+		const Bit8u *eventStart = track.position;
+		const Bit8u *data = eventStart;
+		bool decoded = data < track.end;
+		if (decoded) {
+			Bit8u status = *data;
+			if (status < 0x80) {
+				// Running status, which only channel messages set. The sysex and meta events are tolerated in between.
+				status = track.runningStatus;
+			} else {
+				data++;
+			}
+			Bit32u length;
+			switch (status) {
+			case 0x00:
+				decoded = false;
+				break;
+			case 0xF0:
+			case 0xF7:
+			case 0xFF:
+				if (status == 0xFF) {
+					decoded = data < track.end;
+					if (!decoded) break;
+					event.type = SMFEventType_META;
+					event.metaType = *(data++);
+				} else if (status == 0xF0) {
+					event.type = SMFEventType_SYSEX;
+				} else {
+					event.type = track.unterminatedSysex ? SMFEventType_SYSEX_CONTINUATION : SMFEventType_ESCAPED;
+				}
+				decoded = readVLQ(data, track.end, length) && length <= Bit32u(track.end - data)
+					&& (length > 0 || status != 0xF7);
+				if (!decoded) break;
+				event.data = data;
+				event.dataLength = length;
+				data += length;
+				if (event.type != SMFEventType_META && event.type != SMFEventType_ESCAPED) {
+					track.unterminatedSysex = length == 0 || data[-1] != 0xF7;
+				}
+				break;
+			default:
+				length = getMessageLength(status);
+				decoded = length > 0 && length - 1 <= Bit32u(track.end - data);
+				if (!decoded) break;
+				event.type = SMFEventType_SHORT_MESSAGE;
+				event.shortMessage = status;
+				for (Bit32u i = 1; i < length; i++) {
+					event.shortMessage |= Bit32u(*(data++)) << (8 * i);
+				}
+				if (status < 0xF0) {
+					track.runningStatus = status;
+				}
+				break;
+			}
+		}
+		if (!decoded) {
+			if (reportErrors && eventStart < track.end) {
+				fprintf(stderr, "SMF warning: unable to parse MIDI event in track %u; truncating track.\n", trackPosition.trackIx + 1);
+			}
+			track.end = eventStart;
+			trackHeap.pop_back();
+			continue;
+		}
+		event.timeSeconds = ticksToSeconds(trackPosition.tick);
+		if (event.type == SMFEventType_META && event.metaType == META_SET_TEMPO && event.dataLength >= 3) {
+			Bit32u tempo = (Bit32u(event.data[0]) << 16) | (Bit32u(event.data[1]) << 8) | event.data[2];
+			if (tempo > 0) {
+				tempoSeconds = event.timeSeconds;
+				tempoTick = trackPosition.tick;
+				microsecondsPerQuarterNote = tempo;
+			}
+		}
+		track.position = data;
+		Bit32u deltaTime;
+		bool endOfTrack = event.type == SMFEventType_META && event.metaType == META_END_OF_TRACK;
+		if (!endOfTrack && readVLQ(track.position, track.end, deltaTime)) {
+			trackPosition.tick += deltaTime;
+			std::push_heap(trackHeap.begin(), trackHeap.end(), isLater);
+		} else {
+			if (!endOfTrack && reportErrors && data < track.end) {
+				fprintf(stderr, "SMF warning: unable to parse MIDI event in track %u; truncating track.\n", trackPosition.trackIx + 1);
+			}
+			track.end = data;
+			trackHeap.pop_back();
+		}
+		return true;
+	}
+	return false;
+}
+
+double SMFReader::ticksToSeconds(unsigned long tick) const {
+	return tempoSeconds + double(tick - tempoTick) * (microsecondsPerQuarterNote / (double(division) * 1000000.0));
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2012-2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SMF_READER_H
+#define SMF_READER_H
+
+#include <cstddef>
+#include <vector>
+
+#include <mt32emu/mt32emu.h>
+
+enum SMFEventType {
+	SMFEventType_SHORT_MESSAGE,
+	// Starts a sysex message, the data excludes the leading 0xF0 status byte.
+	SMFEventType_SYSEX,
+	// Follows a sysex event which is not terminated with 0xF7 byte.
+	SMFEventType_SYSEX_CONTINUATION,
+	// Any other data that is sent as is, typically a system realtime message.
+	SMFEventType_ESCAPED,
+	SMFEventType_META
+};
+
+struct SMFEvent {
+	SMFEventType type;
+	double timeSeconds;
+	// For short messages, the message packed as the synth expects it, the status byte in the least significant byte.
+	MT32Emu::Bit32u shortMessage;
+	// For meta events, the type of the event.
+	MT32Emu::Bit8u metaType;
+	// The data of the sysex, escaped and meta events. Points into the file buffer.
+	const MT32Emu::Bit8u *data;
+	MT32Emu::Bit32u dataLength;
+};
+
+// Reads the events of a Standard MIDI File from a buffer that holds the entire file, merged in the order of time.
+// The events are decoded lazily as they are requested, the reader merely keeps the position in each track,
+// so that even huge files are read without allocating memory for each event. When loaded, the file is read through once
+// to check the tracks and find the length. The buffer must stay valid while the reader is in use. Copies of the reader
+// are independent and cheap to make.
+class SMFReader {
+public:
+	SMFReader();
+
+	// Locates the tracks in the buffer and rewinds. Returns false if the buffer doesn't contain a supported SMF.
+	bool load(const MT32Emu::Bit8u *fileBuffer, size_t fileBufferLength);
+	void rewind();
+	// Decodes the next event, returns false when there are no more events.
+	bool nextEvent(SMFEvent &event);
+	// Returns the time of the last event.
+	double getLengthSeconds() const;
+
+	unsigned int getFormat() const;
+	unsigned int getTrackCount() const;
+	unsigned int getDivision() const;
+
+private:
+	struct Track {
+		const MT32Emu::Bit8u *start;
+		// Moved back to the first malformed event when the file is loaded, so that the track ends there.
+		const MT32Emu::Bit8u *end;
+		const MT32Emu::Bit8u *position;
+		MT32Emu::Bit8u runningStatus;
+		bool unterminatedSysex;
+	};
+
+	struct TrackPosition {
+		// Absolute time of the next event of the track in ticks.
+		unsigned long tick;
+		unsigned int trackIx;
+	};
+
+	unsigned int format;
+	unsigned int division;
+	std::vector<Track> tracks;
+	// Min-heap of the tracks that have more events, ordered by the time of the next event and then by the track index.
+	std::vector<TrackPosition> trackHeap;
+	double lengthSeconds;
+
+	// The last tempo change, which the time of the following events is computed from.
+	unsigned long tempoTick;
+	double tempoSeconds;
+	MT32Emu::Bit32u microsecondsPerQuarterNote;
+
+	static bool isLater(const TrackPosition &a, const TrackPosition &b);
+
+	bool nextEvent(SMFEvent &event, bool reportErrors);
+	double ticksToSeconds(unsigned long tick) const;
+};
+
+#endif
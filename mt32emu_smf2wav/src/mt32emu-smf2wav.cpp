@@ -16,7 +16,6 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <cassert>
 #include <cerrno>
 #include <cfloat>
 #include <climits>
@@ -39,26 +38,78 @@
 #error Binary floating point support required
 #endif
 
-#include "smf.h"
+#ifdef WITH_FLAC
+#include <FLAC/stream_encoder.h>
+#endif
+
+#include "SMFReader.h"
 
 static const int DEFAULT_BUFFER_SIZE = 128 * 1024;
 
 // Maximum number of frames to render in each pass while waiting for reverb to become inactive.
 static const unsigned int MAX_REVERB_END_FRAMES = 8192;
 
+// 30 seconds at the native sample rate.
+static const int DEFAULT_CHECKPOINT_INTERVAL = 30 * 32000;
+
+static const char CHECKPOINT_MAGIC[8] = {'S', 'M', 'F', '2', 'W', 'V', 'C', '2'};
+static const unsigned int CHECKPOINT_HEADER_SIZE = sizeof(CHECKPOINT_MAGIC) + 8 * 4;
+static const char CHECKPOINT_FILENAME_FORMAT[] = "smf2wav-checkpoint-%lu.state";
+// The copy of each SMF file played while storing checkpoints, which the file is compared with when re-rendered incrementally.
+static const char CHECKPOINT_INPUT_FILENAME_FORMAT[] = "smf2wav-input-%u.mid";
+
 static const int HEADEROFFS_RIFFLEN = 4;
 static const int HEADEROFFS_FORMAT_TAG = 20;
+static const int HEADEROFFS_CHANNEL_COUNT = 22;
 static const int HEADEROFFS_SAMPLERATE = 24;
 static const int HEADEROFFS_BYTERATE = 28;
 static const int HEADEROFFS_BLOCK_ALIGN = 32;
 static const int HEADEROFFS_BIT_DEPTH = 34;
 static const int HEADEROFFS_DATALEN = 40;
+static const long WAVE_HEADER_SIZE = 44;
+
+// The output is handed over to a separate thread in blocks of this size, so that rendering overlaps with writing or encoding.
+// Large blocks also keep the number of write requests low, which matters on network storage.
+static const size_t OUTPUT_BLOCK_SIZE = 1024 * 1024;
+// Limits the amount of output buffered when the output thread can't keep up with rendering.
+static const unsigned int OUTPUT_BLOCK_COUNT = 4;
+
+#ifdef WITH_FLAC
+static const unsigned int FLAC_COMPRESSION_LEVEL = 5;
+#endif
+
+// In the preview mode, partials are culled below this TVA level (about -48 dB) unless another level is specified.
+static const MT32Emu::Bit8u PREVIEW_PARTIAL_CULLING_LEVEL = 128;
+// In the preview mode, reduced reverb stops processing once its tail decays to about -48 dB.
+static const float PREVIEW_REVERB_SILENCE_THRESHOLD = 0.004f;
+
+enum PREVIEW_REVERB {
+	PREVIEW_REVERB_FULL = 0,
+	PREVIEW_REVERB_REDUCED = 1,
+	PREVIEW_REVERB_DISABLED = 2
+};
 
 enum OUTPUT_SAMPLE_FORMAT {
 	OUTPUT_SAMPLE_FORMAT_SINT16 = 0,
 	OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 = 1
 };
 
+enum SPLIT_STREAMS {
+	SPLIT_STREAMS_NONE = 0,
+	SPLIT_STREAMS_RAW = 1,
+	SPLIT_STREAMS_WAVE = 2
+};
+
+// Inserted into the output file name before the extension when the raw streams are written to separate files.
+static const char * const STREAM_FILENAME_SUFFIXES[] = {
+	"la32-left",
+	"la32-right",
+	"reverb-dry-left",
+	"reverb-dry-right",
+	"reverb-wet-left",
+	"reverb-wet-right"
+};
+
 static const MT32Emu::DACInputMode DAC_INPUT_MODES[] = {
 	MT32Emu::DACInputMode_NICE,
 	MT32Emu::DACInputMode_PURE,
@@ -90,8 +141,19 @@ struct Options {
 	gchar *outputFilename;
 	gboolean force;
 	gboolean quiet;
+	gboolean batch;
+	gboolean flac;
+	gchar *manifestFilename;
+	unsigned int shardIndex;
+	unsigned int shardCount;
 
 	gchar *romDir;
+	gchar *romCacheDir;
+	gchar *renderCacheDir;
+	gchar *checkpointDir;
+	unsigned int checkpointIntervalFrames;
+	gboolean incremental;
+	unsigned int jobCount;
 	unsigned int bufferFrameCount;
 	gint sampleRate;
 	OUTPUT_SAMPLE_FORMAT outputSampleFormat;
@@ -101,9 +163,12 @@ struct Options {
 	MT32Emu::RendererType rendererType;
 	MT32Emu::SamplerateConversionQuality srcQuality;
 	int partialCount;
+	MT32Emu::Bit8u partialCullingLevel;
 	int rawChannelMap[8];
 	int rawChannelCount;
+	SPLIT_STREAMS splitStreams;
 
+	unsigned int renderStartFrames;
 	unsigned int renderMinFrames;
 	unsigned int renderMaxFrames;
 	gint recordMaxStartSilentFrames;
@@ -113,18 +178,62 @@ struct Options {
 	gboolean waitForReverb;
 	gboolean sendAllNotesOff;
 	gboolean niceAmpRamp;
+	gboolean preview;
+	PREVIEW_REVERB previewReverb;
+	gboolean benchmark;
+	gchar *benchmarkJSONFilename;
+};
+
+// Describes the position in the input files where rendering is resumed from after the synth state is restored from a checkpoint.
+struct Checkpoint {
+	MT32Emu::Bit8u *fileBuffer;
+	unsigned int inputFileIx;
+	unsigned long eventCount;
+	unsigned long smfRenderedFrames;
+	unsigned long renderedFrames;
+	// The recording state at the checkpoint, which lets an incremental re-render continue the previous output.
+	unsigned long writtenFrames;
+	unsigned long unwrittenSilentFrames;
+	bool firstNoiseEncountered;
+	const MT32Emu::Bit8u *unterminatedSysex;
+	unsigned int unterminatedSysexLen;
+	const MT32Emu::Bit8u *synthState;
+	gsize synthStateSize;
+};
+
+struct Output;
+struct IncrementalRender;
+
+// Timing of the render passes in the benchmark mode, in microseconds.
+struct BenchmarkTiming {
+	unsigned long passCount;
+	unsigned long frameCount;
+	gint64 totalTime;
+	gint64 maxPassTime;
 };
 
 struct State {
 	void *stereoSampleBuffer;
 	void *rawSampleBuffer[6];
 	MT32Emu::Service &service;
-	FILE *outputFile;
+	Output *output;
+	// Only set when the raw streams are written to separate files, in the order of raw-stream options. The entries
+	// of the dummy streams are NULL. The output is NULL then.
+	Output **streamOutputs;
 	bool lastInputFile;
 	bool firstNoiseEncountered;
 	unsigned long unwrittenSilentFrames;
 	unsigned long renderedFrames;
 	unsigned long writtenFrames;
+	unsigned int inputFileIx;
+	unsigned long nextCheckpointFrame;
+	const Checkpoint *checkpoint;
+	// When set, the rendered samples are stored there as is, to be recorded after the preceding segments.
+	FILE *segmentFile;
+	// Only set in the benchmark mode, the output is NULL then and the rendered samples are discarded.
+	BenchmarkTiming *benchmarkTiming;
+	// Only set when re-rendering incrementally.
+	IncrementalRender *incremental;
 };
 
 static void freeOptions(Options *options) {
@@ -132,8 +241,18 @@ static void freeOptions(Options *options) {
 	options->inputFilenames = NULL;
 	g_free(options->outputFilename);
 	options->outputFilename = NULL;
+	g_free(options->manifestFilename);
+	options->manifestFilename = NULL;
 	g_free(options->romDir);
 	options->romDir = NULL;
+	g_free(options->romCacheDir);
+	options->romCacheDir = NULL;
+	g_free(options->renderCacheDir);
+	options->renderCacheDir = NULL;
+	g_free(options->checkpointDir);
+	options->checkpointDir = NULL;
+	g_free(options->benchmarkJSONFilename);
+	options->benchmarkJSONFilename = NULL;
 }
 
 static bool parseOptions(int argc, char *argv[], Options *options) {
@@ -142,18 +261,34 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 	gint rendererTypeIx = 0;
 	gint srcQualityIx = 2;
 	gint partialCount = MT32Emu::DEFAULT_MAX_PARTIALS;
+	gint partialCullingLevel = 0;
+	gint previewReverb = PREVIEW_REVERB_REDUCED;
 	gint outputSampleFormat = OUTPUT_SAMPLE_FORMAT_SINT16;
+	gint splitStreams = SPLIT_STREAMS_NONE;
 	gint bufferFrameCount = DEFAULT_BUFFER_SIZE;
+	gint checkpointIntervalFrames = DEFAULT_CHECKPOINT_INTERVAL;
+	gint jobCount = -1;
+	gint renderStartFrames = 0;
 	gint renderMinFrames = 0;
 	gint renderMaxFrames = -1;
 	gchar **rawStreams = NULL;
+	gchar *shard = NULL;
 	gchar *deprecatedSysexFile = NULL;
 	options->inputFilenames = NULL;
 	options->outputFilename = NULL;
 	options->force = false;
 	options->quiet = false;
+	options->batch = false;
+	options->flac = false;
+	options->manifestFilename = NULL;
+	options->shardIndex = 0;
+	options->shardCount = 1;
 
 	options->romDir = NULL;
+	options->romCacheDir = NULL;
+	options->renderCacheDir = NULL;
+	options->checkpointDir = NULL;
+	options->incremental = false;
 
 	options->dacInputMode = DAC_INPUT_MODES[0];
 	options->analogOutputMode = ANALOG_OUTPUT_MODES[0];
@@ -161,6 +296,7 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 	options->srcQuality = SRC_QUALITIES[2];
 	options->sampleRate = 0;
 	options->rawChannelCount = 0;
+	options->splitStreams = SPLIT_STREAMS_NONE;
 	options->outputSampleFormat = OUTPUT_SAMPLE_FORMAT_SINT16;
 
 	options->recordMaxStartSilentFrames = 0;
@@ -170,13 +306,36 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 	options->waitForReverb = true;
 	options->sendAllNotesOff = true;
 	options->niceAmpRamp = true;
+	options->preview = false;
+	options->benchmark = false;
+	options->benchmarkJSONFilename = NULL;
 	// FIXME: Perhaps there's a nicer way to represent long argument descriptions...
 	GOptionEntry entries[] = {
-		{"output", 'o', 0, G_OPTION_ARG_FILENAME, &options->outputFilename, "Output file (default: last source file name with \".wav\" appended)", "<filename>"},
+		{"output", 'o', 0, G_OPTION_ARG_FILENAME, &options->outputFilename, "Output file (default: last source file name with \".wav\" or \".flac\" appended)", "<filename>"},
 		{"force", 'f', 0, G_OPTION_ARG_NONE, &options->force, "Overwrite the output file if it already exists", NULL},
 		{"quiet", 'q', 0, G_OPTION_ARG_NONE, &options->quiet, "Be quiet", NULL},
+		{"batch", 0, 0, G_OPTION_ARG_NONE, &options->batch, "Convert each source file to a separate output file named after it with \".wav\" appended, several files at a time (see jobs)\n"
+		 "                If output is specified, it is the directory to store the output files in. Checkpoints are not used in this mode", NULL},
+		{"manifest", 0, 0, G_OPTION_ARG_FILENAME, &options->manifestFilename, "Convert the files listed in this manifest in batch mode instead of the source files given.\n"
+		 "                Each line describes a job with tab-separated fields: the source file, optionally the output file\n"
+		 "                (empty for the default name) and any number of settings in the form name=value, which override\n"
+		 "                the options of the same name for the job: render-min, render-max, record-max-start-silence,\n"
+		 "                record-max-end-silence, record-max-la32-end-silence, wait-for-la32, wait-for-reverb and\n"
+		 "                send-all-notes-off (the last three take 0 or 1). Empty lines and lines starting with # are ignored.\n"
+		 "                A status file named after the output file with \".done\" appended is written when a job succeeds,\n"
+		 "                and the jobs which have one are skipped, so a restarted conversion resumes with the unfinished jobs.\n"
+		 "                The output of an interrupted job is only overwritten with force", "<filename>"},
+		{"shard", 0, 0, G_OPTION_ARG_STRING, &shard, "In batch mode, only convert the share of the files assigned to shard i of N (1 <= i <= N).\n"
+		 "                The files are assigned to the shards deterministically, balanced by file size, so that the invocations\n"
+		 "                for all the shards, e.g. on different machines, convert each file exactly once", "<i/N>"},
+		{"flac", 0, 0, G_OPTION_ARG_NONE, &options->flac, "Write a FLAC file instead of a WAVE file. Encoding runs in a separate thread alongside rendering.\n"
+		 "                The samples are stored with 24-bit resolution when output-sample-format is 1", NULL},
 
 		{"rom-dir", 'm', 0, G_OPTION_ARG_STRING, &options->romDir, "Directory in which ROMs are stored (including trailing path separator)", "<directory>"},
+		{"rom-cache-dir", 0, 0, G_OPTION_ARG_STRING, &options->romCacheDir, "Directory to cache the decoded PCM ROM in to speed up startup (including trailing path separator)", "<directory>"},
+		{"render-cache-dir", 0, 0, G_OPTION_ARG_FILENAME, &options->renderCacheDir, "Directory to cache the output files in. The output is copied from the cache instead of rendering\n"
+		 "                when the contents of the source files, the ROMs, the library and program versions and all the options\n"
+		 "                affecting the output match a previous conversion. The hits and misses are reported at the end", "<directory>"},
 		// buffer-size determines the maximum number of frames to be rendered by the emulator in one pass.
 		// This can have a big impact on performance (Generally more at a time=better).
 		{"buffer-size", 'b', 0, G_OPTION_ARG_INT, &bufferFrameCount, "Buffer size in frames (minimum: 1)", "<frame_count>"},  // FIXME: Show default
@@ -192,6 +351,10 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 		{"max-partials", 'x', 0, G_OPTION_ARG_INT, &partialCount, "The maximum number of partials playing simultaneously.\n"
 		 "                (minimum: 8, default: 32)\n", "<max-partials>"},
 
+		{"partial-culling-level", 0, 0, G_OPTION_ARG_INT, &partialCullingLevel, "Skip generating the waves of partials while their TVA level stays below this level,\n"
+		 "                which speeds up rendering at the expense of accuracy. Each level step is about 0.375 dB.\n"
+		 "                (minimum: 0, maximum: 255, default: 0 - disabled)\n", "<level>"},
+
 		{"analog-output-mode", 'a', 0, G_OPTION_ARG_INT, &analogOutputModeIx, "Analogue low-pass filter emulation mode (default: 0)\n"
 		 "                Ignored if -w is used (in which case 0/DISABLED is always used)\n"
 		 "                 0: DISABLED\n"
@@ -223,7 +386,28 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 		 "                 3: [LA32] Right reverb dry\n"
 		 "                 4: [Reverb] Left reverb wet\n"
 		 "                 5: [Reverb] Right reverb wet", "<stream_id>"},
-
+		{"split-streams", 0, 0, G_OPTION_ARG_INT, &splitStreams, "Write each stream specified with raw-stream to a separate mono file rather than multiplexing them (default: 0)\n"
+		 "                The files are named after the output file with the stream name inserted before the extension, e.g. \".la32-left.wav\".\n"
+		 "                Dummy streams are not written, and the silence is only skipped where all the streams are silent.\n"
+		 "                 0: Disabled\n"
+		 "                 1: Raw files with big-endian samples\n"
+		 "                 2: WAVE files", "<split_streams>"},
+
+		{"checkpoint-dir", 0, 0, G_OPTION_ARG_FILENAME, &options->checkpointDir, "Directory to store checkpoints of the synth state in while rendering SMF files (including trailing path separator)\n"
+		 "                The checkpoints are only valid for the same input files and options, and they are not used when the sample rate is converted", "<directory>"},
+		{"checkpoint-interval", 0, 0, G_OPTION_ARG_INT, &checkpointIntervalFrames, "Store a checkpoint every this many frames (minimum: 1, default: 960000)", "<frame_count>"},
+		{"incremental", 0, 0, G_OPTION_ARG_NONE, &options->incremental, "Re-render an edited SMF file to the output file of its previous conversion, which stored the checkpoints\n"
+		 "                and a copy of the SMF file in checkpoint-dir. Rendering resumes at the last checkpoint preceding the first changed\n"
+		 "                event and stops once the synth state converges with the previous conversion at a later checkpoint.\n"
+		 "                The unchanged audio before and after is copied from the previous output. Requires a single source file,\n"
+		 "                checkpoint-dir and WAVE or raw output, and the other options must be the same as before", NULL},
+		{"jobs", 'j', 0, G_OPTION_ARG_INT, &jobCount, "Render each SMF file in this many segments concurrently (minimum: 1, default: 1)\n"
+		 "                The segments start at the checkpoints stored in checkpoint-dir by a previous conversion, so the output is identical.\n"
+		 "                Without suitable checkpoints, the file is rendered serially, and a warning is printed.\n"
+		 "                In batch mode, this is the number of files converted concurrently instead (default: the number of processors)", "<job_count>"},
+		{"render-start", 0, 0, G_OPTION_ARG_INT, &renderStartFrames, "Start recording at this frame, the preceding frames are rendered but discarded (default: 0)\n"
+		 "                Rendering is fast-forwarded to the nearest preceding checkpoint found in checkpoint-dir, if any.\n"
+		 "                This allows re-rendering a section or resuming an interrupted conversion into a separate file quickly", "<frame_count>"},
 		{"render-min", 0, 0, G_OPTION_ARG_INT, &renderMinFrames, "Render at least this many frames (default: 0) (NYI)", "<frame_count>"},
 		{"render-max", 'e', 0, G_OPTION_ARG_INT, &renderMaxFrames, "Render at most this many frames (default: -1)", "<frame_count>|-1 (unlimited)"},
 		{"record-max-start-silence", 0, 0, G_OPTION_ARG_INT, &options->recordMaxStartSilentFrames, "Record at most this many silent frames at the start of each SMF file (default: 0)", "<frame_count>|-1 (unlimited)"},
@@ -236,6 +420,19 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 		{"no-nice-amp-ramp", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &options->niceAmpRamp, "Emulate amplitude ramp accurately.\n"
 		 "                Quick changes of volume or expression on a MIDI channel may result in amp jumps which are avoided by default.", NULL},
 
+		{"preview", 0, 0, G_OPTION_ARG_NONE, &options->preview, "Render a draft for quick auditioning, trading emulation accuracy for speed.\n"
+		 "                Uses the float renderer with fast wave functions, partial culling (unless partial-culling-level is specified),\n"
+		 "                no analogue low-pass filter and the fastest sample rate conversion. Overrides the respective options", NULL},
+		{"preview-reverb", 0, 0, G_OPTION_ARG_INT, &previewReverb, "Reverb processing in the preview mode (default: 1)\n"
+		 "                 0: Full\n"
+		 "                 1: Reduced, the reverb tail is cut short\n"
+		 "                 2: Disabled", "<preview_reverb>"},
+
+		{"benchmark", 0, 0, G_OPTION_ARG_NONE, &options->benchmark, "Render the source files without writing any output and report the rendering performance for each SMF file:\n"
+		 "                the realtime factor, frames per second, mean and peak time per render pass (see buffer-size)\n"
+		 "                and the time spent in each rendering stage when the library is built with render statistics", NULL},
+		{"benchmark-json", 0, 0, G_OPTION_ARG_FILENAME, &options->benchmarkJSONFilename, "In the benchmark mode, also write the results to this file in JSON format", "<filename>"},
+
 		{"s", 's', 0, G_OPTION_ARG_FILENAME, &deprecatedSysexFile, "[DEPRECATED] Play this SMF or sysex file before any other. DEPRECATED: Instead just specify the file first in the file list.", "<midi_file>"},
 		{G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &options->inputFilenames, NULL, "<midi_file> [midi_file...]"},
 		{NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}
@@ -259,10 +456,20 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 		fprintf(stderr, "output-sample-format must be either 0 or 1\n");
 		parseSuccess = false;
 	}
+	if (splitStreams < SPLIT_STREAMS_NONE || splitStreams > SPLIT_STREAMS_WAVE) {
+		fprintf(stderr, "split-streams must be between 0 and 2\n");
+		parseSuccess = false;
+	} else {
+		options->splitStreams = static_cast<SPLIT_STREAMS>(splitStreams);
+	}
 	if (srcQualityIx < 0 || srcQualityIx > 3) {
 		fprintf(stderr, "src-quality must be between 0 and 3\n");
 		parseSuccess = false;
 	}
+	if (previewReverb < PREVIEW_REVERB_FULL || previewReverb > PREVIEW_REVERB_DISABLED) {
+		fprintf(stderr, "preview-reverb must be between 0 and 2\n");
+		parseSuccess = false;
+	}
 	if (dacInputModeIx < 0 || dacInputModeIx > 3) {
 		fprintf(stderr, "dac-input-mode must be between 0 and 3\n");
 		parseSuccess = false;
@@ -273,7 +480,50 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 	} else {
 		options->bufferFrameCount = bufferFrameCount;
 	}
+	if (checkpointIntervalFrames < 1) {
+		fprintf(stderr, "checkpoint-interval must be greater than 0\n");
+		parseSuccess = false;
+	} else {
+		options->checkpointIntervalFrames = checkpointIntervalFrames;
+	}
+	if (options->manifestFilename != NULL) {
+		if ((options->inputFilenames != NULL && g_strv_length(options->inputFilenames) > 0) || deprecatedSysexFile != NULL) {
+			fprintf(stderr, "manifest can't be used together with source files\n");
+			parseSuccess = false;
+		}
+		options->batch = true;
+	}
+	if (shard != NULL) {
+		unsigned int shardIndex, shardCount;
+		char trailing;
+		if (sscanf(shard, "%u/%u%c", &shardIndex, &shardCount, &trailing) != 2 || shardIndex < 1 || shardIndex > shardCount) {
+			fprintf(stderr, "shard must be in the form i/N, where 1 <= i <= N\n");
+			parseSuccess = false;
+		} else if (!options->batch) {
+			fprintf(stderr, "shard requires batch or manifest\n");
+			parseSuccess = false;
+		} else {
+			options->shardIndex = shardIndex - 1;
+			options->shardCount = shardCount;
+		}
+		g_free(shard);
+	}
+	if (jobCount == -1) {
+		options->jobCount = options->batch ? g_get_num_processors() : 1;
+	} else if (jobCount < 1) {
+		fprintf(stderr, "jobs must be greater than 0\n");
+		parseSuccess = false;
+	} else {
+		options->jobCount = jobCount;
+	}
 	options->partialCount = partialCount < 8 ? 8 : partialCount;
+	if (partialCullingLevel < 0 || partialCullingLevel > 255) {
+		fprintf(stderr, "partial-culling-level must be between 0 and 255\n");
+		parseSuccess = false;
+	} else {
+		options->partialCullingLevel = MT32Emu::Bit8u(partialCullingLevel);
+	}
+	options->renderStartFrames = renderStartFrames < 0 ? 0 : renderStartFrames;
 	options->renderMaxFrames = renderMaxFrames < 0 ? INT_MAX : renderMaxFrames;
 	options->renderMinFrames = renderMinFrames < 0 ? 0 : renderMinFrames;
 	if (options->renderMinFrames > options->renderMaxFrames) {
@@ -306,6 +556,20 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 			rawStream++;
 		}
 	}
+	if (options->splitStreams != SPLIT_STREAMS_NONE) {
+		if (options->rawChannelCount == 0) {
+			fprintf(stderr, "split-streams requires raw-stream\n");
+			parseSuccess = false;
+		}
+		for (int i = 0; i < options->rawChannelCount; i++) {
+			for (int j = 0; j < i; j++) {
+				if (options->rawChannelMap[i] >= 0 && options->rawChannelMap[i] == options->rawChannelMap[j]) {
+					fprintf(stderr, "Stream %d is specified more than once, which can't be used together with split-streams\n", options->rawChannelMap[i]);
+					parseSuccess = false;
+				}
+			}
+		}
+	}
 	if (deprecatedSysexFile != NULL) {
 		guint oldLength = options->inputFilenames == NULL ? 0 : g_strv_length(options->inputFilenames);
 		gchar **newInputFilenames = g_new(gchar *, oldLength + 2);
@@ -317,7 +581,44 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 		g_free(options->inputFilenames);
 		options->inputFilenames = newInputFilenames;
 	}
-	if (options->inputFilenames == NULL || g_strv_length(options->inputFilenames) == 0) {
+	if (options->flac) {
+#ifdef WITH_FLAC
+		if (options->rawChannelCount > 0) {
+			fprintf(stderr, "flac can't be used together with raw-stream\n");
+			parseSuccess = false;
+		}
+#else
+		fprintf(stderr, "flac isn't supported by this build\n");
+		parseSuccess = false;
+#endif
+	}
+	if (options->renderCacheDir != NULL && options->splitStreams != SPLIT_STREAMS_NONE) {
+		fprintf(stderr, "render-cache-dir can't be used together with split-streams\n");
+		parseSuccess = false;
+	}
+	if (options->incremental) {
+		if (options->checkpointDir == NULL) {
+			fprintf(stderr, "incremental requires checkpoint-dir\n");
+			parseSuccess = false;
+		}
+		if (options->batch || options->benchmark || options->flac || options->splitStreams != SPLIT_STREAMS_NONE || options->renderStartFrames > 0
+			|| options->jobCount > 1 || deprecatedSysexFile != NULL || (options->inputFilenames != NULL && g_strv_length(options->inputFilenames) > 1)) {
+			fprintf(stderr, "incremental can't be used together with batch, benchmark, flac, split-streams, render-start, jobs or several source files\n");
+			parseSuccess = false;
+		}
+	}
+	if (options->jobCount > 1 && !options->batch && !options->incremental && options->checkpointDir == NULL) {
+		fprintf(stderr, "Warning: jobs requires the checkpoints of a previous conversion in checkpoint-dir, rendering serially\n");
+	}
+	if (options->benchmark && options->batch) {
+		fprintf(stderr, "benchmark can't be used together with batch\n");
+		parseSuccess = false;
+	}
+	if (options->benchmarkJSONFilename != NULL && !options->benchmark) {
+		fprintf(stderr, "benchmark-json requires benchmark\n");
+		parseSuccess = false;
+	}
+	if (options->manifestFilename == NULL && (options->inputFilenames == NULL || g_strv_length(options->inputFilenames) == 0)) {
 		fprintf(stderr, "No input files specified\n");
 		parseSuccess = false;
 	}
@@ -325,6 +626,13 @@ static bool parseOptions(int argc, char *argv[], Options *options) {
 	options->rendererType = RENDERER_TYPES[rendererTypeIx];
 	options->outputSampleFormat = static_cast<OUTPUT_SAMPLE_FORMAT>(outputSampleFormat);
 	options->srcQuality = SRC_QUALITIES[srcQualityIx];
+	options->previewReverb = static_cast<PREVIEW_REVERB>(previewReverb);
+	if (options->preview) {
+		options->rendererType = MT32Emu::RendererType_FLOAT;
+		options->analogOutputMode = MT32Emu::AnalogOutputMode_DIGITAL_ONLY;
+		options->srcQuality = MT32Emu::SamplerateConversionQuality_FASTEST;
+		if (options->partialCullingLevel == 0) options->partialCullingLevel = PREVIEW_PARTIAL_CULLING_LEVEL;
+	}
 	g_strfreev(rawStreams);
 	if (options->rawChannelCount > 0) {
 		options->dacInputMode = MT32Emu::DACInputMode_PURE;
@@ -346,8 +654,7 @@ static long secondsToSamples(double seconds, int sampleRate) {
 	return long(seconds * sampleRate);
 }
 
-static bool writeWAVEHeader(FILE *outputFile, int sampleRate, OUTPUT_SAMPLE_FORMAT outputSampleFormat) {
-	const int channelCount = 2;
+static bool writeWAVEHeader(FILE *outputFile, int sampleRate, OUTPUT_SAMPLE_FORMAT outputSampleFormat, int channelCount) {
 	const int bitDepth = outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 32 : 16;
 	const int frameSize = channelCount * (bitDepth / 8);
 	const int byteRate = sampleRate * frameSize;
@@ -362,7 +669,7 @@ static bool writeWAVEHeader(FILE *outputFile, int sampleRate, OUTPUT_SAMPLE_FORM
 		'f','m','t',' ',
 		0x10, 0x00, 0x00, 0x00, // 0x00000010 - 16 byte chunk
 		0x01, 0x00, // 0x0001 - PCM/Uncompressed; 0x0003 - WAVE_FORMAT_IEEE_FLOAT
-		0x02, 0x00, // 0x0002 - 2 channels
+		0x02, 0x00, // 0x0002 - 2 channels, overwritten by real channel count below
 		0x00, 0x7D, 0x00, 0x00, // 0x00007D00 - 32kHz, overwritten by real sample rate below
 		0x00, 0xF4, 0x01, 0x00, // 0x0001F400 - 128000 bytes/sec, overwritten with real value below
 		0x04, 0x00, // 0x0004 - 4 byte alignment
@@ -373,6 +680,7 @@ static bool writeWAVEHeader(FILE *outputFile, int sampleRate, OUTPUT_SAMPLE_FORM
 		0x00, 0x00, 0x00, 0x00 // Chunk length, to be filled in later
 	};
 	waveHeader[HEADEROFFS_FORMAT_TAG] = outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 3 : 1;
+	waveHeader[HEADEROFFS_CHANNEL_COUNT] = channelCount & 0xFF;
 	waveHeader[HEADEROFFS_SAMPLERATE] = sampleRate & 0xFF;
 	waveHeader[HEADEROFFS_SAMPLERATE + 1] = (sampleRate >> 8) & 0xFF;
 	waveHeader[HEADEROFFS_SAMPLERATE + 2] = (sampleRate >> 16) & 0xFF;
@@ -388,9 +696,9 @@ static bool writeWAVEHeader(FILE *outputFile, int sampleRate, OUTPUT_SAMPLE_FORM
 	return fwrite(waveHeader, 1, sizeof(waveHeader), outputFile) == sizeof(waveHeader);
 }
 
-static bool fillWAVESizes(FILE *outputFile, int numFrames, OUTPUT_SAMPLE_FORMAT outputSampleFormat) {
+static bool fillWAVESizes(FILE *outputFile, int numFrames, OUTPUT_SAMPLE_FORMAT outputSampleFormat, int channelCount) {
 	// FIXME: Check return codes, etc.
-	const int frameSize = outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 8 : 4;
+	const int frameSize = channelCount * (outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 4 : 2);
 	int dataSize = numFrames * frameSize;
 	int riffSize = dataSize + 28;
 	if (fseek(outputFile, HEADEROFFS_RIFFLEN, SEEK_SET))
@@ -416,6 +724,189 @@ static bool fillWAVESizes(FILE *outputFile, int numFrames, OUTPUT_SAMPLE_FORMAT
 	return true;
 }
 
+struct OutputBlock {
+	MT32Emu::Bit8u *data;
+	size_t size;
+};
+
+// The recorded frames are collected in blocks which are written or encoded in the output thread. The blocks circulate
+// between the two queues, so the rendering thread waits for a free one only when the output thread falls behind.
+// A block with no data marks the end of the output.
+struct Output {
+	FILE *file;
+#ifdef WITH_FLAC
+	// When set, the blocks contain interleaved 32-bit samples for the encoder rather than the contents of the file.
+	FLAC__StreamEncoder *flacEncoder;
+#endif
+	GAsyncQueue *freeBlocks;
+	GAsyncQueue *filledBlocks;
+	OutputBlock *currentBlock;
+	GThread *thread;
+	// Only accessed by the output thread until it is joined.
+	bool failed;
+};
+
+#ifdef WITH_FLAC
+static FLAC__StreamEncoderWriteStatus writeFLAC(const FLAC__StreamEncoder *, const FLAC__byte buffer[], size_t bytes, unsigned, unsigned, void *clientData) {
+	FILE *file = static_cast<Output *>(clientData)->file;
+	return fwrite(buffer, 1, bytes, file) == bytes ? FLAC__STREAM_ENCODER_WRITE_STATUS_OK : FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+}
+
+static FLAC__StreamEncoderSeekStatus seekFLAC(const FLAC__StreamEncoder *, FLAC__uint64 absoluteByteOffset, void *clientData) {
+	FILE *file = static_cast<Output *>(clientData)->file;
+	if (absoluteByteOffset > FLAC__uint64(LONG_MAX) || fseek(file, long(absoluteByteOffset), SEEK_SET) != 0) {
+		return FLAC__STREAM_ENCODER_SEEK_STATUS_ERROR;
+	}
+	return FLAC__STREAM_ENCODER_SEEK_STATUS_OK;
+}
+
+static FLAC__StreamEncoderTellStatus tellFLAC(const FLAC__StreamEncoder *, FLAC__uint64 *absoluteByteOffset, void *clientData) {
+	FILE *file = static_cast<Output *>(clientData)->file;
+	long position = ftell(file);
+	if (position < 0) {
+		return FLAC__STREAM_ENCODER_TELL_STATUS_ERROR;
+	}
+	*absoluteByteOffset = FLAC__uint64(position);
+	return FLAC__STREAM_ENCODER_TELL_STATUS_OK;
+}
+
+static FLAC__StreamEncoder *startFLACEncoder(Output *output, int sampleRate, OUTPUT_SAMPLE_FORMAT outputSampleFormat) {
+	FLAC__StreamEncoder *encoder = FLAC__stream_encoder_new();
+	if (encoder == NULL) return NULL;
+	FLAC__stream_encoder_set_channels(encoder, 2);
+	FLAC__stream_encoder_set_bits_per_sample(encoder, outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 24 : 16);
+	FLAC__stream_encoder_set_sample_rate(encoder, sampleRate);
+	FLAC__stream_encoder_set_compression_level(encoder, FLAC_COMPRESSION_LEVEL);
+	if (FLAC__stream_encoder_init_stream(encoder, writeFLAC, seekFLAC, tellFLAC, NULL, output) != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+		FLAC__stream_encoder_delete(encoder);
+		return NULL;
+	}
+	return encoder;
+}
+#endif
+
+static bool processOutputBlock(Output &output, const OutputBlock &block) {
+#ifdef WITH_FLAC
+	if (output.flacEncoder != NULL) {
+		const FLAC__int32 *samples = reinterpret_cast<const FLAC__int32 *>(block.data);
+		return FLAC__stream_encoder_process_interleaved(output.flacEncoder, samples, unsigned(block.size / (2 * sizeof(FLAC__int32)))) != 0;
+	}
+#endif
+	return fwrite(block.data, 1, block.size, output.file) == block.size;
+}
+
+static gpointer runOutput(gpointer data) {
+	Output *output = static_cast<Output *>(data);
+	for (;;) {
+		OutputBlock *block = static_cast<OutputBlock *>(g_async_queue_pop(output->filledBlocks));
+		size_t size = block->size;
+		if (size > 0 && !output->failed) {
+			output->failed = !processOutputBlock(*output, *block);
+		}
+		g_async_queue_push(output->freeBlocks, block);
+		if (size == 0) break;
+	}
+	return NULL;
+}
+
+// Starts the output thread, which either writes the output file or encodes it to FLAC. Returns NULL on failure.
+static Output *startOutput(FILE *outputFile, const Options &options) {
+	Output *output = new Output;
+	output->file = outputFile;
+#ifdef WITH_FLAC
+	output->flacEncoder = NULL;
+	if (options.flac) {
+		output->flacEncoder = startFLACEncoder(output, options.sampleRate, options.outputSampleFormat);
+		if (output->flacEncoder == NULL) {
+			delete output;
+			return NULL;
+		}
+	}
+#else
+	(void)options;
+#endif
+	output->freeBlocks = g_async_queue_new();
+	output->filledBlocks = g_async_queue_new();
+	for (unsigned int i = 0; i < OUTPUT_BLOCK_COUNT; i++) {
+		OutputBlock *block = new OutputBlock;
+		// The memory returned by g_malloc() is suitably aligned for the samples passed to the FLAC encoder.
+		block->data = static_cast<MT32Emu::Bit8u *>(g_malloc(OUTPUT_BLOCK_SIZE));
+		g_async_queue_push(output->freeBlocks, block);
+	}
+	output->currentBlock = static_cast<OutputBlock *>(g_async_queue_pop(output->freeBlocks));
+	output->currentBlock->size = 0;
+	output->failed = false;
+	output->thread = g_thread_new("mt32emu-smf2wav output", runOutput, output);
+	return output;
+}
+
+static void submitOutputBlock(Output &output) {
+	g_async_queue_push(output.filledBlocks, output.currentBlock);
+	output.currentBlock = static_cast<OutputBlock *>(g_async_queue_pop(output.freeBlocks));
+	output.currentBlock->size = 0;
+}
+
+// Returns space for the specified number of bytes in the current block, submitting the block first if it lacks room.
+// As long as the sizes requested divide OUTPUT_BLOCK_SIZE, the data never straddles blocks.
+static inline MT32Emu::Bit8u *reserveOutput(Output &output, size_t length) {
+	if (output.currentBlock->size + length > OUTPUT_BLOCK_SIZE) {
+		submitOutputBlock(output);
+	}
+	MT32Emu::Bit8u *data = output.currentBlock->data + output.currentBlock->size;
+	output.currentBlock->size += length;
+	return data;
+}
+
+static void putSilence(Output &output, size_t length) {
+	while (length > 0) {
+		OutputBlock *block = output.currentBlock;
+		if (block->size == OUTPUT_BLOCK_SIZE) {
+			submitOutputBlock(output);
+			continue;
+		}
+		size_t lengthThisPass = MIN(length, OUTPUT_BLOCK_SIZE - block->size);
+		memset(block->data + block->size, 0, lengthThisPass);
+		block->size += lengthThisPass;
+		length -= lengthThisPass;
+	}
+}
+
+// Waits for the output thread to process the remaining data and frees the output. When encoding to FLAC, the stream
+// is completed, which updates the STREAMINFO block with the final length and checksum. Returns false on failure.
+static bool finishOutput(Output *output) {
+	if (output->currentBlock->size > 0) {
+		submitOutputBlock(*output);
+	}
+	g_async_queue_push(output->filledBlocks, output->currentBlock);
+	g_thread_join(output->thread);
+	bool success = !output->failed;
+#ifdef WITH_FLAC
+	if (output->flacEncoder != NULL) {
+		if (!FLAC__stream_encoder_finish(output->flacEncoder)) {
+			success = false;
+		}
+		FLAC__stream_encoder_delete(output->flacEncoder);
+	}
+#endif
+	for (unsigned int i = 0; i < OUTPUT_BLOCK_COUNT; i++) {
+		OutputBlock *block = static_cast<OutputBlock *>(g_async_queue_pop(output->freeBlocks));
+		g_free(block->data);
+		delete block;
+	}
+	g_async_queue_unref(output->freeBlocks);
+	g_async_queue_unref(output->filledBlocks);
+	delete output;
+	return success;
+}
+
+// Returns the size of a frame in the output blocks. The FLAC encoder is fed with 32-bit integer samples.
+// When the raw streams are split, the blocks of each output only contain the samples of a single stream.
+static size_t getOutputFrameSize(const Options &options) {
+	size_t sampleSize = options.flac || options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 4 : 2;
+	if (options.splitStreams != SPLIT_STREAMS_NONE) return sampleSize;
+	return sampleSize * (options.rawChannelCount > 0 ? options.rawChannelCount : 2);
+}
+
 static bool loadFile(MT32Emu::Bit8u *&fileBuffer, gsize &fileBufferLength, const gchar *filename, const gchar *displayFilename) {
 	GError *err = NULL;
 	g_file_get_contents(filename, (gchar **)&fileBuffer, &fileBufferLength, &err);
@@ -427,7 +918,7 @@ static bool loadFile(MT32Emu::Bit8u *&fileBuffer, gsize &fileBufferLength, const
 	return true;
 }
 
-static bool playSysexFileBuffer(MT32Emu::Service &service, const gchar *displayFilename, MT32Emu::Bit8u *fileBuffer, gsize fileBufferLength) {
+static bool playSysexFileBuffer(MT32Emu::Service &service, const gchar *displayFilename, const MT32Emu::Bit8u *fileBuffer, gsize fileBufferLength) {
 	long start = -1;
 	for (gsize i = 0; i < fileBufferLength; i++) {
 		if (fileBuffer[i] == 0xF0) {
@@ -440,7 +931,7 @@ static bool playSysexFileBuffer(MT32Emu::Service &service, const gchar *displayF
 			if (start == -1) {
 				fprintf(stderr, "Ended a sysex message without a start byte - sysex file '%s' may be in an unsupported format.\n", displayFilename);
 			} else {
-				service.playSysexNow((MT32Emu::Bit8u*)(fileBuffer + start), MT32Emu::Bit32u(i - start + 1));
+				service.playSysexNow(fileBuffer + start, MT32Emu::Bit32u(i - start + 1));
 			}
 			start = -1;
 		}
@@ -455,7 +946,7 @@ enum Occasion {
 };
 
 static void flushSilence(Occasion occasion, const Options &options, State &state) {
-	unsigned int channelCount = options.rawChannelCount > 0 ? options.rawChannelCount : 2;
+	if (state.output == NULL && state.streamOutputs == NULL) return;
 	int writtenFrames = state.unwrittenSilentFrames;
 	switch(occasion) {
 	case NOISE_DETECTED:
@@ -474,9 +965,14 @@ static void flushSilence(Occasion occasion, const Options &options, State &state
 		state.unwrittenSilentFrames -= writtenFrames;
 		break;
 	}
-	const int sampleSize = options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 4 : 2;
-	for (unsigned long i = 0; i < writtenFrames * sampleSize * channelCount; i++) {
-		fputc(0, state.outputFile);
+	if (state.streamOutputs != NULL) {
+		for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
+			if (state.streamOutputs[chanMapIx] != NULL) {
+				putSilence(*state.streamOutputs[chanMapIx], writtenFrames * getOutputFrameSize(options));
+			}
+		}
+	} else {
+		putSilence(*state.output, writtenFrames * getOutputFrameSize(options));
 	}
 	state.writtenFrames += writtenFrames;
 }
@@ -539,287 +1035,915 @@ static inline MT32Emu::Bit32u makeIeeeFloat(float sample) {
 	return floatBits;
 }
 
-static inline void putSampleLE(void * const sampleBuffer, const int sampleIx, FILE *outputFile, const OUTPUT_SAMPLE_FORMAT outputSampleFormat) {
+static inline void putSampleLE(void * const sampleBuffer, const int sampleIx, MT32Emu::Bit8u *&data, const OUTPUT_SAMPLE_FORMAT outputSampleFormat) {
 	if (outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32) {
 		MT32Emu::Bit32u sample = makeIeeeFloat(static_cast<float *>(sampleBuffer)[sampleIx]);
-		fputc(sample & 0xFF, outputFile);
-		fputc((sample >> 8) & 0xFF, outputFile);
-		fputc((sample >> 16) & 0xFF, outputFile);
-		fputc((sample >> 24) & 0xFF, outputFile);
+		*(data++) = sample & 0xFF;
+		*(data++) = (sample >> 8) & 0xFF;
+		*(data++) = (sample >> 16) & 0xFF;
+		*(data++) = (sample >> 24) & 0xFF;
 	} else {
 		MT32Emu::Bit16s sample = static_cast<MT32Emu::Bit16s *>(sampleBuffer)[sampleIx];
-		fputc(sample & 0xFF, outputFile);
-		fputc((sample >> 8) & 0xFF, outputFile);
+		*(data++) = sample & 0xFF;
+		*(data++) = (sample >> 8) & 0xFF;
 	}
 }
 
-static inline void putSampleBE(void * const sampleBuffer, const int sampleIx, FILE *outputFile, const OUTPUT_SAMPLE_FORMAT outputSampleFormat) {
+static inline void putSampleBE(void * const sampleBuffer, const int sampleIx, MT32Emu::Bit8u *&data, const OUTPUT_SAMPLE_FORMAT outputSampleFormat) {
 	if (outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32) {
 		MT32Emu::Bit32u sample = makeIeeeFloat(static_cast<float *>(sampleBuffer)[sampleIx]);
-		fputc((sample >> 24) & 0xFF, outputFile);
-		fputc((sample >> 16) & 0xFF, outputFile);
-		fputc((sample >> 8) & 0xFF, outputFile);
-		fputc(sample & 0xFF, outputFile);
+		*(data++) = (sample >> 24) & 0xFF;
+		*(data++) = (sample >> 16) & 0xFF;
+		*(data++) = (sample >> 8) & 0xFF;
+		*(data++) = sample & 0xFF;
 	} else {
 		MT32Emu::Bit16s sample = static_cast<MT32Emu::Bit16s *>(sampleBuffer)[sampleIx];
-		fputc((sample >> 8) & 0xFF, outputFile);
-		fputc(sample & 0xFF, outputFile);
+		*(data++) = (sample >> 8) & 0xFF;
+		*(data++) = sample & 0xFF;
 	}
 }
 
-static void renderStereo(unsigned int frameCount, const Options &options, State &state) {
-	state.renderedFrames += frameCount;
-	while (frameCount > 0) {
-		unsigned int renderedFramesThisPass = MIN(frameCount, options.bufferFrameCount);
-		renderStereo(state.service, state.stereoSampleBuffer, renderedFramesThisPass, options.outputSampleFormat);
-		for (unsigned int i = 0; i < renderedFramesThisPass; i++) {
-			unsigned int leftIx = i * 2;
-			unsigned int rightIx = leftIx + 1;
-			bool silent = isSilence(state.stereoSampleBuffer, leftIx, options.outputSampleFormat)
-				&& isSilence(state.stereoSampleBuffer, rightIx, options.outputSampleFormat);
-			if (silent) {
-				state.unwrittenSilentFrames++;
-				continue;
-			}
-			flushSilence(NOISE_DETECTED, options, state);
-			putSampleLE(state.stereoSampleBuffer, leftIx, state.outputFile, options.outputSampleFormat);
-			putSampleLE(state.stereoSampleBuffer, rightIx, state.outputFile, options.outputSampleFormat);
-			state.writtenFrames++;
-		}
-		frameCount -= renderedFramesThisPass;
+#ifdef WITH_FLAC
+static inline FLAC__int32 makeFLACSample(void * const sampleBuffer, const int sampleIx, const OUTPUT_SAMPLE_FORMAT outputSampleFormat) {
+	if (outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32) {
+		float sample = static_cast<float *>(sampleBuffer)[sampleIx] * 8388608.0f;
+		if (!(sample > -8388608.0f)) return sample < 0.0f ? -8388608 : 0;
+		if (sample >= 8388607.0f) return 8388607;
+		return FLAC__int32(floor(sample + 0.5f));
 	}
+	return static_cast<MT32Emu::Bit16s *>(sampleBuffer)[sampleIx];
 }
+#endif
 
-static void renderRaw(unsigned int frameCount, const Options &options, State &state) {
-	state.renderedFrames += frameCount;
-	while (frameCount > 0) {
-		unsigned int renderedFramesThisPass = MIN(frameCount, options.bufferFrameCount);
-		renderRaw(state.service, state.rawSampleBuffer, renderedFramesThisPass, options.outputSampleFormat);
-		for (unsigned int i = 0; i < renderedFramesThisPass; i++) {
-			bool allSilent = true;
-			for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
-				if (options.rawChannelMap[chanMapIx] >= 0 && !isSilence(state.rawSampleBuffer[options.rawChannelMap[chanMapIx]], i, options.outputSampleFormat)) {
-					allSilent = false;
-					break;
-				}
-			}
-			if (allSilent) {
-				state.unwrittenSilentFrames++;
-				continue;
-			}
-			flushSilence(NOISE_DETECTED, options, state);
-			for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
-				if (options.rawChannelMap[chanMapIx] < 0) {
-					const int sampleSize = options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 4 : 2;
-					for (int sampleIx = 0; sampleIx < sampleSize; sampleIx++) {
-						fputc(0, state.outputFile);
-					}
-				} else {
-					putSampleBE(state.rawSampleBuffer[options.rawChannelMap[chanMapIx]], i, state.outputFile, options.outputSampleFormat);
-				}
-			}
-			state.writtenFrames++;
+static void recordStereo(unsigned int frameCount, const Options &options, State &state) {
+	const size_t frameSize = getOutputFrameSize(options);
+	for (unsigned int i = 0; i < frameCount; i++) {
+		unsigned int leftIx = i * 2;
+		unsigned int rightIx = leftIx + 1;
+		bool silent = isSilence(state.stereoSampleBuffer, leftIx, options.outputSampleFormat)
+			&& isSilence(state.stereoSampleBuffer, rightIx, options.outputSampleFormat);
+		if (silent) {
+			state.unwrittenSilentFrames++;
+			continue;
 		}
-		frameCount -= renderedFramesThisPass;
+		flushSilence(NOISE_DETECTED, options, state);
+		MT32Emu::Bit8u *data = reserveOutput(*state.output, frameSize);
+		state.writtenFrames++;
+#ifdef WITH_FLAC
+		if (options.flac) {
+			FLAC__int32 *samples = reinterpret_cast<FLAC__int32 *>(data);
+			samples[0] = makeFLACSample(state.stereoSampleBuffer, leftIx, options.outputSampleFormat);
+			samples[1] = makeFLACSample(state.stereoSampleBuffer, rightIx, options.outputSampleFormat);
+			continue;
+		}
+#endif
+		putSampleLE(state.stereoSampleBuffer, leftIx, data, options.outputSampleFormat);
+		putSampleLE(state.stereoSampleBuffer, rightIx, data, options.outputSampleFormat);
 	}
 }
 
-static void render(unsigned int frameCount, const Options &options, State &state) {
+// Renders a single pass to the sample buffers. In the benchmark mode, the time the pass takes is accounted.
+static void renderPass(unsigned int frameCount, const Options &options, State &state) {
+	gint64 startTime = state.benchmarkTiming != NULL ? g_get_monotonic_time() : 0;
 	if (options.rawChannelCount > 0) {
-		renderRaw(frameCount, options, state);
+		renderRaw(state.service, state.rawSampleBuffer, frameCount, options.outputSampleFormat);
 	} else {
-		renderStereo(frameCount, options, state);
+		renderStereo(state.service, state.stereoSampleBuffer, frameCount, options.outputSampleFormat);
+	}
+	if (state.benchmarkTiming != NULL) {
+		BenchmarkTiming &timing = *state.benchmarkTiming;
+		gint64 passTime = g_get_monotonic_time() - startTime;
+		timing.passCount++;
+		timing.frameCount += frameCount;
+		timing.totalTime += passTime;
+		timing.maxPassTime = MAX(timing.maxPassTime, passTime);
 	}
 }
 
-static void playSMF(smf_t *smf, const Options &options, State &state) {
-	int unterminatedSysexLen = 0;
-	unsigned char *unterminatedSysex = NULL;
-	unsigned long renderedFrames = 0;
-	smf_rewind(smf);
-	for (;;) {
-		smf_event_t *event = smf_get_next_event(smf);
-		unsigned long eventFrameIx;
+static void renderStereo(unsigned int frameCount, const Options &options, State &state) {
+	state.renderedFrames += frameCount;
+	while (frameCount > 0) {
+		unsigned int renderedFramesThisPass = MIN(frameCount, options.bufferFrameCount);
+		renderPass(renderedFramesThisPass, options, state);
+		if (state.output != NULL) recordStereo(renderedFramesThisPass, options, state);
+		frameCount -= renderedFramesThisPass;
+	}
+}
 
-		if (event == NULL) {
-			break;
+static bool isRawFrameSilent(const unsigned int frameIx, const Options &options, const State &state) {
+	for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
+		if (options.rawChannelMap[chanMapIx] >= 0 && !isSilence(state.rawSampleBuffer[options.rawChannelMap[chanMapIx]], frameIx, options.outputSampleFormat)) {
+			return false;
 		}
+	}
+	return true;
+}
 
-		assert(event->track->track_number >= 0);
-
-		eventFrameIx = secondsToSamples(event->time_seconds, options.sampleRate);
-		unsigned int renderLength = (eventFrameIx > renderedFrames) ? eventFrameIx - renderedFrames : 1;
-		if (state.renderedFrames + renderLength > options.renderMaxFrames) {
-			renderLength = options.renderMaxFrames - state.renderedFrames;
-		}
-		render(renderLength, options, state);
-		renderedFrames += renderLength;
-		if (state.renderedFrames == options.renderMaxFrames) {
-			break;
+// Writes each selected stream to its output straight from the planar sample buffer. The runs of frames that aren't
+// silent are written stream by stream, so that the streams stay aligned as the silence is only skipped in all at once.
+static void recordSplitStreams(unsigned int frameCount, const Options &options, State &state) {
+	const size_t sampleSize = getOutputFrameSize(options);
+	unsigned int i = 0;
+	while (i < frameCount) {
+		if (isRawFrameSilent(i, options, state)) {
+			state.unwrittenSilentFrames++;
+			i++;
+			continue;
 		}
-
-		if (smf_event_is_metadata(event)) {
-			char *decoded = smf_event_decode(event);
-			if (decoded && !options.quiet) {
-				fprintf(stdout, "Metadata: %s\n", decoded);
-			}
-		} else if (smf_event_is_sysex(event) || smf_event_is_sysex_continuation(event))  {
-			bool unterminated = smf_event_is_unterminated_sysex(event) != 0;
-			bool addUnterminated = unterminated;
-			bool continuation = smf_event_is_sysex_continuation(event) != 0;
-			unsigned char *buf;
-			int len;
-			if (continuation) {
-				if (unterminatedSysex != NULL) {
-					addUnterminated = true;
+		unsigned int runEnd = i + 1;
+		while (runEnd < frameCount && !isRawFrameSilent(runEnd, options, state)) runEnd++;
+		flushSilence(NOISE_DETECTED, options, state);
+		for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
+			Output *output = state.streamOutputs[chanMapIx];
+			if (output == NULL) continue;
+			void *sampleBuffer = state.rawSampleBuffer[options.rawChannelMap[chanMapIx]];
+			for (unsigned int sampleIx = i; sampleIx < runEnd; sampleIx++) {
+				MT32Emu::Bit8u *data = reserveOutput(*output, sampleSize);
+				if (options.splitStreams == SPLIT_STREAMS_WAVE) {
+					putSampleLE(sampleBuffer, sampleIx, data, options.outputSampleFormat);
 				} else {
-					fprintf(stderr, "Sysex continuation received without preceding unterminated sysex - hoping for the best\n");
-				}
-				buf = event->midi_buffer + 1;
-				len = event->midi_buffer_length - 1;
-			} else {
-				if (unterminatedSysex != NULL) {
-					fprintf(stderr, "New sysex received with an unterminated sysex pending - ignoring unterminated\n");
-					delete[] unterminatedSysex;
-					unterminatedSysex = NULL;
-					unterminatedSysexLen = 0;
-				}
-				buf = event->midi_buffer;
-				len = event->midi_buffer_length;
-			}
-			if (addUnterminated) {
-				unsigned char *newUnterminatedSysex = new unsigned char[unterminatedSysexLen + len];
-				if(unterminatedSysex != NULL) {
-					memcpy(newUnterminatedSysex, unterminatedSysex, unterminatedSysexLen);
-					delete[] unterminatedSysex;
-				}
-				memcpy(newUnterminatedSysex + unterminatedSysexLen, buf, len);
-				unterminatedSysex = newUnterminatedSysex;
-				unterminatedSysexLen += len;
-				buf = unterminatedSysex;
-				len = unterminatedSysexLen;
-			}
-			if (!unterminated) {
-				state.service.playSysex(buf, len);
-				if (addUnterminated) {
-					delete[] unterminatedSysex;
-					unterminatedSysex = NULL;
-					unterminatedSysexLen = 0;
+					putSampleBE(sampleBuffer, sampleIx, data, options.outputSampleFormat);
 				}
 			}
-		} else {
-			if (event->midi_buffer_length > 3) {
-				fprintf(stderr, "Got message with unusual length: %d\n", event->midi_buffer_length);
-				for (int i = 0; i < event->midi_buffer_length; i++) {
-					fprintf(stderr, " %02x", event->midi_buffer[i]);
-				}
-				fprintf(stderr, "\n");
-			} else {
-				MT32Emu::Bit32u msg = 0;
-				for (int i = 0; i < event->midi_buffer_length; i++) {
-					msg |= (event->midi_buffer[i] << (8 * i));
-				}
-				state.service.playMsg(msg);
-			}
 		}
+		state.writtenFrames += runEnd - i;
+		i = runEnd;
 	}
-	flushSilence(MIDI_ENDED, options, state);
-	if (options.sendAllNotesOff) {
-		for (unsigned char channel = 0; channel < 16; channel++) {
-			state.service.playMsg(0x0040B0 | channel); // Release sustain pedal
-			state.service.playMsg(0x007BB0 | channel); // All notes off
-		}
-	}
-	if (state.lastInputFile && options.renderMinFrames > state.renderedFrames) {
-		render(options.renderMinFrames - state.renderedFrames, options, state);
+}
+
+static void recordRaw(unsigned int frameCount, const Options &options, State &state) {
+	if (state.streamOutputs != NULL) {
+		recordSplitStreams(frameCount, options, state);
+		return;
 	}
-	if (options.waitForLA32) {
-		while (state.renderedFrames < options.renderMaxFrames && state.service.hasActivePartials()) {
-			// FIXME: Rendering one sample at a time is very inefficient, but it's important for
-			// some tests to be able to see the precise frame when partials become inactive.
-			// Perhaps we should add a renderWhilePartialsActive() to Synth
-			// or add a getter for "the minimum number of frames remaining with active partials if
-			// no further MIDI is sent". Which would make quite a function name.
-			render(1, options, state);
+	for (unsigned int i = 0; i < frameCount; i++) {
+		if (isRawFrameSilent(i, options, state)) {
+			state.unwrittenSilentFrames++;
+			continue;
 		}
-		flushSilence(LA32_INACTIVE, options, state);
-		if (options.waitForReverb) {
-			unsigned int reverbEndFrames = MIN(MAX_REVERB_END_FRAMES, options.bufferFrameCount);
-			while (state.renderedFrames < options.renderMaxFrames && state.service.isActive()) {
-				// Render a healthy number of frames while waiting for reverb to become inactive.
-				// Note that once we've detected inactivity, silent samples will not be written.
-				unsigned int renderLength = reverbEndFrames;
-				if (state.renderedFrames + renderLength > options.renderMaxFrames) {
-					renderLength = options.renderMaxFrames - state.renderedFrames;
+		flushSilence(NOISE_DETECTED, options, state);
+		MT32Emu::Bit8u *data = reserveOutput(*state.output, getOutputFrameSize(options));
+		for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
+			if (options.rawChannelMap[chanMapIx] < 0) {
+				const int sampleSize = options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 4 : 2;
+				for (int sampleIx = 0; sampleIx < sampleSize; sampleIx++) {
+					*(data++) = 0;
 				}
-				render(renderLength, options, state);
+			} else {
+				putSampleBE(state.rawSampleBuffer[options.rawChannelMap[chanMapIx]], i, data, options.outputSampleFormat);
 			}
 		}
+		state.writtenFrames++;
 	}
-	if (!state.service.isActive()) {
-		state.unwrittenSilentFrames = 0;
-	}
-	delete[] unterminatedSysex;
 }
 
-static bool playFile(const gchar *inputFilename, const gchar *displayInputFilename, const Options &options, State &state) {
-	MT32Emu::Bit8u *fileBuffer = NULL;
-	gsize fileBufferLength = 0;
-	if (!loadFile(fileBuffer, fileBufferLength, inputFilename, displayInputFilename)) {
-		return false;
+static void renderRaw(unsigned int frameCount, const Options &options, State &state) {
+	state.renderedFrames += frameCount;
+	while (frameCount > 0) {
+		unsigned int renderedFramesThisPass = MIN(frameCount, options.bufferFrameCount);
+		renderPass(renderedFramesThisPass, options, state);
+		if (state.output != NULL || state.streamOutputs != NULL) recordRaw(renderedFramesThisPass, options, state);
+		frameCount -= renderedFramesThisPass;
 	}
-	if (fileBuffer[0] == 0xF0) {
-		return playSysexFileBuffer(state.service, displayInputFilename, fileBuffer, fileBufferLength);
+}
+
+// Renders the frames preceding the start frame, the samples are discarded.
+static void skip(unsigned int frameCount, const Options &options, State &state) {
+	state.renderedFrames += frameCount;
+	while (frameCount > 0) {
+		unsigned int renderedFramesThisPass = MIN(frameCount, options.bufferFrameCount);
+		renderPass(renderedFramesThisPass, options, state);
+		frameCount -= renderedFramesThisPass;
 	}
-	smf_t *smf = smf_load_from_memory(fileBuffer, int(fileBufferLength));
-	if (smf != NULL) {
-		if (!options.quiet) {
-			char *decoded = smf_decode(smf);
-			fprintf(stdout, "%s.\n", decoded);
-			free(decoded);
+}
+
+// Renders the frames to the segment file as is, in blocks prefixed with the frame count.
+static void renderSegment(unsigned int frameCount, const Options &options, State &state) {
+	const size_t sampleSize = options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 4 : 2;
+	state.renderedFrames += frameCount;
+	while (frameCount > 0) {
+		unsigned int renderedFramesThisPass = MIN(frameCount, options.bufferFrameCount);
+		fwrite(&renderedFramesThisPass, sizeof(renderedFramesThisPass), 1, state.segmentFile);
+		if (options.rawChannelCount > 0) {
+			renderRaw(state.service, state.rawSampleBuffer, renderedFramesThisPass, options.outputSampleFormat);
+			for (int i = 0; i < 6; i++) {
+				fwrite(state.rawSampleBuffer[i], sampleSize, renderedFramesThisPass, state.segmentFile);
+			}
+		} else {
+			renderStereo(state.service, state.stereoSampleBuffer, renderedFramesThisPass, options.outputSampleFormat);
+			fwrite(state.stereoSampleBuffer, sampleSize, 2 * renderedFramesThisPass, state.segmentFile);
 		}
-		assert(smf->number_of_tracks >= 1);
-		playSMF(smf, options, state);
-		smf_delete(smf);
-		return true;
+		frameCount -= renderedFramesThisPass;
 	}
-	fprintf(stderr, "Error parsing SMF file '%s'.\n", displayInputFilename);
-	return false;
 }
 
-int main(int argc, char *argv[]) {
-	Options options;
-	MT32Emu::Service service;
-	setlocale(LC_ALL, "");
-	printf("Munt MT32Emu MIDI to Wave Conversion Utility. Version %s\n", VERSION);
-	printf("  Copyright (C) 2009, 2011 Jerome Fisher <re_munt@kingguppy.com>\n");
-	printf("  Copyright (C) 2012-2020 Jerome Fisher, Sergey V. Mikayev\n");
-	printf("Using Munt MT32Emu Library Version %s, libsmf Version %s (with modifications)\n", service.getLibraryVersionString(), smf_get_version());
-	if (!parseOptions(argc, argv, &options)) {
-		return -1;
+// Records the frames stored in the segment file, as if they were just rendered.
+static bool recordSegment(FILE *segmentFile, const Options &options, State &state) {
+	const size_t sampleSize = options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32 ? 4 : 2;
+	unsigned int frameCount;
+	if (fflush(segmentFile) != 0 || fseek(segmentFile, 0, SEEK_SET) != 0) {
+		return false;
 	}
-	gchar *outputFilename;
-	gchar *displayOutputFilename;
-	if (options.outputFilename != NULL) {
-		outputFilename = options.outputFilename;
-	} else {
-		gchar *lastInputFilename = options.inputFilenames[g_strv_length(options.inputFilenames) - 1];
-		size_t allocLen = strlen(lastInputFilename) + 5;
-		outputFilename = (gchar *)malloc(allocLen);
-		if(outputFilename == NULL) {
-			fprintf(stderr, "Error allocating %lu bytes for destination filename.\n", (unsigned long)allocLen);
-			return -1;
+	while (fread(&frameCount, sizeof(frameCount), 1, segmentFile) == 1) {
+		if (frameCount > options.bufferFrameCount) {
+			return false;
 		}
 		if (options.rawChannelCount > 0) {
-			sprintf(outputFilename, "%s.raw", lastInputFilename);
+			for (int i = 0; i < 6; i++) {
+				if (fread(state.rawSampleBuffer[i], sampleSize, frameCount, segmentFile) != frameCount) {
+					return false;
+				}
+			}
+			recordRaw(frameCount, options, state);
 		} else {
-			sprintf(outputFilename, "%s.wav", lastInputFilename);
+			if (fread(state.stereoSampleBuffer, sampleSize, 2 * frameCount, segmentFile) != 2 * frameCount) {
+				return false;
+			}
+			recordStereo(frameCount, options, state);
 		}
+		state.renderedFrames += frameCount;
 	}
-	displayOutputFilename = g_filename_display_name(outputFilename);
+	return feof(segmentFile) != 0;
+}
 
-	service.createContext();
-	gchar *baseDir = options.romDir;
+static void render(unsigned int frameCount, const Options &options, State &state) {
+	if (state.segmentFile != NULL) {
+		renderSegment(frameCount, options, state);
+		return;
+	}
+	if (state.renderedFrames < options.renderStartFrames) {
+		unsigned int skippedFrameCount = MIN(frameCount, options.renderStartFrames - state.renderedFrames);
+		skip(skippedFrameCount, options, state);
+		frameCount -= skippedFrameCount;
+	}
+	if (options.rawChannelCount > 0) {
+		renderRaw(frameCount, options, state);
+	} else {
+		renderStereo(frameCount, options, state);
+	}
+}
+
+static MT32Emu::Bit8u *putUInt32LE(MT32Emu::Bit8u *data, unsigned long value) {
+	for (int i = 0; i < 4; i++) {
+		*(data++) = (value >> (8 * i)) & 0xFF;
+	}
+	return data;
+}
+
+static const MT32Emu::Bit8u *getUInt32LE(const MT32Emu::Bit8u *data, unsigned long &value) {
+	value = 0;
+	for (int i = 0; i < 4; i++) {
+		value |= (unsigned long)*(data++) << (8 * i);
+	}
+	return data;
+}
+
+static gchar *makeCheckpointFilename(const gchar *checkpointDir, unsigned long frame) {
+	gchar *filename = g_strdup_printf(CHECKPOINT_FILENAME_FORMAT, frame);
+	gchar *pathName = g_strconcat(checkpointDir, filename, NULL);
+	g_free(filename);
+	return pathName;
+}
+
+static void saveCheckpoint(const Options &options, State &state, unsigned long eventCount, unsigned long smfRenderedFrames, const unsigned char *unterminatedSysex, int unterminatedSysexLen) {
+	size_t synthStateSize = state.service.saveState(NULL, 0);
+	gsize checkpointSize = CHECKPOINT_HEADER_SIZE + unterminatedSysexLen + synthStateSize;
+	MT32Emu::Bit8u *checkpoint = new MT32Emu::Bit8u[checkpointSize];
+	memcpy(checkpoint, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	MT32Emu::Bit8u *data = checkpoint + sizeof(CHECKPOINT_MAGIC);
+	data = putUInt32LE(data, state.inputFileIx);
+	data = putUInt32LE(data, eventCount);
+	data = putUInt32LE(data, smfRenderedFrames);
+	data = putUInt32LE(data, state.renderedFrames);
+	data = putUInt32LE(data, state.writtenFrames);
+	data = putUInt32LE(data, state.unwrittenSilentFrames);
+	data = putUInt32LE(data, state.firstNoiseEncountered ? 1 : 0);
+	data = putUInt32LE(data, unterminatedSysexLen);
+	if (unterminatedSysexLen > 0) {
+		memcpy(data, unterminatedSysex, unterminatedSysexLen);
+		data += unterminatedSysexLen;
+	}
+	state.service.saveState(data, synthStateSize);
+
+	gchar *filename = makeCheckpointFilename(options.checkpointDir, state.renderedFrames);
+	GError *err = NULL;
+	// The file is replaced atomically, so an interrupted conversion never leaves a truncated checkpoint behind.
+	g_file_set_contents(filename, (const gchar *)checkpoint, gssize(checkpointSize), &err);
+	if (err != NULL) {
+		gchar *displayFilename = g_filename_display_name(filename);
+		fprintf(stderr, "Error writing checkpoint '%s': %s\n", displayFilename, err->message);
+		g_free(displayFilename);
+		g_error_free(err);
+	}
+	g_free(filename);
+	delete[] checkpoint;
+}
+
+// Returns the frame of the latest checkpoint stored in the directory that doesn't exceed maxFrame, or 0 if there is none.
+static unsigned long findCheckpointFrame(const gchar *checkpointDir, unsigned long maxFrame) {
+	GDir *dir = g_dir_open(*checkpointDir != '\0' ? checkpointDir : ".", 0, NULL);
+	if (dir == NULL) {
+		return 0;
+	}
+	unsigned long checkpointFrame = 0;
+	const gchar *name;
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		unsigned long frame;
+		if (sscanf(name, CHECKPOINT_FILENAME_FORMAT, &frame) != 1 || frame <= checkpointFrame || frame > maxFrame) {
+			continue;
+		}
+		gchar *expectedName = g_strdup_printf(CHECKPOINT_FILENAME_FORMAT, frame);
+		if (strcmp(name, expectedName) == 0) {
+			checkpointFrame = frame;
+		}
+		g_free(expectedName);
+	}
+	g_dir_close(dir);
+	return checkpointFrame;
+}
+
+static bool loadCheckpoint(const Options &options, unsigned long frame, Checkpoint &checkpoint) {
+	gchar *filename = makeCheckpointFilename(options.checkpointDir, frame);
+	gchar *displayFilename = g_filename_display_name(filename);
+	gsize fileBufferLength = 0;
+	bool loaded = loadFile(checkpoint.fileBuffer, fileBufferLength, filename, displayFilename);
+	if (loaded) {
+		const MT32Emu::Bit8u *data = checkpoint.fileBuffer;
+		unsigned long inputFileIx = 0;
+		unsigned long firstNoiseEncountered = 0;
+		unsigned long unterminatedSysexLen = 0;
+		loaded = fileBufferLength >= CHECKPOINT_HEADER_SIZE && memcmp(data, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0;
+		if (loaded) {
+			data += sizeof(CHECKPOINT_MAGIC);
+			data = getUInt32LE(data, inputFileIx);
+			data = getUInt32LE(data, checkpoint.eventCount);
+			data = getUInt32LE(data, checkpoint.smfRenderedFrames);
+			data = getUInt32LE(data, checkpoint.renderedFrames);
+			data = getUInt32LE(data, checkpoint.writtenFrames);
+			data = getUInt32LE(data, checkpoint.unwrittenSilentFrames);
+			data = getUInt32LE(data, firstNoiseEncountered);
+			data = getUInt32LE(data, unterminatedSysexLen);
+			loaded = inputFileIx < g_strv_length(options.inputFilenames) && checkpoint.renderedFrames == frame
+				&& unterminatedSysexLen <= fileBufferLength - CHECKPOINT_HEADER_SIZE;
+		}
+		if (loaded) {
+			checkpoint.inputFileIx = inputFileIx;
+			checkpoint.firstNoiseEncountered = firstNoiseEncountered != 0;
+			checkpoint.unterminatedSysex = data;
+			checkpoint.unterminatedSysexLen = unterminatedSysexLen;
+			checkpoint.synthState = data + unterminatedSysexLen;
+			checkpoint.synthStateSize = fileBufferLength - (checkpoint.synthState - checkpoint.fileBuffer);
+		} else {
+			fprintf(stderr, "Checkpoint '%s' is invalid\n", displayFilename);
+			g_free(checkpoint.fileBuffer);
+			checkpoint.fileBuffer = NULL;
+		}
+	}
+	g_free(displayFilename);
+	g_free(filename);
+	return loaded;
+}
+
+static bool restoreCheckpoint(const Options &options, State &state, Checkpoint &checkpoint) {
+	unsigned long frame = findCheckpointFrame(options.checkpointDir, options.renderStartFrames);
+	if (frame == 0 || !loadCheckpoint(options, frame, checkpoint)) {
+		return false;
+	}
+	if (!state.service.restoreState(checkpoint.synthState, checkpoint.synthStateSize)) {
+		fprintf(stderr, "Checkpoint at frame %lu doesn't match the synth configuration, rendering from the start\n", frame);
+		g_free(checkpoint.fileBuffer);
+		checkpoint.fileBuffer = NULL;
+		return false;
+	}
+	if (!options.quiet) {
+		fprintf(stdout, "Resuming from checkpoint at frame %lu\n", frame);
+	}
+	state.renderedFrames = checkpoint.renderedFrames;
+	state.nextCheckpointFrame = checkpoint.renderedFrames + options.checkpointIntervalFrames;
+	return true;
+}
+
+// Keeps track of the previous conversion while an edited SMF file is re-rendered incrementally.
+struct IncrementalRender {
+	gchar *previousOutputFilename;
+	FILE *previousOutput;
+	long previousDataOffset;
+	unsigned long previousFrameCount;
+	MT32Emu::Bit8u *previousSMFBuffer;
+	SMFReader previousSMF;
+	// The frames of the checkpoints stored by the previous conversion from the resume frame on, in ascending order.
+	// Those passed without converging are stale and get deleted.
+	unsigned long *checkpointFrames;
+	unsigned int checkpointCount;
+	unsigned int nextCheckpointIx;
+	unsigned long resumeFrame;
+	bool converged;
+	// Set when the previous output couldn't be read, the output is incomplete then.
+	bool failed;
+};
+
+static gchar *makeCheckpointInputFilename(const gchar *checkpointDir, unsigned int inputFileIx) {
+	gchar *filename = g_strdup_printf(CHECKPOINT_INPUT_FILENAME_FORMAT, inputFileIx);
+	gchar *pathName = g_strconcat(checkpointDir, filename, NULL);
+	g_free(filename);
+	return pathName;
+}
+
+static bool isSameEvent(const SMFEvent &a, const SMFEvent &b, int sampleRate) {
+	if (a.type != b.type || secondsToSamples(a.timeSeconds, sampleRate) != secondsToSamples(b.timeSeconds, sampleRate)) return false;
+	if (a.type == SMFEventType_SHORT_MESSAGE) return a.shortMessage == b.shortMessage;
+	if (a.type == SMFEventType_META && a.metaType != b.metaType) return false;
+	return a.dataLength == b.dataLength && memcmp(a.data, b.data, a.dataLength) == 0;
+}
+
+// Returns the index of the first event that differs between the readers from their current positions on,
+// or ULONG_MAX if the rest of the events is the same.
+static unsigned long findFirstChangedEvent(SMFReader a, SMFReader b, int sampleRate) {
+	SMFEvent eventA, eventB;
+	for (unsigned long eventIx = 0;; eventIx++) {
+		bool hasEventA = a.nextEvent(eventA);
+		bool hasEventB = b.nextEvent(eventB);
+		if (!hasEventA && !hasEventB) return ULONG_MAX;
+		if (hasEventA != hasEventB || !isSameEvent(eventA, eventB, sampleRate)) return eventIx;
+	}
+}
+
+static void deleteCheckpoint(const Options &options, unsigned long frame) {
+	gchar *filename = makeCheckpointFilename(options.checkpointDir, frame);
+	remove(filename);
+	g_free(filename);
+}
+
+// Collects the frames of the checkpoints stored in the directory, starting with minFrame.
+static void findCheckpointFrames(const gchar *checkpointDir, unsigned long minFrame, IncrementalRender &incremental) {
+	incremental.checkpointFrames = NULL;
+	incremental.checkpointCount = 0;
+	GDir *dir = g_dir_open(*checkpointDir != '\0' ? checkpointDir : ".", 0, NULL);
+	if (dir == NULL) {
+		return;
+	}
+	unsigned int capacity = 0;
+	const gchar *name;
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		unsigned long frame;
+		if (sscanf(name, CHECKPOINT_FILENAME_FORMAT, &frame) != 1 || frame < minFrame) {
+			continue;
+		}
+		gchar *expectedName = g_strdup_printf(CHECKPOINT_FILENAME_FORMAT, frame);
+		if (strcmp(name, expectedName) == 0) {
+			if (incremental.checkpointCount == capacity) {
+				capacity = MAX(2 * capacity, 16U);
+				unsigned long *frames = new unsigned long[capacity];
+				for (unsigned int i = 0; i < incremental.checkpointCount; i++) frames[i] = incremental.checkpointFrames[i];
+				delete[] incremental.checkpointFrames;
+				incremental.checkpointFrames = frames;
+			}
+			unsigned int i = incremental.checkpointCount++;
+			for (; i > 0 && incremental.checkpointFrames[i - 1] > frame; i--) {
+				incremental.checkpointFrames[i] = incremental.checkpointFrames[i - 1];
+			}
+			incremental.checkpointFrames[i] = frame;
+		}
+		g_free(expectedName);
+	}
+	g_dir_close(dir);
+}
+
+// Copies the frames of the previous output to the output. Returns false if they can't be read.
+static bool copyPreviousFrames(IncrementalRender &incremental, const Options &options, State &state, unsigned long startFrame, unsigned long frameCount) {
+	const size_t frameSize = getOutputFrameSize(options);
+	if (fseek(incremental.previousOutput, incremental.previousDataOffset + long(startFrame * frameSize), SEEK_SET) != 0) {
+		return false;
+	}
+	size_t length = frameCount * frameSize;
+	while (length > 0) {
+		OutputBlock *block = state.output->currentBlock;
+		if (block->size == OUTPUT_BLOCK_SIZE) {
+			submitOutputBlock(*state.output);
+			continue;
+		}
+		size_t lengthThisPass = MIN(length, OUTPUT_BLOCK_SIZE - block->size);
+		if (fread(block->data + block->size, 1, lengthThisPass, incremental.previousOutput) != lengthThisPass) {
+			return false;
+		}
+		block->size += lengthThisPass;
+		length -= lengthThisPass;
+	}
+	state.writtenFrames += frameCount;
+	return true;
+}
+
+// Loads the copy of the SMF file stored by the previous conversion and finds the last checkpoint preceding the first changed
+// event. The synth state is restored from there and the output recorded up to it is copied. Without a suitable checkpoint,
+// rendering starts from the beginning. Returns false if there is no copy of the SMF file to compare with.
+static bool startIncrementalRender(const SMFReader &smf, const Options &options, State &state, Checkpoint &checkpoint) {
+	IncrementalRender &incremental = *state.incremental;
+	gchar *inputCopyFilename = makeCheckpointInputFilename(options.checkpointDir, state.inputFileIx);
+	gsize previousSMFLength = 0;
+	bool loaded = g_file_get_contents(inputCopyFilename, (gchar **)&incremental.previousSMFBuffer, &previousSMFLength, NULL)
+		&& incremental.previousSMF.load(incremental.previousSMFBuffer, previousSMFLength);
+	g_free(inputCopyFilename);
+	if (!loaded) {
+		fprintf(stderr, "No copy of the SMF file from the previous conversion in checkpoint-dir, rendering from the start\n");
+		return false;
+	}
+	SMFReader newSMF = smf;
+	newSMF.rewind();
+	unsigned long changedEventIx = findFirstChangedEvent(incremental.previousSMF, newSMF, options.sampleRate);
+	findCheckpointFrames(options.checkpointDir, 0, incremental);
+	unsigned int checkpointIx = incremental.checkpointCount;
+	while (checkpointIx > 0) {
+		unsigned long frame = incremental.checkpointFrames[--checkpointIx];
+		if (!loadCheckpoint(options, frame, checkpoint)) continue;
+		if (checkpoint.inputFileIx == state.inputFileIx && checkpoint.eventCount <= changedEventIx && checkpoint.writtenFrames <= incremental.previousFrameCount
+			&& state.service.restoreState(checkpoint.synthState, checkpoint.synthStateSize)) {
+			break;
+		}
+		g_free(checkpoint.fileBuffer);
+		checkpoint.fileBuffer = NULL;
+	}
+	if (checkpoint.fileBuffer != NULL) {
+		incremental.resumeFrame = checkpoint.renderedFrames;
+		if (!copyPreviousFrames(incremental, options, state, 0, checkpoint.writtenFrames)) {
+			fprintf(stderr, "Error reading the previous output\n");
+			incremental.failed = true;
+		}
+		state.renderedFrames = checkpoint.renderedFrames;
+		state.unwrittenSilentFrames = checkpoint.unwrittenSilentFrames;
+		state.firstNoiseEncountered = checkpoint.firstNoiseEncountered;
+		state.nextCheckpointFrame = checkpoint.renderedFrames + options.checkpointIntervalFrames;
+		state.checkpoint = &checkpoint;
+		if (!options.quiet) {
+			fprintf(stdout, "Re-rendering from checkpoint at frame %lu\n", checkpoint.renderedFrames);
+		}
+	} else {
+		incremental.resumeFrame = 0;
+	}
+	// The checkpoints preceding the resume frame remain valid.
+	incremental.nextCheckpointIx = 0;
+	while (incremental.nextCheckpointIx < incremental.checkpointCount && incremental.checkpointFrames[incremental.nextCheckpointIx] < incremental.resumeFrame) {
+		incremental.nextCheckpointIx++;
+	}
+	return true;
+}
+
+// Checks whether the re-rendered output converges with the previous conversion at the current position in the SMF file.
+// This is the case when the previous conversion stored a checkpoint at the same frame with the same synth and recording state,
+// and the rest of the events is the same. The rest of the previous output is copied then. The checkpoints of the previous
+// conversion that are passed without converging are deleted, the re-render stores its own ones.
+static bool checkConvergence(const SMFReader &smf, unsigned long smfRenderedFrames,
+	const unsigned char *unterminatedSysex, int unterminatedSysexLen, const Options &options, State &state)
+{
+	IncrementalRender &incremental = *state.incremental;
+	while (incremental.nextCheckpointIx < incremental.checkpointCount) {
+		unsigned long frame = incremental.checkpointFrames[incremental.nextCheckpointIx];
+		if (frame > state.renderedFrames) break;
+		incremental.nextCheckpointIx++;
+		if (frame == state.renderedFrames) {
+			Checkpoint checkpoint = {NULL, 0, 0, 0, 0, 0, 0, false, NULL, 0, NULL, 0};
+			bool converged = loadCheckpoint(options, frame, checkpoint) && checkpoint.inputFileIx == state.inputFileIx
+				&& checkpoint.smfRenderedFrames == smfRenderedFrames && checkpoint.writtenFrames == state.writtenFrames
+				&& checkpoint.unwrittenSilentFrames == state.unwrittenSilentFrames && checkpoint.firstNoiseEncountered == state.firstNoiseEncountered
+				&& checkpoint.writtenFrames <= incremental.previousFrameCount && int(checkpoint.unterminatedSysexLen) == unterminatedSysexLen
+				&& memcmp(checkpoint.unterminatedSysex, unterminatedSysex, unterminatedSysexLen) == 0
+				&& state.service.saveState(NULL, 0) == checkpoint.synthStateSize;
+			if (converged) {
+				MT32Emu::Bit8u *synthState = new MT32Emu::Bit8u[checkpoint.synthStateSize];
+				state.service.saveState(synthState, checkpoint.synthStateSize);
+				converged = memcmp(synthState, checkpoint.synthState, checkpoint.synthStateSize) == 0;
+				delete[] synthState;
+			}
+			if (converged) {
+				SMFReader previousSMF = incremental.previousSMF;
+				previousSMF.rewind();
+				SMFEvent event;
+				for (unsigned long i = 0; i < checkpoint.eventCount && previousSMF.nextEvent(event); i++) {}
+				converged = findFirstChangedEvent(previousSMF, smf, options.sampleRate) == ULONG_MAX;
+			}
+			if (converged) {
+				unsigned long frameCount = incremental.previousFrameCount - checkpoint.writtenFrames;
+				if (copyPreviousFrames(incremental, options, state, checkpoint.writtenFrames, frameCount)) {
+					if (!options.quiet) {
+						fprintf(stdout, "Converged with the previous conversion at frame %lu\n", frame);
+					}
+					incremental.converged = true;
+				} else {
+					fprintf(stderr, "Error reading the previous output\n");
+					incremental.failed = true;
+				}
+			}
+			g_free(checkpoint.fileBuffer);
+			if (converged) return true;
+		}
+		if (frame != incremental.resumeFrame) deleteCheckpoint(options, frame);
+	}
+	return false;
+}
+
+// Deletes the checkpoints of the previous conversion beyond the end of the re-rendered file, unless it converged.
+static void finishIncrementalRender(const Options &options, IncrementalRender &incremental) {
+	if (!incremental.converged) {
+		for (; incremental.nextCheckpointIx < incremental.checkpointCount; incremental.nextCheckpointIx++) {
+			deleteCheckpoint(options, incremental.checkpointFrames[incremental.nextCheckpointIx]);
+		}
+	}
+	delete[] incremental.checkpointFrames;
+	incremental.checkpointFrames = NULL;
+	incremental.checkpointCount = 0;
+	g_free(incremental.previousSMFBuffer);
+	incremental.previousSMFBuffer = NULL;
+}
+
+// Moves an existing output file aside so that the unchanged parts of it can be copied while the new one is recorded.
+// Returns false if there is nothing to re-render incrementally.
+static bool openPreviousOutput(const Options &options, const gchar *outputFilename, IncrementalRender &incremental) {
+	if (!g_file_test(outputFilename, G_FILE_TEST_IS_REGULAR)) return false;
+	incremental.previousOutputFilename = g_strconcat(outputFilename, ".previous", NULL);
+	remove(incremental.previousOutputFilename);
+	if (rename(outputFilename, incremental.previousOutputFilename) != 0
+		|| (incremental.previousOutput = fopen(incremental.previousOutputFilename, "rb")) == NULL)
+	{
+		fprintf(stderr, "Error opening the previous output for incremental rendering, rendering from the start\n");
+		g_free(incremental.previousOutputFilename);
+		incremental.previousOutputFilename = NULL;
+		return false;
+	}
+	incremental.previousDataOffset = options.rawChannelCount > 0 ? 0 : WAVE_HEADER_SIZE;
+	long fileSize = fseek(incremental.previousOutput, 0, SEEK_END) == 0 ? ftell(incremental.previousOutput) : -1;
+	long dataSize = fileSize - long(incremental.previousDataOffset);
+	incremental.previousFrameCount = dataSize > 0 ? (unsigned long)(dataSize / getOutputFrameSize(options)) : 0;
+	incremental.previousSMFBuffer = NULL;
+	incremental.checkpointFrames = NULL;
+	incremental.checkpointCount = 0;
+	incremental.nextCheckpointIx = 0;
+	incremental.resumeFrame = 0;
+	incremental.converged = false;
+	incremental.failed = false;
+	return true;
+}
+
+static void closePreviousOutput(IncrementalRender &incremental, bool success) {
+	fclose(incremental.previousOutput);
+	if (success) {
+		remove(incremental.previousOutputFilename);
+	} else {
+		gchar *displayFilename = g_filename_display_name(incremental.previousOutputFilename);
+		fprintf(stderr, "The previous output is kept as '%s'\n", displayFilename);
+		g_free(displayFilename);
+	}
+	g_free(incremental.previousOutputFilename);
+}
+
+// Prints a meta event in the same way as libsmf, which the SMF files used to be loaded with.
+static void printMetaEvent(const SMFEvent &event) {
+	static const char * const TEXT_EVENT_NAMES[] = {
+		"Text", "Copyright", "Sequence/Track Name", "Instrument", "Lyric", "Marker", "Cue Point", "Program Name", "Device (Port) Name"
+	};
+	static const char * const MAJOR_KEYS[] = {
+		"Fb", "Cb", "Gb", "Db", "Ab", "Eb", "Bb", "F", "C", "G", "D", "A", "E", "B", "F#", "C#", "G#"
+	};
+	static const char * const MINOR_KEYS[] = {
+		"Dbm", "Abm", "Ebm", "Bbm", "Fm", "Cm", "Gm", "Dm", "Am", "Em", "Bm", "F#m", "C#m", "G#m", "D#m", "A#m", "E#m"
+	};
+
+	const MT32Emu::Bit8u *data = event.data;
+	MT32Emu::Bit32u length = event.dataLength;
+	if (0x01 <= event.metaType && event.metaType <= 0x09) {
+		if (length > 0) {
+			fprintf(stdout, "Metadata: %s: %.*s\n", TEXT_EVENT_NAMES[event.metaType - 1], int(length), (const char *)data);
+		}
+		return;
+	}
+	switch (event.metaType) {
+	case 0x00:
+		fprintf(stdout, "Metadata: Sequence number\n");
+		break;
+	case 0x20:
+		if (length >= 1) {
+			fprintf(stdout, "Metadata: Channel Prefix: %d\n", data[0]);
+		}
+		break;
+	case 0x21:
+		if (length >= 1) {
+			fprintf(stdout, "Metadata: MIDI Port: %d\n", data[0]);
+		}
+		break;
+	case 0x2F:
+		fprintf(stdout, "Metadata: End Of Track\n");
+		break;
+	case 0x51:
+		if (length >= 3) {
+			int mspqn = (data[0] << 16) | (data[1] << 8) | data[2];
+			fprintf(stdout, "Metadata: Tempo: %d microseconds per quarter note, %.2f BPM\n", mspqn, 60000000.0 / double(mspqn));
+		}
+		break;
+	case 0x54:
+		fprintf(stdout, "Metadata: SMPTE Offset\n");
+		break;
+	case 0x58:
+		if (length >= 4) {
+			fprintf(stdout, "Metadata: Time Signature: %d/%d, %d clocks per click, %d notated 32nd notes per quarter note\n",
+				data[0], int(pow(2.0, data[1])), data[2], data[3]);
+		}
+		break;
+	case 0x59:
+		if (length >= 2 && data[1] <= 1) {
+			int flats = data[0];
+			bool minor = data[1] != 0;
+			if (flats > 8 && flats < 248) {
+				fprintf(stdout, "Metadata: Key Signature: %d %s, %s key\n", abs(int(MT32Emu::Bit8s(flats))),
+					flats > 127 ? "flats" : "sharps", minor ? "minor" : "major");
+			} else {
+				int keyIx = (flats - 248) & 255;
+				fprintf(stdout, "Metadata: Key Signature: %s\n", minor ? MINOR_KEYS[keyIx] : MAJOR_KEYS[keyIx]);
+			}
+		}
+		break;
+	case 0x7F:
+		fprintf(stdout, "Metadata: Proprietary (aka Sequencer) Event, length %u\n", length);
+		break;
+	default:
+		break;
+	}
+}
+
+// Plays a sysex message or the continuation of an unterminated one, which is accumulated until the terminating part arrives.
+static void playSysexEvent(MT32Emu::Service &service, const unsigned char *buf, int len, bool continuation, unsigned char *&unterminatedSysex, int &unterminatedSysexLen) {
+	bool unterminated = buf[len - 1] != 0xF7;
+	bool addUnterminated = unterminated;
+	if (continuation) {
+		if (unterminatedSysex != NULL) {
+			addUnterminated = true;
+		} else {
+			fprintf(stderr, "Sysex continuation received without preceding unterminated sysex - hoping for the best\n");
+		}
+	} else {
+		if (unterminatedSysex != NULL) {
+			fprintf(stderr, "New sysex received with an unterminated sysex pending - ignoring unterminated\n");
+			delete[] unterminatedSysex;
+			unterminatedSysex = NULL;
+			unterminatedSysexLen = 0;
+		}
+	}
+	if (addUnterminated) {
+		unsigned char *newUnterminatedSysex = new unsigned char[unterminatedSysexLen + len];
+		if(unterminatedSysex != NULL) {
+			memcpy(newUnterminatedSysex, unterminatedSysex, unterminatedSysexLen);
+			delete[] unterminatedSysex;
+		}
+		memcpy(newUnterminatedSysex + unterminatedSysexLen, buf, len);
+		unterminatedSysex = newUnterminatedSysex;
+		unterminatedSysexLen += len;
+		buf = unterminatedSysex;
+		len = unterminatedSysexLen;
+	}
+	if (!unterminated) {
+		service.playSysex(buf, len);
+		if (addUnterminated) {
+			delete[] unterminatedSysex;
+			unterminatedSysex = NULL;
+			unterminatedSysexLen = 0;
+		}
+	}
+}
+
+// Plays the SMF events from the checkpoint, if any, until either the end of the file or the end frame is reached.
+static void playEvents(SMFReader &smf, const Options &options, State &state, const Checkpoint *checkpoint, unsigned long endFrame) {
+	int unterminatedSysexLen = 0;
+	unsigned char *unterminatedSysex = NULL;
+	// The file keeps the sysex status byte apart from the rest of the message, so it is put back together here.
+	unsigned int sysexBufferSize = 0;
+	unsigned char *sysexBuffer = NULL;
+	unsigned long renderedFrames = 0;
+	unsigned long eventCount = 0;
+	SMFEvent event;
+	smf.rewind();
+	if (checkpoint != NULL) {
+		// The synth state is already restored from the checkpoint, so the preceding events are merely skipped.
+		while (eventCount < checkpoint->eventCount && smf.nextEvent(event)) {
+			eventCount++;
+		}
+		renderedFrames = checkpoint->smfRenderedFrames;
+		if (checkpoint->unterminatedSysexLen > 0) {
+			unterminatedSysexLen = checkpoint->unterminatedSysexLen;
+			unterminatedSysex = new unsigned char[unterminatedSysexLen];
+			memcpy(unterminatedSysex, checkpoint->unterminatedSysex, unterminatedSysexLen);
+		}
+	}
+	for (;;) {
+		if (state.renderedFrames >= endFrame) {
+			break;
+		}
+		if (state.incremental != NULL && checkConvergence(smf, renderedFrames, unterminatedSysex, unterminatedSysexLen, options, state)) {
+			break;
+		}
+		if (options.checkpointDir != NULL && state.segmentFile == NULL && state.renderedFrames >= state.nextCheckpointFrame) {
+			saveCheckpoint(options, state, eventCount, renderedFrames, unterminatedSysex, unterminatedSysexLen);
+			state.nextCheckpointFrame = state.renderedFrames + options.checkpointIntervalFrames;
+		}
+
+		if (!smf.nextEvent(event)) {
+			break;
+		}
+		eventCount++;
+
+		unsigned long eventFrameIx = secondsToSamples(event.timeSeconds, options.sampleRate);
+		unsigned int renderLength = (eventFrameIx > renderedFrames) ? eventFrameIx - renderedFrames : 1;
+		if (state.renderedFrames + renderLength > options.renderMaxFrames) {
+			renderLength = options.renderMaxFrames - state.renderedFrames;
+		}
+		render(renderLength, options, state);
+		renderedFrames += renderLength;
+		// During a dense burst, the synth falls behind the events as it emulates the MIDI interface delays. Rather than
+		// dropping the events that don't fit into the MIDI event queue, rendering proceeds until the queue frees some room.
+		while (state.service.getMIDIEventQueueFreeCapacity() == 0 && state.renderedFrames < options.renderMaxFrames) {
+			render(1, options, state);
+			renderedFrames++;
+		}
+		if (state.renderedFrames == options.renderMaxFrames) {
+			break;
+		}
+
+		switch (event.type) {
+		case SMFEventType_META:
+			if (!options.quiet) {
+				printMetaEvent(event);
+			}
+			break;
+		case SMFEventType_SYSEX:
+			if (sysexBufferSize < event.dataLength + 1) {
+				delete[] sysexBuffer;
+				sysexBufferSize = event.dataLength + 1;
+				sysexBuffer = new unsigned char[sysexBufferSize];
+			}
+			sysexBuffer[0] = 0xF0;
+			memcpy(sysexBuffer + 1, event.data, event.dataLength);
+			playSysexEvent(state.service, sysexBuffer, event.dataLength + 1, false, unterminatedSysex, unterminatedSysexLen);
+			break;
+		case SMFEventType_SYSEX_CONTINUATION:
+			playSysexEvent(state.service, event.data, event.dataLength, true, unterminatedSysex, unterminatedSysexLen);
+			break;
+		case SMFEventType_ESCAPED:
+			if (event.data[0] == 0xF0) {
+				// A complete sysex message may be sent this way as well.
+				playSysexEvent(state.service, event.data, event.dataLength, false, unterminatedSysex, unterminatedSysexLen);
+			} else if (event.dataLength > 3) {
+				fprintf(stderr, "Got message with unusual length: %u\n", event.dataLength);
+				for (MT32Emu::Bit32u i = 0; i < event.dataLength; i++) {
+					fprintf(stderr, " %02x", event.data[i]);
+				}
+				fprintf(stderr, "\n");
+			} else {
+				MT32Emu::Bit32u msg = 0;
+				for (MT32Emu::Bit32u i = 0; i < event.dataLength; i++) {
+					msg |= (event.data[i] << (8 * i));
+				}
+				state.service.playMsg(msg);
+			}
+			break;
+		case SMFEventType_SHORT_MESSAGE:
+			state.service.playMsg(event.shortMessage);
+			break;
+		}
+	}
+	delete[] sysexBuffer;
+	delete[] unterminatedSysex;
+}
+
+static void allocateSampleBuffers(const Options &options, State &state) {
+	if (options.rawChannelCount > 0) {
+		for (int i = 0; i < 6; i++) {
+			if (options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32) {
+				state.rawSampleBuffer[i] = new float[options.bufferFrameCount];
+			} else {
+				state.rawSampleBuffer[i] = new MT32Emu::Bit16s[options.bufferFrameCount];
+			}
+		}
+	} else {
+		if (options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32) {
+			state.stereoSampleBuffer = new float[options.bufferFrameCount * 2];
+		} else {
+			state.stereoSampleBuffer = new MT32Emu::Bit16s[options.bufferFrameCount * 2];
+		}
+	}
+}
+
+static void freeSampleBuffers(const Options &options, State &state) {
+	if (options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32) {
+		delete[] static_cast<float *>(state.stereoSampleBuffer);
+		for (int i = 0; i < 6; i++) {
+			delete[] static_cast<float *>(state.rawSampleBuffer[i]);
+		}
+	} else {
+		delete[] static_cast<MT32Emu::Bit16s *>(state.stereoSampleBuffer);
+		for (int i = 0; i < 6; i++) {
+			delete[] static_cast<MT32Emu::Bit16s *>(state.rawSampleBuffer[i]);
+		}
+	}
+}
+
+static bool addROMFiles(MT32Emu::Service &service, const Options &options) {
+	gchar *baseDir = options.romDir;
 	if (baseDir == NULL)
 		baseDir = (gchar *)"";
 	gchar pathNameUtf8[2048];
@@ -833,7 +1957,7 @@ int main(int argc, char *argv[]) {
 		pathName = g_locale_from_utf8(pathNameUtf8, strlen(pathNameUtf8), NULL, NULL, NULL);
 		if (service.addROMFile(pathName) != MT32EMU_RC_ADDED_CONTROL_ROM) {
 			fprintf(stderr, "Control ROM not found.\n");
-			return 1;
+			return false;
 		}
 	}
 	g_free(pathName);
@@ -847,100 +1971,981 @@ int main(int argc, char *argv[]) {
 		pathName = g_locale_from_utf8(pathNameUtf8, strlen(pathNameUtf8), NULL, NULL, NULL);
 		if (service.addROMFile(pathName) != MT32EMU_RC_ADDED_PCM_ROM) {
 			fprintf(stderr, "PCM ROM not found.\n");
-			return 1;
+			return false;
 		}
 	}
 	g_free(pathName);
+	return true;
+}
+
+static void applyRuntimeSettings(MT32Emu::Service &service, const Options &options) {
+	service.setDACInputMode(options.dacInputMode);
+	if (!options.niceAmpRamp) {
+		service.setNiceAmpRampEnabled(false);
+	}
+	if (options.preview) {
+		service.setFloatWaveAccuracy(MT32Emu::FloatWaveAccuracy_FAST);
+		if (options.previewReverb == PREVIEW_REVERB_REDUCED) {
+			service.setReverbSilenceThreshold(PREVIEW_REVERB_SILENCE_THRESHOLD);
+		} else if (options.previewReverb == PREVIEW_REVERB_DISABLED) {
+			service.setReverbEnabled(false);
+		}
+	}
+}
+
+static bool openSynth(MT32Emu::Service &service, const Options &options) {
 	service.setStereoOutputSampleRate(options.sampleRate);
 	service.setSamplerateConversionQuality(options.srcQuality);
 	service.setPartialCount(options.partialCount);
 	service.setAnalogOutputMode(options.analogOutputMode);
 	service.selectRendererType(options.rendererType);
-	if (service.openSynth() == MT32EMU_RC_OK) {
-		service.setDACInputMode(options.dacInputMode);
-		if (!options.niceAmpRamp) {
-			service.setNiceAmpRampEnabled(false);
+	service.setPartialCullingLevel(options.partialCullingLevel);
+	if (options.romCacheDir != NULL) service.setROMCacheDirectory(options.romCacheDir);
+	if (service.openSynth() != MT32EMU_RC_OK) {
+		return false;
+	}
+	applyRuntimeSettings(service, options);
+	return true;
+}
+
+// Resets the synth to the state it has right after opening, considerably faster than reopening it.
+static bool resetSynth(MT32Emu::Service &service, const Options &options) {
+	if (!service.resetToOpenState()) {
+		return false;
+	}
+	// The reverb may have been re-enabled by the reset.
+	applyRuntimeSettings(service, options);
+	return true;
+}
+
+static void printPreviewApproximations(const Options &options) {
+	static const char *REVERB_DESCRIPTIONS[] = {"full reverb", "reverb tail cut at about -48 dB", "reverb disabled"};
+	printf("Preview mode approximations: float renderer with fast wave functions; partials culled below TVA level %d (about -%.0f dB);"
+		" no analogue low-pass filter; fastest sample rate conversion; %s\n", options.partialCullingLevel,
+		0.375 * (256 - options.partialCullingLevel), REVERB_DESCRIPTIONS[options.previewReverb]);
+}
+
+// Renders a segment of an SMF file in a separate thread with its own synth, starting at a checkpoint.
+struct Job {
+	const Options &options;
+	MT32Emu::Service service;
+	State state;
+	Checkpoint checkpoint;
+	SMFReader smf;
+	unsigned long endFrame;
+	GThread *thread;
+	// The synth state at the end of the last segment, which the rest of the file is played from.
+	MT32Emu::Bit8u *finalSynthState;
+	size_t finalSynthStateSize;
+
+	Job(const Options &useOptions, unsigned int inputFileIx);
+	~Job();
+};
+
+static State makeState(MT32Emu::Service &service, unsigned int inputFileIx, unsigned long nextCheckpointFrame) {
+	State state = {NULL, {NULL, NULL, NULL, NULL, NULL, NULL}, service, NULL, NULL, false, false, 0, 0, 0, inputFileIx, nextCheckpointFrame, NULL, NULL, NULL, NULL};
+	return state;
+}
+
+Job::Job(const Options &useOptions, unsigned int inputFileIx) :
+	options(useOptions), state(makeState(service, inputFileIx, ULONG_MAX)), endFrame(ULONG_MAX), thread(NULL),
+	finalSynthState(NULL), finalSynthStateSize(0)
+{
+	Checkpoint noCheckpoint = {NULL, 0, 0, 0, 0, 0, 0, false, NULL, 0, NULL, 0};
+	checkpoint = noCheckpoint;
+}
+
+Job::~Job() {
+	if (thread != NULL) {
+		g_thread_join(thread);
+	}
+	delete[] finalSynthState;
+	freeSampleBuffers(options, state);
+	if (state.segmentFile != NULL) {
+		fclose(state.segmentFile);
+	}
+	g_free(checkpoint.fileBuffer);
+}
+
+static gpointer runJob(gpointer data) {
+	Job *job = static_cast<Job *>(data);
+	playEvents(job->smf, job->options, job->state, &job->checkpoint, job->endFrame);
+	if (job->endFrame == ULONG_MAX) {
+		job->finalSynthStateSize = job->service.saveState(NULL, 0);
+		job->finalSynthState = new MT32Emu::Bit8u[job->finalSynthStateSize];
+		job->service.saveState(job->finalSynthState, job->finalSynthStateSize);
+	}
+	return NULL;
+}
+
+// Prepares a job to render from the checkpoint at the frame, returns NULL if the checkpoint isn't suitable.
+static Job *createJob(const SMFReader &smf, unsigned long frame, const Options &options, unsigned int inputFileIx) {
+	Job *job = new Job(options, inputFileIx);
+	bool created = loadCheckpoint(options, frame, job->checkpoint) && job->checkpoint.inputFileIx == inputFileIx;
+	if (created) {
+		job->service.createContext();
+		created = addROMFiles(job->service, options) && openSynth(job->service, options)
+			&& job->service.restoreState(job->checkpoint.synthState, job->checkpoint.synthStateSize);
+	}
+	if (created) {
+		job->smf = smf;
+		job->state.segmentFile = tmpfile();
+		created = job->state.segmentFile != NULL;
+	}
+	if (!created) {
+		delete job;
+		return NULL;
+	}
+	allocateSampleBuffers(options, job->state);
+	job->state.renderedFrames = job->checkpoint.renderedFrames;
+	return job;
+}
+
+// Splits rendering of the rest of the SMF file at the checkpoints, the segments following the first one are rendered concurrently.
+// Returns the number of jobs started, the frame that the first segment ends at is the start frame of the first job.
+static unsigned int startJobs(const SMFReader &smf, const Options &options, const State &state, Job **jobs) {
+	unsigned long fileStartFrame = state.renderedFrames - (state.checkpoint != NULL ? state.checkpoint->smfRenderedFrames : 0);
+	unsigned long startFrame = MAX(state.renderedFrames, (unsigned long)options.renderStartFrames);
+	unsigned long endFrame = MIN(fileStartFrame + secondsToSamples(smf.getLengthSeconds(), options.sampleRate), (unsigned long)options.renderMaxFrames);
+	unsigned int jobCount = 0;
+	unsigned long splitFrame = startFrame;
+	for (unsigned int i = 1; i < options.jobCount && startFrame < endFrame; i++) {
+		unsigned long frame = findCheckpointFrame(options.checkpointDir, startFrame + (endFrame - startFrame) / options.jobCount * i);
+		if (frame <= splitFrame) {
+			continue;
 		}
-		options.sampleRate = service.getActualStereoOutputSamplerate();
-		printf("Using output sample rate %d Hz\n", options.sampleRate);
+		Job *job = createJob(smf, frame, options, state.inputFileIx);
+		if (job == NULL) {
+			continue;
+		}
+		if (jobCount > 0) {
+			jobs[jobCount - 1]->endFrame = frame;
+		}
+		jobs[jobCount++] = job;
+		splitFrame = frame;
+	}
+	for (unsigned int i = 0; i < jobCount; i++) {
+		jobs[i]->thread = g_thread_new("mt32emu-smf2wav job", runJob, jobs[i]);
+	}
+	return jobCount;
+}
 
-		FILE *outputFile;
-		bool outputFileExists = false;
-		if (!options.force) {
-			// FIXME: Lame way of avoiding overwriting an existing file
-			// (since it could theoretically be created between us testing and
-			// opening for writing)
-			if (g_file_test(outputFilename, G_FILE_TEST_EXISTS)) {
-				outputFileExists = true;
+static void playSMF(SMFReader &smf, const Options &options, State &state) {
+	Checkpoint incrementalCheckpoint = {NULL, 0, 0, 0, 0, 0, 0, false, NULL, 0, NULL, 0};
+	if (state.incremental != NULL && !startIncrementalRender(smf, options, state, incrementalCheckpoint)) {
+		state.incremental = NULL;
+	}
+	Job **jobs = NULL;
+	unsigned int jobCount = 0;
+	// In batch mode, the job count is the number of files converted concurrently instead.
+	if (options.jobCount > 1 && !options.batch && options.checkpointDir != NULL) {
+		jobs = new Job *[options.jobCount - 1];
+		jobCount = startJobs(smf, options, state, jobs);
+		if (jobCount == 0) {
+			fprintf(stderr, "Warning: No suitable checkpoints found in checkpoint-dir, rendering serially."
+				" The checkpoints stored now allow rendering in segments next time\n");
+		} else if (jobCount + 1 < options.jobCount) {
+			fprintf(stderr, "Warning: Only %u suitable checkpoints found in checkpoint-dir, rendering in %u segments\n", jobCount, jobCount + 1);
+		}
+	}
+	if (jobCount == 0) {
+		playEvents(smf, options, state, state.checkpoint, ULONG_MAX);
+	} else {
+		playEvents(smf, options, state, state.checkpoint, jobs[0]->checkpoint.renderedFrames);
+		bool recorded = true;
+		for (unsigned int i = 0; i < jobCount && recorded; i++) {
+			Job *job = jobs[i];
+			g_thread_join(job->thread);
+			job->thread = NULL;
+			recorded = state.renderedFrames == job->checkpoint.renderedFrames && recordSegment(job->state.segmentFile, options, state);
+		}
+		// Continue with the synth state that the last segment ends with.
+		Job *lastJob = jobs[jobCount - 1];
+		if (!recorded || !state.service.restoreState(lastJob->finalSynthState, lastJob->finalSynthStateSize)) {
+			fprintf(stderr, "Error recording the segments rendered concurrently, the checkpoints may not match the input\n");
+		}
+		for (unsigned int i = 0; i < jobCount; i++) {
+			delete jobs[i];
+		}
+	}
+	delete[] jobs;
+	g_free(incrementalCheckpoint.fileBuffer);
+	if (state.incremental != NULL) {
+		finishIncrementalRender(options, *state.incremental);
+		// The rest of the output is copied from the previous conversion.
+		if (state.incremental->converged) return;
+	}
+	flushSilence(MIDI_ENDED, options, state);
+	if (options.sendAllNotesOff) {
+		for (unsigned char channel = 0; channel < 16; channel++) {
+			state.service.playMsg(0x0040B0 | channel); // Release sustain pedal
+			state.service.playMsg(0x007BB0 | channel); // All notes off
+		}
+	}
+	if (state.lastInputFile && options.renderMinFrames > state.renderedFrames) {
+		render(options.renderMinFrames - state.renderedFrames, options, state);
+	}
+	if (options.waitForLA32) {
+		while (state.renderedFrames < options.renderMaxFrames && state.service.hasActivePartials()) {
+			// Some tests need to see the precise frame when partials become inactive. Rather than rendering one frame
+			// at a time, we jump ahead by the number of frames during which no partial may deactivate.
+			unsigned int renderLength = MAX(1U, state.service.getMinRemainingPartialFrameCount());
+			if (renderLength > options.renderMaxFrames - state.renderedFrames) {
+				renderLength = options.renderMaxFrames - state.renderedFrames;
+			}
+			render(renderLength, options, state);
+		}
+		flushSilence(LA32_INACTIVE, options, state);
+		if (options.waitForReverb) {
+			unsigned int reverbEndFrames = MIN(MAX_REVERB_END_FRAMES, options.bufferFrameCount);
+			while (state.renderedFrames < options.renderMaxFrames && state.service.isActive()) {
+				// Render a healthy number of frames while waiting for reverb to become inactive.
+				// Note that once we've detected inactivity, silent samples will not be written.
+				unsigned int renderLength = reverbEndFrames;
+				if (state.renderedFrames + renderLength > options.renderMaxFrames) {
+					renderLength = options.renderMaxFrames - state.renderedFrames;
+				}
+				render(renderLength, options, state);
 			}
 		}
-		if (outputFileExists) {
+	}
+	if (!state.service.isActive()) {
+		state.unwrittenSilentFrames = 0;
+	}
+}
+
+static bool playFile(const gchar *inputFilename, const gchar *displayInputFilename, const Options &options, State &state) {
+	// The file is mapped rather than read, the SMF events are decoded straight from there.
+	GError *err = NULL;
+	GMappedFile *mappedFile = g_mapped_file_new(inputFilename, FALSE, &err);
+	if (mappedFile == NULL) {
+		fprintf(stderr, "Error reading file '%s': %s\n", displayInputFilename, err->message);
+		g_error_free(err);
+		return false;
+	}
+	const MT32Emu::Bit8u *fileBuffer = (const MT32Emu::Bit8u *)g_mapped_file_get_contents(mappedFile);
+	gsize fileBufferLength = g_mapped_file_get_length(mappedFile);
+	bool played;
+	if (fileBufferLength > 0 && fileBuffer[0] == 0xF0) {
+		played = playSysexFileBuffer(state.service, displayInputFilename, fileBuffer, fileBufferLength);
+	} else {
+		SMFReader smf;
+		played = smf.load(fileBuffer, fileBufferLength);
+		if (played) {
+			if (!options.quiet) {
+				fprintf(stdout, "format: %u (%s); number of tracks: %u; division: %u PPQN.\n", smf.getFormat(),
+					smf.getFormat() == 0 ? "single track" : "several simultaneous tracks", smf.getTrackCount(), smf.getDivision());
+			}
+			playSMF(smf, options, state);
+			if (options.checkpointDir != NULL) {
+				// Kept for comparing with when the file is edited and re-rendered incrementally.
+				gchar *inputCopyFilename = makeCheckpointInputFilename(options.checkpointDir, state.inputFileIx);
+				g_file_set_contents(inputCopyFilename, (const gchar *)fileBuffer, gssize(fileBufferLength), NULL);
+				g_free(inputCopyFilename);
+			}
+		} else {
+			fprintf(stderr, "Error parsing SMF file '%s'.\n", displayInputFilename);
+		}
+	}
+	g_mapped_file_unref(mappedFile);
+	return played;
+}
+
+static gchar *makeOutputFilename(const Options &options, const gchar *inputFilename, const gchar *outputDir) {
+	const gchar *extension = options.splitStreams == SPLIT_STREAMS_WAVE ? ".wav" : options.rawChannelCount > 0 ? ".raw" : options.flac ? ".flac" : ".wav";
+	if (outputDir == NULL) {
+		return g_strconcat(inputFilename, extension, NULL);
+	}
+	gchar *baseName = g_path_get_basename(inputFilename);
+	gchar *fileName = g_strconcat(baseName, extension, NULL);
+	gchar *outputFilename = g_build_filename(outputDir, fileName, NULL);
+	g_free(fileName);
+	g_free(baseName);
+	return outputFilename;
+}
+
+// Plays the input files one after another through the synth and records the output prepared in the state.
+// Returns false if any of the files couldn't be played.
+static bool playFiles(const Options &options, gchar **inputFilenames, State &state) {
+	bool played = true;
+	allocateSampleBuffers(options, state);
+	Checkpoint checkpoint = {NULL, 0, 0, 0, 0, 0, 0, false, NULL, 0, NULL, 0};
+	if (options.checkpointDir != NULL && options.renderStartFrames > 0 && restoreCheckpoint(options, state, checkpoint)) {
+		state.checkpoint = &checkpoint;
+	}
+	gchar **inputFilename = inputFilenames;
+	while (*inputFilename != NULL) {
+		// The files preceding the checkpoint are already played.
+		if (state.checkpoint == NULL || state.inputFileIx == state.checkpoint->inputFileIx) {
+			gchar *displayInputFilename = g_filename_display_name(*inputFilename);
+			state.lastInputFile = *(inputFilename + 1) == NULL; // FIXME: This should actually be true if all subsequent files are sysex
+			if (!playFile(*inputFilename, displayInputFilename, options, state)) played = false;
+			state.checkpoint = NULL;
+			g_free(displayInputFilename);
+		}
+		inputFilename++;
+		state.inputFileIx++;
+	}
+	g_free(checkpoint.fileBuffer);
+	freeSampleBuffers(options, state);
+	return played;
+}
+
+// Opens the output file for writing unless it exists and overwriting isn't forced. Returns NULL on failure.
+static FILE *openOutputFile(const Options &options, const gchar *outputFilename, const gchar *displayOutputFilename) {
+	if (!options.force) {
+		// FIXME: Lame way of avoiding overwriting an existing file
+		// (since it could theoretically be created between us testing and
+		// opening for writing)
+		if (g_file_test(outputFilename, G_FILE_TEST_EXISTS)) {
 			fprintf(stderr, "Destination file '%s' exists.\n", displayOutputFilename);
-			outputFile = NULL;
+			return NULL;
+		}
+	}
+	FILE *outputFile = fopen(outputFilename, "wb");
+	if (outputFile == NULL) {
+		fprintf(stderr, "Error opening file '%s' for writing.\n", displayOutputFilename);
+	}
+	return outputFile;
+}
+
+// Returns the name of the file to write the stream to, the output file name with the stream name inserted before the extension.
+static gchar *makeStreamFilename(const gchar *outputFilename, int streamId) {
+	gchar *baseName = g_path_get_basename(outputFilename);
+	const gchar *baseExtension = strrchr(baseName, '.');
+	// A leading dot doesn't start an extension.
+	size_t extensionLength = baseExtension == NULL || baseExtension == baseName ? 0 : strlen(baseExtension);
+	g_free(baseName);
+	size_t stemLength = strlen(outputFilename) - extensionLength;
+	gchar *stem = g_strndup(outputFilename, stemLength);
+	gchar *streamFilename = g_strconcat(stem, ".", STREAM_FILENAME_SUFFIXES[streamId], outputFilename + stemLength, NULL);
+	g_free(stem);
+	return streamFilename;
+}
+
+// Plays the input files through the synth and records each selected raw stream to a separate file named after the output file.
+// Returns false unless all the output files could be opened and written, and all the input files could be played.
+static bool recordSplitStreamFiles(MT32Emu::Service &service, const Options &options, gchar **inputFilenames, const gchar *outputFilename) {
+	FILE *streamFiles[8];
+	Output *streamOutputs[8];
+	gchar *displayStreamFilenames[8];
+	bool opened = true;
+	for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
+		streamFiles[chanMapIx] = NULL;
+		streamOutputs[chanMapIx] = NULL;
+		displayStreamFilenames[chanMapIx] = NULL;
+		if (options.rawChannelMap[chanMapIx] < 0 || !opened) continue;
+		gchar *streamFilename = makeStreamFilename(outputFilename, options.rawChannelMap[chanMapIx]);
+		displayStreamFilenames[chanMapIx] = g_filename_display_name(streamFilename);
+		streamFiles[chanMapIx] = openOutputFile(options, streamFilename, displayStreamFilenames[chanMapIx]);
+		g_free(streamFilename);
+		if (streamFiles[chanMapIx] == NULL) {
+			opened = false;
+		} else if (options.splitStreams == SPLIT_STREAMS_WAVE && !writeWAVEHeader(streamFiles[chanMapIx], options.sampleRate, options.outputSampleFormat, 1)) {
+			fprintf(stderr, "Error writing WAVE header to '%s'\n", displayStreamFilenames[chanMapIx]);
+			opened = false;
 		} else {
-			outputFile = fopen(outputFilename, "wb");
+			streamOutputs[chanMapIx] = startOutput(streamFiles[chanMapIx], options);
+		}
+	}
+	State state = makeState(service, 0, options.checkpointIntervalFrames);
+	bool success = opened;
+	if (opened) {
+		state.streamOutputs = streamOutputs;
+		success = playFiles(options, inputFilenames, state);
+	}
+	for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
+		if (streamOutputs[chanMapIx] != NULL) {
+			if (!finishOutput(streamOutputs[chanMapIx])) {
+				fprintf(stderr, "Error writing to '%s'\n", displayStreamFilenames[chanMapIx]);
+				success = false;
+			} else if (opened && options.splitStreams == SPLIT_STREAMS_WAVE && !fillWAVESizes(streamFiles[chanMapIx], state.writtenFrames, options.outputSampleFormat, 1)) {
+				fprintf(stderr, "Error writing final sizes to WAVE header\n");
+				success = false;
+			}
+		}
+		if (streamFiles[chanMapIx] != NULL && fclose(streamFiles[chanMapIx]) != 0) success = false;
+		g_free(displayStreamFilenames[chanMapIx]);
+	}
+	return success;
+}
+
+// Counts the conversions served from the render cache and those rendered, shared by the batch workers.
+static volatile gint renderCacheHitCount = 0;
+static volatile gint renderCacheMissCount = 0;
+
+// Returns the name of the file in the render cache that holds the output of the conversion, or NULL if any of the input files
+// can't be read. The name is the SHA-256 hash of everything that affects the output: the contents of the input files,
+// the ROMs, the versions of the library and the program, and the options. The output file name doesn't matter.
+static gchar *makeRenderCacheFilename(MT32Emu::Service &service, const Options &options, gchar **inputFilenames) {
+	GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	mt32emu_rom_info romInfo;
+	service.getROMInfo(&romInfo);
+	GString *key = g_string_new("mt32emu-smf2wav render cache 1\n");
+	g_string_append_printf(key, "version=%s\nlibrary=%s\ncontrolROM=%s\npcmROM=%s\n", VERSION, service.getLibraryVersionString(),
+		romInfo.control_rom_sha1_digest != NULL ? romInfo.control_rom_sha1_digest : "", romInfo.pcm_rom_sha1_digest != NULL ? romInfo.pcm_rom_sha1_digest : "");
+	g_string_append_printf(key, "flac=%d\nsampleFormat=%d\nsampleRate=%d\nsrcQuality=%d\ndacInputMode=%d\nanalogOutputMode=%d\n"
+		"rendererType=%d\npartialCount=%d\npartialCullingLevel=%d\nniceAmpRamp=%d\npreview=%d\npreviewReverb=%d\n",
+		options.flac ? 1 : 0, int(options.outputSampleFormat), options.sampleRate, int(options.srcQuality), int(options.dacInputMode),
+		int(options.analogOutputMode), int(options.rendererType), options.partialCount, int(options.partialCullingLevel),
+		options.niceAmpRamp ? 1 : 0, options.preview ? 1 : 0, int(options.previewReverb));
+	g_string_append(key, "rawStreams=");
+	for (int chanMapIx = 0; chanMapIx < options.rawChannelCount; chanMapIx++) {
+		g_string_append_printf(key, "%d,", options.rawChannelMap[chanMapIx]);
+	}
+	g_string_append_printf(key, "\nrenderStart=%u\nrenderMin=%u\nrenderMax=%u\nrecordMaxStartSilence=%d\nrecordMaxEndSilence=%d\n"
+		"recordMaxLA32EndSilence=%d\nwaitForLA32=%d\nwaitForReverb=%d\nsendAllNotesOff=%d\ninputFiles=%u\n",
+		options.renderStartFrames, options.renderMinFrames, options.renderMaxFrames, options.recordMaxStartSilentFrames,
+		options.recordMaxEndSilentFrames, options.recordMaxLA32EndSilentFrames, options.waitForLA32 ? 1 : 0,
+		options.waitForReverb ? 1 : 0, options.sendAllNotesOff ? 1 : 0, g_strv_length(inputFilenames));
+	g_checksum_update(checksum, reinterpret_cast<const guchar *>(key->str), key->len);
+	g_string_free(key, TRUE);
+	bool readable = true;
+	for (gchar **inputFilename = inputFilenames; readable && *inputFilename != NULL; inputFilename++) {
+		GMappedFile *mappedFile = g_mapped_file_new(*inputFilename, FALSE, NULL);
+		if (mappedFile == NULL) {
+			readable = false;
+			break;
 		}
+		// The length prefix keeps the boundaries of the files apart.
+		gchar *length = g_strdup_printf("%lu\n", (unsigned long)g_mapped_file_get_length(mappedFile));
+		g_checksum_update(checksum, reinterpret_cast<const guchar *>(length), strlen(length));
+		g_free(length);
+		g_checksum_update(checksum, reinterpret_cast<const guchar *>(g_mapped_file_get_contents(mappedFile)), g_mapped_file_get_length(mappedFile));
+		g_mapped_file_unref(mappedFile);
+	}
+	gchar *cacheFilename = NULL;
+	if (readable) {
+		const gchar *extension = options.rawChannelCount > 0 ? ".raw" : options.flac ? ".flac" : ".wav";
+		gchar *fileName = g_strconcat(g_checksum_get_string(checksum), extension, NULL);
+		cacheFilename = g_build_filename(options.renderCacheDir, fileName, NULL);
+		g_free(fileName);
+	}
+	g_checksum_free(checksum);
+	return cacheFilename;
+}
 
-		clock_t startTime = clock();
+// Copies the contents of the source file to the destination file, which is left open. Returns false on failure.
+static bool copyFileContents(const gchar *sourceFilename, FILE *destinationFile) {
+	FILE *sourceFile = fopen(sourceFilename, "rb");
+	if (sourceFile == NULL) return false;
+	MT32Emu::Bit8u *buffer = new MT32Emu::Bit8u[OUTPUT_BLOCK_SIZE];
+	bool success = true;
+	for (;;) {
+		size_t length = fread(buffer, 1, OUTPUT_BLOCK_SIZE, sourceFile);
+		if (length > 0 && fwrite(buffer, 1, length, destinationFile) != length) {
+			success = false;
+			break;
+		}
+		if (length < OUTPUT_BLOCK_SIZE) {
+			success = ferror(sourceFile) == 0;
+			break;
+		}
+	}
+	delete[] buffer;
+	fclose(sourceFile);
+	return success;
+}
 
-		if (outputFile != NULL) {
-			if (options.rawChannelCount > 0 || writeWAVEHeader(outputFile, options.sampleRate, options.outputSampleFormat)) {
-				State state = {NULL, {NULL, NULL, NULL, NULL, NULL, NULL}, service, outputFile, false, false, 0, 0, 0};
-				state.outputFile = outputFile;
-				if (options.rawChannelCount > 0) {
-					for (int i = 0; i < 6; i++) {
-						if (options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32) {
-							state.rawSampleBuffer[i] = new float[options.bufferFrameCount];
-						} else {
-							state.rawSampleBuffer[i] = new MT32Emu::Bit16s[options.bufferFrameCount];
-						}
-					}
-				} else {
-					if (options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32) {
-						state.stereoSampleBuffer = new float[options.bufferFrameCount * 2];
-					} else {
-						state.stereoSampleBuffer = new MT32Emu::Bit16s[options.bufferFrameCount * 2];
-					}
-				}
-				gchar **inputFilename = options.inputFilenames;
-				while (*inputFilename != NULL) {
-					gchar *displayInputFilename = g_filename_display_name(*inputFilename);
-					state.lastInputFile = *(inputFilename + 1) == NULL; // FIXME: This should actually be true if all subsequent files are sysex
-					playFile(*inputFilename, displayInputFilename, options, state);
-					inputFilename++;
-					g_free(displayInputFilename);
-				}
-				if (options.outputSampleFormat == OUTPUT_SAMPLE_FORMAT_IEEE_FLOAT32) {
-					delete[] static_cast<float *>(state.stereoSampleBuffer);
-					for (int i = 0; i < 6; i++) {
-						delete[] static_cast<float *>(state.rawSampleBuffer[i]);
-					}
-				} else {
-					delete[] static_cast<MT32Emu::Bit16s *>(state.stereoSampleBuffer);
-					for (int i = 0; i < 6; i++) {
-						delete[] static_cast<MT32Emu::Bit16s *>(state.rawSampleBuffer[i]);
-					}
+// Stores a copy of the finished output file in the render cache. The copy is written under a temporary name first and renamed
+// when complete, so that other processes sharing the cache never see a partial file.
+static void storeCachedRender(const gchar *outputFilename, const gchar *cacheFilename) {
+	gchar *tempFilename = g_strdup_printf("%s.%08x.tmp", cacheFilename, g_random_int());
+	FILE *tempFile = fopen(tempFilename, "wb");
+	bool stored = false;
+	if (tempFile != NULL) {
+		bool copied = copyFileContents(outputFilename, tempFile);
+		if (fclose(tempFile) == 0 && copied) {
+			// Another process may have stored the same output meanwhile, which is fine.
+			stored = rename(tempFilename, cacheFilename) == 0 || g_file_test(cacheFilename, G_FILE_TEST_IS_REGULAR);
+		}
+		remove(tempFilename);
+	}
+	if (!stored) {
+		gchar *displayCacheFilename = g_filename_display_name(cacheFilename);
+		fprintf(stderr, "Error storing '%s' in the render cache\n", displayCacheFilename);
+		g_free(displayCacheFilename);
+	}
+	g_free(tempFilename);
+}
+
+// Plays the input files one after another through the synth and records the output to a single file.
+// With a render cache, the output is copied from there if the same conversion was done before.
+// Returns false if the output file couldn't be opened or written, or any of the input files couldn't be played.
+static bool recordFiles(MT32Emu::Service &service, const Options &options, gchar **inputFilenames, const gchar *outputFilename) {
+	if (options.splitStreams != SPLIT_STREAMS_NONE) {
+		return recordSplitStreamFiles(service, options, inputFilenames, outputFilename);
+	}
+	gchar *displayOutputFilename = g_filename_display_name(outputFilename);
+	gchar *cacheFilename = options.renderCacheDir != NULL ? makeRenderCacheFilename(service, options, inputFilenames) : NULL;
+	bool cacheHit = cacheFilename != NULL && g_file_test(cacheFilename, G_FILE_TEST_IS_REGULAR);
+	IncrementalRender incremental;
+	bool incrementalRender = options.incremental && options.checkpointDir != NULL && !cacheHit
+		&& openPreviousOutput(options, outputFilename, incremental);
+	FILE *outputFile = openOutputFile(options, outputFilename, displayOutputFilename);
+	bool success = false;
+	if (outputFile != NULL && cacheHit) {
+		success = copyFileContents(cacheFilename, outputFile);
+		if (fclose(outputFile) != 0) success = false;
+		if (success) {
+			g_atomic_int_inc(&renderCacheHitCount);
+			if (!options.quiet) printf("Copied '%s' from the render cache\n", displayOutputFilename);
+		} else {
+			fprintf(stderr, "Error copying '%s' from the render cache\n", displayOutputFilename);
+		}
+	} else if (outputFile != NULL) {
+		State state = makeState(service, 0, options.checkpointIntervalFrames);
+		if (incrementalRender) state.incremental = &incremental;
+		if (options.flac || options.rawChannelCount > 0 || writeWAVEHeader(outputFile, options.sampleRate, options.outputSampleFormat, 2)) {
+			state.output = startOutput(outputFile, options);
+		}
+		if (state.output != NULL) {
+			bool played = playFiles(options, inputFilenames, state) && !(incrementalRender && incremental.failed);
+			if (!finishOutput(state.output)) {
+				fprintf(stderr, "Error writing to '%s'\n", displayOutputFilename);
+			} else if (!options.flac && options.rawChannelCount == 0 && !fillWAVESizes(outputFile, state.writtenFrames, options.outputSampleFormat, 2)) {
+				fprintf(stderr, "Error writing final sizes to WAVE header\n");
+			} else {
+				success = played;
+			}
+		} else if (options.flac) {
+			fprintf(stderr, "Error initialising FLAC encoder for '%s'\n", displayOutputFilename);
+		} else {
+			fprintf(stderr, "Error writing WAVE header to '%s'\n", displayOutputFilename);
+		}
+		if (fclose(outputFile) != 0) success = false;
+		if (cacheFilename != NULL) {
+			g_atomic_int_inc(&renderCacheMissCount);
+			if (success) storeCachedRender(outputFilename, cacheFilename);
+		}
+	}
+	if (incrementalRender) closePreviousOutput(incremental, success);
+	g_free(cacheFilename);
+	g_free(displayOutputFilename);
+	return success;
+}
+
+static void printBenchmarkResult(const gchar *displayInputFilename, const BenchmarkTiming &timing, int sampleRate, const mt32emu_render_statistics *statistics) {
+	double seconds = timing.totalTime * 1e-6;
+	double realtimeFactor = seconds > 0 ? timing.frameCount / double(sampleRate) / seconds : 0;
+	double framesPerSecond = seconds > 0 ? timing.frameCount / seconds : 0;
+	printf("%s: %lu frames in %.3f sec, %.1fx realtime, %.0f frames/sec; render pass mean %.1f us, peak %ld us (%lu passes)\n",
+		displayInputFilename, timing.frameCount, seconds, realtimeFactor, framesPerSecond,
+		double(timing.totalTime) / timing.passCount, long(timing.maxPassTime), timing.passCount);
+	if (statistics != NULL) {
+		printf("  la32 %.3f sec, reverb %.3f sec, analog %.3f sec, conversion %.3f sec, midi dispatch %.3f sec\n",
+			statistics->la32Time, statistics->reverbTime, statistics->analogTime, statistics->sampleFormatConversionTime,
+			statistics->midiEventDispatchTime);
+	}
+}
+
+static void appendJSONString(GString *json, const gchar *str) {
+	g_string_append_c(json, '"');
+	for (const gchar *c = str; *c != 0; c++) {
+		if (*c == '"' || *c == '\\') {
+			g_string_append_c(json, '\\');
+			g_string_append_c(json, *c);
+		} else if ((unsigned char)*c < 0x20) {
+			g_string_append_printf(json, "\\u%04x", (unsigned char)*c);
+		} else {
+			g_string_append_c(json, *c);
+		}
+	}
+	g_string_append_c(json, '"');
+}
+
+// The name is NULL for the totals. The stage times are only included when the statistics are available.
+static void appendBenchmarkResultJSON(GString *json, const gchar *displayInputFilename, const BenchmarkTiming &timing, int sampleRate, const mt32emu_render_statistics *statistics) {
+	double seconds = timing.totalTime * 1e-6;
+	g_string_append(json, "{");
+	if (displayInputFilename != NULL) {
+		g_string_append(json, "\"file\": ");
+		appendJSONString(json, displayInputFilename);
+		g_string_append(json, ", ");
+	}
+	g_string_append_printf(json, "\"frames\": %lu, \"seconds\": %.6f, \"realtimeFactor\": %.3f, \"framesPerSecond\": %.1f, "
+		"\"passes\": %lu, \"meanPassMicroseconds\": %.3f, \"peakPassMicroseconds\": %ld",
+		timing.frameCount, seconds, seconds > 0 ? timing.frameCount / double(sampleRate) / seconds : 0,
+		seconds > 0 ? timing.frameCount / seconds : 0, timing.passCount,
+		timing.passCount > 0 ? double(timing.totalTime) / timing.passCount : 0, long(timing.maxPassTime));
+	if (statistics != NULL) {
+		g_string_append_printf(json, ", \"stageSeconds\": {\"la32\": %.6f, \"reverb\": %.6f, \"analog\": %.6f, \"conversion\": %.6f, \"midiDispatch\": %.6f}",
+			statistics->la32Time, statistics->reverbTime, statistics->analogTime, statistics->sampleFormatConversionTime,
+			statistics->midiEventDispatchTime);
+	}
+	g_string_append(json, "}");
+}
+
+// Plays the input files one after another through the synth as recordFiles() does, but the output is discarded.
+// The time of each render pass is measured, and the results are reported for each SMF file and in total.
+static void benchmarkFiles(MT32Emu::Service &service, const Options &options, gchar **inputFilenames) {
+	State state = makeState(service, 0, ULONG_MAX);
+	allocateSampleBuffers(options, state);
+	BenchmarkTiming totalTiming = {0, 0, 0, 0};
+	mt32emu_render_statistics totalStatistics;
+	memset(&totalStatistics, 0, sizeof(totalStatistics));
+	bool hasStatistics = true;
+	GString *json = g_string_new(NULL);
+	g_string_append_printf(json, "{\n  \"sampleRate\": %d,\n  \"bufferFrames\": %u,\n  \"files\": [", options.sampleRate, options.bufferFrameCount);
+	unsigned int benchmarkedFileCount = 0;
+	for (gchar **inputFilename = inputFilenames; *inputFilename != NULL; inputFilename++, state.inputFileIx++) {
+		BenchmarkTiming timing = {0, 0, 0, 0};
+		state.benchmarkTiming = &timing;
+		state.lastInputFile = *(inputFilename + 1) == NULL;
+		service.resetRenderStatistics();
+		gchar *displayInputFilename = g_filename_display_name(*inputFilename);
+		playFile(*inputFilename, displayInputFilename, options, state);
+		// Sysex files render nothing.
+		if (timing.passCount > 0) {
+			mt32emu_render_statistics statistics;
+			memset(&statistics, 0, sizeof(statistics));
+			hasStatistics = service.getRenderStatistics(&statistics) && hasStatistics;
+			printBenchmarkResult(displayInputFilename, timing, options.sampleRate, hasStatistics ? &statistics : NULL);
+			g_string_append(json, benchmarkedFileCount++ > 0 ? ",\n    " : "\n    ");
+			appendBenchmarkResultJSON(json, displayInputFilename, timing, options.sampleRate, hasStatistics ? &statistics : NULL);
+			totalTiming.passCount += timing.passCount;
+			totalTiming.frameCount += timing.frameCount;
+			totalTiming.totalTime += timing.totalTime;
+			totalTiming.maxPassTime = MAX(totalTiming.maxPassTime, timing.maxPassTime);
+			totalStatistics.la32Time += statistics.la32Time;
+			totalStatistics.reverbTime += statistics.reverbTime;
+			totalStatistics.analogTime += statistics.analogTime;
+			totalStatistics.sampleFormatConversionTime += statistics.sampleFormatConversionTime;
+			totalStatistics.midiEventDispatchTime += statistics.midiEventDispatchTime;
+		}
+		g_free(displayInputFilename);
+	}
+	freeSampleBuffers(options, state);
+	if (benchmarkedFileCount > 1) {
+		printBenchmarkResult("Total", totalTiming, options.sampleRate, hasStatistics ? &totalStatistics : NULL);
+	}
+	g_string_append(json, "\n  ],\n  \"total\": ");
+	appendBenchmarkResultJSON(json, NULL, totalTiming, options.sampleRate, hasStatistics ? &totalStatistics : NULL);
+	g_string_append(json, "\n}\n");
+	if (options.benchmarkJSONFilename != NULL) {
+		GError *err = NULL;
+		if (!g_file_set_contents(options.benchmarkJSONFilename, json->str, json->len, &err)) {
+			fprintf(stderr, "Error writing benchmark results: %s\n", err->message);
+			g_error_free(err);
+		}
+	}
+	g_string_free(json, TRUE);
+}
+
+// A file converted in batch mode, with the options that apply to it.
+struct BatchJob {
+	gchar *inputFilename;
+	gchar *outputFilename;
+	Options options;
+	long inputFileSize;
+};
+
+// The jobs are distributed among the batch workers as they become free.
+struct Batch {
+	const Options &options;
+	BatchJob *jobs;
+	guint jobCount;
+	volatile gint nextJobIx;
+	// Set when converting a manifest, the workers then write the status files of the finished jobs.
+	bool writeStatusFiles;
+};
+
+static long getFileSize(const gchar *filename) {
+	FILE *file = fopen(filename, "rb");
+	if (file == NULL) return -1;
+	long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+	fclose(file);
+	return size;
+}
+
+static gchar *makeStatusFilename(const gchar *outputFilename) {
+	return g_strconcat(outputFilename, ".done", NULL);
+}
+
+// Overrides an option for a job listed in the manifest. Returns false if the setting isn't recognised or the value is invalid.
+static bool applyJobSetting(Options &options, const gchar *name, const gchar *value) {
+	char *end;
+	long number = strtol(value, &end, 10);
+	if (*value == 0 || *end != 0 || number > INT_MAX || number < INT_MIN) return false;
+	if (strcmp(name, "render-min") == 0) {
+		options.renderMinFrames = number < 0 ? 0 : MIN(number, long(options.renderMaxFrames));
+	} else if (strcmp(name, "render-max") == 0) {
+		options.renderMaxFrames = number < 0 ? INT_MAX : number;
+		options.renderMinFrames = MIN(options.renderMinFrames, options.renderMaxFrames);
+	} else if (strcmp(name, "record-max-start-silence") == 0) {
+		options.recordMaxStartSilentFrames = number < 0 ? INT_MAX : gint(number);
+	} else if (strcmp(name, "record-max-end-silence") == 0) {
+		options.recordMaxEndSilentFrames = number < 0 ? INT_MAX : gint(number);
+	} else if (strcmp(name, "record-max-la32-end-silence") == 0) {
+		options.recordMaxLA32EndSilentFrames = number < 0 ? INT_MAX : gint(number);
+	} else if (strcmp(name, "wait-for-la32") == 0 && (number == 0 || number == 1)) {
+		options.waitForLA32 = number != 0;
+	} else if (strcmp(name, "wait-for-reverb") == 0 && (number == 0 || number == 1)) {
+		options.waitForReverb = number != 0;
+	} else if (strcmp(name, "send-all-notes-off") == 0 && (number == 0 || number == 1)) {
+		options.sendAllNotesOff = number != 0;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Reads the jobs listed in the manifest. Returns false if the manifest can't be read or contains an invalid line.
+static bool loadManifest(const Options &options, BatchJob *&jobs, guint &jobCount) {
+	gchar *displayManifestFilename = g_filename_display_name(options.manifestFilename);
+	gchar *contents;
+	GError *err = NULL;
+	if (!g_file_get_contents(options.manifestFilename, &contents, NULL, &err)) {
+		fprintf(stderr, "Error reading manifest '%s': %s\n", displayManifestFilename, err->message);
+		g_error_free(err);
+		g_free(displayManifestFilename);
+		return false;
+	}
+	gchar **lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+	jobs = new BatchJob[g_strv_length(lines)];
+	jobCount = 0;
+	bool success = true;
+	for (guint lineIx = 0; success && lines[lineIx] != NULL; lineIx++) {
+		gchar *line = lines[lineIx];
+		size_t lineLength = strlen(line);
+		if (lineLength > 0 && line[lineLength - 1] == '\r') line[lineLength - 1] = 0;
+		if (*line == 0 || *line == '#') continue;
+		gchar **fields = g_strsplit(line, "\t", -1);
+		BatchJob &job = jobs[jobCount];
+		job.options = options;
+		for (guint fieldIx = 2; fields[1] != NULL && fields[fieldIx] != NULL; fieldIx++) {
+			gchar *separator = strchr(fields[fieldIx], '=');
+			if (separator != NULL) *separator = 0;
+			if (separator == NULL || !applyJobSetting(job.options, fields[fieldIx], separator + 1)) {
+				fprintf(stderr, "Invalid setting in line %u of manifest '%s'\n", lineIx + 1, displayManifestFilename);
+				success = false;
+				break;
+			}
+		}
+		if (success) {
+			job.inputFilename = g_strdup(fields[0]);
+			if (fields[1] != NULL && *fields[1] != 0) {
+				job.outputFilename = g_strdup(fields[1]);
+			} else {
+				job.outputFilename = makeOutputFilename(options, job.inputFilename, options.outputFilename);
+			}
+			jobCount++;
+		}
+		g_strfreev(fields);
+	}
+	g_strfreev(lines);
+	g_free(displayManifestFilename);
+	return success;
+}
+
+// Orders the jobs by descending input file size. As the sort is stable, the jobs with equal sizes keep their order in the list.
+static gint compareJobSizes(gconstpointer a, gconstpointer b, gpointer) {
+	long sizeA = static_cast<const BatchJob *>(a)->inputFileSize;
+	long sizeB = static_cast<const BatchJob *>(b)->inputFileSize;
+	return sizeA > sizeB ? -1 : sizeA < sizeB ? 1 : 0;
+}
+
+// Keeps only the jobs assigned to the selected shard. Starting with the largest, each file is assigned to the shard
+// with the least total size so far, the lowest-numbered one in case of a tie. Since the assignment only depends on
+// the list of jobs and the file sizes, all the shards agree on it. The jobs kept are ordered largest first,
+// which also helps to balance the load of the workers.
+static void selectShard(const Options &options, BatchJob *jobs, guint &jobCount) {
+	for (guint i = 0; i < jobCount; i++) {
+		jobs[i].inputFileSize = getFileSize(jobs[i].inputFilename);
+	}
+	BatchJob *sortedJobs = new BatchJob[jobCount];
+	for (guint i = 0; i < jobCount; i++) sortedJobs[i] = jobs[i];
+	g_qsort_with_data(sortedJobs, gint(jobCount), sizeof(BatchJob), compareJobSizes, NULL);
+	double *shardSizes = new double[options.shardCount];
+	for (unsigned int i = 0; i < options.shardCount; i++) shardSizes[i] = 0;
+	guint selectedJobCount = 0;
+	for (guint i = 0; i < jobCount; i++) {
+		unsigned int shardIx = 0;
+		for (unsigned int j = 1; j < options.shardCount; j++) {
+			if (shardSizes[j] < shardSizes[shardIx]) shardIx = j;
+		}
+		// Missing files still take part in the assignment, they only produce an error in their shard.
+		shardSizes[shardIx] += MAX(sortedJobs[i].inputFileSize, 1L);
+		if (shardIx == options.shardIndex) {
+			jobs[selectedJobCount++] = sortedJobs[i];
+		} else {
+			g_free(sortedJobs[i].inputFilename);
+			g_free(sortedJobs[i].outputFilename);
+		}
+	}
+	delete[] shardSizes;
+	delete[] sortedJobs;
+	jobCount = selectedJobCount;
+}
+
+// Converts the input files taken from the batch to separate output files with a synth of its own.
+// The synth is reset to the state it has right after opening for each file, so that the output doesn't depend
+// on the preceding files. It is only reopened if the reset fails.
+static gpointer runBatchWorker(gpointer data) {
+	Batch *batch = static_cast<Batch *>(data);
+	const Options &options = batch->options;
+	MT32Emu::Service service;
+	service.createContext();
+	if (addROMFiles(service, options)) {
+		bool opened = false;
+		for (;;) {
+			guint jobIx = guint(g_atomic_int_add(&batch->nextJobIx, 1));
+			if (jobIx >= batch->jobCount) break;
+			const BatchJob &job = batch->jobs[jobIx];
+			if (opened && !resetSynth(service, options)) {
+				service.closeSynth();
+				opened = false;
+			}
+			if (!opened) {
+				if (!openSynth(service, options)) {
+					fprintf(stderr, "Error opening MT32Emu synthesizer.\n");
+					break;
 				}
-				if (options.rawChannelCount == 0 && !fillWAVESizes(outputFile, state.writtenFrames, options.outputSampleFormat)) {
-					fprintf(stderr, "Error writing final sizes to WAVE header\n");
+				opened = true;
+			}
+			gchar *inputFilenames[] = {job.inputFilename, NULL};
+			if (recordFiles(service, job.options, inputFilenames, job.outputFilename) && batch->writeStatusFiles) {
+				gchar *statusFilename = makeStatusFilename(job.outputFilename);
+				gchar *status = g_strdup_printf("%ld\n", getFileSize(job.inputFilename));
+				if (!g_file_set_contents(statusFilename, status, -1, NULL)) {
+					gchar *displayStatusFilename = g_filename_display_name(statusFilename);
+					fprintf(stderr, "Error writing status file '%s'\n", displayStatusFilename);
+					g_free(displayStatusFilename);
 				}
+				g_free(status);
+				g_free(statusFilename);
+			}
+		}
+		service.closeSynth();
+	}
+	service.freeContext();
+	return NULL;
+}
+
+// Prepares the jobs from the manifest or the source files, and starts the batch workers for the jobs of the selected shard
+// which aren't finished yet. Waits for all of them to finish.
+static void recordBatch(const Options &options) {
+	Batch batch = {options, NULL, 0, 0, options.manifestFilename != NULL};
+	if (batch.writeStatusFiles) {
+		if (!loadManifest(options, batch.jobs, batch.jobCount)) {
+			for (guint i = 0; i < batch.jobCount; i++) {
+				g_free(batch.jobs[i].inputFilename);
+				g_free(batch.jobs[i].outputFilename);
+			}
+			delete[] batch.jobs;
+			return;
+		}
+	} else {
+		batch.jobCount = g_strv_length(options.inputFilenames);
+		batch.jobs = new BatchJob[batch.jobCount];
+		for (guint i = 0; i < batch.jobCount; i++) {
+			batch.jobs[i].inputFilename = g_strdup(options.inputFilenames[i]);
+			batch.jobs[i].outputFilename = makeOutputFilename(options, options.inputFilenames[i], options.outputFilename);
+			batch.jobs[i].options = options;
+		}
+	}
+	if (options.shardCount > 1) selectShard(options, batch.jobs, batch.jobCount);
+	if (batch.writeStatusFiles) {
+		guint pendingJobCount = 0;
+		for (guint i = 0; i < batch.jobCount; i++) {
+			gchar *statusFilename = makeStatusFilename(batch.jobs[i].outputFilename);
+			if (g_file_test(statusFilename, G_FILE_TEST_EXISTS)) {
+				g_free(batch.jobs[i].inputFilename);
+				g_free(batch.jobs[i].outputFilename);
 			} else {
-				fprintf(stderr, "Error writing WAVE header to '%s'\n", displayOutputFilename);
+				batch.jobs[pendingJobCount++] = batch.jobs[i];
 			}
-			fclose(outputFile);
+			g_free(statusFilename);
+		}
+		if (pendingJobCount < batch.jobCount) {
+			printf("Skipping %u finished jobs\n", batch.jobCount - pendingJobCount);
+		}
+		batch.jobCount = pendingJobCount;
+	}
+	guint workerCount = MIN(options.jobCount, batch.jobCount);
+	GThread **workers = new GThread *[workerCount];
+	for (guint i = 0; i < workerCount; i++) {
+		workers[i] = g_thread_new("mt32emu-smf2wav worker", runBatchWorker, &batch);
+	}
+	for (guint i = 0; i < workerCount; i++) {
+		g_thread_join(workers[i]);
+	}
+	delete[] workers;
+	for (guint i = 0; i < batch.jobCount; i++) {
+		g_free(batch.jobs[i].inputFilename);
+		g_free(batch.jobs[i].outputFilename);
+	}
+	delete[] batch.jobs;
+}
+
+int main(int argc, char *argv[]) {
+	Options options;
+	MT32Emu::Service service;
+	setlocale(LC_ALL, "");
+	printf("Munt MT32Emu MIDI to Wave Conversion Utility. Version %s\n", VERSION);
+	printf("  Copyright (C) 2009, 2011 Jerome Fisher <re_munt@kingguppy.com>\n");
+	printf("  Copyright (C) 2012-2020 Jerome Fisher, Sergey V. Mikayev\n");
+	printf("Using Munt MT32Emu Library Version %s\n", service.getLibraryVersionString());
+	if (!parseOptions(argc, argv, &options)) {
+		return -1;
+	}
+
+	service.createContext();
+	if (!addROMFiles(service, options)) {
+		return 1;
+	}
+	if (openSynth(service, options)) {
+		options.sampleRate = service.getActualStereoOutputSamplerate();
+		printf("Using output sample rate %d Hz\n", options.sampleRate);
+		if (options.preview) printPreviewApproximations(options);
+		if (options.checkpointDir != NULL && options.benchmark) {
+			// Storing the checkpoints would distort the timing.
+			fprintf(stderr, "Checkpoints are not used in benchmark mode, ignoring checkpoint-dir\n");
+			g_free(options.checkpointDir);
+			options.checkpointDir = NULL;
+		}
+		if (options.checkpointDir != NULL && options.batch) {
+			// The checkpoints of different files would be mixed up.
+			fprintf(stderr, "Checkpoints are not supported in batch mode, ignoring checkpoint-dir\n");
+			g_free(options.checkpointDir);
+			options.checkpointDir = NULL;
+		}
+		if (options.checkpointDir != NULL && options.sampleRate != int(service.getStereoOutputSamplerate(options.analogOutputMode))) {
+			// The state of the sample rate converter isn't saved, so rendering couldn't be resumed precisely.
+			fprintf(stderr, "Checkpoints are not supported with sample rate conversion, ignoring checkpoint-dir\n");
+			g_free(options.checkpointDir);
+			options.checkpointDir = NULL;
+		}
+
+		clock_t startTime = clock();
+
+		if (options.benchmark) {
+			benchmarkFiles(service, options, options.inputFilenames);
+		} else if (options.batch) {
+			// The synth of the main thread stays open, so that the workers share the decoded PCM ROM kept alive by it.
+			recordBatch(options);
 			printf("Elapsed time: %f sec\n", float(clock() - startTime) / CLOCKS_PER_SEC);
 		} else {
-			fprintf(stderr, "Error opening file '%s' for writing.\n", displayOutputFilename);
+			gchar *outputFilename;
+			if (options.outputFilename != NULL) {
+				outputFilename = g_strdup(options.outputFilename);
+			} else {
+				outputFilename = makeOutputFilename(options, options.inputFilenames[g_strv_length(options.inputFilenames) - 1], NULL);
+			}
+			if (recordFiles(service, options, options.inputFilenames, outputFilename)) {
+				printf("Elapsed time: %f sec\n", float(clock() - startTime) / CLOCKS_PER_SEC);
+			}
+			g_free(outputFilename);
 		}
 	} else {
 		fprintf(stderr, "Error opening MT32Emu synthesizer.\n");
 	}
+	if (options.renderCacheDir != NULL) {
+		printf("Render cache: %d hits, %d misses\n", g_atomic_int_get(&renderCacheHitCount), g_atomic_int_get(&renderCacheMissCount));
+	}
 	service.freeContext();
 
-	if(options.outputFilename == NULL && outputFilename != NULL) {
-		free(outputFilename);
-	}
-	g_free(displayOutputFilename);
 	freeOptions(&options);
 	return 0;
 }
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2012-2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks SMFReader against small files built in memory, and then against randomly mutated copies of them,
+// which must neither crash nor yield events pointing outside the file. Exits with a non-zero status on failure.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../src/SMFReader.h"
+
+using namespace MT32Emu;
+
+static const unsigned int DIVISION = 96;
+// Seconds per tick at the default tempo of 120 BPM.
+static const double TICK_SECONDS = 0.5 / DIVISION;
+
+static unsigned int failureCount = 0;
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+static void check(bool condition, const char *text, int line) {
+	if (condition) return;
+	fprintf(stderr, "SMFReaderTest.cpp:%d: check failed: %s\n", line, text);
+	failureCount++;
+}
+
+static void appendUInt16BE(std::vector<Bit8u> &file, unsigned int value) {
+	file.push_back(Bit8u(value >> 8));
+	file.push_back(Bit8u(value));
+}
+
+static void appendUInt32BE(std::vector<Bit8u> &file, Bit32u value) {
+	appendUInt16BE(file, value >> 16);
+	appendUInt16BE(file, value & 0xFFFF);
+}
+
+static std::vector<Bit8u> makeHeader(unsigned int format, unsigned int trackCount, unsigned int division) {
+	std::vector<Bit8u> file;
+	file.insert(file.end(), "MThd", "MThd" + 4);
+	appendUInt32BE(file, 6);
+	appendUInt16BE(file, format);
+	appendUInt16BE(file, trackCount);
+	appendUInt16BE(file, division);
+	return file;
+}
+
+// Appends a track chunk. The declared length may exceed the actual data, as in a truncated file.
+static void appendTrack(std::vector<Bit8u> &file, const Bit8u *data, size_t length, size_t declaredLength) {
+	file.insert(file.end(), "MTrk", "MTrk" + 4);
+	appendUInt32BE(file, Bit32u(declaredLength));
+	file.insert(file.end(), data, data + length);
+}
+
+static bool isShortMessage(const SMFEvent &event, Bit32u message, unsigned long tick) {
+	return event.type == SMFEventType_SHORT_MESSAGE && event.shortMessage == message
+		&& std::fabs(event.timeSeconds - tick * TICK_SECONDS) < 1e-9;
+}
+
+static void testRunningStatusAcrossMetaAndSysex() {
+	static const Bit8u TRACK[] = {
+		0x00, 0x90, 0x3C, 0x40,
+		0x00, 0xFF, 0x01, 0x03, 'a', 'b', 'c',
+		0x10, 0x3E, 0x41,
+		0x00, 0xF0, 0x03, 0x41, 0x10, 0xF7,
+		0x10, 0x40, 0x42,
+		0x00, 0xC1, 0x05,
+		0x08, 0x06,
+		0x00, 0xFF, 0x2F, 0x00
+	};
+	std::vector<Bit8u> file = makeHeader(0, 1, DIVISION);
+	appendTrack(file, TRACK, sizeof(TRACK), sizeof(TRACK));
+
+	SMFReader reader;
+	CHECK(reader.load(&file[0], file.size()));
+	CHECK(reader.getFormat() == 0);
+	CHECK(reader.getTrackCount() == 1);
+	CHECK(reader.getDivision() == DIVISION);
+	CHECK(std::fabs(reader.getLengthSeconds() - 40 * TICK_SECONDS) < 1e-9);
+
+	SMFEvent event;
+	CHECK(reader.nextEvent(event) && isShortMessage(event, 0x403C90, 0));
+	CHECK(reader.nextEvent(event) && event.type == SMFEventType_META && event.metaType == 0x01
+		&& event.dataLength == 3 && memcmp(event.data, "abc", 3) == 0);
+	CHECK(reader.nextEvent(event) && isShortMessage(event, 0x413E90, 16));
+	CHECK(reader.nextEvent(event) && event.type == SMFEventType_SYSEX && event.dataLength == 3 && event.data[2] == 0xF7);
+	CHECK(reader.nextEvent(event) && isShortMessage(event, 0x424090, 32));
+	CHECK(reader.nextEvent(event) && isShortMessage(event, 0x05C1, 32));
+	CHECK(reader.nextEvent(event) && isShortMessage(event, 0x06C1, 40));
+	CHECK(reader.nextEvent(event) && event.type == SMFEventType_META && event.metaType == 0x2F);
+	CHECK(!reader.nextEvent(event));
+
+	// A copy starts over independently.
+	reader.rewind();
+	SMFReader copy = reader;
+	CHECK(reader.nextEvent(event) && isShortMessage(event, 0x403C90, 0));
+	CHECK(reader.nextEvent(event) && event.type == SMFEventType_META);
+	CHECK(copy.nextEvent(event) && isShortMessage(event, 0x403C90, 0));
+}
+
+static void testTruncatedTracks() {
+	// The first track is cut off in the middle of a note off, the declared chunk length runs past the end of the file.
+	static const Bit8u TRUNCATED_TRACK[] = {
+		0x00, 0x90, 0x3C, 0x40,
+		0x30, 0x80, 0x3C
+	};
+	// The second track is complete but lacks the end of track event.
+	static const Bit8u UNTERMINATED_TRACK[] = {
+		0x10, 0x91, 0x43, 0x40,
+		0x40, 0x43, 0x00
+	};
+	// The third track ends with an incomplete delta time.
+	static const Bit8u BAD_DELTA_TRACK[] = {
+		0x20, 0xFF, 0x51, 0x03, 0x03, 0xD0, 0x90,
+		0x81
+	};
+	std::vector<Bit8u> file = makeHeader(1, 3, DIVISION);
+	appendTrack(file, UNTERMINATED_TRACK, sizeof(UNTERMINATED_TRACK), sizeof(UNTERMINATED_TRACK));
+	appendTrack(file, BAD_DELTA_TRACK, sizeof(BAD_DELTA_TRACK), sizeof(BAD_DELTA_TRACK));
+	appendTrack(file, TRUNCATED_TRACK, sizeof(TRUNCATED_TRACK), sizeof(TRUNCATED_TRACK) + 10);
+
+	SMFReader reader;
+	CHECK(reader.load(&file[0], file.size()));
+	CHECK(reader.getTrackCount() == 3);
+
+	SMFEvent event;
+	CHECK(reader.nextEvent(event) && isShortMessage(event, 0x403C90, 0));
+	CHECK(reader.nextEvent(event) && isShortMessage(event, 0x404391, 16));
+	// The tempo change to 240 BPM at tick 32 applies to the following events.
+	CHECK(reader.nextEvent(event) && event.type == SMFEventType_META && event.metaType == 0x51
+		&& std::fabs(event.timeSeconds - 32 * TICK_SECONDS) < 1e-9);
+	CHECK(reader.nextEvent(event) && event.type == SMFEventType_SHORT_MESSAGE && event.shortMessage == 0x004391
+		&& std::fabs(event.timeSeconds - (32 * TICK_SECONDS + 48 * 0.25 / DIVISION)) < 1e-9);
+	CHECK(!reader.nextEvent(event));
+	CHECK(std::fabs(reader.getLengthSeconds() - (32 * TICK_SECONDS + 48 * 0.25 / DIVISION)) < 1e-9);
+
+	// The file may end anywhere, even within the header of a track chunk.
+	for (size_t length = file.size(); length > 14; length--) {
+		std::vector<Bit8u> prefix(file.begin(), file.begin() + length);
+		SMFReader prefixReader;
+		bool loaded = prefixReader.load(&prefix[0], prefix.size());
+		CHECK(loaded == (length >= 14 + 8));
+		while (loaded && prefixReader.nextEvent(event)) {}
+	}
+}
+
+static void testSMPTEDivision() {
+	static const Bit8u TRACK[] = {
+		0x00, 0x90, 0x3C, 0x40,
+		0x00, 0xFF, 0x2F, 0x00
+	};
+	// 25 frames per second, 40 ticks per frame.
+	std::vector<Bit8u> file = makeHeader(0, 1, 0xE728);
+	appendTrack(file, TRACK, sizeof(TRACK), sizeof(TRACK));
+	SMFReader reader;
+	CHECK(!reader.load(&file[0], file.size()));
+}
+
+static void testFormat2() {
+	static const Bit8u TRACK[] = {
+		0x00, 0x90, 0x3C, 0x40,
+		0x00, 0xFF, 0x2F, 0x00
+	};
+	std::vector<Bit8u> file = makeHeader(2, 2, DIVISION);
+	appendTrack(file, TRACK, sizeof(TRACK), sizeof(TRACK));
+	appendTrack(file, TRACK, sizeof(TRACK), sizeof(TRACK));
+	SMFReader reader;
+	CHECK(!reader.load(&file[0], file.size()));
+}
+
+// Deterministic, so that a failure is reproducible.
+static Bit32u nextRandom(Bit32u &seed) {
+	seed = seed * 1103515245u + 12345u;
+	return seed >> 16;
+}
+
+static void testMutatedFiles() {
+	static const Bit8u TRACK[] = {
+		0x00, 0x90, 0x3C, 0x40,
+		0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20,
+		0x10, 0x3E, 0x41,
+		0x00, 0xF0, 0x03, 0x41, 0x10, 0x12,
+		0x05, 0xF7, 0x02, 0x00, 0xF7,
+		0x10, 0x40, 0x42,
+		0x83, 0x00, 0xE0, 0x00, 0x40,
+		0x00, 0xFF, 0x2F, 0x00
+	};
+	std::vector<Bit8u> original = makeHeader(1, 2, DIVISION);
+	appendTrack(original, TRACK, sizeof(TRACK), sizeof(TRACK));
+	appendTrack(original, TRACK, sizeof(TRACK), sizeof(TRACK));
+
+	Bit32u seed = 1;
+	for (unsigned int iteration = 0; iteration < 20000; iteration++) {
+		std::vector<Bit8u> file = original;
+		unsigned int mutationCount = 1 + nextRandom(seed) % 4;
+		for (unsigned int i = 0; i < mutationCount && file.size() > 14; i++) {
+			size_t position = 14 + nextRandom(seed) % (file.size() - 14);
+			switch (nextRandom(seed) % 3) {
+			case 0:
+				file[position] = Bit8u(nextRandom(seed));
+				break;
+			case 1:
+				file.erase(file.begin() + position);
+				break;
+			default:
+				file.resize(position);
+				break;
+			}
+		}
+		// A separate buffer of the exact size, so that a memory checker catches reading past the end.
+		Bit8u *buffer = new Bit8u[file.size()];
+		memcpy(buffer, &file[0], file.size());
+		SMFReader reader;
+		if (reader.load(buffer, file.size())) {
+			SMFEvent event;
+			double lastTime = 0.0;
+			unsigned int eventCount = 0;
+			while (reader.nextEvent(event)) {
+				CHECK(event.timeSeconds >= lastTime);
+				lastTime = event.timeSeconds;
+				if (event.type != SMFEventType_SHORT_MESSAGE) {
+					CHECK(event.data >= buffer && event.data + event.dataLength <= buffer + file.size());
+				}
+				eventCount++;
+			}
+			CHECK(lastTime == reader.getLengthSeconds() || eventCount == 0);
+		}
+		delete[] buffer;
+		if (failureCount > 0) {
+			fprintf(stderr, "SMFReaderTest.cpp: mutated file %u failed\n", iteration);
+			return;
+		}
+	}
+}
+
+int main() {
+	testRunningStatusAcrossMetaAndSysex();
+	testTruncatedTracks();
+	testSMPTEDivision();
+	testFormat2();
+	testMutatedFiles();
+	if (failureCount > 0) {
+		fprintf(stderr, "%u check(s) failed\n", failureCount);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Writing end of the MIDI ring the page passes to the AudioWorkletProcessor, for use on the main thread or in a worker.
+//
+// The ring lives in a SharedArrayBuffer: a header of two 32-bit words, the total number of bytes written followed by
+// the total number of bytes read, then the bytes themselves. The capacity is a power of 2 and the counters wrap around,
+// so the position of a byte in the ring is its counter modulo the capacity. There is a single writer and a single
+// reader, the processor, which delivers the bytes available at the start of each render quantum to the synth.
+// The counters are accessed with Atomics, a counter is updated after the bytes it covers are in place.
+
+const HEADER_SIZE = 8;
+const WRITE_COUNT = 0;
+const READ_COUNT = 1;
+
+export class MIDIRing {
+	// Wraps a ring created with MIDIRing.create(), e.g. in another worker the buffer was posted to.
+	constructor(buffer) {
+		this.buffer = buffer;
+		this.header = new Int32Array(buffer, 0, 2);
+		this.data = new Uint8Array(buffer, HEADER_SIZE);
+		this.mask = this.data.length - 1;
+	}
+
+	// Creates a ring that holds up to capacity bytes, rounded up to a power of 2.
+	static create(capacity = 4096) {
+		let size = 1;
+		while (size < capacity) size <<= 1;
+		return new MIDIRing(new SharedArrayBuffer(HEADER_SIZE + size));
+	}
+
+	// Returns the number of bytes that can be written without overrunning the reader.
+	getFreeSpace() {
+		const writeCount = Atomics.load(this.header, WRITE_COUNT);
+		const readCount = Atomics.load(this.header, READ_COUNT);
+		return this.data.length - ((writeCount - readCount) | 0);
+	}
+
+	// Writes a complete MIDI message, either a short message or a SysEx, given as an array of bytes.
+	// Returns false and writes nothing if it doesn't fit, so that no partial message ever reaches the synth.
+	write(bytes) {
+		if (bytes.length > this.getFreeSpace()) return false;
+		let position = Atomics.load(this.header, WRITE_COUNT);
+		for (let i = 0; i < bytes.length; i++) {
+			this.data[position & this.mask] = bytes[i];
+			position++;
+		}
+		Atomics.store(this.header, WRITE_COUNT, position | 0);
+		return true;
+	}
+}
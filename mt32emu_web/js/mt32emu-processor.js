@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// AudioWorkletProcessor that runs the synth. This file is appended to the Emscripten output, which defines
+// createMT32EmuModule(), so the resulting script is loaded with audioWorklet.addModule() as is.
+//
+// The node is created with the processor options:
+//   wasmModule - the WebAssembly.Module compiled from mt32emu-web.wasm by the page,
+//   roms       - an array of ArrayBuffers with the control and PCM ROM images,
+//   midiRing   - the SharedArrayBuffer of a MIDIRing (see mt32emu-midi-ring.js) the page writes MIDI messages to.
+// The processor posts {type: 'ready', simdInstructionSet} once the synth is open, or {type: 'error', message} otherwise.
+// See mt32emu-midi-ring.js for the layout of the ring.
+
+const MIDI_RING_HEADER_SIZE = 8;
+const MIDI_RING_WRITE_COUNT = 0;
+const MIDI_RING_READ_COUNT = 1;
+
+class MT32EmuProcessor extends AudioWorkletProcessor {
+	constructor(options) {
+		super();
+		const processorOptions = options.processorOptions;
+		this.synth = 0;
+		this.midiRingHeader = new Int32Array(processorOptions.midiRing, 0, 2);
+		this.midiRingData = new Uint8Array(processorOptions.midiRing, MIDI_RING_HEADER_SIZE);
+		this.midiRingMask = this.midiRingData.length - 1;
+		try {
+			this.openSynth(processorOptions.wasmModule, processorOptions.roms);
+		} catch (e) {
+			this.port.postMessage({type: 'error', message: String(e)});
+		}
+	}
+
+	openSynth(wasmModule, roms) {
+		// The module is compiled by the page, as an AudioWorkletGlobalScope may not fetch, and instantiated synchronously.
+		const module = createMT32EmuModule({
+			instantiateWasm(imports, successCallback) {
+				const instance = new WebAssembly.Instance(wasmModule, imports);
+				successCallback(instance, wasmModule);
+				return instance.exports;
+			}
+		});
+		const synth = module._mt32emu_web_create();
+		if (synth === 0) throw new Error('Out of memory');
+		for (const rom of roms) {
+			const romData = new Uint8Array(rom);
+			const romAddress = module._malloc(romData.length);
+			module.HEAPU8.set(romData, romAddress);
+			const result = module._mt32emu_web_add_rom(synth, romAddress, romData.length);
+			module._free(romAddress);
+			if (result < 0) {
+				module._mt32emu_web_free(synth);
+				throw new Error('Unsupported ROM image, error ' + result);
+			}
+		}
+		const result = module._mt32emu_web_open(synth, sampleRate);
+		if (result < 0) {
+			module._mt32emu_web_free(synth);
+			throw new Error('Failed to open synth, error ' + result);
+		}
+		this.module = module;
+		this.synth = synth;
+		this.midiBufferAddress = module._mt32emu_web_get_midi_buffer(synth);
+		this.midiBufferSize = module._mt32emu_web_get_midi_buffer_size();
+		this.leftAddress = module._mt32emu_web_get_output(synth, 0);
+		this.rightAddress = module._mt32emu_web_get_output(synth, 1);
+		this.port.postMessage({type: 'ready', simdInstructionSet: module._mt32emu_web_get_simd_instruction_set()});
+	}
+
+	// Moves the bytes available in the ring to the MIDI buffer of the synth, returns their number.
+	drainMIDIRing() {
+		const writeCount = Atomics.load(this.midiRingHeader, MIDI_RING_WRITE_COUNT);
+		let readCount = Atomics.load(this.midiRingHeader, MIDI_RING_READ_COUNT);
+		const byteCount = Math.min((writeCount - readCount) | 0, this.midiBufferSize);
+		const heap = this.module.HEAPU8;
+		for (let i = 0; i < byteCount; i++) {
+			heap[this.midiBufferAddress + i] = this.midiRingData[readCount & this.midiRingMask];
+			readCount++;
+		}
+		Atomics.store(this.midiRingHeader, MIDI_RING_READ_COUNT, readCount | 0);
+		return byteCount;
+	}
+
+	process(inputs, outputs) {
+		if (this.synth === 0) return false;
+		const output = outputs[0];
+		const frameCount = output[0].length;
+		this.module._mt32emu_web_render_block(this.synth, this.drainMIDIRing(), frameCount);
+		// The views are created per quantum, as the heap may not be reused after the memory has grown.
+		const heap = this.module.HEAPF32;
+		output[0].set(heap.subarray(this.leftAddress >> 2, (this.leftAddress >> 2) + frameCount));
+		if (output.length > 1) output[1].set(heap.subarray(this.rightAddress >> 2, (this.rightAddress >> 2) + frameCount));
+		return true;
+	}
+}
+
+registerProcessor('mt32emu-processor', MT32EmuProcessor);
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2020 Jerome Fisher, Sergey V. Mikayev
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Entry points of the WebAssembly module, called by the AudioWorkletProcessor in js/mt32emu-processor.js.
+// The processor drains the MIDI ring the page writes to into the MIDI buffer of the synth, then renders a block
+// of planar float frames that it copies to the outputs. Nothing is allocated while rendering.
+
+#include <cstddef>
+#include <cstdlib>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#else
+#define EMSCRIPTEN_KEEPALIVE
+#endif
+
+#define MT32EMU_API_TYPE 1
+#include <mt32emu/mt32emu.h>
+
+// A render quantum of the Web Audio API is 128 frames, larger blocks are allowed for future hosts.
+static const mt32emu_bit32u MAX_BLOCK_FRAMES = 1024;
+// Limits the MIDI bytes delivered per block. The rest stays in the ring till the next block.
+static const mt32emu_bit32u MIDI_BUFFER_SIZE = 4096;
+
+struct WebSynth {
+	mt32emu_context context;
+	bool open;
+	float left[MAX_BLOCK_FRAMES];
+	float right[MAX_BLOCK_FRAMES];
+	mt32emu_bit8u midiBuffer[MIDI_BUFFER_SIZE];
+};
+
+extern "C" {
+
+EMSCRIPTEN_KEEPALIVE WebSynth *mt32emu_web_create() {
+	WebSynth *synth = static_cast<WebSynth *>(calloc(1, sizeof(WebSynth)));
+	if (synth == NULL) return NULL;
+	const mt32emu_report_handler_i reportHandler = { NULL };
+	synth->context = mt32emu_create_context(reportHandler, NULL);
+	return synth;
+}
+
+EMSCRIPTEN_KEEPALIVE void mt32emu_web_free(WebSynth *synth) {
+	if (synth == NULL) return;
+	mt32emu_free_context(synth->context);
+	free(synth);
+}
+
+// Adds a control or PCM ROM image, which is copied. Returns the mt32emu_return_code.
+EMSCRIPTEN_KEEPALIVE int mt32emu_web_add_rom(WebSynth *synth, const mt32emu_bit8u *data, mt32emu_bit32u size) {
+	return mt32emu_add_rom_data(synth->context, data, size, NULL);
+}
+
+// Opens the synth with the float renderer, converting the output to the sample rate of the AudioContext.
+// Returns the mt32emu_return_code.
+EMSCRIPTEN_KEEPALIVE int mt32emu_web_open(WebSynth *synth, double sampleRate) {
+	mt32emu_select_renderer_type(synth->context, MT32EMU_RT_FLOAT);
+	mt32emu_set_stereo_output_samplerate(synth->context, sampleRate);
+	mt32emu_set_samplerate_conversion_quality(synth->context, MT32EMU_SRCQ_GOOD);
+	const mt32emu_return_code result = mt32emu_open_synth(synth->context);
+	synth->open = result == MT32EMU_RC_OK;
+	return result;
+}
+
+EMSCRIPTEN_KEEPALIVE mt32emu_bit8u *mt32emu_web_get_midi_buffer(WebSynth *synth) {
+	return synth->midiBuffer;
+}
+
+EMSCRIPTEN_KEEPALIVE mt32emu_bit32u mt32emu_web_get_midi_buffer_size() {
+	return MIDI_BUFFER_SIZE;
+}
+
+EMSCRIPTEN_KEEPALIVE mt32emu_bit32u mt32emu_web_get_max_block_frames() {
+	return MAX_BLOCK_FRAMES;
+}
+
+// Returns the planar output buffer of channel 0 (left) or 1 (right), valid for the lifetime of the synth.
+EMSCRIPTEN_KEEPALIVE float *mt32emu_web_get_output(WebSynth *synth, mt32emu_bit32u channel) {
+	return channel == 0 ? synth->left : synth->right;
+}
+
+// Plays the MIDI bytes placed in the MIDI buffer at the start of the block, then renders the block to the output buffers.
+// Messages split between blocks are reassembled by the MIDI stream parser.
+EMSCRIPTEN_KEEPALIVE void mt32emu_web_render_block(WebSynth *synth, mt32emu_bit32u midiByteCount, mt32emu_bit32u frameCount) {
+	if (frameCount > MAX_BLOCK_FRAMES) frameCount = MAX_BLOCK_FRAMES;
+	if (!synth->open) {
+		for (mt32emu_bit32u i = 0; i < frameCount; i++) {
+			synth->left[i] = 0.0f;
+			synth->right[i] = 0.0f;
+		}
+		return;
+	}
+	if (midiByteCount > MIDI_BUFFER_SIZE) midiByteCount = MIDI_BUFFER_SIZE;
+	if (midiByteCount > 0) mt32emu_parse_stream(synth->context, synth->midiBuffer, midiByteCount);
+	const mt32emu_stereo_output_float output = { synth->left, synth->right, 1, MT32EMU_BOOL_FALSE, 1.0f };
+	mt32emu_render_float_output(synth->context, &output, frameCount);
+}
+
+// Returns the SIMD instruction set the kernels are dispatched for, so that the page may report which build is running.
+EMSCRIPTEN_KEEPALIVE int mt32emu_web_get_simd_instruction_set() {
+	return mt32emu_get_simd_instruction_set();
+}
+
+} // extern "C"
@@ -16,6 +16,12 @@
 
 #include "stdafx.h"
 
+#include <cstdlib>
+
+#include <objbase.h>
+#include <mmdeviceapi.h>
+#include <audioclient.h>
+
 #ifdef __MINGW32__
 
 #define sscanf_s sscanf
@@ -24,6 +30,9 @@ typedef LONG LSTATUS;
 
 #endif // defined(__MINGW32__)
 
+typedef HANDLE (WINAPI *AvSetMmThreadCharacteristicsFunction)(LPCWSTR taskName, LPDWORD taskIndex);
+typedef BOOL (WINAPI *AvRevertMmThreadCharacteristicsFunction)(HANDLE avrtHandle);
+
 // For the sake of Win9x compatibility
 #undef CreateEvent
 #define CreateEvent CreateEventA
@@ -33,12 +42,36 @@ namespace MT32Emu {
 static const char MT32EMU_REGISTRY_PATH[] = "Software\\muntemu.org\\Munt mt32emu-qt";
 static const char MT32EMU_REGISTRY_DRIVER_SUBKEY_V1[] = "waveout";
 static const char MT32EMU_REGISTRY_DRIVER_SUBKEY_V2[] = "Audio\\waveout";
+static const char MT32EMU_REGISTRY_WASAPI_DRIVER_SUBKEY[] = "Audio\\wasapi";
 static const char MT32EMU_REGISTRY_MASTER_SUBKEY[] = "Master";
 static const char MT32EMU_REGISTRY_PROFILES_SUBKEY[] = "Profiles";
 
 // Each frame consists of two samples for both the Left and Right channels
 static const unsigned int SAMPLES_PER_FRAME = 2;
 
+// WASAPI device names are the same as used by mt32emu-qt
+static const char WASAPI_DEFAULT_DEVICE_NAME[] = "Default device";
+static const char WASAPI_EXCLUSIVE_MODE_SUFFIX[] = " (exclusive mode)";
+
+// Waiting for the buffer event longer than that means the endpoint has stopped
+static const DWORD WASAPI_EVENT_TIMEOUT_MS = 2000;
+static const REFERENCE_TIME REFTIMES_PER_SECOND = 10000000;
+
+// Defined here rather than taken from uuid.lib, since the MinGW import libraries lack some of them
+static const CLSID CLSID_MT32EMU_MMDeviceEnumerator = {0xBCDE0395, 0xE52F, 0x467C, {0x8E, 0x3D, 0xC4, 0x57, 0x92, 0x91, 0x69, 0x2E}};
+static const IID IID_MT32EMU_IMMDeviceEnumerator = {0xA95664D2, 0x9614, 0x4F35, {0xA7, 0x46, 0xDE, 0x8D, 0xB6, 0x36, 0x17, 0xE6}};
+static const IID IID_MT32EMU_IAudioClient = {0x1CB9AD4C, 0xDBFA, 0x4C32, {0xB1, 0x78, 0xC2, 0xF5, 0x68, 0xA7, 0x03, 0xB2}};
+static const IID IID_MT32EMU_IAudioRenderClient = {0xF294ACFC, 0x3146, 0x4483, {0xA7, 0xBF, 0xAD, 0xDC, 0xA7, 0xC2, 0x60, 0xE2}};
+static const IID IID_MT32EMU_IAudioClock = {0xCD63314F, 0x3FBA, 0x4A1B, {0x81, 0x2C, 0xEF, 0x96, 0x35, 0x87, 0x28, 0xE7}};
+static const PROPERTYKEY PKEY_MT32EMU_Device_FriendlyName = {{0xA45C254E, 0xDF1C, 0x4EFD, {0x80, 0x20, 0x67, 0xD1, 0x46, 0xA8, 0x50, 0xE0}}, 14};
+
+#ifndef AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM
+#define AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM 0x80000000
+#endif
+#ifndef AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY
+#define AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY 0x08000000
+#endif
+
 enum ReverbCompatibilityMode {
 	ReverbCompatibilityMode_DEFAULT,
 	ReverbCompatibilityMode_MT32,
@@ -264,6 +297,7 @@ public:
 } waveOut;
 
 void WaveOutWin32::RenderingThread(void *) {
+	HANDLE hMmcssTask = midiSynth.ApplyRenderingThreadPolicy();
 	if (waveOut.chunks == 1) {
 		// Rendering using single looped ring buffer
 		while (!waveOut.stopProcessing) {
@@ -288,11 +322,272 @@ void WaveOutWin32::RenderingThread(void *) {
 			}
 		}
 	}
+	midiSynth.RevertRenderingThreadPolicy(hMmcssTask);
 #ifdef ENABLE_DEBUG_OUTPUT
 	std::cout << "Rendering thread stopped\n";
 #endif
 }
 
+// Event-driven WASAPI output, the synth renders straight into the endpoint buffer. In the shared mode, the engine
+// converts the format as necessary and the buffer is as long as the audio latency setting. In the exclusive mode,
+// the device period is derived from the chunk length and the buffer holds a single period, played in turn with
+// the one being filled. COM is only used in the rendering thread, which sets up the audio client and reports
+// the outcome to Init() before entering the rendering loop.
+static class WASAPIWin32 {
+private:
+	IAudioClient *audioClient;
+	IAudioRenderClient *renderClient;
+	IAudioClock *audioClock;
+	UINT64 clockFrequency;
+	HANDLE hEvent;
+	HANDLE hInitDone;
+	HANDLE hThread;
+	UINT32 bufferFrames;
+	bool exclusiveMode;
+	int initResult;
+
+	unsigned int sampleRate;
+	unsigned int bufferSize;
+	unsigned int chunkSize;
+	const char *audioDeviceName;
+
+	volatile bool stopProcessing;
+	volatile bool paused;
+
+	template <class T>
+	static void SafeRelease(T *&object) {
+		if (object != NULL) {
+			object->Release();
+			object = NULL;
+		}
+	}
+
+	// Finds the endpoint by the friendly name, the name of the default device selects the default endpoint
+	static IMMDevice *FindAudioDevice(const char *deviceName) {
+		IMMDeviceEnumerator *enumerator = NULL;
+		if (FAILED(CoCreateInstance(CLSID_MT32EMU_MMDeviceEnumerator, NULL, CLSCTX_ALL, IID_MT32EMU_IMMDeviceEnumerator, (void **)&enumerator))) {
+			return NULL;
+		}
+		IMMDevice *device = NULL;
+		IMMDeviceCollection *collection = NULL;
+		UINT deviceCount = 0;
+		if (lstrcmpiA(deviceName, WASAPI_DEFAULT_DEVICE_NAME) && SUCCEEDED(enumerator->EnumAudioEndpoints(eRender, DEVICE_STATE_ACTIVE, &collection))
+			&& SUCCEEDED(collection->GetCount(&deviceCount))) {
+			for (UINT deviceIndex = 0; device == NULL && deviceIndex < deviceCount; deviceIndex++) {
+				IMMDevice *candidate = NULL;
+				IPropertyStore *properties = NULL;
+				if (SUCCEEDED(collection->Item(deviceIndex, &candidate)) && SUCCEEDED(candidate->OpenPropertyStore(STGM_READ, &properties))) {
+					PROPVARIANT friendlyName;
+					PropVariantInit(&friendlyName);
+					if (SUCCEEDED(properties->GetValue(PKEY_MT32EMU_Device_FriendlyName, &friendlyName)) && friendlyName.vt == VT_LPWSTR) {
+						char name[256];
+						WideCharToMultiByte(CP_UTF8, 0, friendlyName.pwszVal, -1, name, sizeof(name), NULL, NULL);
+						name[sizeof(name) - 1] = 0;
+						if (!lstrcmpiA(deviceName, name)) {
+							device = candidate;
+							candidate = NULL;
+						}
+					}
+					PropVariantClear(&friendlyName);
+				}
+				SafeRelease(properties);
+				SafeRelease(candidate);
+			}
+		}
+		SafeRelease(collection);
+		if (device == NULL && FAILED(enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &device))) {
+			device = NULL;
+		}
+		enumerator->Release();
+		return device;
+	}
+
+	HRESULT InitAudioClient(IMMDevice *device) {
+		WAVEFORMATEX format = {WAVE_FORMAT_PCM, 2, sampleRate, sampleRate * 4, 4, 16, 0};
+		HRESULT hr = device->Activate(IID_MT32EMU_IAudioClient, CLSCTX_ALL, NULL, (void **)&audioClient);
+		if (FAILED(hr)) return hr;
+		if (!exclusiveMode) {
+			REFERENCE_TIME duration = REFERENCE_TIME(bufferSize) * REFTIMES_PER_SECOND / sampleRate;
+			return audioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK | AUDCLNT_STREAMFLAGS_NOPERSIST
+				| AUDCLNT_STREAMFLAGS_AUTOCONVERTPCM | AUDCLNT_STREAMFLAGS_SRC_DEFAULT_QUALITY, duration, 0, &format, NULL);
+		}
+		REFERENCE_TIME defaultPeriod, minPeriod;
+		hr = audioClient->GetDevicePeriod(&defaultPeriod, &minPeriod);
+		if (FAILED(hr)) return hr;
+		REFERENCE_TIME period = REFERENCE_TIME(chunkSize) * REFTIMES_PER_SECOND / sampleRate;
+		if (period < minPeriod) period = minPeriod;
+		hr = audioClient->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK | AUDCLNT_STREAMFLAGS_NOPERSIST,
+			period, period, &format, NULL);
+		if (hr != AUDCLNT_E_BUFFER_SIZE_NOT_ALIGNED) return hr;
+
+		// The client has to be recreated with the period matching the aligned buffer size
+		UINT32 alignedFrames;
+		hr = audioClient->GetBufferSize(&alignedFrames);
+		SafeRelease(audioClient);
+		if (FAILED(hr)) return hr;
+		period = REFERENCE_TIME((double)REFTIMES_PER_SECOND * alignedFrames / sampleRate + 0.5);
+		hr = device->Activate(IID_MT32EMU_IAudioClient, CLSCTX_ALL, NULL, (void **)&audioClient);
+		if (FAILED(hr)) return hr;
+		return audioClient->Initialize(AUDCLNT_SHAREMODE_EXCLUSIVE, AUDCLNT_STREAMFLAGS_EVENTCALLBACK | AUDCLNT_STREAMFLAGS_NOPERSIST,
+			period, period, &format, NULL);
+	}
+
+	int SetUp() {
+		char deviceName[256];
+		lstrcpynA(deviceName, audioDeviceName, sizeof(deviceName));
+		int nameLength = lstrlenA(deviceName);
+		int suffixLength = lstrlenA(WASAPI_EXCLUSIVE_MODE_SUFFIX);
+		exclusiveMode = nameLength >= suffixLength && !lstrcmpiA(deviceName + nameLength - suffixLength, WASAPI_EXCLUSIVE_MODE_SUFFIX);
+		if (exclusiveMode) deviceName[nameLength - suffixLength] = 0;
+
+		IMMDevice *device = FindAudioDevice(deviceName);
+		if (device == NULL) return 2;
+		HRESULT hr = InitAudioClient(device);
+		device->Release();
+		if (FAILED(hr)) return 2;
+
+		hEvent = CreateEvent(NULL, false, false, NULL);
+		if (hEvent == NULL || FAILED(audioClient->SetEventHandle(hEvent)) || FAILED(audioClient->GetBufferSize(&bufferFrames))
+			|| FAILED(audioClient->GetService(IID_MT32EMU_IAudioRenderClient, (void **)&renderClient))
+			|| FAILED(audioClient->GetService(IID_MT32EMU_IAudioClock, (void **)&audioClock))
+			|| FAILED(audioClock->GetFrequency(&clockFrequency)) || clockFrequency == 0) {
+			return 3;
+		}
+#ifdef ENABLE_DEBUG_OUTPUT
+		std::cout << "MT32: Using WASAPI " << (exclusiveMode ? "exclusive" : "shared") << " mode, buffer size: " << bufferFrames << " frames." << std::endl;
+#endif
+		// Pre-fill the buffer before starting, as recommended
+		if (!RenderFrames(bufferFrames) || FAILED(audioClient->Start())) return 4;
+		return 0;
+	}
+
+	void TearDown() {
+		if (audioClient != NULL) audioClient->Stop();
+		SafeRelease(audioClock);
+		SafeRelease(renderClient);
+		SafeRelease(audioClient);
+		if (hEvent != NULL) {
+			CloseHandle(hEvent);
+			hEvent = NULL;
+		}
+	}
+
+	bool RenderFrames(UINT32 frameCount) {
+		BYTE *data;
+		if (FAILED(renderClient->GetBuffer(frameCount, &data))) return false;
+		midiSynth.Render((Bit16s *)data, frameCount);
+		return SUCCEEDED(renderClient->ReleaseBuffer(frameCount, 0));
+	}
+
+public:
+	int Init(unsigned int useBufferSize, unsigned int useChunkSize, unsigned int useSampleRate, const char *useAudioDeviceName) {
+		audioClient = NULL;
+		renderClient = NULL;
+		audioClock = NULL;
+		hEvent = NULL;
+		bufferSize = useBufferSize;
+		chunkSize = useChunkSize;
+		sampleRate = useSampleRate;
+		audioDeviceName = useAudioDeviceName;
+		stopProcessing = false;
+		paused = false;
+		initResult = 1;
+
+		hInitDone = CreateEvent(NULL, false, false, NULL);
+		if (hInitDone == NULL) return 1;
+		hThread = (HANDLE)_beginthread(RenderingThread, 16384, this);
+		if (hThread == (HANDLE)-1L) {
+			hThread = NULL;
+		} else {
+			SetThreadPriority(hThread, THREAD_PRIORITY_TIME_CRITICAL);
+			WaitForSingleObject(hInitDone, INFINITE);
+		}
+		CloseHandle(hInitDone);
+		hInitDone = NULL;
+		if (initResult != 0 && hThread != NULL) {
+			WaitForSingleObject(hThread, INFINITE);
+			hThread = NULL;
+		}
+		return initResult;
+	}
+
+	// Returns the number of frames the output keeps buffered
+	unsigned int GetLatencyFrames() {
+		// In the exclusive mode, another period is being played while the buffer is rendered
+		return exclusiveMode ? 2 * bufferFrames : bufferFrames;
+	}
+
+	int Close() {
+		stopProcessing = true;
+		if (hThread != NULL) {
+#ifdef ENABLE_DEBUG_OUTPUT
+			std::cout << "Waiting for rendering thread to die\n";
+#endif
+			WaitForSingleObject(hThread, INFINITE);
+			hThread = NULL;
+		}
+		return 0;
+	}
+
+	int Pause() {
+		paused = true;
+		if (audioClient == NULL || FAILED(audioClient->Stop())) {
+			MessageBox(NULL, L"Failed to Pause wave playback", L"MT32", MB_OK | MB_ICONEXCLAMATION);
+			return 9;
+		}
+		return 0;
+	}
+
+	int Resume() {
+		paused = false;
+		if (audioClient == NULL || FAILED(audioClient->Start())) {
+			MessageBox(NULL, L"Failed to Resume wave playback", L"MT32", MB_OK | MB_ICONEXCLAMATION);
+			return 9;
+		}
+		return 0;
+	}
+
+	UINT64 GetPos() {
+		UINT64 position;
+		if (audioClock == NULL || FAILED(audioClock->GetPosition(&position, NULL))) return 0;
+		return position * sampleRate / clockFrequency;
+	}
+
+	static void RenderingThread(void *);
+} wasapi;
+
+void WASAPIWin32::RenderingThread(void *) {
+	HANDLE hMmcssTask = midiSynth.ApplyRenderingThreadPolicy();
+	HRESULT comInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	wasapi.initResult = wasapi.SetUp();
+	bool initSucceeded = wasapi.initResult == 0;
+	SetEvent(wasapi.hInitDone);
+	while (initSucceeded && !wasapi.stopProcessing) {
+		if (WaitForSingleObject(wasapi.hEvent, WASAPI_EVENT_TIMEOUT_MS) != WAIT_OBJECT_0) {
+			if (wasapi.paused) continue;
+			MessageBox(NULL, L"Audio endpoint stopped responding", L"MT32", MB_OK | MB_ICONEXCLAMATION);
+			break;
+		}
+		UINT32 frameCount = wasapi.bufferFrames;
+		if (!wasapi.exclusiveMode) {
+			UINT32 padding;
+			if (FAILED(wasapi.audioClient->GetCurrentPadding(&padding))) break;
+			frameCount -= padding;
+			if (frameCount == 0) continue;
+		}
+		if (!wasapi.RenderFrames(frameCount)) {
+			MessageBox(NULL, L"Failed to write block to audio endpoint", L"MT32", MB_OK | MB_ICONEXCLAMATION);
+			break;
+		}
+	}
+	wasapi.TearDown();
+	if (SUCCEEDED(comInit)) CoUninitialize();
+	midiSynth.RevertRenderingThreadPolicy(hMmcssTask);
+#ifdef ENABLE_DEBUG_OUTPUT
+	std::cout << "WASAPI rendering thread stopped\n";
+#endif
+}
+
 static class : public ReportHandler {
 protected:
 	virtual void onErrorControlROM() {
@@ -345,6 +640,7 @@ void MidiSynth::Render(Bit16s *bufpos, DWORD framesToRender) {
 	synth->render(bufpos, framesToRender);
 	synthEvent.Release();
 	renderedFramesCount += framesToRender;
+	UpdatePlaybackSnapshot(GetPlayedFramesCount());
 }
 
 static bool LoadBoolValue(HKEY hReg, const char *name, const bool nDefault) {
@@ -400,6 +696,61 @@ static DWORD LoadStringValue(HKEY hReg, const char *name, const char *nDefault,
 	return lstrlenA(destination);
 }
 
+// Parses a comma-separated list of CPU numbers or ranges, e.g. "2,3" or "2-3", the same way as mt32emu-qt does
+static DWORD_PTR ParseCPUList(const char *cpuList) {
+	const unsigned int maxCPUCount = sizeof(DWORD_PTR) * 8;
+	DWORD_PTR mask = 0;
+	const char *pos = cpuList;
+	while (*pos != 0) {
+		char *end;
+		unsigned long firstCPU = strtoul(pos, &end, 10);
+		unsigned long lastCPU = firstCPU;
+		if (end == pos) break;
+		pos = end;
+		while (*pos == ' ') pos++;
+		if (*pos == '-') {
+			lastCPU = strtoul(pos + 1, &end, 10);
+			if (end == pos + 1) break;
+			pos = end;
+			while (*pos == ' ') pos++;
+		}
+		for (unsigned long cpu = firstCPU; cpu <= lastCPU && cpu < maxCPUCount; cpu++) {
+			mask |= DWORD_PTR(1) << cpu;
+		}
+		if (*pos != ',') break;
+		pos++;
+	}
+	return mask;
+}
+
+// The MMCSS API is resolved dynamically, since avrt.dll is missing before Windows Vista
+static FARPROC GetAvrtFunction(const char *name) {
+	HMODULE avrtModule = GetModuleHandleA("avrt.dll");
+	if (avrtModule == NULL) avrtModule = LoadLibraryA("avrt.dll");
+	return avrtModule == NULL ? NULL : GetProcAddress(avrtModule, name);
+}
+
+// Called at the beginning of the rendering thread. Returns the MMCSS task handle to revert on exit, or NULL
+HANDLE MidiSynth::ApplyRenderingThreadPolicy() {
+	if (renderingThreadAffinityMask != 0 && SetThreadAffinityMask(GetCurrentThread(), renderingThreadAffinityMask) == 0) {
+		std::cout << "MT32: Failed to set rendering thread affinity, error: " << GetLastError() << std::endl;
+	}
+	if (!renderingThreadMMCSS) return NULL;
+	AvSetMmThreadCharacteristicsFunction avSetMmThreadCharacteristics = (AvSetMmThreadCharacteristicsFunction)GetAvrtFunction("AvSetMmThreadCharacteristicsW");
+	DWORD taskIndex = 0;
+	HANDLE hMmcssTask = avSetMmThreadCharacteristics == NULL ? NULL : avSetMmThreadCharacteristics(L"Pro Audio", &taskIndex);
+	if (hMmcssTask == NULL) {
+		std::cout << "MT32: Failed to register rendering thread with MMCSS" << std::endl;
+	}
+	return hMmcssTask;
+}
+
+void MidiSynth::RevertRenderingThreadPolicy(HANDLE hMmcssTask) {
+	if (hMmcssTask == NULL) return;
+	AvRevertMmThreadCharacteristicsFunction avRevertMmThreadCharacteristics = (AvRevertMmThreadCharacteristicsFunction)GetAvrtFunction("AvRevertMmThreadCharacteristics");
+	if (avRevertMmThreadCharacteristics != NULL) avRevertMmThreadCharacteristics(hMmcssTask);
+}
+
 unsigned int MidiSynth::MillisToFrames(unsigned int millis) {
 	return UINT(sampleRate * millis / 1000.0f);
 }
@@ -410,7 +761,7 @@ void MidiSynth::LoadWaveOutSettings() {
 		hReg = NULL;
 	}
 	HKEY hRegDriver;
-	const char *driverKey = (settingsVersion == 1) ? MT32EMU_REGISTRY_DRIVER_SUBKEY_V1 : MT32EMU_REGISTRY_DRIVER_SUBKEY_V2;
+	const char *driverKey = (settingsVersion == 1) ? MT32EMU_REGISTRY_DRIVER_SUBKEY_V1 : useWASAPI ? MT32EMU_REGISTRY_WASAPI_DRIVER_SUBKEY : MT32EMU_REGISTRY_DRIVER_SUBKEY_V2;
 	if (hReg == NULL || RegOpenKeyA(hReg, driverKey, &hRegDriver)) {
 		hRegDriver = NULL;
 	}
@@ -422,8 +773,16 @@ void MidiSynth::LoadWaveOutSettings() {
 	chunkSize = MillisToFrames(LoadIntValue(hRegDriver, "ChunkLen", 10));
 	midiLatency = MillisToFrames(LoadIntValue(hRegDriver, "MidiLatency", 0));
 	useRingBuffer = LoadBoolValue(hRegDriver, "UseRingBuffer", false);
+	// Same hidden settings as used by mt32emu-qt for its rendering threads
+	char cpuList[256];
+	LoadStringValue(hRegDriver, "ThreadCPUs", "", cpuList, sizeof(cpuList));
+	renderingThreadAffinityMask = ParseCPUList(cpuList);
+	renderingThreadMMCSS = LoadBoolValue(hRegDriver, "ThreadMMCSS", false);
 	RegCloseKey(hRegDriver);
-	if (useRingBuffer) {
+	if (useWASAPI) {
+		// The actual buffer size is only known once the audio client is initialised
+		std::cout << "MT32: Using WASAPI, requested buffer size: " << bufferSize << " frames, chunk size: " << chunkSize << " frames." << std::endl;
+	} else if (useRingBuffer) {
 		std::cout << "MT32: Using looped ring buffer, buffer size: " << bufferSize << " frames, min. rendering interval: " << chunkSize <<" frames." << std::endl;
 	} else {
 		// Number of chunks should be ceil(bufferSize / chunkSize)
@@ -432,8 +791,6 @@ void MidiSynth::LoadWaveOutSettings() {
 		bufferSize = chunks * chunkSize;
 		std::cout << "MT32: Using " << chunks << " chunks, chunk size: " << chunkSize << " frames, buffer size: " << bufferSize << " frames." << std::endl;
 	}
-	// Default MIDI latency equals the audio buffer length
-	if ((settingsVersion == 1) || (midiLatency == 0)) midiLatency += bufferSize;
 }
 
 void MidiSynth::ReloadSettings() {
@@ -448,6 +805,12 @@ void MidiSynth::ReloadSettings() {
 	settingsVersion = LoadIntValue(hRegMaster, "settingsVersion", 1);
 	resetEnabled = !LoadBoolValue(hRegMaster, "startPinnedSynthRoute", false);
 	LoadStringValue(hRegMaster, "defaultAudioDevice", "", audioDeviceName, sizeof(audioDeviceName));
+	if (synth == NULL) {
+		// The output can't be switched on reset
+		char audioDriverId[32];
+		LoadStringValue(hRegMaster, "defaultAudioDriver", "waveout", audioDriverId, sizeof(audioDriverId));
+		useWASAPI = settingsVersion != 1 && !lstrcmpiA(audioDriverId, "wasapi");
+	}
 	char profile[256];
 	LoadStringValue(hRegMaster, "defaultSynthProfile", "default", profile, sizeof(profile));
 	RegCloseKey(hRegMaster);
@@ -568,6 +931,8 @@ int MidiSynth::Init() {
 		return 1;
 	}
 	synth = new Synth(&reportHandler);
+	// MIDI messages are enqueued directly from the threads of the client applications
+	synth->configureMIDIEventQueueMultiProducer(true);
 	synth->selectRendererType(rendererType);
 	if (!synth->open(*controlROM, *pcmROM, partialCount, analogOutputMode)) {
 		synth->close();
@@ -577,17 +942,40 @@ int MidiSynth::Init() {
 	sampleRate = synth->getStereoOutputSampleRate();
 	sampleRateRatio = SAMPLE_RATE / (double)sampleRate;
 	LoadWaveOutSettings();
-	buffer = new Bit16s[SAMPLES_PER_FRAME * bufferSize];
+	buffer = NULL;
 
 	ApplySettings();
 	FreeROMImages();
 
+	QueryPerformanceFrequency(&counterFrequency);
+	renderedFramesCount = 0;
+	playbackSnapshotChangeCount = 0;
+	UpdatePlaybackSnapshot(0);
+
+	if (useWASAPI) {
+		// The rendering thread pre-fills the endpoint buffer
+		if (wasapi.Init(bufferSize, chunkSize, sampleRate, audioDeviceName) == 0) {
+			bufferSize = wasapi.GetLatencyFrames();
+			// Default MIDI latency equals the audio buffer length
+			if (midiLatency == 0) midiLatency = bufferSize;
+			return 0;
+		}
+		// WASAPI is unavailable prior to Windows Vista, or the device rejected the format
+		std::cout << "MT32: Failed to initialise WASAPI output, falling back to WaveOut" << std::endl;
+		useWASAPI = false;
+		LoadWaveOutSettings();
+	}
+	// Default MIDI latency equals the audio buffer length
+	if ((settingsVersion == 1) || (midiLatency == 0)) midiLatency += bufferSize;
+	buffer = new Bit16s[SAMPLES_PER_FRAME * bufferSize];
+
 	UINT wResult = waveOut.Init(buffer, bufferSize, chunkSize, useRingBuffer, sampleRate, audioDeviceName);
 	if (wResult) return wResult;
 
 	// Start playing stream
 	synth->render(buffer, bufferSize);
 	renderedFramesCount = bufferSize;
+	UpdatePlaybackSnapshot(0);
 
 	wResult = waveOut.Start();
 	return wResult;
@@ -602,7 +990,7 @@ int MidiSynth::Reset() {
 		return 0;
 	}
 
-	UINT wResult = waveOut.Pause();
+	UINT wResult = useWASAPI ? wasapi.Pause() : waveOut.Pause();
 	if (wResult) return wResult;
 
 	synthEvent.Wait();
@@ -618,22 +1006,56 @@ int MidiSynth::Reset() {
 	FreeROMImages();
 	synthEvent.Release();
 
-	wResult = waveOut.Resume();
+	wResult = useWASAPI ? wasapi.Resume() : waveOut.Resume();
 	return wResult;
 }
 
-Bit32u MidiSynth::getMIDIEventTimestamp() {
-	// Taking a snapshot to avoid interference with the rendering thread
-	UINT64 renderedFramesCountSnapshot = renderedFramesCount;
-	Bit32u renderPosition = Bit32u(renderedFramesCountSnapshot % bufferSize);
+// Only invoked from the rendering thread, which makes it the sole user of the audio output position
+UINT64 MidiSynth::GetPlayedFramesCount() {
+	Bit32u renderPosition = Bit32u(renderedFramesCount % bufferSize);
 
 	// Using relative play position helps to keep correct timing after underruns
-	Bit32u playPosition = Bit32u(waveOut.GetPos() % bufferSize);
+	Bit32u playPosition = Bit32u((useWASAPI ? wasapi.GetPos() : waveOut.GetPos()) % bufferSize);
 	Bit32s bufferedFramesCount = renderPosition - playPosition;
 	if (bufferedFramesCount <= 0) {
 		bufferedFramesCount += bufferSize;
 	}
-	UINT64 playedFramesCount = renderedFramesCountSnapshot - bufferedFramesCount;
+	return renderedFramesCount - bufferedFramesCount;
+}
+
+// Publishes the current play position along with the performance counter value it corresponds to.
+// The two snapshots are written in turn, so that while the change count stays intact, it is safe to read
+// the snapshot with the index equal to the last bit of the change count.
+void MidiSynth::UpdatePlaybackSnapshot(UINT64 playedFramesCount) {
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	PlaybackSnapshot &snapshot = playbackSnapshots[(playbackSnapshotChangeCount + 1) & 1];
+	snapshot.playedFramesCount = playedFramesCount;
+	snapshot.renderedFramesCount = renderedFramesCount;
+	snapshot.counter = counter.QuadPart;
+	InterlockedIncrement(&playbackSnapshotChangeCount);
+}
+
+// Stamps a MIDI event at arrival. The play position is extrapolated from the last snapshot published
+// by the rendering thread using the performance counter, so that no call to the audio API is necessary
+// and the events are placed at the exact sample rather than at the rendering chunk boundaries.
+Bit32u MidiSynth::getMIDIEventTimestamp() {
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	PlaybackSnapshot snapshot;
+	for (;;) {
+		LONG changeCount = playbackSnapshotChangeCount;
+		MemoryBarrier();
+		snapshot = playbackSnapshots[changeCount & 1];
+		MemoryBarrier();
+		if (changeCount == playbackSnapshotChangeCount) break;
+	}
+	UINT64 playedFramesCount = snapshot.playedFramesCount;
+	if (counter.QuadPart > snapshot.counter) {
+		playedFramesCount += UINT64(double(counter.QuadPart - snapshot.counter) * sampleRate / counterFrequency.QuadPart);
+		// Playback can't go past the frames rendered, e.g. while the rendering thread is stalled
+		if (playedFramesCount > snapshot.renderedFramesCount) playedFramesCount = snapshot.renderedFramesCount;
+	}
 	// Estimated MIDI event timestamp in audio output samples
 	UINT64 timestamp = playedFramesCount + midiLatency;
 	return Bit32u(timestamp * sampleRateRatio);
@@ -663,8 +1085,12 @@ void MidiSynth::FreeROMImages() {
 }
 
 void MidiSynth::Close() {
-	waveOut.Pause();
-	waveOut.Close();
+	if (useWASAPI) {
+		wasapi.Close();
+	} else {
+		waveOut.Pause();
+		waveOut.Close();
+	}
 	synthEvent.Wait();
 	synth->close();
 
@@ -29,8 +29,11 @@ private:
 	unsigned int chunkSize;
 	unsigned int settingsVersion;
 	bool useRingBuffer;
+	bool useWASAPI;
 	bool resetEnabled;
-	char audioDeviceName[MAXPNAMELEN];
+	char audioDeviceName[256];
+	DWORD_PTR renderingThreadAffinityMask;
+	bool renderingThreadMMCSS;
 
 	DACInputMode emuDACInputMode;
 	MIDIDelayMode midiDelayMode;
@@ -52,6 +55,14 @@ private:
 	Bit16s *buffer;
 	volatile UINT64 renderedFramesCount;
 
+	struct PlaybackSnapshot {
+		UINT64 playedFramesCount;
+		UINT64 renderedFramesCount;
+		LONGLONG counter;
+	} playbackSnapshots[2];
+	volatile LONG playbackSnapshotChangeCount;
+	LARGE_INTEGER counterFrequency;
+
 	Synth *synth;
 	const ROMImage *controlROM;
 	const ROMImage *pcmROM;
@@ -60,6 +71,8 @@ private:
 	void LoadWaveOutSettings();
 	void ReloadSettings();
 	void ApplySettings();
+	UINT64 GetPlayedFramesCount();
+	void UpdatePlaybackSnapshot(UINT64 playedFramesCount);
 
 	MidiSynth();
 
@@ -74,6 +87,8 @@ public:
 	Bit32u getMIDIEventTimestamp();
 	void PlayMIDI(DWORD msg);
 	void PlaySysex(const Bit8u *bufpos, DWORD len);
+	HANDLE ApplyRenderingThreadPolicy();
+	void RevertRenderingThreadPolicy(HANDLE hMmcssTask);
 };
 
 }
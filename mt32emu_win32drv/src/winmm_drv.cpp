@@ -20,6 +20,18 @@
 #define MAX_DRIVERS 8
 #define MAX_CLIENTS 8 // Per driver
 
+// Version 2 of the protocol adds a shared-memory ring per client session, which mt32emu-qt creates upon handshake.
+// The MIDI messages are then written to the ring with no need to switch to mt32emu-qt synchronously.
+// The layout of the ring must match Win32Driver.cpp in mt32emu-qt.
+#define PROTOCOL_VERSION 2
+
+#define MIDI_RING_MAGIC 0x474E4952 // "RING"
+#define MIDI_RING_RECORD_SHORT_MESSAGE 1
+#define MIDI_RING_RECORD_SYSEX 2
+#define MIDI_RING_RECORD_WRAP 3
+// Milliseconds to wait for mt32emu-qt to make room in a full ring before giving up.
+#define MIDI_RING_FULL_TIMEOUT 500
+
 namespace {
 
 static bool hrTimerAvailable;
@@ -56,6 +68,143 @@ static bool synthOpened = false;
 static HWND hwnd = NULL;
 static int driverCount;
 
+struct MidiRingHeader {
+	DWORD magic;
+	// Size of the data area that follows the header, a multiple of 8.
+	DWORD dataSize;
+	// Offsets in the data area. The ring is empty when these are equal, so it never gets completely full.
+	// The write position is only advanced by the driver and the read position is only advanced by mt32emu-qt.
+	volatile LONG writePosition;
+	volatile LONG readPosition;
+};
+
+// Each record is aligned to 8 bytes, and the payload follows the header. The wrap record only consists of the type,
+// it marks that the next record is at the start of the data area.
+struct MidiRingRecordHeader {
+	DWORD type;
+	DWORD length;
+	DWORD timestampLow;
+	DWORD timestampHigh;
+};
+
+static inline DWORD getMidiRingRecordLength(DWORD payloadLength) {
+	return (sizeof(MidiRingRecordHeader) + payloadLength + 7) & ~7;
+}
+
+// Writes the MIDI messages of a client session to the ring created by mt32emu-qt, then wakes up its reading thread
+// when the ring was empty.
+class MidiRingWriter {
+public:
+	MidiRingWriter() : hMapping(NULL), hEvent(NULL), hHostProcess(NULL), header(NULL), data(NULL) {}
+
+	~MidiRingWriter() {
+		close();
+	}
+
+	bool open(DWORD synthInstance) {
+		WCHAR name[64];
+		wsprintfW(name, L"Local\\mt32emu_midi_ring_%08X", synthInstance);
+		hMapping = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name);
+		if (hMapping != NULL) header = (MidiRingHeader *)MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+		if (header == NULL || header->magic != MIDI_RING_MAGIC) {
+			close();
+			return false;
+		}
+		data = (BYTE *)(header + 1);
+		wsprintfW(name, L"Local\\mt32emu_midi_ring_event_%08X", synthInstance);
+		hEvent = OpenEventW(EVENT_MODIFY_STATE, FALSE, name);
+		// As the ring outlives mt32emu-qt while mapped here, its process is watched to tell when it terminates.
+		DWORD hostProcessId = 0;
+		GetWindowThreadProcessId(hwnd, &hostProcessId);
+		hHostProcess = OpenProcess(SYNCHRONIZE, FALSE, hostProcessId);
+		if (hEvent == NULL || hHostProcess == NULL) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+		if (header != NULL) UnmapViewOfFile(header);
+		if (hMapping != NULL) CloseHandle(hMapping);
+		if (hEvent != NULL) CloseHandle(hEvent);
+		if (hHostProcess != NULL) CloseHandle(hHostProcess);
+		hMapping = NULL;
+		hEvent = NULL;
+		hHostProcess = NULL;
+		header = NULL;
+		data = NULL;
+	}
+
+	bool isOpen() const {
+		return header != NULL;
+	}
+
+	// Messages that are too long to fit in the ring are sent the old way once it is drained.
+	bool canWrite(DWORD payloadLength) const {
+		return getMidiRingRecordLength(payloadLength) <= header->dataSize / 2;
+	}
+
+	// Returns false if mt32emu-qt is gone or does not drain the ring.
+	bool write(DWORD type, const void *payload, DWORD payloadLength, const LARGE_INTEGER &timestamp) {
+		const DWORD recordLength = getMidiRingRecordLength(payloadLength);
+		const DWORD waitStartTime = GetTickCount();
+		for (;;) {
+			if (WaitForSingleObject(hHostProcess, 0) != WAIT_TIMEOUT) return false;
+			const LONG writePosition = header->writePosition;
+			const LONG readPosition = InterlockedCompareExchange(&header->readPosition, 0, 0);
+			const LONG recordPosition = findRecordPosition(writePosition, readPosition, recordLength);
+			if (recordPosition >= 0) {
+				if (recordPosition != writePosition) ((MidiRingRecordHeader *)&data[writePosition])->type = MIDI_RING_RECORD_WRAP;
+				MidiRingRecordHeader *record = (MidiRingRecordHeader *)&data[recordPosition];
+				record->type = type;
+				record->length = payloadLength;
+				record->timestampLow = timestamp.LowPart;
+				record->timestampHigh = (DWORD)timestamp.HighPart;
+				memcpy(record + 1, payload, payloadLength);
+				LONG newWritePosition = recordPosition + recordLength;
+				if (DWORD(newWritePosition) == header->dataSize) newWritePosition = 0;
+				InterlockedExchange(&header->writePosition, newWritePosition);
+				// The read position is checked after publishing the record, so that the reader cannot go to sleep missing it.
+				if (InterlockedCompareExchange(&header->readPosition, 0, 0) == writePosition) SetEvent(hEvent);
+				return true;
+			}
+			if (GetTickCount() - waitStartTime > MIDI_RING_FULL_TIMEOUT) return false;
+			SetEvent(hEvent);
+			Sleep(1);
+		}
+	}
+
+	// Waits until mt32emu-qt reads all the records, returns false if it is gone or takes too long.
+	bool drain() {
+		const DWORD waitStartTime = GetTickCount();
+		while (InterlockedCompareExchange(&header->readPosition, 0, 0) != header->writePosition) {
+			if (WaitForSingleObject(hHostProcess, 0) != WAIT_TIMEOUT) return false;
+			if (GetTickCount() - waitStartTime > MIDI_RING_FULL_TIMEOUT) return false;
+			SetEvent(hEvent);
+			Sleep(1);
+		}
+		return true;
+	}
+
+private:
+	HANDLE hMapping;
+	HANDLE hEvent;
+	HANDLE hHostProcess;
+	MidiRingHeader *header;
+	BYTE *data;
+
+	// Returns the position to write a record of the given length at, or -1 if the ring is too full.
+	// When the position is not the current write position, the rest of the data area is skipped with a wrap record.
+	LONG findRecordPosition(LONG writePosition, LONG readPosition, DWORD recordLength) const {
+		const LONG dataSize = (LONG)header->dataSize;
+		const LONG length = (LONG)recordLength;
+		if (writePosition < readPosition) return writePosition + length < readPosition ? writePosition : -1;
+		if (writePosition + length < dataSize || (writePosition + length == dataSize && readPosition != 0)) return writePosition;
+		return length < readPosition ? 0 : -1;
+	}
+};
+
 struct Driver {
 	bool open;
 	int clientCount;
@@ -67,6 +216,7 @@ struct Driver {
 		DWORD_PTR callback;
 		DWORD synth_instance;
 		MidiStreamParser *midiStreamParser;
+		MidiRingWriter *midiRingWriter;
 	} clients[MAX_CLIENTS];
 } drivers[MAX_DRIVERS];
 
@@ -194,6 +344,17 @@ protected:
 	virtual void handleShortMessage(const Bit32u message) {
 		if (hwnd == NULL) {
 			midiSynth.PlayMIDI(message);
+		} else if (client.midiRingWriter->isOpen()) {
+			updateNanoCounter();
+			if (!client.midiRingWriter->write(MIDI_RING_RECORD_SHORT_MESSAGE, &message, sizeof(message), nanoCounter)) {
+				// Synth app was terminated or hung. Fall back to integrated synth
+				client.midiRingWriter->close();
+				hwnd = NULL;
+				if (midiSynth.Init() == 0) {
+					synthOpened = true;
+					midiSynth.PlayMIDI(message);
+				}
+			}
 		} else {
 			updateNanoCounter();
 			DWORD msg[] = { 0, 0, nanoCounter.LowPart, (DWORD)nanoCounter.HighPart, message }; // 0, short MIDI message indicator, timestamp, data
@@ -213,7 +374,20 @@ protected:
 	virtual void handleSysex(const Bit8u stream[], const Bit32u length) {
 		if (hwnd == NULL) {
 			midiSynth.PlaySysex(stream, length);
+		} else if (client.midiRingWriter->isOpen() && client.midiRingWriter->canWrite(length)) {
+			updateNanoCounter();
+			if (!client.midiRingWriter->write(MIDI_RING_RECORD_SYSEX, stream, length, nanoCounter)) {
+				// Synth app was terminated or hung. Fall back to integrated synth
+				client.midiRingWriter->close();
+				hwnd = NULL;
+				if (midiSynth.Init() == 0) {
+					synthOpened = true;
+					midiSynth.PlaySysex(stream, length);
+				}
+			}
 		} else {
+			// The preceding messages in the ring must be played first.
+			if (client.midiRingWriter->isOpen()) client.midiRingWriter->drain();
 			COPYDATASTRUCT cds = { client.synth_instance, length, (PVOID)stream };
 			LRESULT res = SendMessage(hwnd, WM_COPYDATA, NULL, (LPARAM)&cds);
 			if (res != 1) {
@@ -266,7 +440,7 @@ STDAPI_(DWORD) modMessage(DWORD uDeviceID, DWORD uMsg, DWORD_PTR dwUser, DWORD_P
 					synthOpened = false;
 				}
 				updateNanoCounter();
-				DWORD msg[70] = { 0, (DWORD)-1, 1, nanoCounter.LowPart, (DWORD)nanoCounter.HighPart }; // 0, handshake indicator, version, timestamp, .exe filename of calling application
+				DWORD msg[70] = { 0, (DWORD)-1, PROTOCOL_VERSION, nanoCounter.LowPart, (DWORD)nanoCounter.HighPart }; // 0, handshake indicator, version, timestamp, .exe filename of calling application
 				GetModuleFileNameA(GetModuleHandle(NULL), (char *)&msg[5], 255);
 				COPYDATASTRUCT cds = { 0, sizeof(msg), msg };
 				instance = (DWORD)SendMessage(hwnd, WM_COPYDATA, NULL, (LPARAM)&cds);
@@ -282,6 +456,9 @@ STDAPI_(DWORD) modMessage(DWORD uDeviceID, DWORD uMsg, DWORD_PTR dwUser, DWORD_P
 		Driver::Client &client = driver.clients[*(LONG *)dwUser];
 		client.synth_instance = instance;
 		client.midiStreamParser = new MidiStreamParserImpl(client);
+		client.midiRingWriter = new MidiRingWriter;
+		// Older versions of mt32emu-qt create no ring, then the messages are sent synchronously.
+		if (instance != 0) client.midiRingWriter->open(instance);
 		return res;
 	}
 
@@ -292,9 +469,12 @@ STDAPI_(DWORD) modMessage(DWORD uDeviceID, DWORD uMsg, DWORD_PTR dwUser, DWORD_P
 		if (hwnd == NULL) {
 			if (synthOpened) midiSynth.Reset();
 		} else {
+			// mt32emu-qt plays the records left in the ring before ending the session.
+			driver.clients[dwUser].midiRingWriter->close();
 			SendMessage(hwnd, WM_APP, driver.clients[dwUser].synth_instance, NULL); // end of session message
 		}
 		delete driver.clients[dwUser].midiStreamParser;
+		delete driver.clients[dwUser].midiRingWriter;
 		return CloseDriver(driver, uDeviceID, uMsg, dwUser, dwParam1, dwParam2);
 
 	case MODM_GETNUMDEVS: